@@ -40,7 +40,8 @@ using namespace Memory;
 BusInterconnect::BusInterconnect(const char *name,
 		MemoryHierarchy *memoryHierarchy) :
 	Interconnect(name,memoryHierarchy),
-	busBusy_(false)
+	busBusy_(false),
+	new_stats(name, &memoryHierarchy->get_machine())
 {
     memoryHierarchy_->add_interconnect(this);
 
@@ -155,6 +156,28 @@ BusQueueEntry* BusInterconnect::arbitrate_round_robin()
 	else
 		i = 0;
 
+	/* Most urgent queue head, round robin among the equally urgent */
+	if(priority_scheduling) {
+		BusQueueEntry *best = NULL;
+		foreach(n, controllers.count()) {
+			i = (i + 1) % controllers.count();
+			controllerQueue = controllers[i];
+			if(controllerQueue->queue.count() == 0)
+				continue;
+
+			BusQueueEntry *queueEntry = (BusQueueEntry*)
+				controllerQueue->queue.peek();
+			assert(queueEntry);
+			assert(!queueEntry->annuled);
+			if(!best || more_urgent(queueEntry->request, best->request))
+				best = queueEntry;
+		}
+
+		if(best)
+			lastAccessQueue = best->controllerQueue;
+		return best;
+	}
+
 	do {
 		i = (i + 1) % controllers.count();
 		controllerQueue = controllers[i];
@@ -188,16 +211,26 @@ bool BusInterconnect::broadcast_cb(void *arg)
 		return true;
 	}
 
+	/* Wrong path request, arbitrate again once the hierarchy dropped it */
+	if unlikely (memoryHierarchy_->drop_annuled(queueEntry->request)) {
+		marss_add_event(&broadcast_, 1, NULL);
+		return true;
+	}
+
 	// first check if any of the other controller's receive queue is
 	// full or not
 	// if its full the don't broadcast untill it has a free
 	// entry and  pass the queue entry as argument to the broadcast
 	// signal so next time it doesn't need to arbitrate
+	// slices of a banked cache that don't hold the line are skipped
 	bool isFull = false;
+	W64 address = queueEntry->request->get_physical_address();
 	foreach(i, controllers.count()) {
 		if(controllers[i]->controller ==
 				queueEntry->controllerQueue->controller)
 			continue;
+		if(!controllers[i]->controller->owns_line(address))
+			continue;
 		isFull |= controllers[i]->controller->is_full(true);
 	}
 	if(isFull) {
@@ -216,7 +249,8 @@ bool BusInterconnect::broadcast_cb(void *arg)
 	Controller *controller = queueEntry->controllerQueue->controller;
 
 	foreach(i, controllers.count()) {
-		if(controller != controllers[i]->controller) {
+		if(controller != controllers[i]->controller &&
+				controllers[i]->controller->owns_line(address)) {
 			bool ret = controllers[i]->controller->
 				get_interconnect_signal()->emit(&message);
 			assert(ret);
@@ -230,6 +264,7 @@ bool BusInterconnect::broadcast_cb(void *arg)
 	if(!queueEntry->controllerQueue->queue.isFull()) {
 		memoryHierarchy_->set_interconnect_full(this, false);
 	}
+	new_stats.record(latency_, queueEntry->request->is_kernel());
 	queueEntry->request->decRefCounter();
 	marss_add_event(&broadcastCompleted_,
 			latency_, NULL);
@@ -85,6 +85,8 @@ class BusInterconnect : public Interconnect
         int latency_;
         int arbitrate_latency_;
 
+        LinkStats new_stats;
+
 		BusQueueEntry *arbitrate_round_robin();
 
 	public:
@@ -41,12 +41,50 @@ namespace Memory{
 		MAIN_MEMORY
 	};
 
-	const int REQUEST_POOL_SIZE = 1024;
-	const double REQUEST_POOL_LOW_RATIO = 0.1;
+	/*
+	 * Priorities of memory requests, most urgent first. Writebacks are
+	 * always PRIORITY_WRITEBACK, the core sets the others (see
+	 * MemoryRequest::set_priority); with -mem-priority controllers and
+	 * buses serve the most urgent waiting request first, then the oldest.
+	 */
+	enum RequestPriority {
+		PRIORITY_CRITICAL,  /* Load that blocks commit at the ROB head */
+		PRIORITY_DEMAND,    /* Other loads and instruction fetches */
+		PRIORITY_STORE,
+		PRIORITY_PREFETCH,
+		PRIORITY_WRITEBACK,
+		NUM_PRIORITIES
+	};
+
+	static const char* request_priority_names[NUM_PRIORITIES] = {
+		"critical",
+		"demand",
+		"store",
+		"prefetch",
+		"writeback",
+	};
+
+	/* Requests allocated each time a RequestPool runs out */
+	const int REQUEST_POOL_SLAB_SIZE = 1024;
+
+	/* Bytes of history text kept for each memory request */
+	const int REQUEST_HISTORY_SIZE = 256;
 
 	/* CPU Controller */
 	const int CPU_CONT_PENDING_REQ_SIZE = 128;
 	const int CPU_CONT_ICACHE_BUF_SIZE = 32;
+	/* Same line requests merged into one pending request */
+	const int CPU_CONT_MSHR_TARGETS = 8;
+	/* Sets of the line index of pending requests, a power of two */
+	const int CPU_CONT_MSHR_SETS = 64;
+
+	/*
+	 * Banks of one cache (its 'banks' option, see CachePorts). A fast path
+	 * access of a cache hit whose bank has no port left this cycle returns
+	 * CACHE_BANK_CONFLICT instead of a latency.
+	 */
+	const int CACHE_MAX_BANKS = 32;
+	const int CACHE_BANK_CONFLICT = -2;
 
 	/*
 	 * Main memory outstanding queue size
@@ -61,6 +99,17 @@ namespace Memory{
 	 */
 	const int MEM_BANKS = 64;
 
+	/*
+	 * Memory hierarchy event wheel
+	 * EVENT_WHEEL_SIZE must be a power of 2, events delayed by more cycles
+	 * are kept in a sorted overflow list
+	 */
+	const int EVENT_WHEEL_SIZE = 1024;
+	const int EVENT_POOL_SLAB_SIZE = 2048;
+
+	/* Messages allocated each time the message pool runs out */
+	const int MESSAGE_POOL_SLAB_SIZE = 256;
+
 	/* Average wait dealy for retrying (general) */
 	const int AVG_WAIT_DELAY = 5;
 }
@@ -56,23 +56,55 @@ CacheController::CacheController(W8 coreid, const char *name,
 	, type_(type)
 	, isLowestPrivate_(false)
     , wt_disabled_(true)
-	, prefetchEnabled_(false)
+	, prefetcher_(NULL)
+	, prefetchStats_(NULL)
 	, prefetchDelay_(1)
+	, stackDistance_(NULL)
     , new_stats(name, &memoryHierarchy->get_machine())
 {
     memoryHierarchy_->add_cache_mem_controller(this);
 
     cacheLines_ = get_cachelines(type);
+    cacheLines_->register_stats(&new_stats);
+    qos_setup_cache(memoryHierarchy_->get_machine(), name, cacheLines_);
+
+    int banks = 1;
+    int bankBytes = 8;
+    int bankPorts = 1;
+    memoryHierarchy_->get_machine().get_option(name, "banks", banks);
+    memoryHierarchy_->get_machine().get_option(name, "bank_bytes", bankBytes);
+    memoryHierarchy_->get_machine().get_option(name, "bank_ports", bankPorts);
+    if(!cacheLines_->ports().set_banks(banks, bankBytes, bankPorts)) {
+        ptl_logfile << "ERROR: ", name, " needs a power of 2 banks of at ",
+                    "most ", CACHE_MAX_BANKS, ", a power of 2 bank_bytes ",
+                    "and bank_ports > 0", endl;
+        assert(0);
+    }
 
     if(!memoryHierarchy_->get_machine().get_option(name, "last_private", isLowestPrivate_)) {
         isLowestPrivate_ = false;
     }
 
+    slice_.setup(memoryHierarchy_->get_machine(), name, coreid);
+
     cacheLineBits_ = cacheLines_->get_line_bits();
     cacheAccessLatency_ = cacheLines_->get_access_latency();
 
 	cacheLines_->init();
 
+    stackDistance_ = stack_distance_create(memoryHierarchy_->get_machine(),
+            name, cacheLines_->get_set_count(), cacheLineBits_, &new_stats);
+
+    /* Stats exist with any 'prefetcher', even 'none', so an override at
+     * run time can turn one on */
+    stringbuf prefetcher;
+    if (memoryHierarchy_->get_machine().get_option(name, "prefetcher",
+                prefetcher)) {
+        prefetchStats_ = new PrefetchStats("prefetch", &new_stats);
+    }
+
+    config_changed();
+
     SET_SIGNAL_CB(name, "_Cache_Hit", cacheHit_, &CacheController::cache_hit_cb);
 
     SET_SIGNAL_CB(name, "_Cache_Miss", cacheMiss_, &CacheController::cache_miss_cb);
@@ -104,45 +136,88 @@ CacheController::CacheController(W8 coreid, const char *name,
         type_ = L1_I_CACHE;
     else if (( strstr(get_name(), "L1_D") !=NULL) )
         type_ = L1_D_CACHE;
+
+    level_ = type_;
 }
 
 CacheController::~CacheController()
 {
+    delete prefetcher_;
+    delete prefetchStats_;
+}
+
+/**
+ * @brief Re-read latency, replacement and prefetch options
+ *
+ * 'latency' in cache cycles overrides the LATENCY param. 'replacement'
+ * switches between policies that keep the same state, see
+ * replacement.h. A changed 'prefetcher' starts a new, untrained one.
+ */
+void CacheController::config_changed()
+{
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    if (!machine.get_option(get_name(), "latency", cacheAccessLatency_))
+        cacheAccessLatency_ = cacheLines_->get_access_latency();
+
+    stringbuf replacement;
+    if (machine.get_option(get_name(), "replacement", replacement) &&
+            !cacheLines_->set_replacement(replacement)) {
+        ptl_logfile << "ERROR: " << get_name() << " can't switch to " <<
+            "replacement '" << replacement << "'" << endl;
+        assert(0);
+    }
+
+    stringbuf prefetcher;
+    machine.get_option(get_name(), "prefetcher", prefetcher);
+    if (prefetcher != prefetcherType_) {
+        if (!prefetchStats_) {
+            ptl_logfile << "ERROR: " << get_name() << " needs a " <<
+                "'prefetcher' option in the machine config to change it" <<
+                endl;
+            assert(0);
+        }
+
+        delete prefetcher_;
+        prefetcher_ = PrefetcherBuilder::create(get_name(), machine,
+                cacheLineBits_);
+        prefetcherType_ = prefetcher;
+    }
+
+    if (!machine.get_option(get_name(), "prefetch_delay", prefetchDelay_))
+        prefetchDelay_ = 1;
 }
 
 CacheQueueEntry* CacheController::find_dependency(MemoryRequest *request)
 {
 	W64 requestLineAddress = get_line_address(request);
 
-	CacheQueueEntry* queueEntry;
-	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry,
-			prevEntry) {
+	CacheQueueEntry* queueEntry = pendingRequests_.first(requestLineAddress);
+	for(; queueEntry; queueEntry = pendingRequests_.next(queueEntry)) {
 
 		if(request == queueEntry->request || queueEntry->annuled)
 			continue;
 
-		if(get_line_address(queueEntry->request) == requestLineAddress) {
-			// Found an entry with same line address, check if other
-			// entry also depends on this entry or not and to
-			// maintain a chain of dependent entries, return the
-			// last entry in the chain
-			while(queueEntry->depends >= 0) {
-                if(pendingRequests_[queueEntry->depends].annuled)
-                    break;
-				queueEntry = &pendingRequests_[queueEntry->depends];
-            }
-
-			return queueEntry;
+		// Found an entry with same line address, check if other
+		// entry also depends on this entry or not and to
+		// maintain a chain of dependent entries, return the
+		// last entry in the chain
+		while(queueEntry->depends >= 0) {
+			if(pendingRequests_[queueEntry->depends].annuled)
+				break;
+			queueEntry = &pendingRequests_[queueEntry->depends];
 		}
+
+		return queueEntry;
 	}
 	return NULL;
 }
 
 CacheQueueEntry* CacheController::find_match(MemoryRequest *request)
 {
-	CacheQueueEntry* queueEntry;
-	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry,
-			prevEntry) {
+	CacheQueueEntry* queueEntry = pendingRequests_.first(
+			get_line_address(request));
+	for(; queueEntry; queueEntry = pendingRequests_.next(queueEntry)) {
 		if(request == queueEntry->request)
 			return queueEntry;
 	}
@@ -176,8 +251,9 @@ bool CacheController::handle_interconnect_cb(void *arg)
 		 * return false to indicate that this controller
 		 * can't accept new request at now
          */
-		if(is_full(true)) {
+		if(is_full(true, msg->request)) {
 			memdebug(get_name() << "Controller queue is full\n");
+			ptltrace(traceId_, TRACE_CACHE_QUEUE_FULL);
 			return false;
 		}
 
@@ -185,6 +261,7 @@ bool CacheController::handle_interconnect_cb(void *arg)
 				" Received message from upper interconnect\n");
 
 		CacheQueueEntry *queueEntry = pendingRequests_.alloc();
+		update_queue_occupancy();
 
 		/* set full flag if buffer is full */
 		if(pendingRequests_.isFull()) {
@@ -196,6 +273,7 @@ bool CacheController::handle_interconnect_cb(void *arg)
 		}
 
 		queueEntry->request = msg->request;
+		pendingRequests_.index(queueEntry, get_line_address(msg->request));
 		queueEntry->sender = sender;
 		queueEntry->source = (Controller*)msg->origin;
 		queueEntry->dest = (Controller*)msg->dest;
@@ -224,11 +302,18 @@ bool CacheController::handle_interconnect_cb(void *arg)
 		/* Check dependency and access the cache */
 		CacheQueueEntry* dependsOn = find_dependency(msg->request);
 
+		if(dependsOn && prefetcher_)
+			check_late_prefetch(msg->request);
+
 		if(dependsOn) {
 			/* Found an dependency */
 			memdebug("dependent entry: " << *dependsOn << endl);
+			ptltrace(traceId_, TRACE_CACHE_DEPENDENCY,
+					dependsOn->request->get_physical_address(),
+					dependsOn->request->get_coreid());
 			dependsOn->depends = queueEntry->idx;
 			dependsOn->dependsAddr = queueEntry->request->get_physical_address();
+			dependsOn->request->inherit_priority(msg->request);
 			OP_TYPE type = queueEntry->request->get_type();
             bool kernel_req = queueEntry->request->is_kernel();
 			if(type == MEMORY_OP_READ) {
@@ -304,6 +389,7 @@ bool CacheController::handle_interconnect_cb(void *arg)
 					}
 
 					CacheQueueEntry *newEntry = pendingRequests_.alloc();
+					update_queue_occupancy();
 					assert(newEntry);
 					/* set full flag if buffer is full */
 					if(pendingRequests_.isFull()) {
@@ -311,6 +397,8 @@ bool CacheController::handle_interconnect_cb(void *arg)
 					}
 
 					newEntry->request = msg->request;
+					pendingRequests_.index(newEntry,
+							get_line_address(msg->request));
 					newEntry->sender = sender;
 					newEntry->source = (Controller*)msg->origin;
 					newEntry->dest = (Controller*)msg->dest;
@@ -362,14 +450,19 @@ int CacheController::access_fast_path(Interconnect *interconnect,
 		MemoryRequest *request)
 {
 	memdebug("Accessing Cache " << get_name() << " : Request: " << *request << endl);
-	bool hit = false;
+	ptltrace(traceId_, TRACE_CACHE_ACCESS, request->get_physical_address(),
+			request->get_owner_rip(), request->get_coreid(),
+			request->get_type());
+	CacheLine *line = NULL;
 
     if (find_dependency(request) != NULL) {
         return -1;
     }
 
     if (request->get_type() != MEMORY_OP_WRITE)
-        hit = cacheLines_->probe(request);
+        line = cacheLines_->probe(request);
+
+    bool hit = (line != NULL);
 
 	// TESTING
     //	hit = true;
@@ -379,14 +472,87 @@ int CacheController::access_fast_path(Interconnect *interconnect,
      * level cache has to be updated
      */
 	if(hit && request->get_type() != MEMORY_OP_WRITE) {
+        if(!cacheLines_->ports().get_bank_port(request)) {
+            N_STAT_UPDATE(new_stats.cpurequest.stall.read.bank_conflict, ++,
+                    request->is_kernel());
+            return CACHE_BANK_CONFLICT;
+        }
+
         N_STAT_UPDATE(new_stats.cpurequest.count.hit.read.hit, ++,
                 request->is_kernel());
-		return cacheLines_->latency();
+
+        if(prefetcher_) {
+            bool prefetchHit = line->prefetched;
+            if(prefetchHit) {
+                line->prefetched = 0;
+                N_STAT_UPDATE(prefetchStats_->useful, ++,
+                        request->is_kernel());
+            }
+            train_prefetcher(request, false, prefetchHit);
+        }
+
+		return cacheAccessLatency_;
 	}
 
 	return -1;
 }
 
+/**
+ * @brief Install a line for functional warmup
+ *
+ * @param request Request with address of the line
+ *
+ * @return true if line is already present
+ */
+bool CacheController::warm_line(MemoryRequest *request)
+{
+	if(cacheLines_->probe(request))
+		return true;
+
+	/* Warmed lines are clean so victim is dropped silently */
+	W64 oldTag = InvalidTag<W64>::INVALID;
+	CacheLine *line = cacheLines_->insert(request, oldTag);
+
+	line->state = LINE_VALID;
+	line->init(get_line_tag(request));
+	line->prefetched = 0;
+
+	return false;
+}
+
+/**
+ * @brief Save or load the valid lines of this cache
+ */
+void CacheController::transfer_warm_state(WarmState &state)
+{
+	cacheLines_->transfer_warm_state(state);
+}
+
+/**
+ * @brief Drop the lines of a range of memory written outside simulation
+ *
+ * @return Number of lines dropped
+ */
+int CacheController::invalidate_lines(W64 physaddr, W64 size)
+{
+	MemoryRequest request;
+	request.set_coreid(0);
+
+	int lineSize = cacheLines_->get_line_size();
+	int count = 0;
+
+	for(W64 addr = physaddr; addr < physaddr + size; addr += lineSize) {
+		request.set_physical_address(addr);
+		if(!cacheLines_->probe(&request))
+			continue;
+
+		cacheLines_->invalidate(&request);
+		count++;
+	}
+
+	return count;
+}
+
 void CacheController::register_interconnect(Interconnect *interconnect,
         int type)
 {
@@ -431,8 +597,14 @@ bool CacheController::cache_hit_cb(void *arg)
 	queueEntry->eventFlags[CACHE_HIT_EVENT]--;
 	memdebug("Cache: " << get_name() << " cache_hit_cb entry: " <<
 			*queueEntry << endl);
+	ptltrace(traceId_, TRACE_CACHE_HIT,
+			queueEntry->request->get_physical_address(),
+			queueEntry->request->get_coreid());
 
 	if(queueEntry->prefetch) {
+		/* Line was already in cache */
+		N_STAT_UPDATE(prefetchStats_->redundant, ++,
+				queueEntry->request->is_kernel());
 		clear_entry_cb(queueEntry);
 	} else if(queueEntry->sender == upperInterconnect_ ||
 			queueEntry->sender == upperInterconnect2_) {
@@ -459,6 +631,14 @@ bool CacheController::cache_miss_cb(void *arg)
 		return true;
 
 	queueEntry->eventFlags[CACHE_MISS_EVENT]--;
+	ptltrace(traceId_, TRACE_CACHE_MISS,
+			queueEntry->request->get_physical_address(),
+			queueEntry->request->get_coreid());
+
+	if(queueEntry->prefetch) {
+		N_STAT_UPDATE(prefetchStats_->issued, ++,
+				queueEntry->request->is_kernel());
+	}
 
 	queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
 	queueEntry->sendTo = lowerInterconnect_;
@@ -496,11 +676,25 @@ bool CacheController::cache_insert_cb(void *arg)
             if(wt_disabled_ && line->state == LINE_MODIFIED) {
                 send_update_message(queueEntry, oldTag);
 			}
+
+            if(line->prefetched) {
+                N_STAT_UPDATE(prefetchStats_->useless, ++,
+                        queueEntry->request->is_kernel());
+            }
 		}
 
+        /* Compressed lines evict more than one line to make room */
+        W64 victimTag;
+        W8 victimState;
+        while(cacheLines_->pop_victim(victimTag, victimState)) {
+            if(wt_disabled_ && victimState == LINE_MODIFIED)
+                send_update_message(queueEntry, victimTag);
+        }
+
         line->state = LINE_VALID;
-        line->init(cacheLines_->tagOf(queueEntry->request->
-                    get_physical_address()));
+        line->init(get_line_tag(queueEntry->request));
+        line->prefetched = queueEntry->prefetch &&
+            !queueEntry->prefetchDemanded;
 
 		queueEntry->eventFlags[CACHE_INSERT_COMPLETE_EVENT]++;
 		marss_add_event(&cacheInsertComplete_,
@@ -536,6 +730,13 @@ bool CacheController::cache_access_cb(void *arg)
 	if(queueEntry->annuled)
 		return true;
 
+	/* Wrong path request, the hierarchy drops this entry */
+	if unlikely (memoryHierarchy_->drop_annuled(queueEntry->request)) {
+		N_STAT_UPDATE(new_stats.annul, ++,
+				queueEntry->request->is_kernel());
+		return true;
+	}
+
 	queueEntry->eventFlags[CACHE_ACCESS_EVENT]--;
 
 	if(cacheLines_->get_port(queueEntry->request)) {
@@ -550,14 +751,22 @@ bool CacheController::cache_access_cb(void *arg)
 		bool kernel_req = queueEntry->request->is_kernel();
 		Signal *signal = NULL;
 		int delay;
+
+		if(stackDistance_ && !queueEntry->prefetch &&
+				(type == MEMORY_OP_READ || type == MEMORY_OP_WRITE))
+			stackDistance_->access(
+					queueEntry->request->get_physical_address());
+
 		if(hit) {
 			if(type == MEMORY_OP_READ ||
 					type == MEMORY_OP_WRITE) {
 				signal = &cacheHit_;
-				delay = cacheAccessLatency_;
+				delay = cacheAccessLatency_ + cacheLines_->hit_latency(line);
 				queueEntry->eventFlags[CACHE_HIT_EVENT]++;
 
-				if(type == MEMORY_OP_READ) {
+				if(queueEntry->prefetch) {
+					/* Prefetches are not demand accesses */
+				} else if(type == MEMORY_OP_READ) {
 					N_STAT_UPDATE(new_stats.cpurequest.count.hit.read.hit, ++,
 							kernel_req);
 				} else if(type == MEMORY_OP_WRITE) {
@@ -565,6 +774,17 @@ bool CacheController::cache_access_cb(void *arg)
 							kernel_req);
 				}
 
+				if(prefetcher_ && !queueEntry->prefetch) {
+					bool prefetchHit = line->prefetched;
+					if(prefetchHit) {
+						line->prefetched = 0;
+						N_STAT_UPDATE(prefetchStats_->useful, ++,
+								kernel_req);
+					}
+					train_prefetcher(queueEntry->request, false,
+							prefetchHit);
+				}
+
                 /*
                  * Create a new memory request with
                  * opration type MEMORY_OP_UPDATE and
@@ -597,6 +817,12 @@ bool CacheController::cache_access_cb(void *arg)
 			} else if(type == MEMORY_OP_EVICT) {
                 if(is_private()) {
                     line->state = LINE_NOT_VALID;
+
+                    if(line->prefetched) {
+                        line->prefetched = 0;
+                        N_STAT_UPDATE(prefetchStats_->useless, ++,
+                                kernel_req);
+                    }
                 }
                 /* Else its an evict message from any coherent cache
                  * so ignore that. */
@@ -613,7 +839,9 @@ bool CacheController::cache_access_cb(void *arg)
 				delay = cacheAccessLatency_;
 				queueEntry->eventFlags[CACHE_MISS_EVENT]++;
 
-				if(type == MEMORY_OP_READ) {
+				if(queueEntry->prefetch) {
+					/* Prefetches are not demand accesses */
+				} else if(type == MEMORY_OP_READ) {
 					N_STAT_UPDATE(new_stats.cpurequest.count.miss.read, ++,
 							kernel_req);
 				} else if(type == MEMORY_OP_WRITE) {
@@ -621,8 +849,8 @@ bool CacheController::cache_access_cb(void *arg)
 							kernel_req);
 				}
 
-				if(!queueEntry->prefetch && type == MEMORY_OP_READ)
-					do_prefetch(queueEntry->request);
+				if(prefetcher_ && !queueEntry->prefetch)
+					train_prefetcher(queueEntry->request, true, false);
 			}
             /* else its update and its a cache miss, so ignore that */
 			else {
@@ -644,8 +872,13 @@ bool CacheController::cache_access_cb(void *arg)
 	} else {
 		OP_TYPE type = queueEntry->request->get_type();
         bool kernel_req = queueEntry->request->is_kernel();
-		if(type == MEMORY_OP_READ) {
+		bool conflict = !cacheLines_->ports().bank_free(queueEntry->request);
+		if(type == MEMORY_OP_READ && conflict) {
+			N_STAT_UPDATE(new_stats.cpurequest.stall.read.bank_conflict, ++, kernel_req);
+		} else if(type == MEMORY_OP_READ) {
 			N_STAT_UPDATE(new_stats.cpurequest.stall.read.cache_port, ++, kernel_req);
+		} else if(type == MEMORY_OP_WRITE && conflict) {
+			N_STAT_UPDATE(new_stats.cpurequest.stall.write.bank_conflict, ++, kernel_req);
 		} else if(type == MEMORY_OP_WRITE) {
 			N_STAT_UPDATE(new_stats.cpurequest.stall.write.cache_port, ++, kernel_req);
 		}
@@ -665,6 +898,14 @@ bool CacheController::wait_interconnect_cb(void *arg)
 	if(queueEntry->annuled)
 		return true;
 
+	/* Don't send a miss of a wrong path request down */
+	if unlikely (queueEntry->sendTo == lowerInterconnect_ &&
+			memoryHierarchy_->drop_annuled(queueEntry->request)) {
+		N_STAT_UPDATE(new_stats.annul, ++,
+				queueEntry->request->is_kernel());
+		return true;
+	}
+
 	queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]--;
 
 	if(!queueEntry->sendTo) {
@@ -771,15 +1012,18 @@ bool CacheController::clear_entry_cb(void *arg)
 			}
 
 			// make sure that no pending entry will wake up the removed entry (in the case of annuled)
+			// dependencies are only formed between entries of the same line
 			int removed_idx = queueEntry->idx;
-			CacheQueueEntry *tmpEntry;
-			foreach_list_mutable(pendingRequests_.list(), tmpEntry, entry, nextentry) {
+			CacheQueueEntry *tmpEntry = pendingRequests_.first(
+					get_line_address(queueEntry->request));
+			for(; tmpEntry; tmpEntry = pendingRequests_.next(tmpEntry)) {
 				if(tmpEntry->depends == removed_idx) {
 					tmpEntry->depends = -1;
 					tmpEntry->dependsAddr = -1;
 				}
-            }
+			}
 			pendingRequests_.free(queueEntry);
+			update_queue_occupancy();
 		}
 
         /*
@@ -796,10 +1040,12 @@ bool CacheController::clear_entry_cb(void *arg)
 
 void CacheController::annul_request(MemoryRequest *request)
 {
-	CacheQueueEntry *queueEntry;
-	foreach_list_mutable(pendingRequests_.list(), queueEntry,
-			entry, nextentry) {
-		if(queueEntry->request->is_same(request)) {
+	CacheQueueEntry *queueEntry = pendingRequests_.first(
+			get_line_address(request));
+	CacheQueueEntry *nextEntry;
+	for(; queueEntry; queueEntry = nextEntry) {
+		nextEntry = pendingRequests_.next(queueEntry);
+		if(queueEntry->request == request) {
             queueEntry->eventFlags.reset();
             clear_entry_cb(queueEntry);
 			queueEntry->annuled = true;
@@ -821,6 +1067,7 @@ bool CacheController::send_update_message(CacheQueueEntry *queueEntry,
 	}
 
 	CacheQueueEntry *new_entry = pendingRequests_.alloc();
+	update_queue_occupancy();
 	if(new_entry == NULL)
 		return false;
 
@@ -832,6 +1079,7 @@ bool CacheController::send_update_message(CacheQueueEntry *queueEntry,
 	}
 
 	new_entry->request = request;
+	pendingRequests_.index(new_entry, get_line_address(request));
 	new_entry->sender = NULL;
 	new_entry->sendTo = lowerInterconnect_;
 	request->incRefCounter();
@@ -845,33 +1093,85 @@ bool CacheController::send_update_message(CacheQueueEntry *queueEntry,
 	return true;
 }
 
-void CacheController::do_prefetch(MemoryRequest *request, int additional_delay)
+/**
+ * @brief Train the prefetcher with a demand access and issue its prefetches
+ */
+void CacheController::train_prefetcher(MemoryRequest *request, bool miss,
+		bool prefetchHit)
+{
+	prefetchLines_.clear();
+	prefetcher_->train(request, miss, prefetchHit, prefetchLines_);
+
+	foreach(i, prefetchLines_.count()) {
+		do_prefetch(request, prefetchLines_[i]);
+	}
+}
+
+/**
+ * @brief Check if a demand request has to wait for a prefetch in flight
+ *
+ * Such a prefetch was late, the line it brings is counted as used.
+ */
+void CacheController::check_late_prefetch(MemoryRequest *request)
+{
+	OP_TYPE type = request->get_type();
+	if(type != MEMORY_OP_READ && type != MEMORY_OP_WRITE)
+		return;
+
+	CacheQueueEntry *queueEntry = pendingRequests_.first(
+			get_line_address(request));
+	for(; queueEntry; queueEntry = pendingRequests_.next(queueEntry)) {
+		if(queueEntry->prefetch && !queueEntry->prefetchDemanded &&
+				!queueEntry->annuled) {
+			queueEntry->prefetchDemanded = true;
+			N_STAT_UPDATE(prefetchStats_->late, ++, request->is_kernel());
+			train_prefetcher(request, false, true);
+			return;
+		}
+	}
+}
+
+void CacheController::do_prefetch(MemoryRequest *request, W64 lineAddress)
 {
-	if(!prefetchEnabled_)
+	bool kernel_req = request->is_kernel();
+
+	/* Line is already being fetched or evicted */
+	if(pendingRequests_.contains(lineAddress)) {
+		N_STAT_UPDATE(prefetchStats_->redundant, ++, kernel_req);
 		return;
+	}
 
     /*
 	 * Don't prefetch if our pending request queue is almost full
 	 * This makes sure that we have some space in queue for new requests
      */
-	if(pendingRequests_.count() > pendingRequests_.size() * 0.7)
+	if(pendingRequests_.count() > pendingRequests_.size() * 0.7) {
+		N_STAT_UPDATE(prefetchStats_->dropped, ++, kernel_req);
 		return;
+	}
 
 	MemoryRequest *new_request = memoryHierarchy_->get_free_request(
             request->get_coreid());
 	assert(new_request);
 
 	new_request->init(request);
+	new_request->set_physical_address(lineAddress << cacheLineBits_);
 
-	/* Now generate a new address for the prefetch */
-	W64 next_line_address = get_line_address(request);
-	next_line_address = (next_line_address + 1) << cacheLineBits_;
-	new_request->set_physical_address(next_line_address);
+	/* Prefetch only brings the line, even if a store triggered it */
+	new_request->set_op_type(MEMORY_OP_READ);
+	new_request->set_priority(PRIORITY_PREFETCH);
 
 	CacheQueueEntry *new_entry = pendingRequests_.alloc();
+	update_queue_occupancy();
 	assert(new_entry);
 
+	/* set full flag if buffer is full */
+	if(pendingRequests_.isFull()) {
+		memoryHierarchy_->set_controller_full(this, true);
+	}
+
 	new_entry->request = new_request;
+	pendingRequests_.index(new_entry, lineAddress);
 	new_entry->sender = NULL;
 	new_entry->sendTo = lowerInterconnect_;
 	new_entry->prefetch = true;
@@ -879,8 +1179,8 @@ void CacheController::do_prefetch(MemoryRequest *request, int additional_delay)
 	new_request->incRefCounter();
 	ADD_HISTORY_ADD(new_request);
 
-	marss_add_event(&cacheAccess_, prefetchDelay_+additional_delay,
-		   new_entry);
+	new_entry->eventFlags[CACHE_ACCESS_EVENT]++;
+	marss_add_event(&cacheAccess_, prefetchDelay_, new_entry);
 }
 
 /**
@@ -897,10 +1197,22 @@ void CacheController::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "sets", cacheLines_->get_set_count());
 	YAML_KEY_VAL(out, "ways", cacheLines_->get_way_count());
 	YAML_KEY_VAL(out, "line_size", cacheLines_->get_line_size());
-	YAML_KEY_VAL(out, "latency", cacheLines_->get_access_latency());
+	YAML_KEY_VAL(out, "latency", cacheAccessLatency_);
 	YAML_KEY_VAL(out, "pending_queue_size", pendingRequests_.size());
 	YAML_KEY_VAL(out, "config", (wt_disabled_ ? "writeback" : "writethrough"));
 
+	if(cacheLines_->ports().get_banks() > 1) {
+		YAML_KEY_VAL(out, "banks", cacheLines_->ports().get_banks());
+		YAML_KEY_VAL(out, "bank_bytes", cacheLines_->ports().get_bank_bytes());
+		YAML_KEY_VAL(out, "bank_ports", cacheLines_->ports().get_bank_ports());
+	}
+
+	if(slice_.is_sliced())
+		slice_.dump_configuration(out);
+
+	if(prefetcher_)
+		prefetcher_->dump_configuration(out);
+
 	out << YAML::EndMap;
 }
 
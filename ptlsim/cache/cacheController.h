@@ -35,6 +35,8 @@
 #include <cacheConstants.h>
 #include <memoryStats.h>
 #include <cacheLines.h>
+#include <prefetcher.h>
+#include <stackDistance.h>
 
 #include <statsBuilder.h>
 
@@ -80,6 +82,7 @@ struct CacheQueueEntry : public FixStateListObject
 		bool annuled;
 		bool prefetch;
 		bool prefetchCompleted;
+		bool prefetchDemanded;
 
 		void init() {
 			request = NULL;
@@ -93,6 +96,7 @@ struct CacheQueueEntry : public FixStateListObject
 			annuled = false;
 			prefetch = false;
 			prefetchCompleted = false;
+			prefetchDemanded = false;
 		}
 
 		ostream& print(ostream& os) const {
@@ -146,7 +150,7 @@ class CacheController : public Controller
 		int cacheAccessLatency_;
 
 		// A Queue conatining pending requests for this cache
-		FixStateList<CacheQueueEntry, 128> pendingRequests_;
+		IndexedFixStateList<CacheQueueEntry, 128> pendingRequests_;
 
 		// Flag to indicate if this cache is lowest private
 		// level cache
@@ -155,9 +159,17 @@ class CacheController : public Controller
 		// Flag to indicate if cache is write through or not
 		bool wt_disabled_;
 
-		// Prefetch related variables
-		bool prefetchEnabled_;
+		// Prefetch related variables, prefetcher_ is NULL unless
+		// 'prefetcher' option is set for this cache
+		Prefetcher *prefetcher_;
+		PrefetchStats *prefetchStats_;
+		dynarray<W64> prefetchLines_;
 		int prefetchDelay_;
+		stringbuf prefetcherType_;
+
+		// LRU stack distances of demand accesses, NULL unless
+		// 'stack_distance' option is set for this cache
+		StackDistanceProfile *stackDistance_;
 
 		// This caches are connected to only two interconnects
 		// upper and lower interconnect.
@@ -181,6 +193,12 @@ class CacheController : public Controller
         // Stats Objects
         BaseCacheStats new_stats;
 
+		// After each alloc and free of pendingRequests_
+		void update_queue_occupancy() {
+			new_stats.queue_occupancy.update(pendingRequests_.count(),
+					sim_cycle, user_stats);
+		}
+
 		CacheQueueEntry* find_dependency(MemoryRequest *request);
 
 		// This function is used to find pending request with either
@@ -191,10 +209,18 @@ class CacheController : public Controller
 			return request->get_physical_address() >> cacheLineBits_;
 		}
 
+		// Same as CacheLinesBase::tagOf without the virtual dispatch
+		W64 get_line_tag(MemoryRequest *request) {
+			return get_line_address(request) << cacheLineBits_;
+		}
+
 		bool send_update_message(CacheQueueEntry *queueEntry,
 				W64 tag=-1);
 
-		void do_prefetch(MemoryRequest *request, int additional_delay=0);
+		void train_prefetcher(MemoryRequest *request, bool miss,
+				bool prefetchHit);
+		void check_late_prefetch(MemoryRequest *request);
+		void do_prefetch(MemoryRequest *request, W64 lineAddress);
 
 	public:
 		CacheController(W8 coreid, const char *name,
@@ -203,6 +229,10 @@ class CacheController : public Controller
 		bool handle_interconnect_cb(void *arg);
 		int access_fast_path(Interconnect *interconnect,
 				MemoryRequest *request);
+		bool warm_line(MemoryRequest *request);
+		void transfer_warm_state(WarmState &state);
+		int invalidate_lines(W64 physaddr, W64 size);
+		Statable* get_stats() { return &new_stats; }
 
 		void register_interconnect(Interconnect *interconnect, int type);
 		void register_upper_interconnect(Interconnect *interconnect);
@@ -212,6 +242,7 @@ class CacheController : public Controller
 
 		void annul_request(MemoryRequest *request);
 		void dump_configuration(YAML::Emitter &out) const;
+		void config_changed();
 
 		// Callback functions for signals of cache
 		bool cache_hit_cb(void *arg);
@@ -238,8 +269,14 @@ class CacheController : public Controller
 		void print(ostream& os) const;
 
 		bool is_full(bool fromInterconnect = false, MemoryRequest *req = NULL) const {
+			/* Loads blocking a ROB head may use half of the reserve */
+			int reserve = 4;
+			if(priority_scheduling && req &&
+					req->get_priority() == PRIORITY_CRITICAL)
+				reserve = 2;
+
 			if(pendingRequests_.count() >= (
-						pendingRequests_.size() - 4)) {
+						pendingRequests_.size() - reserve)) {
 				return true;
 			}
 			return false;
@@ -29,6 +29,13 @@
 #define CACHE_LINES_H
 
 #include <logic.h>
+#include <memoryRequest.h>
+#include <memoryStats.h>
+#include <replacement.h>
+#include <lazyChunks.h>
+#include <qos.h>
+#include <warmstate.h>
+#include <lineCompression.h>
 
 namespace Memory {
 
@@ -38,15 +45,25 @@ namespace Memory {
         /* This is a generic variable used by all caches to represent its
          * coherence state */
         W8 state;
+        /* Set while a line brought in by a prefetch is not used yet */
+        W8 prefetched;
+        /* Class of service of the core that filled it, in QoS caches */
+        W8 clos;
 
         void init(W64 tag_t) {
             tag = tag_t;
-            if (tag == (W64)-1) state = 0;
+            if (tag == (W64)-1) {
+                state = 0;
+                prefetched = 0;
+                clos = 0;
+            }
         }
 
         void reset() {
             tag = -1;
             state = 0;
+            prefetched = 0;
+            clos = 0;
         }
 
         void invalidate() { reset(); }
@@ -69,11 +86,145 @@ namespace Memory {
         return os;
     }
 
+    /*
+     * Per cycle read/write port accounting shared by CacheLines backends.
+     *
+     * With set_banks() the lines are also interleaved over banks by
+     * address, bankBytes at a time, and each bank serves bankPorts
+     * requests a cycle. A request of a bank that has none left waits even
+     * if the cache still has a port: a bank conflict.
+     */
+    class CachePorts
+    {
+        private:
+            int readPortUsed_;
+            int writePortUsed_;
+            int readPorts_;
+            int writePorts_;
+            W64 lastAccessCycle_;
+
+            int banks_;
+            int bankShift_;
+            int bankPorts_;
+            W8 bankPortUsed_[CACHE_MAX_BANKS];
+
+            void new_cycle()
+            {
+                if(lastAccessCycle_ < sim_cycle) {
+                    lastAccessCycle_ = sim_cycle;
+                    writePortUsed_ = 0;
+                    readPortUsed_ = 0;
+                    foreach(i, banks_)
+                        bankPortUsed_[i] = 0;
+                }
+            }
+
+            int bank_of(MemoryRequest *request) const
+            {
+                return (request->get_physical_address() >> bankShift_) &
+                    (banks_ - 1);
+            }
+
+        public:
+            CachePorts(int readPorts, int writePorts)
+                : readPortUsed_(0)
+                  , writePortUsed_(0)
+                  , readPorts_(readPorts)
+                  , writePorts_(writePorts)
+                  , lastAccessCycle_(0)
+                  , banks_(1)
+                  , bankShift_(0)
+                  , bankPorts_(0)
+            {
+                bankPortUsed_[0] = 0;
+            }
+
+            /*
+             * Returns false, and stays unbanked, unless banks and bankBytes
+             * are powers of 2, banks is at most CACHE_MAX_BANKS and
+             * bankPorts is at least 1
+             */
+            bool set_banks(int banks, int bankBytes, int bankPorts)
+            {
+                if(banks <= 0 || banks > CACHE_MAX_BANKS ||
+                        (banks & (banks - 1)) || bankBytes <= 0 ||
+                        (bankBytes & (bankBytes - 1)) || bankPorts <= 0)
+                    return false;
+
+                banks_ = banks;
+                bankShift_ = lsbindex32(bankBytes);
+                bankPorts_ = bankPorts;
+                foreach(i, banks_)
+                    bankPortUsed_[i] = 0;
+                return true;
+            }
+
+            int get_banks() const { return banks_; }
+            int get_bank_bytes() const { return 1 << bankShift_; }
+            int get_bank_ports() const { return bankPorts_; }
+
+            /* True if the bank of request has a port left this cycle */
+            bool bank_free(MemoryRequest *request)
+            {
+                if likely (banks_ == 1)
+                    return true;
+
+                new_cycle();
+                return bankPortUsed_[bank_of(request)] < bankPorts_;
+            }
+
+            /* Take a port of the bank of request only, false on a conflict */
+            bool get_bank_port(MemoryRequest *request)
+            {
+                if(!bank_free(request))
+                    return false;
+
+                if(banks_ > 1)
+                    bankPortUsed_[bank_of(request)]++;
+                return true;
+            }
+
+            bool get_port(MemoryRequest *request)
+            {
+                bool rc = false;
+
+                new_cycle();
+
+                if(!bank_free(request))
+                    return false;
+
+                switch(request->get_type()) {
+                    case MEMORY_OP_READ:
+                        rc = (readPortUsed_ < readPorts_) ? ++readPortUsed_ : 0;
+                        break;
+                    case MEMORY_OP_WRITE:
+                    case MEMORY_OP_UPDATE:
+                    case MEMORY_OP_EVICT:
+                        rc = (writePortUsed_ < writePorts_) ? ++writePortUsed_ : 0;
+                        break;
+                    default:
+                        ptl_logfile << "Unknown type of memory request: ",
+                                    request->get_type(), endl;
+                        assert(0);
+                };
+
+                if(rc && banks_ > 1)
+                    bankPortUsed_[bank_of(request)]++;
+                return rc;
+            }
+    };
+
     // A base struct to provide a pointer to CacheLines without any need
     // of a template
     struct CacheLinesBase
     {
+        protected:
+            /* Fills are limited to the way mask of their core's class */
+            bool qos_;
+
         public:
+            CacheLinesBase() : qos_(false) {}
+
             virtual void init()=0;
             virtual W64 tagOf(W64 address)=0;
             virtual int latency() const =0;
@@ -82,6 +233,7 @@ namespace Memory {
                     W64& oldTag)=0;
             virtual int invalidate(MemoryRequest *request)=0;
             virtual bool get_port(MemoryRequest *request)=0;
+            virtual CachePorts& ports()=0;
             virtual void print(ostream& os) const =0;
             virtual int get_line_bits() const=0;
             virtual int get_access_latency() const=0;
@@ -89,20 +241,92 @@ namespace Memory {
 			virtual int get_set_count() const=0;
 			virtual int get_way_count() const=0;
 			virtual int get_line_size() const=0;
+
+            /* Backends with stats of their own add them under 'parent' */
+            virtual void register_stats(Statable *parent) {}
+
+            /* Way partition fills by class of service, see qos.h */
+            virtual void enable_qos() { qos_ = true; }
+
+            /* Add the valid lines of each class to lines[QOS_MAX_CLOS] */
+            virtual void count_clos_lines(W64 *lines) const {}
+
+            /* Append copies of the valid lines to 'lines' */
+            virtual void get_valid_lines(dynarray<CacheLine> &lines) const {}
+
+            /* Cycles a hit on 'line' takes on top of the access latency */
+            virtual int hit_latency(const CacheLine *line) { return 0; }
+
+            /* Switch to replacement policy 'name', see set_policy() in
+             * replacement.h. False if this backend can't. */
+            virtual bool set_replacement(const char *name) { return false; }
+
+            /*
+             * Lines the last insert() evicted besides the one it returned,
+             * for backends that make room for a fill by evicting several
+             */
+            virtual bool pop_victim(W64& tag, W8& state) { return false; }
+
+            const CachePorts& ports() const {
+                return const_cast<CacheLinesBase*>(this)->ports();
+            }
+
+            void transfer_warm_state(WarmState &state);
     };
 
+    /**
+     * @brief Save or load tag and state of the valid lines, see warmstate.h
+     *
+     * Loaded lines are inserted like fills, so the replacement state only
+     * follows the order of the saved lines.
+     */
+    inline void CacheLinesBase::transfer_warm_state(WarmState &state)
+    {
+        if(state.saving()) {
+            dynarray<CacheLine> lines;
+            get_valid_lines(lines);
+
+            W64 count = lines.count();
+            state.value(count);
+            foreach(i, lines.count()) {
+                state.value(lines[i].tag);
+                state.value(lines[i].state);
+            }
+            return;
+        }
+
+        W64 count = 0;
+        state.value(count);
+
+        MemoryRequest request;
+        request.set_coreid(0);
+
+        foreach(i, count) {
+            W64 tag;
+            W8 lineState;
+            state.value(tag);
+            state.value(lineState);
+            if(!state.ok())
+                break;
+
+            request.set_physical_address(tag);
+            CacheLine *line = probe(&request);
+            if(!line) {
+                W64 oldTag = InvalidTag<W64>::INVALID;
+                line = insert(&request, oldTag);
+            }
+
+            line->init(tag);
+            line->state = lineState;
+            line->prefetched = 0;
+        }
+    }
+
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
         class CacheLines : public CacheLinesBase,
         public AssociativeArray<W64, CacheLine, SET_COUNT,
         WAY_COUNT, LINE_SIZE>
     {
-        private:
-            int readPortUsed_;
-            int writePortUsed_;
-            int readPorts_;
-            int writePorts_;
-            W64 lastAccessCycle_;
-
         public:
             typedef AssociativeArray<W64, CacheLine, SET_COUNT,
                     WAY_COUNT, LINE_SIZE> base_t;
@@ -110,6 +334,13 @@ namespace Memory {
                     NullAssociativeArrayStatisticsCollector<W64,
                     CacheLine> > Set;
 
+        private:
+            CachePorts ports_;
+
+            CacheLine* qos_select(MemoryRequest *request, W64& oldTag);
+
+        public:
+
             CacheLines(int readPorts, int writePorts);
             void init();
             W64 tagOf(W64 address);
@@ -118,7 +349,10 @@ namespace Memory {
             CacheLine* insert(MemoryRequest *request, W64& oldTag);
             int invalidate(MemoryRequest *request);
             bool get_port(MemoryRequest *request);
+            CachePorts& ports() { return ports_; }
             void print(ostream& os) const;
+            void count_clos_lines(W64 *lines) const;
+            void get_valid_lines(dynarray<CacheLine> &lines) const;
 
 			/**
 			 * @brief Get Cache Size
@@ -185,12 +419,8 @@ namespace Memory {
 
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
         CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::CacheLines(int readPorts, int writePorts) :
-            readPorts_(readPorts)
-            , writePorts_(writePorts)
+            ports_(readPorts, writePorts)
     {
-        lastAccessCycle_ = 0;
-        readPortUsed_ = 0;
-        writePortUsed_ = 0;
     }
 
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
@@ -224,12 +454,58 @@ namespace Memory {
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
         CacheLine* CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::insert(MemoryRequest *request, W64& oldTag)
         {
+            if unlikely (qos_)
+                return qos_select(request, oldTag);
+
             W64 physAddress = request->get_physical_address();
             CacheLine *line = base_t::select(physAddress, oldTag);
 
             return line;
         }
 
+    /*
+     * Same as FullyAssociativeTags::select() with the victim taken from the
+     * ways of the class's mask: the first of them without its MRU bit,
+     * after clearing their MRU bits if they are all set.
+     */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
+        CacheLine* CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::qos_select(MemoryRequest *request, W64& oldTag)
+        {
+            W64 physAddress = request->get_physical_address();
+            W64 tag = base_t::tagof(physAddress);
+            Set &set = base_t::sets[base_t::setof(physAddress)];
+            FullyAssociativeTags<W64, WAY_COUNT> &tags = set.tags;
+
+            int way = tags.probe(tag);
+            if(way < 0) {
+                int clos = qos.clos_of(request->get_coreid());
+                W64 mask = qos.way_mask(request->get_coreid(), WAY_COUNT,
+                        request->is_io());
+
+                W64 notUsed = mask & ~W64(tags.evictmap.integer());
+                if(notUsed) {
+                    way = lsbindex64(notUsed);
+                } else {
+                    for(W64 m = mask; m; m &= m - 1)
+                        tags.evictmap[lsbindex64(m)] = 0;
+                    way = lsbindex64(mask);
+                }
+
+                oldTag = tags.tags[way];
+                tags.tags[way] = tag;
+                set.data[way].clos = clos;
+                qos.classes[clos].fills++;
+            }
+
+            tags.use(way);
+            if(tags.evictmap.allset()) {
+                tags.evictmap = 0;
+                tags.use(way);
+            }
+
+            return &set.data[way];
+        }
+
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
         int CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::invalidate(MemoryRequest *request)
         {
@@ -240,29 +516,7 @@ namespace Memory {
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
         bool CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::get_port(MemoryRequest *request)
         {
-            bool rc = false;
-
-            if(lastAccessCycle_ < sim_cycle) {
-                lastAccessCycle_ = sim_cycle;
-                writePortUsed_ = 0;
-                readPortUsed_ = 0;
-            }
-
-            switch(request->get_type()) {
-                case MEMORY_OP_READ:
-                    rc = (readPortUsed_ < readPorts_) ? ++readPortUsed_ : 0;
-                    break;
-                case MEMORY_OP_WRITE:
-                case MEMORY_OP_UPDATE:
-                case MEMORY_OP_EVICT:
-                    rc = (writePortUsed_ < writePorts_) ? ++writePortUsed_ : 0;
-                    break;
-                default:
-                    memdebug("Unknown type of memory request: " <<
-                            request->get_type() << endl);
-                    assert(0);
-            };
-            return rc;
+            return ports_.get_port(request);
         }
 
     template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
@@ -276,6 +530,1117 @@ namespace Memory {
             }
         }
 
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
+        void CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::count_clos_lines(W64 *lines) const
+        {
+            foreach(i, SET_COUNT) {
+                const Set &set = base_t::sets[i];
+                foreach(j, WAY_COUNT) {
+                    const CacheLine &line = set.data[j];
+                    if(line.state && line.tag != (W64)-1)
+                        lines[line.clos]++;
+                }
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY>
+        void CacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY>::get_valid_lines(dynarray<CacheLine> &lines) const
+        {
+            foreach(i, SET_COUNT) {
+                const Set &set = base_t::sets[i];
+                foreach(j, WAY_COUNT) {
+                    const CacheLine &line = set.data[j];
+                    if(line.state && line.tag != (W64)-1)
+                        lines.push(line);
+                }
+            }
+        }
+
+    /**
+     * @brief CacheLines backend with a structure-of-arrays layout
+     *
+     * Tags of each set are stored contiguously, padded to a multiple of
+     * four ways, and a probe compares all ways of the set with packed
+     * 64-bit compares (AVX2 when available, otherwise SSE). CacheLine
+     * objects, which carry the coherence state updated by the controllers,
+     * live in their own array and the replacement state of each set is
+     * packed in one or two words by POLICY (see replacement.h).
+     *
+     * Tags and lines are kept in chunks of CHUNK_SETS sets that are
+     * allocated and initialized when a line is first inserted in them, and
+     * reset() only starts a new epoch of the chunks (see lazyChunks.h). So
+     * caches of any size are built and reset in constant time and only
+     * hold memory for the sets in use.
+     *
+     * The default BitPLRU policy follows FullyAssociativeTags exactly, so
+     * this backend gives the same results as CacheLines. Select it with
+     * 'LINES_BACKEND: vector' in the cache params of the config file, and
+     * the policy with 'REPLACEMENT'.
+     */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY = BitPLRU<SET_COUNT, WAY_COUNT> >
+        class VectorCacheLines : public CacheLinesBase
+    {
+        private:
+            enum { PADDED_WAYS = (WAY_COUNT + 3) & ~3 };
+
+            /* Replacement state is packed in W64s per set */
+            typedef char way_count_check[(WAY_COUNT <= 64) ? 1 : -1];
+
+            enum {
+                CHUNK_SETS = (SET_COUNT < 64) ? SET_COUNT : 64,
+                CHUNKS = SET_COUNT / CHUNK_SETS,
+            };
+
+            /* Chunks are cache line aligned, so are the tags of each set */
+            struct Chunk {
+                W64 tags[CHUNK_SETS][PADDED_WAYS];
+                CacheLine lines[CHUNK_SETS][WAY_COUNT];
+            };
+
+            LazyChunks chunks_;
+            POLICY policy_;
+            CachePorts ports_;
+
+            static const W64 INVALID = InvalidTag<W64>::INVALID;
+
+            static int setof(W64 addr) {
+                return bits(addr, log2(LINE_SIZE), log2(SET_COUNT));
+            }
+
+            static W64 all_ways() {
+                return bitmask(WAY_COUNT);
+            }
+
+            int match(int set, W64 tag) const;
+            int probe_way(int set, W64 tag);
+
+            /* Chunk of 'set' or NULL if nothing is in it yet */
+            Chunk* find_chunk(int set) const {
+                return (Chunk*)chunks_.find(set / CHUNK_SETS);
+            }
+
+            Chunk* get_chunk(int set);
+
+        public:
+            VectorCacheLines(int readPorts, int writePorts);
+            void reset();
+            void init();
+            W64 tagOf(W64 address);
+            int latency() const { return LATENCY; };
+            CacheLine* probe(MemoryRequest *request);
+            CacheLine* insert(MemoryRequest *request, W64& oldTag);
+            int invalidate(MemoryRequest *request);
+            bool get_port(MemoryRequest *request);
+            CachePorts& ports() { return ports_; }
+            void print(ostream& os) const;
+            void count_clos_lines(W64 *lines) const;
+            void get_valid_lines(dynarray<CacheLine> &lines) const;
+
+            bool set_replacement(const char *name) {
+                return policy_.set_policy(name);
+            }
+
+            int get_size() const {
+                return (SET_COUNT * WAY_COUNT * LINE_SIZE);
+            }
+
+            int get_set_count() const {
+                return SET_COUNT;
+            }
+
+            int get_way_count() const {
+                return WAY_COUNT;
+            }
+
+            int get_line_size() const {
+                return LINE_SIZE;
+            }
+
+            int get_line_bits() const {
+                return log2(LINE_SIZE);
+            }
+
+            int get_access_latency() const {
+                return LATENCY;
+            }
+    };
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        static inline ostream& operator <<(ostream& os, const
+                VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>&
+                cacheLines)
+        {
+            cacheLines.print(os);
+            return os;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::VectorCacheLines(int readPorts, int writePorts) :
+            chunks_(CHUNKS, sizeof(Chunk))
+            , ports_(readPorts, writePorts)
+    {
+        reset();
+    }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        void VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::reset()
+        {
+            chunks_.reset();
+            policy_.reset_shared();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        typename VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::Chunk* VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::get_chunk(int set)
+        {
+            bool fresh;
+            Chunk *chunk = (Chunk*)chunks_.get(set / CHUNK_SETS, fresh);
+
+            if unlikely (fresh) {
+                int base = set & ~(CHUNK_SETS - 1);
+                foreach(i, CHUNK_SETS) {
+                    foreach(j, PADDED_WAYS) {
+                        chunk->tags[i][j] = INVALID;
+                    }
+                    foreach(j, WAY_COUNT) {
+                        chunk->lines[i][j].reset();
+                    }
+                    policy_.reset_set(base + i);
+                }
+            }
+
+            return chunk;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        void VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::init()
+        {
+            /* Lines are reset along with their chunk on first use */
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        W64 VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::tagOf(W64 address)
+        {
+            return floor(address, LINE_SIZE);
+        }
+
+    // Return the way holding 'tag' in 'set' or -1; padding ways never match
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        int VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::match(int set, W64 tag) const
+        {
+            const Chunk *chunk = find_chunk(set);
+            if(!chunk) return -1;
+
+            const W64 *tags = chunk->tags[set & (CHUNK_SETS - 1)];
+            W64 mask = 0;
+
+#ifdef __AVX2__
+            vec4q target = {tag, tag, tag, tag};
+            for(int i = 0; i < PADDED_WAYS; i += 4) {
+                mask |= W64(x86_avx2_maskeqq(target,
+                            *(const vec4q*)&tags[i])) << i;
+            }
+#else
+            vec2q target = {tag, tag};
+            for(int i = 0; i < PADDED_WAYS; i += 2) {
+                mask |= W64(x86_sse_maskeqq(target,
+                            *(const vec2q*)&tags[i])) << i;
+            }
+#endif
+
+            mask &= all_ways();
+            return (mask) ? int(lsbindex64(mask)) : -1;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        int VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::probe_way(int set, W64 tag)
+        {
+            int way = match(set, tag);
+            if(way >= 0)
+                policy_.touch(set, way);
+            return way;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        CacheLine* VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::probe(MemoryRequest *request)
+        {
+            W64 physAddress = request->get_physical_address();
+            int set = setof(physAddress);
+            int way = probe_way(set, tagOf(physAddress));
+
+            if(way < 0) return NULL;
+            return &find_chunk(set)->lines[set & (CHUNK_SETS - 1)][way];
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        CacheLine* VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::insert(MemoryRequest *request, W64& oldTag)
+        {
+            W64 physAddress = request->get_physical_address();
+            W64 tag = tagOf(physAddress);
+            int set = setof(physAddress);
+            Chunk *chunk = get_chunk(set);
+            int row = set & (CHUNK_SETS - 1);
+
+            int way = probe_way(set, tag);
+            bool miss = (way < 0);
+            if(miss && likely(!qos_)) {
+                way = policy_.victim(set);
+                oldTag = chunk->tags[row][way];
+                chunk->tags[row][way] = tag;
+            } else if(miss) {
+                int clos = qos.clos_of(request->get_coreid());
+                way = policy_.victim(set, qos.way_mask(
+                            request->get_coreid(), WAY_COUNT,
+                            request->is_io()));
+                oldTag = chunk->tags[row][way];
+                chunk->tags[row][way] = tag;
+                chunk->lines[row][way].clos = clos;
+                qos.classes[clos].fills++;
+            }
+
+            policy_.inserted(set, way, miss);
+
+            return &chunk->lines[row][way];
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        int VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::invalidate(MemoryRequest *request)
+        {
+            W64 physAddress = request->get_physical_address();
+            int set = setof(physAddress);
+            int way = probe_way(set, tagOf(physAddress));
+            if(way < 0) return -1;
+
+            Chunk *chunk = find_chunk(set);
+            int row = set & (CHUNK_SETS - 1);
+            chunk->tags[row][way] = INVALID;
+            policy_.invalidate(set, way);
+            chunk->lines[row][way].reset();
+            return way;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        bool VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::get_port(MemoryRequest *request)
+        {
+            return ports_.get_port(request);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        void VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::print(ostream& os) const
+        {
+            CacheLine empty;
+            empty.reset();
+
+            foreach(i, SET_COUNT) {
+                const Chunk *chunk = find_chunk(i);
+                foreach(j, WAY_COUNT) {
+                    os << (chunk ? chunk->lines[i & (CHUNK_SETS - 1)][j] :
+                            empty);
+                }
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        void VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::count_clos_lines(W64 *lines) const
+        {
+            foreach(i, SET_COUNT) {
+                const Chunk *chunk = find_chunk(i);
+                if(!chunk) continue;
+
+                foreach(j, WAY_COUNT) {
+                    const CacheLine &line =
+                        chunk->lines[i & (CHUNK_SETS - 1)][j];
+                    if(line.state && line.tag != (W64)-1)
+                        lines[line.clos]++;
+                }
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             typename POLICY>
+        void VectorCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, POLICY>::get_valid_lines(dynarray<CacheLine> &lines) const
+        {
+            foreach(i, SET_COUNT) {
+                const Chunk *chunk = find_chunk(i);
+                if(!chunk) continue;
+
+                foreach(j, WAY_COUNT) {
+                    const CacheLine &line =
+                        chunk->lines[i & (CHUNK_SETS - 1)][j];
+                    if(line.state && line.tag != (W64)-1)
+                        lines.push(line);
+                }
+            }
+        }
+
+    /**
+     * @brief CacheLines backend that models one in SAMPLE_RATE sets
+     *
+     * Sets whose index is a multiple of SAMPLE_RATE are kept exactly, in a
+     * VectorCacheLines of SET_COUNT / SAMPLE_RATE sets with the given
+     * replacement POLICY. Accesses to the other sets are filtered: probes
+     * always miss and inserts hand out a scratch line that is never found
+     * again and never evicts anything. Memory and warmup of the cache drop
+     * by SAMPLE_RATE.
+     *
+     * Misses of filtered sets all go to the next level, so timing of the
+     * run is pessimistic. Probes of the sampled sets are counted in
+     * 'set_sampling' stats of the cache, whose 'miss_rate' estimates the
+     * miss rate of the whole cache and 'miss_rate_error' its relative
+     * confidence half width. Select it with 'SAMPLE_SETS: <rate>' in the
+     * cache params of the config file.
+     */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE,
+             typename POLICY = BitPLRU<SET_COUNT / SAMPLE_RATE, WAY_COUNT> >
+        class SampledCacheLines : public CacheLinesBase
+    {
+        private:
+            enum { SAMPLED_SETS = SET_COUNT / SAMPLE_RATE };
+
+            typedef char sample_rate_check[
+                (SAMPLE_RATE > 0 && (SAMPLE_RATE & (SAMPLE_RATE - 1)) == 0 &&
+                 SAMPLED_SETS > 0) ? 1 : -1];
+
+            typedef VectorCacheLines<SAMPLED_SETS, WAY_COUNT, LINE_SIZE,
+                    LATENCY, POLICY> Sampled;
+
+            Sampled sampled_;
+            CacheLine scratch_;
+            MemoryRequest request_;
+
+            W64 setMisses_[SAMPLED_SETS];
+            W64 accesses_;
+            W64 misses_;
+            W64 missesSq_;
+            W64 filtered_;
+            SetSamplingStats *stats_;
+
+            enum {
+                LINE_BITS = log2(LINE_SIZE),
+                SET_BITS = log2(SET_COUNT),
+                RATE_BITS = log2(SAMPLE_RATE),
+            };
+
+            static int setof(W64 addr) {
+                return bits(addr, LINE_BITS, SET_BITS);
+            }
+
+            /*
+             * Drop the low set bits, which are zero in sampled sets, so the
+             * address indexes the smaller cache and back again.
+             */
+            static W64 to_sampled(W64 addr) {
+                W64 low = addr & bitmask(LINE_BITS);
+                return ((addr >> (LINE_BITS + RATE_BITS)) << LINE_BITS) | low;
+            }
+
+            static W64 from_sampled(W64 addr) {
+                W64 low = addr & bitmask(LINE_BITS);
+                return ((addr >> LINE_BITS) << (LINE_BITS + RATE_BITS)) | low;
+            }
+
+            bool sampled(W64 addr) const {
+                return (setof(addr) & (SAMPLE_RATE - 1)) == 0;
+            }
+
+            MemoryRequest* sampled_request(MemoryRequest *request) {
+                request_.set_physical_address(
+                        to_sampled(request->get_physical_address()));
+                request_.set_coreid(request->get_coreid());
+                return &request_;
+            }
+
+            void update_stats();
+
+        public:
+            SampledCacheLines(int readPorts, int writePorts);
+            ~SampledCacheLines();
+            void init();
+            W64 tagOf(W64 address);
+            int latency() const { return LATENCY; };
+            CacheLine* probe(MemoryRequest *request);
+            CacheLine* insert(MemoryRequest *request, W64& oldTag);
+            int invalidate(MemoryRequest *request);
+            bool get_port(MemoryRequest *request);
+            CachePorts& ports() { return sampled_.ports(); }
+            void print(ostream& os) const;
+            void register_stats(Statable *parent);
+            void enable_qos();
+            void count_clos_lines(W64 *lines) const;
+            void get_valid_lines(dynarray<CacheLine> &lines) const;
+
+            bool set_replacement(const char *name) {
+                return sampled_.set_replacement(name);
+            }
+
+            int get_size() const {
+                return (SET_COUNT * WAY_COUNT * LINE_SIZE);
+            }
+
+            int get_set_count() const {
+                return SET_COUNT;
+            }
+
+            int get_way_count() const {
+                return WAY_COUNT;
+            }
+
+            int get_line_size() const {
+                return LINE_SIZE;
+            }
+
+            int get_line_bits() const {
+                return LINE_BITS;
+            }
+
+            int get_access_latency() const {
+                return LATENCY;
+            }
+    };
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::SampledCacheLines(int readPorts, int writePorts) :
+            sampled_(readPorts, writePorts)
+            , accesses_(0)
+            , misses_(0)
+            , missesSq_(0)
+            , filtered_(0)
+            , stats_(NULL)
+    {
+        scratch_.reset();
+        foreach(i, SAMPLED_SETS) setMisses_[i] = 0;
+    }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::~SampledCacheLines()
+        {
+            delete stats_;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::init()
+        {
+            sampled_.init();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        W64 SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::tagOf(W64 address)
+        {
+            return floor(address, LINE_SIZE);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::register_stats(Statable *parent)
+        {
+            if(stats_) return;
+
+            stats_ = new SetSamplingStats("set_sampling", parent);
+            stats_->set_default_stats(user_stats);
+
+            W64 sets = SET_COUNT;
+            W64 sampledSets = SAMPLED_SETS;
+            stats_->sets = sets;
+            stats_->sampled_sets = sampledSets;
+            update_stats();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::update_stats()
+        {
+            if(!stats_) return;
+
+            stats_->accesses = accesses_;
+            stats_->misses = misses_;
+            stats_->misses_sq = missesSq_;
+            stats_->filtered = filtered_;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        CacheLine* SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::probe(MemoryRequest *request)
+        {
+            W64 physAddress = request->get_physical_address();
+
+            if(!sampled(physAddress)) {
+                filtered_++;
+                update_stats();
+                return NULL;
+            }
+
+            CacheLine *line = sampled_.probe(sampled_request(request));
+
+            accesses_++;
+            if(!line) {
+                /* Sum of squares moves by 2m + 1 when m grows by one */
+                W64 &m = setMisses_[setof(physAddress) >> RATE_BITS];
+                missesSq_ += 2 * m + 1;
+                m++;
+                misses_++;
+            }
+            update_stats();
+
+            return line;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        CacheLine* SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::insert(MemoryRequest *request, W64& oldTag)
+        {
+            if(!sampled(request->get_physical_address())) {
+                scratch_.reset();
+                return &scratch_;
+            }
+
+            /* Tags are line aligned, so 1 is left alone only by a hit */
+            W64 sampledTag = 1;
+            CacheLine *line = sampled_.insert(sampled_request(request),
+                    sampledTag);
+
+            if(sampledTag == 1)
+                return line;
+
+            if(sampledTag != InvalidTag<W64>::INVALID &&
+                    sampledTag != (W64)-1)
+                oldTag = from_sampled(sampledTag);
+            else
+                oldTag = sampledTag;
+
+            return line;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        int SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::invalidate(MemoryRequest *request)
+        {
+            if(!sampled(request->get_physical_address()))
+                return -1;
+
+            return sampled_.invalidate(sampled_request(request));
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        bool SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::get_port(MemoryRequest *request)
+        {
+            return sampled_.get_port(request);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::print(ostream& os) const
+        {
+            sampled_.print(os);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::enable_qos()
+        {
+            qos_ = true;
+            sampled_.enable_qos();
+        }
+
+    /* Occupancy of the sampled sets scaled to the whole cache */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::count_clos_lines(W64 *lines) const
+        {
+            W64 sampled[QOS_MAX_CLOS];
+            foreach(i, QOS_MAX_CLOS) sampled[i] = 0;
+
+            sampled_.count_clos_lines(sampled);
+            foreach(i, QOS_MAX_CLOS) lines[i] += sampled[i] * SAMPLE_RATE;
+        }
+
+    /* Lines keep the tag of the full cache, so they load back as is */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int SAMPLE_RATE, typename POLICY>
+        void SampledCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, SAMPLE_RATE, POLICY>::get_valid_lines(dynarray<CacheLine> &lines) const
+        {
+            sampled_.get_valid_lines(lines);
+        }
+
+    /**
+     * @brief CacheLines backend with compressed lines in sets of extra tags
+     *
+     * Each set has TAG_FACTOR * WAY_COUNT tags and the data array of
+     * WAY_COUNT lines, in segments of 8 bytes. A fill reads the line with
+     * cache_line_reader (guest memory) and takes the segments of its
+     * COMPRESSION size (see lineCompression.h), also when the line is
+     * filled again on a write-back. Lines of unknown contents are not
+     * compressed. Least recently used lines, the invalid ones first, are
+     * evicted until the tag and the segments of the fill are free: the
+     * first evicted line is the one insert() returns, the others are
+     * given to the controller by pop_victim().
+     *
+     * Hits on compressed lines take DECOMPRESS_LATENCY cycles more. Sizes
+     * of the fills and of the resident lines are in 'compression' stats of
+     * the cache, 'effective_capacity' is the uncompressed bytes held per
+     * byte of the data array. Select it with 'COMPRESSION: bdi' or 'fpc'
+     * in the cache params of the config file. QoS way partitions don't
+     * apply to it.
+     */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR = 2>
+        class CompressedCacheLines : public CacheLinesBase
+    {
+        private:
+            enum {
+                TAGS = WAY_COUNT * TAG_FACTOR,
+                SEGMENT_SIZE = 8,
+                SEGMENTS = WAY_COUNT * LINE_SIZE / SEGMENT_SIZE,
+                LINE_WORDS = LINE_SIZE / 8,
+            };
+
+            typedef char compressed_check[(TAG_FACTOR > 0 &&
+                    LINE_SIZE % SEGMENT_SIZE == 0 &&
+                    COMPRESSION >= 0 &&
+                    COMPRESSION < NUM_LINE_COMPRESSIONS) ? 1 : -1];
+
+            struct Entry {
+                W64 tag;
+                W64 stamp;
+                int segments;
+            };
+
+            struct Victim {
+                W64 tag;
+                W8 state;
+            };
+
+            static const W64 INVALID = InvalidTag<W64>::INVALID;
+
+            Entry *entries_;
+            CacheLine *lines_;
+            int *usedSegments_;
+            W64 clock_;
+            CachePorts ports_;
+
+            Victim victims_[TAGS];
+            int victimCount_;
+
+            W64 residentLines_;
+            W64 residentSegments_;
+            W64 fills_;
+            W64 unknownFills_;
+            W64 fillBytes_;
+            W64 fillCompressedBytes_;
+            W64 extraEvictions_;
+            W64 compressedHits_;
+            W64 decompressCycles_;
+            CompressionStats *stats_;
+
+            static int setof(W64 addr) {
+                return bits(addr, log2(LINE_SIZE), log2(SET_COUNT));
+            }
+
+            int find(int set, W64 tag) const;
+            int lru(int set, int keep) const;
+            int fill_segments(W64 tag);
+            void evict(int set, int way);
+            void make_room(int set, int segments, int keep);
+            void update_stats();
+
+        public:
+            CompressedCacheLines(int readPorts, int writePorts);
+            ~CompressedCacheLines();
+            void init();
+            W64 tagOf(W64 address);
+            int latency() const { return LATENCY; };
+            CacheLine* probe(MemoryRequest *request);
+            CacheLine* insert(MemoryRequest *request, W64& oldTag);
+            int invalidate(MemoryRequest *request);
+            bool get_port(MemoryRequest *request);
+            CachePorts& ports() { return ports_; }
+            void print(ostream& os) const;
+            void register_stats(Statable *parent);
+            void count_clos_lines(W64 *lines) const;
+            void get_valid_lines(dynarray<CacheLine> &lines) const;
+            int hit_latency(const CacheLine *line);
+            bool pop_victim(W64& tag, W8& state);
+
+            /* Segments of 'way' of 'set', or 0 if it is free */
+            int get_segments(int set, int way) const {
+                const Entry &entry = entries_[set * TAGS + way];
+                return (entry.tag == INVALID) ? 0 : entry.segments;
+            }
+
+            int get_size() const {
+                return (SET_COUNT * WAY_COUNT * LINE_SIZE);
+            }
+
+            int get_set_count() const {
+                return SET_COUNT;
+            }
+
+            int get_way_count() const {
+                return WAY_COUNT;
+            }
+
+            int get_line_size() const {
+                return LINE_SIZE;
+            }
+
+            int get_line_bits() const {
+                return log2(LINE_SIZE);
+            }
+
+            int get_access_latency() const {
+                return LATENCY;
+            }
+    };
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::CompressedCacheLines(int readPorts, int writePorts) :
+            clock_(0)
+            , ports_(readPorts, writePorts)
+            , victimCount_(0)
+            , residentLines_(0)
+            , residentSegments_(0)
+            , fills_(0)
+            , unknownFills_(0)
+            , fillBytes_(0)
+            , fillCompressedBytes_(0)
+            , extraEvictions_(0)
+            , compressedHits_(0)
+            , decompressCycles_(0)
+            , stats_(NULL)
+    {
+        entries_ = new Entry[SET_COUNT * TAGS];
+        lines_ = new CacheLine[SET_COUNT * TAGS];
+        usedSegments_ = new int[SET_COUNT];
+        init();
+    }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::~CompressedCacheLines()
+        {
+            delete[] entries_;
+            delete[] lines_;
+            delete[] usedSegments_;
+            delete stats_;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::init()
+        {
+            foreach(i, SET_COUNT * TAGS) {
+                entries_[i].tag = INVALID;
+                entries_[i].stamp = 0;
+                entries_[i].segments = 0;
+                lines_[i].reset();
+            }
+            foreach(i, SET_COUNT) usedSegments_[i] = 0;
+
+            victimCount_ = 0;
+            residentLines_ = 0;
+            residentSegments_ = 0;
+            update_stats();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        W64 CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::tagOf(W64 address)
+        {
+            return floor(address, LINE_SIZE);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        int CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::find(int set, W64 tag) const
+        {
+            const Entry *entries = &entries_[set * TAGS];
+            foreach(i, TAGS) {
+                if(entries[i].tag == tag)
+                    return i;
+            }
+            return -1;
+        }
+
+    /* Least recently used way but 'keep', lines not in use first */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        int CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::lru(int set, int keep) const
+        {
+            const Entry *entries = &entries_[set * TAGS];
+            const CacheLine *lines = &lines_[set * TAGS];
+            int way = -1;
+            bool wayUnused = false;
+
+            foreach(i, TAGS) {
+                if(i == keep || entries[i].tag == INVALID)
+                    continue;
+
+                bool unused = (lines[i].state == 0);
+                if(way < 0 || (unused && !wayUnused) ||
+                        (unused == wayUnused &&
+                         entries[i].stamp < entries[way].stamp)) {
+                    way = i;
+                    wayUnused = unused;
+                }
+            }
+            return way;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        int CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::fill_segments(W64 tag)
+        {
+            W64 words[LINE_WORDS];
+            int size = LINE_SIZE;
+
+            if(cache_line_reader && cache_line_reader(tag, words, LINE_WORDS))
+                size = line_compressed_size(COMPRESSION, words, LINE_SIZE);
+            else
+                unknownFills_++;
+
+            fills_++;
+            fillBytes_ += LINE_SIZE;
+            fillCompressedBytes_ += size;
+
+            return max((size + SEGMENT_SIZE - 1) / SEGMENT_SIZE, 1);
+        }
+
+    /* Drop an extra victim, the controller evicts the ones in use */
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::evict(int set, int way)
+        {
+            Entry &entry = entries_[set * TAGS + way];
+            CacheLine &line = lines_[set * TAGS + way];
+
+            if(line.state && victimCount_ < TAGS) {
+                victims_[victimCount_].tag = entry.tag;
+                victims_[victimCount_].state = line.state;
+                victimCount_++;
+            }
+
+            usedSegments_[set] -= entry.segments;
+            residentSegments_ -= entry.segments;
+            residentLines_--;
+            extraEvictions_++;
+
+            entry.tag = INVALID;
+            entry.segments = 0;
+            line.reset();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::make_room(int set, int segments, int keep)
+        {
+            while(usedSegments_[set] + segments > SEGMENTS) {
+                int way = lru(set, keep);
+                assert(way >= 0);
+                evict(set, way);
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        CacheLine* CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::probe(MemoryRequest *request)
+        {
+            W64 physAddress = request->get_physical_address();
+            int set = setof(physAddress);
+            int way = find(set, tagOf(physAddress));
+
+            if(way < 0) return NULL;
+
+            entries_[set * TAGS + way].stamp = ++clock_;
+            return &lines_[set * TAGS + way];
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        CacheLine* CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::insert(MemoryRequest *request, W64& oldTag)
+        {
+            W64 physAddress = request->get_physical_address();
+            W64 tag = tagOf(physAddress);
+            int set = setof(physAddress);
+            int segments = fill_segments(tag);
+
+            victimCount_ = 0;
+
+            int way = find(set, tag);
+            if(way >= 0) {
+                /* Filled again, its size may have changed */
+                Entry &entry = entries_[set * TAGS + way];
+                usedSegments_[set] -= entry.segments;
+                residentSegments_ -= entry.segments;
+                residentLines_--;
+            } else {
+                way = find(set, INVALID);
+                if(way < 0) {
+                    way = lru(set, -1);
+                    Entry &entry = entries_[set * TAGS + way];
+                    usedSegments_[set] -= entry.segments;
+                    residentSegments_ -= entry.segments;
+                    residentLines_--;
+                }
+                oldTag = entries_[set * TAGS + way].tag;
+            }
+
+            Entry &entry = entries_[set * TAGS + way];
+            entry.tag = tag;
+            entry.segments = 0;
+            make_room(set, segments, way);
+
+            entry.segments = segments;
+            entry.stamp = ++clock_;
+            usedSegments_[set] += segments;
+            residentSegments_ += segments;
+            residentLines_++;
+            update_stats();
+
+            return &lines_[set * TAGS + way];
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        int CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::invalidate(MemoryRequest *request)
+        {
+            W64 physAddress = request->get_physical_address();
+            int set = setof(physAddress);
+            int way = find(set, tagOf(physAddress));
+            if(way < 0) return -1;
+
+            Entry &entry = entries_[set * TAGS + way];
+            usedSegments_[set] -= entry.segments;
+            residentSegments_ -= entry.segments;
+            residentLines_--;
+
+            entry.tag = INVALID;
+            entry.segments = 0;
+            lines_[set * TAGS + way].reset();
+            update_stats();
+            return way;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        bool CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::get_port(MemoryRequest *request)
+        {
+            return ports_.get_port(request);
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        int CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::hit_latency(const CacheLine *line)
+        {
+            if(line < lines_ || line >= lines_ + SET_COUNT * TAGS)
+                return 0;
+
+            if(entries_[line - lines_].segments * SEGMENT_SIZE >= LINE_SIZE)
+                return 0;
+
+            compressedHits_++;
+            decompressCycles_ += DECOMPRESS_LATENCY;
+            update_stats();
+            return DECOMPRESS_LATENCY;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        bool CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::pop_victim(W64& tag, W8& state)
+        {
+            if(!victimCount_)
+                return false;
+
+            victimCount_--;
+            tag = victims_[victimCount_].tag;
+            state = victims_[victimCount_].state;
+            return true;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::register_stats(Statable *parent)
+        {
+            if(stats_) return;
+
+            stats_ = new CompressionStats("compression", parent);
+            stats_->set_default_stats(user_stats);
+
+            W64 capacity = get_size();
+            stats_->capacity = capacity;
+            update_stats();
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::update_stats()
+        {
+            if(!stats_) return;
+
+            W64 residentBytes = residentLines_ * LINE_SIZE;
+            W64 residentCompressed = residentSegments_ * SEGMENT_SIZE;
+            stats_->resident_lines = residentLines_;
+            stats_->resident_bytes = residentBytes;
+            stats_->resident_compressed_bytes = residentCompressed;
+            stats_->fills = fills_;
+            stats_->unknown_fills = unknownFills_;
+            stats_->fill_bytes = fillBytes_;
+            stats_->fill_compressed_bytes = fillCompressedBytes_;
+            stats_->extra_evictions = extraEvictions_;
+            stats_->compressed_hits = compressedHits_;
+            stats_->decompress_cycles = decompressCycles_;
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::print(ostream& os) const
+        {
+            foreach(i, SET_COUNT * TAGS) {
+                os << lines_[i];
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::count_clos_lines(W64 *lines) const
+        {
+            foreach(i, SET_COUNT * TAGS) {
+                const CacheLine &line = lines_[i];
+                if(line.state && line.tag != (W64)-1)
+                    lines[line.clos]++;
+            }
+        }
+
+    template <int SET_COUNT, int WAY_COUNT, int LINE_SIZE, int LATENCY,
+             int COMPRESSION, int DECOMPRESS_LATENCY, int TAG_FACTOR>
+        void CompressedCacheLines<SET_COUNT, WAY_COUNT, LINE_SIZE, LATENCY, COMPRESSION, DECOMPRESS_LATENCY, TAG_FACTOR>::get_valid_lines(dynarray<CacheLine> &lines) const
+        {
+            foreach(i, SET_COUNT * TAGS) {
+                const CacheLine &line = lines_[i];
+                if(line.state && line.tag != (W64)-1)
+                    lines.push(line);
+            }
+        }
+
 };
 
 #endif // CACHE_LINES_H
@@ -0,0 +1,189 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <cacheSlice.h>
+#include <logic.h>
+#include <machine.h>
+
+using namespace Memory;
+
+/*
+ * Slices interleave whole 64 byte lines, all caches of a banked level use
+ * this line size.
+ */
+#define SLICE_LINE_SIZE 64
+
+template <int slices>
+static inline int slice_of(W64 address, SliceHash hash)
+{
+    if (hash == SLICE_HASH_CRC)
+        return CRCCacheIndexingFunction<W64, slices,
+               SLICE_LINE_SIZE>::setof(address);
+
+    return XORCacheIndexingFunction<W64, slices,
+           SLICE_LINE_SIZE>::setof(address);
+}
+
+void CacheSlice::setup(BaseMachine &machine, const char *name, int idx)
+{
+    stringbuf hashName;
+
+    if (!machine.get_option(name, "slices", count))
+        count = 1;
+
+    if (count <= 1) {
+        count = 1;
+        index = 0;
+        return;
+    }
+
+    if (count > MAX_CACHE_SLICES || (count & (count - 1))) {
+        ptl_logfile << "ERROR: " << name << " slices must be a power of 2 ";
+        ptl_logfile << "up to " << MAX_CACHE_SLICES << ", not " << count;
+        ptl_logfile << endl;
+        assert(0);
+    }
+
+    index = idx;
+    if (index >= count) {
+        ptl_logfile << "ERROR: " << name << " is slice " << index;
+        ptl_logfile << " of a cache with " << count << " slices, ";
+        ptl_logfile << "check its 'insts' and 'slices'" << endl;
+        assert(0);
+    }
+
+    hash = SLICE_HASH_XOR;
+    if (machine.get_option(name, "slice_hash", hashName)) {
+        if (hashName == "crc") {
+            hash = SLICE_HASH_CRC;
+        } else if (!(hashName == "xor")) {
+            ptl_logfile << "ERROR: Unknown slice_hash '" << hashName;
+            ptl_logfile << "' for " << name << endl;
+            assert(0);
+        }
+    }
+}
+
+/* Value of option 'opt' of controller name, a power of 2 or assert */
+static int get_power_of_2(BaseMachine &machine, const char *name,
+        const char *opt, int def)
+{
+    int value;
+
+    if (!machine.get_option(name, opt, value))
+        value = def;
+
+    if (value <= 0 || (value & (value - 1))) {
+        ptl_logfile << "ERROR: " << name << " " << opt;
+        ptl_logfile << " must be a power of 2, not " << value << endl;
+        assert(0);
+    }
+
+    return value;
+}
+
+void CacheSlice::setup_interleave(BaseMachine &machine, const char *name,
+        int idx)
+{
+    int channels = get_power_of_2(machine, name, "interleave", 1);
+    int sockets = get_power_of_2(machine, name, "sockets", 1);
+
+    count = channels * sockets;
+    index = 0;
+    hash = SLICE_HASH_BITS;
+    channelBits = lsbindex32(channels);
+    socketBits = lsbindex32(sockets);
+
+    if (!machine.get_option(name, "interleave_bit", channelShift))
+        channelShift = 6;
+    if (!machine.get_option(name, "socket_bit", socketShift))
+        socketShift = 0;
+
+    if (count == 1) {
+        hash = SLICE_HASH_XOR;
+        return;
+    }
+
+    if (count > MAX_CACHE_SLICES) {
+        ptl_logfile << "ERROR: " << name << " interleave * sockets must ";
+        ptl_logfile << "be at most " << MAX_CACHE_SLICES << endl;
+        assert(0);
+    }
+
+    if (channelBits && (channelShift < 6 || channelShift +
+                channelBits > 48)) {
+        ptl_logfile << "ERROR: " << name << " interleave_bit must be ";
+        ptl_logfile << "a physical address bit of a line number" << endl;
+        assert(0);
+    }
+
+    /* Socket bits are kept above channel bits so they never overlap */
+    if (socketBits && (socketShift < channelShift + channelBits ||
+                socketShift + socketBits > 48)) {
+        ptl_logfile << "ERROR: " << name << " needs a socket_bit above ";
+        ptl_logfile << "its channel bits (interleave_bit ";
+        ptl_logfile << channelShift << ", " << channelBits << " bits)";
+        ptl_logfile << endl;
+        assert(0);
+    }
+
+    index = idx;
+    if (index >= count) {
+        ptl_logfile << "ERROR: " << name << " is memory controller ";
+        ptl_logfile << index << " of " << count << " (interleave * ";
+        ptl_logfile << "sockets), check its 'insts'" << endl;
+        assert(0);
+    }
+}
+
+int CacheSlice::get_slice(W64 address) const
+{
+    if (hash == SLICE_HASH_BITS) {
+        int socket = bits(address, socketShift, socketBits);
+        int channel = bits(address, channelShift, channelBits);
+        return (socket << channelBits) | channel;
+    }
+
+    switch (count) {
+        case 1:  return 0;
+        case 2:  return slice_of<2>(address, hash);
+        case 4:  return slice_of<4>(address, hash);
+        case 8:  return slice_of<8>(address, hash);
+        case 16: return slice_of<16>(address, hash);
+        case 32: return slice_of<32>(address, hash);
+        case 64: return slice_of<64>(address, hash);
+        default: assert(0);
+    }
+
+    return 0;
+}
+
+void CacheSlice::dump_configuration(YAML::Emitter &out) const
+{
+    const char *hashName = (hash == SLICE_HASH_CRC) ? "crc" : "xor";
+
+    if (hash == SLICE_HASH_BITS) {
+        YAML_KEY_VAL(out, "interleave", 1 << channelBits);
+        YAML_KEY_VAL(out, "interleave_bit", channelShift);
+        YAML_KEY_VAL(out, "sockets", 1 << socketBits);
+        YAML_KEY_VAL(out, "socket_bit", socketShift);
+        YAML_KEY_VAL(out, "controller", index);
+        return;
+    }
+
+    YAML_KEY_VAL(out, "slices", count);
+    YAML_KEY_VAL(out, "slice", index);
+    YAML_KEY_VAL(out, "slice_hash", hashName);
+}
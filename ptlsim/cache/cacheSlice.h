@@ -0,0 +1,118 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef CACHE_SLICE_H
+#define CACHE_SLICE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+    enum SliceHash {
+        SLICE_HASH_XOR,
+        SLICE_HASH_CRC,
+        SLICE_HASH_BITS, /* interleaved memory controllers */
+    };
+
+    /* Largest supported number of slices of a banked cache */
+    #define MAX_CACHE_SLICES 64
+
+    /**
+     * @brief Address to slice mapping of a banked cache
+     *
+     * A banked cache is built from 'insts' controllers of the same cache,
+     * each one is a slice with its own queues and interconnect port and
+     * holds the lines whose address hashes to its index.  The hash folds
+     * all line address bits, so unlike slicing on the low set index bits
+     * every set of each slice stays in use.
+     *
+     * Options, set on the cache instances:
+     *   slices     : number of slices, a power of 2 up to MAX_CACHE_SLICES,
+     *                1 (not banked) by default
+     *   slice_hash : 'xor' (default) or 'crc'
+     *
+     * Memory controllers use setup_interleave() instead: 'insts' memory
+     * controllers split the physical address space on plain address bits,
+     * so an address maps to one controller the way it maps to one channel
+     * and socket of a real machine.  The controller index is
+     * socket * interleave + channel, with the options:
+     *   interleave     : controllers per socket, a power of 2, 1 by
+     *                    default
+     *   interleave_bit : lowest address bit of the channel, 6 (lines) by
+     *                    default, 12 interleaves pages
+     *   sockets        : number of sockets (NUMA nodes), a power of 2,
+     *                    1 by default
+     *   socket_bit     : lowest address bit of the socket, required with
+     *                    more than one socket, e.g. 30 for 1GB per node
+     */
+    struct CacheSlice
+    {
+        int count;
+        int index;
+        SliceHash hash;
+
+        /* SLICE_HASH_BITS only */
+        int channelBits;
+        int channelShift;
+        int socketBits;
+        int socketShift;
+
+        CacheSlice()
+            : count(1)
+              , index(0)
+              , hash(SLICE_HASH_XOR)
+              , channelBits(0)
+              , channelShift(6)
+              , socketBits(0)
+              , socketShift(0)
+        {}
+
+        void setup(BaseMachine &machine, const char *name, int idx);
+        void setup_interleave(BaseMachine &machine, const char *name,
+                int idx);
+
+        bool is_sliced() const { return count > 1; }
+
+        /* Index of the slice that holds given physical address */
+        int get_slice(W64 address) const;
+
+        bool owns(W64 address) const {
+            return count <= 1 || get_slice(address) == index;
+        }
+
+        /*
+         * Address within the controller's own memory: the channel and
+         * socket bits taken out, so its banks and DRAMSim2 see a dense
+         * address space instead of one with constant bits
+         */
+        W64 local_address(W64 address) const {
+            if likely (hash != SLICE_HASH_BITS)
+                return address;
+
+            /* socket bits are above channel bits, remove them first */
+            address = remove_bits(address, socketShift, socketBits);
+            return remove_bits(address, channelShift, channelBits);
+        }
+
+        static W64 remove_bits(W64 address, int shift, int bits) {
+            if (!bits)
+                return address;
+            return ((address >> (shift + bits)) << shift) |
+                lowbits(address, shift);
+        }
+
+        void dump_configuration(YAML::Emitter &out) const;
+    };
+
+};
+
+#endif // CACHE_SLICE_H
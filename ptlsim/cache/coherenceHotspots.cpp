@@ -0,0 +1,133 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <ptlsim.h>
+#include <coherenceHotspots.h>
+#include <memoryRequest.h>
+
+using namespace Memory;
+
+bool Memory::coherence_hotspots_enabled = false;
+
+CoherenceHotspots Memory::coherence_hotspots;
+
+namespace {
+    const int TOP_LINES = 16;
+
+    struct CoherenceHotspotStats : public Statable
+    {
+        StatObj<W64> line;
+        StatObj<W64> invalidations;
+        StatObj<W64> cores;
+        StatObj<W64> shared_words;
+        StatObj<W64> false_sharing;
+        StatArray<W64, NUM_SIM_CORES> rip;
+
+        CoherenceHotspotStats(stringbuf &name, Statable *parent)
+            : Statable(name, parent)
+              , line("line", this)
+              , invalidations("invalidations", this)
+              , cores("cores", this)
+              , shared_words("shared_words", this)
+              , false_sharing("false_sharing", this)
+              , rip("rip", this)
+        {}
+    };
+
+    Statable *hotspots_root = NULL;
+    CoherenceHotspotStats *hotspots_nodes[TOP_LINES];
+
+    /* Most invalidations first */
+    struct InvalidationsComparator {
+        int operator ()(const CoherenceHotspotEntry *a,
+                const CoherenceHotspotEntry *b) const {
+            if (a->invalidations == b->invalidations) return 0;
+            return (a->invalidations > b->invalidations) ? -1 : +1;
+        }
+    };
+};
+
+int CoherenceHotspots::top(CoherenceHotspotEntry **list, int count)
+{
+    dynarray<CoherenceHotspotEntry*> used;
+
+    foreach (i, TRACKED) {
+        if (tracked[i].estimate)
+            used.push(&tracked[i]);
+    }
+
+    sort(used.data, used.length, InvalidationsComparator());
+
+    int n = min(count, (int)used.length);
+    foreach (i, n) list[i] = used[i];
+    return n;
+}
+
+void Memory::coherence_hotspots_register()
+{
+    if (hotspots_root)
+        return;
+
+    hotspots_root = new Statable("coherence_hotspots");
+    hotspots_root->disable_dump();
+
+    foreach (i, TOP_LINES) {
+        stringbuf name;
+        name << "top", i;
+        hotspots_nodes[i] = new CoherenceHotspotStats(name, hotspots_root);
+    }
+}
+
+void Memory::coherence_hotspot_invalidation(MemoryRequest *request)
+{
+    coherence_hotspots.invalidation(request->get_physical_address());
+}
+
+void Memory::coherence_hotspot_access(MemoryRequest *request)
+{
+    coherence_hotspots.access(request->get_physical_address(),
+            request->get_coreid(),
+            request->get_type() == MEMORY_OP_WRITE,
+            request->get_owner_rip());
+}
+
+void Memory::coherence_hotspots_set_stats()
+{
+    if (!hotspots_root || !coherence_hotspots_enabled)
+        return;
+
+    CoherenceHotspotEntry *top[TOP_LINES];
+    int count = coherence_hotspots.top(top, TOP_LINES);
+
+    hotspots_root->enable_dump();
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+    foreach (s, 3) {
+        hotspots_root->set_default_stats(stats[s]);
+
+        foreach (i, count) {
+            CoherenceHotspotStats& node = *hotspots_nodes[i];
+            CoherenceHotspotEntry& e = *top[i];
+            W64 line = e.line << CoherenceHotspots::LINE_SHIFT;
+            W64 invalidations = e.invalidations;
+            W64 cores = e.cores();
+            W64 shared_words = e.shared_words();
+            W64 false_sharing = e.false_sharing();
+
+            node.line = line;
+            node.invalidations = invalidations;
+            node.cores = cores;
+            node.shared_words = shared_words;
+            node.false_sharing = false_sharing;
+            foreach (c, NUM_SIM_CORES)
+                node.rip[c] = e.rip[c];
+        }
+    }
+}
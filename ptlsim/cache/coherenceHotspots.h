@@ -0,0 +1,194 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef COHERENCE_HOTSPOTS_H
+#define COHERENCE_HOTSPOTS_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+class MemoryRequest;
+
+/*
+ * Coherence hot spot detector ('-coherence-hotspots')
+ *
+ * The coherence logics report each line of a core's lowest private cache
+ * that a snoop invalidates. Invalidations go into a count-min sketch over
+ * line addresses, which estimates the invalidations of any line in fixed
+ * memory and never under counts. Once a line's estimate reaches
+ * TRACK_THRESHOLD it gets an entry in a small direct mapped table, which
+ * from then on also records which 8 byte words of the line each core
+ * reads and writes, and the last rip of each core that touched it.
+ *
+ * A tracked line has true sharing if a word written by one core is
+ * accessed by another, and false sharing if several cores write it but
+ * always to different words: padding or splitting the line would remove
+ * its invalidations.
+ *
+ * The most invalidated lines are written to the 'coherence_hotspots'
+ * stats node:
+ *
+ *   coherence_hotspots:
+ *     top0: {line: .., invalidations: .., cores: .., shared_words: ..,
+ *            false_sharing: .., rip: [..]}
+ */
+extern bool coherence_hotspots_enabled;
+
+struct CoherenceHotspotEntry {
+    W64 line;
+    W32 estimate;      /* sketch estimate when last updated */
+    W32 invalidations; /* counted since tracked */
+    W8 read_words[NUM_SIM_CORES];
+    W8 write_words[NUM_SIM_CORES];
+    W64 rip[NUM_SIM_CORES];
+
+    void reset(W64 l = 0) {
+        line = l;
+        estimate = invalidations = 0;
+        foreach (i, NUM_SIM_CORES) {
+            read_words[i] = write_words[i] = 0;
+            rip[i] = 0;
+        }
+    }
+
+    /* Bitmask of the cores that accessed the line */
+    W64 cores() const {
+        W64 mask = 0;
+        foreach (i, NUM_SIM_CORES) {
+            if (read_words[i] | write_words[i]) mask |= (1ULL << i);
+        }
+        return mask;
+    }
+
+    /* Words written by a core and accessed by another one */
+    int shared_words() const {
+        W8 shared = 0;
+        foreach (i, NUM_SIM_CORES) {
+            W8 others = 0;
+            foreach (j, NUM_SIM_CORES) {
+                if (j != i) others |= read_words[j] | write_words[j];
+            }
+            shared |= write_words[i] & others;
+        }
+        return popcount(shared);
+    }
+
+    bool false_sharing() const {
+        int writers = 0;
+        foreach (i, NUM_SIM_CORES) writers += (write_words[i] != 0);
+        return writers > 1 && shared_words() == 0;
+    }
+};
+
+struct CoherenceHotspots {
+    static const int LINE_SHIFT = 6;
+    static const int SKETCH_DEPTH = 4;
+    static const int SKETCH_WIDTH = 4096;
+    static const int TRACKED = 256;
+    static const W32 TRACK_THRESHOLD = 8;
+
+    W32 sketch[SKETCH_DEPTH][SKETCH_WIDTH];
+    CoherenceHotspotEntry tracked[TRACKED];
+
+    CoherenceHotspots() { reset(); }
+
+    void reset() {
+        memset(sketch, 0, sizeof(sketch));
+        foreach (i, TRACKED) tracked[i].reset();
+    }
+
+    static W64 line_of(W64 addr) {
+        return addr >> LINE_SHIFT;
+    }
+
+    static int sketch_index(W64 line, int row) {
+        static const W64 seeds[SKETCH_DEPTH] = {
+            0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+            0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+        };
+        return int(((line + 1) * seeds[row]) >> 52) % SKETCH_WIDTH;
+    }
+
+    /* Tracked entry of the line, or NULL */
+    CoherenceHotspotEntry* find(W64 line) {
+        CoherenceHotspotEntry& e = tracked[line % TRACKED];
+        return (e.estimate && e.line == line) ? &e : NULL;
+    }
+
+    /* Estimated invalidations of the line */
+    W32 estimate(W64 line) const {
+        W32 est = (W32)-1;
+        foreach (i, SKETCH_DEPTH)
+            est = min(est, sketch[i][sketch_index(line, i)]);
+        return est;
+    }
+
+    /* Line at addr was invalidated in a core's private cache */
+    void invalidation(W64 addr) {
+        W64 line = line_of(addr);
+        W32 est = (W32)-1;
+
+        foreach (i, SKETCH_DEPTH) {
+            W32& count = sketch[i][sketch_index(line, i)];
+            count++;
+            est = min(est, count);
+        }
+
+        CoherenceHotspotEntry& e = tracked[line % TRACKED];
+        if (e.estimate && e.line == line) {
+            e.invalidations++;
+        } else if (est >= TRACK_THRESHOLD && est > e.estimate) {
+            /* Replaces a line invalidated less often */
+            e.reset(line);
+            e.invalidations = 1;
+        } else {
+            return;
+        }
+
+        e.estimate = est;
+    }
+
+    /* Core accessed the 8 byte word at addr */
+    void access(W64 addr, int core, bool write, W64 rip) {
+        CoherenceHotspotEntry *e = find(line_of(addr));
+        if likely (!e || core >= NUM_SIM_CORES) return;
+
+        W8 word = W8(1 << bits(addr, 3, LINE_SHIFT - 3));
+        if (write)
+            e->write_words[core] |= word;
+        else
+            e->read_words[core] |= word;
+        if (rip) e->rip[core] = rip;
+    }
+
+    /* Fill list with the count tracked lines of most invalidations */
+    int top(CoherenceHotspotEntry **list, int count);
+};
+
+extern CoherenceHotspots coherence_hotspots;
+
+/* Create the 'coherence_hotspots' stats node, once */
+void coherence_hotspots_register();
+
+/* A snoop invalidated the line of request in a lowest private cache */
+void coherence_hotspot_invalidation(MemoryRequest *request);
+
+/* A core accessed the line of request */
+void coherence_hotspot_access(MemoryRequest *request);
+
+/* Dump the 'coherence_hotspots' node if '-coherence-hotspots' is set */
+void coherence_hotspots_set_stats();
+
+};
+
+#endif // COHERENCE_HOTSPOTS_H
@@ -33,6 +33,7 @@
 #include <controller.h>
 #include <statsBuilder.h>
 #include <cacheLines.h>
+#include <coherenceHotspots.h>
 
 namespace Memory {
 
@@ -43,6 +44,58 @@ namespace Memory {
         class CacheController;
         class CacheQueueEntry;
 
+        /*
+         * Table driven state transitions
+         *
+         * A protocol describes what happens to a line on an event with a
+         * table of CoherenceTransition indexed by old line state and
+         * request type. Protocols keep one table per event (snoop hit,
+         * request fill) and per variant of it that changes the outcome,
+         * like a private level being the lowest one, so handlers only
+         * look up an entry and perform its actions instead of walking
+         * nested switches. Adding a protocol is adding its tables.
+         */
+        enum CoherenceAction {
+            COH_NONE           = 0,
+            COH_ERROR          = 1 << 0,  /* Transition is not possible */
+            COH_STATE_FROM_ARG = 1 << 1,  /* New state is in request arg */
+            COH_SHARED         = 1 << 2,  /* Response marks line shared */
+            COH_NO_DATA        = 1 << 3,  /* Response carries no line */
+            COH_UPDATE_LOWER   = 1 << 4,  /* Write back to lower level */
+            COH_EVICT_UPPER    = 1 << 5,  /* Invalidate upper levels */
+            COH_UPDATE_UPPER   = 1 << 6,  /* Update upper levels state */
+            COH_EVICT          = 1 << 7,  /* Protocol evict of the line */
+            COH_EVICT_DIR      = 1 << 8,  /* Same, directory included */
+            COH_CLEAR          = 1 << 9,  /* Clear the queue entry */
+            COH_DONE           = 1 << 10, /* Clear entry, no response */
+        };
+
+        struct CoherenceTransition {
+            W8  next;
+            W16 actions;
+        };
+
+#define COH_T(next, actions) { (W8)(next), (W16)(actions) }
+
+        /* Coherence messages sent by a protocol, to compare protocols */
+        struct CoherenceTraffic : public Statable
+        {
+            StatObj<W64> data_responses;
+            StatObj<W64> dataless_responses;
+            StatObj<W64> invalidations;
+            StatObj<W64> writebacks;
+            StatObj<W64> upper_updates;
+
+            CoherenceTraffic(const char *name, Statable *parent)
+                : Statable(name, parent)
+                  , data_responses("data_responses", this)
+                  , dataless_responses("dataless_responses", this)
+                  , invalidations("invalidations", this)
+                  , writebacks("writebacks", this)
+                  , upper_updates("upper_updates", this)
+            {}
+        };
+
         class CoherenceLogic : public Statable
         {
             public:
@@ -51,7 +104,9 @@ namespace Memory {
                     : Statable(name, parent)
                       , controller(cont)
                       , memoryHierarchy(mem)
-            {}
+            {
+                coherence_hotspots_register();
+            }
 
                 virtual void handle_local_hit(CacheQueueEntry *entry)      = 0;
                 virtual void handle_local_miss(CacheQueueEntry *entry)     = 0;
@@ -64,8 +119,16 @@ namespace Memory {
                         Message &message)                                  = 0;
                 virtual bool is_line_valid(CacheLine *line)                = 0;
                 virtual void invalidate_line(CacheLine *line)              = 0;
+                /* Set state of a line installed by functional warmup */
+                virtual void warm_line(CacheLine *line)                    = 0;
                 virtual void handle_response(CacheQueueEntry *entry,
                         Message &message) = 0;
+                /*
+                 * Count a read hit of an upper cache served without a
+                 * queue entry, false if the protocol needs the event path
+                 */
+                virtual bool fast_read_hit(CacheLine *line,
+                        MemoryRequest *request) { return false; }
 				virtual void dump_configuration(YAML::Emitter &out) const = 0;
 
                 CacheController* controller;
@@ -42,6 +42,9 @@
 using namespace Memory;
 using namespace Memory::CoherentCache;
 
+bool Memory::fast_fill_enabled = false;
+bool Memory::fast_fill_check = false;
+
 
 CacheController::CacheController(W8 coreid, const char *name,
         MemoryHierarchy *memoryHierarchy, CacheType type) :
@@ -50,22 +53,95 @@ CacheController::CacheController(W8 coreid, const char *name,
     , isLowestPrivate_(false)
     , directory_(NULL)
     , lowerCont_(NULL)
+    , inclusion_(INCLUSION_INCLUSIVE)
+    , lowerExclusive_(false)
+    , insertVictimTag_(InvalidTag<W64>::INVALID)
+    , insertVictimState_(0)
+    , victimSent_(false)
+    , inclusionStats_(NULL)
+    , victimUseCounter_(0)
+    , victimLatency_(1)
+    , victimStats_(NULL)
+    , fastFillStats_(NULL)
+    , stackDistance_(NULL)
     , coherence_logic_(NULL)
 {
     memoryHierarchy_->add_cache_mem_controller(this);
+    level_ = type_;
     new_stats = new MESIStats(name, &memoryHierarchy->get_machine());
 
     cacheLines_ = get_cachelines(type);
+    cacheLines_->register_stats(new_stats);
+    qos_setup_cache(memoryHierarchy_->get_machine(), name, cacheLines_);
+
+    int banks = 1;
+    int bankBytes = 8;
+    int bankPorts = 1;
+    memoryHierarchy_->get_machine().get_option(name, "banks", banks);
+    memoryHierarchy_->get_machine().get_option(name, "bank_bytes", bankBytes);
+    memoryHierarchy_->get_machine().get_option(name, "bank_ports", bankPorts);
+    if(!cacheLines_->ports().set_banks(banks, bankBytes, bankPorts)) {
+        ptl_logfile << "ERROR: ", name, " needs a power of 2 banks of at ",
+                    "most ", CACHE_MAX_BANKS, ", a power of 2 bank_bytes ",
+                    "and bank_ports > 0", endl;
+        assert(0);
+    }
 
     if(!memoryHierarchy_->get_machine().get_option(name, "last_private", isLowestPrivate_)) {
         isLowestPrivate_ = false;
     }
 
+    slice_.setup(memoryHierarchy_->get_machine(), name, coreid);
+
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+    stringbuf inclusion;
+
+    if(machine.get_option(name, "inclusion", inclusion)) {
+        if(inclusion == "non_inclusive") {
+            inclusion_ = INCLUSION_NON_INCLUSIVE;
+        } else if(inclusion == "exclusive") {
+            inclusion_ = INCLUSION_EXCLUSIVE;
+        } else if(!(inclusion == "inclusive")) {
+            ptl_logfile << "ERROR: Unknown inclusion '" << inclusion <<
+                "' for " << name << endl;
+            assert(0);
+        }
+
+        if(inclusion_ != INCLUSION_INCLUSIVE && !isLowestPrivate_) {
+            ptl_logfile << "ERROR: " << name << " inclusion applies to " <<
+                "last_private caches only" << endl;
+            assert(0);
+        }
+    }
+
+    if(isLowestPrivate_)
+        inclusionStats_ = new InclusionStats("inclusion", new_stats);
+
+    int victimEntries = 0;
+    if(!machine.get_option(name, "victim_cache", victimEntries))
+        victimEntries = 0;
+
+    if(victimEntries > 0) {
+        victims_.resize(victimEntries);
+        foreach (i, victims_.count()) {
+            victims_[i].valid = false;
+        }
+
+        if(!machine.get_option(name, "victim_latency", victimLatency_))
+            victimLatency_ = 1;
+
+        victimStats_ = new VictimCacheStats("victim_cache", new_stats);
+    }
+
+    fastFillStats_ = new FastFillStats("fast_fill", new_stats);
+
     cacheLineBits_ = cacheLines_->get_line_bits();
-    cacheAccessLatency_ = cacheLines_->get_access_latency();
 
     cacheLines_->init();
+    config_changed();
 
+    stackDistance_ = stack_distance_create(machine, name,
+            cacheLines_->get_set_count(), cacheLineBits_, new_stats);
 
     SET_SIGNAL_CB(name, "_Cache_Hit", cacheHit_, &CacheController::cache_hit_cb);
 
@@ -92,32 +168,54 @@ CacheController::CacheController(W8 coreid, const char *name,
 
 CacheController::~CacheController()
 {
+    delete inclusionStats_;
+    delete victimStats_;
+    delete fastFillStats_;
     delete new_stats;
 }
 
+/**
+ * @brief Re-read latency and replacement options
+ *
+ * 'latency' in cache cycles overrides the LATENCY param, 'replacement'
+ * switches between policies that keep the same state, see replacement.h.
+ */
+void CacheController::config_changed()
+{
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    if (!machine.get_option(get_name(), "latency", cacheAccessLatency_))
+        cacheAccessLatency_ = cacheLines_->get_access_latency();
+
+    stringbuf replacement;
+    if (machine.get_option(get_name(), "replacement", replacement) &&
+            !cacheLines_->set_replacement(replacement)) {
+        ptl_logfile << "ERROR: " << get_name() << " can't switch to " <<
+            "replacement '" << replacement << "'" << endl;
+        assert(0);
+    }
+}
+
 CacheQueueEntry* CacheController::find_dependency(MemoryRequest *request)
 {
     W64 requestLineAddress = get_line_address(request);
 
-    CacheQueueEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_.list(), queueEntry, entry,
-            prevEntry) {
+    CacheQueueEntry* queueEntry = pendingRequests_.first(requestLineAddress);
+    for(; queueEntry; queueEntry = pendingRequests_.next(queueEntry)) {
 
         if(request == queueEntry->request || queueEntry->annuled)
             continue;
 
-        if(get_line_address(queueEntry->request) == requestLineAddress) {
-            /*
-             * Found an entry with same line address, check if other
-             * entry also depends on this entry or not and to
-             * maintain a chain of dependent entries, return the
-             * last entry in the chain
-             */
-            while(queueEntry->depends >= 0)
-                queueEntry = &pendingRequests_[queueEntry->depends];
+        /*
+         * Found an entry with same line address, check if other
+         * entry also depends on this entry or not and to
+         * maintain a chain of dependent entries, return the
+         * last entry in the chain
+         */
+        while(queueEntry->depends >= 0)
+            queueEntry = &pendingRequests_[queueEntry->depends];
 
-            return queueEntry;
-        }
+        return queueEntry;
     }
     return NULL;
 }
@@ -129,22 +227,14 @@ bool CacheController::is_line_in_use(W64 tag)
     }
 
     /* Check each local cache request for same line tag */
-    CacheQueueEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_.list(), queueEntry, entry,
-            prevEntry) {
-        if (get_line_address(queueEntry->request) == tag) {
-            return true;
-        }
-    }
-
-    return false;
+    return pendingRequests_.contains(tag);
 }
 
 CacheQueueEntry* CacheController::find_match(MemoryRequest *request)
 {
-    CacheQueueEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_.list(), queueEntry, entry,
-            prevEntry) {
+    CacheQueueEntry* queueEntry = pendingRequests_.first(
+            get_line_address(request));
+    for(; queueEntry; queueEntry = pendingRequests_.next(queueEntry)) {
         if(request == queueEntry->request)
             return queueEntry;
     }
@@ -172,12 +262,14 @@ bool CacheController::handle_upper_interconnect(Message &message)
     }
 
     CacheQueueEntry *queueEntry = pendingRequests_.alloc();
+    update_queue_occupancy();
 
     if(queueEntry == NULL) {
         return false;
     }
 
     queueEntry->request = message.request;
+    pendingRequests_.index(queueEntry, get_line_address(message.request));
     queueEntry->sender  = (Interconnect*)message.sender;
     queueEntry->isSnoop = false;
     queueEntry->m_arg   = message.arg;
@@ -185,6 +277,11 @@ bool CacheController::handle_upper_interconnect(Message &message)
     queueEntry->dest    = (Controller*)message.dest;
     queueEntry->request->incRefCounter();
 
+    /* Victim state is only valid while the message is delivered */
+    if(inclusion_ == INCLUSION_EXCLUSIVE && message.arg &&
+            message.request->get_type() == MEMORY_OP_UPDATE)
+        queueEntry->victimState = *(W8*)(message.arg);
+
     queueEntry->eventFlags[CACHE_ACCESS_EVENT]++;
 
     /* Check dependency and access the cache */
@@ -234,6 +331,12 @@ bool CacheController::handle_lower_interconnect(Message &message)
         }
     }
 
+    /* Anything else from below may change the line, so its victim copy
+     * can't be used anymore */
+    if(victims_.count())
+        purge_victim(get_line_tag(message.request),
+                message.request->is_kernel());
+
     if(isLowestPrivate_) {
 
         /* Ignore response that is not for this controller */
@@ -241,8 +344,10 @@ bool CacheController::handle_lower_interconnect(Message &message)
             return true;
 
         CacheQueueEntry *newEntry = pendingRequests_.alloc();
+        update_queue_occupancy();
         assert(newEntry);
         newEntry->request = message.request;
+        pendingRequests_.index(newEntry, get_line_address(message.request));
         newEntry->isSnoop = true;
         newEntry->sender  = (Interconnect*)message.sender;
         newEntry->source  = (Controller*)message.origin;
@@ -260,9 +365,12 @@ bool CacheController::handle_lower_interconnect(Message &message)
                     message.request->get_type() == MEMORY_OP_UPDATE) {
                 /* alloc new queueentry and evict the cache line if present */
                 CacheQueueEntry *evictEntry = pendingRequests_.alloc();
+                update_queue_occupancy();
                 assert(evictEntry);
 
                 evictEntry->request = message.request;
+                pendingRequests_.index(evictEntry,
+                        get_line_address(message.request));
                 evictEntry->request->incRefCounter();
                 evictEntry->isSnoop = true;
                 evictEntry->m_arg   = message.arg;
@@ -282,7 +390,7 @@ bool CacheController::is_line_valid(CacheLine *line)
     return coherence_logic_->is_line_valid(line);
 }
 
-void CacheController::send_message(CacheQueueEntry *queueEntry,
+CacheQueueEntry* CacheController::send_message(CacheQueueEntry *queueEntry,
         Interconnect *interconn, OP_TYPE type, W64 tag)
 {
     MemoryRequest *request = memoryHierarchy_->get_free_request(
@@ -297,6 +405,7 @@ void CacheController::send_message(CacheQueueEntry *queueEntry,
     request->set_op_type(type);
 
     CacheQueueEntry *evictEntry = pendingRequests_.alloc();
+    update_queue_occupancy();
     assert(evictEntry);
 
     /* set full flag if buffer is full */
@@ -305,9 +414,10 @@ void CacheController::send_message(CacheQueueEntry *queueEntry,
     }
 
     evictEntry->request = request;
+    pendingRequests_.index(evictEntry, get_line_address(request));
     evictEntry->sender  = NULL;
     evictEntry->sendTo  = interconn;
-    evictEntry->dest    = queueEntry->dest;
+    evictEntry->dest    = get_slice_owner(queueEntry->dest, tag);
     evictEntry->line    = queueEntry->line;
     evictEntry->request->incRefCounter();
 
@@ -316,10 +426,22 @@ void CacheController::send_message(CacheQueueEntry *queueEntry,
 
     evictEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
     marss_add_event(&waitInterconnect_, 1, evictEntry);
+
+    return evictEntry;
 }
 
 void CacheController::send_evict_to_upper(CacheQueueEntry *entry, W64 oldTag)
 {
+    if(oldTag != InvalidTag<W64>::INVALID && oldTag == insertVictimTag_) {
+        /* Only inclusive caches back-invalidate the lines they evict */
+        if(inclusion_ != INCLUSION_INCLUSIVE)
+            return;
+
+        if(inclusionStats_)
+            N_STAT_UPDATE(inclusionStats_->back_invalidations, ++,
+                    entry->request->is_kernel());
+    }
+
     send_message(entry, upperInterconnect_, MEMORY_OP_EVICT, oldTag);
 
     if(upperInterconnect2_)
@@ -341,18 +463,220 @@ void CacheController::send_update_to_upper(CacheQueueEntry *entry, W64 tag)
 
 void CacheController::send_update_to_lower(CacheQueueEntry *entry, W64 tag)
 {
-    entry->dest = lowerCont_;
-    send_message(entry, lowerInterconnect_, MEMORY_OP_UPDATE, tag);
+    if(tag == InvalidTag<W64>::INVALID || tag == (W64)-1)
+        entry->dest = get_lower_cont(entry->request->get_physical_address());
+    else
+        entry->dest = get_lower_cont(tag);
+
+    CacheQueueEntry *update = send_message(entry, lowerInterconnect_,
+            MEMORY_OP_UPDATE, tag);
+
+    if(lowerExclusive_ && tag != InvalidTag<W64>::INVALID &&
+            tag == insertVictimTag_) {
+        update->isVictim    = true;
+        update->victimState = insertVictimState_;
+        victimSent_         = true;
+    }
 }
 
 void CacheController::handle_cache_insert(CacheQueueEntry *queueEntry,
         W64 oldTag)
 {
+    evict_line(queueEntry, oldTag);
+
+    /*
+     * Compressed lines evict more than one line to make room, each goes
+     * through the coherence logic from a copy with its state
+     */
+    W64 victimTag;
+    W8 victimState;
+    CacheLine *line = queueEntry->line;
+    CacheLine victim;
+
+    while(cacheLines_->pop_victim(victimTag, victimState)) {
+        if(is_line_in_use(victimTag))
+            continue;
+
+        victim.reset();
+        victim.init(victimTag);
+        victim.state = victimState;
+        queueEntry->line = &victim;
+        evict_line(queueEntry, victimTag);
+    }
+
+    queueEntry->line = line;
+}
+
+void CacheController::evict_line(CacheQueueEntry *queueEntry, W64 oldTag)
+{
+    bool victim = (oldTag != InvalidTag<W64>::INVALID &&
+            oldTag != (W64)-1 && is_line_valid(queueEntry->line));
+    bool kernel = queueEntry->request->is_kernel();
+
+    if(victim && victims_.count())
+        add_victim(oldTag, queueEntry->line->state, kernel);
+
+    /*
+     * Coherence logic sends evicts and write-backs of the old line, keep
+     * the line around so send_evict_to_upper and send_update_to_lower
+     * can apply inclusion policy to them.
+     */
+    insertVictimTag_   = victim ? oldTag : InvalidTag<W64>::INVALID;
+    insertVictimState_ = queueEntry->line->state;
+    victimSent_        = false;
+
     coherence_logic_->handle_cache_insert(queueEntry, oldTag);
+
+    /* Exclusive lower cache takes clean victims too */
+    if(victim && lowerExclusive_ && !victimSent_)
+        send_update_to_lower(queueEntry, oldTag);
+
+    insertVictimTag_ = InvalidTag<W64>::INVALID;
+}
+
+/**
+ * @brief Insert a victim of upper cache into this exclusive cache
+ *
+ * @param queueEntry Update request carrying the victim
+ */
+void CacheController::insert_victim_fill(CacheQueueEntry *queueEntry)
+{
+    if(queueEntry->line == NULL) {
+        W64 oldTag = InvalidTag<W64>::INVALID;
+        CacheLine *line = cacheLines_->insert(queueEntry->request,
+                oldTag);
+
+        if (is_line_in_use(oldTag)) {
+            oldTag = -1;
+        }
+
+        queueEntry->line = line;
+        handle_cache_insert(queueEntry, oldTag);
+        queueEntry->line->init(get_line_tag(queueEntry->request));
+    }
+
+    queueEntry->line->state = queueEntry->victimState;
+
+    N_STAT_UPDATE(inclusionStats_->victim_fills, ++,
+            queueEntry->request->is_kernel());
+
+    queueEntry->eventFlags[CACHE_INSERT_EVENT]++;
+    marss_add_event(&cacheInsert_, 0, (void*)(queueEntry));
+}
+
+/**
+ * @brief Drop a line this exclusive cache just handed to upper cache
+ *
+ * Upper caches are expected on p2p interconnects, which deliver the line
+ * state along with the response before it is invalidated here.
+ */
+void CacheController::move_line_up(CacheQueueEntry *queueEntry)
+{
+    OP_TYPE type = queueEntry->request->get_type();
+
+    if(queueEntry->isSnoop || queueEntry->line == NULL ||
+            queueEntry->line == &queueEntry->bypassLine)
+        return;
+
+    if(type != MEMORY_OP_READ && type != MEMORY_OP_WRITE)
+        return;
+
+    if(!is_line_valid(queueEntry->line))
+        return;
+
+    coherence_logic_->invalidate_line(queueEntry->line);
+
+    N_STAT_UPDATE(inclusionStats_->moved_up, ++,
+            queueEntry->request->is_kernel());
+}
+
+void CacheController::add_victim(W64 tag, W8 state, bool kernel)
+{
+    VictimEntry *victim = &victims_[0];
+
+    foreach (i, victims_.count()) {
+        VictimEntry &entry = victims_[i];
+
+        if(entry.valid && entry.tag == tag) {
+            victim = &entry;
+            break;
+        }
+
+        if(!entry.valid) {
+            if(victim->valid)
+                victim = &entry;
+        } else if(victim->valid && entry.lastUse < victim->lastUse) {
+            victim = &entry;
+        }
+    }
+
+    victim->tag     = tag;
+    victim->state   = state;
+    victim->valid   = true;
+    victim->lastUse = victimUseCounter_++;
+
+    N_STAT_UPDATE(victimStats_->inserts, ++, kernel);
+}
+
+/**
+ * @brief Bring a line back from victim cache on a miss
+ *
+ * @param queueEntry Missing request
+ *
+ * @return true if the line was in victim cache, the request then
+ * continues as a hit after victim cache latency
+ */
+bool CacheController::restore_victim(CacheQueueEntry *queueEntry)
+{
+    W64 tag = get_line_tag(queueEntry->request);
+    VictimEntry *victim = NULL;
+
+    foreach (i, victims_.count()) {
+        if(victims_[i].valid && victims_[i].tag == tag) {
+            victim = &victims_[i];
+            break;
+        }
+    }
+
+    if(victim == NULL)
+        return false;
+
+    W8 state = victim->state;
+    victim->valid = false;
+
+    /* Displaced line goes to victim cache in turn */
+    W64 oldTag = InvalidTag<W64>::INVALID;
+    CacheLine *line = cacheLines_->insert(queueEntry->request, oldTag);
+
+    if (is_line_in_use(oldTag)) {
+        oldTag = -1;
+    }
+
+    queueEntry->line = line;
+    handle_cache_insert(queueEntry, oldTag);
+    line->init(tag);
+    line->state = state;
+
+    N_STAT_UPDATE(victimStats_->hits, ++,
+            queueEntry->request->is_kernel());
+
+    marss_add_event(&cacheHit_, victimLatency_, queueEntry);
+    return true;
+}
+
+void CacheController::purge_victim(W64 tag, bool kernel)
+{
+    foreach (i, victims_.count()) {
+        if(victims_[i].valid && victims_[i].tag == tag) {
+            victims_[i].valid = false;
+            N_STAT_UPDATE(victimStats_->purges, ++, kernel);
+            return;
+        }
+    }
 }
 
 bool CacheController::complete_request(Message &message,
-        CacheQueueEntry *queueEntry)
+        CacheQueueEntry *queueEntry, int responseDelay)
 {
     if (pendingRequests_.count() >= (
                 pendingRequests_.size() - 4)) {
@@ -363,8 +687,24 @@ bool CacheController::complete_request(Message &message,
      * first check that we have a valid line pointer in queue entry
      * and then check that message has data flag set
      */
+    OP_TYPE type = queueEntry->request->get_type();
+    bool fromUpper = !queueEntry->isSnoop &&
+        (type == MEMORY_OP_READ || type == MEMORY_OP_WRITE);
+    bool bypass = false;
+
+    if(queueEntry->line == NULL || queueEntry->line->tag !=
+            get_line_tag(queueEntry->request)) {
+        if(inclusion_ == INCLUSION_EXCLUSIVE && fromUpper) {
+            /* Fills for upper caches don't allocate in an exclusive cache */
+            bypass = true;
+            queueEntry->line = &queueEntry->bypassLine;
+            queueEntry->line->reset();
+            queueEntry->line->init(get_line_tag(queueEntry->request));
+        }
+    }
+
     if(queueEntry->line == NULL || queueEntry->line->tag !=
-            cacheLines_->tagOf(queueEntry->request->get_physical_address())) {
+            get_line_tag(queueEntry->request)) {
         W64 oldTag = InvalidTag<W64>::INVALID;
         CacheLine *line = cacheLines_->insert(queueEntry->request,
                 oldTag);
@@ -376,8 +716,11 @@ bool CacheController::complete_request(Message &message,
 
         queueEntry->line = line;
         handle_cache_insert(queueEntry, oldTag);
-        queueEntry->line->init(cacheLines_->tagOf(queueEntry->
-                    request->get_physical_address()));
+        queueEntry->line->init(get_line_tag(queueEntry->request));
+
+        if(inclusionStats_ && fromUpper)
+            N_STAT_UPDATE(inclusionStats_->duplicate_fills, ++,
+                    queueEntry->request->is_kernel());
     }
 
     assert(queueEntry->line);
@@ -386,13 +729,36 @@ bool CacheController::complete_request(Message &message,
     coherence_logic_->complete_request(queueEntry, message);
 
     /* insert the updated line into cache */
-    queueEntry->eventFlags[CACHE_INSERT_EVENT]++;
-    marss_add_event(&cacheInsert_, 0,
-            (void*)(queueEntry));
+    if(!bypass) {
+        queueEntry->eventFlags[CACHE_INSERT_EVENT]++;
+        marss_add_event(&cacheInsert_, 0,
+                (void*)(queueEntry));
+    }
+
+    /* A read that could have been filled at once, see fast_fill() */
+    if unlikely (queueEntry->fastFillCycle) {
+        Controller *lower = get_lower_cont(
+                queueEntry->request->get_physical_address());
+
+        if(lower && queueEntry->request->get_level() == lower->level_) {
+            bool kernel = queueEntry->request->is_kernel();
+            N_STAT_UPDATE(fastFillStats_->checked, ++, kernel);
+            if(sim_cycle + responseDelay != queueEntry->fastFillCycle)
+                N_STAT_UPDATE(fastFillStats_->mismatches, ++, kernel);
+        }
+        queueEntry->fastFillCycle = 0;
+    }
+
+    /* A read miss that went down calibrates -mem-surrogate */
+    if unlikely (queueEntry->missCycle) {
+        memoryHierarchy_->surrogate_sample(queueEntry->request,
+                sim_cycle + responseDelay - queueEntry->missCycle);
+        queueEntry->missCycle = 0;
+    }
 
     /* send back the response */
     queueEntry->sendTo = queueEntry->sender;
-    marss_add_event(&waitInterconnect_, 1, queueEntry);
+    marss_add_event(&waitInterconnect_, responseDelay, queueEntry);
 
     memdebug("Cache Request completed: " << *queueEntry << endl);
 
@@ -434,14 +800,255 @@ int CacheController::access_fast_path(Interconnect *interconnect,
      */
     if(line && is_line_valid(line) &&
             request->get_type() != MEMORY_OP_WRITE) {
+        if(!cacheLines_->ports().get_bank_port(request)) {
+            N_STAT_UPDATE(new_stats->cpurequest.stall.read.bank_conflict, ++,
+                    request->is_kernel());
+            return CACHE_BANK_CONFLICT;
+        }
+
         N_STAT_UPDATE(new_stats->cpurequest.count.hit.read.hit, ++,
                 request->is_kernel());
-        return cacheLines_->latency();
+        return cacheAccessLatency_;
     }
 
     return -1;
 }
 
+/**
+ * @brief Fill a read miss at once from an idle cache below it hits in
+ *
+ * @param queueEntry Read from the upper cache that missed here
+ *
+ * @return true if the line is filled and only the response is left,
+ * false if the read takes the event path
+ *
+ * On the event path the read goes down after this cache's latency, the
+ * lower cache answers after its own and the response goes up the cycle
+ * after. With no other request in either queue the answer is known now,
+ * so the line is filled and the response scheduled at that same cycle,
+ * without the miss, lower queue entry and hit events. Requests for the
+ * line still wait on this entry until the response is sent. With
+ * -mem-fast-fill-check the read takes the event path and its response
+ * cycle is compared with the predicted one in complete_request().
+ */
+bool CacheController::fast_fill(CacheQueueEntry *queueEntry)
+{
+    MemoryRequest *request = queueEntry->request;
+
+    /* Response delay below is in simulation cycles */
+    if(isLowestPrivate_ || !is_private() || clockDomain_ ||
+            !lowerInterconnect_ || victims_.count() ||
+            pendingRequests_.count() != 1 || request->is_annuled() ||
+            request_latency_enabled || mem_parallelism_enabled)
+        return false;
+
+    void *arg = NULL;
+    int lowerLatency = lowerInterconnect_->fill_fast_path(this, request,
+            !fast_fill_check, &arg);
+
+    if(lowerLatency < 0)
+        return false;
+
+    int delay = cacheAccessLatency_ + lowerLatency + 1;
+    fastFillStats_->enable_dump();
+
+    if(fast_fill_check) {
+        queueEntry->fastFillCycle = sim_cycle + delay;
+        return false;
+    }
+
+    N_STAT_UPDATE(fastFillStats_->fills, ++, request->is_kernel());
+
+    Message message;
+    message.init();
+    message.sender  = lowerInterconnect_;
+    message.request = request;
+    message.hasData = true;
+    message.arg     = arg;
+
+    bool completed = complete_request(message, queueEntry, delay);
+    assert(completed);
+    return true;
+}
+
+/**
+ * @brief Fill a read miss of an L1 cache from the -mem-surrogate model
+ *
+ * @param queueEntry Read from the core that missed here
+ *
+ * @return true if the line is filled and only the response is left,
+ * false if the read takes the event path
+ *
+ * In a fast phase the line is filled in the state functional warmup
+ * gives it, so a later write upgrades it through the detailed path, and
+ * the response is sent after the latency the model predicts. Reads that
+ * take the event path have their miss cycle kept to calibrate the model
+ * in complete_request().
+ */
+bool CacheController::surrogate_fill(CacheQueueEntry *queueEntry)
+{
+    MemoryRequest *request = queueEntry->request;
+
+    /* Latencies below are in simulation cycles */
+    if((type_ != L1_I_CACHE && type_ != L1_D_CACHE) || clockDomain_ ||
+            !lowerInterconnect_ || request->is_annuled() ||
+            pendingRequests_.count() >= pendingRequests_.size() - 4)
+        return false;
+
+    int latency = memoryHierarchy_->surrogate_miss(this, request);
+    if(latency < 0) {
+        queueEntry->missCycle = sim_cycle;
+        return false;
+    }
+
+    CacheLine warm;
+    setzero(warm);
+    coherence_logic_->warm_line(&warm);
+
+    Message message;
+    message.init();
+    message.sender   = lowerInterconnect_;
+    message.request  = request;
+    message.hasData  = true;
+    message.isShared = true;
+    message.arg      = &warm.state;
+
+    bool completed = complete_request(message, queueEntry, latency);
+    assert(completed);
+    return true;
+}
+
+/**
+ * @brief Serve a read of the upper cache on a hit, see fast_fill()
+ *
+ * @param interconnect Interconnect the read comes from
+ * @param request Read that missed in the upper cache
+ * @param serve False to only get the latency
+ * @param arg Set to the line state the upper cache fills with
+ *
+ * @return Hit latency in simulation cycles, or -1 if the read has to take
+ * the event path
+ *
+ * Only an idle private cache serves, so no earlier request can change
+ * the line or hold the port before the read would have got here. The
+ * port is not taken either, the read would only have taken it later.
+ */
+int CacheController::fill_fast_path(Interconnect *interconnect,
+        MemoryRequest *request, bool serve, void **arg)
+{
+    if((interconnect != upperInterconnect_ &&
+                interconnect != upperInterconnect2_) ||
+            !is_private() || inclusion_ != INCLUSION_INCLUSIVE ||
+            pendingRequests_.count() > 0 || request_latency_enabled ||
+            request->get_type() != MEMORY_OP_READ)
+        return -1;
+
+    int latency = to_sim_cycles(cacheAccessLatency_);
+    if(!serve)
+        return latency;
+
+    CacheLine *line = cacheLines_->probe(request);
+    if(!line || !is_line_valid(line))
+        return -1;
+
+    if(!coherence_logic_->fast_read_hit(line, request))
+        return -1;
+
+    request->reach_level(level_);
+
+    if(stackDistance_)
+        stackDistance_->access(request->get_physical_address());
+
+    N_STAT_UPDATE(new_stats->cpurequest.count.hit.read.hit, ++,
+            request->is_kernel());
+
+    *arg = &line->state;
+    return latency;
+}
+
+/**
+ * @brief Install a line for functional warmup
+ *
+ * @param request Request with address of the line
+ *
+ * @return true if line is already present
+ *
+ * Lines are installed clean and shared so no cache has to be told about
+ * them. Caches kept coherent by a directory are not warmed as the
+ * directory would not know about the sharers, and an exclusive cache only
+ * gets lines evicted from its upper caches.
+ */
+bool CacheController::warm_line(MemoryRequest *request)
+{
+    if(directory_)
+        return true;
+
+    CacheLine *line = cacheLines_->probe(request);
+
+    if(line && is_line_valid(line))
+        return true;
+
+    if(inclusion_ == INCLUSION_EXCLUSIVE)
+        return false;
+
+    if(line == NULL) {
+        /* Warmed lines are clean so victim is dropped silently */
+        W64 oldTag = InvalidTag<W64>::INVALID;
+        line = cacheLines_->insert(request, oldTag);
+        line->init(get_line_tag(request));
+    }
+
+    line->prefetched = 0;
+    coherence_logic_->warm_line(line);
+
+    return false;
+}
+
+/**
+ * @brief Save or load the valid lines and their coherence states
+ *
+ * Lines of all caches are saved at the same time, so loaded states agree
+ * with each other and with the directory.
+ */
+void CacheController::transfer_warm_state(WarmState &state)
+{
+    cacheLines_->transfer_warm_state(state);
+}
+
+/**
+ * @brief Drop the lines of a range of memory written outside simulation
+ *
+ * @return Number of lines dropped
+ *
+ * Dirty lines are dropped too, the data is in QEMU's memory. Like
+ * warm_line(), caches kept coherent by a directory are left alone so the
+ * directory's sharers stay right.
+ */
+int CacheController::invalidate_lines(W64 physaddr, W64 size)
+{
+    if(directory_)
+        return 0;
+
+    MemoryRequest request;
+    request.set_coreid(0);
+
+    int lineSize = cacheLines_->get_line_size();
+    int count = 0;
+
+    for(W64 addr = physaddr; addr < physaddr + size; addr += lineSize) {
+        request.set_physical_address(addr);
+        CacheLine *line = cacheLines_->probe(&request);
+
+        if(!line || !is_line_valid(line))
+            continue;
+
+        cacheLines_->invalidate(&request);
+        count++;
+    }
+
+    return count;
+}
+
 void CacheController::print_map(ostream& os)
 {
     os << "Cache-Controller: " << get_name() << endl;
@@ -496,6 +1103,8 @@ void CacheController::get_directory(Interconnect *interconn)
                                 sg->controller);
                         assert(cont);
                         lowerCont_ = *cont;
+                        lowerConts_.push(*cont);
+                        lowerExclusive_ |= (*cont)->is_exclusive_cache();
                         break;
                     default:
                         break;
@@ -505,6 +1114,30 @@ void CacheController::get_directory(Interconnect *interconn)
     }
 }
 
+/**
+ * @brief Find the slice of a banked cache that holds given address
+ *
+ * @param cont Controller a message is sent to
+ * @param address Physical address of the message
+ *
+ * @return cont itself unless it is a slice of lower banked cache that
+ * doesn't hold the address, in that case the slice that does
+ */
+Controller* CacheController::get_slice_owner(Controller *cont, W64 address)
+{
+    if(!cont || cont->owns_line(address))
+        return cont;
+
+    foreach (i, lowerConts_.count()) {
+        Controller *slice = lowerConts_[i];
+
+        if(slice->get_slice().is_sliced() && slice->owns_line(address))
+            return slice;
+    }
+
+    return cont;
+}
+
 void CacheController::register_upper_interconnect(Interconnect *interconnect)
 {
     upperInterconnect_ = interconnect;
@@ -529,12 +1162,26 @@ bool CacheController::cache_hit_cb(void *arg)
 
     queueEntry->eventFlags[CACHE_HIT_EVENT]--;
 
+    if(inclusion_ == INCLUSION_EXCLUSIVE && !queueEntry->isSnoop &&
+            queueEntry->request->get_type() == MEMORY_OP_UPDATE) {
+        insert_victim_fill(queueEntry);
+        return true;
+    }
+
+    /* Threads spinning on the line wait for it to be invalidated */
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+    CacheLine *line = queueEntry->line;
+    bool spin_watch = machine.spin_waits.count() && line &&
+        coherence_logic_->is_line_valid(line);
+    W64 physaddr = queueEntry->request->get_physical_address();
+
     if(queueEntry->isSnoop) {
         if (pendingRequests_.count() >=  (
                     pendingRequests_.size() - 4)) {
             /* Snoop hit can cause eviction in local cache and if we dont have
              * free queue entries we delay this by 2 cycles */
             marss_add_event(&cacheHit_, 2, queueEntry);
+            return true;
         } else {
             coherence_logic_->handle_interconn_hit(queueEntry);
         }
@@ -542,6 +1189,9 @@ bool CacheController::cache_hit_cb(void *arg)
         coherence_logic_->handle_local_hit(queueEntry);
     }
 
+    if unlikely (spin_watch && !coherence_logic_->is_line_valid(line))
+        machine.spin_line_changed(physaddr, cacheLines_->get_line_size());
+
     return true;
 }
 
@@ -553,6 +1203,20 @@ bool CacheController::cache_miss_cb(void *arg)
 
     queueEntry->eventFlags[CACHE_MISS_EVENT]--;
 
+    OP_TYPE type = queueEntry->request->get_type();
+
+    if(inclusion_ == INCLUSION_EXCLUSIVE && !queueEntry->isSnoop &&
+            type == MEMORY_OP_UPDATE) {
+        insert_victim_fill(queueEntry);
+        return true;
+    }
+
+    if(victims_.count() && !queueEntry->isSnoop &&
+            (type == MEMORY_OP_READ || type == MEMORY_OP_WRITE) &&
+            restore_victim(queueEntry)) {
+        return true;
+    }
+
     if(queueEntry->request->get_type() == MEMORY_OP_EVICT &&
             !is_lowest_private()) {
         if(queueEntry->line)
@@ -572,6 +1236,24 @@ bool CacheController::cache_miss_cb(void *arg)
         queueEntry->line         = NULL;
         queueEntry->isShared     = false;
         queueEntry->responseData = false;
+
+        /*
+         * Upper caches may hold lines a non-inclusive cache doesn't, so
+         * the snoop has to invalidate them there.
+         */
+        if(inclusion_ != INCLUSION_INCLUSIVE && type != MEMORY_OP_UPDATE) {
+            if (pendingRequests_.count() >= (
+                        pendingRequests_.size() - 4)) {
+                queueEntry->eventFlags[CACHE_MISS_EVENT]++;
+                marss_add_event(&cacheMiss_, 2, queueEntry);
+                return true;
+            }
+
+            send_evict_to_upper(queueEntry);
+            N_STAT_UPDATE(inclusionStats_->snoop_invalidations, ++,
+                    queueEntry->request->is_kernel());
+        }
+
         coherence_logic_->handle_interconn_miss(queueEntry);
     } else {
         coherence_logic_->handle_local_miss(queueEntry);
@@ -630,6 +1312,14 @@ bool CacheController::cache_access_cb(void *arg)
     if(queueEntry->annuled)
         return true;
 
+    /* Wrong path request, the hierarchy drops this entry */
+    if unlikely (!queueEntry->isSnoop &&
+            memoryHierarchy_->drop_annuled(queueEntry->request)) {
+        N_STAT_UPDATE(new_stats->annul, ++,
+                queueEntry->request->is_kernel());
+        return true;
+    }
+
     queueEntry->eventFlags[CACHE_ACCESS_EVENT]--;
     bool kernel_req = queueEntry->request->is_kernel();
 	OP_TYPE type = queueEntry->request->get_type();
@@ -639,6 +1329,11 @@ bool CacheController::cache_access_cb(void *arg)
         CacheLine *line	= cacheLines_->probe(queueEntry->request);
         queueEntry->line = line;
 
+        if(stackDistance_ && !queueEntry->isSnoop &&
+                (type == MEMORY_OP_READ || type == MEMORY_OP_WRITE))
+            stackDistance_->access(
+                    queueEntry->request->get_physical_address());
+
         if(line) hit = true;
         else hit = false;
 
@@ -650,7 +1345,7 @@ bool CacheController::cache_access_cb(void *arg)
         int delay;
         if(hit) {
             signal = &cacheHit_;
-            delay = cacheAccessLatency_;
+            delay = cacheAccessLatency_ + cacheLines_->hit_latency(line);
 
 			if (!queueEntry->isSnoop) {
 				if(type == MEMORY_OP_READ) {
@@ -677,15 +1372,31 @@ bool CacheController::cache_access_cb(void *arg)
 							kernel_req);
 				}
 			}
+
+            if unlikely (memoryHierarchy_->surrogate_enabled() &&
+                    !queueEntry->isSnoop && type == MEMORY_OP_READ &&
+                    surrogate_fill(queueEntry))
+                return true;
+
+            if unlikely (fast_fill_enabled && !queueEntry->isSnoop &&
+                    type == MEMORY_OP_READ && fast_fill(queueEntry))
+                return true;
         }
         marss_add_event(signal, delay,
                 (void*)queueEntry);
         return true;
     } else {
         OP_TYPE type = queueEntry->request->get_type();
-        if(type == MEMORY_OP_READ) {
+        bool conflict = !cacheLines_->ports().bank_free(queueEntry->request);
+        if(type == MEMORY_OP_READ && conflict) {
+            N_STAT_UPDATE(new_stats->cpurequest.stall.read.bank_conflict, ++,
+                    kernel_req);
+        } else if(type == MEMORY_OP_READ) {
             N_STAT_UPDATE(new_stats->cpurequest.stall.read.cache_port, ++,
                     kernel_req);
+        } else if(type == MEMORY_OP_WRITE && conflict) {
+            N_STAT_UPDATE(new_stats->cpurequest.stall.write.bank_conflict, ++,
+                    kernel_req);
         } else if(type == MEMORY_OP_WRITE) {
             N_STAT_UPDATE(new_stats->cpurequest.stall.write.cache_port, ++,
                     kernel_req);
@@ -705,6 +1416,15 @@ bool CacheController::wait_interconnect_cb(void *arg)
     if(queueEntry->annuled)
         return true;
 
+    /* Don't send a miss of a wrong path request down */
+    if unlikely (queueEntry->sendTo == lowerInterconnect_ &&
+            !queueEntry->isSnoop &&
+            memoryHierarchy_->drop_annuled(queueEntry->request)) {
+        N_STAT_UPDATE(new_stats->annul, ++,
+                queueEntry->request->is_kernel());
+        return true;
+    }
+
     queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]--;
 
     if(queueEntry->sendTo == NULL)
@@ -719,7 +1439,8 @@ bool CacheController::wait_interconnect_cb(void *arg)
     message.dest     = queueEntry->dest;
     bool success     = false;
 
-    if (queueEntry->line) message.arg = &(queueEntry->line->state);
+    if (queueEntry->isVictim) message.arg = &(queueEntry->victimState);
+    else if (queueEntry->line) message.arg = &(queueEntry->line->state);
     else message.arg = NULL;
 
     if(queueEntry->sendTo == upperInterconnect_ ||
@@ -734,6 +1455,9 @@ bool CacheController::wait_interconnect_cb(void *arg)
             emit(&message);
 
         if(success == true) {
+            if(inclusion_ == INCLUSION_EXCLUSIVE)
+                move_line_up(queueEntry);
+
             /* free this entry if no future event is going to use it */
             clear_entry_cb(queueEntry);
         } else {
@@ -814,6 +1538,7 @@ bool CacheController::clear_entry_cb(void *arg)
             }
 
             pendingRequests_.free(queueEntry);
+            update_queue_occupancy();
         }
 
         /*
@@ -830,10 +1555,12 @@ bool CacheController::clear_entry_cb(void *arg)
 
 void CacheController::annul_request(MemoryRequest *request)
 {
-    CacheQueueEntry *queueEntry;
-    foreach_list_mutable(pendingRequests_.list(), queueEntry,
-            entry, nextentry) {
-        if (queueEntry->request->is_same(request)) {
+    CacheQueueEntry *queueEntry = pendingRequests_.first(
+            get_line_address(request));
+    CacheQueueEntry *nextEntry;
+    for(; queueEntry; queueEntry = nextEntry) {
+        nextEntry = pendingRequests_.next(queueEntry);
+        if (queueEntry->request == request) {
             queueEntry->annuled = true;
             /* Fix dependency chain if this entry was waiting for
              * some other entry, else wakeup that entry.*/
@@ -853,9 +1580,11 @@ void CacheController::annul_request(MemoryRequest *request)
             }
 
             pendingRequests_.free(queueEntry);
+            update_queue_occupancy();
             ADD_HISTORY_REM(queueEntry->request);
 
             queueEntry->request->decRefCounter();
+            memoryHierarchy_->set_controller_full(this, false);
         }
     }
 }
@@ -863,6 +1592,7 @@ void CacheController::annul_request(MemoryRequest *request)
 CacheQueueEntry* CacheController::get_new_queue_entry()
 {
     CacheQueueEntry *queueEntry = pendingRequests_.alloc();
+    update_queue_occupancy();
     assert(queueEntry);
 
     return queueEntry;
@@ -882,9 +1612,32 @@ void CacheController::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "sets", cacheLines_->get_set_count());
 	YAML_KEY_VAL(out, "ways", cacheLines_->get_way_count());
 	YAML_KEY_VAL(out, "line_size", cacheLines_->get_line_size());
-	YAML_KEY_VAL(out, "latency", cacheLines_->get_access_latency());
+	YAML_KEY_VAL(out, "latency", cacheAccessLatency_);
 	YAML_KEY_VAL(out, "pending_queue_size", pendingRequests_.size());
 
+	if(cacheLines_->ports().get_banks() > 1) {
+		YAML_KEY_VAL(out, "banks", cacheLines_->ports().get_banks());
+		YAML_KEY_VAL(out, "bank_bytes", cacheLines_->ports().get_bank_bytes());
+		YAML_KEY_VAL(out, "bank_ports", cacheLines_->ports().get_bank_ports());
+	}
+
+	if(slice_.is_sliced())
+		slice_.dump_configuration(out);
+
+	if(isLowestPrivate_) {
+		const char *inclusion = "inclusive";
+		if(inclusion_ == INCLUSION_NON_INCLUSIVE)
+			inclusion = "non_inclusive";
+		else if(inclusion_ == INCLUSION_EXCLUSIVE)
+			inclusion = "exclusive";
+		YAML_KEY_VAL(out, "inclusion", inclusion);
+	}
+
+	if(victims_.count()) {
+		YAML_KEY_VAL(out, "victim_cache", victims_.count());
+		YAML_KEY_VAL(out, "victim_latency", victimLatency_);
+	}
+
 	coherence_logic_->dump_configuration(out);
 
 	out << YAML::EndMap;
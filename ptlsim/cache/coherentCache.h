@@ -36,6 +36,7 @@
 #include <memoryStats.h>
 #include <statsBuilder.h>
 #include <cacheLines.h>
+#include <stackDistance.h>
 
 namespace Memory {
 
@@ -56,6 +57,79 @@ namespace Memory {
             CACHE_NO_EVENTS
         };
 
+        // Inclusion of upper private caches' lines in the last private
+        // cache, set by 'inclusion' option
+        enum InclusionPolicy {
+            INCLUSION_INCLUSIVE,
+            INCLUSION_NON_INCLUSIVE,
+            INCLUSION_EXCLUSIVE,
+        };
+
+        // Inclusion statistics of the last private cache
+        //
+        // Each duplicate fill takes a line that upper caches also hold,
+        // victim fills and moved up lines are held in one level only, so
+        // their ratio shows how much of this cache adds to capacity.
+        struct InclusionStats : public Statable
+        {
+            // Evicts sent to upper caches for lines this cache evicted
+            StatObj<W64> back_invalidations;
+            // Snoops that missed here and were passed to upper caches
+            StatObj<W64> snoop_invalidations;
+            // Lines inserted while upper caches got a copy
+            StatObj<W64> duplicate_fills;
+            // Victims of upper caches inserted by an exclusive cache
+            StatObj<W64> victim_fills;
+            // Lines an exclusive cache handed up and dropped
+            StatObj<W64> moved_up;
+
+            InclusionStats(const char *name, Statable *parent)
+                : Statable(name, parent)
+                  , back_invalidations("back_invalidations", this)
+                  , snoop_invalidations("snoop_invalidations", this)
+                  , duplicate_fills("duplicate_fills", this)
+                  , victim_fills("victim_fills", this)
+                  , moved_up("moved_up", this)
+            {}
+        };
+
+        struct VictimCacheStats : public Statable
+        {
+            StatObj<W64> inserts;
+            StatObj<W64> hits;
+            // Entries dropped because a snoop or lower level message
+            // changed the line
+            StatObj<W64> purges;
+
+            VictimCacheStats(const char *name, Statable *parent)
+                : Statable(name, parent)
+                  , inserts("inserts", this)
+                  , hits("hits", this)
+                  , purges("purges", this)
+            {}
+        };
+
+        // Reads of this cache filled at once from the cache below, see
+        // CacheController::fast_fill
+        struct FastFillStats : public Statable
+        {
+            StatObj<W64> fills;
+            // With -mem-fast-fill-check, reads that could have been
+            // filled at once and hit below, and those of them whose
+            // response was not sent at the predicted cycle
+            StatObj<W64> checked;
+            StatObj<W64> mismatches;
+
+            FastFillStats(const char *name, Statable *parent)
+                : Statable(name, parent)
+                  , fills("fills", this)
+                  , checked("checked", this)
+                  , mismatches("mismatches", this)
+            {
+                disable_dump();
+            }
+        };
+
         // CacheQueueEntry
         // Cache has queue to maintain a list of pending requests
         // that this caches has received.
@@ -81,6 +155,16 @@ namespace Memory {
                 bool isSnoop;
                 bool isShared;
                 bool responseData;
+                // Update carrying a victim line to an exclusive lower
+                // cache, victimState is the state it had
+                bool isVictim;
+                W8   victimState;
+                // Line of a fill that bypasses an exclusive cache
+                CacheLine bypassLine;
+                // Response cycle predicted with -mem-fast-fill-check
+                W64  fastFillCycle;
+                // Cycle an L1 read missed, with -mem-surrogate
+                W64  missCycle;
 
                 void init() {
                     request      = NULL;
@@ -96,6 +180,10 @@ namespace Memory {
                     isSnoop      = false;
                     isShared     = false;
                     responseData = false;
+                    isVictim     = false;
+                    victimState  = 0;
+                    fastFillCycle = 0;
+                    missCycle    = 0;
                     source       = NULL;
                     dest         = NULL;
                     eventFlags.reset();
@@ -172,8 +260,9 @@ namespace Memory {
                 // Cache Access Latency
                 int cacheAccessLatency_;
 
-                // A Queue conatining pending requests for this cache
-                FixStateList<CacheQueueEntry, 256> pendingRequests_;
+                // A Queue conatining pending requests for this cache,
+                // indexed by cache line address
+                IndexedFixStateList<CacheQueueEntry, 256> pendingRequests_;
 
                 // Flag to indicate if this cache is lowest private
                 // level cache
@@ -189,6 +278,37 @@ namespace Memory {
 
                 Controller *directory_;
                 Controller *lowerCont_;
+                // All upper controllers of lower interconnect, more than one
+                // if lower level is a banked cache
+                dynarray<Controller*> lowerConts_;
+
+                InclusionPolicy inclusion_;
+                // Lower cache is exclusive and takes clean victims too
+                bool lowerExclusive_;
+                // Line being evicted by current insert and its state
+                W64 insertVictimTag_;
+                W8  insertVictimState_;
+                bool victimSent_;
+                InclusionStats *inclusionStats_;
+
+                // Small fully associative cache of lines evicted from
+                // this cache, an entry is just the line's tag and state
+                struct VictimEntry {
+                    W64 tag;
+                    W64 lastUse;
+                    W8  state;
+                    bool valid;
+                };
+
+                dynarray<VictimEntry> victims_;
+                W64 victimUseCounter_;
+                int victimLatency_;
+                VictimCacheStats *victimStats_;
+                FastFillStats *fastFillStats_;
+
+                // LRU stack distances of demand accesses, NULL unless
+                // 'stack_distance' option is set for this cache
+                StackDistanceProfile *stackDistance_;
 
                 // All signals of cache
                 Signal clearEntry_;
@@ -203,6 +323,12 @@ namespace Memory {
                 // Stats Objects
                 MESIStats *new_stats;
 
+                // After each alloc and free of pendingRequests_
+                void update_queue_occupancy() {
+                    new_stats->queue_occupancy.update(pendingRequests_.count(),
+                            sim_cycle, user_stats);
+                }
+
                 CoherenceLogic *coherence_logic_;
 
                 CacheQueueEntry* find_dependency(MemoryRequest *request);
@@ -215,17 +341,32 @@ namespace Memory {
                     return request->get_physical_address() >> cacheLineBits_;
                 }
 
+                // Same as CacheLinesBase::tagOf without the virtual dispatch
+                W64 get_line_tag(MemoryRequest *request) {
+                    return get_line_address(request) << cacheLineBits_;
+                }
+
                 bool handle_upper_interconnect(Message &message);
 
                 bool handle_lower_interconnect(Message &message);
 
                 void handle_cache_insert(CacheQueueEntry *queueEntry,
                         W64 oldTag);
+                void evict_line(CacheQueueEntry *queueEntry, W64 oldTag);
                 bool is_line_valid(CacheLine *line);
                 bool is_line_in_use(W64 tag);
 
                 bool complete_request(Message &message, CacheQueueEntry
-                        *queueEntry);
+                        *queueEntry, int responseDelay = 1);
+                bool fast_fill(CacheQueueEntry *queueEntry);
+                bool surrogate_fill(CacheQueueEntry *queueEntry);
+
+                void insert_victim_fill(CacheQueueEntry *queueEntry);
+                void move_line_up(CacheQueueEntry *queueEntry);
+
+                void add_victim(W64 tag, W8 state, bool kernel);
+                bool restore_victim(CacheQueueEntry *queueEntry);
+                void purge_victim(W64 tag, bool kernel);
 
                 void get_directory(Interconnect *interconn);
 
@@ -236,6 +377,11 @@ namespace Memory {
                 bool handle_interconnect_cb(void *arg);
                 int access_fast_path(Interconnect *interconnect,
                         MemoryRequest *request);
+                int fill_fast_path(Interconnect *interconnect,
+                        MemoryRequest *request, bool serve, void **arg);
+                bool warm_line(MemoryRequest *request);
+                void transfer_warm_state(WarmState &state);
+                int invalidate_lines(W64 physaddr, W64 size);
                 void print_map(ostream& os);
 
                 void register_interconnect(Interconnect *interconnect, int type);
@@ -252,6 +398,18 @@ namespace Memory {
                     return isLowestPrivate_;
                 }
 
+                InclusionPolicy get_inclusion() const {
+                    return inclusion_;
+                }
+
+                bool is_exclusive_cache() const {
+                    return inclusion_ == INCLUSION_EXCLUSIVE;
+                }
+
+                bool has_victim_cache() const {
+                    return victims_.count() > 0;
+                }
+
                 void print(ostream& os) const;
 
                 bool is_full(bool fromInterconnect = false, MemoryRequest *request = NULL) const {
@@ -274,6 +432,7 @@ namespace Memory {
 
                 void annul_request(MemoryRequest *request);
 				void dump_configuration(YAML::Emitter &out) const;
+                void config_changed();
 
                 // Callback functions for signals of cache
                 virtual bool cache_hit_cb(void *arg);
@@ -291,7 +450,7 @@ namespace Memory {
 
                 Statable* get_stats() { return new_stats; }
 
-                void send_message(CacheQueueEntry *queueEntry,
+                CacheQueueEntry* send_message(CacheQueueEntry *queueEntry,
                         Interconnect *interconn, OP_TYPE type, W64 tag =-1);
 
                 virtual void send_evict_to_upper(CacheQueueEntry *entry, W64 tag=-1);
@@ -301,7 +460,10 @@ namespace Memory {
 
                 Interconnect* get_lower_intrconn() { return lowerInterconnect_;}
                 Controller* get_directory() { return directory_; }
-				Controller* get_lower_cont() { return lowerCont_; }
+				Controller* get_lower_cont(W64 address) {
+					return get_slice_owner(lowerCont_, address);
+				}
+				Controller* get_slice_owner(Controller *cont, W64 address);
                 CacheQueueEntry* get_new_queue_entry();
 
         };
@@ -31,18 +31,31 @@
 #include <globals.h>
 #include <superstl.h>
 #include <memoryRequest.h>
+#include <cacheSlice.h>
+#include <eventtrace.h>
+#include <hostperf.h>
+#include <clockdomain.h>
+#include <requestLatency.h>
+#include <slabPool.h>
+#include <warmstate.h>
+#include <statehash.h>
 
 namespace Memory {
 
 class Interconnect;
 
-struct Message : public FixStateListObject {
-	void *sender;
-    void *origin;
-    void *dest;
-	MemoryRequest *request;
+/*
+ * The flags go first so they fill the tail padding of FixStateListObject,
+ * then the fields every hop reads. Only arg, which just the coherence
+ * logic looks at, falls in the second cache line.
+ */
+struct CACHE_LINE_ALIGNED Message : public FixStateListObject {
 	bool hasData;
 	bool isShared;
+	MemoryRequest *request;
+	void *sender;
+    void *dest;
+    void *origin;
 	void *arg;
 
 	ostream& print(ostream& os) const {
@@ -76,6 +89,15 @@ static inline ostream& operator <<(ostream& os, const Message& msg)
 	return msg.print(os);
 }
 
+/*
+ * With -mem-fast-fill, reads that miss in an upper private cache and hit
+ * in an idle private cache below are filled at once, see
+ * CacheController::fast_fill. With -mem-fast-fill-check they take the
+ * event path and are only checked against the predicted response cycle.
+ */
+extern bool fast_fill_enabled;
+extern bool fast_fill_check;
+
 class MemoryHierarchy;
 
 class Controller
@@ -85,9 +107,23 @@ class Controller
 		Signal handle_interconnect_;
 		bool isPrivate_;
 
+	protected:
+		/* Set up by caches that are one slice of a banked cache */
+		CacheSlice slice_;
+
 	public:
 		MemoryHierarchy *memoryHierarchy_;
 		W8 idx;
+		/* Component id of this controller in -tracefile records */
+		W32 traceId_;
+		/* Host time of this controller with -host-perf */
+		HostPerfCounter *hostPerf_;
+		/* Component id of this controller with -mem-latency */
+		W16 latencyId_;
+		/* Clock domain from 'clock_domain' option, NULL at sim clock */
+		ClockDomain *clockDomain_;
+		/* Level of this controller, recorded in the requests it gets */
+		CacheType level_;
 
 		Controller(W8 coreid, const char *name,
 				MemoryHierarchy *memoryHierarchy)
@@ -97,9 +133,15 @@ class Controller
 		{
 			name_ << name;
 			isPrivate_ = false;
+			traceId_ = trace_register_component(name);
+			hostPerf_ = host_perf_register(name);
+			latencyId_ = request_latency_register(name);
+			clockDomain_ = clock_domain_bind(memoryHierarchy, name, coreid);
+			level_ = L1_I_CACHE;
 
 			handle_interconnect_.connect(signal_mem_ptr \
-					(*this, &Controller::handle_interconnect_cb));
+					(*this, &Controller::interconnect_cb));
+			handle_interconnect_.set_perf(hostPerf_);
 		}
 
         virtual ~Controller()
@@ -107,23 +149,84 @@ class Controller
             memoryHierarchy_ = NULL;
         }
 
+		/* Records the request's arrival here before handling it */
+		bool interconnect_cb(void* arg) {
+			Message *msg = (Message*)arg;
+			msg->request->reach_level(level_);
+			if unlikely (request_latency_enabled)
+				msg->request->record_hop(latencyId_);
+			if unlikely (state_hash_enabled)
+				state_hash_mem_event(traceId_,
+						msg->request->get_physical_address(),
+						msg->request->get_type());
+			return handle_interconnect_cb(arg);
+		}
+
 		virtual bool handle_interconnect_cb(void* arg)=0;
 		virtual int access_fast_path(Interconnect *interconnect,
 				MemoryRequest *request) { return -1; };
+
+		/*
+		 * Serve a read of an upper cache at once if it hits here,
+		 * returns the latency in simulation cycles and sets arg as the
+		 * response message's, or -1 if the read has to be sent. With
+		 * serve false nothing changes and the latency is returned
+		 * without looking up the line.
+		 */
+		virtual int fill_fast_path(Interconnect *interconnect,
+				MemoryRequest *request, bool serve, void **arg) {
+			return -1;
+		}
+
+		/* Simulation cycles of 'cycles' cycles of this controller */
+		int to_sim_cycles(int cycles) const {
+			if likely (!clockDomain_ || cycles <= 0)
+				return cycles;
+			return clockDomain_->to_sim_cycles(cycles);
+		}
         virtual void register_interconnect(Interconnect* interconnect,
                 int conn_type)=0;
 		virtual void print_map(ostream& os)=0;
 
 		virtual void print(ostream& os) const =0;
 		virtual bool is_full(bool fromInterconnect = false, MemoryRequest *request = NULL) const = 0;
+
+		/* True if every free of a pending entry calls
+		 * set_controller_full(this, false), so a sender blocked on
+		 * is_full can wait_for_space() instead of retrying. */
+		virtual bool notifies_space() const { return true; }
 		virtual void annul_request(MemoryRequest* request) = 0;
 		virtual void dump_configuration(YAML::Emitter &out) const = 0;
 
+		/* Re-read options that can change at run time, after the
+		 * -machine-options overrides, see BaseMachine::config_changed() */
+		virtual void config_changed() {}
+
 		int flush() {
 			return 0;
 		}
 
-		int get_no_pending_request(W8 coreid) { assert(0); return 0; }
+		virtual int get_no_pending_request(W8 coreid) { assert(0); return 0; }
+
+		/* True for caches that only hold victims of their upper caches */
+		virtual bool is_exclusive_cache() const { return false; }
+
+		/* Functional warmup: install request's line without timing or
+		 * messages. Returns true if line was already present, so lower
+		 * levels don't need to be warmed. */
+		virtual bool warm_line(MemoryRequest *request) { return false; }
+
+		/* Save or load the warm state of this controller in its section
+		 * of a warm state file, see warmstate.h */
+		virtual void transfer_warm_state(WarmState &state) {}
+
+		/* Drop the lines of [physaddr, physaddr + size) without timing or
+		 * messages, for memory written outside of simulation. Returns the
+		 * number of lines dropped. */
+		virtual int invalidate_lines(W64 physaddr, W64 size) { return 0; }
+
+		/* Stats node of this controller, NULL if it has none */
+		virtual Statable* get_stats() { return NULL; }
 
 		Signal* get_interconnect_signal() {
 			return &handle_interconnect_;
@@ -139,6 +242,14 @@ class Controller
 
 		bool is_private() { return isPrivate_; }
 
+		const CacheSlice& get_slice() const { return slice_; }
+
+		/* False if this is a slice of a banked cache that doesn't
+		 * hold given address */
+		bool owns_line(W64 address) const {
+			return slice_.owns(address);
+		}
+
 };
 
 static inline ostream& operator <<(ostream& os, const Controller&
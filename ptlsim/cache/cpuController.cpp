@@ -55,6 +55,9 @@ CPUController::CPUController(W8 coreid, const char *name,
     SET_SIGNAL_CB(name, "_Cache_Access", cacheAccess_, &CPUController::cache_access_cb);
 
     SET_SIGNAL_CB(name, "_Queue_Access", queueAccess_, &CPUController::queue_access_cb);
+
+	foreach(i, CPU_CONT_MSHR_SETS)
+		mshrSets_[i] = -1;
 }
 
 bool CPUController::handle_interconnect_cb(void *arg)
@@ -72,7 +75,6 @@ bool CPUController::handle_interconnect_cb(void *arg)
 		return true;
 	}
 
-	wakeup_dependents(queueEntry);
 	finalize_request(queueEntry);
 
 	return true;
@@ -80,7 +82,11 @@ bool CPUController::handle_interconnect_cb(void *arg)
 
 CPUControllerQueueEntry* CPUController::find_entry(MemoryRequest *request)
 {
-	CPUControllerQueueEntry* entry;
+	CPUControllerQueueEntry* entry = find_mshr(mshr_key(request));
+	if likely (entry && entry->request == request)
+		return entry;
+
+	/* Entries that are not indexed */
 	foreach_list_mutable(pendingRequests_.list(), entry, entry_t, prev_t) {
 		if(entry->request == request)
 			return entry;
@@ -93,29 +99,53 @@ void CPUController::annul_request(MemoryRequest *request)
 	CPUControllerQueueEntry *entry;
 	foreach_list_mutable(pendingRequests_.list(), entry,
 			entry_t, nextentry_t) {
+		int kept = 0;
+		foreach(i, entry->targetCount) {
+			MemoryRequest *target = entry->targets[i];
+			if(target->is_same(request)) {
+				target->decRefCounter();
+				ADD_HISTORY_REM(target);
+			} else {
+				entry->targets[kept++] = target;
+			}
+		}
+		entry->targetCount = kept;
+
 		if(entry->request->is_same(request)) {
-			entry->annuled = true;
 			entry->request->decRefCounter();
+			ADD_HISTORY_REM(entry->request);
+
+			if unlikely (entry->targetCount) {
+				/* The oldest target takes over the entry and goes to
+				 * the cache in place of the annuled request */
+				entry->request = entry->targets[0];
+				entry->targetCount--;
+				foreach(i, entry->targetCount)
+					entry->targets[i] = entry->targets[i + 1];
+				cache_access_cb(entry);
+				continue;
+			}
 
-            if unlikely  (entry->depends >= 0) {
-                CPUControllerQueueEntry *depEntry = &pendingRequests_[entry->depends];
-                if (entry->waitFor >= 0) {
-                    pendingRequests_[entry->waitFor].depends = depEntry->idx;
-                    depEntry->waitFor = entry->waitFor;
-                } else {
-                    depEntry->waitFor = -1;
-                    cache_access_cb(depEntry);
-                }
-            } else if (entry->waitFor >= 0) {
-                pendingRequests_[entry->waitFor].depends = -1;
-            }
-
+			entry->annuled = true;
+			remove_mshr(entry);
 			pendingRequests_.free(entry);
-            ADD_HISTORY_REM(entry->request);
+			update_queue_occupancy();
+			memoryHierarchy_->set_controller_full(this, false);
 		}
 	}
 }
 
+/* A part of a split load that won't come back releases its owner */
+static void drop_split_part(MemoryRequest *request)
+{
+	MemoryRequest *owner = request->get_split_owner();
+	if likely (!owner) return;
+
+	request->set_split_owner(NULL);
+	owner->set_split_parts(owner->get_split_parts() - 1);
+	owner->decRefCounter();
+}
+
 int CPUController::flush()
 {
 	CPUControllerQueueEntry *entry;
@@ -123,9 +153,19 @@ int CPUController::flush()
 			entry_t, nextentry_t) {
 		if(entry->annuled) continue;
 		entry->annuled = true;
+		drop_split_part(entry->request);
 		entry->request->decRefCounter();
+		foreach(i, entry->targetCount) {
+			drop_split_part(entry->targets[i]);
+			entry->targets[i]->decRefCounter();
+		}
+		entry->targetCount = 0;
 		pendingRequests_.free(entry);
+		update_queue_occupancy();
 	}
+	foreach(i, CPU_CONT_MSHR_SETS)
+		mshrSets_[i] = -1;
+	memoryHierarchy_->set_controller_full(this, false);
 	return 4;
 }
 
@@ -142,7 +182,7 @@ bool CPUController::is_icache_buffer_hit(MemoryRequest *request)
 			prev_t) {
 		if(entry->lineAddress == lineAddress) {
 			N_STAT_UPDATE(stats.cpurequest.count.hit.read.hit, ++, request->is_kernel());
-            N_STAT_UPDATE(stats.icache_latency, [1]++, request->is_kernel());
+            N_STAT_UPDATE(stats.icache_latency, .record(1), request->is_kernel());
 			return true;
 		}
 	}
@@ -166,10 +206,8 @@ int CPUController::access_fast_path(Interconnect *interconnect,
 				return 0;
 
 			fastPathLat = int_L1_i_->access_fast_path(this, request);
-            N_STAT_UPDATE(stats.icache_latency, [fastPathLat]++, kernel_req);
 		} else {
 			fastPathLat = int_L1_d_->access_fast_path(this, request);
-            N_STAT_UPDATE(stats.dcache_latency, [fastPathLat]++, kernel_req);
 		}
 	}
 
@@ -179,115 +217,187 @@ int CPUController::access_fast_path(Interconnect *interconnect,
 	request->incRefCounter();
 	ADD_HISTORY_ADD(request);
 
-	CPUControllerQueueEntry *dependentEntry = find_dependency(request);
+	if(merge_request(request))
+		return -1;
 
 	CPUControllerQueueEntry* queueEntry = pendingRequests_.alloc();
+	update_queue_occupancy();
 
 	if unlikely (queueEntry == NULL) {
 		marss_add_event(&queueAccess_, 1, request);
 		return -1;
 	}
 
+	queueEntry->request = request;
+	add_request(queueEntry, fastPathLat);
+	return -1;
+}
+
+/**
+ * @brief Check a data load for an L1 hit without queueing it
+ *
+ * @param request Load, not owned by the controller
+ *
+ * @return L1 hit latency, or 0 if the line is not in the L1 or a pending
+ * request holds it, then the load has to go through access(), or
+ * CACHE_BANK_CONFLICT if it hits a bank that has no port left this cycle
+ */
+int CPUController::access_hit(MemoryRequest *request)
+{
+	if(find_mshr(mshr_key(request)))
+		return 0;
+
+	int latency = int_L1_d_->access_fast_path(this, request);
+	if(latency == CACHE_BANK_CONFLICT)
+		return latency;
+	if(latency <= 0)
+		return 0;
+
+	N_STAT_UPDATE(stats.dcache_latency, .record(latency),
+			request->is_kernel());
+	return latency;
+}
+
+bool CPUController::is_cache_availabe(bool is_icache)
+{
+	assert(0);
+	return false;
+}
+
+CPUControllerQueueEntry* CPUController::find_mshr(W64 key)
+{
+	int idx = mshrSets_[mshr_set(key)];
+	while(idx >= 0) {
+		CPUControllerQueueEntry *entry = &pendingRequests_[idx];
+		if(entry->key == key)
+			return entry;
+		idx = entry->hashNext;
+	}
+	return NULL;
+}
+
+void CPUController::add_mshr(CPUControllerQueueEntry *queueEntry)
+{
+	queueEntry->key = mshr_key(queueEntry->request);
+
+	/* A request that could not merge into a full entry is not indexed,
+	 * the older entry keeps taking same line requests */
+	if(find_mshr(queueEntry->key))
+		return;
+
+	int set = mshr_set(queueEntry->key);
+	queueEntry->hashNext = mshrSets_[set];
+	queueEntry->indexed = true;
+	mshrSets_[set] = queueEntry->idx;
+}
+
+void CPUController::remove_mshr(CPUControllerQueueEntry *queueEntry)
+{
+	if(!queueEntry->indexed)
+		return;
+
+	int *link = &mshrSets_[mshr_set(queueEntry->key)];
+	while(*link != queueEntry->idx)
+		link = &pendingRequests_[*link].hashNext;
+	*link = queueEntry->hashNext;
+
+	queueEntry->indexed = false;
+	queueEntry->hashNext = -1;
+}
+
+/**
+ * @brief Merge request into the pending request of its line
+ *
+ * @param request Request from the core
+ *
+ * @return true if merged, the request then completes with the pending one
+ * and needs no entry of its own
+ */
+bool CPUController::merge_request(MemoryRequest *request)
+{
+	CPUControllerQueueEntry *entry = find_mshr(mshr_key(request));
+	if(!entry || entry->targetCount == CPU_CONT_MSHR_TARGETS)
+		return false;
+
+	memdebug("Merging into entry: ", *entry, endl);
+	entry->targets[entry->targetCount++] = request;
+
+	/* The fill below is read for its priority wherever it waits */
+	entry->request->inherit_priority(request);
+
+	bool kernel_req = request->is_kernel();
+	if(request->is_instruction() || request->get_type() == MEMORY_OP_READ) {
+		N_STAT_UPDATE(stats.cpurequest.stall.read.dependency, ++, kernel_req);
+	} else {
+		N_STAT_UPDATE(stats.cpurequest.stall.write.dependency, ++, kernel_req);
+	}
+	return true;
+}
+
+/**
+ * @brief Start a newly allocated pending request
+ *
+ * @param queueEntry Entry holding the request
+ * @param fastPathLat Latency of an L1 hit, or negative to send the request
+ * to the cache
+ */
+void CPUController::add_request(CPUControllerQueueEntry *queueEntry,
+		int fastPathLat)
+{
     /*
      * now check if pendingRequests_ buffer is full then
      * set the full flag in memory hierarchy
      */
 	if(pendingRequests_.isFull()) {
 		memoryHierarchy_->set_controller_full(this, true);
-		N_STAT_UPDATE(stats.queueFull, ++, request->is_kernel());
+		N_STAT_UPDATE(stats.queueFull, ++, queueEntry->request->is_kernel());
 	}
 
-	queueEntry->request = request;
+	add_mshr(queueEntry);
 
-	if(dependentEntry &&
-			dependentEntry->request->get_type() == request->get_type()) {
-        /*
-         * Found an entry with same line request and request type,
-         * Now in dependentEntry->depends add current entry's
-         * index value so it can wakeup this entry when
-         * dependent entry is handled.
-         */
-		memdebug("Dependent entry is: ", *dependentEntry, endl);
-		dependentEntry->depends = queueEntry->idx;
-        queueEntry->waitFor = dependentEntry->idx;
-		queueEntry->cycles = -1;
-		if unlikely(queueEntry->request->is_instruction()) {
-			N_STAT_UPDATE(stats.cpurequest.stall.read.dependency, ++, kernel_req);
-		}
-		else  {
-			if(queueEntry->request->get_type() == MEMORY_OP_READ) {
-				N_STAT_UPDATE(stats.cpurequest.stall.read.dependency, ++, kernel_req);
-            } else {
-				N_STAT_UPDATE(stats.cpurequest.stall.write.dependency, ++, kernel_req);
-            }
-		}
+	if(fastPathLat > 0) {
+		queueEntry->cycles = fastPathLat;
 	} else {
-		if(fastPathLat > 0) {
-			queueEntry->cycles = fastPathLat;
-		} else {
-			cache_access_cb(queueEntry);
-		}
+		cache_access_cb(queueEntry);
 	}
 	memdebug("Added Queue Entry: ", *queueEntry, endl);
-	return -1;
 }
 
-bool CPUController::is_cache_availabe(bool is_icache)
+/**
+ * @brief Return a request to the core
+ *
+ * @param request Request that completed
+ * @param fill True for the request that brought the line, false for the
+ * targets merged into it
+ */
+void CPUController::complete_request(MemoryRequest *request, bool fill)
 {
-	assert(0);
-	return false;
-}
+	W64 req_latency = sim_cycle - request->get_init_cycles();
+    bool kernel_req = request->is_kernel();
 
-CPUControllerQueueEntry* CPUController::find_dependency(
-		MemoryRequest *request)
-{
-	W64 requestLineAddr = get_line_address(request);
+	if unlikely (request_latency_enabled)
+		request_latency_record(request, latencyId_);
 
-	CPUControllerQueueEntry* queueEntry;
-	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry_t,
-			prev_t) {
-		assert(queueEntry);
-		if unlikely (request == queueEntry->request)
-			continue;
-
-		if(get_line_address(queueEntry->request) == requestLineAddr) {
-
-            /*
-             * The dependency is handled as chained, so all the
-             * entries maintain an index to their next dependent
-             * entry. Find the last entry of the chain which has
-             * the depends value set to -1 and return that entry
-             */
-
-			CPUControllerQueueEntry *retEntry = queueEntry;
-			while(retEntry->depends >= 0) {
-				retEntry = &pendingRequests_[retEntry->depends];
+	if unlikely (request->is_instruction()) {
+		if(fill) {
+			W64 lineAddress = get_line_address(request);
+			if likely (icacheBuffer_.isFull()) {
+				memdebug("Freeing icache buffer head\n");
+				icacheBuffer_.free(icacheBuffer_.head());
+				N_STAT_UPDATE(stats.queueFull, ++, kernel_req);
 			}
-			return retEntry;
+			CPUControllerBufferEntry *bufEntry = icacheBuffer_.alloc();
+			bufEntry->lineAddress = lineAddress;
 		}
+        N_STAT_UPDATE(stats.icache_latency, .record(req_latency), kernel_req);
+	} else {
+        N_STAT_UPDATE(stats.dcache_latency, .record(req_latency), kernel_req);
 	}
-	return NULL;
-}
+	stats.priority.record(request->get_priority(), req_latency, kernel_req);
+    memoryHierarchy_->core_wakeup(request);
 
-void CPUController::wakeup_dependents(CPUControllerQueueEntry *queueEntry)
-{
-    /*
-     * All the dependents are wakeup one after another in
-     * sequence in which they were requested. The delay
-     * for each entry to wakeup is 1 cycle
-     * At first wakeup only next dependent in next cycle.
-     * Following dependent entries will be waken up
-     * automatically when the next entry is finalized.
-     */
-	CPUControllerQueueEntry *entry = queueEntry;
-	CPUControllerQueueEntry *nextEntry;
-	if(entry->depends >= 0) {
-		nextEntry = &pendingRequests_[entry->depends];
-		assert(nextEntry->request);
-		memdebug("Setting cycles left to 1 for dependent\n");
-		nextEntry->cycles = 1;
-        nextEntry->waitFor = -1;
-	}
+	request->decRefCounter();
+	ADD_HISTORY_REM(request);
 }
 
 void CPUController::finalize_request(CPUControllerQueueEntry *queueEntry)
@@ -295,32 +405,20 @@ void CPUController::finalize_request(CPUControllerQueueEntry *queueEntry)
 	memdebug("Controller: ", get_name(), " Finalizing entry: ",
 			*queueEntry, endl);
 	MemoryRequest *request = queueEntry->request;
-
-	int req_latency = sim_cycle - request->get_init_cycles();
-	req_latency = (req_latency >= 200) ? 199 : req_latency;
     bool kernel_req = request->is_kernel();
 
-	if unlikely (request->is_instruction()) {
-		W64 lineAddress = get_line_address(request);
-		if likely (icacheBuffer_.isFull()) {
-			memdebug("Freeing icache buffer head\n");
-			icacheBuffer_.free(icacheBuffer_.head());
-			N_STAT_UPDATE(stats.queueFull, ++, request->is_kernel());
-		}
-		CPUControllerBufferEntry *bufEntry = icacheBuffer_.alloc();
-		bufEntry->lineAddress = lineAddress;
-        N_STAT_UPDATE(stats.icache_latency, [req_latency]++, kernel_req);
-	} else {
-        N_STAT_UPDATE(stats.dcache_latency, [req_latency]++, kernel_req);
-	}
-    memoryHierarchy_->core_wakeup(request);
+	remove_mshr(queueEntry);
+
+	complete_request(request, true);
+	foreach(i, queueEntry->targetCount)
+		complete_request(queueEntry->targets[i], false);
+	queueEntry->targetCount = 0;
 
 	memdebug("Entry finalized..\n");
 
-	request->decRefCounter();
-	ADD_HISTORY_REM(request);
     if(!queueEntry->annuled)
 		pendingRequests_.free(queueEntry);
+    update_queue_occupancy();
 
     /*
      * now check if pendingRequests_ buffer has space left then
@@ -328,7 +426,7 @@ void CPUController::finalize_request(CPUControllerQueueEntry *queueEntry)
      */
 	if likely (!pendingRequests_.isFull()) {
 		memoryHierarchy_->set_controller_full(this, false);
-		N_STAT_UPDATE(stats.queueFull, ++, request->is_kernel());
+		N_STAT_UPDATE(stats.queueFull, ++, kernel_req);
 	}
 }
 
@@ -365,54 +463,19 @@ bool CPUController::queue_access_cb(void *arg)
 {
 	MemoryRequest *request = (MemoryRequest*)arg;
 
+	if(merge_request(request))
+		return true;
+
 	CPUControllerQueueEntry* queueEntry = pendingRequests_.alloc();
+	update_queue_occupancy();
 
 	if(queueEntry == NULL) {
 		marss_add_event(&queueAccess_, 1, request);
 		return true;
 	}
 
-    /*
-     * now check if pendingRequests_ buffer is full then
-     * set the full flag in memory hierarchy
-     */
-	if(pendingRequests_.isFull()) {
-		memoryHierarchy_->set_controller_full(this, true);
-		N_STAT_UPDATE(stats.queueFull, ++, request->is_kernel());
-	}
-
 	queueEntry->request = request;
-
-	CPUControllerQueueEntry *dependentEntry = find_dependency(request);
-
-	if(dependentEntry &&
-			dependentEntry->request->get_type() == request->get_type()) {
-        /*
-         * Found an entry with same line request and request type,
-         * Now in dependentEntry->depends add current entry's
-         * index value so it can wakeup this entry when
-         * dependent entry is handled.
-         */
-		memdebug("Dependent entry is: ", *dependentEntry, endl);
-		dependentEntry->depends = queueEntry->idx;
-        queueEntry->waitFor = dependentEntry->idx;
-		queueEntry->cycles = -1;
-        bool kernel_req = queueEntry->request->is_kernel();
-		if unlikely(queueEntry->request->is_instruction()) {
-			N_STAT_UPDATE(stats.cpurequest.stall.read.dependency, ++, kernel_req);
-		}
-		else  {
-			if(queueEntry->request->get_type() == MEMORY_OP_READ) {
-				N_STAT_UPDATE(stats.cpurequest.stall.read.dependency, ++, kernel_req);
-            } else {
-				N_STAT_UPDATE(stats.cpurequest.stall.write.dependency, ++, kernel_req);
-            }
-		}
-	} else {
-		cache_access_cb(queueEntry);
-	}
-
-	memdebug("Added Queue Entry: ", *queueEntry, endl);
+	add_request(queueEntry, -1);
 
 	return true;
 }
@@ -426,11 +489,43 @@ void CPUController::clock()
 		if(queueEntry->cycles == 0) {
 			memdebug("Finalizing from clock\n");
 			finalize_request(queueEntry);
-			wakeup_dependents(queueEntry);
 		}
 	}
 }
 
+/**
+ * @brief Find the first cycle in which clock() will finalize a request
+ *
+ * @return Cycle number or infinity if no request is counting down
+ */
+W64 CPUController::get_next_active_cycle()
+{
+	W64 next = infinity;
+	CPUControllerQueueEntry* queueEntry;
+	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry_t,
+			prev_t) {
+		if(queueEntry->cycles > 0)
+			next = min(next, sim_cycle + queueEntry->cycles - 1);
+	}
+	return next;
+}
+
+/**
+ * @brief Update pending requests for cycles that were not clocked
+ *
+ * @param cycles Number of skipped cycles, must be less than cycles left of
+ * any counting down request
+ */
+void CPUController::skip_cycles(W64 cycles)
+{
+	CPUControllerQueueEntry* queueEntry;
+	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry_t,
+			prev_t) {
+		assert(queueEntry->cycles <= 0 || (W64)queueEntry->cycles > cycles);
+		queueEntry->cycles -= cycles;
+	}
+}
+
 void CPUController::print(ostream& os) const
 {
 	os << "---CPU-Controller: "<< get_name()<< endl;
@@ -483,6 +578,7 @@ has no relevence to any hardware module.\n");
 	YAML_KEY_VAL(out, "type", "core_controller");
 	YAML_KEY_VAL(out, "pending_queue_size", pendingRequests_.size());
 	YAML_KEY_VAL(out, "icache_buffer_size", icacheBuffer_.size());
+	YAML_KEY_VAL(out, "mshr_targets", CPU_CONT_MSHR_TARGETS);
 
 	out << YAML::EndMap;
 }
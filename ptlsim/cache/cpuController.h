@@ -36,20 +36,34 @@
 
 namespace Memory {
 
+/*
+ * A pending request works like an L1 MSHR: later requests of the same type
+ * to its line, up to CPU_CONT_MSHR_TARGETS, are merged in as targets and
+ * complete with it instead of taking their own entry and going to the
+ * cache again.
+ */
 struct CPUControllerQueueEntry : public FixStateListObject
 {
 	MemoryRequest *request;
 	int cycles;
-	int depends;
-    int waitFor;
 	bool annuled;
 
+	/* Line index, see CPUController::mshr_key */
+	W64 key;
+	int hashNext;
+	bool indexed;
+
+	int targetCount;
+	MemoryRequest *targets[CPU_CONT_MSHR_TARGETS];
+
 	void init() {
 		request = NULL;
 		cycles = -1;
-		depends = -1;
-        waitFor = -1;
 		annuled = false;
+		key = 0;
+		hashNext = -1;
+		indexed = false;
+		targetCount = 0;
 	}
 
 	ostream& print(ostream& os) const {
@@ -60,8 +74,7 @@ struct CPUControllerQueueEntry : public FixStateListObject
 		os << "Request{", *request, "} ";
         os << "idx[", idx, "] ";
 		os << "cycles[", cycles, "] ";
-		os << "depends[", depends, "] ";
-        os << "waitFor[", waitFor, "] ";
+		os << "targets[", targetCount, "] ";
 		os << "annuled[", annuled, "] ";
 		os << endl;
 		return os;
@@ -119,17 +132,41 @@ class CPUController : public Controller
 		FixStateList<CPUControllerBufferEntry, \
 			CPU_CONT_ICACHE_BUF_SIZE> icacheBuffer_;
 
+		/* Heads of the line index chains, -1 if empty */
+		int mshrSets_[CPU_CONT_MSHR_SETS];
+
 		bool is_icache_buffer_hit(MemoryRequest *request) ;
 
-		CPUControllerQueueEntry* find_dependency(MemoryRequest *request);
+		/* After each alloc and free of pendingRequests_ */
+		void update_queue_occupancy() {
+			stats.queue_occupancy.update(pendingRequests_.count(),
+					sim_cycle, user_stats);
+		}
+
+		W64 mshr_key(MemoryRequest *request) const {
+			return (get_line_address(request) << 4) |
+				(W64(request->get_type()) << 1) |
+				W64(request->is_instruction());
+		}
+
+		int mshr_set(W64 key) const {
+			return foldbits<log2(CPU_CONT_MSHR_SETS)>(key);
+		}
+
+		CPUControllerQueueEntry* find_mshr(W64 key);
+		void add_mshr(CPUControllerQueueEntry *queueEntry);
+		void remove_mshr(CPUControllerQueueEntry *queueEntry);
 
-		void wakeup_dependents(CPUControllerQueueEntry *queueEntry);
+		bool merge_request(MemoryRequest *request);
+		void add_request(CPUControllerQueueEntry *queueEntry,
+				int fastPathLat);
 
+		void complete_request(MemoryRequest *request, bool fill);
 		void finalize_request(CPUControllerQueueEntry *queueEntry);
 
 		CPUControllerQueueEntry* find_entry(MemoryRequest *request);
 
-		W64 get_line_address(MemoryRequest *request) {
+		W64 get_line_address(MemoryRequest *request) const {
 			if(request->is_instruction())
 				return request->get_physical_address() >> icacheLineBits_;
 			return request->get_physical_address() >> dcacheLineBits_;
@@ -146,6 +183,8 @@ class CPUController : public Controller
 		int access_fast_path(Interconnect *interconnect,
 				MemoryRequest *request);
 		void clock();
+		W64 get_next_active_cycle();
+		void skip_cycles(W64 cycles);
         void register_interconnect(Interconnect *interconnect, int type);
 		void register_interconnect_L1_d(Interconnect *interconnect);
 		void register_interconnect_L1_i(Interconnect *interconnect);
@@ -167,6 +206,8 @@ class CPUController : public Controller
 			return access_fast_path(NULL, request);
 		}
 
+		int access_hit(MemoryRequest *request);
+
 		bool is_full(bool fromInterconnect = false, MemoryRequest *request = NULL) const {
 			return pendingRequests_.isFull();
 		}
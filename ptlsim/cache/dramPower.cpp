@@ -0,0 +1,113 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <dramPower.h>
+#include <machine.h>
+
+using namespace Memory;
+
+const char* Memory::dram_state_names[DRAM_STATE_COUNT] = {"standby",
+    "powerdown", "self_refresh"};
+
+static int get_dram_option(BaseMachine &machine, const char *name,
+        const char *opt, int def)
+{
+    int value;
+
+    if (!machine.get_option(name, opt, value))
+        value = def;
+
+    return value;
+}
+
+void DRAMPower::setup(BaseMachine &machine, const char *name)
+{
+    DRAMPowerConfig cfg;
+    bool enable = false;
+
+    machine.get_option(name, "dram_power", enable);
+    if (!enable) {
+        init(cfg);
+        return;
+    }
+
+    cfg.ranks = get_dram_option(machine, name, "dram_ranks", 1);
+    if (cfg.ranks < 1 || cfg.ranks > MEM_BANKS ||
+            (MEM_BANKS % cfg.ranks)) {
+        ptl_logfile << "ERROR: " << name << " needs dram_ranks that ";
+        ptl_logfile << "divides its " << MEM_BANKS << " banks" << endl;
+        assert(0);
+    }
+
+    int trefi = get_dram_option(machine, name, "dram_trefi", 7800);
+    int trfc = get_dram_option(machine, name, "dram_trfc", 350);
+    int pdIdle = get_dram_option(machine, name, "dram_powerdown_idle", 0);
+    int txp = get_dram_option(machine, name, "dram_txp", 6);
+    int srIdle = get_dram_option(machine, name, "dram_self_refresh_idle", 0);
+    int txs = get_dram_option(machine, name, "dram_txs", 360);
+
+    if (trefi < 0 || trfc < 0 || (trefi && trfc >= trefi) || pdIdle < 0 ||
+            txp < 0 || srIdle < 0 || txs < 0) {
+        ptl_logfile << "ERROR: " << name << " needs dram_trfc below ";
+        ptl_logfile << "dram_trefi and no negative dram_* times" << endl;
+        assert(0);
+    }
+
+    cfg.refreshInterval = ns_to_simcycles(trefi);
+    cfg.refreshCycles = ns_to_simcycles(trfc);
+    cfg.powerdownIdle = ns_to_simcycles(pdIdle);
+    cfg.powerdownExit = ns_to_simcycles(txp);
+    cfg.selfRefreshIdle = ns_to_simcycles(srIdle);
+    cfg.selfRefreshExit = ns_to_simcycles(txs);
+
+    /* One refresh event per rank in each interval */
+    if (cfg.refreshInterval && cfg.refreshInterval < W64(cfg.ranks))
+        cfg.refreshInterval = cfg.ranks;
+
+    cfg.actEnergy = get_dram_option(machine, name, "dram_act_pj", 1800);
+    cfg.readEnergy = get_dram_option(machine, name, "dram_read_pj", 2400);
+    cfg.writeEnergy = get_dram_option(machine, name, "dram_write_pj", 2600);
+    cfg.refreshEnergy = get_dram_option(machine, name, "dram_refresh_pj",
+            120000);
+    cfg.powerAt[DRAM_STATE_STANDBY] = get_dram_option(machine, name,
+            "dram_standby_mw", 250);
+    cfg.powerAt[DRAM_STATE_POWERDOWN] = get_dram_option(machine, name,
+            "dram_powerdown_mw", 90);
+    cfg.powerAt[DRAM_STATE_SELF_REFRESH] = get_dram_option(machine, name,
+            "dram_self_refresh_mw", 35);
+
+    init(cfg);
+}
+
+void DRAMPower::dump_configuration(YAML::Emitter &out) const
+{
+    YAML_KEY_VAL(out, "dram_ranks", config.ranks);
+    YAML_KEY_VAL(out, "dram_trefi", config.refreshInterval);
+    YAML_KEY_VAL(out, "dram_trfc", config.refreshCycles);
+    YAML_KEY_VAL(out, "dram_powerdown_idle", config.powerdownIdle);
+    YAML_KEY_VAL(out, "dram_txp", config.powerdownExit);
+    YAML_KEY_VAL(out, "dram_self_refresh_idle", config.selfRefreshIdle);
+    YAML_KEY_VAL(out, "dram_txs", config.selfRefreshExit);
+    YAML_KEY_VAL(out, "dram_act_pj", config.actEnergy);
+    YAML_KEY_VAL(out, "dram_read_pj", config.readEnergy);
+    YAML_KEY_VAL(out, "dram_write_pj", config.writeEnergy);
+    YAML_KEY_VAL(out, "dram_refresh_pj", config.refreshEnergy);
+    YAML_KEY_VAL(out, "dram_standby_mw", config.powerAt[DRAM_STATE_STANDBY]);
+    YAML_KEY_VAL(out, "dram_powerdown_mw",
+            config.powerAt[DRAM_STATE_POWERDOWN]);
+    YAML_KEY_VAL(out, "dram_self_refresh_mw",
+            config.powerAt[DRAM_STATE_SELF_REFRESH]);
+}
@@ -0,0 +1,327 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef DRAM_POWER_H
+#define DRAM_POWER_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+#include <cacheConstants.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+/* Background state of a rank, in stats labels order */
+enum {
+    DRAM_STATE_STANDBY,      /* accessing, refreshing or idle and awake */
+    DRAM_STATE_POWERDOWN,    /* precharge power-down, exits in tXP */
+    DRAM_STATE_SELF_REFRESH, /* refreshes itself, exits in tXS */
+    DRAM_STATE_COUNT
+};
+
+extern const char* dram_state_names[DRAM_STATE_COUNT];
+
+/* Options of the DRAM power model, times in sim cycles */
+struct DRAMPowerConfig {
+    int ranks;
+    W64 refreshInterval;  /* tREFI of each rank, 0 never refreshes */
+    W64 refreshCycles;    /* tRFC */
+    W64 powerdownIdle;    /* idle before power-down, 0 never */
+    W64 powerdownExit;    /* tXP */
+    W64 selfRefreshIdle;  /* idle before self refresh, 0 never */
+    W64 selfRefreshExit;  /* tXS */
+
+    /* Energy of each event in pJ, background power of a rank in mW */
+    int actEnergy;
+    int readEnergy;
+    int writeEnergy;
+    int refreshEnergy;
+    int powerAt[DRAM_STATE_COUNT];
+
+    DRAMPowerConfig()
+        : ranks(0)
+          , refreshInterval(0)
+          , refreshCycles(0)
+          , powerdownIdle(0)
+          , powerdownExit(0)
+          , selfRefreshIdle(0)
+          , selfRefreshExit(0)
+          , actEnergy(0)
+          , readEnergy(0)
+          , writeEnergy(0)
+          , refreshEnergy(0)
+    {
+        foreach (i, DRAM_STATE_COUNT) powerAt[i] = 0;
+    }
+};
+
+struct DRAMRank {
+    int busy;        /* banks with an access started */
+    W64 busyUntil;   /* latest end of an access of its banks */
+    W64 idleSince;   /* power-down and self refresh timers start here */
+    W64 refreshEnd;
+    W64 accounted;   /* background cycles are counted up to here */
+};
+
+/* What waking a rank up for an access did */
+struct DRAMWakeup {
+    int exited;      /* state the rank left, DRAM_STATE_STANDBY if awake */
+    W64 exitCycles;
+    W64 refreshCycles; /* waited for a refresh of the rank */
+
+    W64 delay() const { return exitCycles + refreshCycles; }
+};
+
+/**
+ * @brief Refresh, low power states and energy of the ranks of a memory
+ * controller without DRAMSim2
+ *
+ * Enabled with 'dram_power' in the controller's machine config options.
+ * The controller's banks are split in 'dram_ranks' ranks of consecutive
+ * bank ids. Every 'dram_trefi' ns each rank is refreshed for 'dram_trfc'
+ * ns, ranks staggered over the interval. A refresh starts once the
+ * accesses of the rank are done, and accesses starting during or before
+ * it wait for its end. A rank idle for 'dram_powerdown_idle' ns enters
+ * precharge power-down and the next access waits 'dram_txp' ns for the
+ * exit, a refresh wakes it up too. One idle for 'dram_self_refresh_idle'
+ * ns enters self refresh, needs no refresh and wakes up in 'dram_txs' ns.
+ * Options, 0 disables the state:
+ *
+ *   dram_ranks             : 1
+ *   dram_trefi, dram_trfc  : 7800, 350
+ *   dram_powerdown_idle    : 0, dram_txp : 6
+ *   dram_self_refresh_idle : 0, dram_txs : 360
+ *
+ * Energy of an activate and precharge, a 64 byte read or write burst and
+ * of a rank's refresh in pJ, and the background power of a rank in mW of
+ * each state (DDR4 8Gb x8 like defaults):
+ *
+ *   dram_act_pj: 1800, dram_read_pj: 2400, dram_write_pj: 2600,
+ *   dram_refresh_pj: 120000
+ *   dram_standby_mw: 250, dram_powerdown_mw: 90, dram_self_refresh_mw: 35
+ *
+ * The controller closes a row after each access, so each access is an
+ * activate, a burst and a precharge. Background cycles of a rank are
+ * counted when it is accessed or refreshed, so without refresh those of
+ * an idle rank since its last access are missing at the end of the run.
+ */
+class DRAMPower {
+    public:
+        DRAMPower() {}
+
+        void setup(BaseMachine &machine, const char *name);
+
+        void init(const DRAMPowerConfig &cfg) {
+            config = cfg;
+            ranks.resize(config.ranks);
+
+            foreach (i, ranks.length) {
+                DRAMRank &r = ranks[i];
+                r.busy = 0;
+                r.busyUntil = r.idleSince = r.refreshEnd = r.accounted = 0;
+            }
+        }
+
+        void dump_configuration(YAML::Emitter &out) const;
+
+        bool enabled() const { return config.ranks > 0; }
+
+        int rank_of(int bank) const {
+            return bank / (MEM_BANKS / config.ranks);
+        }
+
+        /* Cycles between refreshes of consecutive ranks, 0 without refresh */
+        W64 refresh_step() const {
+            return config.refreshInterval / config.ranks;
+        }
+
+        /* State of the rank in cycle, if it is not busy */
+        int idle_state(const DRAMRank &r, W64 cycle) const {
+            if (r.busy || cycle < r.idleSince)
+                return DRAM_STATE_STANDBY;
+            W64 idle = cycle - r.idleSince;
+            if (config.selfRefreshIdle && idle >= config.selfRefreshIdle)
+                return DRAM_STATE_SELF_REFRESH;
+            if (config.powerdownIdle && idle >= config.powerdownIdle)
+                return DRAM_STATE_POWERDOWN;
+            return DRAM_STATE_STANDBY;
+        }
+
+        /**
+         * @brief Background cycles of a rank in each state up to cycle
+         *
+         * @param rank Rank
+         * @param cycle Now
+         * @param cycles Adds to these since the last call
+         */
+        void account(int rank, W64 cycle, W64 *cycles) {
+            DRAMRank &r = ranks[rank];
+            W64 from = r.accounted;
+            if (cycle <= from)
+                return;
+            r.accounted = cycle;
+
+            if (r.busy) {
+                cycles[DRAM_STATE_STANDBY] += cycle - from;
+                return;
+            }
+
+            W64 never = W64(-1);
+            W64 pd = (config.powerdownIdle) ?
+                r.idleSince + config.powerdownIdle : never;
+            W64 sr = (config.selfRefreshIdle) ?
+                r.idleSince + config.selfRefreshIdle : never;
+            pd = min(pd, sr);
+
+            cycles[DRAM_STATE_STANDBY] += overlap(from, cycle, 0, pd);
+            cycles[DRAM_STATE_POWERDOWN] += overlap(from, cycle, pd, sr);
+            cycles[DRAM_STATE_SELF_REFRESH] += overlap(from, cycle, sr, never);
+        }
+
+        /**
+         * @brief An access to a bank of rank starts, wake the rank up
+         *
+         * @return Exit and refresh cycles before the access can start
+         */
+        DRAMWakeup start(int rank, W64 cycle, W64 *cycles) {
+            DRAMRank &r = ranks[rank];
+            DRAMWakeup wake;
+            account(rank, cycle, cycles);
+
+            wake.exited = idle_state(r, cycle);
+            wake.exitCycles = 0;
+            if (wake.exited == DRAM_STATE_SELF_REFRESH)
+                wake.exitCycles = config.selfRefreshExit;
+            else if (wake.exited == DRAM_STATE_POWERDOWN)
+                wake.exitCycles = config.powerdownExit;
+
+            W64 begin = cycle + wake.exitCycles;
+            wake.refreshCycles = (begin < r.refreshEnd) ?
+                r.refreshEnd - begin : 0;
+
+            r.busy++;
+            return wake;
+        }
+
+        /* Access of the rank started in start() ends in cycle 'end' */
+        void busy_until(int rank, W64 end) {
+            DRAMRank &r = ranks[rank];
+            r.busyUntil = max(r.busyUntil, end);
+        }
+
+        void done(int rank, W64 cycle, W64 *cycles) {
+            DRAMRank &r = ranks[rank];
+            account(rank, cycle, cycles);
+            assert(r.busy > 0);
+            if (--r.busy == 0)
+                r.idleSince = max(cycle, r.refreshEnd);
+        }
+
+        /**
+         * @brief Refresh of a rank is due
+         *
+         * @return Cycle it starts in, 0 if the rank is in self refresh
+         */
+        W64 refresh(int rank, W64 cycle, W64 *cycles) {
+            DRAMRank &r = ranks[rank];
+            account(rank, cycle, cycles);
+
+            int state = idle_state(r, cycle);
+            if (state == DRAM_STATE_SELF_REFRESH)
+                return 0;
+
+            W64 begin = max(max(cycle, r.busyUntil), r.refreshEnd);
+            if (state == DRAM_STATE_POWERDOWN)
+                begin += config.powerdownExit;
+
+            r.refreshEnd = begin + config.refreshCycles;
+            if (!r.busy)
+                r.idleSince = r.refreshEnd;
+            return begin;
+        }
+
+        /* nJ of the activate and precharge, and of the burst of an access */
+        double act_energy() const {
+            return config.actEnergy / 1000.0;
+        }
+
+        double burst_energy(bool write) const {
+            return (write ? config.writeEnergy : config.readEnergy) / 1000.0;
+        }
+
+        double refresh_energy() const {
+            return config.refreshEnergy / 1000.0;
+        }
+
+        /* nJ of a rank's background cycles in state, at freq_hz */
+        double background_energy(int state, W64 cycles, W64 freq_hz) const {
+            /* mW times s is mJ, times 1e6 nJ */
+            return config.powerAt[state] * (double(cycles) / freq_hz) * 1e6;
+        }
+
+        DRAMPowerConfig config;
+        dynarray<DRAMRank> ranks;
+
+    private:
+        static W64 overlap(W64 from, W64 to, W64 lo, W64 hi) {
+            W64 a = max(from, lo);
+            W64 b = min(to, hi);
+            return (b > a) ? b - a : 0;
+        }
+};
+
+/*
+ * Written under the controller's node, energy in nJ and cycles summed over
+ * ranks in user stats as dramsim_energy, refresh waits and low power exits
+ * in the mode of the access:
+ *
+ *   MEM_0:
+ *     dram_power:
+ *       actpre: .., burst: .., refresh: .., background: ..
+ *       bank_energy: [..]
+ *       refreshes: .., refresh_wait_cycles: ..
+ *       powerdown_exits: .., self_refresh_exits: .., exit_cycles: ..
+ *       state_cycles: {standby: .., powerdown: .., self_refresh: ..}
+ */
+struct DRAMPowerStats : public Statable
+{
+    StatObj<double> actpre;
+    StatObj<double> burst;
+    StatObj<double> refresh;
+    StatObj<double> background;
+    StatArray<double, MEM_BANKS> bank_energy;
+    StatObj<W64> refreshes;
+    StatObj<W64> refresh_wait_cycles;
+    StatObj<W64> powerdown_exits;
+    StatObj<W64> self_refresh_exits;
+    StatObj<W64> exit_cycles;
+    StatArray<W64, DRAM_STATE_COUNT> state_cycles;
+
+    DRAMPowerStats(Statable *parent)
+        : Statable("dram_power", parent)
+          , actpre("actpre", this)
+          , burst("burst", this)
+          , refresh("refresh", this)
+          , background("background", this)
+          , bank_energy("bank_energy", this)
+          , refreshes("refreshes", this)
+          , refresh_wait_cycles("refresh_wait_cycles", this)
+          , powerdown_exits("powerdown_exits", this)
+          , self_refresh_exits("self_refresh_exits", this)
+          , exit_cycles("exit_cycles", this)
+          , state_cycles("state_cycles", this, dram_state_names)
+    {}
+};
+
+};
+
+#endif // DRAM_POWER_H
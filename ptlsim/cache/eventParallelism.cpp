@@ -0,0 +1,294 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <ptlsim.h>
+#include <eventParallelism.h>
+#include <eventWheel.h>
+
+using namespace Memory;
+
+bool Memory::mem_parallelism_enabled = false;
+
+namespace {
+    const char *window_names[MEM_PARALLELISM_WINDOWS] = {
+        "w1", "w2", "w4", "w8", "w16", "w32", "w64",
+    };
+
+    struct LPStats : public Statable
+    {
+        StatObj<W64> events;
+        StatObj<W64> ticks;
+        StatObj<W64> cross_events;
+        StatObj<W64> rollbacks;
+        StatObj<W64> rollback_ticks;
+
+        LPStats(const char *name, Statable *parent)
+            : Statable(name, parent)
+              , events("events", this)
+              , ticks("ticks", this)
+              , cross_events("cross_events", this)
+              , rollbacks("rollbacks", this)
+              , rollback_ticks("rollback_ticks", this)
+        {}
+    };
+
+    struct MemParallelismStats : public Statable
+    {
+        StatObj<W64> ticks;
+        StatObj<double> optimistic_speedup;
+        StatObj<W64> rollbacks;
+        StatObj<W64> rollback_ticks;
+        StatObj<W64> zero_delay_cross;
+        StatObj<W64> min_cross_delay;
+        StatArray<double, MEM_PARALLELISM_WINDOWS> conservative_speedup;
+        Statable lps;
+
+        MemParallelismStats()
+            : Statable("mem_parallelism")
+              , ticks("ticks", this)
+              , optimistic_speedup("optimistic_speedup", this)
+              , rollbacks("rollbacks", this)
+              , rollback_ticks("rollback_ticks", this)
+              , zero_delay_cross("zero_delay_cross", this)
+              , min_cross_delay("min_cross_delay", this)
+              , conservative_speedup("conservative_speedup", this,
+                      window_names)
+              , lps("lps", this)
+        {}
+    };
+
+    /* Model of one LP, in host ticks */
+    struct LP {
+        W64 free;       /* done with its last event */
+        W64 max_ready;  /* latest ready time of its events so far */
+
+        W64 events;
+        W64 ticks;
+        W64 cross_events;
+        W64 rollbacks;
+        W64 rollback_ticks;
+
+        LPStats *stats;
+    };
+
+    /* Work of each LP in the current window of 1 << w cycles */
+    struct Window {
+        W64 index;
+        W64 max_work;
+        W64 total;
+        dynarray<W64> work;
+        dynarray<W16> touched;
+    };
+
+    MemParallelismStats *root = NULL;
+    dynarray<LP> lps;
+    Window windows[MEM_PARALLELISM_WINDOWS];
+
+    /* LP and model start of the executing event, -1 outside events */
+    int current_lp = -1;
+    W64 current_start = 0;
+    W64 current_tsc = 0;
+
+    /* Start of the run loop's time outside events, 0 before the first */
+    W64 outside_tsc = 0;
+
+    W64 sequential_ticks = 0;
+    W64 zero_delay_cross = 0;
+    W64 min_cross_delay = (W64)-1;
+
+    void add_window_work(int lp, W64 cycle, W64 work)
+    {
+        foreach (w, MEM_PARALLELISM_WINDOWS) {
+            Window &win = windows[w];
+            W64 index = cycle >> w;
+
+            if (index != win.index) {
+                win.total += win.max_work;
+                win.max_work = 0;
+                foreach (i, win.touched.count())
+                    win.work[win.touched[i]] = 0;
+                win.touched.clear();
+                win.index = index;
+            }
+
+            if (win.work.count() <= lp)
+                win.work.resize(lp + 1, 0);
+            if (!win.work[lp])
+                win.touched.push(lp);
+
+            win.work[lp] += work;
+            win.max_work = max(win.max_work, win.work[lp]);
+        }
+    }
+
+    void add_work(int lp, W64 cycle, W64 work)
+    {
+        lps[lp].events++;
+        lps[lp].ticks += work;
+        sequential_ticks += work;
+        add_window_work(lp, cycle, work);
+    }
+};
+
+W16 Memory::mem_parallelism_register(const char *component)
+{
+    if (!root) {
+        root = new MemParallelismStats();
+        root->disable_dump();
+
+        /* LP 0, signals that are not set up by a component run here */
+        LP cores;
+        memset(&cores, 0, sizeof(cores));
+        cores.stats = new LPStats("cores", &root->lps);
+        lps.push(cores);
+    }
+
+    foreach (i, lps.count()) {
+        if (strequal(lps[i].stats->get_name(), component))
+            return W16(i);
+    }
+
+    LP lp;
+    memset(&lp, 0, sizeof(lp));
+    lp.stats = new LPStats(component, &root->lps);
+    lps.push(lp);
+
+    return W16(lps.count() - 1);
+}
+
+void Memory::mem_parallelism_schedule(Event *event, W64 delay)
+{
+    int lp = event->get_signal()->get_partition();
+    int source;
+    W64 ready;
+
+    if (current_lp >= 0) {
+        source = current_lp;
+        ready = current_start + (rdtsc() - current_tsc);
+    } else {
+        source = 0;
+        ready = lps[0].free + (outside_tsc ? rdtsc() - outside_tsc : 0);
+    }
+
+    if (source != lp) {
+        if (delay == 0)
+            zero_delay_cross++;
+        else
+            min_cross_delay = min(min_cross_delay, delay);
+    }
+
+    event->set_source(source, ready);
+}
+
+bool Memory::mem_parallelism_execute(Event *event)
+{
+    int lp_id = event->get_signal()->get_partition();
+    LP &lp = lps[lp_id];
+    W64 ready = event->get_ready();
+
+    current_lp = lp_id;
+    current_start = max(lp.free, ready);
+    current_tsc = rdtsc();
+
+    bool ret = event->execute();
+
+    W64 work = rdtsc() - current_tsc;
+    lp.free = current_start + work;
+    current_lp = -1;
+
+    if (event->get_source() != lp_id)
+        lp.cross_events++;
+
+    /*
+     * An event of an earlier cycle only became ready after this one, so
+     * Time Warp would have run this one first and rolled it back
+     */
+    if (ready < lp.max_ready) {
+        lp.rollbacks++;
+        lp.rollback_ticks += work;
+    }
+    lp.max_ready = max(lp.max_ready, ready);
+
+    add_work(lp_id, event->get_clock(), work);
+    return ret;
+}
+
+void Memory::mem_parallelism_begin_events()
+{
+    if (!root)
+        mem_parallelism_register("cores");
+
+    W64 now = rdtsc();
+
+    if (outside_tsc) {
+        W64 work = now - outside_tsc;
+        lps[0].free += work;
+        add_work(0, sim_cycle, work);
+    }
+
+    /* Events run from here on the model of their own LP */
+    outside_tsc = 0;
+}
+
+void Memory::mem_parallelism_end_events()
+{
+    outside_tsc = rdtsc();
+}
+
+void Memory::mem_parallelism_set_stats()
+{
+    if (!root || !mem_parallelism_enabled)
+        return;
+
+    W64 optimistic = 0;
+    W64 rollbacks = 0;
+    W64 rollback_ticks = 0;
+
+    foreach (i, lps.count()) {
+        optimistic = max(optimistic, lps[i].free);
+        rollbacks += lps[i].rollbacks;
+        rollback_ticks += lps[i].rollback_ticks;
+    }
+
+    double optimistic_speedup = optimistic ?
+        double(sequential_ticks) / double(optimistic) : 0;
+    W64 cross_delay = (min_cross_delay == (W64)-1) ? 0 : min_cross_delay;
+
+    root->enable_dump();
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+    foreach (s, 3) {
+        root->set_default_stats(stats[s]);
+
+        root->ticks = sequential_ticks;
+        root->optimistic_speedup = optimistic_speedup;
+        root->rollbacks = rollbacks;
+        root->rollback_ticks = rollback_ticks;
+        root->zero_delay_cross = zero_delay_cross;
+        root->min_cross_delay = cross_delay;
+
+        foreach (w, MEM_PARALLELISM_WINDOWS) {
+            W64 total = windows[w].total + windows[w].max_work;
+            root->conservative_speedup[w] = total ?
+                double(sequential_ticks) / double(total) : 0;
+        }
+
+        foreach (i, lps.count()) {
+            LP &lp = lps[i];
+            LPStats &node = *lp.stats;
+
+            node.events = lp.events;
+            node.ticks = lp.ticks;
+            node.cross_events = lp.cross_events;
+            node.rollbacks = lp.rollbacks;
+            node.rollback_ticks = lp.rollback_ticks;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef EVENT_PARALLELISM_H
+#define EVENT_PARALLELISM_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+class Event;
+
+/*
+ * Parallelism of the memory hierarchy's events ('-mem-parallelism')
+ *
+ * Estimates how fast the run would be with the hierarchy partitioned
+ * into logical processes (LPs) that each run their events on a host
+ * thread, before building it. Every controller and interconnect is an LP
+ * (its signals are set up with SET_SIGNAL_CB), so each L2 slice,
+ * directory slice and memory controller is one. LP 0, 'cores', is
+ * everything the run loop does outside events: clocking the cores and
+ * the components and the direct calls of the cores into their caches.
+ *
+ * Each event is executed as usual, timed with rdtsc, and replayed on a
+ * model of host time in which every LP runs its own events one after
+ * another in cycle order. An event can only start once its LP is done
+ * with the previous one and the event that scheduled it has got to the
+ * point where it did, which gives:
+ *
+ *  - optimistic: the critical path, which Time Warp execution reaches if
+ *    rollbacks cost nothing. Time Warp runs each event of an LP as soon
+ *    as it is ready, so an event that was ready before one of an earlier
+ *    cycle of its LP is run too early and rolled back: these are counted
+ *    in rollbacks, with their ticks, once each and without cascades.
+ *
+ *  - conservative: windows of W cycles, in which all LPs run in parallel
+ *    up to a barrier at the end of the window, for the W of
+ *    MEM_PARALLELISM_WINDOWS. Such windows are only safe while W is at
+ *    most the shortest delay of an event scheduled into another LP,
+ *    written as min_cross_delay.
+ *
+ * Events of delay 0 run inside the one that scheduled them, so their
+ * ticks are charged to it, and the ones into another LP are counted in
+ * zero_delay_cross: partitioned, each of them is a message without any
+ * lookahead. Thread communication, barriers and rollbacks themselves are
+ * taken as free, the speedups are upper bounds.
+ *
+ * Results are written to the 'mem_parallelism' stats node:
+ *
+ *   mem_parallelism:
+ *     ticks: .., optimistic_speedup: .., rollbacks: .., rollback_ticks: ..,
+ *     zero_delay_cross: .., min_cross_delay: ..,
+ *     conservative_speedup: {w1: .., w2: .., ..., w64: ..}
+ *     lps:
+ *       cores: {events: .., ticks: .., cross_events: .., rollbacks: ..,
+ *               rollback_ticks: ..}
+ *       L2_0:  {...}
+ */
+extern bool mem_parallelism_enabled;
+
+#define MEM_PARALLELISM_WINDOWS 7
+
+/**
+ * @brief LP of a controller or interconnect, registering the same name
+ * again returns the same LP
+ */
+W16 mem_parallelism_register(const char *component);
+
+/* Stamp an event being scheduled with its source and ready time */
+void mem_parallelism_schedule(Event *event, W64 delay);
+
+/* Execute a due event through the model */
+bool mem_parallelism_execute(Event *event);
+
+/* The run loop goes from and back to executing the cycle's events */
+void mem_parallelism_begin_events();
+void mem_parallelism_end_events();
+
+/* Dump the 'mem_parallelism' node if '-mem-parallelism' is set */
+void mem_parallelism_set_stats();
+
+};
+
+#endif // EVENT_PARALLELISM_H
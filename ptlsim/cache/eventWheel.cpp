@@ -0,0 +1,208 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <globals.h>
+#include <ptlsim.h>
+#endif
+
+#include <eventWheel.h>
+
+using namespace Memory;
+
+EventWheel::EventWheel()
+	: curClock_(sim_cycle)
+	, wheelCount_(0)
+{
+}
+
+EventWheel::~EventWheel()
+{
+}
+
+Event* EventWheel::alloc()
+{
+	Event *event = pool_.alloc();
+	event->init();
+	return event;
+}
+
+void EventWheel::free(Event *event)
+{
+	pool_.free(event);
+}
+
+/**
+ * @brief Insert an allocated Event based on its clock
+ *
+ * @param event Event to insert, its clock must be set by Event::setup
+ *
+ * Events of same clock are executed in the order they are scheduled. An
+ * Event whose clock is already passed is executed on next call to pop, ahead
+ * of the Events of current cycle and after older passed Events.
+ */
+void EventWheel::schedule(Event *event)
+{
+	W64 clock = event->get_clock();
+
+	if unlikely (clock < curClock_) {
+		insert_sorted(get_slot(curClock_), event);
+		wheelCount_++;
+		return;
+	}
+
+	if likely (in_window(clock)) {
+		get_slot(clock).enqueue((selfqueuelink*)event);
+		wheelCount_++;
+		return;
+	}
+
+	insert_sorted(overflow_, event);
+}
+
+/**
+ * @brief Keep list sorted by clock, preserving insertion order of Events
+ * with same clock
+ */
+void EventWheel::insert_sorted(StateList& list, Event *event)
+{
+	Event *entryEvent;
+	foreach_list_mutable_backwards(list, entryEvent, entry, preventry) {
+		if(*event >= *entryEvent) {
+			list.enqueue_after((selfqueuelink*)event,
+					(selfqueuelink*)entryEvent);
+			return;
+		}
+	}
+
+	list.enqueue_after((selfqueuelink*)event, NULL);
+}
+
+/**
+ * @brief Move Events from overflow list whose clock is now in wheel window
+ */
+void EventWheel::migrate_overflow()
+{
+	while(!overflow_.empty()) {
+		Event *event = (Event*)overflow_.head();
+
+		if(!in_window(event->get_clock()))
+			break;
+
+		overflow_.remove((selfqueuelink*)event);
+		get_slot(event->get_clock()).enqueue((selfqueuelink*)event);
+		wheelCount_++;
+	}
+}
+
+/**
+ * @brief Remove next Event that is due at or before given clock
+ *
+ * @param clock Current simulation cycle
+ *
+ * @return Event to execute or NULL if no Event is due. Returned Event must be
+ * released with free() after execution.
+ */
+Event* EventWheel::pop(W64 clock)
+{
+	while(curClock_ <= clock) {
+		StateList& slot = get_slot(curClock_);
+
+		if(!slot.empty()) {
+			wheelCount_--;
+			return (Event*)slot.dequeue();
+		}
+
+		if(wheelCount_ == 0) {
+			/* Nothing in the wheel, jump directly to the first cycle
+			 * that has an Event in overflow list or to next cycle */
+			W64 nextClock = clock + 1;
+			if(!overflow_.empty()) {
+				W64 overflowClock = ((Event*)overflow_.head())->get_clock();
+				overflowClock -= (EVENT_WHEEL_SIZE - 1);
+				if(overflowClock < nextClock)
+					nextClock = overflowClock;
+			}
+			curClock_ = max(curClock_ + 1, nextClock);
+		} else {
+			curClock_++;
+		}
+
+		migrate_overflow();
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find the clock of earliest pending Event
+ *
+ * @return Clock of the Event or infinity if there is no pending Event
+ */
+W64 EventWheel::get_next_clock() const
+{
+	if(wheelCount_ > 0) {
+		for(W64 clock = curClock_; ; clock++) {
+			if(!slots_[clock & (EVENT_WHEEL_SIZE - 1)].empty())
+				return clock;
+		}
+	}
+
+	if(!overflow_.empty())
+		return ((Event*)overflow_.head())->get_clock();
+
+	return infinity;
+}
+
+void EventWheel::reset()
+{
+	foreach(i, EVENT_WHEEL_SIZE) {
+		slots_[i].reset();
+	}
+	overflow_.reset();
+	pool_.reset();
+
+	curClock_ = sim_cycle;
+	wheelCount_ = 0;
+}
+
+ostream& EventWheel::print(ostream& os) const
+{
+	os << "EventWheel: pending[", count(), "] capacity[", capacity(), "] ";
+	os << "clock[", curClock_, "]\n";
+
+	for(W64 clock = curClock_; clock < curClock_ + EVENT_WHEEL_SIZE;
+			clock++) {
+		const StateList& slot = slots_[clock & (EVENT_WHEEL_SIZE - 1)];
+		if(!slot.empty())
+			os << "cycle ", clock, slot;
+	}
+
+	if(!overflow_.empty())
+		os << "overflow", overflow_;
+
+	return os;
+}
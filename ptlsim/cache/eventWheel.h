@@ -0,0 +1,203 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef EVENT_WHEEL_H
+#define EVENT_WHEEL_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statelist.h>
+#include <cacheConstants.h>
+#include <slabPool.h>
+
+namespace Memory {
+
+  class CACHE_LINE_ALIGNED Event : public FixStateListObject
+	{
+		private:
+			Signal *signal_;
+			W64    clock_;
+			void   *arg_;
+
+			/* LP that scheduled it and host time it did, -mem-parallelism */
+			W64    ready_;
+			W16    source_;
+
+		public:
+			void init() {
+				signal_ = NULL;
+				clock_ = -1;
+				arg_ = NULL;
+				ready_ = 0;
+				source_ = 0;
+			}
+
+			void setup(Signal *signal, W64 clock, void *arg) {
+				signal_ = signal;
+				clock_ = clock;
+				arg_ = arg;
+			}
+
+			bool execute() {
+				return signal_->emit(arg_);
+			}
+
+			W64 get_clock() {
+				return clock_;
+			}
+
+			Signal* get_signal() {
+				return signal_;
+			}
+
+			void set_source(W16 source, W64 ready) {
+				source_ = source;
+				ready_ = ready;
+			}
+
+			W16 get_source() {
+				return source_;
+			}
+
+			W64 get_ready() {
+				return ready_;
+			}
+
+			void* get_arg() {
+				return arg_;
+			}
+
+			ostream& print(ostream& os) const {
+				os << "Event< ";
+				if(signal_)
+					os << "Signal:" << signal_->get_name() << " ";
+				os << "Clock:" << clock_ << " ";
+				os << "arg:" << arg_ ;
+				os << ">" << endl, flush;
+				return os;
+			}
+
+			bool operator ==(Event &event) {
+				if(clock_ == event.clock_)
+					return true;
+				return false;
+			}
+
+			bool operator >(Event &event) {
+				if(clock_ > event.clock_)
+					return true;
+				return false;
+			}
+
+			bool operator <(Event &event) {
+				if(clock_ < event.clock_)
+					return true;
+				return false;
+			}
+
+            bool operator >=(Event &event) {
+                if (clock_ >= event.clock_)
+                    return true;
+                return false;
+            }
+	};
+
+  static inline ostream& operator <<(ostream& os, const Event& event) {
+      return event.print(os);
+  }
+
+/*
+ * EventWheel
+ *
+ * Timing wheel of Events keyed by their simulation cycle. Each slot of the
+ * wheel holds the events of one cycle in FIFO order, so insertion and removal
+ * of due events are O(1). Events that are scheduled further than
+ * EVENT_WHEEL_SIZE cycles in future are kept in a sorted overflow list and
+ * moved into the wheel when their cycle enters the wheel window.
+ *
+ * Events are allocated from a SlabPool that grows by EVENT_POOL_SLAB_SIZE
+ * entries, so there is no hard limit on the number of pending events.
+ */
+class EventWheel
+{
+	public:
+		EventWheel();
+		~EventWheel();
+
+		Event* alloc();
+		void free(Event *event);
+
+		void schedule(Event *event);
+		Event* pop(W64 clock);
+		W64 get_next_clock() const;
+
+		void reset();
+
+		bool empty() const {
+			return (wheelCount_ + overflow_.count) == 0;
+		}
+
+		int count() const {
+			return wheelCount_ + overflow_.count;
+		}
+
+		int capacity() const {
+			return pool_.capacity();
+		}
+
+		void set_pool_stats(PoolStats *stats) {
+			pool_.set_stats(stats);
+		}
+
+		ostream& print(ostream& os) const;
+
+	private:
+		array<StateList, EVENT_WHEEL_SIZE> slots_;
+		StateList overflow_;
+		SlabPool<Event, EVENT_POOL_SLAB_SIZE> pool_;
+
+		/* Next cycle whose slot has not been drained yet */
+		W64 curClock_;
+		int wheelCount_;
+
+		StateList& get_slot(W64 clock) {
+			return slots_[clock & (EVENT_WHEEL_SIZE - 1)];
+		}
+
+		bool in_window(W64 clock) const {
+			return (clock - curClock_) < (W64)EVENT_WHEEL_SIZE;
+		}
+
+		void insert_sorted(StateList& list, Event *event);
+		void migrate_overflow();
+};
+
+static inline ostream& operator <<(ostream& os, const EventWheel& wheel)
+{
+	return wheel.print(os);
+}
+
+};
+
+#endif // EVENT_WHEEL_H
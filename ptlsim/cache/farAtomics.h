@@ -0,0 +1,110 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef FAR_ATOMICS_H
+#define FAR_ATOMICS_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+/**
+ * @brief Timing of atomic operations executed at the last level cache
+ *
+ * With -far-atomics the locked load of an atomic RMW is not sent through
+ * the core's caches, the operation is shipped to the shared cache, done
+ * there and only its result comes back, so a contended line stays in the
+ * shared cache instead of moving between the cores' caches. Copies of the
+ * line in private caches are dropped when the operation reaches it.
+ *
+ * Operations on one line are serialized: each holds the line for
+ * 'occupancy' cycles (-far-atomic-occupancy) once it arrived, half the
+ * round trip 'latency' (-far-atomic-latency) after issue, and its result
+ * is back the other half later. Busy lines are kept in a small direct
+ * mapped table, a line that replaced another one in its slot is not
+ * serialized with the operations on it still in flight.
+ */
+struct FarAtomicUnit {
+    static const int LINES = 256;
+    static const int LINE_SIZE = 64;
+    static const W64 INVALID_LINE = W64(-1);
+
+    struct Line {
+        W64 line;
+        W64 busyUntil;
+    };
+
+    Line lines[LINES];
+    W64 latency;
+    W64 occupancy;
+
+    FarAtomicUnit() : latency(20), occupancy(4) { reset(); }
+
+    void reset() {
+        foreach (i, LINES) {
+            lines[i].line = INVALID_LINE;
+            lines[i].busyUntil = 0;
+        }
+    }
+
+    /*
+     * Cycle the result of an operation issued on line at cycle is back,
+     * wait is set to the cycles it waited for earlier ones on the line
+     */
+    W64 execute(W64 line, W64 cycle, W64 &wait) {
+        Line &slot = lines[line % LINES];
+        W64 arrival = cycle + latency / 2;
+        W64 start = arrival;
+
+        if (slot.line == line && slot.busyUntil > arrival)
+            start = slot.busyUntil;
+
+        slot.line = line;
+        slot.busyUntil = start + occupancy;
+
+        wait = start - arrival;
+        return slot.busyUntil + (latency - latency / 2);
+    }
+};
+
+/*
+ * Written under the machine's node, split in user and kernel by the mode
+ * of the core that issued the operation:
+ *
+ *   far_atomics:
+ *     ops: .., serialized: .., wait_cycles: .., invalidations: ..,
+ *     latency: {count: .., ..}
+ *
+ * serialized counts the operations that waited for earlier ones on their
+ * line, invalidations the private cache lines they dropped.
+ */
+struct FarAtomicStats : public Statable
+{
+    StatObj<W64> ops;
+    StatObj<W64> serialized;
+    StatObj<W64> wait_cycles;
+    StatObj<W64> invalidations;
+    StatHistogram<> latency;
+
+    FarAtomicStats(Statable *parent)
+        : Statable("far_atomics", parent)
+          , ops("ops", this)
+          , serialized("serialized", this)
+          , wait_cycles("wait_cycles", this)
+          , invalidations("invalidations", this)
+          , latency("latency", this)
+    {}
+};
+
+};
+
+#endif // FAR_ATOMICS_H
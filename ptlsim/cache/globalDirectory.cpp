@@ -10,6 +10,8 @@
 
 #include <globalDirectory.h>
 
+#include <new>
+
 /* Local variables and functions */
 static W16 line_bits = log2(DIR_LINE_SIZE);
 
@@ -26,6 +28,7 @@ void DirectoryEntry::reset()
 {
     present.reset();
     tag   = -1;
+    lastUse = 0;
     owner = -1;
     dirty = 0;
 	locked = 0;
@@ -40,47 +43,314 @@ void DirectoryEntry::init(W64 tag_)
     present.reset();
 }
 
-Directory::Directory()
+Directory::Directory(BaseMachine &machine, const char *name)
+    : useCounter_(0)
+{
+    if (!machine.get_option(name, "sets", sets_))
+        sets_ = DIR_SET;
+
+    if (!machine.get_option(name, "ways", ways_))
+        ways_ = DIR_WAY;
+
+    if (sets_ <= 0 || (sets_ & (sets_ - 1)) || ways_ <= 0) {
+        ptl_logfile << "ERROR: Global Directory sets must be a power of 2 "
+            << "and ways must be positive, got sets " << sets_
+            << " ways " << ways_ << endl;
+        assert(0);
+    }
+
+    if (!machine.get_option(name, "sharer_group", sharerGroup_))
+        sharerGroup_ = DIR_SHARER_GROUP;
+
+    if (!machine.get_option(name, "sharer_pointers", sharerPointers_))
+        sharerPointers_ = DIR_SHARER_POINTERS;
+
+    sharerGroup_    = max(sharerGroup_, 1);
+    sharerPointers_ = max(sharerPointers_, 1);
+
+    stringbuf encoding;
+    encoding_ = DIR_SHARERS_FULL;
+
+    if (machine.get_option(name, "sharers", encoding)) {
+        if (encoding == "coarse") {
+            encoding_ = DIR_SHARERS_COARSE;
+        } else if (encoding == "limited") {
+            encoding_ = DIR_SHARERS_LIMITED;
+        } else if (!(encoding == "full")) {
+            ptl_logfile << "ERROR: Unknown Global Directory sharer encoding "
+                << encoding << endl;
+            assert(0);
+        }
+    }
+
+    chunkSets_ = min(sets_, DIR_CHUNK_SETS);
+    entries_ = new LazyChunks(sets_ / chunkSets_,
+            sizeof(DirectoryEntry) * chunkSets_ * ways_);
+}
+
+/**
+ * @brief Entries of the set of given address, allocated on first use
+ */
+DirectoryEntry* Directory::get_set(W64 addr)
 {
-    entries = new base_t();
+    int set = set_of(addr);
+    bool fresh;
+    DirectoryEntry *chunk = (DirectoryEntry*)entries_->get(
+            set / chunkSets_, fresh);
+
+    if unlikely (fresh) {
+        foreach (i, chunkSets_ * ways_)
+            new (&chunk[i]) DirectoryEntry();
+    }
+
+    return &chunk[(set & (chunkSets_ - 1)) * ways_];
 }
 
+/**
+ * @brief Select an entry for given request's line
+ *
+ * @param req Memory request
+ * @param old_tag Tag of the replaced valid entry, INVALID if none
+ *
+ * @return Directory entry with line's tag, not yet initialized
+ */
 DirectoryEntry* Directory::insert(MemoryRequest *req, W64& old_tag)
 {
-    W64 phys_addr = req->get_physical_address();
-    DirectoryEntry* entry = entries->select(phys_addr, old_tag);
+    W64 tag = tag_of(req->get_physical_address());
+    DirectoryEntry *set = get_set(tag);
+    DirectoryEntry *victim = &set[0];
 
-    return entry;
+    old_tag = InvalidTag<W64>::INVALID;
+
+    foreach (i, ways_) {
+        DirectoryEntry *entry = &set[i];
+
+        if (entry->tag == tag) {
+            entry->lastUse = useCounter_++;
+            return entry;
+        }
+
+        /* Prefer free entries, then the least recently used one */
+        if (victim->tag == InvalidTag<W64>::INVALID)
+            continue;
+
+        if (entry->tag == InvalidTag<W64>::INVALID ||
+                entry->lastUse < victim->lastUse)
+            victim = entry;
+    }
+
+    old_tag         = victim->tag;
+    victim->tag     = tag;
+    victim->lastUse = useCounter_++;
+
+    return victim;
 }
 
 DirectoryEntry* Directory::probe(MemoryRequest *req)
 {
-    W64 phys_addr = req->get_physical_address();
-    DirectoryEntry* entry = entries->probe(phys_addr);
+    W64 tag = tag_of(req->get_physical_address());
+    DirectoryEntry *set = find_set(tag);
+    if (!set) return NULL;
+
+    foreach (i, ways_) {
+        if (set[i].tag == tag) {
+            set[i].lastUse = useCounter_++;
+            return &set[i];
+        }
+    }
 
-    return entry;
+    return NULL;
 }
 
 int Directory::invalidate(MemoryRequest *req)
 {
-    return entries->invalidate(req->get_physical_address());
+    W64 tag = tag_of(req->get_physical_address());
+    DirectoryEntry *set = find_set(tag);
+    if (!set) return -1;
+
+    foreach (i, ways_) {
+        if (set[i].tag == tag) {
+            set[i].reset();
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Caches the directory hardware would invalidate for an entry
+ *
+ * @param entry Directory entry
+ * @param targets Set to the sharers as seen through the encoding, always
+ * a superset of entry's exact sharers
+ *
+ * @return true if a limited pointer entry overflowed to a broadcast
+ */
+bool Directory::get_invalidation_targets(const DirectoryEntry *entry,
+        bitvec<NUM_SIM_CORES> &targets) const
+{
+    targets = entry->present;
+
+    switch (encoding_) {
+        case DIR_SHARERS_COARSE:
+            foreach (i, NUM_SIM_CORES) {
+                if (!entry->present.test(i))
+                    continue;
+
+                int first = (i / sharerGroup_) * sharerGroup_;
+                for (int j = first; j < first + sharerGroup_ &&
+                        j < NUM_SIM_CORES; j++)
+                    targets.set(j);
+            }
+            break;
+        case DIR_SHARERS_LIMITED:
+            if ((int)entry->present.popcount() > sharerPointers_) {
+                targets.setall();
+                return true;
+            }
+            break;
+        case DIR_SHARERS_FULL:
+        default:
+            break;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Sharer storage of one entry in the modelled hardware
+ */
+int Directory::get_sharer_bits() const
+{
+    int pointerBits = 1;
+
+    switch (encoding_) {
+        case DIR_SHARERS_COARSE:
+            return (NUM_SIM_CORES + sharerGroup_ - 1) / sharerGroup_;
+        case DIR_SHARERS_LIMITED:
+            while ((1 << pointerBits) < NUM_SIM_CORES)
+                pointerBits++;
+
+            /* Pointers plus an overflow bit */
+            return sharerPointers_ * pointerBits + 1;
+        case DIR_SHARERS_FULL:
+        default:
+            return NUM_SIM_CORES;
+    }
+}
+
+void Directory::dump_configuration(YAML::Emitter &out) const
+{
+    const char *encodings[] = {"full", "coarse", "limited"};
+
+	YAML_KEY_VAL(out, "size", sets_ * ways_);
+	YAML_KEY_VAL(out, "line_size", DIR_LINE_SIZE);
+	YAML_KEY_VAL(out, "sets", sets_);
+	YAML_KEY_VAL(out, "ways", ways_);
+	YAML_KEY_VAL(out, "sharers", encodings[encoding_]);
+	YAML_KEY_VAL(out, "sharer_bits", get_sharer_bits());
+
+    if (encoding_ == DIR_SHARERS_COARSE)
+        YAML_KEY_VAL(out, "sharer_group", sharerGroup_);
+    if (encoding_ == DIR_SHARERS_LIMITED)
+        YAML_KEY_VAL(out, "sharer_pointers", sharerPointers_);
+}
+
+/**
+ * @brief Save or load the entries that track lines, see warmstate.h
+ *
+ * Entries of each set are saved from least to most recently used, so
+ * inserting them back in that order keeps their LRU order.
+ */
+void Directory::transfer_warm_state(WarmState &state)
+{
+    W64 count = 0;
+
+    if (state.saving()) {
+        dynarray<DirectoryEntry*> valid;
+
+        foreach (i, sets_ / chunkSets_) {
+            DirectoryEntry *chunk = (DirectoryEntry*)entries_->find(i);
+            if (!chunk) continue;
+
+            foreach (j, chunkSets_) {
+                int first = valid.count();
+
+                foreach (k, ways_) {
+                    DirectoryEntry *entry = &chunk[j * ways_ + k];
+                    if (entry->tag == InvalidTag<W64>::INVALID)
+                        continue;
+
+                    int pos = valid.count();
+                    valid.push(entry);
+                    while (pos > first &&
+                            valid[pos - 1]->lastUse > entry->lastUse) {
+                        valid[pos] = valid[pos - 1];
+                        pos--;
+                    }
+                    valid[pos] = entry;
+                }
+            }
+        }
+
+        count = valid.count();
+        state.value(count);
+        foreach (i, valid.count()) {
+            DirectoryEntry *entry = valid[i];
+            state.value(entry->tag);
+            state.value(entry->present);
+            state.value(entry->dirty);
+            state.value(entry->owner);
+        }
+        return;
+    }
+
+    state.value(count);
+
+    MemoryRequest request;
+    foreach (i, count) {
+        W64 tag;
+        bitvec<NUM_SIM_CORES> present;
+        bool dirty;
+        W8 owner;
+
+        state.value(tag);
+        state.value(present);
+        state.value(dirty);
+        state.value(owner);
+        if (!state.ok())
+            break;
+
+        W64 old_tag;
+        request.set_physical_address(tag);
+        DirectoryEntry *entry = insert(&request, old_tag);
+        entry->init(tag);
+        entry->present = present;
+        entry->dirty = dirty;
+        entry->owner = owner;
+    }
 }
 
 Directory* Directory::dir = NULL;
-FixStateList<DirContBufferEntry, REQ_Q_SIZE>*
+IndexedFixStateList<DirContBufferEntry, REQ_Q_SIZE>*
 DirectoryController::pendingRequests_ = NULL;
 
 /**
  * @brief Get the global directory
  *
+ * @param machine Machine to read directory options from
+ * @param name Name of the controller whose options configure the
+ * directory, only used on first call
+ *
  * @return reference to global Directory
  */
-Directory& Directory::get_directory()
+Directory& Directory::get_directory(BaseMachine &machine, const char *name)
 {
     if (dir == NULL) {
-        dir = new Directory();
+        dir = new Directory(machine, name);
         DirectoryController::pendingRequests_ =
-            new FixStateList<DirContBufferEntry, REQ_Q_SIZE>();
+            new IndexedFixStateList<DirContBufferEntry, REQ_Q_SIZE>();
     }
 
     return *dir;
@@ -94,7 +364,8 @@ DirectoryController* DirectoryController::dir_controllers[NUM_SIM_CORES] = {0};
 DirectoryController::DirectoryController(W8 idx, const char *name,
         MemoryHierarchy *memoryHierarchy)
     : Controller(idx, name, memoryHierarchy)
-      , dir_(Directory::get_directory())
+      , dir_(Directory::get_directory(memoryHierarchy->get_machine(), name))
+      , new_stats(name, &memoryHierarchy->get_machine())
 {
     memoryHierarchy_->add_cache_mem_controller(this);
 
@@ -322,8 +593,7 @@ bool DirectoryController::read_miss_cb(void *arg)
                     queueEntry);
         } else {
             queueEntry->responder = lower_cont;
-            marss_add_event(&sig_dir->send_update,
-                    DIR_ACCESS_DELAY, queueEntry);
+            sig_dir->start_update(queueEntry);
         }
 
         return true;
@@ -521,35 +791,82 @@ bool DirectoryController::evict_cb(void *arg)
  * @return true on success
  *
  */
+/**
+ * @brief Start sending UPDATE to the owner of queueEntry's dirty line
+ *
+ * @param queueEntry Entry of the miss that waits for the writeback
+ */
+void DirectoryController::start_update(DirContBufferEntry *queueEntry)
+{
+    UpdateTransaction *txn = updateTxns_.alloc();
+    txn->init();
+    txn->queueEntry = queueEntry;
+    send_update_cb(txn);
+}
+
+/**
+ * @brief Resume an update transaction after its wait
+ *
+ * @param arg UpdateTransaction to resume
+ *
+ * @return True on success
+ */
 bool DirectoryController::send_update_cb(void *arg)
 {
-    DirContBufferEntry *queueEntry = (DirContBufferEntry*)arg;
-    if (queueEntry->annuled)
-        return true;
+    UpdateTransaction *txn = (UpdateTransaction*)arg;
 
-    DirContBufferEntry *newEntry = pendingRequests_->alloc();
+    if (update_txn(*txn))
+        updateTxns_.free(txn);
+    else
+        marss_add_event(&send_update, txn->waitCycles, txn);
 
-    if (!newEntry) {
-        marss_add_event(&send_update, 1,
-                queueEntry);
-        return true;
-    }
+    return true;
+}
+
+/**
+ * @brief Send UPDATE message to the owner of the line, see Transaction
+ *
+ * @param txn Transaction to run up to its next wait
+ *
+ * @return True once the message is sent or the miss is annulled
+ */
+bool DirectoryController::update_txn(UpdateTransaction &txn)
+{
+    TXN_BEGIN(txn);
 
-    newEntry->request = memoryHierarchy_->get_free_request(
-            queueEntry->request->get_coreid());
-    newEntry->request->init(queueEntry->request);
-    newEntry->request->incRefCounter();
-    newEntry->request->set_op_type(MEMORY_OP_UPDATE);
-    newEntry->entry  = queueEntry->entry;
-    newEntry->origin = (queueEntry->cont) ? queueEntry->idx : -1;
+    TXN_WAIT(txn, DIR_ACCESS_DELAY);
 
-    ADD_HISTORY_ADD(newEntry->request);
+    for (;;) {
+        if (txn.queueEntry->annuled)
+            TXN_EXIT(txn);
+        txn.newEntry = pendingRequests_->alloc();
+        if (txn.newEntry)
+            break;
+        TXN_WAIT(txn, 1);
+    }
 
-    newEntry->cont      = controllers[queueEntry->entry->owner];
-    newEntry->responder = queueEntry->responder;
-    send_msg_cb(newEntry);
+    txn.newEntry->request = memoryHierarchy_->get_free_request(
+            txn.queueEntry->request->get_coreid());
+    txn.newEntry->request->init(txn.queueEntry->request);
+    txn.newEntry->request->incRefCounter();
+    txn.newEntry->request->set_op_type(MEMORY_OP_UPDATE);
+    txn.newEntry->entry  = txn.queueEntry->entry;
+    txn.newEntry->origin = (txn.queueEntry->cont) ?
+        txn.queueEntry->idx : -1;
+    index_entry(txn.newEntry);
+
+    ADD_HISTORY_ADD(txn.newEntry->request);
+
+    txn.newEntry->cont      = controllers[txn.queueEntry->entry->owner];
+    txn.newEntry->responder = txn.queueEntry->responder;
+
+    while (!try_send_msg(txn.newEntry, txn.delay)) {
+        TXN_WAIT(txn, txn.delay);
+        if (txn.newEntry->annuled)
+            TXN_EXIT(txn);
+    }
 
-    return true;
+    TXN_END(txn);
 }
 
 /**
@@ -565,13 +882,6 @@ bool DirectoryController::send_evict_cb(void *arg)
     if (queueEntry->annuled)
         return true;
 
-    /* Check if we have enough free entries in queue */
-    if (pendingRequests_->remaining() <
-            (int)queueEntry->entry->present.popcount()) {
-        marss_add_event(&send_evict, 1, queueEntry);
-        return true;
-    }
-
 	/* While handling this request, if all other cache lines are
 	 * evicted then send response to this request. */
 	if (queueEntry->entry->present.iszero()) {
@@ -581,14 +891,41 @@ bool DirectoryController::send_evict_cb(void *arg)
 		return true;
 	}
 
+    /* Caches that get an evict message as seen through the sharer
+     * encoding. The requester is skipped only as an extra target, as a
+     * real sharer its ack is needed to empty 'present'. */
+    bitvec<NUM_SIM_CORES> targets;
+    bool overflow = dir_.get_invalidation_targets(queueEntry->entry,
+            targets);
+
+    foreach (i, NUM_SIM_CORES) {
+        if (!controllers[i] ||
+                (queueEntry->cont && queueEntry->cont->idx == i &&
+                 !queueEntry->entry->present.test(i)))
+            targets.reset(i);
+    }
+
+    /* Check if we have enough free entries in queue */
+    if (pendingRequests_->remaining() < (int)targets.popcount()) {
+        marss_add_event(&send_evict, 1, queueEntry);
+        return true;
+    }
+
 	queueEntry->entry->locked = 1;
+	queueEntry->holdsLock = 1;
+
+    bool kernel = queueEntry->request->is_kernel();
+
+    if (overflow)
+        N_STAT_UPDATE(new_stats.pointer_overflows, ++, kernel);
 
-    /* Now for each cached entry, send evict message to that
-     * controller */
+    /* Now for each target, send evict message to that controller */
     foreach (i, NUM_SIM_CORES) {
-        if (!queueEntry->entry->present.test(i))
+        if (!targets.test(i))
             continue;
 
+        bool sharer = queueEntry->entry->present.test(i);
+
         DirContBufferEntry *newEntry = pendingRequests_->alloc();
 
         assert(newEntry);
@@ -599,13 +936,22 @@ bool DirectoryController::send_evict_cb(void *arg)
         newEntry->request->incRefCounter();
         newEntry->request->set_op_type(MEMORY_OP_EVICT);
         newEntry->entry  = queueEntry->entry;
-        newEntry->origin = (queueEntry->cont) ? queueEntry->idx : -1;
+
+        /* Only acks of real sharers can complete the original request,
+         * so it gets a single response. */
+        newEntry->origin = (queueEntry->cont && sharer) ?
+            queueEntry->idx : -1;
+        index_entry(newEntry);
 
         ADD_HISTORY_ADD(newEntry->request);
 
         newEntry->cont      = controllers[i];
         newEntry->responder = this;
         dir_controllers[i]->send_msg_cb(newEntry);
+
+        N_STAT_UPDATE(new_stats.invalidations, ++, kernel);
+        if (!sharer)
+            N_STAT_UPDATE(new_stats.extra_invalidations, ++, kernel);
     }
 
     if (queueEntry->free_on_success) {
@@ -631,6 +977,7 @@ bool DirectoryController::send_response_cb(void *arg)
     queueEntry->entry->present.set(queueEntry->cont->idx);
 
 	queueEntry->entry->locked = 0;
+	queueEntry->holdsLock = 0;
 
     if (queueEntry->request->get_type() == MEMORY_OP_WRITE) {
         queueEntry->entry->owner = queueEntry->cont->idx;
@@ -671,6 +1018,24 @@ bool DirectoryController::send_msg_cb(void *arg)
     if (queueEntry->annuled)
         return true;
 
+    int delay;
+    if (!try_send_msg(queueEntry, delay))
+        marss_add_event(&send_msg, delay, queueEntry);
+
+    return true;
+}
+
+/**
+ * @brief Send queue entry's message to interconnect once
+ *
+ * @param queueEntry Queue entry to use to send message
+ * @param delay Set to the cycles to wait before a retry
+ *
+ * @return False if the interconnect didn't take the message
+ */
+bool DirectoryController::try_send_msg(DirContBufferEntry *queueEntry,
+        int &delay)
+{
     Message& message  = *memoryHierarchy_->get_message();
     message.sender    = this;
     message.dest      = queueEntry->cont;
@@ -688,12 +1053,11 @@ bool DirectoryController::send_msg_cb(void *arg)
     memoryHierarchy_->free_message(&message);
 
     if (!success) {
-        int delay = interconn_->get_delay();
+        delay = interconn_->get_delay();
         if (delay == 0) delay = AVG_WAIT_DELAY;
         if (queueEntry->request->get_type() == MEMORY_OP_EVICT)
             delay = 1;
-        marss_add_event(&send_msg, delay, queueEntry);
-        return true;
+        return false;
     }
 
     if (queueEntry->free_on_success) {
@@ -721,29 +1085,32 @@ DirContBufferEntry* DirectoryController::add_entry(Message *msg)
     queueEntry->request = msg->request;
     queueEntry->request->incRefCounter();
     queueEntry->cont = (Controller*)msg->origin;
+    index_entry(queueEntry);
 
     ADD_HISTORY_ADD(queueEntry->request);
 
     return queueEntry;
 }
 
-DirContBufferEntry* DirectoryController::get_entry(int idx)
+/* Once its request and address are set, entries are found by their line */
+void DirectoryController::index_entry(DirContBufferEntry *queueEntry)
 {
-    DirContBufferEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_->list(), queueEntry, entry,
-            preventry) {
-        if (idx == queueEntry->idx)
-            return queueEntry;
-    }
+    pendingRequests_->index(queueEntry,
+            get_line_addr(queueEntry->request->get_physical_address()));
+}
 
-    return NULL;
+DirContBufferEntry* DirectoryController::get_entry(int idx)
+{
+    DirContBufferEntry* queueEntry = &(*pendingRequests_)[idx];
+    return (queueEntry->free) ? NULL : queueEntry;
 }
 
 DirContBufferEntry* DirectoryController::find_entry(MemoryRequest *req)
 {
-    DirContBufferEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_->list(), queueEntry, entry,
-            preventry) {
+    DirContBufferEntry* queueEntry = pendingRequests_->first(
+            get_line_addr(req->get_physical_address()));
+
+    for (; queueEntry; queueEntry = pendingRequests_->next(queueEntry)) {
         if (req == queueEntry->request)
             return queueEntry;
     }
@@ -756,23 +1123,20 @@ DirContBufferEntry* DirectoryController::find_dependent_enry(
 {
     W64 line_addr = get_line_addr(req->get_physical_address());
 
-    DirContBufferEntry* queueEntry;
-    foreach_list_mutable(pendingRequests_->list(), queueEntry, entry,
-            preventry) {
+    /* Oldest entry of the line, then the last one chained behind it */
+    DirContBufferEntry* queueEntry = pendingRequests_->first(line_addr);
+    for (; queueEntry; queueEntry = pendingRequests_->next(queueEntry)) {
 
         if (req == queueEntry->request || queueEntry->annuled)
             continue;
 
-        if (get_line_addr(queueEntry->request->get_physical_address())
-                == line_addr) {
-            while(queueEntry->depends >= 0) {
-                if ((*pendingRequests_)[queueEntry->depends].annuled)
-                    break;
-                queueEntry = &(*pendingRequests_)[queueEntry->depends];
-            }
-
-            return queueEntry;
+        while(queueEntry->depends >= 0) {
+            if ((*pendingRequests_)[queueEntry->depends].annuled)
+                break;
+            queueEntry = &(*pendingRequests_)[queueEntry->depends];
         }
+
+        return queueEntry;
     }
 
     return NULL;
@@ -804,6 +1168,8 @@ DirectoryEntry* DirectoryController::get_directory_entry(
          * must send evict signal to those caches. */
         if ((old_tag != InvalidTag<W64>::INVALID && old_tag != (W64)-1) &&
                 entry->present.nonzero()) {
+            N_STAT_UPDATE(new_stats.dir_evictions, ++, req->is_kernel());
+
             DirContBufferEntry *newEntry = pendingRequests_->alloc();
 
             assert(newEntry);
@@ -816,6 +1182,7 @@ DirectoryEntry* DirectoryController::get_directory_entry(
             newEntry->request->set_op_type(MEMORY_OP_EVICT);
             newEntry->entry = get_dummy_entry(entry, old_tag);
             newEntry->free_on_success = 1;
+            index_entry(newEntry);
 
             ADD_HISTORY_ADD(newEntry->request);
 
@@ -938,12 +1305,33 @@ bool DirectoryController::is_full(bool flag, MemoryRequest *request) const
     return false;
 }
 
+/* True if evicts or an update sent for the entry will answer it */
+bool DirectoryController::has_children(DirContBufferEntry *queueEntry)
+{
+    DirContBufferEntry *entry = pendingRequests_->first(
+            get_line_addr(queueEntry->request->get_physical_address()));
+
+    for (; entry; entry = pendingRequests_->next(entry)) {
+        if (entry != queueEntry && entry->origin == queueEntry->idx)
+            return true;
+    }
+    return false;
+}
+
 void DirectoryController::annul_request(MemoryRequest *request)
 {
     DirContBufferEntry *entry;
     foreach_list_mutable (pendingRequests_->list(), entry,
             entry_t, nextentry_t) {
-        if (entry->request->is_same(request)) {
+        if (entry->request == request) {
+            /*
+             * Once evicts or an update are out the entry may hold the
+             * line's lock and its children find it by index, so it
+             * completes and send_response_cb() unlocks the line.
+             */
+            if (entry->holdsLock || has_children(entry))
+                continue;
+
             entry->annuled = true;
             ADD_HISTORY_REM(entry->request);
             entry->request->decRefCounter();
@@ -965,14 +1353,23 @@ void DirectoryController::dump_configuration(YAML::Emitter &out) const
 	out << YAML::Key << get_name() << YAML::Value << YAML::BeginMap;
 
 	YAML_KEY_VAL(out, "type", "directory");
-	YAML_KEY_VAL(out, "size", DIR_SET * DIR_WAY);
-	YAML_KEY_VAL(out, "line_size", DIR_LINE_SIZE);
-	YAML_KEY_VAL(out, "sets", DIR_SET);
-	YAML_KEY_VAL(out, "ways", DIR_WAY);
+	dir_.dump_configuration(out);
 
 	out << YAML::EndMap;
 }
 
+/**
+ * @brief Save or load the directory, which all directory controllers
+ * share, so only the first one does it
+ */
+void DirectoryController::transfer_warm_state(WarmState &state)
+{
+    if (idx != 0)
+        return;
+
+    dir_.transfer_warm_state(state);
+}
+
 /**
  * @brief A Builder plugin for Global Directory Controller
  */
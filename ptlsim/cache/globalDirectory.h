@@ -18,6 +18,9 @@
 #include <memoryHierarchy.h>
 
 #include <machine.h>
+#include <lazyChunks.h>
+#include <slabPool.h>
+#include <transaction.h>
 
 using namespace Memory;
 
@@ -25,15 +28,35 @@ using namespace Memory;
 #define DIR_WAY 16
 #define DIR_LINE_SIZE 64
 #define DIR_ACCESS_DELAY 10
+/* Sets of the directory allocated together on first use */
+#define DIR_CHUNK_SETS 256
 #define REQ_Q_SIZE 128
 
+/* Default group size and pointer count of inexact sharer encodings */
+#define DIR_SHARER_GROUP 4
+#define DIR_SHARER_POINTERS 4
+
+/**
+ * @brief Sharer encodings of the modelled directory hardware
+ *
+ * FULL    : one presence bit per core
+ * COARSE  : one bit per group of 'sharer_group' cores
+ * LIMITED : 'sharer_pointers' core pointers, broadcast on overflow
+ */
+enum DirSharerEncoding {
+    DIR_SHARERS_FULL,
+    DIR_SHARERS_COARSE,
+    DIR_SHARERS_LIMITED,
+};
+
 /**
  * @brief A Directory entry containing information for one line
  */
 struct DirectoryEntry {
+    W64  tag;
+    W64  lastUse;
     bitvec<NUM_SIM_CORES> present;
     bool dirty;
-    W64  tag;
     W8   owner;
 	bool locked;
 
@@ -53,39 +76,104 @@ static inline ostream& operator <<(ostream &os, const DirectoryEntry &e)
     return e.print(os);
 }
 
+struct DirectoryStats : public Statable
+{
+    /* Valid entries replaced to make room for a new line */
+    StatObj<W64> dir_evictions;
+    /* Evict messages sent to caches */
+    StatObj<W64> invalidations;
+    /* Evict messages sent to caches that did not hold the line */
+    StatObj<W64> extra_invalidations;
+    /* Limited pointer entries that had to broadcast */
+    StatObj<W64> pointer_overflows;
+
+    DirectoryStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , dir_evictions("dir_evictions", this)
+          , invalidations("invalidations", this)
+          , extra_invalidations("extra_invalidations", this)
+          , pointer_overflows("pointer_overflows", this)
+    {}
+};
+
 /**
  * @brief A Directory containing cacheline informations.
  *
  * This is a singleton class so there is only one Global directory.
  * All directory controllers get access to this directory and should
- * simulate appropriate access delay. This directory is a set-assoc
- * structure. The size of the directory is statically set.
+ * simulate appropriate access delay. This directory is a sparse
+ * set-assoc structure with LRU replacement, the ways of a set are
+ * stored next to each other so a probe touches a single run of memory.
+ * Replacing an entry whose line is still cached invalidates the line in
+ * all its sharers.
+ *
+ * Size and sharer encoding are taken from the options of the first
+ * directory controller:
+ *   sets, ways      : directory geometry, sets must be a power of 2
+ *   sharers         : 'full', 'coarse' or 'limited'
+ *   sharer_group    : cores per bit of 'coarse' encoding
+ *   sharer_pointers : pointers of 'limited' encoding
+ *
+ * Entries keep the exact set of sharers for protocol bookkeeping, the
+ * encoding decides which caches get an evict message when the line is
+ * invalidated.
+ *
+ * Entries are allocated and reset DIR_CHUNK_SETS sets at a time when a
+ * line of those sets is first inserted, so a large directory costs
+ * nothing until it is used.
  *
  * TODO:
- *	- Allow configuration options to dynamically set directory size.
  *	- Simulate limited port access
  */
 class Directory {
     private:
-        Directory();
+        Directory(BaseMachine &machine, const char *name);
         static Directory* dir;
 
-        typedef AssociativeArray<W64, DirectoryEntry, DIR_SET,
-                DIR_WAY, DIR_LINE_SIZE> base_t;
-        typedef FullyAssociativeArray<W64, DirectoryEntry, DIR_WAY,
-                NullAssociativeArrayStatisticsCollector<W64,
-                DirectoryEntry> > Set;
+        /* 'ways_' entries of each set are contiguous */
+        LazyChunks *entries_;
+        int sets_;
+        int ways_;
+        int chunkSets_;
+        W64 useCounter_;
+
+        DirSharerEncoding encoding_;
+        int sharerGroup_;
+        int sharerPointers_;
+
+        int set_of(W64 addr) const {
+            return (addr / DIR_LINE_SIZE) & (sets_ - 1);
+        }
+
+        /* Entries of the set, NULL if its chunk was never used */
+        DirectoryEntry *find_set(W64 addr) const {
+            int set = set_of(addr);
+            DirectoryEntry *chunk = (DirectoryEntry*)entries_->find(
+                    set / chunkSets_);
+            if (!chunk) return NULL;
+            return &chunk[(set & (chunkSets_ - 1)) * ways_];
+        }
 
-        base_t* entries;
+        DirectoryEntry *get_set(W64 addr);
 
     public:
-        static Directory& get_directory();
+        static Directory& get_directory(BaseMachine &machine,
+                const char *name);
 
         DirectoryEntry *insert(MemoryRequest *req, W64&old_tag);
         DirectoryEntry *probe(MemoryRequest *req);
         int             invalidate(MemoryRequest *req);
 
-        W64 tag_of(W64 addr) { return base_t::tagof(addr); }
+        W64 tag_of(W64 addr) { return addr & ~(W64)(DIR_LINE_SIZE - 1); }
+
+        bool get_invalidation_targets(const DirectoryEntry *entry,
+                bitvec<NUM_SIM_CORES> &targets) const;
+
+        int get_sets() const { return sets_; }
+        int get_ways() const { return ways_; }
+        int get_sharer_bits() const;
+        void dump_configuration(YAML::Emitter &out) const;
+        void transfer_warm_state(WarmState &state);
 };
 
 struct DirContBufferEntry : public FixStateListObject
@@ -99,6 +187,7 @@ struct DirContBufferEntry : public FixStateListObject
     bool            free_on_success;
     bool            shared;
     bool            hasData;
+    bool            holdsLock; /* set entry->locked, send_response_cb clears it */
     int             depends;
     int             origin;
 
@@ -111,6 +200,7 @@ struct DirContBufferEntry : public FixStateListObject
         origin          = -1;
         shared          = 0;
         hasData         = 0;
+        holdsLock       = 0;
         responder       = NULL;
         wakeup_sig      = NULL;
         free_on_success = 0;
@@ -143,6 +233,25 @@ static inline ostream& operator << (ostream& os, const
     return entry.print(os);
 }
 
+/*
+ * Asks the owner of a dirty line to write it back for queueEntry's miss:
+ * waits out the directory access, a free queue entry for the UPDATE and
+ * an interconnect that takes it.
+ */
+struct UpdateTransaction : public Transaction
+{
+    DirContBufferEntry *queueEntry;
+    DirContBufferEntry *newEntry;
+    int                 delay;
+
+    void init() {
+        Transaction::init();
+        queueEntry = NULL;
+        newEntry   = NULL;
+        delay      = 0;
+    }
+};
+
 /**
  * @brief A Controller interface to access Global Directory
  *
@@ -160,6 +269,8 @@ class DirectoryController : public Controller {
 
         DirectoryEntry dummy_entries[REQ_Q_SIZE];
 
+        DirectoryStats new_stats;
+
         /* Simple function dispatcher to handle memory request */
         typedef bool (DirectoryController::*req_handler)(Message *msg);
         req_handler req_handlers[NUM_MEMORY_OP];
@@ -173,6 +284,8 @@ class DirectoryController : public Controller {
         Signal send_response;
         Signal send_msg;
 
+        SlabPool<UpdateTransaction, 16> updateTxns_;
+
         static Controller   *controllers[NUM_SIM_CORES];
         static Controller   *lower_cont;
 
@@ -181,7 +294,9 @@ class DirectoryController : public Controller {
         DirectoryController(W8 idx, const char *name,
                 MemoryHierarchy *memoryHierachy);
 
-        static FixStateList<DirContBufferEntry, REQ_Q_SIZE> *pendingRequests_;
+        /* Indexed by line address */
+        static IndexedFixStateList<DirContBufferEntry, REQ_Q_SIZE>
+            *pendingRequests_;
 
         bool handle_interconnect_cb(void *arg);
         void register_interconnect(Interconnect *interconnect,
@@ -189,8 +304,10 @@ class DirectoryController : public Controller {
         void print_map(ostream &os);
         void print(ostream &os) const;
         bool is_full(bool flag=false, MemoryRequest *request = NULL) const;
+        bool notifies_space() const { return false; }
         void annul_request(MemoryRequest *request);
 		void dump_configuration(YAML::Emitter &out) const;
+        void transfer_warm_state(WarmState &state);
 
         bool handle_read_miss(Message *message);
         bool handle_write_miss(Message *message);
@@ -206,9 +323,15 @@ class DirectoryController : public Controller {
         bool send_response_cb(void *arg);
         bool send_msg_cb(void *arg);
 
+        void start_update(DirContBufferEntry *queueEntry);
+        bool update_txn(UpdateTransaction &txn);
+        bool try_send_msg(DirContBufferEntry *queueEntry, int &delay);
+
         DirContBufferEntry* add_entry(Message *msg);
+        void index_entry(DirContBufferEntry *queueEntry);
         DirContBufferEntry* get_entry(int idx);
         DirContBufferEntry* find_entry(MemoryRequest *req);
+        bool has_children(DirContBufferEntry *queueEntry);
         DirContBufferEntry* find_dependent_enry(MemoryRequest *req);
         void wakeup_dependent(DirContBufferEntry *queueEntry);
 
@@ -49,13 +49,21 @@ class Interconnect
 
 	public:
 		MemoryHierarchy *memoryHierarchy_;
+		/* Component id of this interconnect with -mem-latency */
+		W16 latencyId_;
+		/* Clock domain from 'clock_domain' option, NULL at sim clock */
+		ClockDomain *clockDomain_;
+
 		Interconnect(const char *name, MemoryHierarchy *memoryHierarchy)
 			: controller_request_("Controller Request")
 			, memoryHierarchy_(memoryHierarchy)
 		{
 			name_ << name;
+			latencyId_ = request_latency_register(name);
 			controller_request_.connect(signal_mem_ptr(*this,
-						&Interconnect::controller_request_cb));
+						&Interconnect::request_cb));
+			clockDomain_ = clock_domain_bind(memoryHierarchy, name, -1);
+			controller_request_.set_perf(host_perf_register(name));
 		}
 
         virtual ~Interconnect()
@@ -63,16 +71,34 @@ class Interconnect
             memoryHierarchy_ = NULL;
         }
 
+		/* Records the request's arrival here before handling it */
+		bool request_cb(void *arg) {
+			if unlikely (request_latency_enabled) {
+				Message *msg = (Message*)arg;
+				msg->request->record_hop(latencyId_);
+			}
+			return controller_request_cb(arg);
+		}
+
 		virtual bool controller_request_cb(void *arg)=0;
 		virtual void register_controller(Controller *controller)=0;
 		virtual int access_fast_path(Controller *controller,
 				MemoryRequest *request)=0;
+		/* See Controller::fill_fast_path */
+		virtual int fill_fast_path(Controller *controller,
+				MemoryRequest *request, bool serve, void **arg) {
+			return -1;
+		}
 		virtual void print_map(ostream& os)=0;
 		virtual void print(ostream& os) const = 0;
 		virtual int get_delay()=0;
 		virtual void annul_request(MemoryRequest* request) = 0;
 		virtual void dump_configuration(YAML::Emitter &out) const = 0;
 
+		/* Only called for interconnects added with
+		 * MemoryHierarchy::add_clocked_interconnect */
+		virtual void clock() { }
+
 		Signal* get_controller_request_signal() {
 			return &controller_request_;
 		}
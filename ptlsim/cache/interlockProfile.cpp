@@ -0,0 +1,45 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <interlockProfile.h>
+
+using namespace Memory;
+
+namespace {
+    /* Most conflicts first, then longest total hold */
+    struct ContentionComparator {
+        int operator ()(const InterlockLockEntry *a,
+                const InterlockLockEntry *b) const {
+            W64 ca = a->conflicts + a->set_full;
+            W64 cb = b->conflicts + b->set_full;
+            if (ca != cb) return (ca > cb) ? -1 : +1;
+            if (a->hold_cycles == b->hold_cycles) return 0;
+            return (a->hold_cycles > b->hold_cycles) ? -1 : +1;
+        }
+    };
+};
+
+int InterlockProfile::top(InterlockLockEntry **list, int count)
+{
+    dynarray<InterlockLockEntry*> used;
+
+    foreach (i, SETS) {
+        foreach (j, WAYS) {
+            if (entries[i][j].activity())
+                used.push(&entries[i][j]);
+        }
+    }
+
+    sort(used.data, used.length, ContentionComparator());
+
+    int n = min(count, (int)used.length);
+    foreach (i, n) list[i] = used[i];
+    return n;
+}
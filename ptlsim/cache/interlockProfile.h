@@ -0,0 +1,180 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef INTERLOCK_PROFILE_H
+#define INTERLOCK_PROFILE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+struct InterlockLockEntry {
+    W64 addr;
+    W64 grabs;       /* locks acquired */
+    W64 conflicts;   /* grabs and probes refused, lock held by another */
+    W64 set_full;    /* grabs refused, no free way in the set */
+    W64 hold_cycles;
+    W64 max_hold;
+
+    void reset(W64 a = 0) {
+        addr = a;
+        grabs = conflicts = set_full = 0;
+        hold_cycles = max_hold = 0;
+    }
+
+    W64 activity() const {
+        return grabs + conflicts + set_full;
+    }
+
+    W64 avg_hold() const {
+        return grabs ? hold_cycles / grabs : 0;
+    }
+};
+
+/**
+ * @brief Contention profile of the interlock buffer by lock address
+ *
+ * Set associative with the least active entry replaced, so memory stays
+ * bounded however many addresses atomic operations touch. Only grabs,
+ * refusals and releases update it: a probe that finds the line free does
+ * not, which keeps it off the path of ordinary loads and stores.
+ */
+struct InterlockProfile {
+    static const int SETS = 64;
+    static const int WAYS = 4;
+
+    InterlockLockEntry entries[SETS][WAYS];
+    W64 evictions;
+
+    InterlockProfile() { reset(); }
+
+    void reset() {
+        foreach (i, SETS) foreach (j, WAYS) entries[i][j].reset();
+        evictions = 0;
+    }
+
+    InterlockLockEntry& lookup(W64 addr) {
+        W64 line = addr >> 3;
+        InterlockLockEntry *set = entries[(line ^ (line >> 6)) % SETS];
+        InterlockLockEntry *victim = &set[0];
+
+        foreach (i, WAYS) {
+            if likely (set[i].addr == addr) return set[i];
+            if (set[i].activity() < victim->activity()) victim = &set[i];
+        }
+
+        if (victim->activity()) evictions++;
+        victim->reset(addr);
+        return *victim;
+    }
+
+    void grab(W64 addr) {
+        lookup(addr).grabs++;
+    }
+
+    void conflict(W64 addr) {
+        lookup(addr).conflicts++;
+    }
+
+    void set_full(W64 addr) {
+        lookup(addr).set_full++;
+    }
+
+    void release(W64 addr, W64 cycles) {
+        InterlockLockEntry& e = lookup(addr);
+        e.hold_cycles += cycles;
+        e.max_hold = max(e.max_hold, cycles);
+    }
+
+    /* Fill list with the count most contended addresses */
+    int top(InterlockLockEntry **list, int count);
+};
+
+struct InterlockRowStats : public Statable
+{
+    StatObj<W64> addr;
+    StatObj<W64> grabs;
+    StatObj<W64> conflicts;
+    StatObj<W64> set_full;
+    StatObj<W64> avg_hold;
+    StatObj<W64> max_hold;
+
+    InterlockRowStats(stringbuf &name, Statable *parent)
+        : Statable(name, parent)
+          , addr("addr", this)
+          , grabs("grabs", this)
+          , conflicts("conflicts", this)
+          , set_full("set_full", this)
+          , avg_hold("avg_hold", this)
+          , max_hold("max_hold", this)
+    {}
+};
+
+/*
+ * Interlock buffer counters of the machine, split in user and kernel by
+ * the mode of the requesting VCPU, with the most contended addresses
+ * written at the end of the run:
+ *
+ *   interlocks:
+ *     grabs: .., acquired: .., held: .., set_full: .., probes: ..,
+ *     probe_conflicts: .., releases: .., hold_cycles: {count: .., ..}
+ *     hot:
+ *       evictions: ..
+ *       top0: {addr: .., grabs: .., conflicts: .., set_full: .., ..}
+ */
+struct InterlockStats : public Statable
+{
+    static const int TOP = 16;
+
+    StatObj<W64> grabs;
+    StatObj<W64> acquired;
+    StatObj<W64> held;
+    StatObj<W64> set_full;
+    StatObj<W64> probes;
+    StatObj<W64> probe_conflicts;
+    StatObj<W64> releases;
+    StatHistogram<> hold_cycles;
+
+    struct hot : public Statable
+    {
+        StatObj<W64> evictions;
+        InterlockRowStats *rows[TOP];
+
+        hot(Statable *parent)
+            : Statable("hot", parent)
+              , evictions("evictions", this)
+        {
+            foreach (i, TOP) {
+                stringbuf name;
+                name << "top", i;
+                rows[i] = new InterlockRowStats(name, this);
+            }
+        }
+    } hot;
+
+    InterlockStats(Statable *parent)
+        : Statable("interlocks", parent)
+          , grabs("grabs", this)
+          , acquired("acquired", this)
+          , held("held", this)
+          , set_full("set_full", this)
+          , probes("probes", this)
+          , probe_conflicts("probe_conflicts", this)
+          , releases("releases", this)
+          , hold_cycles("hold_cycles", this)
+          , hot(this)
+    {}
+};
+
+};
+
+#endif // INTERLOCK_PROFILE_H
@@ -0,0 +1,303 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#include <ptl-qemu.h>
+#endif
+
+#include <ioAgent.h>
+#include <memoryHierarchy.h>
+#include <machine.h>
+
+using namespace Memory;
+
+/* OwnerRIP of DMA requests, counted as kernel like the drivers behind it */
+#define IO_AGENT_RIP 0xffffffff80000000ULL
+
+namespace {
+    dynarray<IOAgentController*> io_agents;
+};
+
+IOAgentController::IOAgentController(W8 coreid, const char *name,
+        MemoryHierarchy *memoryHierarchy)
+    : Controller(coreid, name, memoryHierarchy)
+    , interconnect_(NULL)
+    , cache_(NULL)
+    , stats_(name, &memoryHierarchy->get_machine())
+    , issueQueued_(false)
+    , retry_(NULL)
+    , busySince_(0)
+{
+    memoryHierarchy_->add_cache_mem_controller(this);
+
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    lineSize_ = 64;
+    machine.get_option(name, "line_size", lineSize_);
+    maxPending_ = IO_AGENT_PENDING_SIZE;
+    machine.get_option(name, "pending", maxPending_);
+    issueCycles_ = 1;
+    machine.get_option(name, "issue_cycles", issueCycles_);
+
+    if(lineSize_ <= 0 || (lineSize_ & (lineSize_ - 1)) ||
+            maxPending_ <= 0 || maxPending_ > IO_AGENT_PENDING_SIZE ||
+            issueCycles_ <= 0) {
+        ptl_logfile << "ERROR: ", name, " needs a power of 2 line_size, ",
+                    "0 < pending <= ", IO_AGENT_PENDING_SIZE,
+                    " and issue_cycles > 0", endl;
+        assert(0);
+    }
+
+    SET_SIGNAL_CB(name, "_Issue", issue_, &IOAgentController::issue_cb);
+
+    io_agents.push(this);
+}
+
+/*
+ * The cache on the other end of the interconnect, found in the machine's
+ * connections as the LLC's directory is
+ */
+void IOAgentController::find_cache()
+{
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    foreach(i, machine.connections.count()) {
+        ConnectionDef *connDef = machine.connections[i];
+        if(strcmp(connDef->name.buf, interconnect_->get_name()) != 0)
+            continue;
+
+        foreach(j, connDef->connections.count()) {
+            SingleConnection *sg = connDef->connections[j];
+            if(sg->type != INTERCONN_TYPE_UPPER &&
+                    sg->type != INTERCONN_TYPE_UPPER2)
+                continue;
+
+            Controller **cont = machine.controller_hash.get(sg->controller);
+            assert(cont);
+            cache_ = *cont;
+        }
+    }
+}
+
+void IOAgentController::dma(W64 physaddr, W64 size, bool isWrite)
+{
+    /* Not connected in the machine config */
+    if unlikely (!interconnect_)
+        return;
+
+    W64 line = floor(physaddr, lineSize_);
+    W64 end = ceil(physaddr + size, lineSize_);
+
+    for(; line < end; line += lineSize_) {
+        if(!backlog_.enqueue(line | W64(isWrite))) {
+            stats_.dropped_lines(kernel_stats) += (end - line) / lineSize_;
+            break;
+        }
+    }
+
+    /* A snoop of the write would drop the private copies by now */
+    if(isWrite) {
+        stats_.invalidations(kernel_stats) +=
+            memoryHierarchy_->invalidate_private(floor(physaddr, lineSize_),
+                    end - floor(physaddr, lineSize_), cache_);
+    }
+
+    /* QEMU runs its devices between the cycles, so at the next one */
+    queue_issue(1);
+}
+
+void IOAgentController::queue_issue(int delay)
+{
+    if(issueQueued_)
+        return;
+
+    issueQueued_ = true;
+    marss_add_event(&issue_, delay, NULL);
+}
+
+/* Send the line that has to go again, else the next one of the backlog */
+bool IOAgentController::issue_cb(void *arg)
+{
+    issueQueued_ = false;
+
+    if(retry_) {
+        IOAgentQueueEntry *entry = retry_;
+        retry_ = NULL;
+        send(entry);
+        return true;
+    }
+
+    if(backlog_.empty() || pending_.count() >= maxPending_)
+        return true;
+
+    W64 item = *backlog_.dequeue();
+    bool isWrite = item & 1;
+
+    MemoryRequest *request = memoryHierarchy_->get_free_request(
+            idx % NUM_SIM_CORES);
+    assert(request);
+    request->init(idx, 0, item & ~W64(1), 0, sim_cycle, false,
+            IO_AGENT_RIP, 0, isWrite ? MEMORY_OP_WRITE : MEMORY_OP_READ);
+    request->set_io(true);
+    request->incRefCounter();
+    ADD_HISTORY_ADD(request);
+
+    if(!pending_.count())
+        busySince_ = sim_cycle;
+
+    IOAgentQueueEntry *entry = pending_.alloc();
+    assert(entry);
+    entry->request = request;
+
+    if(isWrite) {
+        stats_.write_lines(kernel_stats)++;
+        stats_.write_bytes(kernel_stats) += lineSize_;
+    } else {
+        stats_.read_lines(kernel_stats)++;
+        stats_.read_bytes(kernel_stats) += lineSize_;
+    }
+
+    send(entry);
+    return true;
+}
+
+/* Returns false if the interconnect didn't take it, it is retried */
+bool IOAgentController::send(IOAgentQueueEntry *entry)
+{
+    Message& message = *memoryHierarchy_->get_message();
+    message.sender = this;
+    message.request = entry->request;
+    bool success = interconnect_->get_controller_request_signal()->
+        emit(&message);
+    memoryHierarchy_->free_message(&message);
+
+    if(!success) {
+        stats_.retries(kernel_stats)++;
+        retry_ = entry;
+        queue_issue(1);
+        return false;
+    }
+
+    if(!backlog_.empty() && pending_.count() < maxPending_)
+        queue_issue(issueCycles_);
+    return true;
+}
+
+bool IOAgentController::handle_interconnect_cb(void *arg)
+{
+    Message *msg = (Message*)arg;
+
+    /* Evictions and updates of the cache's lines are not about the DMA */
+    IOAgentQueueEntry *entry;
+    foreach_list_mutable(pending_.list(), entry, entry_t, prev_t) {
+        if(entry->request == msg->request && entry != retry_) {
+            complete(entry);
+            break;
+        }
+    }
+
+    return true;
+}
+
+void IOAgentController::complete(IOAgentQueueEntry *entry)
+{
+    MemoryRequest *request = entry->request;
+
+    stats_.latency(kernel_stats).record(sim_cycle -
+            request->get_init_cycles());
+    if unlikely (request_latency_enabled)
+        request_latency_record(request, latencyId_);
+
+    request->decRefCounter();
+    ADD_HISTORY_REM(request);
+    pending_.free(entry);
+
+    if(!pending_.count())
+        stats_.busy_cycles(kernel_stats) += sim_cycle - busySince_;
+
+    if(!backlog_.empty())
+        queue_issue(issueCycles_);
+}
+
+void IOAgentController::register_interconnect(Interconnect *interconnect,
+        int type)
+{
+    switch(type) {
+        case INTERCONN_TYPE_LOWER:
+            interconnect_ = interconnect;
+            find_cache();
+            break;
+        default:
+            assert(0);
+    }
+}
+
+void IOAgentController::print_map(ostream& os)
+{
+    os << "IO-Agent: " << get_name() << endl;
+    os << "\tconnected to: " << endl;
+    if(interconnect_)
+        os << "\t\tlower: " << interconnect_->get_name() << endl;
+}
+
+void IOAgentController::print(ostream& os) const
+{
+    os << "---IO-Agent: ", get_name(), endl;
+    os << "backlog[", backlog_.count, "] pending[", pending_.count(), "]",
+       endl;
+    if(pending_.count() > 0)
+        os << "Queue : ", pending_, endl;
+    os << "---End IO-Agent: ", get_name(), endl;
+}
+
+void IOAgentController::dump_configuration(YAML::Emitter &out) const
+{
+    out << YAML::Key << get_name() << YAML::Value << YAML::BeginMap;
+
+    YAML_KEY_VAL(out, "type", "io_agent");
+    YAML_KEY_VAL(out, "line_size", lineSize_);
+    YAML_KEY_VAL(out, "pending", maxPending_);
+    YAML_KEY_VAL(out, "issue_cycles", issueCycles_);
+    YAML_KEY_VAL(out, "backlog_size", IO_AGENT_BACKLOG_SIZE);
+
+    out << YAML::EndMap;
+}
+
+/* IO Agent Builder */
+struct IOAgentControllerBuilder : public ControllerBuilder
+{
+    IOAgentControllerBuilder(const char* name) :
+        ControllerBuilder(name)
+    {}
+
+    Controller* get_new_controller(W8 coreid, W8 type,
+            MemoryHierarchy& mem, const char *name) {
+        return new IOAgentController(coreid, name, &mem);
+    }
+};
+
+IOAgentControllerBuilder ioAgentBuilder("io_agent");
+
+/*
+ * Called by QEMU for each DMA to guest RAM, the agents share the pages
+ * of memory
+ */
+extern "C" void ptl_dma_access(uint64_t physaddr, uint64_t size,
+        int is_write)
+{
+    if likely (!in_simulation || !io_agents.count() || !size)
+        return;
+
+    int agent = (physaddr >> 12) % io_agents.count();
+    io_agents[agent]->dma(physaddr, size, is_write);
+}
@@ -0,0 +1,172 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef IO_AGENT_H
+#define IO_AGENT_H
+
+#include <controller.h>
+#include <interconnect.h>
+#include <superstl.h>
+#include <logic.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+/* Lines of one agent in flight in the hierarchy */
+#define IO_AGENT_PENDING_SIZE 32
+
+/* Lines of DMA waiting to be sent, more are dropped */
+#define IO_AGENT_BACKLOG_SIZE 4096
+
+struct IOAgentQueueEntry : public FixStateListObject
+{
+    MemoryRequest *request;
+
+    void init() {
+        request = NULL;
+    }
+
+    ostream& print(ostream& os) const {
+        if(!request) {
+            os << "Free IO Entry";
+            return os;
+        }
+        os << "Request{", *request, "} ";
+        os << "idx[", idx, "]", endl;
+        return os;
+    }
+};
+
+static inline ostream& operator <<(ostream& os,
+        const IOAgentQueueEntry& entry)
+{
+    return entry.print(os);
+}
+
+/*
+ * Written to the node of the agent, bytes are of whole lines:
+ *
+ *   IO_0:
+ *     read_lines: .., write_lines: .., read_bytes: .., write_bytes: ..,
+ *     dropped_lines: .., invalidations: .., retries: ..,
+ *     busy_cycles: .., latency: {count: .., ..}
+ *
+ * busy_cycles have a line in flight, so the bytes over them are the IO
+ * bandwidth while the device is active and over sim_cycle its average.
+ */
+struct IOAgentStats : public Statable
+{
+    StatObj<W64> read_lines;
+    StatObj<W64> write_lines;
+    StatObj<W64> read_bytes;
+    StatObj<W64> write_bytes;
+    StatObj<W64> dropped_lines;
+    StatObj<W64> invalidations;
+    StatObj<W64> retries;
+    StatObj<W64> busy_cycles;
+    StatHistogram<> latency;
+
+    IOAgentStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , read_lines("read_lines", this)
+          , write_lines("write_lines", this)
+          , read_bytes("read_bytes", this)
+          , write_bytes("write_bytes", this)
+          , dropped_lines("dropped_lines", this)
+          , invalidations("invalidations", this)
+          , retries("retries", this)
+          , busy_cycles("busy_cycles", this)
+          , latency("latency", this)
+    { }
+};
+
+/**
+ * @brief Device DMA sent through the memory hierarchy
+ *
+ * QEMU's devices read and write guest RAM directly, ptl_dma_access()
+ * hands each of their transfers in simulation to an agent (the agents
+ * share them by page) which sends them a line at a time to the cache it
+ * is connected to, usually the LLC:
+ *
+ *   memory:
+ *     - type: io_agent
+ *       name_prefix: IO_
+ *       insts: 1
+ *   interconnects:
+ *     - type: p2p
+ *       connections:
+ *         - IO_0: LOWER
+ *           L2_0: UPPER2
+ *
+ * So DMA takes memory bandwidth and cache space from the cores. Writes
+ * first drop the line from the private caches, as a snoop would, and
+ * with 'io_ways' in the cache's options (see qos.h) lines of DMA only
+ * fill those ways, like Intel DDIO. The data itself is still moved by
+ * QEMU at once; the agent only models the traffic, and the device does
+ * not wait for it. Options:
+ *
+ *   line_size   : bytes per request, 64 by default
+ *   pending     : lines in flight, at most IO_AGENT_PENDING_SIZE
+ *   issue_cycles: cycles between two lines sent, 1 by default
+ */
+class IOAgentController : public Controller
+{
+    private:
+        Interconnect *interconnect_;
+        /* Cache at the other end, its own lines are not dropped */
+        Controller *cache_;
+        IOAgentStats stats_;
+
+        FixStateList<IOAgentQueueEntry, IO_AGENT_PENDING_SIZE> pending_;
+        /* Line address, bit 0 set for a write */
+        FixedQueue<W64, IO_AGENT_BACKLOG_SIZE> backlog_;
+
+        Signal issue_;
+        bool issueQueued_;
+        /* Sent line the interconnect didn't take, it goes again first */
+        IOAgentQueueEntry *retry_;
+
+        int lineSize_;
+        int maxPending_;
+        int issueCycles_;
+        W64 busySince_;
+
+        void find_cache();
+        void queue_issue(int delay);
+        bool send(IOAgentQueueEntry *entry);
+        void complete(IOAgentQueueEntry *entry);
+
+    public:
+        IOAgentController(W8 coreid, const char *name,
+                MemoryHierarchy *memoryHierarchy);
+
+        /* Queue the lines of [physaddr, physaddr + size) */
+        void dma(W64 physaddr, W64 size, bool isWrite);
+
+        bool handle_interconnect_cb(void *arg);
+        bool issue_cb(void *arg);
+
+        void register_interconnect(Interconnect *interconnect, int type);
+        void print_map(ostream& os);
+        void print(ostream& os) const;
+        void annul_request(MemoryRequest *request) {}
+        void dump_configuration(YAML::Emitter &out) const;
+        Statable* get_stats() { return &stats_; }
+
+        /* Responses are never held back */
+        bool is_full(bool fromInterconnect = false,
+                MemoryRequest *request = NULL) const {
+            return false;
+        }
+};
+
+};
+
+#endif // IO_AGENT_H
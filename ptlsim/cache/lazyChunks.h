@@ -0,0 +1,105 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef LAZY_CHUNKS_H
+#define LAZY_CHUNKS_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <hostmem.h>
+
+namespace Memory {
+
+/*
+ * LazyChunks
+ *
+ * Storage of a large array split in 'count' chunks of 'bytes' each that
+ * are allocated, on cache line boundaries, the first time they are used.
+ * Every chunk carries the epoch it was last initialized in; reset() only
+ * moves to the next epoch, so after it every chunk reads as untouched
+ * again and is handed back as fresh on its next use. The owner initializes
+ * fresh chunks, untouched ones are never read.
+ *
+ * Tag arrays and directories use it so building and resetting a machine
+ * with large caches only costs the sets that are actually used. Chunks
+ * are laid out in one host_alloc() region whose pages the host only
+ * populates once a chunk in them is used, on huge pages with
+ * '-host-huge-pages'.
+ */
+class LazyChunks
+{
+	public:
+		LazyChunks(int count, size_t bytes)
+			: count_(count)
+			, stride_((bytes + 63) & ~(size_t)63)
+			, epoch_(1)
+		{
+			mem_ = (char*)host_alloc(stride_ * count_);
+			epochs_ = new W32[count_];
+			foreach(i, count_) {
+				epochs_[i] = 0;
+			}
+		}
+
+		~LazyChunks()
+		{
+			host_free(mem_, stride_ * count_);
+			delete[] epochs_;
+		}
+
+		/* Chunk 'c' if used in this epoch, otherwise NULL */
+		char* find(int c) const
+		{
+			return (epochs_[c] == epoch_) ? chunk(c) : NULL;
+		}
+
+		/* Chunk 'c', 'fresh' is set if the owner must initialize it */
+		char* get(int c, bool &fresh)
+		{
+			fresh = false;
+			if likely (epochs_[c] == epoch_)
+				return chunk(c);
+
+			epochs_[c] = epoch_;
+			fresh = true;
+			return chunk(c);
+		}
+
+		void reset()
+		{
+			if unlikely (++epoch_ == 0) {
+				foreach(i, count_) epochs_[i] = 0;
+				epoch_ = 1;
+			}
+		}
+
+		int count() const { return count_; }
+
+		/* Chunks used in this epoch */
+		int used() const
+		{
+			int n = 0;
+			foreach(i, count_) n += (epochs_[i] == epoch_);
+			return n;
+		}
+
+	private:
+		char* chunk(int c) const { return mem_ + (size_t)c * stride_; }
+
+		char *mem_;
+		W32 *epochs_;
+		int count_;
+		size_t stride_;
+		W32 epoch_;
+};
+
+};
+
+#endif // LAZY_CHUNKS_H
@@ -0,0 +1,146 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <lineCompression.h>
+
+namespace Memory {
+
+CacheLineReader cache_line_reader = NULL;
+
+/* True if 'value' of 'bits' bits is a sign extended 'to' bit value */
+static bool fits_signed(W64 value, int bits, int to)
+{
+    if (to >= bits)
+        return true;
+
+    W64 high = (bits == 64) ? value : (value & bitmask(bits));
+    W64 sign = high >> (to - 1);
+    W64 ones = bitmask(bits - to + 1);
+    return sign == 0 || sign == ones;
+}
+
+static W64 element_of(const W64 *words, int i, int size)
+{
+    const byte *b = (const byte*)words;
+    W64 value = 0;
+    memcpy(&value, b + i * size, size);
+    return value;
+}
+
+/* Size of the line as base 'size' and deltas of 'delta' bytes, -1 if not */
+static int bdi_size(const W64 *words, int bytes, int size, int delta)
+{
+    int n = bytes / size;
+    int bits = size * 8;
+    W64 mask = (bits == 64) ? W64(-1) : bitmask(bits);
+    bool have_base = false;
+    W64 base = 0;
+
+    foreach (i, n) {
+        W64 value = element_of(words, i, size);
+
+        /* Immediate, delta from zero */
+        if (fits_signed(value, bits, delta * 8))
+            continue;
+
+        if (!have_base) {
+            base = value;
+            have_base = true;
+            continue;
+        }
+
+        if (!fits_signed((value - base) & mask, bits, delta * 8))
+            return -1;
+    }
+
+    return size + n * delta + (n + 7) / 8;
+}
+
+int bdi_compressed_size(const W64 *words, int bytes)
+{
+    static const int encodings[][2] = {
+        {8, 1}, {4, 1}, {8, 2}, {2, 1}, {4, 2}, {8, 4},
+    };
+
+    int n = bytes / 8;
+    bool zero = true;
+    bool repeated = true;
+
+    foreach (i, n) {
+        if (words[i]) zero = false;
+        if (words[i] != words[0]) repeated = false;
+    }
+
+    if (zero) return 1;
+    if (repeated) return min(8, bytes);
+
+    int best = bytes;
+    foreach (i, sizeof(encodings) / sizeof(encodings[0])) {
+        int size = bdi_size(words, bytes, encodings[i][0], encodings[i][1]);
+        if (size > 0 && size < best)
+            best = size;
+    }
+
+    return best;
+}
+
+int fpc_compressed_size(const W64 *words, int bytes)
+{
+    const W32 *w = (const W32*)words;
+    int n = bytes / 4;
+    int bits = 0;
+    int zeros = 0;
+
+    foreach (i, n) {
+        W32 word = w[i];
+
+        if (word == 0) {
+            /* Run of zero words, 3 bits of length */
+            if (zeros == 0) bits += 3 + 3;
+            zeros = (zeros + 1) % 8;
+            continue;
+        }
+        zeros = 0;
+
+        W16 lo = W16(word);
+        W16 hi = W16(word >> 16);
+        byte b = byte(word);
+
+        if (fits_signed(word, 32, 4)) {
+            bits += 3 + 4;
+        } else if (fits_signed(word, 32, 8)) {
+            bits += 3 + 8;
+        } else if (fits_signed(word, 32, 16) || lo == 0) {
+            bits += 3 + 16;
+        } else if (fits_signed(lo, 16, 8) && fits_signed(hi, 16, 8)) {
+            bits += 3 + 16;
+        } else if (word == W32(b) * 0x01010101U) {
+            bits += 3 + 8;
+        } else {
+            bits += 3 + 32;
+        }
+    }
+
+    return min((bits + 7) / 8, bytes);
+}
+
+int line_compressed_size(int scheme, const W64 *words, int bytes)
+{
+    switch (scheme) {
+        case LINE_COMPRESSION_BDI:
+            return bdi_compressed_size(words, bytes);
+        case LINE_COMPRESSION_FPC:
+            return fpc_compressed_size(words, bytes);
+        default:
+            return bytes;
+    }
+}
+
+};
@@ -0,0 +1,54 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef LINE_COMPRESSION_H
+#define LINE_COMPRESSION_H
+
+#include <globals.h>
+
+namespace Memory {
+
+    /* Compression schemes of CompressedCacheLines, 'COMPRESSION' param */
+    enum {
+        LINE_COMPRESSION_BDI = 0,
+        LINE_COMPRESSION_FPC,
+        NUM_LINE_COMPRESSIONS,
+    };
+
+    /*
+     * Base-Delta-Immediate: the line is one base of 8, 4 or 2 bytes and a
+     * 1, 2 or 4 byte delta of each element from it or from zero, with a
+     * bit per element for which. All zero and repeated 8 byte lines are
+     * special cases. Returns the smallest encoding in bytes, 'bytes' if
+     * none is smaller.
+     */
+    int bdi_compressed_size(const W64 *words, int bytes);
+
+    /*
+     * Frequent Pattern Compression: each 32-bit word takes a 3-bit prefix
+     * and 0 (runs of up to 8 zero words), 4, 8, 16 or 32 bits of data.
+     * Returns the size in bytes rounded up, 'bytes' if not smaller.
+     */
+    int fpc_compressed_size(const W64 *words, int bytes);
+
+    int line_compressed_size(int scheme, const W64 *words, int bytes);
+
+    /*
+     * Reads 'count' words of the line at physical 'addr' for compression,
+     * returns false if its contents are not known. The memory hierarchy
+     * sets it to read guest memory, without it lines don't compress.
+     */
+    typedef bool (*CacheLineReader)(W64 addr, W64 *words, int count);
+
+    extern CacheLineReader cache_line_reader;
+
+};
+
+#endif // LINE_COMPRESSION_H
@@ -35,9 +35,15 @@
 
 #include <memoryController.h>
 #include <memoryHierarchy.h>
+#include <qos.h>
 
 #include <machine.h>
 
+#ifdef DRAMSIM
+#include <sched.h>
+#include <unistd.h>
+#endif
+
 extern uint64_t qemu_ram_size;
 using namespace Memory;
 
@@ -47,27 +53,111 @@ MemoryController::MemoryController(W8 coreid, const char *name,
     , new_stats(name, &memoryHierarchy->get_machine())
 {
     memoryHierarchy_->add_cache_mem_controller(this);
+    memoryHierarchy_->add_memory_controller(this);
+    level_ = MAIN_MEMORY;
+
+    /* One of 'insts' controllers that split memory by address bits */
+    slice_.setup_interleave(memoryHierarchy_->get_machine(), name, coreid);
 
-    if(!memoryHierarchy_->get_machine().get_option(name, "latency", latency_)) {
-        latency_ = 50;
-    }
 #ifdef DRAMSIM
 
+    /* Each interleaved controller has its own DRAMSim2 memory system of
+     * its share of RAM, with its own results */
+    stringbuf resultsDir;
+    resultsDir << config.dramsim_results_dir_name;
+    if(slice_.is_sliced())
+        resultsDir << "_" << name;
+
     mem = DRAMSim::getMemorySystemInstance(config.dramsim_device_ini_file.buf,
             config.dramsim_system_ini_file.buf, config.dramsim_pwd.buf,
-            config.dramsim_results_dir_name.buf, qemu_ram_size>>20 ); 
+            resultsDir.buf, (qemu_ram_size / slice_.count) >> 20);
 
     mem->setCPUClockSpeed(config.core_freq_hz); 
 
 	typedef DRAMSim::Callback <Memory::MemoryController, void, uint, uint64_t, uint64_t> dramsim_callback_t;
 	DRAMSim::TransactionCompleteCB *read_cb = new dramsim_callback_t(this, &MemoryController::read_return_cb);
 	DRAMSim::TransactionCompleteCB *write_cb = new dramsim_callback_t(this, &MemoryController::write_return_cb);
-	mem->RegisterCallbacks(read_cb, write_cb, NULL);
+	mem->RegisterCallbacks(read_cb, write_cb, &DRAMSimPower::report_cb);
+	power_.stats = &new_stats.dramsim_energy;
+
+    memoryHierarchy_->add_dramsim_controller(this);
+
+    dramsimThread_ = NULL;
+    if(config.dramsim_lookahead > 0) {
+        dramsimThread_ = new DRAMSimThread(mem, config.dramsim_lookahead,
+                config.dramsim_skip_idle, &power_);
+    }
+
+    dramsimOutstanding_ = 0;
+    acceptCycle_ = acceptAddrCycle_ = (W64)-1;
+    acceptAddr_ = 0;
+    accepts_ = acceptsAddr_ = false;
+
+    int tierPages;
+    if(memoryHierarchy_->get_machine().get_option(name, "tier_fast_pages",
+                tierPages) && tierPages > 0) {
+        ptl_logfile << "Memory controller ", name, ": tier_* options are ",
+                    "only used without DRAMSim2, ignored", endl;
+    }
+
+    int writeQueue;
+    if(memoryHierarchy_->get_machine().get_option(name, "write_queue",
+                writeQueue) && writeQueue > 0) {
+        ptl_logfile << "Memory controller ", name, ": write_* options are ",
+                    "only used without DRAMSim2, ignored", endl;
+    }
+
+    bool dramPower = false;
+    if(memoryHierarchy_->get_machine().get_option(name, "dram_power",
+                dramPower) && dramPower) {
+        ptl_logfile << "Memory controller ", name, ": dram_* options are ",
+                    "only used without DRAMSim2, ignored", endl;
+    }
+#else
+    tiering_.setup(memoryHierarchy_->get_machine(), name);
+    tieringStats_ = NULL;
+    if(tiering_.enabled())
+        tieringStats_ = new TieringStats(&new_stats);
+
+    writeStats_ = NULL;
+    writesQueued_ = 0;
 
+    int writeQueue = 0;
+    memoryHierarchy_->get_machine().get_option(name, "write_queue",
+            writeQueue);
+    if(writeQueue > 0) {
+        int writeHigh = max(writeQueue * 3 / 4, 1);
+        int writeLow = writeQueue / 4;
+        memoryHierarchy_->get_machine().get_option(name, "write_high",
+                writeHigh);
+        memoryHierarchy_->get_machine().get_option(name, "write_low",
+                writeLow);
+
+        if(writeQueue > MEM_REQ_NUM || writeHigh > writeQueue ||
+                writeLow < 0 || writeLow >= writeHigh) {
+            ptl_logfile << "ERROR: ", name, " needs 0 <= write_low < ",
+                        "write_high <= write_queue <= ", MEM_REQ_NUM, endl;
+            assert(0);
+        }
+
+        writeDrain_.setup(writeQueue, writeHigh, writeLow);
+        writeStats_ = new WriteQueueStats(&new_stats);
+    }
+
+    dramPower_.setup(memoryHierarchy_->get_machine(), name);
+    dramStats_ = NULL;
+    refreshRank_ = 0;
+    refreshScheduled_ = false;
+    if(dramPower_.enabled()) {
+        dramStats_ = new DRAMPowerStats(&new_stats);
+        SET_SIGNAL_CB(name, "_Refresh", refresh_,
+                &MemoryController::refresh_cb);
+    }
 #endif
 
-    /* Convert latency from ns to cycles */
-    latency_ = ns_to_simcycles(latency_);
+    config_changed();
+
+    qos_setup_controller(memoryHierarchy_->get_machine(), name);
 
     SET_SIGNAL_CB(name, "_Access_Completed", accessCompleted_,
             &MemoryController::access_completed_cb);
@@ -94,7 +184,269 @@ MemoryController::MemoryController(W8 coreid, const char *name,
  */
 int MemoryController::get_bank_id(W64 addr)
 {
-    return lowbits(addr >> 6, bankBits_);
+    return lowbits(slice_.local_address(addr) >> 6, bankBits_);
+}
+
+#ifndef DRAMSIM
+/**
+ * @brief Cycles the bank of a request is busy for it
+ *
+ * @param queueEntry Request that starts its access in this cycle
+ *
+ * @return latency_, or with tiering the latency of the page's tier
+ */
+int MemoryController::access_latency(MemoryQueueEntry *queueEntry)
+{
+    if likely (!tieringStats_)
+        return latency_;
+
+    TierAccess tier;
+    bool kernel = queueEntry->request->is_kernel();
+    tiering_.access(queueEntry->request->get_physical_address(), sim_cycle,
+            tier);
+
+    queueEntry->slowTier = tier.slow;
+    if(tier.slow) {
+        N_STAT_UPDATE(tieringStats_->slow_accesses, ++, kernel);
+        N_STAT_UPDATE(tieringStats_->slow_bytes, += 64, kernel);
+    } else {
+        N_STAT_UPDATE(tieringStats_->fast_accesses, ++, kernel);
+        N_STAT_UPDATE(tieringStats_->fast_bytes, += 64, kernel);
+    }
+
+    if(tier.placed)
+        N_STAT_UPDATE(tieringStats_->placed_fast, ++, kernel);
+
+    if(tier.epoch) {
+        W64 pages = tier.promotions + tier.demotions;
+        N_STAT_UPDATE(tieringStats_->epochs, ++, kernel);
+        N_STAT_UPDATE(tieringStats_->promotions, += tier.promotions, kernel);
+        N_STAT_UPDATE(tieringStats_->demotions, += tier.demotions, kernel);
+        N_STAT_UPDATE(tieringStats_->skipped, += tier.skipped, kernel);
+        N_STAT_UPDATE(tieringStats_->migrated_bytes,
+                += pages << TIER_PAGE_BITS, kernel);
+    }
+
+    return tier.slow ? tier.latency : latency_;
+}
+
+/* Refresh and background energy of a rank go to its banks equally */
+void MemoryController::add_rank_energy(int rank, double nj)
+{
+    int banks = MEM_BANKS / dramPower_.config.ranks;
+    foreach(i, banks) {
+        dramStats_->bank_energy(user_stats)[rank * banks + i] += nj / banks;
+    }
+}
+
+void MemoryController::add_background(int rank, const W64 *cycles)
+{
+    foreach(state, DRAM_STATE_COUNT) {
+        if(!cycles[state])
+            continue;
+
+        double nj = dramPower_.background_energy(state, cycles[state],
+                config.core_freq_hz);
+        dramStats_->state_cycles(user_stats)[state] += cycles[state];
+        dramStats_->background(user_stats) += nj;
+        add_rank_energy(rank, nj);
+    }
+}
+
+/**
+ * @brief Wake up the rank of a bank for an access and count its energy
+ *
+ * @param queueEntry Request that starts its access in this cycle
+ * @param bank_no Bank of the request
+ * @param latency Cycles of the access once the rank is ready
+ *
+ * @return Cycles of low power exit and refresh before the access
+ */
+int MemoryController::dram_access(MemoryQueueEntry *queueEntry,
+        int bank_no, int latency)
+{
+    bool kernel = queueEntry->request->is_kernel();
+    OP_TYPE type = queueEntry->request->get_type();
+    int rank = dramPower_.rank_of(bank_no);
+    W64 cycles[DRAM_STATE_COUNT];
+    setzero(cycles);
+
+    /* Refreshes go on from the first access, staggered over the ranks */
+    if(!refreshScheduled_ && dramPower_.refresh_step()) {
+        refreshScheduled_ = true;
+        marss_add_event(&refresh_, dramPower_.refresh_step(), NULL);
+    }
+
+    DRAMWakeup wake = dramPower_.start(rank, sim_cycle, cycles);
+    add_background(rank, cycles);
+    dramPower_.busy_until(rank, sim_cycle + wake.delay() + latency);
+
+    if(wake.exited == DRAM_STATE_POWERDOWN) {
+        N_STAT_UPDATE(dramStats_->powerdown_exits, ++, kernel);
+    } else if(wake.exited == DRAM_STATE_SELF_REFRESH) {
+        N_STAT_UPDATE(dramStats_->self_refresh_exits, ++, kernel);
+    }
+    if(wake.exitCycles)
+        N_STAT_UPDATE(dramStats_->exit_cycles, += wake.exitCycles, kernel);
+    if(wake.refreshCycles)
+        N_STAT_UPDATE(dramStats_->refresh_wait_cycles,
+                += wake.refreshCycles, kernel);
+
+    double act = dramPower_.act_energy();
+    double burst = dramPower_.burst_energy(type == MEMORY_OP_WRITE ||
+            type == MEMORY_OP_UPDATE);
+    dramStats_->actpre(user_stats) += act;
+    dramStats_->burst(user_stats) += burst;
+    dramStats_->bank_energy(user_stats)[bank_no] += act + burst;
+
+    return wake.delay();
+}
+
+/**
+ * @brief Refresh of the next rank is due
+ *
+ * Goes on every refresh_step() cycles, each rank in turn.
+ */
+bool MemoryController::refresh_cb(void *arg)
+{
+    int rank = refreshRank_;
+    W64 cycles[DRAM_STATE_COUNT];
+    setzero(cycles);
+
+    refreshRank_ = (refreshRank_ + 1) % dramPower_.config.ranks;
+
+    if(dramPower_.refresh(rank, sim_cycle, cycles)) {
+        double nj = dramPower_.refresh_energy();
+        dramStats_->refreshes(user_stats)++;
+        dramStats_->refresh(user_stats) += nj;
+        add_rank_energy(rank, nj);
+    }
+    add_background(rank, cycles);
+
+    marss_add_event(&refresh_, dramPower_.refresh_step(), NULL);
+    return true;
+}
+
+/* Latest pending writeback of a line, NULL if a read of it is later */
+MemoryQueueEntry* MemoryController::find_write(W64 addr)
+{
+    MemoryQueueEntry *entry;
+    foreach_list_mutable_backwards(pendingRequests_.list(),
+            entry, entry_t, nextentry_t) {
+        if(entry->request->get_physical_address() == addr) {
+            if(!entry->annuled && entry->request->get_type() ==
+                    MEMORY_OP_UPDATE)
+                return entry;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void MemoryController::start_access(MemoryQueueEntry *queueEntry,
+        int bank_no)
+{
+    queueEntry->inUse = true;
+    banksUsed_[bank_no] = 1;
+
+    if(queueEntry->request->get_type() == MEMORY_OP_UPDATE) {
+        /* A writeback blocked on the full write queue can come in now */
+        if(write_queue_full(queueEntry->request) &&
+                !pendingRequests_.isFull())
+            memoryHierarchy_->set_controller_full(this, false);
+        writesQueued_--;
+    }
+
+    int latency = access_latency(queueEntry);
+    if(dramStats_)
+        latency += dram_access(queueEntry, bank_no, latency);
+
+    N_STAT_UPDATE(new_stats.bank_busy_cycles, [bank_no] += latency,
+            queueEntry->request->is_kernel());
+
+    marss_add_event(&accessCompleted_, latency, queueEntry);
+}
+
+/**
+ * @brief Start the next access of each idle bank from the write queue
+ *
+ * Oldest read of a bank first, or with -mem-priority the most urgent and
+ * then oldest read, unless the queued writes are being drained
+ * (see WriteDrain). Called when a request comes in or a bank gets free.
+ *
+ * @param kernel Mode of the request that made the decision, for stats
+ */
+void MemoryController::schedule(bool kernel)
+{
+    MemoryQueueEntry *reads[MEM_BANKS];
+    MemoryQueueEntry *writes[MEM_BANKS];
+    bool readWaiting = false;
+
+    foreach(i, MEM_BANKS) {
+        reads[i] = writes[i] = NULL;
+    }
+
+    MemoryQueueEntry *entry;
+    foreach_list_mutable(pendingRequests_.list(), entry, entry_t,
+            prev_t) {
+        if(entry->inUse)
+            continue;
+
+        /* Wrong path read, the hierarchy drops it without a bank */
+        if unlikely (memoryHierarchy_->drop_annuled(entry->request))
+            continue;
+
+        int bank_no = get_bank_id(entry->request->get_physical_address());
+        if(entry->request->get_type() == MEMORY_OP_UPDATE) {
+            if(!writes[bank_no])
+                writes[bank_no] = entry;
+        } else {
+            if(!reads[bank_no] || more_urgent(entry->request,
+                        reads[bank_no]->request))
+                reads[bank_no] = entry;
+            readWaiting = true;
+        }
+    }
+
+    if(writeDrain_.check_start(writesQueued_, sim_cycle))
+        N_STAT_UPDATE(writeStats_->drains, ++, kernel);
+
+    foreach(bank_no, MEM_BANKS) {
+        if(banksUsed_[bank_no])
+            continue;
+
+        MemoryQueueEntry *next = writeDrain_.pick(reads[bank_no],
+                writes[bank_no], readWaiting);
+        if(!next)
+            continue;
+
+        if(next == writes[bank_no]) {
+            if(writeDrain_.draining) {
+                N_STAT_UPDATE(writeStats_->drained_writes, ++, kernel);
+            } else {
+                N_STAT_UPDATE(writeStats_->idle_writes, ++, kernel);
+            }
+        }
+
+        start_access(next, bank_no);
+    }
+
+    W64 drainCycles = writeDrain_.check_end(writesQueued_, sim_cycle);
+    if(drainCycles)
+        N_STAT_UPDATE(writeStats_->drain_cycles, += drainCycles, kernel);
+}
+#endif
+
+/* Latency in ns, re-read for -machine-options overrides */
+void MemoryController::config_changed()
+{
+    if(!memoryHierarchy_->get_machine().get_option(get_name(), "latency",
+                latency_)) {
+        latency_ = 50;
+    }
+
+    /* Convert latency from ns to cycles */
+    latency_ = ns_to_simcycles(latency_);
 }
 
 void MemoryController::register_interconnect(Interconnect *interconnect,
@@ -114,6 +466,9 @@ bool MemoryController::handle_interconnect_cb(void *arg)
 	Message *message = (Message*)arg;
 
 	memdebug("Received message in Memory controller: " ,get_name() , " ", *message, endl);
+	ptltrace(traceId_, TRACE_MEM_ACCESS,
+			message->request->get_physical_address(),
+			message->request->get_coreid(), message->request->get_type());
 
 	if(message->hasData && message->request->get_type() !=
 			MEMORY_OP_UPDATE)
@@ -160,11 +515,31 @@ bool MemoryController::handle_interconnect_cb(void *arg)
 		}
 	}
 
+#ifndef DRAMSIM
+	bool kernel = message->request->is_kernel();
+	bool isUpdate = message->request->get_type() == MEMORY_OP_UPDATE;
+	MemoryQueueEntry *write = NULL;
+
+	if(writeStats_) {
+		if(write_queue_full(message->request)) {
+			memdebug("Memory write queue is full\n");
+			N_STAT_UPDATE(writeStats_->full, ++, kernel);
+			return false;
+		}
+
+		/* Reads of a line being written back take the write's data */
+		if(!isUpdate)
+			write = find_write(message->request->get_physical_address());
+	}
+#endif
+
 	MemoryQueueEntry *queueEntry = pendingRequests_.alloc();
+	update_queue_occupancy();
 
 	/* if queue is full return false to indicate failure */
 	if(queueEntry == NULL) {
 		memdebug("Memory queue is full\n");
+		ptltrace(traceId_, TRACE_MEM_QUEUE_FULL);
 		return false;
 	}
 
@@ -174,49 +549,38 @@ bool MemoryController::handle_interconnect_cb(void *arg)
 
 	queueEntry->request = message->request;
 	queueEntry->source = (Controller*)message->origin;
+	queueEntry->cycle = sim_cycle;
 
 	queueEntry->request->incRefCounter();
 	ADD_HISTORY_ADD(queueEntry->request);
 
+    assert(queueEntry->inUse == false);
+
+#ifndef DRAMSIM
 	int bank_no = get_bank_id(message->request->
 			get_physical_address());
 
-    assert(queueEntry->inUse == false);
+	if(isUpdate) {
+		writesQueued_++;
+		if(writeStats_)
+			N_STAT_UPDATE(writeStats_->writes, ++, kernel);
+	}
 
-	if(banksUsed_[bank_no] == 0) {
-		banksUsed_[bank_no] = 1;
+	if(write) {
+		queueEntry->forwarded = true;
 		queueEntry->inUse = true;
-#ifndef DRAMSIM
-		marss_add_event(&accessCompleted_, latency_,
-				queueEntry);
-#endif
+		N_STAT_UPDATE(writeStats_->forwarded, ++, kernel);
+		marss_add_event(&accessCompleted_, 1, queueEntry);
+	} else if(writeStats_) {
+		schedule(kernel);
+	} else if(banksUsed_[bank_no] == 0 &&
+			!memoryHierarchy_->drop_annuled(queueEntry->request)) {
+		start_access(queueEntry, bank_no);
 	}
-#ifdef DRAMSIM
-	MemoryRequest *memRequest = queueEntry->request;
-	uint64_t physicalAddress = memRequest->get_physical_address();
-	// align the request; for now assume a 64 byte transaction 
-	// FIXME: in the future there should be some mechanism to check that the size
-	// 	of a transaction and maybe make sure it matches the LLC line size
-	physicalAddress = ALIGN_ADDRESS(physicalAddress, dramsim_transaction_size); 
-    
-    /* This fixes issue #9: since we assume a write-allocate policy for MARSS,
-     * a MEMORY_OP_WRITE which corresponds to a write miss should be treated as
-     * a read operation in DRAMSim2. Once the line is brought into the cache it
-     * will be modified. Therefore, data writebacks will only happen on an
-     * MEMORY_OP_UPDATE operation when a dirty line is evicted from the cache. 
-     */
-
-    bool isWrite = memRequest->get_type() == MEMORY_OP_UPDATE;
-    bool accepted = mem->addTransaction(isWrite,physicalAddress);
-    queueEntry->inUse = true;
-    // the interconnect should have called mem->WillAcceptTransaction() via can_broadcast() before we got here, so this should always succeed
-    if (!accepted) {
-        queueEntry->request->decRefCounter();
-        //XXX: hack alert -- shouldn't be allocating this entry in the first place if the transaction won't be accepted
-        pendingRequests_.free(queueEntry); 
-        ptl_logfile << "###### DRAMSIM REJECTING "<< *(queueEntry->request)<<endl; 
-        assert(0);
-    }
+#else
+	/* Handed to DRAMSim2 in clock() with all other requests of this cycle */
+	queueEntry->inUse = true;
+	dramsimBatch_.push(queueEntry);
 #endif
 
 	return true;
@@ -231,58 +595,370 @@ void MemoryController::print(ostream& os) const
 	os << "---End Memory-Controller: ", get_name(), endl;
 }
 #ifdef DRAMSIM
-void MemoryController::write_return_cb(uint id, uint64_t addr, uint64_t cycle)
+/**
+ * @brief Submit this cycle's requests and clock DRAMSim2
+ *
+ * Called every cycle from MemoryHierarchy::clock(). Requests that DRAMSim2
+ * rejects stay in the batch, in order, and are retried in next cycle.
+ */
+void MemoryController::clock()
 {
-	MemoryQueueEntry *queueEntry = NULL;
-	memdebug("[DRAMSIM] WRITE ACK" <<std::hex<<addr<<std::dec);
+	int submitted = 0;
+
+	foreach(i, dramsimBatch_.count()) {
+		MemoryQueueEntry *queueEntry = dramsimBatch_[i];
+		MemoryRequest *memRequest = queueEntry->request;
+
+		/* Wrong path reads don't go to DRAMSim2 */
+		if(queueEntry->annuled ||
+				memoryHierarchy_->drop_annuled(memRequest)) {
+			memRequest->decRefCounter();
+			ADD_HISTORY_REM(memRequest);
+			pendingRequests_.free(queueEntry);
+			update_queue_occupancy();
+			if(!pendingRequests_.isFull()) {
+				memoryHierarchy_->set_controller_full(this, false);
+			}
+			submitted++;
+			continue;
+		}
+
+		// align the request; for now assume a 64 byte transaction
+		// FIXME: in the future there should be some mechanism to check that the size
+		// 	of a transaction and maybe make sure it matches the LLC line size
+		// interleaved controllers give DRAMSim2 their own dense addresses,
+		// completions come back with the same address
+		uint64_t physicalAddress = ALIGN_ADDRESS(
+				slice_.local_address(memRequest->get_physical_address()),
+				dramsim_transaction_size);
+
+		/* This fixes issue #9: since we assume a write-allocate policy for MARSS,
+		 * a MEMORY_OP_WRITE which corresponds to a write miss should be treated as
+		 * a read operation in DRAMSim2. Once the line is brought into the cache it
+		 * will be modified. Therefore, data writebacks will only happen on an
+		 * MEMORY_OP_UPDATE operation when a dirty line is evicted from the cache.
+		 */
+		bool isWrite = memRequest->get_type() == MEMORY_OP_UPDATE;
+
+		if(dramsimThread_) {
+			dramsimThread_->submit(physicalAddress, isWrite);
+		} else if(!mem->addTransaction(isWrite, physicalAddress)) {
+			memdebug("[DRAMSIM] rejected ", *memRequest, endl);
+			break;
+		}
+
+		pendingRequests_.index(queueEntry,
+				dramsim_key(physicalAddress, isWrite));
+		dramsimOutstanding_++;
+		submitted++;
+	}
+
+	if(submitted == dramsimBatch_.count()) {
+		dramsimBatch_.clear();
+	} else if(submitted > 0) {
+		int remaining = dramsimBatch_.count() - submitted;
+		foreach(i, remaining) {
+			dramsimBatch_[i] = dramsimBatch_[i + submitted];
+		}
+		dramsimBatch_.resize(remaining);
+	}
+
+	/* Queues changed, drop cached willAcceptTransaction results */
+	acceptCycle_ = acceptAddrCycle_ = (W64)-1;
+
+	if(dramsimThread_) {
+		if(!dramsimThread_->is_running())
+			dramsimThread_->start(sim_cycle);
+
+		dramsimThread_->publish(sim_cycle);
+
+		/* Deliver completions up to this cycle, waiting for the DRAMSim2
+		 * thread if it is behind */
+		DRAMSimQueue<DRAMSimTransaction, 256>& done =
+			dramsimThread_->completions();
+		int spins = 0;
+
+		while(1) {
+			bool caught_up = dramsimThread_->get_simulated_cycle() >= sim_cycle;
 
-	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry_t,
-			prev_t) {
-		if (ALIGN_ADDRESS(queueEntry->request->get_physical_address(),dramsim_transaction_size) == addr)
-		{
-			memdebug("[DRAMSIM] entry for address "<< std::hex << addr << std::dec);
-			access_completed_cb(queueEntry);
-			return;
+			while(!done.empty() && done.front().cycle <= sim_cycle) {
+				DRAMSimTransaction completion = done.front();
+				done.pop();
+				dramsim_complete(completion.addr, completion.isWrite);
+			}
+
+			if(caught_up)
+				break;
+
+			/* Let DRAMSim2 thread run if host is oversubscribed */
+			if(++spins > 1000)
+				sched_yield();
+			else
+				cpu_pause();
 		}
+
+		if(spins)
+			dramsimThread_->waits++;
+		return;
 	}
-	assert(0);
+
+	if(dramsimOutstanding_ > 0 || !config.dramsim_skip_idle) {
+		power_.clock(sim_cycle);
+		mem->update();
+	}
+}
+
+void MemoryController::stop_dramsim_thread()
+{
+	if(!dramsimThread_ || !dramsimThread_->is_running())
+		return;
+
+	dramsimThread_->stop();
+}
+
+void MemoryController::dramsim_complete(uint64_t addr, bool isWrite)
+{
+	/* DRAMSim2 completes transactions to the same line in order */
+	MemoryQueueEntry *queueEntry = pendingRequests_.first(
+			dramsim_key(addr, isWrite));
+	assert(queueEntry);
+
+	pendingRequests_.unindex(queueEntry);
+	dramsimOutstanding_--;
+	access_completed_cb(queueEntry);
+}
+
+void MemoryController::write_return_cb(uint id, uint64_t addr, uint64_t cycle)
+{
+	memdebug("[DRAMSIM] WRITE ACK" <<std::hex<<addr<<std::dec);
+	dramsim_complete(addr, true);
 }
 
 void MemoryController::read_return_cb(uint id, uint64_t addr, uint64_t cycle)
 {
-	//make sure something is there
-//	assert(pending_map.find(addr) != pending_map.end());
 	// no delay here since we've already waited up to this cycle
-//	Message *message = pending_map[addr];
-	MemoryQueueEntry *queueEntry = NULL;
+	memdebug("[DRAMSIM] READ RETURN 0x"<<std::hex<<addr<<std::dec);
+	dramsim_complete(addr, false);
+}
 
+/* DRAMSimPower being clocked on this host thread */
+static __thread DRAMSimPower *dramsim_power = NULL;
 
-	memdebug("[DRAMSIM] READ RETURN 0x"<<std::hex<<addr<<std::dec);
+void DRAMSimPower::clock(W64 cycle_)
+{
+	cycle = cycle_;
+	if unlikely (epochEnd == (W64)-1)
+		epochEnd = cycle;
+	dramsim_power = this;
+}
+
+void DRAMSimPower::report_cb(double background, double burst,
+		double refresh, double actpre)
+{
+	if(dramsim_power)
+		dramsim_power->report(background, burst, refresh, actpre);
+}
+
+void DRAMSimPower::report(double background, double burst, double refresh,
+		double actpre)
+{
+	/* Each rank reports in the last cycle of the epoch */
+	if(cycle != epochEnd) {
+		epochCycles = cycle - epochEnd;
+		epochEnd = cycle;
+	}
+
+	/* W times ns is nJ; with the DRAMSim2 thread only it writes these */
+	double ns = simcycles_to_ns(epochCycles);
+	stats->background(user_stats) += background * ns;
+	stats->burst(user_stats) += burst * ns;
+	stats->refresh(user_stats) += refresh * ns;
+	stats->actpre(user_stats) += actpre * ns;
+}
+
+DRAMSimThread::DRAMSimThread(MultiChannelMemorySystem *mem, W64 lookahead,
+		bool skipIdle, DRAMSimPower *power)
+	: waits(0)
+	, mem_(mem)
+	, power_(power)
+	, lookahead_(lookahead)
+	, skipIdle_(skipIdle)
+	, running_(false)
+	, stopping_(false)
+	, submittedCycle_(0)
+	, simulatedCycle_(0)
+	, currentCycle_(0)
+	, outstanding_(0)
+{
+	/* DRAMSim2 calls back on its own thread from now on */
+	typedef DRAMSim::Callback <Memory::DRAMSimThread, void, uint, uint64_t, uint64_t> dramsim_callback_t;
+	DRAMSim::TransactionCompleteCB *read_cb = new dramsim_callback_t(this, &DRAMSimThread::read_return_cb);
+	DRAMSim::TransactionCompleteCB *write_cb = new dramsim_callback_t(this, &DRAMSimThread::write_return_cb);
+	mem_->RegisterCallbacks(read_cb, write_cb, &DRAMSimPower::report_cb);
+}
+
+void DRAMSimThread::start(W64 cycle)
+{
+	/* DRAMSim2 clock starts at the first cycle memory controller is
+	 * clocked, same as inline mode */
+	simulatedCycle_ = cycle - 1;
+	submittedCycle_ = cycle - 1;
+	stopping_ = false;
+
+	if(pthread_create(&thread_, NULL, thread_entry, this)) {
+		ptl_logfile << "[ERROR] Unable to start DRAMSim2 thread", endl, flush;
+		cerr << "[ERROR] Unable to start DRAMSim2 thread" << endl << flush;
+		assert(0);
+	}
+
+	running_ = true;
+	ptl_logfile << "DRAMSim2 running on its own thread with lookahead ",
+				lookahead_, " cycles", endl;
+}
+
+void DRAMSimThread::stop()
+{
+	stopping_ = true;
+	pthread_join(thread_, NULL);
+	running_ = false;
+
+	ptl_logfile << "DRAMSim2 thread stopped at cycle ", simulatedCycle_,
+				", simulation waited for it in ", waits, " cycles", endl;
+}
+
+void DRAMSimThread::submit(uint64_t addr, bool isWrite)
+{
+	DRAMSimTransaction transaction;
+	transaction.cycle = sim_cycle + lookahead_;
+	transaction.addr = addr;
+	transaction.isWrite = isWrite;
+
+	/* At most MEM_REQ_NUM transactions are pending at any time */
+	commands_.push(transaction);
+}
+
+void DRAMSimThread::publish(W64 cycle)
+{
+	__sync_synchronize();
+	submittedCycle_ = cycle + lookahead_;
+}
+
+void* DRAMSimThread::thread_entry(void *arg)
+{
+	((DRAMSimThread*)arg)->run();
+	return NULL;
+}
+
+void DRAMSimThread::run()
+{
+	int spins = 0;
+
+	while(!stopping_) {
+		W64 cycle = simulatedCycle_ + 1;
+
+		if(submittedCycle_ < cycle) {
+			/* Back off in case simulation is not running (e.g.
+			 * fast-forwarding) or host is oversubscribed */
+			if(++spins > 100000)
+				usleep(100);
+			else if(spins > 1000)
+				sched_yield();
+			else
+				cpu_pause();
+			continue;
+		}
+
+		spins = 0;
+		clock_dram(cycle);
+
+		/* Completions of this cycle are visible before cycle is */
+		__sync_synchronize();
+		simulatedCycle_ = cycle;
+	}
+}
+
+/**
+ * @brief Clock DRAMSim2 for one cycle
+ *
+ * Same as MemoryController::clock() in inline mode: transactions of this
+ * cycle are added first, in order, and the ones DRAMSim2 rejects are
+ * retried in next cycle.
+ */
+void DRAMSimThread::clock_dram(W64 cycle)
+{
+	while(!commands_.empty() && commands_.front().cycle <= cycle) {
+		retry_.push(commands_.front());
+		commands_.pop();
+	}
+
+	int added = 0;
+	foreach(i, retry_.count()) {
+		if(!mem_->addTransaction(retry_[i].isWrite, retry_[i].addr))
+			break;
+		added++;
+	}
 
-	foreach_list_mutable(pendingRequests_.list(), queueEntry, entry_t,
-			prev_t) {
-		if (ALIGN_ADDRESS(queueEntry->request->get_physical_address(),dramsim_transaction_size) == addr)
-		{
-			memdebug("[DRAMSIM] entry for address "<< std::hex << addr << queueEntry->request << std::dec);
-			access_completed_cb(queueEntry);
-			return;
+	if(added > 0) {
+		int remaining = retry_.count() - added;
+		foreach(i, remaining) {
+			retry_[i] = retry_[i + added];
 		}
+		retry_.resize(remaining);
+		outstanding_ += added;
 	}
-	assert(0);
 
+	if(outstanding_ > 0 || !skipIdle_) {
+		currentCycle_ = cycle;
+		power_->clock(cycle);
+		mem_->update();
+	}
 }
 
-#endif
-bool MemoryController::access_completed_cb(void *arg)
+void DRAMSimThread::read_return_cb(uint id, uint64_t addr, uint64_t cycle)
 {
-    MemoryQueueEntry *queueEntry = (MemoryQueueEntry*)arg;
+	DRAMSimTransaction completion;
+	completion.cycle = currentCycle_;
+	completion.addr = addr;
+	completion.isWrite = false;
+
+	outstanding_--;
+	completions_.push(completion);
+}
+
+void DRAMSimThread::write_return_cb(uint id, uint64_t addr, uint64_t cycle)
+{
+	DRAMSimTransaction completion;
+	completion.cycle = currentCycle_;
+	completion.addr = addr;
+	completion.isWrite = true;
 
+	outstanding_--;
+	completions_.push(completion);
+}
+
+#endif
 #ifndef DRAMSIM
-    bool kernel = queueEntry->request->is_kernel();
+/**
+ * @brief Free the bank of a finished access and start its next one
+ *
+ * @param queueEntry Request whose bank access is done
+ * @param kernel Mode of the request, for stats
+ */
+void MemoryController::bank_completed(MemoryQueueEntry *queueEntry,
+        bool kernel)
+{
     int bank_no = get_bank_id(queueEntry->request->
             get_physical_address());
     banksUsed_[bank_no] = 0;
 
+    if(dramStats_) {
+        int rank = dramPower_.rank_of(bank_no);
+        W64 cycles[DRAM_STATE_COUNT];
+        setzero(cycles);
+        dramPower_.done(rank, sim_cycle, cycles);
+        add_background(rank, cycles);
+    }
+
     N_STAT_UPDATE(new_stats.bank_access, [bank_no]++, kernel);
     switch(queueEntry->request->get_type()) {
         case MEMORY_OP_READ:
@@ -298,23 +974,64 @@ bool MemoryController::access_completed_cb(void *arg)
             assert(0);
     }
 
+    if(tieringStats_) {
+        W64 latency = sim_cycle - queueEntry->cycle;
+        if(queueEntry->slowTier) {
+            N_STAT_UPDATE(tieringStats_->slow_latency, .record(latency),
+                    kernel);
+        } else {
+            N_STAT_UPDATE(tieringStats_->fast_latency, .record(latency),
+                    kernel);
+        }
+    }
+
+    if(writeStats_) {
+        schedule(kernel);
+        return;
+    }
+
     /*
      * Now check if we still have pending requests
      * for the same bank
      */
     MemoryQueueEntry* entry;
+    MemoryQueueEntry* next = NULL;
     foreach_list_mutable(pendingRequests_.list(), entry, entry_t,
             prev_t) {
         int bank_no_2 = get_bank_id(entry->request->
                 get_physical_address());
-        if(bank_no == bank_no_2 && entry->inUse == false) {
-            entry->inUse = true;
-            marss_add_event(&accessCompleted_,
-                    latency_, entry);
-            banksUsed_[bank_no] = 1;
-            break;
+        if(bank_no == bank_no_2 && entry->inUse == false &&
+                !memoryHierarchy_->drop_annuled(entry->request)) {
+            if(!next || more_urgent(entry->request, next->request))
+                next = entry;
+            if(!priority_scheduling)
+                break;
         }
     }
+
+    if(next)
+        start_access(next, bank_no);
+}
+#endif
+
+bool MemoryController::access_completed_cb(void *arg)
+{
+    MemoryQueueEntry *queueEntry = (MemoryQueueEntry*)arg;
+
+#ifndef DRAMSIM
+    bool kernel = queueEntry->request->is_kernel();
+
+    if(writeStats_ && queueEntry->request->get_type() != MEMORY_OP_UPDATE) {
+        N_STAT_UPDATE(writeStats_->read_latency,
+                .record(sim_cycle - queueEntry->cycle), kernel);
+    }
+
+    new_stats.priority.record(queueEntry->request->get_priority(),
+            sim_cycle - queueEntry->cycle, kernel);
+
+    /* Forwarded from a writeback, no bank was used */
+    if(!queueEntry->forwarded)
+        bank_completed(queueEntry, kernel);
 #endif
 
     if(!queueEntry->annuled) {
@@ -322,12 +1039,26 @@ bool MemoryController::access_completed_cb(void *arg)
         /* Send response back to cache */
         memdebug("Memory access done for Request: ", *queueEntry->request,
                 endl);
-        wait_interconnect_cb(queueEntry);
+        ptltrace(traceId_, TRACE_MEM_DONE,
+                queueEntry->request->get_physical_address(),
+                queueEntry->request->get_coreid());
+
+        /* Responses wait for the bandwidth of their core's class, DMA
+         * of IO agents is not a core's */
+        int delay = qos.memory_access(queueEntry->request->get_coreid(),
+                sim_cycle, queueEntry->request->get_type() !=
+                MEMORY_OP_UPDATE && !queueEntry->request->is_io());
+        if(delay)
+            marss_add_event(&waitInterconnect_, delay, queueEntry);
+        else
+            wait_interconnect_cb(queueEntry);
     } else {
 		 memdebug("!!!!!annuled entry!!!"); 
         queueEntry->request->decRefCounter();
         ADD_HISTORY_REM(queueEntry->request);
         pendingRequests_.free(queueEntry);
+        update_queue_occupancy();
+        memoryHierarchy_->set_controller_full(this, false);
     }
 
 	return true;
@@ -346,6 +1077,8 @@ bool MemoryController::wait_interconnect_cb(void *arg)
 		queueEntry->request->decRefCounter();
 		ADD_HISTORY_REM(queueEntry->request);
 		pendingRequests_.free(queueEntry);
+		update_queue_occupancy();
+		memoryHierarchy_->set_controller_full(this, false);
 		return true;
 	}
 
@@ -369,6 +1102,7 @@ bool MemoryController::wait_interconnect_cb(void *arg)
 		queueEntry->request->decRefCounter();
 		ADD_HISTORY_REM(queueEntry->request);
 		pendingRequests_.free(queueEntry);
+		update_queue_occupancy();
 
 		if(!pendingRequests_.isFull()) {
 			memoryHierarchy_->set_controller_full(this, false);
@@ -382,12 +1116,18 @@ void MemoryController::annul_request(MemoryRequest *request)
     MemoryQueueEntry *queueEntry;
     foreach_list_mutable(pendingRequests_.list(), queueEntry,
             entry, nextentry) {
-        if(queueEntry->request->is_same(request)) {
+        if(queueEntry->request == request) {
             queueEntry->annuled = true;
             if(!queueEntry->inUse) {
+#ifndef DRAMSIM
+                if(queueEntry->request->get_type() == MEMORY_OP_UPDATE)
+                    writesQueued_--;
+#endif
                 queueEntry->request->decRefCounter();
                 ADD_HISTORY_REM(queueEntry->request);
                 pendingRequests_.free(queueEntry);
+                update_queue_occupancy();
+                memoryHierarchy_->set_controller_full(this, false);
             }
         }
     }
@@ -420,6 +1160,19 @@ void MemoryController::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "latency", latency_);
 	YAML_KEY_VAL(out, "latency_ns", simcycles_to_ns(latency_));
 	YAML_KEY_VAL(out, "pending_queue_size", pendingRequests_.size());
+	if(slice_.is_sliced())
+		slice_.dump_configuration(out);
+#ifndef DRAMSIM
+	if(tiering_.enabled())
+		tiering_.dump_configuration(out);
+	if(writeDrain_.enabled()) {
+		YAML_KEY_VAL(out, "write_queue", writeDrain_.size);
+		YAML_KEY_VAL(out, "write_high", writeDrain_.high);
+		YAML_KEY_VAL(out, "write_low", writeDrain_.low);
+	}
+	if(dramPower_.enabled())
+		dramPower_.dump_configuration(out);
+#endif
 
 	out << YAML::EndMap;
 }
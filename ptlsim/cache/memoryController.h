@@ -32,16 +32,162 @@
 #include <interconnect.h>
 #include <superstl.h>
 #include <memoryStats.h>
+#include <memoryTiering.h>
+#include <writeQueue.h>
+#include <dramPower.h>
 
 #ifdef DRAMSIM
 #include <DRAMSim.h>
 using DRAMSim::MultiChannelMemorySystem;
 static const unsigned dramsim_transaction_size = 64;
+#define ALIGN_ADDRESS(addr, bytes) (addr & ~(((unsigned long)bytes) - 1L))
+#include <pthread.h>
 #endif
 
 
 namespace Memory {
 
+#ifdef DRAMSIM
+/**
+ * @brief Lock-free single producer single consumer queue
+ *
+ * Used between the simulation thread and the DRAMSim2 thread.  Only the
+ * producer moves tail and only the consumer moves head.  SIZE must be a
+ * power of 2.
+ */
+template <typename T, int SIZE>
+struct DRAMSimQueue
+{
+	volatile W32 head;
+	char headPad[60];
+	volatile W32 tail;
+	char tailPad[60];
+	T entries[SIZE];
+
+	DRAMSimQueue() : head(0), tail(0) { }
+
+	bool empty() const { return head == tail; }
+	bool full() const { return (tail - head) == (W32)SIZE; }
+
+	T& front() {
+		/* Read the entry only after seeing tail moved */
+		__sync_synchronize();
+		return entries[head & (SIZE - 1)];
+	}
+
+	void pop() {
+		__sync_synchronize();
+		head++;
+	}
+
+	void push(const T& entry) {
+		assert(!full());
+		entries[tail & (SIZE - 1)] = entry;
+		__sync_synchronize();
+		tail++;
+	}
+};
+
+struct DRAMSimTransaction
+{
+	W64 cycle;
+	uint64_t addr;
+	bool isWrite;
+};
+
+/**
+ * @brief Energy of the power DRAMSim2 reports at the end of its epochs
+ *
+ * DRAMSim2 hands the average power in W of each rank over the epoch to a
+ * plain function, report_cb(), which passes it to the DRAMSimPower whose
+ * clock() was called last on this host thread. Power times the cycles
+ * since the epoch before is the energy, added in nJ to 'dramsim_energy'
+ * of the controller.
+ */
+struct DRAMSimPower
+{
+	DRAMSimEnergyStats *stats;
+	W64 cycle;
+	W64 epochEnd;
+	W64 epochCycles;
+
+	DRAMSimPower() : stats(NULL), cycle(0), epochEnd(-1), epochCycles(0) {}
+
+	/* Before each update() of DRAMSim2 */
+	void clock(W64 cycle);
+
+	void report(double background, double burst, double refresh,
+			double actpre);
+
+	static void report_cb(double background, double burst, double refresh,
+			double actpre);
+};
+
+/**
+ * @brief Clock DRAMSim2 on its own host thread
+ *
+ * The simulation thread stamps each transaction with the cycle it enters
+ * DRAMSim2, 'lookahead' cycles after the memory controller accepted it.
+ * Once the simulation thread has submitted everything for cycle t, DRAMSim2
+ * cycles up to t + lookahead are fully known and the DRAMSim2 thread runs
+ * them while the simulation goes on.  The simulation thread only waits when
+ * it needs completions of a cycle DRAMSim2 hasn't reached yet.  The DRAMSim2
+ * input depends only on simulated time, so results are deterministic.
+ */
+class DRAMSimThread
+{
+	public:
+		DRAMSimThread(MultiChannelMemorySystem *mem, W64 lookahead,
+				bool skipIdle, DRAMSimPower *power);
+
+		void start(W64 cycle);
+		void stop();
+		bool is_running() const { return running_; }
+
+		/* Simulation thread side */
+		void submit(uint64_t addr, bool isWrite);
+		void publish(W64 cycle);
+		W64 get_simulated_cycle() const { return simulatedCycle_; }
+		DRAMSimQueue<DRAMSimTransaction, 256>& completions() {
+			return completions_;
+		}
+
+		/* DRAMSim2 thread side */
+		void read_return_cb(uint, uint64_t, uint64_t);
+		void write_return_cb(uint, uint64_t, uint64_t);
+
+		W64 waits;
+
+	private:
+		MultiChannelMemorySystem *mem_;
+		DRAMSimPower *power_;
+		W64 lookahead_;
+		bool skipIdle_;
+		bool running_;
+		volatile bool stopping_;
+		pthread_t thread_;
+
+		DRAMSimQueue<DRAMSimTransaction, 256> commands_;
+		DRAMSimQueue<DRAMSimTransaction, 256> completions_;
+
+		/* Published by simulation thread: all transactions entering
+		 * DRAMSim2 at or before this cycle are in commands_ */
+		volatile W64 submittedCycle_;
+
+		/* Published by DRAMSim2 thread: last cycle it has clocked */
+		volatile W64 simulatedCycle_;
+
+		/* Only used by DRAMSim2 thread */
+		dynarray<DRAMSimTransaction> retry_;
+		W64 currentCycle_;
+		int outstanding_;
+
+		static void* thread_entry(void *arg);
+		void run();
+		void clock_dram(W64 cycle);
+};
+#endif
+
 struct MemoryQueueEntry : public FixStateListObject
 {
 	MemoryRequest *request;
@@ -49,12 +195,18 @@ struct MemoryQueueEntry : public FixStateListObject
 	int depends;
 	bool annuled;
 	bool inUse;
+	bool slowTier;
+	bool forwarded;
+	W64 cycle;
 
 	void init() {
 		request = NULL;
 		depends = -1;
 		annuled = false;
 		inUse = false;
+		slowTier = false;
+		forwarded = false;
+		cycle = 0;
 	}
 
 	ostream& print(ostream &os) const {
@@ -80,7 +232,27 @@ class MemoryController : public Controller
 		Signal accessCompleted_;
 		Signal waitInterconnect_;
 
+#ifdef DRAMSIM
+		/* Entries handed to DRAMSim2 are indexed by dramsim_key() */
+		IndexedFixStateList<MemoryQueueEntry, MEM_REQ_NUM> pendingRequests_;
+
+		/* Entries to hand to DRAMSim2 in next clock() */
+		dynarray<MemoryQueueEntry*> dramsimBatch_;
+		int dramsimOutstanding_;
+
+		/* willAcceptTransaction results, valid until next clock() */
+		mutable W64 acceptCycle_;
+		mutable bool accepts_;
+		mutable W64 acceptAddrCycle_;
+		mutable W64 acceptAddr_;
+		mutable bool acceptsAddr_;
+
+		static W64 dramsim_key(W64 addr, bool isWrite) {
+			return ALIGN_ADDRESS(addr, dramsim_transaction_size) | isWrite;
+		}
+#else
 		FixStateList<MemoryQueueEntry, MEM_REQ_NUM> pendingRequests_;
+#endif
 
         int latency_;
 		int bankBits_;
@@ -88,14 +260,68 @@ class MemoryController : public Controller
 
         RAMStats new_stats;
 
+		/* After each alloc and free of pendingRequests_ */
+		void update_queue_occupancy() {
+			new_stats.queue_occupancy.update(pendingRequests_.count(),
+					sim_cycle, user_stats);
+		}
+
+#ifndef DRAMSIM
+		/* Fast and slow tier of pages if 'tier_fast_pages' is set */
+		MemoryTiering tiering_;
+		TieringStats *tieringStats_;
+
+		int access_latency(MemoryQueueEntry *queueEntry);
+
+		/* Writes held back and drained if 'write_queue' is set */
+		WriteDrain writeDrain_;
+		WriteQueueStats *writeStats_;
+		int writesQueued_; /* MEMORY_OP_UPDATE entries not started yet */
+
+		bool write_queue_full(MemoryRequest *request) const {
+			return writeStats_ && request &&
+				request->get_type() == MEMORY_OP_UPDATE &&
+				writeDrain_.full(writesQueued_);
+		}
+
+		/* Refresh, low power states and energy if 'dram_power' is set */
+		DRAMPower dramPower_;
+		DRAMPowerStats *dramStats_;
+		Signal refresh_;
+		int refreshRank_; /* next rank refresh_ is for */
+		bool refreshScheduled_;
+
+		int dram_access(MemoryQueueEntry *queueEntry, int bank_no,
+				int latency);
+		void add_rank_energy(int rank, double nj);
+		void add_background(int rank, const W64 *cycles);
+
+		MemoryQueueEntry* find_write(W64 addr);
+		void start_access(MemoryQueueEntry *queueEntry, int bank_no);
+		void bank_completed(MemoryQueueEntry *queueEntry, bool kernel);
+		void schedule(bool kernel);
+#endif
+
 	public:
 		MemoryController(W8 coreid, const char *name,
 				 MemoryHierarchy *memoryHierarchy);
 #ifdef DRAMSIM
-#define ALIGN_ADDRESS(addr, bytes) (addr & ~(((unsigned long)bytes) - 1L))
 		void read_return_cb(uint, uint64_t, uint64_t);
 		void write_return_cb(uint, uint64_t, uint64_t);
+		void dramsim_complete(uint64_t addr, bool isWrite);
 		MultiChannelMemorySystem *mem;
+		DRAMSimPower power_;
+
+		/* NULL unless -dramsim-lookahead is set */
+		DRAMSimThread *dramsimThread_;
+
+		void clock();
+		void stop_dramsim_thread();
+
+		/* True if DRAMSim2 has transactions to work on */
+		bool is_active() const {
+			return dramsimOutstanding_ > 0 || dramsimBatch_.count() > 0;
+		}
 #endif
 		virtual bool handle_interconnect_cb(void *arg);
 		void print(ostream& os) const;
@@ -104,27 +330,54 @@ class MemoryController : public Controller
 
 		virtual bool access_completed_cb(void *arg);
 		virtual bool wait_interconnect_cb(void *arg);
+#ifndef DRAMSIM
+		virtual bool refresh_cb(void *arg);
+#endif
 
 		void annul_request(MemoryRequest *request);
 		virtual void dump_configuration(YAML::Emitter &out) const;
+		void config_changed();
 
 		virtual int get_no_pending_request(W8 coreid);
 
 		bool is_full(bool fromInterconnect = false, MemoryRequest *request = NULL) const {
-			bool dramsimIsFull = false; 
+			bool dramsimIsFull = false;
 #ifdef DRAMSIM
-            if (request)
-            {
-    			dramsimIsFull = !mem->willAcceptTransaction(request->get_physical_address());
-            }
-            else
-            {
-    			dramsimIsFull = !mem->willAcceptTransaction();
+            /* DRAMSim2 queues only change in clock(), so ask it once per
+             * cycle instead of on every probe.  With the DRAMSim2 thread
+             * its queues can't be probed, transactions it rejects wait in
+             * the thread instead. */
+            if (dramsimThread_) {
+                dramsimIsFull = false;
+            } else if (request) {
+                W64 addr = slice_.local_address(
+                        request->get_physical_address());
+                if (acceptAddrCycle_ != sim_cycle || acceptAddr_ != addr) {
+                    acceptsAddr_ = mem->willAcceptTransaction(addr);
+                    acceptAddr_ = addr;
+                    acceptAddrCycle_ = sim_cycle;
+                }
+                dramsimIsFull = !acceptsAddr_;
+            } else {
+                if (acceptCycle_ != sim_cycle) {
+                    accepts_ = mem->willAcceptTransaction();
+                    acceptCycle_ = sim_cycle;
+                }
+                dramsimIsFull = !accepts_;
             }
+#else
+			/* Writebacks also wait for space in the write queue */
+			if(write_queue_full(request))
+				return true;
 #endif
 			return pendingRequests_.isFull() || dramsimIsFull;
 		}
 
+#ifdef DRAMSIM
+		/* DRAMSim2 frees its queues on its own clock, without telling us */
+		bool notifies_space() const { return false; }
+#endif
+
 		void print_map(ostream& os)
 		{
 			os << "Memory Controller: ", get_name(), endl;
@@ -43,22 +43,67 @@
 #include <statelist.h>
 
 #include <cpuController.h>
+#include <memtrace.h>
+#include <coherenceHotspots.h>
 #include <memoryController.h>
+#include <lineCompression.h>
 
 #include <yaml/yaml.h>
 
 using namespace Memory;
 
+/* Contents of a line being filled in a compressed cache */
+static bool read_guest_line(W64 addr, W64 *words, int count)
+{
+    Context& ctx = contextof(0);
+    foreach(i, count)
+        words[i] = ctx.loadphys(addr + i * 8);
+    return true;
+}
+
 MemoryHierarchy::MemoryHierarchy(BaseMachine& machine) :
     machine_(machine)
+    , warmAccesses_(0)
     , someStructIsFull_(false)
 {
     coreNo_ = machine_.get_num_cores();
+    cache_line_reader = read_guest_line;
 
     foreach(i, NUM_SIM_CORES) {
-        RequestPool* pool = new RequestPool();
+        RequestPool* pool = new RequestPool(i, &machine_);
         requestPool_.push(pool);
     }
+
+    messagePoolStats_ = new PoolStats("message_pool", &machine_);
+    messagePoolStats_->set_default_stats(user_stats);
+    messagePool_.set_stats(messagePoolStats_);
+
+    eventPoolStats_ = new PoolStats("event_pool", &machine_);
+    eventPoolStats_->set_default_stats(user_stats);
+    eventQueue_.set_pool_stats(eventPoolStats_);
+
+    interlockStats_ = new InterlockStats(&machine_);
+
+    farAtomicStats_ = NULL;
+    if (config.far_atomics) {
+        farAtomics_.latency = config.far_atomic_latency;
+        farAtomics_.occupancy = config.far_atomic_occupancy;
+        farAtomicStats_ = new FarAtomicStats(&machine_);
+        SET_SIGNAL_CB("far_atomics", "_done", farAtomicDone_,
+                &MemoryHierarchy::far_atomic_done_cb);
+    }
+
+    SET_SIGNAL_CB("split_part", "_done", splitPartDone_,
+            &MemoryHierarchy::split_part_done_cb);
+
+    surrogateStats_ = NULL;
+    if (config.mem_surrogate) {
+        surrogate_.window = max(config.mem_surrogate_window, W64(1));
+        surrogate_.period = max(config.mem_surrogate_period, W64(1));
+        surrogate_.bound = config.mem_surrogate_error;
+        surrogate_.reset(sim_cycle);
+        surrogateStats_ = new MemorySurrogateStats(&machine_);
+    }
 }
 
 MemoryHierarchy::~MemoryHierarchy()
@@ -68,6 +113,11 @@ MemoryHierarchy::~MemoryHierarchy()
         delete pool;
     }
     requestPool_.clear();
+
+    messagePool_.set_stats(NULL);
+    eventQueue_.set_pool_stats(NULL);
+    delete messagePoolStats_;
+    delete eventPoolStats_;
 }
 
 bool MemoryHierarchy::access_cache(MemoryRequest *request)
@@ -76,8 +126,17 @@ bool MemoryHierarchy::access_cache(MemoryRequest *request)
 	CPUController *cpuController = (CPUController*)cpuControllers_[coreid];
 	assert(cpuController != NULL);
 
+	if unlikely (memtrace_capturing)
+		memtrace_capture(request);
+
+	if unlikely (coherence_hotspots_enabled && !request->is_instruction())
+		coherence_hotspot_access(request);
+
 	int ret_val;
-	ret_val = ((CPUController*)cpuController)->access(request);
+	{
+		HostPerfScope perf(cpuController->hostPerf_);
+		ret_val = ((CPUController*)cpuController)->access(request);
+	}
 
 	if(ret_val == 0)
 		return true;
@@ -88,35 +147,388 @@ bool MemoryHierarchy::access_cache(MemoryRequest *request)
 	return false;
 }
 
+bool MemoryHierarchy::access_cache_split(MemoryRequest *request,
+        W64 physaddr2)
+{
+    W64 line = floor(request->get_physical_address(),
+            FarAtomicUnit::LINE_SIZE);
+    if (line == floor(physaddr2, FarAtomicUnit::LINE_SIZE))
+        return access_cache(request);
+
+    MemoryRequest *part = get_free_request(request->get_coreid());
+    assert(part != NULL);
+
+    part->init(request);
+    part->set_physical_address(physaddr2);
+    part->set_coreSignal(&splitPartDone_);
+    part->set_split_owner(request);
+
+    /* The owner is held until its last part is back */
+    request->incRefCounter();
+    request->set_split_parts(1);
+
+    if (access_cache(part))
+        split_part_done_cb((void*)part);
+
+    bool hit = access_cache(request);
+    if (!hit || request->get_split_parts() == 0)
+        return hit;
+
+    request->set_split_filled(true);
+    return false;
+}
+
+bool MemoryHierarchy::split_part_done_cb(void *arg)
+{
+    MemoryRequest *part = (MemoryRequest*)arg;
+    MemoryRequest *owner = part->get_split_owner();
+    assert(owner != NULL);
+
+    part->set_split_owner(NULL);
+    owner->set_split_parts(owner->get_split_parts() - 1);
+
+    if (owner->get_split_parts() == 0 && owner->is_split_filled() &&
+            !owner->is_annuled())
+        core_wakeup(owner);
+
+    owner->decRefCounter();
+    return true;
+}
+
+int MemoryHierarchy::access_hit(W8 coreid, W8 threadid, W64 physaddr,
+        W64 rip, W64 uuid)
+{
+	CPUController *cpuController = (CPUController*)cpuControllers_[coreid];
+	assert(cpuController != NULL);
+
+	hitRequest_.init(coreid, threadid, physaddr, 0, sim_cycle, false, rip,
+			uuid, MEMORY_OP_READ);
+
+	int latency;
+	{
+		HostPerfScope perf(cpuController->hostPerf_);
+		latency = cpuController->access_hit(&hitRequest_);
+	}
+
+	/* Misses are captured by access_cache, conflicts when they retry */
+	if unlikely (latency > 0 && memtrace_capturing)
+		memtrace_capture(&hitRequest_);
+
+	if unlikely (latency > 0 && coherence_hotspots_enabled)
+		coherence_hotspot_access(&hitRequest_);
+
+	return latency;
+}
+
+void MemoryHierarchy::setup_warm_links()
+{
+    foreach(i, machine_.connections.count()) {
+        ConnectionDef* connDef = machine_.connections[i];
+
+        foreach(j, connDef->connections.count()) {
+            SingleConnection* up = connDef->connections[j];
+
+            if(up->type != INTERCONN_TYPE_LOWER &&
+                    up->type != INTERCONN_TYPE_I &&
+                    up->type != INTERCONN_TYPE_D)
+                continue;
+
+            foreach(k, connDef->connections.count()) {
+                SingleConnection* low = connDef->connections[k];
+
+                if(low->type != INTERCONN_TYPE_UPPER &&
+                        low->type != INTERCONN_TYPE_UPPER2)
+                    continue;
+
+                WarmLink link;
+                link.upper = *machine_.controller_hash.get(up->controller);
+                link.lower = *machine_.controller_hash.get(low->controller);
+                link.type = up->type;
+                warmLinks_.push(link);
+            }
+        }
+    }
+}
+
+void MemoryHierarchy::warm_access(W8 coreid, W64 physaddr, bool is_icache,
+        bool is_write)
+{
+    if(warmLinks_.empty())
+        setup_warm_links();
+
+    warmAccesses_++;
+
+    warmRequest_.init(coreid, 0, physaddr, 0, sim_cycle, is_icache, 0, 0,
+            is_write ? MEMORY_OP_WRITE : MEMORY_OP_READ);
+
+    warm_below(cpuControllers_[coreid],
+            is_icache ? INTERCONN_TYPE_I : INTERCONN_TYPE_D);
+}
+
+int MemoryHierarchy::warm_below(Controller* cont, int type)
+{
+    W64 physaddr = warmRequest_.get_physical_address();
+
+    while(cont) {
+        Controller* next = NULL;
+
+        foreach(i, warmLinks_.count()) {
+            WarmLink& link = warmLinks_[i];
+
+            if(link.upper == cont && link.type == type &&
+                    link.lower->owns_line(physaddr)) {
+                next = link.lower;
+                break;
+            }
+        }
+
+        if(!next)
+            return cont->level_;
+        if(next->warm_line(&warmRequest_))
+            return next->level_;
+
+        cont = next;
+        type = INTERCONN_TYPE_LOWER;
+    }
+
+    return MAIN_MEMORY;
+}
+
+int MemoryHierarchy::surrogate_miss(Controller *cont, MemoryRequest *request)
+{
+    surrogate_.arrival();
+    if(!surrogate_.fast)
+        return -1;
+
+    if(warmLinks_.empty())
+        setup_warm_links();
+
+    warmAccesses_++;
+    warmRequest_.init(request->get_coreid(), request->get_threadid(),
+            request->get_physical_address(), 0, sim_cycle,
+            request->is_instruction(), request->get_owner_rip(), 0,
+            MEMORY_OP_READ);
+
+    /* A level with too few samples yet gets the line, but not from us */
+    int level = warm_below(cont, INTERCONN_TYPE_LOWER);
+    int latency = surrogate_.predict(level);
+    if(latency < 0)
+        return -1;
+
+    request->reach_level(level);
+    N_STAT_UPDATE(surrogateStats_->fills, ++, request->is_kernel());
+    return latency;
+}
+
+void MemoryHierarchy::surrogate_sample(MemoryRequest *request, W64 latency)
+{
+    if(surrogate_.fast)
+        return;
+
+    surrogate_.sample(request->get_level(), latency);
+    N_STAT_UPDATE(surrogateStats_->samples, ++, request->is_kernel());
+}
+
+void MemoryHierarchy::surrogate_clock()
+{
+    if(surrogate_.fast)
+        surrogateStats_->fast_cycles(user_stats)++;
+
+    int phase = surrogate_.clock(sim_cycle);
+    if likely (phase == MemorySurrogate::PHASE_SAME)
+        return;
+
+    if(phase == MemorySurrogate::PHASE_FAST)
+        surrogateStats_->fast_phases(user_stats)++;
+    else if(phase == MemorySurrogate::PHASE_RECALIBRATE)
+        surrogateStats_->recalibrations(user_stats)++;
+
+    if(phase != MemorySurrogate::PHASE_DETAILED &&
+            surrogate_.lastError >= 0)
+        surrogateStats_->error_ppm(user_stats).record(
+                W64(surrogate_.lastError * 1e6));
+
+    if(logable(1)) {
+        ptl_logfile << "mem_surrogate: ", sim_cycle, ": ",
+                    (surrogate_.fast ? "fast" : "detailed"), " until ",
+                    surrogate_.phaseEnd, ", window error ",
+                    surrogate_.lastError, endl;
+    }
+}
+
+int MemoryHierarchy::invalidate_page(W64 physaddr)
+{
+    int count = 0;
+
+    foreach(i, machine_.controllers.count())
+        count += machine_.controllers[i]->invalidate_lines(
+                floor(physaddr, PAGE_SIZE), PAGE_SIZE);
+
+    return count;
+}
+
+int MemoryHierarchy::invalidate_private(W64 physaddr, W64 size,
+        Controller *except)
+{
+    int count = 0;
+
+    foreach(i, allControllers_.count()) {
+        Controller *cont = allControllers_[i];
+        if(cont->is_private() && cont != except)
+            count += cont->invalidate_lines(physaddr, size);
+    }
+
+    return count;
+}
+
+/*
+ * Do the atomic operation of a locked load at the shared cache: private
+ * copies of its line are dropped now and the core is woken up when the
+ * result is back, see FarAtomicUnit for the timing
+ */
+void MemoryHierarchy::far_atomic(MemoryRequest *request)
+{
+    bool kernel = request->is_kernel();
+    W64 lineaddr = floor(request->get_physical_address(),
+            FarAtomicUnit::LINE_SIZE);
+
+    int invalidated = invalidate_private(lineaddr, FarAtomicUnit::LINE_SIZE,
+            NULL);
+
+    W64 wait;
+    W64 done = farAtomics_.execute(lineaddr / FarAtomicUnit::LINE_SIZE,
+            sim_cycle, wait);
+
+    request->reach_level(L3_CACHE);
+    request->incRefCounter();
+    add_event(&farAtomicDone_, int(done - sim_cycle), request);
+
+    N_STAT_UPDATE(farAtomicStats_->ops, ++, kernel);
+    N_STAT_UPDATE(farAtomicStats_->serialized, += (wait > 0), kernel);
+    N_STAT_UPDATE(farAtomicStats_->wait_cycles, += wait, kernel);
+    N_STAT_UPDATE(farAtomicStats_->invalidations, += invalidated, kernel);
+    N_STAT_UPDATE(farAtomicStats_->latency, .record(done - sim_cycle),
+            kernel);
+}
+
+bool MemoryHierarchy::far_atomic_done_cb(void *arg)
+{
+    MemoryRequest *request = (MemoryRequest*)arg;
+
+    if(!request->is_annuled())
+        core_wakeup(request);
+
+    request->decRefCounter();
+    return true;
+}
+
 void MemoryHierarchy::clock()
 {
+	if unlikely (surrogateStats_)
+		surrogate_clock();
+
+	clock_components();
+	execute_events();
+}
+
+void MemoryHierarchy::clock_components()
+{
+	if unlikely (annuledRequests_.count())
+		drop_annuled_requests();
+
 	// First clock all the cpu controllers
 	foreach(i, cpuControllers_.count()) {
 		CPUController *cpuController = (CPUController*)(
 				cpuControllers_[i]);
 		cpuController->clock();
 	}
+
+	foreach(i, clockedInterconnects_.count()) {
+		clockedInterconnects_[i]->clock();
+	}
 #ifdef DRAMSIM
-    ((MemoryController*)memoryController_)->mem->update();	
+    foreach(i, dramsimControllers_.count()) {
+        dramsimControllers_[i]->clock();
+    }
 #endif
+}
 
+void MemoryHierarchy::execute_events()
+{
 	Event *event;
-	while(!eventQueue_.empty()) {
-		event = eventQueue_.head();
-		if(event->get_clock() <= sim_cycle) {
+
+	if unlikely (mem_parallelism_enabled) {
+		mem_parallelism_begin_events();
+		while((event = eventQueue_.pop(sim_cycle))) {
 			memdebug("Executing event: ", *event);
 			eventQueue_.free(event);
-			assert(event->execute());
-		} else {
-			break;
+			assert(mem_parallelism_execute(event));
 		}
+		mem_parallelism_end_events();
+		return;
+	}
+
+	while((event = eventQueue_.pop(sim_cycle))) {
+		memdebug("Executing event: ", *event);
+		eventQueue_.free(event);
+		assert(event->execute());
+	}
+}
+/**
+ * @brief Find the first cycle in which clock() has any work to do
+ *
+ * @return Cycle number, sim_cycle if memory hierarchy must be clocked in
+ * current cycle
+ */
+W64 MemoryHierarchy::get_next_active_cycle()
+{
+#ifdef DRAMSIM
+	/* DRAMSim must be updated every cycle unless it is allowed to stop
+	 * while it has no transactions */
+	foreach(i, dramsimControllers_.count()) {
+		if(!config.dramsim_skip_idle ||
+				dramsimControllers_[i]->is_active())
+			return sim_cycle;
+	}
+#endif
+	/* Clocked interconnects can receive work at any cycle */
+	if(clockedInterconnects_.count())
+		return sim_cycle;
+
+	W64 next = eventQueue_.get_next_clock();
+
+	foreach(i, cpuControllers_.count()) {
+		CPUController *cpuController = (CPUController*)(
+				cpuControllers_[i]);
+		next = min(next, cpuController->get_next_active_cycle());
 	}
+
+	return next;
 }
+
+/**
+ * @brief Skip given number of cycles in which memory hierarchy has no work
+ *
+ * Pending events are simulated at their clock value so only the CPU
+ * controllers need to count down their pending requests.
+ */
+void MemoryHierarchy::skip_cycles(W64 cycles)
+{
+	foreach(i, cpuControllers_.count()) {
+		CPUController *cpuController = (CPUController*)(
+				cpuControllers_[i]);
+		cpuController->skip_cycles(cycles);
+	}
+}
+
 #ifdef DRAMSIM
 void MemoryHierarchy::simulation_done()
 {
 	//do a final dump of statistics in DRAMSim which completes the vis file
-	((MemoryController*)memoryController_)->mem->printStats(true);	
+	foreach(i, dramsimControllers_.count()) {
+		dramsimControllers_[i]->stop_dramsim_thread();
+		dramsimControllers_[i]->mem->printStats(true);
+	}
 }
 #endif
 
@@ -162,6 +574,34 @@ void MemoryHierarchy::set_controller_full(Controller* controller,
 		anyFull |= interconnectsFullFlags_[i];
 	}
 	someStructIsFull_ = anyFull;
+
+	if(!flag && spaceWaiters_.count()) {
+		int kept = 0;
+		foreach(i, spaceWaiters_.count()) {
+			if(spaceWaiters_[i].controller == controller) {
+				marss_add_event(spaceWaiters_[i].signal, 1, NULL);
+			} else {
+				spaceWaiters_[kept++] = spaceWaiters_[i];
+			}
+		}
+		spaceWaiters_.resize(kept);
+	}
+}
+
+void MemoryHierarchy::wait_for_space(Controller* controller, Signal* signal)
+{
+	assert(controller->notifies_space());
+
+	foreach(i, spaceWaiters_.count()) {
+		if(spaceWaiters_[i].controller == controller &&
+				spaceWaiters_[i].signal == signal)
+			return;
+	}
+
+	SpaceWaiter waiter;
+	waiter.controller = controller;
+	waiter.signal = signal;
+	spaceWaiters_.push(waiter);
 }
 
 void MemoryHierarchy::set_interconnect_full(Interconnect* interconnect,
@@ -264,58 +704,20 @@ void MemoryHierarchy::print_map(ostream& os)
 	os << "--End MemoryHierarchy Map\n";
 }
 
-void MemoryHierarchy::sort_event_queue(Event *event)
-{
-	// First make sure that given event is in tail of queue
-	assert(eventQueue_.tail() == event);
-
-	// No need to sort if only 1 event
-	if(eventQueue_.count() == 1)
-		return;
-
-	Event* entryEvent;
-	foreach_list_mutable(eventQueue_.list(), entryEvent, entry, preventry) {
-		if(*event < *entryEvent) {
-			eventQueue_.unlink(event);
-			eventQueue_.insert_after(event, (Event*)(entryEvent->prev));
-			return;
-		}
-	}
-
-	// Entry is already at the tail of queue, keep it there
-	return;
-}
-
-void MemoryHierarchy::sort_event_queue_tail(Event *event)
-{
-	// First make sure that given event is in tail of queue
-	assert(eventQueue_.tail() == event);
-
-	// No need to sort if only 1 event
-	if (eventQueue_.count() == 1)
-		return;
-
-	Event* entryEvent;
-	foreach_list_mutable_backwards(eventQueue_.list(), entryEvent, entry, preventry) {
-        if (entryEvent == event)
-            continue;
-
-        if (*event >= *entryEvent) {
-            eventQueue_.unlink(event);
-            eventQueue_.insert_after(event, (Event*)(entryEvent));
-            return;
-        }
-    }
-}
-
 void MemoryHierarchy::add_event(Signal *signal, int delay, void *arg)
 {
+	/* Delays of components in a slower clock domain are in its cycles */
+	ClockDomain *clock = signal->get_clock();
+	if unlikely (clock && delay > 0)
+		delay = clock->to_sim_cycles(delay);
+
 	Event *event = eventQueue_.alloc();
-	if(eventQueue_.count() == 1)
-		assert(event == eventQueue_.head());
 	assert(event);
 	event->setup(signal, sim_cycle + delay, arg);
 
+	if unlikely (mem_parallelism_enabled)
+		mem_parallelism_schedule(event, delay);
+
 	// If delay is 0, execute without sorting the queue
 	if(delay == 0) {
 		memdebug("Executing event: ", *event);
@@ -328,73 +730,70 @@ void MemoryHierarchy::add_event(Signal *signal, int delay, void *arg)
 
 	memdebug("Adding event:", *event);
 
-    sort_event_queue(event);
+	eventQueue_.schedule(event);
 
 	return;
 }
 
 Message* MemoryHierarchy::get_message()
 {
-    Message* message = messageQueue_.alloc();
-    assert(message);
+    Message* message = messagePool_.alloc();
+    message->init();
     return message;
 }
 
 void MemoryHierarchy::free_message(Message* msg)
 {
-	messageQueue_.free(msg);
-}
-
-void MemoryHierarchy::annul_request(W8 coreid,
-		W8 threadid, int robid, W64 physaddr,
-		bool is_icache, bool is_write)
-{
-    /*
-	 * Flushin of the caches is disabled currently because we need to
-	 * implement a logic where every cache will check physaddr's cache line
-	 * address with pending requests and flush them.
-     */
-	MemoryRequest* memRequest = get_free_request(coreid);
-	memRequest->init(coreid, threadid, physaddr, robid, sim_cycle, is_icache,
-			-1, -1, (is_write ? MEMORY_OP_WRITE : MEMORY_OP_READ));
-	cpuControllers_[coreid]->annul_request(memRequest);
-	//foreach(i, allControllers_.count()) {
-	//	allControllers_[i]->annul_request(memRequest);
-	//}
-    //foreach(i, allInterconnects_.count()) {
-    //    allInterconnects_[i]->annul_request(memRequest);
-    //}
-	//memRequest->set_ref_counter(0);
+	messagePool_.free(msg);
+}
+
+void MemoryHierarchy::annul_request(MemoryRequestHandle& handle)
+{
+	MemoryRequest *request = handle.get();
+	handle.reset();
+
+	if(!request || request->is_annuled())
+		return;
+
+	request->annul();
+	cpuControllers_[request->get_coreid()]->annul_request(request);
+}
+
 /*
- *     foreach_list_mutable(requestPool_.used_list(), memRequest,
- *             entry, nextentry) {
- *         if likely (!memRequest->get_ref_counter()) continue;
- *         if(memRequest->is_same(coreid, threadid, robid,
- *                     physaddr, is_icache, is_write)) {
- *             annul_request = memRequest;
- *             // now remove this request from queue of each controller
- *             // and interconnect
- *             foreach(i, cpuControllers_.count()) {
- *                 cpuControllers_[i]->annul_request(annul_request);
- *             }
- *             // foreach(j, allControllers_.count()) {
- *                 // allControllers_[j]->annul_request(annul_request);
- *             // }
- *             // foreach(k, allInterconnects_.count()) {
- *                 // allInterconnects_[k]->annul_request(annul_request);
- *             // }
- *             // annul_request->set_ref_counter(0);
- *
- *         }
- *     }
+ * Drop the annuled requests that reached a controller or interconnect in
+ * the last cycle from all of them at once, outside of their callbacks, so
+ * no entry is left waiting for a response that won't come. Entries are
+ * matched by the request object, not is_same(): the refetched uop of an
+ * annuled load can send an equal request to the same line before the
+ * annuled one is dropped.
  */
+void MemoryHierarchy::drop_annuled_requests()
+{
+	foreach(i, annuledRequests_.count()) {
+		MemoryRequest *request = annuledRequests_[i];
 
+		foreach(j, allControllers_.count()) {
+			allControllers_[j]->annul_request(request);
+		}
+		foreach(j, allInterconnects_.count()) {
+			allInterconnects_[j]->annul_request(request);
+		}
+
+		request->set_drop_pending(false);
+		request->decRefCounter();
+	}
+	annuledRequests_.clear();
 }
 
 int MemoryHierarchy::get_core_pending_offchip_miss(W8 coreid)
 {
-	return ((MemoryController*)memoryController_)->
-		get_no_pending_request(coreid);
+	int count = 0;
+
+	foreach(i, memoryControllers_.count()) {
+		count += memoryControllers_[i]->get_no_pending_request(coreid);
+	}
+
+	return count;
 }
 
 /**
@@ -408,11 +807,23 @@ int MemoryHierarchy::get_core_pending_offchip_miss(W8 coreid)
 bool MemoryHierarchy::grab_lock(W64 lockaddr, W8 ctx_id)
 {
     bool ret = false;
+    bool kernel = contextof(ctx_id).kernel_mode;
     MemoryInterlockEntry* lock = interlocks.select_and_lock(lockaddr);
 
+    N_STAT_UPDATE(interlockStats_->grabs, ++, kernel);
+
     if likely (lock && lock->ctx_id == (W8)-1) {
         lock->ctx_id = ctx_id;
+        lock->grab_cycle = sim_cycle;
+        interlockProfile_.grab(lockaddr);
+        N_STAT_UPDATE(interlockStats_->acquired, ++, kernel);
         ret = true;
+    } else if (lock) {
+        interlockProfile_.conflict(lockaddr);
+        N_STAT_UPDATE(interlockStats_->held, ++, kernel);
+    } else {
+        interlockProfile_.set_full(lockaddr);
+        N_STAT_UPDATE(interlockStats_->set_full, ++, kernel);
     }
 
     return ret;
@@ -430,6 +841,13 @@ void MemoryHierarchy::invalidate_lock(W64 lockaddr, W8 ctx_id)
 
     assert(lock);
     assert(lock->ctx_id == ctx_id);
+
+    bool kernel = contextof(ctx_id).kernel_mode;
+    W64 held = sim_cycle - lock->grab_cycle;
+    interlockProfile_.release(lockaddr, held);
+    N_STAT_UPDATE(interlockStats_->releases, ++, kernel);
+    N_STAT_UPDATE(interlockStats_->hold_cycles, .record(held), kernel);
+
     interlocks.invalidate(lockaddr);
 }
 
@@ -444,17 +862,53 @@ void MemoryHierarchy::invalidate_lock(W64 lockaddr, W8 ctx_id)
 bool MemoryHierarchy::probe_lock(W64 lockaddr, W8 ctx_id)
 {
     bool ret = false;
+    bool kernel = contextof(ctx_id).kernel_mode;
     MemoryInterlockEntry* lock = interlocks.probe(lockaddr);
 
+    N_STAT_UPDATE(interlockStats_->probes, ++, kernel);
+
     if likely (!lock) { // If no one has grab the lock
         ret = true;
     } else if(lock && lock->ctx_id == ctx_id) {
         ret = true;
+    } else {
+        interlockProfile_.conflict(lockaddr);
+        N_STAT_UPDATE(interlockStats_->probe_conflicts, ++, kernel);
     }
 
     return ret;
 }
 
+/**
+ * @brief Write the most contended lock addresses to all Stats
+ *
+ * Called at the end of the run, once user and kernel stats are summed.
+ */
+void MemoryHierarchy::update_stats()
+{
+    InterlockLockEntry *top[InterlockStats::TOP];
+    int count = interlockProfile_.top(top, InterlockStats::TOP);
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+    foreach (s, 3) {
+        struct InterlockStats::hot& hot = interlockStats_->hot;
+        hot.set_default_stats(stats[s]);
+        hot.evictions = interlockProfile_.evictions;
+
+        foreach (i, count) {
+            InterlockRowStats& row = *hot.rows[i];
+            InterlockLockEntry& e = *top[i];
+            W64 avg_hold = e.avg_hold();
+            row.addr = e.addr;
+            row.grabs = e.grabs;
+            row.conflicts = e.conflicts;
+            row.set_full = e.set_full;
+            row.avg_hold = avg_hold;
+            row.max_hold = e.max_hold;
+        }
+    }
+}
+
 namespace Memory {
 
 MemoryInterlockBuffer interlocks;
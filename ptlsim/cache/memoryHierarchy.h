@@ -36,8 +36,14 @@
 #include <memoryRequest.h>
 #include <controller.h>
 #include <interconnect.h>
+#include <eventWheel.h>
+#include <eventParallelism.h>
+#include <interlockProfile.h>
+#include <farAtomics.h>
+#include <memorySurrogate.h>
 
 #include <statsBuilder.h>
+#include <hostperf.h>
 
 #define DEBUG_MEMORY
 //#define DEBUG_WITH_FILE_NAME
@@ -56,7 +62,6 @@
 #define memdebug(...) (0)
 #endif
 
-#define ENABLE_MEM_REQUEST_HISTORY
 #ifdef ENABLE_MEM_REQUEST_HISTORY
 #define ADD_HISTORY(req, ...) req->get_history() << __VA_ARGS__
 #define ADD_HISTORY_ADD(req) ADD_HISTORY(req, "{+", get_name(), "} ")
@@ -78,85 +83,26 @@
 
 #define SET_SIGNAL_CB(name, name_postfix, signal, cb) \
 { \
-    stringbuf *sg_n = new stringbuf(); \
-    *sg_n << name, name_postfix; \
-    signal.set_name(sg_n->buf); \
+    stringbuf sg_n; \
+    sg_n << name, name_postfix; \
+    signal.set_name(sg_n.buf); \
     signal.connect(signal_mem_ptr(*this, cb)); \
+    signal.set_perf(host_perf_register(name)); \
+    signal.set_clock(clock_domain_of(name)); \
+    signal.set_partition(Memory::mem_parallelism_register(name)); \
 }
 
 namespace Memory {
 
-  class Event : public FixStateListObject
-	{
-		private:
-			Signal *signal_;
-			W64    clock_;
-			void   *arg_;
-
-		public:
-			void init() {
-				signal_ = NULL;
-				clock_ = -1;
-				arg_ = NULL;
-			}
-
-			void setup(Signal *signal, W64 clock, void *arg) {
-				signal_ = signal;
-				clock_ = clock;
-				arg_ = arg;
-			}
-
-			bool execute() {
-				return signal_->emit(arg_);
-			}
-
-			W64 get_clock() {
-				return clock_;
-			}
-
-			ostream& print(ostream& os) const {
-				os << "Event< ";
-				if(signal_)
-					os << "Signal:" << signal_->get_name() << " ";
-				os << "Clock:" << clock_ << " ";
-				os << "arg:" << arg_ ;
-				os << ">" << endl, flush;
-				return os;
-			}
-
-			bool operator ==(Event &event) {
-				if(clock_ == event.clock_)
-					return true;
-				return false;
-			}
-
-			bool operator >(Event &event) {
-				if(clock_ > event.clock_)
-					return true;
-				return false;
-			}
-
-			bool operator <(Event &event) {
-				if(clock_ < event.clock_)
-					return true;
-				return false;
-			}
-
-            bool operator >=(Event &event) {
-                if (clock_ >= event.clock_)
-                    return true;
-                return false;
-            }
-	};
-
-  static inline ostream& operator <<(ostream& os, const Event& event) {
-      return event.print(os);
-  }
+#ifdef DRAMSIM
+  class MemoryController;
+#endif
 
   struct MemoryInterlockEntry {
       W8 ctx_id;
+      W64 grab_cycle;
 
-      void reset() {ctx_id = -1;}
+      void reset() {ctx_id = -1; grab_cycle = 0;}
 
       ostream& print(ostream& os, W64 physaddr) const {
           os << "phys " << (void*)physaddr << ": vcpu " << (int)ctx_id;
@@ -164,7 +110,20 @@ namespace Memory {
       }
   };
 
-  struct MemoryInterlockBuffer: public LockableAssociativeArray<W64, MemoryInterlockEntry, 16, 4, 8> { };
+  /*
+   * Interlock buffer geometry, set at build time with
+   * 'scons interlock_sets=.. interlock_ways=..'. A locked RMW whose set
+   * is full replays until a way frees, which shows as interlocks.set_full.
+   */
+#ifndef INTERLOCK_SETS
+#define INTERLOCK_SETS 64
+#endif
+
+#ifndef INTERLOCK_WAYS
+#define INTERLOCK_WAYS 8
+#endif
+
+  struct MemoryInterlockBuffer: public LockableAssociativeArray<W64, MemoryInterlockEntry, INTERLOCK_SETS, INTERLOCK_WAYS, 8> { };
 
   extern MemoryInterlockBuffer interlocks;
 
@@ -183,24 +142,96 @@ namespace Memory {
     // interface to memory hierarchy
 	bool access_cache(MemoryRequest *request);
 
+    // synchronous L1 hit of a data load: returns the hit latency, after
+    // which the core wakes up the load itself, or 0 if the load must go
+    // through access_cache, or CACHE_BANK_CONFLICT if the L1 bank of the
+    // line has no port left this cycle. No request is taken from the pool.
+    int access_hit(W8 coreid, W8 threadid, W64 physaddr, W64 rip,
+            W64 uuid);
+
+    // access of a load that crosses into the line at 'physaddr2': the
+    // second line is sent as a part request along with it, and the core
+    // is woken up once both lines are back. Same as access_cache if both
+    // addresses are in one line.
+    bool access_cache_split(MemoryRequest *request, W64 physaddr2);
+
+    // -far-atomics: locked loads are sent to the shared cache with
+    // far_atomic() instead of access_cache, the core wakes the load up
+    // when the result is back, and the locked store is not sent at all
+    bool far_atomics_enabled() const { return farAtomicStats_ != NULL; }
+    void far_atomic(MemoryRequest *request);
+
     // New Core wakeup function that uses Signal of MemoryRequest
     // if Signal is not setup, it uses old wrapper functions
     void core_wakeup(MemoryRequest *request) {
+        if unlikely (request->get_split_parts()) {
+            request->set_split_filled(true);
+            return;
+        }
         if(request->get_coreSignal()) {
             request->get_coreSignal()->emit((void*)request);
             return;
         }
     }
 
-	// to remove the requests if rob eviction has occured
-	void annul_request(W8 coreid,
-			W8 threadid,
-			int robid,
-			W64 physaddr,
-			bool is_icache,
-			bool is_write);
+    // functional warmup: install line in caches from given core's L1
+    // to the first level that already has it, without timing
+    void warm_access(W8 coreid, W64 physaddr, bool is_icache,
+            bool is_write);
+
+    // -mem-surrogate: called by an L1 cache on a read miss, returns the
+    // cycles after which to send the response if the surrogate model
+    // fills it at once, -1 if the read goes down through events. The
+    // lower caches get the line as with warm_access.
+    bool surrogate_enabled() const { return surrogateStats_ != NULL; }
+    int surrogate_miss(Controller *cont, MemoryRequest *request);
+
+    // latency of a read miss of an L1 cache that went down, from the
+    // miss to the response, for the calibration of the surrogate model
+    void surrogate_sample(MemoryRequest *request, W64 latency);
+
+    // lines warm_access installed so far, interconnects that track the
+    // lines of their caches forget them when it changes
+    W64 get_warm_accesses() const { return warmAccesses_; }
+
+    // drop the lines of a page QEMU wrote in emulation from all caches,
+    // returns the number of lines dropped
+    int invalidate_page(W64 physaddr);
+
+    // drop [physaddr, physaddr + size) from the private caches but
+    // except, without timing, for writes to a line that don't go through
+    // them; returns the number of lines dropped
+    int invalidate_private(W64 physaddr, W64 size, Controller *except);
+
+	// to remove the requests if rob eviction has occured: marks the
+	// request of the handle annuled and drops it from the core's cpu
+	// controller, other controllers and interconnects drop it lazily
+	void annul_request(MemoryRequestHandle& handle);
+
+	// called by controllers and interconnects before a request takes a
+	// cache port, bus or bank: true if its core annuled it, then it is
+	// dropped from every controller and interconnect at the next clock
+	// and the caller leaves it where it is
+	bool drop_annuled(MemoryRequest *request) {
+		if likely (!request->is_annuled())
+			return false;
+
+		if(!request->is_drop_pending()) {
+			request->set_drop_pending(true);
+			request->incRefCounter();
+			annuledRequests_.push(request);
+		}
+		return true;
+	}
 
+    // clock() is clock_components() followed by execute_events()
     void clock();
+    void clock_components();
+    void execute_events();
+
+    // idle cycle skipping support
+    W64 get_next_active_cycle();
+    void skip_cycles(W64 cycles);
 
     void reset();
 
@@ -222,6 +253,13 @@ namespace Memory {
 	void set_interconnect_full(Interconnect* interconnect, bool flag);
 	bool is_controller_full(Controller* controller);
 
+	/*
+	 * Emit signal (with a NULL argument) the next time controller frees a
+	 * pending entry, i.e. calls set_controller_full(controller, false).
+	 * Only valid for controllers that notifies_space().
+	 */
+	void wait_for_space(Controller* controller, Signal* signal);
+
 	Message* get_message();
 	void free_message(Message* msg);
 
@@ -238,14 +276,29 @@ namespace Memory {
 
     void add_cache_mem_controller(Controller* cont) {
         allControllers_.push(cont);
-        //FIXME: assumes only one controller
-        memoryController_ = cont; 
     }
 
+    // Main memory controllers, one per interleaved channel and socket
+    void add_memory_controller(Controller* cont) {
+        memoryControllers_.push(cont);
+    }
+
+#ifdef DRAMSIM
+    // Memory controllers that drive a DRAMSim2 instance each
+    void add_dramsim_controller(MemoryController* cont) {
+        dramsimControllers_.push(cont);
+    }
+#endif
+
     void add_interconnect(Interconnect* conn) {
         allInterconnects_.push(conn);
     }
 
+    // Interconnects that have to be clocked every cycle
+    void add_clocked_interconnect(Interconnect* conn) {
+        clockedInterconnects_.push(conn);
+    }
+
     void setup_full_flags() {
         // Setup the full flags
         cpuFullFlags_.resize(cpuControllers_.count(), false);
@@ -257,16 +310,48 @@ namespace Memory {
     bool probe_lock(W64 lockaddr, W8 ctx_id);
     void invalidate_lock(W64 lockaddr, W8 ctx_id);
 
+    // write the most contended lock addresses to the interlocks stats
+    void update_stats();
+
   private:
 
     // machine
     BaseMachine &machine_;
 
+    // Controller pairs connected by an interconnect, type is the upper
+    // controller's connection type. Built on first warm_access.
+    struct WarmLink {
+        Controller* upper;
+        Controller* lower;
+        int type;
+    };
+
+    dynarray<WarmLink> warmLinks_;
+    MemoryRequest warmRequest_;
+    W64 warmAccesses_;
+
+    // probes of access_hit
+    MemoryRequest hitRequest_;
+
+    // annuled requests to drop at the next clock, see drop_annuled
+    dynarray<MemoryRequest*> annuledRequests_;
+    void drop_annuled_requests();
+
+    void setup_warm_links();
+
+    // install the line of warmRequest_ below cont, returns the level it
+    // was found at
+    int warm_below(Controller* cont, int type);
+
 	// array of caches and memory
 	dynarray<Controller*> cpuControllers_;
 	dynarray<Controller*> allControllers_;
 	dynarray<Interconnect*> allInterconnects_;
-	Controller* memoryController_;
+	dynarray<Interconnect*> clockedInterconnects_;
+	dynarray<Controller*> memoryControllers_;
+#ifdef DRAMSIM
+	dynarray<MemoryController*> dramsimControllers_;
+#endif
 
 	// array to indicate if controller or interconnect buffers
 	// are full or not
@@ -275,6 +360,13 @@ namespace Memory {
 	dynarray<bool> interconnectsFullFlags_;
 	bool someStructIsFull_;
 
+	// signals waiting for a controller to free a pending entry
+	struct SpaceWaiter {
+		Controller* controller;
+		Signal* signal;
+	};
+	dynarray<SpaceWaiter> spaceWaiters_;
+
     // number of cores
     int coreNo_;
 
@@ -282,13 +374,33 @@ namespace Memory {
 	dynarray<RequestPool*> requestPool_;
 
 	// Message pool
-	FixStateList<Message, 128> messageQueue_;
+	SlabPool<Message, MESSAGE_POOL_SLAB_SIZE> messagePool_;
+	PoolStats *messagePoolStats_;
 
 	// Event Queue
-	FixStateList<Event, 2048> eventQueue_;
-
-	void sort_event_queue(Event *event);
-	void sort_event_queue_tail(Event *event);
+	EventWheel eventQueue_;
+	PoolStats *eventPoolStats_;
+
+	// Interlock buffer contention
+	InterlockProfile interlockProfile_;
+	InterlockStats *interlockStats_;
+
+	// Atomic operations done at the shared cache, stats are NULL
+	// without -far-atomics
+	FarAtomicUnit farAtomics_;
+	FarAtomicStats *farAtomicStats_;
+	Signal farAtomicDone_;
+	bool far_atomic_done_cb(void *arg);
+
+	// Part requests of access_cache_split signal here when they are back
+	Signal splitPartDone_;
+	bool split_part_done_cb(void *arg);
+
+	// Latency model of the hierarchy below the L1 caches, stats are NULL
+	// without -mem-surrogate
+	MemorySurrogate surrogate_;
+	MemorySurrogateStats *surrogateStats_;
+	void surrogate_clock();
 
     // Temp Stats
     Stats *stats;
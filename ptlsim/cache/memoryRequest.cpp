@@ -37,10 +37,12 @@
 #include <memoryRequest.h>
 #include <statelist.h>
 #include <memoryHierarchy.h>
+#include <hostmem.h>
 
 
 using namespace Memory;
 
+bool Memory::priority_scheduling = false;
 
 void MemoryRequest::init(W8 coreId,
 		W8 threadId,
@@ -62,9 +64,16 @@ void MemoryRequest::init(W8 coreId,
 	refCounter_ = 0; // or maybe 1
 	opType_ = opType;
 	isData_ = !isInstruction;
+	priority_ = (opType == MEMORY_OP_WRITE) ? PRIORITY_STORE : PRIORITY_DEMAND;
+	isIO_ = false;
 
-	if(history) delete history;
-	history = new stringbuf();
+	if(cold_) cold_->reset();
+	level_ = L1_I_CACHE;
+	annuled_ = false;
+	dropPending_ = false;
+	splitOwner_ = NULL;
+	splitParts_ = 0;
+	splitFilled_ = false;
 
 	memdebug("Init ", *this, endl);
 }
@@ -81,9 +90,16 @@ void MemoryRequest::init(MemoryRequest *request)
 	refCounter_ = 0; // or maybe 1
 	opType_ = request->opType_;
 	isData_ = request->isData_;
+	priority_ = request->priority_;
+	isIO_ = request->isIO_;
 
-	if(history) delete history;
-	history = new stringbuf();
+	if(cold_) cold_->reset();
+	level_ = L1_I_CACHE;
+	annuled_ = false;
+	dropPending_ = false;
+	splitOwner_ = NULL;
+	splitParts_ = 0;
+	splitFilled_ = false;
 
 	memdebug("Init ", *this, endl);
 }
@@ -123,33 +139,136 @@ bool MemoryRequest::is_same(MemoryRequest *request)
 }
 
 
-RequestPool::RequestPool()
+RequestPool::RequestPool(int id, Statable *parent)
+	: size_(0)
+	, peakUsed_(0)
 {
-	size_ = REQUEST_POOL_SIZE;
-	foreach(i, REQUEST_POOL_SIZE) {
-		freeRequestList_.enqueue((selfqueuelink*)&((*this)[i]));
+	stringbuf name;
+	name << "request_pool_", id;
+	stats_ = new RequestPoolStats(name, parent);
+	stats_->set_default_stats(user_stats);
+
+	add_slab();
+}
+
+RequestPool::~RequestPool()
+{
+	foreach(i, slabs_.count()) {
+		foreach(j, REQUEST_POOL_SLAB_SIZE) {
+			slabs_[i][j].~MemoryRequest();
+		}
+		host_free(slabs_[i], sizeof(MemoryRequest) * REQUEST_POOL_SLAB_SIZE);
+		host_free(coldSlabs_[i], sizeof(RequestCold) * REQUEST_POOL_SLAB_SIZE);
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+		host_free(historyArenas_[i],
+				REQUEST_POOL_SLAB_SIZE * REQUEST_HISTORY_SIZE);
+#endif
+	}
+	slabs_.clear();
+	coldSlabs_.clear();
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+	historyArenas_.clear();
+#endif
+	delete stats_;
+}
+
+void RequestPool::add_slab()
+{
+	/* Slabs and history arenas share huge pages with -host-huge-pages */
+	MemoryRequest *slab = (MemoryRequest*)host_alloc(
+			sizeof(MemoryRequest) * REQUEST_POOL_SLAB_SIZE);
+	slabs_.push(slab);
+
+	RequestCold *cold = (RequestCold*)host_alloc(
+			sizeof(RequestCold) * REQUEST_POOL_SLAB_SIZE);
+	coldSlabs_.push(cold);
+
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+	char *arena = (char*)host_alloc(
+			REQUEST_POOL_SLAB_SIZE * REQUEST_HISTORY_SIZE);
+	historyArenas_.push(arena);
+#endif
+
+	foreach(i, REQUEST_POOL_SLAB_SIZE) {
+		MemoryRequest *request = new (&slab[i]) MemoryRequest();
+		request->pool_ = this;
+		request->poolState_ = MemoryRequest::POOL_FREE;
+		request->cold_ = new (&cold[i]) RequestCold();
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+		request->get_history().set_buffer(
+				&arena[i * REQUEST_HISTORY_SIZE],
+				REQUEST_HISTORY_SIZE);
+#endif
+		freeRequestList_.enqueue((selfqueuelink*)request);
+	}
+
+	size_ += REQUEST_POOL_SLAB_SIZE;
+	stats_->slabs++;
+
+	memdebug("Request pool grown to ", size_, " requests\n");
+}
+
+void RequestPool::recycle_released()
+{
+	selfqueuelink *entry;
+	while((entry = releasedRequestList_.dequeue())) {
+		MemoryRequest *request = (MemoryRequest*)entry;
+		request->poolState_ = MemoryRequest::POOL_FREE;
+		freeRequestList_.enqueue(entry);
 	}
 }
 
 MemoryRequest* RequestPool::get_free_request()
 {
-	if (isPoolLow()){
-		garbage_collection();
-        /* if asserted here please increase REQUEST_POOL_SIZE */
-		assert(!isEmpty());
+	if (isEmpty()) {
+		recycle_released();
+
+		/*
+		 * Only requests that were handed out but never referenced are left
+		 * on the used list with a zero counter, so scanning for them is
+		 * rare. Grow the pool if that doesn't help either.
+		 */
+		if (isEmpty())
+			garbage_collection();
+
+		if (isEmpty())
+			add_slab();
 	}
-	MemoryRequest* memoryRequest = (MemoryRequest*)freeRequestList_.peek();
-	freeRequestList_.remove((selfqueuelink*)memoryRequest);
+
+	MemoryRequest* memoryRequest = (MemoryRequest*)freeRequestList_.dequeue();
+	memoryRequest->poolState_ = MemoryRequest::POOL_USED;
 	usedRequestsList_.enqueue((selfqueuelink*)memoryRequest);
 
+	if (W64(usedRequestsList_.count) > peakUsed_) {
+		peakUsed_ = usedRequestsList_.count;
+		stats_->peak_used = peakUsed_;
+	}
+
 	return memoryRequest;
 }
 
+void RequestPool::release_request(MemoryRequest *request)
+{
+	assert(request->poolState_ == MemoryRequest::POOL_USED);
+	usedRequestsList_.remove(request);
+	request->poolState_ = MemoryRequest::POOL_RELEASED;
+	releasedRequestList_.enqueue(request);
+}
+
+void RequestPool::reclaim_request(MemoryRequest *request)
+{
+	assert(request->poolState_ == MemoryRequest::POOL_RELEASED);
+	releasedRequestList_.remove(request);
+	request->poolState_ = MemoryRequest::POOL_USED;
+	usedRequestsList_.enqueue(request);
+}
+
 void RequestPool::freeRequest( MemoryRequest* memoryrequest)
 {
     /* we should free it only when no one refrence to it  */
 	assert(0 == memoryrequest->get_ref_counter());
 	usedRequestsList_.remove(memoryrequest);
+	memoryrequest->poolState_ = MemoryRequest::POOL_FREE;
 	freeRequestList_.enqueue(memoryrequest);
 	memoryrequest->set_ref_counter(0);
 }
@@ -165,6 +284,7 @@ void RequestPool::garbage_collection()
 			cleaned++;
 		}
 	}
+	stats_->garbage_collections++;
 	memdebug("number of Request cleaned by garbageCollector is: ",
 		   cleaned,	endl);
 }
@@ -32,9 +32,13 @@
 #include <superstl.h>
 #include <statelist.h>
 #include <cacheConstants.h>
+#include <memoryStats.h>
+#include <slabPool.h>
 
 namespace Memory {
 
+class RequestPool;
+
 enum OP_TYPE {
 	MEMORY_OP_READ,   /* Indicates cache miss on a read/load operation */
 	MEMORY_OP_WRITE,  /* Indicates cache miss on a write/store operation */
@@ -50,10 +54,155 @@ static const char* memory_op_names[NUM_MEMORY_OP] = {
 	"memory_op_evict"
 };
 
-class MemoryRequest: public selfqueuelink
+/*
+ * Request history records the name of each controller and interconnect a
+ * request passes through. It is only useful for debugging so it is disabled
+ * when logging is disabled.
+ */
+#ifndef DISABLE_LOGGING
+#define ENABLE_MEM_REQUEST_HISTORY
+#endif
+
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+
+/*
+ * RequestHistory
+ *
+ * Fixed size ring buffer of text, the buffer memory is provided by the
+ * RequestPool from its preallocated arena. When the buffer is full the
+ * oldest text is overwritten.
+ */
+class RequestHistory
 {
 	public:
-		MemoryRequest() { reset(); }
+		RequestHistory() { buf_ = NULL; size_ = 0; reset(); }
+
+		void set_buffer(char *buf, int size) {
+			buf_ = buf;
+			size_ = size;
+			reset();
+		}
+
+		void reset() {
+			head_ = 0;
+			isWrapped_ = false;
+		}
+
+		RequestHistory& operator <<(const char *str) {
+			if unlikely (!buf_ || !str) return *this;
+
+			while(*str) {
+				buf_[head_++] = *str++;
+				if unlikely (head_ == size_) {
+					head_ = 0;
+					isWrapped_ = true;
+				}
+			}
+			return *this;
+		}
+
+		ostream& print(ostream& os) const {
+			if(!buf_) return os;
+
+			if(isWrapped_) {
+				os << "...";
+				os.write(buf_ + head_, size_ - head_);
+			}
+			os.write(buf_, head_);
+			return os;
+		}
+
+	private:
+		char *buf_;
+		int size_;
+		int head_;
+		bool isWrapped_;
+};
+
+template <class T>
+static inline RequestHistory& operator <<(RequestHistory& history, const T& v)
+{
+	/* Format using stringbuf's internal buffer, no heap allocation */
+	stringbuf sb;
+	sb << v;
+	return history << (const char*)sb;
+}
+
+template <class T>
+static inline RequestHistory& operator ,(RequestHistory& history, const T& v)
+{
+	return history << v;
+}
+
+static inline ostream& operator <<(ostream& os, const RequestHistory& history)
+{
+	return history.print(os);
+}
+
+#endif
+
+/*
+ * Components (controllers and interconnects) a request reached, in order
+ * of first arrival, with the cycle of arrival counted from the request's
+ * init cycle. Only filled with '-mem-latency', see requestLatency.h.
+ */
+#define REQUEST_MAX_HOPS 12
+
+struct RequestHops {
+	W32 arrive[REQUEST_MAX_HOPS];
+	W16 component[REQUEST_MAX_HOPS];
+	W8 count;
+
+	void reset() { count = 0; }
+
+	void record(W16 id, W32 cycle) {
+		foreach(i, count) {
+			if(component[i] == id) return;
+		}
+
+		if(count < REQUEST_MAX_HOPS) {
+			component[count] = id;
+			arrive[count] = cycle;
+			count++;
+		}
+	}
+};
+
+/*
+ * Fields of a request only debugging and '-mem-latency' look at, kept by
+ * the RequestPool in a side table next to each slab so they don't take
+ * space in the lines every hop of the request touches.
+ */
+struct RequestCold {
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+	RequestHistory history;
+#endif
+	RequestHops hops;
+
+	void reset() {
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+		history.reset();
+#endif
+		hops.reset();
+	}
+};
+
+/*
+ * Hot fields, the ones read or written at each hop, fill the first cache
+ * line; the pool bookkeeping and the core signal share the second one.
+ */
+class CACHE_LINE_ALIGNED MemoryRequest: public selfqueuelink
+{
+	public:
+		MemoryRequest()
+			: coreSignal_(NULL)
+			, pool_(NULL)
+			, cold_(NULL)
+			, poolState_(POOL_FREE)
+			, isIO_(false)
+		{
+			reset();
+		}
 
 		void reset() {
 			coreId_ = 0;
@@ -65,17 +214,20 @@ class MemoryRequest: public selfqueuelink
 			refCounter_ = 0; // or maybe 1
 			opType_ = MEMORY_OP_READ;
 			isData_ = 0;
-			history = new stringbuf();
+			if(cold_) cold_->reset();
+			level_ = L1_I_CACHE;
             coreSignal_ = NULL;
+			annuled_ = false;
+			dropPending_ = false;
+			priority_ = PRIORITY_DEMAND;
+			isIO_ = false;
+			splitOwner_ = NULL;
+			splitParts_ = 0;
+			splitFilled_ = false;
 		}
 
-		void incRefCounter(){
-			refCounter_++;
-		}
-
-		void decRefCounter(){
-			refCounter_--;
-		}
+		inline void incRefCounter();
+		inline void decRefCounter();
 
 		void init(W8 coreId,
 				W8 threadId,
@@ -113,6 +265,7 @@ class MemoryRequest: public selfqueuelink
 		void set_physical_address(W64 addr) { physicalAddress_ = addr; }
 
 		int get_coreid() { return int(coreId_); }
+		void set_coreid(W8 coreid) { coreId_ = coreid; }
 
 		int get_threadid() { return int(threadId_); }
 
@@ -123,12 +276,95 @@ class MemoryRequest: public selfqueuelink
 
 		W64 get_owner_uuid() { return ownerUUID_; }
 
-		OP_TYPE get_type() { return opType_; }
+		OP_TYPE get_type() { return OP_TYPE(opType_); }
 		void set_op_type(OP_TYPE type) { opType_ = type; }
 
 		W64 get_init_cycles() { return cycles_; }
 
-		stringbuf& get_history() { return *history; }
+		/*
+		 * Requests that don't come from a pool (probes built on the stack)
+		 * have no side table, their history and hops stay empty.
+		 */
+		static RequestCold& no_cold() {
+			static RequestCold cold;
+			return cold;
+		}
+
+		RequestCold& get_cold() const {
+			return cold_ ? *cold_ : no_cold();
+		}
+
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+		RequestHistory& get_history() { return get_cold().history; }
+#endif
+
+		const RequestHops& get_hops() const { return get_cold().hops; }
+
+		void record_hop(W16 component) {
+			if(!cold_) return;
+			W64 cycles = sim_cycle - cycles_;
+			cold_->hops.record(component, W32(min(cycles, W64(0xffffffff))));
+		}
+
+		/* Deepest level of the hierarchy the request reached so far */
+		CacheType get_level() const { return CacheType(level_); }
+
+		void reach_level(W8 level) {
+			if(level > level_) level_ = level;
+		}
+
+		/*
+		 * Annuled by its core on a pipeline flush, its controllers and
+		 * interconnects drop it lazily (see MemoryHierarchy::annul_request).
+		 * Requests created from it (writebacks, prefetches) are not.
+		 */
+		bool is_annuled() const { return annuled_; }
+		void annul() { annuled_ = true; }
+
+		/* Queued to be dropped by the hierarchy at the next clock */
+		bool is_drop_pending() const { return dropPending_; }
+		void set_drop_pending(bool pending) { dropPending_ = pending; }
+
+		/*
+		 * Urgency of the request, lower is more urgent. Writebacks are
+		 * always PRIORITY_WRITEBACK whatever they were created from.
+		 */
+		RequestPriority get_priority() const {
+			if(opType_ == MEMORY_OP_UPDATE || opType_ == MEMORY_OP_EVICT)
+				return PRIORITY_WRITEBACK;
+			return RequestPriority(priority_);
+		}
+		void set_priority(RequestPriority priority) { priority_ = priority; }
+
+		/*
+		 * Device DMA of an IO agent (see ioAgent.h), requests created
+		 * from it are too. Only looked at by fills of QoS caches.
+		 */
+		bool is_io() const { return isIO_; }
+		void set_io(bool io) { isIO_ = io; }
+
+		/*
+		 * Line crossing access of one LSQ entry, see
+		 * MemoryHierarchy::access_cache_split: a request waits for its
+		 * parts, the requests of the other lines, before its core is
+		 * woken up, and each part points to the request it belongs to.
+		 */
+		MemoryRequest* get_split_owner() const { return splitOwner_; }
+		void set_split_owner(MemoryRequest *owner) { splitOwner_ = owner; }
+
+		int get_split_parts() const { return splitParts_; }
+		void set_split_parts(int parts) { splitParts_ = parts; }
+
+		/* Its own line is back while parts are still pending */
+		bool is_split_filled() const { return splitFilled_; }
+		void set_split_filled(bool filled) { splitFilled_ = filled; }
+
+		/* A request merged with or waiting on this one makes it as urgent */
+		void inherit_priority(const MemoryRequest *request) {
+			RequestPriority priority = request->get_priority();
+			if(priority < priority_)
+				priority_ = priority;
+		}
 
         bool is_kernel() {
             // based on owner RIP value
@@ -160,27 +396,94 @@ class MemoryRequest: public selfqueuelink
 			os << "isData[", isData_, "] ";
 			os << "ownerUUID[", ownerUUID_, "] ";
 			os << "ownerRIP[", (void*)ownerRIP_, "] ";
-			os << "History[ " << *history << "] ";
+			os << "priority[", request_priority_names[get_priority()], "] ";
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+			os << "History[ " << get_cold().history << "] ";
+#endif
             if(coreSignal_) {
                 os << "Signal[ " << coreSignal_->get_name() << "] ";
             }
 			return os;
 		}
 
+		/* Which RequestPool list this request is currently linked on */
+		enum PoolState {
+			POOL_FREE,
+			POOL_USED,
+			POOL_RELEASED
+		};
+
 	private:
-		W8 coreId_;
-		W8 threadId_;
+		friend class RequestPool;
+
+		/* First line, after the vtable and the list links */
 		W64 physicalAddress_;
-		bool isData_;
-		int robId_;
 		W64 cycles_;
 		W64 ownerRIP_;
-		W64 ownerUUID_;
+		int robId_;
 		int refCounter_;
-		OP_TYPE opType_;
-		stringbuf *history;
-        Signal *coreSignal_;
+		W8 coreId_;
+		W8 threadId_;
+		W8 opType_;
+		W8 level_;
+		W8 priority_;
+		bool isData_;
+		bool annuled_;
+		bool dropPending_;
 
+		/* Second line, the owner uuid is only checked by its core */
+		W64 ownerUUID_;
+		Signal *coreSignal_;
+		RequestPool *pool_;
+		RequestCold *cold_;
+		W8 poolState_;
+		bool isIO_;
+		W8 splitParts_;
+		bool splitFilled_;
+		MemoryRequest *splitOwner_;
+};
+
+extern bool priority_scheduling;
+
+/* With -mem-priority, true if a has to be served before b */
+static inline bool more_urgent(const MemoryRequest *a, const MemoryRequest *b)
+{
+	return priority_scheduling && a->get_priority() < b->get_priority();
+}
+
+/**
+ * @brief A core's reference to a request it sent to the hierarchy
+ *
+ * The pool hands a request object out again once the hierarchy is done
+ * with it, so the handle keeps the owner uop's uuid and ROB index and
+ * get() only returns the request while it still belongs to them.
+ */
+struct MemoryRequestHandle
+{
+	MemoryRequest *request;
+	W64 uuid;
+	int robid;
+
+	MemoryRequestHandle() { reset(); }
+
+	void reset() {
+		request = NULL;
+		uuid = (W64)-1;
+		robid = -1;
+	}
+
+	void set(MemoryRequest *req) {
+		request = req;
+		uuid = req->get_owner_uuid();
+		robid = req->get_robid();
+	}
+
+	MemoryRequest* get() const {
+		if(request && request->get_owner_uuid() == uuid &&
+				request->get_robid() == robid)
+			return request;
+		return NULL;
+	}
 };
 
 static inline ostream& operator <<(ostream& os, const MemoryRequest& request)
@@ -188,19 +491,46 @@ static inline ostream& operator <<(ostream& os, const MemoryRequest& request)
 	return request.print(os);
 }
 
-class RequestPool: public array<MemoryRequest,REQUEST_POOL_SIZE>
+/**
+ * @brief Per-core pool of MemoryRequest objects
+ *
+ * Requests are allocated in slabs of REQUEST_POOL_SLAB_SIZE and the pool
+ * grows by another slab whenever it runs dry, so the number of outstanding
+ * requests is not bounded by a compile time constant. Every request is
+ * linked on exactly one of three lists:
+ *
+ *  - free     : ready to be handed out by get_free_request()
+ *  - used     : handed out and possibly referenced
+ *  - released : reference counter dropped back to zero
+ *
+ * decRefCounter() moves a request to the released list when its last
+ * reference goes away, so reclaiming it never needs a scan. Released
+ * requests are only recycled once the free list is empty; a request that
+ * is picked up again before that (incRefCounter() from zero) simply moves
+ * back to the used list. Requests that are handed out but never referenced
+ * stay on the used list and are recovered by garbage_collection().
+ */
+class RequestPool
 {
 	public:
-		RequestPool();
+		RequestPool(int id, Statable *parent);
+		~RequestPool();
 		MemoryRequest* get_free_request();
 		void garbage_collection();
 
+		void release_request(MemoryRequest *request);
+		void reclaim_request(MemoryRequest *request);
+
 		StateList& used_list() {
 			return usedRequestsList_;
 		}
 
+		int size() const { return size_; }
+
 		void print(ostream& os) {
-			os << "Request pool : size[", size_, "]\n";
+			os << "Request pool : size[", size_, "] ";
+			os << "slabs[", slabs_.count(), "] ";
+			os << "peak-used[", peakUsed_, "]\n";
 			os << "used requests : count[", usedRequestsList_.count,
 			   "]\n", flush;
 
@@ -211,6 +541,15 @@ class RequestPool: public array<MemoryRequest,REQUEST_POOL_SIZE>
 				os << *usedReq , endl, flush;
 			}
 
+			os << "released requests : count[", releasedRequestList_.count,
+			   "]\n", flush;
+
+			MemoryRequest *releasedReq;
+			foreach_list_mutable(releasedRequestList_, releasedReq, \
+					entry__, nextentry__) {
+				os << *releasedReq, endl, flush;
+			}
+
 			os << "free request : count[", freeRequestList_.count,
 			   "]\n", flush;
 
@@ -225,23 +564,40 @@ class RequestPool: public array<MemoryRequest,REQUEST_POOL_SIZE>
 
 	private:
 		int size_;
+		W64 peakUsed_;
+		dynarray<MemoryRequest*> slabs_;
+		dynarray<RequestCold*> coldSlabs_;
+#ifdef ENABLE_MEM_REQUEST_HISTORY
+		dynarray<char*> historyArenas_;
+#endif
 		StateList freeRequestList_;
 		StateList usedRequestsList_;
+		StateList releasedRequestList_;
 
+		RequestPoolStats *stats_;
+
+		void add_slab();
+		void recycle_released();
 		void freeRequest(MemoryRequest* request);
 
 		bool isEmpty()
 		{
 			return (freeRequestList_.empty());
 		}
-
-		bool isPoolLow()
-		{
-			return (freeRequestList_.count < (
-						REQUEST_POOL_SIZE * REQUEST_POOL_LOW_RATIO));
-		}
 };
 
+inline void MemoryRequest::incRefCounter()
+{
+	if(refCounter_++ == 0 && poolState_ == POOL_RELEASED)
+		pool_->reclaim_request(this);
+}
+
+inline void MemoryRequest::decRefCounter()
+{
+	if(--refCounter_ == 0 && poolState_ == POOL_USED)
+		pool_->release_request(this);
+}
+
 static inline ostream& operator <<(ostream& os, RequestPool &pool)
 {
 	pool.print(os);
@@ -32,6 +32,8 @@
 #include <statsBuilder.h>
 #include <cacheConstants.h>
 
+#include <cmath>
+
 //#include <dcache.h>
 
 #define SETUP_STATS(type) \
@@ -109,12 +111,15 @@ struct BaseCacheStats : public Statable
                 StatObj<W64> dependency;
                 StatObj<W64> cache_port;
                 StatObj<W64> buffer_full;
+                /* Waited on the port of a bank with the cache's free */
+                StatObj<W64> bank_conflict;
 
                 stall_sub(const char *name, Statable *parent)
                     : Statable(name, parent)
                       , dependency("dependency", this)
                       , cache_port("cache_port", this)
                       , buffer_full("buffer_full", this)
+                      , bank_conflict("bank_conflict", this)
                 {}
             };
 
@@ -140,24 +145,47 @@ struct BaseCacheStats : public Statable
 
     StatObj<W64> annul;
     StatObj<W64> queueFull;
+    StatOccupancy queue_occupancy;   /* of pendingRequests_ */
 
     BaseCacheStats(const char *name, Statable *parent=NULL)
         : Statable(name, parent)
           , cpurequest(this)
           , annul("annul", this)
           , queueFull("queueFull", this)
+          , queue_occupancy("queue_occupancy", this)
     {}
 };
 
+/* Requests served and their total latency in cycles, by RequestPriority */
+struct PriorityLatencyStats : public Statable
+{
+    StatArray<W64, NUM_PRIORITIES> requests;
+    StatArray<W64, NUM_PRIORITIES> cycles;
+
+    PriorityLatencyStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , requests("requests", this, request_priority_names)
+          , cycles("cycles", this, request_priority_names)
+    { }
+
+    void record(int priority, W64 latency, bool kernel)
+    {
+        N_STAT_UPDATE(requests, [priority]++, kernel);
+        N_STAT_UPDATE(cycles, [priority] += latency, kernel);
+    }
+};
+
 struct CPUControllerStats : public BaseCacheStats
 {
-    StatArray<W64, 200> icache_latency;
-    StatArray<W64, 200> dcache_latency;
+    StatHistogram<> icache_latency;
+    StatHistogram<> dcache_latency;
+    PriorityLatencyStats priority;
 
     CPUControllerStats(const char *name, Statable *parent)
         : BaseCacheStats(name, parent)
           , icache_latency("icache_latency", this)
           , dcache_latency("dcache_latency", this)
+          , priority("priority", this)
     { }
 };
 
@@ -227,6 +255,7 @@ struct BusStats : public Statable {
     StatObj<W64> addr_bus_cycles;
     StatObj<W64> data_bus_cycles;
     StatObj<W64> bus_not_ready;
+    StatOccupancy queue_occupancy;   /* of pendingRequests_ */
 
     BusStats(const char* name, Statable *parent)
         : Statable(name, parent)
@@ -235,15 +264,206 @@ struct BusStats : public Statable {
           , addr_bus_cycles("addr_bus_cycles", this)
           , data_bus_cycles("data_bus_cycles", this)
           , bus_not_ready("bus_not_ready", this)
+          , queue_occupancy("queue_occupancy", this)
     {}
 };
 
+/**
+ * @brief Transfers and busy cycles of an interconnect link
+ *
+ * Busy cycles are credited when a transfer takes the link, for all the
+ * cycles it holds it; a switch sums them over its receive ports. With
+ * -bandwidth-timeline they are a time-stats column, each period's busy
+ * cycles over -time-stats-period being the utilization in that period.
+ */
+struct LinkStats : public Statable {
+
+    StatObj<W64> transfers;
+    StatObj<W64> busy_cycles;
+
+    LinkStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , transfers("transfers", this)
+          , busy_cycles("busy_cycles", this)
+    {
+        if(config.bandwidth_timeline)
+            busy_cycles.enable_periodic_dump();
+    }
+
+    void record(W64 cycles, bool kernel)
+    {
+        N_STAT_UPDATE(transfers, ++, kernel);
+        N_STAT_UPDATE(busy_cycles, += cycles, kernel);
+    }
+};
+
+struct RequestPoolStats : public Statable {
+
+    StatObj<W64> peak_used;
+    StatObj<W64> slabs;
+    StatObj<W64> garbage_collections;
+
+    RequestPoolStats(stringbuf &name, Statable *parent)
+        : Statable(name, parent)
+          , peak_used("peak_used", this)
+          , slabs("slabs", this)
+          , garbage_collections("garbage_collections", this)
+    {}
+};
+
+/* Object pool of a memory hierarchy, see SlabPool */
+struct PoolStats : public Statable {
+
+    StatObj<W64> peak_used;
+    StatObj<W64> slabs;
+    StatOccupancy occupancy;        /* objects in use */
+
+    PoolStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , peak_used("peak_used", this)
+          , slabs("slabs", this)
+          , occupancy("occupancy", this)
+    {}
+};
+
+/**
+ * @brief Relative error of misses extrapolated from sampled sets
+ *
+ * Elements are sampled sets, total sets, misses and the sum of squared
+ * per set misses. Each sampled set is one sample of the misses of a set,
+ * so the half width of the confidence interval of the extrapolated misses
+ * is z * N * sqrt((1 - n/N) * s^2 / n). It is returned relative to the
+ * estimate, using '-sample-zscore' as z, and is 1.0 without any misses.
+ */
+struct SetSampleMissError {
+    typedef dynarray<StatObj<W64>* > elems_t;
+
+    static double compute(Stats* stats, const elems_t& elems)
+    {
+        assert(elems.count() == 4);
+        double n = double((*elems[0])(stats));
+        double sets = double((*elems[1])(stats));
+        double misses = double((*elems[2])(stats));
+        double misses_sq = double((*elems[3])(stats));
+
+        if(n < 2 || misses == 0)
+            return 1.0;
+
+        double mean = misses / n;
+        double var = (misses_sq - misses * mean) / (n - 1);
+        if(var <= 0)
+            return 0;
+
+        double fpc = 1.0 - n / sets;
+        return config.sample_zscore * sqrt(fpc * var / n) / mean;
+    }
+};
+
+/* Probes of a set sampled cache, see SampledCacheLines */
+struct SetSamplingStats : public Statable {
+
+    StatObj<W64> sets;
+    StatObj<W64> sampled_sets;
+    StatObj<W64> accesses;
+    StatObj<W64> misses;
+    StatObj<W64> misses_sq;
+    StatObj<W64> filtered;
+    StatEquation<W64, double, StatObjFormulaDiv> miss_rate;
+    StatEquation<W64, double, SetSampleMissError> miss_rate_error;
+
+    SetSamplingStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , sets("sets", this)
+          , sampled_sets("sampled_sets", this)
+          , accesses("accesses", this)
+          , misses("misses", this)
+          , misses_sq("misses_sq", this)
+          , filtered("filtered", this)
+          , miss_rate("miss_rate", this)
+          , miss_rate_error("miss_rate_error", this)
+    {
+        miss_rate.add_elem(&misses);
+        miss_rate.add_elem(&accesses);
+
+        miss_rate_error.add_elem(&sampled_sets);
+        miss_rate_error.add_elem(&sets);
+        miss_rate_error.add_elem(&misses);
+        miss_rate_error.add_elem(&misses_sq);
+    }
+};
+
+/* Sizes of the lines of a compressed cache, see CompressedCacheLines */
+struct CompressionStats : public Statable {
+
+    StatObj<W64> capacity;
+    StatObj<W64> resident_lines;
+    StatObj<W64> resident_bytes;
+    StatObj<W64> resident_compressed_bytes;
+    StatObj<W64> fills;
+    StatObj<W64> unknown_fills;
+    StatObj<W64> fill_bytes;
+    StatObj<W64> fill_compressed_bytes;
+    StatObj<W64> extra_evictions;
+    StatObj<W64> compressed_hits;
+    StatObj<W64> decompress_cycles;
+    StatEquation<W64, double, StatObjFormulaDiv> compression_ratio;
+    StatEquation<W64, double, StatObjFormulaDiv> effective_capacity;
+
+    CompressionStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , capacity("capacity", this)
+          , resident_lines("resident_lines", this)
+          , resident_bytes("resident_bytes", this)
+          , resident_compressed_bytes("resident_compressed_bytes", this)
+          , fills("fills", this)
+          , unknown_fills("unknown_fills", this)
+          , fill_bytes("fill_bytes", this)
+          , fill_compressed_bytes("fill_compressed_bytes", this)
+          , extra_evictions("extra_evictions", this)
+          , compressed_hits("compressed_hits", this)
+          , decompress_cycles("decompress_cycles", this)
+          , compression_ratio("compression_ratio", this)
+          , effective_capacity("effective_capacity", this)
+    {
+        compression_ratio.add_elem(&fill_bytes);
+        compression_ratio.add_elem(&fill_compressed_bytes);
+
+        /* Uncompressed bytes held per byte of the data array */
+        effective_capacity.add_elem(&resident_bytes);
+        effective_capacity.add_elem(&capacity);
+    }
+};
+
+#ifdef DRAMSIM
+/* Energy in nJ of the power DRAMSim2 reports, see DRAMSimPower */
+struct DRAMSimEnergyStats : public Statable {
+    StatObj<double> background;
+    StatObj<double> burst;
+    StatObj<double> refresh;
+    StatObj<double> actpre;
+
+    DRAMSimEnergyStats(Statable *parent)
+        : Statable("dramsim_energy", parent)
+          , background("background", this)
+          , burst("burst", this)
+          , refresh("refresh", this)
+          , actpre("actpre", this)
+    {}
+};
+#endif
+
 struct RAMStats : public Statable {
 
     StatArray<W64, MEM_BANKS> bank_access;
     StatArray<W64, MEM_BANKS> bank_read;
     StatArray<W64, MEM_BANKS> bank_write;
     StatArray<W64, MEM_BANKS> bank_update;
+    StatArray<W64, MEM_BANKS> bank_busy_cycles;
+    PriorityLatencyStats priority;
+    StatOccupancy queue_occupancy;   /* of pendingRequests_ */
+#ifdef DRAMSIM
+    DRAMSimEnergyStats dramsim_energy;
+#endif
 
     RAMStats(const char* name, Statable *parent)
         : Statable(name, parent)
@@ -251,7 +471,17 @@ struct RAMStats : public Statable {
           , bank_read("bank_read", this)
           , bank_write("bank_write", this)
           , bank_update("bank_update", this)
-    {}
+          , bank_busy_cycles("bank_busy_cycles", this)
+          , priority("priority", this)
+          , queue_occupancy("queue_occupancy", this)
+#ifdef DRAMSIM
+          , dramsim_energy(this)
+#endif
+    {
+        /* Each bank is a time-stats column, see LinkStats */
+        if(config.bandwidth_timeline)
+            bank_busy_cycles.enable_periodic_dump();
+    }
 };
 
 };
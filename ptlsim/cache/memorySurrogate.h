@@ -0,0 +1,210 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MEMORY_SURROGATE_H
+#define MEMORY_SURROGATE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+#include <cacheConstants.h>
+
+namespace Memory {
+
+/**
+ * @brief Latency model standing in for the hierarchy below the L1 caches
+ *
+ * With -mem-surrogate the run goes through detailed windows of
+ * -mem-surrogate-window cycles and fast phases of -mem-surrogate-period
+ * cycles. In a fast phase a read miss of an L1 cache is filled at once:
+ * the caches below only get the line as in functional warmup, which
+ * tells the level that has it, and the response is sent after
+ *
+ *   latency = base[level] + slope[level] * load
+ *
+ * load being the L1 read misses of the machine per cycle over the last
+ * LOAD_INTERVAL cycles, so the delay grows with the traffic as a first
+ * order queueing delay. Each detailed window fits base and slope of the
+ * levels, by least squares on the latencies of its read misses, and
+ * checks the latencies the fit of the window before predicts against
+ * them. Only a window whose error, the sum of the differences over the
+ * sum of the latencies, is within -mem-surrogate-error is followed by a
+ * fast phase; otherwise the next window is detailed too, so the run
+ * falls back to the detailed hierarchy while the model is off.
+ */
+struct MemorySurrogate {
+    static const int LEVELS = MAIN_MEMORY + 1;
+    static const int LOAD_INTERVAL = 256;
+    /* Fewer read misses of a level in a window keep its last fit */
+    static const int MIN_SAMPLES = 32;
+
+    enum {
+        PHASE_SAME = 0,
+        PHASE_FAST,         /* Window within the bound, fast phase begins */
+        PHASE_RECALIBRATE,  /* Window off the bound, one more detailed */
+        PHASE_DETAILED,     /* Fast phase over, detailed window begins */
+    };
+
+    struct LevelFit {
+        /* Sums of the window's (load, latency) */
+        double n, sx, sy, sxx, sxy;
+        double base;
+        double slope;
+        bool valid;
+    };
+
+    LevelFit levels[LEVELS];
+    W64 window;
+    W64 period;
+    double bound;
+
+    bool fast;
+    W64 phaseEnd;
+
+    W64 arrivals;
+    W64 loadStart;
+    double load;
+
+    /* Predictions of the window against its latencies */
+    double errorSum;
+    double actualSum;
+    double lastError;
+
+    MemorySurrogate() : window(100000), period(900000), bound(0.1) {
+        reset(0);
+    }
+
+    void reset(W64 cycle) {
+        foreach (i, LEVELS) {
+            setzero(levels[i]);
+        }
+        fast = false;
+        phaseEnd = cycle + window;
+        arrivals = 0;
+        loadStart = cycle;
+        load = 0;
+        errorSum = 0;
+        actualSum = 0;
+        lastError = -1;
+    }
+
+    /* An L1 read miss, filled either way */
+    void arrival() { arrivals++; }
+
+    /* Predicted latency of a read miss served by level, -1 if unknown */
+    int predict(int level) const {
+        const LevelFit &f = levels[level];
+        if (!f.valid) return -1;
+        return max(1, int(f.base + f.slope * load + 0.5));
+    }
+
+    /* Latency of a read miss served by level in a detailed window */
+    void sample(int level, W64 latency) {
+        LevelFit &f = levels[level];
+        double y = double(latency);
+
+        int predicted = predict(level);
+        if (predicted > 0) {
+            errorSum += fabs(predicted - y);
+            actualSum += y;
+        }
+
+        f.n++;
+        f.sx += load;
+        f.sy += y;
+        f.sxx += load * load;
+        f.sxy += load * y;
+    }
+
+    /* Returns one of PHASE_, called every cycle */
+    int clock(W64 cycle) {
+        if (cycle - loadStart >= LOAD_INTERVAL) {
+            load = double(arrivals) / (cycle - loadStart);
+            arrivals = 0;
+            loadStart = cycle;
+        }
+
+        if likely (cycle < phaseEnd) return PHASE_SAME;
+
+        if (fast) {
+            fast = false;
+            phaseEnd = cycle + window;
+            return PHASE_DETAILED;
+        }
+
+        lastError = (actualSum > 0) ? errorSum / actualSum : -1;
+        bool ok = (actualSum > 0) && (lastError <= bound);
+        errorSum = 0;
+        actualSum = 0;
+        refit();
+
+        fast = ok;
+        phaseEnd = cycle + (ok ? period : window);
+        return ok ? PHASE_FAST : PHASE_RECALIBRATE;
+    }
+
+    private:
+
+    void refit() {
+        foreach (i, LEVELS) {
+            LevelFit &f = levels[i];
+
+            if (f.n >= MIN_SAMPLES) {
+                double mx = f.sx / f.n;
+                double my = f.sy / f.n;
+                double var = f.sxx / f.n - mx * mx;
+
+                /* Latency does not drop with more load */
+                f.slope = (var > 1e-12) ? (f.sxy / f.n - mx * my) / var : 0;
+                if (f.slope < 0) f.slope = 0;
+                f.base = my - f.slope * mx;
+                f.valid = true;
+            }
+
+            f.n = f.sx = f.sy = f.sxx = f.sxy = 0;
+        }
+    }
+};
+
+/*
+ * Written under the machine's node:
+ *
+ *   mem_surrogate:
+ *     fills: .., samples: .., fast_phases: .., recalibrations: ..,
+ *     fast_cycles: .., error_ppm: {count: .., ..}
+ *
+ * fills are the read misses the model served and samples the detailed
+ * ones it was fitted on. recalibrations count the windows whose error
+ * was off the bound, error_ppm has the error of each window in parts
+ * per million.
+ */
+struct MemorySurrogateStats : public Statable
+{
+    StatObj<W64> fills;
+    StatObj<W64> samples;
+    StatObj<W64> fast_phases;
+    StatObj<W64> recalibrations;
+    StatObj<W64> fast_cycles;
+    StatHistogram<> error_ppm;
+
+    MemorySurrogateStats(Statable *parent)
+        : Statable("mem_surrogate", parent)
+          , fills("fills", this)
+          , samples("samples", this)
+          , fast_phases("fast_phases", this)
+          , recalibrations("recalibrations", this)
+          , fast_cycles("fast_cycles", this)
+          , error_ppm("error_ppm", this)
+    {}
+};
+
+};
+
+#endif // MEMORY_SURROGATE_H
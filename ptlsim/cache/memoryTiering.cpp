@@ -0,0 +1,219 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <memoryTiering.h>
+#include <machine.h>
+
+using namespace Memory;
+
+static int get_tier_option(BaseMachine &machine, const char *name,
+        const char *opt, int def)
+{
+    int value;
+
+    if (!machine.get_option(name, opt, value))
+        value = def;
+
+    return value;
+}
+
+void MemoryTiering::setup(BaseMachine &machine, const char *name)
+{
+    TierConfig cfg;
+    stringbuf policy;
+
+    cfg.fastPages = get_tier_option(machine, name, "tier_fast_pages", 0);
+    if (cfg.fastPages <= 0) {
+        init(cfg);
+        return;
+    }
+
+    cfg.slowLatency = ns_to_simcycles(get_tier_option(machine, name,
+                "tier_slow_latency", 150));
+    cfg.slowLineCycles = max((int)ns_to_simcycles(get_tier_option(machine,
+                    name, "tier_slow_line_ns", 4)), 1);
+    cfg.epochCycles = max(ns_to_simcycles(get_tier_option(machine, name,
+                    "tier_epoch", 100000)), W64(1));
+    cfg.hotThreshold = get_tier_option(machine, name, "tier_hot", 8);
+    cfg.coldThreshold = get_tier_option(machine, name, "tier_cold", 2);
+    cfg.migratePages = get_tier_option(machine, name, "tier_migrate", 64);
+    cfg.sketchWidth = get_tier_option(machine, name, "tier_sketch_width",
+            4096);
+
+    cfg.policy = TIER_POLICY_HOT;
+    if (machine.get_option(name, "tier_policy", policy)) {
+        if (policy == "static") {
+            cfg.policy = TIER_POLICY_STATIC;
+        } else if (!(policy == "hot")) {
+            ptl_logfile << "ERROR: Unknown tier_policy '" << policy;
+            ptl_logfile << "' for " << name << endl;
+            assert(0);
+        }
+    }
+
+    if (cfg.hotThreshold < 1 || cfg.hotThreshold > 255 ||
+            cfg.coldThreshold < 0 || cfg.migratePages < 0 ||
+            cfg.sketchWidth < 2 ||
+            (cfg.sketchWidth & (cfg.sketchWidth - 1))) {
+        ptl_logfile << "ERROR: " << name << " needs tier_hot in 1..255, ";
+        ptl_logfile << "tier_cold and tier_migrate of 0 or more and a ";
+        ptl_logfile << "power of 2 tier_sketch_width" << endl;
+        assert(0);
+    }
+
+    init(cfg);
+}
+
+void MemoryTiering::init(const TierConfig &cfg)
+{
+    config = cfg;
+    candidates.clear();
+    clockHand = 0;
+    epochEnd = 0;
+    slowFreeCycle = 0;
+
+    if (!enabled())
+        return;
+
+    sketch.setup(config.sketchWidth);
+    fast.setup(config.fastPages);
+}
+
+/**
+ * @brief Place the page of an access and time it if it is in the slow tier
+ *
+ * @param addr Physical address of the access
+ * @param cycle Cycle the access starts
+ * @param result Tier of the access and the migrations of an epoch it ended
+ */
+void MemoryTiering::access(W64 addr, W64 cycle, TierAccess &result)
+{
+    W64 page = addr >> TIER_PAGE_BITS;
+
+    result.slow = false;
+    result.placed = false;
+    result.latency = 0;
+    result.epoch = false;
+    result.promotions = result.demotions = result.skipped = 0;
+
+    if unlikely (cycle >= epochEnd) {
+        if (epochEnd)
+            end_epoch(cycle, result);
+        epochEnd = cycle + config.epochCycles;
+    }
+
+    W8 count = sketch.add(page);
+
+    if likely (fast.contains(page))
+        return;
+
+    if (!fast.full()) {
+        fast.insert(page);
+        result.placed = true;
+        return;
+    }
+
+    result.slow = true;
+
+    if (config.policy == TIER_POLICY_HOT && count >= config.hotThreshold &&
+            candidates.length < config.migratePages) {
+        bool listed = false;
+        foreach (i, candidates.length) {
+            if (candidates[i] == page) {
+                listed = true;
+                break;
+            }
+        }
+        if (!listed)
+            candidates.push(page);
+    }
+
+    W64 start = max(cycle, slowFreeCycle);
+    slowFreeCycle = start + config.slowLineCycles;
+    result.latency = config.slowLatency + int(start - cycle);
+}
+
+/*
+ * Promote this epoch's hot slow pages, each in the place of a cold fast
+ * page, and start counting the next epoch from halved counts
+ */
+void MemoryTiering::end_epoch(W64 cycle, TierAccess &result)
+{
+    result.epoch = true;
+
+    foreach (i, candidates.length) {
+        W64 page = candidates[i];
+
+        if (fast.full()) {
+            int victim = find_cold_page();
+            if (victim < 0) {
+                result.skipped = candidates.length - i;
+                break;
+            }
+            fast.remove_slot(victim);
+            result.demotions++;
+        }
+
+        fast.insert(page);
+        result.promotions++;
+    }
+
+    /* Promotions read the slow tier, demotions write it */
+    occupy_slow(cycle, (result.promotions + result.demotions) *
+            TIER_LINES_PER_PAGE);
+
+    candidates.clear();
+    sketch.decay();
+}
+
+/* Slot of a fast page below the cold count, -1 if a sweep finds none */
+int MemoryTiering::find_cold_page()
+{
+    int size = fast.slots.length;
+
+    foreach (n, size) {
+        int i = clockHand;
+        clockHand = (clockHand + 1) & (size - 1);
+
+        W64 entry = fast.slots[i];
+        if (entry && sketch.estimate(entry - 1) < config.coldThreshold)
+            return i;
+    }
+
+    return -1;
+}
+
+void MemoryTiering::occupy_slow(W64 cycle, int lines)
+{
+    W64 start = max(cycle, slowFreeCycle);
+    slowFreeCycle = start + W64(lines) * config.slowLineCycles;
+}
+
+void MemoryTiering::dump_configuration(YAML::Emitter &out) const
+{
+    const char *policy = (config.policy == TIER_POLICY_STATIC) ?
+        "static" : "hot";
+
+    YAML_KEY_VAL(out, "tier_fast_pages", config.fastPages);
+    YAML_KEY_VAL(out, "tier_slow_latency", config.slowLatency);
+    YAML_KEY_VAL(out, "tier_slow_line_cycles", config.slowLineCycles);
+    YAML_KEY_VAL(out, "tier_policy", policy);
+    YAML_KEY_VAL(out, "tier_epoch", config.epochCycles);
+    YAML_KEY_VAL(out, "tier_hot", config.hotThreshold);
+    YAML_KEY_VAL(out, "tier_cold", config.coldThreshold);
+    YAML_KEY_VAL(out, "tier_migrate", config.migratePages);
+    YAML_KEY_VAL(out, "tier_sketch_width", config.sketchWidth);
+}
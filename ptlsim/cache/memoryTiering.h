@@ -0,0 +1,304 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MEMORY_TIERING_H
+#define MEMORY_TIERING_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+#define TIER_PAGE_BITS 12
+#define TIER_LINES_PER_PAGE ((1 << TIER_PAGE_BITS) / 64)
+
+/**
+ * @brief Access counts of pages in a Count-Min sketch of 8 bit counters
+ *
+ * An estimate never undercounts a page, it can only overcount when other
+ * pages collide with it in every row. decay() halves all counters at the end
+ * of each epoch, so estimates are a moving count of recent accesses and the
+ * counters never stay saturated.
+ */
+struct PageHotnessSketch {
+    static const int DEPTH = 4;
+
+    int widthBits;
+    dynarray<W8> counters[DEPTH];
+
+    PageHotnessSketch() : widthBits(0) {}
+
+    void setup(int width) {
+        widthBits = lsbindex32(width);
+        foreach (d, DEPTH) counters[d].resize(1 << widthBits);
+        reset();
+    }
+
+    void reset() {
+        foreach (d, DEPTH) {
+            foreach (i, counters[d].length) counters[d][i] = 0;
+        }
+    }
+
+    int slot(W64 page, int row) const {
+        W64 h = (page + 1) * (0x9e3779b97f4a7c15ULL + (row << 1));
+        return int(h >> (64 - widthBits));
+    }
+
+    /* Count an access to page and return its new estimate */
+    W8 add(W64 page) {
+        W8 est = 255;
+        foreach (d, DEPTH) {
+            W8 &c = counters[d][slot(page, d)];
+            if (c < 255) c++;
+            est = min(est, c);
+        }
+        return est;
+    }
+
+    W8 estimate(W64 page) const {
+        W8 est = 255;
+        foreach (d, DEPTH) est = min(est, counters[d][slot(page, d)]);
+        return est;
+    }
+
+    void decay() {
+        foreach (d, DEPTH) {
+            foreach (i, counters[d].length) counters[d][i] >>= 1;
+        }
+    }
+};
+
+/**
+ * @brief Set of pages resident in the fast tier
+ *
+ * Open addressing with linear probing in twice as many slots as the tier
+ * holds pages, removal shifts the following entries back so lookups never
+ * need tombstones. Slots are also the positions of the demotion clock.
+ */
+struct TierPageSet {
+    dynarray<W64> slots; /* page + 1, 0 if free */
+    int capacity;
+    int count;
+
+    TierPageSet() : capacity(0), count(0) {}
+
+    void setup(int pages) {
+        capacity = pages;
+        int size = 1;
+        while (size < 2 * pages) size <<= 1;
+        slots.resize(size);
+        reset();
+    }
+
+    void reset() {
+        foreach (i, slots.length) slots[i] = 0;
+        count = 0;
+    }
+
+    bool full() const { return count >= capacity; }
+
+    int home(W64 page) const {
+        return int(((page + 1) * 0x9e3779b97f4a7c15ULL) >>
+                (64 - lsbindex32(slots.length)));
+    }
+
+    int find(W64 page) const {
+        int mask = slots.length - 1;
+        for (int i = home(page);; i = (i + 1) & mask) {
+            if (!slots[i]) return -1;
+            if (slots[i] == page + 1) return i;
+        }
+    }
+
+    bool contains(W64 page) const { return find(page) >= 0; }
+
+    void insert(W64 page) {
+        int mask = slots.length - 1;
+        int i = home(page);
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = page + 1;
+        count++;
+    }
+
+    void remove_slot(int i) {
+        int mask = slots.length - 1;
+        int hole = i;
+        slots[hole] = 0;
+        count--;
+
+        /* Move back entries whose probe sequence passes the hole */
+        for (int j = (hole + 1) & mask; slots[j]; j = (j + 1) & mask) {
+            int h = home(slots[j] - 1);
+            bool reachable = (hole <= j) ? (h <= hole || h > j)
+                : (h <= hole && h > j);
+            if (reachable) {
+                slots[hole] = slots[j];
+                slots[j] = 0;
+                hole = j;
+            }
+        }
+    }
+};
+
+enum TierPolicy {
+    TIER_POLICY_HOT,    /* promote hot slow pages, demote cold fast pages */
+    TIER_POLICY_STATIC, /* pages stay in the tier of their first touch */
+};
+
+/* Options of a tiered memory controller, latencies in sim cycles */
+struct TierConfig {
+    int fastPages;
+    int slowLatency;
+    int slowLineCycles;
+    TierPolicy policy;
+    W64 epochCycles;
+    int hotThreshold;
+    int coldThreshold;
+    int migratePages;
+    int sketchWidth;
+
+    TierConfig()
+        : fastPages(0)
+          , slowLatency(0)
+          , slowLineCycles(1)
+          , policy(TIER_POLICY_HOT)
+          , epochCycles(100000)
+          , hotThreshold(8)
+          , coldThreshold(2)
+          , migratePages(64)
+          , sketchWidth(4096)
+    {}
+};
+
+/* What happened on one access, for the controller's stats */
+struct TierAccess {
+    bool slow;
+    bool placed;      /* first touch, placed in the fast tier */
+    int latency;      /* slow tier only: latency including its queue */
+    bool epoch;       /* access closed an epoch */
+    int promotions;
+    int demotions;
+    int skipped;      /* promotions left for lack of a cold fast page */
+};
+
+/**
+ * @brief Fast and slow tier placement of the pages of a memory controller
+ *
+ * Enabled with 'tier_fast_pages' in the controller's machine config options.
+ * The fast tier is the controller itself, the slow tier (CXL-like memory)
+ * has 'tier_slow_latency' ns latency and moves one line every
+ * 'tier_slow_line_ns' ns, so it queues accesses when used beyond its
+ * bandwidth. Options:
+ *
+ *   tier_fast_pages   : 4KB pages in the fast tier, 0 (no tiering) default
+ *   tier_slow_latency : slow tier latency in ns, 150 by default
+ *   tier_slow_line_ns : ns per 64 byte line of the slow tier, 4 by default
+ *                       (16GB/s)
+ *   tier_policy       : 'hot' (default) or 'static'
+ *   tier_epoch        : ns between migrations, 100000 by default
+ *   tier_hot          : accesses of a slow page in decayed count to
+ *                       promote it, 8 by default
+ *   tier_cold         : fast pages below this count can be demoted, 2
+ *   tier_migrate      : most pages promoted per epoch, 64 by default
+ *   tier_sketch_width : counters per sketch row, a power of 2, 4096
+ *
+ * A page goes to the fast tier on its first touch while it has room and to
+ * the slow tier after. Migrations swap pages, so once the fast tier is full
+ * it stays full and a page missing from it while it has room is a first
+ * touch: only fast pages have to be tracked.
+ *
+ * With the 'hot' policy slow pages that reach the hot count in an epoch are
+ * promoted when it ends, each into the place of a cold fast page found by a
+ * clock sweep of the fast tier. A migration copies a page each way and holds
+ * the slow tier for the lines it moves.
+ *
+ * Epochs end at the first access after their last cycle, so an idle
+ * controller costs nothing.
+ */
+struct MemoryTiering {
+    TierConfig config;
+    PageHotnessSketch sketch;
+    TierPageSet fast;
+
+    dynarray<W64> candidates;
+    int clockHand;
+    W64 epochEnd;
+    W64 slowFreeCycle;
+
+    MemoryTiering() : clockHand(0), epochEnd(0), slowFreeCycle(0) {}
+
+    bool enabled() const { return config.fastPages > 0; }
+
+    /* Read options of controller 'name', leaves tiering off if unset */
+    void setup(BaseMachine &machine, const char *name);
+
+    void init(const TierConfig &cfg);
+
+    void access(W64 addr, W64 cycle, TierAccess &result);
+
+    void dump_configuration(YAML::Emitter &out) const;
+
+  private:
+    void end_epoch(W64 cycle, TierAccess &result);
+    int find_cold_page();
+    void occupy_slow(W64 cycle, int lines);
+};
+
+/*
+ * Split in user and kernel by the mode of each access, epoch migrations by
+ * the mode of the access that ended the epoch:
+ *
+ *   MEM_0:
+ *     tiering:
+ *       fast_accesses: .., slow_accesses: .., fast_bytes: .., slow_bytes: ..
+ *       placed_fast: .., epochs: .., promotions: ..,
+ *       demotions: .., skipped: .., migrated_bytes: ..
+ *       fast_latency: {count: .., mean: .., p50: .., .., p99: .., max: ..}
+ *       slow_latency: {..}
+ */
+struct TieringStats : public Statable
+{
+    StatObj<W64> fast_accesses;
+    StatObj<W64> slow_accesses;
+    StatObj<W64> fast_bytes;
+    StatObj<W64> slow_bytes;
+    StatObj<W64> placed_fast;
+    StatObj<W64> epochs;
+    StatObj<W64> promotions;
+    StatObj<W64> demotions;
+    StatObj<W64> skipped;
+    StatObj<W64> migrated_bytes;
+    StatHistogram<> fast_latency;
+    StatHistogram<> slow_latency;
+
+    TieringStats(Statable *parent)
+        : Statable("tiering", parent)
+          , fast_accesses("fast_accesses", this)
+          , slow_accesses("slow_accesses", this)
+          , fast_bytes("fast_bytes", this)
+          , slow_bytes("slow_bytes", this)
+          , placed_fast("placed_fast", this)
+          , epochs("epochs", this)
+          , promotions("promotions", this)
+          , demotions("demotions", this)
+          , skipped("skipped", this)
+          , migrated_bytes("migrated_bytes", this)
+          , fast_latency("fast_latency", this)
+          , slow_latency("slow_latency", this)
+    {}
+};
+
+};
+
+#endif // MEMORY_TIERING_H
@@ -55,7 +55,8 @@ void MESILogic::handle_local_hit(CacheQueueEntry *queueEntry)
 		/* If we receive update from upper cache and local cache line state
 		 * is not MODIFIED, then send the response down because cache update
 		 * must have been initiated from this level, or lower level cache. */
-		queueEntry->dest = controller->get_lower_cont();
+		queueEntry->dest = controller->get_lower_cont(
+                queueEntry->request->get_physical_address());
 		queueEntry->sendTo = controller->get_lower_intrconn();
 		queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
 		controller->wait_interconnect_cb(queueEntry);
@@ -100,6 +101,7 @@ void MESILogic::handle_local_hit(CacheQueueEntry *queueEntry)
                     newState                = MESI_MODIFIED;
                     queueEntry->sendTo      = queueEntry->sender;
                     controller->send_evict_to_lower(queueEntry);
+                    N_STAT_UPDATE(traffic.invalidations, ++, kernel_req);
                     controller->wait_interconnect_cb(queueEntry);
                 } else {
                     /*
@@ -139,100 +141,161 @@ void MESILogic::handle_local_miss(CacheQueueEntry *queueEntry)
     controller->wait_interconnect_cb(queueEntry);
 }
 
+/*
+ * Snoop hit transitions, [lowest private][line state][request type]
+ *
+ * Evicts, and updates of a level that is not the lowest private one,
+ * only change the line state and don't need a response.
+ */
+static const CoherenceTransition MESISnoopTable[2][NO_MESI_STATES][NUM_MEMORY_OP] = {
+    { /* Not lowest private */
+        /* Invalid */
+        {COH_T(MESI_INVALID, COH_NO_DATA),
+         COH_T(MESI_INVALID, COH_NO_DATA),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESI_INVALID, COH_DONE)},
+        /* Modified */
+        {COH_T(MESI_SHARED,  COH_SHARED | COH_UPDATE_LOWER),
+         COH_T(MESI_INVALID, COH_UPDATE_LOWER),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESI_INVALID, COH_DONE)},
+        /* Exclusive */
+        {COH_T(MESI_SHARED,  COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MESI_INVALID, COH_NONE),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESI_INVALID, COH_DONE)},
+        /* Shared */
+        {COH_T(MESI_SHARED,  COH_SHARED),
+         COH_T(MESI_INVALID, COH_NONE),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESI_INVALID, COH_DONE)},
+    },
+    { /* Lowest private */
+        /* Invalid */
+        {COH_T(MESI_INVALID, COH_NO_DATA),
+         COH_T(MESI_INVALID, COH_NO_DATA),
+         COH_T(MESI_INVALID, COH_NO_DATA),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Modified */
+        {COH_T(MESI_SHARED,  COH_SHARED | COH_UPDATE_LOWER),
+         COH_T(MESI_INVALID, COH_UPDATE_LOWER | COH_EVICT_UPPER),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG | COH_UPDATE_LOWER),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Exclusive */
+        {COH_T(MESI_SHARED,  COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Shared */
+        {COH_T(MESI_SHARED,  COH_SHARED),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER),
+         COH_T(MESI_INVALID, COH_STATE_FROM_ARG),
+         COH_T(MESI_INVALID, COH_EVICT_UPPER | COH_DONE)},
+    },
+};
+
+/*
+ * Fill transitions of the lowest private level, [shared][line state]
+ * [request type]. Updates never wait for a fill.
+ */
+static const CoherenceTransition MESIFillTable[2][NO_MESI_STATES][NUM_MEMORY_OP] = {
+    { /* Not shared */
+        {COH_T(MESI_EXCLUSIVE, COH_NONE),
+         COH_T(MESI_MODIFIED,  COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_MODIFIED,  COH_NONE),
+         COH_T(MESI_MODIFIED,  COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_EXCLUSIVE, COH_NONE),
+         COH_T(MESI_MODIFIED,  COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_SHARED,    COH_NONE),
+         COH_T(MESI_MODIFIED,  COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+    },
+    { /* Shared */
+        {COH_T(MESI_SHARED,    COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_SHARED,    COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_SHARED,    COH_NONE),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESI_SHARED,    COH_NONE),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_ERROR),
+         COH_T(MESI_INVALID,   COH_EVICT_UPPER)},
+    },
+};
+
+void MESILogic::send_messages(CacheQueueEntry *queueEntry, W16 actions)
+{
+    bool kernel_req = queueEntry->request->is_kernel();
+
+    if(actions & COH_UPDATE_LOWER) {
+        controller->send_update_to_lower(queueEntry);
+        N_STAT_UPDATE(traffic.writebacks, ++, kernel_req);
+    }
+    if(actions & COH_EVICT_UPPER) {
+        controller->send_evict_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.invalidations, ++, kernel_req);
+    }
+    if(actions & COH_UPDATE_UPPER) {
+        controller->send_update_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.upper_updates, ++, kernel_req);
+    }
+}
+
 void MESILogic::handle_interconn_hit(CacheQueueEntry *queueEntry)
 {
     MESICacheLineState oldState = (MESICacheLineState)queueEntry->line->state;
-    MESICacheLineState newState = NO_MESI_STATES;
     OP_TYPE type                = queueEntry->request->get_type();
     bool kernel_req             = queueEntry->request->is_kernel();
 
+    assert(oldState < NO_MESI_STATES);
+    const CoherenceTransition &trans = MESISnoopTable[
+        controller->is_lowest_private()][oldState][type];
+
     N_STAT_UPDATE(hit_state.snoop, [oldState]++,
                  kernel_req);
-    if(type == MEMORY_OP_EVICT) {
-        if(controller->is_lowest_private())
-            controller->send_evict_to_upper(queueEntry);
-        UPDATE_MESI_TRANS_STATS(oldState, MESI_INVALID, kernel_req);
-        queueEntry->line->state = MESI_INVALID;
-        controller->clear_entry_cb(queueEntry);
-        return;
-    }
 
-    if (type == MEMORY_OP_UPDATE && !controller->is_lowest_private()) {
-        queueEntry->line->state = *(MESICacheLineState*)(queueEntry->m_arg);
-        UPDATE_MESI_TRANS_STATS(oldState, queueEntry->line->state, kernel_req);
+    MESICacheLineState newState = (MESICacheLineState)trans.next;
+    if(trans.actions & COH_STATE_FROM_ARG)
+        newState = *(MESICacheLineState*)(queueEntry->m_arg);
+
+    queueEntry->line->state = newState;
+    UPDATE_MESI_TRANS_STATS(oldState, newState, kernel_req);
+
+    if unlikely (coherence_hotspots_enabled && oldState != MESI_INVALID &&
+            newState == MESI_INVALID && controller->is_lowest_private())
+        coherence_hotspot_invalidation(queueEntry->request);
+
+    if(trans.actions & COH_DONE) {
+        send_messages(queueEntry, trans.actions);
         controller->clear_entry_cb(queueEntry);
         return;
     }
 
-    // By default we mark the queueEntry's shared flat to false
-    queueEntry->isShared     = false;
-    queueEntry->responseData = true;
+    queueEntry->isShared     = (trans.actions & COH_SHARED);
+    queueEntry->responseData = !(trans.actions & COH_NO_DATA);
+    if(trans.actions & COH_NO_DATA)
+        queueEntry->line = NULL;
 
-    switch(oldState) {
-        case MESI_INVALID:
-            queueEntry->line         = NULL;
-            queueEntry->responseData = false;
-            newState                 = MESI_INVALID;
-            break;
-        case MESI_EXCLUSIVE:
-            if(type == MEMORY_OP_READ) {
-                queueEntry->line->state = MESI_SHARED;
-                queueEntry->isShared    = true;
-                newState                = MESI_SHARED;
-                controller->send_update_to_upper(queueEntry);
-            } else if(type == MEMORY_OP_WRITE) {
-                if(controller->is_lowest_private())
-                    controller->send_evict_to_upper(queueEntry);
-                queueEntry->line->state = MESI_INVALID;
-                newState = MESI_INVALID;
-            } else if(type == MEMORY_OP_UPDATE) {
-                newState = *(MESICacheLineState*)(queueEntry->m_arg);
-                queueEntry->line->state = newState;
-            } else {
-                assert(0);
-            }
-            break;
-        case MESI_SHARED:
-            if(type == MEMORY_OP_READ) {
-                queueEntry->isShared = true;
-                newState             = MESI_SHARED;
-            } else if(type == MEMORY_OP_WRITE) {
-                if(controller->is_lowest_private())
-                    controller->send_evict_to_upper(queueEntry);
-                queueEntry->line->state = MESI_INVALID;
-                newState                = MESI_INVALID;
-            } else if(type == MEMORY_OP_UPDATE) {
-                newState = *(MESICacheLineState*)(queueEntry->m_arg);
-                queueEntry->line->state = newState;
-            } else {
-                assert(0);
-            }
-            break;
-        case MESI_MODIFIED:
-            controller->send_update_to_lower(queueEntry);
-            if(type == MEMORY_OP_READ) {
-                queueEntry->line->state = MESI_SHARED;
-                queueEntry->isShared    = true;
-                newState                = MESI_SHARED;
-            } else if(type == MEMORY_OP_WRITE) {
-                if(controller->is_lowest_private())
-                    controller->send_evict_to_upper(queueEntry);
-                queueEntry->line->state = MESI_INVALID;
-                newState                = MESI_INVALID;
-            } else if(type == MEMORY_OP_UPDATE) {
-                newState = *(MESICacheLineState*)(queueEntry->m_arg);
-                queueEntry->line->state = newState;
-            } else {
-                assert(0);
-            }
-            break;
-        default:
-            memdebug("Invalid line state: " << oldState);
-            assert(0);
-    }
+    send_messages(queueEntry, trans.actions);
 
-    if(newState != NO_MESI_STATES) {
-        UPDATE_MESI_TRANS_STATS(oldState, newState, kernel_req);
+    if(queueEntry->responseData) {
+        N_STAT_UPDATE(traffic.data_responses, ++, kernel_req);
+    } else {
+        N_STAT_UPDATE(traffic.dataless_responses, ++, kernel_req);
     }
 
     /* send back the response */
@@ -263,12 +326,15 @@ void MESILogic::handle_cache_evict(CacheQueueEntry *queueEntry)
      */
     if(oldState == MESI_MODIFIED && controller->is_lowest_private()) {
         controller->send_update_to_lower(queueEntry);
+        N_STAT_UPDATE(traffic.writebacks, ++,
+                queueEntry->request->is_kernel());
     }
 }
 
 void MESILogic::handle_cache_insert(CacheQueueEntry *queueEntry, W64 oldTag)
 {
     MESICacheLineState oldState = (MESICacheLineState)queueEntry->line->state;
+    bool kernel_req             = queueEntry->request->is_kernel();
     /*
      * if evicting line state is modified, then create a new
      * memory request of type MEMORY_OP_UPDATE and send it to
@@ -276,11 +342,13 @@ void MESILogic::handle_cache_insert(CacheQueueEntry *queueEntry, W64 oldTag)
      */
     if(oldState == MESI_MODIFIED) {
         controller->send_update_to_lower(queueEntry, oldTag);
+        N_STAT_UPDATE(traffic.writebacks, ++, kernel_req);
     }
 
     if(oldState != MESI_INVALID && controller->is_lowest_private()) {
         /* send evict message to upper cache */
         controller->send_evict_to_upper(queueEntry, oldTag);
+        N_STAT_UPDATE(traffic.invalidations, ++, kernel_req);
     }
 
     /* Now set the new line state */
@@ -316,116 +384,25 @@ void MESILogic::complete_request(CacheQueueEntry *queueEntry,
     }
 }
 
+/* Only the lowest private level takes its line state from a fill */
 MESICacheLineState MESILogic::get_new_state(
         CacheQueueEntry *queueEntry, bool isShared)
 {
     MESICacheLineState oldState = (MESICacheLineState)queueEntry->line->state;
-    MESICacheLineState newState = MESI_INVALID;
     OP_TYPE type                = queueEntry->request->get_type();
     bool kernel_req             = queueEntry->request->is_kernel();
 
-    if(type == MEMORY_OP_EVICT) {
-        if(controller->is_lowest_private())
-            controller->send_evict_to_upper(queueEntry);
-        UPDATE_MESI_TRANS_STATS(oldState, MESI_INVALID, kernel_req);
-        return MESI_INVALID;
-    }
+    assert(oldState < NO_MESI_STATES);
+    const CoherenceTransition &trans = MESIFillTable[isShared][oldState][type];
 
-    if(type == MEMORY_OP_UPDATE) {
+    if(trans.actions & COH_ERROR) {
         ptl_logfile << "Queueentry: " << *queueEntry << endl;
         assert(0);
     }
 
-    switch(oldState) {
-        case MESI_INVALID:
-            if(isShared) {
-                if(type == MEMORY_OP_READ) {
-                    newState = MESI_SHARED;
-                } else { //if(type == MEMORY_OP_WRITE)
-                    assert(0);
-                }
-            } else {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_EXCLUSIVE;
-                else if(type == MEMORY_OP_WRITE)
-                    newState = MESI_MODIFIED;
-                else if(type == MEMORY_OP_EVICT)
-                    newState = MESI_INVALID;
-                else
-                    assert(0);
-            }
-            break;
-        case MESI_EXCLUSIVE:
-            if(isShared) {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_SHARED;
-                else {
-                    if(controller->is_lowest_private())
-                        controller->send_evict_to_upper(queueEntry);
-                    newState = MESI_INVALID;
-                }
-            } else {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_EXCLUSIVE;
-                else if(type == MEMORY_OP_WRITE)
-                    newState = MESI_MODIFIED;
-                else if(type == MEMORY_OP_EVICT) {
-                    if(controller->is_lowest_private())
-                        controller->send_evict_to_upper(queueEntry);
-                    newState = MESI_INVALID;
-                }
-                else
-                    assert(0);
-            }
-            break;
-        case MESI_SHARED:
-            if(isShared) {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_SHARED;
-                else if(type == MEMORY_OP_WRITE)
-                    assert(0);
-                else
-                    assert(0);
-            } else {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_SHARED;
-                else if(type == MEMORY_OP_WRITE)
-                    newState = MESI_MODIFIED;
-                else if(type == MEMORY_OP_EVICT) {
-                    if(controller->is_lowest_private())
-                        controller->send_evict_to_upper(queueEntry);
-                    newState = MESI_INVALID;
-                }
-                else
-                    assert(0);
-            }
-            break;
-        case MESI_MODIFIED:
-            if(isShared) {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_SHARED;
-                else if(type == MEMORY_OP_WRITE)
-                    assert(0);
-                else
-                    assert(0);
-            } else {
-                if(type == MEMORY_OP_READ)
-                    newState = MESI_MODIFIED;
-                else if(type == MEMORY_OP_WRITE)
-                    newState = MESI_MODIFIED;
-                else if(type == MEMORY_OP_EVICT) {
-                    if(controller->is_lowest_private())
-                        controller->send_evict_to_upper(queueEntry);
-                    newState = MESI_INVALID;
-                }
-                else
-                    assert(0);
-            }
-            break;
-        default:
-            memdebug("Invalid line state: " << oldState);
-            assert(0);
-    }
+    MESICacheLineState newState = (MESICacheLineState)trans.next;
+    send_messages(queueEntry, trans.actions);
+
     UPDATE_MESI_TRANS_STATS(oldState, newState, kernel_req);
     return newState;
 }
@@ -435,6 +412,12 @@ void MESILogic::invalidate_line(CacheLine *line)
     line->state = MESI_INVALID;
 }
 
+/* Warmed lines have no owner to track, so they are all clean shared */
+void MESILogic::warm_line(CacheLine *line)
+{
+    line->state = MESI_SHARED;
+}
+
 bool MESILogic::is_line_valid(CacheLine *line)
 {
     if(line->state == MESI_INVALID) {
@@ -448,6 +431,18 @@ void MESILogic::handle_response(CacheQueueEntry *entry, Message &msg)
 {
 }
 
+/* A read hit keeps the line state whatever it is, as handle_local_hit */
+bool MESILogic::fast_read_hit(CacheLine *line, MemoryRequest *request)
+{
+    MESICacheLineState state = (MESICacheLineState)line->state;
+
+    if(state == MESI_INVALID)
+        return false;
+
+    N_STAT_UPDATE(hit_state.cpu, [state]++, request->is_kernel());
+    return true;
+}
+
 /**
  * @brief Dump MESI Coherence Logic Configuration
  *
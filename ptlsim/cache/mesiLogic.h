@@ -71,6 +71,7 @@ namespace CoherentCache {
                   , miss_state("miss_state", this)
                   , hit_state("hit_state", this)
                   , state_transition("state_transition", this)
+                  , traffic("traffic", this)
             {}
 
             void handle_local_hit(CacheQueueEntry *queueEntry);
@@ -85,9 +86,12 @@ namespace CoherentCache {
                     Message &message);
             bool is_line_valid(CacheLine *line);
             void invalidate_line(CacheLine *line);
+            void warm_line(CacheLine *line);
+            bool fast_read_hit(CacheLine *line, MemoryRequest *request);
 			void dump_configuration(YAML::Emitter &out) const;
 
             MESICacheLineState get_new_state(CacheQueueEntry *queueEntry, bool isShared);
+            void send_messages(CacheQueueEntry *queueEntry, W16 actions);
 
             /* Statistics */
 
@@ -110,6 +114,7 @@ namespace CoherentCache {
             } hit_state;
 
             StatArray<W64,16> state_transition;
+            CoherenceTraffic traffic;
     };
 };
 
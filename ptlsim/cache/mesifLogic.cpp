@@ -0,0 +1,462 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <mesifLogic.h>
+
+#include <memoryRequest.h>
+#include <coherentCache.h>
+
+#include <machine.h>
+
+using namespace Memory;
+using namespace Memory::CoherentCache;
+
+/*
+ * Snoop hit transitions, [lowest private][line state][request type]
+ *
+ * Only Forward, Exclusive and Modified lines answer with data. Evicts,
+ * and updates of a level that is not the lowest private one, only
+ * change the line state and don't need a response.
+ */
+static const CoherenceTransition MESIFSnoopTable[2][NO_MESIF_STATES][NUM_MEMORY_OP] = {
+    { /* Not lowest private */
+        /* Invalid */
+        {COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESIF_INVALID, COH_DONE)},
+        /* Modified */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_UPDATE_LOWER),
+         COH_T(MESIF_INVALID, COH_UPDATE_LOWER),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESIF_INVALID, COH_DONE)},
+        /* Exclusive */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MESIF_INVALID, COH_NONE),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESIF_INVALID, COH_DONE)},
+        /* Shared */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESIF_INVALID, COH_DONE)},
+        /* Forward */
+        {COH_T(MESIF_SHARED,  COH_SHARED),
+         COH_T(MESIF_INVALID, COH_NONE),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MESIF_INVALID, COH_DONE)},
+    },
+    { /* Lowest private */
+        /* Invalid */
+        {COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Modified */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_UPDATE_LOWER),
+         COH_T(MESIF_INVALID, COH_UPDATE_LOWER | COH_EVICT_UPPER),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG | COH_UPDATE_LOWER),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Exclusive */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Shared */
+        {COH_T(MESIF_SHARED,  COH_SHARED | COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_NO_DATA),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_DONE)},
+        /* Forward */
+        {COH_T(MESIF_SHARED,  COH_SHARED),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER),
+         COH_T(MESIF_INVALID, COH_STATE_FROM_ARG),
+         COH_T(MESIF_INVALID, COH_EVICT_UPPER | COH_DONE)},
+    },
+};
+
+/*
+ * Fill transitions of the lowest private level, [shared][line state]
+ * [request type]. A shared fill makes this cache the new forwarder.
+ */
+static const CoherenceTransition MESIFFillTable[2][NO_MESIF_STATES][NUM_MEMORY_OP] = {
+    { /* Not shared */
+        {COH_T(MESIF_EXCLUSIVE, COH_NONE),
+         COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_EXCLUSIVE, COH_NONE),
+         COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_SHARED,    COH_NONE),
+         COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_FORWARD,   COH_NONE),
+         COH_T(MESIF_MODIFIED,  COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+    },
+    { /* Shared */
+        {COH_T(MESIF_FORWARD,   COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_SHARED,    COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_SHARED,    COH_NONE),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_SHARED,    COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+        {COH_T(MESIF_FORWARD,   COH_NONE),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_ERROR),
+         COH_T(MESIF_INVALID,   COH_EVICT_UPPER)},
+    },
+};
+
+void MESIFLogic::send_messages(CacheQueueEntry *queueEntry, W16 actions)
+{
+    bool kernel_req = queueEntry->request->is_kernel();
+
+    if(actions & COH_UPDATE_LOWER) {
+        controller->send_update_to_lower(queueEntry);
+        N_STAT_UPDATE(traffic.writebacks, ++, kernel_req);
+    }
+    if(actions & COH_EVICT_UPPER) {
+        controller->send_evict_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.invalidations, ++, kernel_req);
+    }
+    if(actions & COH_UPDATE_UPPER) {
+        controller->send_update_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.upper_updates, ++, kernel_req);
+    }
+}
+
+void MESIFLogic::handle_local_hit(CacheQueueEntry *queueEntry)
+{
+    MESIFCacheLineState oldState = (MESIFCacheLineState)queueEntry->line->state;
+    MESIFCacheLineState newState = NO_MESIF_STATES;
+    OP_TYPE type                 = queueEntry->request->get_type();
+    bool kernel_req              = queueEntry->request->is_kernel();
+
+    N_STAT_UPDATE(hit_state.cpu, [oldState]++, kernel_req);
+
+    if(type == MEMORY_OP_EVICT) {
+        UPDATE_MESIF_TRANS_STATS(oldState, MESIF_INVALID, kernel_req);
+        queueEntry->line->state = MESIF_INVALID;
+        controller->clear_entry_cb(queueEntry);
+        return;
+    }
+
+    if(type == MEMORY_OP_UPDATE && oldState != MESIF_MODIFIED) {
+        /* Update from upper cache of a line that is not Modified here
+         * was started by this or a lower level, pass it down. */
+        queueEntry->dest = controller->get_lower_cont(
+                queueEntry->request->get_physical_address());
+        queueEntry->sendTo = controller->get_lower_intrconn();
+        queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
+        controller->wait_interconnect_cb(queueEntry);
+        return;
+    }
+
+    switch(oldState) {
+        case MESIF_INVALID:
+            /* treat it as a miss */
+            N_STAT_UPDATE(miss_state.cpu, [oldState]++, kernel_req);
+            controller->cache_miss_cb(queueEntry);
+            break;
+        case MESIF_EXCLUSIVE:
+        case MESIF_SHARED:
+        case MESIF_FORWARD:
+            if(type == MEMORY_OP_WRITE) {
+                if(controller->is_lowest_private()) {
+                    queueEntry->line->state = MESIF_MODIFIED;
+                    newState                = MESIF_MODIFIED;
+                    queueEntry->sendTo      = queueEntry->sender;
+
+                    /* Other sharers have to drop their copies */
+                    if(oldState != MESIF_EXCLUSIVE) {
+                        controller->send_evict_to_lower(queueEntry);
+                        N_STAT_UPDATE(traffic.invalidations, ++,
+                                kernel_req);
+                    }
+                    controller->wait_interconnect_cb(queueEntry);
+                } else {
+                    /*
+                     * treat it as miss so lower cache also update
+                     * its cache line state
+                     */
+                    queueEntry->line->state = MESIF_INVALID;
+                    newState                = MESIF_INVALID;
+                    N_STAT_UPDATE(miss_state.cpu, [oldState]++,
+                            kernel_req);
+                    controller->cache_miss_cb(queueEntry);
+                }
+            } else if(type == MEMORY_OP_READ) {
+                queueEntry->sendTo = queueEntry->sender;
+                controller->wait_interconnect_cb(queueEntry);
+            }
+            break;
+        case MESIF_MODIFIED:
+            /* we dont' change anything in this case */
+            queueEntry->sendTo = queueEntry->sender;
+            controller->wait_interconnect_cb(queueEntry);
+            break;
+        default:
+            memdebug("Invalid line state: " << oldState);
+            assert(0);
+    }
+
+    if(newState != NO_MESIF_STATES) {
+        UPDATE_MESIF_TRANS_STATS(oldState, newState, kernel_req);
+    }
+}
+
+void MESIFLogic::handle_local_miss(CacheQueueEntry *queueEntry)
+{
+    queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
+    queueEntry->sendTo = controller->get_lower_intrconn();
+    controller->wait_interconnect_cb(queueEntry);
+}
+
+void MESIFLogic::handle_interconn_hit(CacheQueueEntry *queueEntry)
+{
+    MESIFCacheLineState oldState = (MESIFCacheLineState)queueEntry->line->state;
+    OP_TYPE type                 = queueEntry->request->get_type();
+    bool kernel_req              = queueEntry->request->is_kernel();
+
+    assert(oldState < NO_MESIF_STATES);
+    const CoherenceTransition &trans = MESIFSnoopTable[
+        controller->is_lowest_private()][oldState][type];
+
+    N_STAT_UPDATE(hit_state.snoop, [oldState]++, kernel_req);
+
+    MESIFCacheLineState newState = (MESIFCacheLineState)trans.next;
+    if(trans.actions & COH_STATE_FROM_ARG)
+        newState = *(MESIFCacheLineState*)(queueEntry->m_arg);
+
+    queueEntry->line->state = newState;
+    UPDATE_MESIF_TRANS_STATS(oldState, newState, kernel_req);
+
+    if unlikely (coherence_hotspots_enabled && oldState != MESIF_INVALID &&
+            newState == MESIF_INVALID && controller->is_lowest_private())
+        coherence_hotspot_invalidation(queueEntry->request);
+
+    if(trans.actions & COH_DONE) {
+        send_messages(queueEntry, trans.actions);
+        controller->clear_entry_cb(queueEntry);
+        return;
+    }
+
+    queueEntry->isShared     = (trans.actions & COH_SHARED);
+    queueEntry->responseData = !(trans.actions & COH_NO_DATA);
+
+    send_messages(queueEntry, trans.actions);
+
+    /* Shared copies keep their line, they just don't forward it */
+    if(oldState == MESIF_INVALID)
+        queueEntry->line = NULL;
+
+    if(queueEntry->responseData) {
+        N_STAT_UPDATE(traffic.data_responses, ++, kernel_req);
+    } else {
+        N_STAT_UPDATE(traffic.dataless_responses, ++, kernel_req);
+    }
+
+    /* send back the response */
+    queueEntry->sendTo = queueEntry->sender;
+    controller->wait_interconnect_cb(queueEntry);
+}
+
+void MESIFLogic::handle_interconn_miss(CacheQueueEntry *queueEntry)
+{
+    /* On cache miss we dont perform anything */
+    if(queueEntry->request->get_type() != MEMORY_OP_EVICT &&
+            queueEntry->request->get_type() != MEMORY_OP_UPDATE) {
+        queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
+        queueEntry->sendTo = controller->get_lower_intrconn();
+        controller->wait_interconnect_cb(queueEntry);
+    } else {
+        controller->clear_entry_cb(queueEntry);
+    }
+}
+
+void MESIFLogic::handle_cache_evict(CacheQueueEntry *queueEntry)
+{
+    MESIFCacheLineState oldState = (MESIFCacheLineState)queueEntry->line->state;
+
+    if(oldState == MESIF_MODIFIED && controller->is_lowest_private()) {
+        controller->send_update_to_lower(queueEntry);
+        N_STAT_UPDATE(traffic.writebacks, ++,
+                queueEntry->request->is_kernel());
+    }
+}
+
+void MESIFLogic::handle_cache_insert(CacheQueueEntry *queueEntry, W64 oldTag)
+{
+    MESIFCacheLineState oldState = (MESIFCacheLineState)queueEntry->line->state;
+    bool kernel_req              = queueEntry->request->is_kernel();
+
+    /* Write back Modified victims, a dropped Forward line is simply
+     * refetched from lower level by the next sharer */
+    if(oldState == MESIF_MODIFIED) {
+        controller->send_update_to_lower(queueEntry, oldTag);
+        N_STAT_UPDATE(traffic.writebacks, ++, kernel_req);
+    }
+
+    if(oldState != MESIF_INVALID && controller->is_lowest_private()) {
+        /* send evict message to upper cache */
+        controller->send_evict_to_upper(queueEntry, oldTag);
+        N_STAT_UPDATE(traffic.invalidations, ++, kernel_req);
+    }
+
+    /* Now set the new line state */
+    queueEntry->line->state = MESIF_INVALID;
+}
+
+void MESIFLogic::complete_request(CacheQueueEntry *queueEntry,
+        Message &message)
+{
+    assert(queueEntry->line);
+    assert(message.hasData);
+
+    if(!controller->is_lowest_private()) {
+        if(message.request->get_type() == MEMORY_OP_EVICT) {
+            queueEntry->line->state = MESIF_INVALID;
+        } else if(controller->is_private()) {
+            /* Lower private cache sends its line state as argument */
+            queueEntry->line->state = *((MESIFCacheLineState*)
+                    message.arg);
+        } else {
+            /* From main memory */
+            queueEntry->line->state = MESIF_EXCLUSIVE;
+        }
+    } else {
+        queueEntry->line->state = get_new_state(queueEntry,
+                message.isShared);
+    }
+}
+
+/* Only the lowest private level takes its line state from a fill */
+MESIFCacheLineState MESIFLogic::get_new_state(
+        CacheQueueEntry *queueEntry, bool isShared)
+{
+    MESIFCacheLineState oldState = (MESIFCacheLineState)queueEntry->line->state;
+    OP_TYPE type                 = queueEntry->request->get_type();
+    bool kernel_req              = queueEntry->request->is_kernel();
+
+    assert(oldState < NO_MESIF_STATES);
+    const CoherenceTransition &trans = MESIFFillTable[isShared][oldState][type];
+
+    if(trans.actions & COH_ERROR) {
+        ptl_logfile << "Queueentry: " << *queueEntry << endl;
+        assert(0);
+    }
+
+    MESIFCacheLineState newState = (MESIFCacheLineState)trans.next;
+    send_messages(queueEntry, trans.actions);
+
+    UPDATE_MESIF_TRANS_STATS(oldState, newState, kernel_req);
+    return newState;
+}
+
+void MESIFLogic::invalidate_line(CacheLine *line)
+{
+    line->state = MESIF_INVALID;
+}
+
+/* Warmed lines have no owner to track, so they are all clean shared and
+ * the first miss on them makes a forwarder */
+void MESIFLogic::warm_line(CacheLine *line)
+{
+    line->state = MESIF_SHARED;
+}
+
+bool MESIFLogic::is_line_valid(CacheLine *line)
+{
+    return line->state != MESIF_INVALID;
+}
+
+void MESIFLogic::handle_response(CacheQueueEntry *entry, Message &msg)
+{
+}
+
+/**
+ * @brief Dump MESIF Coherence Logic Configuration
+ *
+ * @param out YAML Object
+ */
+void MESIFLogic::dump_configuration(YAML::Emitter &out) const
+{
+    YAML_KEY_VAL(out, "coherence", "MESIF");
+}
+
+/* MESIF Controller Builder */
+struct MESIFCacheControllerBuilder : public ControllerBuilder
+{
+    MESIFCacheControllerBuilder(const char* name) :
+        ControllerBuilder(name)
+    {}
+
+    Controller* get_new_controller(W8 coreid, W8 type,
+            MemoryHierarchy& mem, const char *name) {
+        CacheController *cont = new CacheController(coreid, name, &mem,
+                (Memory::CacheType)(type));
+
+        MESIFLogic *mesif = new MESIFLogic(cont, cont->get_stats(), &mem);
+
+        cont->set_coherence_logic(mesif);
+
+        bool is_private = false;
+        if (!mem.get_machine().get_option(name, "private", is_private)) {
+            is_private = false;
+        }
+        cont->set_private(is_private);
+
+        bool is_lowest_private = false;
+        if (!mem.get_machine().get_option(name, "last_private",
+                    is_lowest_private)) {
+            is_lowest_private = false;
+        }
+        cont->set_lowest_private(is_lowest_private);
+
+        return cont;
+    }
+};
+
+MESIFCacheControllerBuilder mesifCacheBuilder("mesif_cache");
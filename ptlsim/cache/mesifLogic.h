@@ -0,0 +1,125 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MESIF_COHERENCE_LOGIC_H
+#define MESIF_COHERENCE_LOGIC_H
+
+#include <coherenceLogic.h>
+
+#define UPDATE_MESIF_TRANS_STATS(old_state, new_state, mode) \
+    if(mode) { /* kernel mode */ \
+        state_transition(kernel_stats)[(old_state * NO_MESIF_STATES) + new_state]++; \
+    } else { \
+        state_transition(user_stats)[(old_state * NO_MESIF_STATES) + new_state]++; \
+    }
+
+namespace Memory {
+
+namespace CoherentCache {
+
+    /*
+     * MESIF adds a Forward state to MESI: of all caches sharing a clean
+     * line only the one in Forward answers snoops with data, Shared
+     * copies answer without it. The last cache to read a shared line
+     * becomes the forwarder. If the forwarder drops its line, data
+     * of the next miss comes from the lower level.
+     */
+    enum MESIFCacheLineState {
+        MESIF_INVALID = 0, // 0 has to be invalid as its default
+        MESIF_MODIFIED,
+        MESIF_EXCLUSIVE,
+        MESIF_SHARED,
+        MESIF_FORWARD,
+        NO_MESIF_STATES
+    };
+
+    static const char* MESIFStateNames[NO_MESIF_STATES] = {
+        "Invalid",
+        "Modified",
+        "Exclusive",
+        "Shared",
+        "Forward",
+    };
+
+    class MESIFLogic : public CoherenceLogic
+    {
+        public:
+            MESIFLogic(CacheController *cont, Statable *parent,
+                    MemoryHierarchy *mem_hierarchy)
+                : CoherenceLogic("mesif", cont, parent, mem_hierarchy)
+                  , miss_state("miss_state", this)
+                  , hit_state("hit_state", this)
+                  , state_transition("state_transition", this)
+                  , traffic("traffic", this)
+            {}
+
+            void handle_local_hit(CacheQueueEntry *queueEntry);
+            void handle_local_miss(CacheQueueEntry *queueEntry);
+            void handle_interconn_hit(CacheQueueEntry *queueEntry);
+            void handle_interconn_miss(CacheQueueEntry *queueEntry);
+            void handle_cache_insert(CacheQueueEntry *queueEntry, W64 oldTag);
+            void handle_cache_evict(CacheQueueEntry *entry);
+            void complete_request(CacheQueueEntry *queueEntry,
+                    Message &message);
+            void handle_response(CacheQueueEntry *entry,
+                    Message &message);
+            bool is_line_valid(CacheLine *line);
+            void invalidate_line(CacheLine *line);
+            void warm_line(CacheLine *line);
+            void dump_configuration(YAML::Emitter &out) const;
+
+            MESIFCacheLineState get_new_state(CacheQueueEntry *queueEntry,
+                    bool isShared);
+            void send_messages(CacheQueueEntry *queueEntry, W16 actions);
+
+            /* Statistics */
+
+            struct miss_state : public Statable {
+                StatArray<W64, NO_MESIF_STATES> cpu;
+                miss_state(const char *name, Statable *parent)
+                    : Statable(name, parent)
+                      , cpu("cpu", this, MESIFStateNames)
+                {}
+            } miss_state;
+
+            struct hit_state : public Statable {
+                StatArray<W64, NO_MESIF_STATES> snoop;
+                StatArray<W64, NO_MESIF_STATES> cpu;
+                hit_state(const char *name, Statable *parent)
+                    : Statable(name, parent)
+                      , snoop("snoop", this, MESIFStateNames)
+                      , cpu("cpu", this, MESIFStateNames)
+                {}
+            } hit_state;
+
+            StatArray<W64, NO_MESIF_STATES * NO_MESIF_STATES> state_transition;
+            CoherenceTraffic traffic;
+    };
+};
+
+};
+
+#endif
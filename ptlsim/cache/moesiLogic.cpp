@@ -53,7 +53,8 @@ void MOESILogic::handle_local_hit(CacheQueueEntry *queueEntry)
 		/* If we receive update from upper cache and local cache line state
 		 * is not MODIFIED, then send the response down because cache update
 		 * must have been initiated from this level, or lower level cache. */
-		queueEntry->dest = controller->get_lower_cont();
+		queueEntry->dest = controller->get_lower_cont(
+                queueEntry->request->get_physical_address());
 		queueEntry->sendTo = controller->get_lower_intrconn();
 		queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
 		controller->wait_interconnect_cb(queueEntry);
@@ -118,7 +119,8 @@ void MOESILogic::handle_local_miss(CacheQueueEntry *queueEntry)
             queueEntry->request->get_type() != MEMORY_OP_UPDATE) {
         queueEntry->dest = controller->get_directory();
     } else {
-        queueEntry->dest = controller->get_lower_cont();
+        queueEntry->dest = controller->get_lower_cont(
+                queueEntry->request->get_physical_address());
     }
 
     queueEntry->eventFlags[CACHE_WAIT_INTERCONNECT_EVENT]++;
@@ -126,130 +128,218 @@ void MOESILogic::handle_local_miss(CacheQueueEntry *queueEntry)
     controller->wait_interconnect_cb(queueEntry);
 }
 
+/*
+ * Snoop hit transitions, [lowest private][line state][request type]
+ *
+ * Levels above the lowest private one only follow evicts and updates
+ * sent to them. Updates of Modified and Owner lines at the lowest
+ * private level depend on the directory that sent them and are handled
+ * in update_owned_line().
+ */
+static const CoherenceTransition MOESISnoopTable[2][NUM_MOESI_STATES][NUM_MEMORY_OP] = {
+    { /* Not lowest private */
+        /* Invalid */
+        {COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MOESI_INVALID, COH_DONE)},
+        /* Modified */
+        {COH_T(MOESI_OWNER,   COH_SHARED),
+         COH_T(MOESI_INVALID, COH_NONE),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MOESI_INVALID, COH_DONE)},
+        /* Owner */
+        {COH_T(MOESI_OWNER,   COH_SHARED),
+         COH_T(MOESI_INVALID, COH_NONE),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MOESI_INVALID, COH_DONE)},
+        /* Exclusive */
+        {COH_T(MOESI_SHARED,  COH_SHARED),
+         COH_T(MOESI_INVALID, COH_NONE),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MOESI_INVALID, COH_DONE)},
+        /* Shared */
+        {COH_T(MOESI_SHARED,  COH_SHARED),
+         COH_T(MOESI_INVALID, COH_NONE),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_DONE),
+         COH_T(MOESI_INVALID, COH_DONE)},
+    },
+    { /* Lowest private */
+        /* Invalid */
+        {COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_NO_DATA | COH_EVICT_DIR)},
+        /* Modified */
+        {COH_T(MOESI_OWNER,   COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MOESI_INVALID, COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_ERROR),
+         COH_T(MOESI_INVALID, COH_EVICT)},
+        /* Owner */
+        {COH_T(MOESI_OWNER,   COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MOESI_INVALID, COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_ERROR),
+         COH_T(MOESI_INVALID, COH_EVICT)},
+        /* Exclusive */
+        {COH_T(MOESI_SHARED,  COH_SHARED | COH_UPDATE_UPPER),
+         COH_T(MOESI_INVALID, COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_CLEAR),
+         COH_T(MOESI_INVALID, COH_EVICT)},
+        /* Shared */
+        {COH_T(MOESI_SHARED,  COH_SHARED),
+         COH_T(MOESI_INVALID, COH_EVICT_DIR),
+         COH_T(MOESI_INVALID, COH_STATE_FROM_ARG | COH_CLEAR),
+         COH_T(MOESI_INVALID, COH_EVICT)},
+    },
+};
+
+/*
+ * Fill transitions of the lowest private level, [shared][line state]
+ * [request type]. Valid lines are only refilled on writes.
+ */
+static const CoherenceTransition MOESIFillTable[2][NUM_MOESI_STATES][NUM_MEMORY_OP] = {
+    { /* Not shared */
+        {COH_T(MOESI_EXCLUSIVE, COH_NONE),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_NONE)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+    },
+    { /* Shared */
+        {COH_T(MOESI_SHARED,    COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+        {COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_MODIFIED,  COH_NONE),
+         COH_T(MOESI_INVALID,   COH_ERROR),
+         COH_T(MOESI_INVALID,   COH_ERROR)},
+    },
+};
+
+void MOESILogic::send_messages(CacheQueueEntry *queueEntry, W16 actions)
+{
+    if (actions & COH_EVICT_DIR)
+        send_evict(queueEntry, -1, 1);
+    if (actions & COH_EVICT)
+        send_evict(queueEntry);
+    if (actions & COH_UPDATE_UPPER) {
+        controller->send_update_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.upper_updates, ++,
+                queueEntry->request->is_kernel());
+    }
+}
+
+void MOESILogic::update_owned_line(CacheQueueEntry *queueEntry)
+{
+    MOESICacheLineState *state = (MOESICacheLineState*)(&queueEntry->line->state);
+
+    /* In case of multiple directory controllers we check if message
+     * argument is not set to this controller then we need to update
+     * lower level cache.  */
+    if (queueEntry->sender == controller->get_lower_intrconn()) {
+        if (queueEntry->m_arg == this) {
+            *state = MOESI_OWNER;
+        } else {
+            *state = MOESI_SHARED;
+        }
+        controller->send_update_to_upper(queueEntry);
+        N_STAT_UPDATE(traffic.upper_updates, ++,
+                queueEntry->request->is_kernel());
+    }
+}
+
 void MOESILogic::handle_interconn_hit(CacheQueueEntry *queueEntry)
 {
     MOESICacheLineState *state = (MOESICacheLineState*)(&queueEntry->line->state);
     MOESICacheLineState oldState = *state;
     OP_TYPE type = queueEntry->request->get_type();
     bool k_req = queueEntry->request->is_kernel();
-
-    // By default we mark the queueEntry's shared flat to false
-    queueEntry->isShared     = false;
-    queueEntry->responseData = true;
+    bool lowest = controller->is_lowest_private();
 
     memdebug("MOESI:: Interconn Hit: " << *queueEntry << endl);
 
     assert(type != MEMORY_OP_WRITE);
+    assert(oldState < NUM_MOESI_STATES);
 
-    if (!controller->is_lowest_private() && type == MEMORY_OP_EVICT) {
-        *state = MOESI_INVALID;
-        UPDATE_MOESI_TRANS_STATS(oldState, *state, k_req);
-        controller->clear_entry_cb(queueEntry);
-        return;
-    }
+    const CoherenceTransition &trans = MOESISnoopTable[lowest][oldState][type];
 
-    if (!controller->is_lowest_private() && type == MEMORY_OP_UPDATE) {
-        *state = *(MOESICacheLineState*)(queueEntry->m_arg);
+    if (trans.actions & COH_DONE) {
+        *state = (trans.actions & COH_STATE_FROM_ARG) ?
+            *(MOESICacheLineState*)(queueEntry->m_arg) :
+            (MOESICacheLineState)trans.next;
         UPDATE_MOESI_TRANS_STATS(oldState, *state, k_req);
+        if unlikely (coherence_hotspots_enabled && lowest &&
+                oldState != MOESI_INVALID && *state == MOESI_INVALID)
+            coherence_hotspot_invalidation(queueEntry->request);
         controller->clear_entry_cb(queueEntry);
         return;
     }
 
-    switch (oldState) {
-        case MOESI_INVALID:
-            *state = MOESI_INVALID;
-            queueEntry->line = NULL;
-            queueEntry->responseData = false;
-            send_evict(queueEntry, -1, 1);
-            break;
-
-        case MOESI_MODIFIED:
-        case MOESI_OWNER:
-            if (type == MEMORY_OP_READ) {
-                *state = MOESI_OWNER;
-                queueEntry->isShared = true;
-
-                if (controller->is_lowest_private())
-                    controller->send_update_to_upper(queueEntry);
-            } else if (type == MEMORY_OP_WRITE) {
-                *state = MOESI_INVALID;
+    queueEntry->isShared     = (trans.actions & COH_SHARED);
+    queueEntry->responseData = true;
 
-                if (controller->is_lowest_private())
-                    send_evict(queueEntry, -1, 1);
+    if (lowest && type == MEMORY_OP_UPDATE &&
+            (oldState == MOESI_MODIFIED || oldState == MOESI_OWNER)) {
+        update_owned_line(queueEntry);
+    } else {
+        if (trans.actions & COH_STATE_FROM_ARG)
+            *state = *(MOESICacheLineState*)(queueEntry->m_arg);
+        else
+            *state = (MOESICacheLineState)trans.next;
 
-            } else if (type == MEMORY_OP_UPDATE) {
-                if (controller->is_lowest_private()) {
-                    /* In case of multiple directory controllers we
-                     * check if message argument is not set to this
-                     * controller then we need to update lower level
-                     * cache.  */
-                    if (queueEntry->sender ==
-                            controller->get_lower_intrconn()) {
-                        if (queueEntry->m_arg == this) {
-                            *state = MOESI_OWNER;
-                        } else {
-                            *state = MOESI_SHARED;
-                        }
-                        controller->send_update_to_upper(queueEntry);
-                    }
-                } else {
-                    *state = *(MOESICacheLineState*)(queueEntry->m_arg);
-                }
-            } else if (type == MEMORY_OP_EVICT) {
-                *state = MOESI_INVALID;
-                if (controller->is_lowest_private()) {
-                    send_evict(queueEntry);
-                }
-            }
-            break;
+        if unlikely (coherence_hotspots_enabled && lowest &&
+                oldState != MOESI_INVALID && *state == MOESI_INVALID)
+            coherence_hotspot_invalidation(queueEntry->request);
 
-        case MOESI_EXCLUSIVE:
-            if (type == MEMORY_OP_READ) {
-                /* In this case we dont need to update directory. */
-                *state = MOESI_SHARED;
-                queueEntry->isShared = true;
-                if (controller->is_lowest_private())
-                    controller->send_update_to_upper(queueEntry);
-            } else if (type == MEMORY_OP_WRITE) {
-                *state = MOESI_INVALID;
-                if (controller->is_lowest_private())
-                    send_evict(queueEntry, -1, 1);
-            } else if (type == MEMORY_OP_UPDATE) {
-                *state = *(MOESICacheLineState*)(queueEntry->m_arg);
-                controller->clear_entry_cb(queueEntry);
-            } else if (type == MEMORY_OP_EVICT) {
-                *state = MOESI_INVALID;
-                if (controller->is_lowest_private())
-                    send_evict(queueEntry);
-            }
-            break;
+        if (trans.actions & COH_NO_DATA) {
+            queueEntry->line = NULL;
+            queueEntry->responseData = false;
+        }
 
-        case MOESI_SHARED:
-            if (type == MEMORY_OP_READ) {
-                queueEntry->isShared = true;
-            } else if (type == MEMORY_OP_WRITE) {
-                *state = MOESI_INVALID;
-                if(controller->is_lowest_private())
-                    send_evict(queueEntry, -1, 1);
-            } else if (type == MEMORY_OP_UPDATE) {
-                *state = *(MOESICacheLineState*)(queueEntry->m_arg);
-                controller->clear_entry_cb(queueEntry);
-            } else if (type == MEMORY_OP_EVICT) {
-                *state = MOESI_INVALID;
-                if (controller->is_lowest_private())
-                    send_evict(queueEntry);
-            }
-            break;
+        if (trans.actions & COH_CLEAR)
+            controller->clear_entry_cb(queueEntry);
 
-        default:
-            memdebug("Invalid line state: " << oldState);
-            assert(0);
+        send_messages(queueEntry, trans.actions);
     }
 
     if (oldState != *state) {
         UPDATE_MOESI_TRANS_STATS(oldState, *state, k_req);
     }
 
+    if (queueEntry->responseData) {
+        N_STAT_UPDATE(traffic.data_responses, ++, k_req);
+    } else {
+        N_STAT_UPDATE(traffic.dataless_responses, ++, k_req);
+    }
+
     /* send back the response */
     queueEntry->sendTo = queueEntry->sender;
     queueEntry->dest = queueEntry->source;
@@ -300,6 +390,8 @@ void MOESILogic::handle_cache_insert(CacheQueueEntry *queueEntry,
                 send_evict(queueEntry, oldTag, 1);
 			} else if (oldState == MOESI_MODIFIED) {
 				controller->send_update_to_lower(queueEntry, oldTag);
+				N_STAT_UPDATE(traffic.writebacks, ++,
+						queueEntry->request->is_kernel());
 			}
 		}
     }
@@ -320,50 +412,17 @@ void MOESILogic::complete_request(CacheQueueEntry *queueEntry,
     if (controller->is_lowest_private()) {
         /* We have received our cache request. Based on old state
          * and shared variable find out the new state. */
-        switch (oldState) {
-            case MOESI_INVALID:
-                if (isShared) {
-                    if (type == MEMORY_OP_READ) {
-                        *state = MOESI_SHARED;
-                    } else {
-                        // Other states are not possible
-                        assert(0);
-                    }
-                } else {
-                    switch (type) {
-                        case MEMORY_OP_READ:
-                            *state = MOESI_EXCLUSIVE; break;
-                        case MEMORY_OP_WRITE:
-                            *state = MOESI_MODIFIED; break;
-                        case MEMORY_OP_EVICT:
-                            *state = MOESI_INVALID; break;
-                        default: assert(0);
-                    }
-                }
-                break;
-
-            case MOESI_MODIFIED:
-                memoryHierarchy->get_machine().dump_state(ptl_logfile);
-                assert(0);
-
-            case MOESI_OWNER:
-            case MOESI_EXCLUSIVE:
-            case MOESI_SHARED:
-                /* On read access we dont need to treat it as cache miss
-                 * so this request must be write access.*/
-                if (type == MEMORY_OP_WRITE)
-                    *state = MOESI_MODIFIED;
-                else  {
-                    memoryHierarchy->get_machine().dump_state(ptl_logfile);
-                    assert(0);
-                }
-                break;
+        assert(oldState < NUM_MOESI_STATES);
+        const CoherenceTransition &trans =
+            MOESIFillTable[isShared][oldState][type];
 
-            default:
-                memdebug("Invalid line state: " << oldState);
-                assert(0);
+        if (trans.actions & COH_ERROR) {
+            memoryHierarchy->get_machine().dump_state(ptl_logfile);
+            assert(0);
         }
 
+        *state = (MOESICacheLineState)trans.next;
+
         if (oldState != *state) {
             UPDATE_MOESI_TRANS_STATS(oldState, *state, k_req);
         }
@@ -386,6 +445,12 @@ void MOESILogic::invalidate_line(CacheLine *line)
     line->state = MOESI_INVALID;
 }
 
+/* Warmed lines have no owner to track, so they are all clean shared */
+void MOESILogic::warm_line(CacheLine *line)
+{
+    line->state = MOESI_SHARED;
+}
+
 bool MOESILogic::is_line_valid(CacheLine *line)
 {
     if (line->state == MOESI_INVALID)
@@ -440,7 +505,7 @@ void MOESILogic::send_to_cont(CacheQueueEntry *queueEntry,
         Interconnect *sendTo, Controller *dest)
 {
     queueEntry->dest = dest;
-    queueEntry->request->get_history() << "{MOESI} ";
+    ADD_HISTORY(queueEntry->request, "{MOESI} ");
 
     send_response(queueEntry, sendTo);
 }
@@ -462,6 +527,10 @@ void MOESILogic::send_evict(CacheQueueEntry *queueEntry, W64 oldTag,
 
     /* Last write-back to Lower level cache */
     controller->send_update_to_lower(queueEntry, oldTag);
+
+    bool k_req = queueEntry->request->is_kernel();
+    N_STAT_UPDATE(traffic.invalidations, ++, k_req);
+    N_STAT_UPDATE(traffic.writebacks, ++, k_req);
 }
 
 void MOESILogic::send_update(CacheQueueEntry *queueEntry, W64 oldTag)
@@ -491,6 +560,22 @@ struct MOESICacheControllerBuilder : public ControllerBuilder
             MemoryHierarchy& mem, const char *name) {
         CacheController *cont = new CacheController(coreid, name, &mem, (Memory::CacheType)(type));
 
+        /* Directory tracks sharers at last private level, it can't
+         * see lines that level doesn't hold */
+        if (cont->get_inclusion() != INCLUSION_INCLUSIVE) {
+            ptl_logfile << "ERROR: " << name << " MOESI caches only " <<
+                "support inclusive hierarchies" << endl;
+            assert(0);
+        }
+
+        /* Evicted lines are dropped from the directory, a victim hit
+         * would bring one back without registering it */
+        if (cont->has_victim_cache()) {
+            ptl_logfile << "ERROR: " << name << " MOESI caches don't " <<
+                "support victim_cache" << endl;
+            assert(0);
+        }
+
         MOESILogic *moesi = new MOESILogic(cont, cont->get_stats(), &mem);
 
         cont->set_coherence_logic(moesi);
@@ -83,6 +83,7 @@ namespace CoherentCache {
                   , state_transition("state_trans", this)
                   , miss_state("miss_state", this, MOESIStateNames)
                   , hit_state("hit_state", this, MOESIStateNames)
+                  , traffic("traffic", this)
             {}
 
             void handle_local_hit(CacheQueueEntry *queueEntry);
@@ -97,6 +98,7 @@ namespace CoherentCache {
                     Message &message);
             bool is_line_valid(CacheLine *line);
             void invalidate_line(CacheLine *line);
+            void warm_line(CacheLine *line);
 			void dump_configuration(YAML::Emitter &out) const;
 
             void send_response(CacheQueueEntry *queueEntry,
@@ -106,11 +108,14 @@ namespace CoherentCache {
             void send_evict(CacheQueueEntry *queueEntry, W64 oldTag=-1,
                     bool with_directory=0);
             void send_update(CacheQueueEntry *queueEntry, W64 oldTag=-1);
+            void send_messages(CacheQueueEntry *queueEntry, W16 actions);
+            void update_owned_line(CacheQueueEntry *queueEntry);
 
             /* Statistics */
             StatArray<W64,NUM_MOESI_STATE_TRANS> state_transition;
             StatArray<W64, NUM_MOESI_STATES> miss_state;
             StatArray<W64, NUM_MOESI_STATES> hit_state;
+            CoherenceTraffic traffic;
     };
 
 };
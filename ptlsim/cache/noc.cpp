@@ -0,0 +1,544 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <noc.h>
+
+using namespace Memory;
+using namespace Memory::NetworkOnChip;
+
+NoCInterconnect::NoCInterconnect(const char *name,
+        MemoryHierarchy *memoryHierarchy, NoCTopology topology)
+    : Interconnect(name, memoryHierarchy)
+      , topology_(topology)
+      , routers_(NULL)
+      , routerCount_(0)
+      , columns_(0)
+      , rows_(0)
+      , new_stats(name, &memoryHierarchy->get_machine())
+{
+    memoryHierarchy_->add_interconnect(this);
+
+    SET_SIGNAL_CB(name, "_arrive", arrive_, &NoCInterconnect::arrive_cb);
+    SET_SIGNAL_CB(name, "_eject", eject_, &NoCInterconnect::eject_cb);
+
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    if (!machine.get_option(name, "columns", columns_))
+        columns_ = 0;
+
+    if (!machine.get_option(name, "router_latency", routerLatency_))
+        routerLatency_ = NOC_ROUTER_LATENCY;
+
+    if (!machine.get_option(name, "link_latency", linkLatency_))
+        linkLatency_ = NOC_LINK_LATENCY;
+
+    if (!machine.get_option(name, "virtual_channels", vcs_))
+        vcs_ = NOC_VIRTUAL_CHANNELS;
+
+    if (!machine.get_option(name, "flit_size", flitSize_))
+        flitSize_ = NOC_FLIT_SIZE;
+
+    if (!machine.get_option(name, "inject_queue", injectQueue_))
+        injectQueue_ = NOC_INJECT_QUEUE;
+
+    routerLatency_ = max(routerLatency_, 0);
+    linkLatency_   = max(linkLatency_, 1);
+    vcs_           = max(vcs_, 1);
+    flitSize_      = max(flitSize_, 1);
+    injectQueue_   = max(injectQueue_, 1);
+
+    if (config.bandwidth_timeline)
+        new_stats.link_busy.enable_periodic_dump();
+}
+
+NoCInterconnect::~NoCInterconnect()
+{
+    if (routers_)
+        delete [] routers_;
+
+    foreach (i, nodeStats_.count()) {
+        delete nodeStats_[i];
+    }
+}
+
+void NoCInterconnect::register_controller(Controller *controller)
+{
+    /* Routers are laid out once the first packet is sent */
+    assert(routers_ == NULL);
+
+    controllers_.push(controller);
+    NoCNodeStats *stats = new NoCNodeStats(controller->get_name(),
+            &new_stats);
+    nodeStats_.push(stats);
+
+    /* Each output port is a time-stats column, see LinkStats */
+    if (config.bandwidth_timeline)
+        stats->link_busy.enable_periodic_dump();
+}
+
+/**
+ * @brief Create routers and links for all registered controllers
+ */
+void NoCInterconnect::setup_topology()
+{
+    int nodes = controllers_.count();
+    assert(nodes > 0);
+
+    if (topology_ == NOC_MESH) {
+        if (columns_ <= 0) {
+            columns_ = 1;
+            while (columns_ * columns_ < nodes)
+                columns_++;
+        }
+
+        columns_     = min(columns_, nodes);
+        rows_        = (nodes + columns_ - 1) / columns_;
+        routerCount_ = columns_ * rows_;
+    } else {
+        columns_     = nodes;
+        rows_        = 1;
+        routerCount_ = nodes;
+    }
+
+    routers_ = new Router[routerCount_];
+
+    foreach (i, routerCount_) {
+        Router &router = routers_[i];
+
+        if (i < nodes) {
+            router.controller = controllers_[i];
+            router.stats      = nodeStats_[i];
+        }
+
+        foreach (port, NOC_PORTS) {
+            Link &link      = router.links[port];
+            link.from       = i;
+            link.port       = port;
+            link.to         = get_neighbor(i, port);
+            link.freeVCs[0] = vcs_;
+            link.freeVCs[1] = vcs_;
+        }
+    }
+}
+
+int NoCInterconnect::get_node(Controller *cont) const
+{
+    foreach (i, controllers_.count()) {
+        if (controllers_[i] == cont)
+            return i;
+    }
+
+    assert(0);
+    return -1;
+}
+
+/**
+ * @brief Router on the other end of given port, -1 if none
+ */
+int NoCInterconnect::get_neighbor(int node, int port) const
+{
+    if (topology_ == NOC_RING) {
+        if (port == NOC_EAST)
+            return (node + 1) % routerCount_;
+        if (port == NOC_WEST)
+            return (node + routerCount_ - 1) % routerCount_;
+        return -1;
+    }
+
+    int x = node % columns_;
+    int y = node / columns_;
+
+    switch (port) {
+        case NOC_EAST:  x++; break;
+        case NOC_WEST:  x--; break;
+        case NOC_NORTH: y--; break;
+        case NOC_SOUTH: y++; break;
+        default: assert(0);
+    }
+
+    if (x < 0 || x >= columns_ || y < 0 || y >= rows_)
+        return -1;
+
+    return y * columns_ + x;
+}
+
+/**
+ * @brief Output port to take at 'node' towards 'destNode'
+ *
+ * Mesh routes X first then Y, ring takes the shorter way round.
+ */
+int NoCInterconnect::get_port(int node, int destNode) const
+{
+    assert(node != destNode);
+
+    if (topology_ == NOC_RING) {
+        int forward = (destNode - node + routerCount_) % routerCount_;
+        return (forward <= routerCount_ / 2) ? NOC_EAST : NOC_WEST;
+    }
+
+    int x     = node % columns_;
+    int destX = destNode % columns_;
+
+    if (destX > x)
+        return NOC_EAST;
+    if (destX < x)
+        return NOC_WEST;
+
+    return (destNode / columns_ > node / columns_) ? NOC_SOUTH : NOC_NORTH;
+}
+
+/**
+ * @brief Check if link wraps around the ring
+ */
+bool NoCInterconnect::is_dateline(int node, int port) const
+{
+    if (topology_ != NOC_RING)
+        return false;
+
+    return (port == NOC_EAST && node == routerCount_ - 1) ||
+        (port == NOC_WEST && node == 0);
+}
+
+int NoCInterconnect::access_fast_path(Controller *controller,
+        MemoryRequest *request)
+{
+    return -1;
+}
+
+bool NoCInterconnect::controller_request_cb(void *arg)
+{
+    Message *msg = (Message*)arg;
+
+    if (!routers_)
+        setup_topology();
+
+    int src = get_node((Controller*)msg->sender);
+    Router &router = routers_[src];
+
+    if (router.waitingInject >= injectQueue_)
+        return false;
+
+    Packet *packet = packets_.alloc();
+
+    if (!packet)
+        return false;
+
+    packet->setup(*msg);
+    packet->srcNode     = src;
+    packet->node        = src;
+    packet->destNode    = get_node(packet->dest);
+    packet->inSource    = true;
+    packet->injectCycle = sim_cycle;
+
+    /* One head flit and the cache line if there is one */
+    packet->flits = 1;
+    if (packet->has_data)
+        packet->flits += (NOC_DATA_SIZE + flitSize_ - 1) / flitSize_;
+
+    ADD_HISTORY_ADD(packet->request);
+
+    router.waitingInject++;
+    N_STAT_UPDATE(router.stats->injected, ++,
+            packet->request->is_kernel());
+
+    memdebug("NoC " << get_name() << " injected: " << *packet << endl);
+
+    route(packet);
+
+    return true;
+}
+
+/**
+ * @brief Forward a packet that reached 'packet->node'
+ */
+void NoCInterconnect::route(Packet *packet)
+{
+    if (packet->node == packet->destNode) {
+        if (packet->inSource) {
+            packet->inSource = false;
+            routers_[packet->node].waitingInject--;
+        }
+
+        routers_[packet->node].eject.push(packet);
+        schedule_eject(packet->node);
+        return;
+    }
+
+    int port   = get_port(packet->node, packet->destNode);
+    Link *link = &routers_[packet->node].links[port];
+    assert(link->to >= 0);
+
+    if (is_dateline(packet->node, port))
+        packet->vcClass = 1;
+
+    int vcClass = packet->vcClass;
+
+    if (link->freeVCs[vcClass] == 0 || link->waiting[vcClass].count()) {
+        N_STAT_UPDATE(new_stats.vc_stalls, ++,
+                packet->request->is_kernel());
+    }
+
+    link->waiting[vcClass].push(packet);
+    try_send(link, vcClass);
+}
+
+/**
+ * @brief Move waiting packets over the link while it has free channels
+ */
+void NoCInterconnect::try_send(Link *link, int vcClass)
+{
+    dynarray<Packet*> &waiting = link->waiting[vcClass];
+
+    while (waiting.count() && link->freeVCs[vcClass] > 0) {
+        Packet *packet = waiting[0];
+        waiting.remove(packet);
+
+        if (packet->annuled) {
+            free_packet(packet);
+            continue;
+        }
+
+        link->freeVCs[vcClass]--;
+
+        Link *prev     = packet->link;
+        int prevClass  = packet->linkClass;
+
+        packet->link      = link;
+        packet->linkClass = vcClass;
+
+        if (packet->inSource) {
+            packet->inSource = false;
+            routers_[packet->srcNode].waitingInject--;
+        }
+
+        /* Flits follow the ones already queued on this link */
+        W64 start = max(sim_cycle, link->busyUntil);
+        link->busyUntil = start + packet->flits;
+
+        bool kernel = packet->request->is_kernel();
+        N_STAT_UPDATE(new_stats.hops, ++, kernel);
+        N_STAT_UPDATE(new_stats.link_busy, += packet->flits, kernel);
+
+        Router &router = routers_[link->from];
+        if (router.stats) {
+            N_STAT_UPDATE(router.stats->link_busy, [link->port] +=
+                    packet->flits, kernel);
+        }
+
+        packet->node = link->to;
+
+        int delay = (start - sim_cycle) + routerLatency_ + linkLatency_ +
+            packet->flits - 1;
+        marss_add_event(&arrive_, delay, packet);
+
+        /* Channel on previous link is free once the packet moved on */
+        if (prev) {
+            prev->freeVCs[prevClass]++;
+            try_send(prev, prevClass);
+        }
+    }
+}
+
+bool NoCInterconnect::arrive_cb(void *arg)
+{
+    Packet *packet = (Packet*)arg;
+
+    if (packet->annuled) {
+        free_packet(packet);
+        return true;
+    }
+
+    route(packet);
+
+    return true;
+}
+
+void NoCInterconnect::schedule_eject(int node)
+{
+    Router &router = routers_[node];
+
+    if (router.ejectPending)
+        return;
+
+    router.ejectPending = true;
+    marss_add_event(&eject_, 1, &router);
+}
+
+/**
+ * @brief Deliver the oldest packet at a router to its controller
+ *
+ * One packet is delivered per cycle, a refused packet is retried on next
+ * cycle and blocks the packets behind it.
+ */
+bool NoCInterconnect::eject_cb(void *arg)
+{
+    Router &router = *(Router*)arg;
+    router.ejectPending = false;
+
+    while (router.eject.count() && router.eject[0]->annuled) {
+        Packet *packet = router.eject[0];
+        router.eject.remove(packet);
+        free_packet(packet);
+    }
+
+    if (router.eject.count() == 0)
+        return true;
+
+    Packet *packet = router.eject[0];
+
+    Message *msg = memoryHierarchy_->get_message();
+    msg->sender  = this;
+    packet->fill(*msg);
+
+    bool success = packet->dest->get_interconnect_signal()->emit(msg);
+
+    memoryHierarchy_->free_message(msg);
+
+    memdebug("NoC " << get_name() << " delivering " << *packet <<
+            " success: " << success << endl);
+
+    if (success) {
+        bool kernel = packet->request->is_kernel();
+        N_STAT_UPDATE(new_stats.packets, ++, kernel);
+        N_STAT_UPDATE(new_stats.flits, += packet->flits, kernel);
+        N_STAT_UPDATE(new_stats.latency, += sim_cycle -
+                packet->injectCycle, kernel);
+        N_STAT_UPDATE(router.stats->ejected, ++, kernel);
+
+        router.eject.remove(packet);
+        packet->request->decRefCounter();
+        ADD_HISTORY_REM(packet->request);
+        free_packet(packet);
+    }
+
+    if (router.eject.count())
+        schedule_eject(&router - routers_);
+
+    return true;
+}
+
+/**
+ * @brief Release packet and the channel it holds
+ *
+ * Request's reference is dropped by the caller, or by annul_request.
+ */
+void NoCInterconnect::free_packet(Packet *packet)
+{
+    if (packet->inSource) {
+        packet->inSource = false;
+        routers_[packet->srcNode].waitingInject--;
+    }
+
+    Link *link    = packet->link;
+    int linkClass = packet->linkClass;
+    packet->link  = NULL;
+
+    packets_.free(packet);
+
+    if (link) {
+        link->freeVCs[linkClass]++;
+        try_send(link, linkClass);
+    }
+}
+
+void NoCInterconnect::annul_request(MemoryRequest *request)
+{
+    /* Annuled packets are dropped when they next reach a router or
+     * the head of a queue. */
+    Packet *packet;
+    foreach_list_mutable (packets_.list(), packet, entry, nextentry) {
+        if (!packet->annuled && packet->request == request) {
+            packet->annuled = true;
+            packet->request->decRefCounter();
+            ADD_HISTORY_REM(packet->request);
+        }
+    }
+}
+
+/**
+ * @brief Dump NoC Interconnect Configuration in YAML Format
+ *
+ * @param out YAML Object
+ */
+void NoCInterconnect::dump_configuration(YAML::Emitter &out) const
+{
+	const char *topology = (topology_ == NOC_MESH) ? "mesh" : "ring";
+
+	out << YAML::Key << get_name() << YAML::Value << YAML::BeginMap;
+
+	YAML_KEY_VAL(out, "type", "interconnect");
+	YAML_KEY_VAL(out, "topology", topology);
+	YAML_KEY_VAL(out, "nodes", controllers_.count());
+	if (topology_ == NOC_MESH)
+		YAML_KEY_VAL(out, "columns", columns_);
+	YAML_KEY_VAL(out, "router_latency", routerLatency_);
+	YAML_KEY_VAL(out, "link_latency", linkLatency_);
+	YAML_KEY_VAL(out, "virtual_channels", vcs_);
+	YAML_KEY_VAL(out, "flit_size", flitSize_);
+	YAML_KEY_VAL(out, "inject_queue", injectQueue_);
+
+	out << YAML::EndMap;
+}
+
+void NoCInterconnect::print(ostream& os) const
+{
+    os << "--NoC-Interconnect: " << get_name() << endl;
+
+    foreach (i, routerCount_) {
+        const Router &router = routers_[i];
+        os << "Router " << i << " ";
+        if (router.controller)
+            os << router.controller->get_name() << " ";
+        os << "inject: " << router.waitingInject << " ";
+        os << "eject: " << router.eject.count() << endl;
+
+        foreach (port, NOC_PORTS) {
+            const Link &link = router.links[port];
+            if (link.to < 0)
+                continue;
+            os << "  port " << port << " to " << link.to;
+            os << " free vcs: " << link.freeVCs[0] << "/" << link.freeVCs[1];
+            os << " waiting: " << link.waiting[0].count() << "/" <<
+                link.waiting[1].count() << endl;
+        }
+    }
+
+    os << "Packets:" << endl << packets_ << endl;
+    os << "--End-NoC-Interconnect\n";
+}
+
+void NoCInterconnect::print_map(ostream& os)
+{
+    os << "NoC Interconnect: " << get_name() << endl;
+    os << "\tconnected to: " << endl;
+
+    foreach (i, controllers_.count()) {
+        os << "\t\tcontroller[" << i << "]: ";
+        os << controllers_[i]->get_name() << endl;
+    }
+}
+
+struct NoCBuilder : public InterconnectBuilder
+{
+    NoCTopology topology;
+
+    NoCBuilder(const char *name, NoCTopology topology_) :
+        InterconnectBuilder(name)
+        , topology(topology_)
+    { }
+
+    Interconnect* get_new_interconnect(MemoryHierarchy &mem,
+            const char *name)
+    {
+        return new NoCInterconnect(name, &mem, topology);
+    }
+};
+
+NoCBuilder meshBuilder("mesh", NOC_MESH);
+NoCBuilder ringBuilder("ring", NOC_RING);
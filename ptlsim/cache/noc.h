@@ -0,0 +1,319 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef NOC_H
+#define NOC_H
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <interconnect.h>
+#include <memoryHierarchy.h>
+#include <statsBuilder.h>
+
+#include <machine.h>
+
+#define NOC_ROUTER_LATENCY 1
+#define NOC_LINK_LATENCY 1
+#define NOC_VIRTUAL_CHANNELS 2
+#define NOC_FLIT_SIZE 16
+#define NOC_INJECT_QUEUE 16
+#define NOC_MAX_PACKETS 512
+
+/* Payload of a message that carries a cache line, in bytes */
+#define NOC_DATA_SIZE 64
+
+namespace Memory {
+
+namespace NetworkOnChip {
+
+    enum NoCTopology {
+        NOC_MESH,
+        NOC_RING,
+    };
+
+    /* Output ports of a router, ring only uses east and west */
+    enum {
+        NOC_EAST = 0,
+        NOC_WEST,
+        NOC_NORTH,
+        NOC_SOUTH,
+        NOC_PORTS,
+    };
+
+    struct NoCStats : public Statable
+    {
+        /* Delivered packets and flits */
+        StatObj<W64> packets;
+        StatObj<W64> flits;
+        /* Link traversals of all packets */
+        StatObj<W64> hops;
+        /* Sum of injection to delivery cycles */
+        StatObj<W64> latency;
+        /* Packets that found all virtual channels of a link taken */
+        StatObj<W64> vc_stalls;
+        /* Cycles all links were busy sending flits */
+        StatObj<W64> link_busy;
+
+        NoCStats(const char *name, Statable *parent)
+            : Statable(name, parent)
+              , packets("packets", this)
+              , flits("flits", this)
+              , hops("hops", this)
+              , latency("latency", this)
+              , vc_stalls("vc_stalls", this)
+              , link_busy("link_busy", this)
+        {}
+    };
+
+    /**
+     * @brief Statistics of a router that has a controller attached
+     *
+     * link_busy is indexed by output port, its ratio to simulated
+     * cycles gives the utilization of each link.
+     */
+    struct NoCNodeStats : public Statable
+    {
+        StatObj<W64> injected;
+        StatObj<W64> ejected;
+        StatArray<W64, NOC_PORTS> link_busy;
+
+        NoCNodeStats(const char *name, Statable *parent)
+            : Statable(name, parent)
+              , injected("injected", this)
+              , ejected("ejected", this)
+              , link_busy("link_busy", this)
+        {}
+    };
+
+    struct Packet;
+
+    /**
+     * @brief A unidirectional link to a neighbor router
+     *
+     * A link sends one flit per cycle.  Its virtual channels are split
+     * in two classes, the ring moves packets to second class once they
+     * cross the dateline so the ring can't deadlock.  Packets waiting
+     * for a channel are kept in order per class.
+     */
+    struct Link {
+        int  from;
+        int  port;
+        int  to;
+        W64  busyUntil;
+        int  freeVCs[2];
+        dynarray<Packet*> waiting[2];
+
+        Link() {
+            from      = -1;
+            port      = -1;
+            to        = -1;
+            busyUntil = 0;
+            freeVCs[0] = freeVCs[1] = 0;
+        }
+    };
+
+    struct Packet : public FixStateListObject
+    {
+        MemoryRequest *request;
+        Controller    *source;
+        Controller    *dest;
+        void          *m_arg;
+        bool           has_data;
+        bool           shared;
+        bool           annuled;
+
+        int   srcNode;
+        int   destNode;
+        /* Router the packet is at or is heading to */
+        int   node;
+        int   flits;
+        int   vcClass;
+        /* Still waiting in its source router's injection queue */
+        bool  inSource;
+        /* Link whose virtual channel this packet holds */
+        Link *link;
+        int   linkClass;
+        W64   injectCycle;
+
+        void init() {
+            request     = NULL;
+            source      = NULL;
+            dest        = NULL;
+            m_arg       = NULL;
+            has_data    = 0;
+            shared      = 0;
+            annuled     = 0;
+            srcNode     = -1;
+            destNode    = -1;
+            node        = -1;
+            flits       = 0;
+            vcClass     = 0;
+            inSource    = 0;
+            link        = NULL;
+            linkClass   = 0;
+            injectCycle = 0;
+        }
+
+        void setup(const Message &msg) {
+            source   = (Controller*)msg.sender;
+            dest     = (Controller*)msg.dest;
+            request  = msg.request;
+            m_arg    = msg.arg;
+            has_data = msg.hasData;
+            shared   = msg.isShared;
+            request->incRefCounter();
+        }
+
+        void fill(Message &msg) const {
+            msg.origin   = source;
+            msg.dest     = dest;
+            msg.request  = request;
+            msg.arg      = m_arg;
+            msg.hasData  = has_data;
+            msg.isShared = shared;
+        }
+
+        ostream& print(ostream& os) const {
+            if (!request) {
+                os << "Free packet";
+                return os;
+            }
+
+            os << "request[" << *request << "] ";
+            os << "source[" << source->get_name() << "] ";
+            os << "dest[" << dest->get_name() << "] ";
+            os << "node[" << node << "] ";
+            os << "flits[" << flits << "] ";
+            os << "vc[" << vcClass << "] ";
+            os << "annuled[" << annuled << "]";
+            return os;
+        }
+    };
+
+    static inline ostream& operator <<(ostream& os, const Packet &packet)
+    {
+        return packet.print(os);
+    }
+
+    struct Router {
+        /* NULL for mesh routers that only forward packets */
+        Controller   *controller;
+        NoCNodeStats *stats;
+        int           waitingInject;
+        bool          ejectPending;
+        dynarray<Packet*> eject;
+        Link          links[NOC_PORTS];
+
+        Router() {
+            controller    = NULL;
+            stats         = NULL;
+            waitingInject = 0;
+            ejectPending  = false;
+        }
+    };
+
+    /**
+     * @brief Packet switched 2D mesh or ring interconnect
+     *
+     * Each registered controller gets its own router, in registration
+     * order.  Mesh routers are laid out row by row in 'columns' columns
+     * and packets take X-Y dimension order routes, a partial last row is
+     * filled with routers that only forward.  Ring packets take the
+     * shorter direction.
+     *
+     * A packet moves to the next router once it gets a free virtual
+     * channel on the output link and the link's previous flits are sent.
+     * It holds that channel until it moves on again or is delivered, so
+     * a destination that refuses messages backs up the network.  Every
+     * hop is scheduled with marss_add_event after router and link latency
+     * plus its serialization over the link.
+     *
+     * Options:
+     *   columns          : mesh width, smallest square fit by default
+     *   router_latency   : cycles through a router
+     *   link_latency     : cycles over a link
+     *   virtual_channels : channels per link and class
+     *   flit_size        : link width in bytes, messages carrying a
+     *                      cache line take more flits
+     *   inject_queue     : packets waiting at each router's injection
+     *                      port before the sender is refused
+     */
+    class NoCInterconnect : public Interconnect
+    {
+        private:
+            NoCTopology topology_;
+
+            dynarray<Controller*> controllers_;
+            dynarray<NoCNodeStats*> nodeStats_;
+
+            Router *routers_;
+            int     routerCount_;
+            int     columns_;
+            int     rows_;
+
+            int routerLatency_;
+            int linkLatency_;
+            int vcs_;
+            int flitSize_;
+            int injectQueue_;
+
+            FixStateList<Packet, NOC_MAX_PACKETS> packets_;
+
+            Signal arrive_;
+            Signal eject_;
+
+            NoCStats new_stats;
+
+            void setup_topology();
+            int  get_node(Controller *cont) const;
+            int  get_neighbor(int node, int port) const;
+            int  get_port(int node, int destNode) const;
+            bool is_dateline(int node, int port) const;
+
+            void route(Packet *packet);
+            void try_send(Link *link, int vcClass);
+            void free_packet(Packet *packet);
+            void schedule_eject(int node);
+
+        public:
+            NoCInterconnect(const char *name,
+                    MemoryHierarchy *memoryHierarchy,
+                    NoCTopology topology);
+            ~NoCInterconnect();
+
+            bool controller_request_cb(void *arg);
+            void register_controller(Controller *controller);
+            int  access_fast_path(Controller *controller,
+                    MemoryRequest *request);
+            void annul_request(MemoryRequest *request);
+            int  get_delay() { return routerLatency_ + linkLatency_; }
+            void dump_configuration(YAML::Emitter &out) const;
+
+            bool arrive_cb(void *arg);
+            bool eject_cb(void *arg);
+
+            void print(ostream& os) const;
+            void print_map(ostream& os);
+    };
+
+    static inline ostream& operator <<(ostream& os,
+            const NoCInterconnect &noc)
+    {
+        noc.print(os);
+        return os;
+    }
+};
+
+};
+
+#endif // NOC_H
@@ -0,0 +1,495 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <openPageMemoryController.h>
+#include <memoryHierarchy.h>
+#include <machine.h>
+#include <qos.h>
+
+using namespace Memory;
+using namespace Memory::OpenPageDRAM;
+
+OpenPageMemoryController::OpenPageMemoryController(W8 coreid,
+        const char *name, MemoryHierarchy *memoryHierarchy)
+    : Controller(coreid, name, memoryHierarchy)
+    , cacheInterconnect_(NULL)
+    , nextIssueCycle_((W64)-1)
+    , new_stats(name, &memoryHierarchy->get_machine())
+{
+    memoryHierarchy_->add_cache_mem_controller(this);
+    memoryHierarchy_->add_memory_controller(this);
+    level_ = MAIN_MEMORY;
+
+    /* One of 'insts' controllers that split memory by address bits */
+    slice_.setup_interleave(memoryHierarchy_->get_machine(), name, coreid);
+
+    channels_        = get_int_option(name, "channels", OPEN_PAGE_CHANNELS);
+    banksPerChannel_ = get_int_option(name, "banks", OPEN_PAGE_BANKS);
+    rowSize_         = get_int_option(name, "row_size", OPEN_PAGE_ROW_SIZE);
+
+    if (channels_ <= 0 || banksPerChannel_ <= 0 || rowSize_ < 64 ||
+            (channels_ & (channels_ - 1)) ||
+            (banksPerChannel_ & (banksPerChannel_ - 1)) ||
+            (rowSize_ & (rowSize_ - 1)) ||
+            channels_ * banksPerChannel_ > MEM_BANKS) {
+        ptl_logfile << "[ERROR] Memory controller ", name, ": channels, ",
+                    "banks and row_size must be powers of 2 with at most ",
+                    MEM_BANKS, " banks in total", endl, superstl::flush;
+        cerr << "[ERROR] Memory controller " << name << ": channels, "
+             << "banks and row_size must be powers of 2 with at most "
+             << MEM_BANKS << " banks in total" << endl << std::flush;
+        assert(0);
+    }
+
+    channelBits_ = lsbindex32(channels_);
+    bankBits_    = lsbindex32(banksPerChannel_);
+    columnBits_  = lsbindex32(rowSize_ >> 6);
+
+    config_changed();
+
+    banks_.resize(channels_ * banksPerChannel_);
+    foreach (i, banks_.count()) {
+        banks_[i].openRow    = 0;
+        banks_[i].isOpen     = false;
+        banks_[i].readyCycle = 0;
+    }
+
+    busReadyCycle_.resize(channels_, 0);
+
+    qos_setup_controller(memoryHierarchy_->get_machine(), name);
+
+    SET_SIGNAL_CB(name, "_Issue", issue_,
+            &OpenPageMemoryController::issue_cb);
+
+    SET_SIGNAL_CB(name, "_Access_Completed", accessCompleted_,
+            &OpenPageMemoryController::access_completed_cb);
+
+    SET_SIGNAL_CB(name, "_Wait_Interconnect", waitInterconnect_,
+            &OpenPageMemoryController::wait_interconnect_cb);
+}
+
+int OpenPageMemoryController::get_int_option(const char *name,
+        const char *opt, int defaultValue)
+{
+    int value;
+
+    if (!memoryHierarchy_->get_machine().get_option(name, opt, value))
+        value = defaultValue;
+
+    return value;
+}
+
+/* Timings, re-read for -machine-options overrides */
+void OpenPageMemoryController::config_changed()
+{
+    tRCDns_          = get_int_option(get_name(), "t_rcd", OPEN_PAGE_T_RCD);
+    tRPns_           = get_int_option(get_name(), "t_rp", OPEN_PAGE_T_RP);
+    tCASns_          = get_int_option(get_name(), "t_cas", OPEN_PAGE_T_CAS);
+    tBurstns_        = get_int_option(get_name(), "t_burst", OPEN_PAGE_T_BURST);
+    latencyns_       = get_int_option(get_name(), "latency", OPEN_PAGE_LATENCY);
+
+    /* Convert timings from ns to cycles, a burst takes at least one cycle
+     * so the data bus always moves forward */
+    tRCD_    = ns_to_simcycles(tRCDns_);
+    tRP_     = ns_to_simcycles(tRPns_);
+    tCAS_    = ns_to_simcycles(tCASns_);
+    tBurst_  = max((int)ns_to_simcycles(tBurstns_), 1);
+    latency_ = ns_to_simcycles(latencyns_);
+}
+
+/**
+ * @brief Split the line address into channel, column, bank and row
+ *
+ * From low to high bits: line offset, channel, column, bank, row, of the
+ * address without the bits that select this controller.
+ */
+void OpenPageMemoryController::decode_address(OpenPageQueueEntry *entry)
+{
+    W64 line = slice_.local_address(
+            entry->request->get_physical_address()) >> 6;
+
+    entry->channel = lowbits(line, channelBits_);
+    line >>= channelBits_ + columnBits_;
+    entry->bank = lowbits(line, bankBits_);
+    entry->row = line >> bankBits_;
+}
+
+void OpenPageMemoryController::register_interconnect(
+        Interconnect *interconnect, int type)
+{
+    switch (type) {
+        case INTERCONN_TYPE_UPPER:
+            cacheInterconnect_ = interconnect;
+            break;
+        default:
+            assert(0);
+    }
+}
+
+bool OpenPageMemoryController::handle_interconnect_cb(void *arg)
+{
+    Message *message = (Message*)arg;
+
+    memdebug("Received message in Memory controller: ", get_name(), " ",
+            *message, endl);
+
+    if (message->hasData && message->request->get_type() !=
+            MEMORY_OP_UPDATE)
+        return true;
+
+    if (message->request->get_type() == MEMORY_OP_EVICT) {
+        /* We ignore all the evict messages */
+        return true;
+    }
+
+    /* Merge with a queued update to the same line, same as
+     * simple_dram_cont, unless something else to that line is queued
+     * after it */
+    if (message->request->get_type() == MEMORY_OP_UPDATE) {
+        OpenPageQueueEntry *entry;
+        foreach_list_mutable_backwards(pendingRequests_.list(),
+                entry, entry_t, nextentry_t) {
+            if (entry->request->get_physical_address() ==
+                    message->request->get_physical_address()) {
+                if (!entry->inUse && entry->request->get_type() ==
+                        MEMORY_OP_UPDATE) {
+                    return true;
+                }
+                break;
+            }
+        }
+    }
+
+    OpenPageQueueEntry *queueEntry = pendingRequests_.alloc();
+
+    /* if queue is full return false to indicate failure */
+    if (queueEntry == NULL) {
+        memdebug("Memory queue is full\n");
+        return false;
+    }
+
+    if (pendingRequests_.isFull()) {
+        memoryHierarchy_->set_controller_full(this, true);
+    }
+
+    queueEntry->request = message->request;
+    queueEntry->source = (Controller*)message->origin;
+    queueEntry->arrivalCycle = sim_cycle;
+    decode_address(queueEntry);
+
+    queueEntry->request->incRefCounter();
+    ADD_HISTORY_ADD(queueEntry->request);
+
+    schedule_issue(sim_cycle + 1);
+
+    return true;
+}
+
+/**
+ * @brief Make sure the issue event runs at or before given cycle
+ */
+void OpenPageMemoryController::schedule_issue(W64 cycle)
+{
+    if (cycle >= nextIssueCycle_)
+        return;
+
+    /* An already scheduled later event finds nothing new to do */
+    nextIssueCycle_ = cycle;
+    marss_add_event(&issue_, cycle - sim_cycle, NULL);
+}
+
+/**
+ * @brief FR-FCFS pick among the waiting requests of one channel
+ *
+ * @return Oldest row hit on a ready bank, else oldest request on a ready
+ * bank, NULL if no bank with waiting requests is ready. With -mem-priority
+ * the most urgent requests are picked from first, by the same rules.
+ */
+OpenPageQueueEntry* OpenPageMemoryController::pick_request(int channel)
+{
+    OpenPageQueueEntry *best = NULL;
+    bool bestHit = false;
+    OpenPageQueueEntry *entry;
+
+    foreach_list_mutable(pendingRequests_.list(), entry, entry_t,
+            nextentry_t) {
+        if (entry->inUse || entry->channel != channel)
+            continue;
+
+        BankState &bank = get_bank(entry);
+        if (bank.readyCycle > sim_cycle)
+            continue;
+
+        bool hit = bank.isOpen && bank.openRow == entry->row;
+        if (hit && !priority_scheduling)
+            return entry;
+
+        if (!best || more_urgent(entry->request, best->request) ||
+                (hit && !bestHit &&
+                 !more_urgent(best->request, entry->request))) {
+            best = entry;
+            bestHit = hit;
+        }
+    }
+
+    return best;
+}
+
+void OpenPageMemoryController::issue_request(OpenPageQueueEntry *entry)
+{
+    BankState &bank = get_bank(entry);
+    bool kernel = entry->request->is_kernel();
+    W64 column;
+
+    if (bank.isOpen && bank.openRow == entry->row) {
+        column = sim_cycle;
+        N_STAT_UPDATE(new_stats.row_hit, ++, kernel);
+    } else if (!bank.isOpen) {
+        column = sim_cycle + tRCD_;
+        N_STAT_UPDATE(new_stats.row_miss, ++, kernel);
+    } else {
+        column = sim_cycle + tRP_ + tRCD_;
+        N_STAT_UPDATE(new_stats.row_conflict, ++, kernel);
+    }
+
+    /* Open page policy: row stays open for the next access */
+    bank.isOpen = true;
+    bank.openRow = entry->row;
+    bank.readyCycle = column + tBurst_;
+
+    W64 &busReady = busReadyCycle_[entry->channel];
+    W64 dataStart = max(column + tCAS_, busReady);
+    busReady = dataStart + tBurst_;
+
+    int bank_no = entry->channel * banksPerChannel_ + entry->bank;
+    N_STAT_UPDATE(new_stats.bank_access, [bank_no]++, kernel);
+    N_STAT_UPDATE(new_stats.bank_busy_cycles, [bank_no] +=
+            bank.readyCycle - sim_cycle, kernel);
+    N_STAT_UPDATE(new_stats.channel_busy_cycles, [entry->channel] +=
+            tBurst_, kernel);
+    N_STAT_UPDATE(new_stats.queue_cycles, += sim_cycle -
+            entry->arrivalCycle, kernel);
+
+    entry->inUse = true;
+    marss_add_event(&accessCompleted_, busReady + latency_ - sim_cycle,
+            entry);
+
+    memdebug("Memory issued ", *entry, " done in ",
+            busReady + latency_ - sim_cycle, endl);
+}
+
+/**
+ * @brief Issue at most one request per channel and plan the next issue
+ */
+bool OpenPageMemoryController::issue_cb(void *arg)
+{
+    if (nextIssueCycle_ == sim_cycle)
+        nextIssueCycle_ = (W64)-1;
+
+    foreach (channel, channels_) {
+        OpenPageQueueEntry *entry = pick_request(channel);
+        if (entry)
+            issue_request(entry);
+    }
+
+    /* Wake up again when the first bank with waiting requests is ready */
+    W64 next = (W64)-1;
+    OpenPageQueueEntry *entry;
+
+    foreach_list_mutable(pendingRequests_.list(), entry, entry_t,
+            nextentry_t) {
+        if (entry->inUse)
+            continue;
+
+        next = min(next, max(get_bank(entry).readyCycle, sim_cycle + 1));
+    }
+
+    if (next != (W64)-1)
+        schedule_issue(next);
+
+    return true;
+}
+
+void OpenPageMemoryController::free_entry(OpenPageQueueEntry *entry)
+{
+    entry->request->decRefCounter();
+    ADD_HISTORY_REM(entry->request);
+    pendingRequests_.free(entry);
+
+    if (!pendingRequests_.isFull()) {
+        memoryHierarchy_->set_controller_full(this, false);
+    }
+}
+
+bool OpenPageMemoryController::access_completed_cb(void *arg)
+{
+    OpenPageQueueEntry *queueEntry = (OpenPageQueueEntry*)arg;
+    bool kernel = queueEntry->request->is_kernel();
+
+    switch (queueEntry->request->get_type()) {
+        case MEMORY_OP_READ:
+            N_STAT_UPDATE(new_stats.read, ++, kernel);
+            break;
+        case MEMORY_OP_WRITE:
+            N_STAT_UPDATE(new_stats.write, ++, kernel);
+            break;
+        case MEMORY_OP_UPDATE:
+            N_STAT_UPDATE(new_stats.update, ++, kernel);
+            break;
+        default:
+            assert(0);
+    }
+
+    new_stats.priority.record(queueEntry->request->get_priority(),
+            sim_cycle - queueEntry->arrivalCycle, kernel);
+
+    if (!queueEntry->annuled) {
+        memdebug("Memory access done for Request: ", *queueEntry->request,
+                endl);
+
+        /* Responses wait for the bandwidth of their core's class, DMA
+         * of IO agents is not a core's */
+        int delay = qos.memory_access(queueEntry->request->get_coreid(),
+                sim_cycle, queueEntry->request->get_type() !=
+                MEMORY_OP_UPDATE && !queueEntry->request->is_io());
+        if (delay)
+            marss_add_event(&waitInterconnect_, delay, queueEntry);
+        else
+            wait_interconnect_cb(queueEntry);
+    } else {
+        free_entry(queueEntry);
+    }
+
+    return true;
+}
+
+bool OpenPageMemoryController::wait_interconnect_cb(void *arg)
+{
+    OpenPageQueueEntry *queueEntry = (OpenPageQueueEntry*)arg;
+
+    /* Don't send response if its a memory update request */
+    if (queueEntry->request->get_type() == MEMORY_OP_UPDATE) {
+        free_entry(queueEntry);
+        return true;
+    }
+
+    Message& message = *memoryHierarchy_->get_message();
+    message.sender = this;
+    message.dest = queueEntry->source;
+    message.request = queueEntry->request;
+    message.hasData = true;
+
+    memdebug("Memory sending message: ", message);
+    bool success = cacheInterconnect_->get_controller_request_signal()->
+        emit(&message);
+    memoryHierarchy_->free_message(&message);
+
+    if (!success) {
+        /* Failed to response to cache, retry after 1 cycle */
+        marss_add_event(&waitInterconnect_, 1, queueEntry);
+    } else {
+        free_entry(queueEntry);
+    }
+
+    return true;
+}
+
+void OpenPageMemoryController::annul_request(MemoryRequest *request)
+{
+    OpenPageQueueEntry *queueEntry;
+    foreach_list_mutable(pendingRequests_.list(), queueEntry,
+            entry, nextentry) {
+        if (queueEntry->request == request) {
+            queueEntry->annuled = true;
+            if (!queueEntry->inUse) {
+                free_entry(queueEntry);
+            }
+        }
+    }
+}
+
+int OpenPageMemoryController::get_no_pending_request(W8 coreid)
+{
+    int count = 0;
+    OpenPageQueueEntry *queueEntry;
+    foreach_list_mutable(pendingRequests_.list(), queueEntry,
+            entry, nextentry) {
+        if (queueEntry->request->get_coreid() == coreid)
+            count++;
+    }
+    return count;
+}
+
+void OpenPageMemoryController::print(ostream& os) const
+{
+    os << "---Open-Page-Memory-Controller: ", get_name(), endl;
+    if (pendingRequests_.count() > 0)
+        os << "Queue : ", pendingRequests_, endl;
+    foreach (i, banks_.count()) {
+        if (banks_[i].isOpen)
+            os << "bank ", i, " open row ", banks_[i].openRow, " ready at ",
+               banks_[i].readyCycle, endl;
+    }
+    os << "---End Open-Page-Memory-Controller: ", get_name(), endl;
+}
+
+/**
+ * @brief Dump Open Page Memory Controller in YAML Format
+ *
+ * @param out YAML Object
+ */
+void OpenPageMemoryController::dump_configuration(YAML::Emitter &out) const
+{
+    out << YAML::Key << get_name() << YAML::Value << YAML::BeginMap;
+
+    YAML_KEY_VAL(out, "type", "dram_cont");
+    YAML_KEY_VAL(out, "model", "open_page");
+    YAML_KEY_VAL(out, "RAM_size", ram_size); /* ram_size is from QEMU */
+    YAML_KEY_VAL(out, "channels", channels_);
+    YAML_KEY_VAL(out, "banks", banksPerChannel_);
+    YAML_KEY_VAL(out, "row_size", rowSize_);
+    YAML_KEY_VAL(out, "t_rcd_ns", tRCDns_);
+    YAML_KEY_VAL(out, "t_rp_ns", tRPns_);
+    YAML_KEY_VAL(out, "t_cas_ns", tCASns_);
+    YAML_KEY_VAL(out, "t_burst_ns", tBurstns_);
+    YAML_KEY_VAL(out, "latency", latency_);
+    YAML_KEY_VAL(out, "latency_ns", latencyns_);
+    YAML_KEY_VAL(out, "pending_queue_size", pendingRequests_.size());
+    if (slice_.is_sliced())
+        slice_.dump_configuration(out);
+
+    out << YAML::EndMap;
+}
+
+/**
+ * @brief Open Page Memory Controller Builder
+ *
+ * Exports the controller as 'open_page_dram_cont' for machine
+ * configuration files.
+ */
+struct OpenPageMemoryControllerBuilder : public ControllerBuilder
+{
+    OpenPageMemoryControllerBuilder(const char* name) :
+        ControllerBuilder(name)
+    {}
+
+    Controller* get_new_controller(W8 coreid, W8 type,
+            MemoryHierarchy& mem, const char *name) {
+        return new OpenPageMemoryController(coreid, name, &mem);
+    }
+};
+
+OpenPageMemoryControllerBuilder openPageMemControllerBuilder(
+        "open_page_dram_cont");
@@ -0,0 +1,216 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef OPEN_PAGE_MEMORY_CONTROLLER_H
+#define OPEN_PAGE_MEMORY_CONTROLLER_H
+
+#include <controller.h>
+#include <interconnect.h>
+#include <superstl.h>
+#include <memoryStats.h>
+
+namespace Memory {
+
+namespace OpenPageDRAM {
+
+    /* Defaults loosely follow a DDR3-1600 11-11-11 part, all in ns */
+    const int OPEN_PAGE_CHANNELS = 2;
+    const int OPEN_PAGE_BANKS = 8;
+    const int OPEN_PAGE_ROW_SIZE = 8192;
+    const int OPEN_PAGE_T_RCD = 14;
+    const int OPEN_PAGE_T_RP = 14;
+    const int OPEN_PAGE_T_CAS = 14;
+    const int OPEN_PAGE_T_BURST = 5;
+    const int OPEN_PAGE_LATENCY = 10;
+
+    struct OpenPageRAMStats : public Statable
+    {
+        StatObj<W64> row_hit;
+        StatObj<W64> row_miss;
+        StatObj<W64> row_conflict;
+        StatObj<W64> read;
+        StatObj<W64> write;
+        StatObj<W64> update;
+        StatObj<W64> queue_cycles;
+        StatArray<W64, MEM_BANKS> bank_access;
+        /* Cycles from a command until the bank takes the next one */
+        StatArray<W64, MEM_BANKS> bank_busy_cycles;
+        /* Data bus cycles of each channel, the first 'channels' used */
+        StatArray<W64, MEM_BANKS> channel_busy_cycles;
+        PriorityLatencyStats priority;
+
+        OpenPageRAMStats(const char* name, Statable *parent)
+            : Statable(name, parent)
+              , row_hit("row_hit", this)
+              , row_miss("row_miss", this)
+              , row_conflict("row_conflict", this)
+              , read("read", this)
+              , write("write", this)
+              , update("update", this)
+              , queue_cycles("queue_cycles", this)
+              , bank_access("bank_access", this)
+              , bank_busy_cycles("bank_busy_cycles", this)
+              , channel_busy_cycles("channel_busy_cycles", this)
+              , priority("priority", this)
+        {
+            /* Time-stats columns, see LinkStats */
+            if (config.bandwidth_timeline) {
+                bank_busy_cycles.enable_periodic_dump();
+                channel_busy_cycles.enable_periodic_dump();
+            }
+        }
+    };
+
+    /**
+     * @brief State of one DRAM bank
+     */
+    struct BankState {
+        W64  openRow;
+        bool isOpen;
+
+        /* First cycle bank can take a new column command */
+        W64  readyCycle;
+    };
+
+    struct OpenPageQueueEntry : public FixStateListObject
+    {
+        MemoryRequest *request;
+        Controller    *source;
+        W64            arrivalCycle;
+        W64            row;
+        int            channel;
+        int            bank;
+        bool           annuled;
+        bool           inUse;
+
+        void init() {
+            request      = NULL;
+            source       = NULL;
+            arrivalCycle = 0;
+            row          = 0;
+            channel      = 0;
+            bank         = 0;
+            annuled      = false;
+            inUse        = false;
+        }
+
+        ostream& print(ostream &os) const {
+            if (request)
+                os << "Request{", *request, "} ";
+            if (source)
+                os << "source[", source->get_name(), "] ";
+            os << "channel[", channel, "] bank[", bank, "] row[", row, "] ";
+            os << "annuled[", annuled, "] ";
+            os << "inUse[", inUse, "] ";
+            os << endl;
+            return os;
+        }
+    };
+
+    static inline ostream& operator <<(ostream& os, const OpenPageQueueEntry
+            &entry) {
+        return entry.print(os);
+    }
+
+    /**
+     * @brief Analytical DRAM model with per bank row buffer state
+     *
+     * Sits between 'simple_dram_cont', which charges a fixed latency to
+     * every access, and DRAMSim2.  Each channel has its own data bus and
+     * a set of banks that keep their last row open.  Requests are
+     * scheduled FR-FCFS per channel: the oldest request that hits an open
+     * row goes first, otherwise the oldest one whose bank is ready.  An
+     * access then costs tCAS on a row hit, tRCD + tCAS on a closed bank and
+     * tRP + tRCD + tCAS on a row conflict, plus its tBurst slot on the
+     * channel's data bus and a fixed controller 'latency'.
+     *
+     * Lines are interleaved across channels and then fill a row, so
+     * streaming accesses mostly hit an open row.  No refresh or power-down
+     * is modelled.
+     */
+    class OpenPageMemoryController : public Controller
+    {
+        private:
+            Interconnect *cacheInterconnect_;
+
+            FixStateList<OpenPageQueueEntry, MEM_REQ_NUM> pendingRequests_;
+
+            Signal issue_;
+            Signal accessCompleted_;
+            Signal waitInterconnect_;
+
+            int channels_;
+            int banksPerChannel_;
+            int rowSize_;
+            int channelBits_;
+            int bankBits_;
+            int columnBits_;
+
+            /* Timings in ns as configured, and in simulation cycles */
+            int tRCDns_, tRPns_, tCASns_, tBurstns_, latencyns_;
+            int tRCD_, tRP_, tCAS_, tBurst_, latency_;
+
+            dynarray<BankState> banks_;
+            dynarray<W64> busReadyCycle_;
+
+            /* Cycle of the scheduled issue event, -1 if none */
+            W64 nextIssueCycle_;
+
+            OpenPageRAMStats new_stats;
+
+            int get_int_option(const char *name, const char *opt,
+                    int defaultValue);
+            void decode_address(OpenPageQueueEntry *entry);
+            BankState& get_bank(OpenPageQueueEntry *entry) {
+                return banks_[entry->channel * banksPerChannel_ +
+                    entry->bank];
+            }
+
+            void schedule_issue(W64 cycle);
+            OpenPageQueueEntry* pick_request(int channel);
+            void issue_request(OpenPageQueueEntry *entry);
+            void free_entry(OpenPageQueueEntry *entry);
+
+        public:
+            OpenPageMemoryController(W8 coreid, const char *name,
+                    MemoryHierarchy *memoryHierarchy);
+
+            bool handle_interconnect_cb(void *arg);
+            void register_interconnect(Interconnect *interconnect,
+                    int type);
+
+            bool issue_cb(void *arg);
+            bool access_completed_cb(void *arg);
+            bool wait_interconnect_cb(void *arg);
+
+            void annul_request(MemoryRequest *request);
+            void dump_configuration(YAML::Emitter &out) const;
+            void config_changed();
+            int get_no_pending_request(W8 coreid);
+
+            bool is_full(bool fromInterconnect = false,
+                    MemoryRequest *request = NULL) const {
+                return pendingRequests_.isFull();
+            }
+
+            void print(ostream& os) const;
+
+            void print_map(ostream& os)
+            {
+                os << "Open Page Memory Controller: ", get_name(), endl;
+                os << "\tconnected to:", endl;
+                os << "\t\tinterconnect: ", cacheInterconnect_->get_name(),
+                   endl;
+            }
+    };
+};
+
+};
+
+#endif // OPEN_PAGE_MEMORY_CONTROLLER_H
@@ -48,6 +48,8 @@ using namespace Memory;
 P2PInterconnect::P2PInterconnect(const char *name,
 		MemoryHierarchy *memoryHierarchy) :
 	Interconnect(name, memoryHierarchy)
+	, new_stats(name, &memoryHierarchy->get_machine())
+	, lastTransferCycle_(W64(-1))
 {
 	controllers_[0] = NULL;
 	controllers_[1] = NULL;
@@ -105,6 +107,12 @@ bool P2PInterconnect::controller_request_cb(void *arg)
 	bool ret_val;
 	ret_val = receiver->get_interconnect_signal()->emit((void *)&message);
 
+	if(ret_val) {
+		new_stats.record(lastTransferCycle_ != sim_cycle,
+				msg->request->is_kernel());
+		lastTransferCycle_ = sim_cycle;
+	}
+
     /* Free the message */
 	memoryHierarchy_->free_message(&message);
 
@@ -118,13 +126,42 @@ bool P2PInterconnect::controller_request_cb(void *arg)
  * @param controller Sender
  * @param request Memory Request
  *
- * @return Access cycle delay for fast path access
+ * @return Access delay of the fast path in simulation cycles
  */
 int P2PInterconnect::access_fast_path(Controller *controller,
 		MemoryRequest *request)
 {
 	Controller *receiver = get_other_controller(controller);
-	return receiver->access_fast_path(this, request);
+
+	/* Hit latency is in the receiver's cycles */
+	return receiver->to_sim_cycles(receiver->access_fast_path(this,
+				request));
+}
+
+/**
+ * @brief Serve a read of the other controller at once, see
+ * Controller::fill_fast_path
+ *
+ * @param controller Sender of the read
+ * @param request Memory Request
+ * @param serve False to only get the latency
+ * @param arg Set to the response message's arg
+ *
+ * @return Latency in simulation cycles, or -1 to send the read
+ */
+int P2PInterconnect::fill_fast_path(Controller *controller,
+		MemoryRequest *request, bool serve, void **arg)
+{
+	Controller *receiver = get_other_controller(controller);
+	int latency = receiver->fill_fast_path(this, request, serve, arg);
+
+	/* The read and its response would cross later, a cycle each */
+	if(serve && latency >= 0) {
+		new_stats.record(1, request->is_kernel());
+		new_stats.record(1, request->is_kernel());
+	}
+
+	return latency;
 }
 
 /**
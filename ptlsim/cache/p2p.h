@@ -45,6 +45,10 @@ class P2PInterconnect : public Interconnect
 	private:
 		Controller *controllers_[2];
 
+		/* Zero latency, a cycle with any transfer is one busy cycle */
+		LinkStats new_stats;
+		W64 lastTransferCycle_;
+
 		bool send_request(Controller *sender, MemoryRequest *request,
 				bool hasData);
 
@@ -72,6 +76,8 @@ class P2PInterconnect : public Interconnect
 		void register_controller(Controller *controller);
 		int access_fast_path(Controller *controller,
 				MemoryRequest *request);
+		int fill_fast_path(Controller *controller,
+				MemoryRequest *request, bool serve, void **arg);
 		void print_map(ostream& os);
 
 		void print(ostream& os) const {
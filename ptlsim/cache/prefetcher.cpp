@@ -0,0 +1,296 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <prefetcher.h>
+#include <machine.h>
+
+using namespace Memory;
+
+/* Prefetches never cross a page of this size */
+static const int PREFETCH_PAGE_BITS = 12;
+
+Prefetcher::Prefetcher(const char *name, BaseMachine &machine,
+        int lineBits, int defaultTableSize)
+    : lineBits_(lineBits)
+{
+    name_ << name;
+
+    if (!machine.get_option(name, "prefetch_degree", degree_))
+        degree_ = 2;
+
+    if (!machine.get_option(name, "prefetch_distance", distance_))
+        distance_ = 1;
+
+    if (!machine.get_option(name, "prefetch_table_size", tableSize_))
+        tableSize_ = defaultTableSize;
+
+    degree_ = max(degree_, 1);
+    distance_ = max(distance_, 1);
+    tableSize_ = max(tableSize_, 1);
+}
+
+void Prefetcher::train(MemoryRequest *request, bool miss, bool prefetchHit,
+        dynarray<W64> &lines)
+{
+    W64 line = request->get_physical_address() >> lineBits_;
+    int count = lines.count();
+
+    access(line, request, miss, prefetchHit, lines);
+
+    /* Drop targets outside the page of this access */
+    int pageShift = max(PREFETCH_PAGE_BITS - lineBits_, 0);
+    int kept = count;
+
+    for (int i = count; i < lines.count(); i++) {
+        if ((lines[i] >> pageShift) == (line >> pageShift))
+            lines[kept++] = lines[i];
+    }
+
+    lines.resize(kept);
+}
+
+void Prefetcher::dump_configuration(YAML::Emitter &out) const
+{
+    out << YAML::Key << "prefetcher" << YAML::Value << YAML::BeginMap;
+
+    YAML_KEY_VAL(out, "type", get_type());
+    YAML_KEY_VAL(out, "degree", degree_);
+    YAML_KEY_VAL(out, "distance", distance_);
+    YAML_KEY_VAL(out, "table_size", tableSize_);
+
+    out << YAML::EndMap;
+}
+
+PrefetcherBuilder::PrefetcherBuilder(const char *name)
+{
+    if (!prefetcherBuilders) {
+        prefetcherBuilders = new Hashtable<const char*,
+                           PrefetcherBuilder*, 1>();
+    }
+    prefetcherBuilders->add(name, this);
+}
+
+Hashtable<const char*, PrefetcherBuilder*, 1>
+    *PrefetcherBuilder::prefetcherBuilders = NULL;
+
+Prefetcher* PrefetcherBuilder::create(const char *cacheName,
+        BaseMachine &machine, int lineBits)
+{
+    stringbuf type;
+
+    if (!machine.get_option(cacheName, "prefetcher",
+                type))
+        return NULL;
+
+    if (type == "none" || type == "")
+        return NULL;
+
+    PrefetcherBuilder **builder = NULL;
+    if (prefetcherBuilders)
+        builder = prefetcherBuilders->get(type.buf);
+
+    if (!builder) {
+        stringbuf err;
+        err << "::ERROR::Can't find prefetcher '" << type << "' for " <<
+            cacheName << ". Please check your config file." << endl;
+        ptl_logfile << err;
+        cout << err;
+        assert(builder);
+    }
+
+    return (*builder)->get_new_prefetcher(cacheName, machine,
+            lineBits);
+}
+
+NextLinePrefetcher::NextLinePrefetcher(const char *name,
+        BaseMachine &machine, int lineBits)
+    : Prefetcher(name, machine, lineBits, 1)
+{ }
+
+void NextLinePrefetcher::access(W64 line, MemoryRequest *request,
+        bool miss, bool prefetchHit, dynarray<W64> &lines)
+{
+    if (!miss && !prefetchHit)
+        return;
+
+    foreach (i, degree_) {
+        lines.push(line + distance_ + i);
+    }
+}
+
+StridePrefetcher::StridePrefetcher(const char *name,
+        BaseMachine &machine, int lineBits)
+    : Prefetcher(name, machine, lineBits, 64)
+{
+    table_.resize(tableSize_);
+
+    foreach (i, table_.count()) {
+        table_[i].rip = (W64)-1;
+        table_[i].lastLine = 0;
+        table_[i].stride = 0;
+        table_[i].confidence = 0;
+    }
+}
+
+void StridePrefetcher::access(W64 line, MemoryRequest *request, bool miss,
+        bool prefetchHit, dynarray<W64> &lines)
+{
+    /* Instruction fetches have no load RIP to learn from */
+    if (request->is_instruction())
+        return;
+
+    W64 rip = request->get_owner_rip();
+    Entry &entry = table_[(rip ^ (rip >> 12)) % table_.count()];
+
+    if (entry.rip != rip) {
+        entry.rip = rip;
+        entry.lastLine = line;
+        entry.stride = 0;
+        entry.confidence = 0;
+        return;
+    }
+
+    W64s stride = (W64s)(line - entry.lastLine);
+
+    /* Same line again, e.g. next word of it, nothing to learn */
+    if (stride == 0)
+        return;
+
+    if (stride == entry.stride) {
+        entry.confidence = min(entry.confidence + 1, 3);
+    } else if (entry.confidence > 0) {
+        entry.confidence--;
+    } else {
+        entry.stride = stride;
+    }
+
+    entry.lastLine = line;
+
+    if (entry.confidence < 1)
+        return;
+
+    foreach (i, degree_) {
+        lines.push(line + entry.stride * (distance_ + i));
+    }
+}
+
+StreamPrefetcher::StreamPrefetcher(const char *name,
+        BaseMachine &machine, int lineBits)
+    : Prefetcher(name, machine, lineBits, 16)
+    , useCounter_(0)
+{
+    streams_.resize(tableSize_);
+
+    foreach (i, streams_.count()) {
+        streams_[i].valid = false;
+    }
+}
+
+void StreamPrefetcher::access(W64 line, MemoryRequest *request, bool miss,
+        bool prefetchHit, dynarray<W64> &lines)
+{
+    if (!miss && !prefetchHit)
+        return;
+
+    Stream *stream = NULL;
+    Stream *victim = &streams_[0];
+
+    foreach (i, streams_.count()) {
+        Stream &s = streams_[i];
+
+        if (!s.valid) {
+            if (victim->valid)
+                victim = &s;
+            continue;
+        }
+
+        W64s delta = (W64s)(line - s.lastLine);
+        if (delta != 0 && delta >= -STREAM_WINDOW &&
+                delta <= STREAM_WINDOW &&
+                (s.direction == 0 || (delta > 0) == (s.direction > 0))) {
+            stream = &s;
+            break;
+        }
+
+        if (victim->valid && s.lastUse < victim->lastUse)
+            victim = &s;
+    }
+
+    if (!stream) {
+        /* Only misses start new streams */
+        if (!miss)
+            return;
+
+        victim->valid = true;
+        victim->lastLine = line;
+        victim->lastUse = useCounter_++;
+        victim->frontier = line;
+        victim->direction = 0;
+        victim->confidence = 0;
+        return;
+    }
+
+    int direction = (line > stream->lastLine) ? 1 : -1;
+
+    if (stream->direction == direction) {
+        stream->confidence = min(stream->confidence + 1, 3);
+    } else {
+        stream->direction = direction;
+        stream->confidence = 1;
+        stream->frontier = line;
+    }
+
+    stream->lastLine = line;
+    stream->lastUse = useCounter_++;
+
+    if (stream->confidence < 2)
+        return;
+
+    /* Only prefetch lines beyond what this stream already prefetched */
+    W64s first = max((W64s)distance_,
+            (W64s)(stream->frontier - line) * direction);
+    W64s last = distance_ + degree_ - 1;
+
+    for (W64s i = first; i <= last; i++) {
+        lines.push(line + direction * i);
+    }
+
+    if (first <= last)
+        stream->frontier = line + direction * (last + 1);
+}
+
+/**
+ * @brief Builder for each prefetcher type
+ */
+template <typename T>
+struct SimplePrefetcherBuilder : public PrefetcherBuilder
+{
+    SimplePrefetcherBuilder(const char *name) :
+        PrefetcherBuilder(name)
+    { }
+
+    Prefetcher* get_new_prefetcher(const char *name,
+            BaseMachine &machine, int lineBits)
+    {
+        return new T(name, machine, lineBits);
+    }
+};
+
+SimplePrefetcherBuilder<NextLinePrefetcher>
+    nextLinePrefetcherBuilder("next_line");
+SimplePrefetcherBuilder<StridePrefetcher>
+    stridePrefetcherBuilder("stride");
+SimplePrefetcherBuilder<StreamPrefetcher>
+    streamPrefetcherBuilder("stream");
@@ -0,0 +1,209 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <superstl.h>
+#include <memoryRequest.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+    /**
+     * @brief Prefetch statistics of one cache
+     *
+     * accuracy = (useful + late) / issued
+     * coverage = (useful + late) / (useful + late + demand misses)
+     */
+    struct PrefetchStats : public Statable
+    {
+        /* Prefetches sent to lower level */
+        StatObj<W64> issued;
+        /* Prefetch targets already in cache or queue */
+        StatObj<W64> redundant;
+        /* Prefetches dropped because the queue was too full */
+        StatObj<W64> dropped;
+        /* Demand accesses that hit a prefetched line */
+        StatObj<W64> useful;
+        /* Demand accesses that found their prefetch still in flight */
+        StatObj<W64> late;
+        /* Prefetched lines evicted before any demand access */
+        StatObj<W64> useless;
+
+        PrefetchStats(const char *name, Statable *parent)
+            : Statable(name, parent)
+              , issued("issued", this)
+              , redundant("redundant", this)
+              , dropped("dropped", this)
+              , useful("useful", this)
+              , late("late", this)
+              , useless("useless", this)
+        {}
+    };
+
+    /**
+     * @brief Base class of cache prefetchers
+     *
+     * The owning cache calls train() for each demand access and issues a
+     * prefetch for each line address the prefetcher returns.  Targets are
+     * kept within the 4KB physical page of the access, as the next page is
+     * not known to be contiguous.
+     *
+     * Common options, set per cache instance in machine config:
+     *   prefetcher          : name of the prefetcher, none by default
+     *   prefetch_degree     : lines prefetched per trigger (default 2)
+     *   prefetch_distance   : how far ahead of the access to start, in
+     *                         strides or lines (default 1)
+     *   prefetch_table_size : entries in the prefetcher's table
+     */
+    class Prefetcher
+    {
+        public:
+            Prefetcher(const char *name, BaseMachine &machine,
+                    int lineBits, int defaultTableSize);
+            virtual ~Prefetcher() { }
+
+            /**
+             * @brief Learn from a demand access
+             *
+             * @param request Demand request
+             * @param miss True if the access missed in cache
+             * @param prefetchHit True if it is the first hit to a line
+             * brought in by a prefetch
+             * @param lines Line addresses (physical address >> lineBits)
+             * to prefetch are appended here
+             */
+            void train(MemoryRequest *request, bool miss, bool prefetchHit,
+                    dynarray<W64> &lines);
+
+            const char *get_name() const { return name_.buf; }
+            void dump_configuration(YAML::Emitter &out) const;
+
+        protected:
+            stringbuf name_;
+            int lineBits_;
+            int degree_;
+            int distance_;
+            int tableSize_;
+
+            virtual const char *get_type() const = 0;
+            virtual void access(W64 line, MemoryRequest *request,
+                    bool miss, bool prefetchHit, dynarray<W64> &lines) = 0;
+    };
+
+    /**
+     * @brief Builder of a prefetcher type
+     *
+     * Same as ControllerBuilder, each prefetcher registers a global
+     * builder under the name used in 'prefetcher' option.
+     */
+    struct PrefetcherBuilder
+    {
+        PrefetcherBuilder(const char *name);
+        virtual ~PrefetcherBuilder() { }
+
+        virtual Prefetcher* get_new_prefetcher(const char *name,
+                BaseMachine &machine, int lineBits) = 0;
+
+        static Hashtable<const char*, PrefetcherBuilder*, 1>
+            *prefetcherBuilders;
+
+        /* Create the prefetcher configured for given cache, NULL if none */
+        static Prefetcher* create(const char *cacheName,
+                BaseMachine &machine, int lineBits);
+    };
+
+    /**
+     * @brief Tagged next-line prefetcher
+     *
+     * Prefetches the following lines on a miss and on the first hit to a
+     * prefetched line.
+     */
+    class NextLinePrefetcher : public Prefetcher
+    {
+        public:
+            NextLinePrefetcher(const char *name,
+                    BaseMachine &machine, int lineBits);
+
+        protected:
+            const char *get_type() const { return "next_line"; }
+            void access(W64 line, MemoryRequest *request, bool miss,
+                    bool prefetchHit, dynarray<W64> &lines);
+    };
+
+    /**
+     * @brief PC indexed stride prefetcher
+     *
+     * A reference prediction table indexed by the load's RIP keeps the
+     * last line and stride of each instruction.  Once the same stride was
+     * seen twice in a row the next 'degree' strides after 'distance' are
+     * prefetched.
+     */
+    class StridePrefetcher : public Prefetcher
+    {
+        public:
+            StridePrefetcher(const char *name,
+                    BaseMachine &machine, int lineBits);
+
+        protected:
+            struct Entry {
+                W64 rip;
+                W64 lastLine;
+                W64s stride;
+                int confidence;
+            };
+
+            dynarray<Entry> table_;
+
+            const char *get_type() const { return "stride"; }
+            void access(W64 line, MemoryRequest *request, bool miss,
+                    bool prefetchHit, dynarray<W64> &lines);
+    };
+
+    /**
+     * @brief Stream prefetcher
+     *
+     * Tracks up to 'table_size' streams of misses.  A miss within
+     * STREAM_WINDOW lines of a stream's last line trains that stream,
+     * once the direction was confirmed lines ahead of the stream are
+     * prefetched.  Hits on prefetched lines keep the stream running.
+     */
+    class StreamPrefetcher : public Prefetcher
+    {
+        public:
+            StreamPrefetcher(const char *name,
+                    BaseMachine &machine, int lineBits);
+
+        protected:
+            static const int STREAM_WINDOW = 16;
+
+            struct Stream {
+                W64 lastLine;
+                /* Next line to prefetch */
+                W64 frontier;
+                W64 lastUse;
+                int direction;
+                int confidence;
+                bool valid;
+            };
+
+            dynarray<Stream> streams_;
+            W64 useCounter_;
+
+            const char *get_type() const { return "stream"; }
+            void access(W64 line, MemoryRequest *request, bool miss,
+                    bool prefetchHit, dynarray<W64> &lines);
+    };
+
+};
+
+#endif // PREFETCHER_H
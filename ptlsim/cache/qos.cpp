@@ -0,0 +1,212 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <qos.h>
+#include <cacheLines.h>
+#include <machine.h>
+
+using namespace Memory;
+
+QosState Memory::qos;
+
+namespace {
+    /* Created with the first QoS option, NULL if the machine has none */
+    QosStats *qos_stats = NULL;
+    dynarray<CacheLinesBase*> qos_caches;
+    int qos_cores = 0;
+
+    void qos_enable_stats()
+    {
+        if (!qos_stats)
+            qos_stats = new QosStats();
+    }
+
+    /* Comma separated values of an option, at most 'limit' of them */
+    int qos_parse_list(BaseMachine &machine, const char *name,
+            const char *opt, W64 *values, int limit)
+    {
+        stringbuf list;
+        dynarray<stringbuf*> items;
+
+        if (!machine.get_option(name, opt, list))
+            return 0;
+
+        list.split(items, ",");
+        int count = items.count();
+
+        if (count > limit) {
+            ptl_logfile << "ERROR: ", name, " ", opt, " has ", count,
+                        " entries, at most ", limit, endl;
+            assert(0);
+        }
+
+        foreach (i, count) {
+            char *end;
+            values[i] = strtoull(items[i]->buf, &end, 0);
+            if (end == items[i]->buf) {
+                ptl_logfile << "ERROR: ", name, " ", opt, " entry '",
+                            items[i]->buf, "' is not a number", endl;
+                assert(0);
+            }
+            delete items[i];
+        }
+
+        return count;
+    }
+
+    /* 'qos_clos' of a QoS cache or controller: class of each core by id */
+    void qos_setup_clos(BaseMachine &machine, const char *name)
+    {
+        W64 classes[NUM_SIM_CORES];
+        int count = qos_parse_list(machine, name, "qos_clos", classes,
+                NUM_SIM_CORES);
+
+        foreach (i, count) {
+            if (!qos.set_clos(i, classes[i] < QOS_MAX_CLOS ?
+                        int(classes[i]) : -1)) {
+                ptl_logfile << "ERROR: ", name, " qos_clos of core ", i,
+                            " is not a class in 0..", QOS_MAX_CLOS - 1,
+                            endl;
+                assert(0);
+            }
+        }
+    }
+};
+
+void Memory::qos_setup_cache(BaseMachine &machine, const char *name,
+        CacheLinesBase *lines)
+{
+    W64 masks[QOS_MAX_CLOS];
+    int count = qos_parse_list(machine, name, "qos_ways", masks,
+            QOS_MAX_CLOS);
+    W64 ioMask;
+    bool ioWays = qos_parse_list(machine, name, "io_ways", &ioMask, 1);
+
+    if (!count && !ioWays)
+        return;
+
+    if (ioWays && !qos.set_io_ways(ioMask)) {
+        ptl_logfile << "ERROR: ", name, " io_ways has no way", endl;
+        assert(0);
+    }
+
+    qos_setup_clos(machine, name);
+
+    foreach (i, count) {
+        if (!qos.set_ways(i, masks[i])) {
+            ptl_logfile << "ERROR: ", name, " qos_ways of class ", i,
+                        " has no way", endl;
+            assert(0);
+        }
+    }
+
+    lines->enable_qos();
+    qos_caches.push(lines);
+    qos_enable_stats();
+}
+
+void Memory::qos_setup_controller(BaseMachine &machine, const char *name)
+{
+    W64 rates[QOS_MAX_CLOS];
+    int count = qos_parse_list(machine, name, "qos_bandwidth", rates,
+            QOS_MAX_CLOS);
+    int burst;
+
+    if (!count)
+        return;
+
+    qos_setup_clos(machine, name);
+
+    foreach (i, count) {
+        if (rates[i] > 0x7fffffff || !qos_set_bandwidth(i, int(rates[i]))) {
+            ptl_logfile << "ERROR: ", name, " qos_bandwidth of class ", i,
+                        " is out of range", endl;
+            assert(0);
+        }
+    }
+
+    if (machine.get_option(name, "qos_burst", burst))
+        qos.set_burst(burst);
+
+    qos_enable_stats();
+}
+
+void Memory::qos_setup_core(BaseMachine &machine, const char *name,
+        int coreid)
+{
+    int clos;
+
+    qos_cores = max(qos_cores, coreid + 1);
+
+    if (!machine.get_option(name, "clos", clos))
+        return;
+
+    if (!qos.set_clos(coreid, clos)) {
+        ptl_logfile << "ERROR: ", name, " clos ", clos, " is not in 0..",
+                    QOS_MAX_CLOS - 1, endl;
+        assert(0);
+    }
+
+    qos_enable_stats();
+}
+
+bool Memory::qos_set_bandwidth(int clos, int mbps)
+{
+    if (!qos.set_bandwidth(clos, mbps, config.core_freq_hz))
+        return false;
+
+    qos_enable_stats();
+    return true;
+}
+
+void Memory::qos_set_stats()
+{
+    if (!qos_stats)
+        return;
+
+    W64 lines[QOS_MAX_CLOS];
+    W64 cores[QOS_MAX_CLOS];
+
+    foreach (i, QOS_MAX_CLOS) lines[i] = cores[i] = 0;
+    foreach (i, qos_caches.length) qos_caches[i]->count_clos_lines(lines);
+    foreach (i, qos_cores) cores[qos.clos_of(i)]++;
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+
+    foreach (i, QOS_MAX_CLOS) {
+        QosClass &c = qos.classes[i];
+        QosClassStats &node = *qos_stats->classes[i];
+
+        if (!cores[i] && !lines[i] && !c.fills && !c.memBytes) {
+            node.disable_dump();
+            continue;
+        }
+        node.enable_dump();
+
+        W64 bandwidth = c.bandwidth;
+        foreach (s, 3) {
+            node.set_default_stats(stats[s]);
+            node.way_mask = c.wayMask;
+            node.bandwidth_mbps = bandwidth;
+            node.cores = cores[i];
+            node.llc_lines = lines[i];
+            node.llc_fills = c.fills;
+            node.mem_bytes = c.memBytes;
+            node.throttled = c.throttled;
+            node.throttle_cycles = c.throttleCycles;
+        }
+    }
+}
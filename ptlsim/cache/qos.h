@@ -0,0 +1,271 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef QOS_H
+#define QOS_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+    struct CacheLinesBase;
+
+#define QOS_MAX_CLOS 16
+
+/* Fractional bits of the bandwidth pacing clock */
+#define QOS_FRAC_BITS 8
+
+/**
+ * @brief Memory traffic of one core paced to a rate (generic cell rate)
+ *
+ * A token bucket kept as the theoretical arrival time 'tat' of its next
+ * line, in cycles << QOS_FRAC_BITS: each line moves it by the interval of
+ * the rate and a line that comes more than 'burst' ahead of it waits for
+ * the difference. So a core gets its rate on average and bursts of up to
+ * burst / interval lines go through unpaced.
+ */
+struct QosBucket {
+    W64 tat;
+
+    QosBucket() : tat(0) {}
+
+    W64 pace(W64 cycle, W64 interval, W64 burst) {
+        W64 now = cycle << QOS_FRAC_BITS;
+        W64 start = max(tat, now);
+        tat = start + interval;
+        return (start > now + burst) ?
+            (start - now - burst + bitmask(QOS_FRAC_BITS)) >> QOS_FRAC_BITS :
+            0;
+    }
+};
+
+/* A class of service (CLOS), shared by the cores mapped to it */
+struct QosClass {
+    W64 wayMask;   /* ways of QoS caches it fills, bit per way */
+    int bandwidth; /* MB/s per core, 0 if not throttled */
+    W64 interval;  /* cycles << QOS_FRAC_BITS per line at bandwidth */
+
+    /* Counted for the 'qos' stats */
+    W64 fills;
+    W64 memBytes;
+    W64 throttled;
+    W64 throttleCycles;
+};
+
+/**
+ * @brief Cache way partitioning and memory bandwidth throttling by CLOS
+ *
+ * Like Intel CAT and MBA, each core is mapped to one of QOS_MAX_CLOS
+ * classes of service (class 0 by default) and a class has:
+ *
+ *   - a way mask: caches with 'qos_ways' in their machine config options
+ *     only fill a line of a core into the ways of its class's mask, hits
+ *     are not restricted. Bits above the cache's associativity are
+ *     ignored and a mask with no way left means all ways.
+ *   - a bandwidth: memory controllers with 'qos_bandwidth' hold back the
+ *     responses of each core of the class to that many MB/s, with bursts
+ *     of 'qos_burst' lines (8 by default) going through unpaced.
+ *
+ * The classes are machine wide, so all QoS caches use the same masks and
+ * a core's bandwidth is its total over all controllers. Device DMA that
+ * IO agents send (see ioAgent.h) fills the ways of the IO mask instead of
+ * its class's, so it can only take that much of the cache. Options:
+ *
+ *   qos_ways      : way mask of each class from class 0, e.g. '0xff0,0xf'
+ *   io_ways       : way mask of the lines IO agents fill, like DDIO
+ *   qos_bandwidth : MB/s of each class from class 0, 0 for no limit
+ *   qos_burst     : unpaced burst in lines
+ *   qos_clos      : class of each core from core 0, with either of them
+ *   clos          : class of a core, in the core's options
+ *
+ * PTLCALL_QOS changes a core's class and the classes at run time.
+ */
+struct QosState {
+    QosClass classes[QOS_MAX_CLOS];
+    W8 coreClos[NUM_SIM_CORES];
+    QosBucket buckets[NUM_SIM_CORES];
+    W64 ioWayMask;
+    int burstLines;
+    bool throttled; /* a class has a bandwidth */
+
+    QosState() { reset(); }
+
+    void reset() {
+        foreach (i, QOS_MAX_CLOS) {
+            QosClass &c = classes[i];
+            c.wayMask = (W64)-1;
+            c.bandwidth = 0;
+            c.interval = 0;
+            c.fills = c.memBytes = c.throttled = c.throttleCycles = 0;
+        }
+        foreach (i, NUM_SIM_CORES) {
+            coreClos[i] = 0;
+            buckets[i] = QosBucket();
+        }
+        ioWayMask = (W64)-1;
+        burstLines = 8;
+        throttled = false;
+    }
+
+    /* Requests of no core (e.g. DMA) are in class 0 */
+    int clos_of(int coreid) const {
+        return (coreid >= 0 && coreid < NUM_SIM_CORES) ? coreClos[coreid] : 0;
+    }
+
+    /* io: fill of an IO agent's request, it takes the IO mask */
+    W64 way_mask(int coreid, int ways, bool io = false) const {
+        W64 mask = (io) ? ioWayMask : classes[clos_of(coreid)].wayMask;
+        mask &= bitmask(ways);
+        return (mask) ? mask : bitmask(ways);
+    }
+
+    bool set_clos(int coreid, int clos) {
+        if (coreid < 0 || coreid >= NUM_SIM_CORES ||
+                clos < 0 || clos >= QOS_MAX_CLOS)
+            return false;
+        coreClos[coreid] = clos;
+        return true;
+    }
+
+    bool set_ways(int clos, W64 mask) {
+        if (clos < 0 || clos >= QOS_MAX_CLOS || !mask)
+            return false;
+        classes[clos].wayMask = mask;
+        return true;
+    }
+
+    bool set_io_ways(W64 mask) {
+        if (!mask)
+            return false;
+        ioWayMask = mask;
+        return true;
+    }
+
+    /* freqHz: simulation clock, to convert MB/s into cycles per line */
+    bool set_bandwidth(int clos, int mbps, W64 freqHz) {
+        if (clos < 0 || clos >= QOS_MAX_CLOS || mbps < 0)
+            return false;
+
+        QosClass &c = classes[clos];
+        c.bandwidth = mbps;
+        c.interval = (mbps) ? ((64 * freqHz) << QOS_FRAC_BITS) /
+            (W64(mbps) * 1000000) : 0;
+
+        throttled = false;
+        foreach (i, QOS_MAX_CLOS) throttled |= (classes[i].bandwidth > 0);
+        return true;
+    }
+
+    void set_burst(int lines) {
+        burstLines = max(lines, 0);
+    }
+
+    /**
+     * @brief Count a line moved by memory for a core
+     *
+     * @param paced Line is a demand fill, paced to the core's bandwidth
+     *
+     * @return Cycles the line's response waits for the core's bandwidth
+     */
+    int memory_access(int coreid, W64 cycle, bool paced) {
+        QosClass &c = classes[clos_of(coreid)];
+        c.memBytes += 64;
+
+        if likely (!paced || !c.interval || coreid < 0 ||
+                coreid >= NUM_SIM_CORES)
+            return 0;
+
+        W64 delay = buckets[coreid].pace(cycle, c.interval,
+                burstLines * c.interval);
+        if (delay) {
+            c.throttled++;
+            c.throttleCycles += delay;
+        }
+        return int(delay);
+    }
+};
+
+extern QosState qos;
+
+struct QosClassStats : public Statable
+{
+    StatObj<W64> way_mask;
+    StatObj<W64> bandwidth_mbps;
+    StatObj<W64> cores;
+    StatObj<W64> llc_lines;
+    StatObj<W64> llc_fills;
+    StatObj<W64> mem_bytes;
+    StatObj<W64> throttled;
+    StatObj<W64> throttle_cycles;
+
+    QosClassStats(stringbuf &name, Statable *parent)
+        : Statable(name, parent)
+          , way_mask("way_mask", this)
+          , bandwidth_mbps("bandwidth_mbps", this)
+          , cores("cores", this)
+          , llc_lines("llc_lines", this)
+          , llc_fills("llc_fills", this)
+          , mem_bytes("mem_bytes", this)
+          , throttled("throttled", this)
+          , throttle_cycles("throttle_cycles", this)
+    {}
+};
+
+/*
+ * Written to the 'qos' node at the end of the run for the classes in use,
+ * llc_lines is the occupancy of all QoS caches at that time:
+ *
+ *   qos:
+ *     clos_0:
+ *       way_mask: .., bandwidth_mbps: .., cores: ..,
+ *       llc_lines: .., llc_fills: .., mem_bytes: ..,
+ *       throttled: .., throttle_cycles: ..
+ */
+struct QosStats : public Statable
+{
+    QosClassStats *classes[QOS_MAX_CLOS];
+
+    QosStats()
+        : Statable("qos")
+    {
+        foreach (i, QOS_MAX_CLOS) {
+            stringbuf name;
+            name << "clos_", i;
+            classes[i] = new QosClassStats(name, this);
+        }
+    }
+};
+
+/*
+ * Apply the 'qos_ways' and 'io_ways' options of cache 'name' and enable
+ * way partitioning of its lines if either is set
+ */
+void qos_setup_cache(BaseMachine &machine, const char *name,
+        CacheLinesBase *lines);
+
+/* Apply 'qos_bandwidth' and 'qos_burst' options of a memory controller */
+void qos_setup_controller(BaseMachine &machine, const char *name);
+
+/* Apply the 'clos' option of core 'name' */
+void qos_setup_core(BaseMachine &machine, const char *name, int coreid);
+
+/* Change a class's bandwidth at the simulation clock */
+bool qos_set_bandwidth(int clos, int mbps);
+
+/* Write the classes in use to the 'qos' stats node */
+void qos_set_stats();
+
+};
+
+#endif // QOS_H
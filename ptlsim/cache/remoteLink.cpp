@@ -0,0 +1,397 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifdef MEM_TEST
+#include <test.h>
+#else
+#include <ptlsim.h>
+#endif
+
+#include <remoteLink.h>
+#include <memoryHierarchy.h>
+#include <machine.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace Memory;
+using namespace Memory::RemoteLinkInterconnect;
+
+static const W32 RING_MASK = REMOTE_LINK_RING_SIZE - 1;
+
+RemoteLink::RemoteLink(const char *name, MemoryHierarchy *memoryHierarchy)
+    : Interconnect(name, memoryHierarchy)
+    , controller_(NULL)
+    , shared_(NULL)
+{
+    memoryHierarchy_->add_interconnect(this);
+    memoryHierarchy_->add_clocked_interconnect(this);
+
+    BaseMachine &machine = memoryHierarchy_->get_machine();
+
+    if (!machine.get_option(name, "link", linkName_)) {
+        linkName_ << name;
+    }
+
+    if (!machine.get_option(name, "side", side_)) {
+        side_ = 0;
+    }
+
+    if (!machine.get_option(name, "latency", latency_)) {
+        latency_ = REMOTE_LINK_DELAY;
+    }
+
+    if (side_ != 0 && side_ != 1) {
+        ptl_logfile << "[ERROR] Remote link ", name, " side must be 0 or 1",
+                    endl, flush;
+        cerr << "[ERROR] Remote link " << name << " side must be 0 or 1"
+             << endl << flush;
+        assert(0);
+    }
+
+    open_shared_link();
+}
+
+RemoteLink::~RemoteLink()
+{
+    if (shared_) {
+        munmap(shared_, sizeof(SharedLink));
+        shared_ = NULL;
+    }
+}
+
+/**
+ * @brief Map the shared memory segment of this link
+ *
+ * Whichever side starts first creates and initializes the segment, the
+ * other one waits until it is ready and then removes the name, so no stale
+ * segment is left behind once both sides have it mapped.
+ */
+void RemoteLink::open_shared_link()
+{
+    stringbuf shmName;
+    shmName << "/marss-link-", linkName_;
+
+    bool created = true;
+    int fd = shm_open(shmName, O_RDWR | O_CREAT | O_EXCL, 0666);
+
+    if (fd == -1 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(shmName, O_RDWR, 0666);
+    }
+
+    if (fd != -1 && created &&
+            ftruncate(fd, sizeof(SharedLink)) == -1) {
+        close(fd);
+        shm_unlink(shmName);
+        fd = -1;
+    }
+
+    if (fd != -1 && !created) {
+        /* Creator may not have sized the segment yet */
+        struct stat st;
+        while (fstat(fd, &st) == 0 &&
+                st.st_size < (off_t)sizeof(SharedLink))
+            usleep(1000);
+    }
+
+    void *addr = MAP_FAILED;
+    if (fd != -1) {
+        addr = mmap(NULL, sizeof(SharedLink), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+        close(fd);
+    }
+
+    if (addr == MAP_FAILED) {
+        ptl_logfile << "[ERROR] Remote link ", get_name(),
+                    " can't map ", shmName.buf, ": ", strerror(errno),
+                    endl, flush;
+        cerr << "[ERROR] Remote link " << get_name() << " can't map "
+             << shmName << ": " << strerror(errno) << endl << flush;
+        assert(0);
+    }
+
+    shared_ = (SharedLink*)addr;
+
+    if (created) {
+        /* ftruncate has zeroed both rings */
+        __sync_synchronize();
+        shared_->magic = REMOTE_LINK_MAGIC;
+    } else {
+        while (shared_->magic != REMOTE_LINK_MAGIC)
+            usleep(1000);
+    }
+
+    ptl_logfile << "Remote link ", get_name(), " mapped ", shmName.buf,
+                " as side ", side_, endl;
+
+    if (!created)
+        shm_unlink(shmName);
+}
+
+void RemoteLink::register_controller(Controller *controller)
+{
+    /* The other end of this link is in the peer process */
+    assert(controller_ == NULL);
+    controller_ = controller;
+}
+
+int RemoteLink::access_fast_path(Controller *controller,
+        MemoryRequest *request)
+{
+    return -1;
+}
+
+void RemoteLink::annul_request(MemoryRequest *request)
+{
+    /* Peer still sends the response, drop it when it arrives */
+    PendingEntry *entry;
+    foreach_list_mutable (pending_.list(), entry, entry_t, nextentry_t) {
+        if (entry->request == request) {
+            entry->annuled = true;
+        }
+    }
+}
+
+ProxyEntry* RemoteLink::find_proxy(MemoryRequest *request)
+{
+    ProxyEntry *proxy;
+    foreach_list_mutable (proxies_.list(), proxy, entry_t, nextentry_t) {
+        if (proxy->request == request)
+            return proxy;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Send a message from local controller to the peer
+ *
+ * @param arg Message sent from Controller
+ *
+ * @return False if ring or pending queue is full so controller retries
+ */
+bool RemoteLink::controller_request_cb(void *arg)
+{
+    Message *msg = (Message*)arg;
+    MemoryRequest *request = msg->request;
+    Ring &ring = tx_ring();
+
+    if (ring.tail - ring.head >= (W32)REMOTE_LINK_RING_SIZE) {
+        return false;
+    }
+
+    Packet &packet = ring.packets[ring.tail & RING_MASK];
+
+    ProxyEntry *proxy = find_proxy(request);
+
+    if (proxy) {
+        /* Response to a request we received from the peer */
+        packet.type = PACKET_TYPE_RESPONSE;
+        packet.id   = proxy->remoteId;
+
+        proxy->request->decRefCounter();
+        ADD_HISTORY_REM(proxy->request);
+        proxies_.free(proxy);
+    } else {
+        packet.type = PACKET_TYPE_REQUEST;
+        packet.id   = REMOTE_LINK_NO_RESPONSE;
+
+        /* Same rule as MemoryController: only read and write misses
+         * get a response */
+        OP_TYPE type = request->get_type();
+        if (!msg->hasData && (type == MEMORY_OP_READ ||
+                    type == MEMORY_OP_WRITE)) {
+            PendingEntry *entry = pending_.alloc();
+
+            if (!entry) {
+                return false;
+            }
+
+            entry->request = request;
+            request->incRefCounter();
+            ADD_HISTORY_ADD(request);
+            packet.id = entry->idx;
+        }
+    }
+
+    packet.deliverCycle    = sim_cycle + latency_;
+    packet.physicalAddress = request->get_physical_address();
+    packet.ownerRIP        = request->get_owner_rip();
+    packet.ownerUUID       = request->get_owner_uuid();
+    packet.opType          = request->get_type();
+    packet.coreId          = request->get_coreid();
+    packet.threadId        = request->get_threadid();
+    packet.isInstruction   = request->is_instruction();
+    packet.hasData         = msg->hasData;
+    packet.isShared        = msg->isShared;
+
+    /* Publish the packet before moving tail */
+    __sync_synchronize();
+    ring.tail++;
+
+    memdebug("Remote link ", get_name(), " sent ", *request, endl);
+
+    return true;
+}
+
+bool RemoteLink::deliver_response(Packet &packet)
+{
+    assert(packet.id < (W32)REMOTE_LINK_MAX_PENDING);
+    PendingEntry &entry = pending_[packet.id];
+    assert(!entry.free);
+
+    if (!entry.annuled) {
+        Message &message = *memoryHierarchy_->get_message();
+        message.sender   = this;
+        message.request  = entry.request;
+        message.hasData  = packet.hasData;
+        message.isShared = packet.isShared;
+
+        bool success = controller_->get_interconnect_signal()->
+            emit(&message);
+
+        memoryHierarchy_->free_message(&message);
+
+        if (!success) {
+            return false;
+        }
+    }
+
+    entry.request->decRefCounter();
+    ADD_HISTORY_REM(entry.request);
+    pending_.free(&entry);
+
+    return true;
+}
+
+bool RemoteLink::deliver_request(Packet &packet)
+{
+    ProxyEntry *proxy = NULL;
+
+    if (packet.id != REMOTE_LINK_NO_RESPONSE) {
+        proxy = proxies_.alloc();
+
+        if (!proxy) {
+            return false;
+        }
+    }
+
+    /* Peer's core ids may not exist here, map them on local pools */
+    W8 coreid = packet.coreId % NUM_SIM_CORES;
+
+    MemoryRequest *request = memoryHierarchy_->get_free_request(coreid);
+    request->init(coreid, packet.threadId, packet.physicalAddress, 0,
+            sim_cycle, packet.isInstruction, packet.ownerRIP,
+            packet.ownerUUID, (OP_TYPE)packet.opType);
+    request->incRefCounter();
+    ADD_HISTORY_ADD(request);
+
+    Message &message = *memoryHierarchy_->get_message();
+    message.sender   = this;
+    message.request  = request;
+    message.hasData  = packet.hasData;
+    message.isShared = packet.isShared;
+
+    bool success = controller_->get_interconnect_signal()->emit(&message);
+
+    memoryHierarchy_->free_message(&message);
+
+    if (success && proxy) {
+        proxy->request  = request;
+        proxy->remoteId = packet.id;
+        return true;
+    }
+
+    if (proxy) {
+        proxies_.free(proxy);
+    }
+
+    request->decRefCounter();
+    ADD_HISTORY_REM(request);
+
+    return success;
+}
+
+bool RemoteLink::deliver(Packet &packet)
+{
+    if (packet.type == PACKET_TYPE_RESPONSE)
+        return deliver_response(packet);
+
+    return deliver_request(packet);
+}
+
+/**
+ * @brief Deliver packets from the peer that are due in this cycle
+ *
+ * Packets are delivered in order, if the local controller can't accept
+ * one then it is retried in next cycle.
+ */
+void RemoteLink::clock()
+{
+    Ring &ring = rx_ring();
+
+    while (ring.head != ring.tail) {
+        /* Read the packet only after seeing tail moved */
+        __sync_synchronize();
+
+        Packet &packet = ring.packets[ring.head & RING_MASK];
+
+        if (packet.deliverCycle > sim_cycle || !deliver(packet))
+            break;
+
+        /* Done with the packet before giving its slot back */
+        __sync_synchronize();
+        ring.head++;
+    }
+}
+
+/**
+ * @brief Dump Remote Link Configuration in YAML Format
+ *
+ * @param out YAML Object
+ */
+void RemoteLink::dump_configuration(YAML::Emitter &out) const
+{
+	out << YAML::Key << get_name() << YAML::Value << YAML::BeginMap;
+
+	YAML_KEY_VAL(out, "type", "interconnect");
+	YAML_KEY_VAL(out, "link", linkName_.buf);
+	YAML_KEY_VAL(out, "side", side_);
+	YAML_KEY_VAL(out, "latency", latency_);
+	YAML_KEY_VAL(out, "ring_size", REMOTE_LINK_RING_SIZE);
+	YAML_KEY_VAL(out, "max_pending", REMOTE_LINK_MAX_PENDING);
+
+	out << YAML::EndMap;
+}
+
+/**
+ * @brief Remote Link Builder to export remote link to machine
+ *
+ * This builder creates an Interconnect module named 'remote_link' that can
+ * be used in machine configuration file.
+ */
+struct RemoteLinkBuilder : public InterconnectBuilder
+{
+    RemoteLinkBuilder(const char *name) :
+        InterconnectBuilder(name)
+    { }
+
+    Interconnect* get_new_interconnect(MemoryHierarchy &mem,
+            const char *name)
+    {
+        return new RemoteLink(name, &mem);
+    }
+};
+
+RemoteLinkBuilder remoteLinkBuilder("remote_link");
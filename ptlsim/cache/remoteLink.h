@@ -0,0 +1,209 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef REMOTE_LINK_H
+#define REMOTE_LINK_H
+
+#include <interconnect.h>
+#include <statelist.h>
+
+namespace Memory {
+
+namespace RemoteLinkInterconnect {
+
+    /* Must be power of 2 */
+    const int REMOTE_LINK_RING_SIZE = 1024;
+    const int REMOTE_LINK_MAX_PENDING = 64;
+    const int REMOTE_LINK_DELAY = 10;
+
+    /* "MRSLINK1", bump the digit when Packet or SharedLink changes */
+    const W64 REMOTE_LINK_MAGIC = 0x314b4e494c53524dULL;
+
+    /* Packet id of requests that don't expect a response */
+    const W32 REMOTE_LINK_NO_RESPONSE = (W32)-1;
+
+    enum PacketType {
+        PACKET_TYPE_REQUEST,
+        PACKET_TYPE_RESPONSE,
+    };
+
+    /**
+     * @brief Message as it travels between two simulator processes
+     *
+     * Pointers are meaningless in the other process, so a request is sent
+     * by value and responses refer back to it by the sender's id.
+     */
+    struct Packet {
+        W64 deliverCycle;
+        W64 physicalAddress;
+        W64 ownerRIP;
+        W64 ownerUUID;
+        W32 id;
+        W8  type;
+        W8  opType;
+        W8  coreId;
+        W8  threadId;
+        W8  isInstruction;
+        W8  hasData;
+        W8  isShared;
+        W8  pad;
+    };
+
+    /**
+     * @brief Single producer single consumer ring of Packets
+     *
+     * Only the producer writes tail and only the consumer writes head, so
+     * no lock is needed.  Both are free running counters.
+     */
+    struct Ring {
+        volatile W32 head;
+        char         headPad[60];
+        volatile W32 tail;
+        char         tailPad[60];
+        Packet       packets[REMOTE_LINK_RING_SIZE];
+    };
+
+    /**
+     * @brief Layout of the shared memory segment, rings[i] is written by
+     * side i
+     */
+    struct SharedLink {
+        volatile W64 magic;
+        char         magicPad[56];
+        Ring         rings[2];
+    };
+
+    /**
+     * @brief Local request waiting for its response from the peer
+     */
+    struct PendingEntry : public FixStateListObject
+    {
+        MemoryRequest *request;
+        bool           annuled;
+
+        void init() {
+            request = NULL;
+            annuled = 0;
+        }
+
+        ostream& print(ostream& os) const {
+            if (!request) {
+                os << "Free entry";
+                return os;
+            }
+
+            os << "request[", *request, "] ";
+            os << "annuled[", annuled, "]";
+            return os;
+        }
+    };
+
+    /**
+     * @brief Local copy of a request received from the peer
+     */
+    struct ProxyEntry : public FixStateListObject
+    {
+        MemoryRequest *request;
+        W32            remoteId;
+
+        void init() {
+            request  = NULL;
+            remoteId = 0;
+        }
+
+        ostream& print(ostream& os) const {
+            if (!request) {
+                os << "Free entry";
+                return os;
+            }
+
+            os << "request[", *request, "] ";
+            os << "remote-id[", remoteId, "]";
+            return os;
+        }
+    };
+
+    static inline ostream& operator <<(ostream& os, const PendingEntry
+            &entry) {
+        return entry.print(os);
+    }
+
+    static inline ostream& operator <<(ostream& os, const ProxyEntry
+            &entry) {
+        return entry.print(os);
+    }
+
+    /**
+     * @brief Interconnect to a controller in another simulator process
+     *
+     * Works like the P2P interconnect except that the other controller lives
+     * in a peer MARSS instance.  Both instances configure a 'remote_link'
+     * with the same 'link' name and opposite 'side' (0 or 1), and each
+     * connects one of its own controllers to it.  Messages travel over a
+     * lock-free ring in the shared memory segment /marss-link-<link> and
+     * are delivered 'latency' cycles after they were sent.
+     *
+     * Delivery uses the receiver's sim_cycle, so run both instances
+     * with -sync no larger than the latency to keep timing exact.
+     */
+    class RemoteLink : public Interconnect
+    {
+        private:
+            Controller *controller_;
+            SharedLink *shared_;
+            stringbuf   linkName_;
+            int         side_;
+            int         latency_;
+
+            FixStateList<PendingEntry, REMOTE_LINK_MAX_PENDING> pending_;
+            FixStateList<ProxyEntry, REMOTE_LINK_MAX_PENDING> proxies_;
+
+            void open_shared_link();
+            ProxyEntry* find_proxy(MemoryRequest *request);
+            bool deliver(Packet &packet);
+            bool deliver_response(Packet &packet);
+            bool deliver_request(Packet &packet);
+
+            Ring& tx_ring() { return shared_->rings[side_]; }
+            Ring& rx_ring() { return shared_->rings[1 - side_]; }
+
+        public:
+            RemoteLink(const char *name, MemoryHierarchy *memoryHierarchy);
+            ~RemoteLink();
+
+            bool controller_request_cb(void *arg);
+            void register_controller(Controller *controller);
+            int  access_fast_path(Controller *controller,
+                    MemoryRequest *request);
+            void annul_request(MemoryRequest *request);
+            int  get_delay() { return latency_; }
+            void dump_configuration(YAML::Emitter &out) const;
+            void clock();
+
+            void print(ostream& os) const {
+                os << "--Remote-Link: ", get_name(), " link: ", linkName_,
+                   " side: ", side_, endl;
+                os << "Pending: ", pending_, endl;
+                os << "Proxies: ", proxies_, endl;
+                os << "--End-Remote-Link\n";
+            }
+
+            void print_map(ostream& os) {
+                os << "Remote Link: ", get_name(), endl;
+                os << "\tconnected to: ", endl;
+                os << "\t\tcontroller: ", (controller_ ?
+                        controller_->get_name() : "None"), endl;
+                os << "\t\tpeer: ", linkName_, " side ", 1 - side_, endl;
+            }
+    };
+};
+
+};
+
+#endif // REMOTE_LINK_H
@@ -0,0 +1,335 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <globals.h>
+
+namespace Memory {
+
+    /*
+     * Replacement policies of VectorCacheLines, selected per cache with
+     * 'REPLACEMENT' in the cache params of the config file. Each keeps the
+     * state of a set packed in one or two W64 words, so up to 64 ways.
+     *
+     * reset() clears all sets. Caches that initialize their sets lazily
+     * call reset_shared() once and then reset_set() on each set's first
+     * use.
+     *
+     * A policy is told about:
+     *   touch(set, way)            - a probe hit the way
+     *   victim(set)                - a miss needs a way to fill
+     *   victim(set, mask)          - same, from the ways set in mask (way
+     *                                partitioning, see qos.h)
+     *   inserted(set, way, miss)   - a line was inserted, or re-inserted
+     *                                on a hit
+     *   invalidate(set, way)       - the way was invalidated
+     *
+     * set_policy(name) switches the policy to the one called 'name' when
+     * it keeps the same state, for 'replacement' machine option overrides
+     * at run time. It returns false if the policy can't be switched.
+     */
+
+    /*
+     * bit-plru: one MRU bit per way, the victim is the first way without
+     * it. All bits are cleared when they would all be set. Same as
+     * FullyAssociativeTags, which the 'array' backend uses.
+     */
+    template <int SET_COUNT, int WAY_COUNT>
+        struct BitPLRU
+        {
+            W64 mru_[SET_COUNT];
+
+            static W64 all_ways() { return bitmask(WAY_COUNT); }
+
+            void reset() {
+                reset_shared();
+                foreach(i, SET_COUNT) reset_set(i);
+            }
+
+            void reset_shared() {}
+
+            void reset_set(int set) {
+                mru_[set] = 0;
+            }
+
+            void touch(int set, int way) {
+                mru_[set] |= (1ULL << way);
+            }
+
+            int victim(int set) {
+                W64 free_ways = ~mru_[set] & all_ways();
+                int way = (free_ways) ? lsbindex64(free_ways) : 0;
+                if(mru_[set] == all_ways()) mru_[set] = 0;
+                return way;
+            }
+
+            /* MRU bits of the masked ways are cleared when all set */
+            int victim(int set, W64 mask) {
+                W64 free_ways = ~mru_[set] & mask;
+                int way = lsbindex64((free_ways) ? free_ways : mask);
+                if((mru_[set] & mask) == mask) mru_[set] &= ~mask;
+                return way;
+            }
+
+            void inserted(int set, int way, bool miss) {
+                touch(set, way);
+                if(mru_[set] == all_ways()) {
+                    mru_[set] = 0;
+                    touch(set, way);
+                }
+            }
+
+            void invalidate(int set, int way) {
+                mru_[set] &= ~(1ULL << way);
+            }
+
+            bool set_policy(const char *name) {
+                return strequal(name, "bit-plru");
+            }
+        };
+
+    /*
+     * tree-plru: binary tree of WAY_COUNT-1 bits per set, heap ordered
+     * from bit 1. Each bit points to the half holding the victim; an access
+     * points the bits on its path away from it. WAY_COUNT must be a power
+     * of two.
+     */
+    template <int SET_COUNT, int WAY_COUNT>
+        struct TreePLRU
+        {
+            typedef char power_of_two_check[
+                ((WAY_COUNT & (WAY_COUNT - 1)) == 0) ? 1 : -1];
+
+            W64 tree_[SET_COUNT];
+
+            void reset() {
+                reset_shared();
+                foreach(i, SET_COUNT) reset_set(i);
+            }
+
+            void reset_shared() {}
+
+            void reset_set(int set) {
+                tree_[set] = 0;
+            }
+
+            /* Point the path to 'way' towards it (victim) or away (use) */
+            void point(int set, int way, bool towards) {
+                W64 tree = tree_[set];
+                int node = 1;
+                for(int level = log2(WAY_COUNT) - 1; level >= 0; level--) {
+                    int right = (way >> level) & 1;
+                    int bit = (towards) ? right : !right;
+                    tree = (tree & ~(1ULL << node)) | (W64(bit) << node);
+                    node = 2 * node + right;
+                }
+                tree_[set] = tree;
+            }
+
+            void touch(int set, int way) {
+                point(set, way, false);
+            }
+
+            int victim(int set) const {
+                W64 tree = tree_[set];
+                int node = 1;
+                while(node < WAY_COUNT)
+                    node = 2 * node + int((tree >> node) & 1);
+                return node - WAY_COUNT;
+            }
+
+            /* Follow the tree, but never into a half with no masked way */
+            int victim(int set, W64 mask) const {
+                W64 tree = tree_[set];
+                int node = 1;
+                int first = 0;
+                for(int half = WAY_COUNT >> 1; half; half >>= 1) {
+                    int right = int((tree >> node) & 1);
+                    W64 ways = bitmask(half) << (first + right * half);
+                    if(!(mask & ways)) right = !right;
+                    first += right * half;
+                    node = 2 * node + right;
+                }
+                return first;
+            }
+
+            void inserted(int set, int way, bool miss) {
+                touch(set, way);
+            }
+
+            void invalidate(int set, int way) {
+                point(set, way, true);
+            }
+
+            bool set_policy(const char *name) {
+                return strequal(name, "tree-plru");
+            }
+        };
+
+    /*
+     * Re-reference interval prediction (Jaleel et al., ISCA 2010) with
+     * 2-bit RRPVs kept as two bit planes per set. Hits set the RRPV to 0.
+     * The victim is the first way at 3, after ageing every way until one
+     * is.
+     *
+     *   srrip: insert at 2
+     *   brrip: insert at 3, at 2 once every 32 fills
+     *   drrip: set dueling between the two, 32 leader sets each decide
+     *          with a 10 bit PSEL counter what the other sets use
+     */
+    enum {
+        RRIP_STATIC,
+        RRIP_BIMODAL,
+        RRIP_DYNAMIC,
+    };
+
+    template <int SET_COUNT, int WAY_COUNT, int MODE>
+        struct RRIP
+        {
+            enum {
+                RRPV_LONG = 2,
+                RRPV_DISTANT = 3,
+                BRRIP_PERIOD = 32,
+                DUEL_PERIOD = (SET_COUNT >= 64) ? (SET_COUNT / 32) : 2,
+                PSEL_MAX = 1023,
+            };
+
+            W64 lo_[SET_COUNT];
+            W64 hi_[SET_COUNT];
+            int fills_;
+            int psel_;
+            int mode_;
+
+            RRIP() : mode_(MODE) {}
+
+            static W64 all_ways() { return bitmask(WAY_COUNT); }
+
+            void reset() {
+                reset_shared();
+                foreach(i, SET_COUNT) reset_set(i);
+            }
+
+            void reset_shared() {
+                fills_ = 0;
+                psel_ = PSEL_MAX / 2;
+            }
+
+            /* Empty ways are the first victims */
+            void reset_set(int set) {
+                lo_[set] = all_ways();
+                hi_[set] = all_ways();
+            }
+
+            void set_rrpv(int set, int way, int rrpv) {
+                W64 b = 1ULL << way;
+                lo_[set] = (rrpv & 1) ? (lo_[set] | b) : (lo_[set] & ~b);
+                hi_[set] = (rrpv & 2) ? (hi_[set] | b) : (hi_[set] & ~b);
+            }
+
+            int rrpv(int set, int way) const {
+                return int((lo_[set] >> way) & 1) |
+                    (int((hi_[set] >> way) & 1) << 1);
+            }
+
+            void touch(int set, int way) {
+                set_rrpv(set, way, 0);
+            }
+
+            int victim(int set) {
+                for(;;) {
+                    W64 distant = lo_[set] & hi_[set] & all_ways();
+                    if likely (distant)
+                        return lsbindex64(distant);
+
+                    /* No way is at 3: add one to every RRPV */
+                    W64 lo = lo_[set];
+                    hi_[set] |= lo;
+                    lo_[set] = ~lo & all_ways();
+                }
+            }
+
+            /* Only the masked ways age, other classes' lines keep theirs */
+            int victim(int set, W64 mask) {
+                for(;;) {
+                    W64 distant = lo_[set] & hi_[set] & mask;
+                    if likely (distant)
+                        return lsbindex64(distant);
+
+                    W64 lo = lo_[set];
+                    hi_[set] |= lo & mask;
+                    lo_[set] = (lo & ~mask) | (~lo & mask);
+                }
+            }
+
+            /* 0: SRRIP leader, 1: BRRIP leader, -1: follower */
+            static int leader(int set) {
+                int slot = set % DUEL_PERIOD;
+                return (slot < 2) ? slot : -1;
+            }
+
+            bool bimodal(int set) const {
+                if(mode_ == RRIP_STATIC) return false;
+                if(mode_ == RRIP_BIMODAL) return true;
+
+                int lead = leader(set);
+                if(lead >= 0) return (lead == 1);
+                return (psel_ > PSEL_MAX / 2);
+            }
+
+            void inserted(int set, int way, bool miss) {
+                if(!miss) {
+                    touch(set, way);
+                    return;
+                }
+
+                if(mode_ == RRIP_DYNAMIC) {
+                    /* A miss in a leader set votes for the other policy */
+                    int lead = leader(set);
+                    if(lead == 0 && psel_ < PSEL_MAX) psel_++;
+                    if(lead == 1 && psel_ > 0) psel_--;
+                }
+
+                int rrpv = RRPV_LONG;
+                if(bimodal(set)) {
+                    rrpv = (++fills_ == BRRIP_PERIOD) ? RRPV_LONG :
+                        RRPV_DISTANT;
+                    if(fills_ == BRRIP_PERIOD) fills_ = 0;
+                }
+                set_rrpv(set, way, rrpv);
+            }
+
+            void invalidate(int set, int way) {
+                set_rrpv(set, way, RRPV_DISTANT);
+            }
+
+            /* The three keep the same RRPVs, only insertion differs */
+            bool set_policy(const char *name) {
+                if(strequal(name, "srrip")) mode_ = RRIP_STATIC;
+                else if(strequal(name, "brrip")) mode_ = RRIP_BIMODAL;
+                else if(strequal(name, "drrip")) mode_ = RRIP_DYNAMIC;
+                else return false;
+                return true;
+            }
+        };
+
+    template <int SET_COUNT, int WAY_COUNT>
+        struct SRRIP : public RRIP<SET_COUNT, WAY_COUNT, RRIP_STATIC> { };
+
+    template <int SET_COUNT, int WAY_COUNT>
+        struct BRRIP : public RRIP<SET_COUNT, WAY_COUNT, RRIP_BIMODAL> { };
+
+    template <int SET_COUNT, int WAY_COUNT>
+        struct DRRIP : public RRIP<SET_COUNT, WAY_COUNT, RRIP_DYNAMIC> { };
+
+};
+
+#endif // REPLACEMENT_H
@@ -0,0 +1,66 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <requestLatency.h>
+#include <memoryRequest.h>
+
+using namespace Memory;
+
+bool Memory::request_latency_enabled = false;
+
+/* Created on first registration, components of all machines go here */
+static Statable *request_latency_root = NULL;
+static dynarray<RequestLatencyStats*> request_latency_nodes;
+
+W16 Memory::request_latency_register(const char *component)
+{
+    if (!request_latency_root) {
+        request_latency_root = new Statable("memory_latency");
+        request_latency_root->disable_dump();
+    }
+
+    foreach (i, request_latency_nodes.length) {
+        if (strequal(request_latency_nodes[i]->get_name(), component))
+            return W16(i);
+    }
+
+    RequestLatencyStats *node = new RequestLatencyStats(component,
+            request_latency_root);
+    request_latency_nodes.push(node);
+    return W16(request_latency_nodes.length - 1);
+}
+
+void Memory::request_latency_record(MemoryRequest *request, W16 cpu)
+{
+    const RequestHops &hops = request->get_hops();
+    W64 total = sim_cycle - request->get_init_cycles();
+    bool kernel = request->is_kernel();
+
+    foreach (i, hops.count) {
+        if (hops.component[i] == cpu)
+            continue;
+
+        W64 until = (i + 1 < hops.count) ? hops.arrive[i + 1] : total;
+        W64 local = (until > hops.arrive[i]) ? until - hops.arrive[i] : 0;
+        RequestLatencyStats &node = *request_latency_nodes[hops.component[i]];
+        N_STAT_UPDATE(node, .record(local), kernel);
+    }
+
+    RequestLatencyStats &node = *request_latency_nodes[cpu];
+    N_STAT_UPDATE(node, .record(total), kernel);
+}
+
+void Memory::request_latency_set_stats()
+{
+    if (!request_latency_root || !request_latency_enabled)
+        return;
+
+    request_latency_root->enable_dump();
+}
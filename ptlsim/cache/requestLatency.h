@@ -0,0 +1,68 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef REQUEST_LATENCY_H
+#define REQUEST_LATENCY_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+class MemoryRequest;
+
+/*
+ * Per hop latency of memory requests ('-mem-latency')
+ *
+ * Every controller and interconnect registers as a component. With the
+ * option set, a request records the cycle it first reaches each component
+ * (see RequestHops), and when it completes in its CPU controller the time
+ * between consecutive arrivals is charged to each hop: queueing, lookup
+ * and hand over to the next component. The last component the request
+ * reached before coming back, such as the memory controller, is charged
+ * until the response arrives at the CPU controller, which itself gets the
+ * end to end latency of its core's requests. Hits in the L1 fast path
+ * never leave the core and are not recorded.
+ *
+ * Distributions are StatHistograms written to the 'memory_latency' stats
+ * node:
+ *
+ *   memory_latency:
+ *     L2_0: {count: .., mean: .., p50: .., p90: .., p95: .., p99: .., max: ..}
+ *     core_0_cont: {...}
+ */
+extern bool request_latency_enabled;
+
+typedef StatHistogram<> RequestLatencyStats;
+
+/**
+ * @brief Component id of a controller or interconnect
+ *
+ * Registering the same name again returns the same id.
+ */
+W16 request_latency_register(const char *component);
+
+/**
+ * @brief Charge a completed request to the components it went through
+ *
+ * @param request Request that just completed
+ * @param cpu Component id of the CPU controller it completed in
+ */
+void request_latency_record(MemoryRequest *request, W16 cpu);
+
+/**
+ * @brief Dump the 'memory_latency' node if '-mem-latency' is set
+ */
+void request_latency_set_stats();
+
+};
+
+#endif // REQUEST_LATENCY_H
@@ -0,0 +1,150 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statelist.h>
+#include <memoryStats.h>
+
+#include <new>
+
+namespace Memory {
+
+/*
+ * SlabPool
+ *
+ * Pool of FixStateListObjects that grows by SLAB entries whenever it runs
+ * dry, so the number of objects in use is not limited at compile time.
+ * Slabs are allocated on cache line boundaries: objects declared
+ * CACHE_LINE_ALIGNED never share a line with their neighbours or cross
+ * more lines than their size needs.
+ *
+ * If stats are given, the pool keeps the highest number of objects in
+ * use, the number of slabs in them and the time weighted number in use,
+ * in user stats as the pool serves both modes.
+ */
+#define CACHE_LINE_ALIGNED __attribute__((aligned(64)))
+
+template <typename T, int SLAB>
+class SlabPool
+{
+	public:
+		SlabPool()
+			: used_(0)
+			, peakUsed_(0)
+			, stats_(NULL)
+		{
+			grow();
+		}
+
+		~SlabPool()
+		{
+			foreach(i, slabs_.count()) {
+				foreach(j, SLAB) slabs_[i][j].~T();
+				::free(slabs_[i]);
+			}
+			slabs_.clear();
+		}
+
+		void set_stats(PoolStats *stats)
+		{
+			stats_ = stats;
+			if(stats_) {
+				W64 slabs = slabs_.count();
+				stats_->slabs = slabs;
+				stats_->peak_used = peakUsed_;
+			}
+		}
+
+		T* alloc()
+		{
+			if unlikely (freeList_.empty())
+				grow();
+
+			T *obj = (T*)freeList_.dequeue();
+			obj->free = false;
+
+			if unlikely (++used_ > peakUsed_) {
+				peakUsed_ = used_;
+				if(stats_) stats_->peak_used = peakUsed_;
+			}
+
+			if(stats_) stats_->occupancy.update(used_, sim_cycle, user_stats);
+
+			return obj;
+		}
+
+		void free(T *obj)
+		{
+			assert(!obj->free);
+			obj->free = true;
+			freeList_.enqueue((selfqueuelink*)obj);
+			used_--;
+
+			if(stats_) stats_->occupancy.update(used_, sim_cycle, user_stats);
+		}
+
+		/* Put every object back on the free list, keeping the slabs */
+		void reset()
+		{
+			freeList_.reset();
+			foreach(i, slabs_.count()) {
+				foreach(j, SLAB) {
+					slabs_[i][j].free = true;
+					freeList_.enqueue((selfqueuelink*)&slabs_[i][j]);
+				}
+			}
+			used_ = 0;
+
+			if(stats_) stats_->occupancy.update(0, sim_cycle, user_stats);
+		}
+
+		int capacity() const { return slabs_.count() * SLAB; }
+		int used() const { return used_; }
+		W64 peak_used() const { return peakUsed_; }
+
+	private:
+		StateList freeList_;
+		dynarray<T*> slabs_;
+		W64 used_;
+		W64 peakUsed_;
+		PoolStats *stats_;
+
+		void grow()
+		{
+			int base = capacity();
+			void *mem = NULL;
+
+			if(posix_memalign(&mem, 64, sizeof(T) * SLAB) != 0)
+				assert_fail(__STRING(posix_memalign), __FILE__, __LINE__,
+						__PRETTY_FUNCTION__);
+
+			T *slab = (T*)mem;
+			foreach(i, SLAB) {
+				new (&slab[i]) T();
+				slab[i].idx = base + i;
+				slab[i].free = true;
+				freeList_.enqueue((selfqueuelink*)&slab[i]);
+			}
+
+			slabs_.push(slab);
+			if(stats_) {
+				W64 slabs = slabs_.count();
+				stats_->slabs = slabs;
+			}
+		}
+};
+
+};
+
+#endif // SLAB_POOL_H
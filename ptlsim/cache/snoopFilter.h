@@ -0,0 +1,164 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef SNOOP_FILTER_H
+#define SNOOP_FILTER_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+/**
+ * @brief Snoop filter of a split phase bus
+ *
+ * Enabled with 'snoop_filter' in the bus' machine config options, the
+ * number of lines it tracks, in sets of 'snoop_filter_ways' (8) lines
+ * replaced LRU. Lines are 'snoop_filter_line' (64) bytes, at least the
+ * line size of the caches on the bus. A tracked line has a mask of the
+ * bus' controllers that may hold it, and its address phases only go to
+ * the private controllers in the mask. The others aren't snooped and
+ * count as having answered without the line. Shared controllers always
+ * see every request.
+ *
+ * The mask is a superset of the holders: a controller is added when it
+ * puts a read or write of the line on the bus, and removed only after it
+ * answered a snoop without keeping the line while it had no request of
+ * its own for the line pending. A line that isn't tracked, never seen or
+ * its entry replaced, may be held anywhere and is snooped everywhere, so
+ * replacing an entry needs no back invalidation. Functional warmup puts
+ * lines in the caches without going over the bus, forget() is called
+ * after it.
+ */
+struct SnoopFilter {
+    static const W64 INVALID_LINE = W64(-1);
+
+    struct Entry {
+        W64 line;
+        W64 sharers;
+        W64 lastUse;
+    };
+
+    dynarray<Entry> entries;
+    int sets;
+    int ways;
+    int lineBits;
+    W64 useClock;
+
+    SnoopFilter() : sets(0), ways(0), lineBits(6), useClock(0) {}
+
+    bool enabled() const { return sets > 0; }
+
+    void setup(int size, int ways_, int lineSize) {
+        ways = max(min(ways_, size), 1);
+        sets = size / ways;
+        lineBits = lsbindex64(W64(lineSize));
+        entries.resize(sets * ways);
+        forget();
+    }
+
+    W64 get_line(W64 address) const { return address >> lineBits; }
+
+    /* Lines may be held anywhere again */
+    void forget() {
+        foreach (i, entries.count()) {
+            entries[i].line = INVALID_LINE;
+            entries[i].sharers = 0;
+            entries[i].lastUse = 0;
+        }
+    }
+
+    /* Entry of a tracked line, NULL if it may be held anywhere */
+    Entry* find(W64 line) {
+        if (!enabled())
+            return NULL;
+
+        Entry *set = &entries[(line % sets) * ways];
+        foreach (i, ways) {
+            if (set[i].line == line) {
+                set[i].lastUse = ++useClock;
+                return &set[i];
+            }
+        }
+        return NULL;
+    }
+
+    /*
+     * Entry of line, a new one in place of the LRU line of its set has all
+     * controllers as sharers. replaced is set if that line was still held.
+     */
+    Entry* track(W64 line, bool &replaced) {
+        replaced = false;
+
+        Entry *entry = find(line);
+        if (entry)
+            return entry;
+
+        Entry *set = &entries[(line % sets) * ways];
+        Entry *victim = &set[0];
+        foreach (i, ways) {
+            if (set[i].line == INVALID_LINE) {
+                victim = &set[i];
+                break;
+            }
+            if (set[i].lastUse < victim->lastUse)
+                victim = &set[i];
+        }
+
+        replaced = (victim->line != INVALID_LINE && victim->sharers);
+        victim->line = line;
+        victim->sharers = W64(-1);
+        victim->lastUse = ++useClock;
+        return victim;
+    }
+};
+
+/*
+ * Written under the bus' node:
+ *
+ *   split_bus_0:
+ *     snoop_filter:
+ *       lookups: .., hits: .., hit_rate: .., replaced: .., removed: ..,
+ *       snoops: .., filtered: ..
+ *
+ * lookups are address phases of reads and writes, hits the ones of a
+ * tracked line. snoops and filtered count private controllers that were
+ * and weren't sent an address phase, removed the sharers dropped from a
+ * mask after their answer.
+ */
+struct SnoopFilterStats : public Statable
+{
+    StatObj<W64> lookups;
+    StatObj<W64> hits;
+    StatEquation<W64, double, StatObjFormulaDiv> hit_rate;
+    StatObj<W64> replaced;
+    StatObj<W64> removed;
+    StatObj<W64> snoops;
+    StatObj<W64> filtered;
+
+    SnoopFilterStats(Statable *parent)
+        : Statable("snoop_filter", parent)
+          , lookups("lookups", this)
+          , hits("hits", this)
+          , hit_rate("hit_rate", this)
+          , replaced("replaced", this)
+          , removed("removed", this)
+          , snoops("snoops", this)
+          , filtered("filtered", this)
+    {
+        hit_rate.add_elem(&hits);
+        hit_rate.add_elem(&lookups);
+    }
+};
+
+};
+
+#endif // SNOOP_FILTER_H
@@ -44,8 +44,13 @@ BusInterconnect::BusInterconnect(const char *name,
         MemoryHierarchy *memoryHierarchy) :
     Interconnect(name,memoryHierarchy)
     , lastAccessQueue(NULL)
-    , busBusy_(false)
+    , readyQueues_(0)
+    , busyPhases_(0)
+    , waitingPhases_(0)
+    , waitingData_(NULL)
     , dataBusBusy_(false)
+    , filterStats_(NULL)
+    , filterWarmAccesses_(0)
 {
     memoryHierarchy_->add_interconnect(this);
     new_stats = new BusStats(name, &memoryHierarchy->get_machine());
@@ -60,8 +65,17 @@ BusInterconnect::BusInterconnect(const char *name,
     SET_SIGNAL_CB(name, "_Data_Broadcast_Complete", dataBroadcastCompleted_,
             &BusInterconnect::data_broadcast_completed_cb);
 
+    SET_SIGNAL_CB(name, "_Space_Free", spaceFree_,
+            &BusInterconnect::space_free_cb);
+
     new_stats->set_default_stats(user_stats);
 
+    /* Address and data bus are time-stats columns, see LinkStats */
+    if(config.bandwidth_timeline) {
+        new_stats->addr_bus_cycles.enable_periodic_dump();
+        new_stats->data_bus_cycles.enable_periodic_dump();
+    }
+
     if(!memoryHierarchy_->get_machine().get_option(name, "latency", latency_)) {
         latency_ = BUS_BROADCASTS_DELAY;
     }
@@ -75,10 +89,40 @@ BusInterconnect::BusInterconnect(const char *name,
 				snoopDisabled_)) {
 		snoopDisabled_ = false;
 	}
+
+    /*
+     * Number of address phases that can be in flight at once, each one
+     * arbitrating and broadcasting a different controller's request
+     */
+    if(!memoryHierarchy_->get_machine().get_option(name, "address_phases",
+                addressPhases_) || addressPhases_ < 1) {
+        addressPhases_ = 1;
+    }
+
+    int filterSize = 0;
+    int filterWays = 8;
+    int filterLine = 64;
+    memoryHierarchy_->get_machine().get_option(name, "snoop_filter",
+            filterSize);
+    memoryHierarchy_->get_machine().get_option(name, "snoop_filter_ways",
+            filterWays);
+    memoryHierarchy_->get_machine().get_option(name, "snoop_filter_line",
+            filterLine);
+    if(filterSize > 0) {
+        if(filterLine <= 0 || (filterLine & (filterLine - 1))) {
+            ptl_logfile << "ERROR: ", name, " needs a power of two ",
+                        "snoop_filter_line", endl;
+            assert(0);
+        }
+
+        snoopFilter_.setup(filterSize, filterWays, filterLine);
+        filterStats_ = new SnoopFilterStats(new_stats);
+    }
 }
 
 BusInterconnect::~BusInterconnect()
 {
+    delete filterStats_;
     delete new_stats;
 }
 
@@ -86,6 +130,7 @@ void BusInterconnect::register_controller(Controller *controller)
 {
     BusControllerQueue *busControllerQueue = new BusControllerQueue();
     busControllerQueue->controller = controller;
+    busControllerQueue->inFlight = NULL;
 
     /* Set controller pointer in each queue entry */
     BusQueueEntry *entry;
@@ -96,6 +141,8 @@ void BusInterconnect::register_controller(Controller *controller)
         entry->controllerQueue = busControllerQueue;
     }
 
+    /* One bit per controller in readyQueues_ */
+    assert(controllers.count() < 64);
     busControllerQueue->idx = controllers.count();
     controllers.push(busControllerQueue);
 }
@@ -112,21 +159,27 @@ void BusInterconnect::annul_request(MemoryRequest *request)
         BusQueueEntry *entry;
         foreach_list_mutable(controllers[i]->queue.list(),
                 entry, entry_t, nextentry_t) {
-            if(entry->request->is_same(request)) {
+            if(entry->request == request) {
                 entry->annuled = true;
                 entry->request->decRefCounter();
+                if(controllers[i]->inFlight == entry)
+                    controllers[i]->inFlight = NULL;
                 controllers[i]->queue.free(entry);
             }
         }
+        update_ready(controllers[i]);
     }
     PendingQueueEntry *queueEntry;
     foreach_list_mutable(pendingRequests_.list(), queueEntry,
             entry, nextentry) {
-        if(queueEntry->request->is_same(request)) {
+        if(queueEntry->request == request) {
             queueEntry->annuled = true;
             queueEntry->request->decRefCounter();
             ADD_HISTORY_REM(queueEntry->request);
             pendingRequests_.free(queueEntry);
+            update_queue_occupancy();
+            if(waitingPhases_)
+                space_free_cb(NULL);
         }
     }
 }
@@ -167,6 +220,9 @@ bool BusInterconnect::controller_request_cb(void *arg)
             if(sender->is_private()) {
                 pendingEntry->shared |= message->isShared;
 
+                if(filterStats_)
+                    filter_response(pendingEntry, idx, message);
+
                 /*
                  * If same level cache responed with data indicating via shared
                  * flag, then we can emit 'annul' signal to all other
@@ -224,12 +280,12 @@ bool BusInterconnect::controller_request_cb(void *arg)
     busQueueEntry->request = message->request;
     message->request->incRefCounter();
     busQueueEntry->hasData = message->hasData;
-
+    update_ready(busControllerQueue);
 
     if(!is_busy()) {
         /* address bus */
         marss_add_event(&broadcast_, 1, NULL);
-        set_bus_busy(true);
+        busyPhases_++;
     } else {
         N_STAT_UPDATE(new_stats->bus_not_ready, ++, kernel);
         memdebug("Bus is busy\n");
@@ -241,44 +297,189 @@ bool BusInterconnect::controller_request_cb(void *arg)
 BusQueueEntry* BusInterconnect::arbitrate_round_robin()
 {
     memdebug("BUS:: doing arbitration.. \n");
-    BusControllerQueue *controllerQueue;
-    int i;
-    if(lastAccessQueue)
-        i = lastAccessQueue->idx;
-    else
-        i = 0;
-
-    do {
-        i = (i + 1) % controllers.count();
-        controllerQueue = controllers[i];
-
-        if(controllerQueue->queue.count() > 0) {
-            BusQueueEntry *queueEntry = (BusQueueEntry*)
-                controllerQueue->queue.peek();
-            assert(queueEntry);
-            assert(!queueEntry->annuled);
-            lastAccessQueue = controllerQueue;
-            return queueEntry;
+
+    if(!readyQueues_)
+        return NULL;
+
+    /* First ready queue after the last one granted, wrapping around */
+    int start = lastAccessQueue ? lastAccessQueue->idx + 1 : 1;
+    start %= controllers.count();
+
+    W64 after = readyQueues_ & (W64(-1) << start);
+    int i = lsbindex64(after ? after : readyQueues_);
+    BusControllerQueue *controllerQueue = controllers[i];
+
+    BusQueueEntry *queueEntry = (BusQueueEntry*)
+        controllerQueue->queue.peek();
+    assert(queueEntry);
+    assert(!queueEntry->annuled);
+
+    /* A more urgent head wins, ties keep the round robin order */
+    if(priority_scheduling) {
+        W64 order[2] = { after, readyQueues_ & ~after };
+        foreach(k, 2) {
+            W64 ready = order[k];
+            while(ready) {
+                int j = lsbindex64(ready);
+                ready &= ready - 1;
+
+                BusQueueEntry *head = (BusQueueEntry*)
+                    controllers[j]->queue.peek();
+                if(more_urgent(head->request, queueEntry->request)) {
+                    controllerQueue = controllers[j];
+                    queueEntry = head;
+                }
+            }
         }
-    } while(controllerQueue != lastAccessQueue);
+        assert(!queueEntry->annuled);
+    }
+
+    /* Other address phases skip this queue until its head is done */
+    controllerQueue->inFlight = queueEntry;
+    update_ready(controllerQueue);
+    lastAccessQueue = controllerQueue;
+    return queueEntry;
+}
+
+void BusInterconnect::update_ready(BusControllerQueue *queue)
+{
+    W64 bit = W64(1) << queue->idx;
+    if(queue->queue.count() > 0 && !queue->inFlight)
+        readyQueues_ |= bit;
+    else
+        readyQueues_ &= ~bit;
+}
 
-    return NULL;
+/*
+ * Give the head entry taken by an address phase back to arbitration, it is
+ * either broadcast and freed or has to wait for the snoopers.
+ */
+void BusInterconnect::release_entry(BusControllerQueue *queue)
+{
+    queue->inFlight = NULL;
+    update_ready(queue);
 }
 
-bool BusInterconnect::can_broadcast(BusControllerQueue *queue, MemoryRequest *request)
+bool BusInterconnect::can_broadcast(BusControllerQueue *queue, MemoryRequest *request,
+        Controller **fullController)
 {
-    bool isFull = false;
+    W64 address = request->get_physical_address();
     foreach(i, controllers.count()) {
         if(controllers[i]->controller == queue->controller)
             continue;
-        isFull |= controllers[i]->controller->is_full(true, request);
+        /* Slices of a banked cache that don't hold the line won't see it */
+        if(!controllers[i]->controller->owns_line(address))
+            continue;
+        /* One full snooper is enough to hold the broadcast */
+        if(controllers[i]->controller->is_full(true, request)) {
+            if(fullController)
+                *fullController = controllers[i]->controller;
+            return false;
+        }
     }
-    if(isFull) {
+    return true;
+}
+
+/*
+ * Wait for fullController to free an entry, returns false if it can't tell
+ * when that happens and the caller has to retry.
+ */
+bool BusInterconnect::wait_for_space(Controller *fullController)
+{
+    if(!fullController->notifies_space())
         return false;
+
+    memoryHierarchy_->wait_for_space(fullController, &spaceFree_);
+    return true;
+}
+
+bool BusInterconnect::space_free_cb(void *arg)
+{
+    int phases = waitingPhases_;
+    waitingPhases_ = 0;
+    while(phases-- > 0)
+        marss_add_event(&broadcast_, 1, NULL);
+
+    if(waitingData_) {
+        marss_add_event(&dataBroadcast_, 1, waitingData_);
+        waitingData_ = NULL;
     }
+
     return true;
 }
 
+/*
+ * Controllers the address phase of queueEntry goes to, see SnoopFilter.
+ * Reads and writes make their sender a sharer of the line.
+ */
+W64 BusInterconnect::snoop_targets(BusQueueEntry *queueEntry)
+{
+    if(!filterStats_)
+        return W64(-1);
+
+    if(memoryHierarchy_->get_warm_accesses() != filterWarmAccesses_) {
+        filterWarmAccesses_ = memoryHierarchy_->get_warm_accesses();
+        snoopFilter_.forget();
+    }
+
+    MemoryRequest *request = queueEntry->request;
+    W64 line = snoopFilter_.get_line(request->get_physical_address());
+    OP_TYPE type = request->get_type();
+
+    if(type != MEMORY_OP_READ && type != MEMORY_OP_WRITE) {
+        SnoopFilter::Entry *filterEntry = snoopFilter_.find(line);
+        return filterEntry ? filterEntry->sharers : W64(-1);
+    }
+
+    bool kernel = request->is_kernel();
+    N_STAT_UPDATE(filterStats_->lookups, ++, kernel);
+
+    SnoopFilter::Entry *filterEntry = snoopFilter_.find(line);
+    if(filterEntry) {
+        N_STAT_UPDATE(filterStats_->hits, ++, kernel);
+    } else {
+        bool replaced;
+        filterEntry = snoopFilter_.track(line, replaced);
+        if(replaced)
+            N_STAT_UPDATE(filterStats_->replaced, ++, kernel);
+    }
+
+    W64 sharers = filterEntry->sharers;
+    filterEntry->sharers |= W64(1) << queueEntry->controllerQueue->idx;
+    return sharers;
+}
+
+/*
+ * Drop controllers[idx] from the sharers of the line of pendingEntry if
+ * it answered without keeping the line, writes invalidate it, and no
+ * request of its own for the line is pending
+ */
+void BusInterconnect::filter_response(PendingQueueEntry *pendingEntry,
+        int idx, Message *message)
+{
+    MemoryRequest *request = pendingEntry->request;
+    if(request->get_type() != MEMORY_OP_WRITE &&
+            (message->isShared || message->hasData))
+        return;
+
+    W64 line = snoopFilter_.get_line(request->get_physical_address());
+    SnoopFilter::Entry *filterEntry = snoopFilter_.find(line);
+    W64 bit = W64(1) << idx;
+    if(!filterEntry || !(filterEntry->sharers & bit))
+        return;
+
+    PendingQueueEntry *other;
+    foreach_list_mutable(pendingRequests_.list(), other,
+            entry, nextentry) {
+        if(other->controllerQueue->idx == idx && snoopFilter_.get_line(
+                    other->request->get_physical_address()) == line)
+            return;
+    }
+
+    filterEntry->sharers &= ~bit;
+    N_STAT_UPDATE(filterStats_->removed, ++, request->is_kernel());
+}
+
 bool BusInterconnect::broadcast_cb(void *arg)
 {
     BusQueueEntry *queueEntry;
@@ -291,7 +492,14 @@ bool BusInterconnect::broadcast_cb(void *arg)
     }
 
     if(queueEntry == NULL || queueEntry->annuled) { // nothing to broadcast
-        set_bus_busy(false);
+        busyPhases_--;
+        return true;
+    }
+
+    /* Wrong path request, arbitrate again once the hierarchy dropped it */
+    if unlikely (memoryHierarchy_->drop_annuled(queueEntry->request)) {
+        release_entry(queueEntry->controllerQueue);
+        marss_add_event(&broadcast_, 1, NULL);
         return true;
     }
 
@@ -302,8 +510,8 @@ bool BusInterconnect::broadcast_cb(void *arg)
     if(pendingRequests_.isFull() &&
             queueEntry->request->get_type() != MEMORY_OP_UPDATE) {
         memdebug("Bus cant do addr broadcast, pending queue full\n");
-        marss_add_event(&broadcast_,
-                latency_, NULL);
+        release_entry(queueEntry->controllerQueue);
+        waitingPhases_++;
         return true;
     }
 
@@ -313,16 +521,18 @@ bool BusInterconnect::broadcast_cb(void *arg)
      * entry and  pass the queue entry as argument to the broadcast
      * signal so next time it doesn't need to arbitrate
      */
-    if(!can_broadcast(queueEntry->controllerQueue, queueEntry->request)) {
+    Controller *fullController = NULL;
+    if(!can_broadcast(queueEntry->controllerQueue, queueEntry->request,
+                &fullController)) {
         memdebug("Bus cant do addr broadcast\n");
-        set_bus_busy(true);
-        marss_add_event(&broadcast_,
-                latency_, NULL);
+        release_entry(queueEntry->controllerQueue);
+        if(wait_for_space(fullController))
+            waitingPhases_++;
+        else
+            marss_add_event(&broadcast_, latency_, NULL);
         return true;
     }
 
-    set_bus_busy(true);
-
     marss_add_event(&broadcastCompleted_,
             latency_, queueEntry);
 
@@ -331,7 +541,7 @@ bool BusInterconnect::broadcast_cb(void *arg)
 
 bool BusInterconnect::broadcast_completed_cb(void *arg)
 {
-    assert(is_busy());
+    assert(busyPhases_ > 0);
     BusQueueEntry *queueEntry = (BusQueueEntry*)arg;
 
     if(queueEntry == NULL || queueEntry->annuled) {
@@ -339,10 +549,22 @@ bool BusInterconnect::broadcast_completed_cb(void *arg)
         return true;
     }
 
-	if(!can_broadcast(queueEntry->controllerQueue, queueEntry->request)) {
-		set_bus_busy(true);
-		marss_add_event(&broadcastCompleted_,
-				2, NULL);
+    bool needsPending = queueEntry->request->get_type() != MEMORY_OP_UPDATE &&
+        queueEntry->request->get_type() != MEMORY_OP_EVICT;
+
+    /*
+     * Another address phase may have taken the last pending entry since
+     * this one started
+     */
+    Controller *fullController = NULL;
+    bool snoopersReady = can_broadcast(queueEntry->controllerQueue,
+            queueEntry->request, &fullController);
+	if(!snoopersReady || (needsPending && pendingRequests_.isFull())) {
+        release_entry(queueEntry->controllerQueue);
+        if(snoopersReady || wait_for_space(fullController))
+            waitingPhases_++;
+        else
+            marss_add_event(&broadcastCompleted_, 2, NULL);
 		return true;
 	}
 
@@ -350,9 +572,9 @@ bool BusInterconnect::broadcast_completed_cb(void *arg)
 
     /* now create an entry into pendingRequests_ */
     PendingQueueEntry *pendingEntry = NULL;
-    if(queueEntry->request->get_type() != MEMORY_OP_UPDATE &&
-			queueEntry->request->get_type() != MEMORY_OP_EVICT) {
+    if(needsPending) {
         pendingEntry = pendingRequests_.alloc();
+        update_queue_occupancy();
         assert(pendingEntry);
         pendingEntry->request = queueEntry->request;
         pendingEntry->request->incRefCounter();
@@ -370,29 +592,41 @@ bool BusInterconnect::broadcast_completed_cb(void *arg)
     message.origin = NULL;
 
     Controller *controller = queueEntry->controllerQueue->controller;
+    W64 address = queueEntry->request->get_physical_address();
+    bool kernel = queueEntry->request->is_kernel();
+    W64 sharers = snoop_targets(queueEntry);
 
     foreach(i, controllers.count()) {
-        if(controller != controllers[i]->controller) {
-            bool ret = controllers[i]->controller->
-                get_interconnect_signal()->emit(&message);
-            assert(ret);
-        } else {
+        Controller *snooper = controllers[i]->controller;
+        bool skip = controller == snooper || !snooper->owns_line(address);
+        bool filtered = !skip && snooper->is_private() &&
+            !(sharers & (W64(1) << i));
+
+        if(skip || filtered) {
             /*
-             * its the originating controller, mark its
-             * response received flag to true
+             * its the originating controller, a slice of banked cache
+             * that doesn't hold this line or a private cache the snoop
+             * filter knows doesn't, mark its response received flag
+             * to true
              */
             if(pendingEntry)
                 pendingEntry->responseReceived[i] = true;
+            if(filtered)
+                N_STAT_UPDATE(filterStats_->filtered, ++, kernel);
+        } else {
+            bool ret = snooper->get_interconnect_signal()->emit(&message);
+            assert(ret);
+            if(filterStats_ && snooper->is_private())
+                N_STAT_UPDATE(filterStats_->snoops, ++, kernel);
         }
     }
 
-    bool kernel = queueEntry->request->is_kernel();
-
     /* Free the entry from queue */
     queueEntry->request->decRefCounter();
     if(!queueEntry->annuled) {
         queueEntry->controllerQueue->queue.free(queueEntry);
     }
+    release_entry(queueEntry->controllerQueue);
     if(!queueEntry->controllerQueue->queue.isFull()) {
         memoryHierarchy_->set_interconnect_full(this, false);
     }
@@ -463,9 +697,13 @@ bool BusInterconnect::data_broadcast_cb(void *arg)
      * entry and  pass the queue entry as argument to the broadcast
      * signal so next time it doesn't need to arbitrate
      */
-    if(!can_broadcast(pendingEntry->controllerQueue, pendingEntry->request)) {
-        marss_add_event(&dataBroadcast_,
-                latency_, arg);
+    Controller *fullController = NULL;
+    if(!can_broadcast(pendingEntry->controllerQueue, pendingEntry->request,
+                &fullController)) {
+        if(wait_for_space(fullController))
+            waitingData_ = pendingEntry;
+        else
+            marss_add_event(&dataBroadcast_, latency_, arg);
         return true;
     }
 
@@ -497,12 +735,17 @@ bool BusInterconnect::data_broadcast_completed_cb(void *arg)
     message.isShared = pendingEntry->shared;
     message.origin = NULL;
 
+    W64 address = pendingEntry->request->get_physical_address();
+
     foreach(i, controllers.count()) {
         if(pendingEntry->controllerWithData == controllers[i]->controller) {
             /* Don't send the data message back to the responding controller */
             continue;
         }
 
+        if(!controllers[i]->controller->owns_line(address))
+            continue;
+
         bool ret = controllers[i]->controller->
             get_interconnect_signal()->emit(&message);
         assert(ret);
@@ -524,7 +767,10 @@ bool BusInterconnect::data_broadcast_completed_cb(void *arg)
 
     pendingEntry->request->decRefCounter();
     pendingRequests_.free(pendingEntry);
+    update_queue_occupancy();
     ADD_HISTORY_REM(pendingEntry->request);
+    if(waitingPhases_)
+        space_free_cb(NULL);
 
     memoryHierarchy_->free_message(&message);
 
@@ -545,6 +791,14 @@ void BusInterconnect::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "type", "interconnect");
 	YAML_KEY_VAL(out, "latency", latency_);
 	YAML_KEY_VAL(out, "arbitrate_latency", arbitrate_latency_);
+	YAML_KEY_VAL(out, "address_phases", addressPhases_);
+	if (snoopFilter_.enabled()) {
+		YAML_KEY_VAL(out, "snoop_filter",
+				snoopFilter_.sets * snoopFilter_.ways);
+		YAML_KEY_VAL(out, "snoop_filter_ways", snoopFilter_.ways);
+		YAML_KEY_VAL(out, "snoop_filter_line",
+				1 << snoopFilter_.lineBits);
+	}
 	if (controllers.size() > 0)
 		YAML_KEY_VAL(out, "per_cont_queue_size",
 				controllers[0]->queue.size());
@@ -30,6 +30,7 @@
 
 #include <interconnect.h>
 #include <memoryStats.h>
+#include <snoopFilter.h>
 
 namespace Memory {
 
@@ -125,6 +126,8 @@ struct BusControllerQueue
 {
 	int idx;
 	Controller *controller;
+	/* Head entry taken by an address phase, NULL if none */
+	BusQueueEntry *inFlight;
 	FixStateList<BusQueueEntry, 16> queue;
 	FixStateList<BusQueueEntry, 16> dataQueue;
 };
@@ -135,7 +138,23 @@ class BusInterconnect : public Interconnect
 		dynarray<BusControllerQueue*> controllers;
 		BusControllerQueue* lastAccessQueue;
 		FixStateList<PendingQueueEntry, 32> pendingRequests_;
-		bool busBusy_;
+		/*
+		 * Bit i is set when controllers[i] has a queued entry that no
+		 * address phase has taken yet, so arbitration doesn't have to
+		 * walk the empty queues.
+		 */
+		W64 readyQueues_;
+		/* Address phases in flight, at most addressPhases_ */
+		int busyPhases_;
+		int addressPhases_;
+		/*
+		 * Address phases and data broadcast blocked on a full snooper or
+		 * a full pending queue, restarted by spaceFree_ when it frees an
+		 * entry instead of retrying every few cycles.
+		 */
+		int waitingPhases_;
+		PendingQueueEntry *waitingData_;
+		Signal spaceFree_;
 		bool dataBusBusy_;
 		bool snoopDisabled_;
 		Signal broadcast_;
@@ -144,20 +163,35 @@ class BusInterconnect : public Interconnect
 		Signal dataBroadcastCompleted_;
         BusStats *new_stats;
 
+        /* After each alloc and free of pendingRequests_ */
+        void update_queue_occupancy() {
+            new_stats->queue_occupancy.update(pendingRequests_.count(),
+                    sim_cycle, user_stats);
+        }
+
+        /* See SnoopFilter, filterStats_ is NULL without one */
+        SnoopFilter snoopFilter_;
+        SnoopFilterStats *filterStats_;
+        W64 filterWarmAccesses_;
+
         int latency_;
         int arbitrate_latency_;
 
 		BusQueueEntry *arbitrate_round_robin();
-		bool can_broadcast(BusControllerQueue *queue, MemoryRequest *request);
+		void update_ready(BusControllerQueue *queue);
+		void release_entry(BusControllerQueue *queue);
+		bool can_broadcast(BusControllerQueue *queue, MemoryRequest *request,
+				Controller **fullController = NULL);
+		bool wait_for_space(Controller *fullController);
+		W64 snoop_targets(BusQueueEntry *queueEntry);
+		void filter_response(PendingQueueEntry *pendingEntry, int idx,
+				Message *message);
 
 	public:
 		BusInterconnect(const char *name, MemoryHierarchy *memoryHierarchy);
         ~BusInterconnect();
 
-		bool is_busy(){ return busBusy_; }
-		void set_bus_busy(bool flag){
-			busBusy_ = flag;
-		}
+		bool is_busy(){ return busyPhases_ >= addressPhases_; }
 		bool controller_request_cb(void *arg);
 		void register_controller(Controller *controller);
 		int access_fast_path(Controller *controller,
@@ -196,6 +230,7 @@ class BusInterconnect : public Interconnect
 		bool broadcast_completed_cb(void *arg);
 		bool data_broadcast_cb(void *arg);
 		bool data_broadcast_completed_cb(void *arg);
+		bool space_free_cb(void *arg);
 };
 
 static inline ostream& operator <<(ostream& os,
@@ -0,0 +1,69 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <ptlsim.h>
+#include <machine.h>
+#include <stackDistance.h>
+
+using namespace Memory;
+
+namespace {
+    struct StackDistanceEntry {
+        StackDistanceProfile *profile;
+        StackDistanceStats *stats;
+    };
+
+    dynarray<StackDistanceEntry> profiles;
+};
+
+StackDistanceProfile* Memory::stack_distance_create(BaseMachine &machine,
+        const char *name, int set_count, int line_bits, Statable *parent)
+{
+    bool enabled = false;
+    if (!machine.get_option(name, "stack_distance", enabled) || !enabled)
+        return NULL;
+
+    StackDistanceEntry entry;
+    entry.profile = new StackDistanceProfile(set_count, line_bits);
+    entry.stats = new StackDistanceStats(*entry.profile, parent);
+    profiles.push(entry);
+
+    return entry.profile;
+}
+
+void Memory::stack_distance_set_stats()
+{
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+
+    foreach (i, profiles.length) {
+        StackDistanceProfile& profile = *profiles[i].profile;
+        StackDistanceStats& node = *profiles[i].stats;
+        W64 line_size = 1ULL << profile.line_bits;
+
+        foreach (s, 3) {
+            node.set_default_stats(stats[s]);
+            node.line_size = line_size;
+            node.accesses = profile.accesses;
+
+            foreach (p, StackDistanceProfile::SET_POINTS) {
+                StackDistancePointStats& point = *node.points[p];
+                W64 sets = profile.sets[p];
+                point.sets = sets;
+
+                foreach (w, StackDistanceProfile::MAX_WAYS) {
+                    W64 misses = profile.misses(p, w + 1);
+                    point.misses[w] = misses;
+                    point.miss_ratio[w] = profile.accesses ?
+                        double(misses) / double(profile.accesses) : 0;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,157 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+
+namespace Memory {
+
+/**
+ * @brief LRU stack distances of a cache's demand accesses (Mattson)
+ *
+ * Enabled per cache with 'stack_distance: true' in its machine config
+ * options. Every read and write the cache looks up is also run through
+ * per-set LRU stacks for SET_POINTS set counts, from a quarter to four
+ * times the cache's own. An access that finds its line at depth d of the
+ * stack hits in every LRU cache of that set count with more than d ways,
+ * so one pass gives the misses of all SET_POINTS x MAX_WAYS geometries of
+ * the cache's line size.
+ *
+ * Stacks are bounded at MAX_WAYS lines, deeper reuse and first touches
+ * count as misses of every geometry. The stack is a small array moved to
+ * front on each hit, which is cheaper than a tree at this depth.
+ */
+struct StackDistanceProfile {
+    static const int MAX_WAYS = 32;
+    static const int SET_POINTS = 5;
+    static const int BASE_POINT = 2; /* point of the cache's own set count */
+
+    int line_bits;
+    int sets[SET_POINTS];
+    W64 accesses;
+    W64 hist[SET_POINTS][MAX_WAYS + 1]; /* hits by depth, last: beyond */
+    dynarray<W64> stacks[SET_POINTS];   /* line + 1 per way, 0 if empty */
+
+    StackDistanceProfile(int set_count, int line_bits_) {
+        line_bits = line_bits_;
+        foreach (p, SET_POINTS) {
+            int shift = p - BASE_POINT;
+            sets[p] = (shift < 0) ? max(set_count >> -shift, 1)
+                : set_count << shift;
+            stacks[p].resize(sets[p] * MAX_WAYS);
+        }
+        reset();
+    }
+
+    void reset() {
+        accesses = 0;
+        foreach (p, SET_POINTS) {
+            foreach (d, MAX_WAYS + 1) hist[p][d] = 0;
+            foreach (i, stacks[p].length) stacks[p][i] = 0;
+        }
+    }
+
+    void access(W64 addr) {
+        W64 tag = (addr >> line_bits) + 1;
+        accesses++;
+
+        foreach (p, SET_POINTS) {
+            W64 *stack = &stacks[p][((tag - 1) & (sets[p] - 1)) * MAX_WAYS];
+            int depth = 0;
+
+            while (depth < MAX_WAYS && stack[depth] && stack[depth] != tag)
+                depth++;
+
+            bool found = (depth < MAX_WAYS && stack[depth] == tag);
+            hist[p][found ? depth : MAX_WAYS]++;
+
+            /* Move or insert to the front, dropping the LRU line if full */
+            int last = (depth < MAX_WAYS) ? depth : MAX_WAYS - 1;
+            for (int i = last; i > 0; i--) stack[i] = stack[i - 1];
+            stack[0] = tag;
+        }
+    }
+
+    /* Misses of the LRU cache with sets[point] sets and 'ways' ways */
+    W64 misses(int point, int ways) const {
+        W64 hits = 0;
+        foreach (d, ways) hits += hist[point][d];
+        return accesses - hits;
+    }
+};
+
+struct StackDistancePointStats : public Statable
+{
+    StatObj<W64> sets;
+    StatArray<W64, StackDistanceProfile::MAX_WAYS> misses;
+    StatArray<double, StackDistanceProfile::MAX_WAYS> miss_ratio;
+
+    StackDistancePointStats(stringbuf &name, Statable *parent)
+        : Statable(name, parent)
+          , sets("sets", this)
+          , misses("misses", this)
+          , miss_ratio("miss_ratio", this)
+    {}
+};
+
+/*
+ * Written to the 'stack_distance' node of the cache at the end of the run,
+ * entry w - 1 of misses and miss_ratio is for a cache of w ways:
+ *
+ *   L2_0:
+ *     stack_distance:
+ *       line_size: 64
+ *       accesses: ..
+ *       sets_256: {sets: 256, misses: [..], miss_ratio: [..]}
+ *       ...
+ */
+struct StackDistanceStats : public Statable
+{
+    StatObj<W64> line_size;
+    StatObj<W64> accesses;
+    StackDistancePointStats *points[StackDistanceProfile::SET_POINTS];
+
+    StackDistanceStats(const StackDistanceProfile& profile,
+            Statable *parent)
+        : Statable("stack_distance", parent)
+          , line_size("line_size", this)
+          , accesses("accesses", this)
+    {
+        foreach (p, StackDistanceProfile::SET_POINTS) {
+            stringbuf name;
+            name << "sets_", profile.sets[p];
+            points[p] = new StackDistancePointStats(name, this);
+
+            /* Small caches clamp several points to one set */
+            if (p && profile.sets[p] == profile.sets[p - 1])
+                points[p]->disable_dump();
+        }
+    }
+};
+
+/*
+ * Profile for the cache 'name' if its 'stack_distance' option is set in
+ * machine, registered for stack_distance_set_stats(), or NULL
+ */
+StackDistanceProfile* stack_distance_create(BaseMachine &machine,
+        const char *name, int set_count, int line_bits, Statable *parent);
+
+/* Write all registered profiles to their stats nodes */
+void stack_distance_set_stats();
+
+};
+
+#endif // STACK_DISTANCE_H
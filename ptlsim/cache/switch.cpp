@@ -16,6 +16,7 @@ using namespace Memory::SwitchInterconnect;
 
 Switch::Switch(const char *name, MemoryHierarchy *memoryHierarchy)
     : Interconnect(name, memoryHierarchy)
+    , new_stats(name, &memoryHierarchy->get_machine())
 {
     memoryHierarchy_->add_interconnect(this);
 
@@ -54,7 +55,7 @@ void Switch::annul_request(MemoryRequest *request)
         foreach_list_mutable (controllers[i]->queue.list(),
                 entry, entry_t, nextentry_t) {
 
-            if (entry->request->is_same(request)) {
+            if (entry->request == request) {
                 entry->annuled = true;
                 entry->request->decRefCounter();
                 ADD_HISTORY_REM(entry->request);
@@ -115,6 +116,7 @@ bool Switch::send_cb(void *arg)
     /* Set destination as busy and signal send_complete */
     queueEntry->in_use = 1;
     dest_cq->recv_busy = 1;
+    new_stats.record(latency_, queueEntry->request->is_kernel());
     marss_add_event(&send_complete, latency_, cq);
 
     return true;
@@ -133,6 +133,8 @@ namespace SwitchInterconnect {
 
             int latency_;
 
+            LinkStats new_stats;
+
         public:
             Switch(const char *name, MemoryHierarchy *memoryHierarchy);
             ~Switch();
@@ -0,0 +1,86 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statelist.h>
+
+namespace Memory {
+
+/*
+ * Transaction
+ *
+ * A controller operation of several phases written as one sequential
+ * function instead of a chain of Signal callbacks passing their state
+ * through the event queue's void*:
+ *
+ *   bool Controller::update_txn(UpdateTransaction &txn)
+ *   {
+ *       TXN_BEGIN(txn);
+ *       TXN_WAIT(txn, ACCESS_DELAY);
+ *       while (!(txn.entry = queue_.alloc()))
+ *           TXN_WAIT(txn, 1);
+ *       ...
+ *       TXN_END(txn);
+ *   }
+ *
+ * The function is a stackless coroutine: TXN_WAIT returns false with the
+ * cycles to wait in waitCycles, and the next call jumps back to the wait
+ * through a switch on resumePoint. Locals don't survive a wait, anything
+ * used across one is a member of the transaction. It returns true once
+ * done, after TXN_END or TXN_EXIT. The owner keeps transactions in a
+ * SlabPool and resumes them from one Signal whose arg is the transaction.
+ *
+ * TXN_WAIT can not be used inside a switch of the function itself.
+ */
+struct Transaction : public FixStateListObject
+{
+    int resumePoint;
+    int waitCycles;
+
+    void init() {
+        resumePoint = 0;
+        waitCycles  = 0;
+    }
+
+    bool done() const { return resumePoint < 0; }
+};
+
+#define TXN_BEGIN(txn) \
+    switch ((txn).resumePoint) { \
+        case 0:
+
+#define TXN_WAIT(txn, cycles) \
+    do { \
+        (txn).waitCycles = (cycles); \
+        (txn).resumePoint = __LINE__; \
+        return false; \
+        case __LINE__:; \
+    } while (0)
+
+#define TXN_EXIT(txn) \
+    do { \
+        (txn).resumePoint = -1; \
+        return true; \
+    } while (0)
+
+#define TXN_END(txn) \
+        default: \
+            break; \
+    } \
+    (txn).resumePoint = -1; \
+    return true
+
+};
+
+#endif // TRANSACTION_H
@@ -0,0 +1,126 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include <globals.h>
+#include <statsBuilder.h>
+
+namespace Memory {
+
+/**
+ * @brief Write queue drain policy of a memory controller
+ *
+ * Enabled with 'write_queue' in the controller's machine config options,
+ * the most writebacks (MEMORY_OP_UPDATE) it buffers before refusing more.
+ * Queued writes wait while reads are waiting, reads go first to every
+ * bank. Once 'write_high' writes are queued the controller drains them:
+ * each idle bank takes its oldest write before any read, until at most
+ * 'write_low' are left. Writes also go to a bank when no read waits at
+ * all. Reads of a line with a queued write take the data from the write
+ * without a bank access. Options:
+ *
+ *   write_queue : writes buffered, 0 (in order scheduling) by default
+ *   write_high  : queued writes that start a drain, 3/4 of write_queue
+ *   write_low   : queued writes that end it, 1/4 of write_queue
+ *
+ * Drains end at the first scheduling decision after the queue is down to
+ * write_low, so an idle controller costs nothing.
+ */
+struct WriteDrain {
+    int size;
+    int high;
+    int low;
+    bool draining;
+    W64 start;
+
+    WriteDrain() : size(0), high(0), low(0), draining(false), start(0) {}
+
+    bool enabled() const { return size > 0; }
+
+    void setup(int size_, int high_, int low_) {
+        size = size_;
+        high = high_;
+        low = low_;
+        draining = false;
+        start = 0;
+    }
+
+    bool full(int queued) const { return queued >= size; }
+
+    /* Start a drain at the high watermark, true if it started */
+    bool check_start(int queued, W64 cycle) {
+        if (draining || queued < high)
+            return false;
+        draining = true;
+        start = cycle;
+        return true;
+    }
+
+    /* End a drain at the low watermark, returns its cycles or 0 */
+    W64 check_end(int queued, W64 cycle) {
+        if (!draining || queued > low)
+            return 0;
+        draining = false;
+        return max(cycle - start, W64(1));
+    }
+
+    /*
+     * Next access of an idle bank from its oldest waiting read and write,
+     * readWaiting if a read waits for any bank. NULL if the bank stays idle.
+     */
+    template <typename T>
+    T* pick(T *read, T *write, bool readWaiting) const {
+        if (draining && write)
+            return write;
+        if (read)
+            return read;
+        return readWaiting ? NULL : write;
+    }
+};
+
+/*
+ * Written under the controller's node, in the mode of the request whose
+ * arrival or completion made the decision:
+ *
+ *   MEM_0:
+ *     write_queue:
+ *       writes: .., full: .., forwarded: ..,
+ *       drains: .., drain_cycles: .., drained_writes: .., idle_writes: ..
+ *       read_latency: {count: .., mean: .., p50: .., .., p99: .., max: ..}
+ */
+struct WriteQueueStats : public Statable
+{
+    StatObj<W64> writes;
+    StatObj<W64> full;
+    StatObj<W64> forwarded;
+    StatObj<W64> drains;
+    StatObj<W64> drain_cycles;
+    StatObj<W64> drained_writes;
+    StatObj<W64> idle_writes;
+    StatHistogram<> read_latency;
+
+    WriteQueueStats(Statable *parent)
+        : Statable("write_queue", parent)
+          , writes("writes", this)
+          , full("full", this)
+          , forwarded("forwarded", this)
+          , drains("drains", this)
+          , drain_cycles("drain_cycles", this)
+          , drained_writes("drained_writes", this)
+          , idle_writes("idle_writes", this)
+          , read_latency("read_latency", this)
+    {}
+};
+
+};
+
+#endif // WRITE_QUEUE_H
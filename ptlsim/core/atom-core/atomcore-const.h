@@ -35,6 +35,36 @@
 #define ATOM_ITLB_SIZE 32
 #endif
 
+/* Large page TLB arrays, pages without an array use 4KB TLB entries */
+#ifndef ATOM_DTLB_2M_SIZE
+#define ATOM_DTLB_2M_SIZE 0
+#endif
+
+#ifndef ATOM_DTLB_1G_SIZE
+#define ATOM_DTLB_1G_SIZE 0
+#endif
+
+#ifndef ATOM_ITLB_2M_SIZE
+#define ATOM_ITLB_2M_SIZE 0
+#endif
+
+#ifndef ATOM_ITLB_1G_SIZE
+#define ATOM_ITLB_1G_SIZE 0
+#endif
+
+/* Second level TLB and page walk caches, 0 sets or entries disables them */
+#ifndef ATOM_STLB_SETS
+#define ATOM_STLB_SETS 0
+#endif
+
+#ifndef ATOM_STLB_WAYS
+#define ATOM_STLB_WAYS 8
+#endif
+
+#ifndef ATOM_PWC_SIZE
+#define ATOM_PWC_SIZE 0
+#endif
+
 #ifndef ATOM_FETCH_WIDTH
 #define ATOM_FETCH_WIDTH 2
 #endif
@@ -14,6 +14,9 @@
 #include <branchpred.h>
 #include <decode.h>
 #include <memoryHierarchy.h>
+#include <hostperf.h>
+#include <statehash.h>
+#include <guestpmu.h>
 
 //#define DISABLE_LDST_FWD
 
@@ -25,6 +28,24 @@ using namespace Memory;
 //   Static and Global Variables/Functions
 //---------------------------------------------//
 
+/**
+ * @brief Map for Register visibility
+ */
+/**
+ * @brief Fill the FU, port and latency of a uop descriptor from fuinfo
+ *
+ * @param desc Descriptor to fill
+ * @param op Uop it describes
+ */
+static void fill_uop_desc(UopDescriptor& desc, const TransOp& op)
+{
+    desc.fu = fuinfo[op.opcode].fu;
+    desc.port = fuinfo[op.opcode].port;
+    desc.latency = fuinfo[op.opcode].latency;
+    if (!fuinfo[op.opcode].pipelined)
+        desc.flags |= UOPDESC_NONPIPE;
+}
+
 /**
  * @brief Map for Register visibility
  */
@@ -105,13 +126,7 @@ static inline W32 first_set(W32 val)
 
 static inline int get_fu_idx(W32 fu)
 {
-    int i = -1;
-    while (fu > 0) {
-        fu >>= 1;
-        i++;
-    }
-
-    return i;
+    return msbindexi32(fu);
 }
 
 //---------------------------------------------//
@@ -230,9 +245,140 @@ void AtomOp::commit_flags(int idx)
         (flags & flagmask);
 }
 
+/**
+ * @brief Group the uops starting at 'start' the way they fit in one AtomOp
+ *
+ * @param tmpl Template to fill
+ * @param bb BasicBlock with its uop descriptors
+ * @param start Index of first uop of the group
+ */
+static void fill_atomop_template(AtomOpTemplate& tmpl, const BasicBlock& bb,
+        int start)
+{
+    int src_reg_count = 0;
+    bool eom = false;
+
+    tmpl.fu_mask = (W32)-1;
+    tmpl.port_mask = (W8)-1;
+    tmpl.execution_cycles = 0;
+    tmpl.num_uops = 0;
+    tmpl.flags = 0;
+
+    foreach(i, MAX_REG_ACCESS_PER_ATOMOP) {
+        tmpl.src_registers[i] = -1;
+    }
+
+    foreach(i, MAX_UOPS_PER_ATOMOP) {
+        tmpl.dest_registers[i] = -1;
+    }
+
+    foreach(i, MAX_UOPS_PER_ATOMOP) {
+        assert(start + i < bb.count);
+
+        const TransOp& op = bb.transops[start + i];
+        const UopDescriptor& desc = bb.uopdescs[start + i];
+
+        /* Check if we can't execute all uops in one FU cluster then
+         * we split the AtomOp and put remaining uops into next AtomOp.
+         */
+        if(!(tmpl.fu_mask & desc.fu) || !(tmpl.port_mask & desc.port)) {
+            tmpl.flags |= ATOMOP_TMPL_NONPIPE;
+            break;
+        }
+
+        tmpl.num_uops++;
+        tmpl.fu_mask &= desc.fu;
+        tmpl.port_mask &= desc.port;
+        tmpl.execution_cycles = max(desc.latency, tmpl.execution_cycles);
+
+        if(desc.flags & UOPDESC_NONPIPE)
+            tmpl.flags |= ATOMOP_TMPL_NONPIPE;
+
+        if(desc.flags & UOPDESC_BARRIER)
+            tmpl.flags |= ATOMOP_TMPL_BARRIER;
+
+        if(op.som) {
+            assert(i == 0);
+            tmpl.flags |= ATOMOP_TMPL_SOM;
+        }
+
+        if(op.opcode == OP_ast)
+            tmpl.flags |= ATOMOP_TMPL_AST;
+
+        // If any of the operands are 'visible' registers then we need to read
+        // them from Register-File so save it in 'src_registers'
+        if(archdest_is_visible[op.ra]) {
+            tmpl.src_registers[src_reg_count++] = op.ra;
+        }
+        if(archdest_is_visible[op.rb]) {
+            tmpl.src_registers[src_reg_count++] = op.rb;
+        }
+        if(archdest_is_visible[op.rc]) {
+            tmpl.src_registers[src_reg_count++] = op.rc;
+        }
+
+        tmpl.dest_registers[i] = op.rd;
+
+        assert(src_reg_count < MAX_REG_ACCESS_PER_ATOMOP);
+
+        if(op.eom) {
+            tmpl.flags |= ATOMOP_TMPL_EOM;
+            eom = true;
+            break;
+        }
+    }
+
+    /* Check that we have atleast 1 uop and 1 fu set to execute */
+    assert(tmpl.num_uops > 0);
+    assert(tmpl.fu_mask != 0);
+    assert(tmpl.port_mask != 0);
+
+    /*
+     * Mark this op non-pipelined if its broken down into multiple ops or its
+     * execution time is loger than minimum pipeline cycles.
+     */
+    if(!eom || tmpl.execution_cycles >= MIN_PIPELINE_CYCLES) {
+        tmpl.flags |= ATOMOP_TMPL_NONPIPE;
+    }
+}
+
+/**
+ * @brief Get the AtomOp grouping of a BasicBlock, built on first use
+ *
+ * @param bb BasicBlock with its uop descriptors set up
+ *
+ * @return Templates indexed by uop, valid at the first uop of each AtomOp
+ */
+AtomOpTemplate* ATOM_CORE_MODEL::get_atomop_templates(BasicBlock& bb)
+{
+    if likely (bb.coredata) {
+        return (AtomOpTemplate*)bb.coredata;
+    }
+
+    assert(bb.uopdescs);
+
+    AtomOpTemplate* tmpls = (AtomOpTemplate*)malloc(
+            sizeof(AtomOpTemplate) * bb.count);
+    assert(tmpls);
+
+    /* Fetch always starts a BasicBlock at its first uop and each AtomOp
+     * starts right after the previous one, so the groups are fixed */
+    int start = 0;
+    while(start < bb.count) {
+        fill_atomop_template(tmpls[start], bb, start);
+        start += tmpls[start].num_uops;
+    }
+
+    bb.coredata = tmpls;
+    return tmpls;
+}
+
 /**
  * @brief Fill AtomOp's uops and other variables
  *
+ * The grouping of uops comes from the BasicBlock's AtomOpTemplate, only
+ * branch prediction and the frontend stall checks are done per fetch.
+ *
  * @return true indicating if another instruction can be fetched
  */
 bool AtomOp::fetch()
@@ -240,73 +386,53 @@ bool AtomOp::fetch()
     // Sanity checks
     assert(thread);
     assert(thread->current_bb);
-    assert(thread->current_bb->synthops);
+    assert(thread->current_bb->uopdescs);
 
     bool ret_value = true;
 
+    BasicBlock& bb = *thread->current_bb;
     RIPVirtPhys& fetchrip = thread->fetchrip;
+    int start = thread->bb_transop_index;
+
+    const AtomOpTemplate& tmpl = get_atomop_templates(bb)[start];
 
     uuid = thread->fetch_uuid;
     thread->fetch_uuid++;
 
-    foreach(i, MAX_UOPS_PER_ATOMOP) {
-
-        Waddr predrip = 0;
-        bool redirectrip = false;
-
-        TransOp& op = uops[i];
-
-        op = thread->current_bb->transops[thread->bb_transop_index];
-        synthops[i] = thread->current_bb->synthops[thread->bb_transop_index];
+    rip = fetchrip;
 
-        rip = fetchrip;
+    num_uops_used = tmpl.num_uops;
+    fu_mask = tmpl.fu_mask;
+    port_mask = tmpl.port_mask;
+    execution_cycles = tmpl.execution_cycles;
+    is_nonpipe = ((tmpl.flags & ATOMOP_TMPL_NONPIPE) != 0);
+    is_ast = ((tmpl.flags & ATOMOP_TMPL_AST) != 0);
+    som = ((tmpl.flags & ATOMOP_TMPL_SOM) != 0);
 
-        assert(op.bbindex == thread->bb_transop_index);
+    thread->bb_transop_index += num_uops_used;
+    thread->st_fetch.uops += num_uops_used;
 
-        /* Check if we can't execute all uops in one FU cluster then
-         * we split the AtomOp and put remaining uops into next AtomOp.
-         */
-        if(!(fu_mask & fuinfo[op.opcode].fu) ||
-                !(port_mask & fuinfo[op.opcode].port)) {
-            ret_value = true;
-            is_nonpipe = true;
-            break;
-        }
+    if unlikely (tmpl.flags & ATOMOP_TMPL_BARRIER) {
+        thread->stall_frontend = true;
+        thread->st_fetch.stop.assist++;
+        is_barrier = true;
+        ret_value = false;
+    }
 
-        num_uops_used++;
-        thread->bb_transop_index++;
-        thread->st_fetch.uops++;
+    foreach(i, num_uops_used) {
 
-        /* Update AtomOp from fuinfo */
-        fu_mask &= fuinfo[op.opcode].fu;
-        port_mask &= fuinfo[op.opcode].port;
-        execution_cycles = max(fuinfo[op.opcode].latency,
-                execution_cycles);
-        is_nonpipe |= ~(fuinfo[op.opcode].pipelined); 
+        Waddr predrip = 0;
+        bool redirectrip = false;
 
-        if unlikely (isclass(op.opcode, OPCLASS_BARRIER)) {
-            thread->stall_frontend = true;
-            thread->st_fetch.stop.assist++;
-            is_barrier = true;
-            ret_value = false;
-        }
+        TransOp& op = uops[i];
+        const UopDescriptor& desc = bb.uopdescs[start + i];
 
-        if(rip == (W64)-1) {
-            rip = fetchrip;
-        } else {
-            assert(rip == fetchrip);
-        }
-        
-        if(op.som) {
-            som = true;
-            assert(i == 0);
-        }
+        op = bb.transops[start + i];
+        synthops[i] = desc.synthop;
 
-        if(op.opcode == OP_ast) {
-            is_ast = 1;
-        }
+        assert(op.bbindex == start + i);
 
-        if (isbranch(op.opcode)) {
+        if (desc.flags & UOPDESC_BRANCH) {
             predinfo.uuid = thread->fetch_uuid;
             predinfo.bptype =
                 (isclass(op.opcode, OPCLASS_COND_BRANCH) <<
@@ -374,7 +500,7 @@ bool AtomOp::fetch()
             op.ripseq = predrip;
         }
 
-        thread->st_fetch.opclass[opclassof(op.opcode)]++;
+        thread->st_fetch.opclass[desc.opclass]++;
 
         if likely (op.eom) {
             fetchrip.rip += op.bytes;
@@ -401,27 +527,13 @@ bool AtomOp::fetch()
             }
 
             thread->st_fetch.insns++;
-
-            break;
         }
     }
 
-    /* Check that we have atleast 1 fu set to execute */
-    assert(fu_mask != 0);
-    assert(port_mask != 0);
-
     change_state(thread->op_fetch_list);
     cycles_left = NUM_FRONTEND_STAGES;
 
-    setup_registers();
-
-    /*
-     * Mark this op non-pipelined if its broken down into multiple ops or its
-     * execution time is loger than minimum pipeline cycles.
-     */
-    if(!eom || execution_cycles >= MIN_PIPELINE_CYCLES) {
-        is_nonpipe = true;
-    }
+    setup_registers(tmpl);
 
     if(is_nonpipe) {
         ret_value = false;
@@ -435,33 +547,13 @@ bool AtomOp::fetch()
 
 /**
  * @brief Setup AtomOp's src and dest registers
+ *
+ * @param tmpl Template this AtomOp was fetched from
  */
-void AtomOp::setup_registers()
+void AtomOp::setup_registers(const AtomOpTemplate& tmpl)
 {
-    int src_reg_count = 0;
-
-    // Iterate through all the valid uops and setup src and dest registers
-    foreach(i, num_uops_used) {
-
-        TransOp& op = uops[i];
-
-        // If any of the operands are 'visible' registers then we need to read
-        // them from Register-File so save it in 'src_registers'
-        if(archdest_is_visible[op.ra]) {
-            src_registers[src_reg_count++] = op.ra;
-        }
-        if(archdest_is_visible[op.rb]) {
-            src_registers[src_reg_count++] = op.rb;
-        }
-        if(archdest_is_visible[op.rc]) {
-            src_registers[src_reg_count++] = op.rc;
-        }
-
-        // Check if destination register is visible or not
-        dest_registers[i] = op.rd;
-
-        assert(src_reg_count < MAX_REG_ACCESS_PER_ATOMOP);
-    }
+    memcpy(src_registers, tmpl.src_registers, sizeof(src_registers));
+    memcpy(dest_registers, tmpl.dest_registers, sizeof(dest_registers));
 }
 
 /**
@@ -522,7 +614,7 @@ W8 AtomOp::issue(bool first_issue)
         if(archdest_is_visible[dest_registers[i]]) {
             thread->register_invalid[dest_registers[i]] = true;
             thread->register_owner[dest_registers[i]] = this;
-            thread->core.clear_forward(dest_registers[i]);
+            thread->core.clear_forward(dest_registers[i], thread->threadid);
         }
     }
 
@@ -536,6 +628,7 @@ W8 AtomOp::issue(bool first_issue)
     /* If not pipelined then set flag in core's fu_available */
     if(is_nonpipe) {
         thread->core.fu_available &= ~fu_mask;
+        thread->fu_reserved |= fu_mask;
         thread->st_issue.non_pipelined++;
         return_value = ISSUE_OK_BLOCK;
     }
@@ -602,7 +695,8 @@ bool AtomOp::all_src_ready()
 
         if(reg_not_ready) {
             // Probe Forward buffer
-            reg_not_ready = (thread->core.forwardbuf.probe(renamed_reg)
+            reg_not_ready = (thread->core.forwardbuf.probe(
+                        AtomCore::forward_key(renamed_reg, thread->threadid))
                     == NULL);
         }
 
@@ -649,7 +743,8 @@ W64 AtomOp::read_reg(W16 reg, W8 uop_idx)
 
     if(thread->register_invalid[reg]) {
         /* Probe forwarding buffer for given register */
-        ForwardEntry* buf = thread->core.forwardbuf.probe(reg);
+        ForwardEntry* buf = thread->core.forwardbuf.probe(
+                AtomCore::forward_key(reg, thread->threadid));
         if(buf) {
             ATOMOPLOG2("Reg ", arch_reg_names[reg],
                     " is fwd from fwd buf, value ",
@@ -905,6 +1000,8 @@ W8 AtomOp::execute_load(TransOp& uop, int idx)
         return ISSUE_FAIL;
     }
 
+    load_addrs[idx] = addr;
+
     /* For internal load, load data and save to dest_reg */
     if(uop.internal) {
         state.reg.rddata = thread->ctx.loadphys(addr, true, uop.size);
@@ -1187,7 +1284,7 @@ W64 AtomOp::generate_address(TransOp& uop, bool is_st)
 
     /* Access TLB */
 	thread->st_dtlb.accesses++;
-    tlb_hit = thread->core.dtlb.probe(virtaddr, thread->threadid);
+    tlb_hit = thread->probe_tlb(virtaddr, false);
 	if (tlb_hit)
 		thread->st_dtlb.hits++;
 
@@ -1198,7 +1295,7 @@ W64 AtomOp::generate_address(TransOp& uop, bool is_st)
         get_phys_address(uop, is_st, virtaddr2);
 
         /* Access TLB with next page address */
-        tlb_hit2 = thread->core.dtlb.probe(virtaddr2, thread->threadid);
+        tlb_hit2 = thread->probe_tlb(virtaddr2, false);
 		if (tlb_hit2)
 			thread->st_dtlb.hits++;
     }
@@ -1220,9 +1317,11 @@ W64 AtomOp::generate_address(TransOp& uop, bool is_st)
 
     /* Its a tlb-miss, initiate page-walk */
 	thread->st_dtlb.misses++;
-    thread->dtlb_walk_level = thread->ctx.page_table_level_count();
+    if unlikely (pc_profile_enabled)
+        thread->core.pc_profile.dtlb_miss(rip);
     thread->dtlb_miss_addr = (exception) ? page_fault_addr :
         (!tlb_hit ? virtaddr : virtaddr2);
+    thread->dtlb_walk_level = thread->start_tlb_walk(thread->dtlb_miss_addr);
     thread->dtlb_miss_op = this;
     thread->dtlb_walk();
 
@@ -1352,12 +1451,13 @@ void AtomOp::forward()
         assert(reg != (W8)-1);
 
         if(thread->register_owner[reg] == this) {
-            core.set_forward(reg, dest_register_values[i]);
+            core.set_forward(reg, dest_register_values[i], thread->threadid);
         }
     }
 
     if(is_nonpipe) {
         core.fu_available |= fu_mask;
+        thread->fu_reserved &= ~fu_mask;
         thread->issue_disabled = false;
     }
 }
@@ -1464,6 +1564,8 @@ void AtomOp::update_reg_mem()
             W8 reg = dest_registers[i];
 
             thread->ctx.set_reg(reg, dest_register_values[i]);
+            if unlikely (config.checker_enabled && !thread->ctx.kernel_mode)
+                checker_written_reg(reg, dest_register_values[i]);
 
             /*
              * We update the register invalid flag and clear the forwarding
@@ -1471,7 +1573,15 @@ void AtomOp::update_reg_mem()
              */
             if(thread->register_owner[reg] == this) {
                 thread->register_invalid[reg] = false;
-                thread->core.clear_forward(reg);
+                thread->core.clear_forward(reg, thread->threadid);
+            }
+        }
+
+        if unlikely (config.spin_fast_forward) {
+            if(stores[i] != NULL) {
+                thread->spin.store();
+            } else if(isload(uops[i].opcode)) {
+                thread->spin.load(load_addrs[i]);
             }
         }
 
@@ -1500,6 +1610,11 @@ void AtomOp::update_reg_mem()
                 thread->access_dcache(buf->addr, rip,
                         Memory::MEMORY_OP_WRITE,
                         uuid);
+
+                BaseMachine& machine = thread->core.machine;
+                if unlikely (machine.spin_waits.count())
+                    machine.spin_line_changed(buf->addr);
+
                 if(config.checker_enabled && !thread->ctx.kernel_mode) {
                     add_checker_store(buf, uops[i].size);
                 } else {
@@ -1576,10 +1691,10 @@ void AtomOp::update_checker()
     if(config.checker_enabled && eom && !thread->ctx.kernel_mode) {
         // TODO Add a mmio checker
         if(!is_barrier && thread->ctx.eip != rip) {
-            execute_checker();
-            TransOp& last_uop = uops[num_uops_used - 1];
-            compare_checker(thread->ctx.cpu_index,
-                    setflags_to_x86_flags[last_uop.setflags]);
+            if(is_ast)
+                checker_mark_sync();
+            checker_commit_insn(thread->ctx.cpu_index, rip, true,
+                    checker_stores_count);
 
             if(checker_context->eip) {
                 foreach(i, checker_stores_count) {
@@ -1595,7 +1710,7 @@ void AtomOp::update_checker()
                 }
             }
         } else {
-            clear_checker();
+            checker_commit_insn(thread->ctx.cpu_index, rip, false, false);
         }
 
         reset_checker_stores();
@@ -1702,6 +1817,7 @@ ostream& AtomOp::print(ostream& os) const
 AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
     : Statable("thread", &core)
       , threadid(threadid)
+      , tlbid(threadid)
       , core(core)
       , ctx(ctx)
       /* Initialize Statistics structures*/
@@ -1711,9 +1827,15 @@ AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
       , st_branch_predictions(this)
       , st_dcache("dcache", this)
       , st_icache("icache", this)
+      , st_load_level("load_level", this, Core::topdown_memory_names)
 	  , st_itlb("itlb", this)
 	  , st_dtlb("dtlb", this)
+	  , st_stlb("stlb", this)
+	  , st_pwc("pwc", this)
+	  , st_tlb_asid("tlb_asid", this)
+      , st_switch(this)
       , st_cycles("cycles", this)
+      , st_spin(this)
       , assists("assists", this, assist_names)
       , lassists("lassists", this, light_assist_names)
 {
@@ -1737,6 +1859,10 @@ AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
     icache_signal.connect(signal_mem_ptr(*this,
             &AtomThread::icache_wakeup));
 
+    HostPerfCounter *perf = host_perf_register(core.get_name());
+    dcache_signal.set_perf(perf);
+    icache_signal.set_perf(perf);
+
     op_lists.reset();
     op_free_list("free", op_lists);
     op_fetch_list("fetch", op_lists);
@@ -1747,10 +1873,18 @@ AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
     op_ready_to_writeback_list("ready-to-writeback", op_lists);
 
     fetch_uuid = 0;
+    fu_reserved = 0;
+    total_insns_committed = 0;
+    total_uops_committed = 0;
 
     handle_interrupt_at_next_eom = 0;
+    events.recheck();
     current_bb = NULL;
 
+    /* Predictor is kept across pipeline flushes, it is only reset with
+     * the core, so warmed up state is not lost on first flush */
+    branchpred.init(core.get_coreid(), threadid, core.branchpred_type.buf);
+
     reset();
 
     // Set Stat Equations
@@ -1763,6 +1897,9 @@ AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
     st_commit.uipc.add_elem(&st_commit.uops);
     st_commit.uipc.add_elem(&st_cycles);
 
+    st_switch.utilization.add_elem(&st_switch.issue_cycles);
+    st_switch.utilization.add_elem(&st_cycles);
+
 	st_dcache.miss_ratio.add_elem(&st_dcache.misses);
 	st_dcache.miss_ratio.add_elem(&st_dcache.accesses);
 
@@ -1774,6 +1911,12 @@ AtomThread::AtomThread(AtomCore& core, W8 threadid, Context& ctx)
 
 	st_dtlb.hit_ratio.add_elem(&st_dtlb.hits);
 	st_dtlb.hit_ratio.add_elem(&st_dtlb.accesses);
+
+	st_stlb.hit_ratio.add_elem(&st_stlb.hits);
+	st_stlb.hit_ratio.add_elem(&st_stlb.accesses);
+
+	st_pwc.hit_ratio.add_elem(&st_pwc.hits);
+	st_pwc.hit_ratio.add_elem(&st_pwc.accesses);
 }
 
 /**
@@ -1812,6 +1955,10 @@ void AtomThread::reset()
     pause_counter = 0;
     running = 0;
     ready = 1;
+    miss_cycle = 0;
+
+    if unlikely (spin.waiting)
+        spin_wake(SPIN_WAKE_FLUSH);
 
     op_free_list.reset();
     op_fetch_list.reset();
@@ -1821,7 +1968,6 @@ void AtomThread::reset()
     op_waiting_to_writeback_list.reset();
     op_ready_to_writeback_list.reset();
 
-    branchpred.init(core.get_coreid(), threadid);
     branches_in_flight = 0;
 
     foreach(i, NUM_ATOM_OPS_PER_THREAD) {
@@ -1834,6 +1980,8 @@ void AtomThread::reset()
         temp_registers[i] = 0xdeadbeefdeadbeef;
     }
 
+    fetchq.reset();
+
     dispatchq.reset();
 
     storebuf.reset();
@@ -1863,6 +2011,11 @@ bool AtomThread::fetch()
         return true;
     }
 
+    // Nothing to fetch until an event wakes up a halted thread
+    if unlikely (core.threads_halted() || spin.waiting) {
+        return true;
+    }
+
     // Fetch an instruction
     while(fetchcount < MAX_FETCH_WIDTH) {
 
@@ -1872,7 +2025,7 @@ bool AtomThread::fetch()
         }
 
         // First check if fetchq is empty or not
-        if(!core.fetchq.remaining() || op_free_list.count == 0) {
+        if(!fetchq.remaining() || op_free_list.count == 0) {
             st_fetch.stop.fetch_q_full++;
             return true;
         }
@@ -1993,17 +2146,28 @@ bool AtomThread::fetch_check_current_bb()
     // We need to fetch new basic block from the buffer.
     fetchrip.update(ctx);
 
+    BasicBlockCache& bbc = bbcache_of(ctx.cpu_index);
+
+    // Old block is only used for its successor links, see
+    // BasicBlockCache::get_successor
+    BasicBlock *prev_bb = current_bb;
+
     if(current_bb) {
         current_bb->release();
         current_bb = NULL;
     }
 
-    BasicBlock *bb = bbcache[ctx.cpu_index](fetchrip);
+    BasicBlock *bb = bbc.get_successor(prev_bb, fetchrip);
 
     if likely (bb) {
         current_bb = bb;
     } else {
-        current_bb = bbcache[ctx.cpu_index].translate(ctx, fetchrip);
+        W32 link_epoch = bbc.link_epoch;
+        current_bb = bbc.translate(ctx, fetchrip);
+
+        if(current_bb && prev_bb && link_epoch == bbc.link_epoch) {
+            bbc.link_successor(prev_bb, current_bb);
+        }
 
         if unlikely (!current_bb) {
             if(fetchrip.rip == ctx.eip) {
@@ -2022,8 +2186,8 @@ bool AtomThread::fetch_check_current_bb()
         current_bb->acquire();
         current_bb->use(sim_cycle);
 
-        if(!current_bb->synthops) {
-            synth_uops_for_bb(*current_bb);
+        if(!current_bb->uopdescs) {
+            synth_uops_for_bb(*current_bb, fill_uop_desc);
         }
 
         bb_transop_index = 0;
@@ -2042,7 +2206,7 @@ bool AtomThread::fetch_check_current_bb()
 bool AtomThread::fetch_probe_itlb()
 {
 	st_itlb.accesses++;
-    if(core.itlb.probe((Waddr)(fetchrip), threadid)) {
+    if(probe_tlb((Waddr)(fetchrip), true)) {
         // Its a TLB hit
 		st_itlb.hits++;
         return true;
@@ -2050,7 +2214,7 @@ bool AtomThread::fetch_probe_itlb()
 
     // Its a ITLB miss - do TLB page walk
 	st_itlb.misses++;
-    itlb_walk_level = ctx.page_table_level_count();
+    itlb_walk_level = start_tlb_walk((Waddr)fetchrip);
     itlb_walk();
     
     return false;
@@ -2064,8 +2228,9 @@ void AtomThread::itlb_walk()
     if(!itlb_walk_level) {
 
 itlb_walk_finish:
-        core.itlb.insert((Waddr)fetchrip, threadid);
-        assert(core.itlb.probe((Waddr)fetchrip, threadid));
+        insert_tlb((Waddr)fetchrip, true);
+        assert(probe_tlb((Waddr)fetchrip, true));
+        finish_tlb_walk((Waddr)fetchrip);
         itlb_walk_level = 0;
         waiting_for_icache_miss = 0;
         return;
@@ -2105,6 +2270,122 @@ itlb_walk_finish:
     }
 }
 
+/**
+ * @brief Probe 4KB and large page TLB arrays of the core
+ */
+bool AtomThread::probe_tlb(Waddr virtaddr, bool is_icache)
+{
+    if(is_icache)
+        return core.itlb.probe(virtaddr, tlbid) ||
+            core.itlb_large.probe(virtaddr, tlbid);
+
+    return core.dtlb.probe(virtaddr, tlbid) ||
+        core.dtlb_large.probe(virtaddr, tlbid);
+}
+
+/**
+ * @brief Insert translation of virtaddr in TLB array of its page size
+ */
+void AtomThread::insert_tlb(Waddr virtaddr, bool is_icache)
+{
+    bool large = is_icache ? ITLBLarge::ENABLED : DTLBLarge::ENABLED;
+
+    if(large) {
+        int shift = ctx.page_shift(virtaddr);
+
+        if(shift > 12) {
+            bool inserted = is_icache ?
+                core.itlb_large.insert(virtaddr, tlbid, shift) :
+                core.dtlb_large.insert(virtaddr, tlbid, shift);
+            if(inserted) return;
+        }
+    }
+
+    if(is_icache)
+        core.itlb.insert(virtaddr, tlbid);
+    else
+        core.dtlb.insert(virtaddr, tlbid);
+}
+
+/**
+ * @brief Look up STLB and page walk caches after a DTLB or ITLB miss
+ *
+ * @param virtaddr Virtual address to translate
+ *
+ * @return Page table level where walk starts, 0 if STLB hit
+ */
+W8 AtomThread::start_tlb_walk(Waddr virtaddr)
+{
+    int level_count = ctx.page_table_level_count();
+
+    if(STLB::ENABLED) {
+        st_stlb.accesses++;
+        if(core.stlb.probe(virtaddr, tlbid)) {
+            st_stlb.hits++;
+            return 0;
+        }
+        st_stlb.misses++;
+    }
+
+    int level = core.pwc.start_level(virtaddr, tlbid, level_count);
+
+    if(PWC::ENABLED) {
+        st_pwc.accesses++;
+        if(level < level_count)
+            st_pwc.hits++;
+        else
+            st_pwc.misses++;
+    }
+
+    return level;
+}
+
+/**
+ * @brief Install translation of a completed walk in STLB and page walk caches
+ */
+void AtomThread::finish_tlb_walk(Waddr virtaddr)
+{
+    core.stlb.insert(virtaddr, tlbid);
+    core.pwc.fill(virtaddr, tlbid, ctx.page_table_level_count());
+}
+
+/**
+ * @brief Move this thread's TLB entries to the address space of its CR3
+ *
+ * @return false if CR3 didn't change, or the core has no 'tlb_asids', and
+ * TLBs have to be flushed
+ */
+bool AtomThread::switch_address_space()
+{
+    if(!address_spaces.enabled())
+        return false;
+
+    W64 root = floor(ctx.cr[3], PAGE_SIZE);
+    if(root == address_spaces.root()) {
+        st_tlb_asid.flushes++;
+        return false;
+    }
+
+    st_tlb_asid.switches++;
+
+    if(address_spaces.switch_to(root)) {
+        st_tlb_asid.reused++;
+        tlbid = address_spaces.tlb_id(threadid);
+        return true;
+    }
+
+    /* Drop what the id's previous root left */
+    st_tlb_asid.recycled++;
+    tlbid = address_spaces.tlb_id(threadid);
+    core.dtlb.flush_thread(tlbid, TLB_ID_MASK);
+    core.itlb.flush_thread(tlbid, TLB_ID_MASK);
+    core.dtlb_large.flush_thread(tlbid, TLB_ID_MASK);
+    core.itlb_large.flush_thread(tlbid, TLB_ID_MASK);
+    core.stlb.flush_thread(tlbid, TLB_ID_MASK);
+    core.pwc.flush_thread(tlbid, TLB_ID_MASK);
+    return true;
+}
+
 /**
  * @brief Perform D-TLB page walk
  */
@@ -2115,7 +2396,8 @@ void AtomThread::dtlb_walk()
     if(!dtlb_walk_level) {
 
 dtlb_walk_finish:
-        core.dtlb.insert(dtlb_miss_addr, threadid);
+        insert_tlb(dtlb_miss_addr, false);
+        finish_tlb_walk(dtlb_miss_addr);
         dtlb_walk_level = 0;
         dtlb_miss_addr = -1;
 
@@ -2164,7 +2446,7 @@ dtlb_walk_finish:
  */
 bool AtomThread::fetch_into_atomop()
 {
-    BufferEntry& fetch_entry = *core.fetchq.alloc();
+    BufferEntry& fetch_entry = *fetchq.alloc();
 
     fetch_entry.op = (AtomOp*)op_free_list.peek();
     assert(fetch_entry.op);
@@ -2191,10 +2473,10 @@ void AtomThread::frontend()
             // Add this AtomOp to the dispatchq
 
             BufferEntry* op_buf = op->buf_entry;
-            assert(core.fetchq.peek() == op_buf);
+            assert(fetchq.peek() == op_buf);
 
             if(dispatch(op)) {
-                core.fetchq.commit(op_buf);
+                fetchq.commit(op_buf);
             } else {
                 st_fetch.stop.dispatch_q_full++;
                 break;
@@ -2240,6 +2522,7 @@ bool AtomThread::issue()
 {
     W8 issue_result;
     W8 num_issues;
+    bool issued = false;
 
     /*
      * First check if issue is not disabled for this thread
@@ -2264,7 +2547,9 @@ bool AtomThread::issue()
         return true;
     }
 
-    for(num_issues = 0; num_issues < MAX_ISSUE_PER_CYCLE; num_issues++) {
+    /* With SMT switching all threads share the issue width of the core */
+    for(num_issues = 0; core.issue_count < MAX_ISSUE_PER_CYCLE;
+            num_issues++) {
 
         /* Check if dispatch queue has anything to dispatch. */
         if(dispatchq.empty()) {
@@ -2279,7 +2564,7 @@ bool AtomThread::issue()
 
         assert(buf_entry.op);
 
-        issue_result = buf_entry.op->issue(num_issues == 0);
+        issue_result = buf_entry.op->issue(core.issue_count == 0);
 
         st_issue.result[issue_result]++;
 
@@ -2287,10 +2572,13 @@ bool AtomThread::issue()
             break;
         } else if(issue_result == ISSUE_CACHE_MISS) {
             ready = false;
+            miss_cycle = sim_cycle;
             break;
         } else {
             add_to_commitbuf(buf_entry.op);
             dispatchq.pophead();
+            core.issue_count++;
+            issued = true;
 
             st_issue.atomops++;
             st_issue.uops += buf_entry.op->num_uops_used;
@@ -2300,8 +2588,10 @@ bool AtomThread::issue()
 
             if(issue_result == ISSUE_OK_BLOCK) {
                 issue_disabled = true;
+                core.issue_count = MAX_ISSUE_PER_CYCLE;
                 break;
             } else if(issue_result == ISSUE_OK_SKIP) {
+                core.issue_count = MAX_ISSUE_PER_CYCLE;
                 break;
             }
         }
@@ -2309,6 +2599,10 @@ bool AtomThread::issue()
 
     st_issue.width[num_issues]++;
 
+    if(issued) {
+        st_switch.issue_cycles++;
+    }
+
     return false;
 }
 
@@ -2325,8 +2619,8 @@ void AtomThread::redirect_fetch(W64 rip)
     ATOMTHLOG1("RIP redirected to ", (void*)rip);
 
     // Before we clear fetchq, update branch predictor
-    foreach_backward(core.fetchq, i) {
-        core.fetchq[i].annul();
+    foreach_backward(fetchq, i) {
+        fetchq[i].annul();
     }
 
     foreach_forward_after(dispatchq, (&dispatchq[dispatchq.head]), i) {
@@ -2335,7 +2629,7 @@ void AtomThread::redirect_fetch(W64 rip)
 
     // Clear the dispatch queue and fetch queue
     dispatchq.reset();
-    core.fetchq.reset();
+    fetchq.reset();
     fetchrip.rip = rip;
     fetchrip.update(ctx);
 
@@ -2385,6 +2679,15 @@ bool AtomThread::access_dcache(Waddr addr, W64 rip, W8 type, W64 uuid)
 
     if(!hit) {
         st_dcache.misses++;
+    } else if (type == Memory::MEMORY_OP_READ) {
+        st_load_level[Core::TOPDOWN_MEM_L1]++;
+    }
+
+    /* Misses and stores are profiled once they complete in dcache_wakeup */
+    if unlikely (pc_profile_enabled) {
+        core.pc_profile.access(rip);
+        if (hit && type == Memory::MEMORY_OP_READ)
+            core.pc_profile.complete(rip, Memory::L1_D_CACHE, 0);
     }
 
     return hit;
@@ -2402,6 +2705,11 @@ bool AtomThread::dcache_wakeup(void *arg)
     MemoryRequest* req = (MemoryRequest*)arg;
     W64 req_rip = req->get_owner_rip();
 
+    if unlikely (pc_profile_enabled && req_rip) {
+        core.pc_profile.complete(req_rip, req->get_level(),
+                sim_cycle - req->get_init_cycles());
+    }
+
     if(req->get_type() == Memory::MEMORY_OP_WRITE) {
         return true;
     }
@@ -2413,6 +2721,15 @@ bool AtomThread::dcache_wakeup(void *arg)
         return true;
     }
 
+    int level;
+    switch (req->get_level()) {
+        case Memory::L2_CACHE: level = Core::TOPDOWN_MEM_L2; break;
+        case Memory::L3_CACHE: level = Core::TOPDOWN_MEM_L3; break;
+        case Memory::MAIN_MEMORY: level = Core::TOPDOWN_MEM_DRAM; break;
+        default: level = Core::TOPDOWN_MEM_L1; break;
+    }
+    st_load_level[level]++;
+
     /* First check if request entry is present in dispatch queue or not */
     if(dispatchq.empty()) return true;
 
@@ -2556,7 +2873,8 @@ bool AtomThread::writeback()
     AtomOp* op;
     bool ret_value = false;
 
-    if(sim_cycle > (last_commit_cycle + 1024*1024)) {
+    if(sim_cycle > (last_commit_cycle + 1024*1024) && !ctx.halted &&
+            !spin.waiting) {
         ptl_logfile << "Core has not progressed since cycle ",
                     last_commit_cycle, " dumping all information\n";
         core.machine.dump_state(ptl_logfile);
@@ -2655,6 +2973,8 @@ bool AtomThread::commit_queue()
         return handle_exception();
     }
 
+    bool spinning = false;
+
     foreach_forward(commitbuf, i) {
         BufferEntry& buf = commitbuf[i];
 
@@ -2667,6 +2987,7 @@ bool AtomThread::commit_queue()
 
         if (commit_result == COMMIT_FAILED) {
             handle_interrupt_at_next_eom = 0;
+            events.recheck();
             break;
         }
 
@@ -2676,14 +2997,30 @@ bool AtomThread::commit_queue()
 
         st_commit.atomops++;
         st_commit.uops += buf.op->num_uops_used;
+        total_uops_committed += buf.op->num_uops_used;
 
         if(buf.op->eom || commit_result == COMMIT_BARRIER) {
-            total_insns_committed++;
+            ::total_insns_committed++;
             st_commit.insns++;
+            core.committed_insns++;
+            total_insns_committed++;
+            if unlikely (state_hash_enabled)
+                state_hash_commit(ctx.cpu_index, buf.op->rip);
+
+            spinning = (config.spin_fast_forward && buf.op->is_branch &&
+                    spin.taken_branch(buf.op->rip, ctx.eip, (W64*)ctx.regs,
+                        ctx.reg_flags, total_insns_committed,
+                        total_uops_committed, sim_cycle));
             break;
         }
     }
 
+    // Younger AtomOps of a spinning thread only repeat the loop
+    if unlikely (spinning) {
+        flush_pipeline();
+        spin_wait();
+    }
+
     ATOMTHLOG3("After AtomOp-x86 inst Commit Ctx is\n", ctx);
 
     if(commit_result == COMMIT_BARRIER) {
@@ -2693,6 +3030,63 @@ bool AtomThread::commit_queue()
     return false;
 }
 
+/**
+ * @brief Wait in the spin loop whose branch just committed
+ *
+ * The pipeline was flushed, fetch restarts at the loop head in ctx.eip
+ * once woken. With event and miss switching other threads run meanwhile.
+ */
+void AtomThread::spin_wait()
+{
+    core.machine.spin_wait(spin);
+    st_spin.waits++;
+
+    ready = false;
+    miss_cycle = sim_cycle;
+
+    if(core.switch_policy < THREAD_SWITCH_FINE && core.running_thread == this)
+        core.in_thread_switch = true;
+}
+
+/* End the wait once the line changed, an event is pending or on timeout */
+void AtomThread::spin_poll()
+{
+    if(spin.woken) {
+        spin_wake(SPIN_WAKE_LINE);
+    } else if(ctx.check_events()) {
+        spin_wake(SPIN_WAKE_EVENT);
+    } else if(sim_cycle - spin.wait_cycle >= config.spin_max_cycles) {
+        spin_wake(SPIN_WAKE_TIMEOUT);
+    }
+}
+
+/**
+ * @brief End a spin wait, accounting the iterations it skipped
+ */
+void AtomThread::spin_wake(int reason)
+{
+    W64 insns, uops;
+
+    core.machine.spin_unwatch(spin);
+    W64 cycles = spin.wake(sim_cycle, insns, uops);
+
+    st_spin.wakeups[reason]++;
+    st_spin.cycles += cycles;
+    st_spin.insns += insns;
+
+    ::total_insns_committed += insns;
+    st_commit.insns += insns;
+    st_commit.uops += uops;
+    total_insns_committed += insns;
+    total_uops_committed += uops;
+    core.committed_insns += insns;
+    if unlikely (state_hash_enabled && insns)
+        state_hash_commit(ctx.cpu_index, ctx.eip, insns);
+
+    ready = true;
+    last_commit_cycle = sim_cycle;
+}
+
 /**
  * @brief Add AtomOp entry to the Commit buffer
  *
@@ -2781,6 +3175,7 @@ bool AtomThread::handle_interrupt()
 {
     ctx.event_upcall();
     handle_interrupt_at_next_eom = 0;
+    events.recheck();
 
     ATOMTHLOG1("Handling interrupt ", ctx.interrupt_request, " exit ",
             ctx.exit_request, " elfags ", hexstring(ctx.eflags,32),
@@ -2832,8 +3227,8 @@ void AtomThread::flush_pipeline()
 {
     ATOMTHLOG1("flush_pipeline()");
 
-    foreach_backward(core.fetchq, i) {
-        core.fetchq[i].annul();
+    foreach_backward(fetchq, i) {
+        fetchq[i].annul();
     }
 
     foreach_forward(dispatchq, i) {
@@ -2952,6 +3347,11 @@ ostream& AtomThread::print(ostream& os) const
         os << "[", intstring(i,2), "]", atomOps[i], "\n";
     }
 
+    os << " Fetch Queue:\n";
+    foreach_forward(fetchq, i) {
+        os << "  ", fetchq[i], endl;
+    }
+
     os << " Dispatch Queue:\n";
     foreach_forward(dispatchq, i) {
         os << "  ", dispatchq[i], endl;
@@ -2990,6 +3390,33 @@ AtomCore::AtomCore(BaseMachine& machine, int num_threads, const char* name)
     }
     threadcount = th_count;
 
+    if(!machine.get_option(name, "branch_predictor", branchpred_type)) {
+        branchpred_type << "combined";
+    }
+
+    switch_policy = machine.get_named_option(name, "thread_switch",
+            thread_switch_names, NUM_THREAD_SWITCH, THREAD_SWITCH_EVENT);
+
+    /* Cycles after a switch before the new thread issues */
+    if(!machine.get_option(name, "switch_penalty", switch_penalty) ||
+            switch_penalty < 0) {
+        switch_penalty = 0;
+    }
+
+    /* Misses shorter than this don't switch with 'miss' policy, by default
+     * the ones that go past the L2 */
+    if(!machine.get_option(name, "switch_miss_latency", switch_miss_latency)
+            || switch_miss_latency < 0) {
+        switch_miss_latency = 20;
+    }
+
+    /* Address space ids per thread of TLB entries, 0 flushes on CR3 write */
+    int tlb_asids;
+    if(!machine.get_option(name, "tlb_asids", tlb_asids) || tlb_asids < 0) {
+        tlb_asids = 0;
+    }
+    tlb_asids = min(tlb_asids, TLB_MAX_ASIDS);
+
     //coreid = machine.get_next_coreid();
 
     threads = (AtomThread**)qemu_mallocz(threadcount*sizeof(AtomThread*));
@@ -2998,12 +3425,18 @@ AtomCore::AtomCore(BaseMachine& machine, int num_threads, const char* name)
 	sg_name << name << "-run-cycle";
 	run_cycle.set_name(sg_name.buf);
 	run_cycle.connect(signal_mem_ptr(*this, &AtomCore::runcycle));
+	run_cycle.set_perf(host_perf_register(get_name()));
+	perf_commit = host_perf_register(get_name(), "commit");
+	perf_issue = host_perf_register(get_name(), "issue");
+	perf_fetch = host_perf_register(get_name(), "fetch");
 	marss_register_per_cycle_event(&run_cycle);
+	run_cycle_signal = &run_cycle;
 
     foreach(i, threadcount) {
         Context& ctx = machine.get_next_context();
 
         AtomThread* thread = new AtomThread(*this, i, ctx);
+        thread->address_spaces.setup(tlb_asids);
         threads[i] = thread;
     }
 
@@ -3097,14 +3530,15 @@ bool AtomCore::writeback()
  *
  * @param reg Register index of which data is forwarded
  * @param data Data value to be forwarded
+ * @param threadid Thread that produced the value
  */
-void AtomCore::set_forward(W8 reg, W64 data)
+void AtomCore::set_forward(W8 reg, W64 data, W8 threadid)
 {
     if(!archdest_is_visible[reg]) {
         return;
     }
 
-    ForwardEntry* buf = forwardbuf.select((W16)reg);
+    ForwardEntry* buf = forwardbuf.select(forward_key(reg, threadid));
     buf->data = data;
 
     ATOMCORELOG("Forwarding Reg ", arch_reg_names[reg],
@@ -3115,11 +3549,50 @@ void AtomCore::set_forward(W8 reg, W64 data)
  * @brief Clear a Forwarding entry of specified register
  *
  * @param reg Register index of which to clear entry
+ * @param threadid Thread of the register
  */
-void AtomCore::clear_forward(W8 reg)
+void AtomCore::clear_forward(W8 reg, W8 threadid)
 {
     ATOMCORELOG("Clearing forwarding reg ", arch_reg_names[reg]);
-    forwardbuf.invalidate((W16)reg);
+    forwardbuf.invalidate(forward_key(reg, threadid));
+}
+
+/**
+ * @brief Clear all Forwarding entries of a thread
+ *
+ * @param threadid ID of the thread
+ */
+void AtomCore::clear_thread_forward(W8 threadid)
+{
+    foreach(way, FORWARD_BUF_SIZE) {
+        W16 tag = forwardbuf.tags.tags[way];
+        if(tag != forwardbuf.tags.INVALID && (tag >> 8) == threadid) {
+            forwardbuf.invalidate_way(way);
+        }
+    }
+}
+
+/**
+ * @brief Set the stats and interrupt state of a thread for this cycle
+ *
+ * Both only change with a context event, see ContextEvents.
+ *
+ * @param thread Thread to run
+ */
+void AtomCore::set_thread_stats(AtomThread* thread)
+{
+    running_thread = thread;
+
+    if likely (!thread->events.changed())
+        return;
+
+    thread->handle_interrupt_at_next_eom = thread->ctx.check_events();
+
+    if(thread->ctx.kernel_mode) {
+        thread->set_default_stats(kernel_stats);
+    } else {
+        thread->set_default_stats(user_stats);
+    }
 }
 
 /**
@@ -3131,22 +3604,49 @@ bool AtomCore::runcycle(void* none)
 {
     bool exit_requested = false;
 
+    /* Contexts are run by the migration peer of this core */
+    if unlikely (!active)
+        return exit_requested;
+
+    /* No edge of this core's clock in this simulation cycle */
+    if unlikely (!clock_domain->ticks)
+        return exit_requested;
+
+    /* Nothing to do until an event wakes up a halted or spinning thread */
+    if unlikely (get_next_active_cycle() > sim_cycle) {
+        machine.request_park(*this);
+        return exit_requested;
+    }
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        if unlikely (thread->ctx.halted && !thread->ctx.is_halted()) {
+            thread->ctx.halted = 0;
+            thread->last_commit_cycle = sim_cycle;
+        }
+
+        if unlikely (thread->spin.waiting)
+            thread->spin_poll();
+    }
+
     fu_used = 0;
     port_available = (W8)-1;
+    issue_count = 0;
 
     assert(running_thread);
 
     ATOMCORELOG("Cycle: ", sim_cycle);
 
-    running_thread->handle_interrupt_at_next_eom =
-        running_thread->ctx.check_events();
-
-    if(running_thread->ctx.kernel_mode) {
-        running_thread->set_default_stats(kernel_stats);
-    } else {
-        running_thread->set_default_stats(user_stats);
+    if(switch_policy >= THREAD_SWITCH_FINE) {
+        return runcycle_threads();
     }
 
+    set_thread_stats(running_thread);
+
+    /* Writeback, transfer, forward and complete */
+    HostPerfScope stage_perf(perf_commit);
+
     exit_requested = writeback();
 
     if(exit_requested) {
@@ -3176,6 +3676,13 @@ bool AtomCore::runcycle(void* none)
         return false;
     }
 
+    // Newly switched in thread refills the pipeline
+    if(penalty_left) {
+        penalty_left--;
+        running_thread->st_switch.penalty_cycles++;
+        return false;
+    }
+
     // If we are waiting for DTLB to fill then just return because when cache
     // access is completed, it will call dtlb_walk
     if(running_thread->dtlb_walk_level) {
@@ -3189,8 +3696,13 @@ bool AtomCore::runcycle(void* none)
 
     assert(in_thread_switch == false);
 
+    stage_perf.switch_to(perf_issue);
+
     issue();
 
+    /* Frontend and fetch */
+    stage_perf.switch_to(perf_fetch);
+
     frontend();
 
     fetch();
@@ -3198,6 +3710,154 @@ bool AtomCore::runcycle(void* none)
     return false;
 }
 
+/**
+ * @brief Find the first cycle in which this core has work to do
+ *
+ * @return sim_cycle if core is busy, the end of the first spin wait if
+ * all running threads wait in spin loops, infinity if all threads are
+ * halted (or not running) and have no AtomOps, stores or walks in flight
+ */
+W64 AtomCore::get_next_active_cycle()
+{
+    W64 cycle = infinity;
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        if(thread->op_free_list.count != NUM_ATOM_OPS_PER_THREAD ||
+                !thread->storebuf.empty() ||
+                thread->waiting_for_icache_miss ||
+                thread->dtlb_walk_level)
+            return sim_cycle;
+
+        if(!thread->ctx.running || thread->ctx.is_halted())
+            continue;
+
+        if(!thread->spin.waiting)
+            return sim_cycle;
+
+        cycle = min(cycle, thread->spin.wake_cycle(thread->ctx.check_events(),
+                    config.spin_max_cycles, sim_cycle));
+    }
+
+    return cycle;
+}
+
+/**
+ * @brief Account cycles in which this core was not clocked
+ */
+void AtomCore::skip_cycles(W64 cycles)
+{
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        if(switch_policy < THREAD_SWITCH_FINE && thread != running_thread)
+            continue;
+
+        thread->set_default_stats(thread->ctx.kernel_mode ?
+                kernel_stats : user_stats);
+        thread->st_cycles += cycles;
+    }
+}
+
+/**
+ * @brief True if all threads wait in hlt for an event
+ */
+bool AtomCore::threads_halted()
+{
+    foreach(i, threadcount) {
+        if(!threads[i]->ctx.halted)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Simulate one cycle with fine grained or SMT thread switching
+ *
+ * All threads have AtomOps in flight so the backend of each thread is
+ * clocked every cycle. With 'fine' policy the next ready thread issues,
+ * with 'smt' all threads issue and share the issue width and FUs. Threads
+ * take turns to fetch.
+ *
+ * @return true if exit to qemu is requested
+ */
+bool AtomCore::runcycle_threads()
+{
+    HostPerfScope stage_perf(perf_commit);
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        set_thread_stats(thread);
+
+        if(thread->writeback()) {
+            ATOMCORELOG("Exit to qemu requested");
+            machine.ret_qemu_env = &thread->ctx;
+            return true;
+        }
+
+        thread->transfer();
+        thread->forward();
+        thread->complete();
+
+        thread->st_cycles++;
+
+        // Thread waiting for DTLB fill doesn't run its frontend
+        if(thread->dtlb_walk_level && thread->init_dtlb_walk) {
+            thread->dtlb_walk();
+        }
+    }
+
+    stage_perf.switch_to(perf_issue);
+
+    int first = next_thread;
+    next_thread = add_index_modulo(next_thread, +1, threadcount);
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[add_index_modulo(first, i, threadcount)];
+
+        if(thread->dtlb_walk_level) {
+            continue;
+        }
+
+        if(switch_policy == THREAD_SWITCH_FINE &&
+                (!thread->ready || thread->issue_disabled ||
+                 thread->dispatchq.empty() ||
+                 issue_count == MAX_ISSUE_PER_CYCLE)) {
+            continue;
+        }
+
+        running_thread = thread;
+        thread->issue();
+
+        // Only one thread issues in a cycle with 'fine' policy
+        if(switch_policy == THREAD_SWITCH_FINE) {
+            issue_count = MAX_ISSUE_PER_CYCLE;
+        }
+    }
+
+    stage_perf.switch_to(perf_fetch);
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        if(!thread->dtlb_walk_level) {
+            running_thread = thread;
+            thread->frontend();
+        }
+    }
+
+    AtomThread* fetch_thread = threads[first];
+    if(!fetch_thread->dtlb_walk_level) {
+        running_thread = fetch_thread;
+        fetch_thread->fetch();
+    }
+
+    return false;
+}
+
 /**
  * @brief Try to switch running thread
  */
@@ -3209,6 +3869,12 @@ void AtomCore::try_thread_switch()
         return;
     }
 
+    // Wait for short misses without switching
+    if(switch_policy == THREAD_SWITCH_MISS &&
+            sim_cycle - running_thread->miss_cycle < switch_miss_latency) {
+        return;
+    }
+
     if(running_thread->ready_to_switch()) {
 
         int old_id = running_thread->threadid;
@@ -3221,10 +3887,14 @@ void AtomCore::try_thread_switch()
 
         flush_shared_structs(old_id);
 
+        running_thread->st_switch.count++;
         running_thread = threads[next_id];
         in_thread_switch = false;
+        penalty_left = switch_penalty;
 
         ATOMCORELOG("Switching to thread ", next_id);
+    } else if(threadcount > 1) {
+        running_thread->st_switch.drain_cycles++;
     }
 }
 
@@ -3239,15 +3909,19 @@ void AtomCore::reset()
 
     foreach(i, threadcount) {
         threads[i]->reset();
+        threads[i]->branchpred.reset();
+        threads[i]->fu_reserved = 0;
     }
 
     dtlb.reset();
     itlb.reset();
-    fetchq.reset();
 
     forwardbuf.reset();
     running_thread = threads[0];
     in_thread_switch = 0;
+    penalty_left = 0;
+    issue_count = 0;
+    next_thread = 0;
 }
 
 /**
@@ -3259,13 +3933,146 @@ void AtomCore::flush_tlb(Context& ctx)
 {
     foreach(i, threadcount) {
         if(threads[i]->ctx.cpu_index == ctx.cpu_index) {
+            if(threads[i]->switch_address_space())
+                break;
+
             dtlb.flush_thread(i);
             itlb.flush_thread(i);
+            dtlb_large.flush_thread(i);
+            itlb_large.flush_thread(i);
+            stlb.flush_thread(i);
+            pwc.flush_thread(i);
             break;
         }
     }
 }
 
+/**
+ * @brief Find the thread that runs given Context
+ *
+ * @return NULL if ctx is not run by this core
+ */
+AtomThread* AtomCore::get_thread(Context& ctx)
+{
+    foreach(i, threadcount) {
+        if(&threads[i]->ctx == &ctx)
+            return threads[i];
+    }
+
+    return NULL;
+}
+
+bool AtomCore::runs_context(Context& ctx)
+{
+    return get_thread(ctx) != NULL;
+}
+
+/**
+ * @brief Functional warmup: install virtaddr in TLB for ctx's thread
+ */
+void AtomCore::warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache)
+{
+    AtomThread* thread = get_thread(ctx);
+    assert(thread);
+
+    thread->insert_tlb(virtaddr, is_icache);
+}
+
+/**
+ * @brief Functional warmup: train branch predictor with a committed branch
+ *
+ * Does what fetch and writeback do to the predictor for this branch, with
+ * branch resolved to target.
+ */
+void AtomCore::warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+        W64 target)
+{
+    AtomThread* thread = get_thread(ctx);
+    assert(thread);
+
+    BranchPredictorUpdateInfo predinfo;
+    predinfo.uuid = 0;
+    predinfo.ctxid = 0;
+    predinfo.ripafter = ripafter;
+    predinfo.bptype =
+        (isclass(uop.opcode, OPCLASS_COND_BRANCH) <<
+         log2(BRANCH_HINT_COND)) |
+        (isclass(uop.opcode, OPCLASS_INDIR_BRANCH) <<
+         log2(BRANCH_HINT_INDIRECT)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_PUSH_RAS)) <<
+         log2(BRANCH_HINT_CALL)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_POP_RAS)) <<
+         log2(BRANCH_HINT_RET));
+
+    thread->branchpred.predict(predinfo, predinfo.bptype, ripafter,
+            uop.riptaken);
+
+    if(predinfo.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET))
+        thread->branchpred.updateras(predinfo, ripafter);
+
+    thread->branchpred.update(predinfo, ripafter, target);
+}
+
+/**
+ * @brief Save or load TLBs, page walk caches and branch predictors
+ *
+ * TLB tags hold the address space id of their thread, so the address
+ * spaces are kept with them.
+ */
+void AtomCore::transfer_warm_state(WarmState& state)
+{
+    state.object(dtlb);
+    state.object(itlb);
+    state.object(dtlb_large);
+    state.object(itlb_large);
+    state.object(stlb);
+    state.object(pwc);
+
+    state.expect(threadcount);
+
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        state.object(thread->address_spaces);
+        state.value(thread->tlbid);
+        thread->branchpred.transfer_warm_state(state);
+    }
+}
+
+void AtomCore::get_warmup_counts(Stats* stats, WarmupCounts& counts)
+{
+    foreach(i, threadcount) {
+        AtomThread* thread = threads[i];
+
+        counts.tlb_accesses += thread->st_dtlb.accesses(stats);
+        counts.tlb_misses += thread->st_dtlb.misses(stats);
+        counts.branches += thread->st_branch_predictions.predictions(stats);
+        counts.mispredicts += thread->st_branch_predictions.fail(stats);
+    }
+}
+
+bool AtomCore::get_pmu_counts(Context& ctx, Stats* stats, W64 *counts)
+{
+    AtomThread* thread = get_thread(ctx);
+    if (!thread) return false;
+
+    W64 cycles = thread->st_cycles(stats);
+
+    counts[PMU_EVENT_CYCLES] = cycles;
+    counts[PMU_EVENT_INSNS] = thread->st_commit.insns(stats);
+    counts[PMU_EVENT_REF_CYCLES] = cycles;
+    counts[PMU_EVENT_LLC_REFS] =
+        thread->st_load_level(stats)[Core::TOPDOWN_MEM_L3] +
+        thread->st_load_level(stats)[Core::TOPDOWN_MEM_DRAM];
+    counts[PMU_EVENT_LLC_MISSES] =
+        thread->st_load_level(stats)[Core::TOPDOWN_MEM_DRAM];
+    counts[PMU_EVENT_BRANCHES] =
+        thread->st_branch_predictions.predictions(stats);
+    counts[PMU_EVENT_BRANCH_MISSES] =
+        thread->st_branch_predictions.fail(stats);
+    return true;
+}
+
 /**
  * @brief Flush a specific entry in TLB
  *
@@ -3276,8 +4083,13 @@ void AtomCore::flush_tlb_virt(Context& ctx, Waddr virtaddr)
 {
     foreach(i, threadcount) {
         if(threads[i]->ctx.cpu_index == ctx.cpu_index) {
-            dtlb.flush_virt(virtaddr, i);
-            itlb.flush_virt(virtaddr, i);
+            W8 tid = threads[i]->tlbid;
+            dtlb.flush_virt(virtaddr, tid);
+            itlb.flush_virt(virtaddr, tid);
+            dtlb_large.flush_virt(virtaddr, tid);
+            itlb_large.flush_virt(virtaddr, tid);
+            stlb.flush_virt(virtaddr, tid);
+            pwc.flush_virt(virtaddr, tid, ctx.page_table_level_count());
             break;
         }
     }
@@ -3303,14 +4115,18 @@ void AtomCore::flush_pipeline()
     }
 
     // Reset shared structures
-    fetchq.reset();
     forwardbuf.reset();
 
     fu_available = (W32)-1;
     fu_used = 0;
     port_available = (W8)-1;
 
+    foreach(i, threadcount) {
+        threads[i]->fu_reserved = 0;
+    }
+
     running_thread = threads[0];
+    penalty_left = 0;
 }
 
 /**
@@ -3322,14 +4138,24 @@ void AtomCore::flush_shared_structs(W8 threadid)
 {
     AtomThread* thread = threads[threadid];
 
-    // If this thread is running thread, flush fetchq and forwardbuf
+    // Other threads share the pipeline with fine grained and SMT switching,
+    // so only release what this thread holds
+    if(switch_policy >= THREAD_SWITCH_FINE) {
+        clear_thread_forward(threadid);
+
+        fu_available |= thread->fu_reserved;
+        thread->fu_reserved = 0;
+        return;
+    }
+
+    // If this thread is running thread, flush forwardbuf
     if(thread == running_thread) {
-        fetchq.reset();
         forwardbuf.reset();
 
         fu_available = (W32)-1;
         fu_used = 0;
         port_available = (W8)-1;
+        thread->fu_reserved = 0;
     }
 }
 
@@ -3340,6 +4166,7 @@ void AtomCore::check_ctx_changes()
 {
     foreach(i, threadcount) {
         threads[i]->ctx.handle_interrupt = 0;
+        threads[i]->events.recheck();
 
         if(threads[i]->ctx.eip != threads[i]->ctx.old_eip) {
             // IP Address has changed, so flush the pipeline
@@ -3360,11 +4187,6 @@ ostream& AtomCore::print(ostream& os) const
 {
     os << "Atom-Core: ", int(get_coreid()), endl;
 
-    os << " Fetch Queue:\n";
-    foreach_forward(fetchq, i) {
-        os << "  ", fetchq[i], endl;
-    }
-
     foreach(i, threadcount) {
         os << *threads[i], endl;
     }
@@ -3386,10 +4208,17 @@ void AtomCore::dump_configuration(YAML::Emitter &out) const
 
 	YAML_KEY_VAL(out, "type", "core");
 	YAML_KEY_VAL(out, "threads", threadcount);
-	YAML_KEY_VAL(out, "fetch_q_size", NUM_FRONTEND_STAGES+1);
+	YAML_KEY_VAL(out, "branch_predictor", branchpred_type.buf);
 	YAML_KEY_VAL(out, "forward_buf_size", FORWARD_BUF_SIZE);
 	YAML_KEY_VAL(out, "itlb_size", ITLB_SIZE);
 	YAML_KEY_VAL(out, "dtlb_size", DTLB_SIZE);
+	YAML_KEY_VAL(out, "dtlb_2m_size", DTLB_2M_SIZE);
+	YAML_KEY_VAL(out, "dtlb_1g_size", DTLB_1G_SIZE);
+	YAML_KEY_VAL(out, "itlb_2m_size", ITLB_2M_SIZE);
+	YAML_KEY_VAL(out, "itlb_1g_size", ITLB_1G_SIZE);
+	YAML_KEY_VAL(out, "stlb_sets", STLB_SETS);
+	YAML_KEY_VAL(out, "stlb_ways", STLB_WAYS);
+	YAML_KEY_VAL(out, "pwc_size", PWC_SIZE);
 	YAML_KEY_VAL(out, "total_FUs", (ATOM_ALU_FU_COUNT + ATOM_FPU_FU_COUNT +
 				ATOM_AGU_FU_COUNT));
 	YAML_KEY_VAL(out, "int_FUs", ATOM_ALU_FU_COUNT);
@@ -3401,8 +4230,12 @@ void AtomCore::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "fetch_width", ATOM_FETCH_WIDTH);
 	YAML_KEY_VAL(out, "issue_width", ATOM_ISSUE_PER_CYCLE);
 	YAML_KEY_VAL(out, "max_branch_in_flight", ATOM_MAX_BRANCH_IN_FLIGHT);
+	YAML_KEY_VAL(out, "thread_switch", thread_switch_names[switch_policy]);
+	YAML_KEY_VAL(out, "switch_penalty", switch_penalty);
+	YAML_KEY_VAL(out, "switch_miss_latency", switch_miss_latency);
 
 	out << YAML::Key << "per_thread" << YAML::Value << YAML::BeginMap;
+	YAML_KEY_VAL(out, "fetch_q_size", NUM_FRONTEND_STAGES+1);
 	YAML_KEY_VAL(out, "dispatch_q_size", ATOM_DISPATCH_Q_SIZE);
 	YAML_KEY_VAL(out, "store_buf_size", ATOM_STORE_BUF_SIZE);
 	out << YAML::EndMap;
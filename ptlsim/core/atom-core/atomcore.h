@@ -13,10 +13,13 @@
 
 #include <basecore.h>
 #include <branchpred.h>
+#include <pagewalk.h>
 #include <statelist.h>
 #include <decode.h>
 
 #include <statsBuilder.h>
+#include <spinloop.h>
+#include <topdown.h>
 
 #include <atomcore-const.h>
 
@@ -78,6 +81,13 @@ namespace ATOM_CORE_MODEL {
 
     const int DTLB_SIZE = ATOM_DTLB_SIZE;
     const int ITLB_SIZE = ATOM_ITLB_SIZE;
+    const int DTLB_2M_SIZE = ATOM_DTLB_2M_SIZE;
+    const int DTLB_1G_SIZE = ATOM_DTLB_1G_SIZE;
+    const int ITLB_2M_SIZE = ATOM_ITLB_2M_SIZE;
+    const int ITLB_1G_SIZE = ATOM_ITLB_1G_SIZE;
+    const int STLB_SETS = ATOM_STLB_SETS;
+    const int STLB_WAYS = ATOM_STLB_WAYS;
+    const int PWC_SIZE = ATOM_PWC_SIZE;
 
     const W8 MAX_FETCH_WIDTH = ATOM_FETCH_WIDTH;
 
@@ -171,6 +181,19 @@ namespace ATOM_CORE_MODEL {
         "ok", "barrier", "interrupt", "smc", "failed",
     };
 
+    enum {
+        THREAD_SWITCH_EVENT = 0, // Switch thread on every cache miss
+        THREAD_SWITCH_MISS,      // Switch only if miss is longer than
+                                 // switch_miss_latency
+        THREAD_SWITCH_FINE,      // Issue from next ready thread each cycle
+        THREAD_SWITCH_SMT,       // Issue from all ready threads each cycle
+        NUM_THREAD_SWITCH
+    };
+
+    static const char* thread_switch_names[NUM_THREAD_SWITCH] = {
+        "event", "miss", "fine", "smt",
+    };
+
     //
     // Opcodes and properties
     //
@@ -410,16 +433,16 @@ namespace ATOM_CORE_MODEL {
     //
     template <int tlbid, int size>
     struct TranslationLookasideBuffer: 
-        public FullyAssociativeTagsNbitOneHot<size, 40> {
+        public FullyAssociativeTagsNbitOneHot<size, 44> {
 
-        typedef FullyAssociativeTagsNbitOneHot<size, 40> base_t;
+        typedef FullyAssociativeTagsNbitOneHot<size, 44> base_t;
         TranslationLookasideBuffer(): base_t() { }
 
         void reset() {
             base_t::reset();
         }
 
-        // Get the 40-bit TLB tag (36 bit virtual page ID plus 4 bit threadid)
+        // Get the 44-bit TLB tag (36 bit virtual page ID plus 8 bit TLB id)
         static W64 tagof(W64 addr, W64 threadid) {
             return bits(addr, 12, 36) | (threadid << 36);
         }
@@ -449,9 +472,9 @@ namespace ATOM_CORE_MODEL {
             return size;
         }
 
-        int flush_thread(W64 threadid) {
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
             W64 tag = threadid << 36;
-            W64 tagmask = 0xfULL << 36;
+            W64 tagmask = mask << 36;
             bitvec<size> slotmask = base_t::masked_match(tag, tagmask);
             int n = slotmask.popcount();
             base_t::masked_invalidate(slotmask);
@@ -472,6 +495,10 @@ namespace ATOM_CORE_MODEL {
 
     typedef TranslationLookasideBuffer<0, DTLB_SIZE> DTLB;
     typedef TranslationLookasideBuffer<1, ITLB_SIZE> ITLB;
+    typedef LargePageTLBs<DTLB_2M_SIZE, DTLB_1G_SIZE> DTLBLarge;
+    typedef LargePageTLBs<ITLB_2M_SIZE, ITLB_1G_SIZE> ITLBLarge;
+    typedef SecondLevelTLB<STLB_SETS, STLB_WAYS> STLB;
+    typedef PageWalkCache<PWC_SIZE> PWC;
 
     struct BranchPredictorUpdateInfo: public PredictorUpdate {
         int stack_recover_idx;
@@ -480,7 +507,36 @@ namespace ATOM_CORE_MODEL {
     };
 
     struct StoreBufferEntry;
-    
+
+    enum {
+        ATOMOP_TMPL_NONPIPE = (1 << 0),
+        ATOMOP_TMPL_BARRIER = (1 << 1),
+        ATOMOP_TMPL_AST     = (1 << 2),
+        ATOMOP_TMPL_SOM     = (1 << 3),
+        ATOMOP_TMPL_EOM     = (1 << 4),
+    };
+
+    /**
+     * @brief Pre-decoded grouping of a BasicBlock's uops into one AtomOp
+     *
+     * Which uops go in an AtomOp, its FU/Port masks, latency and registers
+     * only depend on the uops, so they are computed once per BasicBlock
+     * (see get_atomop_templates) and AtomOp::fetch copies them instead of
+     * walking the uop descriptors again. Only the entry at the first uop of
+     * each group is valid.
+     */
+    struct AtomOpTemplate {
+        W32 fu_mask;
+        W8  port_mask;
+        W8  execution_cycles;
+        W8  num_uops;
+        W8  flags;
+        W8  src_registers[MAX_REG_ACCESS_PER_ATOMOP];
+        W8  dest_registers[MAX_UOPS_PER_ATOMOP];
+    };
+
+    AtomOpTemplate* get_atomop_templates(BasicBlock& bb);
+
     /**
      * @brief Represents one Atom Instruction in pipeline.
      *
@@ -504,7 +560,7 @@ namespace ATOM_CORE_MODEL {
 
         // Fetch Functions
         bool fetch();
-        void setup_registers();
+        void setup_registers(const AtomOpTemplate& tmpl);
 
         // Issue Functions
         W8   issue(bool first_issue);
@@ -573,6 +629,7 @@ namespace ATOM_CORE_MODEL {
         uopimpl_func_t synthops[MAX_UOPS_PER_ATOMOP];
         TransOp        uops[MAX_UOPS_PER_ATOMOP];
         bool           load_requestd[MAX_UOPS_PER_ATOMOP];
+        W64            load_addrs[MAX_UOPS_PER_ATOMOP];
         W16            rflags[MAX_UOPS_PER_ATOMOP];
         W8             num_uops_used;
         W64            uuid;
@@ -740,6 +797,9 @@ namespace ATOM_CORE_MODEL {
 
         bool writeback();
         bool commit_queue();
+        void spin_wait();
+        void spin_poll();
+        void spin_wake(int reason);
         bool handle_exception();
         bool handle_interrupt();
         bool handle_barrier();
@@ -747,6 +807,11 @@ namespace ATOM_CORE_MODEL {
 
         void itlb_walk();
         void dtlb_walk();
+        bool probe_tlb(Waddr virtaddr, bool is_icache);
+        void insert_tlb(Waddr virtaddr, bool is_icache);
+        W8 start_tlb_walk(Waddr virtaddr);
+        void finish_tlb_walk(Waddr virtaddr);
+        bool switch_address_space();
 
         bool access_dcache(Waddr addr, W64 rip, W8 type, W64 uuid);
 
@@ -766,6 +831,8 @@ namespace ATOM_CORE_MODEL {
         ostream& print(ostream& os) const;
 
         W8      threadid;
+        W8      tlbid; /* TLB tags of this thread's current address space */
+        TLBAddressSpaces address_spaces;
         W64     fetch_uuid;
         bool    register_invalid[TRANSREG_COUNT];
         AtomOp* register_owner[TRANSREG_COUNT];
@@ -800,6 +867,11 @@ namespace ATOM_CORE_MODEL {
         bool    inst_in_pipe;
         W64     last_commit_cycle;
 
+        /* With -spin-ff, a spinning thread doesn't fetch until woken */
+        SpinLoopDetector spin;
+        W64     total_insns_committed;
+        W64     total_uops_committed;
+
         BranchPredictorInterface branchpred;
 
         /**
@@ -807,6 +879,18 @@ namespace ATOM_CORE_MODEL {
          */
         W8 branches_in_flight;
         
+        /**
+         * @brief Fetch/Decode Queue
+         *
+         * This queue simulate the frontend pipeline which handles 'fetch' and
+         * 'decode' stages. Each thread has its own so threads can be in the
+         * frontend togather with fine grained and SMT thread switching.
+         *
+         * Note: Here 'Queue' keeps 1 entry for tracking 'head' and 'tail' of
+         * the ring buffer. So We add +1 to our fetchq.
+         */
+        Queue<BufferEntry, NUM_FRONTEND_STAGES+1> fetchq;
+
         RIPVirtPhys dispatchrip;
         Queue<BufferEntry, DISPATCH_QUEUE_SIZE+1> dispatchq;
 
@@ -834,10 +918,17 @@ namespace ATOM_CORE_MODEL {
         bool issue_disabled;
 
         bool    handle_interrupt_at_next_eom;
+        ContextEvents events; /* interrupt state is current for it */
         AtomOp* exception_op;
         bool    running;
         bool    ready;
 
+        /* Cycle this thread stopped on a cache miss */
+        W64     miss_cycle;
+
+        /* FUs held by this thread's non-pipelined AtomOps */
+        W32     fu_reserved;
+
         W8  queued_mem_lock_count;
         W64 queued_mem_lock_list[4];
 
@@ -997,6 +1088,9 @@ namespace ATOM_CORE_MODEL {
 
         cache_access st_dcache, st_icache;
 
+        /* Loads by the level of the hierarchy that served them */
+        StatArray<W64, Core::TOPDOWN_MEM_COUNT> st_load_level;
+
 		struct tlb_access : public Statable
 		{
 			StatObj<W64> accesses;
@@ -1014,10 +1108,32 @@ namespace ATOM_CORE_MODEL {
 				{}
 		};
 
-		tlb_access st_itlb, st_dtlb;
+		tlb_access st_itlb, st_dtlb, st_stlb, st_pwc;
+		TLBSpaceStats st_tlb_asid;
+
+        struct st_switch : public Statable
+        {
+            StatObj<W64> count;
+            StatObj<W64> drain_cycles;
+            StatObj<W64> penalty_cycles;
+            StatObj<W64> issue_cycles;
+
+            StatEquation<W64, double, StatObjFormulaDiv> utilization;
+
+            st_switch(Statable *parent)
+                : Statable("thread_switch", parent)
+                  , count("count", this)
+                  , drain_cycles("drain_cycles", this)
+                  , penalty_cycles("penalty_cycles", this)
+                  , issue_cycles("issue_cycles", this)
+                  , utilization("utilization", this)
+            {}
+        } st_switch;
 
         StatObj<W64> st_cycles;
 
+        SpinLoopStats st_spin;
+
         StatArray<W64, ASSIST_COUNT> assists;
         StatArray<W64, L_ASSIST_COUNT> lassists;
     };
@@ -1044,9 +1160,20 @@ namespace ATOM_CORE_MODEL {
         void check_ctx_changes();
         void flush_tlb(Context& ctx);
         void flush_tlb_virt(Context& ctx, Waddr virtaddr);
+        AtomThread* get_thread(Context& ctx);
+        bool runs_context(Context& ctx);
+        void warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache);
+        void warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+                W64 target);
+        void transfer_warm_state(WarmState& state);
+        void get_warmup_counts(Stats* stats, WarmupCounts& counts);
+        bool get_pmu_counts(Context& ctx, Stats* stats, W64 *counts);
         void dump_state(ostream& os);
         void update_stats();
         void flush_pipeline();
+        W64 get_next_active_cycle();
+        void skip_cycles(W64 cycles);
+        bool threads_halted();
         //W8   get_coreid();
 		void dump_configuration(YAML::Emitter &out) const;
 
@@ -1060,8 +1187,14 @@ namespace ATOM_CORE_MODEL {
         void complete();
 
         void forward();
-        void set_forward(W8 reg, W64 data);
-        void clear_forward(W8 reg);
+        void set_forward(W8 reg, W64 data, W8 threadid = 0);
+        void clear_forward(W8 reg, W8 threadid = 0);
+        void clear_thread_forward(W8 threadid);
+
+        /* Forward buffer entries are tagged with their thread */
+        static W16 forward_key(W8 reg, W8 threadid) {
+            return (W16(threadid) << 8) | reg;
+        }
 
         void transfer();
 
@@ -1070,6 +1203,8 @@ namespace ATOM_CORE_MODEL {
         void flush_shared_structs(W8 threadid);
 
         void try_thread_switch();
+        bool runcycle_threads();
+        void set_thread_stats(AtomThread* thread);
 
         ostream& print(ostream& os) const;
 
@@ -1077,34 +1212,49 @@ namespace ATOM_CORE_MODEL {
         W8   threadcount;
         bool in_thread_switch;
 
+        /* Thread switch policy, see THREAD_SWITCH_* */
+        int  switch_policy;
+        int  switch_penalty;
+        int  switch_miss_latency;
+        int  penalty_left;
+
+        /* AtomOps issued this cycle by all threads */
+        W8   issue_count;
+
+        /* Thread that fetches (and issues first) this cycle with fine
+         * grained and SMT switching */
+        W8   next_thread;
+
+        // Type of branch predictor of each thread
+        stringbuf branchpred_type;
+
         AtomThread** threads;
         AtomThread*  running_thread;
 
 		Signal run_cycle;
 
-        /**
-         * @brief Fetch/Decode Queue
-         *
-         * This queue simulate the frontend pipeline which handles 'fetch' and
-         * 'decode' stages. This queue is shared between threads. When one
-         * thread is stopped, this queue is flushed to start fetch/decode of
-         * other thread.
-         *
-         * Note: Here 'Queue' keeps 1 entry for tracking 'head' and 'tail' of
-         * the ring buffer. So We add +1 to our fetchq.
-         */
-        Queue<BufferEntry, NUM_FRONTEND_STAGES+1> fetchq;
+        /* Host time of groups of pipeline stages with -host-perf */
+        HostPerfCounter *perf_commit;
+        HostPerfCounter *perf_issue;
+        HostPerfCounter *perf_fetch;
 
         /**
          * @brief Fully Associative Array to store Forwarding Data
          *
-         * This forward buffer is shared between threads and on thread switch
-         * its cleared.
+         * This forward buffer is shared between threads, entries are keyed
+         * by forward_key. On thread switch or flush a thread's entries are
+         * cleared.
          */
         FullyAssociativeArray<W16, ForwardEntry, FORWARD_BUF_SIZE> forwardbuf;
 
         DTLB dtlb;
         ITLB itlb;
+        DTLBLarge dtlb_large;
+        ITLBLarge itlb_large;
+
+        // Second level TLB and page walk caches shared by all threads
+        STLB stlb;
+        PWC pwc;
 
         // fu_available is used across cycles for non-pipeliend instructions
         // fu_used is used within cycle to make sure that we dont issue
@@ -11,14 +11,55 @@
 #include <basecore.h>
 #include <globals.h>
 #include <decode.h>
+#include <qos.h>
 
 using namespace Core;
 
 BaseCore::BaseCore(BaseMachine& machine, const char* name)
     : Statable(name, &machine)
       , machine(machine)
+      , migration_peer(NULL)
+      , active(true)
+      , committed_insns(0)
+      , run_cycle_signal(NULL)
+      , parked(false)
+      , parked_cycle(0)
+      , pc_profile_stats(this)
 {
     coreid = machine.get_next_coreid();
+    context_base = machine.context_counter;
+    clock_domain = clock_domain_get(name);
+    Memory::qos_setup_core(machine, name, coreid);
+}
+
+void BaseCore::update_pc_profile_stats() {
+    if (!pc_profile_enabled)
+        return;
+
+    PcProfileEntry *top[PcProfileStats::TOP];
+    int count = pc_profile.top(top, PcProfileStats::TOP);
+
+    pc_profile_stats.enable_dump();
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+    foreach (s, 3) {
+        pc_profile_stats.set_default_stats(stats[s]);
+        pc_profile_stats.evictions = pc_profile.evictions;
+
+        foreach (i, count) {
+            PcProfileRowStats& row = *pc_profile_stats.rows[i];
+            PcProfileEntry& e = *top[i];
+            W64 avg_latency = e.avg_latency();
+            row.rip = e.rip;
+            row.accesses = e.accesses;
+            row.l1_misses = e.l1_misses;
+            row.l2_misses = e.l2_misses;
+            row.llc_misses = e.llc_misses;
+            row.dtlb_misses = e.dtlb_misses;
+            row.avg_latency = avg_latency;
+            row.max_latency = e.max_latency;
+        }
+    }
 }
 
 void BaseCore::update_memory_hierarchy_ptr() {
@@ -29,13 +70,16 @@ extern "C" void ptl_flush_bbcache(int8_t context_id) {
     if(in_simulation) {
       foreach(i, NUM_SIM_CORES) {
         bbcache[i].flush(context_id);
-        // Get the current ptlsim machine and call its flush tlb
-        PTLsimMachine* machine = PTLsimMachine::getcurrent();
+      }
 
-        if(machine) {
-            Context& ctx = machine->contextof(context_id);
-            machine->flush_tlb(ctx);
-        }
+      // Get the current ptlsim machine and call its flush tlb, once: with
+      // 'tlb_asids' a second call would see an unchanged CR3 and flush.
+      // Code flushes of all contexts (-1) don't touch TLBs.
+      PTLsimMachine* machine = PTLsimMachine::getcurrent();
+
+      if(machine && context_id >= 0) {
+          Context& ctx = machine->contextof(context_id);
+          machine->flush_tlb(ctx);
       }
     }
 }
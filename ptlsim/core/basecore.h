@@ -16,9 +16,21 @@
 #include <machine.h>
 #include <statsBuilder.h>
 #include <memoryHierarchy.h>
+#include <clockdomain.h>
+#include <pcprofile.h>
+#include <warmstate.h>
+#include <hostmem.h>
 
 namespace Core {
 
+    /* Counters of -warmup-detect, see warmupdetect.h */
+    struct WarmupCounts {
+        W64 tlb_accesses;
+        W64 tlb_misses;
+        W64 branches;
+        W64 mispredicts;
+    };
+
     class BaseCore : public Statable {
         W8 coreid;
 
@@ -26,6 +38,15 @@ namespace Core {
             BaseCore(BaseMachine& machine, const char* name);
             virtual ~BaseCore() {}
 
+            /* Pipeline structures and register files are on huge pages
+             * with -host-huge-pages, see hostmem.h */
+            static void* operator new(size_t bytes) {
+                return host_alloc(bytes);
+            }
+            static void operator delete(void *mem, size_t bytes) {
+                host_free(mem, bytes);
+            }
+
             virtual void reset() = 0;
             virtual void check_ctx_changes() = 0;
             virtual void flush_tlb(Context& ctx) = 0;
@@ -35,11 +56,90 @@ namespace Core {
             virtual void flush_pipeline() = 0;
 		    virtual void dump_configuration(YAML::Emitter &out) const = 0;
 
+            /*
+             * Idle cycle skipping: get_next_active_cycle returns the first
+             * cycle in which core has work to do (sim_cycle if core is busy)
+             * and skip_cycles updates per-cycle state for skipped cycles.
+             * Only cores with halted or spinning threads and nothing in
+             * flight report a later cycle: a pipeline stalled on a cache
+             * miss still counts its stall stats every cycle, so it is busy.
+             */
+            virtual W64 get_next_active_cycle() { return sim_cycle; }
+            virtual void skip_cycles(W64 cycles) {}
+
+            /*
+             * Functional warmup (see warmup.h): runs_context returns true
+             * if ctx is run by one of this core's threads, warm_tlb and
+             * warm_branch train TLBs and branch predictor of that thread
+             * with an access or a committed branch uop.
+             */
+            virtual bool runs_context(Context& ctx) { return false; }
+            virtual void warm_tlb(Context& ctx, Waddr virtaddr,
+                    bool is_icache) {}
+            virtual void warm_branch(Context& ctx, const TransOp& uop,
+                    W64 ripafter, W64 target) {}
+
+            /*
+             * Save or load TLBs and branch predictors in this core's
+             * section of a warm state file (see warmstate.h).
+             */
+            virtual void transfer_warm_state(WarmState& state) {}
+
+            /* Add TLB and branch counts of all threads in stats to counts */
+            virtual void get_warmup_counts(Stats* stats,
+                    WarmupCounts& counts) {}
+
+            /*
+             * Set counts, in PMU_EVENT_ order, to the events of ctx's
+             * thread in stats for its guest PMU (see guestpmu.h). False
+             * if this core doesn't count them.
+             */
+            virtual bool get_pmu_counts(Context& ctx, Stats* stats,
+                    W64 *counts) { return false; }
+
             void update_memory_hierarchy_ptr();
 
             BaseMachine& machine;
             Memory::MemoryHierarchy* memoryHierarchy;
 
+            /*
+             * Migration (see coremigration.h): a migration peer runs the same
+             * Contexts as its primary core, starting at context_base. Only
+             * one core of a pair is active; inactive cores are not clocked.
+             * committed_insns counts x86 instructions committed by all
+             * threads of the core.
+             */
+            BaseCore* migration_peer;
+            bool active;
+            W8 context_base;
+            W64 committed_insns;
+
+            /*
+             * Clock domain named after the core (see clockdomain.h), the
+             * core is only clocked in the cycles in which it ticks.
+             */
+            ClockDomain* clock_domain;
+
+            /*
+             * Parking: a core with no work (get_next_active_cycle returns
+             * a later cycle, e.g. all its threads are halted or spin) asks
+             * the machine to take run_cycle_signal off the per-cycle
+             * signals. It is clocked again once it has work, cycles spent
+             * parked since parked_cycle are accounted with skip_cycles.
+             */
+            Signal* run_cycle_signal;
+            bool parked;
+            W64 parked_cycle;
+
+            /*
+             * Per-rip load and store profile ('-pc-profile'), see
+             * pcprofile.h. update_pc_profile_stats writes its top entries
+             * to the core's 'pc_profile' stats node.
+             */
+            PcProfileTable pc_profile;
+            PcProfileStats pc_profile_stats;
+            void update_pc_profile_stats();
+
             W8 get_coreid() const {
                 return coreid;
             }
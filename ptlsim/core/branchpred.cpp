@@ -9,6 +9,7 @@
 //
 
 #include <branchpred.h>
+#include <warmstate.h>
 
 const char* branchpred_outcome_names[2] = {"mispred", "correct"};
 
@@ -427,11 +428,458 @@ struct CombinedPredictor {
   }
 };
 
+//
+// TAGE conditional and ITTAGE indirect branch predictors
+// (A. Seznec, "A case for (partially) TAgged GEometric history length
+// branch prediction", JILP 2006 and "A 64-Kbytes ITTAGE indirect branch
+// predictor", JWAC-2 2011).
+//
+// Each tagged table is indexed and tagged with a hash of the branch
+// address and a global history length of a geometric series. Histories
+// are folded to index and tag width incrementally, so a prediction only
+// XORs a few words per table. Entries are packed into 4 bytes (TAGE) and
+// 16 bytes (ITTAGE) so one table lookup touches one host cache line.
+//
+
+// Global history folded to 'width' bits (a circular shift register)
+struct FoldedHistory {
+  W32 comp;
+  int length;
+  int width;
+  int outpoint;
+
+  void init(int length, int width) {
+    this->length = length;
+    this->width = width;
+    outpoint = length % width;
+    comp = 0;
+  }
+
+  void update(byte newbit, byte oldbit) {
+    comp = (comp << 1) ^ newbit;
+    comp ^= oldbit << outpoint;
+    comp ^= comp >> width;
+    comp &= (1 << width) - 1;
+  }
+};
+
+struct TageHistory {
+  static const int BUFSIZE = 1024;
+
+  byte bits[BUFSIZE];
+  int ptr;
+  W32 path;
+  int length[TAGE_TABLES];
+  FoldedHistory index[TAGE_TABLES];
+  FoldedHistory tag0[TAGE_TABLES];
+  FoldedHistory tag1[TAGE_TABLES];
+
+  void reset(int minhist, int maxhist, int indexbits, int tagbits) {
+    assert(maxhist < BUFSIZE);
+    foreach (i, BUFSIZE) bits[i] = 0;
+    ptr = 0;
+    path = 0;
+
+    // Geometric series of history lengths from minhist to maxhist
+    foreach (i, TAGE_TABLES) {
+      double ratio = double(maxhist) / double(minhist);
+      length[i] = int(minhist * pow(ratio, double(i) / (TAGE_TABLES - 1)) + 0.5);
+      index[i].init(length[i], indexbits);
+      tag0[i].init(length[i], tagbits);
+      tag1[i].init(length[i], tagbits - 1);
+    }
+  }
+
+  void push(bool bit, W64 branchaddr) {
+    ptr = (ptr - 1) & (BUFSIZE - 1);
+    bits[ptr] = bit;
+    path = lowbits((path << 1) ^ (branchaddr & 1), 16);
+
+    foreach (i, TAGE_TABLES) {
+      byte oldbit = bits[(ptr + length[i]) & (BUFSIZE - 1)];
+      index[i].update(bit, oldbit);
+      tag0[i].update(bit, oldbit);
+      tag1[i].update(bit, oldbit);
+    }
+  }
+
+  int hash_index(W64 branchaddr, int table, int indexbits) const {
+    W64 pathbits = lowbits(path, min(length[table], 16));
+    return lowbits(branchaddr ^ (branchaddr >> indexbits) ^
+        index[table].comp ^ pathbits ^ (pathbits >> (table + 1)), indexbits);
+  }
+
+  W16 hash_tag(W64 branchaddr, int table, int tagbits) const {
+    return lowbits(branchaddr ^ tag0[table].comp ^ (tag1[table].comp << 1),
+        tagbits);
+  }
+};
+
+struct TageEntry {
+  W16 tag;
+  byte ctr;    // 3-bit direction counter, taken if >= 4
+  byte u;      // 2-bit useful counter
+};
+
+template <int LOGBASE, int LOGSIZE, int TAGBITS, int MINHIST, int MAXHIST>
+struct TagePredictor {
+  array<byte, (1 << LOGBASE)> base;
+  TageEntry table[TAGE_TABLES][1 << LOGSIZE];
+  TageHistory history;
+  int use_alt_on_na;
+  W64 tick;
+
+  void reset() {
+    foreach (i, (1 << LOGBASE)) base[i] = 2;
+    foreach (i, TAGE_TABLES) {
+      foreach (j, (1 << LOGSIZE)) {
+        table[i][j].tag = 0;
+        table[i][j].ctr = 4;
+        table[i][j].u = 0;
+      }
+    }
+    history.reset(MINHIST, MAXHIST, LOGSIZE, TAGBITS);
+    use_alt_on_na = 8;
+    tick = 0;
+  }
+
+  bool predict(PredictorUpdate& update, W64 branchaddr) {
+    int provider = -1;
+    int alt = -1;
+
+    update.tage_base = lowbits(branchaddr, LOGBASE);
+
+    for (int i = TAGE_TABLES - 1; i >= 0; i--) {
+      update.tage_index[i] = history.hash_index(branchaddr, i, LOGSIZE);
+      update.tage_tag[i] = history.hash_tag(branchaddr, i, TAGBITS);
+
+      if (table[i][update.tage_index[i]].tag == update.tage_tag[i]) {
+        if (provider < 0) provider = i;
+        else if (alt < 0) alt = i;
+      }
+    }
+
+    bool basepred = (base[update.tage_base] >= 2);
+    bool altpred = (alt >= 0) ?
+      (table[alt][update.tage_index[alt]].ctr >= 4) : basepred;
+    bool pred = basepred;
+    bool weak = 0;
+    bool provpred = basepred;
+
+    if (provider >= 0) {
+      TageEntry& e = table[provider][update.tage_index[provider]];
+      provpred = (e.ctr >= 4);
+      // Newly allocated entries are less accurate than alternate prediction
+      weak = (e.ctr == 3 || e.ctr == 4) && (e.u == 0);
+      pred = (weak && use_alt_on_na >= 8) ? altpred : provpred;
+    }
+
+    update.tage_provider = provider + 1;
+    update.tage_alt = alt + 1;
+    update.tage_pred = pred;
+    update.tage_provpred = provpred;
+    update.tage_altpred = altpred;
+    update.tage_weak = weak;
+
+    return pred;
+  }
+
+  void update(PredictorUpdate& update, W64 branchaddr, bool taken) {
+    int provider = update.tage_provider - 1;
+    bool mispred = (update.tage_pred != taken);
+
+    // Entry may have been replaced since it provided the prediction
+    bool replaced = (provider >= 0 &&
+        table[provider][update.tage_index[provider]].tag !=
+        update.tage_tag[provider]);
+
+    // Allocate one entry with longer history on a misprediction
+    if (mispred && update.tage_provider < TAGE_TABLES) {
+      bool allocated = 0;
+      for (int i = update.tage_provider; i < TAGE_TABLES; i++) {
+        TageEntry& e = table[i][update.tage_index[i]];
+        if (e.u == 0) {
+          e.tag = update.tage_tag[i];
+          e.ctr = (taken) ? 4 : 3;
+          allocated = 1;
+          break;
+        }
+      }
+
+      if (!allocated) {
+        for (int i = update.tage_provider; i < TAGE_TABLES; i++) {
+          TageEntry& e = table[i][update.tage_index[i]];
+          if (e.u > 0) e.u--;
+        }
+      }
+    }
+
+    if (replaced) {
+      // Nothing left to train
+    } else if (provider >= 0) {
+      TageEntry& e = table[provider][update.tage_index[provider]];
+
+      if (update.tage_weak && update.tage_provpred != update.tage_altpred) {
+        use_alt_on_na = clipto(use_alt_on_na +
+            ((update.tage_altpred == taken) ? +1 : -1), 0, 15);
+      }
+
+      e.ctr = clipto(e.ctr + (taken ? +1 : -1), 0, 7);
+
+      if (update.tage_provpred != update.tage_altpred) {
+        e.u = clipto(e.u + ((update.tage_provpred == taken) ? +1 : -1), 0, 3);
+      }
+    } else {
+      byte& ctr = base[update.tage_base];
+      ctr = clipto(ctr + (taken ? +1 : -1), 0, 3);
+    }
+
+    // Periodically age useful counters so stale entries can be replaced
+    if unlikely (lowbits(++tick, 18) == 0) {
+      foreach (i, TAGE_TABLES) {
+        foreach (j, (1 << LOGSIZE)) table[i][j].u >>= 1;
+      }
+    }
+  }
+};
+
+struct IttageEntry {
+  W64 target;
+  W16 tag;
+  byte conf;   // 2-bit confidence of target
+  byte u;      // 1-bit useful flag
+  W32 pad;
+};
+
+template <int LOGSIZE, int TAGBITS, int MINHIST, int MAXHIST>
+struct IttagePredictor {
+  IttageEntry table[TAGE_TABLES][1 << LOGSIZE];
+  TageHistory history;
+  W64 tick;
+
+  void reset() {
+    foreach (i, TAGE_TABLES) {
+      foreach (j, (1 << LOGSIZE)) {
+        setzero(table[i][j]);
+      }
+    }
+    history.reset(MINHIST, MAXHIST, LOGSIZE, TAGBITS);
+    tick = 0;
+  }
+
+  // Returns 0 if no table has a target, so base (BTB) target is used
+  W64 predict(PredictorUpdate& update, W64 branchaddr) {
+    int provider = -1;
+    int alt = -1;
+
+    for (int i = TAGE_TABLES - 1; i >= 0; i--) {
+      update.tage_index[i] = history.hash_index(branchaddr, i, LOGSIZE);
+      update.tage_tag[i] = history.hash_tag(branchaddr, i, TAGBITS);
+
+      if (table[i][update.tage_index[i]].tag == update.tage_tag[i]) {
+        if (provider < 0) provider = i;
+        else if (alt < 0) alt = i;
+      }
+    }
+
+    update.tage_provider = provider + 1;
+    update.tage_alt = alt + 1;
+
+    // Low confidence provider defers to alternate prediction
+    update.tage_weak = (provider >= 0 && alt >= 0 &&
+        table[provider][update.tage_index[provider]].conf == 0);
+
+    return predicted_target(update);
+  }
+
+  W64 predicted_target(const PredictorUpdate& update) const {
+    int table_id = (update.tage_weak) ? update.tage_alt : update.tage_provider;
+    if (!table_id) return 0;
+
+    return table[table_id - 1][update.tage_index[table_id - 1]].target;
+  }
+
+  void update(PredictorUpdate& update, W64 target, bool mispred) {
+    int provider = update.tage_provider - 1;
+
+    if (provider >= 0 && table[provider][update.tage_index[provider]].tag !=
+        update.tage_tag[provider]) {
+      provider = -1;
+    }
+
+    if (provider >= 0) {
+      IttageEntry& e = table[provider][update.tage_index[provider]];
+
+      if (e.target == target) {
+        e.conf = min(e.conf + 1, 3);
+        if (!update.tage_weak) e.u = 1;
+      } else if (e.conf > 0) {
+        e.conf--;
+      } else {
+        e.target = target;
+        e.u = 0;
+      }
+    }
+
+    if (mispred && update.tage_provider < TAGE_TABLES) {
+      bool allocated = 0;
+      for (int i = update.tage_provider; i < TAGE_TABLES; i++) {
+        IttageEntry& e = table[i][update.tage_index[i]];
+        if (e.u == 0) {
+          e.tag = update.tage_tag[i];
+          e.target = target;
+          e.conf = 0;
+          allocated = 1;
+          break;
+        }
+      }
+
+      if (!allocated) {
+        for (int i = update.tage_provider; i < TAGE_TABLES; i++) {
+          table[i][update.tage_index[i]].u = 0;
+        }
+      }
+    }
+
+    if unlikely (lowbits(++tick, 18) == 0) {
+      foreach (i, TAGE_TABLES) {
+        foreach (j, (1 << LOGSIZE)) table[i][j].u = 0;
+      }
+    }
+  }
+};
+
+template <int BTBSETS, int BTBWAYS, int RASSIZE>
+struct TageBranchPredictor {
+  TagePredictor<14, 10, 11, 4, 320> tage;
+  IttagePredictor<9, 11, 4, 320> ittage;
+
+  BranchTargetBuffer<BTBSETS, BTBWAYS> btb;
+  ReturnAddressStack<RASSIZE> ras;
+  W8 coreid;
+  W8 threadid;
+  TageBranchPredictor(W8 coreid_, W8 threadid_): coreid(coreid_), threadid(threadid_){};
+
+  void reset() {
+    tage.reset();
+    ittage.reset();
+    btb.reset(coreid, threadid);
+    ras.reset(coreid, threadid);
+  }
+
+  void updateras(PredictorUpdate& predinfo, W64 rip) {
+    if unlikely (predinfo.flags & BRANCH_HINT_RET) {
+      predinfo.ras_push = 0;
+      ras.pop(predinfo.ras_old);
+    } else if likely (predinfo.flags & BRANCH_HINT_CALL) {
+      predinfo.ras_push = 1;
+      ras.push(predinfo.uuid, rip, predinfo.ras_old);
+    }
+  }
+
+  W64 predict(PredictorUpdate& update, int type, W64 branchaddr, W64 target) {
+    update.cp1 = NULL;
+    update.cp2 = NULL;
+    update.cpmeta = NULL;
+    update.flags = type;
+
+    if unlikely ((type & (BRANCH_HINT_COND|BRANCH_HINT_INDIRECT)) == 0) {
+      return target;
+    }
+
+    if unlikely (type & BRANCH_HINT_RET) {
+      return ras.peek();
+    }
+
+    if likely (type & BRANCH_HINT_COND) {
+      return tage.predict(update, branchaddr) ? target : branchaddr;
+    }
+
+    W64 predicted = ittage.predict(update, branchaddr);
+    if (predicted) return predicted;
+
+    BTBEntry* pbtb = btb.probe(branchaddr);
+    return (pbtb ? pbtb->target : target);
+  }
+
+  void update(PredictorUpdate& update, W64 branchaddr, W64 target) {
+    int type = update.flags;
+    bool taken = (target != branchaddr);
+
+    if unlikely (type & BRANCH_HINT_RET) return;
+
+    if likely (type & BRANCH_HINT_COND) {
+      tage.update(update, branchaddr, taken);
+      tage.history.push(taken, branchaddr);
+      ittage.history.push(taken, branchaddr);
+      return;
+    }
+
+    if unlikely ((type & BRANCH_HINT_INDIRECT) == 0) return;
+
+    W64 predicted = ittage.predicted_target(update);
+    BTBEntry* pbtb = btb.probe(branchaddr);
+    if (!predicted && pbtb) predicted = pbtb->target;
+
+    ittage.update(update, target, predicted != target);
+
+    pbtb = btb.select(branchaddr);
+    pbtb->target = target;
+
+    // Indirect branches extend history with a bit of their target
+    ittage.history.push(bit(target, 2), branchaddr);
+  }
+
+  void annulras(const PredictorUpdate& predinfo) {
+    if (predinfo.ras_push)
+      ras.annulpush(predinfo.ras_old);
+    else ras.annulpop(predinfo.ras_old);
+  }
+};
+
+//
+// Predictor selected with core's 'branch_predictor' option
+//
+struct BranchPredictorImplementation {
+  virtual ~BranchPredictorImplementation() { }
+  virtual void reset() = 0;
+  virtual W64 predict(PredictorUpdate& update, int type, W64 branchaddr, W64 target) = 0;
+  virtual void update(PredictorUpdate& update, W64 branchaddr, W64 target) = 0;
+  virtual void updateras(PredictorUpdate& predinfo, W64 rip) = 0;
+  virtual void annulras(const PredictorUpdate& predinfo) = 0;
+  virtual ostream& print_ras(ostream& os) = 0;
+  virtual void transfer_warm_state(WarmState& state) = 0;
+};
+
+template <typename P>
+struct BranchPredictorModel: public BranchPredictorImplementation, public P {
+  BranchPredictorModel(W8 coreid, W8 threadid): P(coreid, threadid) { }
+  void reset() { P::reset(); }
+  W64 predict(PredictorUpdate& update, int type, W64 branchaddr, W64 target) {
+    return P::predict(update, type, branchaddr, target);
+  }
+  void update(PredictorUpdate& update, W64 branchaddr, W64 target) {
+    P::update(update, branchaddr, target);
+  }
+  void updateras(PredictorUpdate& predinfo, W64 rip) { P::updateras(predinfo, rip); }
+  void annulras(const PredictorUpdate& predinfo) { P::annulras(predinfo); }
+  ostream& print_ras(ostream& os) { return os << P::ras; }
+
+  // Tables are saved as one blob, a predictor built with other sizes
+  // doesn't load it. The loading core keeps its own ids.
+  void transfer_warm_state(WarmState& state) {
+    W8 coreid = P::coreid;
+    W8 threadid = P::threadid;
+    state.object(static_cast<P&>(*this));
+    P::coreid = coreid;
+    P::threadid = threadid;
+  }
+};
+
 // template <int METASIZE, int BIMODSIZE, int L1SIZE, int L2SIZE, int SHIFTWIDTH, bool HISTORYXOR, int BTBSETS, int BTBWAYS, int RASSIZE>
 // G-share constraints: METASIZE, BIMODSIZE, 1, L2SIZE, log2(L2SIZE), (HISTORYXOR = true), BTBSETS, BTBWAYS, RASSIZE
-struct BranchPredictorImplementation: public CombinedPredictor<65536, 65536, 1, 65536, 16, 1, 1024, 4, 1024> {
-  BranchPredictorImplementation(W8 coreid, W8 threadid):CombinedPredictor<65536, 65536, 1, 65536, 16, 1, 1024, 4, 1024> (coreid, threadid){}
- };
+typedef BranchPredictorModel<CombinedPredictor<65536, 65536, 1, 65536, 16, 1, 1024, 4, 1024> > CombinedModel;
+typedef BranchPredictorModel<TageBranchPredictor<1024, 4, 1024> > TageModel;
 
 void BranchPredictorInterface::destroy() {
   if (impl) delete impl;
@@ -442,12 +890,27 @@ void BranchPredictorInterface::reset() {
   impl->reset();
 }
 
-void BranchPredictorInterface::init(W8 coreid, W8 threadid) {
+void BranchPredictorInterface::init(W8 coreid, W8 threadid, const char* type) {
   destroy();
-  //  impl = new BranchPredictorImplementation();
-  impl = new BranchPredictorImplementation(coreid, threadid);
+
+  if (strequal(type, "tage")) {
+    impl = new TageModel(coreid, threadid);
+  } else if (strequal(type, "combined")) {
+    impl = new CombinedModel(coreid, threadid);
+  } else {
+    stringbuf err;
+    err << "::ERROR::Can't find branch predictor '" << type <<
+      "'. Please check your config file." << endl;
+    ptl_logfile << err;
+    cout << err;
+    assert(impl);
+  }
+
   reset();
-  
+}
+
+void BranchPredictorInterface::transfer_warm_state(WarmState& state) {
+  impl->transfer_warm_state(state);
 }
 
 W64 BranchPredictorInterface::predict(PredictorUpdate& update, int type, W64 branchaddr, W64 target) {
@@ -469,6 +932,6 @@ void BranchPredictorInterface::annulras(const PredictorUpdate& predinfo) {
 void BranchPredictorInterface::flush() { }
 
 ostream& operator <<(ostream& os, const BranchPredictorInterface& branchpred) {
-  os << branchpred.impl->ras;
+  branchpred.impl->print_ras(os);
   return os;
 }
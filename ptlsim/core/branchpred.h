@@ -41,6 +41,9 @@ struct ReturnAddressStackEntry {
 
 ostream& operator <<(ostream& os, const ReturnAddressStackEntry& e);
 
+// Tagged tables of TAGE and ITTAGE predictors
+#define TAGE_TABLES             7
+
 struct PredictorUpdate {
   W64 uuid;
   byte* cp1;
@@ -49,6 +52,13 @@ struct PredictorUpdate {
   // predicted directions:
   W32 ctxid:8, flags:8, bimodal:1, twolevel:1, meta:1, ras_push:1;
   ReturnAddressStackEntry ras_old;
+  // TAGE/ITTAGE: table entries looked up at prediction time
+  W16 tage_index[TAGE_TABLES];
+  W16 tage_tag[TAGE_TABLES];
+  W16 tage_base;
+  // provider and alternate table plus one, 0 is base predictor
+  W8 tage_provider, tage_alt;
+  W8 tage_pred:1, tage_provpred:1, tage_altpred:1, tage_weak:1;
 };
 
 extern W64 branchpred_ras_pushes;
@@ -58,6 +68,7 @@ extern W64 branchpred_ras_underflows;
 extern W64 branchpred_ras_annuls;
 
 struct BranchPredictorImplementation;
+class WarmState;
 
 struct BranchPredictorInterface {
   // Pointer to private implementation:
@@ -65,7 +76,7 @@ struct BranchPredictorInterface {
 
   BranchPredictorInterface() { impl = NULL; }
   //  void init();
-  void init(W8 coreid, W8 threadid);
+  void init(W8 coreid, W8 threadid, const char* type = "combined");
   void reset();
   void destroy();
   W64 predict(PredictorUpdate& update, int type, W64 branchaddr, W64 target);
@@ -73,6 +84,7 @@ struct BranchPredictorInterface {
   void updateras(PredictorUpdate& predinfo, W64 branchaddr);
   void annulras(const PredictorUpdate& predinfo);
   void flush();
+  void transfer_warm_state(WarmState& state);
 };
 
 ostream& operator <<(ostream& os, const BranchPredictorInterface& branchpred);
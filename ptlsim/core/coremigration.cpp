@@ -0,0 +1,315 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <coremigration.h>
+#include <basecore.h>
+#include <globals.h>
+
+using namespace Core;
+
+const char* Core::migration_policy_names[MIGRATION_POLICY_COUNT] = {
+    "none", "interval", "ipc"
+};
+
+const char* Core::migration_source_names[MIGRATION_SOURCE_COUNT] = {
+    "guest", "policy"
+};
+
+MigrationController Core::migration;
+
+/* Contexts of a pair are not run until its new core is activated */
+bool MigrationPair::pending() const
+{
+    return !current->active;
+}
+
+/**
+ * @brief Find the core pairs of the machine
+ *
+ * @param machine Machine whose cores are built
+ *
+ * Called once the machine is built. Machines without migration peers
+ * have no pairs and no 'migration' stats.
+ */
+void MigrationController::init(BaseMachine& machine)
+{
+    pairs.clear();
+    requests.clear();
+
+    foreach (i, machine.cores.count()) {
+        BaseCore* core = machine.cores[i];
+
+        if (!core->migration_peer || !core->active)
+            continue;
+
+        MigrationPair pair;
+        pair.primary = core;
+        pair.peer = core->migration_peer;
+        pair.current = core;
+        pair.ctx = &machine.contextof(core->context_base);
+        pair.ready_cycle = 0;
+        pair.resident_cycle = pair.interval_cycle = sim_cycle;
+        pair.resident_insns = pair.interval_insns = core->committed_insns;
+        pairs.push(pair);
+    }
+
+    if (enabled() && !stats)
+        stats = new MigrationStats(&machine);
+
+    config_changed(config);
+}
+
+void MigrationController::reset()
+{
+    pairs.clear();
+    requests.clear();
+}
+
+void MigrationController::config_changed(PTLsimConfig& config)
+{
+    foreach (i, MIGRATION_POLICY_COUNT) {
+        if (config.migration_policy == migration_policy_names[i]) {
+            policy = i;
+            return;
+        }
+    }
+
+    cerr << "Unknown -migration-policy " << config.migration_policy <<
+         ", use none, interval or ipc" << endl;
+    config.migration_policy = "none";
+    policy = MIGRATION_POLICY_NONE;
+}
+
+void MigrationController::set_stats_mode(Context& ctx)
+{
+    stats->set_default_stats(ctx.kernel_mode ? kernel_stats : user_stats);
+}
+
+MigrationPair* MigrationController::find_pair(Context& ctx)
+{
+    foreach (i, pairs.count()) {
+        if (pairs[i].primary->runs_context(ctx))
+            return &pairs[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Queue a migration of the core pair that runs ctx
+ *
+ * @param ctx Context that asks for the migration
+ * @param target MIGRATE_TO_PRIMARY, MIGRATE_TO_PEER or MIGRATE_SWAP
+ * @param source Who asks, MIGRATION_SOURCE_xxx
+ *
+ * @return false if ctx is not run by a core pair or target is unknown
+ *
+ * All Contexts of the pair move with ctx. The request is applied at the
+ * start of next cycle.
+ */
+bool MigrationController::request(Context& ctx, int target, int source)
+{
+    if (!enabled())
+        return false;
+
+    set_stats_mode(ctx);
+    stats->requests[source]++;
+
+    if (target < 0 || target >= MIGRATE_TARGET_COUNT || !find_pair(ctx)) {
+        stats->rejected++;
+        return false;
+    }
+
+    Request req;
+    req.ctx = &ctx;
+    req.target = target;
+    req.source = source;
+    requests.push(req);
+
+    return true;
+}
+
+/**
+ * @brief Apply queued requests and the policy, once per cycle
+ *
+ * @param config Simulation configuration
+ *
+ * Runs before the cores are clocked.
+ */
+void MigrationController::clock(PTLsimConfig& config)
+{
+    foreach (i, requests.count()) {
+        Request& req = requests[i];
+        MigrationPair* pair = find_pair(*req.ctx);
+
+        if (!pair || !migrate(*pair, req.target, config.migration_penalty)) {
+            set_stats_mode(*req.ctx);
+            stats->rejected++;
+        }
+    }
+    requests.clear();
+
+    W64 interval = max(config.migration_interval, W64(1));
+
+    foreach (i, pairs.count()) {
+        MigrationPair& pair = pairs[i];
+
+        if (pair.pending()) {
+            if (sim_cycle >= pair.ready_cycle)
+                activate(pair);
+            continue;
+        }
+
+        if (policy != MIGRATION_POLICY_NONE &&
+                sim_cycle - pair.interval_cycle >= interval)
+            apply_policy(pair, config);
+    }
+}
+
+/**
+ * @brief Start moving the Contexts of pair to another core
+ *
+ * @return false if the Contexts already are on target or still moving
+ *
+ * Flushing the running core leaves the state of its last committed
+ * instructions in the Contexts, the new core restarts from there once the
+ * penalty is over.
+ */
+bool MigrationController::migrate(MigrationPair& pair, int target,
+        W64 penalty)
+{
+    BaseCore* to;
+
+    if (target == MIGRATE_TO_PRIMARY) {
+        to = pair.primary;
+    } else if (target == MIGRATE_TO_PEER) {
+        to = pair.peer;
+    } else {
+        to = (pair.current == pair.primary) ? pair.peer : pair.primary;
+    }
+
+    if (pair.pending() || to == pair.current)
+        return false;
+
+    BaseCore* from = pair.current;
+
+    update_residency(pair);
+    from->flush_pipeline();
+    from->active = false;
+
+    pair.current = to;
+    pair.ready_cycle = sim_cycle + penalty;
+
+    set_stats_mode(*pair.ctx);
+    stats->migrations++;
+    stats->penalty_cycles += penalty;
+
+    if (logable(1)) {
+        ptl_logfile << "Migrating contexts of ", from->get_name(), " to ",
+                    to->get_name(), " at cycle ", sim_cycle, endl;
+    }
+
+    return true;
+}
+
+void MigrationController::activate(MigrationPair& pair)
+{
+    BaseCore* core = pair.current;
+
+    core->active = true;
+    core->flush_pipeline();
+    core->check_ctx_changes();
+
+    pair.resident_cycle = pair.interval_cycle = sim_cycle;
+    pair.resident_insns = pair.interval_insns = core->committed_insns;
+}
+
+void MigrationController::apply_policy(MigrationPair& pair,
+        PTLsimConfig& config)
+{
+    BaseCore* core = pair.current;
+    W64 cycles = sim_cycle - pair.interval_cycle;
+    double ipc = double(core->committed_insns - pair.interval_insns) /
+        double(cycles);
+
+    pair.interval_cycle = sim_cycle;
+    pair.interval_insns = core->committed_insns;
+
+    int target;
+
+    if (policy == MIGRATION_POLICY_INTERVAL) {
+        target = MIGRATE_SWAP;
+    } else if (core == pair.primary && ipc < config.migration_ipc_low) {
+        target = MIGRATE_TO_PEER;
+    } else if (core == pair.peer && ipc > config.migration_ipc_high) {
+        target = MIGRATE_TO_PRIMARY;
+    } else {
+        return;
+    }
+
+    set_stats_mode(*pair.ctx);
+    stats->requests[MIGRATION_SOURCE_POLICY]++;
+
+    migrate(pair, target, config.migration_penalty);
+}
+
+void MigrationController::update_residency(MigrationPair& pair)
+{
+    BaseCore* core = pair.current;
+
+    if (pair.pending())
+        return;
+
+    W64 cycles = sim_cycle - pair.resident_cycle;
+    W64 insns = core->committed_insns - pair.resident_insns;
+
+    set_stats_mode(*pair.ctx);
+
+    if (core == pair.primary) {
+        stats->primary_cycles += cycles;
+        stats->primary_insns += insns;
+    } else {
+        stats->peer_cycles += cycles;
+        stats->peer_insns += insns;
+    }
+
+    pair.resident_cycle = sim_cycle;
+    pair.resident_insns = core->committed_insns;
+}
+
+void MigrationController::update_stats()
+{
+    foreach (i, pairs.count()) {
+        update_residency(pairs[i]);
+    }
+}
+
+/**
+ * @brief First cycle in which a migration has to be applied
+ */
+W64 MigrationController::get_next_active_cycle() const
+{
+    if (requests.count())
+        return sim_cycle;
+
+    W64 horizon = infinity;
+    W64 interval = max(config.migration_interval, W64(1));
+
+    foreach (i, pairs.count()) {
+        const MigrationPair& pair = pairs[i];
+
+        if (pair.pending()) {
+            horizon = min(horizon, pair.ready_cycle);
+        } else if (policy != MIGRATION_POLICY_NONE) {
+            horizon = min(horizon, pair.interval_cycle + interval);
+        }
+    }
+
+    return horizon;
+}
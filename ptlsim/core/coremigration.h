@@ -0,0 +1,150 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef CORE_MIGRATION_H
+#define CORE_MIGRATION_H
+
+#include <ptlsim.h>
+#include <machine.h>
+#include <statsBuilder.h>
+
+namespace Core {
+
+    class BaseCore;
+
+    enum {
+        MIGRATION_POLICY_NONE = 0,
+        MIGRATION_POLICY_INTERVAL,
+        MIGRATION_POLICY_IPC,
+        MIGRATION_POLICY_COUNT
+    };
+
+    extern const char* migration_policy_names[MIGRATION_POLICY_COUNT];
+
+    /* Targets of a migration request, same values as PTLCALL_MIGRATE_xxx */
+    enum {
+        MIGRATE_TO_PRIMARY = 0,
+        MIGRATE_TO_PEER,
+        MIGRATE_SWAP,
+        MIGRATE_TARGET_COUNT
+    };
+
+    /* Who asked for a migration */
+    enum {
+        MIGRATION_SOURCE_GUEST = 0,
+        MIGRATION_SOURCE_POLICY,
+        MIGRATION_SOURCE_COUNT
+    };
+
+    extern const char* migration_source_names[MIGRATION_SOURCE_COUNT];
+
+    struct MigrationStats : public Statable {
+        StatArray<W64, MIGRATION_SOURCE_COUNT> requests;
+        StatObj<W64> migrations;
+        StatObj<W64> rejected;
+        StatObj<W64> penalty_cycles;
+        StatObj<W64> primary_cycles;
+        StatObj<W64> peer_cycles;
+        StatObj<W64> primary_insns;
+        StatObj<W64> peer_insns;
+
+        MigrationStats(Statable *parent)
+            : Statable("migration", parent)
+              , requests("requests", this, migration_source_names)
+              , migrations("migrations", this)
+              , rejected("rejected", this)
+              , penalty_cycles("penalty_cycles", this)
+              , primary_cycles("primary_cycles", this)
+              , peer_cycles("peer_cycles", this)
+              , primary_insns("primary_insns", this)
+              , peer_insns("peer_insns", this)
+        { }
+    };
+
+    /**
+     * @brief A core and its migration peer
+     *
+     * current is the core that runs the Contexts, or will run them once
+     * ready_cycle is reached. Residency (cycles and instructions on each
+     * core) is added to the stats when the pair migrates and on
+     * update_stats(), in user or kernel stats by the mode of ctx.
+     */
+    struct MigrationPair {
+        BaseCore* primary;
+        BaseCore* peer;
+        BaseCore* current;
+        Context* ctx;
+        W64 ready_cycle;
+
+        W64 resident_cycle;
+        W64 resident_insns;
+        W64 interval_cycle;
+        W64 interval_insns;
+
+        bool pending() const;
+    };
+
+    /**
+     * @brief Moves Contexts between the cores of big.LITTLE pairs
+     *
+     * Machine configs pair a core with a migration peer of another type
+     * (see CoreBuilder::add_migration_peer) that is built on the same
+     * Contexts. A migration flushes the pipeline of the running core, so
+     * its committed state is all in the Contexts, waits the
+     * '-migration-penalty' cycles of state transfer and then restarts the
+     * other core from the Contexts with flush_pipeline and
+     * check_ctx_changes. The caches of the new core start cold.
+     *
+     * Migrations are requested by the guest with PTLCALL_MIGRATE and by
+     * the '-migration-policy': 'interval' swaps the cores of each pair
+     * every '-migration-interval' cycles, 'ipc' moves a pair to the peer
+     * core when IPC of an interval on the primary core is below
+     * '-migration-ipc-low' and back once IPC on the peer core is above
+     * '-migration-ipc-high'. Requests are applied at the start of the next
+     * cycle so they never flush a pipeline in the middle of its commit.
+     */
+    struct MigrationController {
+        dynarray<MigrationPair> pairs;
+        MigrationStats* stats;
+        int policy;
+
+        struct Request {
+            Context* ctx;
+            int target;
+            int source;
+        };
+        dynarray<Request> requests;
+
+        MigrationController() : stats(NULL), policy(MIGRATION_POLICY_NONE) {}
+
+        void init(BaseMachine& machine);
+        void reset();
+        void config_changed(PTLsimConfig& config);
+
+        bool enabled() const { return pairs.count() > 0; }
+
+        bool request(Context& ctx, int target, int source);
+        void clock(PTLsimConfig& config);
+        W64 get_next_active_cycle() const;
+        void update_stats();
+
+        private:
+        MigrationPair* find_pair(Context& ctx);
+        bool migrate(MigrationPair& pair, int target, W64 penalty);
+        void activate(MigrationPair& pair);
+        void apply_policy(MigrationPair& pair, PTLsimConfig& config);
+        void update_residency(MigrationPair& pair);
+        void set_stats_mode(Context& ctx);
+    };
+
+    extern MigrationController migration;
+
+};
+
+#endif // CORE_MIGRATION_H
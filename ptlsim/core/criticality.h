@@ -0,0 +1,64 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef CRITICALITY_H
+#define CRITICALITY_H
+
+#include <ptlsim.h>
+
+namespace Core {
+
+    /**
+     * @brief Predictor of uops on the critical path
+     *
+     * (E. Tune, D. Liang, D. Tullsen and B. Calder, "Dynamic Prediction of
+     * Critical Path Instructions", HPCA 2001.)
+     *
+     * A uop that was the oldest in the ROB and held back commit is taken
+     * as critical. Each rip hashes to a 2 bit counter, counted up when its
+     * uop blocked commit and down when it committed without blocking. The
+     * uop is predicted critical from the upper half of the counter.
+     *
+     * Table size must be power of two.
+     */
+    template <int size>
+    struct CriticalityPredictor {
+        static const byte MAX_COUNT = 3;
+        static const byte CRITICAL_COUNT = 2;
+
+        byte counters[size];
+
+        CriticalityPredictor() { reset(); }
+
+        void reset() {
+            foreach (i, size) counters[i] = 0;
+        }
+
+        static int index(W64 rip) {
+            return lowbits(rip ^ (rip >> log2(size)), log2(size));
+        }
+
+        bool critical(W64 rip) const {
+            return counters[index(rip)] >= CRITICAL_COUNT;
+        }
+
+        /* Committed uop at rip, blocked if it held back commit */
+        void train(W64 rip, bool blocked) {
+            byte& c = counters[index(rip)];
+            if (blocked) {
+                if (c < MAX_COUNT) c++;
+            } else {
+                if (c > 0) c--;
+            }
+        }
+    };
+
+};
+
+#endif // CRITICALITY_H
@@ -0,0 +1,39 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef INTERVAL_CONST_H
+#define INTERVAL_CONST_H
+
+#ifndef INTERVAL_DTLB_SIZE
+#define INTERVAL_DTLB_SIZE 64
+#endif
+
+#ifndef INTERVAL_ITLB_SIZE
+#define INTERVAL_ITLB_SIZE 64
+#endif
+
+/* Defaults of the run time options, see IntervalCore */
+#ifndef INTERVAL_DISPATCH_WIDTH
+#define INTERVAL_DISPATCH_WIDTH 4
+#endif
+
+#ifndef INTERVAL_ROB_SIZE
+#define INTERVAL_ROB_SIZE 128
+#endif
+
+#ifndef INTERVAL_MISPREDICT_PENALTY
+#define INTERVAL_MISPREDICT_PENALTY 14
+#endif
+
+#ifndef INTERVAL_TLB_MISS_PENALTY
+#define INTERVAL_TLB_MISS_PENALTY 30
+#endif
+
+#endif
@@ -0,0 +1,971 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <intervalcore.h>
+#include <intervalvariant.h>
+#include <globals.h>
+#include <ptlsim.h>
+#include <branchpred.h>
+#include <decode.h>
+#include <memoryHierarchy.h>
+#include <hostperf.h>
+#include <statehash.h>
+
+using namespace INTERVAL_CORE_MODEL;
+using namespace Memory;
+
+//---------------------------------------------//
+//   IntervalThread
+//---------------------------------------------//
+
+/**
+ * @brief Create a new IntervalThread
+ *
+ * @param core IntervalCore to which this thread belongs to
+ * @param threadid This thread's ID
+ * @param ctx CPU Context of this thread
+ */
+IntervalThread::IntervalThread(IntervalCore& core, W8 threadid, Context& ctx)
+    : Statable("thread", &core)
+      , core(core)
+      , threadid(threadid)
+      , ctx(ctx)
+      , exec_stats(this, "exec")
+      , exec(ctx, core, exec_stats, this)
+      , st_commit(this)
+      , st_branch_predictions(this)
+      , st_dcache("dcache", this)
+      , st_icache("icache", this)
+      , st_itlb("itlb", this)
+      , st_dtlb("dtlb", this)
+      , st_overlapped_misses("overlapped_misses", this)
+      , st_cycles("cycles", this)
+      , st_cpi_stack("cpi_stack", this, cycle_type_names)
+      , assists("assists", this, assist_names)
+{
+    stringbuf th_name;
+    th_name << "thread_" << threadid;
+    update_name(th_name.buf);
+
+    stringbuf sig_name;
+    sig_name << "Core" << core.get_coreid() << "-Th" << threadid << "-dcache-wakeup";
+    dcache_signal.set_name(sig_name.buf);
+    dcache_signal.connect(signal_mem_ptr(*this,
+            &IntervalThread::dcache_wakeup));
+
+    sig_name.reset();
+    sig_name << "Core" << core.get_coreid() << "-Th" << threadid << "-icache-wakeup";
+    icache_signal.set_name(sig_name.buf);
+    icache_signal.connect(signal_mem_ptr(*this,
+            &IntervalThread::icache_wakeup));
+
+    HostPerfCounter *perf = host_perf_register(core.get_name());
+    dcache_signal.set_perf(perf);
+    icache_signal.set_perf(perf);
+
+    /* Predictor is kept across pipeline flushes, it is only reset with
+     * the core, so warmed up state is not lost on first flush */
+    branchpred.init(core.get_coreid(), threadid, core.branchpred_type.buf);
+
+    foreach(i, core.variantcount) {
+        variants.push(new IntervalVariant(*this, i + 1));
+    }
+
+    reset();
+
+    // Set Stat Equations
+    st_commit.ipc.add_elem(&st_commit.insns);
+    st_commit.ipc.add_elem(&st_cycles);
+
+    st_dcache.miss_ratio.add_elem(&st_dcache.misses);
+    st_dcache.miss_ratio.add_elem(&st_dcache.accesses);
+
+    st_icache.miss_ratio.add_elem(&st_icache.misses);
+    st_icache.miss_ratio.add_elem(&st_icache.accesses);
+
+    st_itlb.miss_ratio.add_elem(&st_itlb.misses);
+    st_itlb.miss_ratio.add_elem(&st_itlb.accesses);
+
+    st_dtlb.miss_ratio.add_elem(&st_dtlb.misses);
+    st_dtlb.miss_ratio.add_elem(&st_dtlb.accesses);
+}
+
+IntervalThread::~IntervalThread()
+{
+    foreach(i, variants.count()) {
+        delete variants[i];
+    }
+}
+
+/**
+ * @brief Reset the thread
+ */
+void IntervalThread::reset()
+{
+    flush_pipeline();
+
+    dtlb.reset();
+    itlb.reset();
+    dispatched_uops = 0;
+
+    foreach(i, variants.count()) {
+        variants[i]->reset();
+    }
+}
+
+/**
+ * @brief Drop the timing state of instructions in flight
+ *
+ * Outstanding cache requests still complete, their callbacks are
+ * ignored.
+ */
+void IntervalThread::flush_pipeline()
+{
+    exec.reset();
+
+    credits = 0;
+    stall_cycles = 0;
+    wait_type = CYCLE_IDLE;
+    waiting_for_icache = false;
+    icache_miss_addr = 0;
+    load_misses.clear();
+
+    foreach(i, variants.count()) {
+        variants[i]->flush_pipeline();
+    }
+}
+
+/**
+ * @brief True if 'rob_size' uops were dispatched after the oldest
+ * outstanding load miss
+ */
+bool IntervalThread::window_full() const
+{
+    return load_misses.count() &&
+        dispatched_uops - load_misses[0] >= (W64)core.rob_size;
+}
+
+/**
+ * @brief Stop dispatching for a miss event penalty
+ */
+void IntervalThread::stall(int cycles, int type)
+{
+    stall_cycles += cycles;
+    st_cpi_stack[type] += cycles;
+}
+
+/**
+ * @brief Account cycles in which the thread is halted or not running
+ */
+void IntervalThread::idle(W64 cycles)
+{
+    st_cpi_stack[CYCLE_IDLE] += cycles;
+
+    foreach(i, variants.count()) {
+        variants[i]->idle(cycles);
+    }
+}
+
+/**
+ * @brief Simulate one cycle of this thread
+ *
+ * @return true if exit to qemu is requested
+ */
+bool IntervalThread::runcycle()
+{
+    set_default_stats(ctx.kernel_mode ? kernel_stats : user_stats);
+
+    st_cycles++;
+
+    if unlikely (!ctx.running || ctx.halted) {
+        wait_type = CYCLE_IDLE;
+        idle(1);
+        return false;
+    }
+
+    /* Cycles of penalties are already accounted */
+    if(stall_cycles) {
+        stall_cycles--;
+        return false;
+    }
+
+    if(waiting_for_icache || window_full()) {
+        wait_type = waiting_for_icache ? CYCLE_ICACHE : CYCLE_DCACHE;
+        st_cpi_stack[wait_type]++;
+        return false;
+    }
+
+    st_cpi_stack[CYCLE_DISPATCH]++;
+
+    /* Width left over by a short block is not kept for later cycles */
+    credits = min(credits + core.dispatch_width, core.dispatch_width);
+
+    while(credits > 0) {
+        W64 insns = exec.insns;
+        W64 uops = exec.uops;
+
+        bool running = exec.run_bb();
+
+        insns = exec.insns - insns;
+        uops = exec.uops - uops;
+
+        st_commit.insns += insns;
+        st_commit.uops += uops;
+        core.committed_insns += insns;
+        ::total_insns_committed += insns;
+        ::total_uops_committed += uops;
+        if unlikely (state_hash_enabled && insns)
+            state_hash_commit(ctx.cpu_index, ctx.eip, insns);
+
+        credits -= uops;
+        dispatched_uops += uops;
+
+        foreach(i, variants.count()) {
+            variants[i]->dispatch(uops);
+        }
+
+        if(!running)
+            return handle_stop();
+
+        if(stall_cycles || waiting_for_icache || window_full())
+            break;
+    }
+
+    /* The core may park before the next cycle of this thread */
+    if(waiting_for_icache || window_full())
+        wait_type = waiting_for_icache ? CYCLE_ICACHE : CYCLE_DCACHE;
+
+    return false;
+}
+
+/**
+ * @brief Handle the reason the functional execution stopped
+ *
+ * @return true if exit to qemu needed
+ */
+bool IntervalThread::handle_stop()
+{
+    bool exit_requested = true;
+
+    exec_stats.stop[exec.stop]++;
+
+    switch(exec.stop) {
+        case WARMUP_STOP_BARRIER:
+            exit_requested = handle_barrier();
+            break;
+        case WARMUP_STOP_EXCEPTION:
+            exit_requested = handle_exception();
+            break;
+        case WARMUP_STOP_INTERRUPT:
+            INTERVALTHLOG1("Handling interrupt ", ctx.interrupt_request,
+                    " exit ", ctx.exit_request);
+            ctx.event_upcall();
+            break;
+        default:
+            ptl_logfile << "ERROR: ", core.get_name(), " thread ",
+                        threadid, " can't execute rip ",
+                        hexstring(ctx.eip, 48), ": ",
+                        warmup_stop_names[exec.stop], endl;
+            assert(0);
+    }
+
+    /* Assists and QEMU change the Context, restart from its state */
+    exec.reset();
+
+    return exit_requested;
+}
+
+/**
+ * @brief Raise the exception left in the Context by the execution
+ *
+ * @return true if exit to qemu needed
+ */
+bool IntervalThread::handle_exception()
+{
+    INTERVALTHLOG1("handle_exception()");
+    assert(ctx.exception > 0);
+
+    int write_exception = 0;
+
+    switch(ctx.exception) {
+        case EXCEPTION_PageFaultOnRead:
+            write_exception = 0;
+            goto handle_page_fault;
+        case EXCEPTION_PageFaultOnWrite:
+            write_exception = 1;
+            goto handle_page_fault;
+        case EXCEPTION_PageFaultOnExec:
+            write_exception = 2;
+            goto handle_page_fault;
+handle_page_fault:
+            {
+                INTERVALTHLOG1("Page fault: ", exception_names[ctx.exception],
+                        " addr: ", hexstring(ctx.page_fault_addr, 48));
+
+                assert(ctx.page_fault_addr != 0);
+                ctx.handle_interrupt = 1;
+                ctx.handle_page_fault(ctx.page_fault_addr, write_exception);
+
+                ctx.exception = 0;
+                ctx.exception_index = 0;
+                ctx.exception_is_int = 0;
+                return true;
+            }
+        case EXCEPTION_FloatingPoint:
+            ctx.exception_index = EXCEPTION_x86_fpu;
+            break;
+        case EXCEPTION_FloatingPointNotAvailable:
+            ctx.exception_index = EXCEPTION_x86_fpu_not_avail;
+            break;
+        default:
+            ptl_logfile << "ERROR: ", core.get_name(), " thread ", threadid,
+                        " unsupported exception ",
+                        exception_names[ctx.exception], endl;
+            assert(0);
+    }
+
+    ctx.propagate_x86_exception(ctx.exception_index, ctx.error_code,
+            ctx.page_fault_addr);
+
+    return true;
+}
+
+/**
+ * @brief Call the assist of a committed barrier instruction
+ *
+ * @return true if exit to qemu needed
+ */
+bool IntervalThread::handle_barrier()
+{
+    int assistid = ctx.eip;
+    assist_func_t assist = (assist_func_t)(Waddr)assistid_to_func[assistid];
+
+    INTERVALTHLOG1("Executing Assist Function ", assist_name(assist));
+
+    assist(ctx);
+
+    assists[assistid]++;
+
+    return true;
+}
+
+/**
+ * @brief Look up an access in the thread's TLB, a miss walks page tables
+ */
+void IntervalThread::tlb_access(Waddr virtaddr, bool is_icache)
+{
+    foreach(i, variants.count()) {
+        variants[i]->tlb_access(virtaddr, is_icache);
+    }
+
+    if(is_icache) {
+        st_itlb.accesses++;
+        if likely (itlb.probe(virtaddr))
+            return;
+        st_itlb.misses++;
+        itlb.insert(virtaddr);
+    } else {
+        st_dtlb.accesses++;
+        if likely (dtlb.probe(virtaddr))
+            return;
+        st_dtlb.misses++;
+        dtlb.insert(virtaddr);
+    }
+
+    stall(core.tlb_miss_penalty, CYCLE_TLB);
+}
+
+/**
+ * @brief Send an access to the memory hierarchy
+ *
+ * Load hits in the L1 are hidden by the window and are not sent. Accesses
+ * that find the CPU controller queue full are installed without timing,
+ * the instruction has already executed.
+ */
+void IntervalThread::cache_access(W64 physaddr, bool is_icache,
+        bool is_store)
+{
+    MemoryHierarchy* mem = core.memoryHierarchy;
+    W8 coreid = core.get_coreid();
+
+    if(is_icache) {
+        st_icache.accesses++;
+    } else {
+        st_dcache.accesses++;
+    }
+
+    if unlikely (config.perfect_cache)
+        return;
+
+    if(!is_icache && !is_store &&
+            mem->access_hit(coreid, threadid, physaddr, ctx.eip,
+                dispatched_uops))
+        return;
+
+    if unlikely (!mem->is_cache_available(coreid, threadid, is_icache)) {
+        if(is_icache) {
+            st_icache.queue_full++;
+        } else {
+            st_dcache.queue_full++;
+        }
+        mem->warm_access(coreid, physaddr, is_icache, is_store);
+        return;
+    }
+
+    MemoryRequest *request = mem->get_free_request(coreid);
+    assert(request);
+
+    request->init(coreid, threadid, physaddr, 0, sim_cycle, is_icache,
+            ctx.eip, dispatched_uops,
+            is_store ? MEMORY_OP_WRITE : MEMORY_OP_READ);
+    request->set_coreSignal(is_icache ? &icache_signal : &dcache_signal);
+
+    bool hit = mem->access_cache(request);
+
+    if(hit || is_store)
+        return;
+
+    if(is_icache) {
+        waiting_for_icache = true;
+        icache_miss_addr = floor(physaddr, 64);
+        return;
+    }
+
+    st_dcache.misses++;
+
+    if(load_misses.count())
+        st_overlapped_misses++;
+    load_misses.push(dispatched_uops);
+
+    foreach(i, variants.count()) {
+        variants[i]->load_miss(dispatched_uops);
+    }
+}
+
+/**
+ * @brief Predict a committed branch and train the predictor with it
+ *
+ * @param branchpred Predictor of the thread or of one of its variants
+ *
+ * @return true if the branch was mispredicted
+ */
+bool IntervalThread::predict_branch(BranchPredictorInterface& branchpred,
+        const TransOp& uop, W64 ripafter, W64 target)
+{
+    BranchPredictorUpdateInfo predinfo;
+    predinfo.uuid = 0;
+    predinfo.ctxid = ctx.cpu_index;
+    predinfo.ripafter = ripafter;
+    predinfo.bptype =
+        (isclass(uop.opcode, OPCLASS_COND_BRANCH) <<
+         log2(BRANCH_HINT_COND)) |
+        (isclass(uop.opcode, OPCLASS_INDIR_BRANCH) <<
+         log2(BRANCH_HINT_INDIRECT)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_PUSH_RAS)) <<
+         log2(BRANCH_HINT_CALL)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_POP_RAS)) <<
+         log2(BRANCH_HINT_RET));
+
+    W64 predrip = branchpred.predict(predinfo, predinfo.bptype, ripafter,
+            uop.riptaken);
+
+    if(predinfo.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET))
+        branchpred.updateras(predinfo, ripafter);
+
+    branchpred.update(predinfo, ripafter, target);
+
+    return predrip != target;
+}
+
+void IntervalThread::branch(const TransOp& uop, W64 ripafter, W64 target)
+{
+    st_branch_predictions.predictions++;
+
+    foreach(i, variants.count()) {
+        variants[i]->branch(uop, ripafter, target);
+    }
+
+    if(!predict_branch(branchpred, uop, ripafter, target))
+        return;
+
+    st_branch_predictions.mispredicts++;
+    stall(core.mispredict_penalty, CYCLE_BRANCH);
+}
+
+/**
+ * @brief Callback function for dcache access
+ *
+ * @param arg MemoryRequest* containing information of original request
+ *
+ * @return indicating if callback is executed without any issue or not
+ */
+bool IntervalThread::dcache_wakeup(void *arg)
+{
+    MemoryRequest* req = (MemoryRequest*)arg;
+
+    if(req->get_type() == Memory::MEMORY_OP_WRITE) {
+        return true;
+    }
+
+    /* Requests of a flushed window are not in load_misses anymore */
+    W64 uuid = req->get_owner_uuid();
+    foreach(i, load_misses.count()) {
+        if(load_misses[i] == uuid) {
+            load_misses.remove(uuid);
+
+            foreach(j, variants.count()) {
+                variants[j]->load_done(uuid,
+                        sim_cycle - req->get_init_cycles());
+            }
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Callback function for icache access
+ *
+ * @param arg MemoryRequest* containing information of original request
+ *
+ * @return indicating if callback is executed without any issue or not
+ */
+bool IntervalThread::icache_wakeup(void *arg)
+{
+    MemoryRequest* req = (MemoryRequest*)arg;
+
+    /* Only misses that went past the L1 are counted as misses */
+    if(req->get_level() > L1_D_CACHE) {
+        st_icache.misses++;
+    }
+
+    if(waiting_for_icache &&
+            icache_miss_addr == floor(req->get_physical_address(), 64)) {
+        waiting_for_icache = false;
+        icache_miss_addr = 0;
+
+        foreach(i, variants.count()) {
+            variants[i]->icache_miss(sim_cycle - req->get_init_cycles());
+        }
+    }
+
+    return true;
+}
+
+ostream& IntervalThread::print(ostream& os) const
+{
+    os << "IntervalThread: ", threadid, " rip: ", hexstring(ctx.eip, 48),
+       " dispatched uops: ", dispatched_uops, " credits: ", credits,
+       " stall cycles: ", stall_cycles, " waiting for icache: ",
+       waiting_for_icache, " load misses: ", load_misses.count(), endl;
+
+    return os;
+}
+
+//---------------------------------------------//
+//   IntervalCore
+//---------------------------------------------//
+
+/**
+ * @brief Create a new IntervalCore model
+ *
+ * @param machine BaseMachine that glue all cores and memory
+ * @param name Name of the core, its options are read with it
+ */
+IntervalCore::IntervalCore(BaseMachine& machine, const char* name)
+    : BaseCore(machine, name)
+{
+    if(!machine.get_option(name, "threads", threadcount)) {
+        threadcount = 1;
+    }
+
+    if(!machine.get_option(name, "branch_predictor", branchpred_type)) {
+        branchpred_type << "combined";
+    }
+
+    dispatch_width = get_count_option("dispatch_width",
+            INTERVAL_DISPATCH_WIDTH, 1);
+    rob_size = get_count_option("rob_size",
+            INTERVAL_ROB_SIZE, 1);
+    mispredict_penalty = get_count_option("mispredict_penalty",
+            INTERVAL_MISPREDICT_PENALTY, 0);
+    tlb_miss_penalty = get_count_option("tlb_miss_penalty",
+            INTERVAL_TLB_MISS_PENALTY, 0);
+    variantcount = get_count_option("variants", 0, 0);
+
+    threads = (IntervalThread**)qemu_mallocz(
+            threadcount*sizeof(IntervalThread*));
+
+    stringbuf sg_name;
+    sg_name << name << "-run-cycle";
+    run_cycle.set_name(sg_name.buf);
+    run_cycle.connect(signal_mem_ptr(*this, &IntervalCore::runcycle));
+    run_cycle.set_perf(host_perf_register(get_name()));
+    marss_register_per_cycle_event(&run_cycle);
+    run_cycle_signal = &run_cycle;
+
+    foreach(i, threadcount) {
+        Context& ctx = machine.get_next_context();
+
+        threads[i] = new IntervalThread(*this, i, ctx);
+    }
+
+    reset();
+}
+
+IntervalCore::~IntervalCore()
+{
+}
+
+/**
+ * @brief Simulate one cycle of execution
+ *
+ * @return true if exit to qemu is requested
+ */
+bool IntervalCore::runcycle(void* none)
+{
+    /* Contexts are run by the migration peer of this core */
+    if unlikely (!active)
+        return false;
+
+    /* No edge of this core's clock in this simulation cycle */
+    if unlikely (!clock_domain->ticks)
+        return false;
+
+    /* Nothing to do until an event or a cache miss wakes up a thread */
+    if unlikely (get_next_active_cycle() > sim_cycle) {
+        machine.request_park(*this);
+        return false;
+    }
+
+    INTERVALCORELOG("Cycle: ", sim_cycle);
+
+    foreach(i, threadcount) {
+        IntervalThread* thread = threads[i];
+
+        if unlikely (thread->ctx.halted && !thread->ctx.is_halted()) {
+            thread->ctx.halted = 0;
+        }
+
+        if(thread->runcycle()) {
+            INTERVALCORELOG("Exit to qemu requested");
+            machine.ret_qemu_env = &thread->ctx;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Find the first cycle in which this core has work to do
+ *
+ * @return sim_cycle if a thread can dispatch or pays a penalty, infinity
+ * if all threads are halted, not running or wait for the memory hierarchy
+ */
+W64 IntervalCore::get_next_active_cycle()
+{
+    foreach(i, threadcount) {
+        IntervalThread* thread = threads[i];
+
+        if(!thread->ctx.running || thread->ctx.is_halted())
+            continue;
+
+        if(!thread->stall_cycles &&
+                (thread->waiting_for_icache || thread->window_full()))
+            continue;
+
+        return sim_cycle;
+    }
+
+    return infinity;
+}
+
+/**
+ * @brief Account cycles in which this core was not clocked
+ */
+void IntervalCore::skip_cycles(W64 cycles)
+{
+    foreach(i, threadcount) {
+        IntervalThread* thread = threads[i];
+
+        thread->set_default_stats(thread->ctx.kernel_mode ?
+                kernel_stats : user_stats);
+        thread->st_cycles += cycles;
+
+        if(!thread->ctx.running || thread->ctx.halted) {
+            thread->idle(cycles);
+        } else {
+            thread->st_cpi_stack[thread->wait_type] += cycles;
+        }
+    }
+}
+
+/**
+ * @brief Reset the core and its threads
+ */
+void IntervalCore::reset()
+{
+    foreach(i, threadcount) {
+        IntervalThread* thread = threads[i];
+
+        thread->reset();
+        thread->branchpred.reset();
+
+        foreach(j, thread->variants.count()) {
+            thread->variants[j]->branchpred.reset();
+        }
+    }
+}
+
+/**
+ * @brief Flush a Context specific TLB entries
+ *
+ * @param ctx Context of which we flush entries
+ */
+void IntervalCore::flush_tlb(Context& ctx)
+{
+    IntervalThread* thread = get_thread(ctx);
+
+    if(thread) {
+        thread->dtlb.reset();
+        thread->itlb.reset();
+
+        foreach(i, thread->variants.count()) {
+            thread->variants[i]->dtlb.reset();
+            thread->variants[i]->itlb.reset();
+        }
+    }
+}
+
+/**
+ * @brief Flush a specific entry in TLB
+ *
+ * @param ctx Context of which we flush the entry
+ * @param virtaddr Address of the page to flush
+ */
+void IntervalCore::flush_tlb_virt(Context& ctx, Waddr virtaddr)
+{
+    IntervalThread* thread = get_thread(ctx);
+
+    if(thread) {
+        thread->dtlb.flush_virt(virtaddr);
+        thread->itlb.flush_virt(virtaddr);
+
+        foreach(i, thread->variants.count()) {
+            thread->variants[i]->dtlb.flush_virt(virtaddr);
+            thread->variants[i]->itlb.flush_virt(virtaddr);
+        }
+    }
+}
+
+/**
+ * @brief Find the thread that runs given Context
+ *
+ * @return NULL if ctx is not run by this core
+ */
+IntervalThread* IntervalCore::get_thread(Context& ctx)
+{
+    foreach(i, threadcount) {
+        if(&threads[i]->ctx == &ctx)
+            return threads[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Read a count option of the core
+ *
+ * @param def Value if the option is not set
+ * @param min Smallest allowed value
+ */
+int IntervalCore::get_count_option(const char* opt, int def, int min)
+{
+    int value;
+
+    if(!machine.get_option(get_name(), opt, value))
+        return def;
+
+    if(value < min) {
+        ptl_logfile << "ERROR: ", get_name(), " ", opt, " ", value,
+                    " is less than ", min, endl;
+        assert(0);
+    }
+
+    return value;
+}
+
+bool IntervalCore::runs_context(Context& ctx)
+{
+    return get_thread(ctx) != NULL;
+}
+
+/**
+ * @brief Functional warmup: install virtaddr in TLB for ctx's thread
+ */
+void IntervalCore::warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache)
+{
+    IntervalThread* thread = get_thread(ctx);
+    assert(thread);
+
+    if(is_icache) {
+        thread->itlb.insert(virtaddr);
+    } else {
+        thread->dtlb.insert(virtaddr);
+    }
+
+    foreach(i, thread->variants.count()) {
+        IntervalVariant* variant = thread->variants[i];
+
+        if(is_icache) {
+            variant->itlb.insert(virtaddr);
+        } else {
+            variant->dtlb.insert(virtaddr);
+        }
+    }
+}
+
+/**
+ * @brief Functional warmup: train branch predictor with a committed branch
+ */
+void IntervalCore::warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+        W64 target)
+{
+    IntervalThread* thread = get_thread(ctx);
+    assert(thread);
+
+    thread->predict_branch(thread->branchpred, uop, ripafter, target);
+
+    foreach(i, thread->variants.count()) {
+        IntervalVariant* variant = thread->variants[i];
+        thread->predict_branch(variant->branchpred, uop, ripafter, target);
+    }
+}
+
+/**
+ * @brief Save or load TLBs and branch predictors of threads and variants
+ */
+void IntervalCore::transfer_warm_state(WarmState& state)
+{
+    state.expect(threadcount);
+    state.expect(variantcount);
+
+    foreach(i, threadcount) {
+        IntervalThread* thread = threads[i];
+
+        state.object(thread->dtlb);
+        state.object(thread->itlb);
+        thread->branchpred.transfer_warm_state(state);
+
+        foreach(j, thread->variants.count()) {
+            IntervalVariant* variant = thread->variants[j];
+
+            state.object(variant->dtlb);
+            state.object(variant->itlb);
+            variant->branchpred.transfer_warm_state(state);
+        }
+    }
+}
+
+void IntervalCore::dump_state(ostream& os)
+{
+    os << *this;
+}
+
+void IntervalCore::update_stats()
+{
+}
+
+/**
+ * @brief Flush the timing state of all threads
+ */
+void IntervalCore::flush_pipeline()
+{
+    foreach(i, threadcount) {
+        threads[i]->flush_pipeline();
+    }
+}
+
+/**
+ * @brief Restart threads from their Contexts after QEMU ran
+ *
+ * Unlike the pipelined cores nothing is fetched ahead of the Context, so
+ * it is enough to restart execution and flags from its state.
+ */
+void IntervalCore::check_ctx_changes()
+{
+    foreach(i, threadcount) {
+        threads[i]->ctx.handle_interrupt = 0;
+        threads[i]->exec.reset();
+    }
+}
+
+ostream& IntervalCore::print(ostream& os) const
+{
+    os << "Interval-Core: ", int(get_coreid()), endl;
+
+    foreach(i, threadcount) {
+        os << *threads[i], endl;
+    }
+
+    return os;
+}
+
+/**
+ * @brief Dump Interval Core configuration
+ *
+ * @param out YAML object to dump configuration parameters
+ */
+void IntervalCore::dump_configuration(YAML::Emitter &out) const
+{
+    out << YAML::Key << get_name();
+    out << YAML::Value << YAML::BeginMap;
+
+    YAML_KEY_VAL(out, "type", "core");
+    YAML_KEY_VAL(out, "model", "interval");
+    YAML_KEY_VAL(out, "threads", threadcount);
+    YAML_KEY_VAL(out, "branch_predictor", branchpred_type.buf);
+    YAML_KEY_VAL(out, "dispatch_width", dispatch_width);
+    YAML_KEY_VAL(out, "rob_size", rob_size);
+    YAML_KEY_VAL(out, "mispredict_penalty", mispredict_penalty);
+    YAML_KEY_VAL(out, "tlb_miss_penalty", tlb_miss_penalty);
+    YAML_KEY_VAL(out, "itlb_size", ITLB_SIZE);
+    YAML_KEY_VAL(out, "dtlb_size", DTLB_SIZE);
+    YAML_KEY_VAL(out, "variants", variantcount);
+
+    /* Variants of all threads have the same options */
+    if(variantcount) {
+        IntervalThread* thread = threads[0];
+
+        foreach(i, thread->variants.count()) {
+            thread->variants[i]->dump_configuration(out);
+        }
+    }
+
+    out << YAML::EndMap;
+}
+
+IntervalCoreBuilder::IntervalCoreBuilder(const char* name)
+    : CoreBuilder(name)
+{
+}
+
+BaseCore* IntervalCoreBuilder::get_new_core(BaseMachine& machine,
+        const char* name)
+{
+    IntervalCore* core = new IntervalCore(machine, name);
+    return core;
+}
+
+namespace INTERVAL_CORE_MODEL {
+    IntervalCoreBuilder intervalBuilder(INTERVAL_CORE_NAME);
+};
@@ -0,0 +1,325 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MARSS_INTERVAL_CORE_H
+#define MARSS_INTERVAL_CORE_H
+
+#include <basecore.h>
+#include <branchpred.h>
+#include <warmup.h>
+#include <decode.h>
+#include <statsBuilder.h>
+
+#include <intervalcore-const.h>
+
+/* Logging Macros */
+// Base Logging Level
+#define INTERVAL_BASE_LL 5
+
+#define INTERVALLOG1(...) if(logable(INTERVAL_BASE_LL)) { ptl_logfile << __VA_ARGS__ ; }
+
+#define INTERVALCORELOG(...) INTERVALLOG1("Core:", get_coreid(), " ", \
+        __VA_ARGS__, endl)
+#define INTERVALTHLOG1(...) INTERVALLOG1("Core:", core.get_coreid(), \
+        " Th:", threadid, " ", __VA_ARGS__, endl)
+
+namespace INTERVAL_CORE_MODEL {
+
+    using namespace superstl;
+    using namespace Core;
+
+    /* Constants */
+    const int DTLB_SIZE = INTERVAL_DTLB_SIZE;
+    const int ITLB_SIZE = INTERVAL_ITLB_SIZE;
+
+    /* What a thread did in a cycle, its CPI stack */
+    enum {
+        CYCLE_DISPATCH = 0, // Dispatched uops
+        CYCLE_BRANCH,       // Refilled the frontend after a mispredict
+        CYCLE_ICACHE,       // Waited for an I-cache miss
+        CYCLE_TLB,          // Walked page tables after a TLB miss
+        CYCLE_DCACHE,       // Window full behind a D-cache miss
+        CYCLE_IDLE,         // Halted or not running
+        CYCLE_TYPE_COUNT
+    };
+
+    static const char* cycle_type_names[CYCLE_TYPE_COUNT] = {
+        "dispatch", "branch", "icache", "tlb", "dcache", "idle",
+    };
+
+    struct IntervalCore;
+    struct IntervalVariant;
+
+    //
+    // Per thread TLB with one-hot semantics, tagged with the 36 bit
+    // virtual page ID of 48 bit virtual addresses.
+    //
+    template <int size>
+    struct TranslationLookasideBuffer:
+        public FullyAssociativeTagsNbitOneHot<size, 36> {
+
+        typedef FullyAssociativeTagsNbitOneHot<size, 36> base_t;
+        TranslationLookasideBuffer(): base_t() { }
+
+        static W64 tagof(W64 addr) {
+            return bits(addr, 12, 36);
+        }
+
+        bool probe(W64 addr) {
+            return (base_t::probe(tagof(addr)) >= 0);
+        }
+
+        void insert(W64 addr) {
+            W64 oldtag = -1;
+            base_t::select(tagof(addr), oldtag);
+        }
+
+        int flush_virt(Waddr virtaddr) {
+            return this->invalidate(tagof(virtaddr));
+        }
+    };
+
+    typedef TranslationLookasideBuffer<DTLB_SIZE> DTLB;
+    typedef TranslationLookasideBuffer<ITLB_SIZE> ITLB;
+
+    struct BranchPredictorUpdateInfo: public PredictorUpdate {
+        int stack_recover_idx;
+        int bptype;
+        W64 ripafter;
+    };
+
+    /**
+     * @brief One hardware thread of the interval core
+     *
+     * Instructions are executed functionally one basic block at a time by
+     * a WarmupThread, whose accesses and branches are the miss events of
+     * the thread. Between them the thread dispatches 'dispatch_width' uops
+     * per cycle. A mispredicted branch costs 'mispredict_penalty' cycles
+     * and a TLB miss 'tlb_miss_penalty' cycles. I-cache misses stall until
+     * the line arrives. A D-cache load miss stalls once 'rob_size' uops are
+     * dispatched after it, so independent misses in one window overlap.
+     * Stores don't stall.
+     */
+    struct IntervalThread : public Statable, public WarmupTiming {
+        IntervalCore& core;
+        W8 threadid;
+        Context& ctx;
+
+        WarmupStats exec_stats;
+        WarmupThread exec;
+
+        BranchPredictorInterface branchpred;
+        DTLB dtlb;
+        ITLB itlb;
+
+        /* Uops that can still be dispatched in this cycle, < 0 if the last
+         * basic block took more than this cycle's width */
+        int credits;
+        W64 dispatched_uops;
+
+        /* Cycles left of penalties, put in st_cpi_stack when taken */
+        int stall_cycles;
+
+        /* What the thread waited for in its last cycle, the type of the
+         * cycles in which the core is parked */
+        int wait_type;
+
+        bool waiting_for_icache;
+        W64 icache_miss_addr;
+
+        /* dispatched_uops when each outstanding load miss was issued */
+        dynarray<W64> load_misses;
+
+        /* Timing of the same instructions under other core parameters */
+        dynarray<IntervalVariant*> variants;
+
+        Signal dcache_signal;
+        Signal icache_signal;
+
+        IntervalThread(IntervalCore& core, W8 threadid, Context& ctx);
+        ~IntervalThread();
+
+        void reset();
+        void flush_pipeline();
+        bool runcycle();
+        bool handle_stop();
+        bool handle_exception();
+        bool handle_barrier();
+        bool window_full() const;
+        void stall(int cycles, int type);
+        void idle(W64 cycles);
+        bool predict_branch(BranchPredictorInterface& branchpred,
+                const TransOp& uop, W64 ripafter, W64 target);
+
+        bool dcache_wakeup(void *arg);
+        bool icache_wakeup(void *arg);
+
+        /* WarmupTiming */
+        void tlb_access(Waddr virtaddr, bool is_icache);
+        void cache_access(W64 physaddr, bool is_icache, bool is_store);
+        void branch(const TransOp& uop, W64 ripafter, W64 target);
+
+        ostream& print(ostream& os) const;
+
+        /* Statistics */
+        struct st_commit : public Statable
+        {
+            StatObj<W64> insns;
+            StatObj<W64> uops;
+
+            StatEquation<W64, double, StatObjFormulaDiv> ipc;
+
+            st_commit(Statable *parent)
+                : Statable("commit", parent)
+                  , insns("insns", this)
+                  , uops("uops", this)
+                  , ipc("ipc", this)
+            {
+                ipc.enable_summary();
+            }
+        } st_commit;
+
+        struct st_branch_predictions : public Statable
+        {
+            StatObj<W64> predictions;
+            StatObj<W64> mispredicts;
+
+            st_branch_predictions(Statable *parent)
+                : Statable("branch_predictions", parent)
+                  , predictions("predictions", this)
+                  , mispredicts("mispredicts", this)
+            {}
+        } st_branch_predictions;
+
+        struct cache_access_stats : public Statable
+        {
+            StatObj<W64> accesses;
+            StatObj<W64> misses;
+            StatObj<W64> queue_full;
+
+            StatEquation<W64, double, StatObjFormulaDiv> miss_ratio;
+
+            cache_access_stats(const char* name, Statable *parent)
+                : Statable(name, parent)
+                  , accesses("accesses", this)
+                  , misses("misses", this)
+                  , queue_full("queue_full", this)
+                  , miss_ratio("miss_ratio", this)
+            {}
+        };
+
+        cache_access_stats st_dcache, st_icache;
+
+        struct tlb_access_stats : public Statable
+        {
+            StatObj<W64> accesses;
+            StatObj<W64> misses;
+
+            StatEquation<W64, double, StatObjFormulaDiv> miss_ratio;
+
+            tlb_access_stats(const char* name, Statable *parent)
+                : Statable(name, parent)
+                  , accesses("accesses", this)
+                  , misses("misses", this)
+                  , miss_ratio("miss_ratio", this)
+            {}
+        };
+
+        tlb_access_stats st_itlb, st_dtlb;
+
+        /* Load misses issued while another one is outstanding */
+        StatObj<W64> st_overlapped_misses;
+
+        StatObj<W64> st_cycles;
+        StatArray<W64, CYCLE_TYPE_COUNT> st_cpi_stack;
+
+        StatArray<W64, ASSIST_COUNT> assists;
+    };
+
+    static inline ostream& operator <<(ostream& os, const IntervalThread& th)
+    {
+        return th.print(os);
+    }
+
+    /**
+     * @brief Fast core model based on interval analysis
+     *
+     * Runs its threads functionally and accounts time only for the miss
+     * events that interrupt a steady dispatch rate, see IntervalThread.
+     * Needs no pipeline state, so it simulates many cores and long runs at
+     * a fraction of the cost of OooCore. Options:
+     *
+     *   threads            : hardware threads, 1 by default
+     *   branch_predictor   : as for the other cores, 'combined' by default
+     *   dispatch_width     : uops dispatched per cycle
+     *   rob_size           : uops dispatched after a load miss before the
+     *                        thread waits for it
+     *   mispredict_penalty : cycles lost per mispredicted branch
+     *   tlb_miss_penalty   : cycles of a page walk
+     *   variants           : timing variants run on the same instructions,
+     *                        0 by default, see IntervalVariant
+     *
+     * Defaults of dispatch_width to tlb_miss_penalty are the INTERVAL_*
+     * params of the core type in interval_core.conf.
+     */
+    struct IntervalCore : public BaseCore {
+        IntervalCore(BaseMachine& machine, const char* name);
+        ~IntervalCore();
+
+        bool runcycle(void* none);
+        void reset();
+        void check_ctx_changes();
+        void flush_tlb(Context& ctx);
+        void flush_tlb_virt(Context& ctx, Waddr virtaddr);
+        void dump_state(ostream& os);
+        void update_stats();
+        void flush_pipeline();
+        void dump_configuration(YAML::Emitter &out) const;
+
+        W64 get_next_active_cycle();
+        void skip_cycles(W64 cycles);
+
+        bool runs_context(Context& ctx);
+        void warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache);
+        void warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+                W64 target);
+        void transfer_warm_state(WarmState& state);
+
+        IntervalThread* get_thread(Context& ctx);
+        int get_count_option(const char* opt, int def, int min);
+
+        ostream& print(ostream& os) const;
+
+        IntervalThread** threads;
+        int threadcount;
+
+        stringbuf branchpred_type;
+        int dispatch_width;
+        int rob_size;
+        int mispredict_penalty;
+        int tlb_miss_penalty;
+        int variantcount;
+
+        Signal run_cycle;
+    };
+
+    static inline ostream& operator <<(ostream& os, const IntervalCore& core)
+    {
+        return core.print(os);
+    }
+
+    struct IntervalCoreBuilder : public CoreBuilder {
+        IntervalCoreBuilder(const char* name);
+        BaseCore* get_new_core(BaseMachine& machine, const char* name);
+    };
+
+}; // namespace
+
+#endif // MARSS_INTERVAL_CORE_H
@@ -0,0 +1,211 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <intervalvariant.h>
+#include <globals.h>
+#include <ptlsim.h>
+
+using namespace INTERVAL_CORE_MODEL;
+
+/**
+ * @brief Create variant 'id' of a thread from the core's options
+ *
+ * @param thread IntervalThread whose instruction stream drives the variant
+ * @param id Index of the variant, from 1
+ */
+IntervalVariant::IntervalVariant(IntervalThread& thread, int id)
+    : Statable("variant", &thread)
+      , thread(thread)
+      , id(id)
+      , st_cycles("cycles", this)
+      , st_cpi_stack("cpi_stack", this, cycle_type_names)
+      , st_ipc("ipc", this)
+      , st_mispredicts("mispredicts", this)
+      , st_itlb_misses("itlb_misses", this)
+      , st_dtlb_misses("dtlb_misses", this)
+      , st_overlapped_misses("overlapped_misses", this)
+{
+    IntervalCore& core = thread.core;
+    stringbuf opt;
+
+    opt << "variant" << id;
+    update_name(opt.buf);
+
+    opt.reset();
+    opt << "variant" << id << "_dispatch_width";
+    dispatch_width = core.get_count_option(opt.buf, core.dispatch_width, 1);
+
+    opt.reset();
+    opt << "variant" << id << "_rob_size";
+    rob_size = core.get_count_option(opt.buf, core.rob_size, 1);
+
+    opt.reset();
+    opt << "variant" << id << "_mispredict_penalty";
+    mispredict_penalty = core.get_count_option(opt.buf,
+            core.mispredict_penalty, 0);
+
+    opt.reset();
+    opt << "variant" << id << "_tlb_miss_penalty";
+    tlb_miss_penalty = core.get_count_option(opt.buf,
+            core.tlb_miss_penalty, 0);
+
+    opt.reset();
+    opt << "variant" << id << "_branch_predictor";
+    if(!core.machine.get_option(core.get_name(), opt.buf, branchpred_type)) {
+        branchpred_type << core.branchpred_type.buf;
+    }
+
+    branchpred.init(core.get_coreid(), thread.threadid, branchpred_type.buf);
+
+    reset();
+
+    st_ipc.add_elem(&thread.st_commit.insns);
+    st_ipc.add_elem(&st_cycles);
+    st_ipc.enable_summary();
+}
+
+/**
+ * @brief Reset the variant with its thread, the predictor is reset with
+ * the core
+ */
+void IntervalVariant::reset()
+{
+    flush_pipeline();
+
+    dtlb.reset();
+    itlb.reset();
+}
+
+/**
+ * @brief Forget the load misses of a flushed window, like the thread
+ */
+void IntervalVariant::flush_pipeline()
+{
+    partial_uops = 0;
+    window_miss = -1;
+    load_misses.clear();
+}
+
+void IntervalVariant::account(W64 cycles, int type)
+{
+    st_cycles += cycles;
+    st_cpi_stack[type] += cycles;
+}
+
+/**
+ * @brief Account the cycles to dispatch uops committed by the thread
+ */
+void IntervalVariant::dispatch(int uops)
+{
+    partial_uops += uops;
+
+    if(partial_uops < dispatch_width)
+        return;
+
+    account(partial_uops / dispatch_width, CYCLE_DISPATCH);
+    partial_uops %= dispatch_width;
+}
+
+/**
+ * @brief Account cycles in which the thread was halted or not running
+ */
+void IntervalVariant::idle(W64 cycles)
+{
+    account(cycles, CYCLE_IDLE);
+}
+
+void IntervalVariant::tlb_access(Waddr virtaddr, bool is_icache)
+{
+    if(is_icache) {
+        if likely (itlb.probe(virtaddr))
+            return;
+        st_itlb_misses++;
+        itlb.insert(virtaddr);
+    } else {
+        if likely (dtlb.probe(virtaddr))
+            return;
+        st_dtlb_misses++;
+        dtlb.insert(virtaddr);
+    }
+
+    account(tlb_miss_penalty, CYCLE_TLB);
+}
+
+void IntervalVariant::branch(const TransOp& uop, W64 ripafter, W64 target)
+{
+    if(!thread.predict_branch(branchpred, uop, ripafter, target))
+        return;
+
+    st_mispredicts++;
+    account(mispredict_penalty, CYCLE_BRANCH);
+}
+
+/**
+ * @brief A load of the thread missed the L1-D
+ *
+ * @param uuid dispatched_uops of the thread when the load executed
+ */
+void IntervalVariant::load_miss(W64 uuid)
+{
+    if(window_miss != (W64)-1 && uuid - window_miss < (W64)rob_size) {
+        st_overlapped_misses++;
+        return;
+    }
+
+    window_miss = uuid;
+    load_misses.push(uuid);
+}
+
+/**
+ * @brief A load miss of the thread returned after 'latency' cycles
+ */
+void IntervalVariant::load_done(W64 uuid, W64 latency)
+{
+    bool found = false;
+
+    foreach(i, load_misses.count()) {
+        if(load_misses[i] == uuid) {
+            found = true;
+            break;
+        }
+    }
+
+    if(!found)
+        return;
+
+    load_misses.remove(uuid);
+
+    W64 hidden = rob_size / dispatch_width;
+
+    if(latency > hidden)
+        account(latency - hidden, CYCLE_DCACHE);
+}
+
+/**
+ * @brief The thread waited 'latency' cycles for an I-cache miss
+ */
+void IntervalVariant::icache_miss(W64 latency)
+{
+    account(latency, CYCLE_ICACHE);
+}
+
+void IntervalVariant::dump_configuration(YAML::Emitter &out) const
+{
+    out << YAML::Key << get_name();
+    out << YAML::Value << YAML::BeginMap;
+
+    YAML_KEY_VAL(out, "branch_predictor", branchpred_type.buf);
+    YAML_KEY_VAL(out, "dispatch_width", dispatch_width);
+    YAML_KEY_VAL(out, "rob_size", rob_size);
+    YAML_KEY_VAL(out, "mispredict_penalty", mispredict_penalty);
+    YAML_KEY_VAL(out, "tlb_miss_penalty", tlb_miss_penalty);
+
+    out << YAML::EndMap;
+}
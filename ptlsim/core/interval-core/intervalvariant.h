@@ -0,0 +1,89 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MARSS_INTERVAL_VARIANT_H
+#define MARSS_INTERVAL_VARIANT_H
+
+#include <intervalcore.h>
+
+namespace INTERVAL_CORE_MODEL {
+
+    /**
+     * @brief Timing of an IntervalThread under other core parameters
+     *
+     * Set 'variants' in the core options to the number of variants, and
+     * for variant i in 1..variants any of 'variant<i>_dispatch_width',
+     * 'variant<i>_rob_size', 'variant<i>_mispredict_penalty',
+     * 'variant<i>_tlb_miss_penalty' and 'variant<i>_branch_predictor'.
+     * Unset ones are taken from the core.
+     *
+     * A variant sees the committed instruction stream of its thread, so
+     * all variants of a run are compared on the same instructions. It has
+     * its own branch predictor and TLBs, but no memory hierarchy: which
+     * accesses miss the caches and how long they take is what the
+     * thread's accesses saw. Cycles are counted analytically instead of
+     * clocked: uops / dispatch_width, plus the penalties, plus for each
+     * load miss that doesn't overlap an earlier one within rob_size uops
+     * its latency less the rob_size / dispatch_width cycles the window
+     * hides.
+     */
+    struct IntervalVariant : public Statable {
+        IntervalThread& thread;
+        int id;
+
+        stringbuf branchpred_type;
+        int dispatch_width;
+        int rob_size;
+        int mispredict_penalty;
+        int tlb_miss_penalty;
+
+        BranchPredictorInterface branchpred;
+        DTLB dtlb;
+        ITLB itlb;
+
+        /* Dispatched uops short of a full cycle */
+        int partial_uops;
+
+        /* dispatched_uops of the load miss that opened the window of
+         * misses it overlaps, -1 if none */
+        W64 window_miss;
+
+        /* Non-overlapped load misses whose latency is not known yet */
+        dynarray<W64> load_misses;
+
+        IntervalVariant(IntervalThread& thread, int id);
+
+        void reset();
+        void flush_pipeline();
+        void account(W64 cycles, int type);
+
+        void dispatch(int uops);
+        void idle(W64 cycles);
+        void tlb_access(Waddr virtaddr, bool is_icache);
+        void branch(const TransOp& uop, W64 ripafter, W64 target);
+        void load_miss(W64 uuid);
+        void load_done(W64 uuid, W64 latency);
+        void icache_miss(W64 latency);
+
+        void dump_configuration(YAML::Emitter &out) const;
+
+        StatObj<W64> st_cycles;
+        StatArray<W64, CYCLE_TYPE_COUNT> st_cpi_stack;
+        StatEquation<W64, double, StatObjFormulaDiv> st_ipc;
+
+        StatObj<W64> st_mispredicts;
+        StatObj<W64> st_itlb_misses;
+        StatObj<W64> st_dtlb_misses;
+        StatObj<W64> st_overlapped_misses;
+    };
+
+}; // namespace
+
+#endif // MARSS_INTERVAL_VARIANT_H
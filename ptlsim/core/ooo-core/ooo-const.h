@@ -47,6 +47,47 @@
 #define OOO_ROB_SIZE 128
 #endif
 
+/*
+ * Storage of the ROB, issue queue and load and store queues. The sizes
+ * above are defaults of the core's 'rob_size', 'iq_size', 'ldq_size' and
+ * 'stq_size' options, which can take any size up to these.
+ */
+#ifndef OOO_MAX_ROB_SIZE
+#define OOO_MAX_ROB_SIZE 256
+#endif
+
+#ifndef OOO_MAX_ISSUE_Q_SIZE
+#define OOO_MAX_ISSUE_Q_SIZE 128
+#endif
+
+#ifndef OOO_MAX_LOAD_Q_SIZE
+#define OOO_MAX_LOAD_Q_SIZE 96
+#endif
+
+#ifndef OOO_MAX_STORE_Q_SIZE
+#define OOO_MAX_STORE_Q_SIZE 96
+#endif
+
+#if OOO_ROB_SIZE > OOO_MAX_ROB_SIZE
+#undef OOO_MAX_ROB_SIZE
+#define OOO_MAX_ROB_SIZE OOO_ROB_SIZE
+#endif
+
+#if OOO_ISSUE_Q_SIZE > OOO_MAX_ISSUE_Q_SIZE
+#undef OOO_MAX_ISSUE_Q_SIZE
+#define OOO_MAX_ISSUE_Q_SIZE OOO_ISSUE_Q_SIZE
+#endif
+
+#if OOO_LOAD_Q_SIZE > OOO_MAX_LOAD_Q_SIZE
+#undef OOO_MAX_LOAD_Q_SIZE
+#define OOO_MAX_LOAD_Q_SIZE OOO_LOAD_Q_SIZE
+#endif
+
+#if OOO_STORE_Q_SIZE > OOO_MAX_STORE_Q_SIZE
+#undef OOO_MAX_STORE_Q_SIZE
+#define OOO_MAX_STORE_Q_SIZE OOO_STORE_Q_SIZE
+#endif
+
 #ifndef OOO_FETCH_WIDTH
 #define OOO_FETCH_WIDTH 4
 #endif
@@ -79,6 +120,73 @@
 #define OOO_DTLB_SIZE 32
 #endif
 
+/* Large page TLB arrays, pages without an array use 4KB TLB entries */
+#ifndef OOO_DTLB_2M_SIZE
+#define OOO_DTLB_2M_SIZE 0
+#endif
+
+#ifndef OOO_DTLB_1G_SIZE
+#define OOO_DTLB_1G_SIZE 0
+#endif
+
+#ifndef OOO_ITLB_2M_SIZE
+#define OOO_ITLB_2M_SIZE 0
+#endif
+
+#ifndef OOO_ITLB_1G_SIZE
+#define OOO_ITLB_1G_SIZE 0
+#endif
+
+/* Second level TLB and page walk caches, 0 sets or entries disables them */
+#ifndef OOO_STLB_SETS
+#define OOO_STLB_SETS 0
+#endif
+
+#ifndef OOO_STLB_WAYS
+#define OOO_STLB_WAYS 8
+#endif
+
+#ifndef OOO_PWC_SIZE
+#define OOO_PWC_SIZE 0
+#endif
+
+/* Decoded uop cache and loop stream detector, 0 sets or uops disables them */
+#ifndef OOO_UOP_CACHE_SETS
+#define OOO_UOP_CACHE_SETS 0
+#endif
+
+#ifndef OOO_UOP_CACHE_WAYS
+#define OOO_UOP_CACHE_WAYS 8
+#endif
+
+#ifndef OOO_LSD_SIZE
+#define OOO_LSD_SIZE 0
+#endif
+
+/* Store set memory dependence predictor tables (power of two) */
+#ifndef OOO_SSIT_SIZE
+#define OOO_SSIT_SIZE 1024
+#endif
+
+#ifndef OOO_LFST_SIZE
+#define OOO_LFST_SIZE 128
+#endif
+
+/* Counters of the criticality predictor used in cluster steering (power of two) */
+#ifndef OOO_CRITICALITY_SIZE
+#define OOO_CRITICALITY_SIZE 1024
+#endif
+
+/* Slots of the LSQ address filter (power of two) */
+#ifndef OOO_LSQ_FILTER_SIZE
+#define OOO_LSQ_FILTER_SIZE 1024
+#endif
+
+/* Entries of the fetch target queue, the deepest 'fdip_depth' allowed */
+#ifndef OOO_FTQ_SIZE
+#define OOO_FTQ_SIZE 32
+#endif
+
 /* functional units */
 #ifndef OOO_ALU_FU_COUNT
 #define OOO_ALU_FU_COUNT 2
@@ -161,8 +269,9 @@ namespace OOO_CORE_MODEL {
 
 #define BIG_ROB
 
+    /* Default size of ROB and size of its storage */
     const int ROB_SIZE = OOO_ROB_SIZE;
-     /* const int ROB_SIZE = 64; */
+    const int MAX_ROB_SIZE = OOO_MAX_ROB_SIZE;
 
     /* Maximum number of branches in the pipeline at any given time */
     const int MAX_BRANCHES_IN_FLIGHT = OOO_BRANCH_IN_FLIGHT;
@@ -184,6 +293,8 @@ namespace OOO_CORE_MODEL {
 
     const int LDQ_SIZE = OOO_LOAD_Q_SIZE;
     const int STQ_SIZE = OOO_STORE_Q_SIZE;
+    const int MAX_LDQ_SIZE = OOO_MAX_LOAD_Q_SIZE;
+    const int MAX_STQ_SIZE = OOO_MAX_STORE_Q_SIZE;
 
     /*
      * Fetch
@@ -241,24 +352,120 @@ namespace OOO_CORE_MODEL {
     const int MAX_FORWARDING_LATENCY = 2;
 
     static const int ISSUE_QUEUE_SIZE = 16;
+    static const int MAX_ISSUE_QUEUE_SIZE = 16;
 #else
     const int MAX_CLUSTERS = 1;
 
     const int MAX_FORWARDING_LATENCY = 0;
 
     static const int ISSUE_QUEUE_SIZE = OOO_ISSUE_Q_SIZE;
+    static const int MAX_ISSUE_QUEUE_SIZE = OOO_MAX_ISSUE_Q_SIZE;
 #endif
 
     /* TLBs */
     const int ITLB_SIZE = OOO_ITLB_SIZE;
     const int DTLB_SIZE = OOO_DTLB_SIZE;
+    const int DTLB_2M_SIZE = OOO_DTLB_2M_SIZE;
+    const int DTLB_1G_SIZE = OOO_DTLB_1G_SIZE;
+    const int ITLB_2M_SIZE = OOO_ITLB_2M_SIZE;
+    const int ITLB_1G_SIZE = OOO_ITLB_1G_SIZE;
+    const int STLB_SETS = OOO_STLB_SETS;
+    const int STLB_WAYS = OOO_STLB_WAYS;
+    const int PWC_SIZE = OOO_PWC_SIZE;
+
+    /* Frontend uop cache and loop stream detector */
+    const int UOP_CACHE_SETS = OOO_UOP_CACHE_SETS;
+    const int UOP_CACHE_WAYS = OOO_UOP_CACHE_WAYS;
+    const int LSD_SIZE = OOO_LSD_SIZE;
+
+    /* Store set predictor */
+    const int SSIT_SIZE = OOO_SSIT_SIZE;
+    const int LFST_SIZE = OOO_LFST_SIZE;
+
+    /* Criticality predictor */
+    const int CRITICALITY_SIZE = OOO_CRITICALITY_SIZE;
+
+    /* LSQ address filter */
+    const int LSQ_FILTER_SIZE = OOO_LSQ_FILTER_SIZE;
+
+    /* Fetch directed instruction prefetch */
+    const int FTQ_SIZE = OOO_FTQ_SIZE;
+    static const int FDIP_LINE_SIZE = 64;
+    /* Prefetched lines kept to see if fetch uses them in time */
+    static const int FDIP_TRACKED_LINES = 32;
+    static const int FDIP_MAX_INFLIGHT = 8;
+    /* Blocks queued and lines prefetched per cycle */
+    static const int FDIP_BLOCKS_PER_CYCLE = 2;
+    static const int FDIP_PREFETCHES_PER_CYCLE = 2;
+
+    /* Runahead pre-execution, the most uops 'runahead_depth' allows */
+    static const int RUNAHEAD_MAX_DEPTH = 4096;
+    static const int RUNAHEAD_LINE_SIZE = 64;
+    /* Prefetched lines kept to see if loads use them in time */
+    static const int RUNAHEAD_TRACKED_LINES = 64;
+    static const int RUNAHEAD_MAX_INFLIGHT = 16;
+    /* Stores of an episode a later load of it can read */
+    static const int RUNAHEAD_STORES = 16;
 
     /* How many bytes of x86 code to fetch into decode buffer at once */
     static const int ICACHE_FETCH_GRANULARITY = 16;
+    /* Uop cache windows are ICACHE_FETCH_GRANULARITY bytes */
+    static const int UOP_CACHE_WINDOW_SHIFT = 4;
+    /* Loop iterations seen before the loop stream detector streams a loop */
+    static const int LSD_LOCK_ITERATIONS = 2;
     /* Deadlock timeout: if nothing dispatches for this many cycles, flush the pipeline */
     static const int DISPATCH_DEADLOCK_COUNTDOWN_CYCLES = 4096; //256;
     /* Size of unaligned predictor Bloom filter */
     static const int UNALIGNED_PREDICTOR_SIZE = 4096;
+    /* Buckets in the per-cluster completion wheel (power of two) */
+    static const int COMPLETION_WHEEL_SIZE = 64;
+    /* Cycles a load waits for the cache before STALL and FLUSH fetch policies gate its thread */
+    static const int LONG_LATENCY_LOAD_CYCLES = 32;
+    /* Cycles between clearing of the store set predictor's SSIT */
+    static const int STORE_SET_CLEAR_CYCLES = 1000000;
+
+    /* SMT fetch policies, selected with core's 'fetch_policy' option */
+    enum {
+        FETCH_POLICY_ICOUNT,      /* fewest uops in frontend and issue queues first */
+        FETCH_POLICY_ROUND_ROBIN, /* rotate priority every cycle */
+        FETCH_POLICY_BRCOUNT,     /* fewest branches in flight first */
+        FETCH_POLICY_MISSCOUNT,   /* fewest outstanding dcache misses first */
+        FETCH_POLICY_STALL,       /* ICOUNT, don't fetch a thread waiting on a long latency load */
+        FETCH_POLICY_FLUSH,       /* STALL, and annul uops fetched after the load */
+        FETCH_POLICY_COUNT
+    };
+
+    /* ROB and LSQ sharing between threads, selected with 'smt_partition' option */
+    enum {
+        SMT_PARTITION_PRIVATE,    /* each thread has rob_size and lsq_size entries */
+        SMT_PARTITION_STATIC,     /* each thread has an equal share of rob_size and lsq_size */
+        SMT_PARTITION_DYNAMIC,    /* shared, but half of each thread's share is reserved for it */
+        SMT_PARTITION_SHARED,     /* threads compete for all rob_size and lsq_size entries */
+        SMT_PARTITION_COUNT
+    };
+
+    /* Memory dependence predictors, selected with core's 'memdep_predictor' option */
+    enum {
+        MEMDEP_PREDICTOR_LSAP,       /* loads that aliased before wait on any unresolved store */
+        MEMDEP_PREDICTOR_STORE_SETS, /* loads wait on last store of their store set */
+        MEMDEP_PREDICTOR_COUNT
+    };
+
+    /* Cluster steering of dispatched uops, selected with core's 'cluster_steering' option */
+    enum {
+        CLUSTER_STEERING_OPERANDS,   /* cluster with most pending operands, else the first with room */
+        CLUSTER_STEERING_DEPENDENCE, /* cluster of the producers, else the least loaded one */
+        CLUSTER_STEERING_BALANCED,   /* free issue queue slots plus 'steering_bias' per pending operand */
+        CLUSTER_STEERING_CRITICAL,   /* predicted critical uops follow producers, others go to the least loaded */
+        CLUSTER_STEERING_COUNT
+    };
+
+    /* Uops removed at rename, enabled with core's 'move_elimination', 'zero_idioms' and 'stack_engine' options */
+    enum {
+        RENAME_ELIM_MOVE  = (1 << 0), /* 64 bit mov shares the physical register of its source */
+        RENAME_ELIM_ZERO  = (1 << 1), /* xor or sub of a register with itself, independent of it */
+        RENAME_ELIM_STACK = (1 << 2), /* rsp update of push, pop, call and ret done at rename */
+    };
 
     /* String names used in stats labels */
     extern const char* physreg_state_names[MAX_PHYSREG_STATE];
@@ -272,6 +479,11 @@ namespace OOO_CORE_MODEL {
 
     extern const char* phys_reg_file_names[PHYS_REG_FILE_COUNT];
 
+    extern const char* fetch_policy_names[FETCH_POLICY_COUNT];
+    extern const char* smt_partition_names[SMT_PARTITION_COUNT];
+    extern const char* memdep_predictor_names[MEMDEP_PREDICTOR_COUNT];
+    extern const char* cluster_steering_names[CLUSTER_STEERING_COUNT];
+
 };
 
 #endif /* OOOCORE_CONST_H */
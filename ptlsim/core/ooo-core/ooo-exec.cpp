@@ -176,7 +176,7 @@ void IssueQueue<size, operandcount>::clock() {
  */
 template <int size, int operandcount>
 bool IssueQueue<size, operandcount>::insert(tag_t uopid, const tag_t* operands, const tag_t* preready) {
-    if unlikely (count == size)
+    if unlikely (count >= capacity)
         return false;
 
     assert(count < size);
@@ -209,12 +209,18 @@ bool IssueQueue<size, operandcount>::insert(tag_t uopid, const tag_t* operands,
  * @return True.
  *
  * This is used to wakeup dependent entries in issue-queue.
+ * Entries are kept packed in slots [0, count), so only the tag
+ * chunks covering live slots are compared, and operand columns
+ * with no waiting entry are skipped with a single word test.
  */
 template <int size, int operandcount>
 bool IssueQueue<size, operandcount>::broadcast(tag_t uopid) {
     vec_t tagvec = assoc_t::prep(uopid);
 
-    foreach (operand, operandcount) tags[operand].invalidate(tagvec);
+    foreach (operand, operandcount) {
+        if (!tags[operand].valid) continue;
+        tags[operand].invalidate(tagvec, count);
+    }
 
     return true;
 }
@@ -437,7 +443,8 @@ int ReorderBufferEntry::issue() {
         return ISSUE_COMPLETED;
     }
 
-    W32 executable_on_fu = fuinfo[uop.opcode].fu & clusters[cluster].fu_mask & core.fu_avail;
+    const UopDescriptor& desc = uop.desc;
+    W32 executable_on_fu = desc.fu & clusters[cluster].fu_mask & core.fu_avail;
 
     /* Are any FUs available in this cycle? */
     if unlikely (!executable_on_fu) {
@@ -492,26 +499,28 @@ int ReorderBufferEntry::issue() {
       */
 
     thread.thread_stats.issue.uops++;
+    trace_stage(TRACE_UOP_ISSUE, cluster);
 
     fu = lsbindex(executable_on_fu);
     clearbit(core.fu_avail, fu);
     core.robs_on_fu[fu] = this;
-    cycles_left = fuinfo[uop.opcode].latency;
+    cycles_left = desc.latency;
     changestate(thread.rob_issued_list[cluster]);
+    thread.schedule_completion(*this);
 
     IssueState state;
     state.reg.rdflags = 0;
 
-    W64 radata = ra.data;
-    W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : rb.data;
-    W64 rcdata = (uop.rc == REG_imm) ? uop.rcimm : rc.data;
-    bool ld = isload(uop.opcode);
-    bool st = isstore(uop.opcode);
-    bool br = isbranch(uop.opcode);
+    W64 radata = ra.data();
+    W64 rbdata = (desc.flags & UOPDESC_RB_IMM) ? uop.rbimm : rb.data();
+    W64 rcdata = (desc.flags & UOPDESC_RC_IMM) ? uop.rcimm : rc.data();
+    bool ld = (desc.flags & UOPDESC_LOAD);
+    bool st = (desc.flags & UOPDESC_STORE);
+    bool br = (desc.flags & UOPDESC_BRANCH);
 
     assert(operands[RA]->ready());
     assert(rb.ready());
-    if likely ((!st || (st && load_store_second_phase)) && (uop.rc != REG_imm)) assert(rc.ready());
+    if likely ((!st || (st && load_store_second_phase)) && !(desc.flags & UOPDESC_RC_IMM)) assert(rc.ready());
     if likely (!st) assert(operands[RS]->ready());
 
     if likely (ra.nonnull()) {
@@ -535,7 +544,7 @@ int ReorderBufferEntry::issue() {
                rc.rfid, [rc.state]++);
     }
 
-    if unlikely ((ra.flags | rb.flags | rc.flags) & FLAG_INV) {
+    if unlikely ((ra.flags() | rb.flags() | rc.flags()) & FLAG_INV) {
 
          /*
           * Invalid data propagated through operands: mark output as
@@ -550,7 +559,7 @@ int ReorderBufferEntry::issue() {
                         rb, "] rc[", rc, "] ", endl;
         }
     } else {
-        thread.thread_stats.issue.opclass[opclassof(uop.opcode)]++;
+        thread.thread_stats.issue.opclass[desc.opclass]++;
 
         if unlikely (ld|st) {
             int completed = 0;
@@ -581,18 +590,18 @@ int ReorderBufferEntry::issue() {
         } else if unlikely (uop.opcode == OP_ld_pre) {
             issueprefetch(state, radata, rbdata, rcdata, uop.cachelevel);
         } else if unlikely (uop.opcode == OP_ast) {
-            issueast(state, uop.riptaken, radata, rbdata, rcdata, ra.flags, rb.flags, rc.flags);
+            issueast(state, uop.riptaken, radata, rbdata, rcdata, ra.flags(), rb.flags(), rc.flags());
         } else {
             if unlikely (br) {
                 state.brreg.riptaken = uop.riptaken;
                 state.brreg.ripseq = uop.ripseq;
             }
-            uop.synthop(state, radata, rbdata, rcdata, ra.flags, rb.flags, rc.flags);
+            uop.desc.synthop(state, radata, rbdata, rcdata, ra.flags(), rb.flags(), rc.flags());
         }
     }
 
-    physreg->flags = state.reg.rdflags;
-    physreg->data = state.reg.rddata;
+    physreg->flags() = state.reg.rdflags;
+    physreg->data() = state.reg.rddata;
 
     if unlikely (!physreg->valid()) {
 
@@ -629,8 +638,8 @@ int ReorderBufferEntry::issue() {
         changestate(thread.rob_ready_to_commit_queue);
     }
 
-    bool mispredicted = (physreg->data != uop.riptaken);
-    //  bool mispredicted = (physreg->valid()) ? (physreg->data != uop.riptaken) : false;
+    bool mispredicted = (physreg->data() != uop.riptaken);
+    //  bool mispredicted = (physreg->valid()) ? (physreg->data() != uop.riptaken) : false;
 
      /*
       * Release the issue queue entry, since we are beyond the point of no return:
@@ -656,7 +665,7 @@ int ReorderBufferEntry::issue() {
                 thread.thread_stats.branchpred.ret[MISPRED]+=ret;
                 thread.thread_stats.branchpred.indir[MISPRED]+= (indir & !ret) ;
                 thread.thread_stats.branchpred.cond[MISPRED] += cond;
-                W64 realrip = physreg->data;
+                W64 realrip = physreg->data();
 
                 /*
                  *  Correct the branch directions and cond code field.
@@ -679,7 +688,7 @@ int ReorderBufferEntry::issue() {
                      * correct code for the swapped condition.
                      */
 
-                    uop.synthop = get_synthcode_for_cond_branch(uop.opcode, uop.cond, uop.size, 0);
+                    uop.desc.synthop = get_synthcode_for_cond_branch(uop.opcode, uop.cond, uop.size, 0);
                     swap(uop.riptaken, uop.ripseq);
                 } else if unlikely (isclass(uop.opcode, OPCLASS_INDIR_BRANCH)) {
                     uop.riptaken = realrip;
@@ -739,7 +748,7 @@ bool ReorderBufferEntry::recheck_page_fault() {
     if(uop.internal || (lsq->sfence | lsq->lfence))
         return false;
 
-    if unlikely (physreg->flags & FLAG_INV)
+    if unlikely (physreg->flags() & FLAG_INV)
         return true;
 
     int exception;
@@ -753,8 +762,8 @@ bool ReorderBufferEntry::recheck_page_fault() {
     Waddr virtaddr = lsq->virtaddr;
     if unlikely (exception) {
         if(!handle_common_load_store_exceptions(*lsq, virtaddr, addr, exception, pfec)) {
-            physreg->flags = lsq->data;
-            physreg->data = (lsq->invalid << log2(FLAG_INV)) | ((!lsq->datavalid) << log2(FLAG_WAIT));
+            physreg->flags() = lsq->data;
+            physreg->data() = (lsq->invalid << log2(FLAG_INV)) | ((!lsq->datavalid) << log2(FLAG_WAIT));
             return true;
         }
     }
@@ -1020,7 +1029,7 @@ bool ReorderBufferEntry::release_mem_lock(bool forced) {
  */
 int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr, W64 ra, W64 rb, W64 rc, bool rcready, PTEUpdate& pteupdate) {
     ThreadContext& thread = getthread();
-    Queue<LoadStoreQueueEntry, LSQ_SIZE>& LSQ = thread.LSQ;
+    Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE>& LSQ = thread.LSQ;
     LoadStoreAliasPredictor& lsap = thread.lsap;
 
     OooCore& core = getcore();
@@ -1043,6 +1052,9 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
             /* Its an exception, return ISSUE_COMPLETED */
             return ISSUE_COMPLETED;
 #endif
+            if unlikely (pc_profile_enabled)
+                core.pc_profile.dtlb_miss(uop.rip.rip);
+
             /* This ROB entry is moved to rob_tlb_miss_list so return success */
             issueq_operation_on_cluster(core, cluster, replay(iqslot));
             return ISSUE_SKIPPED;
@@ -1059,6 +1071,11 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
     thread.thread_stats.dcache.store.size[sizeshift]++;
 
     state.physaddr = (annul) ? INVALID_PHYSADDR : (physaddr >> 3);
+    thread.lsq_filter.add(state);
+
+    /* Address is known now: loads of this store's set don't wait on it */
+    if (core.memdep_predictor == MEMDEP_PREDICTOR_STORE_SETS)
+        thread.store_sets.issue_store(uop.rip, uop.uuid);
 
 /*
  *     The STQ is then searched for the most recent prior store S to same 64-bit block. If found, U's
@@ -1079,8 +1096,13 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
  *
  */
     LoadStoreQueueEntry* sfra = NULL;
+    LSQAddressFilter& filter = thread.lsq_filter;
 
-    foreach_backward_before(LSQ, lsq, i) {
+    /* Without unresolved stores only overlapping ones can match */
+    bool scan_stores = (thread.stores_in_flight > filter.stores) ||
+        filter.may_overlap(true, state);
+
+    if (scan_stores) foreach_backward_before(LSQ, lsq, i) {
         LoadStoreQueueEntry& stbuf = LSQ[i];
 
         /* Skip over loads (we only care about the store queue subset): */
@@ -1199,7 +1221,9 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
      * itself and the load after it in program order at commit time.
      */
 
-    foreach_forward_after (LSQ, lsq, i) {
+    bool scan_loads = filter.may_overlap(false, state);
+
+    if (scan_loads) foreach_forward_after (LSQ, lsq, i) {
         LoadStoreQueueEntry& ldbuf = LSQ[i];
 
          /*
@@ -1241,7 +1265,11 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
             state.datavalid = 1;
 
             /* Add the rip to the load to the load/store alias predictor: */
-            lsap.select(ldbuf.rob->uop.rip);
+            if (core.memdep_predictor == MEMDEP_PREDICTOR_STORE_SETS)
+                thread.store_sets.violation(ldbuf.rob->uop.rip, uop.rip);
+            else
+                lsap.select(ldbuf.rob->uop.rip);
+            thread.thread_stats.dcache.memdep.violations++;
 
             /*
              * The load as dependent on this store. Add a new dependency
@@ -1359,7 +1387,7 @@ static inline W64 extract_bytes(void* target, int SIZESHIFT, bool SIGNEXT) {
 W64 ReorderBufferEntry::get_load_data(LoadStoreQueueEntry& state, W64 data){
 
     ThreadContext& thread = getthread();
-    Queue<LoadStoreQueueEntry, LSQ_SIZE>& LSQ = thread.LSQ;
+    Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE>& LSQ = thread.LSQ;
 
     int sizeshift = uop.size;
     int aligntype = uop.cond;
@@ -1394,7 +1422,7 @@ W64 ReorderBufferEntry::get_load_data(LoadStoreQueueEntry& state, W64 data){
     }
 
     PhysicalRegister& rb = *operands[RB];
-    W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : rb.data;
+    W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : rb.data();
     assert(generated_addr && original_addr); /* updated in issueload() */
     if unlikely (aligntype == LDST_ALIGN_HI) {
         if likely (!annul) {
@@ -1439,7 +1467,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
     OooCore& core = getcore();
     ThreadContext& thread = getthread();
-    Queue<LoadStoreQueueEntry, LSQ_SIZE>& LSQ = thread.LSQ;
+    Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE>& LSQ = thread.LSQ;
     LoadStoreAliasPredictor& lsap = thread.lsap;
 
     int sizeshift = uop.size;
@@ -1460,6 +1488,9 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
             /* Its an exception, return ISSUE_COMPLETED */
             return ISSUE_COMPLETED;
 #endif
+            if unlikely (pc_profile_enabled)
+                core.pc_profile.dtlb_miss(uop.rip.rip);
+
             /* This ROB entry is moved to rob_tlb_miss_list so return success */
             issueq_operation_on_cluster(core, cluster, replay(iqslot));
             return ISSUE_SKIPPED;
@@ -1476,6 +1507,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     thread.thread_stats.dcache.load.size[sizeshift]++;
 
     state.physaddr = (annul) ? INVALID_PHYSADDR : (physaddr >> 3);
+    thread.lsq_filter.add(state);
 
     W64 data;
 
@@ -1484,6 +1516,9 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 #define SMT_ENABLE_LOAD_HOISTING
 #ifdef SMT_ENABLE_LOAD_HOISTING
     bool load_is_known_to_alias_with_store = (lsap(uop.rip) >= 0);
+    /* Store sets: load waits only on the store its set predicts */
+    if (core.memdep_predictor == MEMDEP_PREDICTOR_STORE_SETS)
+        load_is_known_to_alias_with_store = memdep_store;
 #else
     /* For processors that cannot speculatively issue loads before unresolved stores: */
     bool load_is_known_to_alias_with_store = 1;
@@ -1505,7 +1540,16 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     int sfra_addr_diff;
     bool all_sfra_datavalid = true;
 
-    foreach_backward_before(LSQ, lsq, i) {
+    /*
+     * Without unresolved stores only overlapping ones can match, and a
+     * store this load waits on has to be found to count false dependences
+     */
+    LSQAddressFilter& filter = thread.lsq_filter;
+    bool scan_stores = (thread.stores_in_flight > filter.stores) ||
+        memdep_waited || filter.may_overlap(true, state);
+    thread.thread_stats.dcache.load.dependency.stq_scan_skipped += !scan_stores;
+
+    if (scan_stores) foreach_backward_before(LSQ, lsq, i) {
         LoadStoreQueueEntry& stbuf = LSQ[i];
 
         /* Skip over loads (we only care about the store queue subset): */
@@ -1516,6 +1560,14 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
             if unlikely (stbuf.lfence | stbuf.sfence) continue;
 
             sfra_addr_diff = (stbuf.physaddr - state.physaddr);
+
+            /* Store this load waited on as predicted alias has resolved */
+            if unlikely (memdep_waited && stbuf.rob->uop.uuid == memdep_wait_uuid) {
+                memdep_waited = 0;
+                thread.thread_stats.dcache.memdep.false_dependences +=
+                    !(-1 <= sfra_addr_diff && sfra_addr_diff <= 1);
+            }
+
             if(-1 <= sfra_addr_diff && sfra_addr_diff <= 1) {
                 thread.thread_stats.dcache.load.dependency.stq_address_match++;
                 if(sfra == NULL) sfra = &stbuf;
@@ -1547,7 +1599,14 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
             /* Is this load known to alias with prior stores, and therefore cannot be hoisted? */
             if unlikely (load_is_known_to_alias_with_store) {
+                /* With store sets only the predicted store holds the load */
+                if (core.memdep_predictor == MEMDEP_PREDICTOR_STORE_SETS &&
+                        stbuf.rob->uop.uuid != memdep_store_uuid)
+                    continue;
+
                 thread.thread_stats.dcache.load.dependency.predicted_alias_unresolved++;
+                memdep_waited = 1;
+                memdep_wait_uuid = stbuf.rob->uop.uuid;
                 sfra = &stbuf;
                 break;
             }
@@ -1712,9 +1771,10 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
         state.invalid = 0;
         state.bytemask = 0xff;
 
-        physreg->flags &= ~FLAG_WAIT;
+        physreg->flags() &= ~FLAG_WAIT;
         physreg->complete();
         changestate(thread.rob_issued_list[cluster]);
+        thread.schedule_completion(*this);
         lfrqslot = -1;
         forward_cycle = 0;
 
@@ -1753,16 +1813,99 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
         state.sfr_bytemask = 0;
     }
 
+    if unlikely (pc_profile_enabled)
+        core.pc_profile.access(uop.rip.rip);
+
+    if unlikely (core.runahead_depth) thread.runahead_demand(state.physaddr << 3);
+
+    if unlikely (lock_acquired && core.memoryHierarchy->far_atomics_enabled()) {
+        /* Done at the shared cache, its locked store is not sent */
+        Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
+        assert(request != NULL);
+
+        request->init(core.get_coreid(), threadid, state.physaddr << 3, idx, sim_cycle,
+                false, uop.rip.rip, uop.uuid, Memory::MEMORY_OP_READ);
+        request->set_coreSignal(&core.dcache_signal);
+        mem_request.set(request);
+
+        core.memoryHierarchy->far_atomic(request);
+
+        cycles_left = 0;
+        cache_miss_init_cycle = sim_cycle;
+        changestate(thread.rob_cache_miss_list);
+        physreg->changestate(PHYSREG_WAITING);
+        return ISSUE_COMPLETED;
+    }
+
+    /*
+     * The high part of a load crossing into the next line reads the
+     * 8 bytes after the low part, request that line along with it if it
+     * is on the same page. The high part then hits in the L1.
+     */
+    W64 split_physaddr = 0;
+    if unlikely (core.split_line_batching && !uop.internal &&
+            aligntype == LDST_ALIGN_LO) {
+        W64 hi_physaddr = (state.physaddr << 3) + 8;
+        if ((hi_physaddr % 64) == 0 && (hi_physaddr % PAGE_SIZE) != 0)
+            split_physaddr = hi_physaddr;
+    }
+
+    int hit_latency = 0;
+    if likely (!split_physaddr) {
+        hit_latency = core.memoryHierarchy->access_hit(core.get_coreid(),
+                threadid, state.physaddr << 3, uop.rip.rip, uop.uuid);
+    }
+
+    if unlikely (hit_latency == Memory::CACHE_BANK_CONFLICT) {
+        /* A locked load holds its lock already, it waits in the L1 queue */
+        if (!lock_acquired) {
+            replay();
+            load_store_second_phase = 1;
+            thread.thread_stats.dcache.load.issue.replay.bank_conflict++;
+            return ISSUE_NEEDS_REPLAY;
+        }
+        hit_latency = 0;
+    }
+
+    if likely (hit_latency) {
+        /* Woken up by the core, see OooCore::wakeup_load_hits */
+        OooCore::LoadHit hit;
+        hit.cycle = sim_cycle + hit_latency;
+        hit.physaddr = state.physaddr << 3;
+        hit.uuid = uop.uuid;
+        hit.robid = idx;
+        hit.threadid = threadid;
+        core.load_hits.push(hit);
+
+        thread.thread_stats.dcache.load.issue.hit++;
+
+        cycles_left = 0;
+        cache_miss_init_cycle = sim_cycle;
+        changestate(thread.rob_cache_miss_list);
+        physreg->changestate(PHYSREG_WAITING);
+        return ISSUE_COMPLETED;
+    }
+
     Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
     assert(request != NULL);
 
     request->init(core.get_coreid(), threadid, state.physaddr << 3, idx, sim_cycle,
             false, uop.rip.rip, uop.uuid, Memory::MEMORY_OP_READ);
     request->set_coreSignal(&core.dcache_signal);
-
-    bool L1hit = core.memoryHierarchy->access_cache(request);
+    if (idx == thread.ROB.head) request->set_priority(Memory::PRIORITY_CRITICAL);
+    mem_request.set(request);
+
+    bool L1hit;
+    if unlikely (split_physaddr) {
+        L1hit = core.memoryHierarchy->access_cache_split(request,
+                split_physaddr);
+        thread.thread_stats.dcache.load.issue.split_batched++;
+    } else {
+        L1hit = core.memoryHierarchy->access_cache(request);
+    }
 
     if(L1hit) {
+        cache_miss_init_cycle = sim_cycle;
         changestate(thread.rob_cache_miss_list); /* This is hack for 'dcache_wakeup' to work */
         core.dcache_wakeup((void*)request);
         thread.thread_stats.dcache.load.issue.hit++;
@@ -1770,6 +1913,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
         thread.thread_stats.dcache.load.issue.miss++;
 
         cycles_left = 0;
+        cache_miss_init_cycle = sim_cycle;
         changestate(thread.rob_cache_miss_list); /* TODO: change to cache access waiting list */
         physreg->changestate(PHYSREG_WAITING);
     }
@@ -1838,9 +1982,10 @@ int ReorderBufferEntry::probecache(Waddr addr, LoadStoreQueueEntry* sfra) {
 
         load_store_second_phase = 1;
         state.datavalid = 1;
-        physreg->flags &= ~FLAG_WAIT;
+        physreg->flags() &= ~FLAG_WAIT;
         physreg->complete();
         changestate(thread.rob_issued_list[cluster]);
+        thread.schedule_completion(*this);
         lfrqslot = -1;
         forward_cycle = 0;
 
@@ -1894,7 +2039,7 @@ bool ReorderBufferEntry::probetlb(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
 #ifndef DISABLE_TLB
     /* First check if its a TLB hit or miss */
-    if unlikely (exception != 0 || !thread.dtlb.probe(origaddr, threadid)) {
+    if unlikely (exception != 0 || !thread.probe_tlb(origaddr, false)) {
 
         if(logable(6)) {
             ptl_logfile << "dtlb miss origaddr: ", (void*)origaddr, endl;
@@ -1904,8 +2049,8 @@ bool ReorderBufferEntry::probetlb(LoadStoreQueueEntry& state, Waddr& origaddr, W
         cycles_left = 0;
         changestate(thread.rob_tlb_miss_list);
         tlb_miss_init_cycle = sim_cycle;
-        tlb_walk_level = thread.ctx.page_table_level_count();
         thread.thread_stats.dcache.dtlb.misses++;
+        tlb_walk_level = getcore().start_tlb_walk(thread, virtpage, false);
 
         return false;
     }
@@ -1950,8 +2095,8 @@ bool ReorderBufferEntry::probetlb(LoadStoreQueueEntry& state, Waddr& origaddr, W
           * storing the page fault address
           */
         origvirt = virtpage;
-        physreg->flags = (state.invalid << log2(FLAG_INV)) | ((!state.datavalid) << log2(FLAG_WAIT));
-        physreg->data = state.data;
+        physreg->flags() = (state.invalid << log2(FLAG_INV)) | ((!state.datavalid) << log2(FLAG_WAIT));
+        physreg->data() = state.data;
         assert(!physreg->valid());
 
         cycles_left = 0;
@@ -1995,8 +2140,7 @@ void ReorderBufferEntry::tlbwalk() {
 
 rob_cont:
 
-        int delay = min(sim_cycle - tlb_miss_init_cycle, (W64)1000);
-        thread.thread_stats.dcache.dtlb_latency[delay]++;
+        thread.thread_stats.dcache.dtlb_latency.record(sim_cycle - tlb_miss_init_cycle);
 
         if(logable(6)) {
             ptl_logfile << "Finalizing dtlb miss rob ", *this, " virtaddr: ", (void*)origvirt, endl;
@@ -2023,8 +2167,8 @@ rob_cont:
                       * storing the page fault address
                       */
                     origvirt = virtpage;
-                    physreg->flags = (state.invalid << log2(FLAG_INV)) | ((!state.datavalid) << log2(FLAG_WAIT));
-                    physreg->data = state.data;
+                    physreg->flags() = (state.invalid << log2(FLAG_INV)) | ((!state.datavalid) << log2(FLAG_WAIT));
+                    physreg->data() = state.data;
                     assert(!physreg->valid());
 
                     cycles_left = 0;
@@ -2038,7 +2182,8 @@ rob_cont:
             assert(exception == 0);
         }
 
-        thread.dtlb.insert(origvirt, threadid);
+        thread.insert_tlb(origvirt, false);
+        core.finish_tlb_walk(thread, virtaddr);
         thread.in_tlb_walk = 0;
 
         if(logable(10)) {
@@ -2066,8 +2211,11 @@ rob_cont:
     request->init(core.get_coreid(), threadid, pteaddr, idx, sim_cycle,
             false, uop.rip.rip, uop.uuid, Memory::MEMORY_OP_READ);
     request->set_coreSignal(&core.dcache_signal);
+    mem_request.set(request);
 
     lsq->physaddr = pteaddr >> 3;
+    if unlikely (lsq->filter_slot >= 0)
+        thread.lsq_filter.add(*lsq);
 
     bool L1_hit = core.memoryHierarchy->access_cache(request);
 
@@ -2106,6 +2254,10 @@ LoadStoreQueueEntry* ReorderBufferEntry::find_nearest_memory_fence() {
     bool ld = isload(uop.opcode);
     bool st = (uop.opcode == OP_st);
 
+    /* Fences without an address are among the stores not in the filter */
+    if likely (thread.stores_in_flight == thread.lsq_filter.stores)
+        return NULL;
+
     foreach_backward_before(thread.LSQ, lsq, i) {
         LoadStoreQueueEntry& stbuf = thread.LSQ[i];
 
@@ -2205,6 +2357,388 @@ void ReorderBufferEntry::issueprefetch(IssueState& state, W64 ra, W64 rb, W64 rc
     if unlikely (annul) return;
 }
 
+/**
+ * @brief Enter runahead under a long latency load at the ROB head, run it
+ * or leave it once the load is done
+ */
+void ThreadContext::runahead_cycle() {
+    if likely (!runahead.active) {
+        if likely (ROB.empty()) return;
+
+        ReorderBufferEntry& head = *ROB.peek();
+        if likely (head.current_state_list != &rob_cache_miss_list) return;
+        if (!isload(head.uop.opcode) || head.tlb_walk_level > 0) return;
+        if (sim_cycle - head.cache_miss_init_cycle < LONG_LATENCY_LOAD_CYCLES) return;
+
+        runahead_enter(head);
+    } else if (ROB.empty() || ROB.peek()->uop.uuid != runahead.load_uuid ||
+            ROB.peek()->current_state_list != &rob_cache_miss_list) {
+        runahead_exit();
+        return;
+    }
+
+    thread_stats.runahead.cycles++;
+
+    foreach (i, FETCH_WIDTH) {
+        if (runahead.stopped || runahead.uops >= core.runahead_depth) break;
+
+        if (!runahead_step()) {
+            runahead.stopped = 1;
+            thread_stats.runahead.stopped++;
+        }
+    }
+}
+
+/**
+ * @brief Checkpoint register values at rename and start pre-executing at
+ * the head of the fetch queue
+ */
+void ThreadContext::runahead_enter(ReorderBufferEntry& load) {
+    runahead.active = 1;
+    runahead.stopped = 0;
+    runahead.load_uuid = load.uop.uuid;
+    runahead.uops = 0;
+    runahead.store_count = 0;
+
+    foreach (i, TRANSREG_COUNT) {
+        PhysicalRegister* physreg = specrrt[i];
+        runahead.regs[i] = physreg->data();
+        runahead.flags[i] = (physreg->ready()) ? physreg->flags() : FLAG_INV;
+    }
+
+    runahead.in_fetchq = 1;
+    runahead.next_uuid = (fetchq.empty()) ? fetch_uuid : fetchq.peek()->uuid;
+    runahead.bb = NULL;
+    runahead.bbindex = 0;
+    runahead.rip = 0;
+
+    thread_stats.runahead.episodes++;
+}
+
+void ThreadContext::runahead_exit() {
+    runahead.active = 0;
+    runahead.bb = NULL;
+}
+
+/**
+ * @brief Pre-execute the next uop of the episode
+ *
+ * @return false if runahead can't go on
+ */
+bool ThreadContext::runahead_step() {
+    BasicBlockCache& bbc = bbcache_of(ctx.cpu_index);
+    W64 target;
+
+    if (runahead.in_fetchq) {
+        if (!fetchq.empty()) {
+            W64 first = fetchq.peek()->uuid;
+            if unlikely (runahead.next_uuid < first) return false;
+
+            W64 offset = runahead.next_uuid - first;
+            if (offset < W64(fetchq.count)) {
+                FetchBufferEntry& fetchbuf = fetchq[add_index_modulo(fetchq.head,
+                        int(offset), fetchq.size)];
+                runahead.next_uuid++;
+
+                if (!runahead_execute(fetchbuf, fetchbuf.desc, fetchbuf.rip,
+                            target)) return false;
+
+                /* Fetch went another way, go where the branch did */
+                if unlikely (target && target != fetchbuf.riptaken) {
+                    runahead.in_fetchq = 0;
+                    runahead.bb = NULL;
+                    runahead.rip = target;
+                }
+                return true;
+            }
+        }
+
+        /* Past the fetch queue, on with the uop fetch takes next */
+        runahead.in_fetchq = 0;
+        runahead.rip = fetchrip.rip;
+        runahead.bb = NULL;
+
+        if (current_basic_block && unaligned_ldst_buf.empty() &&
+                current_basic_block_transop_index < current_basic_block->count) {
+            runahead.bb = current_basic_block;
+            runahead.bbindex = current_basic_block_transop_index;
+            runahead.epoch = bbc.link_epoch;
+        }
+    }
+
+    /* Blocks were invalidated, bb may be gone */
+    if unlikely (runahead.bb && runahead.epoch != bbc.link_epoch) return false;
+
+    if (!runahead.bb || runahead.bbindex >= runahead.bb->count) {
+        BasicBlock* prev = runahead.bb;
+        BasicBlock* bb = NULL;
+
+        if (prev && prev->succ_epoch == bbc.link_epoch) {
+            foreach (i, 2) {
+                if (prev->succ[i] && prev->succ[i]->rip.rip == runahead.rip)
+                    bb = prev->succ[i];
+            }
+        }
+
+        if (!bb) {
+            RIPVirtPhys rvp(runahead.rip);
+            rvp.update(ctx);
+            bb = bbc.get(rvp);
+        }
+
+        if (!bb || bb->invalidblock || !bb->uopdescs) return false;
+
+        runahead.bb = bb;
+        runahead.bbindex = 0;
+        runahead.epoch = bbc.link_epoch;
+    }
+
+    BasicBlock* bb = runahead.bb;
+    int index = runahead.bbindex++;
+    const TransOp& uop = bb->transops[index];
+
+    if (!runahead_execute(uop, bb->uopdescs[index], runahead.rip, target))
+        return false;
+
+    if (isbranch(uop.opcode)) {
+        /* Not known: where the block went last time */
+        if (!target) {
+            W64 last = bb->lasttarget;
+            if (isclass(uop.opcode, OPCLASS_COND_BRANCH) &&
+                    last != uop.riptaken && last != uop.ripseq) {
+                last = (uop.riptaken < runahead.rip) ? uop.riptaken : uop.ripseq;
+            }
+            target = last;
+        }
+
+        if (!target) return false;
+
+        runahead.rip = target;
+        runahead.bbindex = bb->count;
+    } else if (uop.eom) {
+        runahead.rip += uop.bytes;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Pre-execute one uop on the runahead register values
+ *
+ * @param rip Of the uop's instruction
+ * @param target Set to where a branch goes, 0 if not known
+ *
+ * @return false at a barrier
+ */
+bool ThreadContext::runahead_execute(const TransOp& uop,
+        const UopDescriptor& desc, W64 rip, W64& target) {
+    target = 0;
+
+    if unlikely (isbarrier(uop.opcode)) return false;
+
+    W64 radata = runahead.regs[uop.ra];
+    W64 rbdata = (desc.flags & UOPDESC_RB_IMM) ? uop.rbimm : runahead.regs[uop.rb];
+    W64 rcdata = (desc.flags & UOPDESC_RC_IMM) ? uop.rcimm : runahead.regs[uop.rc];
+    W16 raflags = runahead.flags[uop.ra];
+    W16 rbflags = runahead.flags[uop.rb];
+    W16 rcflags = runahead.flags[uop.rc];
+
+    bool ld = isload(uop.opcode);
+    bool st = isstore(uop.opcode);
+    bool br = isbranch(uop.opcode);
+
+    IssueState state;
+    state.reg.rddata = 0;
+    state.reg.rdflags = 0;
+
+    if unlikely (st) {
+        /* Stores to an unknown address are lost, like in the LSQ */
+        if likely (uop.opcode != OP_mf && uop.cond == LDST_ALIGN_NORMAL &&
+                !((raflags | rbflags) & FLAG_INV) &&
+                runahead.store_count < RUNAHEAD_STORES) {
+            RunaheadStore& store = runahead.stores[runahead.store_count++];
+            store.virtaddr = (W64)signext64(radata + rbdata, 48) & ctx.virt_addr_mask;
+            store.data = rcdata;
+            store.size = uop.size;
+            store.invalid = ((rcflags & FLAG_INV) != 0);
+        }
+    } else if unlikely ((raflags | rbflags | rcflags) & FLAG_INV) {
+        state.reg.rdflags = FLAG_INV;
+    } else if unlikely (ld) {
+        runahead_load(uop, rip, radata, rbdata, state);
+    } else if unlikely (isprefetch(uop.opcode)) {
+        /* Nothing to execute */
+    } else if unlikely (uop.opcode == OP_ast) {
+        state.reg.rdflags = FLAG_INV;
+    } else {
+        if unlikely (br) {
+            state.brreg.riptaken = uop.riptaken;
+            state.brreg.ripseq = uop.ripseq;
+        }
+        desc.synthop(state, radata, rbdata, rcdata, raflags, rbflags, rcflags);
+
+        if unlikely (br && !(state.reg.rdflags & FLAG_INV))
+            target = state.reg.rddata;
+    }
+
+    thread_stats.runahead.uops++;
+    thread_stats.runahead.invalid += ((state.reg.rdflags & FLAG_INV) != 0);
+    runahead.uops++;
+
+    if likely (!st) runahead_write(uop, state.reg.rddata, state.reg.rdflags);
+
+    return true;
+}
+
+/**
+ * @brief Write a uop's result to its destination and flags, as rename
+ * maps them
+ */
+void ThreadContext::runahead_write(const TransOp& uop, W64 data, W16 flags) {
+    if likely (archdest_can_commit[uop.rd]) {
+        runahead.regs[uop.rd] = data;
+        runahead.flags[uop.rd] = flags;
+    }
+
+    if unlikely (!uop.nouserflags) {
+        if (uop.setflags & SETFLAG_ZF) {
+            runahead.regs[REG_zf] = data;
+            runahead.flags[REG_zf] = flags;
+        }
+        if (uop.setflags & SETFLAG_CF) {
+            runahead.regs[REG_cf] = data;
+            runahead.flags[REG_cf] = flags;
+        }
+        if (uop.setflags & SETFLAG_OF) {
+            runahead.regs[REG_of] = data;
+            runahead.flags[REG_of] = flags;
+        }
+    }
+}
+
+/**
+ * @brief Uop renamed before runahead got to it, its results are not known
+ */
+void ThreadContext::runahead_skip(const FetchBufferEntry& fetchbuf) {
+    if (!runahead.in_fetchq || fetchbuf.uuid < runahead.next_uuid) return;
+
+    runahead.next_uuid = fetchbuf.uuid + 1;
+    runahead_write(fetchbuf, 0, FLAG_INV);
+}
+
+/**
+ * @brief Pre-execute a load: forward from a store of the episode, read a
+ * line in the L1-D or prefetch it
+ */
+void ThreadContext::runahead_load(const TransOp& uop, W64 rip, W64 ra,
+        W64 rb, IssueState& state) {
+    state.reg.rdflags = FLAG_INV;
+
+    /* Halves of a load split by fetch, the whole one comes from its block */
+    if unlikely (uop.cond != LDST_ALIGN_NORMAL) return;
+
+    Waddr addr = (W64)signext64(ra + rb, 48) & ctx.virt_addr_mask;
+
+    int exception = 0;
+    int mmio = 0;
+    PageFaultErrorCode pfec = 0;
+    Waddr physaddr = ctx.check_and_translate(addr, uop.size, false,
+            uop.internal, exception, mmio, pfec);
+
+    if (exception || mmio) return;
+
+    bool signext = (uop.opcode == OP_ldx);
+
+    if unlikely (uop.internal) {
+        state.reg.rddata = ctx.loadphys(physaddr, true, uop.size);
+        state.reg.rdflags = 0;
+        return;
+    }
+
+    for (int i = runahead.store_count - 1; i >= 0; i--) {
+        RunaheadStore& store = runahead.stores[i];
+        if (store.virtaddr != addr) continue;
+        if (store.invalid || store.size < uop.size) return;
+
+        state.reg.rddata = extract_bytes(&store.data, uop.size, signext);
+        state.reg.rdflags = 0;
+        return;
+    }
+
+    if (!runahead_prefetch(physaddr, rip)) return;
+
+    W64 data = ctx.loadvirt(addr, uop.size);
+    state.reg.rddata = extract_bytes(&data, uop.size, signext);
+    state.reg.rdflags = 0;
+}
+
+/**
+ * @brief Prefetch the line of a runahead load into the L1-D
+ *
+ * @return true if the line is in the L1-D already
+ */
+bool ThreadContext::runahead_prefetch(W64 physaddr, W64 rip) {
+    W64 line = physaddr >> log2(RUNAHEAD_LINE_SIZE);
+
+    PrefetchedLine* entry = runahead.find_line(line);
+    if (entry) {
+        thread_stats.runahead.hits += entry->ready;
+        return entry->ready;
+    }
+
+    if (runahead.inflight >= RUNAHEAD_MAX_INFLIGHT) return false;
+    if (!core.memoryHierarchy->is_cache_available(core.get_coreid(),
+                threadid, false/* icache */)) return false;
+
+    Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
+    assert(request != NULL);
+
+    request->init(core.get_coreid(), threadid, physaddr, 0, sim_cycle,
+            false, rip, 0, Memory::MEMORY_OP_READ);
+    request->set_coreSignal(&core.runahead_signal);
+    request->set_priority(Memory::PRIORITY_PREFETCH);
+
+    if (core.memoryHierarchy->access_cache(request)) {
+        thread_stats.runahead.hits++;
+        return true;
+    }
+
+    thread_stats.runahead.prefetches++;
+    if (runahead.add_line(line)) thread_stats.runahead.unused++;
+    return false;
+}
+
+/**
+ * @brief Account a load's dcache access to a line runahead prefetched
+ */
+void ThreadContext::runahead_demand(W64 physaddr) {
+    PrefetchedLine* entry = runahead.find_line(physaddr >> log2(RUNAHEAD_LINE_SIZE));
+    if likely (!entry) return;
+
+    if (entry->ready)
+        thread_stats.runahead.timely++;
+    else thread_stats.runahead.late++;
+
+    runahead.remove_line(*entry);
+}
+
+/**
+ * @brief Runahead prefetch is in the L1-D
+ *
+ * @param arg MemoryRequest Object passed to this call-back
+ *
+ * @return Always true
+ */
+bool OooCore::runahead_wakeup(void *arg) {
+    Memory::MemoryRequest* request = (Memory::MemoryRequest*)arg;
+
+    ThreadContext* thread = threads[request->get_threadid()];
+    thread->runahead.fill_line(request->get_physical_address() >>
+            log2(RUNAHEAD_LINE_SIZE));
+
+    return true;
+}
+
 /**
  * @brief D-Cache responded with requested data
  *
@@ -2218,20 +2752,61 @@ bool OooCore::dcache_wakeup(void *arg) {
 
     /* If request was for memory write, no need to do anything.. */
     if(request->get_type() == Memory::MEMORY_OP_WRITE) {
+        if unlikely (pc_profile_enabled) {
+            pc_profile.complete(request->get_owner_rip(), request->get_level(),
+                    sim_cycle - request->get_init_cycles());
+        }
         return true;
     }
 
-    int idx = request->get_robid();
-    W64 physaddr = request->get_physical_address();
-    ThreadContext* thread = threads[request->get_threadid()];
-    assert(inrange(idx, 0, ROB_SIZE-1));
+    if(logable(6)) ptl_logfile << " dcache_wakeup request ", *request, endl;
+
+    return load_wakeup(request->get_threadid(), request->get_robid(),
+            request->get_physical_address(), request->get_owner_uuid(),
+            request->get_level());
+}
+
+/**
+ * @brief Wake up the load waiting in rob_cache_miss_list for its data
+ *
+ * @param threadid Thread of the load
+ * @param idx ROB index of the load
+ * @param physaddr Physical address it accessed
+ * @param uuid uuid of the load's uop, stale wakeups of annuled loads are
+ * ignored
+ * @param level Deepest level of the hierarchy the load reached
+ *
+ * @return True indicating success of receiving data
+ */
+bool OooCore::load_wakeup(W8 threadid, int idx, W64 physaddr, W64 uuid,
+        Memory::CacheType level) {
+
+    ThreadContext* thread = threads[threadid];
+    assert(inrange(idx, 0, MAX_ROB_SIZE-1));
     ReorderBufferEntry& rob = thread->ROB[idx];
-    if(logable(6)) ptl_logfile << " dcache_wakeup ", rob, " request ", *request, endl;
-    if(rob.lsq && request->get_owner_uuid() == rob.uop.uuid &&
+    if(logable(6)) ptl_logfile << " load_wakeup ", rob, endl;
+    if(rob.lsq && uuid == rob.uop.uuid &&
             rob.lsq->physaddr == (physaddr >> 3) &&
             rob.current_state_list == &thread->rob_cache_miss_list){
         if(logable(6)) ptl_logfile << " rob ", rob, endl;
 
+        int topdown_level;
+        switch (level) {
+            case Memory::L2_CACHE: topdown_level = TOPDOWN_MEM_L2; break;
+            case Memory::L3_CACHE: topdown_level = TOPDOWN_MEM_L3; break;
+            case Memory::MAIN_MEMORY: topdown_level = TOPDOWN_MEM_DRAM; break;
+            default: topdown_level = TOPDOWN_MEM_L1; break;
+        }
+        thread->thread_stats.topdown.memory[topdown_level] +=
+            rob.topdown_miss_slots;
+        rob.topdown_miss_slots = 0;
+        thread->thread_stats.dcache.load_level[topdown_level]++;
+
+        if unlikely (pc_profile_enabled) {
+            pc_profile.complete(rob.uop.rip.rip, level,
+                    sim_cycle - rob.cache_miss_init_cycle);
+        }
+
         /*
          * Because of QEMU's in-order execution and Simulator's
          * out-of-order execution we may have page fault at this point
@@ -2268,7 +2843,7 @@ bool OooCore::dcache_wakeup(void *arg) {
                  * Scan through all the LSQ from head to find Store that may
                  * have the most recent data and merge all the data for this load
                  */
-                Queue<LoadStoreQueueEntry, LSQ_SIZE>& LSQ = thread->LSQ;
+                Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE>& LSQ = thread->LSQ;
                 foreach_forward(LSQ, i) {
                     LoadStoreQueueEntry& stq = LSQ[i];
                     if unlikely (&stq == rob.lsq)
@@ -2328,7 +2903,7 @@ bool OooCore::dcache_wakeup(void *arg) {
     }else{
         if(logable(5)) {
             ptl_logfile << " ignor annulled request : request uuid ",
-                        request->get_owner_uuid(), " rob.uop.uuid ", rob.uop.uuid;
+                        uuid, " rob.uop.uuid ", rob.uop.uuid;
             if(rob.lsq)
                 ptl_logfile << " lsq_physaddr ", (void*)(rob.lsq->physaddr << 3),
                             " physaddr ", (void*)physaddr;
@@ -2357,13 +2932,14 @@ void ReorderBufferEntry::loadwakeup() {
         changestate(getthread().rob_tlb_miss_list);
     } else {
         /* Actually wake up the load */
-        physreg->data = lsq->data;
-        physreg->flags &= ~FLAG_WAIT;
+        physreg->data() = lsq->data;
+        physreg->flags() &= ~FLAG_WAIT;
         physreg->complete();
 
         lsq->datavalid = 1;
 
         changestate(getthread().rob_completed_list[cluster]);
+        trace_stage(TRACE_UOP_COMPLETE);
         cycles_left = 0;
         lfrqslot = -1;
         forward_cycle = 0;
@@ -2384,8 +2960,8 @@ void ReorderBufferEntry::fencewakeup() {
     assert(!lsq->datavalid);
     assert(!lsq->addrvalid);
 
-    physreg->flags &= ~FLAG_WAIT;
-    physreg->data = 0;
+    physreg->flags() &= ~FLAG_WAIT;
+    physreg->data() = 0;
     physreg->complete();
     lsq->datavalid = 1;
     lsq->addrvalid = 1;
@@ -2403,6 +2979,7 @@ void ReorderBufferEntry::fencewakeup() {
     load_store_second_phase = 1;
 
     changestate(thread.rob_completed_list[cluster]);
+    trace_stage(TRACE_UOP_COMPLETE);
 }
 
 /**
@@ -2453,6 +3030,7 @@ void ReorderBufferEntry::replay() {
         changestate(get_ready_to_issue_list());
     }
 
+    trace_stage(TRACE_UOP_REPLAY);
     issueq_operation_on_cluster(core, cluster, replay(iqslot, uopids, preready));
 }
 
@@ -2491,6 +3069,7 @@ void ReorderBufferEntry::replay_locked() {
         changestate(get_ready_to_issue_list());
     }
 
+    trace_stage(TRACE_UOP_REPLAY);
     issueq_operation_on_cluster(core, cluster, switch_to_end(iqslot,  uopids, preready));
 }
 
@@ -2567,7 +3146,7 @@ int OooCore::issue(int cluster) {
         int threadid, idx;
         decode_tag(robid, threadid, idx);
         ThreadContext* thread = threads[threadid];
-        assert(inrange(idx, 0, ROB_SIZE-1));
+        assert(inrange(idx, 0, MAX_ROB_SIZE-1));
         ReorderBufferEntry& rob = thread->ROB[idx];
 
 		if unlikely (opclassof(rob.uop.opcode) == OPCLASS_FP)
@@ -2663,8 +3242,8 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
 
     ThreadContext& thread = getthread();
     BranchPredictorInterface& branchpred = thread.branchpred;
-    Queue<ReorderBufferEntry, ROB_SIZE>& ROB = thread.ROB;
-    Queue<LoadStoreQueueEntry, LSQ_SIZE>& LSQ = thread.LSQ;
+    Queue<ReorderBufferEntry, MAX_ROB_SIZE>& ROB = thread.ROB;
+    Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE>& LSQ = thread.LSQ;
     RegisterRenameTable& specrrt = thread.specrrt;
     RegisterRenameTable& commitrrt = thread.commitrrt;
     int& loads_in_flight = thread.loads_in_flight;
@@ -2679,12 +3258,12 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
 
     int somidx = index();
 
-    while (!ROB[somidx].uop.som) somidx = add_index_modulo(somidx, -1, ROB_SIZE);
+    while (!ROB[somidx].uop.som) somidx = add_index_modulo(somidx, -1, MAX_ROB_SIZE);
     int eomidx = index();
-    while (!ROB[eomidx].uop.eom) eomidx = add_index_modulo(eomidx, +1, ROB_SIZE);
+    while (!ROB[eomidx].uop.eom) eomidx = add_index_modulo(eomidx, +1, MAX_ROB_SIZE);
 
     /* Find uop to start annulment at */
-    int startidx = (keep_misspec_uop) ? add_index_modulo(eomidx, +1, ROB_SIZE) : somidx;
+    int startidx = (keep_misspec_uop) ? add_index_modulo(eomidx, +1, MAX_ROB_SIZE) : somidx;
     if unlikely (startidx == ROB.tail) {
         /*
          * The uop causing the mis-speculation was the only uop in the ROB:
@@ -2694,7 +3273,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
     }
 
     /* Find uop to stop annulment at (later in program order) */
-    int endidx = add_index_modulo(ROB.tail, -1, ROB_SIZE);
+    int endidx = add_index_modulo(ROB.tail, -1, MAX_ROB_SIZE);
 
     /* For branches, branch must always terminate the macro-op */
     if (keep_misspec_uop) assert(eomidx == index());
@@ -2731,7 +3310,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
         annulrob.iqslot = -1;
 
         if unlikely (idx == startidx) break;
-        idx = add_index_modulo(idx, -1, ROB_SIZE);
+        idx = add_index_modulo(idx, -1, MAX_ROB_SIZE);
     }
 
     int annulcount = 0;
@@ -2766,7 +3345,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
 
     // if (logable(6)) ptl_logfile << "Restored SpecRRT from CommitRRT; walking forward from:", endl, core.specrrt, endl;
     idx = ROB.head;
-    for (idx = ROB.head; idx != startidx; idx = add_index_modulo(idx, +1, ROB_SIZE)) {
+    for (idx = ROB.head; idx != startidx; idx = add_index_modulo(idx, +1, MAX_ROB_SIZE)) {
         ReorderBufferEntry& rob = ROB[idx];
         rob.pseudocommit();
     }
@@ -2785,7 +3364,12 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
          */
 
         foreach (j, MAX_OPERANDS) { annulrob.operands[j]->unref(annulrob, thread.threadid); }
-        annulrob.physreg->free();
+        if unlikely (annulrob.move_eliminated) {
+            /* Register of the move's source, which still owns it */
+            annulrob.physreg->unref(annulrob, thread.threadid);
+        } else {
+            annulrob.physreg->free();
+        }
 
         if unlikely (isclass(annulrob.uop.opcode, OPCLASS_LOAD|OPCLASS_STORE)) {
             /*
@@ -2803,18 +3387,12 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
             if (annulrob.release_mem_lock(true)) thread.flush_mem_lock_release_list(queued_locks_before);
             loads_in_flight -= (annulrob.lsq->store == 0);
             stores_in_flight -= (annulrob.lsq->store == 1);
+            thread.lsq_filter.remove(*annulrob.lsq);
             annulrob.lsq->reset();
             LSQ.annul(annulrob.lsq);
 
-            /* annul any cache requests for this entry */
-
-            bool is_store = isclass(annulrob.uop.opcode, OPCLASS_STORE);
-            core.memoryHierarchy->annul_request(core.get_coreid(),
-                    threadid,
-                    annulrob.idx/*robid*/,
-                    annulrob.lsq->physaddr << 3,
-                    false/* icache */,
-                    is_store);
+            /* annul the outstanding cache request of this entry */
+            core.memoryHierarchy->annul_request(annulrob.mem_request);
         }
 
         if unlikely (annulrob.lfrqslot >= 0) {
@@ -2841,6 +3419,9 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
             branchpred.annulras(annulrob.uop.predinfo);
         }
 
+        thread.branches_in_flight -= isbranch(annulrob.uop.opcode);
+
+        annulrob.trace_stage(TRACE_UOP_ANNUL);
         annulrob.reset();
 
         ROB.annul(annulrob);
@@ -2848,7 +3429,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
         annulcount++;
 
         if (idx == startidx) break;
-        idx = add_index_modulo(idx, -1, ROB_SIZE);
+        idx = add_index_modulo(idx, -1, MAX_ROB_SIZE);
     }
 
     assert(ROB[startidx].uop.som);
@@ -2925,6 +3506,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
     thread.flush_mem_lock_release_list();
 
     if unlikely (lsq) {
+        thread.lsq_filter.remove(*lsq);
         lsq->physaddr = 0;
         lsq->virtaddr = 0;
         lsq->addrvalid = 0;
@@ -2942,8 +3524,8 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
     }
 
     /* Return physreg to state just after allocation */
-    physreg->data = 0;
-    physreg->flags = FLAG_WAIT;
+    physreg->data() = 0;
+    physreg->flags() = FLAG_WAIT;
     physreg->changestate(PHYSREG_WAITING);
 
     /* Force ROB to be re-dispatched in program order */
@@ -2951,6 +3533,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
     forward_cycle = 0;
     load_store_second_phase = 0;
     changestate(thread.rob_ready_to_dispatch_list, true, prevrob);
+    trace_stage(TRACE_UOP_REDISPATCH);
 }
 
 /**
@@ -2963,9 +3546,9 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
  */
 void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
     ThreadContext& thread = getthread();
-    Queue<ReorderBufferEntry, ROB_SIZE>& ROB = thread.ROB;
+    Queue<ReorderBufferEntry, MAX_ROB_SIZE>& ROB = thread.ROB;
 
-    bitvec<ROB_SIZE> depmap;
+    bitvec<MAX_ROB_SIZE> depmap;
     depmap = 0;
     depmap[index()] = 1;
 
@@ -2987,6 +3570,9 @@ void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
             continue;
         }
 
+        /* Eliminated moves have no sources and share the register of one */
+        if unlikely (reissuerob.move_eliminated) continue;
+
         bitvec<MAX_OPERANDS> dependent_operands;
         dependent_operands = 0;
 
@@ -3016,7 +3602,7 @@ void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
         }
     }
 
-    assert(inrange(count, 1, ROB_SIZE));
+    assert(inrange(count, 1, MAX_ROB_SIZE));
     thread.thread_stats.dispatch.redispatch.dependent_uops[count-1]++;
 }
 
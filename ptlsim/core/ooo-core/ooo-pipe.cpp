@@ -19,6 +19,8 @@
 #include <ooo.h>
 
 #include <memoryHierarchy.h>
+#include <statehash.h>
+#include <uoptrace.h>
 
 #ifndef ENABLE_CHECKS
 #undef assert
@@ -33,6 +35,17 @@
 using namespace OOO_CORE_MODEL;
 using namespace Memory;
 
+/**
+ * @brief Fill the FU mask and latency of a uop descriptor from fuinfo
+ *
+ * @param desc Descriptor to fill
+ * @param op Uop it describes
+ */
+static void fill_uop_desc(UopDescriptor& desc, const TransOp& op) {
+    desc.fu = fuinfo[op.opcode].fu;
+    desc.latency = fuinfo[op.opcode].latency;
+}
+
 /**
  * @brief AVADH
  *
@@ -62,6 +75,8 @@ bool OooCore::icache_wakeup(void *arg) {
             if (logable(6)) ptl_logfile << "[vcpu ", thread->ctx.cpu_index, "] i-cache wait ", (void*)thread->waiting_for_icache_fill_physaddr,
                 " delivered ", (void*) physaddr,endl;
         }
+
+        if unlikely (thread && fdip_depth) thread->fdip_fill(physaddr);
     }
 
     return true;
@@ -80,15 +95,15 @@ bool ThreadContext::probeitlb(Waddr icache_addr) {
     return true;
 #endif
 
-    if(!itlb.probe(icache_addr, threadid)) {
+    if(!probe_tlb(icache_addr, true)) {
 
         if(logable(6)) {
             ptl_logfile << "itlb miss addr: ", (void*)icache_addr, endl;
         }
 
-        itlb_walk_level = ctx.page_table_level_count();
         itlb_miss_init_cycle = sim_cycle;
         thread_stats.dcache.itlb.misses++;
+        itlb_walk_level = core.start_tlb_walk(*this, icache_addr, true);
 
         return false;
     }
@@ -113,9 +128,9 @@ itlb_walk_finish:
             ptl_logfile << "itlbwalk finished for virtaddr: ", (void*)(W64(fetchrip)), endl;
         }
         itlb_walk_level = 0;
-        itlb.insert(fetchrip, threadid);
-        int delay = min(sim_cycle - itlb_miss_init_cycle, (W64)1000);
-        thread_stats.dcache.itlb_latency[delay]++;
+        insert_tlb(fetchrip, true);
+        core.finish_tlb_walk(*this, fetchrip);
+        thread_stats.dcache.itlb_latency.record(sim_cycle - itlb_miss_init_cycle);
         waiting_for_icache_fill = 0;
         return;
     }
@@ -214,8 +229,7 @@ void OooCore::flush_pipeline() {
         ThreadContext* thread = threads[i];
         thread->flush_pipeline();
     }
-    machine.memoryHierarchyPtr->flush(-1);
-    /* Clear out everything global: */
+    /* Threads flushed this core's CPU controller, clear out the rest: */
     setzero(robs_on_fu);
 }
 
@@ -225,6 +239,7 @@ void OooCore::flush_pipeline() {
  */
 void ThreadContext::flush_pipeline() {
     if (logable(3)) ptl_logfile << " core[", core.get_coreid(),"] TH[", threadid, "] flush_pipeline()",endl;
+    ptltrace(trace_id, TRACE_OOO_FLUSH, ctx.get_cs_eip());
 
     core.machine.memoryHierarchyPtr->flush(core.get_coreid());
 
@@ -269,19 +284,21 @@ void ThreadContext::flush_pipeline() {
     rob_states.reset();
 
     ROB.reset();
-    foreach (i, ROB_SIZE) {
+    foreach (i, MAX_ROB_SIZE) {
         ROB[i].coreid = core.get_coreid();
         ROB[i].core = &core;
         ROB[i].threadid = threadid;
         ROB[i].changestate(rob_free_list);
     }
     LSQ.reset();
-    foreach (i, LSQ_SIZE) {
+    lsq_filter.reset();
+    foreach (i, MAX_LSQ_SIZE) {
         LSQ[i].coreid = core.get_coreid();
         LSQ[i].core = &core;
     }
     loads_in_flight = 0;
     stores_in_flight = 0;
+    branches_in_flight = 0;
     foreach_issueq(reset(core.get_coreid(), threadid, &core));
 
     dispatch_deadlock_countdown = DISPATCH_DEADLOCK_COUNTDOWN_CYCLES;
@@ -292,6 +309,61 @@ void ThreadContext::flush_pipeline() {
         thread_stats.cycles_in_pause -= pause_counter;
     pause_counter = 0;
     in_tlb_walk = 0;
+
+    if unlikely (spin.waiting)
+        spin_wake(SPIN_WAKE_FLUSH);
+}
+
+/**
+ * @brief Wait in the spin loop whose branch just committed
+ *
+ * The caller annulled the younger uops, they are further iterations of
+ * the loop. Fetch restarts at the loop head in ctx.eip once woken.
+ */
+void ThreadContext::spin_wait() {
+    if(pause_counter)
+        thread_stats.cycles_in_pause -= pause_counter;
+    pause_counter = 0;
+
+    core.machine.spin_wait(spin);
+    thread_stats.spin.waits++;
+}
+
+/* End the wait once the line changed, an event is pending or on timeout */
+void ThreadContext::spin_poll() {
+    if (spin.woken) {
+        spin_wake(SPIN_WAKE_LINE);
+    } else if (ctx.check_events()) {
+        spin_wake(SPIN_WAKE_EVENT);
+    } else if (sim_cycle - spin.wait_cycle >= config.spin_max_cycles) {
+        spin_wake(SPIN_WAKE_TIMEOUT);
+    }
+}
+
+/**
+ * @brief End a spin wait, accounting the iterations it skipped
+ */
+void ThreadContext::spin_wake(int reason) {
+    W64 insns, uops;
+
+    core.machine.spin_unwatch(spin);
+    W64 cycles = spin.wake(sim_cycle, insns, uops);
+
+    thread_stats.spin.wakeups[reason]++;
+    thread_stats.spin.cycles += cycles;
+    thread_stats.spin.insns += insns;
+
+    ::total_insns_committed += insns;
+    ::total_uops_committed += uops;
+    thread_stats.commit.insns += insns;
+    thread_stats.commit.uops += uops;
+    total_insns_committed += insns;
+    total_uops_committed += uops;
+    core.committed_insns += insns;
+    if unlikely (state_hash_enabled && insns)
+        state_hash_commit(ctx.cpu_index, ctx.eip, insns);
+
+    last_commit_at_cycle = sim_cycle;
 }
 
 /**
@@ -315,8 +387,19 @@ void ThreadContext::reset_fetch_unit(W64 realrip) {
     waiting_for_icache_fill = 0;
     itlb_walk_level = 0;
     fetchq.reset();
+    if unlikely (pipe_trace.active)
+        trace_record(sim_cycle, trace_id, TRACE_UOP_REDIRECT, fetch_uuid, realrip);
     current_basic_block_transop_index = 0;
     unaligned_ldst_buf.reset();
+    lsd.reset();
+    ftq.flush();
+
+    /* The path runahead followed is gone, another episode may start */
+    if unlikely (runahead.active) runahead_exit();
+
+    /* Empty ROB slots until the new path commits are bad speculation */
+    topdown_refill = 1;
+    topdown_refill_uuid = fetch_uuid;
 }
 
 /**
@@ -326,9 +409,10 @@ void ThreadContext::reset_fetch_unit(W64 realrip) {
  */
 void ThreadContext::invalidate_smc() {
     if unlikely (smc_invalidate_pending) {
-        if (logable(5)) ptl_logfile << "SMC invalidate pending on ", smc_invalidate_rvp, endl;
-        bbcache[ctx.cpu_index].invalidate_page(smc_invalidate_rvp.mfnlo, INVALIDATE_REASON_SMC);
-        if unlikely (smc_invalidate_rvp.mfnlo != smc_invalidate_rvp.mfnhi) bbcache[ctx.cpu_index].invalidate_page(smc_invalidate_rvp.mfnhi, INVALIDATE_REASON_SMC);
+        if (logable(5)) ptl_logfile << "SMC invalidate pending on ", bbcache_of(ctx.cpu_index).smc_dirty_pages.length, " pages", endl;
+        bbcache_of(ctx.cpu_index).invalidate_smc_lines(INVALIDATE_REASON_SMC);
+        uop_cache.flush_all();
+        flush_decoded_uops();
         smc_invalidate_pending = 0;
     }
 }
@@ -342,8 +426,8 @@ void ThreadContext::external_to_core_state() {
         PhysicalRegister* zeroreg = rf.alloc(threadid, PHYS_REG_NULL);
         zeroreg->addspecref(0, threadid);
         zeroreg->commit();
-        zeroreg->data = 0;
-        zeroreg->flags = 0;
+        zeroreg->data() = 0;
+        zeroreg->flags() = 0;
         zeroreg->archreg = REG_zero;
     }
 
@@ -370,8 +454,8 @@ void ThreadContext::external_to_core_state() {
         PhysicalRegister* physreg = (i == REG_zero) ? zeroreg : rf.alloc(threadid);
         assert(physreg); /* need increase rf size if failed. */
         physreg->archreg = i;
-        physreg->data = ctx.get(i);
-        physreg->flags = 0;
+        physreg->data() = ctx.get(i);
+        physreg->flags() = 0;
         commitrrt[i] = physreg;
 
 		thread_stats.physreg_writes[physreg->rfid]++;
@@ -382,7 +466,7 @@ void ThreadContext::external_to_core_state() {
 			thread_stats.reg_reads++;
     }
 
-    commitrrt[REG_flags]->flags = (W16)commitrrt[REG_flags]->data;
+    commitrrt[REG_flags]->flags() = (W16)commitrrt[REG_flags]->data();
 
      /*
       * Internal translation registers are never used before
@@ -396,8 +480,8 @@ void ThreadContext::external_to_core_state() {
             PhysicalRegister* physreg = (i == REG_zero) ? zeroreg : rf.alloc(threadid);
             assert(physreg); /* need increase rf size if failed. */
             physreg->archreg = i;
-            physreg->data = ctx.get(i);
-            physreg->flags = 0;
+            physreg->data() = ctx.get(i);
+            physreg->flags() = 0;
             commitrrt[i] = physreg;
         } else {
             commitrrt[i] = zeroreg;
@@ -440,6 +524,13 @@ void ThreadContext::redispatch_deadlock_recovery() {
     /* don't want to reset the counter for no commit in this case */
     W64 previous_last_commit_at_cycle = last_commit_at_cycle;
     if (logable(3)) ptl_logfile << " redispatch_deadlock_recovery, flush_pipeline.",endl;
+
+    /* Keep the events that led up to the deadlock before flushing */
+    ptltrace(trace_id, TRACE_OOO_DEADLOCK, previous_last_commit_at_cycle);
+    const char *flight = flight_recorder_dump("deadlock recovery");
+    if (flight)
+        ptl_logfile << "[vcpu ", ctx.cpu_index, "] thread ", threadid, ": flight recorder dumped to ", flight, endl;
+
     flush_pipeline();
     last_commit_at_cycle = previous_last_commit_at_cycle; /* so we can exit after no commit after deadlock recovery a few times in a roll */
     ptl_logfile << "[vcpu ", ctx.cpu_index, "] thread ", threadid, ": reset thread.last_commit_at_cycle to be before redispatch_deadlock_recovery() ", previous_last_commit_at_cycle, endl;
@@ -570,8 +661,28 @@ bool ThreadContext::fetch() {
             //
         }
 
+        /*
+         * Uops streamed by the loop stream detector, or of a fetch window
+         * that hits in the uop cache, are already decoded: skip ITLB and
+         * icache for them
+         */
+        bool streamed = lsd.active(fetchrip);
+        bool decoded = streamed;
+
+        if (!decoded && UopCacheType::ENABLED) {
+            W64 window = floor(W64(fetchrip), ICACHE_FETCH_GRANULARITY);
+            if (window != current_fetch_window) {
+                current_fetch_window = window;
+                current_fetch_window_decoded = uop_cache.probe(window, threadid);
+                if (current_fetch_window_decoded)
+                    thread_stats.fetch.uop_cache.hits++;
+                else thread_stats.fetch.uop_cache.misses++;
+            }
+            decoded = current_fetch_window_decoded;
+        }
+
         // First probe tlb
-        if(!probeitlb(fetchrip)) {
+        if(!decoded && !probeitlb(fetchrip)) {
             // Its a itlb miss
             itlbwalk();
             break;
@@ -580,10 +691,12 @@ bool ThreadContext::fetch() {
         PageFaultErrorCode pfec;
         int exception = 0;
         int mmio = 0;
-        Waddr physaddr = ctx.check_and_translate(fetchrip, 3, false, false, exception, mmio, pfec, true);
+        Waddr physaddr = 0;
+        if (!decoded)
+            physaddr = ctx.check_and_translate(fetchrip, 3, false, false, exception, mmio, pfec, true);
 
         W64 req_icache_block = floor(physaddr, ICACHE_FETCH_GRANULARITY);
-        if ((!current_basic_block->invalidblock) && (req_icache_block != current_icache_block)) {
+        if ((!decoded) && (!current_basic_block->invalidblock) && (req_icache_block != current_icache_block)) {
 
             // test if icache is available:
             bool cache_available = core.memoryHierarchy->is_cache_available(core.get_coreid(), threadid, true/* icache */);
@@ -596,6 +709,8 @@ bool ThreadContext::fetch() {
             bool hit;
             assert(!waiting_for_icache_fill);
 
+            if unlikely (core.fdip_depth) fdip_demand(physaddr);
+
             Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
             assert(request != NULL);
 
@@ -617,6 +732,13 @@ bool ThreadContext::fetch() {
             current_icache_block = req_icache_block;
         }
 
+        /* Window is decoded now, its remaining uops come from uop cache */
+        if ((!decoded) && UopCacheType::ENABLED &&
+                (!current_basic_block->invalidblock)) {
+            uop_cache.insert(fetchrip, threadid);
+            current_fetch_window_decoded = 1;
+        }
+
         if(current_basic_block->invalidblock){
             thread_stats.fetch.stop.invalid_blocks++;
         }
@@ -624,12 +746,14 @@ bool ThreadContext::fetch() {
         FetchBufferEntry& transop = *fetchq.alloc();
 
         uopimpl_func_t synthop = NULL;
+        bool buffered;
 
-        assert(current_basic_block->synthops);
+        assert(current_basic_block->uopdescs);
 
-        if likely (!unaligned_ldst_buf.get(transop, synthop)) {
+        buffered = unaligned_ldst_buf.get(transop, synthop);
+        if likely (!buffered) {
             transop = current_basic_block->transops[current_basic_block_transop_index];
-            synthop = current_basic_block->synthops[current_basic_block_transop_index];
+            transop.desc = current_basic_block->uopdescs[current_basic_block_transop_index];
         }
 
         transop.unaligned = ((transop.opcode == OP_ld) | (transop.opcode == OP_ldx) | (transop.opcode == OP_st)) &&
@@ -650,10 +774,13 @@ bool ThreadContext::fetch() {
         if unlikely (transop.unaligned) {
             split_unaligned(transop, unaligned_ldst_buf);
             assert(unaligned_ldst_buf.get(transop, synthop));
+            buffered = 1;
         }
 
+        /* Split uops are not in the basic block's descriptors */
+        if unlikely (buffered) make_uop_descriptor(transop.desc, transop, synthop, fill_uop_desc);
+
         assert(transop.bbindex == current_basic_block_transop_index);
-        transop.synthop = synthop;
 
         current_basic_block_transop_index += (unaligned_ldst_buf.empty());
 
@@ -665,12 +792,22 @@ bool ThreadContext::fetch() {
         }
 
         thread_stats.fetch.uops++;
+        if (streamed) thread_stats.fetch.lsd_uops++;
+        lsd.add_uop();
+
         Waddr predrip = 0;
         bool redirectrip = false;
 
         transop.rip = fetchrip;
         transop.uuid = fetch_uuid++;
 
+        pipe_trace.fetch(fetchrip.rip, sim_cycle);
+        if unlikely (pipe_trace.active) {
+            trace_record(sim_cycle, trace_id, TRACE_UOP_FETCH, transop.uuid,
+                    transop.rip.rip, pipe_trace_name(nameof(transop.opcode)),
+                    transop.som | (transop.eom << 1));
+        }
+
         if (isbranch(transop.opcode)) {
             transop.predinfo.uuid = transop.uuid;
             transop.predinfo.bptype =
@@ -711,7 +848,7 @@ bool ThreadContext::fetch() {
                 // uop according to the old condition, so redo that here so we call the
                 // correct code for the swapped condition.
                 //
-                transop.synthop = get_synthcode_for_cond_branch(transop.opcode, transop.cond, transop.size, 0);
+                transop.desc.synthop = get_synthcode_for_cond_branch(transop.opcode, transop.cond, transop.size, 0);
                 swap(transop.riptaken, transop.ripseq);
             }
         }
@@ -732,6 +869,9 @@ bool ThreadContext::fetch() {
             if unlikely (redirectrip && predrip) {
                 // follow to target, then end fetching for this cycle if predicted taken
                 bool taken = (predrip != fetchrip);
+                /* Loop branch of a streamed loop doesn't end the fetch cycle */
+                bool looped = taken && lsd.taken_branch((W64)transop.rip, predrip);
+                taken &= !looped;
                 taken_branch_count += taken;
                 fetchrip = predrip;
                 fetchrip.update(ctx);
@@ -760,20 +900,34 @@ bool ThreadContext::fetch() {
  */
 BasicBlock* ThreadContext::fetch_or_translate_basic_block(const RIPVirtPhys& rvp) {
 
+    BasicBlockCache& bbc = bbcache_of(ctx.cpu_index);
+
+    /*
+     * Keep the old block around to find or record its successor link.
+     * Releasing it is safe: it can only be freed by an invalidation,
+     * which also bumps the cache's link epoch.
+     */
+    BasicBlock* prev_bb = current_basic_block;
+
     if likely (current_basic_block) {
         /* Release our ref to the old basic block being fetched */
         current_basic_block->release();
         current_basic_block = NULL;
     }
 
-    BasicBlock* bb = bbcache[ctx.cpu_index](rvp);
+    BasicBlock* bb = bbc.get_successor(prev_bb, rvp);
 
     if likely (bb) {
         current_basic_block = bb;
     } else {
-        current_basic_block = bbcache[ctx.cpu_index].translate(ctx, rvp);
+        W32 link_epoch = bbc.link_epoch;
+        current_basic_block = bbc.translate(ctx, rvp);
         if (current_basic_block == NULL) return NULL;
         assert(current_basic_block);
+
+        /* Translation may have reclaimed the old block */
+        if (prev_bb && link_epoch == bbc.link_epoch)
+            bbc.link_successor(prev_bb, current_basic_block);
     }
 
      /*
@@ -785,15 +939,191 @@ BasicBlock* ThreadContext::fetch_or_translate_basic_block(const RIPVirtPhys& rvp
     current_basic_block->acquire();
     current_basic_block->use(sim_cycle);
 
-    if unlikely (!current_basic_block->synthops) synth_uops_for_bb(*current_basic_block);
-    assert(current_basic_block->synthops);
+    if unlikely (!current_basic_block->uopdescs) synth_uops_for_bb(*current_basic_block, fill_uop_desc, core.fusion);
+    assert(current_basic_block->uopdescs);
 
     current_basic_block_transop_index = 0;
     assert(current_basic_block->rip == rvp);
 
+    if unlikely (core.fdip_depth) fdip_enter_block(current_basic_block);
+
     return current_basic_block;
 }
 
+/**
+ * @brief Queue blocks fetch is predicted to go to and prefetch their lines
+ *
+ * Runs every cycle the thread may fetch, also while fetch waits on an
+ * icache miss, see FetchTargetQueue.
+ */
+void ThreadContext::fdip_runahead() {
+    BasicBlockCache& bbc = bbcache_of(ctx.cpu_index);
+
+    if unlikely (ftq.tail && ftq.epoch != bbc.link_epoch) {
+        /* Blocks were invalidated: restart from the one being fetched */
+        ftq.flush();
+    }
+
+    if unlikely (!ftq.tail && current_basic_block) {
+        ftq.tail = current_basic_block;
+        ftq.epoch = bbc.link_epoch;
+    }
+
+    int queued = 0;
+    while (ftq.tail && (ftq.count < core.fdip_depth) &&
+            (queued < FDIP_BLOCKS_PER_CYCLE)) {
+        BasicBlock* bb = bbc.get_last_successor(ftq.tail);
+        if (!bb) break;
+
+        ftq.push(bb, bbc.link_epoch);
+        thread_stats.fetch.fdip.blocks++;
+        queued++;
+    }
+
+    int sent = 0;
+    while ((ftq.prefetch < ftq.count) && (sent < FDIP_PREFETCHES_PER_CYCLE)) {
+        FetchTarget& target = ftq[ftq.prefetch];
+
+        if (target.prefetched == target.lines) {
+            ftq.prefetch++;
+            continue;
+        }
+
+        W64 physaddr = target.line_physaddr(target.prefetched);
+        W64 line = physaddr >> log2(FDIP_LINE_SIZE);
+
+        if (physaddr && !ftq.find_line(line)) {
+            /* Demand fetches keep the rest of the queue and requests */
+            if (ftq.inflight >= FDIP_MAX_INFLIGHT) break;
+            if (!core.memoryHierarchy->is_cache_available(core.get_coreid(),
+                        threadid, true/* icache */)) break;
+
+            Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
+            assert(request != NULL);
+
+            request->init(core.get_coreid(), threadid, physaddr, 0, sim_cycle,
+                    true, 0, 0, Memory::MEMORY_OP_READ);
+            request->set_coreSignal(&core.icache_signal);
+            request->set_priority(Memory::PRIORITY_PREFETCH);
+
+            if (core.memoryHierarchy->access_cache(request)) {
+                thread_stats.fetch.fdip.redundant++;
+            } else {
+                thread_stats.fetch.fdip.issued++;
+                if (ftq.add_line(line)) thread_stats.fetch.fdip.unused++;
+            }
+
+            sent++;
+        }
+
+        target.prefetched++;
+    }
+}
+
+/**
+ * @brief Pop the fetch target queue when fetch enters the block at its
+ * head, or flush it and run ahead from bb
+ */
+void ThreadContext::fdip_enter_block(BasicBlock* bb) {
+    if likely (ftq.count && ftq[0].rip == bb->rip.rip) {
+        ftq.pop();
+        thread_stats.fetch.fdip.followed++;
+        return;
+    }
+
+    if (ftq.count) thread_stats.fetch.fdip.diverged++;
+
+    ftq.flush();
+    ftq.tail = bb;
+    ftq.epoch = bbcache_of(ctx.cpu_index).link_epoch;
+}
+
+/**
+ * @brief Account a demand icache access to a line fdip prefetched
+ */
+void ThreadContext::fdip_demand(W64 physaddr) {
+    PrefetchedLine* entry = ftq.find_line(physaddr >> log2(FDIP_LINE_SIZE));
+    if likely (!entry) return;
+
+    if (entry->ready)
+        thread_stats.fetch.fdip.timely++;
+    else thread_stats.fetch.fdip.late++;
+
+    ftq.remove_line(*entry);
+}
+
+/**
+ * @brief Mark a prefetched line in icache when its request completes
+ */
+void ThreadContext::fdip_fill(W64 physaddr) {
+    ftq.fill_line(physaddr >> log2(FDIP_LINE_SIZE));
+}
+
+/**
+ * @brief RENAME_ELIM_ kind of the core's 'rename_elim' removing a uop at
+ * rename, 0 if it is renamed and executed as usual
+ */
+int ThreadContext::rename_elimination(const TransOp& uop) {
+    int kinds = core.rename_elim;
+    if likely (!kinds) return 0;
+
+    if ((kinds & RENAME_ELIM_MOVE) && (uop.opcode == OP_mov) &&
+            (uop.size == 3) && (!uop.is_sse) && (!uop.is_x87) &&
+            (uop.rb != REG_zero) && (uop.rb != REG_imm) &&
+            (uop.rb < TRANSREG_COUNT) && (uop.rd != uop.rb) &&
+            (uop.rd != REG_rip) && archdest_can_commit[uop.rd] &&
+            (!uop.setflags) && specrrt[uop.rb]->nonnull()) {
+        return RENAME_ELIM_MOVE;
+    }
+
+    if ((kinds & RENAME_ELIM_ZERO) &&
+            ((uop.opcode == OP_xor) | (uop.opcode == OP_sub)) &&
+            (uop.ra == uop.rb) && (uop.size >= 2) && (!uop.is_x87) &&
+            (uop.ra != REG_zero) && (uop.ra != REG_imm)) {
+        return RENAME_ELIM_ZERO;
+    }
+
+    if ((kinds & RENAME_ELIM_STACK) &&
+            ((uop.opcode == OP_add) | (uop.opcode == OP_sub)) &&
+            (uop.rd == REG_rsp) && (uop.ra == REG_rsp) &&
+            (uop.rb == REG_imm) && (!uop.setflags)) {
+        return RENAME_ELIM_STACK;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Complete a uop removed at rename without dispatching it
+ *
+ * An eliminated move already has its source's register. Zero idioms run
+ * on the null register and stack pointer updates on the ready rsp, so
+ * the result is written before any consumer is renamed.
+ */
+void ThreadContext::execute_at_rename(ReorderBufferEntry& rob) {
+    const FetchBufferEntry& uop = rob.uop;
+
+    if likely (!rob.move_eliminated) {
+        const PhysicalRegister& ra = *rob.operands[RA];
+        const PhysicalRegister& rb = *rob.operands[RB];
+        const PhysicalRegister& rc = *rob.operands[RC];
+
+        IssueState state;
+        state.reg.rdflags = 0;
+
+        W64 rbdata = (uop.desc.flags & UOPDESC_RB_IMM) ? uop.rbimm : rb.data();
+        W64 rcdata = (uop.desc.flags & UOPDESC_RC_IMM) ? uop.rcimm : rc.data();
+        uop.desc.synthop(state, ra.data(), rbdata, rcdata, ra.flags(), rb.flags(), rc.flags());
+
+        rob.physreg->data() = state.reg.rddata;
+        rob.physreg->flags() = state.reg.rdflags;
+        rob.physreg->writeback();
+    }
+
+    rob.cycles_left = 0;
+    rob.changestate(rob_ready_to_commit_queue);
+}
+
 /**
  * @brief Allocate and Rename Stages
  */
@@ -801,19 +1131,27 @@ void ThreadContext::rename() {
 
     int prepcount = 0;
 
-    while (prepcount < FRONTEND_WIDTH) {
+    /* A fused uop goes in the slot of the one before it */
+    while ((prepcount < FRONTEND_WIDTH) ||
+            ((!fetchq.empty()) && fetchq.peek()->desc.fused)) {
         if unlikely (fetchq.empty()) {
             thread_stats.frontend.status.fetchq_empty++;
             break;
         }
 
-        if unlikely (!ROB.remaining()) {
+        if unlikely (ROB.count >= core.rob_size - 1) {
             thread_stats.frontend.status.rob_full++;
             break;
         }
 
+        if unlikely (core.smt_partition_full(threadid, false)) {
+            thread_stats.smt.rob_partition_full++;
+            break;
+        }
+
         FetchBufferEntry& fetchbuf = *fetchq.peek();
 
+        int elim = rename_elimination(fetchbuf);
         int phys_reg_file = -1;
 
         W32 acceptable_phys_reg_files = phys_reg_files_writable_by_uop(fetchbuf);
@@ -825,7 +1163,8 @@ void ThreadContext::rename() {
             }
         }
 
-        if (phys_reg_file < 0) {
+        /* An eliminated move takes no register */
+        if ((phys_reg_file < 0) && (elim != RENAME_ELIM_MOVE)) {
             thread_stats.frontend.status.physregs_full++;
             break;
         }
@@ -834,17 +1173,22 @@ void ThreadContext::rename() {
         bool st = isstore(fetchbuf.opcode);
         bool br = isbranch(fetchbuf.opcode);
 
-        if unlikely (ld && (loads_in_flight >= LDQ_SIZE)) {
+        if unlikely (ld && (loads_in_flight >= core.ldq_size)) {
             thread_stats.frontend.status.ldq_full++;
             break;
         }
 
-        if unlikely (st && (stores_in_flight >= STQ_SIZE)) {
+        if unlikely (st && (stores_in_flight >= core.stq_size)) {
             thread_stats.frontend.status.stq_full++;
             break;
         }
 
-        if unlikely ((ld|st) && (!LSQ.remaining())) {
+        if unlikely ((ld|st) && (LSQ.count >= core.lsq_size - 1)) {
+            break;
+        }
+
+        if unlikely ((ld|st) && core.smt_partition_full(threadid, true)) {
+            thread_stats.smt.lsq_partition_full++;
             break;
         }
 
@@ -852,6 +1196,8 @@ void ThreadContext::rename() {
 
         FetchBufferEntry& transop = *fetchq.dequeue();
         ReorderBufferEntry& rob = *ROB.alloc();
+
+        if unlikely (runahead.active) runahead_skip(transop);
         PhysicalRegister* physreg = NULL;
 
         LoadStoreQueueEntry* lsqp = (ld|st) ? LSQ.alloc() : NULL;
@@ -871,9 +1217,21 @@ void ThreadContext::rename() {
             lsq.datavalid = 0;
             lsq.addrvalid = 0;
             lsq.invalid = 0;
+            lsq.filter_slot = -1;
             loads_in_flight += (st == 0);
             stores_in_flight += (st == 1);
         }
+        branches_in_flight += br;
+
+        if (core.memdep_predictor == MEMDEP_PREDICTOR_STORE_SETS) {
+            thread_stats.dcache.memdep.ssit_clears += store_sets.tick(sim_cycle);
+            if (ld) {
+                rob.memdep_store = store_sets.rename_load(transop.rip,
+                        rob.memdep_store_uuid);
+            } else if (st && transop.opcode != OP_mf) {
+                store_sets.rename_store(transop.rip, transop.uuid);
+            }
+        }
 
         thread_stats.frontend.alloc.reg+= (!(ld|st|br));
         thread_stats.frontend.alloc.ldreg+=ld;
@@ -891,6 +1249,20 @@ void ThreadContext::rename() {
         rob.operands[RC] = specrrt[transop.rc];
         rob.operands[RS] = &core.physregfiles[0][PHYS_REG_NULL]; /* used for loads and stores only */
 
+        /* Moves and zero idioms don't wait for, or replay with, their sources */
+        if unlikely (elim & (RENAME_ELIM_MOVE|RENAME_ELIM_ZERO)) {
+            rob.operands[RA] = rob.operands[RS];
+            rob.operands[RB] = rob.operands[RS];
+            rob.operands[RC] = rob.operands[RS];
+        }
+
+        /* The stack update waits like any uop (a sync) if rsp is not known */
+        if unlikely ((elim == RENAME_ELIM_STACK) &&
+                !(rob.operands[RA]->ready() && rob.operands[RA]->valid())) {
+            thread_stats.frontend.eliminated.stack_sync++;
+            elim = 0;
+        }
+
 
         // See notes above on Physical Register Recycling Complications
         foreach (i, MAX_OPERANDS) {
@@ -934,21 +1306,29 @@ void ThreadContext::rename() {
           */
 
         /* For assignment only: */
-        assert(bit(acceptable_phys_reg_files, phys_reg_file));
+        assert((elim == RENAME_ELIM_MOVE) || bit(acceptable_phys_reg_files, phys_reg_file));
 
         /*
          *  Allocate the physical register
          */
 
-        physreg = core.physregfiles[phys_reg_file].alloc(threadid);
-        assert(physreg);
-        physreg->flags = FLAG_WAIT;
-        physreg->data = 0xdeadbeefdeadbeefULL;
-        physreg->rob = &rob;
-        physreg->archreg = rob.uop.rd;
-        rob.physreg = physreg;
+        if unlikely (elim == RENAME_ELIM_MOVE) {
+            /* Source's register, this entry holds a reference until commit or annul */
+            physreg = specrrt[transop.rb];
+            physreg->addref(rob, threadid);
+            rob.move_eliminated = 1;
+            rob.physreg = physreg;
+        } else {
+            physreg = core.physregfiles[phys_reg_file].alloc(threadid);
+            assert(physreg);
+            physreg->flags() = FLAG_WAIT;
+            physreg->data() = 0xdeadbeefdeadbeefULL;
+            physreg->rob = &rob;
+            physreg->archreg = rob.uop.rd;
+            rob.physreg = physreg;
 
-		thread_stats.physreg_writes[physreg->rfid]++;
+            thread_stats.physreg_writes[physreg->rfid]++;
+        }
 
         bool renamed_reg = 0;
         bool renamed_flags = 0;
@@ -1008,9 +1388,19 @@ void ThreadContext::rename() {
         thread_stats.frontend.renamed.flags += ((!renamed_reg) && (renamed_flags));
         thread_stats.frontend.renamed.flags += ((!renamed_reg) && (renamed_flags));
 		thread_stats.rename_table_writes += ((renamed_reg) || (renamed_flags));
-        rob.changestate(rob_frontend_list);
+        if unlikely (elim) {
+            thread_stats.frontend.eliminated.move += (elim == RENAME_ELIM_MOVE);
+            thread_stats.frontend.eliminated.zero += (elim == RENAME_ELIM_ZERO);
+            thread_stats.frontend.eliminated.stack += (elim == RENAME_ELIM_STACK);
+            execute_at_rename(rob);
+        } else {
+            rob.changestate(rob_frontend_list);
+        }
+        rob.trace_stage(TRACE_UOP_RENAME, rob.index());
 
-        prepcount++;
+        thread_stats.frontend.fused.macro += (transop.desc.fused == FUSION_MACRO);
+        thread_stats.frontend.fused.micro += (transop.desc.fused == FUSION_MICRO);
+        prepcount += (!transop.desc.fused);
     }
 
     thread_stats.frontend.width[prepcount]++;
@@ -1173,7 +1563,7 @@ static inline int find_random_set_bit(W32 v, int randsource) {
 }
 
 static inline int find_first_set_bit(W32 v) {
-    return (v & (-v));
+    return lsbindex32(v);
 }
 
 /**
@@ -1241,10 +1631,10 @@ bool ReorderBufferEntry::find_sources() {
     ThreadContext& thread = getthread();
 
 #ifndef MULTI_IQ
-    assert(thread.issueq_count >= 0 && thread.issueq_count <= ISSUE_QUEUE_SIZE);
+    assert(thread.issueq_count >= 0 && thread.issueq_count <= MAX_ISSUE_QUEUE_SIZE);
     thread.issueq_count++;
 #else
-    assert(thread.issueq_count[cluster] >= 0 && thread.issueq_count[cluster] <= ISSUE_QUEUE_SIZE*4);
+    assert(thread.issueq_count[cluster] >= 0 && thread.issueq_count[cluster] <= MAX_ISSUE_QUEUE_SIZE*4);
     thread.issueq_count[cluster]++;
 #endif
 
@@ -1253,6 +1643,13 @@ bool ReorderBufferEntry::find_sources() {
     return operands_still_needed;
 }
 
+/**
+ * @brief Pick the cluster whose issue queue gets this uop with the core's
+ * 'cluster_steering' policy
+ *
+ * @return cluster, -1 if the issue queues of all clusters it can execute on
+ * are full
+ */
 int ReorderBufferEntry::select_cluster() {
 
     if (MAX_CLUSTERS == 1) {
@@ -1261,22 +1658,37 @@ int ReorderBufferEntry::select_cluster() {
         return (cluster_issue_queue_avail_count[0] > 0) ? 0 : -1;
     }
 
+    OooCore& core = getcore();
+    ThreadContext& thread = getthread();
     W32 executable_on_cluster = executable_on_cluster_mask;
 
     int cluster_operand_tally[MAX_CLUSTERS];
+    int operands_pending = 0;
     foreach (i, MAX_CLUSTERS) { cluster_operand_tally[i] = 0; }
     foreach (i, MAX_OPERANDS) {
         PhysicalRegister& r = *operands[i];
-        if ((&r) && ((r.state == PHYSREG_WAITING) || (r.state == PHYSREG_BYPASS)) && (r.rob->cluster >= 0)) cluster_operand_tally[r.rob->cluster]++;
+        if ((&r) && ((r.state == PHYSREG_WAITING) || (r.state == PHYSREG_BYPASS)) && (r.rob->cluster >= 0)) {
+            cluster_operand_tally[r.rob->cluster]++;
+            operands_pending++;
+        }
     }
 
     assert(executable_on_cluster);
 
+    /* Cluster of most producers this uop can run on, full or not */
+    int producer = -1;
+    foreach (i, MAX_CLUSTERS) {
+        if (bit(executable_on_cluster, i) && (cluster_operand_tally[i] > 0) &&
+                ((producer < 0) || (cluster_operand_tally[i] > cluster_operand_tally[producer]))) {
+            producer = i;
+        }
+    }
+
     /* If a given cluster's issue queue is full, try another cluster: */
     int cluster_issue_queue_avail_count[MAX_CLUSTERS];
     W32 cluster_issue_queue_avail_mask = 0;
 
-    getcore().sched_get_all_issueq_free_slots(cluster_issue_queue_avail_count);
+    core.sched_get_all_issueq_free_slots(cluster_issue_queue_avail_count);
 
     foreach (i, MAX_CLUSTERS) {
         cluster_issue_queue_avail_mask |= ((cluster_issue_queue_avail_count[i] > 0) << i);
@@ -1288,17 +1700,54 @@ int ReorderBufferEntry::select_cluster() {
         return -1;
     }
 
+    int policy = core.cluster_steering;
+    if (policy == CLUSTER_STEERING_CRITICAL) {
+        bool critical = thread.criticality.critical(uop.rip.rip);
+        thread.thread_stats.dispatch.steering.critical += critical;
+        policy = (critical) ? CLUSTER_STEERING_DEPENDENCE : -1;
+    }
+
     int n = 0;
     int cluster = find_first_set_bit(executable_on_cluster);
 
-    foreach (i, MAX_CLUSTERS) {
-        if ((cluster_operand_tally[i] > n) && bit(executable_on_cluster, i)) {
-            n = cluster_operand_tally[i];
-            cluster = i;
+    if (policy == CLUSTER_STEERING_OPERANDS) {
+        foreach (i, MAX_CLUSTERS) {
+            if ((cluster_operand_tally[i] > n) && bit(executable_on_cluster, i)) {
+                n = cluster_operand_tally[i];
+                cluster = i;
+            }
+        }
+    } else if ((policy == CLUSTER_STEERING_DEPENDENCE) && (producer >= 0) &&
+            bit(executable_on_cluster, producer)) {
+        cluster = producer;
+    } else {
+        /*
+         * Balanced policy weighs pending operands against free slots, the
+         * others fall back to the least loaded cluster
+         */
+        int bias = (policy == CLUSTER_STEERING_BALANCED) ? core.steering_bias : 0;
+        int best = -1;
+        foreach (i, MAX_CLUSTERS) {
+            if (!bit(executable_on_cluster, i)) continue;
+            int score = cluster_issue_queue_avail_count[i] + bias * cluster_operand_tally[i];
+            if (score > best) {
+                best = score;
+                cluster = i;
+            }
         }
     }
 
-    ThreadContext& thread = getthread();
+    int most_free = cluster_issue_queue_avail_count[0];
+    int least_free = cluster_issue_queue_avail_count[0];
+    foreach (i, MAX_CLUSTERS) {
+        most_free = max(most_free, cluster_issue_queue_avail_count[i]);
+        least_free = min(least_free, cluster_issue_queue_avail_count[i]);
+    }
+
+    thread.thread_stats.dispatch.steering.local_operands += cluster_operand_tally[cluster];
+    thread.thread_stats.dispatch.steering.intercluster_operands += operands_pending - cluster_operand_tally[cluster];
+    thread.thread_stats.dispatch.steering.producer_full += ((producer >= 0) && !bit(executable_on_cluster, producer));
+    thread.thread_stats.dispatch.steering.imbalance += most_free - least_free;
     thread.thread_stats.dispatch.cluster[cluster]++;
 
 
@@ -1315,7 +1764,8 @@ int ThreadContext::dispatch() {
 
     ReorderBufferEntry* rob;
     foreach_list_mutable(rob_ready_to_dispatch_list, rob, entry, nextentry) {
-        if unlikely (core.dispatchcount >= DISPATCH_WIDTH) break;
+        bool fused = rob->uop.desc.fused;
+        if unlikely ((core.dispatchcount >= DISPATCH_WIDTH) && (!fused)) break;
 
         /* All operands start out as valid, then get put on wait queues if they are not actually ready. */
 
@@ -1379,7 +1829,8 @@ int ThreadContext::dispatch() {
             rob->changestate(rob->get_ready_to_issue_list());
         }
 
-        core.dispatchcount++;
+        rob->trace_stage(TRACE_UOP_DISPATCH, rob->cluster);
+        core.dispatchcount += (!fused);
 
 		if unlikely (opclassof(rob->uop.opcode) == OPCLASS_FP)
 			CORE_STATS(iq_fp_writes)++;
@@ -1420,30 +1871,58 @@ int ThreadContext::dispatch() {
   */
 int ThreadContext::complete(int cluster) {
 
-    int completecount = 0;
-    ReorderBufferEntry* rob;
-
-
     /*
-     * Check the list of issued ROBs. If a given ROB is complete (i.e., is ready
-     * for writeback and forwarding), move it to rob_completed_list.
+     * Only the ROBs whose latency runs out on this tick are visited;
+     * everything else on rob_issued_list stays untouched. The bucket is
+     * in scheduling order, which is also rob_issued_list order.
      */
 
-    foreach_list_mutable(rob_issued_list[cluster], rob, entry, nextentry) {
-        rob->cycles_left--;
+    W64 now = ++complete_tick[cluster];
+    dynarray<CompletionEvent>& bucket = completion_wheel[cluster][now % COMPLETION_WHEEL_SIZE];
 
-        if unlikely (rob->cycles_left <= 0) {
-            rob->changestate(rob_completed_list[cluster]);
-            rob->physreg->complete();
-            rob->forward_cycle = 0;
-            rob->fu = 0;
-            completecount++;
+    int kept = 0;
+    foreach (i, bucket.length) {
+        CompletionEvent& event = bucket[i];
+        ReorderBufferEntry* rob = event.rob;
+
+        if unlikely ((rob->complete_seq != event.seq) ||
+                (rob->current_state_list != &rob_issued_list[cluster])) continue;
+
+        /* Due on a later turn of the wheel */
+        if unlikely (event.tick != now) {
+            bucket[kept++] = event;
+            continue;
         }
+
+        rob->cycles_left = 0;
+        rob->changestate(rob_completed_list[cluster]);
+        rob->trace_stage(TRACE_UOP_COMPLETE);
+        rob->physreg->complete();
+        rob->forward_cycle = 0;
+        rob->fu = 0;
     }
 
+    bucket.resize(kept);
+
     return 0;
 }
 
+/**
+ * @brief Schedule an ROB that just entered rob_issued_list to complete
+ * once its cycles_left has elapsed
+ *
+ * @param rob ROB entry with cycles_left set
+ */
+void ThreadContext::schedule_completion(ReorderBufferEntry& rob) {
+    int cluster = rob.cluster;
+    CompletionEvent event;
+    event.rob = &rob;
+    event.tick = complete_tick[cluster] + max((int)rob.cycles_left, 1);
+    event.seq = ++completion_seq;
+    rob.complete_seq = event.seq;
+    completion_wheel[cluster][event.tick % COMPLETION_WHEEL_SIZE].push(event);
+}
+
 /**
  * @brief Process ROBs in flight between completion and global
  * forwarding/writeback.
@@ -1454,8 +1933,8 @@ int ThreadContext::complete(int cluster) {
  */
 int ThreadContext::transfer(int cluster) {
 
-    ReorderBufferEntry* rob;
-    foreach_list_mutable(rob_completed_list[cluster], rob, entry, nextentry) {
+    foreach_state_member(rob_completed_list[cluster], ROB.head, i) {
+        ReorderBufferEntry* rob = &ROB[i];
         rob->forward();
         rob->forward_cycle++;
         if unlikely (rob->forward_cycle > MAX_FORWARDING_LATENCY) {
@@ -1470,7 +1949,8 @@ int ThreadContext::transfer(int cluster) {
 }
 
 /**
- * @brief Writeback at most WRITEBACK_WIDTH ROBs on rob_ready_to_writeback_list.
+ * @brief Writeback at most WRITEBACK_WIDTH ROBs on rob_ready_to_writeback_list,
+ * oldest first.
  *
  * @param cluster
  *
@@ -1479,10 +1959,11 @@ int ThreadContext::transfer(int cluster) {
 int ThreadContext::writeback(int cluster) {
 
     int wakeupcount = 0;
-    ReorderBufferEntry* rob;
-    foreach_list_mutable(rob_ready_to_writeback_list[cluster], rob, entry, nextentry) {
+    foreach_state_member(rob_ready_to_writeback_list[cluster], ROB.head, i) {
         if unlikely (core.writecount >= WRITEBACK_WIDTH) break;
 
+        ReorderBufferEntry* rob = &ROB[i];
+
         /*
          * Gather statistics
          */
@@ -1522,6 +2003,7 @@ int ThreadContext::writeback(int cluster) {
         rob->physreg->writeback();
         rob->cycles_left = -1;
         rob->changestate(rob_ready_to_commit_queue);
+        rob->trace_stage(TRACE_UOP_WRITEBACK);
 
 		thread_stats.physreg_writes[rob->physreg->rfid]++;
     }
@@ -1606,27 +2088,100 @@ int ThreadContext::commit() {
       */
 
     int rc = COMMIT_RESULT_OK;
+    int committed = 0;
+
+    topdown_blocker = NULL;
 
     foreach_forward(ROB, i) {
         ReorderBufferEntry& rob = ROB[i];
 
-        if unlikely (core.commitcount >= COMMIT_WIDTH) break;
+        /* Fused uops retire in the slot of the uop before them */
+        bool fused = rob.uop.desc.fused;
+        if unlikely ((core.commitcount >= COMMIT_WIDTH) && (!fused)) break;
+        W64 uuid = rob.uop.uuid;
+        W64 rip = rob.uop.rip.rip;
         rc = rob.commit();
         if likely (rc == COMMIT_RESULT_OK) {
-            core.commitcount++;
+            core.commitcount += (!fused);
+            committed += (!fused);
             last_commit_at_cycle = sim_cycle;
-			thread_stats.rob_reads++;
+
+            if unlikely (topdown_refill && uuid >= topdown_refill_uuid)
+                topdown_refill = 0;
+            if unlikely (topdown_hotspots.enabled && !fused)
+                topdown_hotspots.add(rip, TOPDOWN_RETIRING, 1);
         } else {
             break;
         }
     }
 
+    thread_stats.rob_reads += committed;
     CORE_STATS(commit.width)[core.commitcount]++;
+    topdown_account(rc, committed);
 
 
     return rc;
 }
 
+/**
+ * @brief Charge this cycle's commit slots to their top-down category
+ *
+ * @param rc Result of the last ROB entry commit tried
+ * @param committed Commit slots used by this thread in this cycle, fused
+ *        uops take none
+ */
+void ThreadContext::topdown_account(int rc, int committed) {
+    /* A spin wait is accounted in thread_stats.spin */
+    if unlikely (spin.waiting) return;
+
+    Core::TopDownStats& stats = thread_stats.topdown;
+    stats.slots += COMMIT_WIDTH;
+    stats.bound[TOPDOWN_RETIRING] += committed;
+
+    int lost = COMMIT_WIDTH - committed;
+    if (!lost) return;
+
+    ReorderBufferEntry* rob = topdown_blocker;
+    int category = TOPDOWN_CORE;
+
+    /* A dispatched uop holding back commit is on the critical path */
+    if (rob && rob->cluster >= 0) rob->blocked_commit = 1;
+
+    if (core.commitcount >= COMMIT_WIDTH) {
+        /* Slots used by the other threads of the core */
+        category = TOPDOWN_CORE;
+    } else if (rc != COMMIT_RESULT_OK && rc != COMMIT_RESULT_NONE) {
+        /* Exception, barrier, SMC or interrupt, the pipeline is flushed */
+        category = TOPDOWN_BAD_SPECULATION;
+    } else if (!rob || rob->current_state_list == &rob_frontend_list ||
+            rob->current_state_list == &rob_ready_to_dispatch_list) {
+        category = (topdown_refill) ? TOPDOWN_BAD_SPECULATION :
+            TOPDOWN_FRONTEND;
+    } else if (rob->current_state_list == &rob_cache_miss_list) {
+        /* Charged to a level once the data arrives, see load_wakeup() */
+        category = TOPDOWN_MEMORY;
+        rob->topdown_miss_slots += lost;
+    } else if (rob->current_state_list == &rob_tlb_miss_list ||
+            rob->current_state_list == &rob_memory_fence_list ||
+            rob->current_state_list == &rob_ready_to_commit_queue) {
+        /* TLB walks, fences and stores waiting for the cache */
+        category = TOPDOWN_MEMORY;
+    } else if (rob->lsq && rob->cluster >= 0 &&
+            (rob->current_state_list == &rob_issued_list[rob->cluster] ||
+             rob->current_state_list == &rob_ready_to_load_list[rob->cluster])) {
+        /* Load or store in the L1 pipeline */
+        category = TOPDOWN_MEMORY;
+        stats.memory[TOPDOWN_MEM_L1] += lost;
+    }
+
+    stats.bound[category] += lost;
+
+    if unlikely (topdown_hotspots.enabled) {
+        W64 rip = (rob) ? rob->uop.rip.rip : ctx.get_cs_eip();
+        topdown_hotspots.add(rip, category, lost);
+    }
+}
+
 void ThreadContext::flush_mem_lock_release_list(int start) {
     for (int i = start; i < queued_mem_lock_release_count; i++) {
         W64 lockaddr = queued_mem_lock_release_list[i];
@@ -1758,12 +2313,16 @@ int ReorderBufferEntry::commit() {
      * asynchronous interrupts are only taken after committing or excepting the
      * EOM uop in a macro-op.
      *
+     * So the other uops of a macro-op are at the head of the ROB only after
+     * the scan from its SOM uop found all of them ready and exception-free,
+     * which they stay: they commit without scanning the macro-op again.
+     *
      */
 
-    bool found_eom = 0;
+    bool found_eom = !uop.som;
     ReorderBufferEntry* cant_commit_subrob = NULL;
 
-    foreach_forward_from(thread.ROB, this, j) {
+    if likely (uop.som) foreach_forward_from(thread.ROB, this, j) {
         ReorderBufferEntry& subrob = thread.ROB[j];
 
         found_eom |= subrob.uop.eom;
@@ -1774,13 +2333,13 @@ int ReorderBufferEntry::commit() {
         }
 
         if unlikely ((subrob.uop.is_sse|subrob.uop.is_x87) && ((ctx.cr[0] & CR0_TS_MASK) | (subrob.uop.is_x87 & (ctx.cr[0] & CR0_EM_MASK)))) {
-            subrob.physreg->data = EXCEPTION_FloatingPointNotAvailable;
-            subrob.physreg->flags = FLAG_INV;
+            subrob.physreg->data() = EXCEPTION_FloatingPointNotAvailable;
+            subrob.physreg->flags() = FLAG_INV;
             if unlikely (subrob.lsq) subrob.lsq->invalid = 1;
         }
 
         if unlikely (subrob.ready_to_commit() &&
-                (subrob.physreg->flags & FLAG_INV) &&
+                (subrob.physreg->flags() & FLAG_INV) &&
                 (subrob.uop.opcode != OP_ast)) {
 
             /*
@@ -1792,8 +2351,8 @@ int ReorderBufferEntry::commit() {
              *  the first exception in uop order.
              *
              */
-            ctx.exception = LO32(subrob.physreg->data);
-            ctx.error_code = HI32(subrob.physreg->data);
+            ctx.exception = LO32(subrob.physreg->data());
+            ctx.error_code = HI32(subrob.physreg->data());
 
             /* Capture the faulting virtual address for page faults */
             if ((ctx.exception == EXCEPTION_PageFaultOnRead) |
@@ -1821,6 +2380,7 @@ int ReorderBufferEntry::commit() {
 
     if unlikely (!all_ready_to_commit && cant_commit_subrob != NULL) {
             thread.thread_stats.commit.result.none++;
+            thread.topdown_blocker = cant_commit_subrob;
 
             if(cant_commit_subrob->current_state_list == &getthread().rob_free_list) {
                     thread.thread_stats.commit.fail.free_list++;
@@ -1830,6 +2390,10 @@ int ReorderBufferEntry::commit() {
                     thread.thread_stats.commit.fail.ready_to_dispatch_list++;
             } else if (cant_commit_subrob->current_state_list == &getthread().rob_cache_miss_list) {
                     thread.thread_stats.commit.fail.cache_miss_list++;
+
+                    /* The miss now holds up commit, serve it before the rest */
+                    Memory::MemoryRequest *request = cant_commit_subrob->mem_request.get();
+                    if (request) request->set_priority(Memory::PRIORITY_CRITICAL);
             } else if (cant_commit_subrob->current_state_list == &getthread().rob_tlb_miss_list) {
                     thread.thread_stats.commit.fail.tlb_miss_list++;
             } else if (cant_commit_subrob->current_state_list == &getthread().rob_memory_fence_list) {
@@ -1861,8 +2425,8 @@ int ReorderBufferEntry::commit() {
 
     if(logable(5)) {
         ptl_logfile << "Committing ROB entry: ", *this,
-                    " destreg_value:", hexstring(physreg->data, 64),
-                    " destflags: ", hexstring(physreg->flags, 16),
+                    " destreg_value:", hexstring(physreg->data(), 64),
+                    " destflags: ", hexstring(physreg->flags(), 16),
                     " flagmask: ", hexstring(uop.setflags, 16),
                     endl;
     }
@@ -1880,6 +2444,7 @@ int ReorderBufferEntry::commit() {
     if(st && !core.memoryHierarchy->is_cache_available(core.get_coreid(), threadid, false/* icache */)){
         msdebug << " dcache can not write. core:", core.get_coreid(), " threadid ", threadid, endl;
         thread.thread_stats.commit.result.dcache_stall++;
+        thread.topdown_blocker = this;
         return COMMIT_RESULT_NONE;
     }
 
@@ -1904,24 +2469,21 @@ int ReorderBufferEntry::commit() {
 
     /*
      *
-     *  Check for self modifying code (SMC) by checking if any previous
-     *  instruction has dirtied the page(s) on which the current instruction
-     *  resides. The SMC check is done first since it's perfectly legal for a
-     *  store to overwrite its own instruction bytes, but this update only
-     *  becomes visible after the store has committed.
+     *  Check for self modifying code (SMC): a committed store that wrote
+     *  a 64 byte line holding decoded code flushes the pipeline at the
+     *  start of the next x86 instruction. The SMC check is done first since
+     *  it's perfectly legal for a store to overwrite its own instruction
+     *  bytes, but this update only becomes visible after the store has
+     *  committed.
      *
      */
-    if unlikely (thread.ctx.smc_isdirty(uop.rip.mfnlo)) {
+    if unlikely (thread.smc_invalidate_pending && uop.som) {
 
          /*
-          * Invalidate the pages only after the pipeline is flushed: we may still
-          * hold refs to the affected basic blocks in the pipeline. Queue the
-          * updates for later.
+          * Invalidate the lines only after the pipeline is flushed: we may
+          * still hold refs to the affected basic blocks in the pipeline.
           */
 
-        thread.smc_invalidate_pending = 1;
-        thread.smc_invalidate_rvp = uop.rip;
-
         thread.thread_stats.commit.result.smc++;
         return COMMIT_RESULT_SMC;
     }
@@ -1957,6 +2519,7 @@ int ReorderBufferEntry::commit() {
 
         if unlikely (!lock) {
             thread.thread_stats.commit.result.memlocked++;
+            thread.topdown_blocker = this;
             return COMMIT_RESULT_NONE;
         }
     }
@@ -2027,7 +2590,7 @@ int ReorderBufferEntry::commit() {
 
     if (st) assert(lsq->addrvalid && lsq->datavalid);
 
-    if (ld) physreg->data = lsq->data;
+    if (ld) physreg->data() = lsq->data;
 
     // FIXME : Check if we really need to merge the load with existing register
 #if 0
@@ -2036,9 +2599,9 @@ int ReorderBufferEntry::commit() {
     if(ld | st) {
         merged_data = mux64(
                 expand_8bit_to_64bit_lut[lsq->bytemask],
-                old_data, physreg->data);
+                old_data, physreg->data());
     } else {
-        merged_data = physreg->data;
+        merged_data = physreg->data();
     }
 #endif
 
@@ -2074,7 +2637,9 @@ int ReorderBufferEntry::commit() {
         thread.commitrrt[uop.rd]->addcommitref(uop.rd, thread.threadid);
 
         if likely (uop.rd < ARCHREG_COUNT) {
-            ctx.set_reg(uop.rd, physreg->data);
+            ctx.set_reg(uop.rd, physreg->data());
+            if unlikely (config.checker_enabled && !ctx.kernel_mode)
+                checker_written_reg(uop.rd, physreg->data());
         }
 
 		if unlikely (opclassof(uop.opcode) == OPCLASS_FP)
@@ -2092,22 +2657,22 @@ int ReorderBufferEntry::commit() {
             assert(isbranch(uop.opcode));
 
             if(logable(10))
-                ptl_logfile << "destination is REG_rip : ", physreg->data, endl, flush;
+                ptl_logfile << "destination is REG_rip : ", physreg->data(), endl, flush;
 
-            if(uop.riptaken != physreg->data) {
+            if(uop.riptaken != physreg->data()) {
                 if(logable(6)) {
                     ptl_logfile << "branch misprediction: assumed-rip: ",
-                                uop.riptaken, " actual-rip: ", physreg->data,
+                                uop.riptaken, " actual-rip: ", physreg->data(),
                                 endl;
                 }
                 /* Annul the remaining ROB entries and fetch new code */
                 thread.annul_fetchq();
                 annul_after();
-                thread.reset_fetch_unit(physreg->data);
+                thread.reset_fetch_unit(physreg->data());
                 thread.thread_stats.issue.result.branch_mispredict++;
             }
-            assert(physreg->data);
-            ctx.eip = physreg->data;
+            assert(physreg->data());
+            ctx.eip = physreg->data();
         } else {
             assert(!isbranch(uop.opcode));
             ctx.eip += uop.bytes;
@@ -2120,7 +2685,7 @@ int ReorderBufferEntry::commit() {
         /* If Assist opcode, it might have updated the Interrupt flag */
         if(uop.opcode == OP_ast)
             flagmask |= IF_MASK;
-        ctx.reg_flags = (ctx.reg_flags & ~flagmask) | (physreg->flags & flagmask);
+        ctx.reg_flags = (ctx.reg_flags & ~flagmask) | (physreg->flags() & flagmask);
 
         thread.thread_stats.commit.setflags.no += (uop.setflags == 0);
         thread.thread_stats.commit.setflags.yes += (uop.setflags != 0);
@@ -2142,15 +2707,18 @@ int ReorderBufferEntry::commit() {
         }
     }
 
+    if unlikely (uop.opcode == OP_ast && !ctx.kernel_mode &&
+            config.checker_enabled) {
+        /* Assists change the context outside of uop destinations */
+        checker_mark_sync();
+    }
+
     if unlikely (uop.eom && !ctx.kernel_mode && config.checker_enabled) {
         bool mmio = (lsq != NULL) ? lsq->mmio : false;
-        if likely (!isclass(uop.opcode, OPCLASS_BARRIER) &&
-                uop.rip.rip != ctx.eip && !mmio) {
-            execute_checker();
-            compare_checker(ctx.cpu_index, setflags_to_x86_flags[uop.setflags]);
-        } else {
-            clear_checker();
-        }
+        bool checkable = !isclass(uop.opcode, OPCLASS_BARRIER) &&
+            uop.rip.rip != ctx.eip && !mmio;
+        checker_commit_insn(ctx.cpu_index, uop.rip.rip, checkable,
+                checker_stores_count || uop.opcode == OP_st);
     }
 
     if unlikely (!config.checker_enabled && config.checker_start_rip == uop.rip.rip) {
@@ -2163,6 +2731,13 @@ int ReorderBufferEntry::commit() {
     if unlikely (uop.opcode == OP_st) {
         thread.ctx.smc_setdirty(lsq->physaddr << 3);
 
+        if unlikely (core.machine.spin_waits.count())
+            core.machine.spin_line_changed(lsq->physaddr << 3);
+
+        if unlikely (!uop.internal &&
+                bbcache_of(thread.ctx.cpu_index).smc_store(lsq->physaddr << 3))
+            thread.smc_invalidate_pending = 1;
+
         if(uop.internal) {
             thread.ctx.store_internal(lsq->virtaddr, lsq->data,
                     lsq->bytemask);
@@ -2174,15 +2749,21 @@ int ReorderBufferEntry::commit() {
               */
             assert(lsq->physaddr);
 
-            Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
-            assert(request != NULL);
+            if unlikely (pc_profile_enabled)
+                core.pc_profile.access(uop.rip.rip);
 
-            request->init(core.get_coreid(), threadid, lsq->physaddr << 3, 0,
-                    sim_cycle, false, uop.rip.rip, uop.uuid,
-                    Memory::MEMORY_OP_WRITE);
-            request->set_coreSignal(&core.dcache_signal);
+            /* With -far-atomics the locked load did the write at the shared cache */
+            if likely (!(uop.locked && core.memoryHierarchy->far_atomics_enabled())) {
+                Memory::MemoryRequest *request = core.memoryHierarchy->get_free_request(core.get_coreid());
+                assert(request != NULL);
 
-            assert(core.memoryHierarchy->access_cache(request));
+                request->init(core.get_coreid(), threadid, lsq->physaddr << 3, 0,
+                        sim_cycle, false, uop.rip.rip, uop.uuid,
+                        Memory::MEMORY_OP_WRITE);
+                request->set_coreSignal(&core.dcache_signal);
+
+                assert(core.memoryHierarchy->access_cache(request));
+            }
             assert(lsq->virtaddr > 0xfff);
             if(config.checker_enabled && !ctx.kernel_mode) {
                 add_checker_store(lsq, uop.size);
@@ -2193,30 +2774,55 @@ int ReorderBufferEntry::commit() {
         }
     }
 
-    if(uop.eom && !ctx.kernel_mode && config.checker_enabled && is_checker_valid()) {
+    if(uop.eom && !ctx.kernel_mode && config.checker_enabled) {
+        /* Checker ran up to this instruction in checker_commit_insn() */
+        bool valid = is_checker_valid();
         foreach(i, checker_stores_count) {
-            thread.ctx.check_store_virt(checker_stores[i].virtaddr,
-                    checker_stores[i].data, checker_stores[i].bytemask,
-                    checker_stores[i].sizeshift);
+            if(valid) {
+                thread.ctx.check_store_virt(checker_stores[i].virtaddr,
+                        checker_stores[i].data, checker_stores[i].bytemask,
+                        checker_stores[i].sizeshift);
+            } else {
+                thread.ctx.storemask_virt(checker_stores[i].virtaddr,
+                        checker_stores[i].data, checker_stores[i].bytemask,
+                        checker_stores[i].sizeshift);
+            }
         }
         reset_checker_stores();
     }
 
+    if unlikely (uoptrace_capturing) {
+        W64 addr = (ld|st) ? (lsq->physaddr << 3) : br ? physreg->data() : 0;
+        uoptrace_capture(core.get_coreid(), threadid, uop, uop.rip.rip,
+                uop.desc.latency, uop.predinfo.bptype, addr);
+    }
+
      /*
       * Free physical registers, load/store queue entries, etc.
       */
 
     if unlikely (ld|st) {
-        assert(lsq->data == physreg->data);
+        if unlikely (config.spin_fast_forward) {
+            if (st) thread.spin.store();
+            else thread.spin.load(lsq->physaddr << 3);
+        }
+
+        assert(lsq->data == physreg->data());
         thread.loads_in_flight -= (lsq->store == 0);
         thread.stores_in_flight -= (lsq->store == 1);
+        thread.lsq_filter.remove(*lsq);
         lsq->reset();
         thread.LSQ.commit(lsq);
         core.set_unaligned_hint(uop.rip, uop.ld_st_truly_unaligned);
     }
 
+    thread.branches_in_flight -= br;
+
     assert(archdest_can_commit[uop.rd]);
-    assert(oldphysreg->state == PHYSREG_ARCH);
+    /* With move elimination other arch registers may still map a pending free one */
+    assert((oldphysreg->state == PHYSREG_ARCH) ||
+            ((core.rename_elim & RENAME_ELIM_MOVE) &&
+             (oldphysreg->state == PHYSREG_PENDINGFREE)));
 
     if likely (oldphysreg->nonnull()) {
         if unlikely (oldphysreg->referenced()) {
@@ -2246,6 +2852,12 @@ int ReorderBufferEntry::commit() {
         operands[i]->unref(*this, thread.threadid);
     }
 
+    /* The commit RRT now holds the shared register of an eliminated move */
+    if unlikely (move_eliminated) physreg->unref(*this, thread.threadid);
+
+    if unlikely (thread.core.cluster_steering == CLUSTER_STEERING_CRITICAL)
+        thread.criticality.train(uop.rip.rip, blocked_commit);
+
      /*
       * Update branch prediction
       */
@@ -2266,10 +2878,28 @@ int ReorderBufferEntry::commit() {
         thread.thread_stats.branchpred.updates++;
     }
 
+    trace_stage(TRACE_UOP_COMMIT);
+
     if likely (uop.eom) {
         total_insns_committed++;
         thread.thread_stats.commit.insns++;
         thread.total_insns_committed++;
+        thread.core.committed_insns++;
+        ptltrace(thread.trace_id, TRACE_OOO_COMMIT, uop.rip.rip, uop.uuid);
+        if unlikely (state_hash_enabled)
+            state_hash_commit(ctx.cpu_index, uop.rip.rip);
+
+        /* Younger uops of a spinning thread only repeat the loop */
+        if unlikely (config.spin_fast_forward && isbranch(uop.opcode) &&
+                thread.spin.taken_branch(uop.rip.rip, ctx.eip,
+                    (W64*)ctx.regs, ctx.reg_flags,
+                    thread.total_insns_committed, thread.total_uops_committed,
+                    sim_cycle)) {
+            thread.annul_fetchq();
+            annul_after();
+            thread.reset_fetch_unit(ctx.eip);
+            thread.spin_wait();
+        }
 
 #ifdef TRACE_RIP
             ptl_rip_trace << "commit_rip: ",
@@ -2307,6 +2937,7 @@ int ReorderBufferEntry::commit() {
 
     if unlikely (uop_is_eom & thread.handle_interrupt_at_next_eom) {
         thread.handle_interrupt_at_next_eom = 0;
+        thread.events.recheck();
         return COMMIT_RESULT_INTERRUPT;
     }
 
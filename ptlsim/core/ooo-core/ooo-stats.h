@@ -16,6 +16,9 @@
 #include <statsBuilder.h>
 #include <ooo-const.h>
 #include <decode.h>
+#include <spinloop.h>
+#include <topdown.h>
+#include <pagewalk.h>
 
 namespace OOO_CORE_MODEL {
 
@@ -54,18 +57,63 @@ namespace OOO_CORE_MODEL {
             StatArray<W64, OPCLASS_COUNT> opclass;
             StatArray<W64, FETCH_WIDTH+1> width;
 
+            struct uop_cache : public Statable
+            {
+                StatObj<W64> hits;
+                StatObj<W64> misses;
+
+                uop_cache(Statable *parent)
+                    : Statable("uop_cache", parent)
+                      , hits("hits", this)
+                      , misses("misses", this)
+                {}
+            } uop_cache;
+
+            /* Fetch directed instruction prefetch, with 'fdip_depth' set */
+            struct fdip : public Statable
+            {
+                /* Blocks queued, fetched in queue order, or not */
+                StatObj<W64> blocks;
+                StatObj<W64> followed;
+                StatObj<W64> diverged;
+                /* Prefetches sent, and those already in the icache buffer */
+                StatObj<W64> issued;
+                StatObj<W64> redundant;
+                /* Fetches of a prefetched line that came in or was in flight */
+                StatObj<W64> timely;
+                StatObj<W64> late;
+                /* Prefetched lines replaced before any fetch used them */
+                StatObj<W64> unused;
+
+                fdip(Statable *parent)
+                    : Statable("fdip", parent)
+                      , blocks("blocks", this)
+                      , followed("followed", this)
+                      , diverged("diverged", this)
+                      , issued("issued", this)
+                      , redundant("redundant", this)
+                      , timely("timely", this)
+                      , late("late", this)
+                      , unused("unused", this)
+                {}
+            } fdip;
+
             StatObj<W64> blocks;
             StatObj<W64> uops;
             StatObj<W64> user_insns;
+            StatObj<W64> lsd_uops;
 
             fetch(Statable *parent)
                 : Statable("fetch", parent)
                   , stop(this)
                   , opclass("opclass", this, opclass_names)
                   , width("width", this)
+                  , uop_cache(this)
+                  , fdip(this)
                   , blocks("blocks", this)
                   , uops("uops", this)
                   , user_insns("user_insns", this)
+                  , lsd_uops("lsd_uops", this)
             {}
         } fetch;
 
@@ -125,6 +173,36 @@ namespace OOO_CORE_MODEL {
                 {}
             } alloc;
 
+            /* Uops renamed in the slot of the uop before them */
+            struct fused : public Statable
+            {
+                StatObj<W64> macro;
+                StatObj<W64> micro;
+
+                fused(Statable *parent)
+                    : Statable("fused", parent)
+                      , macro("macro", this)
+                      , micro("micro", this)
+                {}
+            } fused;
+
+            /* Uops removed at rename, see rename_elimination() */
+            struct eliminated : public Statable
+            {
+                StatObj<W64> move;
+                StatObj<W64> zero;
+                StatObj<W64> stack;
+                StatObj<W64> stack_sync;
+
+                eliminated(Statable *parent)
+                    : Statable("eliminated", parent)
+                      , move("move", this)
+                      , zero("zero", this)
+                      , stack("stack", this)
+                      , stack_sync("stack_sync", this)
+                {}
+            } eliminated;
+
             StatArray<W64, FRONTEND_WIDTH+1> width;
             StatArray<W64, 256> consumer_count;
 
@@ -133,6 +211,8 @@ namespace OOO_CORE_MODEL {
                   , status(this)
                   , renamed(this)
                   , alloc(this)
+                  , fused(this)
+                  , eliminated(this)
                   , width("width", this)
                   , consumer_count("consumer_count", this)
             {}
@@ -145,7 +225,7 @@ namespace OOO_CORE_MODEL {
                 StatObj<W64> trigger_uops;
                 StatObj<W64> deadlock_flushes;
                 StatObj<W64> deadlock_uops_flushed;
-                StatArray<W64, ROB_SIZE+1> dependent_uops;
+                StatArray<W64, MAX_ROB_SIZE+1> dependent_uops;
 
                 redispatch(Statable *parent)
                     : Statable("redispatch", parent)
@@ -156,11 +236,36 @@ namespace OOO_CORE_MODEL {
                 {}
             } redispatch;
 
+            /*
+             * Cluster steering, see select_cluster(): operands still waiting
+             * on the chosen and other clusters, uops whose producers' cluster
+             * was full, and the sum of the spread of free issue queue slots
+             * between clusters at each steering
+             */
+            struct steering : public Statable
+            {
+                StatObj<W64> local_operands;
+                StatObj<W64> intercluster_operands;
+                StatObj<W64> producer_full;
+                StatObj<W64> critical;
+                StatObj<W64> imbalance;
+
+                steering(Statable *parent)
+                    : Statable("steering", parent)
+                      , local_operands("local_operands", this)
+                      , intercluster_operands("intercluster_operands", this)
+                      , producer_full("producer_full", this)
+                      , critical("critical", this)
+                      , imbalance("imbalance", this)
+                {}
+            } steering;
+
             StatArray<W64, MAX_CLUSTERS> cluster;
 
             dispatch(Statable *parent)
                 : Statable("dispatch", parent)
                   , redispatch(this)
+                  , steering(this)
                   , cluster("cluster", this, cluster_names)
             {}
         } dispatch;
@@ -367,6 +472,7 @@ namespace OOO_CORE_MODEL {
                     StatObj<W64> exception;
                     StatObj<W64> ordering;
                     StatObj<W64> unaligned;
+                    StatObj<W64> split_batched;
 
                     struct replay : public Statable
                     {
@@ -404,6 +510,7 @@ namespace OOO_CORE_MODEL {
                           , exception("exception", this)
                           , ordering("ordering", this)
                           , unaligned("unaligned", this)
+                          , split_batched("split_batched", this)
                           , replay(this)
                     {}
                 } issue;
@@ -432,6 +539,7 @@ namespace OOO_CORE_MODEL {
                     StatObj<W64> stq_address_not_ready;
                     StatObj<W64> fence;
                     StatObj<W64> mmio;
+                    StatObj<W64> stq_scan_skipped;
 
                         dependency(Statable *parent)
                             : Statable("dependency", parent)
@@ -441,6 +549,7 @@ namespace OOO_CORE_MODEL {
                               , stq_address_not_ready("stq_address_not_ready", this)
                               , fence("fence", this)
                               , mmio("mmio", this)
+                              , stq_scan_skipped("stq_scan_skipped", this)
                     {}
                 } dependency;
 
@@ -504,9 +613,29 @@ namespace OOO_CORE_MODEL {
 
             tlb_stat dtlb;
             tlb_stat itlb;
+            tlb_stat stlb;
+            tlb_stat pwc;
+            Core::TLBSpaceStats tlb_asid;
 
-            StatArray<W64, 1001> dtlb_latency;
-            StatArray<W64, 1001> itlb_latency;
+            StatHistogram<> dtlb_latency;
+            StatHistogram<> itlb_latency;
+
+            /* Loads by the level of the hierarchy that served them */
+            StatArray<W64, Core::TOPDOWN_MEM_COUNT> load_level;
+
+            struct memdep : public Statable
+            {
+                StatObj<W64> violations;
+                StatObj<W64> false_dependences;
+                StatObj<W64> ssit_clears;
+
+                memdep(Statable *parent)
+                    : Statable("memdep", parent)
+                      , violations("violations", this)
+                      , false_dependences("false_dependences", this)
+                      , ssit_clears("ssit_clears", this)
+                {}
+            } memdep;
 
             dcache(Statable *parent)
                 : Statable("dcache", parent)
@@ -515,14 +644,101 @@ namespace OOO_CORE_MODEL {
                   , fence(this)
                   , dtlb("dtlb", this)
                   , itlb("itlb", this)
+                  , stlb("stlb", this)
+                  , pwc("pwc", this)
+                  , tlb_asid("tlb_asid", this)
                   , dtlb_latency("dtlb_latency", this)
                   , itlb_latency("itlb_latency", this)
+                  , load_level("load_level", this, Core::topdown_memory_names)
+                  , memdep(this)
             {}
         } dcache;
 
+        struct smt : public Statable
+        {
+            StatObj<W64> fetch_cycles;
+            StatObj<W64> fetch_gated;
+            StatObj<W64> long_load_flushes;
+            StatObj<W64> rob_partition_full;
+            StatObj<W64> lsq_partition_full;
+            StatObj<W64> rob_occupancy;
+            StatObj<W64> lsq_occupancy;
+            StatEquation<W64, double, StatObjFormulaDiv> fetch_share;
+            StatEquation<W64, double, StatObjFormulaDiv> avg_rob_occupancy;
+            StatEquation<W64, double, StatObjFormulaDiv> avg_lsq_occupancy;
+
+            smt(Statable *parent)
+                : Statable("smt", parent)
+                  , fetch_cycles("fetch_cycles", this)
+                  , fetch_gated("fetch_gated", this)
+                  , long_load_flushes("long_load_flushes", this)
+                  , rob_partition_full("rob_partition_full", this)
+                  , lsq_partition_full("lsq_partition_full", this)
+                  , rob_occupancy("rob_occupancy", this)
+                  , lsq_occupancy("lsq_occupancy", this)
+                  , fetch_share("fetch_share", this)
+                  , avg_rob_occupancy("avg_rob_occupancy", this)
+                  , avg_lsq_occupancy("avg_lsq_occupancy", this)
+            {}
+        } smt;
+
+        /* Runahead pre-execution, with 'runahead_depth' set */
+        struct runahead : public Statable
+        {
+            /*
+             * Episodes, and those stopped at a barrier, an unknown indirect
+             * target or a block not in the basic block cache
+             */
+            StatObj<W64> episodes;
+            StatObj<W64> stopped;
+            StatObj<W64> cycles;
+            /* Uops pre-executed, and those with an INV result */
+            StatObj<W64> uops;
+            StatObj<W64> invalid;
+            /* Loads that found their line in the L1-D or prefetched it */
+            StatObj<W64> hits;
+            StatObj<W64> prefetches;
+            /* Loads of a prefetched line that came in or was in flight */
+            StatObj<W64> timely;
+            StatObj<W64> late;
+            /* Prefetched lines replaced before any load used them */
+            StatObj<W64> unused;
+
+            runahead(Statable *parent)
+                : Statable("runahead", parent)
+                  , episodes("episodes", this)
+                  , stopped("stopped", this)
+                  , cycles("cycles", this)
+                  , uops("uops", this)
+                  , invalid("invalid", this)
+                  , hits("hits", this)
+                  , prefetches("prefetches", this)
+                  , timely("timely", this)
+                  , late("late", this)
+                  , unused("unused", this)
+            {}
+        } runahead;
+
+        /* Time weighted, see StatOccupancy */
+        struct occupancy : public Statable
+        {
+            StatOccupancy rob;
+            StatOccupancy lsq;
+            StatOccupancy iq;
+
+            occupancy(Statable *parent)
+                : Statable("occupancy", parent)
+                  , rob("rob", this)
+                  , lsq("lsq", this)
+                  , iq("iq", this)
+            {}
+        } occupancy;
+
         StatObj<W64> interrupt_requests;
         StatObj<W64> cpu_exit_requests;
         StatObj<W64> cycles_in_pause;
+        Core::SpinLoopStats spin;
+        Core::TopDownStats topdown;
         StatArray<W64, ASSIST_COUNT> assists;
         StatArray<W64, L_ASSIST_COUNT> lassists;
 
@@ -552,9 +768,14 @@ namespace OOO_CORE_MODEL {
 			  , commit(this)
 			  , branchpred(this)
 			  , dcache(this)
+			  , smt(this)
+			  , runahead(this)
+			  , occupancy(this)
 			  , interrupt_requests("interrupt_requests", this)
 			  , cpu_exit_requests("cpu_exit_requests", this)
 			  , cycles_in_pause("cycles_in_pause", this)
+			  , spin(this)
+			  , topdown(this)
 			  , assists("assists", this, assist_names)
 			  , lassists("lassists", this, light_assist_names)
 			  , physreg_reads("physreg_reads", this, phys_reg_file_names)
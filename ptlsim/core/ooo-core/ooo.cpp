@@ -23,6 +23,8 @@
 #include <ooo.h>
 
 #include <memoryHierarchy.h>
+#include <hostperf.h>
+#include <guestpmu.h>
 
 #define MYDEBUG if(logable(99)) ptl_logfile
 
@@ -57,6 +59,15 @@ namespace OOO_CORE_MODEL {
 
     const char* phys_reg_file_names[PHYS_REG_FILE_COUNT] = {"int", "fp", "st", "br"};
 
+    const char* fetch_policy_names[FETCH_POLICY_COUNT] = {"icount",
+        "round_robin", "brcount", "misscount", "stall", "flush"};
+    const char* smt_partition_names[SMT_PARTITION_COUNT] = {"private",
+        "static", "dynamic", "shared"};
+    const char* memdep_predictor_names[MEMDEP_PREDICTOR_COUNT] = {"lsap",
+        "store_sets"};
+    const char* cluster_steering_names[CLUSTER_STEERING_COUNT] = {"operands",
+        "dependence", "balanced", "critical"};
+
     const char* fu_names[FU_COUNT] = {
         "ldu0",
         "stu0",
@@ -114,10 +125,16 @@ ThreadContext::ThreadContext(OooCore& core_, W8 threadid_, Context& ctx_)
     : core(core_), threadid(threadid_), ctx(ctx_)
       , thread_stats("thread", &core_)
 {
+    tlbid = threadid;
+
     stringbuf stats_name;
     stats_name << "thread" << threadid;
     thread_stats.update_name(stats_name.buf);
 
+    stringbuf trace_name;
+    trace_name << "core_" << core_.get_coreid() << "_thread" << threadid;
+    trace_id = trace_register_component(trace_name);
+
     /* Set decoder stats */
     set_decoder_stats(&thread_stats, ctx.cpu_index);
 
@@ -130,6 +147,15 @@ ThreadContext::ThreadContext(OooCore& core_, W8 threadid_, Context& ctx_)
 
     thread_stats.commit.ipc.add_elem(&thread_stats.commit.insns);
     thread_stats.commit.ipc.add_elem(&core_.core_stats.cycles);
+
+    thread_stats.smt.fetch_share.add_elem(&thread_stats.smt.fetch_cycles);
+    thread_stats.smt.fetch_share.add_elem(&core_.core_stats.cycles);
+
+    thread_stats.smt.avg_rob_occupancy.add_elem(&thread_stats.smt.rob_occupancy);
+    thread_stats.smt.avg_rob_occupancy.add_elem(&core_.core_stats.cycles);
+
+    thread_stats.smt.avg_lsq_occupancy.add_elem(&thread_stats.smt.lsq_occupancy);
+    thread_stats.smt.avg_lsq_occupancy.add_elem(&core_.core_stats.cycles);
     /* thread_stats.commit.ipc.enable_periodic_dump(); */
 
     thread_stats.set_default_stats(user_stats);
@@ -142,6 +168,8 @@ ThreadContext::ThreadContext(OooCore& core_, W8 threadid_, Context& ctx_)
 void ThreadContext::reset() {
     setzero(specrrt);
     setzero(commitrrt);
+    specrrt.core = &core;
+    commitrrt.core = &core;
 
     setzero(fetchrip);
     current_basic_block = NULL;
@@ -151,15 +179,17 @@ void ThreadContext::reset() {
     waiting_for_icache_fill_physaddr = 0;
     fetch_uuid = 0;
     current_icache_block = 0;
+    flush_decoded_uops();
     loads_in_flight = 0;
     stores_in_flight = 0;
+    branches_in_flight = 0;
     prev_interrupts_pending = false;
     handle_interrupt_at_next_eom = false;
+    events.recheck();
     stop_at_next_eom = false;
 
     last_commit_at_cycle = 0;
     smc_invalidate_pending = 0;
-    setzero(smc_invalidate_rvp);
 
     chk_recovery_rip = 0;
     unaligned_ldst_buf.reset();
@@ -167,6 +197,20 @@ void ThreadContext::reset() {
 
     pause_counter = 0;
 
+    if unlikely (spin.waiting)
+        core.machine.spin_unwatch(spin);
+    spin.reset();
+
+    topdown_blocker = NULL;
+    topdown_refill = 0;
+    topdown_refill_uuid = 0;
+
+    foreach (i, MAX_CLUSTERS) {
+        foreach (j, COMPLETION_WHEEL_SIZE) completion_wheel[i][j].clear();
+        complete_tick[i] = 0;
+    }
+    completion_seq = 0;
+
     total_uops_committed = 0;
     total_insns_committed = 0;
     dispatch_deadlock_countdown = 0;
@@ -178,7 +222,10 @@ void ThreadContext::reset() {
     issueq_count = 0;
 #endif
     queued_mem_lock_release_count = 0;
-    branchpred.init(coreid, threadid);
+    branchpred.init(coreid, threadid, core.branchpred_type.buf);
+    lsq_filter.reset();
+    ftq.reset();
+    runahead.reset();
 
     in_tlb_walk = 0;
 }
@@ -196,6 +243,80 @@ void ThreadContext::setupTLB() {
     }
 }
 
+/**
+ * @brief Probe 4KB and large page TLB arrays of this thread
+ */
+bool ThreadContext::probe_tlb(Waddr virtaddr, bool is_icache) {
+    if(is_icache)
+        return itlb.probe(virtaddr, tlbid) ||
+            itlb_large.probe(virtaddr, tlbid);
+
+    return dtlb.probe(virtaddr, tlbid) ||
+        dtlb_large.probe(virtaddr, tlbid);
+}
+
+/**
+ * @brief Insert translation of virtaddr in TLB array of its page size
+ */
+void ThreadContext::insert_tlb(Waddr virtaddr, bool is_icache) {
+    bool large = is_icache ? ITLBLarge::ENABLED : DTLBLarge::ENABLED;
+
+    if(large) {
+        int shift = ctx.page_shift(virtaddr);
+
+        if(shift > 12) {
+            bool inserted = is_icache ?
+                itlb_large.insert(virtaddr, tlbid, shift) :
+                dtlb_large.insert(virtaddr, tlbid, shift);
+            if(inserted) return;
+        }
+    }
+
+    if(is_icache)
+        itlb.insert(virtaddr, tlbid);
+    else
+        dtlb.insert(virtaddr, tlbid);
+}
+
+/**
+ * @brief Move this thread's TLB entries to the address space of its CR3
+ *
+ * @return false if CR3 didn't change, or the core has no 'tlb_asids', and
+ * TLBs have to be flushed
+ */
+bool ThreadContext::switch_address_space() {
+    if(!address_spaces.enabled())
+        return false;
+
+    W64 root = floor(ctx.cr[3], PAGE_SIZE);
+    if(root == address_spaces.root()) {
+        thread_stats.dcache.tlb_asid.flushes++;
+        return false;
+    }
+
+    thread_stats.dcache.tlb_asid.switches++;
+
+    if(address_spaces.switch_to(root)) {
+        thread_stats.dcache.tlb_asid.reused++;
+        tlbid = address_spaces.tlb_id(threadid);
+    } else {
+        /* Drop what the id's previous root left */
+        thread_stats.dcache.tlb_asid.recycled++;
+        tlbid = address_spaces.tlb_id(threadid);
+        dtlb.flush_thread(tlbid, TLB_ID_MASK);
+        itlb.flush_thread(tlbid, TLB_ID_MASK);
+        dtlb_large.flush_thread(tlbid, TLB_ID_MASK);
+        itlb_large.flush_thread(tlbid, TLB_ID_MASK);
+        core.stlb.flush_thread(tlbid, TLB_ID_MASK);
+        core.pwc.flush_thread(tlbid, TLB_ID_MASK);
+    }
+
+    /* Decoded uops are cached by virtual address */
+    uop_cache.flush_all();
+    flush_decoded_uops();
+    return true;
+}
+
 /**
  * @brief Initialize thread context variables and structures
  */
@@ -221,6 +342,12 @@ void ThreadContext::init() {
     rob_memory_fence_list("memory-fence", rob_states, 0);
     rob_ready_to_commit_queue("ready-to-commit", rob_states, ROB_STATE_READY);
 
+    /* Walked every cycle by transfer() and writeback() */
+    foreach (i, MAX_CLUSTERS) {
+        rob_completed_list[i].track_members(MAX_ROB_SIZE);
+        rob_ready_to_writeback_list[i].track_members(MAX_ROB_SIZE);
+    }
+
     /* Setup TLB of each thread */
     setupTLB();
 
@@ -228,6 +355,30 @@ void ThreadContext::init() {
     coreid = core.get_coreid();
 }
 
+/**
+ * @brief Read a structure size option of core 'name'
+ *
+ * @param def Size if the option is not set
+ * @param min Smallest size the structure works with
+ * @param max Entries of the structure's storage
+ */
+static int get_size_option(BaseMachine& machine, const char* name,
+        const char* opt, int def, int min, int max)
+{
+    int size;
+
+    if (!machine.get_option(name, opt, size))
+        return def;
+
+    if (size < min || size > max) {
+        ptl_logfile << "ERROR: ", name, " ", opt, " ", size,
+                    " is not in ", min, "..", max, endl;
+        assert(0);
+    }
+
+    return size;
+}
+
 OooCore::OooCore(BaseMachine& machine_, W8 num_threads,
         const char* name)
 : BaseCore(machine_, name)
@@ -237,6 +388,84 @@ OooCore::OooCore(BaseMachine& machine_, W8 num_threads,
         threadcount = 1;
     }
 
+    if(!machine_.get_option(name, "branch_predictor", branchpred_type)) {
+        branchpred_type << "combined";
+    }
+
+    /* SMT fetch arbitration and ROB/LSQ sharing between threads */
+    fetch_policy = machine_.get_named_option(name, "fetch_policy",
+            fetch_policy_names, FETCH_POLICY_COUNT, FETCH_POLICY_ICOUNT);
+    smt_partition = machine_.get_named_option(name, "smt_partition",
+            smt_partition_names, SMT_PARTITION_COUNT, SMT_PARTITION_PRIVATE);
+
+    memdep_predictor = machine_.get_named_option(name, "memdep_predictor",
+            memdep_predictor_names, MEMDEP_PREDICTOR_COUNT,
+            MEMDEP_PREDICTOR_LSAP);
+
+    /* Clusters of dispatched uops, only used with MULTI_IQ */
+    cluster_steering = machine_.get_named_option(name, "cluster_steering",
+            cluster_steering_names, CLUSTER_STEERING_COUNT,
+            CLUSTER_STEERING_OPERANDS);
+    if(!machine_.get_option(name, "steering_bias", steering_bias) ||
+            steering_bias < 0) {
+        steering_bias = 4;
+    }
+
+    if(!machine_.get_option(name, "fetch_threads", fetch_threads) ||
+            fetch_threads <= 0 || fetch_threads > threadcount) {
+        fetch_threads = threadcount;
+    }
+
+    /* Address space ids per thread of TLB entries, 0 flushes on CR3 write */
+    int tlb_asids;
+    if(!machine_.get_option(name, "tlb_asids", tlb_asids) ||
+            tlb_asids < 0) {
+        tlb_asids = 0;
+    }
+    tlb_asids = min(tlb_asids, TLB_MAX_ASIDS);
+
+    fdip_depth = get_size_option(machine_, name, "fdip_depth", 0, 0,
+            FTQ_SIZE);
+    runahead_depth = get_size_option(machine_, name, "runahead_depth", 0, 0,
+            RUNAHEAD_MAX_DEPTH);
+
+    /* Fusion of cmp+jcc and load-op uops into one frontend slot */
+    bool macro_fusion = false;
+    bool micro_fusion = false;
+    machine_.get_option(name, "macro_fusion", macro_fusion);
+    machine_.get_option(name, "micro_fusion", micro_fusion);
+    fusion = (macro_fusion ? FUSION_MACRO : 0) |
+        (micro_fusion ? FUSION_MICRO : 0);
+
+    /* Moves, zero idioms and stack pointer updates removed at rename */
+    bool move_elimination = false;
+    bool zero_idioms = false;
+    bool stack_engine = false;
+    machine_.get_option(name, "move_elimination", move_elimination);
+    machine_.get_option(name, "zero_idioms", zero_idioms);
+    machine_.get_option(name, "stack_engine", stack_engine);
+    rename_elim = (move_elimination ? RENAME_ELIM_MOVE : 0) |
+        (zero_idioms ? RENAME_ELIM_ZERO : 0) |
+        (stack_engine ? RENAME_ELIM_STACK : 0);
+
+    /* Both lines of a line crossing load requested by its low part */
+    split_line_batching = false;
+    machine_.get_option(name, "split_line_batching", split_line_batching);
+
+    /* Sizes of ROB, LSQ, issue queue and register files in their storage */
+    rob_size = get_size_option(machine_, name, "rob_size", ROB_SIZE, 2,
+            MAX_ROB_SIZE);
+    ldq_size = get_size_option(machine_, name, "ldq_size", LDQ_SIZE, 1,
+            MAX_LDQ_SIZE);
+    stq_size = get_size_option(machine_, name, "stq_size", STQ_SIZE, 1,
+            MAX_STQ_SIZE);
+    lsq_size = ldq_size + stq_size;
+    issueq_size = get_size_option(machine_, name, "iq_size",
+            ISSUE_QUEUE_SIZE, 2, MAX_ISSUE_QUEUE_SIZE);
+    phys_reg_file_size = get_size_option(machine_, name,
+            "phys_reg_file_size", PHYS_REG_FILE_SIZE, 1,
+            MAX_PHYS_REG_FILE_SIZE);
+
     setzero(threads);
 
     assert(num_threads > 0 && "Core has atleast 1 thread");
@@ -266,11 +495,29 @@ OooCore::OooCore(BaseMachine& machine_, W8 num_threads,
     icache_signal.connect(signal_mem_ptr(*this,
                 &OooCore::icache_wakeup));
 
+    sig_name.reset();
+
+    sig_name << core_name << "-runahead-wakeup";
+    runahead_signal.set_name(sig_name.buf);
+    runahead_signal.connect(signal_mem_ptr(*this,
+                &OooCore::runahead_wakeup));
+
 	sig_name.reset();
 	sig_name << core_name << "-run-cycle";
 	run_cycle.set_name(sig_name.buf);
 	run_cycle.connect(signal_mem_ptr(*this, &OooCore::runcycle));
 	marss_register_per_cycle_event(&run_cycle);
+	run_cycle_signal = &run_cycle;
+
+    HostPerfCounter *perf = host_perf_register(core_name.buf);
+    dcache_signal.set_perf(perf);
+    icache_signal.set_perf(perf);
+    runahead_signal.set_perf(perf);
+    run_cycle.set_perf(perf);
+    perf_commit = host_perf_register(core_name.buf, "commit");
+    perf_issue = host_perf_register(core_name.buf, "issue");
+    perf_dispatch = host_perf_register(core_name.buf, "dispatch");
+    perf_fetch = host_perf_register(core_name.buf, "fetch");
 
     threads = (ThreadContext**)malloc(sizeof(ThreadContext*) * threadcount);
 
@@ -279,6 +526,7 @@ OooCore::OooCore(BaseMachine& machine_, W8 num_threads,
         Context& ctx = machine.get_next_context();
         ThreadContext* thread = new ThreadContext(*this, i, ctx);
         threads[i] = thread;
+        thread->address_spaces.setup(tlb_asids);
         thread->init();
     }
 
@@ -300,32 +548,36 @@ void OooCore::reset() {
 
 #ifndef MULTI_IQ
     int reserved_iq_entries_per_thread = (int)sqrt(
-            ISSUE_QUEUE_SIZE / threadcount);
+            issueq_size / threadcount);
     reserved_iq_entries = reserved_iq_entries_per_thread * \
                           threadcount;
     assert(reserved_iq_entries && reserved_iq_entries < \
-            ISSUE_QUEUE_SIZE);
+            issueq_size);
 
     foreach_issueq(set_reserved_entries(reserved_iq_entries));
 #else
     int reserved_iq_entries_per_thread = (int)sqrt(
-            ISSUE_QUEUE_SIZE / threadcount);
+            issueq_size / threadcount);
 
     for_each_cluster(cluster){
         reserved_iq_entries[cluster] = reserved_iq_entries_per_thread * \
                                        threadcount;
         assert(reserved_iq_entries[cluster] && reserved_iq_entries[cluster] < \
-                ISSUE_QUEUE_SIZE);
+                issueq_size);
     }
 
     foreach_issueq(set_reserved_entries(
                 reserved_iq_entries_per_thread * threadcount));
 #endif
 
+    foreach_issueq(set_capacity(issueq_size));
     foreach_issueq(reset_shared_entries());
 
     unaligned_predictor.reset();
 
+    load_hits.clear();
+    load_hits_head = 0;
+
     foreach (i, threadcount) threads[i]->reset();
 }
 
@@ -358,6 +610,8 @@ static void OOO_CORE_MODEL::print_list_of_state_lists(ostream& os, const ListOfS
 void PhysicalRegisterFile::init(const char* name, W8 coreid, int rfid, int size, OooCore* core) {
     assert(rfid < PHYS_REG_FILE_COUNT);
     assert(size <= MAX_PHYS_REG_FILE_SIZE);
+    /* Rename table handles are 16 bits */
+    assert(PHYS_REG_FILE_COUNT * MAX_PHYS_REG_FILE_SIZE <= 65536);
     this->size = size;
     this->coreid = coreid;
     this->core = core;
@@ -373,7 +627,7 @@ void PhysicalRegisterFile::init(const char* name, W8 coreid, int rfid, int size,
     }
 
     foreach (i, size) {
-        (*this)[i].init(coreid, rfid, i, core);
+        (*this)[i].init(coreid, rfid, i, this);
     }
 }
 
@@ -384,7 +638,7 @@ PhysicalRegister* PhysicalRegisterFile::alloc(W8 threadid, int r) {
     PhysicalRegister* physreg = (PhysicalRegister*)((r == 0) ? &(*this)[r] : states[PHYSREG_FREE].peek());
     if unlikely (!physreg) return NULL;
     physreg->changestate(PHYSREG_WAITING);
-    physreg->flags = FLAG_WAIT;
+    physreg->flags() = FLAG_WAIT;
     physreg->threadid = threadid;
     allocations++;
 
@@ -449,13 +703,13 @@ void PhysicalRegisterFile::reset() {
 }
 
 StateList& PhysicalRegister::get_state_list(int s) const {
-    return core->physregfiles[rfid].states[s];
+    return file->states[s];
 }
 
 namespace OOO_CORE_MODEL {
     ostream& operator <<(ostream& os, const PhysicalRegister& physreg) {
         stringbuf sb;
-        print_value_and_flags(sb, physreg.data, physreg.flags);
+        print_value_and_flags(sb, physreg.data(), physreg.flags());
         os << "TH ", physreg.threadid, " rfid ", physreg.rfid;
         os << "  r", intstring(physreg.index(), -3), " state ", padstring(physreg.get_state_list().name, -12), " ", sb;
         if (physreg.rob) os << " rob ", physreg.rob->index(), " (uuid ", physreg.rob->uop.uuid, ")";
@@ -496,9 +750,23 @@ ostream& RegisterRenameTable::print(ostream& os) const {
  *  the thread with the lowest number, since this thread is moving
  *  uops through very quickly and can make more progress.
  *
+ *  Core's 'fetch_policy' option selects other counts: BRCOUNT uses
+ *  branches in flight, MISSCOUNT outstanding dcache misses, and
+ *  ROUND_ROBIN rotates priority every cycle. STALL and FLUSH use ICOUNT.
+ *
  * @return  thread priority
  */
 int ThreadContext::get_priority() const {
+    switch (core.fetch_policy) {
+        case FETCH_POLICY_ROUND_ROBIN:
+            return add_index_modulo(threadid, -core.round_robin_tid,
+                    core.threadcount);
+        case FETCH_POLICY_BRCOUNT:
+            return branches_in_flight;
+        case FETCH_POLICY_MISSCOUNT:
+            return rob_cache_miss_list.count;
+    }
+
     int priority =
         fetchq.count +
         rob_frontend_list.count +
@@ -515,32 +783,217 @@ int ThreadContext::get_priority() const {
     return priority;
 }
 
+/**
+ * @brief Find oldest load waiting on dcache for LONG_LATENCY_LOAD_CYCLES
+ *
+ * @return ROB entry of the load, NULL if there is none
+ */
+ReorderBufferEntry* ThreadContext::find_long_latency_load() {
+    ReorderBufferEntry* oldest = NULL;
+    ReorderBufferEntry* rob;
+
+    foreach_list_mutable(rob_cache_miss_list, rob, entry, nextentry) {
+        if (!isload(rob->uop.opcode) || rob->tlb_walk_level > 0) continue;
+        if (sim_cycle - rob->cache_miss_init_cycle < LONG_LATENCY_LOAD_CYCLES) continue;
+        if (!oldest || rob->uop.uuid < oldest->uop.uuid) oldest = rob;
+    }
+
+    return oldest;
+}
+
+/**
+ * @brief Check if STALL or FLUSH fetch policy keeps this thread from fetching
+ *
+ * Under FLUSH policy uops after the long latency load are annulled and
+ * fetch restarts after the load once its thread is no longer gated.
+ *
+ * @return true if thread should not fetch this cycle
+ */
+bool ThreadContext::fetch_gated() {
+    if likely (core.fetch_policy != FETCH_POLICY_STALL &&
+            core.fetch_policy != FETCH_POLICY_FLUSH) {
+        return false;
+    }
+
+    ReorderBufferEntry* load = find_long_latency_load();
+    if likely (!load) return false;
+
+    thread_stats.smt.fetch_gated++;
+
+    if (core.fetch_policy == FETCH_POLICY_FLUSH) {
+        /* Keep the whole x86 insn of the load, annul everything after it */
+        int eomidx = load->index();
+        while (!ROB[eomidx].uop.eom) eomidx = add_index_modulo(eomidx, +1, MAX_ROB_SIZE);
+
+        if (add_index_modulo(eomidx, +1, MAX_ROB_SIZE) != ROB.tail) {
+            annul_fetchq();
+            W64 recoveryrip = ROB[eomidx].annul(true, true);
+            reset_fetch_unit(recoveryrip);
+            thread_stats.smt.long_load_flushes++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check if ROB or LSQ partition of a thread has no free entry
+ *
+ * With 'private' partitioning every thread has its own full size ROB and
+ * LSQ. Otherwise threads share rob_size and lsq_size entries: 'static'
+ * gives each thread an equal share, 'shared' lets threads take any free
+ * entry and 'dynamic' shares entries but keeps half of each thread's
+ * equal share reserved for it.
+ *
+ * @param tid Thread allocating an entry
+ * @param lsq Check LSQ if true, ROB otherwise
+ *
+ * @return true if thread can't allocate another entry
+ */
+bool OooCore::smt_partition_full(int tid, bool lsq) const {
+    if likely (smt_partition == SMT_PARTITION_PRIVATE) return false;
+
+    int size = (lsq) ? lsq_size : rob_size;
+    int share = size / threadcount;
+    int used = 0;
+    int total = 0;
+    int reserved = 0;
+
+    foreach (i, threadcount) {
+        int count = (lsq) ? threads[i]->LSQ.count : threads[i]->ROB.count;
+        total += count;
+        if (i == tid) used = count;
+        else reserved += max(share / 2 - count, 0);
+    }
+
+    switch (smt_partition) {
+        case SMT_PARTITION_STATIC:
+            return (used >= share);
+        case SMT_PARTITION_DYNAMIC:
+            return (total + reserved >= size);
+        case SMT_PARTITION_SHARED:
+            return (total >= size);
+    }
+
+    return false;
+}
+
 /**
  * @brief Execute one cycle of the entire core state machine
  *
  * @return true if the core should stop simulating after this cycle
  */
+/**
+ * @brief Find the first cycle in which this core has work to do
+ *
+ * @return sim_cycle if core is busy, the end of the first spin wait if
+ * all running threads wait in spin loops, infinity if none of the threads
+ * is running (or all are halted) and no uop is in flight
+ */
+W64 OooCore::get_next_active_cycle() {
+    W64 cycle = infinity;
+
+    foreach (i, threadcount) {
+        ThreadContext* thread = threads[i];
+        if (!thread->ROB.empty())
+            return sim_cycle;
+        if (!thread->ctx.running || thread->ctx.is_halted())
+            continue;
+        if (!thread->spin.waiting)
+            return sim_cycle;
+
+        cycle = min(cycle, thread->spin.wake_cycle(thread->ctx.check_events(),
+                    config.spin_max_cycles, sim_cycle));
+    }
+
+    return cycle;
+}
+
+/**
+ * @brief Update per-cycle state for cycles that were skipped while idle
+ */
+void OooCore::skip_cycles(W64 cycles) {
+    round_robin_tid = add_index_modulo(round_robin_tid,
+            int(cycles % threadcount), threadcount);
+    core_stats.cycles += cycles;
+}
+
+/**
+ * @brief Wake up the L1 hit loads whose latency is over
+ *
+ * Runs before the pipeline stages, like the memory hierarchy's wakeups of
+ * queued requests, so a hit completes in the same cycle either way.
+ */
+void OooCore::wakeup_load_hits() {
+    while (load_hits_head < load_hits.length) {
+        LoadHit hit = load_hits[load_hits_head];
+        if (hit.cycle > sim_cycle)
+            break;
+
+        load_hits_head++;
+        load_wakeup(hit.threadid, hit.robid, hit.physaddr, hit.uuid);
+    }
+
+    int left = load_hits.length - load_hits_head;
+    if (!left || load_hits_head >= 64) {
+        foreach (i, left)
+            load_hits[i] = load_hits[load_hits_head + i];
+        load_hits.resize(left);
+        load_hits_head = 0;
+    }
+}
+
 bool OooCore::runcycle(void* none) {
     bool exiting = 0;
 
+    pipe_trace.clock(sim_cycle);
+
+    /* Contexts are run by the migration peer of this core */
+    if unlikely (!active)
+        return exiting;
+
+    /* No edge of this core's clock in this simulation cycle */
+    if unlikely (!clock_domain->ticks)
+        return exiting;
+
+    /* Nothing to do until an event wakes up a halted or spinning thread */
+    if unlikely (get_next_active_cycle() > sim_cycle) {
+        machine.request_park(*this);
+        return exiting;
+    }
+
      /*
       * Detect edge triggered transition from 0->1 for
       * pending interrupt events, then wait for current
       * x86 insn EOM uop to commit before redirecting
-      * to the interrupt handler.
+      * to the interrupt handler. Interrupts, hlt wake ups
+      * and mode changes all come with a context event, so
+      * threads only look at them after one.
       */
 
     foreach (i, threadcount) {
         ThreadContext* thread = threads[i];
-        bool current_interrupts_pending = thread->ctx.check_events();
-        thread->handle_interrupt_at_next_eom = current_interrupts_pending;
-        thread->prev_interrupts_pending = current_interrupts_pending;
-
-        if(thread->ctx.kernel_mode) {
-            thread->thread_stats.set_default_stats(kernel_stats);
-        } else {
-            thread->thread_stats.set_default_stats(user_stats);
+
+        if unlikely (thread->events.changed()) {
+            bool current_interrupts_pending = thread->ctx.check_events();
+            thread->handle_interrupt_at_next_eom = current_interrupts_pending;
+            thread->prev_interrupts_pending = current_interrupts_pending;
+
+            /* hlt ends here, a halted thread does not fetch before */
+            if unlikely (thread->ctx.halted && !thread->ctx.is_halted()) {
+                thread->ctx.halted = 0;
+                thread->last_commit_at_cycle = sim_cycle;
+            }
+
+            if(thread->ctx.kernel_mode) {
+                thread->thread_stats.set_default_stats(kernel_stats);
+            } else {
+                thread->thread_stats.set_default_stats(user_stats);
+            }
         }
+
+        if unlikely (thread->spin.waiting)
+            thread->spin_poll();
     }
 
      /*
@@ -549,6 +1002,9 @@ bool OooCore::runcycle(void* none) {
       */
     set_default_stats(threads[0]->thread_stats.get_default_stats(), false);
 
+    if (load_hits.length)
+        wakeup_load_hits();
+
     /*
      * Compute reserved issue queue entries to avoid starvation:
      */
@@ -572,12 +1028,12 @@ bool OooCore::runcycle(void* none) {
         }
     }
 
-    MYDEBUG << " ISSUE_QUEUE_SIZE ", ISSUE_QUEUE_SIZE, " issueq_all.count ", issueq_all.count, " issueq_all.shared_free_entries ",
+    MYDEBUG << " issueq_size ", issueq_size, " issueq_all.count ", issueq_all.count, " issueq_all.shared_free_entries ",
             issueq_all.shared_free_entries, " total_issueq_reserved_free ", total_issueq_reserved_free,
             " reserved_iq_entries ", reserved_iq_entries, " total_issueq_count ", total_issueq_count, endl;
 
     assert (total_issueq_count == issueq_all.count);
-    assert((ISSUE_QUEUE_SIZE - issueq_all.count) == (issueq_all.shared_free_entries + total_issueq_reserved_free));
+    assert((issueq_size - issueq_all.count) == (issueq_all.shared_free_entries + total_issueq_reserved_free));
 #else
     foreach(cluster, 4){
         int total_issueq_count = 0;
@@ -600,11 +1056,11 @@ bool OooCore::runcycle(void* none) {
         issueq_operation_on_cluster_with_result((*this), cluster, issueq_count, count);
         int issueq_shared_free_entries = 0;
         issueq_operation_on_cluster_with_result((*this), cluster, issueq_shared_free_entries, shared_free_entries);
-        MYDEBUG << " cluster[", cluster, "] ISSUE_QUEUE_SIZE ", ISSUE_QUEUE_SIZE, " issueq[" , cluster, "].count ", issueq_count, " issueq[" , cluster, "].shared_free_entries ",
+        MYDEBUG << " cluster[", cluster, "] issueq_size ", issueq_size, " issueq[" , cluster, "].count ", issueq_count, " issueq[" , cluster, "].shared_free_entries ",
                 issueq_shared_free_entries, " total_issueq_reserved_free ", total_issueq_reserved_free,
                 " reserved_iq_entries ", reserved_iq_entries[cluster], " total_issueq_count ", total_issueq_count, endl;
         assert (total_issueq_count == issueq_count);
-        assert((ISSUE_QUEUE_SIZE - issueq_count) == (issueq_shared_free_entries + total_issueq_reserved_free));
+        assert((issueq_size - issueq_count) == (issueq_shared_free_entries + total_issueq_reserved_free));
 
     }
 
@@ -626,6 +1082,9 @@ bool OooCore::runcycle(void* none) {
         ptl_logfile << "OooCore::run():thread-commit\n";
     }
 
+    /* Commit, writeback and transfer */
+    HostPerfScope stage_perf(perf_commit);
+
     foreach (permute, threadcount) {
         int tid = add_index_modulo(round_robin_tid, +permute, threadcount);
         ThreadContext* thread = threads[tid];
@@ -665,6 +1124,8 @@ bool OooCore::runcycle(void* none) {
       * loads can issue
       */
 
+    stage_perf.switch_to(perf_issue);
+
     foreach (permute, threadcount) {
         int tid = add_index_modulo(round_robin_tid, +permute, threadcount);
         ThreadContext* thread = threads[tid];
@@ -689,6 +1150,9 @@ bool OooCore::runcycle(void* none) {
         ptl_logfile << "OooCore::run():dispatch\n";
     }
 
+    /* Complete, dispatch, frontend and rename */
+    stage_perf.switch_to(perf_dispatch);
+
     int dispatchrc[threadcount];
     dispatchcount = 0;
     foreach (permute, threadcount) {
@@ -717,6 +1181,8 @@ bool OooCore::runcycle(void* none) {
         ptl_logfile << "OooCore::run():fetch\n";
     }
 
+    stage_perf.switch_to(perf_fetch);
+
     int priority_value[threadcount];
     int priority_index[threadcount];
 
@@ -744,18 +1210,55 @@ bool OooCore::runcycle(void* none) {
      */
 
     bool fetch_exception[threadcount];
+    int fetched_threads = 0;
     foreach (j, threadcount) {
         int i = priority_index[j];
         ThreadContext* thread = threads[i];
         assert(thread);
         fetch_exception[i] = true;
-        if unlikely (!thread->ctx.running) {
+        if unlikely (!thread->ctx.running || thread->ctx.halted ||
+                thread->spin.waiting) {
+            continue;
+        }
+
+        thread->thread_stats.smt.rob_occupancy += thread->ROB.count;
+        thread->thread_stats.smt.lsq_occupancy += thread->LSQ.count;
+
+        /* Each one is recorded when it changes, see StatOccupancy */
+        Stats *mode_stats = thread->thread_stats.get_default_stats();
+        int iq_count;
+#ifdef MULTI_IQ
+        iq_count = 0;
+        foreach (c, 4) iq_count += thread->issueq_count[c];
+#else
+        iq_count = thread->issueq_count;
+#endif
+        thread->thread_stats.occupancy.rob.update(thread->ROB.count,
+                sim_cycle, mode_stats);
+        thread->thread_stats.occupancy.lsq.update(thread->LSQ.count,
+                sim_cycle, mode_stats);
+        thread->thread_stats.occupancy.iq.update(iq_count, sim_cycle,
+                mode_stats);
+
+        /* Runs while the thread waits, also when it does not fetch */
+        if unlikely (runahead_depth) thread->runahead_cycle();
+
+        /* Only 'fetch_threads' highest priority threads fetch each cycle */
+        if unlikely (fetched_threads >= fetch_threads) {
+            continue;
+        }
+
+        if unlikely (thread->fetch_gated()) {
             continue;
         }
 
         if likely (dispatchrc[i] >= 0) {
             fetch_exception[i] = thread->fetch();
+            thread->thread_stats.smt.fetch_cycles++;
+            fetched_threads++;
         }
+
+        if unlikely (fdip_depth) thread->fdip_runahead();
     }
 
     /*
@@ -764,6 +1267,8 @@ bool OooCore::runcycle(void* none) {
 
     foreach_issueq(clock());
 
+    stage_perf.stop();
+
     /*
      * Advance the round robin priority index
      */
@@ -915,6 +1420,7 @@ bool OooCore::runcycle(void* none) {
     foreach (i, threadcount) {
         ThreadContext* thread = threads[i];
         if unlikely (!thread->ctx.running) break;
+        if unlikely (thread->ctx.halted || thread->spin.waiting) continue;
 
         if unlikely ((sim_cycle - thread->last_commit_at_cycle) > (W64)1024*1024*threadcount) {
             stringbuf sb;
@@ -950,6 +1456,7 @@ void ReorderBufferEntry::init(int idx) {
     entry_valid = 0;
     selfqueuelink::reset();
     current_state_list = NULL;
+    complete_seq = 0;
     reset();
 }
 
@@ -977,7 +1484,13 @@ void ReorderBufferEntry::reset() {
 #endif
     issued = 0;
     generated_addr = original_addr = cache_data = 0;
+    mem_request.reset();
     annul_flag = 0;
+    memdep_store = 0;
+    memdep_waited = 0;
+    move_eliminated = 0;
+    blocked_commit = 0;
+    topdown_miss_slots = 0;
 }
 
 bool ReorderBufferEntry::ready_to_issue() const {
@@ -1043,6 +1556,11 @@ stringbuf& ReorderBufferEntry::get_operand_info(stringbuf& sb, int operand) cons
 
 ThreadContext& ReorderBufferEntry::getthread() const { return *core->threads[threadid]; }
 
+void ReorderBufferEntry::record_stage(int event, W64 arg) {
+    trace_record(sim_cycle, getthread().trace_id, event, uop.uuid,
+            uop.rip.rip, arg);
+}
+
 issueq_tag_t ReorderBufferEntry::get_tag() {
     int mask = ((1 << MAX_THREADS_BIT) - 1) << MAX_ROB_IDX_BIT;
     if (logable(100)) ptl_logfile << " get_tag() thread ", hexstring(threadid, 8), " rob idx ", hexstring(idx, 16), " mask ", hexstring(mask, 32), endl;
@@ -1112,7 +1630,7 @@ void ThreadContext::print_rob(ostream& os) {
 void ThreadContext::print_lsq(ostream& os) {
     os << "LSQ head ", LSQ.head, " to tail ", LSQ.tail, " (", LSQ.count, " entries):", endl, flush;
     foreach_forward(LSQ, i) {
-        assert(i < LSQ_SIZE);
+        assert(i < MAX_LSQ_SIZE);
         LoadStoreQueueEntry& lsq = LSQ[i];
         os << "  ", lsq, endl;
     }
@@ -1197,7 +1715,7 @@ void OooCore::check_refcounts() {
       * for now, we just work on thread[0];
       */
     ThreadContext& thread = *threads[0];
-    Queue<ReorderBufferEntry, ROB_SIZE>& ROB = thread.ROB;
+    Queue<ReorderBufferEntry, MAX_ROB_SIZE>& ROB = thread.ROB;
     RegisterRenameTable& specrrt = thread.specrrt;
     RegisterRenameTable& commitrrt = thread.commitrrt;
 
@@ -1258,9 +1776,9 @@ void OooCore::check_rob() {
       * for now, we just work on thread[0];
       */
     ThreadContext& thread = *threads[0];
-    Queue<ReorderBufferEntry, ROB_SIZE>& ROB = thread.ROB;
+    Queue<ReorderBufferEntry, MAX_ROB_SIZE>& ROB = thread.ROB;
 
-    foreach (i, ROB_SIZE) {
+    foreach (i, MAX_ROB_SIZE) {
         ReorderBufferEntry& rob = ROB[i];
         if (!rob.entry_valid) continue;
         assert(inrange((int)rob.forward_cycle, 0, (MAX_FORWARDING_LATENCY+1)-1));
@@ -1272,7 +1790,7 @@ void OooCore::check_rob() {
             StateList& list = *(thread->rob_states[i]);
             ReorderBufferEntry* rob;
             foreach_list_mutable(list, rob, entry, nextentry) {
-                assert(inrange(rob->index(), 0, ROB_SIZE-1));
+                assert(inrange(rob->index(), 0, MAX_ROB_SIZE-1));
                 assert(rob->current_state_list == &list);
                 if (!((rob->current_state_list != &thread->rob_free_list) ? rob->entry_valid : (!rob->entry_valid))) {
                     ptl_logfile << "ROB ", rob->index(), " list = ", rob->current_state_list->name, " entry_valid ", rob->entry_valid, endl, flush;
@@ -1558,14 +2076,218 @@ ostream& OOO_CORE_MODEL::operator <<(ostream& os, const PhysicalRegisterOperandI
 }
 
 void OooCore::flush_tlb(Context& ctx) {
+    ThreadContext* thread = get_thread(ctx);
+    if(thread && thread->switch_address_space())
+        return;
+
     foreach(i, threadcount) {
         threads[i]->dtlb.flush_all();
         threads[i]->itlb.flush_all();
+        threads[i]->dtlb_large.flush_all();
+        threads[i]->itlb_large.flush_all();
+    }
+    stlb.flush_all();
+    pwc.flush_all();
+
+    foreach(i, threadcount) {
+        threads[i]->uop_cache.flush_all();
+        threads[i]->flush_decoded_uops();
     }
 }
 
 void OooCore::flush_tlb_virt(Context& ctx, Waddr virtaddr) {
-    /* FIXME AVADH DEFCORE */
+    ThreadContext* thread = get_thread(ctx);
+    if(!thread) return;
+
+    W8 tid = thread->tlbid;
+    thread->dtlb.flush_virt(virtaddr, tid);
+    thread->itlb.flush_virt(virtaddr, tid);
+    thread->dtlb_large.flush_virt(virtaddr, tid);
+    thread->itlb_large.flush_virt(virtaddr, tid);
+    stlb.flush_virt(virtaddr, tid);
+    pwc.flush_virt(virtaddr, tid, ctx.page_table_level_count());
+    thread->uop_cache.flush_virt(virtaddr, tid);
+    thread->flush_decoded_uops();
+}
+
+/**
+ * @brief Drop the fetch window and loop whose uops skip ITLB and icache
+ *
+ * Called when translations change, so fetch looks up the uop cache again
+ * and the loop stream detector has to lock on a loop again.
+ */
+void ThreadContext::flush_decoded_uops() {
+    current_fetch_window = (W64)-1;
+    current_fetch_window_decoded = 0;
+    lsd.reset();
+    ftq.flush();
+}
+
+/**
+ * @brief Look up STLB and page walk caches after a first level TLB miss
+ *
+ * @param thread Thread that missed in its DTLB or ITLB
+ * @param virtaddr Virtual address to translate
+ * @param is_icache True for ITLB miss
+ *
+ * @return Page table level where walk starts, 0 if STLB hit
+ */
+byte OooCore::start_tlb_walk(ThreadContext& thread, Waddr virtaddr,
+        bool is_icache) {
+    W8 tid = thread.tlbid;
+    int level_count = thread.ctx.page_table_level_count();
+
+    if(STLB::ENABLED) {
+        if(stlb.probe(virtaddr, tid)) {
+            thread.thread_stats.dcache.stlb.hits++;
+            return 0;
+        }
+        thread.thread_stats.dcache.stlb.misses++;
+    }
+
+    int level = pwc.start_level(virtaddr, tid, level_count);
+
+    if(PWC::ENABLED) {
+        if(level < level_count)
+            thread.thread_stats.dcache.pwc.hits++;
+        else
+            thread.thread_stats.dcache.pwc.misses++;
+    }
+
+    if(logable(6)) {
+        ptl_logfile << (is_icache ? "itlb" : "dtlb"), " walk of ",
+                    (void*)virtaddr, " starts at level ", level, endl;
+    }
+
+    return level;
+}
+
+/**
+ * @brief Install translation of a completed walk in STLB and page walk caches
+ */
+void OooCore::finish_tlb_walk(ThreadContext& thread, Waddr virtaddr) {
+    stlb.insert(virtaddr, thread.tlbid);
+    pwc.fill(virtaddr, thread.tlbid, thread.ctx.page_table_level_count());
+}
+
+/**
+ * @brief Find the thread that runs given Context
+ *
+ * @return NULL if ctx is not run by this core
+ */
+ThreadContext* OooCore::get_thread(Context& ctx) {
+    foreach(i, threadcount) {
+        if(&threads[i]->ctx == &ctx)
+            return threads[i];
+    }
+
+    return NULL;
+}
+
+bool OooCore::runs_context(Context& ctx) {
+    return get_thread(ctx) != NULL;
+}
+
+/**
+ * @brief Functional warmup: install virtaddr in thread's TLB
+ */
+void OooCore::warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache) {
+    ThreadContext* thread = get_thread(ctx);
+    assert(thread);
+
+    thread->insert_tlb(virtaddr, is_icache);
+}
+
+/**
+ * @brief Functional warmup: train branch predictor with a committed branch
+ *
+ * Does what fetch and commit do to the predictor for this branch, with
+ * branch resolved to target.
+ */
+void OooCore::warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+        W64 target) {
+    ThreadContext* thread = get_thread(ctx);
+    assert(thread);
+
+    BranchPredictorUpdateInfo predinfo;
+    predinfo.uuid = 0;
+    predinfo.ctxid = 0;
+    predinfo.ripafter = ripafter;
+    predinfo.bptype =
+        (isclass(uop.opcode, OPCLASS_COND_BRANCH) << log2(BRANCH_HINT_COND)) |
+        (isclass(uop.opcode, OPCLASS_INDIR_BRANCH) << log2(BRANCH_HINT_INDIRECT)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_PUSH_RAS)) << log2(BRANCH_HINT_CALL)) |
+        (bit(uop.extshift, log2(BRANCH_HINT_POP_RAS)) << log2(BRANCH_HINT_RET));
+
+    thread->branchpred.predict(predinfo, predinfo.bptype, ripafter,
+            uop.riptaken);
+
+    if(predinfo.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET))
+        thread->branchpred.updateras(predinfo, ripafter);
+
+    thread->branchpred.update(predinfo, ripafter, target);
+}
+
+/**
+ * @brief Save or load TLBs, page walk caches and branch predictors
+ *
+ * TLB tags hold the address space id of their thread, so the address
+ * spaces are kept with them.
+ */
+void OooCore::transfer_warm_state(WarmState& state) {
+    state.expect(threadcount);
+
+    foreach(i, threadcount) {
+        ThreadContext* thread = threads[i];
+
+        state.object(thread->dtlb);
+        state.object(thread->itlb);
+        state.object(thread->dtlb_large);
+        state.object(thread->itlb_large);
+        state.object(thread->address_spaces);
+        state.value(thread->tlbid);
+        thread->branchpred.transfer_warm_state(state);
+    }
+
+    state.object(stlb);
+    state.object(pwc);
+}
+
+void OooCore::get_warmup_counts(Stats* stats, WarmupCounts& counts)
+{
+    foreach(i, threadcount) {
+        OooCoreThreadStats& st = threads[i]->thread_stats;
+        W64 tlb_misses = st.dcache.dtlb.misses(stats) +
+            st.dcache.itlb.misses(stats);
+
+        counts.tlb_accesses += st.dcache.dtlb.hits(stats) +
+            st.dcache.itlb.hits(stats) + tlb_misses;
+        counts.tlb_misses += tlb_misses;
+        counts.branches += st.branchpred.summary(stats)[MISPRED] +
+            st.branchpred.summary(stats)[CORRECT];
+        counts.mispredicts += st.branchpred.summary(stats)[MISPRED];
+    }
+}
+
+bool OooCore::get_pmu_counts(Context& ctx, Stats* stats, W64 *counts)
+{
+    ThreadContext* thread = get_thread(ctx);
+    if (!thread) return false;
+
+    OooCoreThreadStats& st = thread->thread_stats;
+    W64 cycles = core_stats.cycles(stats);
+    W64 mispredicts = st.branchpred.summary(stats)[MISPRED];
+
+    counts[PMU_EVENT_CYCLES] = cycles;
+    counts[PMU_EVENT_INSNS] = st.commit.insns(stats);
+    counts[PMU_EVENT_REF_CYCLES] = cycles;
+    counts[PMU_EVENT_LLC_REFS] = st.dcache.load_level(stats)[TOPDOWN_MEM_L3] +
+        st.dcache.load_level(stats)[TOPDOWN_MEM_DRAM];
+    counts[PMU_EVENT_LLC_MISSES] = st.dcache.load_level(stats)[TOPDOWN_MEM_DRAM];
+    counts[PMU_EVENT_BRANCHES] = st.branchpred.summary(stats)[CORRECT] +
+        mispredicts;
+    counts[PMU_EVENT_BRANCH_MISSES] = mispredicts;
+    return true;
 }
 
 void OooCore::check_ctx_changes()
@@ -1573,6 +2295,7 @@ void OooCore::check_ctx_changes()
     foreach(i, threadcount) {
         Context& ctx = threads[i]->ctx;
         ctx.handle_interrupt = 0;
+        threads[i]->events.recheck();
 
         if(logable(4))
             ptl_logfile << " Ctx[", ctx.cpu_index, "] eflags: ", (void*)ctx.eflags, endl;
@@ -1608,21 +2331,44 @@ void OooCore::dump_configuration(YAML::Emitter &out) const
 
 	YAML_KEY_VAL(out, "type", "core");
 	YAML_KEY_VAL(out, "threads", threadcount);
-	YAML_KEY_VAL(out, "iq_size", ISSUE_QUEUE_SIZE);
+	YAML_KEY_VAL(out, "branch_predictor", branchpred_type.buf);
+	YAML_KEY_VAL(out, "fetch_policy", fetch_policy_names[fetch_policy]);
+	YAML_KEY_VAL(out, "smt_partition", smt_partition_names[smt_partition]);
+	YAML_KEY_VAL(out, "fetch_threads", fetch_threads);
+	YAML_KEY_VAL(out, "memdep_predictor", memdep_predictor_names[memdep_predictor]);
+	YAML_KEY_VAL(out, "ssit_size", SSIT_SIZE);
+	YAML_KEY_VAL(out, "lfst_size", LFST_SIZE);
+	YAML_KEY_VAL(out, "clusters", MAX_CLUSTERS);
+	YAML_KEY_VAL(out, "cluster_steering", cluster_steering_names[cluster_steering]);
+	YAML_KEY_VAL(out, "steering_bias", steering_bias);
+	YAML_KEY_VAL(out, "criticality_size", CRITICALITY_SIZE);
+	YAML_KEY_VAL(out, "iq_size", issueq_size);
 	YAML_KEY_VAL(out, "phys_reg_files", PHYS_REG_FILE_COUNT);
 #ifdef UNIFIED_INT_FP_PHYS_REG_FILE
-	YAML_KEY_VAL(out, "phys_reg_file_int_fp_size", PHYS_REG_FILE_SIZE);
+	YAML_KEY_VAL(out, "phys_reg_file_int_fp_size", phys_reg_file_size);
 #else
-	YAML_KEY_VAL(out, "phys_reg_file_int_size", PHYS_REG_FILE_SIZE);
-	YAML_KEY_VAL(out, "phys_reg_file_fp_size", PHYS_REG_FILE_SIZE);
+	YAML_KEY_VAL(out, "phys_reg_file_int_size", phys_reg_file_size);
+	YAML_KEY_VAL(out, "phys_reg_file_fp_size", phys_reg_file_size);
 #endif
-	YAML_KEY_VAL(out, "phys_reg_file_st_size", STQ_SIZE * threadcount);
+	YAML_KEY_VAL(out, "phys_reg_file_st_size", stq_size * threadcount);
 	YAML_KEY_VAL(out, "phys_reg_file_br_size", MAX_BRANCHES_IN_FLIGHT *
 			threadcount);
 	YAML_KEY_VAL(out, "fetch_q_size", FETCH_QUEUE_SIZE);
 	YAML_KEY_VAL(out, "frontend_stages", FRONTEND_STAGES);
 	YAML_KEY_VAL(out, "itlb_size", ITLB_SIZE);
 	YAML_KEY_VAL(out, "dtlb_size", DTLB_SIZE);
+	YAML_KEY_VAL(out, "dtlb_2m_size", DTLB_2M_SIZE);
+	YAML_KEY_VAL(out, "dtlb_1g_size", DTLB_1G_SIZE);
+	YAML_KEY_VAL(out, "itlb_2m_size", ITLB_2M_SIZE);
+	YAML_KEY_VAL(out, "itlb_1g_size", ITLB_1G_SIZE);
+	YAML_KEY_VAL(out, "stlb_sets", STLB_SETS);
+	YAML_KEY_VAL(out, "stlb_ways", STLB_WAYS);
+	YAML_KEY_VAL(out, "pwc_size", PWC_SIZE);
+	YAML_KEY_VAL(out, "uop_cache_sets", UOP_CACHE_SETS);
+	YAML_KEY_VAL(out, "uop_cache_ways", UOP_CACHE_WAYS);
+	YAML_KEY_VAL(out, "lsd_size", LSD_SIZE);
+	YAML_KEY_VAL(out, "fdip_depth", fdip_depth);
+	YAML_KEY_VAL(out, "runahead_depth", runahead_depth);
 
 	YAML_KEY_VAL(out, "total_FUs", (ALU_FU_COUNT + FPU_FU_COUNT +
 				LOAD_FU_COUNT + STORE_FU_COUNT));
@@ -1636,11 +2382,19 @@ void OooCore::dump_configuration(YAML::Emitter &out) const
 	YAML_KEY_VAL(out, "writeback_width", WRITEBACK_WIDTH);
 	YAML_KEY_VAL(out, "commit_width", COMMIT_WIDTH);
 	YAML_KEY_VAL(out, "max_branch_in_flight", MAX_BRANCHES_IN_FLIGHT);
+	YAML_KEY_VAL(out, "macro_fusion", ((fusion & FUSION_MACRO) != 0));
+	YAML_KEY_VAL(out, "micro_fusion", ((fusion & FUSION_MICRO) != 0));
+	YAML_KEY_VAL(out, "move_elimination", ((rename_elim & RENAME_ELIM_MOVE) != 0));
+	YAML_KEY_VAL(out, "zero_idioms", ((rename_elim & RENAME_ELIM_ZERO) != 0));
+	YAML_KEY_VAL(out, "stack_engine", ((rename_elim & RENAME_ELIM_STACK) != 0));
+	YAML_KEY_VAL(out, "split_line_batching", split_line_batching);
 
 	out << YAML::Key << "per_thread" << YAML::Value << YAML::BeginMap;
 
-	YAML_KEY_VAL(out, "rob_size", ROB_SIZE);
-	YAML_KEY_VAL(out, "lsq_size", LSQ_SIZE);
+	YAML_KEY_VAL(out, "rob_size", rob_size);
+	YAML_KEY_VAL(out, "ldq_size", ldq_size);
+	YAML_KEY_VAL(out, "stq_size", stq_size);
+	YAML_KEY_VAL(out, "lsq_size", lsq_size);
 
 	out << YAML::EndMap;
 
@@ -1663,18 +2417,3 @@ namespace OOO_CORE_MODEL {
     OooCoreBuilder defaultCoreBuilder(OOO_CORE_NAME);
 };
 
-namespace OOO_CORE_MODEL {
-    CycleTimer cttotal;
-    CycleTimer ctfetch;
-    CycleTimer ctdecode;
-    CycleTimer ctrename;
-    CycleTimer ctfrontend;
-    CycleTimer ctdispatch;
-    CycleTimer ctissue;
-    CycleTimer ctissueload;
-    CycleTimer ctissuestore;
-    CycleTimer ctcomplete;
-    CycleTimer cttransfer;
-    CycleTimer ctwriteback;
-    CycleTimer ctcommit;
-};
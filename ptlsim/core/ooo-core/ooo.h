@@ -16,6 +16,13 @@
 #include <ptlsim.h>
 #include <basecore.h>
 #include <branchpred.h>
+#include <pagewalk.h>
+#include <uopcache.h>
+#include <spinloop.h>
+#include <storesets.h>
+#include <criticality.h>
+#include <eventtrace.h>
+#include <pipetrace.h>
 #include <statelist.h>
 #include <statsBuilder.h>
 #include <decode.h>
@@ -40,17 +47,6 @@
  *
  */
 
-/* #define ENABLE_SIM_TIMING */
-#ifdef ENABLE_SIM_TIMING
-#define time_this_scope(ct) CycleTimerScope ctscope(ct)
-#define start_timer(ct) ct.start()
-#define stop_timer(ct) ct.stop()
-#else
-#define time_this_scope(ct) (0)
-#define start_timer(ct) (0)
-#define stop_timer(ct) (0)
-#endif
-
 #define CORE_STATS(var) \
     getcore().core_stats.var(getthread().thread_stats.get_default_stats())
 
@@ -366,6 +362,7 @@ namespace OOO_CORE_MODEL {
             bitvec<size> issued;
             bitvec<size> allready;
             int count;
+            int capacity; /* entries in use of the size, core's 'iq_size' */
             byte coreid;
             OooCore* core;
             int shared_free_entries;
@@ -375,10 +372,12 @@ namespace OOO_CORE_MODEL {
 
             IssueQueue(){
                 issueq_id = issueq_id_seq++;
+                capacity = size;
             }
+            void set_capacity(int num) { capacity = num; }
             void set_reserved_entries(int num) { reserved_entries = num; }
             bool reset_shared_entries() {
-                shared_free_entries = size - reserved_entries;
+                shared_free_entries = capacity - reserved_entries;
                 return true;
             }
             bool alloc_shared_entry() {
@@ -387,8 +386,8 @@ namespace OOO_CORE_MODEL {
                 return true;
             }
             bool free_shared_entry() {
-                if(logable(99)) ptl_logfile << "shared_free_entries: ", shared_free_entries, " size: ",  size, " reserved_entries: ",  reserved_entries, endl;
-                assert(shared_free_entries < size - reserved_entries);
+                if(logable(99)) ptl_logfile << "shared_free_entries: ", shared_free_entries, " capacity: ",  capacity, " reserved_entries: ",  reserved_entries, endl;
+                assert(shared_free_entries < capacity - reserved_entries);
                 shared_free_entries++;
                 return true;
             }
@@ -396,7 +395,7 @@ namespace OOO_CORE_MODEL {
                 return (shared_free_entries == 0);
             }
 
-            bool remaining() const { return (size - count); }
+            bool remaining() const { return (capacity - count); }
             bool empty() const { return (!count); }
             bool full() const { return (!remaining()); }
 
@@ -477,7 +476,7 @@ namespace OOO_CORE_MODEL {
     struct FetchBufferEntry: public TransOp {
         RIPVirtPhys rip;
         W64 uuid;
-        uopimpl_func_t synthop;
+        UopDescriptor desc;
         BranchPredictorUpdateInfo predinfo;
         W16 index;
         W8 threadid;
@@ -512,7 +511,7 @@ namespace OOO_CORE_MODEL {
         PhysicalRegister* operands[MAX_OPERANDS];
         LoadStoreQueueEntry* lsq;
         W16s idx;
-        W16s cycles_left; /* execution latency counter, decremented every cycle when executing */
+        W16s cycles_left; /* execution latency, set when the uop enters rob_issued_list */
         W16s forward_cycle; /* forwarding cycle after completion */
         W16s lfrqslot;
         W16s iqslot;
@@ -521,6 +520,11 @@ namespace OOO_CORE_MODEL {
         W8   coreid;
         OooCore* core;
         W64  tlb_miss_init_cycle;
+        W64  cache_miss_init_cycle;
+        W64  memdep_store_uuid; /* store this load is predicted to depend on */
+        W64  memdep_wait_uuid;  /* store this load waited on as predicted alias */
+        W32  complete_seq; /* matches the live completion wheel event, if any */
+        W32  topdown_miss_slots; /* commit slots lost on this cache miss */
 
         W8   threadid;
         byte fu;
@@ -529,17 +533,26 @@ namespace OOO_CORE_MODEL {
         Waddr origvirt; /* original virtual address, with low bits */
         Waddr virtpage; /* virtual page number actually accessed by the load or store */
         W64 original_addr, generated_addr, cache_data;
+        Memory::MemoryRequestHandle mem_request; /* last cache access, annuled on a flush */
         byte entry_valid:1, load_store_second_phase:1, all_consumers_off_bypass:1, dest_renamed_before_writeback:1, no_branches_between_renamings:1, transient:1, lock_acquired:1, issued:1;
         byte annul_flag;
         byte tlb_walk_level;
+        byte memdep_store:1, memdep_waited:1;
+        /* physreg is the source's, shared by move elimination and not owned */
+        byte move_eliminated:1;
+        /* Was the oldest uop and held back commit, trains the criticality predictor */
+        byte blocked_commit:1;
 
         int index() const { return idx; }
         void validate() { entry_valid = true; }
 
         void changestate(StateList& newqueue, bool place_at_head = false, ReorderBufferEntry* prevrob = NULL) {
-            if (current_state_list)
+            if (current_state_list) {
                 current_state_list->remove(this);
+                current_state_list->unmark(idx);
+            }
             current_state_list = &newqueue;
+            newqueue.mark(idx);
             if (place_at_head) newqueue.enqueue_after(this, prevrob); else newqueue.enqueue(this);
         }
 
@@ -586,6 +599,12 @@ namespace OOO_CORE_MODEL {
 
         ThreadContext& getthread() const;
         issueq_tag_t get_tag();
+
+        /* Uop entered a stage, for '-pipe-trace' */
+        void trace_stage(int event, W64 arg = 0) {
+            if unlikely (pipe_trace.active) record_stage(event, arg);
+        }
+        void record_stage(int event, W64 arg);
     };
 
     static inline ostream& operator <<(ostream& os, const ReorderBufferEntry& rob) {
@@ -595,7 +614,7 @@ namespace OOO_CORE_MODEL {
     /*
      * Load/Store Queue
      */
-#define LSQ_SIZE (LDQ_SIZE + STQ_SIZE)
+#define MAX_LSQ_SIZE (MAX_LDQ_SIZE + MAX_STQ_SIZE)
 
     /* Define this to allow speculative issue of loads before unresolved stores */
     /* #define SMT_ENABLE_LOAD_HOISTING */
@@ -612,6 +631,7 @@ namespace OOO_CORE_MODEL {
         W8s mbtag;
         W8 store:1, lfence:1, sfence:1, entry_valid:1, mmio:1;
           /* W32 padding; */
+        W16s filter_slot; /* slot in LSQAddressFilter, -1 if not added */
         W32 time_stamp;
         W64 sfr_data;
         W8 sfr_bytemask;
@@ -630,6 +650,7 @@ namespace OOO_CORE_MODEL {
             sfr_data = -1;
             sfr_bytemask = 0;
             mmio = 0;
+            filter_slot = -1;
         }
 
         void init(int idx) {
@@ -669,13 +690,20 @@ namespace OOO_CORE_MODEL {
      * Physical Register File
      */
 
+    struct PhysicalRegisterFile;
+
+    /**
+     * @brief Rename and state list entry of a physical register
+     *
+     * Its value and flags are kept apart in the arrays of its register
+     * file, see data() and flags(), so this entry only holds what rename,
+     * dispatch and the state lists look at.
+     */
     struct PhysicalRegister: public selfqueuelink {
         ReorderBufferEntry* rob;
-        W64 data;
-        W16 flags;
+        PhysicalRegisterFile* file;
         W16 idx;
         W8  coreid;
-        OooCore* core;
         W8  rfid;
         W8  state;
         W8  archreg;
@@ -683,6 +711,9 @@ namespace OOO_CORE_MODEL {
         W16s refcount;
         W8 threadid;
 
+        inline W64& data() const;
+        inline W16& flags() const;
+
         StateList& get_state_list(int state) const;
         StateList& get_state_list() const { return get_state_list(this->state); }
 
@@ -692,9 +723,9 @@ namespace OOO_CORE_MODEL {
             get_state_list(state).enqueue(this);
         }
 
-        void init(W8 coreid, int rfid, int idx, OooCore* core) {
+        void init(W8 coreid, int rfid, int idx, PhysicalRegisterFile* file) {
             this->coreid = coreid;
-            this->core = core;
+            this->file = file;
             this->rfid = rfid;
             this->idx = idx;
             reset();
@@ -729,7 +760,7 @@ namespace OOO_CORE_MODEL {
             refcount = 0;
             threadid = 0xff;
             all_consumers_sourced_from_bypass = 1;
-            flags = flags & ~(FLAG_INV | FLAG_WAIT);
+            flags() &= ~(FLAG_INV | FLAG_WAIT);
         }
 
         private:
@@ -751,12 +782,12 @@ namespace OOO_CORE_MODEL {
         }
 
         int index() const { return idx; }
-        bool valid() const { return ((flags & FLAG_INV) == 0); }
-        bool ready() const { return ((flags & FLAG_WAIT) == 0); }
+        bool valid() const { return ((flags() & FLAG_INV) == 0); }
+        bool ready() const { return ((flags() & FLAG_WAIT) == 0); }
 
         void fill_operand_info(PhysicalRegisterOperandInfo& opinfo);
 
-        OooCore& getcore() { return *core; }
+        inline OooCore& getcore() const;
     };
 
     ostream& operator <<(ostream& os, const PhysicalRegister& physreg);
@@ -776,6 +807,10 @@ namespace OOO_CORE_MODEL {
         W64 allocations;
         W64 frees;
 
+        /* Value and flags of each register, by register index */
+        W64 regdata[MAX_PHYS_REG_FILE_SIZE];
+        W16 regflags[MAX_PHYS_REG_FILE_SIZE];
+
         PhysicalRegisterFile() { }
 
         PhysicalRegisterFile(const char* name, W8 coreid, int rfid, int size,
@@ -813,13 +848,55 @@ namespace OOO_CORE_MODEL {
         return physregs.print(os);
     }
 
+    inline W64& PhysicalRegister::data() const { return file->regdata[idx]; }
+    inline W16& PhysicalRegister::flags() const { return file->regflags[idx]; }
+    inline OooCore& PhysicalRegister::getcore() const { return *file->core; }
+
     /**
      * @brief Register Rename Table
+     *
+     * Maps are 16 bit handles (rfid and index in the core's register
+     * files), not pointers, so a table takes a quarter of the host cache
+     * lines. Indexing returns an Entry that reads and assigns like a
+     * PhysicalRegister pointer. A zeroed table maps to the null register.
      */
-    struct RegisterRenameTable: public array<PhysicalRegister*, TRANSREG_COUNT> {
+    struct RegisterRenameTable {
+        struct Entry {
+            RegisterRenameTable& rrt;
+            int archreg;
+
+            Entry(RegisterRenameTable& rrt, int archreg)
+                : rrt(rrt), archreg(archreg) { }
+
+            operator PhysicalRegister*() const { return rrt.get(archreg); }
+            PhysicalRegister* operator ->() const { return rrt.get(archreg); }
+
+            Entry& operator =(const PhysicalRegister* physreg) {
+                rrt.set(archreg, physreg);
+                return *this;
+            }
+
+            Entry& operator =(const Entry& e) {
+                rrt.regs[archreg] = e.rrt.regs[e.archreg];
+                return *this;
+            }
+        };
+
+        W16 regs[TRANSREG_COUNT];
+        OooCore* core;
 #ifdef ENABLE_TRANSIENT_VALUE_TRACKING
         bitvec<TRANSREG_COUNT> renamed_in_this_basic_block;
 #endif
+
+        inline PhysicalRegister* get(int archreg) const;
+
+        void set(int archreg, const PhysicalRegister* physreg) {
+            regs[archreg] = (physreg->rfid * MAX_PHYS_REG_FILE_SIZE) + physreg->idx;
+        }
+
+        Entry operator [](int archreg) { return Entry(*this, archreg); }
+        PhysicalRegister* operator [](int archreg) const { return get(archreg); }
+
         ostream& print(ostream& os) const;
     };
 
@@ -866,6 +943,275 @@ namespace OOO_CORE_MODEL {
 
     struct LoadStoreAliasPredictor: public FullyAssociativeTags<W64, 8> { };
 
+    typedef StoreSetPredictor<SSIT_SIZE, LFST_SIZE, STORE_SET_CLEAR_CYCLES> StoreSets;
+
+    typedef CriticalityPredictor<CRITICALITY_SIZE> Criticality;
+
+    /**
+     * @brief Counting filter of the 8-byte granules of LSQ entries with a
+     * generated address, loads and stores apart
+     *
+     * Loads and stores only scan the LSQ for older stores or younger loads
+     * they overlap when the filter has their granule or one next to it.
+     * Entries are added at address generation and removed when they leave
+     * the LSQ or are redispatched, so the filter has false positives only.
+     * Stores and fences without an address are the stores_in_flight that
+     * aren't in the filter, with any of them the LSQ is scanned as before.
+     *
+     * Scans match granules by the low 32 bits of their difference, so
+     * slots only hash the low 32 bits.
+     */
+    struct LSQAddressFilter {
+        W16 counts[2][LSQ_FILTER_SIZE];
+        int stores;
+
+        static int slot_of(W32 granule) {
+            return (granule ^ (granule >> 16)) & (LSQ_FILTER_SIZE - 1);
+        }
+
+        void reset() {
+            setzero(counts);
+            stores = 0;
+        }
+
+        void add(LoadStoreQueueEntry& lsq) {
+            remove(lsq);
+            lsq.filter_slot = slot_of(lsq.physaddr);
+            counts[lsq.store][lsq.filter_slot]++;
+            stores += lsq.store;
+        }
+
+        void remove(LoadStoreQueueEntry& lsq) {
+            if (lsq.filter_slot < 0) return;
+            counts[lsq.store][lsq.filter_slot]--;
+            stores -= lsq.store;
+            lsq.filter_slot = -1;
+        }
+
+        /* Stores (or loads) other than lsq may overlap its granule */
+        bool may_overlap(bool store, const LoadStoreQueueEntry& lsq) const {
+            W32 granule = lsq.physaddr;
+            foreach (i, 3) {
+                int slot = slot_of(granule + i - 1);
+                int own = (lsq.store == store) && (lsq.filter_slot == slot);
+                if (counts[store][slot] > own) return true;
+            }
+            return false;
+        }
+    };
+
+    /**
+     * @brief Basic block queued by the fetch directed prefetcher, and the
+     * physical pages of its code
+     */
+    struct FetchTarget {
+        W64 rip;
+        W64 mfnlo;
+        W64 mfnhi;
+        W8 lines;
+        W8 prefetched;
+
+        void init(const BasicBlock& bb) {
+            rip = bb.rip.rip;
+            mfnlo = bb.rip.mfnlo;
+            mfnhi = bb.rip.mfnhi;
+
+            W64 first = floor(rip, FDIP_LINE_SIZE);
+            W64 last = floor(rip + max(int(bb.bytes), 1) - 1, FDIP_LINE_SIZE);
+            lines = (last - first) / FDIP_LINE_SIZE + 1;
+            prefetched = 0;
+
+            if unlikely (mfnlo == RIPVirtPhys::INVALID || bb.invalidblock)
+                lines = 0;
+        }
+
+        /* Physical address of line i of the block, 0 if unmapped */
+        W64 line_physaddr(int i) const {
+            W64 virt = floor(rip, FDIP_LINE_SIZE) + i * FDIP_LINE_SIZE;
+            W64 mfn = ((virt >> 12) == (rip >> 12)) ? mfnlo : mfnhi;
+            if unlikely (mfn == RIPVirtPhys::INVALID) return 0;
+            return (mfn << 12) | lowbits(virt, 12);
+        }
+    };
+
+    /**
+     * @brief Line prefetched by the fetch directed prefetcher or runahead
+     */
+    struct PrefetchedLine {
+        W64 line; /* physical address >> log2 of the line size */
+        bool valid;
+        bool ready;
+    };
+
+    /**
+     * @brief Last SIZE prefetched lines, kept until a demand access uses
+     * them or newer ones replace them, to count prefetches that were in
+     * time, late or unused
+     */
+    template <int SIZE>
+    struct PrefetchedLines {
+        PrefetchedLine lines[SIZE];
+        int next_line;
+        int inflight;
+
+        void reset_lines() {
+            foreach (i, SIZE) lines[i].valid = 0;
+            next_line = 0;
+            inflight = 0;
+        }
+
+        PrefetchedLine* find_line(W64 line) {
+            foreach (i, SIZE) {
+                if (lines[i].valid && lines[i].line == line) return &lines[i];
+            }
+            return NULL;
+        }
+
+        /* Track a prefetched line, true if it replaced an unused one */
+        bool add_line(W64 line) {
+            PrefetchedLine& entry = lines[next_line];
+            next_line = add_index_modulo(next_line, +1, SIZE);
+
+            bool unused = entry.valid;
+            remove_line(entry);
+            entry.line = line;
+            entry.valid = 1;
+            entry.ready = 0;
+            inflight++;
+            return unused;
+        }
+
+        void remove_line(PrefetchedLine& entry) {
+            if (entry.valid && !entry.ready) inflight--;
+            entry.valid = 0;
+        }
+
+        /* Mark line ready when its prefetch completes */
+        void fill_line(W64 line) {
+            PrefetchedLine* entry = find_line(line);
+            if (!entry || entry->ready) return;
+
+            entry->ready = 1;
+            inflight--;
+        }
+    };
+
+    /**
+     * @brief Fetch target queue of the fetch directed instruction prefetcher
+     *
+     * With 'fdip_depth' set, the queue runs ahead of fetch over the basic
+     * blocks it predicts fetch goes to next, up to fdip_depth blocks, and
+     * prefetches their lines into the L1-I while fetch waits on misses.
+     * The next block is the one fetched after the tail block last time,
+     * from the successor links of the basic block cache: the branch
+     * predictors update their history when they predict, so they can only
+     * be used by fetch itself. Runahead stops at a block without a linked
+     * successor.
+     *
+     * Fetch pops the head when it enters the block there and flushes the
+     * queue when it goes anywhere else. tail is the last block queued,
+     * valid while epoch is the link_epoch of the basic block cache.
+     */
+    struct FetchTargetQueue: public PrefetchedLines<FDIP_TRACKED_LINES> {
+        FetchTarget targets[FTQ_SIZE];
+        int head;
+        int count;
+        int prefetch; /* first entry with lines left to prefetch */
+        BasicBlock* tail;
+        W32 epoch;
+
+        void reset() {
+            flush();
+            reset_lines();
+        }
+
+        void flush() {
+            head = 0;
+            count = 0;
+            prefetch = 0;
+            tail = NULL;
+            epoch = 0;
+        }
+
+        FetchTarget& operator [](int i) {
+            return targets[add_index_modulo(head, i, FTQ_SIZE)];
+        }
+
+        void push(BasicBlock* bb, W32 link_epoch) {
+            (*this)[count++].init(*bb);
+            tail = bb;
+            epoch = link_epoch;
+        }
+
+        void pop() {
+            head = add_index_modulo(head, +1, FTQ_SIZE);
+            count--;
+            prefetch = max(prefetch - 1, 0);
+        }
+    };
+
+    /**
+     * @brief Store pre-executed by runahead, read by later loads of the
+     * episode
+     */
+    struct RunaheadStore {
+        W64 virtaddr;
+        W64 data;
+        W8 size;
+        bool invalid; /* data not known */
+    };
+
+    /**
+     * @brief Runahead pre-execution of a thread under a long latency load
+     *
+     * With 'runahead_depth' set, once the load at the ROB head has waited
+     * LONG_LATENCY_LOAD_CYCLES for the dcache the thread enters runahead:
+     * the values of the architectural registers at rename are checkpointed
+     * from the speculative rename table, those not yet computed marked
+     * FLAG_INV, and uops after the last one renamed are pre-executed on
+     * them FETCH_WIDTH a cycle, up to runahead_depth uops. First come the
+     * uops in the fetch queue, then those of the cached basic blocks after
+     * it. A uop with an INV source gets an INV result. Loads of a line in
+     * the L1-D read their value functionally; the others send a prefetch
+     * of their line and get an INV result, so only loads independent of
+     * the misses are prefetched. Stores are kept for later loads of the
+     * episode and never written. Branches with known operands go where
+     * they compute, the others where they went last time.
+     *
+     * The episode ends when the load leaves the ROB head or fetch is
+     * redirected; the rename table, ROB and fetch are never changed, so
+     * nothing has to be restored. Runahead stops early at a barrier, an
+     * unknown indirect target or a block not in the basic block cache.
+     * Rename marks the results of uops it takes from the fetch queue
+     * before they are pre-executed INV.
+     */
+    struct Runahead: public PrefetchedLines<RUNAHEAD_TRACKED_LINES> {
+        bool active;
+        bool stopped;
+        W64 load_uuid; /* load at ROB head the episode waits on */
+        int uops;
+
+        W64 regs[TRANSREG_COUNT];
+        W16 flags[TRANSREG_COUNT];
+
+        /* Next uop: fetch queue entry of uuid, then index of bb at rip */
+        bool in_fetchq;
+        W64 next_uuid;
+        BasicBlock* bb;
+        int bbindex;
+        W32 epoch;
+        W64 rip;
+
+        RunaheadStore stores[RUNAHEAD_STORES];
+        int store_count;
+
+        void reset() {
+            active = 0;
+            stopped = 0;
+            reset_lines();
+        }
+    };
+
     enum {
         ROB_STATE_READY = (1 << 0),
         ROB_STATE_IN_ISSUE_QUEUE = (1 << 1),
@@ -890,15 +1236,15 @@ namespace OOO_CORE_MODEL {
       */
 
     template <int tlbid, int size>
-      struct TranslationLookasideBuffer: public FullyAssociativeTagsNbitOneHot<size, 40> {
-        typedef FullyAssociativeTagsNbitOneHot<size, 40> base_t;
+      struct TranslationLookasideBuffer: public FullyAssociativeTagsNbitOneHot<size, 44> {
+        typedef FullyAssociativeTagsNbitOneHot<size, 44> base_t;
         TranslationLookasideBuffer(): base_t() { }
 
         void reset() {
           base_t::reset();
         }
 
-        /* Get the 40-bit TLB tag (36 bit virtual page ID plus 4 bit threadid) */
+        /* Get the 44-bit TLB tag (36 bit virtual page ID plus 8 bit TLB id) */
         static W64 tagof(W64 addr, W64 threadid) {
           return bits(addr, 12, 36) | (threadid << 36);
         }
@@ -926,9 +1272,9 @@ namespace OOO_CORE_MODEL {
           return size;
         }
 
-        int flush_thread(W64 threadid) {
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
           W64 tag = threadid << 36;
-          W64 tagmask = 0xfULL << 36;
+          W64 tagmask = mask << 36;
           bitvec<size> slotmask = base_t::masked_match(tag, tagmask);
           int n = slotmask.popcount();
           base_t::masked_invalidate(slotmask);
@@ -947,6 +1293,13 @@ namespace OOO_CORE_MODEL {
 
     typedef TranslationLookasideBuffer<0, DTLB_SIZE> DTLB;
     typedef TranslationLookasideBuffer<1, ITLB_SIZE> ITLB;
+    typedef LargePageTLBs<DTLB_2M_SIZE, DTLB_1G_SIZE> DTLBLarge;
+    typedef LargePageTLBs<ITLB_2M_SIZE, ITLB_1G_SIZE> ITLBLarge;
+    typedef SecondLevelTLB<STLB_SETS, STLB_WAYS> STLB;
+    typedef PageWalkCache<PWC_SIZE> PWC;
+
+    typedef UopCache<UOP_CACHE_SETS, UOP_CACHE_WAYS, UOP_CACHE_WINDOW_SHIFT> UopCacheType;
+    typedef LoopStreamDetector<LSD_SIZE, LSD_LOCK_ITERATIONS> LSD;
 
     /**
      * @brief represent a OOO  thread in SMT core.
@@ -989,15 +1342,43 @@ namespace OOO_CORE_MODEL {
         StateList rob_memory_fence_list;                     // mf uops only: wait for memory fence to reach head of LSQ before completing
         StateList rob_ready_to_commit_queue;                 // Ready to commit
 
-        Queue<ReorderBufferEntry, ROB_SIZE> ROB;
+        /*
+         * Completion wheel: ROBs on rob_issued_list, bucketed by the
+         * complete() tick on which their cycles_left runs out. Events
+         * whose ROB has since left the list or been rescheduled are
+         * recognized by a stale seq and dropped.
+         */
+        struct CompletionEvent {
+            ReorderBufferEntry* rob;
+            W64 tick;
+            W32 seq;
+        };
+
+        dynarray<CompletionEvent> completion_wheel[MAX_CLUSTERS][COMPLETION_WHEEL_SIZE];
+        W64 complete_tick[MAX_CLUSTERS];
+        W32 completion_seq;
 
-        Queue<LoadStoreQueueEntry, LSQ_SIZE> LSQ;
+        void schedule_completion(ReorderBufferEntry& rob);
+
+        Queue<ReorderBufferEntry, MAX_ROB_SIZE> ROB;
+
+        Queue<LoadStoreQueueEntry, MAX_LSQ_SIZE> LSQ;
+        LSQAddressFilter lsq_filter;
         RegisterRenameTable specrrt;
         RegisterRenameTable commitrrt;
 
         DTLB dtlb;
         ITLB itlb;
+        DTLBLarge dtlb_large;
+        ITLBLarge itlb_large;
         void setupTLB();
+        bool probe_tlb(Waddr virtaddr, bool is_icache);
+        void insert_tlb(Waddr virtaddr, bool is_icache);
+
+        /* TLB tags of this thread's entries, threadid and address space */
+        TLBAddressSpaces address_spaces;
+        W8 tlbid;
+        bool switch_address_space();
         W64 itlb_miss_init_cycle;
         bool in_tlb_walk;
 
@@ -1014,29 +1395,70 @@ namespace OOO_CORE_MODEL {
 
         // Last block in icache we fetched into our buffer
         W64 current_icache_block;
+
+        // Fetch directed instruction prefetch
+        FetchTargetQueue ftq;
+        void fdip_runahead();
+        void fdip_enter_block(BasicBlock* bb);
+        void fdip_demand(W64 physaddr);
+        void fdip_fill(W64 physaddr);
+
+        // Runahead pre-execution under long latency loads
+        Runahead runahead;
+        void runahead_cycle();
+        void runahead_enter(ReorderBufferEntry& load);
+        void runahead_exit();
+        bool runahead_step();
+        bool runahead_execute(const TransOp& uop, const UopDescriptor& desc,
+                W64 rip, W64& target);
+        void runahead_load(const TransOp& uop, W64 rip, W64 ra, W64 rb,
+                IssueState& state);
+        bool runahead_prefetch(W64 physaddr, W64 rip);
+        void runahead_write(const TransOp& uop, W64 data, W16 flags);
+        void runahead_skip(const FetchBufferEntry& fetchbuf);
+        void runahead_demand(W64 physaddr);
+
+        // Decoded uop cache and loop stream detector of the frontend
+        UopCacheType uop_cache;
+        LSD lsd;
+        W64 current_fetch_window;
+        bool current_fetch_window_decoded;
+        void flush_decoded_uops();
         W64 fetch_uuid;
         int loads_in_flight;
         int stores_in_flight;
+        int branches_in_flight;
         bool prev_interrupts_pending;
         bool handle_interrupt_at_next_eom;
+        ContextEvents events; /* interrupt state is current for it */
         bool stop_at_next_eom;
 
         W64 last_commit_at_cycle;
         bool smc_invalidate_pending;
-        RIPVirtPhys smc_invalidate_rvp;
         W64 chk_recovery_rip;
 
         TransOpBuffer unaligned_ldst_buf;
         LoadStoreAliasPredictor lsap;
+        StoreSets store_sets;
+        Criticality criticality;
         int loads_in_this_cycle;
         W64 load_to_store_parallel_forwarding_buffer[LOAD_FU_COUNT];
 
         W64 consecutive_commits_inside_spinlock;
         W64 pause_counter;
 
+        /* With -spin-ff, a spinning thread doesn't fetch until woken */
+        SpinLoopDetector spin;
+
+        /* Top-down commit slot accounting, see topdown.h */
+        ReorderBufferEntry* topdown_blocker; /* uop that stopped commit */
+        bool topdown_refill; /* refetching after a redirect */
+        W64 topdown_refill_uuid; /* first uop fetched after the redirect */
+
         // statistics:
         W64 total_uops_committed;
         W64 total_insns_committed;
+        W32 trace_id; /* component id of this thread in trace records */
         int dispatch_deadlock_countdown;
 #ifdef MULTI_IQ
         int issueq_count[4]; // number of occupied issuequeue entries
@@ -1056,6 +1478,12 @@ namespace OOO_CORE_MODEL {
 
         ThreadContext(OooCore& core_, W8 threadid_, Context& ctx_);
 
+        /* The ROB and LSQ are on huge pages with -host-huge-pages */
+        static void* operator new(size_t bytes) { return host_alloc(bytes); }
+        static void operator delete(void *mem, size_t bytes) {
+            host_free(mem, bytes);
+        }
+
         int commit();
         int writeback(int cluster);
         int transfer(int cluster);
@@ -1063,6 +1491,8 @@ namespace OOO_CORE_MODEL {
         int dispatch();
         void frontend();
         void rename();
+        int rename_elimination(const TransOp& uop);
+        void execute_at_rename(ReorderBufferEntry& rob);
         bool fetch();
         void tlbwalk();
 
@@ -1079,6 +1509,12 @@ namespace OOO_CORE_MODEL {
         void redispatch_deadlock_recovery();
         void flush_mem_lock_release_list(int start = 0);
         int get_priority() const;
+        ReorderBufferEntry* find_long_latency_load();
+        bool fetch_gated();
+        void spin_wait();
+        void spin_poll();
+        void spin_wake(int reason);
+        void topdown_account(int rc, int committed);
 
         void dump_smt_state(ostream& os);
         void print_smt_state(ostream& os);
@@ -1113,6 +1549,55 @@ namespace OOO_CORE_MODEL {
         int threadcount;
         ThreadContext** threads;
 
+        /* Second level TLB and page walk caches shared by all threads */
+        STLB stlb;
+        PWC pwc;
+
+        /* Type of branch predictor of each thread */
+        stringbuf branchpred_type;
+
+        /* SMT fetch policy, ROB/LSQ partitioning and threads fetched per cycle */
+        int fetch_policy;
+        int smt_partition;
+        int fetch_threads;
+        bool smt_partition_full(int tid, bool lsq) const;
+
+        /* Memory dependence predictor of each thread */
+        int memdep_predictor;
+
+        /* Cluster steering policy and its weight of a pending operand */
+        int cluster_steering;
+        int steering_bias;
+
+        /* Blocks the fetch target queue runs ahead of fetch, 0 disables it */
+        int fdip_depth;
+
+        /* Uops pre-executed a runahead episode, 0 disables runahead */
+        int runahead_depth;
+
+        /* FUSION_ kinds of uops sharing a rename, dispatch and commit slot */
+        int fusion;
+
+        /* RENAME_ELIM_ kinds of uops removed at rename */
+        int rename_elim;
+
+        /*
+         * The low part of a load split across two lines sends the high
+         * part's line with its own request and completes when both are in
+         */
+        bool split_line_batching;
+
+        /*
+         * Entries of ROB and LSQ per thread, issue queue and int and fp
+         * register files used, from the core's options up to MAX_ sizes
+         */
+        int rob_size;
+        int ldq_size;
+        int stq_size;
+        int lsq_size;
+        int issueq_size;
+        int phys_reg_file_size;
+
         ListOfStateLists rob_states;
         ListOfStateLists lsq_states;
 
@@ -1128,12 +1613,12 @@ namespace OOO_CORE_MODEL {
           * Issue Queues (one per cluster)
           */
 
-#define declare_issueq_templates template struct IssueQueue<ISSUE_QUEUE_SIZE>
+#define declare_issueq_templates template struct IssueQueue<MAX_ISSUE_QUEUE_SIZE>
 #ifdef MULTI_IQ
-        IssueQueue<ISSUE_QUEUE_SIZE> issueq_int0;
-        IssueQueue<ISSUE_QUEUE_SIZE> issueq_int1;
-        IssueQueue<ISSUE_QUEUE_SIZE> issueq_ld;
-        IssueQueue<ISSUE_QUEUE_SIZE> issueq_fp;
+        IssueQueue<MAX_ISSUE_QUEUE_SIZE> issueq_int0;
+        IssueQueue<MAX_ISSUE_QUEUE_SIZE> issueq_int1;
+        IssueQueue<MAX_ISSUE_QUEUE_SIZE> issueq_ld;
+        IssueQueue<MAX_ISSUE_QUEUE_SIZE> issueq_fp;
 
         int reserved_iq_entries[4];  /* this is the total number of iq entries reserved per thread. */
          /* Instantiate any issueq sizes used above: */
@@ -1172,7 +1657,7 @@ namespace OOO_CORE_MODEL {
         }
 
 #else
-        IssueQueue<ISSUE_QUEUE_SIZE> issueq_all;
+        IssueQueue<MAX_ISSUE_QUEUE_SIZE> issueq_all;
 
         int reserved_iq_entries;  /// this is the total number of iq entries reserved per thread.
 
@@ -1219,9 +1704,9 @@ namespace OOO_CORE_MODEL {
 			/*
 			 * Physical register files
 			 */
-            physregfiles[0]("int", get_coreid(), 0, PHYS_REG_FILE_SIZE, this);
-            physregfiles[1]("fp", get_coreid(), 1, PHYS_REG_FILE_SIZE, this);
-            physregfiles[2]("st", get_coreid(), 2, STQ_SIZE * threadcount, this);
+            physregfiles[0]("int", get_coreid(), 0, phys_reg_file_size, this);
+            physregfiles[1]("fp", get_coreid(), 1, phys_reg_file_size, this);
+            physregfiles[2]("st", get_coreid(), 2, stq_size * threadcount, this);
             physregfiles[3]("br", get_coreid(), 3, MAX_BRANCHES_IN_FLIGHT * threadcount, this);
         }
 
@@ -1256,6 +1741,8 @@ namespace OOO_CORE_MODEL {
 
 		/* Pipeline Stages */
         bool runcycle(void*);
+        W64 get_next_active_cycle();
+        void skip_cycles(W64 cycles);
         void flush_pipeline();
         bool fetch();
         void rename();
@@ -1269,14 +1756,55 @@ namespace OOO_CORE_MODEL {
 
         void flush_tlb(Context& ctx);
         void flush_tlb_virt(Context& ctx, Waddr virtaddr);
+        byte start_tlb_walk(ThreadContext& thread, Waddr virtaddr,
+                bool is_icache);
+        void finish_tlb_walk(ThreadContext& thread, Waddr virtaddr);
+
+		/* Functional warmup */
+        ThreadContext* get_thread(Context& ctx);
+        bool runs_context(Context& ctx);
+        void warm_tlb(Context& ctx, Waddr virtaddr, bool is_icache);
+        void warm_branch(Context& ctx, const TransOp& uop, W64 ripafter,
+                W64 target);
+        void transfer_warm_state(WarmState& state);
+        void get_warmup_counts(Stats* stats, WarmupCounts& counts);
+        bool get_pmu_counts(Context& ctx, Stats* stats, W64 *counts);
 
 		/* Cache Signals and Callbacks */
         Signal dcache_signal;
         Signal icache_signal;
+        Signal runahead_signal;
 		Signal run_cycle;
 
+        /* Host time of groups of pipeline stages with -host-perf */
+        HostPerfCounter *perf_commit;
+        HostPerfCounter *perf_issue;
+        HostPerfCounter *perf_dispatch;
+        HostPerfCounter *perf_fetch;
+
         bool dcache_wakeup(void *arg);
         bool icache_wakeup(void *arg);
+        bool runahead_wakeup(void *arg);
+        bool load_wakeup(W8 threadid, int robid, W64 physaddr, W64 uuid,
+                Memory::CacheType level = Memory::L1_D_CACHE);
+
+        /*
+         * Loads that hit in the L1 (MemoryHierarchy::access_hit), woken
+         * up by the core once their latency is over instead of through
+         * a request, the CPU controller queue and dcache_signal. Kept in
+         * issue order; the L1 latency is fixed, so also in cycle order.
+         */
+        struct LoadHit {
+            W64 cycle;
+            W64 physaddr;
+            W64 uuid;
+            int robid;
+            W8 threadid;
+        };
+
+        dynarray<LoadHit> load_hits;
+        int load_hits_head;
+        void wakeup_load_hits();
 
 		/* Debugging */
         void dump_state(ostream& os);
@@ -1294,6 +1822,11 @@ namespace OOO_CORE_MODEL {
 		void dump_configuration(YAML::Emitter &out) const;
     };
 
+    inline PhysicalRegister* RegisterRenameTable::get(int archreg) const {
+        W16 handle = regs[archreg];
+        return &core->physregfiles[handle / MAX_PHYS_REG_FILE_SIZE][handle % MAX_PHYS_REG_FILE_SIZE];
+    }
+
     /**
      * @brief Checker - saved stores to compare after executing emulated
      * instruction
@@ -1312,20 +1845,6 @@ namespace OOO_CORE_MODEL {
 
     void add_checker_store(LoadStoreQueueEntry* lsq, W8 sizeshift);
 
-    extern CycleTimer cttotal;
-    extern CycleTimer ctfetch;
-    extern CycleTimer ctdecode;
-    extern CycleTimer ctrename;
-    extern CycleTimer ctfrontend;
-    extern CycleTimer ctdispatch;
-    extern CycleTimer ctissue;
-    extern CycleTimer ctissueload;
-    extern CycleTimer ctissuestore;
-    extern CycleTimer ctcomplete;
-    extern CycleTimer cttransfer;
-    extern CycleTimer ctwriteback;
-    extern CycleTimer ctcommit;
-
 #ifdef DECLARE_STRUCTURES
 	/*
 	 * The following configuration has two integer/store clusters with a single cycle
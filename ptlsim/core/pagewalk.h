@@ -0,0 +1,414 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef PAGEWALK_H
+#define PAGEWALK_H
+
+#include <ptlsim.h>
+#include <logic.h>
+
+namespace Core {
+
+    /*
+     * TLB, STLB and page walk cache tags have a TLB id at bit 36: the 4 bit
+     * threadid and above it the thread's address space id (see
+     * TLBAddressSpaces), 0 unless the core has 'tlb_asids'.
+     */
+    static const int TLB_THREAD_BITS = 4;
+    static const int TLB_ASID_BITS = 4;
+    static const int TLB_MAX_ASIDS = 1 << TLB_ASID_BITS;
+    static const W64 TLB_THREAD_MASK = (1ULL << TLB_THREAD_BITS) - 1;
+    static const W64 TLB_ID_MASK =
+        (1ULL << (TLB_THREAD_BITS + TLB_ASID_BITS)) - 1;
+
+    /**
+     * @brief Address space ids of one thread's TLB entries, like PCIDs
+     *
+     * Set 'tlb_asids' in the core's machine config options to the number
+     * of ids per thread, at most TLB_MAX_ASIDS. Entries are then tagged
+     * with the id of the page table root (CR3) they were filled from, and
+     * a CR3 write switches ids instead of flushing TLBs, STLB and page walk
+     * caches. A new root takes the id of the least recently used one,
+     * whose entries are flushed, like Linux does with its per CPU PCIDs.
+     * Flushes that don't change CR3 (CR3 reload, CR4.PGE toggle) drop
+     * everything as without ids.
+     *
+     * The QEMU CPU has no PCID or INVPCID, so guests can't tag address
+     * spaces themselves: a root keeps its id until it is recycled.
+     */
+    struct TLBAddressSpaces {
+        W64 roots[TLB_MAX_ASIDS];
+        W64 lastUse[TLB_MAX_ASIDS];
+        int count;
+        int current;
+        W64 clock;
+
+        TLBAddressSpaces() { setup(0); }
+
+        void setup(int count_) {
+            count = count_;
+            reset();
+        }
+
+        void reset() {
+            foreach (i, TLB_MAX_ASIDS) {
+                roots[i] = (W64)-1;
+                lastUse[i] = 0;
+            }
+            current = 0;
+            clock = 0;
+        }
+
+        bool enabled() const { return count > 0; }
+
+        W64 root() const { return roots[current]; }
+
+        /* TLB id of the thread's entries in its current address space */
+        W8 tlb_id(W8 threadid) const {
+            return threadid | (current << TLB_THREAD_BITS);
+        }
+
+        /**
+         * @brief Switch to the address space of page table root 'root'
+         *
+         * @return true if root still had its id, false if it took the id
+         * of another root whose entries have to be flushed
+         */
+        bool switch_to(W64 root) {
+            int victim = 0;
+
+            foreach (i, count) {
+                if (roots[i] == root) {
+                    current = i;
+                    lastUse[i] = ++clock;
+                    return true;
+                }
+                if (lastUse[i] < lastUse[victim])
+                    victim = i;
+            }
+
+            roots[victim] = root;
+            current = victim;
+            lastUse[victim] = ++clock;
+            return false;
+        }
+    };
+
+    /* Written under the thread's node of a core with 'tlb_asids' */
+    struct TLBSpaceStats : public Statable
+    {
+        StatObj<W64> switches;
+        StatObj<W64> reused;
+        StatObj<W64> recycled;
+        StatObj<W64> flushes;
+
+        TLBSpaceStats(const char *name, Statable *parent)
+            : Statable(name, parent)
+              , switches("switches", this)
+              , reused("reused", this)
+              , recycled("recycled", this)
+              , flushes("flushes", this)
+        {}
+    };
+
+    /**
+     * @brief Set associative second level TLB shared by DTLB and ITLB
+     *
+     * Tags are same as first level TLB tags (36 bit virtual page ID plus
+     * TLB id), sets are indexed by low bits of virtual page ID. A core
+     * built with zero sets doesn't have a STLB and it never hits.
+     */
+    template <int setcount, int waycount>
+    struct SecondLevelTLB {
+        static const bool ENABLED = (setcount > 0);
+        static const int SETS = (setcount > 0) ? setcount : 1;
+
+        FullyAssociativeTags<W64, waycount> sets[SETS];
+
+        SecondLevelTLB() { reset(); }
+
+        void reset() {
+            foreach (i, SETS) {
+                sets[i].reset();
+            }
+        }
+
+        static W64 tagof(W64 addr, W64 threadid) {
+            return bits(addr, 12, 36) | (threadid << 36);
+        }
+
+        static int setof(W64 tag) {
+            return lowbits(tag, log2(SETS));
+        }
+
+        bool probe(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            W64 tag = tagof(addr, threadid);
+            return (sets[setof(tag)].probe(tag) >= 0);
+        }
+
+        bool insert(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            W64 tag = tagof(addr, threadid);
+            W64 oldtag = 0;
+            sets[setof(tag)].select(tag, oldtag);
+            return (oldtag != tag);
+        }
+
+        int flush_all() {
+            reset();
+            return SETS * waycount;
+        }
+
+        /* All address spaces of a thread, or with TLB_ID_MASK only one */
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
+            int n = 0;
+            foreach (i, SETS) {
+                foreach (way, waycount) {
+                    W64 tag = sets[i][way];
+                    if (tag != sets[i].INVALID &&
+                            ((tag >> 36) & mask) == threadid) {
+                        sets[i].invalidate_way(way);
+                        n++;
+                    }
+                }
+            }
+            return n;
+        }
+
+        int flush_virt(Waddr virtaddr, W64 threadid) {
+            if (!ENABLED) return 0;
+            W64 tag = tagof(virtaddr, threadid);
+            return (sets[setof(tag)].invalidate(tag) >= 0);
+        }
+    };
+
+    /**
+     * @brief Fully associative TLB for one large page size
+     *
+     * Tags are virtual address bits above 'pageshift' plus TLB id.
+     * A core built with zero entries doesn't have this array and its large
+     * pages are cached as 4KB pages in first level TLB.
+     */
+    template <int size, int pageshift>
+    struct LargePageTLB {
+        static const bool ENABLED = (size > 0);
+        static const int ENTRIES = (size > 0) ? size : 1;
+
+        FullyAssociativeTags<W64, ENTRIES> tags;
+
+        LargePageTLB() { reset(); }
+
+        void reset() {
+            tags.reset();
+        }
+
+        static W64 tagof(W64 addr, W64 threadid) {
+            return bits(addr, pageshift, 48 - pageshift) | (threadid << 36);
+        }
+
+        bool probe(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            return (tags.probe(tagof(addr, threadid)) >= 0);
+        }
+
+        bool insert(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            W64 tag = tagof(addr, threadid);
+            W64 oldtag = 0;
+            tags.select(tag, oldtag);
+            return (oldtag != tag);
+        }
+
+        int flush_all() {
+            reset();
+            return ENTRIES;
+        }
+
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
+            int n = 0;
+            foreach (way, ENTRIES) {
+                if (tags[way] != tags.INVALID &&
+                        ((tags[way] >> 36) & mask) == threadid) {
+                    tags.invalidate_way(way);
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        int flush_virt(Waddr virtaddr, W64 threadid) {
+            if (!ENABLED) return 0;
+            return (tags.invalidate(tagof(virtaddr, threadid)) >= 0);
+        }
+    };
+
+    /**
+     * @brief 2MB and 1GB page arrays that sit next to a first level TLB
+     *
+     * 4MB pages of non PAE page tables, and 1GB pages of a core without
+     * 1GB array, are cached as the 2MB page that contains missed address.
+     */
+    template <int size2m, int size1g>
+    struct LargePageTLBs {
+        static const bool ENABLED = (size2m > 0 || size1g > 0);
+
+        LargePageTLB<size2m, 21> tlb2m;
+        LargePageTLB<size1g, 30> tlb1g;
+
+        void reset() {
+            tlb2m.reset();
+            tlb1g.reset();
+        }
+
+        bool probe(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            return tlb2m.probe(addr, threadid) || tlb1g.probe(addr, threadid);
+        }
+
+        /**
+         * @brief Insert a page of size (1 << pageshift)
+         *
+         * @return false if this core has no array for that page size, so
+         * caller has to insert it in 4KB TLB
+         */
+        bool insert(W64 addr, W8 threadid, int pageshift) {
+            if (pageshift >= 30 && tlb1g.ENABLED) {
+                tlb1g.insert(addr, threadid);
+                return true;
+            }
+
+            if (pageshift >= 21 && tlb2m.ENABLED) {
+                tlb2m.insert(addr, threadid);
+                return true;
+            }
+
+            return false;
+        }
+
+        int flush_all() {
+            return tlb2m.flush_all() + tlb1g.flush_all();
+        }
+
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
+            return tlb2m.flush_thread(threadid, mask) +
+                tlb1g.flush_thread(threadid, mask);
+        }
+
+        int flush_virt(Waddr virtaddr, W64 threadid) {
+            return tlb2m.flush_virt(virtaddr, threadid) +
+                tlb1g.flush_virt(virtaddr, threadid);
+        }
+    };
+
+    /**
+     * @brief Caches of upper level page table entries
+     *
+     * One fully associative cache per page table level above the leaf PTE
+     * (PD, PDP and PML4 entries). An entry of level 'n' is tagged by the
+     * virtual address bits it translates, so a hit lets a walk skip all
+     * directory reads down to level 'n - 1'. A core built with zero entries
+     * always walks from the root.
+     */
+    template <int size>
+    struct PageWalkCache {
+        static const bool ENABLED = (size > 0);
+        static const int ENTRIES = (size > 0) ? size : 1;
+        static const int MAX_LEVELS = 4;
+
+        /* Index 0 caches level 2 (PD) entries */
+        FullyAssociativeTags<W64, ENTRIES> levels[MAX_LEVELS - 1];
+
+        PageWalkCache() { reset(); }
+
+        void reset() {
+            foreach (i, MAX_LEVELS - 1) {
+                levels[i].reset();
+            }
+        }
+
+        /*
+         * 2 level (non PAE) page tables use 4MB page directory entries, PAE
+         * and long mode tables translate 9 bits per level above 4KB pages.
+         */
+        static W64 tagof(W64 addr, int level, int level_count, W64 threadid) {
+            int shift = (level_count == 2) ? 22 : 12 + 9 * (level - 1);
+            return bits(addr, shift, 48 - shift) | (threadid << 36);
+        }
+
+        /**
+         * @brief Level from where a walk of addr has to read page table
+         *
+         * @param level_count Number of page table levels of the Context
+         *
+         * @return level_count if no entry is cached, 1 if only the leaf PTE
+         * has to be read
+         */
+        int start_level(W64 addr, W8 threadid, int level_count) {
+            if (!ENABLED) return level_count;
+
+            for (int level = 2; level <= level_count; level++) {
+                W64 tag = tagof(addr, level, level_count, threadid);
+                if (levels[level - 2].probe(tag) >= 0)
+                    return level - 1;
+            }
+
+            return level_count;
+        }
+
+        /* Install all directory entries read by a completed walk */
+        void fill(W64 addr, W8 threadid, int level_count) {
+            if (!ENABLED) return;
+
+            for (int level = 2; level <= level_count; level++) {
+                levels[level - 2].select(tagof(addr, level, level_count,
+                            threadid));
+            }
+        }
+
+        int flush_all() {
+            reset();
+            return (MAX_LEVELS - 1) * ENTRIES;
+        }
+
+        int flush_thread(W64 threadid, W64 mask = TLB_THREAD_MASK) {
+            int n = 0;
+            foreach (i, MAX_LEVELS - 1) {
+                foreach (way, ENTRIES) {
+                    W64 tag = levels[i][way];
+                    if (tag != levels[i].INVALID &&
+                            ((tag >> 36) & mask) == threadid) {
+                        levels[i].invalidate_way(way);
+                        n++;
+                    }
+                }
+            }
+            return n;
+        }
+
+        /*
+         * INVLPG only has to drop cached PTEs, but like hardware that
+         * doesn't track which directory entries map a page we drop the
+         * whole walk of virtaddr.
+         */
+        int flush_virt(Waddr virtaddr, W64 threadid, int level_count) {
+            if (!ENABLED) return 0;
+
+            int n = 0;
+            for (int level = 2; level <= level_count; level++) {
+                W64 tag = tagof(virtaddr, level, level_count, threadid);
+                n += (levels[level - 2].invalidate(tag) >= 0);
+            }
+            return n;
+        }
+    };
+
+};
+
+#endif // PAGEWALK_H
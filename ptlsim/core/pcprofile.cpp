@@ -0,0 +1,43 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <pcprofile.h>
+
+using namespace Core;
+
+bool Core::pc_profile_enabled = false;
+
+namespace {
+    /* Most total latency first */
+    struct LatencyComparator {
+        int operator ()(const PcProfileEntry *a,
+                const PcProfileEntry *b) const {
+            if (a->latency == b->latency) return 0;
+            return (a->latency > b->latency) ? -1 : +1;
+        }
+    };
+};
+
+int PcProfileTable::top(PcProfileEntry **list, int count)
+{
+    dynarray<PcProfileEntry*> used;
+
+    foreach (i, SETS) {
+        foreach (j, WAYS) {
+            if (entries[i][j].rip)
+                used.push(&entries[i][j]);
+        }
+    }
+
+    sort(used.data, used.length, LatencyComparator());
+
+    int n = min(count, (int)used.length);
+    foreach (i, n) list[i] = used[i];
+    return n;
+}
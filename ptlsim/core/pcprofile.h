@@ -0,0 +1,161 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef PCPROFILE_H
+#define PCPROFILE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+#include <cacheConstants.h>
+
+namespace Core {
+
+    /* Set by '-pc-profile' */
+    extern bool pc_profile_enabled;
+
+    struct PcProfileEntry {
+        W64 rip;
+        W64 accesses;
+        W64 l1_misses;
+        W64 l2_misses;
+        W64 llc_misses;
+        W64 dtlb_misses;
+        W64 completed;
+        W64 latency;
+        W64 max_latency;
+
+        void reset(W64 r = 0) {
+            rip = r;
+            accesses = l1_misses = l2_misses = llc_misses = 0;
+            dtlb_misses = completed = latency = max_latency = 0;
+        }
+
+        W64 avg_latency() const {
+            return completed ? latency / completed : 0;
+        }
+    };
+
+    /**
+     * @brief Per-rip profile of a core's loads and stores ('-pc-profile')
+     *
+     * A set associative table indexed by a hash of the rip, so memory use
+     * is bounded however many instructions run. When a set is full the
+     * entry with fewest accesses is replaced, which keeps the instructions
+     * that access memory most.
+     *
+     * Cores call access() when a load or store accesses the cache,
+     * dtlb_miss() when it misses the DTLB and complete() once its data
+     * arrives, with the deepest level the request reached.
+     */
+    struct PcProfileTable {
+        static const int SETS = 256;
+        static const int WAYS = 4;
+
+        PcProfileEntry entries[SETS][WAYS];
+        W64 evictions;
+
+        PcProfileTable() { reset(); }
+
+        void reset() {
+            foreach (i, SETS) foreach (j, WAYS) entries[i][j].reset();
+            evictions = 0;
+        }
+
+        PcProfileEntry& lookup(W64 rip) {
+            PcProfileEntry *set = entries[(rip ^ (rip >> 8) ^ (rip >> 16)) % SETS];
+            PcProfileEntry *victim = &set[0];
+
+            foreach (i, WAYS) {
+                if likely (set[i].rip == rip) return set[i];
+                if (set[i].accesses < victim->accesses) victim = &set[i];
+            }
+
+            if (victim->rip) evictions++;
+            victim->reset(rip);
+            return *victim;
+        }
+
+        void access(W64 rip) {
+            lookup(rip).accesses++;
+        }
+
+        void dtlb_miss(W64 rip) {
+            lookup(rip).dtlb_misses++;
+        }
+
+        void complete(W64 rip, Memory::CacheType level, W64 latency) {
+            PcProfileEntry& e = lookup(rip);
+            e.l1_misses += (level >= Memory::L2_CACHE);
+            e.l2_misses += (level >= Memory::L3_CACHE);
+            e.llc_misses += (level == Memory::MAIN_MEMORY);
+            e.completed++;
+            e.latency += latency;
+            e.max_latency = max(e.max_latency, latency);
+        }
+
+        /* Fill list with the count entries of most total latency */
+        int top(PcProfileEntry **list, int count);
+    };
+
+    struct PcProfileRowStats : public Statable
+    {
+        StatObj<W64> rip;
+        StatObj<W64> accesses;
+        StatObj<W64> l1_misses;
+        StatObj<W64> l2_misses;
+        StatObj<W64> llc_misses;
+        StatObj<W64> dtlb_misses;
+        StatObj<W64> avg_latency;
+        StatObj<W64> max_latency;
+
+        PcProfileRowStats(stringbuf &name, Statable *parent)
+            : Statable(name, parent)
+              , rip("rip", this)
+              , accesses("accesses", this)
+              , l1_misses("l1_misses", this)
+              , l2_misses("l2_misses", this)
+              , llc_misses("llc_misses", this)
+              , dtlb_misses("dtlb_misses", this)
+              , avg_latency("avg_latency", this)
+              , max_latency("max_latency", this)
+        {}
+    };
+
+    /*
+     * The TOP instructions with most total latency in the 'pc_profile'
+     * node of the core, dumped at the end of the run:
+     *
+     *   pc_profile:
+     *     evictions: ..
+     *     top0: {rip: .., accesses: .., l1_misses: .., ..}
+     */
+    struct PcProfileStats : public Statable
+    {
+        static const int TOP = 16;
+
+        StatObj<W64> evictions;
+        PcProfileRowStats *rows[TOP];
+
+        PcProfileStats(Statable *parent)
+            : Statable("pc_profile", parent)
+              , evictions("evictions", this)
+        {
+            foreach (i, TOP) {
+                stringbuf name;
+                name << "top", i;
+                rows[i] = new PcProfileRowStats(name, this);
+            }
+            disable_dump();
+        }
+    };
+
+};
+
+#endif // PCPROFILE_H
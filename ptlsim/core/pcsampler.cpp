@@ -0,0 +1,92 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <pcsampler.h>
+#include <ptlsim.h>
+
+using namespace Core;
+
+PcSampler Core::pc_sampler;
+
+ostream& FoldedStacks::write(ostream& os)
+{
+    Hashtable<W64, Entry, 65536>::Iterator iter(table);
+    KeyValuePair<W64, Entry> *kvp;
+
+    while ((kvp = iter.next())) {
+        const Entry &e = kvp->value;
+
+        os << "cr3_", hexstring(e.cr3, 64);
+        for (int i = e.depth - 1; i >= 0; i--)
+            os << ";0x", hexstring(frames[e.offset + i], 64);
+        os << " ", e.count, endl;
+    }
+
+    return os;
+}
+
+namespace {
+    /* Word of guest memory at virtaddr, false if it can't be read */
+    bool read_stack(Context& ctx, W64 virtaddr, int sizeshift, W64& data)
+    {
+        if (virtaddr <= 0xffff || (virtaddr & ((1 << sizeshift) - 1)))
+            return false;
+
+        int exception = 0;
+        int mmio = 0;
+        PageFaultErrorCode pfec;
+        ctx.check_and_translate(virtaddr, sizeshift, false, false,
+                exception, mmio, pfec);
+        if (exception || mmio)
+            return false;
+
+        data = ctx.loadvirt(virtaddr, sizeshift);
+        return true;
+    }
+};
+
+int PcSampler::walk(Context& ctx, W64 *rips)
+{
+    int n = 0;
+    rips[n++] = ctx.get_cs_eip();
+
+    int sizeshift = (ctx.use64) ? 3 : 2;
+    W64 word = 1 << sizeshift;
+    W64 fp = ctx.regs[REG_rbp];
+    if (!ctx.use64)
+        fp = W32(fp);
+
+    while (n < depth) {
+        W64 ret, next;
+        if (!read_stack(ctx, fp + word, sizeshift, ret) || !ret)
+            break;
+        if (!read_stack(ctx, fp, sizeshift, next))
+            break;
+
+        rips[n++] = ret;
+
+        /* Caller frames are above, anything else isn't a frame */
+        if (next <= fp)
+            break;
+        fp = next;
+    }
+
+    return n;
+}
+
+void PcSampler::sample()
+{
+    W64 rips[MAX_DEPTH];
+
+    foreach (i, contextcount) {
+        Context& ctx = contextof(i);
+        int n = walk(ctx, rips);
+        stacks.add(floor(ctx.cr[3], PAGE_SIZE), rips, n);
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef PCSAMPLER_H
+#define PCSAMPLER_H
+
+#include <globals.h>
+#include <superstl.h>
+
+struct Context;
+
+namespace Core {
+
+    /**
+     * @brief Call stacks counted by address space, in folded form
+     *
+     * Stacks are rips, leaf first as add() takes them. write() puts each
+     * distinct stack on one line, the address space first and the leaf
+     * last, with its count:
+     *
+     *   cr3_0000000001a2b000;0x0000000000401002;...;0x0000000000400a10 42
+     *
+     * which flame graph tools take as is, the rips symbolized per address
+     * space (e.g. addr2line on the binary the CR3 ran). At most 'limit'
+     * distinct stacks are kept, samples of later ones are dropped.
+     */
+    struct FoldedStacks {
+        struct Entry {
+            W64 cr3;
+            W64 count;
+            W32 offset;    /* of the rips in 'frames' */
+            W32 depth;
+        };
+
+        Hashtable<W64, Entry, 65536> table;
+        dynarray<W64> frames;
+        int stacks;
+        int limit;
+        W64 samples;
+        W64 dropped;
+
+        FoldedStacks() : limit(1 << 20) { reset(); }
+
+        void reset() {
+            table.clear(true);
+            frames.clear();
+            stacks = 0;
+            samples = dropped = 0;
+        }
+
+        static W64 hash_of(W64 cr3, const W64 *rips, int depth) {
+            W64 h = 14695981039346656037ULL ^ cr3;
+            foreach (i, depth) {
+                h ^= rips[i];
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+        bool matches(const Entry &e, W64 cr3, const W64 *rips,
+                int depth) const {
+            if (e.cr3 != cr3 || e.depth != W32(depth))
+                return false;
+            foreach (i, depth) {
+                if (frames[e.offset + i] != rips[i])
+                    return false;
+            }
+            return true;
+        }
+
+        /* Count one sample of the stack, false if it was dropped */
+        bool add(W64 cr3, const W64 *rips, int depth) {
+            samples++;
+
+            /* Stacks with the same hash go to the next free keys */
+            W64 key = hash_of(cr3, rips, depth);
+            for (;;) {
+                Entry *entry = table.get(key);
+                if (!entry)
+                    break;
+                if (matches(*entry, cr3, rips, depth)) {
+                    entry->count++;
+                    return true;
+                }
+                key++;
+            }
+
+            if (stacks >= limit) {
+                dropped++;
+                return false;
+            }
+
+            Entry e;
+            e.cr3 = cr3;
+            e.count = 1;
+            e.offset = frames.length;
+            e.depth = depth;
+            foreach (i, depth)
+                frames.push(rips[i]);
+            table.add(key, e);
+            stacks++;
+            return true;
+        }
+
+        ostream& write(ostream& os);
+    };
+
+    /**
+     * @brief Guest profiler of the simulated cycles ('-pc-sample-period')
+     *
+     * Every 'period' cycles each context gets a sample of the rip it
+     * commits next, which is the ROB head it commits or stalls on, and of
+     * up to depth - 1 return addresses found by following its frame
+     * pointer (rbp) through guest memory. The walk stops at a frame that
+     * isn't mapped, isn't above the previous one or has no return address,
+     * so code built without frame pointers only gives its leaf. Samples
+     * are counted by CR3 in a FoldedStacks written to '-pc-sample-file'.
+     */
+    struct PcSampler {
+        static const int MAX_DEPTH = 64;
+
+        FoldedStacks stacks;
+        W64 period;
+        W64 next_cycle;
+        int depth;
+
+        PcSampler() : period(0), next_cycle(0), depth(16) {}
+
+        void setup(W64 period_, int depth_, W64 cycle) {
+            period = period_;
+            depth = max(min(depth_, MAX_DEPTH), 1);
+            next_cycle = period ? ((cycle / period) + 1) * period : 0;
+        }
+
+        void clock(W64 cycle) {
+            if unlikely (period && cycle >= next_cycle) {
+                next_cycle = cycle + period;
+                sample();
+            }
+        }
+
+        void sample();
+
+        /* Rips of ctx's stack into rips, leaf first, returns how many */
+        int walk(Context& ctx, W64 *rips);
+    };
+
+    extern PcSampler pc_sampler;
+
+};
+
+#endif // PCSAMPLER_H
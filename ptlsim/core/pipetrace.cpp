@@ -0,0 +1,14 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <pipetrace.h>
+
+using namespace Core;
+
+PipeTraceWindow Core::pipe_trace;
@@ -0,0 +1,102 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef PIPETRACE_H
+#define PIPETRACE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+namespace Core {
+
+    /**
+     * @brief Cycle window of the uop lifecycle trace ('-pipe-trace')
+     *
+     * While the window is active the OOO cores add a TRACE_UOP_* record
+     * to the event trace for every stage a uop enters: fetch, rename,
+     * dispatch, issue, complete, writeback and commit, or annul, replay
+     * and redispatch. tools/pipetrace.py converts them for the Konata
+     * pipeline viewer.
+     *
+     * The window opens at cycle 'start', or at the first fetch of 'rip'
+     * after it if set, and closes 'cycles' cycles later (0 keeps it open).
+     * It opens once: uops fetched after it closes are not traced, so their
+     * records don't need a matching fetch.
+     */
+    struct PipeTraceWindow {
+        bool enabled;
+        bool active;
+        bool done;
+        W64 start;
+        W64 rip;
+        W64 cycles;
+        W64 opened;
+
+        /* No rip trigger, same as INVALIDRIP */
+        static const W64 NO_RIP = 0xffffffffffffffffULL;
+
+        PipeTraceWindow() {
+            enabled = true;
+            setup(false, 0, NO_RIP, 0);
+        }
+
+        /* A window with unchanged options keeps its state */
+        void setup(bool enabled_, W64 start_, W64 rip_, W64 cycles_) {
+            if (enabled == enabled_ && start == start_ && rip == rip_ &&
+                    cycles == cycles_)
+                return;
+
+            enabled = enabled_;
+            start = start_;
+            rip = rip_;
+            cycles = cycles_;
+            active = done = false;
+            opened = 0;
+        }
+
+        void open(W64 cycle) {
+            active = true;
+            opened = cycle;
+        }
+
+        /* Called every cycle by the cores */
+        void clock(W64 cycle) {
+            if likely (!enabled || done) return;
+
+            if (active) {
+                if (cycles && cycle >= opened + cycles) {
+                    active = false;
+                    done = true;
+                }
+            } else if (rip == NO_RIP && cycle >= start) {
+                open(cycle);
+            }
+        }
+
+        /* Called for every fetched uop, opens a window triggered by rip */
+        void fetch(W64 fetchrip, W64 cycle) {
+            if unlikely (enabled && !active && !done && fetchrip == rip &&
+                    cycle >= start)
+                open(cycle);
+        }
+    };
+
+    extern PipeTraceWindow pipe_trace;
+
+    /* First 8 characters of a uop name, in one trace argument */
+    static inline W64 pipe_trace_name(const char *name) {
+        W64 packed = 0;
+        for (int i = 0; i < 8 && name[i]; i++)
+            packed |= W64((W8)name[i]) << (i * 8);
+        return packed;
+    }
+
+};
+
+#endif // PIPETRACE_H
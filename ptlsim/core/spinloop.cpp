@@ -0,0 +1,16 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <spinloop.h>
+
+using namespace Core;
+
+const char* Core::spin_wake_names[SPIN_WAKE_COUNT] = {
+    "line", "event", "timeout", "flush"
+};
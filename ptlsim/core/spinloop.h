@@ -0,0 +1,204 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef SPINLOOP_H
+#define SPINLOOP_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Core {
+
+    /* Why a spin wait ended */
+    enum {
+        SPIN_WAKE_LINE = 0,  /* watched line written or invalidated */
+        SPIN_WAKE_EVENT,     /* interrupt or exit request pending */
+        SPIN_WAKE_TIMEOUT,   /* -spin-max-cycles passed */
+        SPIN_WAKE_FLUSH,     /* pipeline flushed by the core */
+        SPIN_WAKE_COUNT
+    };
+
+    extern const char* spin_wake_names[SPIN_WAKE_COUNT];
+
+    struct SpinLoopStats : public Statable
+    {
+        StatObj<W64> waits;
+        StatArray<W64, SPIN_WAKE_COUNT> wakeups;
+        StatObj<W64> cycles;
+        StatObj<W64> insns;
+
+        SpinLoopStats(Statable *parent)
+            : Statable("spin", parent)
+              , waits("waits", this)
+              , wakeups("wakeups", this, spin_wake_names)
+              , cycles("cycles", this)
+              , insns("insns", this)
+        {}
+    };
+
+    /**
+     * @brief Spin loop detector of a thread, fed from commit
+     *
+     * Watches committed taken backward branches. An iteration of the loop
+     * closed by the branch spins if it did no stores, all its loads read
+     * one 64 byte line and rip, integer registers and flags are the same
+     * as at the end of the previous iteration: a 'pause' or compare loop
+     * on a lock held by another core. Such an iteration can only end
+     * differently once the line changes. After ITERATIONS spinning
+     * iterations in a row the thread stops fetching and waits, which takes
+     * no host time, until:
+     *
+     *  - the line is written by a store or invalidated by coherence, see
+     *    BaseMachine::spin_line_changed()
+     *  - an interrupt is pending
+     *  - -spin-max-cycles have passed, as DMA writes aren't seen
+     *
+     * Iterations skipped while waiting are accounted at the cycles,
+     * instructions and uops of the last iteration before the wait.
+     */
+    struct SpinLoopDetector {
+        static const int ITERATIONS = 8;
+        static const int MAX_INSNS = 32;
+        static const int REGS = 16;
+        static const W64 NO_LINE = (W64)-1;
+
+        W64 loop_start;
+        W64 loop_branch;
+        int iterations;
+
+        /* Iteration in progress */
+        W64 line;
+        bool clean;
+        W64 start_cycle;
+        W64 start_insns;
+        W64 start_uops;
+
+        /* Last completed iteration */
+        W64 last_line;
+        W64 regs[REGS];
+        W64 flags;
+        W64 iteration_cycles;
+        W64 iteration_insns;
+        W64 iteration_uops;
+
+        /* Spin wait */
+        bool waiting;
+        bool woken;
+        W64 wait_cycle;
+
+        SpinLoopDetector() { reset(); }
+
+        void reset() {
+            loop_start = 0;
+            loop_branch = 0;
+            iterations = 0;
+            line = last_line = NO_LINE;
+            clean = 0;
+            start_cycle = start_insns = start_uops = 0;
+            iteration_cycles = iteration_insns = iteration_uops = 0;
+            waiting = 0;
+            woken = 0;
+            wait_cycle = 0;
+        }
+
+        /* Committed load of physical address */
+        void load(W64 physaddr) {
+            W64 l = floor(physaddr, 64);
+            if (line == NO_LINE) line = l;
+            clean &= (line == l);
+        }
+
+        /* Committed store */
+        void store() {
+            clean = 0;
+        }
+
+        /**
+         * @brief Committed taken branch
+         *
+         * @param ctxregs Integer registers after the branch
+         * @param ctxflags Flags after the branch
+         * @param insns Instructions committed by the thread, branch included
+         * @param uops Uops committed by the thread, branch included
+         *
+         * @return true if the thread is spinning and should wait
+         */
+        bool taken_branch(W64 rip, W64 target, const W64 *ctxregs,
+                W64 ctxflags, W64 insns, W64 uops, W64 cycle) {
+            /* Forward branches are part of the loop body */
+            if (target > rip) return false;
+
+            bool spin = (rip == loop_branch && target == loop_start &&
+                    clean && line != NO_LINE && line == last_line &&
+                    insns - start_insns <= MAX_INSNS &&
+                    ctxflags == flags &&
+                    !memcmp(ctxregs, regs, sizeof(regs)));
+
+            iterations = (spin) ? iterations + 1 : 0;
+
+            loop_branch = rip;
+            loop_start = target;
+            last_line = line;
+            memcpy(regs, ctxregs, sizeof(regs));
+            flags = ctxflags;
+            iteration_cycles = cycle - start_cycle;
+            iteration_insns = insns - start_insns;
+            iteration_uops = uops - start_uops;
+
+            line = NO_LINE;
+            clean = 1;
+            start_cycle = cycle;
+            start_insns = insns;
+            start_uops = uops;
+
+            return (iterations >= ITERATIONS);
+        }
+
+        void wait(W64 cycle) {
+            waiting = 1;
+            woken = 0;
+            wait_cycle = cycle;
+        }
+
+        /* First cycle from cycle on in which the wait ends */
+        W64 wake_cycle(bool events, W64 max_cycles, W64 cycle) const {
+            if (woken || events) return cycle;
+            return max(wait_cycle + max_cycles, cycle);
+        }
+
+        /* Line of the wait is in the size byte line at physaddr */
+        bool watches(W64 physaddr, int size) const {
+            return waiting && !woken &&
+                floor(last_line, size) == floor(physaddr, size);
+        }
+
+        /**
+         * @brief End the wait and restart detection
+         *
+         * @param insns Set to instructions of the iterations skipped
+         * @param uops Set to uops of the iterations skipped
+         *
+         * @return Cycles waited
+         */
+        W64 wake(W64 cycle, W64& insns, W64& uops) {
+            W64 cycles = cycle - wait_cycle;
+            W64 skipped = cycles / max(iteration_cycles, W64(1));
+
+            insns = skipped * iteration_insns;
+            uops = skipped * iteration_uops;
+            reset();
+
+            return cycles;
+        }
+    };
+
+};
+
+#endif // SPINLOOP_H
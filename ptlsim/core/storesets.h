@@ -0,0 +1,116 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STORESETS_H
+#define STORESETS_H
+
+#include <ptlsim.h>
+
+namespace Core {
+
+    /**
+     * @brief Store set memory dependence predictor
+     *
+     * (G. Chrysos and J. Emer, "Memory Dependence Prediction using Store
+     * Sets", ISCA 1998.)
+     *
+     * The Store Set ID Table (SSIT) maps rip of loads and stores to a
+     * store set. The Last Fetched Store Table (LFST) holds uuid of the last
+     * renamed store of each set. A renamed load with a store set depends on
+     * that store only, other unresolved stores don't hold it back. A memory
+     * order violation puts its load and store in one set. SSIT is cleared
+     * every 'clearinterval' cycles so stale dependences don't stick.
+     *
+     * Both table sizes must be power of two.
+     */
+    template <int ssitsize, int lfstsize, int clearinterval>
+    struct StoreSetPredictor {
+        static const W16 INVALID = 0xffff;
+
+        struct LastStore {
+            W64 uuid;
+            bool valid;
+        };
+
+        W16 ssit[ssitsize];
+        LastStore lfst[lfstsize];
+        int next_ssid;
+        W64 clear_cycle;
+
+        StoreSetPredictor() { reset(); }
+
+        void reset() {
+            foreach (i, ssitsize) ssit[i] = INVALID;
+            foreach (i, lfstsize) lfst[i].valid = 0;
+            next_ssid = 0;
+            clear_cycle = 0;
+        }
+
+        static int ssit_index(W64 rip) {
+            return lowbits(rip ^ (rip >> log2(ssitsize)), log2(ssitsize));
+        }
+
+        int ssid(W64 rip) const {
+            W16 id = ssit[ssit_index(rip)];
+            return (id == INVALID) ? -1 : id;
+        }
+
+        /* Clear SSIT once per 'clearinterval' cycles */
+        bool tick(W64 cycle) {
+            if likely (cycle - clear_cycle < W64(clearinterval)) return false;
+            foreach (i, ssitsize) ssit[i] = INVALID;
+            clear_cycle = cycle;
+            return true;
+        }
+
+        /* Renamed load, returns true and uuid of store it depends on if any */
+        bool rename_load(W64 rip, W64& store_uuid) const {
+            int id = ssid(rip);
+            if likely (id < 0 || !lfst[id].valid) return false;
+            store_uuid = lfst[id].uuid;
+            return true;
+        }
+
+        /* Renamed store becomes last fetched store of its set */
+        void rename_store(W64 rip, W64 uuid) {
+            int id = ssid(rip);
+            if likely (id < 0) return;
+            lfst[id].uuid = uuid;
+            lfst[id].valid = 1;
+        }
+
+        /* Store has resolved its address, later loads don't wait on it */
+        void issue_store(W64 rip, W64 uuid) {
+            int id = ssid(rip);
+            if likely (id < 0) return;
+            if (lfst[id].valid && lfst[id].uuid == uuid) lfst[id].valid = 0;
+        }
+
+        /* Load at loadrip issued before the store at storerip it aliases */
+        void violation(W64 loadrip, W64 storerip) {
+            W16& loadid = ssit[ssit_index(loadrip)];
+            W16& storeid = ssit[ssit_index(storerip)];
+
+            if (loadid == INVALID && storeid == INVALID) {
+                loadid = storeid = next_ssid;
+                next_ssid = lowbits(next_ssid + 1, log2(lfstsize));
+            } else if (loadid == INVALID) {
+                loadid = storeid;
+            } else if (storeid == INVALID) {
+                storeid = loadid;
+            } else {
+                /* Both have sets: smaller store set ID wins */
+                loadid = storeid = min(loadid, storeid);
+            }
+        }
+    };
+
+};
+
+#endif // STORESETS_H
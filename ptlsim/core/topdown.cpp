@@ -0,0 +1,82 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <topdown.h>
+
+using namespace Core;
+
+const char* Core::topdown_names[TOPDOWN_COUNT] = {
+    "retiring", "frontend", "bad_speculation", "memory", "core"
+};
+
+const char* Core::topdown_memory_names[TOPDOWN_MEM_COUNT] = {
+    "l1", "l2", "l3", "dram"
+};
+
+TopDownHotspots Core::topdown_hotspots;
+
+namespace {
+    /* Most lost slots first */
+    struct LostSlotsComparator {
+        int operator ()(const TopDownHotspots::Entry *a,
+                const TopDownHotspots::Entry *b) const {
+            W64 la = a->lost();
+            W64 lb = b->lost();
+            if (la == lb) return 0;
+            return (la > lb) ? -1 : +1;
+        }
+    };
+
+    W64 percent_of(W64 part, W64 whole) {
+        return whole ? (100 * part) / whole : 0;
+    }
+};
+
+ostream& TopDownHotspots::write(ostream& os, int count)
+{
+    dynarray<Entry*> entries;
+    Hashtable<W64, Entry, 4096>::Iterator iter(table);
+    KeyValuePair<W64, Entry> *kvp;
+
+    while ((kvp = iter.next()))
+        entries.push(&kvp->value);
+
+    sort(entries.data, entries.length, LostSlotsComparator());
+
+    W64 slots = 0;
+    W64 lost = 0;
+    foreach (i, TOPDOWN_COUNT)
+        slots += total[i];
+    lost = slots - total[TOPDOWN_RETIRING];
+
+    os << "# Top-down hot spots: commit slots of the ", min(count,
+            (int)entries.length), " of ", entries.length,
+       " instructions with most lost slots", endl;
+    os << "# ", slots, " slots, ", lost, " lost:";
+    foreach (i, TOPDOWN_COUNT)
+        os << " ", topdown_names[i], " ", percent_of(total[i], slots), "%";
+    os << endl;
+
+    os << "#", padstring("rip", 17), " ", padstring("lost", 12), " ",
+       padstring("of_lost%", 8);
+    foreach (i, TOPDOWN_COUNT)
+        os << " ", padstring(topdown_names[i], 15);
+    os << endl;
+
+    foreach (i, min(count, (int)entries.length)) {
+        const Entry *e = entries[i];
+        os << " ", hexstring(e->rip, 64), " ", intstring(e->lost(), 12), " ",
+           intstring(percent_of(e->lost(), lost), 8);
+        foreach (j, TOPDOWN_COUNT)
+            os << " ", intstring(e->slots[j], 15);
+        os << endl;
+    }
+
+    return os;
+}
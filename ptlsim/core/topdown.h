@@ -0,0 +1,116 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef TOPDOWN_H
+#define TOPDOWN_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+namespace Core {
+
+    /*
+     * Top-down categories of commit slots. Each cycle a thread has one
+     * slot per uop it could commit; a slot either retires a uop or is
+     * lost, and lost slots are charged to why the ROB head couldn't
+     * commit:
+     *
+     *  - frontend: ROB empty, or the head is still in the frontend
+     *  - bad_speculation: ROB empty while refilling after a redirect
+     *    (branch mispredict, annul or pipeline flush)
+     *  - memory: head is a load or store waiting for the cache or TLB
+     *  - core: head waits for operands, a unit or its execution
+     */
+    enum {
+        TOPDOWN_RETIRING = 0,
+        TOPDOWN_FRONTEND,
+        TOPDOWN_BAD_SPECULATION,
+        TOPDOWN_MEMORY,
+        TOPDOWN_CORE,
+        TOPDOWN_COUNT
+    };
+
+    /* Memory slots by the level that served the load */
+    enum {
+        TOPDOWN_MEM_L1 = 0,
+        TOPDOWN_MEM_L2,
+        TOPDOWN_MEM_L3,
+        TOPDOWN_MEM_DRAM,
+        TOPDOWN_MEM_COUNT
+    };
+
+    extern const char* topdown_names[TOPDOWN_COUNT];
+    extern const char* topdown_memory_names[TOPDOWN_MEM_COUNT];
+
+    struct TopDownStats : public Statable
+    {
+        StatObj<W64> slots;
+        StatArray<W64, TOPDOWN_COUNT> bound;
+        StatArray<W64, TOPDOWN_MEM_COUNT> memory;
+
+        TopDownStats(Statable *parent)
+            : Statable("topdown", parent)
+              , slots("slots", this)
+              , bound("bound", this, topdown_names)
+              , memory("memory", this, topdown_memory_names)
+        {}
+    };
+
+    /**
+     * @brief Commit slots of each instruction, for '-topdown-report'
+     *
+     * Slots are charged to the rip of the instruction that retired or
+     * blocked the ROB head, empty ROB slots to the rip to be committed
+     * next. write() lists the instructions with most lost slots.
+     */
+    struct TopDownHotspots {
+        struct Entry {
+            W64 rip;
+            W64 slots[TOPDOWN_COUNT];
+
+            W64 lost() const {
+                return slots[TOPDOWN_FRONTEND] + slots[TOPDOWN_BAD_SPECULATION] +
+                    slots[TOPDOWN_MEMORY] + slots[TOPDOWN_CORE];
+            }
+        };
+
+        Hashtable<W64, Entry, 4096> table;
+        W64 total[TOPDOWN_COUNT];
+        bool enabled;
+
+        TopDownHotspots() : enabled(false) { reset(); }
+
+        void reset() {
+            table.clear(true);
+            foreach (i, TOPDOWN_COUNT) total[i] = 0;
+        }
+
+        void add(W64 rip, int category, W64 slots) {
+            Entry *entry = table.get(rip);
+            if unlikely (!entry) {
+                Entry e;
+                e.rip = rip;
+                foreach (i, TOPDOWN_COUNT) e.slots[i] = 0;
+                entry = table.add(rip, e);
+            }
+
+            entry->slots[category] += slots;
+            total[category] += slots;
+        }
+
+        /* Write the 'count' instructions with most lost slots */
+        ostream& write(ostream& os, int count);
+    };
+
+    extern TopDownHotspots topdown_hotspots;
+
+};
+
+#endif // TOPDOWN_H
@@ -0,0 +1,159 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef UOPCACHE_H
+#define UOPCACHE_H
+
+#include <ptlsim.h>
+#include <logic.h>
+
+namespace Core {
+
+    /**
+     * @brief Decoded uop cache of fetch windows
+     *
+     * Tags are virtual address of a (1 << windowshift) byte fetch window
+     * plus 4 bit threadid. A hit means uops of the window were
+     * decoded recently, so fetch doesn't probe ITLB or icache for it. Uops
+     * themselves still come from the basic block cache. A core built with
+     * zero sets doesn't have a uop cache and it never hits.
+     */
+    template <int setcount, int waycount, int windowshift>
+    struct UopCache {
+        static const bool ENABLED = (setcount > 0);
+        static const int SETS = (setcount > 0) ? setcount : 1;
+        static const int WINDOW_SHIFT = windowshift;
+
+        FullyAssociativeTags<W64, waycount> sets[SETS];
+
+        UopCache() { reset(); }
+
+        void reset() {
+            foreach (i, SETS) {
+                sets[i].reset();
+            }
+        }
+
+        static W64 tagof(W64 addr, W64 threadid) {
+            return bits(addr, WINDOW_SHIFT, 48 - WINDOW_SHIFT) |
+                (threadid << (48 - WINDOW_SHIFT));
+        }
+
+        static int setof(W64 tag) {
+            return lowbits(tag, log2(SETS));
+        }
+
+        bool probe(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            W64 tag = tagof(addr, threadid);
+            return (sets[setof(tag)].probe(tag) >= 0);
+        }
+
+        bool insert(W64 addr, W8 threadid = 0) {
+            if (!ENABLED) return false;
+            W64 tag = tagof(addr, threadid);
+            W64 oldtag = tag;
+            sets[setof(tag)].select(tag, oldtag);
+            return (oldtag != tag);
+        }
+
+        int flush_all() {
+            reset();
+            return SETS * waycount;
+        }
+
+        /* Invalidate all windows of 4KB page containing virtaddr */
+        int flush_virt(Waddr virtaddr, W64 threadid) {
+            if (!ENABLED) return 0;
+            W64 page = tagof(virtaddr, threadid) >> (12 - WINDOW_SHIFT);
+            int n = 0;
+            foreach (i, SETS) {
+                foreach (way, waycount) {
+                    W64 tag = sets[i][way];
+                    if (tag != sets[i].INVALID &&
+                            (tag >> (12 - WINDOW_SHIFT)) == page) {
+                        sets[i].invalidate_way(way);
+                        n++;
+                    }
+                }
+            }
+            return n;
+        }
+    };
+
+    /**
+     * @brief Loop stream detector
+     *
+     * Watches predicted taken backward branches. Once the same branch
+     * closes a loop body of at most 'size' uops 'lockiterations' times
+     * in a row, the detector locks on the loop and streams its uops: fetch
+     * skips uop cache, ITLB and icache and the loop branch doesn't end the
+     * fetch cycle. Leaving the loop body, a longer body, any other taken
+     * branch or a fetch redirect unlocks it.
+     */
+    template <int size, int lockiterations>
+    struct LoopStreamDetector {
+        static const bool ENABLED = (size > 0);
+
+        W64 loop_start;
+        W64 loop_branch;
+        int uops;
+        int iterations;
+        bool locked;
+
+        LoopStreamDetector() { reset(); }
+
+        void reset() {
+            loop_start = 0;
+            loop_branch = 0;
+            uops = 0;
+            iterations = 0;
+            locked = 0;
+        }
+
+        /* Returns true if uop at rip is streamed from the detector */
+        bool active(W64 rip) {
+            if likely (!locked) return false;
+            if (rip < loop_start || rip > loop_branch) reset();
+            return locked;
+        }
+
+        void add_uop() {
+            if (!ENABLED) return;
+            if (++uops > size) {
+                locked = 0;
+                iterations = 0;
+            }
+        }
+
+        /* Predicted taken branch, returns true if it is the streamed loop's */
+        bool taken_branch(W64 rip, W64 target) {
+            if (!ENABLED) return false;
+
+            if (rip == loop_branch && target == loop_start && uops <= size) {
+                iterations++;
+            } else if (target <= rip) {
+                loop_branch = rip;
+                loop_start = target;
+                iterations = 0;
+            } else {
+                loop_branch = 0;
+                loop_start = 0;
+                iterations = 0;
+            }
+
+            uops = 0;
+            locked = (iterations >= lockiterations);
+            return locked;
+        }
+    };
+
+};
+
+#endif // UOPCACHE_H
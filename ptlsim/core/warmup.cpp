@@ -0,0 +1,701 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <warmup.h>
+#include <basecore.h>
+#include <globals.h>
+#include <decode.h>
+#include <memoryHierarchy.h>
+
+using namespace Core;
+
+const char* Core::warmup_stop_names[WARMUP_STOP_COUNT] = {
+    "none", "barrier", "exception", "interrupt", "unsupported"
+};
+
+/* Same register maps as AtomCore, warmup executes uops the same way */
+static const bool archdest_is_visible[TRANSREG_COUNT] = {
+    // Integer registers
+    1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1,
+    // SSE registers, low 64 bits
+    1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1,
+    // SSE registers, high 64 bits
+    1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1,
+    // x87 FP / special
+    1, 1, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // MMX registers
+    1, 1, 1, 1, 1, 1, 1, 1,
+    // The following are temporary registers
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const byte archreg_remap_table[TRANSREG_COUNT] = {
+  REG_rax,  REG_rcx,  REG_rdx,  REG_rbx,  REG_rsp,  REG_rbp,  REG_rsi,  REG_rdi,
+  REG_r8,  REG_r9,  REG_r10,  REG_r11,  REG_r12,  REG_r13,  REG_r14,  REG_r15,
+
+  REG_xmml0,  REG_xmmh0,  REG_xmml1,  REG_xmmh1,  REG_xmml2,  REG_xmmh2,  REG_xmml3,  REG_xmmh3,
+  REG_xmml4,  REG_xmmh4,  REG_xmml5,  REG_xmmh5,  REG_xmml6,  REG_xmmh6,  REG_xmml7,  REG_xmmh7,
+
+  REG_xmml8,  REG_xmmh8,  REG_xmml9,  REG_xmmh9,  REG_xmml10,  REG_xmmh10,  REG_xmml11,  REG_xmmh11,
+  REG_xmml12,  REG_xmmh12,  REG_xmml13,  REG_xmmh13,  REG_xmml14,  REG_xmmh14,  REG_xmml15,  REG_xmmh15,
+
+  REG_fptos,  REG_fpsw,  REG_fptags,  REG_fpstack,  REG_msr,  REG_dlptr,  REG_trace, REG_ctx,
+
+  REG_rip,  REG_flags,  REG_dlend, REG_selfrip, REG_nextrip, REG_ar1, REG_ar2, REG_zero,
+
+  REG_mmx0, REG_mmx1, REG_mmx2, REG_mmx3, REG_mmx4, REG_mmx5, REG_mmx6, REG_mmx7,
+
+  REG_temp0,  REG_temp1,  REG_temp2,  REG_temp3,  REG_temp4,  REG_temp5,  REG_temp6,  REG_temp7,
+
+  // REG_zf, REG_cf and REG_of are all mapped to REG_flags
+  REG_flags,  REG_flags,  REG_flags,  REG_imm,  REG_mem,  REG_temp8,  REG_temp9,  REG_temp10,
+};
+
+static inline W64 extract_bytes(W64 data, int sizeshift, bool signext) {
+    switch (sizeshift) {
+        case 0: return (signext) ? (W64s)(W8s)data : (W8)data;
+        case 1: return (signext) ? (W64s)(W16s)data : (W16)data;
+        case 2: return (signext) ? (W64s)(W32s)data : (W32)data;
+        default: return data;
+    }
+}
+
+static const W64 ICACHE_WARM_BLOCK = 64;
+
+WarmupThread::WarmupThread(Context& ctx, BaseCore& core, WarmupStats& stats,
+        WarmupTiming* timing)
+    : ctx(ctx)
+      , core(core)
+      , stats(stats)
+      , timing(timing)
+      , current_bb(NULL)
+      , last_icache_block(-1)
+      , last_itlb_page(-1)
+      , store_count(0)
+      , insns(0)
+      , uops(0)
+      , stop(WARMUP_STOP_NONE)
+{
+    foreach (i, 11) {
+        temp_registers[i] = 0xdeadbeefdeadbeef;
+    }
+
+    reset_flags();
+}
+
+WarmupThread::~WarmupThread()
+{
+    if(current_bb) {
+        current_bb->release();
+    }
+}
+
+/**
+ * @brief Restart execution at Context's RIP after QEMU or an assist ran
+ */
+void WarmupThread::reset()
+{
+    if(current_bb) {
+        current_bb->release();
+        current_bb = NULL;
+    }
+
+    last_icache_block = -1;
+    last_itlb_page = -1;
+    stop = WARMUP_STOP_NONE;
+    events.recheck();
+
+    reset_flags();
+}
+
+/**
+ * @brief Restart flags forwarding from Context's committed flags
+ */
+void WarmupThread::reset_flags()
+{
+    forwarded_flags = ctx.reg_flags & (setflags_to_x86_flags[7] | FLAG_IF);
+    internal_flags = forwarded_flags;
+
+    setzero(register_flags);
+    register_flags[REG_flags] = ctx.reg_flags;
+}
+
+/**
+ * @brief Execute the basic block at Context's current RIP
+ *
+ * @return false if this Context has stopped warmup
+ */
+bool WarmupThread::run_bb()
+{
+    if(events.changed() && ctx.check_events()) {
+        events.recheck();
+        stop = WARMUP_STOP_INTERRUPT;
+        return false;
+    }
+
+    RIPVirtPhys rvp(ctx.eip);
+    rvp.update(ctx);
+
+    BasicBlockCache& bbc = bbcache_of(ctx.cpu_index);
+
+    /* Old block is only used for its successor links */
+    BasicBlock *prev_bb = current_bb;
+
+    if(current_bb) {
+        current_bb->release();
+        current_bb = NULL;
+    }
+
+    BasicBlock *bb = bbc.get_successor(prev_bb, rvp);
+
+    if(!bb) {
+        W32 link_epoch = bbc.link_epoch;
+        bb = bbc.translate(ctx, rvp);
+
+        if(bb && prev_bb && link_epoch == bbc.link_epoch) {
+            bbc.link_successor(prev_bb, bb);
+        }
+    }
+
+    /* Page fault on instruction fetch */
+    if(!bb) {
+        set_exception(EXCEPTION_PageFaultOnExec, 0, ctx.exec_fault_addr);
+        stop = WARMUP_STOP_EXCEPTION;
+        return false;
+    }
+
+    current_bb = bb;
+    bb->acquire();
+    bb->use(sim_cycle);
+    stats.bbs++;
+
+    int first = 0;
+
+    while(first < bb->count) {
+        int last = first;
+        while(last < bb->count - 1 && !bb->transops[last].eom) {
+            last++;
+        }
+
+        W64 rip = ctx.eip;
+
+        stop = execute_insn(*bb, first, last);
+        if(stop != WARMUP_STOP_NONE)
+            return false;
+
+        /* Taken branch or skipped block, continue from new RIP */
+        if(ctx.eip != rip + bb->transops[last].bytes)
+            break;
+
+        first = last + 1;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Execute uops [first, last] of one x86 instruction
+ *
+ * @return WARMUP_STOP_NONE if instruction is committed or skipped
+ */
+int WarmupThread::execute_insn(BasicBlock& bb, int first, int last)
+{
+    W64 rip = ctx.eip;
+    bool barrier = false;
+
+    /* Leave anything that needs QEMU or a split access to the core, before
+     * any of its uops changes state */
+    for(int i = first; i <= last; i++) {
+        const TransOp& uop = bb.transops[i];
+
+        if(isbarrier(uop.opcode)) {
+            if(!timing)
+                return WARMUP_STOP_BARRIER;
+            barrier = true;
+        }
+
+        if((isload(uop.opcode) || isstore(uop.opcode)) &&
+                uop.opcode != OP_mf &&
+                uop.cond != LDST_ALIGN_NORMAL)
+            return WARMUP_STOP_UNSUPPORTED;
+    }
+
+    /* Instruction fetch: ITLB once per page, I-cache once per block */
+    PageFaultErrorCode pfec;
+    int exception = 0;
+    int mmio = 0;
+
+    Waddr physaddr = ctx.check_and_translate(rip, 3, false, false,
+            exception, mmio, pfec, true);
+
+    if(!exception) {
+        if(rip >> 12 != last_itlb_page) {
+            access_tlb(rip, true);
+            last_itlb_page = rip >> 12;
+        }
+
+        W64 block = floor(physaddr, ICACHE_WARM_BLOCK);
+        if(block != last_icache_block) {
+            access_cache(physaddr, true, false);
+            last_icache_block = block;
+        }
+    }
+
+    store_count = 0;
+    int count = last - first + 1;
+
+    foreach (idx, count) {
+        const TransOp& uop = bb.transops[first + idx];
+
+        W64 radata = read_reg(uop.ra, idx);
+        W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : read_reg(uop.rb, idx);
+        W64 rcdata = (uop.rc == REG_imm) ? uop.rcimm : read_reg(uop.rc, idx);
+
+        W16 raflags = register_flags[archreg_remap_table[uop.ra]];
+        W16 rbflags = register_flags[archreg_remap_table[uop.rb]];
+        W16 rcflags = register_flags[archreg_remap_table[uop.rc]];
+
+        IssueState state;
+        setzero(state);
+
+        bool ld = isload(uop.opcode);
+        bool st = isstore(uop.opcode);
+
+        if(uop.opcode == OP_mf || isprefetch(uop.opcode)) {
+            /* Nothing to execute */
+        } else if(ld || st) {
+            state.reg.rddata = rcdata;
+
+            int result = execute_mem(uop, idx, radata, rbdata, rcdata);
+            if(result != WARMUP_STOP_NONE)
+                return result;
+
+            if(ld)
+                state.reg.rddata = dest_register_values[idx];
+        } else if(uop.opcode == OP_ast) {
+            light_assist_func_t assist_func =
+                light_assistid_to_func[uop.riptaken];
+
+            W16 flags = internal_flags;
+            W16 new_flags = flags;
+
+            state.reg.rddata = assist_func(ctx, radata, rbdata, rcdata,
+                    flags, flags, flags, new_flags);
+            state.reg.rdflags = new_flags;
+        } else {
+            if(isbranch(uop.opcode)) {
+                state.brreg.riptaken = uop.riptaken;
+                state.brreg.ripseq = uop.ripseq;
+            }
+
+            uopimpl_func_t synthop = (bb.uopdescs) ?
+                bb.uopdescs[first + idx].synthop :
+                get_synthcode_for_uop(uop.opcode, uop.size, uop.setflags,
+                        uop.cond, uop.extshift, 0, uop.internal);
+
+            synthop(state, radata, rbdata, rcdata, raflags, rbflags,
+                    rcflags);
+
+            if(state.reg.rdflags & FLAG_INV) {
+                if(isclass(uop.opcode, OPCLASS_CHECK) &&
+                        LO32(state.reg.rddata) == EXCEPTION_SkipBlock) {
+                    /* Instruction is skipped, drop its uops */
+                    ctx.eip = rip + uop.bytes;
+                    reset_flags();
+                    return WARMUP_STOP_NONE;
+                }
+
+                set_exception(LO32(state.reg.rddata),
+                        HI32(state.reg.rddata), 0);
+                return WARMUP_STOP_EXCEPTION;
+            }
+        }
+
+        dest_registers[idx] = uop.rd;
+        dest_register_values[idx] = state.reg.rddata;
+        rflags[idx] = 0;
+
+        if((!ld && !st && uop.setflags) || uop.opcode == OP_ast) {
+            W64 flagmask = setflags_to_x86_flags[uop.setflags];
+
+            if(uop.opcode == OP_ast) {
+                flagmask |= FLAG_IF;
+            }
+
+            rflags[idx] = (forwarded_flags & ~flagmask) |
+                (state.reg.rdflags & flagmask);
+
+            internal_flags = rflags[idx];
+            register_flags[uop.rd] = rflags[idx];
+
+            if(!uop.nouserflags) {
+                forwarded_flags = rflags[idx];
+                register_flags[REG_flags] = rflags[idx];
+            }
+        }
+
+        if(!archdest_is_visible[uop.rd]) {
+            write_temp_reg(uop.rd, state.reg.rddata);
+        }
+    }
+
+    commit_insn(bb, first, count, rip);
+
+    /* ctx.eip is the assist id, the core calls the assist */
+    if(barrier)
+        return WARMUP_STOP_BARRIER;
+
+    return WARMUP_STOP_NONE;
+}
+
+/**
+ * @brief Translate a load or store address, handling faults like a core
+ *
+ * @param result Set to reason to stop if address can't be accessed
+ * @param mmio Set if address is MMIO
+ *
+ * @return Physical address
+ */
+Waddr WarmupThread::translate(Waddr virtaddr, const TransOp& uop,
+        int& result, int& mmio)
+{
+    bool is_st = isstore(uop.opcode);
+    PageFaultErrorCode pfec = 0;
+    int exception = 0;
+
+    Waddr physaddr = ctx.check_and_translate(virtaddr, uop.size, is_st,
+            uop.internal, exception, mmio, pfec);
+
+    if(exception && ctx.try_handle_fault(virtaddr, is_st)) {
+        exception = 0;
+        physaddr = ctx.check_and_translate(virtaddr, uop.size, is_st,
+                uop.internal, exception, mmio, pfec);
+    }
+
+    if(exception) {
+        set_exception(is_st ? EXCEPTION_PageFaultOnWrite :
+                EXCEPTION_PageFaultOnRead, 0, virtaddr);
+        result = WARMUP_STOP_EXCEPTION;
+    } else if(mmio && !uop.internal && !timing) {
+        result = WARMUP_STOP_UNSUPPORTED;
+    }
+
+    return physaddr;
+}
+
+/**
+ * @brief Execute a load or store uop
+ *
+ * Loads read memory merged with stores of this instruction, stores are
+ * buffered until the instruction commits.
+ */
+int WarmupThread::execute_mem(const TransOp& uop, int idx, W64 ra, W64 rb,
+        W64 rc)
+{
+    int result = WARMUP_STOP_NONE;
+    bool is_st = isstore(uop.opcode);
+    int op_size = 1 << uop.size;
+    int mmio = 0;
+
+    Waddr virtaddr = (W64)signext64(ra + rb, 48);
+    virtaddr &= ctx.virt_addr_mask;
+
+    W64 physaddr = translate(virtaddr, uop, result, mmio);
+
+    if(!uop.internal) {
+        Waddr virtaddr2 = virtaddr + (op_size - 1);
+
+        if((lowbits(virtaddr, 12) + (op_size - 1)) >> 12) {
+            int mmio2 = 0;
+            translate(virtaddr2, uop, result, mmio2);
+            if(result == WARMUP_STOP_NONE)
+                access_tlb(virtaddr2, false);
+        }
+
+        if(result != WARMUP_STOP_NONE)
+            return result;
+
+        access_tlb(virtaddr, false);
+    } else if(result != WARMUP_STOP_NONE) {
+        return result;
+    }
+
+    if(is_st) {
+        PendingStore& buf = stores[store_count++];
+        buf.data = rc;
+        buf.virtaddr = virtaddr;
+        buf.physaddr = physaddr;
+        buf.bytemask = ((1 << op_size) - 1);
+        buf.size = uop.size;
+        buf.internal = uop.internal;
+        buf.mmio = mmio;
+        return WARMUP_STOP_NONE;
+    }
+
+    if(uop.internal) {
+        W64 data = ctx.loadphys(physaddr, true, uop.size);
+
+        foreach (i, store_count) {
+            if(stores[i].internal && stores[i].virtaddr == virtaddr)
+                data = stores[i].data;
+        }
+
+        dest_register_values[idx] = data;
+        return WARMUP_STOP_NONE;
+    }
+
+    if(!mmio)
+        access_cache(physaddr, false, false);
+
+    dest_register_values[idx] = load_data(virtaddr, uop);
+
+    return WARMUP_STOP_NONE;
+}
+
+/**
+ * @brief Load data from RAM merged with pending stores of this instruction
+ */
+W64 WarmupThread::load_data(Waddr virtaddr, const TransOp& uop)
+{
+    W64 data = ctx.loadvirt(virtaddr, uop.size);
+
+    foreach (i, store_count) {
+        PendingStore& buf = stores[i];
+
+        if(buf.internal)
+            continue;
+
+        W64s diff = (W64s)(buf.virtaddr - virtaddr);
+        if(diff <= -8 || diff >= 8)
+            continue;
+
+        W64 fwd_data = buf.data;
+        W8 fwd_mask = buf.bytemask;
+
+        if(diff > 0) {
+            fwd_data <<= (diff * 8);
+            fwd_mask <<= diff;
+        } else {
+            fwd_data >>= (-diff * 8);
+            fwd_mask >>= -diff;
+        }
+
+        if(fwd_mask == 0)
+            continue;
+
+        data = mux64(expand_8bit_to_64bit_lut[fwd_mask], data, fwd_data);
+    }
+
+    return extract_bytes(data, uop.size, (uop.opcode == OP_ldx));
+}
+
+/**
+ * @brief Commit registers, stores, flags and RIP of current instruction
+ */
+void WarmupThread::commit_insn(BasicBlock& bb, int first, int count, W64 rip)
+{
+    foreach (i, count) {
+        ctx.set_reg(dest_registers[i], dest_register_values[i]);
+    }
+
+    foreach (i, store_count) {
+        PendingStore& buf = stores[i];
+
+        if(buf.internal) {
+            ctx.store_internal(buf.virtaddr, buf.data, buf.bytemask);
+            continue;
+        }
+
+        if(!buf.mmio)
+            access_cache(buf.physaddr, false, true);
+        ctx.storemask_virt(buf.virtaddr, buf.data, buf.bytemask, buf.size);
+    }
+
+    /* Same as AtomOp::commit_flags */
+    foreach (i, count) {
+        const TransOp& uop = bb.transops[first + i];
+        bool ast = (uop.opcode == OP_ast);
+
+        if((isload(uop.opcode) | isstore(uop.opcode) | uop.nouserflags) &&
+                (!ast && !uop.setflags)) {
+            continue;
+        }
+
+        W64 flagmask = setflags_to_x86_flags[uop.setflags];
+
+        if(ast) {
+            flagmask |= FLAG_IF;
+        }
+
+        ctx.reg_flags = (ctx.reg_flags & ~flagmask) | (rflags[i] & flagmask);
+    }
+
+    const TransOp& last_uop = bb.transops[first + count - 1];
+
+    if(last_uop.rd == REG_rip) {
+        ctx.eip = dest_register_values[count - 1];
+    } else {
+        ctx.eip += last_uop.bytes;
+    }
+
+    if(isclass(last_uop.opcode, OPCLASS_BRANCH) &&
+            !isbarrier(last_uop.opcode)) {
+        if(timing)
+            timing->branch(last_uop, rip + last_uop.bytes, ctx.eip);
+        else
+            core.warm_branch(ctx, last_uop, rip + last_uop.bytes, ctx.eip);
+    }
+
+    stats.insns++;
+    stats.uops += count;
+    insns++;
+    uops += count;
+}
+
+void WarmupThread::access_tlb(Waddr virtaddr, bool is_icache)
+{
+    if(timing)
+        timing->tlb_access(virtaddr, is_icache);
+    else
+        core.warm_tlb(ctx, virtaddr, is_icache);
+}
+
+void WarmupThread::access_cache(W64 physaddr, bool is_icache, bool is_store)
+{
+    if(timing)
+        timing->cache_access(physaddr, is_icache, is_store);
+    else
+        core.memoryHierarchy->warm_access(core.get_coreid(), physaddr,
+                is_icache, is_store);
+}
+
+/**
+ * @brief Leave an exception in the Context for the core to raise
+ *
+ * Warmup only stops, the Context is not changed.
+ */
+void WarmupThread::set_exception(int exception, W32 error_code, Waddr addr)
+{
+    if(!timing)
+        return;
+
+    ctx.exception = exception;
+    ctx.error_code = error_code;
+    ctx.page_fault_addr = addr;
+}
+
+/**
+ * @brief Read a register, forwarding from earlier uops of the instruction
+ */
+W64 WarmupThread::read_reg(W16 reg, int idx)
+{
+    reg = archreg_remap_table[reg];
+
+    if(reg == REG_flags) {
+        return internal_flags;
+    }
+
+    for(int i = idx - 1; i >= 0; i--) {
+        if(dest_registers[i] == reg) {
+            return dest_register_values[i];
+        }
+    }
+
+    if(reg >= REG_temp0 && reg <= REG_temp7) {
+        return temp_registers[reg - REG_temp0];
+    } else if(reg >= REG_temp8 && reg <= REG_temp10) {
+        return temp_registers[reg - REG_temp8 + 7];
+    }
+
+    return ctx.get(reg);
+}
+
+void WarmupThread::write_temp_reg(W16 reg, W64 data)
+{
+    if(reg >= REG_temp0 && reg <= REG_temp7) {
+        temp_registers[reg - REG_temp0] = data;
+    } else if(reg >= REG_temp8 && reg <= REG_temp10) {
+        temp_registers[reg - REG_temp8 + 7] = data;
+    } else if(reg == REG_rip) {
+        return;
+    } else {
+        ctx.set_reg(reg, data);
+    }
+}
+
+static WarmupStats* warmup_stats = NULL;
+
+W64 Core::functional_warmup(BaseMachine& machine, W64 insns)
+{
+    if(!warmup_stats) {
+        warmup_stats = new WarmupStats(&machine);
+    }
+
+    dynarray<WarmupThread*> threads;
+
+    foreach (i, NUM_SIM_CORES) {
+        Context& ctx = machine.contextof(i);
+
+        foreach (c, machine.cores.count()) {
+            BaseCore* core = machine.cores[c];
+
+            if(core->active && core->runs_context(ctx)) {
+                threads.push(new WarmupThread(ctx, *core, *warmup_stats));
+                break;
+            }
+        }
+    }
+
+    /* Round robin one basic block at a time so shared caches see the
+     * Contexts' accesses interleaved */
+    bool running = true;
+
+    while(running) {
+        running = false;
+
+        foreach (i, threads.count()) {
+            WarmupThread* thread = threads[i];
+
+            if(thread->stop != WARMUP_STOP_NONE || thread->insns >= insns ||
+                    !thread->ctx.running)
+                continue;
+
+            warmup_stats->set_default_stats(thread->ctx.kernel_mode ?
+                    kernel_stats : user_stats);
+
+            if(thread->run_bb()) {
+                running = true;
+            } else {
+                warmup_stats->stop[thread->stop]++;
+            }
+        }
+    }
+
+    W64 total = 0;
+
+    foreach (i, threads.count()) {
+        WarmupThread* thread = threads[i];
+
+        if(logable(1)) {
+            ptl_logfile << "Warmup vcpu ", thread->ctx.cpu_index, ": ",
+                        thread->insns, " insns, stop: ",
+                        warmup_stop_names[thread->stop], endl;
+        }
+
+        total += thread->insns;
+        delete thread;
+    }
+
+    return total;
+}
@@ -0,0 +1,160 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <ptlsim.h>
+#include <machine.h>
+#include <statsBuilder.h>
+
+namespace Core {
+
+    class BaseCore;
+
+    /* Reasons a context stops functional warmup early */
+    enum {
+        WARMUP_STOP_NONE = 0,
+        WARMUP_STOP_BARRIER,
+        WARMUP_STOP_EXCEPTION,
+        WARMUP_STOP_INTERRUPT,
+        WARMUP_STOP_UNSUPPORTED,
+        WARMUP_STOP_COUNT
+    };
+
+    extern const char* warmup_stop_names[WARMUP_STOP_COUNT];
+
+    struct WarmupStats : public Statable {
+        StatObj<W64> insns;
+        StatObj<W64> uops;
+        StatObj<W64> bbs;
+        StatArray<W64, WARMUP_STOP_COUNT> stop;
+
+        WarmupStats(Statable *parent, const char *name = "warmup")
+            : Statable(name, parent)
+              , insns("insns", this)
+              , uops("uops", this)
+              , bbs("bbs", this)
+              , stop("stop", this, warmup_stop_names)
+        { }
+    };
+
+    /**
+     * @brief Timing model of a core that runs its Contexts on WarmupThread
+     *
+     * Gets the TLB and cache accesses and the committed branches that
+     * functional warmup passes to the core's warm_* functions. Accesses are
+     * made while their instruction executes, ctx.eip is still its RIP.
+     */
+    struct WarmupTiming {
+        virtual ~WarmupTiming() {}
+        virtual void tlb_access(Waddr virtaddr, bool is_icache) = 0;
+        virtual void cache_access(W64 physaddr, bool is_icache,
+                bool is_store) = 0;
+        virtual void branch(const TransOp& uop, W64 ripafter,
+                W64 target) = 0;
+    };
+
+    /**
+     * @brief Functional execution of one Context for warmup
+     *
+     * Executes uops of cached basic blocks directly on the Context, the
+     * way AtomCore does but without a pipeline or timing, and installs
+     * every fetch, load and store in the core's TLBs and caches and every
+     * branch in its branch predictor.
+     *
+     * Anything that needs the detailed core or QEMU (assists, exceptions,
+     * interrupts, MMIO and split unaligned accesses) stops the warmup of
+     * that Context before the instruction changes any state.
+     *
+     * With a WarmupTiming (see IntervalCore) this runs the Context for a
+     * core instead: accesses and branches go to the timing model, MMIO is
+     * executed, a barrier stops after its instruction commits with ctx.eip
+     * set to the assist id, and an exception is left in ctx.exception,
+     * error_code and page_fault_addr for the core to raise.
+     */
+    struct WarmupThread {
+        Context& ctx;
+        BaseCore& core;
+        WarmupStats& stats;
+        WarmupTiming* timing;
+        ContextEvents events;
+
+        BasicBlock* current_bb;
+        W64 last_icache_block;
+        W64 last_itlb_page;
+
+        W64 temp_registers[11];
+        W16 register_flags[TRANSREG_COUNT];
+        W16 internal_flags;
+        W16 forwarded_flags;
+
+        /* State of uops of current instruction until its EOM */
+        struct PendingStore {
+            W64 data;
+            Waddr virtaddr;
+            W64 physaddr;
+            byte bytemask;
+            W8 size;
+            bool internal;
+            bool mmio;
+        };
+
+        W8  dest_registers[MAX_TRANSOPS_PER_USER_INSN];
+        W64 dest_register_values[MAX_TRANSOPS_PER_USER_INSN];
+        W16 rflags[MAX_TRANSOPS_PER_USER_INSN];
+        PendingStore stores[MAX_TRANSOPS_PER_USER_INSN];
+        int store_count;
+
+        W64 insns;
+        W64 uops;
+        int stop;
+
+        WarmupThread(Context& ctx, BaseCore& core, WarmupStats& stats,
+                WarmupTiming* timing = NULL);
+        ~WarmupThread();
+
+        void reset();
+        void reset_flags();
+        bool run_bb();
+
+        private:
+        int execute_insn(BasicBlock& bb, int first, int last);
+        int execute_mem(const TransOp& uop, int idx, W64 ra, W64 rb,
+                W64 rc);
+        W64 load_data(Waddr virtaddr, const TransOp& uop);
+        Waddr translate(Waddr virtaddr, const TransOp& uop, int& result,
+                int& mmio);
+        void commit_insn(BasicBlock& bb, int first, int count, W64 rip);
+
+        void access_tlb(Waddr virtaddr, bool is_icache);
+        void access_cache(W64 physaddr, bool is_icache, bool is_store);
+        void set_exception(int exception, W32 error_code, Waddr addr);
+
+        W64 read_reg(W16 reg, int idx);
+        void write_temp_reg(W16 reg, W64 data);
+    };
+
+    /**
+     * @brief Functionally warm caches, TLBs and branch predictors
+     *
+     * @param machine Machine whose cores and caches are warmed
+     * @param insns Number of instructions to run on each Context
+     *
+     * @return Number of instructions executed on all Contexts
+     *
+     * Contexts keep their architectural state after warmup, so detailed
+     * simulation continues from where warmup stopped. Simulated cycles
+     * and committed instruction counts are not changed.
+     */
+    W64 functional_warmup(BaseMachine& machine, W64 insns);
+
+};
+
+#endif // WARMUP_H
@@ -352,6 +352,96 @@ template <> struct InvalidTag<W32> { static const W32 INVALID = 0xffffffff; };
 template <> struct InvalidTag<W16> { static const W16 INVALID = 0xffff; };
 template <> struct InvalidTag<W8> { static const W8 INVALID = 0xff; };
 
+//
+// Tag match for the fully associative arrays below. The scalar version
+// is branch-free with conditional moves and addition, and relies on
+// having at most one matching entry in the array; otherwise the
+// algorithm breaks. With AVX2 or AVX-512 enabled at build time (the
+// optimized build uses -march=native) 64 and 32 bit tags of up to 64
+// ways are compared a vector at a time and the first match is taken
+// from the compare mask.
+//
+template <typename T, int ways>
+static inline int scalar_tag_match(const T* tags, T target) {
+  int way = 0;
+  foreach (i, ways) {
+    way += (tags[i] == target) ? (i + 1) : 0;
+  }
+
+  return way - 1;
+}
+
+template <typename T, int ways>
+struct TagMatch {
+  static int match(const T* tags, T target) {
+    return scalar_tag_match<T, ways>(tags, target);
+  }
+};
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+
+template <int ways>
+struct TagMatch<W64, ways> {
+  static int match(const W64* tags, W64 target) {
+    if (ways > 64) return scalar_tag_match<W64, ways>(tags, target);
+
+    W64 hits = 0;
+    int i = 0;
+#ifdef __AVX512F__
+    __m512i t8 = _mm512_set1_epi64(target);
+    for (; i + 8 <= ways; i += 8) {
+      __m512i v = _mm512_loadu_si512((const void*)&tags[i]);
+      hits |= (W64)_mm512_cmpeq_epi64_mask(v, t8) << i;
+    }
+#endif
+#ifdef __AVX2__
+    __m256i t4 = _mm256_set1_epi64x(target);
+    for (; i + 4 <= ways; i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)&tags[i]);
+      hits |= (W64)_mm256_movemask_pd(
+          _mm256_castsi256_pd(_mm256_cmpeq_epi64(v, t4))) << i;
+    }
+#endif
+    for (; i < ways; i++) {
+      hits |= (W64)(tags[i] == target) << i;
+    }
+
+    return (hits) ? lsbindex64(hits) : -1;
+  }
+};
+
+template <int ways>
+struct TagMatch<W32, ways> {
+  static int match(const W32* tags, W32 target) {
+    if (ways > 64) return scalar_tag_match<W32, ways>(tags, target);
+
+    W64 hits = 0;
+    int i = 0;
+#ifdef __AVX512F__
+    __m512i t16 = _mm512_set1_epi32(target);
+    for (; i + 16 <= ways; i += 16) {
+      __m512i v = _mm512_loadu_si512((const void*)&tags[i]);
+      hits |= (W64)_mm512_cmpeq_epi32_mask(v, t16) << i;
+    }
+#endif
+#ifdef __AVX2__
+    __m256i t8 = _mm256_set1_epi32(target);
+    for (; i + 8 <= ways; i += 8) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)&tags[i]);
+      hits |= (W64)_mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, t8))) << i;
+    }
+#endif
+    for (; i < ways; i++) {
+      hits |= (W64)(tags[i] == target) << i;
+    }
+
+    return (hits) ? lsbindex64(hits) : -1;
+  }
+};
+#endif
+
 //
 // The replacement policy is pseudo-LRU using a most recently used
 // bit vector (mLRU), as described in the paper "Performance Evaluation
@@ -389,18 +479,11 @@ struct FullyAssociativeTags {
   }
 
   //
-  // This is a clever way of doing branch-free matching
-  // with conditional moves and addition. It relies on
-  // having at most one matching entry in the array;
-  // otherwise the algorithm breaks:
+  // Relies on having at most one matching entry in
+  // the array, see TagMatch.
   //
   int match(T target) {
-    int way = 0;
-    foreach (i, ways) {
-      way += (tags[i] == target) ? (i + 1) : 0;
-    }
-
-    return way - 1;
+    return TagMatch<T, ways>::match(tags, target);
   }
 
   int probe(T target) {
@@ -932,18 +1015,11 @@ struct LockableFullyAssociativeTags {
   }
 
   //
-  // This is a clever way of doing branch-free matching
-  // with conditional moves and addition. It relies on
-  // having at most one matching entry in the array;
-  // otherwise the algorithm breaks:
+  // Relies on having at most one matching entry in
+  // the array, see TagMatch.
   //
   int match(T target) {
-    int way = 0;
-    foreach (i, ways) {
-      way += (tags[i] == target) ? (i + 1) : 0;
-    }
-
-    return way - 1;
+    return TagMatch<T, ways>::match(tags, target);
   }
 
   int probe(T target) {
@@ -1614,6 +1690,22 @@ struct FullyAssociativeTags8bit {
     return match(prep(target));
   }
 
+  //
+  // Match only the first n slots; callers that keep their entries
+  // packed at the low end (e.g. a collapsing issue queue) can skip
+  // the chunks past the last live slot.
+  //
+  bitvec<size> match(const vec_t target, int n) const {
+    bitvec<size> m = 0;
+    int chunks = min((n + 15) / 16, chunkcount);
+
+    foreach (i, chunks) {
+      m = m.accum(i*16, 16, x86_sse_pmovmskb(x86_sse_pcmpeqb(target, tags[i])));
+    }
+
+    return m & valid;
+  }
+
   bitvec<size> matchany(const vec_t target) const {
     bitvec<size> m = 0;
 
@@ -1668,6 +1760,10 @@ struct FullyAssociativeTags8bit {
     return invalidate(prep(target));
   }
 
+  bitvec<size> invalidate(const vec_t target, int n) {
+    return invalidatemask(match(target, n));
+  }
+
   void collapse(int index) {
     base_t* tagbase = (base_t*)&tags;
     base_t* base = tagbase + index;
@@ -1776,6 +1872,18 @@ struct FullyAssociativeTags16bit {
     return match(prep(target));
   }
 
+  // Match only the first n slots (see FullyAssociativeTags8bit)
+  bitvec<size> match(const vec_t target, int n) const {
+    bitvec<size> m = 0;
+    int chunks = min((n + 7) / 8, chunkcount);
+
+    foreach (i, chunks) {
+      m = m.accum(i*8, 8, x86_sse_pmovmskw(x86_sse_pcmpeqw(target, tags[i])));
+    }
+
+    return m & valid;
+  }
+
   bitvec<size> matchany(const vec_t target) const {
     bitvec<size> m = 0;
 
@@ -1830,6 +1938,10 @@ struct FullyAssociativeTags16bit {
     return invalidate(prep(target));
   }
 
+  bitvec<size> invalidate(const vec_t target, int n) {
+    return invalidatemask(match(target, n));
+  }
+
   void collapse(int index) {
     base_t* tagbase = (base_t*)&tags;
     base_t* base = tagbase + index;
@@ -9,6 +9,8 @@ void StateList::init(const char* name, ListOfStateLists& lol, W32 flags) {
 
 
 StateList::StateList(const char* name, ListOfStateLists& lol, W32 flags) {
+  members = NULL;
+  membersize = 0;
   init(name, lol, flags);
 }
 
@@ -18,6 +20,16 @@ void StateList::reset() {
   count = 0;
   dispatch_source_counter = 0;
   issue_source_counter = 0;
+  if (members) memset(members, 0, ((membersize + 63) >> 6) * sizeof(W64));
+}
+
+void StateList::track_members(int size) {
+  assert(size <= STATELIST_MAX_MEMBERS);
+  assert(count == 0);
+  if (members) delete[] members;
+  membersize = size;
+  members = new W64[(size + 63) >> 6];
+  memset(members, 0, ((size + 63) >> 6) * sizeof(W64));
 }
 
 int ListOfStateLists::add(StateList* list) {
@@ -36,6 +36,9 @@
 
   struct StateList;
 
+/* Largest index space a StateList can keep a member bitmap for */
+#define STATELIST_MAX_MEMBERS 1024
+
   struct ListOfStateLists: public array<StateList*, 64> {
     int count;
 
@@ -53,11 +56,20 @@
     W64 issue_source_counter;
     W32 flags;
 
-    StateList() { name = NULL; listid = 0; reset(); }
+    /*
+     * Optional bitmap of the members' indices (ROB, LSQ or physical
+     * register index), kept by the owners' changestate(). Lets hot loops
+     * visit members in index order out of their contiguous array instead
+     * of chasing the list links.
+     */
+    W64* members;
+    int membersize;
+
+    StateList() { name = NULL; listid = 0; members = NULL; membersize = 0; reset(); }
 
-    ~StateList() { if(name) delete name; }
+    ~StateList() { if(name) free(name); if(members) delete[] members; }
 
-    StateList(const char* name_, W32 flags_ = 0): flags(flags_){ name = strdup(name_); listid = 0; reset();}
+    StateList(const char* name_, W32 flags_ = 0): flags(flags_){ name = strdup(name_); listid = 0; members = NULL; membersize = 0; reset();}
 
     void init(const char* name, ListOfStateLists& lol, W32 flags = 0);
 
@@ -71,6 +83,20 @@
 
     void reset();
 
+    void track_members(int size);
+
+    void mark(int idx) {
+      if (members) members[idx >> 6] |= (1ULL << (idx & 63));
+    }
+
+    void unmark(int idx) {
+      if (members) members[idx >> 6] &= ~(1ULL << (idx & 63));
+    }
+
+    bool marked(int idx) const {
+      return (members[idx >> 6] >> (idx & 63)) & 1;
+    }
+
     selfqueuelink* dequeue() {
       if (empty())
         return NULL;
@@ -139,6 +165,52 @@
     return list.print(os);
   }
 
+  /*
+   * Visit the member indices of a StateList with a member bitmap, oldest
+   * first in a circular index space that starts at 'first' (the head of
+   * a ROB or LSQ queue). The current member may change state; members
+   * added at indices not yet visited are visited too.
+   */
+  struct StateMemberScan {
+    const StateList& list;
+    int first;
+    int pos;
+    bool wrapped;
+
+    StateMemberScan(const StateList& list_, int first_)
+      : list(list_), first(first_), pos(first_), wrapped(false) {}
+
+    int next() {
+      for (;;) {
+        int i = find(pos, (wrapped) ? first : list.membersize);
+        if likely (i >= 0) {
+          pos = i + 1;
+          return i;
+        }
+        if (wrapped) return -1;
+        wrapped = true;
+        pos = 0;
+      }
+    }
+
+    int find(int from, int limit) const {
+      while (from < limit) {
+        int w = from >> 6;
+        W64 word = list.members[w] & (~0ULL << (from & 63));
+        if (word) {
+          int i = (w << 6) + lsbindex64(word);
+          return (i < limit) ? i : -1;
+        }
+        from = (w + 1) << 6;
+      }
+      return -1;
+    }
+  };
+
+#define foreach_state_member(L, first, i) \
+  StateMemberScan scan_##i((L), (first)); \
+  for (int i = scan_##i.next(); i >= 0; i = scan_##i.next())
+
 struct FixStateListObject : public selfqueuelink
 {
 	int idx;
@@ -261,6 +333,111 @@ struct FixStateList
 
 };
 
+/*
+ * FixStateList with a hash index on a per-object key (for example a cache
+ * line address). Objects are added to the index with index() once their
+ * key is known and are dropped from it when freed. Lookups walk only the
+ * objects that share a hash bucket, and objects with the same key are
+ * returned in the order they were indexed.
+ */
+template<typename T, int SIZE>
+struct IndexedFixStateList : public FixStateList<T, SIZE>
+{
+	typedef FixStateList<T, SIZE> base_t;
+
+	IndexedFixStateList() {
+		reset_index();
+	}
+
+	void index(T* obj, W64 key) {
+		int idx = obj->idx;
+		assert(!indexed_[idx]);
+
+		int bucket = hash(key);
+		key_[idx] = key;
+		next_[idx] = -1;
+		prev_[idx] = tail_[bucket];
+		if(tail_[bucket] >= 0)
+			next_[tail_[bucket]] = idx;
+		else
+			head_[bucket] = idx;
+		tail_[bucket] = idx;
+		indexed_[idx] = true;
+	}
+
+	void unindex(T* obj) {
+		int idx = obj->idx;
+		if(!indexed_[idx])
+			return;
+
+		int bucket = hash(key_[idx]);
+		if(prev_[idx] >= 0)
+			next_[prev_[idx]] = next_[idx];
+		else
+			head_[bucket] = next_[idx];
+		if(next_[idx] >= 0)
+			prev_[next_[idx]] = prev_[idx];
+		else
+			tail_[bucket] = prev_[idx];
+		indexed_[idx] = false;
+	}
+
+	/* Oldest indexed object with given key, NULL if none */
+	T* first(W64 key) {
+		return scan(head_[hash(key)], key);
+	}
+
+	/* Next object indexed after 'obj' with the same key, NULL if none */
+	T* next(T* obj) {
+		assert(indexed_[obj->idx]);
+		return scan(next_[obj->idx], key_[obj->idx]);
+	}
+
+	bool contains(W64 key) {
+		return (first(key) != NULL);
+	}
+
+	void free(T* obj) {
+		unindex(obj);
+		base_t::free(obj);
+	}
+
+	void reset() {
+		base_t::reset();
+		reset_index();
+	}
+
+	private:
+		W64 key_[SIZE];
+		int next_[SIZE];
+		int prev_[SIZE];
+		bool indexed_[SIZE];
+		int head_[SIZE * 2];
+		int tail_[SIZE * 2];
+
+		int hash(W64 key) const {
+			return int((key ^ (key >> 11)) % W64(SIZE * 2));
+		}
+
+		T* scan(int idx, W64 key) {
+			for(; idx >= 0; idx = next_[idx]) {
+				if(key_[idx] == key)
+					return &(*this)[idx];
+			}
+			return NULL;
+		}
+
+		void reset_index() {
+			foreach(i, SIZE) {
+				indexed_[i] = false;
+				next_[i] = prev_[i] = -1;
+			}
+			foreach(i, SIZE * 2) {
+				head_[i] = tail_[i] = -1;
+			}
+		}
+};
+
 template<typename T, int SIZE>
 static inline ostream& operator <<(ostream& os, const FixStateList<T, SIZE>& list)
 {
@@ -150,9 +150,8 @@ namespace superstl {
   //
 
   void stringbuf::reset(int length) {
-    if (buf && (buf != smallbuf))
-      delete[] buf;
-    buf = (length <= stringbuf_smallbufsize) ? smallbuf : new char[length];
+    release();
+    buf = (length <= stringbuf_smallbufsize) ? smallbuf : alloc(length);
     length = max(length, stringbuf_smallbufsize);
     p = buf;
     this->length = length;
@@ -162,18 +161,11 @@ namespace superstl {
   void stringbuf::resize(int newlength) {
     if (newlength > length) {
       int strlength = (p-buf);
-      if (buf == smallbuf) {
-        buf = new char[newlength];
-        assert(strlength < newlength);
-        memcpy(buf, smallbuf, strlength);
-        buf[strlength] = 0;
-      } else {
-        assert(strlength < newlength);
-        char* newbuf = new char[newlength];
-        memcpy(newbuf, buf, strlength);
-        delete[] buf;
-        buf = newbuf;
-      }
+      assert(strlength < newlength);
+      char* newbuf = alloc(newlength);
+      memcpy(newbuf, buf, strlength);
+      release();
+      buf = newbuf;
       length = newlength;
       p = buf + strlength;
       buf[strlength] = 0;
@@ -209,13 +201,14 @@ namespace superstl {
 			  break;
 		  }
 	  }
-	  retBuf.resize(end - start + 1);
+	  retBuf.resize(end - start + 2);
 	  int k = 0;
 	  for(int j = start; j <= end; j++) {
 		  retBuf.buf[k] = buf[j];
 		  k++;
 	  }
 	  retBuf.buf[k] = '\0';
+	  retBuf.p = retBuf.buf + k;
 	  return retBuf;
   }
 
@@ -234,13 +227,51 @@ namespace superstl {
   }
 
   stringbuf::~stringbuf() {
-    if (buf && (buf != smallbuf))
-      delete buf;
+    release();
     buf = NULL;
     p = NULL;
     length = 0;
   }
 
+  //
+  // StringArena
+  //
+
+  char* StringArena::alloc(int bytes) {
+    /* Keep every string 8 byte aligned */
+    bytes = (bytes + 7) & ~7;
+
+    if (!chunks || (chunks->size - chunks->used) < bytes) {
+      int size = max(bytes, chunksize);
+      Chunk* chunk = (Chunk*)malloc(sizeof(Chunk) + size);
+      chunk->next = chunks;
+      chunk->size = size;
+      chunk->used = 0;
+      chunks = chunk;
+    }
+
+    char* mem = (char*)(chunks + 1) + chunks->used;
+    chunks->used += bytes;
+    allocated += bytes;
+    return mem;
+  }
+
+  char* StringArena::strdup(const char* str) {
+    int bytes = strlen(str) + 1;
+    char* copy = alloc(bytes);
+    memcpy(copy, str, bytes);
+    return copy;
+  }
+
+  void StringArena::reset() {
+    while (chunks) {
+      Chunk* next = chunks->next;
+      free(chunks);
+      chunks = next;
+    }
+    allocated = 0;
+  }
+
   //
   // Writers
   //
@@ -1412,30 +1443,46 @@ const W64 expand_8bit_to_64bit_lut[256] alignto(8) = {
 
 // Signal
 
-Signal::Signal()
-{
-	// name_ = NULL;
-	func = NULL;
-}
+bool superstl::host_perf_enabled = false;
+__thread W64 superstl::host_perf_nested = 0;
 
-Signal::Signal(const char* name)
+/* Signal names are kept for the program's lifetime, shared by name */
+static const char* signal_name_copy(const char *name)
 {
-	name_ << name;
-	func = NULL;
+	static Hashtable<const char*, const char*, 256> *names = NULL;
+	if (!names)
+		names = new Hashtable<const char*, const char*, 256>();
+
+	const char **copy = names->get(name);
+	if (copy)
+		return *copy;
+
+	static StringArena *arena = NULL;
+	if (!arena)
+		arena = new StringArena();
+
+	const char *dup = arena->strdup(name);
+	names->add(name, dup);
+	return dup;
 }
 
-void Signal::connect(TFunctor* _func) {
-	func = _func;
+Signal::Signal()
+{
+	name_ = NULL;
+	perf_ = NULL;
+	clock_ = NULL;
+	partition_ = 0;
 }
 
-bool Signal::emit(void *arg) {
-    assert(name_.size() != 0);
-	bool ret_val = (*func)(arg);
-	return ret_val;
+Signal::Signal(const char* name)
+{
+	name_ = signal_name_copy(name);
+	perf_ = NULL;
+	clock_ = NULL;
+	partition_ = 0;
 }
 
-TFunctor* superstl::signal_fun_ptr(bool (*_fpt)(void *arg)) {
-	TFunctor2 *t = new TFunctor2(_fpt);
-	return (TFunctor*)t;
+void Signal::set_name(const char *name) {
+	name_ = signal_name_copy(name);
 }
 
@@ -92,16 +92,58 @@ namespace superstl {
   stringbuf& operator <<(stringbuf& os, const char* v);
   stringbuf& operator <<(stringbuf& os, const char v);
 
+  //
+  // Bump allocator for the strings of one subsystem. Strings that outgrow
+  // their small buffer take memory from the arena instead of the heap, it
+  // is only given back all at once by reset() or the destructor.
+  //
+  class StringArena {
+  public:
+    StringArena(int chunksize = 65536) {
+      chunks = NULL;
+      this->chunksize = chunksize;
+      allocated = 0;
+    }
+
+    ~StringArena() { reset(); }
+
+    char* alloc(int bytes);
+    char* strdup(const char* str);
+    void reset();
+
+    W64 allocated;
+
+  private:
+    struct Chunk {
+      Chunk* next;
+      int size;
+      int used;
+    };
+
+    Chunk* chunks;
+    int chunksize;
+  };
+
   class stringbuf {
   public:
-    stringbuf() { buf = NULL; reset(); }
+    stringbuf() { buf = NULL; arena = NULL; reset(); }
     stringbuf(int length) {
       buf = NULL;
+      arena = NULL;
       reset(length);
     }
 
+    stringbuf(StringArena* arena) {
+      buf = NULL;
+      this->arena = arena;
+      reset();
+    }
+
     stringbuf(const stringbuf& sb) {
-        *this << sb;
+      buf = NULL;
+      arena = NULL;
+      reset();
+      *this << sb;
     }
 
     void reset(int length = stringbuf_smallbufsize);
@@ -174,6 +216,17 @@ namespace superstl {
     char* buf;
     char* p;
     int length;
+    StringArena* arena;
+
+  private:
+    char* alloc(int length) {
+      return arena ? arena->alloc(length) : new char[length];
+    }
+
+    void release() {
+      if (buf && (buf != smallbuf) && !arena)
+        delete[] buf;
+    }
   };
 
   //
@@ -2713,6 +2766,271 @@ namespace superstl {
     return ht.print(os);
   }
 
+  //
+  // Open addressing replacement for SelfHashtable with the same interface.
+  //
+  // Objects are kept in one array of (hash, pointer) slots, probed
+  // linearly, so a miss or a collision is decided on the hash in the slot
+  // without touching the object. The array starts with <initsize> slots
+  // and doubles once it is 3/4 full. Growing is incremental: every add()
+  // moves a few slots of the old array into the new one, get() and
+  // remove() look in both until the old array is empty. Removed slots
+  // become tombstones, so removing objects while iterating is safe, as it
+  // is with SelfHashtable. Adding while iterating is not.
+  //
+  // The link in each object (LM::linkof) is not used, KM::hash must give
+  // more bits than the largest table has slots: the default asks the key
+  // manager for 2^24 sets.
+  //
+  template <typename K, typename T, int initsize = 64, typename LM = ObjectLinkManager<T>, typename KM = HashtableKeyManager<K, (1 << 24)> >
+  struct OpenHashtable {
+  protected:
+    struct Slot {
+      T* obj;
+      W32 hash;
+    };
+
+    static const int MIGRATE_STEP = 16;
+
+    Slot* slots;
+    int capacity;
+    int used;               // live and removed slots
+    Slot* oldslots;
+    int oldcapacity;
+    int migrated;           // old slots moved so far
+
+    static inline T* tombstone() { return (T*)1; }
+
+    static inline bool live(const Slot& s) {
+      return (s.obj != NULL) && (s.obj != tombstone());
+    }
+
+    static inline W32 hashof(const K& key) {
+      return W32(KM::hash(key));
+    }
+
+    static inline int index(W32 hash, int cap) {
+      return int((W64(hash) * 0x9e3779b97f4a7c15ULL) >> 32) & (cap - 1);
+    }
+
+    static Slot* find(Slot* table, int cap, W32 hash, const K& key) {
+      if unlikely (!table) return NULL;
+
+      int i = index(hash, cap);
+      for (;;) {
+        Slot& s = table[i];
+        if likely (!s.obj) return NULL;
+        if likely ((s.hash == hash) && (s.obj != tombstone()) &&
+            KM::equal(LM::keyof(s.obj), key)) return &s;
+        i = (i + 1) & (cap - 1);
+      }
+    }
+
+    Slot* find(const K& key) {
+      W32 hash = hashof(key);
+      Slot* s = find(slots, capacity, hash, key);
+      if unlikely (!s && oldslots) s = find(oldslots, oldcapacity, hash, key);
+      return s;
+    }
+
+    // Caller made sure <obj> isn't in either array
+    void insert(T* obj, W32 hash) {
+      int i = index(hash, capacity);
+      while (live(slots[i])) i = (i + 1) & (capacity - 1);
+
+      if (!slots[i].obj) used++;
+      slots[i].obj = obj;
+      slots[i].hash = hash;
+    }
+
+    void migrate(int n) {
+      while (oldslots && n--) {
+        // Left as a tombstone so probes in the old slots still get past it
+        Slot& s = oldslots[migrated++];
+        if (live(s)) {
+          insert(s.obj, s.hash);
+          s.obj = tombstone();
+        }
+
+        if (migrated == oldcapacity) {
+          delete[] oldslots;
+          oldslots = NULL;
+          oldcapacity = 0;
+          migrated = 0;
+        }
+      }
+    }
+
+    void grow() {
+      // Finish the last one first, this one only waits for adds
+      migrate(oldcapacity);
+
+      oldslots = slots;
+      oldcapacity = capacity;
+      migrated = 0;
+
+      // Mostly tombstones: same size again
+      if ((count * 2) > capacity) capacity *= 2;
+      slots = new Slot[capacity];
+      memset(slots, 0, capacity * sizeof(Slot));
+      used = 0;
+    }
+
+    void free_arrays() {
+      delete[] slots;
+      delete[] oldslots;
+      slots = oldslots = NULL;
+      capacity = oldcapacity = migrated = used = 0;
+    }
+
+  public:
+    int count;
+
+    OpenHashtable() {
+      slots = oldslots = NULL;
+      reset();
+    }
+
+    ~OpenHashtable() {
+      free_arrays();
+    }
+
+    T* get(const K& key) {
+      Slot* s = find(key);
+      return (s) ? s->obj : NULL;
+    }
+
+    struct Iterator {
+      OpenHashtable<K, T, initsize, LM, KM>* ht;
+      int slot;
+      bool old;
+
+      Iterator() { }
+
+      Iterator(OpenHashtable<K, T, initsize, LM, KM>* ht) {
+        reset(ht);
+      }
+
+      Iterator(OpenHashtable<K, T, initsize, LM, KM>& ht) {
+        reset(ht);
+      }
+
+      void reset(OpenHashtable<K, T, initsize, LM, KM>* ht) {
+        this->ht = ht;
+        slot = 0;
+        old = false;
+      }
+
+      void reset(OpenHashtable<K, T, initsize, LM, KM>& ht) {
+        reset(&ht);
+      }
+
+      T* next() {
+        if likely (!old) {
+          while (slot < ht->capacity) {
+            Slot& s = ht->slots[slot++];
+            if (live(s)) return s.obj;
+          }
+          old = true;
+          slot = ht->migrated;
+        }
+
+        while (ht->oldslots && (slot < ht->oldcapacity)) {
+          Slot& s = ht->oldslots[slot++];
+          if (live(s)) return s.obj;
+        }
+
+        return NULL;
+      }
+    };
+
+    dynarray<T*>& getentries(dynarray<T*>& a) {
+      a.resize(count);
+      int n = 0;
+      Iterator iter(this);
+      T* t;
+      while ((t = iter.next())) {
+        assert(n < count);
+        a[n++] = t;
+      }
+      return a;
+    }
+
+    void reset() {
+      free_arrays();
+      capacity = max(initsize, 16);
+      slots = new Slot[capacity];
+      memset(slots, 0, capacity * sizeof(Slot));
+      count = 0;
+    }
+
+    void clear(bool free_after_remove = false) {
+      if unlikely (free_after_remove) {
+        Iterator iter(this);
+        T* obj;
+        while ((obj = iter.next())) delete obj;
+      }
+      reset();
+    }
+
+    void clear_and_free() {
+      clear(true);
+    }
+
+    T* operator ()(const K& key) {
+      return get(key);
+    }
+
+    T* add(T* obj) {
+      migrate(MIGRATE_STEP);
+
+      const K& key = LM::keyof(obj);
+      Slot* s = find(key);
+      if unlikely (s) {
+        // Replaces the object added before with this key
+        s->obj = obj;
+        return obj;
+      }
+
+      if unlikely (((used + 1) * 4) > (capacity * 3)) grow();
+
+      insert(obj, hashof(key));
+      count++;
+      return obj;
+    }
+
+    T& add(T& obj) {
+      return *add(&obj);
+    }
+
+    T* remove(T* obj) {
+      Slot* s = find(LM::keyof(obj));
+      if (!s || (s->obj != obj)) return obj;
+      s->obj = tombstone();
+      count--;
+      return obj;
+    }
+
+    T& remove(T& obj) {
+      return *remove(&obj);
+    }
+
+    ostream& print(ostream& os) const {
+      os << "Hashtable of ", capacity, " slots containing ", count, " entries:", endl;
+      Iterator iter((OpenHashtable<K, T, initsize, LM, KM>*)this);
+      T* obj;
+      while ((obj = iter.next())) {
+        os << "    ", LM::keyof(obj), " -> ", *obj, endl;
+      }
+      return os;
+    }
+  };
+
+  template <typename K, typename T, int initsize, typename LM, typename KM>
+  static inline ostream& operator <<(ostream& os, const OpenHashtable<K, T, initsize, LM, KM>& ht) {
+    return ht.print(os);
+  }
+
   template <typename K, typename T, typename KM>
   struct ObjectHashtableEntry: public KeyValuePair<K, T> {
     typedef KeyValuePair<K, T> base_t;
@@ -3929,52 +4247,175 @@ namespace superstl {
     ~ScopedLock() { lock.release(); }
   };
 
-  class TFunctor {
-	  public:
-		  virtual bool operator()(void* arg) = 0;
+  /*
+   * Callback of a Signal: an object and a thunk that calls one of its
+   * member functions, or a plain function. The member function pointer
+   * is stored inline, so callbacks are copied by value and emitting a
+   * signal is a single indirect call, without a heap allocated functor.
+   */
+  struct SignalCallback {
+	  typedef bool (*Thunk)(const SignalCallback& cb, void *arg);
+
+	  Thunk thunk;
+	  void *obj;
+	  union {
+		  char member[2 * sizeof(void*)];
+		  bool (*fun)(void *arg);
+	  };
+
+	  SignalCallback() : thunk(NULL), obj(NULL) {}
+
+	  bool operator()(void *arg) const {
+		  return thunk(*this, arg);
+	  }
   };
 
   template<class T>
-	  class TFunctor1 : public TFunctor {
-		  private:
-			  bool (T::*fpt)(void *arg);
-			  T& obj;
-
-		  public:
-			  TFunctor1(T& _obj, bool (T::*_fpt)(void *arg)) :
-				  obj(_obj) {
-					  fpt = _fpt;
-				  };
-
-			  virtual bool operator()(void *arg) {
-				  return (obj.*fpt)(arg);
-			  };
+	  struct SignalMemberThunk {
+		  typedef bool (T::*Member)(void *arg);
+
+		  static bool call(const SignalCallback& cb, void *arg) {
+			  Member fpt;
+			  memcpy(&fpt, cb.member, sizeof(fpt));
+			  return (((T*)cb.obj)->*fpt)(arg);
+		  }
 	  };
 
-  class TFunctor2 : public TFunctor {
-	  private:
-		  bool (*fpt)(void *arg);
+  template<class T>
+	  SignalCallback signal_mem_ptr(T& _obj, bool (T::*_fpt)(void *arg)) {
+		  /* Fails to compile if member pointers don't fit the storage */
+		  typedef char member_fits[(sizeof(_fpt) <= sizeof(SignalCallback().member)) ? 1 : -1];
+		  (void)sizeof(member_fits);
+
+		  SignalCallback cb;
+		  cb.thunk = &SignalMemberThunk<T>::call;
+		  cb.obj = &_obj;
+		  memcpy(cb.member, &_fpt, sizeof(_fpt));
+		  return cb;
+	  }
 
-	  public:
-		  TFunctor2(bool (*_fpt)(void *arg)) :
-			  fpt(_fpt) {}
-		  virtual bool operator()(void *arg) {
-			  return (*fpt)(arg);
-		  }
+  static inline bool signal_fun_thunk(const SignalCallback& cb, void *arg) {
+	  return cb.fun(arg);
+  }
+
+  static inline SignalCallback signal_fun_ptr(bool (*_fpt)(void *arg)) {
+	  SignalCallback cb;
+	  cb.thunk = &signal_fun_thunk;
+	  cb.fun = _fpt;
+	  return cb;
+  }
+
+  /*
+   * Host time of one simulated component with -host-perf: rdtsc ticks
+   * spent in its code, not counting nested scopes of other components
+   * (a cache hit callback waking up a core is counted to the core), and
+   * number of times its code was entered.
+   */
+  struct HostPerfCounter {
+	  W64 ticks;
+	  W64 calls;
+
+	  HostPerfCounter() : ticks(0), calls(0) {}
   };
 
-  template<class T>
-	  TFunctor* signal_mem_ptr(T& _obj, bool (T::*_fpt)(void *arg)) {
-		  TFunctor1<T> *t = new TFunctor1<T>(_obj, _fpt);
-		  return (TFunctor*)t;
+  extern bool host_perf_enabled;
+
+  /* Ticks of scopes nested in the innermost open one */
+  extern __thread W64 host_perf_nested;
+
+  /*
+   * Attributes host time until end of the C++ scope, or until stop() or
+   * switch_to(), to 'counter'. NULL or -host-perf off makes it a no-op.
+   */
+  struct HostPerfScope {
+	  HostPerfCounter *counter;
+	  W64 outer_nested;
+	  W64 start;
+
+	  HostPerfScope(HostPerfCounter *counter_) { begin(counter_); }
+	  ~HostPerfScope() { stop(); }
+
+	  void begin(HostPerfCounter *counter_)
+	  {
+		  counter = host_perf_enabled ? counter_ : NULL;
+		  if likely (!counter) return;
+		  outer_nested = host_perf_nested;
+		  host_perf_nested = 0;
+		  start = rdtsc();
 	  }
 
-  TFunctor* signal_fun_ptr(bool (*_fpt)(void *arg));
+	  void stop()
+	  {
+		  if likely (!counter) return;
+		  W64 elapsed = rdtsc() - start;
+		  counter->ticks += elapsed - host_perf_nested;
+		  counter->calls++;
+		  host_perf_nested = outer_nested + elapsed;
+		  counter = NULL;
+	  }
 
+	  /* Consecutive parts of one function, like pipeline stages */
+	  void switch_to(HostPerfCounter *counter_)
+	  {
+		  stop();
+		  begin(counter_);
+	  }
+  };
+
+  /*
+   * Clock domain of simulated components (see clockdomain.h): runs at
+   * num/den of the simulation clock, num <= den. ticks is true in the
+   * simulation cycles in which the domain's clock has an edge.
+   */
+  struct ClockDomain {
+	  W64 num;
+	  W64 den;
+	  W64 phase;
+	  bool ticks;
+
+	  ClockDomain() : num(1), den(1), phase(0), ticks(true) {}
+
+	  bool full_speed() const { return num >= den; }
+
+	  /* Called once per simulation cycle by the machine */
+	  void tick()
+	  {
+		  if likely (full_speed()) {
+			  ticks = true;
+			  return;
+		  }
+
+		  phase += num;
+		  ticks = (phase >= den);
+		  if (ticks) phase -= den;
+	  }
+
+	  /* Idle cycles skipped by the machine */
+	  void skip(W64 cycles)
+	  {
+		  if likely (full_speed()) return;
+		  phase = (phase + (cycles % den) * num) % den;
+	  }
+
+	  /* Simulation cycles that span 'cycles' cycles of this domain */
+	  W64 to_sim_cycles(W64 cycles) const
+	  {
+		  if likely (full_speed()) return cycles;
+		  return (cycles * den + num - 1) / num;
+	  }
+  };
+
+  /*
+   * Names are copied once out of line, so a Signal is a few words and
+   * emit() inlines into its callers.
+   */
   class Signal {
 	  private:
-		  stringbuf name_;
-		  TFunctor* func;
+		  SignalCallback func;
+		  HostPerfCounter* perf_;
+		  ClockDomain* clock_;
+		  const char* name_;
+		  W16 partition_;
 
 	  public:
 		  Signal();
@@ -3982,13 +4423,42 @@ namespace superstl {
 
           ~Signal() {}
 
-		  bool emit(void *arg) ;
-		  void connect(TFunctor* _func);
+		  bool emit(void *arg) {
+			  assert(name_);
+			  HostPerfScope perf(perf_);
+			  return func(arg);
+		  }
+
+		  void connect(const SignalCallback& _func) {
+			  func = _func;
+		  }
 		  const char* get_name() {
-			  return name_.buf;
+			  return name_;
+		  }
+		  void set_name(const char *name);
+
+		  /* Component whose host time includes this signal's callback */
+		  void set_perf(HostPerfCounter *perf) {
+			  perf_ = perf;
+		  }
+		  HostPerfCounter* get_perf() {
+			  return perf_;
+		  }
+
+		  /* Domain whose cycles the delays of this signal's events are in */
+		  void set_clock(ClockDomain *clock) {
+			  clock_ = clock;
+		  }
+		  ClockDomain* get_clock() {
+			  return clock_;
+		  }
+
+		  /* LP of the component for -mem-parallelism, 0 for cores */
+		  void set_partition(W16 partition) {
+			  partition_ = partition;
 		  }
-		  void set_name(const char *name) {
-			  name_ << name;
+		  W16 get_partition() {
+			  return partition_;
 		  }
   };
 
@@ -0,0 +1,190 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <addrspace.h>
+#include <ptlsim.h>
+#include <machine.h>
+#include <basecore.h>
+#include <controller.h>
+#include <statsBuilder.h>
+
+using namespace Core;
+using namespace Memory;
+
+bool address_space_stats_enabled = false;
+
+/*
+ * Keys are page aligned CR3 values, ids set by the guest have the low bit
+ * set so they never match one
+ */
+static inline W64 id_key(W64 id)
+{
+    return (id << 1) | 1;
+}
+
+static const W64 OTHER_KEY = W64(-1);
+
+struct AddressSpaceCore {
+    BaseCore *core;
+    dynarray<Statable*> nodes;
+    Stats *start;           /* user + kernel counters of nodes at start */
+    int bank;
+    W64 key;
+    W64 start_cycle;
+    W64 start_insns;
+};
+
+static dynarray<AddressSpaceBank*> banks;
+static dynarray<AddressSpaceCore*> address_space_cores;
+static int max_banks = 0;
+static W64 context_ids[MAX_CONTEXTS];
+
+static W64 context_key(Context &ctx)
+{
+    W64 id = context_ids[ctx.cpu_index];
+    return id ? id_key(id) : floor(ctx.cr[3], PAGE_SIZE);
+}
+
+static int find_bank(W64 key)
+{
+    foreach (i, banks.count()) {
+        if (banks[i]->key == key)
+            return i;
+    }
+
+    /* Bank 0 is 'other' */
+    if (banks.count() > max_banks)
+        return 0;
+
+    AddressSpaceBank *bank = new AddressSpaceBank();
+    bank->key = key;
+    if (key & 1)
+        bank->name << "id_" << (key >> 1);
+    else
+        bank->name << "cr3_" << hexstring(key, 64);
+    bank->total = StatsBuilder::get().get_new_stats();
+    bank->switches = bank->cycles = bank->insns = 0;
+    banks.push(bank);
+
+    return banks.count() - 1;
+}
+
+/* Counters of the core's nodes into slot's start */
+static void snapshot(AddressSpaceCore &slot)
+{
+    foreach (i, slot.nodes.count()) {
+        Statable *node = slot.nodes[i];
+        node->sub_stats(*slot.start, *slot.start);
+        node->add_stats(*slot.start, *user_stats);
+        node->add_stats(*slot.start, *kernel_stats);
+    }
+
+    slot.start_cycle = sim_cycle;
+    slot.start_insns = slot.core->committed_insns;
+}
+
+/* Counters of the core since its last snapshot into its bank */
+static void credit(AddressSpaceCore &slot)
+{
+    AddressSpaceBank &bank = *banks[slot.bank];
+
+    foreach (i, slot.nodes.count()) {
+        Statable *node = slot.nodes[i];
+        node->add_stats(*bank.total, *user_stats);
+        node->add_stats(*bank.total, *kernel_stats);
+        node->sub_stats(*bank.total, *slot.start);
+    }
+
+    bank.cycles += sim_cycle - slot.start_cycle;
+    bank.insns += slot.core->committed_insns - slot.start_insns;
+    snapshot(slot);
+}
+
+void address_space_stats_setup(BaseMachine &machine, int count)
+{
+    if (address_space_stats_enabled)
+        return;
+
+    max_banks = count;
+
+    AddressSpaceBank *other = new AddressSpaceBank();
+    other->key = OTHER_KEY;
+    other->name = "other";
+    other->total = StatsBuilder::get().get_new_stats();
+    other->switches = other->cycles = other->insns = 0;
+    banks.push(other);
+
+    foreach (i, machine.cores.count()) {
+        AddressSpaceCore *slot = new AddressSpaceCore();
+        slot->core = machine.cores[i];
+        slot->nodes.push(slot->core);
+
+        foreach (j, machine.controllers.count()) {
+            Controller *cont = machine.controllers[j];
+            if (cont->is_private() && cont->idx == slot->core->get_coreid() &&
+                    cont->get_stats())
+                slot->nodes.push(cont->get_stats());
+        }
+
+        slot->start = StatsBuilder::get().get_new_stats();
+        slot->key = context_key(contextof(slot->core->context_base));
+        slot->bank = find_bank(slot->key);
+        banks[slot->bank]->switches++;
+        snapshot(*slot);
+        address_space_cores.push(slot);
+    }
+
+    address_space_stats_enabled = true;
+}
+
+void address_space_stats_poll()
+{
+    foreach (i, address_space_cores.count()) {
+        AddressSpaceCore &slot = *address_space_cores[i];
+        W64 key = context_key(contextof(slot.core->context_base));
+
+        if likely (key == slot.key)
+            continue;
+
+        credit(slot);
+        slot.key = key;
+        slot.bank = find_bank(key);
+        banks[slot.bank]->switches++;
+    }
+}
+
+bool address_space_set_id(int ctx_id, W64 id)
+{
+    if (!address_space_stats_enabled || !inrange(ctx_id, 0, MAX_CONTEXTS-1))
+        return false;
+
+    /* Shifted into keys, which must not be the 'other' one */
+    if (id >> 62)
+        return false;
+
+    context_ids[ctx_id] = id;
+    return true;
+}
+
+void address_space_stats_update()
+{
+    foreach (i, address_space_cores.count())
+        credit(*address_space_cores[i]);
+}
+
+int address_space_bank_count()
+{
+    return banks.count();
+}
+
+AddressSpaceBank& address_space_bank(int i)
+{
+    return *banks[i];
+}
@@ -0,0 +1,64 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef ADDRSPACE_H
+#define ADDRSPACE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+class Stats;
+struct BaseMachine;
+
+/*
+ * Stats per guest address space ('-stats-address-spaces <n>')
+ *
+ * Each core runs in the address space of its first thread's context: its
+ * page table root (CR3), or the id the guest gave the context with
+ * PTLCALL_STATS_ADDRESS_SPACE. The counters of the core's stats nodes and
+ * of its private caches, user and kernel, are added to the bank of that
+ * address space until it switches to another one. Up to n address spaces
+ * get a bank each, in the order they are first run, the later ones share
+ * the 'other' bank. Each bank is dumped after the total stats, tagged
+ * 'address_space' and its name.
+ */
+struct AddressSpaceBank {
+    W64 key;
+    stringbuf name;
+    Stats *total;
+    W64 switches;   /* times a core switched to it */
+    W64 cycles;     /* core cycles in it */
+    W64 insns;
+};
+
+extern bool address_space_stats_enabled;
+
+/* Banks for count address spaces, after the machine built its cores */
+void address_space_stats_setup(BaseMachine &machine, int count);
+
+void address_space_stats_poll();
+
+/* Cores switch banks once the CR3 or id of their context changed */
+static inline void address_space_stats_clock()
+{
+    if unlikely (address_space_stats_enabled)
+        address_space_stats_poll();
+}
+
+/* Id of the context's address space, 0 for its CR3 again */
+bool address_space_set_id(int ctx_id, W64 id);
+
+/* Add the counters since the last switch of each core to its bank */
+void address_space_stats_update();
+
+int address_space_bank_count();
+AddressSpaceBank& address_space_bank(int i);
+
+#endif // ADDRSPACE_H
@@ -0,0 +1,236 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <clockdomain.h>
+#include <ptlsim.h>
+#include <machine.h>
+#include <basecore.h>
+#include <memoryHierarchy.h>
+
+using namespace Core;
+using namespace Memory;
+
+bool clock_domains_scaled = false;
+
+/* Created on first domain, domains of all machines go here */
+static Statable *clock_domain_root = NULL;
+static dynarray<ClockDomainStats*> clock_domain_nodes;
+
+/* Caches and interconnects set up with a 'clock_domain' option */
+struct ClockDomainBinding {
+    const char *component;
+    ClockDomain *domain;
+};
+static dynarray<ClockDomainBinding> clock_domain_bindings;
+
+static W64 base_mhz()
+{
+    return max(config.core_freq_hz / 1000000, W64(1));
+}
+
+static ClockDomainStats* find_node(const char *name)
+{
+    foreach (i, clock_domain_nodes.length) {
+        ClockDomainStats *node = clock_domain_nodes[i];
+        if (strequal(node->get_name(), name))
+            return node;
+    }
+
+    return NULL;
+}
+
+static ClockDomainStats* find_node(ClockDomain *domain)
+{
+    foreach (i, clock_domain_nodes.length) {
+        ClockDomainStats *node = clock_domain_nodes[i];
+        if (&node->domain == domain)
+            return node;
+    }
+
+    return NULL;
+}
+
+/* Domain cycles since start, current frequency included from last change */
+static W64 domain_cycles(ClockDomainStats *node)
+{
+    W64 cycles = sim_cycle - node->last_change_cycle;
+    return node->domain_cycles +
+        (cycles * node->domain.num) / node->domain.den;
+}
+
+ClockDomain* clock_domain_get(const char *name)
+{
+    if (!clock_domain_root) {
+        clock_domain_root = new Statable("clock_domains");
+        clock_domain_root->disable_dump();
+    }
+
+    ClockDomainStats *node = find_node(name);
+    if (!node) {
+        node = new ClockDomainStats(name, clock_domain_root);
+        clock_domain_nodes.push(node);
+    }
+
+    return &node->domain;
+}
+
+bool clock_domain_set_freq(ClockDomain *domain, W64 mhz)
+{
+    ClockDomainStats *node = find_node(domain);
+    W64 base = base_mhz();
+
+    if (!node || mhz == 0 || mhz > base)
+        return false;
+
+    node->domain_cycles = domain_cycles(node);
+    node->last_change_cycle = sim_cycle;
+    node->change_count++;
+
+    domain->num = mhz;
+    domain->den = base;
+    domain->phase %= base;
+
+    if (!domain->full_speed())
+        clock_domains_scaled = true;
+
+    if (logable(1)) {
+        ptl_logfile << "Clock domain ", node->get_name(), " at ", mhz,
+                    " MHz from cycle ", sim_cycle, endl;
+    }
+
+    return true;
+}
+
+bool clock_domain_set_freq(const char *name, W64 mhz)
+{
+    ClockDomainStats *node = find_node(name);
+    if (!node)
+        return false;
+
+    return clock_domain_set_freq(&node->domain, mhz);
+}
+
+bool clock_domain_set_core_freq(BaseMachine &machine, Context &ctx, W64 mhz)
+{
+    foreach (i, machine.cores.count()) {
+        BaseCore *core = machine.cores[i];
+
+        if (core->active && core->runs_context(ctx))
+            return clock_domain_set_freq(core->clock_domain, mhz);
+    }
+
+    return false;
+}
+
+void clock_domains_configure(const char *spec)
+{
+    /* Frequencies changed by ptlcalls are kept until the option changes */
+    static stringbuf applied;
+    stringbuf list;
+    dynarray<stringbuf*> pairs;
+
+    if (applied == spec)
+        return;
+    applied.reset();
+    applied << spec;
+
+    list << spec;
+    list.split(pairs, ",");
+
+    foreach (i, pairs.count()) {
+        char *pair = pairs[i]->buf;
+        char *value = strchr(pair, '=');
+        W64 mhz = 0;
+
+        if (value) {
+            *value++ = '\0';
+            mhz = strtoull(value, NULL, 10);
+        }
+
+        /* Domains not used by the machine are created for ptlcalls */
+        if (!value || !clock_domain_set_freq(clock_domain_get(pair), mhz)) {
+            cerr << "Invalid -clock-domains entry '" << pair <<
+                 "', use name=MHz with MHz from 1 to " << base_mhz() << endl;
+        }
+
+        delete pairs[i];
+    }
+}
+
+ClockDomain* clock_domain_bind(MemoryHierarchy *memoryHierarchy,
+        const char *component, int coreid)
+{
+    BaseMachine &machine = memoryHierarchy->get_machine();
+    stringbuf name;
+    ClockDomain *domain;
+
+    if (!machine.get_option(component, "clock_domain", name))
+        return NULL;
+
+    if (name == "core") {
+        if (coreid < 0 || coreid >= machine.cores.count()) {
+            cerr << component << ": clock_domain 'core' needs a core with id "
+                 << coreid << endl;
+            return NULL;
+        }
+        domain = machine.cores[coreid]->clock_domain;
+    } else {
+        domain = clock_domain_get(name.buf);
+    }
+
+    ClockDomainBinding binding;
+    binding.component = strdup(component);
+    binding.domain = domain;
+    clock_domain_bindings.push(binding);
+
+    return domain;
+}
+
+ClockDomain* clock_domain_of(const char *component)
+{
+    foreach (i, clock_domain_bindings.length) {
+        if (strequal(clock_domain_bindings[i].component, component))
+            return clock_domain_bindings[i].domain;
+    }
+
+    return NULL;
+}
+
+void clock_domains_tick()
+{
+    foreach (i, clock_domain_nodes.length)
+        clock_domain_nodes[i]->domain.tick();
+}
+
+void clock_domains_skip(W64 cycles)
+{
+    foreach (i, clock_domain_nodes.length)
+        clock_domain_nodes[i]->domain.skip(cycles);
+}
+
+void clock_domain_set_stats(Stats *stats)
+{
+    if (!clock_domain_root || !clock_domains_scaled)
+        return;
+
+    clock_domain_root->enable_dump();
+    clock_domain_root->set_default_stats(stats);
+
+    W64 base = base_mhz();
+
+    foreach (i, clock_domain_nodes.length) {
+        ClockDomainStats *node = clock_domain_nodes[i];
+        W64 mhz = (base * node->domain.num) / node->domain.den;
+        W64 cycles = domain_cycles(node);
+        node->freq_mhz = mhz;
+        node->cycles = cycles;
+        node->changes = node->change_count;
+    }
+}
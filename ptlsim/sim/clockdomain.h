@@ -0,0 +1,116 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef CLOCKDOMAIN_H
+#define CLOCKDOMAIN_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+struct Context;
+
+namespace Memory {
+    class MemoryHierarchy;
+};
+
+/*
+ * Clock domains ('-clock-domains' and PTLCALL_SET_FREQ)
+ *
+ * Simulation cycles (sim_cycle) run at '-corefreq', the fastest clock of
+ * the machine. Each core gets a domain named after it, other domains are
+ * created by name on first use. A domain at a lower frequency has a clock
+ * edge in num/den of the simulation cycles, spread evenly:
+ *
+ *  - cores are only clocked in the cycles in which their domain ticks, so
+ *    a slow core also takes less host time
+ *  - caches and interconnects whose 'clock_domain' option names a domain
+ *    (or 'core', the domain of the core with same id) have their event
+ *    delays and hit latencies scaled from domain to simulation cycles
+ *
+ * Memory controllers time DRAM in nanoseconds and need no domain.
+ *
+ * Per domain stats are written to the 'clock_domains' node:
+ *
+ *   clock_domains:
+ *     uncore: {freq_mhz: .., cycles: .., changes: ..}
+ *
+ * where cycles are the clock cycles of the domain since start.
+ */
+
+struct ClockDomainStats : public Statable
+{
+    StatObj<W64> freq_mhz;
+    StatObj<W64> cycles;
+    StatObj<W64> changes;
+
+    ClockDomain domain;
+    W64 domain_cycles;
+    W64 last_change_cycle;
+    W64 change_count;
+
+    ClockDomainStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , freq_mhz("freq_mhz", this)
+          , cycles("cycles", this)
+          , changes("changes", this)
+          , domain_cycles(0)
+          , last_change_cycle(0)
+          , change_count(0)
+    { }
+};
+
+/**
+ * @brief Domain of given name, created at full speed if it is new
+ */
+ClockDomain* clock_domain_get(const char *name);
+
+/**
+ * @brief Change frequency of a domain
+ *
+ * @return false if there's no such domain or mhz is 0 or above -corefreq
+ */
+bool clock_domain_set_freq(const char *name, W64 mhz);
+bool clock_domain_set_freq(ClockDomain *domain, W64 mhz);
+
+/**
+ * @brief Change frequency of the core running ctx
+ */
+bool clock_domain_set_core_freq(BaseMachine &machine, Context &ctx, W64 mhz);
+
+/**
+ * @brief Apply '-clock-domains', a list of name=MHz pairs
+ */
+void clock_domains_configure(const char *spec);
+
+/**
+ * @brief Domain of a cache or interconnect from its 'clock_domain' option
+ *
+ * @return NULL if the component runs at simulation clock
+ *
+ * The component's signals set up with SET_SIGNAL_CB after this call use
+ * the domain's cycles, see clock_domain_of().
+ */
+ClockDomain* clock_domain_bind(Memory::MemoryHierarchy *memoryHierarchy,
+        const char *component, int coreid);
+ClockDomain* clock_domain_of(const char *component);
+
+/* True once any domain runs slower than the simulation clock */
+extern bool clock_domains_scaled;
+
+void clock_domains_tick();
+void clock_domains_skip(W64 cycles);
+
+/**
+ * @brief Copy domain counters into the default Stats of the node
+ */
+void clock_domain_set_stats(Stats *stats);
+
+#endif // CLOCKDOMAIN_H
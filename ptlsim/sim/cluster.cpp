@@ -0,0 +1,814 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <cluster.h>
+#include <ptlsim.h>
+#include <ptl-qemu.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+
+/* Read the other nodes this often even when no cycle waits for them */
+#define CLUSTER_POLL_CYCLES 1000
+
+#define CLUSTER_WAIT_TIMEOUT_MS 100
+#define CLUSTER_CONNECT_TIMEOUT_MS 120000
+
+/* Log the nodes a cycle still waits for every this many timeouts */
+#define CLUSTER_WAIT_LOG_TIMEOUTS 100
+
+enum {
+    CLUSTER_MSG_HELLO,      /* seq: node */
+    CLUSTER_MSG_FRAME,      /* cycle: arrival, seq: send order */
+    CLUSTER_MSG_TIME,       /* cycle: reached by the sender */
+    CLUSTER_MSG_LEAVE,      /* sender stopped simulating */
+};
+
+struct ClusterMessage {
+    W32 type;
+    W32 size;
+    W64 cycle;
+    W64 seq;
+};
+
+#define CLUSTER_RXBUF_SIZE (sizeof(ClusterMessage) + CLUSTER_MAX_FRAME)
+
+ClusterNode cluster_node;
+
+static W64 cluster_time_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (W64(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+ClusterFrame::ClusterFrame(W32 src, W64 seq, W64 arrival, const byte *buf,
+        W32 size)
+    : arrival(arrival)
+      , deliver(0)
+      , seq(seq)
+      , src(src)
+      , size(size)
+{
+    data = new byte[size];
+    memcpy(data, buf, size);
+}
+
+ClusterFrame::~ClusterFrame()
+{
+    delete[] data;
+}
+
+static bool cluster_frame_before(const ClusterFrame *a, const ClusterFrame *b)
+{
+    if (a->arrival != b->arrival)
+        return a->arrival < b->arrival;
+    if (a->src != b->src)
+        return a->src < b->src;
+    return a->seq < b->seq;
+}
+
+void ClusterRxQueue::add(ClusterFrame *frame)
+{
+    /* Frames mostly come in arrival order, insert from the end */
+    int i = frames_.count();
+    frames_.push(frame);
+
+    while (i > 0 && cluster_frame_before(frame, frames_[i - 1])) {
+        frames_[i] = frames_[i - 1];
+        i--;
+    }
+    frames_[i] = frame;
+}
+
+ClusterFrame* ClusterRxQueue::pop_before(W64 cycle)
+{
+    if (!frames_.count() || frames_[0]->arrival >= cycle)
+        return NULL;
+
+    ClusterFrame *frame = frames_[0];
+    foreach (i, frames_.count() - 1) {
+        frames_[i] = frames_[i + 1];
+    }
+    frames_.resize(frames_.count() - 1);
+
+    return frame;
+}
+
+ClusterNode::ClusterNode()
+    : nodes_(0)
+      , node_(-1)
+      , active_(false)
+      , latency_(0)
+      , safe_cycle_(infinity)
+      , next_cycle_(infinity)
+      , next_poll_cycle_(0)
+      , announced_(false)
+      , announced_cycle_(0)
+      , seq_(0)
+      , delivery_head_(0)
+      , mac_count_(0)
+      , deliver_fn_(NULL)
+      , watch_fn_(NULL)
+      , opaque_(NULL)
+      , frames_sent_(0)
+      , bytes_sent_(0)
+      , frames_received_(0)
+      , untimed_frames_(0)
+      , late_frames_(0)
+      , waits_(0)
+      , wait_ns_(0)
+{
+    foreach (i, CLUSTER_MAX_NODES) {
+        peers_[i].fd = -1;
+        peers_[i].simulating = false;
+        peers_[i].cycle = 0;
+        peers_[i].rxbuf = NULL;
+        peers_[i].rxfill = 0;
+        peers_[i].port = 0;
+    }
+}
+
+/* One 'host:port' line per node, '#' starts a comment */
+bool ClusterNode::read_hosts(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        ptl_logfile << "Cluster: unable to open hosts file ", filename, ": ",
+                    strerror(errno), endl;
+        return false;
+    }
+
+    char line[512];
+    nodes_ = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *host = line;
+        while (*host && isspace(*host)) host++;
+        char *end = host + strlen(host);
+        while (end > host && isspace(end[-1])) *(--end) = '\0';
+
+        if (!*host)
+            continue;
+
+        char *port = strrchr(host, ':');
+        if (!port || nodes_ == CLUSTER_MAX_NODES) {
+            ptl_logfile << "Cluster: bad line '", host, "' in ", filename,
+                        ", expected host:port of at most ",
+                        CLUSTER_MAX_NODES, " nodes", endl;
+            fclose(file);
+            return false;
+        }
+        *port++ = '\0';
+
+        peers_[nodes_].host << host;
+        peers_[nodes_].port = atoi(port);
+        nodes_++;
+    }
+
+    fclose(file);
+    return true;
+}
+
+static int cluster_connect(const char *host, int port)
+{
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addrs;
+    if (getaddrinfo(host, service, &hints, &addrs))
+        return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, addrs->ai_addr, addrs->ai_addrlen) == -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+/*
+ * Node i connects to the nodes before it and accepts the ones after it.
+ * The connections are set up blocking, and made non-blocking once all of
+ * them are up.
+ */
+bool ClusterNode::connect_peers()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(peers_[node_].port);
+
+    if (listen_fd == -1 || bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) ||
+            listen(listen_fd, nodes_)) {
+        ptl_logfile << "Cluster: unable to listen on port ",
+                    peers_[node_].port, ": ", strerror(errno), endl;
+        if (listen_fd != -1) close(listen_fd);
+        return false;
+    }
+
+    ClusterMessage hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.type = CLUSTER_MSG_HELLO;
+    hello.seq = node_;
+
+    foreach (i, node_) {
+        Peer &peer = peers_[i];
+        int waited = 0;
+
+        while ((peer.fd = cluster_connect(peer.host.buf, peer.port)) == -1) {
+            if (waited >= CLUSTER_CONNECT_TIMEOUT_MS) {
+                ptl_logfile << "Cluster: unable to connect to node ", i,
+                            " at ", peer.host, ":", peer.port, endl;
+                close(listen_fd);
+                return false;
+            }
+            usleep(CLUSTER_WAIT_TIMEOUT_MS * 1000);
+            waited += CLUSTER_WAIT_TIMEOUT_MS;
+        }
+
+        if (write(peer.fd, &hello, sizeof(hello)) != sizeof(hello)) {
+            ptl_logfile << "Cluster: unable to greet node ", i, endl;
+            close(listen_fd);
+            return false;
+        }
+    }
+
+    for (int accepted = node_ + 1; accepted < nodes_; accepted++) {
+        pollfd pfd = {listen_fd, POLLIN, 0};
+
+        int fd = -1;
+        if (::poll(&pfd, 1, CLUSTER_CONNECT_TIMEOUT_MS) == 1)
+            fd = accept(listen_fd, NULL, NULL);
+
+        if (fd == -1) {
+            ptl_logfile << "Cluster: ", nodes_ - accepted,
+                        " nodes after ", node_, " did not connect", endl;
+            close(listen_fd);
+            return false;
+        }
+
+        if (recv(fd, &hello, sizeof(hello), MSG_WAITALL) != sizeof(hello) ||
+                hello.type != CLUSTER_MSG_HELLO || hello.seq <= (W64)node_ ||
+                hello.seq >= (W64)nodes_ || peers_[hello.seq].fd != -1) {
+            ptl_logfile << "Cluster: bad greeting from a node, check that ",
+                        "all nodes use the same hosts file", endl;
+            close(fd);
+            close(listen_fd);
+            return false;
+        }
+
+        peers_[hello.seq].fd = fd;
+    }
+
+    close(listen_fd);
+
+    foreach (i, nodes_) {
+        Peer &peer = peers_[i];
+        if (i == node_)
+            continue;
+
+        fcntl(peer.fd, F_SETFL, fcntl(peer.fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(peer.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        peer.rxbuf = new byte[CLUSTER_RXBUF_SIZE];
+        peer.rxfill = 0;
+
+        /* Waited for at cycle 0 until it announces a cycle */
+        peer.simulating = true;
+        peer.cycle = 0;
+
+        if (watch_fn_)
+            watch_fn_(opaque_, peer.fd);
+    }
+
+    return true;
+}
+
+bool ClusterNode::setup(const char *hosts_file, int node,
+        W64 latency_cycles, double cycles_per_byte)
+{
+    if (!read_hosts(hosts_file))
+        return false;
+
+    if (node < 0 || node >= nodes_) {
+        ptl_logfile << "Cluster: node ", node, " is not in ", hosts_file,
+                    " of ", nodes_, " nodes", endl;
+        return false;
+    }
+
+    /* The lookahead, a frame must arrive at least one cycle later */
+    if (latency_cycles < 1)
+        latency_cycles = 1;
+
+    node_ = node;
+    latency_ = latency_cycles;
+    tx_port_.init(cycles_per_byte);
+    rx_port_.init(cycles_per_byte);
+
+    ptl_logfile << "Cluster: node ", node_, " of ", nodes_,
+                " connecting, latency ", latency_, " cycles", endl, flush;
+
+    if (!connect_peers())
+        return false;
+
+    active_ = true;
+    next_poll_cycle_ = 0;
+    update_safe_cycle();
+    next_cycle_ = 0;
+
+    ptl_logfile << "Cluster: all ", nodes_, " nodes connected", endl, flush;
+    return true;
+}
+
+void ClusterNode::attach(ClusterDeliverFn deliver, ClusterWatchFn watch,
+        void *opaque)
+{
+    deliver_fn_ = deliver;
+    watch_fn_ = watch;
+    opaque_ = opaque;
+
+    if (!watch_fn_ || !active_)
+        return;
+
+    foreach (i, nodes_) {
+        if (peers_[i].fd != -1)
+            watch_fn_(opaque_, peers_[i].fd);
+    }
+}
+
+void ClusterNode::drop_peer(int node)
+{
+    Peer &peer = peers_[node];
+
+    ptl_logfile << "Cluster: node ", node, " disconnected", endl;
+
+    close(peer.fd);
+    peer.fd = -1;
+    peer.simulating = false;
+    peer.rxfill = 0;
+
+    update_safe_cycle();
+    next_cycle_ = 0;
+}
+
+/*
+ * Writes the whole buffer. While the peer doesn't take more, the other
+ * nodes are read so two nodes sending to each other don't both block.
+ */
+void ClusterNode::write_all(int node, const byte *data, W32 size)
+{
+    Peer &peer = peers_[node];
+
+    while (size && peer.fd != -1) {
+        ssize_t rc = ::send(peer.fd, data, size, MSG_NOSIGNAL);
+
+        if (rc > 0) {
+            data += rc;
+            size -= rc;
+            continue;
+        }
+
+        if (rc == -1 && (errno == EAGAIN || errno == EINTR)) {
+            pollfd pfd = {peer.fd, POLLOUT, 0};
+            ::poll(&pfd, 1, 1);
+            read_peers(0);
+            continue;
+        }
+
+        drop_peer(node);
+    }
+}
+
+void ClusterNode::write_message(int node, W32 type, W64 cycle, W64 seq,
+        const byte *data, W32 size)
+{
+    ClusterMessage msg;
+    msg.type = type;
+    msg.size = size;
+    msg.cycle = cycle;
+    msg.seq = seq;
+
+    write_all(node, (const byte*)&msg, sizeof(msg));
+    if (size)
+        write_all(node, data, size);
+}
+
+/* False once the peer has closed its connection */
+bool ClusterNode::read_peer(int node)
+{
+    Peer &peer = peers_[node];
+
+    for (;;) {
+        ssize_t rc = recv(peer.fd, peer.rxbuf + peer.rxfill,
+                CLUSTER_RXBUF_SIZE - peer.rxfill, 0);
+
+        if (rc == 0)
+            return false;
+
+        if (rc == -1)
+            return (errno == EAGAIN || errno == EINTR);
+
+        peer.rxfill += rc;
+
+        W32 pos = 0;
+        while (peer.rxfill - pos >= sizeof(ClusterMessage)) {
+            ClusterMessage msg;
+            memcpy(&msg, peer.rxbuf + pos, sizeof(msg));
+
+            if (msg.size > CLUSTER_MAX_FRAME) {
+                ptl_logfile << "Cluster: message of ", msg.size,
+                            " bytes from node ", node, endl;
+                return false;
+            }
+
+            if (peer.rxfill - pos < sizeof(msg) + msg.size)
+                break;
+
+            handle_message(node, msg.type, msg.cycle, msg.seq,
+                    peer.rxbuf + pos + sizeof(msg), msg.size);
+            pos += sizeof(msg) + msg.size;
+
+            /* Dropped while handling it */
+            if (peer.fd == -1)
+                return true;
+        }
+
+        peer.rxfill -= pos;
+        memmove(peer.rxbuf, peer.rxbuf + pos, peer.rxfill);
+    }
+}
+
+void ClusterNode::read_peers(int timeout_ms)
+{
+    pollfd pfds[CLUSTER_MAX_NODES];
+    int nodes[CLUSTER_MAX_NODES];
+    int count = 0;
+
+    foreach (i, nodes_) {
+        if (peers_[i].fd == -1 || i == node_)
+            continue;
+
+        pfds[count].fd = peers_[i].fd;
+        pfds[count].events = POLLIN;
+        pfds[count].revents = 0;
+        nodes[count++] = i;
+    }
+
+    if (!count || ::poll(pfds, count, timeout_ms) <= 0)
+        return;
+
+    foreach (i, count) {
+        if (!pfds[i].revents)
+            continue;
+
+        if (!read_peer(nodes[i]))
+            drop_peer(nodes[i]);
+    }
+
+    update_safe_cycle();
+
+    /* Let clock() look at what came in */
+    next_cycle_ = 0;
+}
+
+void ClusterNode::handle_message(int node, W32 type, W64 cycle, W64 seq,
+        const byte *data, W32 size)
+{
+    Peer &peer = peers_[node];
+
+    switch (type) {
+        case CLUSTER_MSG_FRAME:
+            receive_frame(node, cycle, seq, data, size);
+            break;
+        case CLUSTER_MSG_TIME:
+            peer.simulating = true;
+            peer.cycle = cycle;
+            break;
+        case CLUSTER_MSG_LEAVE:
+            peer.simulating = false;
+            break;
+        default:
+            ptl_logfile << "Cluster: unknown message ", type, " from node ",
+                        node, endl;
+    }
+}
+
+void ClusterNode::receive_frame(int node, W64 cycle, W64 seq,
+        const byte *data, W32 size)
+{
+    frames_received_++;
+    learn_mac(data, size, node);
+
+    if (!deliver_fn_)
+        return;
+
+    ClusterFrame *frame = new ClusterFrame(node, seq, cycle, data, size);
+
+    /* Delivered by the next poll() or cycle */
+    if (cycle == CLUSTER_UNTIMED || !in_simulation) {
+        if (cycle == CLUSTER_UNTIMED)
+            untimed_frames_++;
+        queue_frame(frame, sim_cycle);
+        return;
+    }
+
+    pending_.add(frame);
+}
+
+/* Source and destination MAC addresses start the frame */
+static W64 cluster_mac(const byte *buf)
+{
+    W64 mac = 0;
+    memcpy(&mac, buf, 6);
+    return mac;
+}
+
+void ClusterNode::learn_mac(const byte *buf, W32 size, int node)
+{
+    if (size < 12)
+        return;
+
+    W64 mac = cluster_mac(buf + 6);
+
+    foreach (i, mac_count_) {
+        if (macs_[i].mac == mac) {
+            macs_[i].node = node;
+            return;
+        }
+    }
+
+    /* Frames to the ones that don't fit go to every node */
+    if (mac_count_ == CLUSTER_MAX_MACS)
+        return;
+
+    macs_[mac_count_].mac = mac;
+    macs_[mac_count_].node = node;
+    mac_count_++;
+}
+
+/* Node of the destination, -1 for broadcast, multicast and unknown */
+int ClusterNode::find_mac(const byte *buf, W32 size) const
+{
+    if (size < 6 || (buf[0] & 1))
+        return -1;
+
+    W64 mac = cluster_mac(buf);
+
+    foreach (i, mac_count_) {
+        if (macs_[i].mac == mac)
+            return macs_[i].node;
+    }
+
+    return -1;
+}
+
+void ClusterNode::update_safe_cycle()
+{
+    safe_cycle_ = infinity;
+
+    foreach (i, nodes_) {
+        const Peer &peer = peers_[i];
+        if (peer.fd == -1 || !peer.simulating)
+            continue;
+
+        safe_cycle_ = min(safe_cycle_, peer.cycle + latency_);
+    }
+}
+
+/* Queue the frame on the switch port to this node */
+void ClusterNode::queue_frame(ClusterFrame *frame, W64 arrival)
+{
+    frame->deliver = in_simulation ? rx_port_.transfer(arrival, frame->size)
+        : 0;
+    deliveries_.push(frame);
+}
+
+/* Frames that arrive before the safe cycle can not be overtaken anymore */
+void ClusterNode::release_frames()
+{
+    ClusterFrame *frame;
+
+    while ((frame = pending_.pop_before(safe_cycle_))) {
+        W64 arrival = frame->arrival;
+
+        if (arrival < sim_cycle) {
+            late_frames_++;
+            arrival = sim_cycle;
+        }
+
+        queue_frame(frame, arrival);
+    }
+}
+
+/* Switch port transfers end in queue order */
+void ClusterNode::deliver_frames()
+{
+    while (delivery_head_ < deliveries_.count()) {
+        ClusterFrame *frame = deliveries_[delivery_head_];
+        if (in_simulation && frame->deliver > sim_cycle)
+            break;
+
+        /* The NIC may have gone away */
+        if (deliver_fn_)
+            deliver_fn_(opaque_, frame->data, frame->size);
+        delete frame;
+        delivery_head_++;
+    }
+
+    if (delivery_head_ == deliveries_.count()) {
+        deliveries_.clear();
+        delivery_head_ = 0;
+    }
+}
+
+void ClusterNode::announce(W64 cycle)
+{
+    if (announced_ && cycle <= announced_cycle_)
+        return;
+
+    foreach (i, nodes_) {
+        if (peers_[i].fd != -1 && i != node_)
+            write_message(i, CLUSTER_MSG_TIME, cycle, 0, NULL, 0);
+    }
+
+    announced_ = true;
+    announced_cycle_ = cycle;
+}
+
+void ClusterNode::wait_for_peers()
+{
+    W64 start = cluster_time_ns();
+    int timeouts = 0;
+
+    announce(sim_cycle);
+
+    while (sim_cycle >= safe_cycle_) {
+        read_peers(CLUSTER_WAIT_TIMEOUT_MS);
+
+        if (sim_cycle < safe_cycle_ ||
+                ++timeouts % CLUSTER_WAIT_LOG_TIMEOUTS)
+            continue;
+
+        ptl_logfile << "Cluster: cycle ", sim_cycle, " waits for nodes";
+        foreach (i, nodes_) {
+            const Peer &peer = peers_[i];
+            if (peer.fd != -1 && peer.simulating &&
+                    peer.cycle + latency_ <= sim_cycle)
+                ptl_logfile << " ", i, " (at ", peer.cycle, ")";
+        }
+        ptl_logfile << endl, flush;
+    }
+
+    waits_++;
+    wait_ns_ += cluster_time_ns() - start;
+}
+
+void ClusterNode::send(const byte *buf, W32 size)
+{
+    /* Like an unplugged cable */
+    if (!active_ || size > CLUSTER_MAX_FRAME)
+        return;
+
+    W64 cycle = CLUSTER_UNTIMED;
+    if (in_simulation)
+        cycle = tx_port_.transfer(sim_cycle, size) + latency_;
+
+    seq_++;
+    frames_sent_++;
+    bytes_sent_ += size;
+
+    int dst = find_mac(buf, size);
+
+    foreach (i, nodes_) {
+        if (peers_[i].fd == -1 || i == node_ || (dst != -1 && dst != i))
+            continue;
+
+        write_message(i, CLUSTER_MSG_FRAME, cycle, seq_, buf, size);
+    }
+}
+
+void ClusterNode::poll()
+{
+    if (!active_)
+        return;
+
+    read_peers(0);
+
+    if (in_simulation)
+        return;
+
+    /* Not simulating, nothing can overtake the pending frames */
+    ClusterFrame *frame;
+    while ((frame = pending_.pop_before(infinity)))
+        queue_frame(frame, sim_cycle);
+
+    deliver_frames();
+}
+
+void ClusterNode::clock()
+{
+    if likely (sim_cycle < next_cycle_)
+        return;
+
+    if (sim_cycle >= next_poll_cycle_) {
+        next_poll_cycle_ = sim_cycle + CLUSTER_POLL_CYCLES;
+        read_peers(0);
+    }
+
+    if (sim_cycle >= safe_cycle_)
+        wait_for_peers();
+
+    release_frames();
+    deliver_frames();
+
+    next_cycle_ = min(safe_cycle_, next_poll_cycle_);
+    if (delivery_head_ < deliveries_.count())
+        next_cycle_ = min(next_cycle_, deliveries_[delivery_head_]->deliver);
+}
+
+W64 ClusterNode::get_next_active_cycle() const
+{
+    return next_cycle_;
+}
+
+void ClusterNode::leave()
+{
+    if (!active_)
+        return;
+
+    foreach (i, nodes_) {
+        if (peers_[i].fd != -1 && i != node_)
+            write_message(i, CLUSTER_MSG_LEAVE, sim_cycle, 0, NULL, 0);
+    }
+
+    announced_ = false;
+}
+
+void ClusterNode::shutdown()
+{
+    if (!active_)
+        return;
+
+    leave();
+
+    ptl_logfile << "Cluster: node ", node_, " sent ", frames_sent_,
+                " frames (", bytes_sent_, " bytes), received ",
+                frames_received_, " (", untimed_frames_, " untimed, ",
+                late_frames_, " late), waited ", waits_, " times for ",
+                (wait_ns_ / 1000000), " ms", endl;
+
+    foreach (i, nodes_) {
+        Peer &peer = peers_[i];
+        if (peer.fd != -1)
+            close(peer.fd);
+        peer.fd = -1;
+        delete[] peer.rxbuf;
+        peer.rxbuf = NULL;
+    }
+
+    active_ = false;
+    next_cycle_ = infinity;
+}
+
+extern "C" void ptl_cluster_attach(ClusterDeliverCB deliver,
+        ClusterWatchCB watch, void *opaque)
+{
+    cluster_node.attach(deliver, watch, opaque);
+}
+
+extern "C" void ptl_cluster_send(const uint8_t *buf, int size)
+{
+    cluster_node.send(buf, size);
+}
+
+extern "C" void ptl_cluster_poll(void)
+{
+    cluster_node.poll();
+}
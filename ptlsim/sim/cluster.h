@@ -0,0 +1,223 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/*
+ * Cluster of simulated nodes ('-cluster-hosts', '-cluster-node')
+ *
+ * Each MARSS instance simulates one node of the cluster and gets a NIC
+ * that is connected to the others with '-net nic -net marss'. The hosts
+ * file has one 'host:port' line per node, the same file is given to all
+ * nodes and '-cluster-node' is the line of this one, from 0. Node i
+ * listens on its port and connects over TCP to every node before it, so
+ * nodes can run on different host machines. Configuring the cluster
+ * waits until all nodes are connected.
+ *
+ * Frames go through a star switch. The sending NIC port and the switch
+ * port to the receiver each take the frame size over '-cluster-bandwidth'
+ * to transfer it, and the switch and wires add '-cluster-latency'. The
+ * sender stamps a frame with the cycle it arrives at the receiver's
+ * switch port (send cycle + NIC transfer + latency), the receiver queues
+ * it on its port and the guest NIC gets the frame at the cycle its
+ * transfer ends. The switch learns which node each MAC address is on,
+ * frames to unknown and broadcast addresses go to every node.
+ *
+ * Simulating nodes are kept in time with conservative lookahead instead
+ * of the '-sync' barrier: a frame sent at cycle t arrives at t + latency
+ * at the earliest, so when a node has announced that it reached cycle t
+ * the others can safely simulate up to t + latency - 1 without missing
+ * any of its frames. A node that wants to go further announces its own
+ * cycle and waits for the others' announcements. Nodes that have not
+ * started simulating yet are waited for at cycle 0, so start simulation
+ * on all nodes, e.g. with '-run' in each '-simconfig'. Nodes whose
+ * simulation stopped are not waited for anymore. Frames sent in
+ * emulation are untimed and delivered as soon as they come in, and
+ * frames of a node that simulates again later than the others arrive
+ * late: they are delivered on the next cycle and counted in the late
+ * frames of the log.
+ */
+
+#define CLUSTER_MAX_NODES 64
+#define CLUSTER_MAX_FRAME 65536
+#define CLUSTER_MAX_MACS  1024
+
+/* Preamble, start of frame, FCS and interframe gap on the wire */
+#define CLUSTER_FRAME_OVERHEAD 24
+
+/* Frame cycle of nodes that are not simulating */
+#define CLUSTER_UNTIMED ((W64)-1)
+
+/**
+ * @brief A NIC or switch port, transfers one frame at a time
+ */
+struct ClusterPort {
+    double cycles_per_byte;
+    W64 free_cycle;
+
+    void init(double cycles_per_byte) {
+        this->cycles_per_byte = cycles_per_byte;
+        free_cycle = 0;
+    }
+
+    W64 transfer_cycles(W32 size) const {
+        return (W64)ceil((size + CLUSTER_FRAME_OVERHEAD) * cycles_per_byte);
+    }
+
+    /* Cycle at which a frame offered at 'cycle' has been transferred */
+    W64 transfer(W64 cycle, W32 size) {
+        free_cycle = max(cycle, free_cycle) + transfer_cycles(size);
+        return free_cycle;
+    }
+};
+
+struct ClusterFrame {
+    W64 arrival;    /* at the receiver's switch port */
+    W64 deliver;    /* to the guest NIC */
+    W64 seq;        /* per sender */
+    W32 src;
+    W32 size;
+    byte *data;
+
+    ClusterFrame(W32 src, W64 seq, W64 arrival, const byte *buf, W32 size);
+    ~ClusterFrame();
+};
+
+/**
+ * @brief Timed frames received from the other nodes that may still be
+ * overtaken by frames not received yet
+ *
+ * Kept in arrival order, frames of the same cycle in node and then send
+ * order, so all runs queue them on the switch port in the same order.
+ */
+class ClusterRxQueue {
+    private:
+        dynarray<ClusterFrame*> frames_;
+
+    public:
+        void add(ClusterFrame *frame);
+
+        /* Oldest frame that arrives before 'cycle', NULL if none */
+        ClusterFrame* pop_before(W64 cycle);
+
+        int count() const { return frames_.count(); }
+};
+
+typedef void (*ClusterDeliverFn)(void *opaque, const byte *buf, int size);
+typedef void (*ClusterWatchFn)(void *opaque, int fd);
+
+class ClusterNode {
+    private:
+        struct Peer {
+            int fd;
+            bool simulating;
+            W64 cycle;           /* last announced */
+
+            byte *rxbuf;
+            W32 rxfill;
+
+            stringbuf host;
+            int port;
+        };
+
+        struct MacEntry {
+            W64 mac;
+            W32 node;
+        };
+
+        Peer peers_[CLUSTER_MAX_NODES];
+        int nodes_;
+        int node_;
+        bool active_;
+
+        W64 latency_;
+        ClusterPort tx_port_;
+        ClusterPort rx_port_;
+
+        W64 safe_cycle_;         /* may simulate the cycles before it */
+        W64 next_cycle_;         /* next cycle clock() has work in */
+        W64 next_poll_cycle_;
+        bool announced_;
+        W64 announced_cycle_;
+        W64 seq_;
+
+        ClusterRxQueue pending_;
+        dynarray<ClusterFrame*> deliveries_;
+        int delivery_head_;
+
+        MacEntry macs_[CLUSTER_MAX_MACS];
+        int mac_count_;
+
+        ClusterDeliverFn deliver_fn_;
+        ClusterWatchFn watch_fn_;
+        void *opaque_;
+
+        W64 frames_sent_;
+        W64 bytes_sent_;
+        W64 frames_received_;
+        W64 untimed_frames_;
+        W64 late_frames_;
+        W64 waits_;
+        W64 wait_ns_;
+
+        bool read_hosts(const char *filename);
+        bool connect_peers();
+        void write_message(int node, W32 type, W64 cycle, W64 seq,
+                const byte *data, W32 size);
+        void write_all(int node, const byte *data, W32 size);
+        bool read_peer(int node);
+        void handle_message(int node, W32 type, W64 cycle, W64 seq,
+                const byte *data, W32 size);
+        void receive_frame(int node, W64 cycle, W64 seq,
+                const byte *data, W32 size);
+        void drop_peer(int node);
+        void read_peers(int timeout_ms);
+
+        void learn_mac(const byte *buf, W32 size, int node);
+        int find_mac(const byte *buf, W32 size) const;
+
+        void update_safe_cycle();
+        void queue_frame(ClusterFrame *frame, W64 arrival);
+        void release_frames();
+        void deliver_frames();
+        void wait_for_peers();
+        void announce(W64 cycle);
+
+    public:
+        ClusterNode();
+
+        bool setup(const char *hosts_file, int node, W64 latency_cycles,
+                double cycles_per_byte);
+        bool active() const { return active_; }
+
+        /* Guest NIC side, see ptl_cluster_attach */
+        void attach(ClusterDeliverFn deliver, ClusterWatchFn watch,
+                void *opaque);
+        void send(const byte *buf, W32 size);
+
+        /* Reads the other nodes without waiting for them */
+        void poll();
+
+        /* Every cycle of simulation, waits until the cycle is safe */
+        void clock();
+        W64 get_next_active_cycle() const;
+
+        /* Simulation stopped, don't wait for this node anymore */
+        void leave();
+        void shutdown();
+};
+
+extern ClusterNode cluster_node;
+
+#endif // CLUSTER_H
@@ -0,0 +1,426 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <eventtrace.h>
+
+#include <ptlsim.h>
+
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * Binary trace format (read by tools/ptltrace.py):
+ *
+ *   file:    "PTLTRCE1", W32 event count, per event: W32 name length,
+ *            name, W32 format length, format; then chunks until EOF
+ *   chunk:   W8 kind, then
+ *            'C' component: W32 id, W32 name length, name
+ *            'R' records:   W32 ring id, W32 count, TraceRecord[count]
+ *            'D' dropped:   W32 ring id, W64 records dropped so far
+ *
+ * A component chunk always comes before records that use its id. Records
+ * of one ring are in cycle order; rings are written one after another.
+ * All fields are little-endian.
+ */
+static const char TRACE_MAGIC[8] = {'P','T','L','T','R','C','E','1'};
+
+const char* trace_event_names[TRACE_EVENT_COUNT] = {
+#define PTLTRACE_NAME(id, format) #id,
+    PTLTRACE_EVENTS(PTLTRACE_NAME)
+#undef PTLTRACE_NAME
+};
+
+const char* trace_event_formats[TRACE_EVENT_COUNT] = {
+#define PTLTRACE_FORMAT(id, format) format,
+    PTLTRACE_EVENTS(PTLTRACE_FORMAT)
+#undef PTLTRACE_FORMAT
+};
+
+bool trace_enabled = false;
+__thread TraceRing *trace_thread_ring = NULL;
+
+/*
+ * Rings and component names outlive a trace: threads keep their ring
+ * across trace_close() and trace_open(), and components register at
+ * machine build, before or after the trace opens. Rings are only ever
+ * prepended to the list, so the writer can walk it without the lock.
+ */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing *volatile trace_rings = NULL;
+static int trace_ring_count = 0;
+static dynarray<stringbuf*> trace_components;
+
+struct TraceWriter {
+    ofstream os;
+    W64 ring_size;
+    volatile bool stopping;
+    pthread_t thread;
+
+    int written_components;
+    W64 records;
+};
+
+static TraceWriter *trace_writer = NULL;
+
+/* Size and mode of new rings, set while tracing is enabled */
+static W64 trace_ring_size = 0;
+static bool trace_overwrite = false;
+
+/* Flight recorder keeps dumps of the first few failures only */
+static const int FLIGHT_RECORDER_MAX_DUMPS = 8;
+static char flight_recorder_file[512];
+static char flight_recorder_dump_file[544];
+static int flight_recorder_dumps = 0;
+static bool flight_recorder_enabled = false;
+static bool flight_recorder_handlers = false;
+static struct sigaction flight_recorder_old_segv;
+static struct sigaction flight_recorder_old_bus;
+
+static inline void put_w8(ostream &os, W8 v)
+{
+    os.write((const char*)&v, sizeof(v));
+}
+
+static inline void put_w32(ostream &os, W32 v)
+{
+    os.write((const char*)&v, sizeof(v));
+}
+
+static inline void put_w64(ostream &os, W64 v)
+{
+    os.write((const char*)&v, sizeof(v));
+}
+
+static inline void put_string(ostream &os, const char *s)
+{
+    put_w32(os, strlen(s));
+    os.write(s, strlen(s));
+}
+
+static void write_new_components(TraceWriter *w)
+{
+    pthread_mutex_lock(&trace_lock);
+    for (; w->written_components < trace_components.length;
+            w->written_components++) {
+        put_w8(w->os, 'C');
+        put_w32(w->os, w->written_components);
+        put_string(w->os, trace_components[w->written_components]->buf);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Write out everything queued in all rings, returns records written */
+static W64 drain_rings(TraceWriter *w)
+{
+    W64 written = 0;
+
+    write_new_components(w);
+
+    for (TraceRing *ring = trace_rings; ring; ring = ring->next) {
+        W64 n;
+        const TraceRecord *r;
+        while ((r = ring->front(n)) && n) {
+            put_w8(w->os, 'R');
+            put_w32(w->os, ring->id);
+            put_w32(w->os, n);
+            w->os.write((const char*)r, n * sizeof(TraceRecord));
+            ring->pop(n);
+            written += n;
+        }
+    }
+
+    w->records += written;
+    return written;
+}
+
+static void* trace_writer_thread(void *arg)
+{
+    TraceWriter *w = (TraceWriter*)arg;
+
+    while (!w->stopping) {
+        if (!drain_rings(w))
+            usleep(1000);
+    }
+
+    /* Producers have stopped, write what they left behind */
+    drain_rings(w);
+
+    for (TraceRing *ring = trace_rings; ring; ring = ring->next) {
+        put_w8(w->os, 'D');
+        put_w32(w->os, ring->id);
+        put_w64(w->os, ring->dropped);
+    }
+    w->os.flush();
+
+    return NULL;
+}
+
+W32 trace_register_component(const char *name)
+{
+    stringbuf *s = new stringbuf();
+    *s << name;
+
+    pthread_mutex_lock(&trace_lock);
+    W32 id = trace_components.length;
+    trace_components.push(s);
+    pthread_mutex_unlock(&trace_lock);
+
+    return id;
+}
+
+TraceRing* trace_attach_thread()
+{
+    if (!trace_ring_size) return NULL;
+
+    pthread_mutex_lock(&trace_lock);
+    TraceRing *ring = new TraceRing(trace_ring_count++, trace_ring_size,
+            trace_overwrite);
+    ring->next = trace_rings;
+    /* Ring must be complete before the writer can find it */
+    __sync_synchronize();
+    trace_rings = ring;
+    pthread_mutex_unlock(&trace_lock);
+
+    trace_thread_ring = ring;
+    return ring;
+}
+
+/* Ring index is masked, round its size up to a power of two */
+static W64 round_ring_size(W64 ring_size)
+{
+    W64 size = 1;
+    while (size < ring_size) size <<= 1;
+    return size;
+}
+
+/* Records left over from a previous trace don't belong in the next one.
+ * Rings of threads that already traced keep their size. */
+static void reset_rings(bool overwrite)
+{
+    for (TraceRing *ring = trace_rings; ring; ring = ring->next) {
+        ring->head = ring->tail;
+        ring->dropped = 0;
+        ring->overwrite = overwrite;
+    }
+}
+
+bool trace_open(const char *filename, W64 ring_size)
+{
+    trace_close();
+
+    TraceWriter *w = new TraceWriter();
+    w->os.open(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    if (!w->os) {
+        ptl_logfile << "Unable to open trace file ", filename, endl;
+        delete w;
+        return false;
+    }
+
+    w->ring_size = round_ring_size(ring_size);
+    w->stopping = false;
+    w->written_components = 0;
+    w->records = 0;
+
+    reset_rings(false);
+
+    w->os.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    put_w32(w->os, TRACE_EVENT_COUNT);
+    foreach (i, TRACE_EVENT_COUNT) {
+        put_string(w->os, trace_event_names[i]);
+        put_string(w->os, trace_event_formats[i]);
+    }
+
+    if (pthread_create(&w->thread, NULL, trace_writer_thread, w)) {
+        ptl_logfile << "Unable to start trace writer thread, ",
+                    "tracing disabled", endl;
+        delete w;
+        return false;
+    }
+
+    trace_writer = w;
+    trace_ring_size = w->ring_size;
+    trace_overwrite = false;
+    __sync_synchronize();
+    trace_enabled = true;
+    return true;
+}
+
+void trace_close()
+{
+    if (flight_recorder_enabled) {
+        trace_enabled = false;
+        flight_recorder_enabled = false;
+        trace_ring_size = 0;
+        return;
+    }
+
+    TraceWriter *w = trace_writer;
+    if (!w) return;
+
+    trace_enabled = false;
+    trace_ring_size = 0;
+    __sync_synchronize();
+
+    w->stopping = true;
+    pthread_join(w->thread, NULL);
+    trace_writer = NULL;
+
+    W64 dropped = 0;
+    for (TraceRing *ring = trace_rings; ring; ring = ring->next)
+        dropped += ring->dropped;
+
+    ptl_logfile << "Event trace: ", w->records, " records from ",
+                trace_ring_count, " threads, ", dropped,
+                " dropped on a full ring", endl;
+
+    w->os.close();
+    delete w;
+}
+
+/*
+ * Flight recorder dumps use plain write() and no locks or allocation, so
+ * they also work from the SIGSEGV handler and with trace_lock held by a
+ * crashed thread.
+ */
+static void put_raw(int fd, const void *data, size_t size)
+{
+    const char *p = (const char*)data;
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0) return;
+        p += n;
+        size -= n;
+    }
+}
+
+static void put_raw_w8(int fd, W8 v) { put_raw(fd, &v, sizeof(v)); }
+static void put_raw_w32(int fd, W32 v) { put_raw(fd, &v, sizeof(v)); }
+static void put_raw_w64(int fd, W64 v) { put_raw(fd, &v, sizeof(v)); }
+
+static void put_raw_string(int fd, const char *s)
+{
+    put_raw_w32(fd, strlen(s));
+    put_raw(fd, s, strlen(s));
+}
+
+static void put_raw_records(int fd, TraceRing *ring, W64 start, W64 n)
+{
+    if (!n) return;
+    put_raw_w8(fd, 'R');
+    put_raw_w32(fd, ring->id);
+    put_raw_w32(fd, n);
+    put_raw(fd, &ring->records[start], n * sizeof(TraceRecord));
+}
+
+const char* flight_recorder_dump(const char *reason)
+{
+    if (!flight_recorder_enabled) return NULL;
+    if (flight_recorder_dumps >= FLIGHT_RECORDER_MAX_DUMPS) return NULL;
+
+    if (flight_recorder_dumps)
+        snprintf(flight_recorder_dump_file, sizeof(flight_recorder_dump_file),
+                "%s.%d", flight_recorder_file, flight_recorder_dumps);
+    else
+        snprintf(flight_recorder_dump_file, sizeof(flight_recorder_dump_file),
+                "%s", flight_recorder_file);
+    flight_recorder_dumps++;
+
+    int fd = open(flight_recorder_dump_file, O_WRONLY | O_CREAT | O_TRUNC,
+            0644);
+    if (fd < 0) return NULL;
+
+    put_raw(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    put_raw_w32(fd, TRACE_EVENT_COUNT);
+    foreach (i, TRACE_EVENT_COUNT) {
+        put_raw_string(fd, trace_event_names[i]);
+        put_raw_string(fd, trace_event_formats[i]);
+    }
+
+    foreach (i, trace_components.length) {
+        put_raw_w8(fd, 'C');
+        put_raw_w32(fd, i);
+        put_raw_string(fd, trace_components[i]->buf);
+    }
+
+    /* Oldest record first; the ring may wrap once */
+    for (TraceRing *ring = trace_rings; ring; ring = ring->next) {
+        W64 head = ring->head;
+        W64 count = min(ring->tail - head, ring->size());
+        W64 start = head & (ring->size() - 1);
+        W64 first = min(count, ring->size() - start);
+        put_raw_records(fd, ring, start, first);
+        put_raw_records(fd, ring, 0, count - first);
+
+        /* Records overwritten before this dump */
+        put_raw_w8(fd, 'D');
+        put_raw_w32(fd, ring->id);
+        put_raw_w64(fd, ring->dropped);
+    }
+
+    close(fd);
+
+    /* Reason goes to stderr as ptl_logfile may be what crashed */
+    char msg[768];
+    snprintf(msg, sizeof(msg), "Flight recorder (%s) dumped to %s\n",
+            reason, flight_recorder_dump_file);
+    put_raw(2, msg, strlen(msg));
+
+    return flight_recorder_dump_file;
+}
+
+static void flight_recorder_assert_cb()
+{
+    flight_recorder_dump("assert");
+}
+
+static void flight_recorder_signal(int sig, siginfo_t *info, void *uc)
+{
+    flight_recorder_dump(sig == SIGSEGV ? "SIGSEGV" : "SIGBUS");
+
+    /* Faulting access is retried on return and goes to old handler */
+    sigaction(sig, (sig == SIGSEGV) ? &flight_recorder_old_segv :
+            &flight_recorder_old_bus, NULL);
+}
+
+bool flight_recorder_open(const char *filename, W64 ring_size)
+{
+    if (trace_writer) {
+        ptl_logfile << "Flight recorder is off while writing -tracefile",
+                    endl;
+        return false;
+    }
+
+    /* Forked simulations only change the file name */
+    snprintf(flight_recorder_file, sizeof(flight_recorder_file), "%s",
+            filename);
+    if (flight_recorder_enabled) return true;
+
+    reset_rings(true);
+    trace_ring_size = round_ring_size(ring_size);
+    trace_overwrite = true;
+    flight_recorder_enabled = true;
+
+    if (!flight_recorder_handlers) {
+        flight_recorder_handlers = true;
+        register_assert_cb(&flight_recorder_assert_cb);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = flight_recorder_signal;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &flight_recorder_old_segv);
+        sigaction(SIGBUS, &sa, &flight_recorder_old_bus);
+    }
+
+    __sync_synchronize();
+    trace_enabled = true;
+    return true;
+}
@@ -0,0 +1,178 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef EVENTTRACE_H
+#define EVENTTRACE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/*
+ * Binary event trace
+ *
+ * ptltrace() puts a fixed size record into a ring owned by the calling
+ * host thread; it neither formats text nor takes a lock. A writer thread
+ * drains all rings into the '-tracefile' file, which tools/ptltrace.py
+ * renders as text. If a ring is full the record is dropped and counted,
+ * so the simulation thread never waits for the writer.
+ *
+ * In flight recorder mode ('-flight-recorder') there is no writer: a
+ * full ring overwrites its oldest record, and flight_recorder_dump()
+ * writes the last records of every thread in the same format when an
+ * assert, a deadlock recovery or a crash needs them.
+ *
+ * Each event has a Python str.format() string applied to its four args
+ * by the decoder. Add new events at the end of the list so ids of traces
+ * already written stay valid.
+ */
+#define PTLTRACE_EVENTS(X) \
+    X(CACHE_ACCESS,     "Accessing Cache: Request: addr {0:#x} rip {1:#x} core {2} type {3}") \
+    X(CACHE_HIT,        "cache_hit_cb entry: addr {0:#x} core {1}") \
+    X(CACHE_MISS,       "cache_miss_cb entry: addr {0:#x} core {1}") \
+    X(CACHE_QUEUE_FULL, "Controller queue is full") \
+    X(CACHE_DEPENDENCY, "dependent entry: addr {0:#x} core {1}") \
+    X(MEM_ACCESS,       "Received message in Memory controller: addr {0:#x} core {1} type {2}") \
+    X(MEM_QUEUE_FULL,   "Memory queue is full") \
+    X(MEM_DONE,         "Memory access done for Request: addr {0:#x} core {1}") \
+    X(OOO_COMMIT,       "commit_rip: {0:#x} uuid {1}") \
+    X(OOO_FLUSH,        "flush_pipeline() at rip {0:#x}") \
+    X(OOO_DEADLOCK,     "redispatch_deadlock_recovery, last commit at cycle {0}") \
+    X(UOP_FETCH,        "uop {0} fetch: rip {1:#x}") \
+    X(UOP_RENAME,       "uop {0} rename: rip {1:#x} rob {2}") \
+    X(UOP_DISPATCH,     "uop {0} dispatch: rip {1:#x} cluster {2}") \
+    X(UOP_ISSUE,        "uop {0} issue: rip {1:#x} cluster {2}") \
+    X(UOP_COMPLETE,     "uop {0} complete: rip {1:#x}") \
+    X(UOP_WRITEBACK,    "uop {0} writeback: rip {1:#x}") \
+    X(UOP_COMMIT,       "uop {0} commit: rip {1:#x}") \
+    X(UOP_ANNUL,        "uop {0} annul: rip {1:#x}") \
+    X(UOP_REPLAY,       "uop {0} replay: rip {1:#x}") \
+    X(UOP_REDISPATCH,   "uop {0} redispatch: rip {1:#x}") \
+    X(UOP_REDIRECT,     "fetch redirect to rip {1:#x}, fetched uops before {0} not yet renamed are dropped") \
+    X(GUEST_MARKER,     "guest marker {0:#x} posted to ring slot {1}")
+
+enum {
+#define PTLTRACE_ENUM(id, format) TRACE_##id,
+    PTLTRACE_EVENTS(PTLTRACE_ENUM)
+#undef PTLTRACE_ENUM
+    TRACE_EVENT_COUNT
+};
+
+extern const char* trace_event_names[TRACE_EVENT_COUNT];
+extern const char* trace_event_formats[TRACE_EVENT_COUNT];
+
+struct TraceRecord {
+    W64 cycle;
+    W32 component;
+    W32 event;
+    W64 args[4];
+};
+
+/**
+ * @brief Single producer, single consumer ring of trace records
+ *
+ * Only the owning thread moves tail and only the writer thread moves head,
+ * like DRAMSimQueue but sized at run time.
+ */
+struct TraceRing {
+    volatile W64 head;
+    char headPad[56];
+    volatile W64 tail;
+    char tailPad[56];
+
+    dynarray<TraceRecord> records;
+    W64 dropped;
+    int id;
+    bool overwrite;
+    TraceRing *next;
+
+    TraceRing(int id_, W64 size, bool overwrite_ = false)
+        : head(0), tail(0), dropped(0), id(id_), overwrite(overwrite_)
+        , next(NULL)
+    {
+        assert(size && !(size & (size - 1)));
+        records.resize(size);
+    }
+
+    W64 size() const { return records.length; }
+    W64 count() const { return tail - head; }
+
+    bool push(W64 cycle, W32 component, W32 event,
+            W64 a0, W64 a1, W64 a2, W64 a3) {
+        if unlikely (tail - head == size()) {
+            dropped++;
+            if (!overwrite) return false;
+            /* Flight recorder: owner moves head as there is no writer */
+            head++;
+        }
+
+        TraceRecord& r = records[tail & (size() - 1)];
+        r.cycle = cycle;
+        r.component = component;
+        r.event = event;
+        r.args[0] = a0;
+        r.args[1] = a1;
+        r.args[2] = a2;
+        r.args[3] = a3;
+
+        /* Record must be visible before the writer sees tail move */
+        __sync_synchronize();
+        tail++;
+        return true;
+    }
+
+    /* Writer side: contiguous run of queued records starting at head */
+    const TraceRecord* front(W64& n) {
+        __sync_synchronize();
+        W64 start = head & (size() - 1);
+        n = min(count(), size() - start);
+        return &records[start];
+    }
+
+    void pop(W64 n) {
+        __sync_synchronize();
+        head += n;
+    }
+};
+
+extern bool trace_enabled;
+extern __thread TraceRing *trace_thread_ring;
+
+/* Ring of calling thread, created on its first record */
+TraceRing* trace_attach_thread();
+
+/* Id of a traced component, named in the trace for the decoder */
+W32 trace_register_component(const char *name);
+
+bool trace_open(const char *filename, W64 ring_size);
+void trace_close();
+
+/* Keep last ring_size records of each thread in memory, for dumps to
+ * filename on assert, deadlock recovery, SIGSEGV or SIGBUS */
+bool flight_recorder_open(const char *filename, W64 ring_size);
+
+/* Write the flight recorder out, returns file written or NULL */
+const char* flight_recorder_dump(const char *reason);
+
+static inline void trace_record(W64 cycle, W32 component, W32 event,
+        W64 a0 = 0, W64 a1 = 0, W64 a2 = 0, W64 a3 = 0)
+{
+    TraceRing *ring = trace_thread_ring;
+    if unlikely (!ring) ring = trace_attach_thread();
+    if likely (ring) ring->push(cycle, component, event, a0, a1, a2, a3);
+}
+
+#ifdef DISABLE_TRACE
+#define ptltrace(...) (0)
+#else
+#define ptltrace(component, ...) if unlikely (trace_enabled) { \
+    trace_record(sim_cycle, component, __VA_ARGS__); }
+#endif
+
+#endif // EVENTTRACE_H
@@ -264,6 +264,12 @@ typedef W32 v4si __attribute__ ((vector_size(16)));
 typedef v4si vec4i;
 typedef float v2df __attribute__ ((vector_size(16)));
 typedef v2df vec2d;
+typedef W64 v2di __attribute__ ((vector_size(16)));
+typedef v2di vec2q;
+#ifdef __AVX2__
+typedef W64 v4di __attribute__ ((vector_size(32)));
+typedef v4di vec4q;
+#endif
 
 inline vec16b x86_sse_pcmpeqb(vec16b a, vec16b b) { asm("pcmpeqb %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec8w x86_sse_pcmpeqw(vec8w a, vec8w b) { asm("pcmpeqw %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
@@ -285,6 +291,23 @@ inline vec16b x86_sse_onesb() { vec16b rd = {0}; asm("pcmpeqb %[rd],%[rd]" : [rd
 inline vec8w x86_sse_zerow() { vec8w rd = {0}; asm("pxor %[rd],%[rd]" : [rd] "+x" (rd)); return rd; }
 inline vec8w x86_sse_onesw() { vec8w rd = {0}; asm("pcmpeqw %[rd],%[rd]" : [rd] "+x" (rd)); return rd; }
 
+// Compare two 64-bit lanes against 16-byte aligned memory and return a
+// 2-bit mask of the equal ones
+#ifdef __SSE4_1__
+inline W32 x86_sse_maskeqq(vec2q a, const vec2q& m) { W32 mask; asm("pcmpeqq %[m],%[a]\n\tmovmskpd %[a],%[mask]" : [a] "+x" (a), [mask] "=r" (mask) : [m] "m" (m)); return mask; }
+#else
+inline W32 x86_sse_maskeqq(vec2q a, const vec2q& m) {
+  W32 bytes = x86_sse_pmovmskb((vec16b)x86_sse_pcmpeqd((vec4i)a, (vec4i)m));
+  return ((bytes & 0xff) == 0xff) | ((((bytes >> 8) & 0xff) == 0xff) << 1);
+}
+#endif
+
+#ifdef __AVX2__
+// Compare four 64-bit lanes against memory and return a 4-bit mask of the
+// equal ones
+inline W32 x86_avx2_maskeqq(vec4q a, const vec4q& m) { W32 mask; asm("vpcmpeqq %[m],%[a],%[a]\n\tvmovmskpd %[a],%[mask]" : [a] "+x" (a), [mask] "=r" (mask) : [m] "m" (m)); return mask; }
+#endif
+
 // If lddqu is available (SSE3: Athlon 64 (some cores, like X2), Pentium 4 Prescott), use that instead. It may be faster.
 
 extern const byte byte_to_vec16b[256][16];
@@ -703,12 +726,13 @@ static inline int lsbindex8bit(byte x) {
   return lsbindexlut8bit[x];
 }
 
+// popcnt with -march=native, else the compiler's own bit twiddling
 static inline int popcount(W32 x) {
-  return (popcount8bit(x >> 0) + popcount8bit(x >> 8) + popcount8bit(x >> 16) + popcount8bit(x >> 24));
+  return __builtin_popcount(x);
 }
 
 static inline int popcount64(W64 x) {
-  return popcount(LO32(x)) + popcount(HI32(x));
+  return __builtin_popcountll(x);
 }
 
 
@@ -716,32 +740,18 @@ extern const W64 expand_8bit_to_64bit_lut[256];
 
 // LSB index:
 
-// Operand must be non-zero or result is undefined:
-inline unsigned int lsbindex32(W32 n) { return x86_bsf32(n); }
+// Operand must be non-zero or result is undefined. The builtins, unlike
+// asm, are folded for constants and are tzcnt/lzcnt with BMI:
+inline unsigned int lsbindex32(W32 n) { return __builtin_ctz(n); }
 
 inline int lsbindexi32(W32 n) {
-  int r = lsbindex32(n);
-  return (n ? r : -1);
+  return (n ? int(lsbindex32(n)) : -1);
 }
 
-#ifdef __x86_64__
-inline unsigned int lsbindex64(W64 n) { return x86_bsf64(n); }
-#else
-inline unsigned int lsbindex64(W64 n) {
-  unsigned int z;
-  W32 lo = LO32(n);
-  W32 hi = HI32(n);
-
-  int ilo = lsbindex32(lo);
-  int ihi = lsbindex32(hi) + 32;
-
-  return (lo) ? ilo : ihi;
-}
-#endif
+inline unsigned int lsbindex64(W64 n) { return __builtin_ctzll(n); }
 
 inline unsigned int lsbindexi64(W64 n) {
-  int r = lsbindex64(n);
-  return (n ? r : -1);
+  return (n ? lsbindex64(n) : -1);
 }
 
 // static inline unsigned int lsbindex(W32 n) { return lsbindex32(n); }
@@ -750,31 +760,16 @@ inline unsigned int lsbindex(W64 n) { return lsbindex64(n); }
 // MSB index:
 
 // Operand must be non-zero or result is undefined:
-inline unsigned int msbindex32(W32 n) { return x86_bsr32(n); }
+inline unsigned int msbindex32(W32 n) { return 31 ^ __builtin_clz(n); }
 
 inline int msbindexi32(W32 n) {
-  int r = msbindex32(n);
-  return (n ? r : -1);
+  return (n ? int(msbindex32(n)) : -1);
 }
 
-#ifdef __x86_64__
-inline unsigned int msbindex64(W64 n) { return x86_bsr64(n); }
-#else
-inline unsigned int msbindex64(W64 n) {
-  unsigned int z;
-  W32 lo = LO32(n);
-  W32 hi = HI32(n);
-
-  int ilo = msbindex32(lo);
-  int ihi = msbindex32(hi) + 32;
-
-  return (hi) ? ihi : ilo;
-}
-#endif
+inline unsigned int msbindex64(W64 n) { return 63 ^ __builtin_clzll(n); }
 
 inline unsigned int msbindexi64(W64 n) {
-  int r = msbindex64(n);
-  return (n ? r : -1);
+  return (n ? msbindex64(n) : -1);
 }
 
 // static inline unsigned int msbindex(W32 n) { return msbindex32(n); }
@@ -0,0 +1,106 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <guestpmu.h>
+#include <machine.h>
+#include <basecore.h>
+#include <ptl-qemu.h>
+
+GuestPMUs guest_pmus;
+
+void GuestPMUs::update(BaseMachine& machine, Context& ctx)
+{
+    W64 user[PMU_EVENT_COUNT];
+    W64 kernel[PMU_EVENT_COUNT];
+    setzero(user);
+    setzero(kernel);
+
+    /* Without a core running ctx nothing was counted */
+    Core::BaseCore *core = NULL;
+    foreach (i, machine.cores.count()) {
+        if (machine.cores[i]->runs_context(ctx)) {
+            core = machine.cores[i];
+            break;
+        }
+    }
+
+    if (!core || !core->get_pmu_counts(ctx, user_stats, user) ||
+            !core->get_pmu_counts(ctx, kernel_stats, kernel))
+        return;
+
+    GuestPMU& pmu = pmus[ctx.cpu_index];
+    pmu.update(user, kernel);
+
+    if unlikely (pmu.pmi_pending) {
+        pmu.pmi_pending = false;
+        cpu_deliver_pmi(&ctx);
+    }
+}
+
+void GuestPMUs::sample(BaseMachine& machine, PTLsimConfig& config)
+{
+    next_update = sim_cycle + max(config.guest_pmu_period, W64(1));
+
+    foreach (i, contextcount) {
+        if likely (!pmus[i].sampling())
+            continue;
+        update(machine, contextof(i));
+    }
+}
+
+/* PMU of a CPU brought up to date, NULL without -guest-pmu */
+static GuestPMU* updated_pmu(int cpu_index)
+{
+    if (!config.guest_pmu || !inrange(cpu_index, 0, contextcount - 1))
+        return NULL;
+
+    PTLsimMachine *machine = PTLsimMachine::getmachine(config.core_name.buf);
+    if (machine && machine->initialized)
+        guest_pmus.update(*(BaseMachine*)machine, contextof(cpu_index));
+
+    return &guest_pmus.pmus[cpu_index];
+}
+
+int ptl_pmu_rdmsr(int cpu_index, uint32_t msr, uint64_t *value)
+{
+    if (!config.guest_pmu || !GuestPMU::is_msr(msr))
+        return 0;
+
+    GuestPMU *pmu = updated_pmu(cpu_index);
+    W64 v;
+    if (!pmu || !pmu->rdmsr(msr, v))
+        return 0;
+
+    *value = v;
+    return 1;
+}
+
+int ptl_pmu_wrmsr(int cpu_index, uint32_t msr, uint64_t value)
+{
+    if (!config.guest_pmu || !GuestPMU::is_msr(msr))
+        return 0;
+
+    /* Events so far count with the old settings */
+    GuestPMU *pmu = updated_pmu(cpu_index);
+    return (pmu && pmu->wrmsr(msr, value)) ? 1 : 0;
+}
+
+int ptl_pmu_rdpmc(int cpu_index, uint32_t index, uint64_t *value)
+{
+    GuestPMU *pmu = updated_pmu(cpu_index);
+    W64 v;
+
+    if (!pmu)
+        return -1;
+    if (!pmu->rdpmc(index, v))
+        return 0;
+
+    *value = v;
+    return 1;
+}
@@ -0,0 +1,357 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef GUEST_PMU_H
+#define GUEST_PMU_H
+
+#include <ptlsim.h>
+
+struct BaseMachine;
+struct PTLsimConfig;
+struct Context;
+
+/* Architectural events, in the order of the CPUID.0AH:EBX bits */
+enum {
+    PMU_EVENT_CYCLES = 0,
+    PMU_EVENT_INSNS,
+    PMU_EVENT_REF_CYCLES,
+    PMU_EVENT_LLC_REFS,
+    PMU_EVENT_LLC_MISSES,
+    PMU_EVENT_BRANCHES,
+    PMU_EVENT_BRANCH_MISSES,
+    PMU_EVENT_COUNT,
+};
+
+/* PMU MSRs of architectural perfmon version 2 */
+enum {
+    MSR_PMU_PMC0 = 0xc1,
+    MSR_PMU_PERFEVTSEL0 = 0x186,
+    MSR_PMU_FIXED_CTR0 = 0x309,
+    MSR_PMU_FIXED_CTR_CTRL = 0x38d,
+    MSR_PMU_GLOBAL_STATUS = 0x38e,
+    MSR_PMU_GLOBAL_CTRL = 0x38f,
+    MSR_PMU_GLOBAL_OVF_CTRL = 0x390,
+};
+
+/**
+ * @brief Performance counters of one guest CPU, see '-guest-pmu'
+ *
+ * Counters 0-3 are the general purpose ones, programmed through
+ * IA32_PERFEVTSELx with one of the architectural events, 4-6 the fixed
+ * instructions, core cycles and reference cycles counters. They are
+ * 48 bits wide. Only the event, umask, USR, OS, INT and EN fields of
+ * an event select are used; edge, invert and counter masks are not
+ * modeled.
+ *
+ * The event counts come from the stats of the thread running the guest
+ * CPU, its user and kernel stats for the USR and OS filters. update()
+ * adds what they counted since the last update to the enabled counters,
+ * a counter that wraps sets its bit of IA32_PERF_GLOBAL_STATUS and,
+ * with its INT or PMI bit, requests an interrupt.
+ */
+struct GuestPMU {
+    enum {
+        GP_COUNTERS = 4,
+        FIXED_COUNTERS = 3,
+        COUNTERS = GP_COUNTERS + FIXED_COUNTERS,
+        WIDTH = 48,
+    };
+
+    enum {
+        EVTSEL_USR = (1 << 16),
+        EVTSEL_OS = (1 << 17),
+        EVTSEL_INT = (1 << 20),
+        EVTSEL_EN = (1 << 22),
+    };
+
+    W64 evtsel[GP_COUNTERS];
+    W64 fixed_ctrl;
+    W64 global_ctrl;
+    W64 global_status;
+    W64 value[COUNTERS];
+
+    /* User and kernel event counts at the last update */
+    W64 last_user[PMU_EVENT_COUNT];
+    W64 last_kernel[PMU_EVENT_COUNT];
+
+    bool pmi_pending;
+
+    GuestPMU() { reset(); }
+
+    void reset()
+    {
+        setzero(evtsel);
+        setzero(value);
+        setzero(last_user);
+        setzero(last_kernel);
+        fixed_ctrl = 0;
+        global_ctrl = bitmask(GP_COUNTERS) |
+            (W64(bitmask(FIXED_COUNTERS)) << 32);
+        global_status = 0;
+        pmi_pending = false;
+    }
+
+    static W64 counter_mask() { return (W64(1) << WIDTH) - 1; }
+
+    /* Bit of a counter in the global control and status MSRs */
+    static W64 global_bit(int c)
+    {
+        return (c < GP_COUNTERS) ? (W64(1) << c) :
+            (W64(1) << (32 + c - GP_COUNTERS));
+    }
+
+    /* Event a counter counts, -1 for none */
+    int event_of(int c) const
+    {
+        static const int fixed_events[FIXED_COUNTERS] = {
+            PMU_EVENT_INSNS, PMU_EVENT_CYCLES, PMU_EVENT_REF_CYCLES,
+        };
+
+        if (c >= GP_COUNTERS)
+            return fixed_events[c - GP_COUNTERS];
+
+        switch (evtsel[c] & 0xffff) {
+            case 0x003c: return PMU_EVENT_CYCLES;
+            case 0x00c0: return PMU_EVENT_INSNS;
+            case 0x013c: return PMU_EVENT_REF_CYCLES;
+            case 0x4f2e: return PMU_EVENT_LLC_REFS;
+            case 0x412e: return PMU_EVENT_LLC_MISSES;
+            case 0x00c4: return PMU_EVENT_BRANCHES;
+            case 0x00c5: return PMU_EVENT_BRANCH_MISSES;
+            default: return -1;
+        }
+    }
+
+    /* Fixed counters take 4 bits each: OS, USR, any thread and PMI */
+    W64 fixed_bits(int c) const
+    {
+        return (fixed_ctrl >> (4 * (c - GP_COUNTERS))) & 0xf;
+    }
+
+    bool enabled(int c) const
+    {
+        if (!(global_ctrl & global_bit(c)))
+            return false;
+        if (c < GP_COUNTERS)
+            return (evtsel[c] & EVTSEL_EN) != 0;
+        return (fixed_bits(c) & 3) != 0;
+    }
+
+    bool counts_user(int c) const
+    {
+        return (c < GP_COUNTERS) ? (evtsel[c] & EVTSEL_USR) != 0 :
+            (fixed_bits(c) & 2) != 0;
+    }
+
+    bool counts_kernel(int c) const
+    {
+        return (c < GP_COUNTERS) ? (evtsel[c] & EVTSEL_OS) != 0 :
+            (fixed_bits(c) & 1) != 0;
+    }
+
+    bool interrupts(int c) const
+    {
+        return (c < GP_COUNTERS) ? (evtsel[c] & EVTSEL_INT) != 0 :
+            (fixed_bits(c) & 8) != 0;
+    }
+
+    /* True if any counter can request an interrupt */
+    bool sampling() const
+    {
+        foreach (c, COUNTERS) {
+            if (enabled(c) && interrupts(c))
+                return true;
+        }
+        return false;
+    }
+
+    /*
+     * Counts are cumulative. Counts below the last ones, after the stats
+     * were reset, count from there.
+     */
+    void update(const W64 *user, const W64 *kernel)
+    {
+        W64 delta_user[PMU_EVENT_COUNT];
+        W64 delta_kernel[PMU_EVENT_COUNT];
+
+        foreach (e, PMU_EVENT_COUNT) {
+            delta_user[e] = (user[e] >= last_user[e]) ?
+                user[e] - last_user[e] : user[e];
+            delta_kernel[e] = (kernel[e] >= last_kernel[e]) ?
+                kernel[e] - last_kernel[e] : kernel[e];
+            last_user[e] = user[e];
+            last_kernel[e] = kernel[e];
+        }
+
+        foreach (c, COUNTERS) {
+            int e = event_of(c);
+            if (e < 0 || !enabled(c))
+                continue;
+
+            W64 delta = (counts_user(c) ? delta_user[e] : 0) +
+                (counts_kernel(c) ? delta_kernel[e] : 0);
+            if (!delta)
+                continue;
+
+            W64 sum = value[c] + delta;
+            value[c] = sum & counter_mask();
+
+            if (sum > counter_mask()) {
+                global_status |= global_bit(c);
+                if (interrupts(c))
+                    pmi_pending = true;
+            }
+        }
+    }
+
+    /* Counter of a PMC or fixed counter MSR, -1 if not one */
+    static int msr_counter(W32 msr)
+    {
+        if (inrange(msr, W32(MSR_PMU_PMC0),
+                    W32(MSR_PMU_PMC0 + GP_COUNTERS - 1)))
+            return msr - MSR_PMU_PMC0;
+        if (inrange(msr, W32(MSR_PMU_FIXED_CTR0),
+                    W32(MSR_PMU_FIXED_CTR0 + FIXED_COUNTERS - 1)))
+            return GP_COUNTERS + msr - MSR_PMU_FIXED_CTR0;
+        return -1;
+    }
+
+    static bool is_msr(W32 msr)
+    {
+        return msr_counter(msr) >= 0 ||
+            inrange(msr, W32(MSR_PMU_PERFEVTSEL0),
+                    W32(MSR_PMU_PERFEVTSEL0 + GP_COUNTERS - 1)) ||
+            inrange(msr, W32(MSR_PMU_FIXED_CTR_CTRL),
+                    W32(MSR_PMU_GLOBAL_OVF_CTRL));
+    }
+
+    /* False if msr is not one of the PMU's */
+    bool rdmsr(W32 msr, W64& v) const
+    {
+        int c = msr_counter(msr);
+        if (c >= 0) {
+            v = value[c];
+            return true;
+        }
+
+        if (inrange(msr, W32(MSR_PMU_PERFEVTSEL0),
+                    W32(MSR_PMU_PERFEVTSEL0 + GP_COUNTERS - 1))) {
+            v = evtsel[msr - MSR_PMU_PERFEVTSEL0];
+            return true;
+        }
+
+        switch (msr) {
+            case MSR_PMU_FIXED_CTR_CTRL: v = fixed_ctrl; return true;
+            case MSR_PMU_GLOBAL_STATUS: v = global_status; return true;
+            case MSR_PMU_GLOBAL_CTRL: v = global_ctrl; return true;
+            case MSR_PMU_GLOBAL_OVF_CTRL: v = 0; return true;
+            default: return false;
+        }
+    }
+
+    /*
+     * Writes of the general purpose counters take bits 31:0 sign
+     * extended, as without full width writes; fixed counters take all
+     * 48 bits. IA32_PERF_GLOBAL_OVF_CTRL clears the status bits set in it.
+     */
+    bool wrmsr(W32 msr, W64 v)
+    {
+        int c = msr_counter(msr);
+        if (c >= 0) {
+            if (c < GP_COUNTERS)
+                v = W64(signext64(v, 32));
+            value[c] = v & counter_mask();
+            return true;
+        }
+
+        if (inrange(msr, W32(MSR_PMU_PERFEVTSEL0),
+                    W32(MSR_PMU_PERFEVTSEL0 + GP_COUNTERS - 1))) {
+            evtsel[msr - MSR_PMU_PERFEVTSEL0] = W32(v);
+            return true;
+        }
+
+        switch (msr) {
+            case MSR_PMU_FIXED_CTR_CTRL:
+                fixed_ctrl = v & bitmask(4 * FIXED_COUNTERS);
+                return true;
+            case MSR_PMU_GLOBAL_STATUS:
+                return true;
+            case MSR_PMU_GLOBAL_CTRL:
+                global_ctrl = v & (bitmask(GP_COUNTERS) |
+                        (W64(bitmask(FIXED_COUNTERS)) << 32));
+                return true;
+            case MSR_PMU_GLOBAL_OVF_CTRL:
+                global_status &= ~v;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /* rdpmc: ECX bit 30 selects the fixed counters, false if no counter */
+    bool rdpmc(W32 index, W64& v) const
+    {
+        bool fixed = (index >> 30) & 1;
+        W32 n = index & bitmask(30);
+
+        if (n >= W32(fixed ? FIXED_COUNTERS : GP_COUNTERS))
+            return false;
+
+        v = value[fixed ? GP_COUNTERS + n : n];
+        return true;
+    }
+
+    /* CPUID leaf 0AH: version 2 with 4 general and 3 fixed counters */
+    static void cpuid(W32& eax, W32& ebx, W32& ecx, W32& edx)
+    {
+        eax = 2 | (GP_COUNTERS << 8) | (WIDTH << 16) |
+            (PMU_EVENT_COUNT << 24);
+        ebx = 0;
+        ecx = 0;
+        edx = FIXED_COUNTERS | (WIDTH << 5);
+    }
+};
+
+/**
+ * @brief Guest PMUs of all contexts, with '-guest-pmu'
+ *
+ * Guest reads and writes of the PMU MSRs, rdpmc and CPUID leaf 0AH are
+ * answered from here, in emulation and in simulation. Counters only
+ * count while simulating: they are brought up to date on each access
+ * and, while any can interrupt, every '-guest-pmu-period' cycles, when
+ * a pending interrupt is sent to the local APIC's performance counter
+ * entry. Samples can thus skid up to that many cycles. The guest CPU
+ * model needs a CPUID level of at least 0AH, e.g. '-cpu core2duo', for
+ * the guest to see the PMU.
+ */
+struct GuestPMUs {
+    GuestPMU pmus[MAX_CONTEXTS];
+    W64 next_update;
+
+    GuestPMUs() : next_update(0) {}
+
+    /* Updates the counters of ctx from the stats of its thread */
+    void update(BaseMachine& machine, Context& ctx);
+
+    /* Called once per simulated cycle */
+    void clock(BaseMachine& machine, PTLsimConfig& config)
+    {
+        if likely (sim_cycle < next_update)
+            return;
+        sample(machine, config);
+    }
+
+    private:
+
+    void sample(BaseMachine& machine, PTLsimConfig& config);
+};
+
+extern GuestPMUs guest_pmus;
+
+#endif // GUEST_PMU_H
@@ -0,0 +1,148 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <hostmem.h>
+#include <ptlsim.h>
+
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+bool host_huge_pages = false;
+
+W64 host_hugetlb_bytes = 0;
+W64 host_thp_bytes = 0;
+
+/* Shared regions of small allocations, see hostmem.h, the last one is
+ * filled */
+static dynarray<char*> regions;
+static size_t region_used = 0;
+
+static inline size_t round_up(size_t bytes, size_t align)
+{
+    return (bytes + align - 1) & ~(align - 1);
+}
+
+/* Length of the mapping of an allocation, either way it was made */
+static inline size_t mapping_size(size_t bytes)
+{
+    return round_up(bytes, HOST_HUGE_PAGE_SIZE);
+}
+
+static void* map_huge(size_t size)
+{
+    static bool hugetlb_failed = false;
+
+    if (!hugetlb_failed) {
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {
+            host_hugetlb_bytes += size;
+            return mem;
+        }
+
+        hugetlb_failed = true;
+        ptl_logfile << "No hugetlbfs pages reserved, using transparent ",
+                    "huge pages", endl;
+    }
+
+    /* Map 2 MB more and trim, huge pages need an aligned range */
+    char *mem = (char*)mmap(NULL, size + HOST_HUGE_PAGE_SIZE,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+            MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    char *start = (char*)round_up((size_t)mem, HOST_HUGE_PAGE_SIZE);
+    if (start > mem)
+        munmap(mem, start - mem);
+    munmap(start + size, (mem + HOST_HUGE_PAGE_SIZE) - start);
+
+    madvise(start, size, MADV_HUGEPAGE);
+    host_thp_bytes += size;
+    return start;
+}
+
+/**
+ * @brief Allocate zeroed host memory for a large simulator structure
+ *
+ * @param bytes Size of the structure
+ *
+ * @return Memory aligned on 64 bytes, see hostmem.h
+ */
+void* host_alloc(size_t bytes)
+{
+    void *mem;
+
+    if (bytes >= HOST_HUGE_PAGE_SIZE) {
+        size_t size = mapping_size(bytes);
+
+        if (host_huge_pages) {
+            mem = map_huge(size);
+        } else {
+            mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (mem == MAP_FAILED)
+                mem = NULL;
+        }
+    } else if (host_huge_pages) {
+        bytes = round_up(bytes, 64);
+        if (!regions.count() || region_used + bytes > HOST_HUGE_PAGE_SIZE) {
+            char *region = (char*)map_huge(HOST_HUGE_PAGE_SIZE);
+            if (!region)
+                assert_fail(__STRING(map_huge), __FILE__, __LINE__,
+                        __PRETTY_FUNCTION__);
+            regions.push(region);
+            region_used = 0;
+        }
+
+        mem = regions[regions.count() - 1] + region_used;
+        region_used += bytes;
+    } else {
+        if (posix_memalign(&mem, 64, bytes) != 0)
+            mem = NULL;
+        else
+            memset(mem, 0, bytes);
+    }
+
+    if (!mem)
+        assert_fail(__STRING(host_alloc), __FILE__, __LINE__,
+                __PRETTY_FUNCTION__);
+
+    return mem;
+}
+
+/**
+ * @brief Free memory of host_alloc()
+ *
+ * @param mem Memory returned by host_alloc()
+ * @param bytes Size it was allocated with
+ */
+void host_free(void *mem, size_t bytes)
+{
+    if (!mem)
+        return;
+
+    if (bytes >= HOST_HUGE_PAGE_SIZE) {
+        munmap(mem, mapping_size(bytes));
+        return;
+    }
+
+    /* Small allocations in a shared region stay, see hostmem.h */
+    foreach (i, regions.count()) {
+        if ((char*)mem >= regions[i] &&
+                (char*)mem < regions[i] + HOST_HUGE_PAGE_SIZE)
+            return;
+    }
+
+    ::free(mem);
+}
@@ -0,0 +1,47 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef HOSTMEM_H
+#define HOSTMEM_H
+
+#include <globals.h>
+
+/*
+ * Host memory of large simulator structures ('-host-huge-pages')
+ *
+ * Stats blocks, tag arrays and directories (LazyChunks), request pool
+ * slabs and cores are allocated with host_alloc(). It returns zeroed
+ * memory aligned on 64 bytes. Allocations of HOST_HUGE_PAGE_SIZE or more
+ * get their own mapping, whose pages are only populated when touched.
+ *
+ * With '-host-huge-pages' these mappings are aligned on 2 MB and backed by
+ * hugetlbfs pages when the host has them reserved (vm.nr_hugepages), else
+ * by transparent huge pages (madvise). Smaller allocations are then
+ * carved out of shared 2 MB regions, so many small pool slabs and chunks
+ * don't each take host TLB entries. Memory of those regions is never given
+ * back: host_free() of a small allocation does nothing, which is only
+ * meant for structures that live as long as the machine.
+ *
+ * Set host_huge_pages before the machine is built, memory allocated
+ * before keeps its pages.
+ */
+
+#define HOST_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+extern bool host_huge_pages;
+
+void* host_alloc(size_t bytes);
+void host_free(void *mem, size_t bytes);
+
+/* Bytes in hugetlbfs pages, and in mappings advised for transparent ones */
+extern W64 host_hugetlb_bytes;
+extern W64 host_thp_bytes;
+
+#endif // HOSTMEM_H
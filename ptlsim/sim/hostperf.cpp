@@ -0,0 +1,63 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <hostperf.h>
+
+/* Created on first registration, components of all machines go here */
+static Statable *host_perf_root = NULL;
+static dynarray<HostPerfStats*> host_perf_nodes;
+
+static HostPerfStats* find_node(const char *name, Statable *parent)
+{
+    foreach (i, host_perf_nodes.length) {
+        HostPerfStats *node = host_perf_nodes[i];
+        if (node->parent_node == parent && strequal(node->get_name(), name))
+            return node;
+    }
+
+    HostPerfStats *node = new HostPerfStats(name, parent);
+    host_perf_nodes.push(node);
+    return node;
+}
+
+HostPerfCounter* host_perf_register(const char *component, const char *part)
+{
+    if (!host_perf_root) {
+        host_perf_root = new Statable("host_perf");
+        host_perf_root->disable_dump();
+    }
+
+    HostPerfStats *node = find_node(component, host_perf_root);
+    if (part)
+        node = find_node(part, node);
+
+    return &node->counter;
+}
+
+void host_perf_set_stats(Stats *stats)
+{
+    if (!host_perf_root || !host_perf_enabled)
+        return;
+
+    host_perf_root->enable_dump();
+    host_perf_root->set_default_stats(stats);
+
+    W64 total = 0;
+    foreach (i, host_perf_nodes.length)
+        total += host_perf_nodes[i]->counter.ticks;
+
+    foreach (i, host_perf_nodes.length) {
+        HostPerfStats *node = host_perf_nodes[i];
+        double share = total ? percent(node->counter.ticks, total) : 0;
+        node->ticks = node->counter.ticks;
+        node->calls = node->counter.calls;
+        node->share = share;
+    }
+}
@@ -0,0 +1,71 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef HOSTPERF_H
+#define HOSTPERF_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+/*
+ * Host time profile of simulated components ('-host-perf')
+ *
+ * Every controller and interconnect gets a counter on creation, charged
+ * by the signals set up with SET_SIGNAL_CB and by direct calls wrapped in
+ * a HostPerfScope. Cores are charged for their per-cycle signal and cache
+ * wakeups, and have one part per group of pipeline stages. Basic block
+ * translation is charged to 'decoder'. Time of a scope nested in another
+ * is only counted to the inner one, so the ticks of all components add up
+ * to the host time spent in them.
+ *
+ * Counters are written to the 'host_perf' stats node:
+ *
+ *   host_perf:
+ *     L1_D_0:   {ticks: .., calls: .., share: ..}
+ *     ooo_0_0:  {ticks: .., calls: .., share: ..,
+ *                fetch: {ticks: .., calls: .., share: ..}, ...}
+ *
+ * where share is the percent of all profiled ticks.
+ */
+
+struct HostPerfStats : public Statable
+{
+    StatObj<W64> ticks;
+    StatObj<W64> calls;
+    StatObj<double> share;
+
+    HostPerfCounter counter;
+    Statable *parent_node;
+
+    HostPerfStats(const char *name, Statable *parent)
+        : Statable(name, parent)
+          , ticks("ticks", this)
+          , calls("calls", this)
+          , share("share", this)
+          , parent_node(parent)
+    { }
+};
+
+/**
+ * @brief Counter of a component, or of one part of it
+ *
+ * Registering the same names again returns the same counter, so all
+ * signals of a controller share one.
+ */
+HostPerfCounter* host_perf_register(const char *component,
+        const char *part = NULL);
+
+/**
+ * @brief Copy counters into the default Stats of the 'host_perf' node
+ */
+void host_perf_set_stats(Stats *stats);
+
+#endif // HOSTPERF_H
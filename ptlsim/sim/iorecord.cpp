@@ -0,0 +1,160 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <iorecord.h>
+#include <ptlsim.h>
+
+#include <zlib.h>
+
+#define IO_REPLAY_CHUNK 1024
+
+bool io_recording = false;
+bool io_replaying = false;
+
+namespace {
+
+    gzFile record_file = NULL;
+    W64 recorded = 0;
+
+    struct Replay {
+        gzFile file;
+        IORecord records[IO_REPLAY_CHUNK];
+        int next;
+        int count;
+        W64 replayed;
+        bool diverged;
+    };
+
+    Replay *replay = NULL;
+
+    /* Refill the replay buffer, false at end of file */
+    bool replay_fill(Replay *r)
+    {
+        int bytes = gzread(r->file, r->records, sizeof(r->records));
+        r->next = 0;
+        r->count = (bytes > 0) ? bytes / sizeof(IORecord) : 0;
+        return r->count > 0;
+    }
+
+}
+
+bool io_record_open(const char *filename)
+{
+    io_record_close();
+
+    record_file = gzopen(filename, "wb");
+    if (!record_file) {
+        ptl_logfile << "Unable to open IO record file ", filename, endl;
+        return false;
+    }
+
+    gzwrite(record_file, IO_RECORD_MAGIC, 8);
+    recorded = 0;
+    io_recording = true;
+    return true;
+}
+
+void io_record_close()
+{
+    if (!record_file) return;
+
+    io_recording = false;
+    gzclose(record_file);
+    record_file = NULL;
+
+    ptl_logfile << "IO record: ", recorded, " device reads recorded", endl;
+}
+
+void io_record(int ctx, int kind, W64 addr, int sizeshift, W64 value)
+{
+    IORecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.cycle = sim_cycle;
+    rec.addr = addr;
+    rec.value = value;
+    rec.ctx = ctx;
+    rec.kind = kind;
+    rec.sizeshift = sizeshift;
+
+    gzwrite(record_file, &rec, sizeof(rec));
+    recorded++;
+}
+
+bool io_replay_open(const char *filename)
+{
+    io_replay_close();
+
+    gzFile file = gzopen(filename, "rb");
+    if (!file) {
+        ptl_logfile << "Unable to open IO replay file ", filename, endl;
+        return false;
+    }
+
+    char magic[8];
+    if (gzread(file, magic, 8) != 8 || memcmp(magic, IO_RECORD_MAGIC, 8)) {
+        ptl_logfile << "IO replay file ", filename, " has a bad header", endl;
+        gzclose(file);
+        return false;
+    }
+
+    replay = new Replay();
+    replay->file = file;
+    replay->replayed = 0;
+    replay->diverged = false;
+    replay_fill(replay);
+
+    io_replaying = true;
+    return true;
+}
+
+void io_replay_close()
+{
+    if (!replay) return;
+
+    io_replaying = false;
+    gzclose(replay->file);
+
+    ptl_logfile << "IO replay: ", replay->replayed, " device reads replayed",
+                (replay->diverged ? ", diverged from the record" : ""), endl;
+
+    delete replay;
+    replay = NULL;
+}
+
+bool io_replay(int ctx, int kind, W64 addr, int sizeshift, W64 &value)
+{
+    Replay *r = replay;
+
+    if unlikely (r->next == r->count && !replay_fill(r)) {
+        ptl_logfile << "IO replay: records ran out at cycle ", sim_cycle,
+                    ", reading from devices", endl;
+        io_replaying = false;
+        return false;
+    }
+
+    IORecord &rec = r->records[r->next];
+    if unlikely (rec.ctx != ctx || rec.kind != kind || rec.addr != addr ||
+            rec.sizeshift != sizeshift) {
+        ptl_logfile << "IO replay: diverged at cycle ", sim_cycle,
+                    " after ", r->replayed, " reads, expected kind ",
+                    int(rec.kind), " addr ", hexstring(rec.addr, 64),
+                    " on ctx ", int(rec.ctx), " but got kind ", kind, " addr ",
+                    hexstring(addr, 64), " on ctx ", ctx,
+                    ", reading from devices", endl;
+        r->diverged = true;
+        io_replaying = false;
+        return false;
+    }
+
+    value = rec.value;
+    r->next++;
+    r->replayed++;
+    return true;
+}
@@ -0,0 +1,76 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef IORECORD_H
+#define IORECORD_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/*
+ * Record and replay of device reads ('-event-record', '-event-replay')
+ *
+ * Recording logs every value the simulated machine reads from a device,
+ * port IO 'in' and MMIO loads, with the cycle it was read at. Replaying
+ * hands the recorded values back in the same order instead of asking
+ * QEMU's devices, so reruns from the same checkpoint read the same timer,
+ * status and data registers even when a different microarchitecture
+ * changes the timing. Writes to devices still go to QEMU.
+ *
+ * A read that doesn't match the next record (context, kind, address and
+ * size) ends the replay, the rest of the run reads from the devices.
+ *
+ * File format, gzip compressed:
+ *
+ *   "PTLIORC1"
+ *   IORecord[]    (until end of file)
+ */
+#define IO_RECORD_MAGIC "PTLIORC1"
+
+enum {
+    IO_RECORD_PORT_IN = 0,
+    IO_RECORD_MMIO_READ,
+    IO_RECORD_KIND_COUNT
+};
+
+struct IORecord {
+    W64 cycle;
+    W64 addr;
+    W64 value;
+    W8 ctx;
+    W8 kind;
+    W8 sizeshift;
+    W8 pad[5];
+};
+
+/* Checked by the device access paths before calling in here */
+extern bool io_recording;
+extern bool io_replaying;
+
+bool io_record_open(const char *filename);
+void io_record_close();
+
+bool io_replay_open(const char *filename);
+void io_replay_close();
+
+/**
+ * @brief Log a value read from a device
+ */
+void io_record(int ctx, int kind, W64 addr, int sizeshift, W64 value);
+
+/**
+ * @brief Next recorded value of a device read
+ *
+ * @return false if the read doesn't match the next record or the records
+ * ran out, then replay stops and the caller reads from the device
+ */
+bool io_replay(int ctx, int kind, W64 addr, int sizeshift, W64 &value);
+
+#endif // IORECORD_H
@@ -0,0 +1,184 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MACHINE_OPTIONS_H
+#define MACHINE_OPTIONS_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/**
+ * @brief Typed option store of a machine
+ *
+ * Component names ("ooo_0", "L1_D_3") and option names ("iq_size") are
+ * interned into small integer symbols once. An option is then one entry
+ * of a single hash table keyed by the component symbol, the option symbol
+ * and the value type, so a lookup hashes two names and one integer no
+ * matter how many cores and controllers the machine has.
+ *
+ * As with the per-type tables this replaces, the same option can be set
+ * with different types and a lookup only finds the one of its type.
+ */
+struct MachineOptions {
+    enum { BOOL = 0, INT, STR, TYPE_COUNT };
+
+    struct Value {
+        bool b;
+        int i;
+        stringbuf *s;
+    };
+
+    Hashtable<const char*, W32, 256> symbols;
+    Hashtable<W64, Value, 1024> values;
+    W32 symbol_count;
+
+    MachineOptions() : symbol_count(0) { }
+
+    ~MachineOptions()
+    {
+        dynarray< KeyValuePair<W64, Value> > entries;
+        values.getentries(entries);
+        foreach (i, entries.count()) {
+            if (entries[i].value.s) delete entries[i].value.s;
+        }
+    }
+
+    /* Symbol of name, added if it is new */
+    W32 intern(const char *name)
+    {
+        W32 *sym = symbols.get(name);
+        if likely (sym) return *sym;
+
+        symbols.add(name, symbol_count);
+        return symbol_count++;
+    }
+
+    /* Symbol of name, false if no option ever used it */
+    bool lookup(const char *name, W32 &sym)
+    {
+        W32 *s = symbols.get(name);
+        if (!s) return false;
+        sym = *s;
+        return true;
+    }
+
+    static W64 key(W32 component, W32 opt, int type)
+    {
+        return (W64(component) << 32) | (W64(opt) << 2) | type;
+    }
+
+    Value& set(const char *component, const char *opt, int type)
+    {
+        W64 k = key(intern(component), intern(opt), type);
+        Value *v = values.get(k);
+        if (v) return *v;
+
+        Value nv;
+        nv.b = false;
+        nv.i = 0;
+        nv.s = NULL;
+        return *values.add(k, nv);
+    }
+
+    Value* find(const char *component, const char *opt, int type)
+    {
+        W32 c, o;
+        if (!lookup(component, c) || !lookup(opt, o)) return NULL;
+        return values.get(key(c, o, type));
+    }
+
+    void add(const char *component, const char *opt, bool value)
+    {
+        set(component, opt, BOOL).b = value;
+    }
+
+    void add(const char *component, const char *opt, int value)
+    {
+        set(component, opt, INT).i = value;
+    }
+
+    void add(const char *component, const char *opt, const char *value)
+    {
+        Value &v = set(component, opt, STR);
+        if (!v.s) v.s = new stringbuf();
+        v.s->reset();
+        *v.s << value;
+    }
+
+    bool get(const char *component, const char *opt, bool &value)
+    {
+        Value *v = find(component, opt, BOOL);
+        if (!v) return false;
+        value = v->b;
+        return true;
+    }
+
+    bool get(const char *component, const char *opt, int &value)
+    {
+        Value *v = find(component, opt, INT);
+        if (!v) return false;
+        value = v->i;
+        return true;
+    }
+
+    /* Appends the value, like the stringbuf get_option always did */
+    bool get(const char *component, const char *opt, stringbuf &value)
+    {
+        Value *v = find(component, opt, STR);
+        if (!v) return false;
+        value << *v->s;
+        return true;
+    }
+
+    /*
+     * Set option from text, as the type it already has or else as INT for
+     * a number, BOOL for true or false and STR for anything else. False if
+     * text is not a value of the option's type.
+     */
+    bool add_text(const char *component, const char *opt, const char *text)
+    {
+        char *end;
+        long number = strtol(text, &end, 0);
+        bool is_number = (*text && !*end);
+        bool is_bool = strequal(text, "true") || strequal(text, "false");
+
+        int type = (is_number) ? INT : ((is_bool) ? BOOL : STR);
+        foreach (t, TYPE_COUNT) {
+            if (find(component, opt, t)) {
+                type = t;
+                break;
+            }
+        }
+
+        if (type == INT) {
+            if (!is_number) return false;
+            add(component, opt, (int)number);
+        } else if (type == BOOL) {
+            if (!is_bool) return false;
+            add(component, opt, strequal(text, "true"));
+        } else {
+            add(component, opt, text);
+        }
+        return true;
+    }
+
+    /* True if option is set with any type */
+    bool has(const char *component, const char *opt)
+    {
+        W32 c, o;
+        if (!lookup(component, c) || !lookup(opt, o)) return false;
+        foreach (t, TYPE_COUNT) {
+            if (values.get(key(c, o, t))) return true;
+        }
+        return false;
+    }
+};
+
+#endif // MACHINE_OPTIONS_H
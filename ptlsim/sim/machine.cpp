@@ -13,8 +13,23 @@
 #include <config.h>
 
 #include <basecore.h>
+#include <warmup.h>
+#include <coremigration.h>
+#include <spinloop.h>
+#include <sampling.h>
+#include <warmupdetect.h>
+#include <guestpmu.h>
 #include <statsBuilder.h>
+#include <statsExporter.h>
 #include <memoryHierarchy.h>
+#include <memtrace.h>
+#include <uoptrace.h>
+#include <warmstate.h>
+#include <cluster.h>
+#include <decode.h>
+#include <addrspace.h>
+#include <pcsampler.h>
+#include <statehash.h>
 
 #include <cstdarg>
 
@@ -26,6 +41,10 @@ MachineBuilder machineBuilder("_default_", NULL);
 BaseMachine coremodel("base");
 
 
+const char* host_profile_names[HOST_PROFILE_COUNT] = {
+    "cores", "memory", "events", "io", "qemu", "stats", "other"
+};
+
 BaseMachine::BaseMachine(const char *name)
 {
     machine_name = name;
@@ -37,6 +56,13 @@ BaseMachine::BaseMachine(const char *name)
 
     context_used = 0;
     coreid_counter = 0;
+
+    resumed = false;
+    next_periodic_checkpoint = 0;
+    warm_toggled = false;
+
+    foreach (i, HOST_PROFILE_COUNT)
+        host_profile_ticks[i] = 0;
 }
 
 BaseMachine::~BaseMachine()
@@ -50,6 +76,12 @@ void BaseMachine::reset()
     context_counter = 0;
     coreid_counter = 0;
 
+    migration.reset();
+
+    parked_cores.clear();
+    park_requests.clear();
+    spin_waits.clear();
+
     foreach(i, cores.count()) {
         BaseCore* core = cores[i];
         delete core;
@@ -65,6 +97,8 @@ void BaseMachine::reset()
 
 void BaseMachine::shutdown()
 {
+	migration.reset();
+
 	foreach (i, cores.count()) {
 		BaseCore* core = cores[i];
 		delete core;
@@ -92,6 +126,68 @@ void BaseMachine::shutdown()
 	}
 }
 
+/* Machine options controllers re-read in config_changed() */
+static const char* run_time_machine_options[] = {
+	"latency", "replacement", "prefetcher", "prefetch_delay",
+	"t_rcd", "t_rp", "t_cas", "t_burst",
+};
+
+/**
+ * @brief Apply '-machine-options' overrides and notify the controllers
+ *
+ * @param spec Comma separated <controller>.<option>=<value> list
+ *
+ * Only options in run_time_machine_options can be set, others are built
+ * into the machine once and are rejected. Overrides stay set once made.
+ */
+void BaseMachine::configure_machine_options(const char *spec)
+{
+	stringbuf list;
+	dynarray<stringbuf*> overrides;
+
+	list << spec;
+	list.split(overrides, ",");
+
+	foreach (i, overrides.count()) {
+		stringbuf entry;
+		entry << *overrides[i];
+
+		char *name = overrides[i]->buf;
+		char *value = strchr(name, '=');
+		char *opt = NULL;
+		bool known = false;
+
+		if (value) {
+			*value++ = '\0';
+			opt = strrchr(name, '.');
+		}
+		if (opt) {
+			*opt++ = '\0';
+			foreach (j, lengthof(run_time_machine_options)) {
+				if (strequal(opt, run_time_machine_options[j]))
+					known = true;
+			}
+		}
+
+		Controller *cont = NULL;
+		foreach (j, controllers.count()) {
+			if (strequal(controllers[j]->get_name(), name))
+				cont = controllers[j];
+		}
+
+		if (!known || !cont || !options.add_text(name, opt, value)) {
+			ptl_logfile << "ERROR: Invalid -machine-options entry '" <<
+				entry << "', use <controller>.<option>=<value> " <<
+				"with a latency, replacement or prefetch option" << endl;
+		}
+
+		delete overrides[i];
+	}
+
+	foreach (i, controllers.count())
+		controllers[i]->config_changed();
+}
+
 /**
  * @brief Simulation runtime configuration is changed
  *
@@ -112,6 +208,12 @@ void BaseMachine::config_changed()
 	BUILDER_CONFIG_CHANGED(CoreBuilder, coreBuilders);
 	BUILDER_CONFIG_CHANGED(ControllerBuilder, controllerBuilders);
 	BUILDER_CONFIG_CHANGED(InterconnectBuilder, interconnectBuilders);
+
+	migration.config_changed(config);
+	if (initialized) {
+		clock_domains_configure(config.clock_domains.buf);
+		configure_machine_options(config.machine_options.buf);
+	}
 }
 
 W8 BaseMachine::get_num_cores()
@@ -136,8 +238,15 @@ bool BaseMachine::init(PTLsimConfig& config)
         cores[i]->update_memory_hierarchy_ptr();
     }
 
+    migration.init(*this);
+    clock_domains_configure(config.clock_domains.buf);
+    configure_machine_options(config.machine_options.buf);
+
     init_qemu_io_events();
 
+    /* All stats of the machine exist now, so the formulas can find them */
+    StatsBuilder::get().compile_formulas();
+
     return 1;
 }
 
@@ -217,19 +326,111 @@ int BaseMachine::run(PTLsimConfig& config)
         logenable = 1;
     }
 
-    // reset all cores for fresh start:
-    foreach (cur_core, cores.count()){
-        if(first_run) {
+    // reset all cores for fresh start, or keep them warm from the last run:
+    bool warm = first_run && warm_toggled && config.warm_toggle;
+    warm_toggled = false;
+
+    if(warm) {
+        rewarm_after_emulation();
+    } else if(first_run) {
+        foreach (cur_core, cores.count()){
             cores[cur_core]->reset();
         }
-        cores[cur_core]->check_ctx_changes();
+
+        if(config.warm_state_filename.set())
+            load_warm_state(config.warm_state_filename);
+    }
+
+    if(first_run) {
+        if(config.periodic_checkpoint_cycles && !config.warm_state_dir.set()) {
+            ptl_logfile << "ERROR: -periodic-checkpoint-cycles needs ",
+                        "-warm-state-dir, no periodic checkpoints", endl;
+            config.periodic_checkpoint_cycles = 0;
+        }
+
+        if(config.periodic_checkpoint_cycles) {
+            W64 period = config.periodic_checkpoint_cycles;
+            next_periodic_checkpoint = (sim_cycle / period + 1) * period;
+        }
+
+        // Caches are cold only on first run, warm them up functionally
+        // and restart pipelines from where warmup stopped. A resumed
+        // simulation was warmed up and forked before its checkpoint.
+        if(config.warmup_insns && !resumed && !warm) {
+            W64 insns = functional_warmup(*this, config.warmup_insns);
+
+            if(logable(1))
+                ptl_logfile << "Functional warmup executed ", insns,
+                            " instructions", endl, flush;
+
+            flush_all_pipelines();
+        }
+
+        // What-if simulations continue from the warmed state
+        if(!resumed)
+            fork_simulations(config);
+
+        if(config.sample_interval) {
+            sampler.reset();
+            sampler.start(total_insns_committed, sim_cycle);
+        }
+
+        // A resumed simulation measures from its checkpoint on
+        if(config.warmup_detect && !resumed)
+            warmup_detector.start(*this, config);
+
+        if(config.stats_address_spaces)
+            address_space_stats_setup(*this, config.stats_address_spaces);
+    }
+
+    if unlikely (config.memtrace_file.set() || config.memtrace_mix.set()) {
+        memtrace_replay(*this, config);
+        first_run = 0;
+        config.stop = true;
+        return 1;
+    }
+
+    if unlikely (config.uoptrace_file.set()) {
+        uoptrace_replay(*this, config);
+        first_run = 0;
+        config.stop = true;
+        return 1;
+    }
+
+    /* Contexts may have changed in QEMU, cores park again if still idle */
+    wake_parked_cores(true);
+
+    foreach (cur_core, cores.count()){
+        if (cores[cur_core]->active)
+            cores[cur_core]->check_ctx_changes();
     }
     first_run = 0;
 
     // Run each core
     bool exiting = false;
 
+    /*
+     * With -host-profile each part of the loop adds the rdtsc ticks since
+     * the previous mark to its counter, six rdtsc per cycle in total.
+     * Logging, progress updates and periodic stats dumps count as stats,
+     * the ptl_logfile size check as memory and the stop checks and idle
+     * skipping as other. Memory is the clocking of controllers and
+     * interconnects, events the memory hierarchy events due in the cycle.
+     * ptl_simulate() adds the time of switches to and from QEMU as qemu.
+     */
+    bool profile = config.host_profile;
+    W64 profile_tsc = profile ? rdtsc() : 0;
+
+#define HOST_PROFILE_MARK(part) \
+    if unlikely (profile) { \
+        W64 t = rdtsc(); \
+        host_profile_ticks[part] += t - profile_tsc; \
+        profile_tsc = t; \
+    }
+
     for (;;) {
+        HOST_PROFILE_MARK(HOST_PROFILE_OTHER);
+
         if unlikely ((!logenable) &&
                 iterations >= config.start_log_at_iteration &&
                 !config.log_user_only) {
@@ -241,23 +442,70 @@ int BaseMachine::run(PTLsimConfig& config)
         if(sim_cycle % 1000 == 0)
             update_progress();
 
+        ptl_service_ptlcall_ring();
+
         if unlikely(sim_cycle == 0 && time_stats_file)
             StatsBuilder::get().dump_header(*time_stats_file);
 
         if unlikely (time_stats_file && sim_cycle > 0 &&
                 sim_cycle % config.time_stats_period == 0) {
+            if unlikely (profile)
+                host_profile_set_periodic_stats(host_profile_ticks);
+            StatOccupancy::flush_all(sim_cycle);
             StatsBuilder::get().dump_periodic(*time_stats_file, sim_cycle);
         }
 
+        if unlikely (stats_exporter && config.stats_export_period &&
+                sim_cycle > 0 && sim_cycle % config.stats_export_period == 0) {
+            StatOccupancy::flush_all(sim_cycle);
+            stats_exporter->export_stats(*user_stats, "periodic", sim_cycle,
+                    false, kernel_stats);
+        }
+
+
+        HOST_PROFILE_MARK(HOST_PROFILE_STATS);
 
-        // limit the ptl_logfile size
-        if unlikely (ptl_logfile.is_open() &&
-                ((W64)ptl_logfile.tellp() > config.log_file_size))
+        // limit the ptl_logfile size; tellp() is a seek on the file so
+        // only look every 1000 cycles, and stop once reopening doesn't
+        // shrink it (e.g. /dev/fd/1 can't be rotated)
+        static bool log_rotatable = true;
+        if unlikely (log_rotatable && sim_cycle % 1000 == 0 &&
+                ptl_logfile.is_open() &&
+                ((W64)ptl_logfile.tellp() > config.log_file_size)) {
             backup_and_reopen_logfile();
+            log_rotatable = ((W64)ptl_logfile.tellp() <= config.log_file_size);
+        }
+
+        memoryHierarchyPtr->clock_components();
+        HOST_PROFILE_MARK(HOST_PROFILE_MEMORY);
+
+        memoryHierarchyPtr->execute_events();
+        HOST_PROFILE_MARK(HOST_PROFILE_EVENTS);
 
-        memoryHierarchyPtr->clock();
         clock_qemu_io_events();
 
+        /* Waits here until the other cluster nodes let this cycle run */
+        cluster_node.clock();
+        HOST_PROFILE_MARK(HOST_PROFILE_IO);
+
+        /* Counters of the last cycle go to the last address space */
+        address_space_stats_clock();
+        Core::pc_sampler.clock(sim_cycle);
+        if unlikely (state_hash_enabled)
+            state_hash_clock(*this);
+
+        /* Migrations start and end before the cores are clocked */
+        if unlikely (migration.enabled())
+            migration.clock(config);
+
+        /* Cores in a slower clock domain skip cycles without an edge */
+        if unlikely (clock_domains_scaled)
+            clock_domains_tick();
+
+        /* Parked cores are polled here, e.g. for an interrupt */
+        if unlikely (parked_cores.length)
+            wake_parked_cores();
+
 		foreach (i, coremodel.per_cycle_signals.size()) {
 			if (logable(4))
 				ptl_logfile << "Per-Cycle-Signal : " <<
@@ -265,22 +513,63 @@ int BaseMachine::run(PTLsimConfig& config)
 			exiting |= coremodel.per_cycle_signals[i]->emit(NULL);
 		}
 
+        if unlikely (park_requests.length)
+            park_requested_cores();
+        HOST_PROFILE_MARK(HOST_PROFILE_CORES);
+
         sim_cycle++;
         iterations++;
 
+        if unlikely (warmup_detector.active)
+            warmup_detector.update(*this, config);
+
+        if unlikely (config.guest_pmu)
+            guest_pmus.clock(*this, config);
+
         if unlikely (config.stop_at_insns <= total_insns_committed ||
                 config.stop_at_cycle <= sim_cycle) {
             ptl_logfile << "Stopping simulation loop at specified limits (", sim_cycle, " cycles, ", total_insns_committed, " commits)", endl;
             exiting = 1;
             break;
         }
+        if unlikely (config.sample_interval &&
+                sampler.update(*this, config)) {
+            ptl_logfile << "Stopping sampled simulation at target error (",
+                        sampler.ipc.count, " windows)", endl;
+            exiting = 1;
+            break;
+        }
+        /*
+         * Checkpoints are created by QEMU, so pipelines are flushed and the
+         * loop goes back to QEMU. A simulation resumed from the checkpoint
+         * also starts with flushed pipelines.
+         */
+        if unlikely (config.periodic_checkpoint_cycles &&
+                sim_cycle >= next_periodic_checkpoint) {
+            next_periodic_checkpoint = sim_cycle +
+                config.periodic_checkpoint_cycles;
+            flush_all_pipelines();
+
+            stringbuf chk_name;
+            chk_name << config.periodic_checkpoint_name << "_" << sim_cycle;
+            queue_resumable_checkpoint(chk_name.buf);
+
+            exiting = 1;
+        }
+
         if unlikely (exiting) {
             if unlikely(ret_qemu_env == NULL)
                 ret_qemu_env = &contextof(0);
             break;
         }
+
+        if unlikely (config.skip_idle_cycles)
+            skip_idle_cycles(config);
     }
 
+    HOST_PROFILE_MARK(HOST_PROFILE_OTHER);
+#undef HOST_PROFILE_MARK
+
     if(logable(1))
         ptl_logfile << "Exiting out-of-order core at ", total_insns_committed, " commits, ", total_uops_committed, " uops and ", iterations, " iterations (cycles)", endl;
 
@@ -289,8 +578,89 @@ int BaseMachine::run(PTLsimConfig& config)
     return exiting;
 }
 
+/**
+ * @brief Fast-forward over cycles in which no module has any work to do
+ *
+ * @param config Simulation configuration
+ *
+ * Each core and the memory hierarchy report the first cycle in which they
+ * have work to do. Per-cycle signals are registered by the cores so their
+ * report covers those signals too. Skipping stops at any cycle in which the
+ * run loop does periodic work (progress update, time stats dump, start of
+ * logging and stop cycle) so simulation result is same as clocking every
+ * cycle. Cores are idle only while their threads are halted or spinning
+ * with no uops in flight, cycles stalled on memory are still clocked.
+ */
+void BaseMachine::skip_idle_cycles(PTLsimConfig& config)
+{
+    W64 horizon = infinity;
+
+    /* Parked cores count, a spin wait can end on timeout */
+    foreach (i, cores.count()) {
+        if (!cores[i]->active)
+            continue;
+
+        horizon = min(horizon, cores[i]->get_next_active_cycle());
+        if likely (horizon <= sim_cycle)
+            return;
+    }
+
+    if (migration.enabled())
+        horizon = min(horizon, migration.get_next_active_cycle());
+
+    horizon = min(horizon, memoryHierarchyPtr->get_next_active_cycle());
+    horizon = min(horizon, get_next_qemu_io_event_cycle());
+    horizon = min(horizon, cluster_node.get_next_active_cycle());
+
+    /* Progress update, snapshots and sync are done every 1000 cycles */
+    horizon = min(horizon, ((sim_cycle + 999) / 1000) * 1000);
+
+    if (time_stats_file) {
+        W64 period = config.time_stats_period;
+        horizon = min(horizon, ((sim_cycle + period - 1) / period) * period);
+    }
+
+    if (stats_exporter && config.stats_export_period) {
+        W64 period = config.stats_export_period;
+        horizon = min(horizon, ((sim_cycle + period - 1) / period) * period);
+    }
+
+    if (!logenable && iterations < config.start_log_at_iteration)
+        horizon = min(horizon, sim_cycle +
+                (config.start_log_at_iteration - iterations));
+
+    if (config.stop_at_cycle > sim_cycle)
+        horizon = min(horizon, config.stop_at_cycle - 1);
+
+    if (config.periodic_checkpoint_cycles)
+        horizon = min(horizon, next_periodic_checkpoint - 1);
+
+    if (horizon <= sim_cycle)
+        return;
+
+    W64 cycles = horizon - sim_cycle;
+
+    if (logable(4))
+        ptl_logfile << "Skipping ", cycles, " idle cycles from ",
+                    sim_cycle, endl;
+
+    memoryHierarchyPtr->skip_cycles(cycles);
+    if unlikely (clock_domains_scaled)
+        clock_domains_skip(cycles);
+    /* Parked cores account their cycles once woken up */
+    foreach (i, cores.count()) {
+        if (cores[i]->active && !cores[i]->parked)
+            cores[i]->skip_cycles(cycles);
+    }
+
+    sim_cycle += cycles;
+    iterations += cycles;
+}
+
 void BaseMachine::flush_tlb(Context& ctx)
 {
+    ctx.flush_host_tlb();
+
     foreach(i, cores.count()) {
         BaseCore* core = cores[i];
         core->flush_tlb(ctx);
@@ -299,6 +669,8 @@ void BaseMachine::flush_tlb(Context& ctx)
 
 void BaseMachine::flush_tlb_virt(Context& ctx, Waddr virtaddr)
 {
+    ctx.flush_host_tlb_virt(virtaddr);
+
     foreach(i, cores.count()) {
         BaseCore* core = cores[i];
         core->flush_tlb_virt(ctx, virtaddr);
@@ -317,18 +689,322 @@ void BaseMachine::dump_state(ostream& os)
 
 void BaseMachine::flush_all_pipelines()
 {
-    // TODO
+    foreach (i, cores.count()) {
+        cores[i]->flush_pipeline();
+    }
+}
+
+/**
+ * @brief Remember the state QEMU may change before simulation starts again
+ *
+ * Called when simulation stops with -warm-toggle, starts logging the pages
+ * written in emulation.
+ */
+void BaseMachine::stop_warm()
+{
+    foreach (i, contextcount)
+        stopped_cr3[i] = contextof(i).cr[3];
+
+    ptl_start_emulation_dirty_log();
+    warm_toggled = true;
+}
+
+/**
+ * @brief Start simulation again from the state of the last run
+ *
+ * Toggling simulation on and off around regions of interest then doesn't
+ * start with cold caches and predictors each time. Only what emulation
+ * made stale is dropped: the cache lines and decoded basic blocks of the
+ * pages QEMU wrote, and the TLBs of contexts that switched page tables.
+ * Pipelines restart from the contexts like after functional warmup.
+ */
+void BaseMachine::rewarm_after_emulation()
+{
+    flush_all_pipelines();
+
+    dynarray<W64> pages;
+    if(!ptl_emulation_dirty_pages(pages)) {
+        ptl_logfile << "ERROR: no log of pages written in emulation, ",
+                    "caches are kept as they are", endl;
+    }
+
+    W64 lines = 0;
+    foreach(i, pages.count()) {
+        lines += memoryHierarchyPtr->invalidate_page(pages[i]);
+        bbcache[0].invalidate_page(pages[i] >> 12,
+                INVALIDATE_REASON_DMA);
+    }
+
+    W64 tlb_flushes = 0;
+    foreach(ctx_no, contextcount) {
+        Context& ctx = contextof(ctx_no);
+        if(ctx.cr[3] == stopped_cr3[ctx_no])
+            continue;
+
+        foreach(i, cores.count())
+            cores[i]->flush_tlb(ctx);
+        tlb_flushes++;
+    }
+
+    if(logable(1))
+        ptl_logfile << "Warm restart: ", pages.count(),
+                    " pages written in emulation, ", lines,
+                    " cache lines dropped, ", tlb_flushes,
+                    " TLB flushes", endl, flush;
+}
+
+/**
+ * @brief Save the warm state of all cores and controllers
+ *
+ * @param filename Warm state file to write, see warmstate.h
+ * @param resumable Also save the simulation counters and Stats, for
+ * -periodic-checkpoint-cycles
+ */
+bool BaseMachine::save_warm_state(const char* filename, bool resumable)
+{
+    WarmState state;
+
+    if (!state.open_save(filename))
+        return false;
+
+    if (resumable) {
+        state.begin_section("simulation");
+        transfer_simulation_state(state);
+        state.end_section();
+    }
+
+    foreach (i, cores.count()) {
+        state.begin_section(cores[i]->get_name());
+        cores[i]->transfer_warm_state(state);
+        state.end_section();
+    }
+
+    foreach (i, controllers.count()) {
+        state.begin_section(controllers[i]->get_name());
+        controllers[i]->transfer_warm_state(state);
+        state.end_section();
+    }
+
+    state.close();
+
+    ptl_logfile << "Warm state saved to ", filename, endl;
+    return true;
+}
+
+/**
+ * @brief Load a warm state file into the cores and controllers of the
+ * same names
+ *
+ * Sections without a component of that name, or that don't match the
+ * component's build or configuration, are skipped and logged.
+ */
+bool BaseMachine::load_warm_state(const char* filename)
+{
+    WarmState state;
+    int loaded = 0;
+    int skipped = 0;
+
+    if (!state.open_load(filename))
+        return false;
+
+    while (state.next_section()) {
+        const char* name = state.section_name();
+        bool found = false;
+
+        if (!strcmp(name, "simulation")) {
+            transfer_simulation_state(state);
+            resumed = state.ok();
+            found = true;
+        }
+
+        foreach (i, cores.count()) {
+            if (found) break;
+            if (!strcmp(cores[i]->get_name(), name)) {
+                cores[i]->transfer_warm_state(state);
+                found = true;
+            }
+        }
+
+        foreach (i, controllers.count()) {
+            if (found) break;
+            if (!strcmp(controllers[i]->get_name(), name)) {
+                controllers[i]->transfer_warm_state(state);
+                found = true;
+            }
+        }
+
+        if (!found) {
+            ptl_logfile << "Warm state: no component ", name, endl;
+            skipped++;
+        } else if (!state.ok()) {
+            ptl_logfile << "Warm state: ", name, " doesn't match this ",
+                        "machine, partially loaded", endl;
+            skipped++;
+        } else {
+            loaded++;
+        }
+    }
+
+    state.close();
+
+    ptl_logfile << "Warm state loaded from ", filename, ": ", loaded,
+                " components, ", skipped, " skipped", endl;
+    return true;
+}
+
+/**
+ * @brief Stop clocking a core that has no work, from its runcycle
+ *
+ * @param core Core whose get_next_active_cycle returns a later cycle
+ *
+ * The core is taken off the per-cycle signals once all cores are clocked
+ * in this cycle, which is the first cycle it is not clocked.
+ */
+void BaseMachine::request_park(BaseCore& core)
+{
+    if (core.parked || !core.run_cycle_signal)
+        return;
+
+    core.parked = true;
+    core.parked_cycle = sim_cycle;
+    park_requests.push(&core);
+}
+
+void BaseMachine::park_requested_cores()
+{
+    foreach (i, park_requests.count()) {
+        parked_cores.push(park_requests[i]);
+
+        if (logable(4))
+            ptl_logfile << "Parking idle core ", park_requests[i]->get_name(),
+                        " at cycle ", sim_cycle, endl;
+    }
+
+    park_requests.clear();
+    update_per_cycle_signals();
+}
+
+/**
+ * @brief Clock parked cores again once they have work to do
+ *
+ * @param all Wake up all parked cores, e.g. when simulation restarts
+ *
+ * Runs before the cores are clocked, so a core woken up by an interrupt
+ * delivered in this cycle runs in this cycle as it would if it was
+ * clocked all along.
+ */
+void BaseMachine::wake_parked_cores(bool all)
+{
+    int left = 0;
+
+    foreach (i, parked_cores.count()) {
+        BaseCore* core = parked_cores[i];
+
+        if (!all && core->active &&
+                core->get_next_active_cycle() > sim_cycle) {
+            parked_cores[left++] = core;
+            continue;
+        }
+
+        /* Idle cycles were not clocked, add them to the stats at once */
+        core->skip_cycles(sim_cycle - core->parked_cycle);
+        core->parked = false;
+
+        if (logable(4))
+            ptl_logfile << "Waking up core ", core->get_name(), " parked for ",
+                        sim_cycle - core->parked_cycle, " cycles", endl;
+    }
+
+    if (left == parked_cores.length)
+        return;
+
+    parked_cores.resize(left);
+    update_per_cycle_signals();
+}
+
+/* Signals are registered with coremodel, cores are clocked in that order */
+void BaseMachine::update_per_cycle_signals()
+{
+    dynarray<Signal*>& signals = coremodel.per_cycle_signals;
+    signals.clear();
+
+    foreach (i, coremodel.registered_cycle_signals.count()) {
+        Signal* signal = coremodel.registered_cycle_signals[i];
+        bool parked = false;
+
+        foreach (j, parked_cores.count())
+            parked |= (parked_cores[j]->run_cycle_signal == signal);
+
+        if (!parked)
+            signals.push(signal);
+    }
+}
+
+/**
+ * @brief Start a spin wait of a thread, see Core::SpinLoopDetector
+ */
+void BaseMachine::spin_wait(SpinLoopDetector& spin)
+{
+    spin.wait(sim_cycle);
+    spin_waits.push(&spin);
+}
+
+void BaseMachine::spin_unwatch(SpinLoopDetector& spin)
+{
+    int left = 0;
+
+    foreach (i, spin_waits.count()) {
+        if (spin_waits[i] != &spin)
+            spin_waits[left++] = spin_waits[i];
+    }
+
+    spin_waits.resize(left);
+}
+
+/**
+ * @brief Wake up the threads spinning on a line
+ *
+ * @param physaddr Address in the line
+ * @param size Line size of the caller
+ *
+ * Called by cores for committed stores and by cache controllers when a
+ * snoop or eviction invalidates a valid line. Threads notice they
+ * were woken up the next time they are clocked.
+ */
+void BaseMachine::spin_line_changed(W64 physaddr, int size)
+{
+    size = max(size, 64);
+
+    foreach (i, spin_waits.count()) {
+        if (spin_waits[i]->watches(physaddr, size))
+            spin_waits[i]->woken = 1;
+    }
 }
 
 void BaseMachine::update_stats()
 {
+    foreach (i, parked_cores.count()) {
+        BaseCore* core = parked_cores[i];
+        core->skip_cycles(sim_cycle - core->parked_cycle);
+        core->parked_cycle = sim_cycle;
+    }
+
+    StatOccupancy::flush_all(sim_cycle);
+
     global_stats->reset();
     *global_stats += *user_stats;
     *global_stats += *kernel_stats;
 
     foreach(i, cores.count()) {
         cores[i]->update_stats();
+        cores[i]->update_pc_profile_stats();
     }
+
+    if (memoryHierarchyPtr)
+        memoryHierarchyPtr->update_stats();
+
+    if (migration.enabled())
+        migration.update_stats();
 }
 
 Context& BaseMachine::get_next_context()
@@ -341,7 +1017,7 @@ Context& BaseMachine::get_next_context()
 
 W8 BaseMachine::get_next_coreid()
 {
-    assert((coreid_counter) < MAX_CONTEXTS);
+    assert((coreid_counter) < MAX_MACHINE_CORES);
     return coreid_counter++;
 }
 
@@ -404,111 +1080,100 @@ void BaseMachine::setup_interconnects()
 void BaseMachine::add_option(const char* name, const char* opt,
         bool value)
 {
-    BoolOptions** b = bool_options.get(name);
-    if(!b) {
-        BoolOptions* opts = new BoolOptions();
-        bool_options.add(name, opts);
-        b = &opts;
-    }
-
-    (*b)->add(opt, value);
+    options.add(name, opt, value);
 }
 
 void BaseMachine::add_option(const char* name, const char* opt,
         int value)
 {
-    IntOptions** b = int_options.get(name);
-    if(!b) {
-        IntOptions* opts = new IntOptions();
-        int_options.add(name, opts);
-        b = &opts;
-    }
-
-    (*b)->add(opt, value);
+    options.add(name, opt, value);
 }
 
 void BaseMachine::add_option(const char* name, const char* opt,
         const char* value)
 {
-    StrOptions** b = str_options.get(name);
-    if(!b) {
-        StrOptions* opts = new StrOptions();
-        str_options.add(name, opts);
-        b = &opts;
-    }
-
-    stringbuf* val = new stringbuf();
-    *val << value;
-    (*b)->add(opt, val);
+    options.add(name, opt, value);
 }
 
 void BaseMachine::add_option(const char* c_name, int i, const char* opt,
         bool value)
 {
-    stringbuf core_name;
-    core_name << c_name << i;
-    add_option(core_name.buf, opt, value);
+    char core_name[128];
+    snprintf(core_name, sizeof(core_name), "%s%d", c_name, i);
+    options.add(core_name, opt, value);
 }
 
 void BaseMachine::add_option(const char* c_name, int i, const char* opt,
         int value)
 {
-    stringbuf core_name;
-    core_name << c_name << i;
-    add_option(core_name.buf, opt, value);
+    char core_name[128];
+    snprintf(core_name, sizeof(core_name), "%s%d", c_name, i);
+    options.add(core_name, opt, value);
 }
 
 void BaseMachine::add_option(const char* c_name, int i, const char* opt,
         const char* value)
 {
-    stringbuf core_name;
-    core_name << c_name << i;
-    add_option(core_name.buf, opt, value);
+    char core_name[128];
+    snprintf(core_name, sizeof(core_name), "%s%d", c_name, i);
+    options.add(core_name, opt, value);
+}
+
+bool BaseMachine::has_option(const char* name, const char* opt_name)
+{
+    return options.has(name, opt_name);
 }
 
 bool BaseMachine::get_option(const char* name, const char* opt_name,
         bool& value)
 {
-    BoolOptions** b = bool_options.get(name);
-    if(b) {
-        bool* bt = (*b)->get(opt_name);
-        if(bt) {
-            value = *bt;
-            return true;
-        }
-    }
-
-    return false;
+    return options.get(name, opt_name, value);
 }
 
 bool BaseMachine::get_option(const char* name, const char* opt_name,
         int& value)
 {
-    IntOptions** b = int_options.get(name);
-    if(b) {
-        int* bt = (*b)->get(opt_name);
-        if(bt) {
-            value = *bt;
-            return true;
-        }
-    }
-
-    return false;
+    return options.get(name, opt_name, value);
 }
 
 bool BaseMachine::get_option(const char* name, const char* opt_name,
         stringbuf& value)
 {
-    StrOptions** b = str_options.get(name);
-    if(b) {
-        stringbuf** bt = (*b)->get(opt_name);
-        if(bt) {
-            value << **bt;
-            return true;
+    return options.get(name, opt_name, value);
+}
+
+/**
+ * @brief Read an option whose value is one of a list of names
+ *
+ * @param name Name of the core
+ * @param opt_name Option to read
+ * @param names Accepted values, the option is set to index of its value
+ * @param count Number of accepted values
+ * @param def Index used if option is not set
+ *
+ * @return Index of option's value in names
+ */
+int BaseMachine::get_named_option(const char* name, const char* opt_name,
+        const char** names, int count, int def)
+{
+    stringbuf value;
+    if(!get_option(name, opt_name, value)) {
+        return def;
+    }
+
+    foreach(i, count) {
+        if(strequal(value.buf, names[i])) {
+            return i;
         }
     }
 
-    return false;
+    stringbuf err;
+    err << "::ERROR::Can't find " << opt_name << " '" << value <<
+        "' for " << name << ". Please check your config file." << endl;
+    ptl_logfile << err;
+    cout << err;
+    assert(0);
+    return def;
 }
 
 /* Machine Builder */
@@ -583,6 +1248,46 @@ void CoreBuilder::add_new_core(BaseMachine& machine,
     machine.cores.push(core);
 }
 
+/**
+ * @brief Add a core that runs the Contexts of the last added core
+ *
+ * @param machine Machine to add the core to
+ * @param name Name prefix of the core
+ * @param core_name Name of the CoreBuilder, usually another core type
+ *
+ * The migration peer is built on the same Contexts as the core before it,
+ * so both need the same number of threads. The peer starts inactive and
+ * the Contexts move between the two cores, see coremigration.h.
+ */
+void CoreBuilder::add_migration_peer(BaseMachine& machine,
+        const char* name, const char* core_name)
+{
+    assert(machine.cores.count());
+    BaseCore* primary = machine.cores[machine.cores.count() - 1];
+    assert(!primary->migration_peer);
+
+    W8 context_counter = machine.context_counter;
+    machine.context_counter = primary->context_base;
+
+    add_new_core(machine, name, core_name);
+
+    BaseCore* peer = machine.cores[machine.cores.count() - 1];
+
+    if(machine.context_counter != context_counter) {
+        stringbuf err;
+        err << "::ERROR::Migration peer " << peer->get_name() <<
+            " and " << primary->get_name() <<
+            " need the same number of threads." << endl;
+        ptl_logfile << err;
+        cout << err;
+        assert(0);
+    }
+
+    primary->migration_peer = peer;
+    peer->migration_peer = primary;
+    peer->active = false;
+}
+
 /* Cache Controller Builders */
 
 ControllerBuilder::ControllerBuilder(const char* name)
@@ -691,6 +1396,7 @@ void marss_add_event(Signal* signal, int delay, void* arg)
 void marss_register_per_cycle_event(Signal *signal)
 {
 	coremodel.per_cycle_signals.push(signal);
+	coremodel.registered_cycle_signals.push(signal);
 }
 void BaseMachine::simulation_done()
 {
@@ -12,14 +12,19 @@
 #define MACHINE_H
 
 #include <ptlsim.h>
+#include <machine-options.h>
 
 #define YAML_KEY_VAL(out, key, val) \
 	out << YAML::Key << key << YAML::Value << val;
 
 #define THREAD_PAUSE_CYCLES 10000
 
+/* Each core can have a migration peer that runs its Contexts */
+#define MAX_MACHINE_CORES (2 * MAX_CONTEXTS)
+
 namespace Core {
     struct BaseCore;
+    struct SpinLoopDetector;
 };
 
 namespace Memory {
@@ -28,9 +33,22 @@ namespace Memory {
     struct MemoryHierarchy;
 };
 
-typedef Hashtable<const char*, bool, 1> BoolOptions;
-typedef Hashtable<const char*, int, 1> IntOptions;
-typedef Hashtable<const char*, stringbuf*, 1> StrOptions;
+/* Controllers are looked up by name while the memory hierarchy is wired */
+#define MACHINE_COMPONENT_SETS 64
+
+/* Parts of the run loop whose host time -host-profile measures */
+enum {
+    HOST_PROFILE_CORES = 0,
+    HOST_PROFILE_MEMORY,
+    HOST_PROFILE_EVENTS,
+    HOST_PROFILE_IO,
+    HOST_PROFILE_QEMU,
+    HOST_PROFILE_STATS,
+    HOST_PROFILE_OTHER,
+    HOST_PROFILE_COUNT
+};
+
+extern const char* host_profile_names[HOST_PROFILE_COUNT];
 
 struct SingleConnection {
     stringbuf controller;
@@ -50,10 +68,16 @@ struct BaseMachine: public PTLsimMachine {
     dynarray<ConnectionDef*> connections;
 	dynarray<Signal*> per_cycle_signals;
 
-    Hashtable<const char*, Memory::Controller*, 1> controller_hash;
-    Hashtable<const char*, BoolOptions*, 1> bool_options;
-    Hashtable<const char*, IntOptions*, 1> int_options;
-    Hashtable<const char*, StrOptions*, 1> str_options;
+    // Signals of all cores, per_cycle_signals leaves out the parked ones
+    dynarray<Signal*> registered_cycle_signals;
+    dynarray<Core::BaseCore*> parked_cores;
+    dynarray<Core::BaseCore*> park_requests;
+
+    // Threads waiting in spin loops, see Core::SpinLoopDetector
+    dynarray<Core::SpinLoopDetector*> spin_waits;
+
+    Hashtable<const char*, Memory::Controller*, MACHINE_COMPONENT_SETS> controller_hash;
+    MachineOptions options;
 
     Memory::MemoryHierarchy* memoryHierarchyPtr;
 
@@ -66,6 +90,24 @@ struct BaseMachine: public PTLsimMachine {
     virtual void flush_tlb(Context& ctx);
     virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr);
     void flush_all_pipelines();
+
+    // Warm microarchitectural state files, see warmstate.h. Resumable
+    // ones also hold the counters and Stats of the simulation
+    bool save_warm_state(const char* filename, bool resumable = false);
+    bool load_warm_state(const char* filename);
+
+    // Set once a resumable warm state file is loaded
+    bool resumed;
+
+    // Cycle of the next -periodic-checkpoint-cycles checkpoint
+    W64 next_periodic_checkpoint;
+
+    // With -warm-toggle cores keep their state from one simulation run to
+    // the next, see rewarm_after_emulation()
+    bool warm_toggled;
+    W64 stopped_cr3[MAX_CONTEXTS];
+    void stop_warm();
+    void rewarm_after_emulation();
     virtual void reset();
 	virtual void dump_configuration(ostream& os) const;
 	virtual void shutdown();
@@ -79,6 +121,7 @@ struct BaseMachine: public PTLsimMachine {
     Context& get_next_context();
     W8 get_next_coreid();
 	void config_changed();
+	void configure_machine_options(const char *spec);
 
     // Interconnect related support functions
     ConnectionDef* get_new_connection_def(const char* interconnect,
@@ -86,6 +129,23 @@ struct BaseMachine: public PTLsimMachine {
     void add_new_connection(ConnectionDef* conn, const char* cont, int type);
     void setup_interconnects();
 
+    // Idle cycle skipping
+    void skip_idle_cycles(PTLsimConfig& config);
+
+    // Idle core parking, see BaseCore::parked
+    void request_park(Core::BaseCore& core);
+    void wake_parked_cores(bool all = false);
+    void park_requested_cores();
+    void update_per_cycle_signals();
+
+    // Spin loop fast-forward, with -spin-ff
+    void spin_wait(Core::SpinLoopDetector& spin);
+    void spin_unwatch(Core::SpinLoopDetector& spin);
+    void spin_line_changed(W64 physaddr, int size = 64);
+
+    // Host rdtsc ticks spent in each part of run(), with -host-profile
+    W64 host_profile_ticks[HOST_PROFILE_COUNT];
+
     // Options related support functions
     void add_option(const char* name, const char* opt_name,
             bool value);
@@ -105,6 +165,8 @@ struct BaseMachine: public PTLsimMachine {
     bool get_option(const char* name, const char* opt_name, bool& value);
     bool get_option(const char* name, const char* opt_name, int& value);
     bool get_option(const char* name, const char* opt_name, stringbuf& value);
+    int get_named_option(const char* name, const char* opt_name,
+            const char** names, int count, int def);
 };
 
 typedef void (*machine_gen)(BaseMachine& machine);
@@ -123,6 +185,8 @@ struct CoreBuilder {
     static Hashtable<const char*, CoreBuilder*, 1> *coreBuilders;
     static void add_new_core(BaseMachine& machine, const char* name,
             const char* core_name);
+    static void add_migration_peer(BaseMachine& machine, const char* name,
+            const char* core_name);
 	virtual void config_changed() {}
 };
 
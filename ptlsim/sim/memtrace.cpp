@@ -0,0 +1,567 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <memtrace.h>
+#include <machine.h>
+#include <ptlsim.h>
+#include <memoryHierarchy.h>
+#include <ptl-qemu.h>
+
+#include <pthread.h>
+
+using namespace Memory;
+
+namespace {
+
+    struct ReplayCore {
+        const MemTraceFile *trace;
+        const dynarray<W32> *recs;  /* Record numbers of this core */
+        W64 addr_offset;
+        W64 next;                   /* Index into recs */
+        W64 ready_cycle;
+        W64 done_cycle;             /* Last access done, 0 until then */
+        W64 hit_done_cycle;         /* Last L1 hit of access_hit done */
+        int outstanding;
+    };
+
+    struct ReplayStats {
+        W64 reads;
+        W64 writes;
+        W64 ifetches;
+        W64 fast_hits;
+        W64 completed;
+        W64 latency_sum;
+        W64 latency_max;
+        W64 stalls;
+    };
+
+    dynarray<ReplayCore> replay_cores;
+    ReplayStats replay_stats;
+
+    /* Called when a read or fetch that missed the fast path completes */
+    bool replay_done(void *arg)
+    {
+        MemoryRequest *request = (MemoryRequest*)arg;
+
+        if (request->get_type() == MEMORY_OP_WRITE)
+            return true;
+
+        ReplayCore &rc = replay_cores[request->get_coreid()];
+        assert(rc.outstanding > 0);
+        rc.outstanding--;
+
+        W64 latency = sim_cycle - request->get_init_cycles();
+        replay_stats.completed++;
+        replay_stats.latency_sum += latency;
+        replay_stats.latency_max = max(replay_stats.latency_max, latency);
+
+        return true;
+    }
+
+    /* Open one trace per core of '-memtrace-mix', false on error */
+    bool open_mix(const char *list, int cores,
+            dynarray<MemTraceFile*> &traces, dynarray<stringbuf*> &names)
+    {
+        stringbuf mix;
+        mix << list;
+        mix.split(names, ",");
+
+        if (names.count() > cores) {
+            ptl_logfile << "Memory trace mix has ", names.count(),
+                        " traces for ", cores, " cores", endl, flush;
+            cerr << "Memory trace mix has ", names.count(), " traces for ",
+                 cores, " cores", endl, flush;
+            return false;
+        }
+
+        foreach (i, names.count()) {
+            MemTraceFile *trace = new MemTraceFile();
+            traces.push(trace);
+
+            /* Each workload was captured alone, on core 0 */
+            const char *err = trace->open(names[i]->buf, 1);
+            if (err) {
+                ptl_logfile << "Memory trace ", *names[i], ": ", err, endl,
+                            flush;
+                cerr << "Memory trace ", *names[i], ": ", err, endl, flush;
+                return false;
+            }
+        }
+
+        return names.count() > 0;
+    }
+
+    /* Cycles of each workload from '-memtrace-mix-alone', false if unset */
+    bool parse_alone_cycles(const char *list, int count, dynarray<W64> &alone)
+    {
+        stringbuf values;
+        dynarray<stringbuf*> items;
+        values << list;
+        values.split(items, ",");
+
+        bool ok = (items.count() == count);
+        foreach (i, items.count()) {
+            char *end;
+            W64 cycles = strtoull(items[i]->buf, &end, 0);
+            if (end == items[i]->buf || !cycles)
+                ok = false;
+            alone.push(cycles);
+            delete items[i];
+        }
+
+        if (items.count() && !ok)
+            ptl_logfile << "Ignoring -memtrace-mix-alone, it needs one cycle "
+                        "count above 0 per trace", endl;
+        return ok;
+    }
+
+};
+
+W64 memtrace_replay(BaseMachine& machine, PTLsimConfig& config)
+{
+    MemoryHierarchy *mem = machine.memoryHierarchyPtr;
+    int cores = machine.get_num_cores();
+    bool mix = config.memtrace_mix.set();
+
+    dynarray<MemTraceFile*> traces;
+    dynarray<stringbuf*> names;
+    MemTraceFile trace;
+
+    if (mix) {
+        if (!open_mix(config.memtrace_mix, cores, traces, names)) {
+            foreach (i, traces.count()) delete traces[i];
+            foreach (i, names.count()) delete names[i];
+            return 0;
+        }
+    } else {
+        const char *err = trace.open(config.memtrace_file, cores);
+        if (err) {
+            ptl_logfile << "Memory trace ", config.memtrace_file, ": ", err,
+                        endl, flush;
+            cerr << "Memory trace ", config.memtrace_file, ": ", err, endl,
+                 flush;
+            return 0;
+        }
+    }
+
+    Signal done_signal("memtrace_done");
+    done_signal.connect(signal_fun_ptr(replay_done));
+
+    W64 total = 0;
+    replay_cores.resize(cores);
+    foreach (i, cores) {
+        ReplayCore &rc = replay_cores[i];
+        rc.trace = mix ? ((i < traces.count()) ? traces[i] : NULL) : &trace;
+        rc.recs = rc.trace ? &rc.trace->per_core[mix ? 0 : i] : NULL;
+        rc.addr_offset = mix ? i * config.memtrace_mix_stride : 0;
+        rc.next = 0;
+        rc.outstanding = 0;
+        rc.done_cycle = 0;
+        rc.hit_done_cycle = 0;
+        rc.ready_cycle = sim_cycle;
+        if (rc.recs && rc.recs->count())
+            rc.ready_cycle += rc.trace->records[(*rc.recs)[0]].gap;
+    }
+    memset(&replay_stats, 0, sizeof(replay_stats));
+
+    if (mix) {
+        foreach (i, traces.count()) total += traces[i]->count;
+    } else {
+        total = trace.count;
+    }
+
+    int limit = max(1, int(config.memtrace_outstanding));
+    W64 start_cycle = sim_cycle;
+    W64 issued = 0;
+    W64 tsc_at_start = rdtsc();
+    const char *source = mix ? config.memtrace_mix.buf :
+        config.memtrace_file.buf;
+
+    ptl_logfile << "Replaying ", total, " memory accesses of ", source, endl,
+                flush;
+
+    for (;;) {
+        bool pending = false;
+
+        foreach (i, cores) {
+            ReplayCore &rc = replay_cores[i];
+            if (!rc.recs) continue;
+            const dynarray<W32> &recs = *rc.recs;
+
+            bool busy = rc.outstanding || sim_cycle < rc.hit_done_cycle;
+            if (busy) pending = true;
+            if (rc.next >= recs.count()) {
+                if (!busy && !rc.done_cycle)
+                    rc.done_cycle = max(sim_cycle, start_cycle + 1);
+                continue;
+            }
+            pending = true;
+
+            if (sim_cycle < rc.ready_cycle || rc.outstanding >= limit)
+                continue;
+
+            W32 idx = recs[rc.next];
+            const MemTraceRecord &r = rc.trace->records[idx];
+            bool ifetch = (r.type == MEMTRACE_IFETCH);
+            W64 physaddr = r.physaddr + rc.addr_offset;
+            int hit_latency = 0;
+
+            /*
+             * Data L1 hits are queued by access_cache and only signalled
+             * later, so take them synchronously as the cores do
+             */
+            if (r.type == MEMTRACE_READ) {
+                hit_latency = mem->access_hit(i, r.threadid, physaddr,
+                        r.rip, idx);
+                if (hit_latency == CACHE_BANK_CONFLICT) {
+                    replay_stats.stalls++;
+                    continue;
+                }
+            }
+
+            bool hit = (hit_latency > 0);
+            if (hit) {
+                rc.hit_done_cycle = max(rc.hit_done_cycle,
+                        sim_cycle + hit_latency);
+            } else {
+                if (!mem->is_cache_available(i, r.threadid, ifetch)) {
+                    replay_stats.stalls++;
+                    continue;
+                }
+
+                MemoryRequest *request = mem->get_free_request(i);
+                assert(request != NULL);
+
+                request->init(i, r.threadid, physaddr, idx & 0x7fffffff,
+                        sim_cycle, ifetch, r.rip, idx,
+                        (r.type == MEMTRACE_WRITE) ? MEMORY_OP_WRITE :
+                        MEMORY_OP_READ);
+                request->set_coreSignal(&done_signal);
+
+                hit = mem->access_cache(request);
+            }
+
+            if (r.type == MEMTRACE_WRITE) {
+                replay_stats.writes++;
+            } else {
+                if (ifetch) replay_stats.ifetches++;
+                else replay_stats.reads++;
+
+                if (hit) replay_stats.fast_hits++;
+                else rc.outstanding++;
+            }
+
+            issued++;
+            rc.next++;
+            rc.ready_cycle = sim_cycle + 1;
+            if (rc.next < recs.count())
+                rc.ready_cycle = max(rc.ready_cycle,
+                        sim_cycle + rc.trace->records[recs[rc.next]].gap);
+        }
+
+        if unlikely (!pending)
+            break;
+
+        if (sim_cycle % 1000 == 0)
+            update_progress();
+
+        mem->clock();
+        sim_cycle++;
+
+        if unlikely (config.stop_at_cycle <= sim_cycle) {
+            ptl_logfile << "Stopping memory trace replay at specified "
+                        "limit (", sim_cycle, " cycles)", endl;
+            break;
+        }
+    }
+
+    double seconds = ticks_to_native_seconds(rdtsc() - tsc_at_start);
+    W64 cycles = sim_cycle - start_cycle;
+    W64 misses = replay_stats.reads + replay_stats.ifetches -
+        replay_stats.fast_hits;
+
+    stringbuf sb;
+    sb << "Memory trace replay of ", source, ":", endl;
+    sb << "  accesses ", issued, " of ", total, " (",
+       replay_stats.reads, " reads, ", replay_stats.writes, " writes, ",
+       replay_stats.ifetches, " fetches) in ", cycles, " cycles", endl;
+    sb << "  reads and fetches: ", replay_stats.fast_hits,
+       " L1 and fetch buffer hits, ", misses, " misses, average miss latency ",
+       floatstring(replay_stats.completed ?
+               double(replay_stats.latency_sum) / replay_stats.completed : 0,
+               0, 1),
+       " cycles, max ", replay_stats.latency_max, endl;
+    sb << "  controller full and bank conflict stalls ",
+       replay_stats.stalls, endl;
+    sb << "  host time ", floatstring(seconds, 0, 3), " seconds, ",
+       W64(seconds > 0 ? issued / seconds : 0), " accesses/sec", endl;
+
+    if (mix) {
+        dynarray<W64> shared;
+        dynarray<W64> alone;
+
+        /* Workloads cut off by -stop-at-cycle count up to the end */
+        foreach (i, traces.count()) {
+            ReplayCore &rc = replay_cores[i];
+            shared.push((rc.done_cycle ? rc.done_cycle : sim_cycle) -
+                    start_cycle);
+            sb << "  core ", i, " ", *names[i], ": ", rc.next, " accesses in ",
+               shared[i], " cycles", (rc.done_cycle ? "" : " (not done)"),
+               endl;
+        }
+
+        if (parse_alone_cycles(config.memtrace_mix_alone, traces.count(),
+                    alone)) {
+            MemTraceMixMetrics m = memtrace_mix_metrics(shared.data,
+                    alone.data, traces.count());
+            sb << "  weighted speedup ", floatstring(m.weighted_speedup, 0, 3),
+               ", harmonic speedup ", floatstring(m.harmonic_speedup, 0, 3),
+               ", fairness ", floatstring(m.fairness, 0, 3), endl;
+        }
+    }
+
+    ptl_logfile << sb, flush;
+    cerr << sb, flush;
+
+    replay_cores.clear();
+    foreach (i, traces.count()) delete traces[i];
+    foreach (i, names.count()) delete names[i];
+    return cycles;
+}
+
+/*
+ * Capture of accesses for later replay
+ */
+
+bool memtrace_capturing = false;
+
+namespace {
+
+    struct CaptureWriter {
+        /* Block being filled by the simulation */
+        MemTraceAccess *fill;
+        int filled;
+        int block_records;
+
+        /* Full blocks waiting for the writer thread, and free ones */
+        dynarray<MemTraceAccess*> slots;
+        dynarray<int> slot_counts;
+        dynarray<MemTraceAccess*> free_blocks;
+        int head;
+        int queued;
+        bool stopping;
+
+        ofstream os;
+        dynarray<W8> payload;
+        dynarray<W8> packed;
+
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+
+        W64 records;
+        W64 raw_bytes;
+        W64 written_bytes;
+        W64 stalls;
+    };
+
+    CaptureWriter *capture_writer = NULL;
+
+    template <typename T>
+    void put_raw(ostream &os, T v)
+    {
+        os.write((const char*)&v, sizeof(v));
+    }
+
+    /* Runs on the writer thread */
+    void write_capture_block(CaptureWriter *w, MemTraceAccess *acc,
+            int count)
+    {
+        memtrace_encode_block(acc, count, w->payload);
+
+        uLongf packed_size = compressBound(w->payload.length);
+        w->packed.resize(packed_size);
+        if (compress2((Bytef*)w->packed.data, &packed_size,
+                    (const Bytef*)w->payload.data, w->payload.length,
+                    Z_BEST_SPEED) != Z_OK) {
+            ptl_logfile << "Failed to compress memory trace block, dropping ",
+                        count, " records", endl;
+            return;
+        }
+
+        put_raw(w->os, W64(acc[0].cycle));
+        put_raw(w->os, W32(count));
+        put_raw(w->os, W32(w->payload.length));
+        put_raw(w->os, W32(packed_size));
+        w->os.write((const char*)w->packed.data, packed_size);
+
+        w->raw_bytes += count * sizeof(MemTraceRecord);
+        w->written_bytes += 20 + packed_size;
+    }
+
+    void* capture_writer_thread(void *arg)
+    {
+        CaptureWriter *w = (CaptureWriter*)arg;
+
+        pthread_mutex_lock(&w->lock);
+        for (;;) {
+            while (!w->queued && !w->stopping)
+                pthread_cond_wait(&w->not_empty, &w->lock);
+
+            if (!w->queued) break;
+
+            MemTraceAccess *block = w->slots[w->head];
+            int count = w->slot_counts[w->head];
+            pthread_mutex_unlock(&w->lock);
+
+            write_capture_block(w, block, count);
+
+            pthread_mutex_lock(&w->lock);
+            w->head = (w->head + 1) % w->slots.length;
+            w->queued--;
+            w->free_blocks.push(block);
+            pthread_cond_signal(&w->not_full);
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        return NULL;
+    }
+
+    /* Hand the filled block to the writer thread and take a free one */
+    void queue_capture_block(CaptureWriter *w)
+    {
+        if (!w->filled) return;
+
+        pthread_mutex_lock(&w->lock);
+        if (w->queued == w->slots.length) {
+            w->stalls++;
+            while (w->queued == w->slots.length)
+                pthread_cond_wait(&w->not_full, &w->lock);
+        }
+
+        int tail = (w->head + w->queued) % w->slots.length;
+        w->slots[tail] = w->fill;
+        w->slot_counts[tail] = w->filled;
+        w->queued++;
+        w->fill = w->free_blocks.pop();
+        w->filled = 0;
+
+        pthread_cond_signal(&w->not_empty);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+};
+
+bool memtrace_capture_open(const char *filename, int block_records,
+        int depth)
+{
+    memtrace_capture_close();
+
+    CaptureWriter *w = new CaptureWriter();
+    w->os.open(filename, std::ios_base::binary | std::ios_base::out |
+            std::ios_base::trunc);
+    if (!w->os) {
+        ptl_logfile << "Unable to open memory trace file ", filename, endl;
+        delete w;
+        return false;
+    }
+
+    w->block_records = max(block_records, 1);
+    depth = max(depth, 1);
+
+    /* One block per queue slot plus the one being filled */
+    foreach (i, depth + 1)
+        w->free_blocks.push(new MemTraceAccess[w->block_records]);
+    w->slots.resize(depth);
+    w->slot_counts.resize(depth);
+    w->fill = w->free_blocks.pop();
+    w->filled = 0;
+    w->head = 0;
+    w->queued = 0;
+    w->stopping = false;
+    w->records = 0;
+    w->raw_bytes = 0;
+    w->written_bytes = 0;
+    w->stalls = 0;
+
+    w->os.write(MEMTRACE_PACKED_MAGIC, 8);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+
+    if (pthread_create(&w->thread, NULL, capture_writer_thread, w)) {
+        ptl_logfile << "Unable to start memory trace writer thread, ",
+                    "capture disabled", endl;
+        pthread_cond_destroy(&w->not_full);
+        pthread_cond_destroy(&w->not_empty);
+        pthread_mutex_destroy(&w->lock);
+        delete[] w->fill;
+        foreach (i, w->free_blocks.length) delete[] w->free_blocks[i];
+        delete w;
+        return false;
+    }
+
+    capture_writer = w;
+    memtrace_capturing = true;
+    return true;
+}
+
+void memtrace_capture(MemoryRequest *request)
+{
+    CaptureWriter *w = capture_writer;
+
+    MemTraceAccess &a = w->fill[w->filled];
+    a.cycle = sim_cycle;
+    a.physaddr = request->get_physical_address();
+    a.rip = request->get_owner_rip();
+    a.coreid = request->get_coreid();
+    a.threadid = request->get_threadid();
+    a.type = (request->get_type() == MEMORY_OP_WRITE) ? MEMTRACE_WRITE :
+        (request->is_instruction() ? MEMTRACE_IFETCH : MEMTRACE_READ);
+    w->records++;
+
+    if unlikely (++w->filled == w->block_records)
+        queue_capture_block(w);
+}
+
+void memtrace_capture_close()
+{
+    CaptureWriter *w = capture_writer;
+    if (!w) return;
+
+    memtrace_capturing = false;
+    queue_capture_block(w);
+
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+    capture_writer = NULL;
+    w->os.close();
+
+    ptl_logfile << "Memory trace capture: ", w->records, " accesses, ",
+                w->written_bytes, " bytes written (",
+                floatstring(w->written_bytes ?
+                        double(w->raw_bytes) / w->written_bytes : 0, 0, 1),
+                "x smaller than unpacked), ", w->stalls,
+                " stalls on a full queue", endl;
+
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_mutex_destroy(&w->lock);
+
+    delete[] w->fill;
+    foreach (i, w->free_blocks.length) delete[] w->free_blocks[i];
+    delete w;
+}
@@ -0,0 +1,430 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+#include <zlib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct BaseMachine;
+struct PTLsimConfig;
+
+namespace Memory {
+    class MemoryRequest;
+};
+
+/*
+ * Memory trace files read by '-memtrace', either plain:
+ *
+ *   "PTLMTRC1"
+ *   MemTraceRecord[]    (until end of file)
+ *
+ * or packed, as written by '-memtrace-capture':
+ *
+ *   "PTLMTRZ1", then blocks until end of file
+ *   block:  W64 first cycle, W32 records, W32 raw size,
+ *           W32 compressed size, zlib-compressed payload
+ *
+ * Packed payloads hold per record the varint cycle difference to the
+ * previous record, the core, thread and type bytes, and the zigzag varint
+ * differences of physaddr and rip to the previous record of the same
+ * core. Each block starts from zero previous values, so blocks decode
+ * independently. All fixed-size fields are little-endian.
+ *
+ * Records of all cores are interleaved in the order they were captured.
+ * 'gap' is the number of cycles between the previous access of the same
+ * core and this one, so replay keeps each core's access rate while the
+ * memory hierarchy decides how long each access takes.
+ * ptlsim/tools/memtrace.py writes and synthesizes these files and
+ * unpacks captured ones.
+ */
+#define MEMTRACE_MAGIC "PTLMTRC1"
+#define MEMTRACE_PACKED_MAGIC "PTLMTRZ1"
+
+enum {
+    MEMTRACE_READ = 0,
+    MEMTRACE_WRITE,
+    MEMTRACE_IFETCH,
+    MEMTRACE_TYPE_COUNT
+};
+
+struct MemTraceRecord {
+    W64 physaddr;
+    W64 rip;        /* Bits 48 and up set for kernel accesses */
+    W32 gap;
+    W8 coreid;
+    W8 threadid;
+    W8 type;
+    W8 pad;
+};
+
+/* One access as captured, before it is packed */
+struct MemTraceAccess {
+    W64 cycle;
+    W64 physaddr;
+    W64 rip;
+    W8 coreid;
+    W8 threadid;
+    W8 type;
+};
+
+static inline void memtrace_put_varint(dynarray<W8> &buf, W64 v)
+{
+    while (v >= 0x80) {
+        buf.push((W8)(v | 0x80));
+        v >>= 7;
+    }
+    buf.push((W8)v);
+}
+
+static inline bool memtrace_get_varint(const W8 *&p, const W8 *end, W64 &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        W8 b = *p++;
+        v |= W64(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline W64 memtrace_zigzag(W64 v, W64 prev)
+{
+    W64s delta = (W64s)(v - prev);
+    return (W64)((delta << 1) ^ (delta >> 63));
+}
+
+static inline W64 memtrace_unzigzag(W64 z, W64 prev)
+{
+    return prev + ((z >> 1) ^ -(z & 1));
+}
+
+/**
+ * @brief Pack accesses into one block payload, see format above
+ */
+static inline void memtrace_encode_block(const MemTraceAccess *acc,
+        int count, dynarray<W8> &payload)
+{
+    W64 prev_addr[256];
+    W64 prev_rip[256];
+    memset(prev_addr, 0, sizeof(prev_addr));
+    memset(prev_rip, 0, sizeof(prev_rip));
+
+    payload.clear();
+    if (!count) return;
+
+    W64 cycle = acc[0].cycle;
+    foreach (i, count) {
+        const MemTraceAccess &a = acc[i];
+        memtrace_put_varint(payload, a.cycle - cycle);
+        payload.push(a.coreid);
+        payload.push(a.threadid);
+        payload.push(a.type);
+        memtrace_put_varint(payload,
+                memtrace_zigzag(a.physaddr, prev_addr[a.coreid]));
+        memtrace_put_varint(payload,
+                memtrace_zigzag(a.rip, prev_rip[a.coreid]));
+        cycle = a.cycle;
+        prev_addr[a.coreid] = a.physaddr;
+        prev_rip[a.coreid] = a.rip;
+    }
+}
+
+/**
+ * @brief Unpack one block payload into replay records
+ *
+ * @param last_cycle Cycle of previous access of each core, updated
+ *
+ * @return false if payload is corrupt
+ */
+static inline bool memtrace_decode_block(const W8 *p, const W8 *end,
+        W64 cycle, int count, W64 *last_cycle, MemTraceRecord *out)
+{
+    W64 prev_addr[256];
+    W64 prev_rip[256];
+    memset(prev_addr, 0, sizeof(prev_addr));
+    memset(prev_rip, 0, sizeof(prev_rip));
+
+    foreach (i, count) {
+        W64 delta, addr, rip;
+        if (!memtrace_get_varint(p, end, delta) || end - p < 3)
+            return false;
+        cycle += delta;
+
+        MemTraceRecord &r = out[i];
+        r.coreid = *p++;
+        r.threadid = *p++;
+        r.type = *p++;
+        r.pad = 0;
+
+        if (!memtrace_get_varint(p, end, addr) ||
+                !memtrace_get_varint(p, end, rip))
+            return false;
+
+        r.physaddr = memtrace_unzigzag(addr, prev_addr[r.coreid]);
+        r.rip = memtrace_unzigzag(rip, prev_rip[r.coreid]);
+        prev_addr[r.coreid] = r.physaddr;
+        prev_rip[r.coreid] = r.rip;
+
+        r.gap = W32(min(cycle - last_cycle[r.coreid], W64(0xffffffff)));
+        last_cycle[r.coreid] = cycle;
+    }
+
+    return (p == end);
+}
+
+/**
+ * @brief mmap'd memory trace with the record numbers of each core
+ *
+ * Plain files are mapped read only and never copied, traces of billions
+ * of accesses are paged in as replay goes through them. Packed files are
+ * unpacked into anonymous memory once.
+ */
+struct MemTraceFile {
+    int fd;
+    void *map;
+    size_t map_size;
+    void *unpacked;
+    size_t unpacked_size;
+    const MemTraceRecord *records;
+    W64 count;
+
+    /* Record numbers of each core, in trace order */
+    dynarray< dynarray<W32> > per_core;
+
+    MemTraceFile() : fd(-1), map(NULL), map_size(0), unpacked(NULL),
+        unpacked_size(0), records(NULL), count(0) { }
+
+    ~MemTraceFile() { close(); }
+
+    /**
+     * @brief Map a trace written for a machine of 'cores' cores
+     *
+     * @return NULL if trace is usable, otherwise why it is not
+     */
+    const char* open(const char *filename, int cores)
+    {
+        close();
+
+        fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return "can not open file";
+
+        struct stat st;
+        if (fstat(fd, &st) < 0) return "can not stat file";
+
+        map_size = st.st_size;
+        if (map_size < 8) return "not a memory trace";
+
+        map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            return "can not mmap file";
+        }
+
+        madvise(map, map_size, MADV_SEQUENTIAL);
+
+        if (memcmp(map, MEMTRACE_PACKED_MAGIC, 8) == 0) {
+            const char *err = unpack();
+            if (err) return err;
+        } else if (memcmp(map, MEMTRACE_MAGIC, 8) == 0) {
+            if ((map_size - 8) % sizeof(MemTraceRecord))
+                return "file size is not a whole number of records";
+            records = (const MemTraceRecord*)((const char*)map + 8);
+            count = (map_size - 8) / sizeof(MemTraceRecord);
+        } else {
+            return "not a memory trace";
+        }
+
+        if (count > 0xffffffffULL)
+            return "more than 2^32 records";
+
+        per_core.resize(cores);
+        foreach (i, cores) per_core[i].clear();
+
+        foreach (i, count) {
+            const MemTraceRecord &r = records[i];
+            if (r.coreid >= cores) return "record of core not in machine";
+            if (r.type >= MEMTRACE_TYPE_COUNT) return "unknown record type";
+            per_core[r.coreid].push(W32(i));
+        }
+
+        return NULL;
+    }
+
+    void close()
+    {
+        if (map) munmap(map, map_size);
+        if (unpacked) munmap(unpacked, unpacked_size);
+        if (fd >= 0) ::close(fd);
+        map = NULL;
+        unpacked = NULL;
+        fd = -1;
+        records = NULL;
+        count = 0;
+    }
+
+    private:
+
+    const char* unpack()
+    {
+        const W8 *start = (const W8*)map + 8;
+        const W8 *end = (const W8*)map + map_size;
+        const int header = 20;
+
+        /* Block headers give the number of records to allocate */
+        W64 total = 0;
+        for (const W8 *p = start; p < end;) {
+            W32 n, packed;
+            if (end - p < header) return "truncated block header";
+            memcpy(&n, p + 8, 4);
+            memcpy(&packed, p + 16, 4);
+            p += header;
+            if (W64(end - p) < packed) return "truncated block";
+            p += packed;
+            total += n;
+        }
+
+        count = total;
+        if (!count) return NULL;
+
+        unpacked_size = count * sizeof(MemTraceRecord);
+        unpacked = mmap(NULL, unpacked_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (unpacked == MAP_FAILED) {
+            unpacked = NULL;
+            return "can not allocate unpacked records";
+        }
+
+        MemTraceRecord *out = (MemTraceRecord*)unpacked;
+        W64 last_cycle[256];
+        dynarray<W8> raw;
+        W64 first;
+        memcpy(&first, start, 8);
+        foreach (i, 256) last_cycle[i] = first;
+
+        for (const W8 *p = start; p < end;) {
+            W64 cycle;
+            W32 n, raw_size, packed;
+            memcpy(&cycle, p, 8);
+            memcpy(&n, p + 8, 4);
+            memcpy(&raw_size, p + 12, 4);
+            memcpy(&packed, p + 16, 4);
+            p += header;
+
+            raw.resize(raw_size);
+            uLongf size = raw_size;
+            if (uncompress((Bytef*)raw.data, &size, (const Bytef*)p,
+                        packed) != Z_OK || size != raw_size)
+                return "corrupt compressed block";
+
+            if (!memtrace_decode_block(raw.data, raw.data + raw_size, cycle,
+                        n, last_cycle, out))
+                return "corrupt block payload";
+
+            out += n;
+            p += packed;
+        }
+
+        records = (const MemTraceRecord*)unpacked;
+        return NULL;
+    }
+};
+
+/*
+ * Throughput and fairness of a '-memtrace-mix' run, from the cycles each
+ * workload took to finish in the mix (shared) and on its own (alone).
+ * Workloads do the same accesses in both, so alone / shared is the ratio
+ * of their shared to alone throughput:
+ *
+ *   weighted speedup   sum of alone / shared
+ *   harmonic speedup   n / sum of shared / alone
+ *   fairness           lowest alone / shared over the highest
+ */
+struct MemTraceMixMetrics {
+    double weighted_speedup;
+    double harmonic_speedup;
+    double fairness;
+};
+
+static inline MemTraceMixMetrics memtrace_mix_metrics(const W64 *shared,
+        const W64 *alone, int n)
+{
+    MemTraceMixMetrics m;
+    double slowdowns = 0, lowest = 0, highest = 0;
+
+    m.weighted_speedup = 0;
+    foreach (i, n) {
+        double speedup = double(alone[i]) / double(max(shared[i], W64(1)));
+        m.weighted_speedup += speedup;
+        slowdowns += double(shared[i]) / double(max(alone[i], W64(1)));
+        lowest = i ? min(lowest, speedup) : speedup;
+        highest = i ? max(highest, speedup) : speedup;
+    }
+
+    m.harmonic_speedup = slowdowns > 0 ? n / slowdowns : 0;
+    m.fairness = highest > 0 ? lowest / highest : 0;
+    return m;
+}
+
+/**
+ * @brief Replay '-memtrace' file into the machine's memory hierarchy
+ *
+ * Each core issues its accesses in trace order, one per cycle at most,
+ * once 'gap' cycles passed since its previous access and while it has
+ * fewer than '-memtrace-outstanding' reads in flight. Cores and QEMU are
+ * not clocked. Data reads try the L1 with access_hit first, as the cores
+ * do, so hits are told apart from misses. Cache statistics are collected
+ * as in a full simulation, replay throughput and latencies are written to
+ * the log and console.
+ *
+ * With '-memtrace-mix' each of the listed single core traces, e.g.
+ * captured from a different checkpoint, runs on its own core, the first
+ * on core 0. Workload i's addresses are moved up by i times
+ * '-memtrace-mix-stride' as the guests had separate memories. The cycles
+ * each workload took are reported, and with '-memtrace-mix-alone' (the
+ * cycles of each trace replayed on its own) the mix's weighted and
+ * harmonic speedups and fairness.
+ *
+ * @return Number of cycles simulated
+ */
+W64 memtrace_replay(BaseMachine& machine, PTLsimConfig& config);
+
+/* Set while '-memtrace-capture' is recording */
+extern bool memtrace_capturing;
+
+/**
+ * @brief Start capturing all accesses sent to the memory hierarchy
+ *
+ * Accesses are collected in blocks of 'block_records'; a background thread
+ * packs, compresses and writes full blocks. Up to 'depth' blocks are
+ * queued for it before the simulation waits.
+ */
+bool memtrace_capture_open(const char *filename, int block_records,
+        int depth);
+
+/**
+ * @brief Record one request, called by MemoryHierarchy::access_cache
+ */
+void memtrace_capture(Memory::MemoryRequest *request);
+
+/**
+ * @brief Write out all captured accesses and stop the writer thread
+ */
+void memtrace_capture_close();
+
+#endif // MEMTRACE_H
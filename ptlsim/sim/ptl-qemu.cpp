@@ -38,15 +38,24 @@ extern "C" {
 #include <sysemu.h>
 #include <qemu-objects.h>
 #include <monitor.h>
+#include <kvm.h>
 }
 
 #include <ptl-qemu.h>
 #include <ptlsim.h>
+#include <eventtrace.h>
 
 #include <cacheConstants.h>
 
 #define __INSIDE_MARSS_QEMU__
 #include <ptlcalls.h>
+#include <coremigration.h>
+#include <basecore.h>
+#include <clockdomain.h>
+#include <iorecord.h>
+#include <qos.h>
+#include <addrspace.h>
+#include <guestpmu.h>
 
 #include <test.h>
 
@@ -56,6 +65,10 @@ extern "C" {
  */
 #define PTLSIM_PTLCALL_MMIO_PAGE_PHYSADDR    0x00000008fffff000ULL
 
+/* Ring of asynchronous PTLCALLs (see PTLCallRing), right below it */
+#define PTLSIM_PTLCALL_RING_PHYSADDR \
+    (PTLSIM_PTLCALL_MMIO_PAGE_PHYSADDR - PTLCALL_RING_SIZE)
+
 using namespace Memory;
 
 uint8_t in_simulation = 0;
@@ -69,6 +82,42 @@ static char *pending_command_str = NULL;
 static int pending_call_type = -1;
 static int pending_call_arg3 = -1;
 
+/* Set for checkpoints queued by queue_resumable_checkpoint() */
+static bool pending_resumable = false;
+
+static PTLCallRing *ptlcall_ring = NULL;
+static W32 ptlcall_ring_trace_id = (W32)-1;
+
+struct PTLCallRingStats : public Statable
+{
+    StatObj<W64> serviced;
+    StatObj<W64> markers;
+    StatObj<W64> logs;
+    StatObj<W64> regions;
+    StatObj<W64> unknown;
+    StatObj<W64> full;
+
+    PTLCallRingStats()
+        : Statable("ptlcall_ring")
+          , serviced("serviced", this)
+          , markers("markers", this)
+          , logs("logs", this)
+          , regions("regions", this)
+          , unknown("unknown", this)
+          , full("full", this)
+    { }
+};
+
+static PTLCallRingStats *ptlcall_ring_stats = NULL;
+
+static struct {
+    W64 serviced;
+    W64 markers;
+    W64 logs;
+    W64 regions;
+    W64 unknown;
+} ptlcall_ring_counts;
+
 static void save_core_dump(char* dump, W64 dump_size,
         char* app_name, W64 app_name_size, W64 signum)
 {
@@ -103,10 +152,18 @@ static void save_core_dump(char* dump, W64 dump_size,
 
     ptl_logfile << "Core dump received from VM is saved in ",
                 filename, " with signal ", signum, endl;
+
+    /* Guest crash may be caused by the simulated machine */
+    const char *flight = flight_recorder_dump("guest core dump");
+    if (flight)
+        ptl_logfile << "Flight recorder dumped to ", flight, endl;
 }
 
 static void ptlcall_mmio_write(CPUX86State* cpu, W64 offset, W64 value,
         int length) {
+    /* Under KVM the registers are in the kernel until we ask for them */
+    cpu_synchronize_state(cpu);
+
     int calltype = (int)(cpu->regs[REG_rax]);
     W64 arg1 = cpu->regs[REG_rdi];
     W64 arg2 = cpu->regs[REG_rsi];
@@ -250,6 +307,93 @@ static void ptlcall_mmio_write(CPUX86State* cpu, W64 offset, W64 value,
                 ptl_logfile << "[VM @" << sim_cycle << "] " << vm_log;
                 break;
             }
+        case PTLCALL_STATS_REGION:
+            {
+                char* name_ptr = (char*)arg1;
+                W64 size = min(arg2, (W64)PTLCALL_STATS_REGION_NAME_MAX);
+                stringbuf name(size+1);
+
+                foreach (i, (int)size) {
+                    name.buf[i] = (char)ldub_kernel((target_ulong)(name_ptr));
+                    name_ptr++;
+                }
+                name.buf[size] = '\0';
+
+                bool ok = (arg3 == PTLCALL_STATS_REGION_BEGIN) ?
+                    stats_region_begin(name.buf) : stats_region_end(name.buf);
+                cpu->regs[REG_rax] = ok ? 0 : (W64)(-1);
+                break;
+            }
+        case PTLCALL_MIGRATE:
+            {
+                bool ok = Core::migration.request(*(Context*)cpu, (int)arg1,
+                        Core::MIGRATION_SOURCE_GUEST);
+                cpu->regs[REG_rax] = ok ? 0 : (W64)(-1);
+                break;
+            }
+        case PTLCALL_SET_FREQ:
+            {
+                BaseMachine* machine = (BaseMachine*)PTLsimMachine::getmachine(
+                        config.core_name.buf);
+                bool ok;
+
+                if (arg2) {
+                    char* name_ptr = (char*)arg2;
+                    W64 size = min(arg3, (W64)PTLCALL_SET_FREQ_NAME_MAX);
+                    stringbuf name(size+1);
+
+                    foreach (i, (int)size) {
+                        name.buf[i] = (char)ldub_kernel((target_ulong)(name_ptr));
+                        name_ptr++;
+                    }
+                    name.buf[size] = '\0';
+
+                    ok = clock_domain_set_freq(name.buf, arg1);
+                } else {
+                    ok = machine && clock_domain_set_core_freq(*machine,
+                            *(Context*)cpu, arg1);
+                }
+                cpu->regs[REG_rax] = ok ? 0 : (W64)(-1);
+                break;
+            }
+        case PTLCALL_QOS:
+            {
+                BaseMachine* machine = (BaseMachine*)PTLsimMachine::getmachine(
+                        config.core_name.buf);
+                int clos = (arg2 < QOS_MAX_CLOS) ? (int)arg2 : -1;
+                bool ok = false;
+
+                switch (arg1) {
+                    case PTLCALL_QOS_SET_CLOS:
+                        if (!machine)
+                            break;
+                        foreach (i, machine->cores.count()) {
+                            Core::BaseCore *core = machine->cores[i];
+                            if (core->active &&
+                                    core->runs_context(*(Context*)cpu)) {
+                                ok = qos.set_clos(core->get_coreid(), clos);
+                                break;
+                            }
+                        }
+                        break;
+                    case PTLCALL_QOS_SET_WAYS:
+                        ok = qos.set_ways(clos, arg3);
+                        break;
+                    case PTLCALL_QOS_SET_BANDWIDTH:
+                        ok = arg3 <= 0x7fffffff &&
+                            qos_set_bandwidth(clos, (int)arg3);
+                        break;
+                }
+                cpu->regs[REG_rax] = ok ? 0 : (W64)(-1);
+                break;
+            }
+        case PTLCALL_STATS_ADDRESS_SPACE:
+            {
+                bool ok = address_space_set_id(((Context*)cpu)->cpu_index,
+                        arg1);
+                cpu->regs[REG_rax] = ok ? 0 : (W64)(-1);
+                break;
+            }
         default :
             cout << "PTLCALL type unknown : ", calltype, endl;
             cpu->regs[REG_rax] = -EINVAL;
@@ -310,6 +454,14 @@ void ptlsim_init() {
     cpu_register_physical_memory(PTLSIM_PTLCALL_MMIO_PAGE_PHYSADDR, 4096,
             ptlcall_mmio_pd);
 
+    /* And the PTLCALL ring, plain RAM that the VM and we both access */
+    ram_addr_t ring_offset = qemu_ram_alloc(NULL, "marss.ptlcall_ring",
+            PTLCALL_RING_SIZE);
+    cpu_register_physical_memory(PTLSIM_PTLCALL_RING_PHYSADDR,
+            PTLCALL_RING_SIZE, ring_offset | IO_MEM_RAM);
+    ptlcall_ring = (PTLCallRing*)qemu_get_ram_ptr(ring_offset);
+    memset(ptlcall_ring, 0, PTLCALL_RING_SIZE);
+
     /* Register ptlsim assert callback functions */
     register_assert_cb(&dump_all_info);
     register_assert_cb(&dump_bbcache_to_logfile);
@@ -384,7 +536,8 @@ int ptl_cpuid(uint32_t index, uint32_t count, uint32_t *eax, uint32_t *ebx,
     if(index == PTLSIM_CPUID_MAGIC) {
 
         *eax = PTLSIM_CPUID_FOUND;
-        *ebx = PTLCALL_METHOD_MMIO;
+        *ebx = PTLCALL_METHOD_MMIO |
+            (ptlcall_ring ? PTLCALL_METHOD_RING : 0);
         *ecx = (W32)(PTLSIM_PTLCALL_MMIO_PAGE_PHYSADDR);
         *edx = (W32)((PTLSIM_PTLCALL_MMIO_PAGE_PHYSADDR >> 32) &
                 0xffff) | 0x0;
@@ -398,6 +551,12 @@ int ptl_cpuid(uint32_t index, uint32_t count, uint32_t *eax, uint32_t *ebx,
      * for the cache info and others
      */
 
+    /* Architectural performance monitoring leaf of -guest-pmu */
+    if (index == 0xA && config.guest_pmu) {
+        GuestPMU::cpuid(*eax, *ebx, *ecx, *edx);
+        return 1;
+    }
+
     PTLsimMachine* machine = PTLsimMachine::getmachine(config.core_name);
     if (machine && machine->handle_cpuid)
         return machine->handle_cpuid(index, count, eax, ebx, ecx, edx);
@@ -405,24 +564,179 @@ int ptl_cpuid(uint32_t index, uint32_t count, uint32_t *eax, uint32_t *ebx,
     return 0;
 }
 
-void create_checkpoint(const char* chk_name)
+void create_checkpoint(const char* chk_name, bool resumable = false)
 {
     if (!config.quiet)
         cout << "MARSSx86::Creating checkpoint ",
              chk_name, endl;
 
+    /* Guest RAM goes into separate files that -loadvm maps lazily */
+    stringbuf ram_prefix;
+    stringbuf page_store;
+    if (config.checkpoint_ram_dir.set()) {
+        ram_prefix << config.checkpoint_ram_dir << "/" << chk_name;
+        ram_file_prefix = ram_prefix.buf;
+
+        /* Nearby simpoints share most pages, they are stored once */
+        if (config.checkpoint_page_store) {
+            page_store << config.checkpoint_ram_dir << "/pages.store";
+            ram_page_store = page_store.buf;
+        }
+    }
+
     QDict *checkpoint_dict = qdict_new();
     qdict_put_obj(checkpoint_dict, "name", QOBJECT(
                 qstring_from_str(chk_name)));
     do_savevm(cur_mon, checkpoint_dict);
 
+    ram_file_prefix = NULL;
+    ram_page_store = NULL;
+
+    /* Simulated caches, TLBs and predictors go next to it */
+    if (config.warm_state_dir.set()) {
+        PTLsimMachine *machine = PTLsimMachine::getcurrent();
+        if (machine) {
+            stringbuf warm_file;
+            warm_file << config.warm_state_dir << "/" << chk_name << ".warm";
+            ((BaseMachine*)machine)->save_warm_state(warm_file.buf,
+                    resumable);
+        } else {
+            ptl_logfile << "No simulated machine, checkpoint ", chk_name,
+                        " has no warm state", endl;
+        }
+    }
+
     if (!config.quiet)
         cout << "MARSSx86::Checkpoint ", chk_name,
              " created\n";
 }
 
+/**
+ * @brief Create a resumable checkpoint once simulation returns to QEMU
+ *
+ * @param chk_name Name of the checkpoint
+ *
+ * Called by the machine with flushed pipelines at the end of its run loop,
+ * so the checkpoint and its warm state are of the same simulated cycle.
+ */
+void queue_resumable_checkpoint(const char* chk_name)
+{
+    if (pending_call_type != -1) {
+        ptl_logfile << "Checkpoint ", chk_name, " skipped, an other PTLcall ",
+                    "is pending", endl;
+        return;
+    }
+
+    pending_command_str = (char*)qemu_malloc(strlen(chk_name) + 1);
+    strcpy(pending_command_str, chk_name);
+    pending_call_type = PTLCALL_CHECKPOINT;
+    pending_call_arg3 = PTLCALL_CHECKPOINT_AND_CONTINUE;
+    pending_resumable = true;
+
+    if (cpu_single_env)
+        cpu_exit(cpu_single_env);
+}
+
+/* Service one entry of the ring, like ptlcall_mmio_write() without results */
+static void service_ring_entry(PTLCallRingEntry &entry, W64 slot)
+{
+    W32 length = min(entry.length, (W32)PTLCALL_RING_DATA_MAX);
+
+    switch (entry.callid) {
+        case PTLCALL_MARKER:
+            {
+                if unlikely (ptlcall_ring_trace_id == (W32)-1)
+                    ptlcall_ring_trace_id = trace_register_component(
+                            "ptlcall_ring");
+                ptltrace(ptlcall_ring_trace_id, TRACE_GUEST_MARKER,
+                        entry.arg1, slot);
+                ptlcall_ring_counts.markers++;
+                break;
+            }
+        case PTLCALL_LOG:
+            {
+                stringbuf vm_log(length + 1);
+                memcpy(vm_log.buf, entry.data, length);
+                vm_log.buf[length] = '\0';
+
+                ptl_logfile << "[VM @" << sim_cycle << "] " << vm_log;
+                ptlcall_ring_counts.logs++;
+                break;
+            }
+        case PTLCALL_STATS_REGION:
+            {
+                W32 size = min(length, (W32)PTLCALL_STATS_REGION_NAME_MAX);
+                stringbuf name(size + 1);
+                memcpy(name.buf, entry.data, size);
+                name.buf[size] = '\0';
+
+                if (entry.arg1 == PTLCALL_STATS_REGION_BEGIN)
+                    stats_region_begin(name.buf);
+                else
+                    stats_region_end(name.buf);
+                ptlcall_ring_counts.regions++;
+                break;
+            }
+        default:
+            ptlcall_ring_counts.unknown++;
+            break;
+    }
+
+    ptlcall_ring_counts.serviced++;
+}
+
+void ptl_service_ptlcall_ring() {
+    PTLCallRing *ring = ptlcall_ring;
+
+    if likely (!ring || ring->tail == ring->reserve)
+        return;
+
+    /* At most one ring worth, even if the VM wrote garbage to 'reserve' */
+    W64 tail = ring->tail;
+    foreach (i, PTLCALL_RING_ENTRIES) {
+        PTLCallRingEntry &entry = ring->entries[tail % PTLCALL_RING_ENTRIES];
+
+        /* Stop at the first slot taken but not written yet */
+        if (tail == ring->reserve || entry.seq != tail + 1)
+            break;
+
+        __sync_synchronize();
+        service_ring_entry(entry, tail);
+        tail++;
+    }
+
+    /* Entries are read before the writers can reuse their slots */
+    __sync_synchronize();
+    ring->tail = tail;
+}
+
+void ptlcall_ring_set_stats()
+{
+    if (!ptlcall_ring || !ptlcall_ring_counts.serviced)
+        return;
+
+    if (!ptlcall_ring_stats)
+        ptlcall_ring_stats = new PTLCallRingStats();
+
+    Stats *stats[] = { user_stats, kernel_stats, global_stats };
+    foreach (s, 3) {
+        PTLCallRingStats &node = *ptlcall_ring_stats;
+        node.set_default_stats(stats[s]);
+
+        node.serviced = ptlcall_ring_counts.serviced;
+        node.markers = ptlcall_ring_counts.markers;
+        node.logs = ptlcall_ring_counts.logs;
+        node.regions = ptlcall_ring_counts.regions;
+        node.unknown = ptlcall_ring_counts.unknown;
+        W64 full = ptlcall_ring->full;
+        node.full = full;
+    }
+}
+
 void ptl_check_ptlcall_queue() {
 
+    ptl_service_ptlcall_ring();
+
     if(pending_call_type != -1) {
 
         switch(pending_call_type) {
@@ -435,9 +749,12 @@ void ptl_check_ptlcall_queue() {
                 }
             case PTLCALL_CHECKPOINT:
                 {
-                    create_checkpoint(pending_command_str);
+                    create_checkpoint(pending_command_str, pending_resumable);
+                    pending_resumable = false;
 
                     switch(pending_call_arg3) {
+                        case PTLCALL_CHECKPOINT_AND_CONTINUE:
+                            break;
                         case PTLCALL_CHECKPOINT_AND_SHUTDOWN:
                             if (!config.quiet) cout << "MARSSx86::Shutdown requested\n";
                             ptl_quit();
@@ -518,6 +835,12 @@ W64 Context::virt_to_pte_phys_addr(W64 rawvirt, byte& level) {
             if(!(pdpe & PG_PRESENT_MASK)) {
                 goto dofault;
             }
+            if(pdpe & PG_PSE_MASK) {
+                // 1 GB Page size - no need to look up lower levels
+                level = 0;
+                ret_addr = -1;
+                goto finish;
+            }
             ptep &= pdpe ^ PG_NX_MASK;
         } else {
 
@@ -603,6 +926,29 @@ finish:
     return ret_addr;
 }
 
+/**
+ * @brief Size of the page that maps virtaddr
+ *
+ * @return log2 of page size, 12 for 4KB pages and unmapped addresses
+ */
+int Context::page_shift(Waddr virtaddr) {
+    byte level = 1;
+
+    virt_to_pte_phys_addr(virtaddr, level);
+
+    /* Walk stops above the PTE level only for large pages */
+    if(level != 0)
+        return 12;
+
+    if(!(cr[4] & CR4_PAE_MASK))
+        return 22;
+
+    level = 2;
+    virt_to_pte_phys_addr(virtaddr, level);
+
+    return (level == 0) ? 30 : 21;
+}
+
 int Context::copy_from_vm(void* target, Waddr source, int bytes, PageFaultErrorCode& pfec, Waddr& faultaddr, bool forexec) {
 
     if (source == 0) {
@@ -803,6 +1149,13 @@ Waddr Context::check_and_translate(Waddr virtaddr, int sizeshift, bool store, bo
         mmio = 0;
 
         host_virtaddr = (Waddr)(virtaddr + tlb_table[mmu_index][index].addend);
+
+        HostTLBEntry& host_entry = host_tlb[mmu_index][index];
+        if likely (host_entry.host_page ==
+                (host_virtaddr & TARGET_PAGE_MASK)) {
+            return host_entry.phys_page | (virtaddr & ~TARGET_PAGE_MASK);
+        }
+
         if (unlikely(get_phys_memory_address(host_virtaddr, paddr) < 0))
         {
             // Since the entry is in the TLB, it should also have a mapping, so this case should never arise
@@ -822,6 +1175,9 @@ Waddr Context::check_and_translate(Waddr virtaddr, int sizeshift, bool store, bo
                 }
             }
         }
+
+        host_entry.host_page = host_virtaddr & TARGET_PAGE_MASK;
+        host_entry.phys_page = paddr & TARGET_PAGE_MASK;
         return paddr;
     }
     mmio = 0;
@@ -948,11 +1304,29 @@ void Context::propagate_x86_exception(byte exception, W32 errorcode , Waddr virt
 W64 Context::loadvirt(Waddr virtaddr, int sizeshift) {
     Waddr addr = virtaddr;
     assert(virtaddr > 0xffff);
-    setup_qemu_switch_all_ctx(*this);
     W64 data = 0;
 
+    /* RAM hits in QEMU's TLB are read directly */
+    byte* host = host_addr(virtaddr, sizeshift, false);
+    if likely (host && !logable(10)) {
+        switch(sizeshift) {
+            case 0: return ldub_raw(host);
+            case 1: return lduw_raw(host);
+            case 2: return (W32)ldl_raw(host);
+            default: return ldq_raw(host);
+        }
+    }
+
+    setup_qemu_switch_all_ctx(*this);
+
     bool mmio = is_mmio_addr(virtaddr, 0);
 
+    if unlikely (mmio && io_replaying && io_replay(cpu_index,
+                IO_RECORD_MMIO_READ, virtaddr, sizeshift, data)) {
+        setup_ptlsim_switch_all_ctx(*this);
+        return data;
+    }
+
     if likely (!kernel_mode && !mmio) {
         switch(sizeshift) {
             case 0: {
@@ -995,6 +1369,9 @@ W64 Context::loadvirt(Waddr virtaddr, int sizeshift) {
         }
     }
 
+    if unlikely (mmio && io_recording)
+        io_record(cpu_index, IO_RECORD_MMIO_READ, virtaddr, sizeshift, data);
+
     if(logable(10) && mmio)
         ptl_logfile << "MMIO READ addr: ", hexstring(virtaddr, 64),
                     " data: ", hexstring(data, 64), " size: ",
@@ -1009,6 +1386,122 @@ W64 Context::loadvirt(Waddr virtaddr, int sizeshift) {
     return data;
 }
 
+/*
+ * Guest physical RAM pages and their host pages, learned from QEMU's TLB
+ * fills in ptl_add_phys_memory_mapping.  Pages are kept in chunks of
+ * GUEST_PAGE_CHUNK that are allocated when first touched, so a read of
+ * guest RAM by loadphys is one table walk and a host memory access without
+ * switching Contexts to QEMU.  MMIO pages are never added, writes to ROM
+ * and to pages QEMU tracks (translated code, VGA) go through QEMU.
+ */
+struct GuestRamPage {
+    byte *host;     // NULL if not RAM or not seen yet
+    W64 ram_addr;   // QEMU's RAM offset, for its dirty bitmap
+    bool rom;
+};
+
+#define GUEST_PAGE_CHUNK_BITS 10
+#define GUEST_PAGE_CHUNK (1 << GUEST_PAGE_CHUNK_BITS)
+
+static dynarray<GuestRamPage*> guest_ram_pages;
+
+static void set_guest_ram_page(Waddr paddr, W64 phys_desc, Waddr host_vaddr)
+{
+    W64 page = paddr >> TARGET_PAGE_BITS;
+    int chunk = page >> GUEST_PAGE_CHUNK_BITS;
+
+    if unlikely (chunk >= guest_ram_pages.length)
+        guest_ram_pages.resize(chunk + 1, NULL);
+
+    if unlikely (!guest_ram_pages[chunk]) {
+        guest_ram_pages[chunk] = new GuestRamPage[GUEST_PAGE_CHUNK];
+        memset(guest_ram_pages[chunk], 0,
+                sizeof(GuestRamPage) * GUEST_PAGE_CHUNK);
+    }
+
+    GuestRamPage& entry = guest_ram_pages[chunk][page &
+        (GUEST_PAGE_CHUNK - 1)];
+    int io_index = phys_desc & ~TARGET_PAGE_MASK;
+
+    if (io_index == IO_MEM_RAM || io_index == IO_MEM_ROM) {
+        entry.host = (byte*)(host_vaddr & TARGET_PAGE_MASK);
+        entry.ram_addr = phys_desc & TARGET_PAGE_MASK;
+        entry.rom = (io_index == IO_MEM_ROM);
+    } else {
+        entry.host = NULL;
+    }
+}
+
+/*
+ * Host address of an 8 byte aligned access to guest RAM, NULL if it has
+ * to go through QEMU
+ */
+static inline byte* guest_ram_addr(Waddr paddr, bool store)
+{
+    W64 page = paddr >> TARGET_PAGE_BITS;
+    int chunk = page >> GUEST_PAGE_CHUNK_BITS;
+
+    if unlikely (chunk >= guest_ram_pages.length || !guest_ram_pages[chunk])
+        return NULL;
+
+    GuestRamPage& entry = guest_ram_pages[chunk][page &
+        (GUEST_PAGE_CHUNK - 1)];
+
+    if unlikely (!entry.host)
+        return NULL;
+
+    if (store && (entry.rom || !cpu_physical_memory_is_dirty(entry.ram_addr)))
+        return NULL;
+
+    return entry.host + (paddr & ~TARGET_PAGE_MASK);
+}
+
+static bool emulation_dirty_log = false;
+
+/*
+ * QEMU sets MARSS_DIRTY_FLAG again with its other dirty flags on the first
+ * write to a page, the same way migration logs dirty pages.  Writes of
+ * simulation set it too, so the log is cleared each time it stops.
+ */
+void ptl_start_emulation_dirty_log()
+{
+    RAMBlock *block;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        cpu_physical_memory_reset_dirty(block->offset,
+                block->offset + block->length, MARSS_DIRTY_FLAG);
+    }
+
+    emulation_dirty_log = true;
+}
+
+/* Pages of guest_ram_pages, only those can be cached in simulation */
+bool ptl_emulation_dirty_pages(dynarray<W64> &pages)
+{
+    if (!emulation_dirty_log)
+        return false;
+
+    foreach (chunk, guest_ram_pages.length) {
+        GuestRamPage *entries = guest_ram_pages[chunk];
+        if (!entries)
+            continue;
+
+        foreach (i, GUEST_PAGE_CHUNK) {
+            GuestRamPage& entry = entries[i];
+            if (!entry.host || entry.rom)
+                continue;
+
+            if (cpu_physical_memory_get_dirty(entry.ram_addr,
+                        MARSS_DIRTY_FLAG)) {
+                W64 page = (W64(chunk) << GUEST_PAGE_CHUNK_BITS) + i;
+                pages.push(page << TARGET_PAGE_BITS);
+            }
+        }
+    }
+
+    return true;
+}
+
 W64 Context::loadphys(Waddr addr, bool internal, int sizeshift) {
     /*
      * Currently we check sizeshift only for internal data
@@ -1049,8 +1542,13 @@ W64 Context::loadphys(Waddr addr, bool internal, int sizeshift) {
     W64 data = 0;
     Waddr orig_addr = addr;
     addr = floor(addr, 8);
+
+    byte* host = guest_ram_addr(addr, false);
+    if likely (host && !logable(10))
+        return ldq_raw(host);
+
     setup_qemu_switch_all_ctx(*this);
-    data = ldq_raw((uint8_t*)addr);
+    data = (host) ? ldq_raw(host) : ldq_phys(addr);
 
     if(logable(10))
         ptl_logfile << "Context::loadphys addr[", hexstring(addr, 64),
@@ -1061,6 +1559,18 @@ W64 Context::loadphys(Waddr addr, bool internal, int sizeshift) {
 }
 
 W64 Context::storemask_virt(Waddr virtaddr, W64 data, byte bytemask, int sizeshift) {
+    /* RAM hits in QEMU's TLB without translated code are written directly */
+    byte* host = host_addr(virtaddr, sizeshift, true);
+    if likely (host && !logable(10)) {
+        switch(sizeshift) {
+            case 0: stb_raw(host, data); break;
+            case 1: stw_raw(host, data); break;
+            case 2: stl_raw(host, data); break;
+            default: stq_raw(host, data);
+        }
+        return data;
+    }
+
     setup_qemu_switch_all_ctx(*this);
     Waddr paddr = floor(virtaddr, 8);
 
@@ -1201,20 +1711,30 @@ W64 Context::store_internal(Waddr addr, W64 data, byte bytemask) {
 
 W64 Context::storemask(Waddr paddr, W64 data, byte bytemask) {
     W64 old_data = 0;
+
+    paddr = floor(paddr, 8);
+    byte* host = guest_ram_addr(paddr, true);
+    if likely (host && !logable(10)) {
+        old_data = ldq_raw(host);
+        stq_raw(host, mux64(expand_8bit_to_64bit_lut[bytemask], old_data,
+                    data));
+        return data;
+    }
+
     setup_qemu_switch_all_ctx(*this);
     if(logable(10))
         ptl_logfile << "Trying to write to addr: ", hexstring(paddr, 64),
                     " with bytemask ", bytemask, " data: ", hexstring(
                             data, 64), endl;
-    old_data = ldq_raw((uint8_t*)paddr);
+    old_data = ldq_phys(paddr);
     W64 merged_data = mux64(expand_8bit_to_64bit_lut[bytemask], old_data, data);
     if(logable(10))
         ptl_logfile << "Context::storemask addr[", hexstring(paddr, 64),
                     "] data[", hexstring(merged_data, 64), "]\n";
-    stq_raw((uint8_t*)paddr, merged_data);
+    stq_phys(paddr, merged_data);
 #ifdef CHECK_STORE
     W64 new_data = 0;
-    new_data = ldq_raw((uint8_t*)paddr);
+    new_data = ldq_phys(paddr);
     ptl_logfile << "Context::storemask store-check: addr[",
                 hexstring(paddr, 64), "] data[", hexstring(new_data,
                         64), "]\n";
@@ -1284,9 +1804,23 @@ bool Context::try_handle_fault(Waddr virtaddr, int store) {
     return true;
 }
 
-extern "C" void ptl_add_phys_memory_mapping(int8_t cpu_index, uint64_t host_vaddr, uint64_t guest_paddr)
+extern "C" void ptl_add_phys_memory_mapping(int8_t cpu_index, uint64_t host_vaddr, uint64_t guest_paddr, uint64_t phys_desc)
 {
   contextof(cpu_index).hvirt_gphys_map[(Waddr)host_vaddr] = (Waddr)guest_paddr;
+  set_guest_ram_page((Waddr)guest_paddr, phys_desc, (Waddr)host_vaddr);
+}
+
+extern "C" void ptl_phys_memory_changed(void)
+{
+  foreach (i, guest_ram_pages.length) {
+    delete[] guest_ram_pages[i];
+  }
+  guest_ram_pages.clear();
+}
+
+extern "C" void ptl_notify_event(void)
+{
+  context_events++;
 }
 
 void ptl_quit()
@@ -1300,6 +1834,32 @@ uint64_t get_sim_cpu_freq() {
     return config.core_freq_hz;
 }
 
+/*
+ * Guest clocks with -time-dilation: sim_cycle scaled down by the factor,
+ * rebased whenever the factor changes so they never jump back
+ */
+static double guest_dilation = 1.0;
+static W64 guest_base_sim_cycle = 0;
+static W64 guest_base_cycle = 0;
+
+static inline W64 guest_cycle_since_base()
+{
+    return guest_base_cycle +
+        W64(double(sim_cycle - guest_base_sim_cycle) / guest_dilation);
+}
+
+uint64_t get_sim_guest_cycle() {
+    double factor = max(config.time_dilation, 1.0);
+
+    if unlikely (factor != guest_dilation) {
+        guest_base_cycle = guest_cycle_since_base();
+        guest_base_sim_cycle = sim_cycle;
+        guest_dilation = factor;
+    }
+
+    return guest_cycle_since_base();
+}
+
 /* Simpoint Support */
 
 struct Simpoint
@@ -1655,6 +2215,10 @@ void ptl_qemu_initialized(void)
         run_tests();
     }
 
+    if(config.run_benchmarks.set()) {
+        run_benchmarks(config.run_benchmarks);
+    }
+
     if (simpoint_enabled) {
         set_next_simpoint(&contextof(0));
     }
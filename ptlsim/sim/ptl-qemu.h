@@ -170,6 +170,37 @@ void update_progress(void);
 int ptl_cpuid(uint32_t index, uint32_t count, uint32_t *eax, uint32_t *ebx,
 		uint32_t *ecx, uint32_t *edx);
 
+/*
+ * ptl_pmu_rdmsr, ptl_pmu_wrmsr
+ * cpu_index	: CPU whose MSR is accessed
+ * msr			: MSR number from ECX
+ * value		: value read or to write
+ * return int	: 1 if the MSR is one of the guest PMU's and PTLsim has read
+ *                 or written it, 0 to let QEMU handle it (see guestpmu.h)
+ */
+int ptl_pmu_rdmsr(int cpu_index, uint32_t msr, uint64_t *value);
+int ptl_pmu_wrmsr(int cpu_index, uint32_t msr, uint64_t value);
+
+/*
+ * ptl_pmu_rdpmc
+ * cpu_index	: CPU executing rdpmc
+ * index		: counter from ECX, bit 30 set for the fixed counters
+ * value		: counter value read
+ * return int	: 1 if read, 0 if there is no such counter (#GP) and -1
+ *                 without a guest PMU (#UD)
+ */
+int ptl_pmu_rdpmc(int cpu_index, uint32_t index, uint64_t *value);
+
+/*
+ * PTLSIM_CPUID_MAGIC
+ * working	: cpuid leaf the guest's ptlcalls probe, same as in ptlcalls.h.
+ *             KVM only answers leaves it was given, so its cpuid table
+ *             needs this one
+ */
+#ifndef PTLSIM_CPUID_MAGIC
+#define PTLSIM_CPUID_MAGIC  0x404d5459
+#endif
+
 /*
  * ptl_flush_bbcache
  * context_id	: ID of the context of which the BasicBlockCache will be
@@ -187,7 +218,25 @@ void ptl_check_ptlcall_queue(void);
 
 extern uint8_t ptl_stable_state;
 
-void ptl_add_phys_memory_mapping(int8_t cpu_index, uint64_t host_vaddr, uint64_t guest_paddr);
+void ptl_add_phys_memory_mapping(int8_t cpu_index, uint64_t host_vaddr,
+        uint64_t guest_paddr, uint64_t phys_desc);
+
+/*
+ * ptl_phys_memory_changed
+ * returns void
+ * working		: Forget guest RAM pages learned from TLB fills, called when
+ *				  QEMU registers a new guest physical memory layout
+ */
+void ptl_phys_memory_changed(void);
+
+/*
+ * ptl_notify_event
+ * returns void
+ * working		: Called by QEMU when it raises or clears an interrupt or
+ *				  exit request of a CPU, cores check their threads' events
+ *				  in their next cycle instead of polling every cycle
+ */
+void ptl_notify_event(void);
 
 /*
  * qemu_take_screenshot
@@ -206,6 +255,31 @@ typedef void (*QemuIOCB)(void*);
 
 void add_qemu_io_event(QemuIOCB fn, void* arg, int delay);
 
+/**
+ * @brief Issue a guest disk request to the storage model ('-storage-model')
+ *
+ * @return Cycle the request is done, 0 if it isn't modeled
+ */
+uint64_t storage_io_submit(int is_write, uint64_t bytes);
+
+/**
+ * @brief Cycles to hold back the completion of a request QEMU finished
+ *
+ * @param done_cycle What storage_io_submit returned for the request
+ * @return 0 to complete it now
+ */
+int storage_io_complete(uint64_t done_cycle);
+
+/**
+ * @brief Device DMA to guest RAM, sent through the IO agents of the
+ * machine's memory hierarchy if it has any (see cache/ioAgent.h)
+ *
+ * @param addr Guest physical address
+ * @param len Bytes read or written
+ * @param is_write 1 if the device writes RAM
+ */
+void ptl_dma_access(uint64_t addr, uint64_t len, int is_write);
+
 /*
  * ptl_start_sim_rip
  * RIP location from where to switch to simulation
@@ -216,6 +290,13 @@ extern uint64_t qemu_ram_size;
 
 uint64_t get_sim_cpu_freq(void);
 
+/**
+ * @brief Cycles of the guest clocks (TSC, virtual clock) in simulation
+ *
+ * sim_cycle, or sim_cycle divided by -time-dilation when it is set
+ */
+uint64_t get_sim_guest_cycle(void);
+
 /**
  * @brief Update simulation clock offset if set
  */
@@ -262,6 +343,33 @@ void set_cpu_fast_fwd(void);
  */
 void ptl_qemu_initialized(void);
 
+/*
+ * ptl_cluster_attach
+ * deliver      : called with each frame the guest NIC receives
+ * watch        : called with each connection to the other nodes, poll it
+ *                with ptl_cluster_poll while not simulating
+ * working      : Connect the '-net marss' client to the cluster node, see
+ *                ptlsim/sim/cluster.h
+ */
+typedef void (*ClusterDeliverCB)(void *opaque, const uint8_t *buf, int size);
+typedef void (*ClusterWatchCB)(void *opaque, int fd);
+void ptl_cluster_attach(ClusterDeliverCB deliver, ClusterWatchCB watch,
+        void *opaque);
+
+/*
+ * ptl_cluster_send
+ * working      : Send a frame of the guest NIC to the other nodes, dropped
+ *                if the cluster is not configured
+ */
+void ptl_cluster_send(const uint8_t *buf, int size);
+
+/*
+ * ptl_cluster_poll
+ * working      : Read the connections to the other nodes, and deliver the
+ *                received frames when not simulating
+ */
+void ptl_cluster_poll(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,57 @@
+/*
+ * ptl-sync.h
+ *
+ * Layout of the shared memory barrier used by the -sync option.
+ *
+ * Every simulation instance started with the same MARSS_SEM_ID maps the
+ * segment /marss-sync-<id>, takes a slot and waits on the barrier every
+ * 'sync' cycles.  The last instance to arrive bumps 'generation' and
+ * wakes the others with a futex on it.  Waiters that sleep too long check
+ * the slot pids and drop instances that died without leaving.
+ *
+ * This header is shared with tools/sync_helper.cpp, so keep it free of
+ * any PTLsim headers.
+ */
+
+#ifndef PTL_SYNC_H
+#define PTL_SYNC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define MARSS_SYNC_DEFAULT_ID    3764
+#define MARSS_SYNC_MAX_INSTANCES 64
+
+/* "MRSSYNC1": bump the digit when the layout below changes */
+#define MARSS_SYNC_MAGIC         0x31434e595353524dULL
+
+struct MarssSyncSlot {
+    volatile int32_t  pid;          /* 0 if the slot is free */
+    volatile uint32_t arrived;      /* waiting in the current generation */
+    volatile uint64_t barriers;     /* barriers passed by this instance */
+    volatile uint64_t wait_ns;      /* total time spent waiting */
+    volatile uint64_t cycle;        /* sim_cycle at the last barrier */
+};
+
+struct MarssSyncShared {
+    volatile uint64_t magic;
+    pthread_mutex_t   lock;         /* robust and process shared */
+    volatile int32_t  generation;   /* futex word */
+    volatile uint32_t members;
+    volatile uint32_t arrived;
+    volatile uint32_t shutdown;     /* set when any instance exits */
+    MarssSyncSlot     slots[MARSS_SYNC_MAX_INSTANCES];
+};
+
+/* Name of the shared memory segment, keyed like the old semaphore */
+static inline void marss_sync_name(char *buf, size_t size)
+{
+    const char *env_id = getenv("MARSS_SEM_ID");
+    int id = env_id ? atoi(env_id) : MARSS_SYNC_DEFAULT_ID;
+
+    snprintf(buf, size, "/marss-sync-%d", id);
+}
+
+#endif // PTL_SYNC_H
@@ -0,0 +1,94 @@
+/*
+ * ptl-telemetry.h
+ *
+ * Layout of the telemetry page written by the -telemetry option.
+ *
+ * A running simulation maps the given file (best on a tmpfs like
+ * /dev/shm) and rewrites this page at the rate of its progress line, so a
+ * job manager can watch many simulations by mapping their pages read
+ * only, without any calls into the simulators.  Updates are guarded by a
+ * sequence counter: it is odd while the page is written, so readers copy
+ * the page with marss_telemetry_read() and retry on a change.
+ *
+ * update_ns is the wall clock time of the last update: a page in state
+ * RUNNING that isn't updated for long belongs to a stalled or very slow
+ * simulation.  The page stays after the simulation exits, in state EXITED.
+ *
+ * This header is shared with tools/telemetry_helper.cpp, so keep it free
+ * of any PTLsim headers.
+ */
+
+#ifndef PTL_TELEMETRY_H
+#define PTL_TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define MARSS_TELEMETRY_MAX_CORES 64
+#define MARSS_TELEMETRY_MAX_STATS 32
+#define MARSS_TELEMETRY_NAME_SIZE 64
+
+/* "MRSTLM1\0": bump the digit when the layout below changes */
+#define MARSS_TELEMETRY_MAGIC     0x00314d4c5453524dULL
+
+enum MarssTelemetryState {
+    MARSS_TELEMETRY_STARTING,   /* machine not simulating yet */
+    MARSS_TELEMETRY_RUNNING,
+    MARSS_TELEMETRY_DONE,       /* simulation done, back to emulation */
+    MARSS_TELEMETRY_EXITED,
+};
+
+struct MarssTelemetryStat {
+    char              name[MARSS_TELEMETRY_NAME_SIZE];
+    volatile double   value;        /* user + kernel */
+};
+
+struct MarssTelemetry {
+    volatile uint64_t magic;
+    volatile uint32_t sequence;     /* odd while the page is written */
+    volatile int32_t  pid;
+    volatile uint32_t state;
+    volatile uint32_t num_cores;
+    volatile uint32_t num_stats;
+    volatile uint32_t reserved;
+    char              machine[MARSS_TELEMETRY_NAME_SIZE];
+
+    volatile uint64_t updates;
+    volatile uint64_t start_ns;     /* CLOCK_REALTIME */
+    volatile uint64_t update_ns;
+    volatile uint64_t sim_cycle;
+    volatile uint64_t insns;        /* x86 instructions committed */
+
+    /* Rates since the previous update */
+    volatile double   kips;
+    volatile double   cycles_per_sec;
+    volatile double   core_ipc[MARSS_TELEMETRY_MAX_CORES];
+    volatile uint64_t core_insns[MARSS_TELEMETRY_MAX_CORES];
+
+    MarssTelemetryStat stats[MARSS_TELEMETRY_MAX_STATS];
+};
+
+/*
+ * Copy a consistent page, false if it is not a telemetry page or it is
+ * rewritten all the time
+ */
+static inline bool marss_telemetry_read(const MarssTelemetry *page,
+        MarssTelemetry *copy)
+{
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t sequence = page->sequence;
+        if (sequence & 1)
+            continue;
+
+        __sync_synchronize();
+        memcpy(copy, (const void*)page, sizeof(MarssTelemetry));
+        __sync_synchronize();
+
+        if (page->sequence == sequence)
+            return copy->magic == MARSS_TELEMETRY_MAGIC;
+    }
+
+    return false;
+}
+
+#endif // PTL_TELEMETRY_H
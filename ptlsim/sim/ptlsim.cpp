@@ -17,14 +17,48 @@
 #include <netinet/in.h>
 #include <errno.h>
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ptl-sync.h>
 
-#include <bson/bson.h>
-#include <bson/mongo.h>
 #include <machine.h>
+#include <sampling.h>
+#include <warmupdetect.h>
+#include <eventtrace.h>
+#include <memtrace.h>
+#include <uoptrace.h>
+#include <iorecord.h>
+#include <storage.h>
+#include <statehash.h>
+#include <hostperf.h>
+#include <clockdomain.h>
+#include <requestLatency.h>
+#include <memoryRequest.h>
+#include <controller.h>
+#include <coherenceHotspots.h>
+#include <eventParallelism.h>
+#include <stackDistance.h>
+#include <qos.h>
+#include <statsExporter.h>
 #include <statelist.h>
+#include <topdown.h>
+#include <pcsampler.h>
+#include <pcprofile.h>
+#include <pipetrace.h>
 #include <decode.h>
+#include <warmstate.h>
+#include <hostmem.h>
+#include <cluster.h>
+#include <telemetry.h>
+#include <addrspace.h>
 
 #include <fstream>
 #include <syscalls.h>
@@ -78,12 +112,13 @@ Stats *kernel_stats;
 Stats *global_stats;
 
 ofstream *time_stats_file;
+StatsExporter *stats_exporter = NULL;
 
 #endif
 
 static void sync_remove();
 static void kill_simulation();
-static void write_mongo_stats();
+static void open_stats_exporter();
 static void setup_sim_stats();
 
 /* Stats structure for Simulation Statistics */
@@ -129,14 +164,143 @@ struct SimStats : public Statable
     {
         StatObj<W64> cycles_per_sec;
         StatObj<W64> commits_per_sec;
+        StatObj<double> kips;
+        StatObj<double> host_cycles_per_cycle;
 
         performance(Statable *parent)
             : Statable("performance", parent)
               , cycles_per_sec("cycles_per_sec", this)
               , commits_per_sec("commits_per_sec", this)
+              , kips("kips", this)
+              , host_cycles_per_cycle("host_cycles_per_cycle", this)
         { }
     } performance;
 
+    /*
+     * Host rdtsc ticks of each part of the run loop, with -host-profile.
+     * Host time isn't split by guest mode, the kernel copy stays 0 so the
+     * periodic user + kernel row is the ticks of the period.
+     */
+    struct host_profile : public Statable
+    {
+        StatArray<W64, HOST_PROFILE_COUNT> ticks;
+
+        host_profile(Statable *parent)
+            : Statable("host_profile", parent)
+              , ticks("ticks", this, host_profile_names)
+        {
+            disable_dump();
+        }
+    } host_profile;
+
+    struct sampling : public Statable
+    {
+        StatObj<W64> windows;
+        StatObj<W64> measured_insns;
+        StatObj<W64> measured_cycles;
+        StatObj<W64> functional_insns;
+        StatObj<double> ipc;
+        StatObj<double> ipc_half_width;
+        StatObj<double> ipc_error;
+
+        sampling(Statable *parent)
+            : Statable("sampling", parent)
+              , windows("windows", this)
+              , measured_insns("measured_insns", this)
+              , measured_cycles("measured_cycles", this)
+              , functional_insns("functional_insns", this)
+              , ipc("ipc", this)
+              , ipc_half_width("ipc_half_width", this)
+              , ipc_error("ipc_error", this)
+        {
+            /* Only dumped in sampled simulation */
+            disable_dump();
+        }
+    } sampling;
+
+    /* Detailed warmup before the stats were reset, with -warmup-detect */
+    struct warmup : public Statable
+    {
+        StatObj<W64> insns;
+        StatObj<W64> cycles;
+        StatObj<W64> windows;
+        StatObj<W64> converged;
+
+        warmup(Statable *parent)
+            : Statable("warmup", parent)
+              , insns("insns", this)
+              , cycles("cycles", this)
+              , windows("windows", this)
+              , converged("converged", this)
+        {
+            disable_dump();
+        }
+    } warmup;
+
+    /* Filled only in the documents of stats regions */
+    struct region : public Statable
+    {
+        StatString name;
+        StatObj<W64> entries;
+        StatObj<W64> cycles;
+        StatObj<W64> insns;
+        StatObj<double> ipc;
+
+        region(Statable *parent)
+            : Statable("region", parent)
+              , name("name", this)
+              , entries("entries", this)
+              , cycles("cycles", this)
+              , insns("insns", this)
+              , ipc("ipc", this)
+        {
+            disable_dump();
+        }
+    } region;
+
+    /* Filled only in the documents of address spaces */
+    struct address_space : public Statable
+    {
+        StatString name;
+        StatObj<W64> switches;
+        StatObj<W64> cycles;
+        StatObj<W64> insns;
+        StatObj<double> ipc;
+
+        address_space(Statable *parent)
+            : Statable("address_space", parent)
+              , name("name", this)
+              , switches("switches", this)
+              , cycles("cycles", this)
+              , insns("insns", this)
+              , ipc("ipc", this)
+        {
+            disable_dump();
+        }
+    } address_space;
+
+    /*
+     * Guest time against simulated time with -time-dilation, the guest
+     * saw guest_ns of the sim_ns it ran
+     */
+    struct time_dilation : public Statable
+    {
+        StatObj<double> factor;
+        StatObj<W64> sim_ns;
+        StatObj<W64> guest_ns;
+        StatObj<W64> lost_ns;
+
+        time_dilation(Statable *parent)
+            : Statable("time_dilation", parent)
+              , factor("factor", this)
+              , sim_ns("sim_ns", this)
+              , guest_ns("guest_ns", this)
+              , lost_ns("lost_ns", this)
+        {
+            disable_dump();
+        }
+    } time_dilation;
+
     StatString tags;
 
     SimStats()
@@ -144,6 +308,12 @@ struct SimStats : public Statable
           , version(this)
           , run(this)
           , performance(this)
+          , host_profile(this)
+          , sampling(this)
+          , warmup(this)
+          , region(this)
+          , address_space(this)
+          , time_dilation(this)
           , tags("tags", this)
     {
         tags.set_split(",");
@@ -169,6 +339,14 @@ void ConfigurationParser<PTLsimConfig>::reset() {
   log_on_console = 0;
   log_buffer_size = 524288;
   log_file_size = 1<<26;
+  trace_filename = "";
+  trace_buffer_size = 65536;
+  flight_recorder_size = 0;
+  flight_recorder_file = "ptlsim.flight";
+  pipe_trace = 0;
+  pipe_trace_start = 0;
+  pipe_trace_rip = INVALIDRIP;
+  pipe_trace_cycles = 0;
   screenshot_file = "";
   log_user_only = 0;
   dump_config_filename = "";
@@ -178,16 +356,44 @@ void ConfigurationParser<PTLsimConfig>::reset() {
   verify_cache = 0;
   stats_filename.reset();
   yaml_stats_filename="";
+  topdown_report.reset();
+  pc_sample_period = 0;
+  pc_sample_file.reset();
+  pc_sample_depth = 16;
+  state_hash_file.reset();
+  state_hash_period = 100000;
   stats_format = "yaml";
   snapshot_cycles = infinity;
   snapshot_now.reset();
   time_stats_logfile = "";
   time_stats_period = 10000;
+  time_stats_queue = 0;
+  time_stats_format = "csv";
+  bandwidth_timeline = 0;
 
   start_at_rip = INVALIDRIP;
   fast_fwd_insns = 0;
   fast_fwd_user_insns = 0;
   fast_fwd_checkpoint = "";
+  warmup_insns = 0;
+  fork_configs = "";
+  fork_server = "";
+  fork_server_jobs = 4;
+  memtrace_file = "";
+  memtrace_outstanding = 8;
+  memtrace_mix = "";
+  memtrace_mix_alone = "";
+  memtrace_mix_stride = 1ULL << 36;
+  memtrace_capture_file = "";
+  memtrace_capture_block = 65536;
+  memtrace_capture_queue = 8;
+  uoptrace_file = "";
+  uoptrace_window = 128;
+  uoptrace_width = 4;
+  uoptrace_redirect = 10;
+  uoptrace_predictor = "combined";
+  uoptrace_capture_file = "";
+  uoptrace_capture_block = 65536;
 
   // memory model
   use_memory_model = 0;
@@ -205,7 +411,19 @@ void ConfigurationParser<PTLsimConfig>::reset() {
   event_trace_record_stop = 0;
   event_trace_replay_filename.reset();
 
+  storage_model = 0;
+  storage_read_ns = 80000;
+  storage_write_ns = 20000;
+  storage_mbps = 2000;
+  storage_channels = 8;
+  storage_queue_depth = 32;
+  storage_tail_rate = 0.01;
+  storage_tail_factor = 10;
+
   core_freq_hz = 0;
+  time_dilation = 1.0;
+  guest_pmu = 0;
+  guest_pmu_period = 1000;
   // default timer frequency is 100 hz in time-xen.c:
 
   perfect_cache = 0;
@@ -213,42 +431,113 @@ void ConfigurationParser<PTLsimConfig>::reset() {
   dumpcode_filename = "test.dat";
   dump_at_end = 0;
   bbcache_dump_filename.reset();
+  bbcache_persist_filename.reset();
+  shared_bbcache = 0;
 
   machine_config = "";
+  machine_options = "";
+  skip_idle_cycles = 0;
+  spin_fast_forward = 0;
+  spin_max_cycles = 100000;
 
   ///
   /// memory hierarchy implementation
   ///
+  mem_priority = 0;
+  mem_fast_fill = 0;
+  mem_fast_fill_check = 0;
+  far_atomics = 0;
+  far_atomic_latency = 20;
+  far_atomic_occupancy = 4;
+  mem_surrogate = 0;
+  mem_surrogate_window = 100000;
+  mem_surrogate_period = 900000;
+  mem_surrogate_error = 0.1;
 
   checker_enabled = 0;
   checker_start_rip = INVALIDRIP;
+  checker_batch = 32;
 
   // MongoDB configuration
   enable_mongo = 0;
   mongo_server = "127.0.0.1";
   mongo_port = 27017;
+
+  stats_export = "";
+  stats_export_server = "127.0.0.1";
+  stats_export_port = 8094;
+  stats_export_period = 0;
+  stats_export_batch = 16;
+  stats_export_queue = 8;
+  telemetry = "";
+  telemetry_stats = "";
+  stats_address_spaces = 0;
   bench_name = "";
   tags = "";
 
   // Test Framework
   run_tests = 0;
+  run_benchmarks = "";
+  host_profile = 0;
+  host_perf = 0;
+  mem_latency = 0;
+  pc_profile = 0;
+  coherence_hotspots = 0;
+  mem_parallelism = 0;
 
   // Utilities/Tools
   execute_after_kill = "";
 
   // Sync Options
   sync_interval = 0;
+  cluster_hosts = "";
+  cluster_node = 0;
+  cluster_latency = 1000;
+  cluster_bandwidth = 10000;
 
   // Simpoint options
   simpoint_file = "";
   simpoint_interval = 10e6;
   simpoint_chk_name = "simpoint";
+  checkpoint_ram_dir = "";
+  checkpoint_page_store = 0;
+  host_huge_pages = 0;
+  warm_state_dir = "";
+  warm_state_filename = "";
+  warm_toggle = 0;
+  periodic_checkpoint_cycles = 0;
+  periodic_checkpoint_name = "periodic";
+
+  // Sampling options
+  sample_interval = 0;
+  sample_detailed_warmup = 2000;
+  sample_window = 1000;
+  sample_min_windows = 30;
+  sample_error = 0.03;
+  sample_zscore = 3.0;
+
+  warmup_detect = 0;
+  warmup_detect_window = 500000;
+  warmup_detect_windows = 5;
+  warmup_detect_error = 0.05;
+  warmup_detect_max = 0;
+  warmup_detect_measure = 0;
+
+  migration_policy = "none";
+  migration_interval = 100000;
+  migration_penalty = 1000;
+  migration_ipc_low = 0.5;
+  migration_ipc_high = 0.8;
+
+  clock_domains = "";
 #ifdef DRAMSIM
   // DRAMSim2 options
   dramsim_device_ini_file = "ini/DDR3_micron_8M_8B_x16_sg15.ini";
   dramsim_system_ini_file = "system.ini";
   dramsim_pwd = "../DRAMSim2";
   dramsim_results_dir_name = "MARSS";
+  dramsim_skip_idle = 0;
+  dramsim_lookahead = 0;
 #endif
 
 }
@@ -274,6 +563,14 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(log_on_console,               "consolelog",           "Replicate log file messages to console");
   add(log_buffer_size,              "logbufsize",           "Size of PTLsim ptl_logfile buffer (not related to -ringbuf)");
   add(log_file_size,                "logfilesize",           "Size of PTLsim ptl_logfile");
+  add(trace_filename,               "tracefile",            "Write binary event trace to this file (render with ptlsim/tools/ptltrace.py)");
+  add(trace_buffer_size,            "trace-buffer",         "Records buffered per host thread for -tracefile, more are dropped");
+  add(flight_recorder_size,         "flight-recorder",      "Keep last <N> trace records of each host thread in memory, dumped on assert, deadlock recovery or crash (0 to disable)");
+  add(flight_recorder_file,         "flight-recorder-file", "File for flight recorder dumps (render with ptlsim/tools/ptltrace.py)");
+  add(pipe_trace,                   "pipe-trace",           "Add the pipeline stages of every OOO core uop to -tracefile or the flight recorder (convert with ptlsim/tools/pipetrace.py)");
+  add(pipe_trace_start,             "pipe-trace-start",     "Start -pipe-trace at this cycle");
+  add(pipe_trace_rip,               "pipe-trace-rip",       "Start -pipe-trace when this rip is first fetched after -pipe-trace-start");
+  add(pipe_trace_cycles,            "pipe-trace-cycles",    "Stop -pipe-trace this many cycles after it starts (0 to trace until the end)");
   add(dump_state_now,               "dump-state-now",       "Dump the event log ring buffer and internal state of the active core");
   add(screenshot_file,              "screenshot",           "Takes screenshot of VM window at the end of simulation");
   add(log_user_only,                "log-user-only",        "Only log the user mode activities");
@@ -282,16 +579,44 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   section("Statistics Database");
   add(stats_filename,               "stats",                "Statistics data store hierarchy root");
   add(yaml_stats_filename,          "yamlstats",                "Statistics data stores in YAML format");
-  add(stats_format,					"stats-format",          "Statistics output format, default is YAML");
+  add(topdown_report,               "topdown-report",       "Write the instructions losing most commit slots, by top-down category, to this file at the end (ooo core)");
+  add(pc_sample_file,               "pc-sample-file",       "Write guest call stacks sampled every -pc-sample-period cycles to this file at the end, folded for flame graphs");
+  add(pc_sample_period,             "pc-sample-period",     "Cycles between guest call stack samples (0 to disable)");
+  add(pc_sample_depth,              "pc-sample-depth",      "Frames of each guest call stack sample, walked by frame pointer (max 64)");
+  add(state_hash_file,              "state-hash-file",      "Write hashes of commits, memory hierarchy messages and counters every -state-hash-period cycles to this file (compare runs with ptlsim/tools/statehash.py)");
+  add(state_hash_period,            "state-hash-period",    "Cycles of each -state-hash-file epoch");
+  add(stats_format,					"stats-format",          "Statistics output format: yaml (default), json or text");
   add(snapshot_cycles,              "snapshot-cycles",      "Take statistical snapshot and reset every <snapshot> cycles");
   add(snapshot_now,                 "snapshot-now",         "Take statistical snapshot immediately, using specified name");
   add(time_stats_logfile,           "time-stats-logfile",   "File to write time-series statistics (new)");
   add(time_stats_period,            "time-stats-period",    "Frequency of capturing time-stats (in cycles)");
+  add(time_stats_queue,             "time-stats-queue",     "Write time-stats on a background thread, queueing up to this many snapshots (0 to write inline)");
+  add(time_stats_format,            "time-stats-format",    "Format of time-stats: csv or binary (delta-encoded, read with ptlsim/tools/timestats.py)");
+  add(bandwidth_timeline,           "bandwidth-timeline",   "Add the busy cycles of each interconnect link and memory bank to time-stats, per -time-stats-period");
   section("Trace Start/Stop Point");
   add(start_at_rip,                 "startrip",             "Start at rip <startrip>");
   add(fast_fwd_insns,               "fast-fwd-insns",       "Fast Fwd each CPU by <N> instructions");
   add(fast_fwd_user_insns,          "fast-fwd-user-insns",  "Fast Fwd each CPU by <N> user level instructions");
   add(fast_fwd_checkpoint,          "fast-fwd-checkpoint",  "Create a checkpoint <chk-name> after fast-forwarding");
+  add(warmup_insns,                 "warmup-insns",         "Functionally warm caches, TLBs and branch predictors of each CPU for <N> instructions before simulation");
+  add(fork_configs,                 "fork-configs",         "After warmup fork one simulation per line of given file, each line gives the simconfig options of that simulation");
+  add(fork_server,                  "fork-server",          "After warmup serve jobs on this Unix socket, forking one simulation per line of simconfig options received (client: ptlsim/tools/simjob.py)");
+  add(fork_server_jobs,             "fork-server-jobs",     "Jobs of -fork-server running at once at most");
+  add(memtrace_file,                "memtrace",             "Replay memory access trace file into the memory hierarchy instead of running the cores (write with ptlsim/tools/memtrace.py)");
+  add(memtrace_outstanding,         "memtrace-outstanding", "Reads each core has in flight at most during -memtrace replay");
+  add(memtrace_mix,                 "memtrace-mix",         "Replay these comma separated single core traces together, one per core, to study workload mixes");
+  add(memtrace_mix_alone,           "memtrace-mix-alone",   "Cycles of each -memtrace-mix trace replayed alone, comma separated, for weighted speedup and fairness");
+  add(memtrace_mix_stride,          "memtrace-mix-stride",  "Physical address distance between the memories of -memtrace-mix workloads");
+  add(memtrace_capture_file,        "memtrace-capture",     "Write every access sent to the memory hierarchy to this file, for replay with -memtrace");
+  add(memtrace_capture_block,       "memtrace-capture-block", "Accesses per compressed block of -memtrace-capture");
+  add(memtrace_capture_queue,       "memtrace-capture-queue", "Blocks of -memtrace-capture queued for the writer thread before simulation waits");
+  add(uoptrace_file,                "uoptrace",             "Replay committed uop trace file on a trace driven out-of-order model instead of running the cores");
+  add(uoptrace_window,              "uoptrace-window",      "Uops each core has in flight at most during -uoptrace replay");
+  add(uoptrace_width,               "uoptrace-width",       "Uops each core fetches, issues and commits a cycle during -uoptrace replay");
+  add(uoptrace_redirect,            "uoptrace-redirect",    "Cycles from a mispredicted branch executing to fetch going on during -uoptrace replay");
+  add(uoptrace_predictor,           "uoptrace-predictor",   "Branch predictor of each core during -uoptrace replay (combined or tage)");
+  add(uoptrace_capture_file,        "uoptrace-capture",     "Write every uop the OOO cores commit to this file, for replay with -uoptrace");
+  add(uoptrace_capture_block,       "uoptrace-capture-block", "Uops per compressed block of -uoptrace-capture");
   add(stop_at_insns,                "stopinsns",            "Stop after executing <stopinsns> user instructions");
   add(stop_at_cycle,                "stopcycle",            "Stop after <stop> cycles");
   add(stop_at_iteration,            "stopiter",             "Stop after <stop> iterations (does not apply to cycle-accurate cores)");
@@ -303,16 +628,30 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(flush_interval,               "flushevery",           "Flush the pipeline every N committed instructions");
   add(kill_after_run,               "kill-after-run",       "Kill PTLsim after this run");
   section("Event Trace Recording");
-  add(event_trace_record_filename,  "event-record",         "Save replayable events (interrupts, DMAs, etc) to this file");
-  add(event_trace_record_stop,      "event-record-stop",    "Stop recording events");
-  add(event_trace_replay_filename,  "event-replay",         "Replay events (interrupts, DMAs, etc) to this file, starting at checkpoint");
+  add(event_trace_record_filename,  "event-record",         "Save values read from devices (port IO, MMIO) to this file");
+  add(event_trace_record_stop,      "event-record-stop",    "Stop recording device reads");
+  add(event_trace_replay_filename,  "event-replay",         "Read devices from this '-event-record' file instead of QEMU, starting at the same checkpoint");
+
+  section("Storage Timing");
+  add(storage_model,                "storage-model",        "Complete guest disk IO (IDE, virtio-blk) at the cycle a modeled SSD would, not when the host did");
+  add(storage_read_ns,              "storage-read-ns",      "Storage model: read latency of one flash channel");
+  add(storage_write_ns,             "storage-write-ns",     "Storage model: write latency of one flash channel");
+  add(storage_mbps,                 "storage-mbps",         "Storage model: device link bandwidth in MB/s");
+  add(storage_channels,             "storage-channels",     "Storage model: requests the flash serves in parallel");
+  add(storage_queue_depth,          "storage-queue-depth",  "Storage model: requests in flight, later ones wait for one to finish");
+  add(storage_tail_rate,            "storage-tail-rate",    "Storage model: fraction of requests that take the tail latency");
+  add(storage_tail_factor,          "storage-tail-factor",  "Storage model: tail latency as a multiple of the read or write latency");
 
   section("Timers and Interrupts");
   add(core_freq_hz,                 "corefreq",             "Core clock frequency in Hz (default uses host system frequency)");
+  add(time_dilation,                "time-dilation",        "Guest clocks (TSC and timers) run this many times slower than simulated time, so fewer timer interrupts per cycle (1 or less for none)");
+  add(guest_pmu,                    "guest-pmu",            "Guest performance counters (rdpmc, PERFEVTSEL MSRs) count the simulated cycles, instructions, LLC and branch misses");
+  add(guest_pmu_period,             "guest-pmu-period",     "Cycles between counter updates of the guest PMU while a counter can interrupt on overflow");
 
   section("Validation");
   add(checker_enabled, 		"enable-checker", 		"Enable emulation based checker");
   add(checker_start_rip,          "checker-startrip",     "Start checker at specified RIP");
+  add(checker_batch,              "checker-batch",        "Run checker over up to <N> instructions before comparing, per instruction again after a mismatch (1 to compare each)");
 
   section("Out of Order Core (ooocore)");
   add(perfect_cache,                "perfect-cache",        "Perfect cache performance: all loads and stores hit in L1");
@@ -321,11 +660,17 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(dumpcode_filename,            "dumpcode",             "Save page of user code at final rip to file <dumpcode>");
   add(dump_at_end,                  "dump-at-end",          "Set breakpoint and dump core before first instruction executed on return to native mode");
   add(bbcache_dump_filename,        "bbdump",               "Basic block cache dump filename");
+  add(bbcache_persist_filename,     "bbcache-file",         "Load translated basic blocks from this file at startup and save them back at exit");
+  add(shared_bbcache,               "shared-bbcache",       "Share one basic block cache between all cores, decoding identical code once");
 
  add(verify_cache,               "verify-cache",                   "run simulation with storing actual data in cache");
 
   section("Core Configuration");
   add(machine_config, "machine", "Name of machine configuration to simulate");
+  add(machine_options, "machine-options", "Comma separated <controller>.<option>=<value> overrides of cache and DRAM latency, replacement and prefetch options");
+  add(skip_idle_cycles, "skip-idle-cycles", "Fast-forward over cycles in which all threads are halted or spinning and the memory hierarchy is idle");
+  add(spin_fast_forward, "spin-ff", "Stop fetching in spin loops until the line they read changes, accounting the skipped iterations");
+  add(spin_max_cycles, "spin-max-cycles", "Longest spin loop wait with -spin-ff, in cycles");
 
  ///
  /// following are for the new memory hierarchy implementation:
@@ -333,6 +678,16 @@ void ConfigurationParser<PTLsimConfig>::setup() {
 
   section("Memory Hierarchy Configuration");
   //  add(memory_log,               "memory-log",               "log memory debugging info");
+  add(mem_priority,         "mem-priority",         "Caches, buses and memory controllers serve requests by priority: loads blocking the ROB head, demand loads and fetches, stores, prefetches, then writebacks");
+  add(mem_fast_fill,        "mem-fast-fill",        "Fill read misses of private caches at once when they hit in the idle private cache below, instead of sending them down through events");
+  add(mem_fast_fill_check,  "mem-fast-fill-check",  "With -mem-fast-fill, send the reads down anyway and count in fast_fill stats those not answered at the cycle a fast fill would have used");
+  add(far_atomics,          "far-atomics",          "Execute locked read-modify-write instructions at the shared cache: private copies of the line are dropped and only the result goes back to the core");
+  add(far_atomic_latency,   "far-atomic-latency",   "Round trip cycles of a far atomic between the core and the shared cache");
+  add(far_atomic_occupancy, "far-atomic-occupancy", "Cycles a far atomic holds its line at the shared cache, later ones on the line wait for it");
+  add(mem_surrogate,        "mem-surrogate",        "Fill read misses of the L1 caches from a latency model of the hierarchy below in fast phases, calibrated in detailed windows");
+  add(mem_surrogate_window, "mem-surrogate-window", "Cycles of each detailed window calibrating -mem-surrogate");
+  add(mem_surrogate_period, "mem-surrogate-period", "Cycles of each fast phase of -mem-surrogate");
+  add(mem_surrogate_error,  "mem-surrogate-error",  "Largest error of -mem-surrogate over a detailed window, as a fraction of its miss latencies, for the next phase to be fast");
 
   // MongoDB
   section("bus configuration");
@@ -341,10 +696,27 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(mongo_port,           "mongo-port",           "MongoDB server's port address");
   add(bench_name,           "bench-name",           "Benchmark Name added to database");
   add(tags,              "tags",              "tags added to database");
+  add(stats_export,         "stats-export",         "Send stats from a background thread to: mongo (same as -enable-mongo) or line (time-series line protocol over TCP)");
+  add(stats_export_server,  "stats-export-server",  "Server receiving line protocol stats (MongoDB uses -mongo-server)");
+  add(stats_export_port,    "stats-export-port",    "Port of line protocol server (MongoDB uses -mongo-port)");
+  add(stats_export_period,  "stats-export-period",  "Also export total stats every <N> cycles (0 for final stats only)");
+  add(stats_export_batch,   "stats-export-batch",   "Send up to <N> stats snapshots at once");
+  add(stats_export_queue,   "stats-export-queue",   "Queue up to <N> stats snapshots; periodic ones are skipped when full");
+  add(telemetry,            "telemetry",            "Keep a live telemetry page (see sim/ptl-telemetry.h) in this file, e.g. under /dev/shm, updated with the progress line");
+  add(telemetry_stats,      "telemetry-stats",      "Comma separated stats, like 'ooo_0_0:cycles,formulas:ipc', also written to the telemetry page");
+  add(stats_address_spaces, "stats-address-spaces", "Keep separate stats of the cores and their private caches for up to <N> guest address spaces, by CR3 or the id set with PTLCALL_STATS_ADDRESS_SPACE, later ones go to 'other'");
 
   // Test Framework
   section("Unit Test Framework");
   add(run_tests,            "run-tests",            "Run Test cases");
+  add(run_benchmarks,       "run-benchmarks",       "Run data structure benchmarks and write their XML report to this file (compare with ptlsim/tools/benchcmp.py)");
+  add(host_profile,         "host-profile",         "Measure host time spent in cores, memory hierarchy, memory events, QEMU IO, QEMU switches and stats into 'simulator.host_profile' and time-stats (adds 6 rdtsc per cycle)");
+  add(host_perf,            "host-perf",            "Measure host time of each core, pipeline stage group, cache and interconnect into the 'host_perf' stats node");
+  add(host_huge_pages,      "host-huge-pages",      "Allocate Stats, cache tag arrays, directories, request pools and cores on 2 MB host pages (hugetlbfs if reserved, else transparent huge pages)");
+  add(mem_latency,          "mem-latency",          "Record per hop latency percentiles of memory requests, per cache, interconnect and core, into the 'memory_latency' stats node");
+  add(pc_profile,           "pc-profile",           "Profile accesses, cache and DTLB misses and latency of loads and stores per rip, the top ones of each core go to its 'pc_profile' stats node");
+  add(coherence_hotspots,   "coherence-hotspots",   "Find the lines invalidated most by coherence, with the words and rips of each core touching them and whether they are falsely shared, into the 'coherence_hotspots' stats node");
+  add(mem_parallelism,      "mem-parallelism",      "Estimate the speedup of running the memory hierarchy's controllers on host threads, optimistically and with conservative windows, into the 'mem_parallelism' stats node");
 
   // Utilities/Tools
   section("options for tools/utilities");
@@ -352,17 +724,56 @@ void ConfigurationParser<PTLsimConfig>::setup() {
 
   section("Synchronization Options");
   add(sync_interval, "sync", "Number of simulation cycles between synchronization");
+  add(cluster_hosts, "cluster-hosts", "Simulate one node of a cluster, connected to the others with '-net marss', this file has a 'host:port' line per node");
+  add(cluster_node, "cluster-node", "Line of this node in '-cluster-hosts', from 0");
+  add(cluster_latency, "cluster-latency", "Cluster switch and wire latency in ns, also the lookahead that nodes are kept in sync with");
+  add(cluster_bandwidth, "cluster-bandwidth", "Cluster NIC and switch port bandwidth in Mbit/s");
 
   section("Simpoint Options");
   add(simpoint_file, "simpoint", "Create simpoint based checkpoints from given 'simpoint' file");
   add(simpoint_interval, "simpoint-interval", "Number of instructions in each interval");
   add(simpoint_chk_name, "simpoint-chk-name", "Checkpoint name prefix");
+  add(checkpoint_ram_dir, "checkpoint-ram-dir", "Save guest RAM of created checkpoints in page aligned files in this directory, loaded lazily at -loadvm");
+  add(checkpoint_page_store, "checkpoint-page-store", "With -checkpoint-ram-dir, store each distinct guest page once in <dir>/pages.store shared by all checkpoints, with a page manifest per checkpoint");
+  add(warm_state_dir, "warm-state-dir", "Save caches, directory, TLBs and branch predictors with each checkpoint created while simulating, to <dir>/<chk-name>.warm");
+  add(warm_state_filename, "warm-state", "Load caches, directory, TLBs and branch predictors from this '-warm-state-dir' file when simulation starts");
+  add(warm_toggle, "warm-toggle", "Keep caches, TLBs and branch predictors when simulation stops and starts again, only cache lines and decoded code of pages written in emulation are dropped");
+  add(periodic_checkpoint_cycles, "periodic-checkpoint-cycles", "Every <N> simulated cycles create a checkpoint that simulation resumes from with -loadvm <chk-name> -warm-state <warm-state-dir>/<chk-name>.warm, needs -warm-state-dir");
+  add(periodic_checkpoint_name, "periodic-checkpoint-name", "Periodic checkpoints are named <name>_<cycle>");
+
+  section("Sampling Options");
+  add(sample_interval, "sample-interval", "Sample simulation: functionally warm each CPU for <N> instructions between detailed windows");
+  add(sample_detailed_warmup, "sample-detailed-warmup", "Instructions simulated in detail but not measured at start of each window");
+  add(sample_window, "sample-window", "Instructions measured in each detailed window");
+  add(sample_min_windows, "sample-min-windows", "Minimum number of windows before stopping at target error");
+  add(sample_error, "sample-error", "Stop when confidence interval of IPC is within this fraction of mean (0 to never stop)");
+  add(sample_zscore, "sample-zscore", "Standard normal quantile of the confidence interval (3.0 is 99.7%)");
+
+  section("Warmup Detection Options");
+  add(warmup_detect, "warmup-detect", "Simulate in detail until cache, TLB and branch miss rates converge, then reset stats and start measuring");
+  add(warmup_detect_window, "warmup-detect-window", "Instructions of each window the miss rates are taken over");
+  add(warmup_detect_windows, "warmup-detect-windows", "Last <N> windows whose miss rates must agree (2 to 64)");
+  add(warmup_detect_error, "warmup-detect-error", "Largest spread of a miss rate over the windows, as a fraction of its mean");
+  add(warmup_detect_max, "warmup-detect-max", "Start measuring after <N> instructions even if not converged (0 for no limit)");
+  add(warmup_detect_measure, "warmup-detect-measure", "Stop <N> instructions after measuring started (0 to keep -stop-at-insns)");
+
+  section("Migration Options");
+  add(migration_policy, "migration-policy", "Move Contexts between the cores of each pair: none (guest ptlcalls only), interval or ipc");
+  add(migration_interval, "migration-interval", "Cycles between policy decisions");
+  add(migration_penalty, "migration-penalty", "Cycles in which neither core of a pair runs while state is moved");
+  add(migration_ipc_low, "migration-ipc-low", "ipc policy: move to the peer core when IPC on the primary core is below this");
+  add(migration_ipc_high, "migration-ipc-high", "ipc policy: move back to the primary core when IPC on the peer core is above this");
+
+  section("Clock Domain Options");
+  add(clock_domains, "clock-domains", "Frequencies of clock domains as name=MHz pairs like 'ooo_0=1000,uncore=1600', at most -corefreq");
 #ifdef DRAMSIM
   section("DRAMSim2 Config options");
   add(dramsim_device_ini_file,  "dramsim-device-ini-file",   "Device ini file that DRAMSim2 should load");
   add(dramsim_pwd,              "dramsim-pwd",               "Working directory that DRAMSim2 should execute in");
   add(dramsim_system_ini_file,  "dramsim-system-ini-file",   "System ini file that DRAMSim2 should load"); 
   add(dramsim_results_dir_name, "dramsim-results-dir-name",  "Name of the results directory where the DRAMSim2 output should go"); 
+  add(dramsim_skip_idle,        "dramsim-skip-idle",         "Don't clock DRAMSim2 while it has no transactions (stops refresh and background power while idle)");
+  add(dramsim_lookahead,        "dramsim-lookahead",         "Clock DRAMSim2 on its own thread, transactions reach it this many cycles after the controller accepts them (0 to clock it inline)");
 #endif
 };
 
@@ -422,7 +833,14 @@ void print_usage() {
 
 stringbuf current_stats_filename;
 stringbuf current_log_filename;
+stringbuf current_trace_filename;
+stringbuf current_memtrace_capture_file;
+stringbuf current_uoptrace_capture_file;
+stringbuf current_event_record_file;
+stringbuf current_event_replay_file;
+stringbuf current_state_hash_file;
 stringbuf current_bbcache_dump_filename;
+stringbuf current_bbcache_persist_filename;
 stringbuf current_trace_memory_updates_logfile;
 stringbuf current_yaml_stats_filename;
 W64 current_start_sim_rip;
@@ -467,28 +885,271 @@ void capture_stats_snapshot(const char* name) {
   /* TODO: Support stats snapshot in new Stats module */
 }
 
+/**
+ * @brief Save or restore the 'simulation' section of a resumable warm
+ * state file: global counters, Stats and output file offsets
+ *
+ * A resumed simulation writes its log and time-stats files anew. The
+ * interrupted run's files cut at the saved offsets, followed by them, are
+ * the files of a run that was not interrupted.
+ */
+void transfer_simulation_state(WarmState& state)
+{
+    StatsBuilder& builder = StatsBuilder::get();
+    W64 log_offset = 0;
+    W64 time_stats_offset = 0;
+
+    if (state.saving()) {
+        /* Queued rows and the open binary block go out first */
+        if (time_stats_file) {
+            builder.drain_periodic_writer();
+            builder.finish_periodic(*time_stats_file);
+            time_stats_file->flush();
+            time_stats_offset = time_stats_file->tellp();
+        }
+
+        if (ptl_logfile.is_open()) {
+            ptl_logfile.flush();
+            log_offset = ptl_logfile.tellp();
+        }
+    }
+
+    Stats *stats[] = {user_stats, kernel_stats, global_stats};
+    builder.transfer_warm_state(state, stats, 3);
+
+    state.value(sim_cycle);
+    state.value(unhalted_cycle_count);
+    state.value(iterations);
+    state.value(total_uops_executed);
+    state.value(total_uops_committed);
+    state.value(total_insns_committed);
+    state.value(total_basic_blocks_committed);
+    state.value(last_stats_captured_at_cycle);
+    state.value(log_offset);
+    state.value(time_stats_offset);
+
+    if (state.saving() || !state.ok())
+        return;
+
+    last_printed_status_at_insn = total_insns_committed;
+    last_printed_status_at_cycle = sim_cycle;
+
+    ptl_logfile << "Resumed at cycle ", sim_cycle, " after ",
+                total_insns_committed, " commits, continues the log at byte ",
+                log_offset, " and time-stats at byte ", time_stats_offset,
+                " of the interrupted run", endl;
+}
+
+/*
+ * Stats regions opened and closed by the guest with PTLCALL_STATS_REGION.
+ * Each keeps the user+kernel counters at its last begin and adds the
+ * difference at every end to its own Stats, dumped after the total one.
+ */
+struct StatsRegion {
+    stringbuf name;
+    Stats *start;
+    Stats *total;
+    bool open;
+    W64 entries;
+    W64 start_cycle;
+    W64 start_insns;
+    W64 cycles;
+    W64 insns;
+};
+
+#define MAX_STATS_REGIONS 64
+
+static dynarray<StatsRegion*> stats_regions;
+static Stats *stats_region_scratch = NULL;
+
+static StatsRegion* find_stats_region(const char *name, bool create)
+{
+    foreach (i, stats_regions.length) {
+        if (strequal(stats_regions[i]->name.buf, name))
+            return stats_regions[i];
+    }
+
+    if (!create)
+        return NULL;
+
+    if (stats_regions.length >= MAX_STATS_REGIONS) {
+        ptl_logfile << "Too many stats regions, ignoring '" << name << "'" << endl;
+        return NULL;
+    }
+
+    StatsBuilder &builder = StatsBuilder::get();
+    StatsRegion *region = new StatsRegion();
+    region->name = name;
+    region->start = builder.get_new_stats();
+    region->total = builder.get_new_stats();
+    region->open = false;
+    region->entries = region->cycles = region->insns = 0;
+    stats_regions.push(region);
+
+    if (!stats_region_scratch)
+        stats_region_scratch = builder.get_new_stats();
+
+    return region;
+}
+
+/* Current user + kernel counters into dest */
+static void snapshot_mode_stats(Stats &dest)
+{
+    dest = *user_stats;
+    dest += *kernel_stats;
+}
+
+bool stats_region_begin(const char *name)
+{
+    StatsRegion *region = find_stats_region(name, true);
+
+    if (!region)
+        return false;
+
+    if (region->open) {
+        ptl_logfile << "Stats region '" << name << "' is already open" << endl;
+        return false;
+    }
+
+    snapshot_mode_stats(*region->start);
+    region->start_cycle = sim_cycle;
+    region->start_insns = total_insns_committed;
+    region->open = true;
+    return true;
+}
+
+bool stats_region_end(const char *name)
+{
+    StatsRegion *region = find_stats_region(name, false);
+
+    if (!region || !region->open) {
+        ptl_logfile << "Stats region '" << name << "' is not open" << endl;
+        return false;
+    }
+
+    Stats &delta = *stats_region_scratch;
+    snapshot_mode_stats(delta);
+    StatsBuilder::get().sub_stats(delta, *region->start);
+    *region->total += delta;
+
+    region->cycles += sim_cycle - region->start_cycle;
+    region->insns += total_insns_committed - region->start_insns;
+    region->entries++;
+    region->open = false;
+    return true;
+}
+
+/* Close regions left open and fill their 'region' and tags stats */
+static void set_stats_region_stats(const stringbuf &base_tags)
+{
+    foreach (i, stats_regions.length) {
+        StatsRegion *region = stats_regions[i];
+
+        if (region->open)
+            stats_region_end(region->name.buf);
+
+        stringbuf tags;
+        tags << base_tags << "region," << region->name;
+
+        W64 entries = region->entries;
+        W64 cycles = region->cycles;
+        W64 insns = region->insns;
+        double ipc = cycles ? double(insns) / double(cycles) : 0;
+
+        simstats.set_default_stats(region->total);
+        simstats.tags.set(region->total, tags);
+        simstats.region.name.set(region->total, region->name);
+        simstats.region.entries = entries;
+        simstats.region.cycles = cycles;
+        simstats.region.insns = insns;
+        simstats.region.ipc = ipc;
+    }
+}
+
+/* Credit the cores and fill the 'address_space' and tags stats of banks */
+static void set_address_space_stats(const stringbuf &base_tags)
+{
+    if (!address_space_stats_enabled)
+        return;
+
+    address_space_stats_update();
+
+    foreach (i, address_space_bank_count()) {
+        AddressSpaceBank &bank = address_space_bank(i);
+
+        stringbuf tags;
+        tags << base_tags << "address_space," << bank.name;
+
+        W64 switches = bank.switches;
+        W64 cycles = bank.cycles;
+        W64 insns = bank.insns;
+        double ipc = cycles ? double(insns) / double(cycles) : 0;
+
+        simstats.set_default_stats(bank.total);
+        simstats.tags.set(bank.total, tags);
+        simstats.address_space.name.set(bank.total, bank.name);
+        simstats.address_space.switches = switches;
+        simstats.address_space.cycles = cycles;
+        simstats.address_space.insns = insns;
+        simstats.address_space.ipc = ipc;
+    }
+}
+
 void print_sysinfo(ostream& os) {
 	// TODO: In QEMU based system
 }
 
-void dump_yaml_stats()
+/**
+ * @brief Save stats as YAML documents, or one JSON array of them
+ *
+ * StatsWriter writes straight to the file behind yaml_stats_file, so that
+ * is flushed first and moved to the end after.
+ */
+void dump_yaml_stats(StatsWriter::Format format)
 {
     if(!config.yaml_stats_filename) {
         return;
     }
 
-    YAML::Emitter k_out, u_out, g_out;
+    yaml_stats_file.flush();
 
-    (StatsBuilder::get()).dump(kernel_stats, k_out);
-    yaml_stats_file << k_out.c_str() << "\n";
+    int fd = open(config.yaml_stats_filename, O_WRONLY | O_APPEND);
+    if(fd < 0) {
+        ptl_logfile << "Can't open stats file ", config.yaml_stats_filename,
+                    ": ", strerror(errno), endl;
+        return;
+    }
 
-    (StatsBuilder::get()).dump(user_stats, u_out);
-    yaml_stats_file << u_out.c_str() << "\n";
+    {
+        StatsWriter out(format, fd);
+        out.begin_list();
 
-    (StatsBuilder::get()).dump(global_stats, g_out);
-    yaml_stats_file << g_out.c_str() << "\n";
+        (StatsBuilder::get()).dump(kernel_stats, out);
+        (StatsBuilder::get()).dump(user_stats, out);
+        (StatsBuilder::get()).dump(global_stats, out);
 
-    yaml_stats_file.flush();
+        simstats.region.enable_dump();
+        foreach (i, stats_regions.length) {
+            (StatsBuilder::get()).dump(stats_regions[i]->total, out);
+        }
+        simstats.region.disable_dump();
+
+        simstats.address_space.enable_dump();
+        foreach (i, address_space_bank_count()) {
+            (StatsBuilder::get()).dump(address_space_bank(i).total, out);
+        }
+        simstats.address_space.disable_dump();
+
+        out.end_list();
+
+        if(!out.flush()) {
+            ptl_logfile << "Writing stats to ", config.yaml_stats_filename,
+                        " failed: ", strerror(errno), endl;
+        }
+    }
+
+    close(fd);
+    yaml_stats_file.seekp(0, std::ios_base::end);
 }
 
 /**
@@ -503,6 +1164,24 @@ void dump_text_stats()
 	(StatsBuilder::get()).dump(kernel_stats, yaml_stats_file, "kernel.");
 	(StatsBuilder::get()).dump(global_stats, yaml_stats_file, "total.");
 
+	simstats.region.enable_dump();
+	foreach (i, stats_regions.length) {
+		stringbuf prefix;
+		prefix << "region." << stats_regions[i]->name << ".";
+		(StatsBuilder::get()).dump(stats_regions[i]->total,
+				yaml_stats_file, prefix.buf);
+	}
+	simstats.region.disable_dump();
+
+	simstats.address_space.enable_dump();
+	foreach (i, address_space_bank_count()) {
+		stringbuf prefix;
+		prefix << "address_space." << address_space_bank(i).name << ".";
+		(StatsBuilder::get()).dump(address_space_bank(i).total,
+				yaml_stats_file, prefix.buf);
+	}
+	simstats.address_space.disable_dump();
+
 	yaml_stats_file.flush();
 }
 
@@ -514,24 +1193,66 @@ static void flush_stats()
 
     PTLsimMachine* machine = PTLsimMachine::getmachine(config.core_name.buf);
     assert(machine);
+
+    /* Writing the stats can't be in them, collecting them is */
+    W64 update_tsc = rdtsc();
     machine->update_stats();
+    if (config.host_profile) {
+        ((BaseMachine*)machine)->host_profile_ticks[HOST_PROFILE_STATS] +=
+            rdtsc() - update_tsc;
+    }
 
     // Call this function to setup tags and other info
     setup_sim_stats();
 
 	if (config.stats_format == "text") {
 		dump_text_stats();
+	} else if (config.stats_format == "json") {
+		dump_yaml_stats(StatsWriter::JSON_FORMAT);
 	} else {
 		if (config.stats_format != "yaml")
 			ptl_logfile << "Unknown Stats format: " << config.stats_format <<
 				" dumping in default YAML format." << endl;
-		dump_yaml_stats();
+		dump_yaml_stats(StatsWriter::YAML_FORMAT);
 	}
 
-    if(config.enable_mongo)
-        write_mongo_stats();
+    if(stats_exporter) {
+        /* Waits until the final stats are sent or dropped after retries */
+        stats_exporter->export_stats(*user_stats, "user", sim_cycle, true);
+        stats_exporter->export_stats(*kernel_stats, "kernel", sim_cycle, true);
+        stats_exporter->export_stats(*global_stats, "total", sim_cycle, true);
+        foreach (i, address_space_bank_count()) {
+            stats_exporter->export_stats(*address_space_bank(i).total,
+                    "address_space", sim_cycle, true);
+        }
+        stats_exporter->stop();
+    }
+
+    if (config.topdown_report.set()) {
+        ofstream topdown_file(config.topdown_report);
+        Core::topdown_hotspots.write(topdown_file, 50);
+        topdown_file.close();
+    }
+
+    if (config.pc_sample_file.set() && Core::pc_sampler.period) {
+        ofstream pc_sample_file(config.pc_sample_file);
+        Core::pc_sampler.stacks.write(pc_sample_file);
+        pc_sample_file.close();
+        ptl_logfile << "PC sampler: ", Core::pc_sampler.stacks.samples,
+                    " samples, ", Core::pc_sampler.stacks.stacks, " stacks, ",
+                    Core::pc_sampler.stacks.dropped, " dropped", endl;
+    }
+
+    trace_close();
+    memtrace_capture_close();
+    uoptrace_capture_close();
+    io_record_close();
+    io_replay_close();
+    state_hash_close();
 
     if(time_stats_file) {
+        StatsBuilder::get().stop_periodic_writer();
+        StatsBuilder::get().finish_periodic(*time_stats_file);
         time_stats_file->close();
     }
     //FIXME: this assumes that flush_stats is only called at the end, which is true now but might not be true in the long run
@@ -543,6 +1264,462 @@ static void flush_stats()
     (StatsBuilder::get()).dump_summary(ptl_logfile);
 }
 
+/* Child simulations forked by fork_simulations(), waited for at kill */
+static dynarray<pid_t> forked_sims;
+
+/* Things forked children can't continue, option is the forking one */
+static bool can_fork(PTLsimConfig& config, const char *option)
+{
+    if (config.time_stats_queue > 0) {
+        ptl_logfile << "ERROR: ", option, " doesn't support ",
+                    "-time-stats-queue, not forking", endl;
+        return false;
+    }
+
+    /* Trace writer thread would not exist in the children */
+    if (config.trace_filename.set()) {
+        ptl_logfile << "ERROR: ", option, " doesn't support ",
+                    "-tracefile, not forking", endl;
+        return false;
+    }
+
+    if (config.memtrace_capture_file.set()) {
+        ptl_logfile << "ERROR: ", option, " doesn't support ",
+                    "-memtrace-capture, not forking", endl;
+        return false;
+    }
+
+    if (config.uoptrace_capture_file.set()) {
+        ptl_logfile << "ERROR: ", option, " doesn't support ",
+                    "-uoptrace-capture, not forking", endl;
+        return false;
+    }
+
+#ifdef DRAMSIM
+    /* DRAMSim2 thread would be marked running with no thread behind it */
+    if (config.dramsim_lookahead > 0) {
+        ptl_logfile << "ERROR: ", option, " doesn't support ",
+                    "-dramsim-lookahead, not forking", endl;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+static void prepare_fork()
+{
+    /* Exporter thread and its connection would not exist in children */
+    if (stats_exporter)
+        stats_exporter->stop();
+
+    /* Buffered output would be written again by children */
+    ptl_logfile.flush();
+    yaml_stats_file.flush();
+    if (time_stats_file)
+        time_stats_file->flush();
+}
+
+/**
+ * @brief Set up a forked child to run with options on top of config
+ *
+ * Log and stats files get a '.<kind><id>' suffix and a '<kind><id>' tag
+ * unless options set them.
+ */
+static void start_forked_simulation(PTLsimConfig& config, const char *kind,
+        int id, char *options)
+{
+    stringbuf machine_config;
+    machine_config << config.machine_config;
+
+    stringbuf suffix;
+    suffix << "." << kind << id;
+
+    stringbuf name;
+    if (config.log_filename.set()) {
+        name << config.log_filename << suffix;
+        config.log_filename = name;
+    }
+    if (config.stats_filename.set()) {
+        name.reset();
+        name << config.stats_filename << suffix;
+        config.stats_filename = name;
+    }
+    if (config.yaml_stats_filename.set()) {
+        name.reset();
+        name << config.yaml_stats_filename << suffix;
+        config.yaml_stats_filename = name;
+    }
+    if (config.topdown_report.set()) {
+        name.reset();
+        name << config.topdown_report << suffix;
+        config.topdown_report = name;
+    }
+    if (config.pc_sample_file.set()) {
+        name.reset();
+        name << config.pc_sample_file << suffix;
+        config.pc_sample_file = name;
+    }
+    if (config.state_hash_file.set()) {
+        name.reset();
+        name << config.state_hash_file << suffix;
+        config.state_hash_file = name;
+    }
+    if (config.flight_recorder_size > 0) {
+        name.reset();
+        name << config.flight_recorder_file << suffix;
+        config.flight_recorder_file = name;
+    }
+
+    stringbuf tags;
+    if (config.tags.size() > 0)
+        tags << config.tags << ",";
+    tags << kind << id;
+    config.tags = tags;
+
+    config.fork_configs = "";
+    config.fork_server = "";
+
+    /* Children share the disk image the checkpoints are written to */
+    config.periodic_checkpoint_cycles = 0;
+    ::config.parse(config, options);
+
+    if (config.machine_config != machine_config) {
+        ptl_logfile << "ERROR: Forked simulation can't change machine ",
+                    "to ", config.machine_config, endl;
+        config.machine_config = machine_config;
+    }
+
+    handle_config_change(config);
+
+    /* Line protocol tags include the fork tag */
+    if (stats_exporter)
+        open_stats_exporter();
+
+    if (time_stats_file) {
+        time_stats_file->close();
+        name.reset();
+        name << config.time_stats_logfile << suffix;
+        time_stats_file->open(name.buf);
+        config.time_stats_logfile = name;
+    }
+
+    BaseMachine* machine = (BaseMachine*)(PTLsimMachine::getmachine(
+                config.core_name));
+    machine->config_changed();
+
+    ptl_logfile << "Forked simulation ", kind, " ", id, " configuration: ",
+                ::config, endl;
+}
+
+static int fork_server(PTLsimConfig& config);
+
+/**
+ * @brief Fork a what-if simulation per line of '-fork-configs' file
+ *
+ * @param config Simulation configuration
+ *
+ * @return Index of this simulation, 0 in the parent and 1..N in children
+ *
+ * Each child continues from the warmed state of the parent with options of
+ * its line applied on top of parent's configuration. Log and stats files
+ * get a '.fork<N>' suffix and a 'fork<N>' tag unless the line sets them.
+ * Machine configuration can't be changed as it is built only once, but
+ * '-machine-options' can override the latency, replacement and prefetch
+ * options that controllers re-read in config_changed(), e.g.
+ *
+ *   -machine-options L2_0.latency=14,L2_0.prefetcher=stream
+ *
+ * Children share QEMU's host file descriptors with parent, so disk images
+ * should be opened with -snapshot and devices should be idle.
+ * Runs with -time-stats-queue, -tracefile, -memtrace-capture,
+ * -uoptrace-capture or -dramsim-lookahead don't fork as their helper
+ * threads would be missing in the children.
+ *
+ * With '-fork-server' the lines come from a socket instead, see
+ * fork_server().
+ */
+int fork_simulations(PTLsimConfig& config)
+{
+    static bool forked = false;
+
+    if (forked || !(config.fork_configs.set() || config.fork_server.set()))
+        return 0;
+    forked = true;
+
+    if (config.fork_server.set())
+        return fork_server(config);
+
+    if (!can_fork(config, "-fork-configs"))
+        return 0;
+
+    ifstream is(config.fork_configs);
+    if (!is) {
+        ptl_logfile << "ERROR: Can't open fork configs file ",
+                    config.fork_configs, endl;
+        return 0;
+    }
+
+    dynarray<stringbuf*> lines;
+    for (;;) {
+        std::string temp;
+        std::getline(is, temp);
+        if (!is)
+            break;
+
+        stringbuf* line = new stringbuf();
+        *line << temp.c_str();
+        *line = line->strip();
+
+        /* Skip empty and commented lines */
+        if (line->size() == 0 || line->buf[0] == '#') {
+            delete line;
+            continue;
+        }
+        lines.push(line);
+    }
+
+    prepare_fork();
+
+    int id = 0;
+
+    foreach (i, lines.count()) {
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            ptl_logfile << "ERROR: Unable to fork simulation ", i + 1, endl;
+            break;
+        }
+
+        if (pid > 0) {
+            forked_sims.push(pid);
+            ptl_logfile << "Forked simulation ", i + 1, " (pid ", pid,
+                        "): ", *lines[i], endl;
+            continue;
+        }
+
+        id = i + 1;
+        forked_sims.clear();
+        start_forked_simulation(config, "fork", id, lines[i]->buf);
+        break;
+    }
+
+    foreach (i, lines.count()) {
+        delete lines[i];
+    }
+
+    return id;
+}
+
+namespace {
+
+    struct ServerJob {
+        pid_t pid;
+        int id;
+        int conn;
+    };
+
+    void send_reply(int conn, const stringbuf& reply)
+    {
+        if (write(conn, reply.buf, reply.size()) < 0)
+            ptl_logfile << "Fork server: unable to reply: ",
+                        strerror(errno), endl;
+    }
+
+    /* One line from conn into line, false if none came in time */
+    bool read_job_line(int conn, stringbuf& line)
+    {
+        char buf[4096];
+        int len = 0;
+
+        while (len < int(sizeof(buf)) - 1) {
+            ssize_t n = read(conn, buf + len, 1);
+            if (n <= 0)
+                break;
+            if (buf[len] == '\n')
+                break;
+            len++;
+        }
+
+        buf[len] = 0;
+        line.reset();
+        line << buf;
+        line = line.strip();
+        return line.size() > 0;
+    }
+
+    /* Reply to the clients of jobs that exited, waiting for one if hang */
+    void reap_jobs(dynarray<ServerJob>& jobs, bool hang)
+    {
+        for (;;) {
+            int status;
+            pid_t pid = waitpid(-1, &status, hang ? 0 : WNOHANG);
+            if (pid <= 0)
+                return;
+
+            foreach (i, jobs.count()) {
+                if (jobs[i].pid != pid)
+                    continue;
+
+                int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+                stringbuf reply;
+                reply << "done ", jobs[i].id, " status ", code, "\n";
+                send_reply(jobs[i].conn, reply);
+                close(jobs[i].conn);
+
+                ptl_logfile << "Fork server: job ", jobs[i].id,
+                            " exited with ", code, endl;
+                jobs[i] = jobs[jobs.count() - 1];
+                jobs.pop();
+                break;
+            }
+
+            hang = false;
+        }
+    }
+
+};
+
+/**
+ * @brief Serve simulation jobs on the '-fork-server' Unix socket
+ *
+ * The simulator boots, loads its checkpoint and warms up once, then waits
+ * for jobs: each connection sends one line of simconfig options, as a
+ * '-fork-configs' line. Each job is a child forked from the warmed state,
+ * with '.job<N>' file suffixes and a 'job<N>' tag unless its line sets
+ * them. The server replies "job <N> pid <pid>" when the child starts and
+ * "done <N> status <code>" when it exits, then closes the connection, so
+ * a client sends its line and reads until end of file (see
+ * ptlsim/tools/simjob.py). At most '-fork-server-jobs' run at once, later
+ * connections wait. A "quit" line stops the server once the running jobs
+ * are done and ends the simulator. Jobs are forked like '-fork-configs'
+ * children, so the server doesn't start with the options can_fork()
+ * refuses, e.g. '-dramsim-lookahead'.
+ *
+ * @return Index of the job in children, the server doesn't return
+ */
+static int fork_server(PTLsimConfig& config)
+{
+    if (!can_fork(config, "-fork-server"))
+        return 0;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        ptl_logfile << "ERROR: Fork server: unable to create socket: ",
+                    strerror(errno), endl;
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, config.fork_server.buf, sizeof(addr.sun_path) - 1);
+    unlink(addr.sun_path);
+
+    if (bind(server, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            listen(server, 64) < 0) {
+        ptl_logfile << "ERROR: Fork server: unable to listen on ",
+                    config.fork_server, ": ", strerror(errno), endl;
+        close(server);
+        return 0;
+    }
+
+    ptl_logfile << "Fork server: waiting for jobs on ", config.fork_server,
+                " at cycle ", sim_cycle, endl, flush;
+    cerr << "Fork server: waiting for jobs on ", config.fork_server, endl,
+         flush;
+
+    prepare_fork();
+
+    dynarray<ServerJob> jobs;
+    int limit = max(int(config.fork_server_jobs), 1);
+    int next_id = 1;
+    bool quitting = false;
+
+    while (!quitting) {
+        reap_jobs(jobs, jobs.count() >= limit);
+        if (jobs.count() >= limit)
+            continue;
+
+        /* Wake up now and then to reap jobs that exited */
+        struct pollfd pfd;
+        pfd.fd = server;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        int conn = accept(server, NULL, NULL);
+        if (conn < 0)
+            continue;
+
+        /* A client that doesn't send its line in time is dropped */
+        struct timeval timeout;
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        stringbuf line;
+        if (!read_job_line(conn, line)) {
+            close(conn);
+            continue;
+        }
+
+        if (line == "quit") {
+            stringbuf reply;
+            reply << "quit, waiting for ", jobs.count(), " jobs\n";
+            send_reply(conn, reply);
+            close(conn);
+            quitting = true;
+            continue;
+        }
+
+        int id = next_id++;
+        ptl_logfile.flush();
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            stringbuf reply;
+            reply << "error ", id, " unable to fork\n";
+            send_reply(conn, reply);
+            close(conn);
+            continue;
+        }
+
+        if (pid == 0) {
+            close(server);
+            close(conn);
+            foreach (i, jobs.count())
+                close(jobs[i].conn);
+            start_forked_simulation(config, "job", id, line.buf);
+            return id;
+        }
+
+        ServerJob job;
+        job.pid = pid;
+        job.id = id;
+        job.conn = conn;
+        jobs.push(job);
+
+        stringbuf reply;
+        reply << "job ", id, " pid ", pid, "\n";
+        send_reply(conn, reply);
+
+        ptl_logfile << "Fork server: job ", id, " (pid ", pid, "): ", line,
+                    endl, flush;
+    }
+
+    while (jobs.count())
+        reap_jobs(jobs, true);
+
+    close(server);
+    unlink(addr.sun_path);
+
+    ptl_logfile << "Fork server: done after ", next_id - 1, " jobs", endl;
+    config.kill = 1;
+    kill_simulation();
+    return 0;
+}
+
 static void kill_simulation()
 {
     assert(config.kill || config.kill_after_run);
@@ -556,6 +1733,12 @@ static void kill_simulation()
     ptl_rip_trace.close();
 #endif
 
+    /* Forked what-if simulations finish before their parent */
+    foreach (i, forked_sims.count()) {
+        int status;
+        waitpid(forked_sims[i], &status, 0);
+    }
+
     if (config.execute_after_kill.size() > 0) {
         ptl_logfile << "Executing: " << config.execute_after_kill << endl;
         int ret = system(config.execute_after_kill.buf);
@@ -574,6 +1757,8 @@ static void kill_simulation()
     ptl_logfile.close();
 
     sync_remove();
+    telemetry_remove();
+    cluster_node.shutdown();
 
     ptl_quit();
 }
@@ -586,6 +1771,71 @@ bool handle_config_change(PTLsimConfig& config) {
     backup_and_reopen_logfile();
     current_log_filename = config.log_filename;
   }
+
+  if (config.trace_filename.set() && (config.trace_filename != current_trace_filename)) {
+    trace_open(config.trace_filename, config.trace_buffer_size);
+    current_trace_filename = config.trace_filename;
+  }
+
+  if (config.memtrace_capture_file.set() &&
+      (config.memtrace_capture_file != current_memtrace_capture_file)) {
+    memtrace_capture_open(config.memtrace_capture_file,
+        config.memtrace_capture_block, config.memtrace_capture_queue);
+    current_memtrace_capture_file = config.memtrace_capture_file;
+  }
+
+  if (config.uoptrace_capture_file.set() &&
+      (config.uoptrace_capture_file != current_uoptrace_capture_file)) {
+    uoptrace_capture_open(config.uoptrace_capture_file,
+        config.uoptrace_capture_block);
+    current_uoptrace_capture_file = config.uoptrace_capture_file;
+  }
+
+  if (config.event_trace_record_filename.set() &&
+      (config.event_trace_record_filename != current_event_record_file)) {
+    io_record_open(config.event_trace_record_filename);
+    current_event_record_file = config.event_trace_record_filename;
+  }
+
+  if (config.event_trace_record_stop) {
+    io_record_close();
+    config.event_trace_record_stop = 0;
+  }
+
+  if (config.event_trace_replay_filename.set() &&
+      (config.event_trace_replay_filename != current_event_replay_file)) {
+    io_replay_open(config.event_trace_replay_filename);
+    current_event_replay_file = config.event_trace_replay_filename;
+  }
+
+  if (config.state_hash_file.set() &&
+      (config.state_hash_file != current_state_hash_file)) {
+    state_hash_open(config.state_hash_file, config.state_hash_period);
+    current_state_hash_file = config.state_hash_file;
+  }
+
+  if (config.flight_recorder_size > 0 && !config.trace_filename.set())
+    flight_recorder_open(config.flight_recorder_file, config.flight_recorder_size);
+
+  host_perf_enabled = config.host_perf;
+  ::host_huge_pages = config.host_huge_pages;
+
+  /* Columns of time-stats are fixed once its header is written */
+  if (config.host_profile && sim_cycle == 0) {
+    simstats.host_profile.enable_dump();
+    simstats.host_profile.ticks.enable_periodic_dump();
+  }
+
+  Memory::request_latency_enabled = config.mem_latency;
+  Memory::priority_scheduling = config.mem_priority;
+  Memory::fast_fill_enabled = config.mem_fast_fill;
+  Memory::fast_fill_check = config.mem_fast_fill_check;
+  Core::pc_profile_enabled = config.pc_profile;
+  Memory::coherence_hotspots_enabled = config.coherence_hotspots;
+  Memory::mem_parallelism_enabled = config.mem_parallelism;
+  Core::topdown_hotspots.enabled = config.topdown_report.set();
+  Core::pc_sampler.setup(config.pc_sample_file.set() ?
+          config.pc_sample_period : 0, config.pc_sample_depth, sim_cycle);
 #ifdef TRACE_RIP
 	if(!ptl_rip_trace.is_open())
 		ptl_rip_trace.open("ptl_rip_trace");
@@ -631,12 +1881,24 @@ if ((config.loglevel > 0) & (config.start_log_at_rip == INVALIDRIP) & (config.st
     current_bbcache_dump_filename = config.bbcache_dump_filename;
   }
 
+  if (config.bbcache_persist_filename.set() && (config.bbcache_persist_filename != current_bbcache_persist_filename)) {
+    load_bbcache_file(config.bbcache_persist_filename);
+    current_bbcache_persist_filename = config.bbcache_persist_filename;
+  }
+
+  set_bbcache_shared(config.shared_bbcache);
+
 #ifdef __x86_64__
   config.start_log_at_rip = signext64(config.start_log_at_rip, 48);
   config.start_at_rip = signext64(config.start_at_rip, 48);
   config.stop_at_rip = signext64(config.stop_at_rip, 48);
+  config.pipe_trace_rip = signext64(config.pipe_trace_rip, 48);
 #endif
 
+  Core::pipe_trace.setup(config.pipe_trace && trace_enabled,
+      config.pipe_trace_start, config.pipe_trace_rip,
+      config.pipe_trace_cycles);
+
   if ((config.fast_fwd_insns || config.fast_fwd_user_insns) && qemu_initialized) {
       set_cpu_fast_fwd();
   }
@@ -695,81 +1957,199 @@ if ((config.loglevel > 0) & (config.start_log_at_rip == INVALIDRIP) & (config.st
       config.core_freq_hz = get_native_core_freq_hz();
   }
 
+  storage_model_configure();
+
   return true;
 }
 
-/* Synchronization Support using SystemV Semaphores */
-const int SEM_ID = 3764;
-static int sem_id = -1;
+/* Synchronization support using a barrier in shared memory (see ptl-sync.h) */
+
+/* Spin this many times before sleeping on the futex */
+#define SYNC_SPIN_COUNT 4096
+
+/* Sleep at most this long before checking for dead instances */
+#define SYNC_WAIT_TIMEOUT_NS 100000000
 
-static void sync_op(W16 op)
+static MarssSyncShared *sync_shm = NULL;
+static int sync_slot = -1;
+static char sync_shm_name[64];
+static W64 sync_barriers = 0;
+static W64 sync_wait_ns = 0;
+
+static W64 sync_time_ns()
 {
-    int rc;
-    sembuf sem_op;
-
-    sem_op.sem_num = 0;
-    sem_op.sem_op = op;
-    sem_op.sem_flg = 0;
-
-    while ((rc = semop(sem_id, &sem_op, 1)) == -1) {
-        if (errno != EINTR && errno != EIDRM) {
-            ptl_logfile << "Error in op " << op << " is: ";
-            switch (errno) {
-                case EACCES: ptl_logfile << "Access\n"; break;
-                case EEXIST: ptl_logfile << "Exists\n"; break;
-                case EINVAL: ptl_logfile << "Invalid\n"; break;
-                case ENOENT: ptl_logfile << "NoEnt\n"; break;
-                case ENOMEM: ptl_logfile << "NoMem\n"; break;
-                case ENOSPC: ptl_logfile << "NoSPC\n"; break;
-            }
-            ptl_logfile << flush;
-        }
-        if (errno == EIDRM) {
-            /* Semaphore is removed, so kill simulation */
-            flush_stats();
-            kill_simulation();
-        }
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (W64(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void sync_lock()
+{
+    int rc = pthread_mutex_lock(&sync_shm->lock);
+
+    /* An instance died while holding the lock, its slot will be
+     * cleaned up by sync_purge_dead() */
+    if (rc == EOWNERDEAD)
+        pthread_mutex_consistent(&sync_shm->lock);
+}
+
+static void sync_unlock()
+{
+    pthread_mutex_unlock(&sync_shm->lock);
+}
+
+static void sync_wake_all()
+{
+    syscall(SYS_futex, &sync_shm->generation, FUTEX_WAKE, INT_MAX,
+            NULL, NULL, 0);
+}
+
+/* Release the barrier if all live instances have arrived, lock must be held */
+static void sync_check_release()
+{
+    if (sync_shm->members == 0 || sync_shm->arrived < sync_shm->members)
+        return;
+
+    foreach (i, MARSS_SYNC_MAX_INSTANCES) {
+        sync_shm->slots[i].arrived = 0;
     }
+
+    sync_shm->arrived = 0;
+    __sync_fetch_and_add(&sync_shm->generation, 1);
+    sync_wake_all();
 }
 
-static void sync_set_sem()
+/* Remove instances that exited without leaving the barrier, lock must be held */
+static void sync_purge_dead()
 {
-    sync_op(1);
+    foreach (i, MARSS_SYNC_MAX_INSTANCES) {
+        MarssSyncSlot &slot = sync_shm->slots[i];
+
+        if (slot.pid == 0 || kill(slot.pid, 0) == 0 || errno != ESRCH)
+            continue;
+
+        ptl_logfile << "Sync: instance ", i, " (pid ", slot.pid,
+                    ") died, removing it from the barrier", endl;
+
+        if (slot.arrived)
+            sync_shm->arrived--;
+
+        slot.pid = 0;
+        slot.arrived = 0;
+        sync_shm->members--;
+    }
+
+    sync_check_release();
 }
 
 static void sync_setup()
 {
-    /* First we will try to create a new semaphore if it fails
-     * then some other simulation process has already setup the
-     * semaphore and it will act as Master */
+    /* The first instance creates and initializes the segment, all others
+     * wait for it to be ready and then take a free slot */
 
-    int env_sem_id = -1;
-    char *env_sem_id_p;
+    marss_sync_name(sync_shm_name, sizeof(sync_shm_name));
 
-    env_sem_id_p = getenv("MARSS_SEM_ID");
+    bool created = true;
+    int fd = shm_open(sync_shm_name, O_RDWR | O_CREAT | O_EXCL, 0666);
 
-    if (env_sem_id_p)
-        env_sem_id = atoi(env_sem_id_p);
-    else
-        env_sem_id = SEM_ID;
-
-    sem_id = semget(env_sem_id, 1, IPC_CREAT | 0666);
-
-    if (sem_id == -1) {
-        ptl_logfile << "Sempahore setup error: ";
-        switch (errno) {
-            case EACCES: ptl_logfile << "Access\n"; break;
-            case EEXIST: ptl_logfile << "Exists\n"; break;
-            case EINVAL: ptl_logfile << "Invalid\n"; break;
-            case ENOENT: ptl_logfile << "NoEnt\n"; break;
-            case ENOMEM: ptl_logfile << "NoMem\n"; break;
-            case ENOSPC: ptl_logfile << "NoSPC\n"; break;
+    if (fd == -1 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(sync_shm_name, O_RDWR, 0666);
+    }
+
+    if (fd == -1) {
+        ptl_logfile << "Sync: unable to open ", sync_shm_name, ": ",
+                    strerror(errno), endl, flush;
+        kill_simulation();
+    }
+
+    if (created) {
+        if (ftruncate(fd, sizeof(MarssSyncShared)) == -1) {
+            ptl_logfile << "Sync: unable to size ", sync_shm_name, ": ",
+                        strerror(errno), endl, flush;
+            close(fd);
+            shm_unlink(sync_shm_name);
+            kill_simulation();
+        }
+    } else {
+        /* Creator may not have sized the segment yet */
+        struct stat st;
+        while (fstat(fd, &st) == 0 && st.st_size < (off_t)sizeof(MarssSyncShared))
+            usleep(1000);
+    }
+
+    void *addr = mmap(NULL, sizeof(MarssSyncShared), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        ptl_logfile << "Sync: unable to map ", sync_shm_name, ": ",
+                    strerror(errno), endl, flush;
+        kill_simulation();
+    }
+
+    sync_shm = (MarssSyncShared*)addr;
+
+    if (created) {
+        /* ftruncate zero filled everything else */
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&sync_shm->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        __sync_synchronize();
+        sync_shm->magic = MARSS_SYNC_MAGIC;
+    } else {
+        int retries = 5000;
+        while (sync_shm->magic != MARSS_SYNC_MAGIC && retries--)
+            usleep(1000);
+
+        if (sync_shm->magic != MARSS_SYNC_MAGIC) {
+            ptl_logfile << "Sync: ", sync_shm_name, " is not a Marss sync ",
+                        "segment, remove it with 'sync_helper delete'", endl, flush;
+            munmap(sync_shm, sizeof(MarssSyncShared));
+            sync_shm = NULL;
+            kill_simulation();
         }
-        ptl_logfile << flush;
+    }
+
+    sync_lock();
+    sync_purge_dead();
+
+    /* Left over from a previous run where every instance has exited */
+    if (sync_shm->members == 0)
+        sync_shm->shutdown = 0;
+
+    foreach (i, MARSS_SYNC_MAX_INSTANCES) {
+        MarssSyncSlot &slot = sync_shm->slots[i];
+        if (slot.pid != 0)
+            continue;
+
+        slot.pid = getpid();
+        slot.arrived = 0;
+        slot.barriers = 0;
+        slot.wait_ns = 0;
+        slot.cycle = 0;
+        sync_shm->members++;
+        sync_slot = i;
+        break;
+    }
+
+    W32 members = sync_shm->members;
+    sync_unlock();
+
+    if (sync_slot == -1) {
+        ptl_logfile << "Sync: all ", MARSS_SYNC_MAX_INSTANCES, " slots of ",
+                    sync_shm_name, " are in use", endl, flush;
+        munmap(sync_shm, sizeof(MarssSyncShared));
+        sync_shm = NULL;
         kill_simulation();
     }
 
-    sync_set_sem();
+    ptl_logfile << "Sync: joined ", sync_shm_name, " as instance ", sync_slot,
+                " of ", members, endl, flush;
 }
 
 static void sync_wait()
@@ -781,21 +2161,82 @@ static void sync_wait()
 
     last_sync_cycle = sim_cycle;
 
-    /* Decrement semaphore */
-    sync_op(-1);
+    MarssSyncSlot &slot = sync_shm->slots[sync_slot];
+    W64 start = sync_time_ns();
+
+    sync_lock();
+    int generation = sync_shm->generation;
+    slot.arrived = 1;
+    slot.cycle = sim_cycle;
+    sync_shm->arrived++;
+    sync_check_release();
+    sync_unlock();
+
+    /* Now wait for all processes to reach the barrier */
+    int spins = 0;
+    while (sync_shm->generation == generation) {
+        if (sync_shm->shutdown) {
+            /* Some other instance has exited, so kill simulation */
+            flush_stats();
+            kill_simulation();
+        }
 
-    /* Now wait for all prcoesses to reach to semaphore */
-    sync_op(0);
+        if (spins < SYNC_SPIN_COUNT) {
+            spins++;
+            cpu_pause();
+            continue;
+        }
 
-    sync_set_sem();
+        timespec timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = SYNC_WAIT_TIMEOUT_NS;
+
+        int rc = syscall(SYS_futex, &sync_shm->generation, FUTEX_WAIT,
+                generation, &timeout, NULL, 0);
+
+        if (rc == -1 && errno == ETIMEDOUT) {
+            sync_lock();
+            sync_purge_dead();
+            sync_unlock();
+        }
+    }
+
+    W64 waited = sync_time_ns() - start;
+    sync_barriers++;
+    sync_wait_ns += waited;
+    slot.barriers = sync_barriers;
+    slot.wait_ns = sync_wait_ns;
 }
 
 static void sync_remove()
 {
-    /* We allow any simulation instance to remove the semaphore
+    /* We allow any simulation instance to end the barrier
      * so that other instances will kill themselves */
-    if (sem_id != -1)
-        semctl(sem_id, 0, IPC_RMID);
+    if (!sync_shm)
+        return;
+
+    ptl_logfile << "Sync: instance ", sync_slot, " passed ", sync_barriers,
+                " barriers, waited ", (sync_wait_ns / 1000000), " ms", endl;
+
+    sync_lock();
+    MarssSyncSlot &slot = sync_shm->slots[sync_slot];
+    if (slot.arrived)
+        sync_shm->arrived--;
+    slot.pid = 0;
+    slot.arrived = 0;
+    sync_shm->members--;
+    sync_shm->shutdown = 1;
+    bool last = (sync_shm->members == 0);
+    sync_unlock();
+
+    sync_wake_all();
+
+    if (last)
+        shm_unlink(sync_shm_name);
+
+    munmap(sync_shm, sizeof(MarssSyncShared));
+    sync_shm = NULL;
+    sync_slot = -1;
 }
 
 Hashtable<const char*, PTLsimMachine*, 1>* machinetable = NULL;
@@ -863,10 +2304,31 @@ void ptl_reconfigure(const char* config_str) {
 
 	ptl_logfile << "Configuration changed: " << config << endl;
 
-    if (config.sync_interval && sem_id == -1) {
+    if (config.cluster_hosts.set() && !cluster_node.active()) {
+        double cycles_per_byte = (8.0 * config.core_freq_hz) /
+            (config.cluster_bandwidth * 1e6);
+
+        if (!cluster_node.setup(config.cluster_hosts, config.cluster_node,
+                    ns_to_simcycles(config.cluster_latency),
+                    cycles_per_byte)) {
+            ptl_logfile << "Cluster: unable to set up node ",
+                        config.cluster_node, endl, flush;
+            assert(0);
+        }
+
+        if (config.sync_interval)
+            ptl_logfile << "Cluster: nodes are kept in sync with lookahead, ",
+                        "-sync is not used", endl;
+    }
+
+    /* Cluster nodes are kept in sync by the cluster */
+    if (config.sync_interval && !sync_shm && !cluster_node.active()) {
         sync_setup();
     }
 
+    if (config.telemetry.set())
+        telemetry_setup(config.telemetry.buf, config.telemetry_stats.buf);
+
     /*
 	 * set the curr_ptl_machine to NULL so it will be automatically changed to
 	 * new configured machine
@@ -923,6 +2385,15 @@ extern "C" void ptl_machine_configure(const char* config_str_) {
         {
             time_stats_file = new ofstream(config.time_stats_logfile.buf);
             builder.init_timer_stats();
+            if (config.time_stats_format == "binary") {
+                builder.set_periodic_binary(true);
+            } else if (config.time_stats_format != "csv") {
+                ptl_logfile << "Unknown time-stats format: " <<
+                    config.time_stats_format << " writing csv." << endl;
+            }
+            if (config.time_stats_queue > 0)
+                builder.start_periodic_writer(time_stats_file,
+                        config.time_stats_queue);
         } else {
             time_stats_file = NULL;
         }
@@ -932,7 +2403,7 @@ extern "C" void ptl_machine_configure(const char* config_str_) {
 
     ptl_machine.disable_dump();
 
-    if(config.run_tests) {
+    if(config.run_tests || config.run_benchmarks.set()) {
         in_simulation = 1;
     }
 }
@@ -958,6 +2429,59 @@ CPUX86State* ptl_create_new_context() {
 /* Checker */
 Context* checker_context = NULL;
 
+/*
+ * The checker does not compare whole contexts after each instruction.
+ * Cores report the architectural registers their committed uops write,
+ * which go into a shadow of the committed state. Up to -checker-batch
+ * instructions are then run on checker_context in one go and only the
+ * written registers and rip are compared against the shadow, with every
+ * CHECKER_FULL_COMPARE_BATCHES'th batch comparing all registers to catch
+ * registers the checker changed but the core didn't.
+ *
+ * A batch ends early at an instruction with stores, as they are checked
+ * against memory written by the checker, and at an instruction that
+ * changes the context outside of its uop destinations (checker_mark_sync).
+ * After a mismatch the checker compares each instruction until a batch
+ * worth of them passed, so a lasting bug is pinned to one instruction.
+ */
+static const int CHECKER_REGS = 48; /* GPRs and XMM halves, see Context::get */
+static const int CHECKER_MAX_BATCH = 256;
+static const int CHECKER_FULL_COMPARE_BATCHES = 64;
+static const int CHECKER_MAX_INSN_WRITES = 64;
+
+struct CheckerWrite {
+    int archreg;
+    W64 value;
+};
+
+static W64 checker_shadow[CHECKER_REGS];
+static W64 checker_shadow_eip;
+static W64 checker_dirty;
+static W64 checker_batch_rips[CHECKER_MAX_BATCH];
+static int checker_batched;
+static int checker_batch_limit = 1;
+static W64 checker_clean_insns;
+static W64 checker_batches;
+
+static CheckerWrite checker_insn_writes[CHECKER_MAX_INSN_WRITES];
+static int checker_insn_write_count;
+static bool checker_insn_sync;
+
+/* Shadow follows given context, nothing is pending */
+static void checker_sync_shadow(const Context& ctx)
+{
+    foreach (i, CHECKER_REGS) checker_shadow[i] = ctx.get(i);
+    checker_shadow_eip = ctx.eip;
+    checker_dirty = 0;
+    checker_batched = 0;
+}
+
+static void checker_reset_insn()
+{
+    checker_insn_write_count = 0;
+    checker_insn_sync = false;
+}
+
 void enable_checker() {
 
     if(checker_context != NULL) {
@@ -966,6 +2490,13 @@ void enable_checker() {
 
     checker_context = new Context();
     memset(checker_context, 0, sizeof(Context));
+
+    checker_batch_limit = clipto((int)config.checker_batch, 1,
+            CHECKER_MAX_BATCH);
+    checker_clean_insns = 0;
+    checker_batches = 0;
+    checker_batched = 0;
+    checker_reset_insn();
 }
 
 void setup_checker(W8 contextid) {
@@ -983,12 +2514,15 @@ void setup_checker(W8 contextid) {
 
       /* Copy the context of given contextid */
       memcpy(checker_context, ptl_contexts[contextid], sizeof(Context));
+      checker_sync_shadow(*checker_context);
 
       if(logable(10)) {
 	ptl_logfile << "Checker context setup\n" << *checker_context << endl;
       }
     }
 
+    checker_reset_insn();
+
     if(logable(10)) {
       ptl_logfile << "No change to checker context " << checker_context->kernel_mode << endl;
     }
@@ -997,6 +2531,8 @@ void setup_checker(W8 contextid) {
 void clear_checker() {
     assert(checker_context);
     memset(checker_context, 0, sizeof(Context));
+    checker_batched = 0;
+    checker_reset_insn();
 }
 
 bool is_checker_valid() {
@@ -1050,43 +2586,136 @@ void execute_checker() {
     }
 }
 
-void compare_checker(W8 context_id, W64 flagmask) {
-    int ret, ret1, ret_x87;
-    int check_size = (char*)(&(checker_context->eip)) - (char*)(checker_context);
-    //ptl_logfile << "check_size: ", check_size, endl;
+/**
+ * @brief Record an architectural register written by a committed uop
+ *
+ * @param archreg Register index as in Context::set_reg
+ * @param value Value written
+ */
+void checker_written_reg(int archreg, W64 value) {
+    if unlikely (archreg >= CHECKER_REGS ||
+            checker_insn_write_count == CHECKER_MAX_INSN_WRITES) {
+        checker_insn_sync = true;
+        return;
+    }
+
+    CheckerWrite& w = checker_insn_writes[checker_insn_write_count++];
+    w.archreg = archreg;
+    w.value = value;
+}
+
+/**
+ * @brief Current instruction changed the context outside of its uop
+ * destinations (e.g. an assist), so it ends the batch with a full compare
+ */
+void checker_mark_sync() {
+    checker_insn_sync = true;
+}
+
+/* Run pending instructions on the checker and compare against shadow */
+static void checker_run_batch(W8 context_id, bool full) {
+    int executed = 0;
 
-    if(checker_context->eip == 0) {
-      return;
+    while (executed < checker_batched && checker_context->eip) {
+        execute_checker();
+        executed++;
     }
 
-    ret = memcmp(checker_context, ptl_contexts[context_id], check_size);
+    /* Checker went to kernel mode, it is set up again later */
+    if (!checker_context->eip) {
+        checker_batched = 0;
+        return;
+    }
 
-    check_size = (sizeof(XMMReg) * 16);
-    //ptl_logfile << "check_size: ", check_size, endl;
+    checker_batches++;
+    full |= (checker_batch_limit == 1) ||
+        (checker_batches % CHECKER_FULL_COMPARE_BATCHES == 0);
+    W64 mask = (full) ? bitmask(CHECKER_REGS) : checker_dirty;
+
+    bool fail = (checker_context->eip != checker_shadow_eip);
+    W64 mismatch = 0;
+    foreach (i, CHECKER_REGS) {
+        if ((mask & (1ULL << i)) &&
+                checker_context->get(i) != checker_shadow[i])
+            mismatch |= (1ULL << i);
+    }
 
-    ret1 = memcmp(&checker_context->xmm_regs, &ptl_contexts[context_id]->xmm_regs, check_size);
+    if likely (!fail && !mismatch) {
+        checker_clean_insns += checker_batched;
+        if unlikely (checker_batch_limit == 1 &&
+                checker_clean_insns >= config.checker_batch)
+            checker_batch_limit = clipto((int)config.checker_batch, 1,
+                    CHECKER_MAX_BATCH);
+        checker_batched = 0;
+        checker_dirty = 0;
+        return;
+    }
 
-    check_size = (sizeof(FPReg) * 8);
-    ret_x87 = memcmp(&checker_context->fpregs, &ptl_contexts[context_id]->fpregs, check_size);
-    ret_x87 = 0;
+    ptl_logfile << "Checker comparison failed after ", checker_batched,
+                " instructions [rip:", fail, "] [full:", full, "]\n";
+    ptl_logfile << "Instructions:";
+    foreach (i, checker_batched)
+        ptl_logfile << " ", hexstring(checker_batch_rips[i], 48);
+    ptl_logfile << endl;
+    foreach (i, CHECKER_REGS) {
+        if (mismatch & (1ULL << i))
+            ptl_logfile << "  ", arch_reg_names[i], ": cpu ",
+                        hexstring(checker_shadow[i], 64), " checker ",
+                        hexstring(checker_context->get(i), 64), endl;
+    }
+    ptl_logfile << "CPU Context:\n" << *ptl_contexts[context_id] << endl;
+    ptl_logfile << "Checker Context:\n" << *checker_context << endl << flush;
 
-    bool fail = false;
-    fail = (checker_context->eip != ptl_contexts[context_id]->eip);
+    cout << "\n*******************Failed checker***************\n";
+    memset(checker_context, 0, sizeof(Context));
+    // assert(0);
 
-    //W64 flag1 = checker_context->reg_flags & flagmask & ~(FLAG_INV | FLAG_AF | FLAG_PF);
-    //W64 flag2 = ptl_contexts[context_id]->reg_flags & flagmask & ~(FLAG_INV | FLAG_AF | FLAG_PF);
-    //fail |= (flag1 != flag2);
+    /* Compare each instruction until the failure is pinned down */
+    checker_batch_limit = 1;
+    checker_clean_insns = 0;
+    checker_batched = 0;
+}
 
-    if(ret != 0 || ret1 != 0 || ret_x87 != 0 || fail) {
-        ptl_logfile << "Checker comparison failed [diff-chars: " << ret << "] ";
-        ptl_logfile << "[xmm:" << ret1 << "] [x87:" << ret_x87 << "] ";
-        ptl_logfile << "[flags:" << fail << "]\n";
-        ptl_logfile << "CPU Context:\n" << *ptl_contexts[context_id] << endl;
-        ptl_logfile << "Checker Context:\n" << *checker_context << endl << flush;
+/**
+ * @brief Last uop of an x86 instruction has committed
+ *
+ * @param context_id Context that committed the instruction
+ * @param rip Address of the instruction
+ * @param checkable False if the checker can't execute it (barriers, mmio,
+ * partial rep iterations), the checker is then set up again afterwards
+ * @param sync True if instruction has stores to check against memory
+ */
+void checker_commit_insn(W8 context_id, W64 rip, bool checkable, bool sync) {
+    if (!is_checker_valid()) {
+        checker_reset_insn();
+        return;
+    }
 
-        cout << "\n*******************Failed checker***************\n";
-        memset(checker_context, 0, sizeof(Context));
-        // assert(0);
+    if (!checkable) {
+        /* Shadow is still at the end of the previous instruction */
+        if (checker_batched)
+            checker_run_batch(context_id, false);
+        clear_checker();
+        return;
+    }
+
+    foreach (i, checker_insn_write_count) {
+        CheckerWrite& w = checker_insn_writes[i];
+        checker_shadow[w.archreg] = w.value;
+        checker_dirty |= (1ULL << w.archreg);
+    }
+    checker_shadow_eip = ptl_contexts[context_id]->eip;
+    checker_batch_rips[checker_batched++] = rip;
+
+    sync |= checker_insn_sync;
+    checker_reset_insn();
+
+    if (sync || checker_batched >= checker_batch_limit) {
+        checker_run_batch(context_id, sync);
+
+        /* Instruction changed more than the shadow knows about */
+        if (sync && is_checker_valid())
+            checker_sync_shadow(*ptl_contexts[context_id]);
     }
 }
 
@@ -1120,59 +2749,69 @@ void setup_ptlsim_switch_all_ctx(Context& last_ctx) {
 	last_ctx.setup_ptlsim_switch();
 }
 
-/* This function is auto-generated by dstbuild_bson.py script at compile time */
-void add_bson_PTLsimStats(PTLsimStats *stats, bson_buffer *bb, const char *snapshot_name);
-
-/* Write all the stats to MongoDB */
-void write_mongo_stats() {
-    bson *bout;
-    bson_buffer *bb;
-    mongo_connection conn[1];
-    mongo_connection_options opts;
-    const char *ns = "marss.benchmarks";
-
-    /* First setup the connection to MongoDB */
-    strncpy(opts.host, config.mongo_server.buf , 255);
-    opts.host[254] = '\0';
-    opts.port = config.mongo_port;
-
-    if(mongo_connect(conn, &opts)){
-        cerr << "Failed to connect to MongoDB server at " << opts.host <<
-             ":" << opts.port << " , **Skipping Mongo Datawrite**" << endl;
-        ptl_logfile << "Failed to connect to MongoDB server at " << opts.host <<
-             ":" << opts.port << " , **Skipping Mongo Datawrite**" << endl;
-        config.enable_mongo = 0;
-        return;
+/**
+ * @brief Create stats_exporter for -enable-mongo or -stats-export
+ *
+ * Connects once so a wrong server shows up at the start of simulation and
+ * not after it; export is disabled if that fails.
+ */
+static void open_stats_exporter()
+{
+    if (stats_exporter) {
+        delete stats_exporter;
+        stats_exporter = NULL;
     }
 
-    /* Now write user, kernel and global stats into database */
-    foreach(i, 3) {
-        Stats *stats_;
-
-        bb = (bson_buffer*)qemu_mallocz(sizeof(bson_buffer));
-        bout = (bson*)qemu_mallocz(sizeof(bson));
+    bool mongo = config.enable_mongo || config.stats_export == "mongo";
+    StatsExportBackend *backend;
 
-        bson_buffer_init(bb);
-        bson_append_new_oid(bb, "_id");
-
-        switch(i) {
-            case 0: stats_ = user_stats; break;
-            case 1: stats_ = kernel_stats; break;
-            default: stats_ = global_stats; break;
+    if (mongo) {
+        hostent *host = gethostbyname(config.mongo_server.buf);
+        if(host == NULL) {
+            cerr << "MongoDB Server host " << config.mongo_server << " is unreachable." << endl;
+            config.enable_mongo = 0;
+            config.stats_export = "";
+            return;
         }
-
-        bb = (StatsBuilder::get()).dump(stats_, bb);
-        bson_from_buffer(bout, bb);
-
-        mongo_insert(conn, ns, bout);
-        bson_destroy(bout);
-
-        qemu_free(bb);
-        qemu_free(bout);
+        config.mongo_server = inet_ntoa(*((in_addr *)host->h_addr));
+        backend = new_mongo_export_backend(config.mongo_server,
+                config.mongo_port);
+    } else if (config.stats_export == "line") {
+        utsname hostinfo;
+        stringbuf tags;
+
+        sys_uname(&hostinfo);
+        stats_export_add_tag(tags, "machine", config.machine_config);
+        stats_export_add_tag(tags, "bench", config.bench_name);
+        stats_export_add_tag(tags, "host", hostinfo.nodename);
+        stats_export_add_tag(tags, "tags", config.tags);
+        backend = new_line_export_backend(config.stats_export_server,
+                config.stats_export_port, tags);
+    } else {
+        cerr << "Unknown -stats-export backend " << config.stats_export <<
+             ", use mongo or line" << endl;
+        config.stats_export = "";
+        return;
     }
 
-    /* Close the connection with MongoDB */
-    mongo_destroy(conn);
+    stats_exporter = new StatsExporter(backend,
+            max(config.stats_export_batch, W64(1)),
+            max(config.stats_export_queue, W64(1)));
+
+    if (!stats_exporter->check_connection()) {
+        const char *server = (mongo) ? config.mongo_server.buf :
+            config.stats_export_server.buf;
+        W64 port = (mongo) ? config.mongo_port : config.stats_export_port;
+
+        cerr << "Failed to connect to " << backend->name() << " server at " <<
+             server << ":" << port << " , **Disabling Stats Export**" << endl;
+        ptl_logfile << "Failed to connect to " << backend->name() << " server at " <<
+             server << ":" << port << " , **Disabling Stats Export**" << endl;
+        delete stats_exporter;
+        stats_exporter = NULL;
+        config.enable_mongo = 0;
+        config.stats_export = "";
+    }
 }
 
 stringbuf get_date()
@@ -1190,20 +2829,66 @@ stringbuf get_date()
     return date;
 }
 
+void host_profile_set_periodic_stats(const W64 *ticks)
+{
+    simstats.host_profile.set_default_stats(kernel_stats);
+    foreach (i, HOST_PROFILE_COUNT)
+        simstats.host_profile.ticks[i] = 0;
+
+    simstats.host_profile.set_default_stats(user_stats);
+    foreach (i, HOST_PROFILE_COUNT)
+        simstats.host_profile.ticks[i] = ticks[i];
+}
+
 static void set_run_stats()
 {
     static W64 seconds = 0;
+    static W64 ticks = 0;
     W64 tsc_at_end = rdtsc();
     seconds += W64(ticks_to_native_seconds(tsc_at_end - tsc_at_start));
+    ticks += tsc_at_end - tsc_at_start;
     W64 cycles_per_sec = W64(double(sim_cycle) / double(seconds));
     W64 commits_per_sec = W64(
             double(total_insns_committed) / double(seconds));
+    double host_seconds = ticks_to_native_seconds(ticks);
+    double kips = (host_seconds > 0) ?
+        double(total_insns_committed) / host_seconds / 1000.0 : 0;
+    double host_cycles_per_cycle = sim_cycle ?
+        double(ticks) / double(sim_cycle) : 0;
+
+    W64 profile_ticks[HOST_PROFILE_COUNT];
+    memset(profile_ticks, 0, sizeof(profile_ticks));
+    BaseMachine* machine = (BaseMachine*)(PTLsimMachine::getmachine(
+                config.core_name.buf));
+    if (config.host_profile && machine) {
+        simstats.host_profile.enable_dump();
+        foreach (i, HOST_PROFILE_COUNT)
+            profile_ticks[i] = machine->host_profile_ticks[i];
+    }
+
+    W64 sim_ns = W64(simcycles_to_ns(sim_cycle));
+    W64 guest_ns = W64(simcycles_to_ns(get_sim_guest_cycle()));
+    W64 lost_ns = sim_ns - guest_ns;
+    double dilation = max(config.time_dilation, 1.0);
+    if (config.time_dilation > 1.0)
+        simstats.time_dilation.enable_dump();
 
 #define RUN_STAT(stat) \
     simstats.set_default_stats(stat); \
     simstats.run.seconds = seconds; \
     simstats.performance.cycles_per_sec = cycles_per_sec; \
-    simstats.performance.commits_per_sec = commits_per_sec;
+    simstats.performance.commits_per_sec = commits_per_sec; \
+    simstats.performance.kips = kips; \
+    simstats.performance.host_cycles_per_cycle = host_cycles_per_cycle; \
+    foreach (i, HOST_PROFILE_COUNT) \
+        simstats.host_profile.ticks[i] = (stat == kernel_stats) ? \
+            0 : profile_ticks[i]; \
+    simstats.time_dilation.factor = dilation; \
+    simstats.time_dilation.sim_ns = sim_ns; \
+    simstats.time_dilation.guest_ns = guest_ns; \
+    simstats.time_dilation.lost_ns = lost_ns; \
+    host_perf_set_stats(stat); \
+    clock_domain_set_stats(stat);
 
     RUN_STAT(user_stats);
     RUN_STAT(kernel_stats);
@@ -1211,9 +2896,77 @@ static void set_run_stats()
 #undef RUN_STAT
 }
 
+static void set_sampling_stats()
+{
+    if(!config.sample_interval)
+        return;
+
+    W64 windows = sampler.ipc.count;
+    W64 measured_insns = sampler.measured_insns;
+    W64 measured_cycles = sampler.measured_cycles;
+    W64 functional_insns = sampler.functional_insns;
+    double ipc = sampler.ipc.mean();
+    double half_width = sampler.ipc.half_width(config.sample_zscore);
+    double error = sampler.ipc.relative_error(config.sample_zscore);
+
+    simstats.sampling.enable_dump();
+
+#define SAMPLING_STAT(stat) \
+    simstats.set_default_stats(stat); \
+    simstats.sampling.windows = windows; \
+    simstats.sampling.measured_insns = measured_insns; \
+    simstats.sampling.measured_cycles = measured_cycles; \
+    simstats.sampling.functional_insns = functional_insns; \
+    simstats.sampling.ipc = ipc; \
+    simstats.sampling.ipc_half_width = half_width; \
+    simstats.sampling.ipc_error = error;
+
+    SAMPLING_STAT(user_stats);
+    SAMPLING_STAT(kernel_stats);
+    SAMPLING_STAT(global_stats);
+#undef SAMPLING_STAT
+
+    sampler.report(ptl_logfile, config);
+}
+
+static void set_warmup_stats()
+{
+    if(!config.warmup_detect)
+        return;
+
+    W64 insns = warmup_detector.warmup_insns;
+    W64 cycles = warmup_detector.warmup_cycles;
+    W64 windows = warmup_detector.convergence.windows;
+    W64 converged = warmup_detector.converged;
+
+    simstats.warmup.enable_dump();
+
+#define WARMUP_STAT(stat) \
+    simstats.set_default_stats(stat); \
+    simstats.warmup.insns = insns; \
+    simstats.warmup.cycles = cycles; \
+    simstats.warmup.windows = windows; \
+    simstats.warmup.converged = converged;
+
+    WARMUP_STAT(user_stats);
+    WARMUP_STAT(kernel_stats);
+    WARMUP_STAT(global_stats);
+#undef WARMUP_STAT
+
+    warmup_detector.report(ptl_logfile);
+}
+
 static void setup_sim_stats()
 {
     set_run_stats();
+    set_sampling_stats();
+    set_warmup_stats();
+    Memory::request_latency_set_stats();
+    Memory::coherence_hotspots_set_stats();
+    Memory::mem_parallelism_set_stats();
+    Memory::stack_distance_set_stats();
+    Memory::qos_set_stats();
+    ptlcall_ring_set_stats();
 
     /* Simlation tags contains benchmark name, host name, simulation-date,
      * user specified tags */
@@ -1243,6 +2996,9 @@ static void setup_sim_stats()
     simstats.tags.set(user_stats, user_tags);
     simstats.tags.set(global_stats, total_tags);
 
+    set_stats_region_stats(base_tags);
+    set_address_space_stats(base_tags);
+
 #define COLLECT_SYSINFO(stat) \
     simstats.set_default_stats(stat); \
     collect_common_sysinfo();
@@ -1306,6 +3062,10 @@ extern "C" uint8_t ptl_simulate() {
         run_tests();
     }
 
+    if(config.run_benchmarks.set()) {
+        run_benchmarks(config.run_benchmarks);
+    }
+
 	if (!machine->initialized) {
 		ptl_logfile << "Initializing core '" << machinename << "'" << endl;
 		if (!machine->init(config)) {
@@ -1316,6 +3076,10 @@ extern "C" uint8_t ptl_simulate() {
 		machine->initialized = 1;
 		machine->first_run = 1;
 
+		if (config.host_huge_pages)
+			ptl_logfile << "Host huge pages: ", host_hugetlb_bytes >> 20,
+				" MB hugetlbfs, ", host_thp_bytes >> 20, " MB transparent", endl;
+
 		if(logable(1)) {
 			ptl_logfile << "Switching to simulation core '" << machinename << "'..." << endl << flush;
 			cerr <<  "Switching to simulation core '" << machinename << "'..." << endl << flush;
@@ -1335,33 +3099,20 @@ extern "C" uint8_t ptl_simulate() {
 		tsc_at_start = rdtsc();
 		curr_ptl_machine = machine;
 
-        if(config.enable_mongo) {
-            // Check MongoDB connection
-            hostent *host;
-            mongo_connection conn[1];
-            mongo_connection_options opts;
-
-            host = gethostbyname(config.mongo_server.buf);
-            if(host == NULL) {
-                cerr << "MongoDB Server host " << config.mongo_server << " is unreachable." << endl;
-                config.enable_mongo = 0;
-            } else {
-                config.mongo_server = inet_ntoa(*((in_addr *)host->h_addr));
-                strncpy(opts.host, config.mongo_server.buf , 255);
-                opts.host[254] = '\0';
-                opts.port = config.mongo_port;
-
-                if (mongo_connect( conn , &opts )){
-                    cerr << "Failed to connect to MongoDB server at " << opts.host <<
-                         ":" << opts.port << " , **Disabling Mongo Support**" << endl;
-                    config.enable_mongo = 0;
-                } else {
-                    mongo_destroy(conn);
-                }
-            }
-        }
+        if(config.enable_mongo || config.stats_export.set())
+            open_stats_exporter();
 	}
 
+	/*
+	 * With -host-profile, time from the end of the previous run() to the
+	 * start of this one, spent switching to QEMU, in QEMU for interrupts
+	 * and exceptions and switching back, counts as qemu.
+	 */
+	static W64 qemu_switch_tsc = 0;
+	W64 *profile_ticks = ((BaseMachine*)machine)->host_profile_ticks;
+	if (!qemu_switch_tsc)
+		qemu_switch_tsc = rdtsc();
+
 	foreach(ctx_no, contextcount) {
 		Context& ctx = contextof(ctx_no);
 		ctx.setup_ptlsim_switch();
@@ -1396,10 +3147,16 @@ extern "C" uint8_t ptl_simulate() {
 #ifdef ENABLE_GPERF
     ProfilerStart("marss.prof");
 #endif
+	if (config.host_profile)
+		profile_ticks[HOST_PROFILE_QEMU] += rdtsc() - qemu_switch_tsc;
+
 	machine->run(config);
 
+	qemu_switch_tsc = rdtsc();
+
 	if (config.stop_at_insns <= total_insns_committed || config.kill == true
-			|| config.stop == true || config.stop_at_cycle < sim_cycle) {
+			|| config.stop == true || config.stop_at_cycle < sim_cycle
+			|| (config.sample_interval && sampler.converged(config))) {
 		machine->stopped = 1;
 	}
 
@@ -1425,6 +3182,12 @@ extern "C" uint8_t ptl_simulate() {
 	W64 tsc_at_end = rdtsc();
 	curr_ptl_machine = NULL;
 
+	/* Other cluster nodes don't wait for this one in emulation */
+	cluster_node.leave();
+
+	/* Started again on the next simulation run */
+	qemu_switch_tsc = 0;
+
 	W64 seconds = W64(ticks_to_native_seconds(tsc_at_end - tsc_at_start));
 	stringbuf sb;
 	sb << endl << "Stopped after " << sim_cycle << " cycles, " << total_insns_committed << " instructions and " <<
@@ -1434,6 +3197,31 @@ extern "C" uint8_t ptl_simulate() {
 	ptl_logfile << sb << flush;
 	cerr << sb << flush;
 
+	W64 run_ticks = tsc_at_end - tsc_at_start;
+	sb.reset();
+	sb << "Simulation speed: " << floatstring(double(total_insns_committed) /
+			ticks_to_native_seconds(run_ticks) / 1000.0, 0, 1) << " KIPS, " <<
+	   floatstring(double(run_ticks) / double(sim_cycle), 0, 1) <<
+	   " host cycles per cycle" << endl;
+	if (config.host_profile) {
+		W64 profiled = 0;
+		foreach (i, HOST_PROFILE_COUNT)
+			profiled += profile_ticks[i];
+		sb << "Host time:";
+		foreach (i, HOST_PROFILE_COUNT) {
+			double share = profiled ?
+				100.0 * double(profile_ticks[i]) / double(profiled) : 0;
+			sb << " " << host_profile_names[i] << " " << floatstring(share, 0, 1) << "%";
+		}
+		sb << endl;
+	}
+
+	ptl_logfile << sb << flush;
+	cerr << sb << flush;
+
+	if (config.sample_interval)
+		sampler.report(cerr, config);
+
 	if (config.dumpcode_filename.set()) {
 		//    byte insnbuf[256];
 		//    PageFaultErrorCode pfec;
@@ -1447,6 +3235,7 @@ extern "C" uint8_t ptl_simulate() {
 	last_printed_status_at_ticks = 0;
 	cerr << endl;
 
+    telemetry_done();
     flush_stats();
 
 	if(config.kill || config.kill_after_run) {
@@ -1455,6 +3244,10 @@ extern "C" uint8_t ptl_simulate() {
 
     machine->first_run = 1;
     sim_update_clock_offset = 1;
+    flush_qemu_io_events();
+
+    if(config.warm_toggle)
+        ((BaseMachine*)machine)->stop_warm();
 
     if(config.stop) {
         config.stop = false;
@@ -1506,6 +3299,8 @@ extern "C" void update_progress() {
         cerr << "\r  " << sb;
     }
 
+    telemetry_update(cycles_per_sec, insns_per_sec);
+
     last_printed_status_at_ticks = ticks;
     last_printed_status_at_cycle = sim_cycle;
     last_printed_status_at_insn = total_insns_committed;
@@ -1521,7 +3316,7 @@ extern "C" void update_progress() {
     config.snapshot_now.reset();
   }
 
-  if (config.sync_interval) {
+  if (config.sync_interval && sync_shm) {
       sync_wait();
   }
 }
@@ -1556,23 +3351,65 @@ struct QemuIOSignal : public FixStateListObject
     }
 };
 
-static FixStateList<QemuIOSignal, 32> *qemuIOEvents = NULL;
+static FixStateList<QemuIOSignal, 256> *qemuIOEvents = NULL;
+
+/*
+ * Cycle of the earliest pending IO event, so the run loop only walks the
+ * list on cycles that have something to deliver
+ */
+static W64 nextQemuIOEventCycle = infinity;
 
 void init_qemu_io_events()
 {
-    qemuIOEvents = new FixStateList<QemuIOSignal, 32>();
+    qemuIOEvents = new FixStateList<QemuIOSignal, 256>();
+    nextQemuIOEventCycle = infinity;
 }
 
 void clock_qemu_io_events()
 {
+    if likely (nextQemuIOEventCycle > sim_cycle)
+        return;
+
+    /* Events added by the callbacks lower it again */
+    nextQemuIOEventCycle = infinity;
+
+    W64 next = infinity;
     QemuIOSignal *signal;
     foreach_list_mutable(qemuIOEvents->list(), signal, entry, prev) {
         if (signal->cycle <= sim_cycle) {
-            ptl_logfile << "Executing QEMU IO Event at " << sim_cycle << endl;
+            if (logable(4))
+                ptl_logfile << "Executing QEMU IO Event at " << sim_cycle << endl;
             signal->fn(signal->arg);
             qemuIOEvents->free(signal);
+        } else {
+            next = min(next, signal->cycle);
         }
     }
+
+    nextQemuIOEventCycle = min(nextQemuIOEventCycle, next);
+}
+
+/*
+ * Deliver what is still pending when simulation stops, emulation doesn't
+ * advance sim_cycle so these would wait for the next run
+ */
+void flush_qemu_io_events()
+{
+    if (!qemuIOEvents)
+        return;
+
+    QemuIOSignal *signal;
+    foreach_list_mutable(qemuIOEvents->list(), signal, entry, prev) {
+        signal->fn(signal->arg);
+        qemuIOEvents->free(signal);
+    }
+
+    nextQemuIOEventCycle = infinity;
+}
+
+W64 get_next_qemu_io_event_cycle()
+{
+    return nextQemuIOEventCycle;
 }
 
 extern "C" void add_qemu_io_event(QemuIOCB fn, void *arg, int delay)
@@ -1581,8 +3418,10 @@ extern "C" void add_qemu_io_event(QemuIOCB fn, void *arg, int delay)
     assert(signal);
 
     signal->setup(fn, arg, delay);
+    nextQemuIOEventCycle = min(nextQemuIOEventCycle, signal->cycle);
 
-    ptl_logfile << "Added QEMU IO event for " << (sim_cycle + delay) << endl;
+    if (logable(4))
+        ptl_logfile << "Added QEMU IO event for " << (sim_cycle + delay) << endl;
 }
 
 W64 ns_to_simcycles(W64 ns)
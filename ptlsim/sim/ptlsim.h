@@ -39,6 +39,9 @@ extern Stats *global_stats;
 extern Stats *time_stats;
 extern ofstream *time_stats_file;
 
+class StatsExporter;
+extern StatsExporter *stats_exporter;
+
 struct PTLsimCore{
   virtual PTLsimCore& getcore() const{ return (*((PTLsimCore*)NULL));}
 };
@@ -101,7 +104,11 @@ void setup_checker(W8 context_id);
 void clear_checker();
 void execute_checker();
 bool is_checker_valid();
-void compare_checker(W8 context_id, W64 flagmask);
+
+/* Core commit hooks: checker runs and compares batches of instructions */
+void checker_written_reg(int archreg, W64 value);
+void checker_mark_sync();
+void checker_commit_insn(W8 context_id, W64 rip, bool checkable, bool sync);
 
 struct TransOpBuffer {
   TransOp uops[MAX_TRANSOP_BUFFER_SIZE];
@@ -137,6 +144,30 @@ struct TransOpBuffer {
 void split_unaligned(const TransOp& transop, TransOpBuffer& buf);
 
 void capture_stats_snapshot(const char* name = NULL);
+bool stats_region_begin(const char *name);
+bool stats_region_end(const char *name);
+
+/*
+ * Service the calls the VM posted to the PTLCALL ring, once per cycle in
+ * simulation and from ptl_check_ptlcall_queue() in emulation
+ */
+void ptl_service_ptlcall_ring();
+
+/* Counts of the calls serviced from the PTLCALL ring ('ptlcall_ring') */
+void ptlcall_ring_set_stats();
+
+/*
+ * Log the guest RAM pages written in emulation with -warm-toggle: started
+ * when simulation stops, ptl_emulation_dirty_pages() appends the physical
+ * addresses of the pages simulation had seen that were written since.
+ * Returns false if the log wasn't started.
+ */
+void ptl_start_emulation_dirty_log();
+bool ptl_emulation_dirty_pages(dynarray<W64> &pages);
+
+/* Write -host-profile ticks for the next periodic time-stats row */
+void host_profile_set_periodic_stats(const W64 *ticks);
+
 bool handle_config_change(PTLsimConfig& config);
 void collect_sysinfo(PTLsimStats& stats, int argc, char** argv);
 void print_sysinfo(ostream& os);
@@ -146,6 +177,7 @@ void backup_and_reopen_yamlstats();
 void shutdown_subsystems();
 
 bool simulate(const char* machinename);
+int fork_simulations(PTLsimConfig& config);
 int inject_events();
 bool check_for_async_sim_break();
 
@@ -162,7 +194,9 @@ void init_uops();
 void shutdown_uops();
 uopimpl_func_t get_synthcode_for_uop(int op, int size, bool setflags, int cond, int extshift, bool except, bool internal);
 uopimpl_func_t get_synthcode_for_cond_branch(int opcode, int cond, int size, bool except);
-void synth_uops_for_bb(BasicBlock& bb);
+void make_uop_descriptor(UopDescriptor& desc, const TransOp& op, uopimpl_func_t synthop, uopdesc_fill_func_t fill);
+void synth_uops_for_bb(BasicBlock& bb, uopdesc_fill_func_t fill, int fusion = 0);
+int fuse_uop_kind(const TransOp& prev, const TransOp& op, int fusion);
 struct PTLsimStats;
 
 extern ofstream ptl_logfile;
@@ -199,6 +233,25 @@ struct PTLsimConfig {
   W64 fast_fwd_insns;
   W64 fast_fwd_user_insns;
   stringbuf fast_fwd_checkpoint;
+  W64 warmup_insns;
+  stringbuf fork_configs;
+  stringbuf fork_server;
+  W64 fork_server_jobs;
+  stringbuf memtrace_file;
+  W64 memtrace_outstanding;
+  stringbuf memtrace_mix;
+  stringbuf memtrace_mix_alone;
+  W64 memtrace_mix_stride;
+  stringbuf memtrace_capture_file;
+  W64 memtrace_capture_block;
+  W64 memtrace_capture_queue;
+  stringbuf uoptrace_file;
+  W64 uoptrace_window;
+  W64 uoptrace_width;
+  W64 uoptrace_redirect;
+  stringbuf uoptrace_predictor;
+  stringbuf uoptrace_capture_file;
+  W64 uoptrace_capture_block;
 
   // Logging
   bool quiet;
@@ -209,6 +262,14 @@ struct PTLsimConfig {
   bool log_on_console;
   W64 log_buffer_size;
   W64 log_file_size;
+  stringbuf trace_filename;
+  W64 trace_buffer_size;
+  W64 flight_recorder_size;
+  stringbuf flight_recorder_file;
+  bool pipe_trace;
+  W64 pipe_trace_start;
+  W64 pipe_trace_rip;
+  W64 pipe_trace_cycles;
   stringbuf screenshot_file;
   bool log_user_only;
   stringbuf dump_config_filename;
@@ -221,10 +282,19 @@ struct PTLsimConfig {
   // Statistics Database
   stringbuf stats_filename;
   stringbuf yaml_stats_filename;
+  stringbuf topdown_report;
+  W64 pc_sample_period;
+  stringbuf pc_sample_file;
+  W64 pc_sample_depth;
+  stringbuf state_hash_file;
+  W64 state_hash_period;
   W64 snapshot_cycles;
   stringbuf snapshot_now;
   stringbuf time_stats_logfile;
   W64 time_stats_period;
+  W64 time_stats_queue;
+  stringbuf time_stats_format;
+  bool bandwidth_timeline;
   stringbuf stats_format;
 
   // memory model:
@@ -247,8 +317,23 @@ struct PTLsimConfig {
   bool event_trace_record_stop;
   stringbuf event_trace_replay_filename;
 
+  // Storage timing
+  bool storage_model;
+  W64 storage_read_ns;
+  W64 storage_write_ns;
+  W64 storage_mbps;
+  W64 storage_channels;
+  W64 storage_queue_depth;
+  double storage_tail_rate;
+  W64 storage_tail_factor;
+
   // Core features
   W64 core_freq_hz;
+  double time_dilation;
+
+  // Guest visible performance counters
+  bool guest_pmu;
+  W64 guest_pmu_period;
 
   // Out of order core features
   bool perfect_cache;
@@ -257,17 +342,34 @@ struct PTLsimConfig {
   stringbuf dumpcode_filename;
   bool dump_at_end;
   stringbuf bbcache_dump_filename;
+  stringbuf bbcache_persist_filename;
+  bool shared_bbcache;
 
   // Machine configurations
   stringbuf machine_config;
+  stringbuf machine_options;
+  bool skip_idle_cycles;
+  bool spin_fast_forward;
+  W64 spin_max_cycles;
 
   ///
   /// for memory hierarchy implementaion
   ///
   //  bool memory_log;
+  bool mem_priority;
+  bool mem_fast_fill;
+  bool mem_fast_fill_check;
+  bool far_atomics;
+  W64 far_atomic_latency;
+  W64 far_atomic_occupancy;
+  bool mem_surrogate;
+  W64 mem_surrogate_window;
+  W64 mem_surrogate_period;
+  double mem_surrogate_error;
 
   bool checker_enabled;
   W64 checker_start_rip;
+  W64 checker_batch;
 
   // MongoDB support configuration
   bool enable_mongo;
@@ -276,19 +378,79 @@ struct PTLsimConfig {
   stringbuf bench_name;
   stringbuf tags;
 
+  // Background stats export
+  stringbuf stats_export;
+  stringbuf stats_export_server;
+  W64 stats_export_port;
+  W64 stats_export_period;
+  W64 stats_export_batch;
+  W64 stats_export_queue;
+
+  // Live telemetry page
+  stringbuf telemetry;
+  stringbuf telemetry_stats;
+
+  // Stats per address space
+  W64 stats_address_spaces;
+
   // Test Framework
   bool run_tests;
+  stringbuf run_benchmarks;
+  bool host_profile;
+  bool host_perf;
+  bool mem_latency;
+  bool pc_profile;
+  bool coherence_hotspots;
+  bool mem_parallelism;
 
   //Utilities/Tools
   stringbuf execute_after_kill;
 
   // Sync Options
   W64  sync_interval;
+  stringbuf cluster_hosts;
+  W64  cluster_node;
+  W64  cluster_latency;
+  W64  cluster_bandwidth;
 
   // Simpoint options
   stringbuf simpoint_file;
   W64 simpoint_interval;
   stringbuf simpoint_chk_name;
+  stringbuf checkpoint_ram_dir;
+  bool checkpoint_page_store;
+  bool host_huge_pages;
+  stringbuf warm_state_dir;
+  stringbuf warm_state_filename;
+  bool warm_toggle;
+  W64 periodic_checkpoint_cycles;
+  stringbuf periodic_checkpoint_name;
+
+  // Sampled simulation
+  W64 sample_interval;
+  W64 sample_detailed_warmup;
+  W64 sample_window;
+  W64 sample_min_windows;
+  double sample_error;
+  double sample_zscore;
+
+  // Warmup until miss rates converge
+  bool warmup_detect;
+  W64 warmup_detect_window;
+  W64 warmup_detect_windows;
+  double warmup_detect_error;
+  W64 warmup_detect_max;
+  W64 warmup_detect_measure;
+
+  // Migration between the cores of big.LITTLE pairs
+  stringbuf migration_policy;
+  W64 migration_interval;
+  W64 migration_penalty;
+  double migration_ipc_low;
+  double migration_ipc_high;
+
+  // Clock domains
+  stringbuf clock_domains;
 
 #ifdef DRAMSIM
   // DRAMSim2 options
@@ -296,6 +458,8 @@ struct PTLsimConfig {
   stringbuf dramsim_system_ini_file;
   stringbuf dramsim_pwd;
   stringbuf dramsim_results_dir_name;
+  bool dramsim_skip_idle;
+  W64 dramsim_lookahead;
 #endif
 
   void reset();
@@ -324,6 +488,8 @@ void force_logging_enabled();
 
 void init_qemu_io_events();
 void clock_qemu_io_events();
+void flush_qemu_io_events();
+W64 get_next_qemu_io_event_cycle();
 
 /**
  * @brief Convert nano-seconds to Simulation Cycles
@@ -346,4 +512,9 @@ float simcycles_to_ns(W64 cycles);
 void set_next_simpoint(Context& ctx);
 stringbuf* get_simpoint_chk_name();
 
+/* Resumable checkpoints, see -periodic-checkpoint-cycles */
+class WarmState;
+void queue_resumable_checkpoint(const char* chk_name);
+void transfer_simulation_state(WarmState& state);
+
 #endif // _PTLSIM_H_
@@ -0,0 +1,105 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <sampling.h>
+#include <machine.h>
+#include <warmup.h>
+
+SampleController sampler;
+
+void SampleController::reset()
+{
+    ipc.reset();
+    phase = PHASE_WARMUP;
+    phase_insns = 0;
+    phase_cycle = 0;
+    measured_insns = 0;
+    measured_cycles = 0;
+    functional_insns = 0;
+}
+
+void SampleController::start(W64 insns, W64 cycle)
+{
+    phase = PHASE_WARMUP;
+    phase_insns = insns;
+    phase_cycle = cycle;
+}
+
+bool SampleController::converged(const PTLsimConfig& config) const
+{
+    if(config.sample_error == 0 || ipc.count < config.sample_min_windows)
+        return false;
+
+    return ipc.relative_error(config.sample_zscore) <= config.sample_error;
+}
+
+/**
+ * @brief Advance sampling phases, called once per simulated cycle
+ *
+ * @param machine Machine that is simulated
+ * @param config Simulation configuration
+ *
+ * @return true once the target error is reached
+ */
+bool SampleController::update(BaseMachine& machine, PTLsimConfig& config)
+{
+    W64 insns = total_insns_committed - phase_insns;
+
+    if(phase == PHASE_WARMUP) {
+        if(insns >= config.sample_detailed_warmup) {
+            phase = PHASE_MEASURE;
+            phase_insns = total_insns_committed;
+            phase_cycle = sim_cycle;
+        }
+        return false;
+    }
+
+    if(insns < config.sample_window)
+        return false;
+
+    W64 cycles = sim_cycle - phase_cycle;
+    if(cycles == 0) cycles = 1;
+
+    ipc.add(double(insns) / double(cycles));
+    measured_insns += insns;
+    measured_cycles += cycles;
+
+    if(logable(1)) {
+        ptl_logfile << "Sample window ", ipc.count, ": ", insns,
+                    " insns in ", cycles, " cycles, mean IPC ", ipc.mean(),
+                    " +/- ", ipc.half_width(config.sample_zscore), endl;
+    }
+
+    if(converged(config))
+        return true;
+
+    /* Pipelines only hold uncommitted state, so Contexts can be warmed
+     * from where the window stopped and pipelines restarted after it */
+    functional_insns += Core::functional_warmup(machine,
+            config.sample_interval);
+    machine.flush_all_pipelines();
+
+    start(total_insns_committed, sim_cycle);
+
+    return false;
+}
+
+ostream& SampleController::report(ostream& os,
+        const PTLsimConfig& config) const
+{
+    os << "Sampled simulation: ", ipc.count, " windows, ",
+       measured_insns, " measured insns, ", functional_insns,
+       " functional insns", endl;
+    os << "Sampled IPC: ", ipc.mean(), " +/- ",
+       ipc.half_width(config.sample_zscore), " (",
+       ipc.relative_error(config.sample_zscore) * 100.0, "% at z=",
+       config.sample_zscore, ")", endl;
+
+    return os;
+}
@@ -0,0 +1,109 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <ptlsim.h>
+
+#include <cmath>
+
+struct BaseMachine;
+
+/**
+ * @brief Running mean and confidence interval of per-window samples
+ *
+ * Windows are assumed to be independent samples of the same population, so
+ * the half width of the confidence interval of their mean is
+ * z * s / sqrt(n) where s is the sample standard deviation.
+ */
+struct SampleEstimate {
+    W64 count;
+    double sum;
+    double sum_sq;
+
+    SampleEstimate() { reset(); }
+
+    void reset()
+    {
+        count = 0;
+        sum = 0;
+        sum_sq = 0;
+    }
+
+    void add(double value)
+    {
+        count++;
+        sum += value;
+        sum_sq += value * value;
+    }
+
+    double mean() const
+    {
+        return count ? sum / count : 0;
+    }
+
+    double stddev() const
+    {
+        if(count < 2)
+            return 0;
+
+        double var = (sum_sq - (sum * sum) / count) / (count - 1);
+        return var > 0 ? sqrt(var) : 0;
+    }
+
+    double half_width(double z) const
+    {
+        return count ? z * stddev() / sqrt(double(count)) : 0;
+    }
+
+    /* Half width relative to the mean, 1.0 until there is any mean */
+    double relative_error(double z) const
+    {
+        double m = mean();
+        return m > 0 ? half_width(z) / m : 1.0;
+    }
+};
+
+/**
+ * @brief Systematic (SMARTS style) sampled simulation controller
+ *
+ * Simulation alternates between functional warming of caches, TLBs and
+ * branch predictors for '-sample-interval' instructions of each CPU and a
+ * detailed window. First '-sample-detailed-warmup' instructions of each
+ * window warm the pipelines and are not measured, IPC of next
+ * '-sample-window' instructions is one sample. Simulation stops once at
+ * least '-sample-min-windows' samples are taken and the confidence interval
+ * of their mean IPC is within '-sample-error' of the mean.
+ */
+struct SampleController {
+    enum { PHASE_WARMUP = 0, PHASE_MEASURE };
+
+    SampleEstimate ipc;
+
+    int phase;
+    W64 phase_insns;
+    W64 phase_cycle;
+
+    W64 measured_insns;
+    W64 measured_cycles;
+    W64 functional_insns;
+
+    SampleController() { reset(); }
+
+    void reset();
+    void start(W64 insns, W64 cycle);
+    bool update(BaseMachine& machine, PTLsimConfig& config);
+    bool converged(const PTLsimConfig& config) const;
+    ostream& report(ostream& os, const PTLsimConfig& config) const;
+};
+
+extern SampleController sampler;
+
+#endif // SAMPLING_H
@@ -0,0 +1,98 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <statehash.h>
+#include <ptlsim.h>
+#include <machine.h>
+#include <basecore.h>
+
+#include <zlib.h>
+
+using namespace Core;
+
+bool state_hash_enabled = false;
+
+namespace {
+
+    gzFile hash_file = NULL;
+    StateHash state_hash;
+    W64 period = 0;
+    W64 next_cycle = 0;
+    W64 epochs = 0;
+
+    void write_epoch(W64 cycle)
+    {
+        StateHashRecord rec = state_hash.end_epoch(cycle);
+        gzwrite(hash_file, &rec, sizeof(rec));
+        epochs++;
+    }
+
+}
+
+bool state_hash_open(const char *filename, W64 period_)
+{
+    state_hash_close();
+
+    hash_file = gzopen(filename, "wb");
+    if (!hash_file) {
+        ptl_logfile << "Unable to open state hash file ", filename, endl;
+        return false;
+    }
+
+    period = max(period_, W64(1));
+    gzwrite(hash_file, STATE_HASH_MAGIC, 8);
+    gzwrite(hash_file, &period, sizeof(period));
+
+    state_hash.reset();
+    next_cycle = ((sim_cycle / period) + 1) * period;
+    epochs = 0;
+    state_hash_enabled = true;
+    return true;
+}
+
+void state_hash_close()
+{
+    if (!hash_file) return;
+
+    /* The last epoch ends early, its record is still written */
+    if (state_hash.commits || state_hash.mem_events)
+        write_epoch(sim_cycle);
+
+    state_hash_enabled = false;
+    gzclose(hash_file);
+    hash_file = NULL;
+
+    ptl_logfile << "State hash: ", epochs, " epochs of ", period,
+                " cycles written", endl;
+}
+
+void state_hash_commit(int ctx, W64 rip, W64 insns)
+{
+    state_hash.commit(sim_cycle, ctx, rip, insns);
+}
+
+void state_hash_mem_event(int controller, W64 addr, int type)
+{
+    state_hash.mem_event(sim_cycle, controller, addr, type);
+}
+
+void state_hash_clock(BaseMachine &machine)
+{
+    if likely (sim_cycle < next_cycle)
+        return;
+
+    next_cycle = sim_cycle + period;
+
+    foreach (i, machine.cores.count())
+        state_hash.stat(machine.cores[i]->committed_insns);
+    state_hash.stat(total_insns_committed);
+
+    write_epoch(sim_cycle);
+}
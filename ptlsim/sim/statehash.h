@@ -0,0 +1,125 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/*
+ * Run verification by state hashes ('-state-hash-file')
+ *
+ * Three rolling hashes follow the run: one of committed instructions
+ * (cycle, context, rip), one of messages reaching a memory hierarchy
+ * controller (cycle, controller, physical address, request type) and one
+ * of selected counters (instructions committed by each core) taken at the
+ * end of each epoch. Every '-state-hash-period' cycles the hashes are
+ * written out. They are never reset, so two runs of the same checkpoint
+ * and configuration, e.g. one with an optimized path or engine and one
+ * without, match up to the first epoch in which they diverge and differ
+ * from there on. ptlsim/tools/statehash.py compares two files and reports
+ * that epoch and which of the hashes differs first.
+ *
+ * Controllers are named by their registration order, so only runs of the
+ * same machine configuration can be compared.
+ *
+ * File format, gzip compressed:
+ *
+ *   "PTLSTHS1"
+ *   W64 period
+ *   StateHashRecord[]    (until end of file)
+ */
+#define STATE_HASH_MAGIC "PTLSTHS1"
+
+struct StateHashRecord {
+    W64 cycle;          /* end of the epoch */
+    W64 commits;        /* in the epoch */
+    W64 mem_events;     /* in the epoch */
+    W64 commit_hash;
+    W64 mem_hash;
+    W64 stats_hash;
+};
+
+struct StateHash {
+    W64 commit_hash;
+    W64 mem_hash;
+    W64 stats_hash;
+    W64 commits;
+    W64 mem_events;
+
+    StateHash() { reset(); }
+
+    void reset()
+    {
+        commit_hash = mem_hash = stats_hash = 14695981039346656037ULL;
+        commits = mem_events = 0;
+    }
+
+    /* Order sensitive, every bit of v reaches every bit of the result */
+    static W64 mix(W64 h, W64 v)
+    {
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void commit(W64 cycle, int ctx, W64 rip, W64 insns)
+    {
+        commit_hash = mix(mix(mix(commit_hash, cycle), ctx), rip);
+        if unlikely (insns != 1)
+            commit_hash = mix(commit_hash, insns);
+        commits += insns;
+    }
+
+    void mem_event(W64 cycle, int controller, W64 addr, int type)
+    {
+        mem_hash = mix(mix(mix(mix(mem_hash, cycle), controller), addr),
+                type);
+        mem_events++;
+    }
+
+    void stat(W64 value)
+    {
+        stats_hash = mix(stats_hash, value);
+    }
+
+    /* Record of the epoch ending at cycle, the counts start over */
+    StateHashRecord end_epoch(W64 cycle)
+    {
+        StateHashRecord rec;
+        rec.cycle = cycle;
+        rec.commits = commits;
+        rec.mem_events = mem_events;
+        rec.commit_hash = commit_hash;
+        rec.mem_hash = mem_hash;
+        rec.stats_hash = stats_hash;
+        commits = mem_events = 0;
+        return rec;
+    }
+};
+
+/* Checked by the commit and controller paths before calling in here */
+extern bool state_hash_enabled;
+
+bool state_hash_open(const char *filename, W64 period);
+void state_hash_close();
+
+void state_hash_commit(int ctx, W64 rip, W64 insns=1);
+void state_hash_mem_event(int controller, W64 addr, int type);
+
+struct BaseMachine;
+
+/* Writes the epoch's record once its period has passed */
+void state_hash_clock(BaseMachine &machine);
+
+#endif // STATEHASH_H
@@ -0,0 +1,84 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <storage.h>
+#include <ptlsim.h>
+#include <ptl-qemu.h>
+
+bool storage_model_enabled = false;
+
+static StorageModel storage_model;
+static StorageStats storage_stats;
+
+void storage_model_configure()
+{
+    /* Requests in flight keep their done cycles until the options change */
+    static stringbuf applied;
+    stringbuf options;
+
+    storage_model_enabled = config.storage_model;
+    if (!storage_model_enabled)
+        return;
+
+    storage_stats.enable_dump();
+
+    options << config.core_freq_hz, " ", config.storage_read_ns, " ",
+            config.storage_write_ns, " ", config.storage_mbps, " ",
+            config.storage_channels, " ", config.storage_queue_depth, " ",
+            config.storage_tail_rate, " ", config.storage_tail_factor;
+    if (applied == options)
+        return;
+    applied = options;
+
+    double mbps = max(config.storage_mbps, W64(1));
+    storage_model.setup(ns_to_simcycles(config.storage_read_ns),
+            ns_to_simcycles(config.storage_write_ns),
+            double(config.core_freq_hz) / (mbps * 1e6),
+            config.storage_channels, config.storage_queue_depth,
+            config.storage_tail_rate, config.storage_tail_factor);
+}
+
+extern "C" uint64_t storage_io_submit(int is_write, uint64_t bytes)
+{
+    if (!storage_model_enabled || !in_simulation)
+        return 0;
+
+    W64 wait;
+    bool tail;
+    W64 done = storage_model.submit(sim_cycle, is_write, bytes, wait, tail);
+
+    if (is_write) {
+        storage_stats.writes(kernel_stats)++;
+        storage_stats.written_bytes(kernel_stats) += bytes;
+    } else {
+        storage_stats.reads(kernel_stats)++;
+        storage_stats.read_bytes(kernel_stats) += bytes;
+    }
+    storage_stats.wait_cycles(kernel_stats) += wait;
+    if (tail)
+        storage_stats.tail(kernel_stats)++;
+    storage_stats.latency(kernel_stats).record(done - sim_cycle);
+
+    return max(done, W64(1));
+}
+
+extern "C" int storage_io_complete(uint64_t done_cycle)
+{
+    if (!done_cycle || !in_simulation)
+        return 0;
+
+    if (done_cycle <= sim_cycle) {
+        if (done_cycle < sim_cycle)
+            storage_stats.late(kernel_stats)++;
+        return 0;
+    }
+
+    return int(min(done_cycle - sim_cycle, W64(0x7fffffff)));
+}
@@ -0,0 +1,171 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <statsBuilder.h>
+
+/*
+ * Timing of guest block IO in simulation ('-storage-model')
+ *
+ * QEMU still reads and writes the disk image, but the IDE and virtio-blk
+ * completion interrupts reach the guest when the modeled SSD would have
+ * finished the request, in simulated cycles, instead of when the host did.
+ *
+ * A request waits for a free slot once 'queue depth' requests are in
+ * flight, then for the first free of 'channels' flash units, which is busy
+ * for the read or write latency. One in 'tail rate' requests takes 'tail
+ * factor' times that latency, picked by a seeded generator so reruns
+ * from a checkpoint see the same ones. The data then moves over the
+ * device link at its bandwidth, one request after another. A completion
+ * the host delivers after its modeled cycle is passed on at once and
+ * counted as late.
+ */
+struct StorageModel {
+    W64 readCycles;
+    W64 writeCycles;
+    double cyclesPerByte;
+    int channels;
+    int queueDepth;
+    double tailRate;
+    W64 tailFactor;
+
+    dynarray<W64> channelBusy;
+    dynarray<W64> slots;        /* done cycle of each request in flight */
+    W64 linkBusy;
+    W64 seed;
+
+    StorageModel()
+        : readCycles(0), writeCycles(0), cyclesPerByte(0), channels(1)
+          , queueDepth(1), tailRate(0), tailFactor(1)
+    {
+        reset();
+    }
+
+    void setup(W64 read_cycles, W64 write_cycles, double cycles_per_byte,
+            int channels_, int queue_depth, double tail_rate,
+            W64 tail_factor)
+    {
+        readCycles = read_cycles;
+        writeCycles = write_cycles;
+        cyclesPerByte = cycles_per_byte;
+        channels = max(channels_, 1);
+        queueDepth = max(queue_depth, 1);
+        tailRate = tail_rate;
+        tailFactor = max(tail_factor, W64(1));
+        reset();
+    }
+
+    void reset()
+    {
+        channelBusy.resize(channels);
+        slots.resize(queueDepth);
+        foreach (i, channels)
+            channelBusy[i] = 0;
+        foreach (i, queueDepth)
+            slots[i] = 0;
+        linkBusy = 0;
+        seed = 0x9e3779b97f4a7c15ULL;
+    }
+
+    /* xorshift64*, uniform in [0, 1) */
+    double random()
+    {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return double((seed * 2685821657736338717ULL) >> 11) /
+            double(1ULL << 53);
+    }
+
+    static int earliest(const dynarray<W64> &busy)
+    {
+        int first = 0;
+        foreach (i, busy.length) {
+            if (busy[i] < busy[first])
+                first = i;
+        }
+        return first;
+    }
+
+    /*
+     * Done cycle of a request of bytes issued at cycle, wait is set to the
+     * cycles it waited for a queue slot and a channel, tail to whether it
+     * took the tail latency
+     */
+    W64 submit(W64 cycle, bool is_write, W64 bytes, W64 &wait, bool &tail)
+    {
+        int slot = earliest(slots);
+        int channel = earliest(channelBusy);
+        W64 start = max(max(cycle, slots[slot]), channelBusy[channel]);
+
+        W64 latency = is_write ? writeCycles : readCycles;
+        tail = (tailRate > 0) && (random() < tailRate);
+        if (tail)
+            latency *= tailFactor;
+
+        channelBusy[channel] = start + latency;
+
+        W64 transfer = W64(cyclesPerByte * double(bytes));
+        W64 link_start = max(start + latency, linkBusy);
+        linkBusy = link_start + transfer;
+
+        slots[slot] = linkBusy;
+        wait = start - cycle;
+        return linkBusy;
+    }
+};
+
+/*
+ * Written at the top level, as kernel counters since the guest kernel
+ * issues all block IO:
+ *
+ *   storage:
+ *     reads: .., writes: .., read_bytes: .., written_bytes: ..,
+ *     wait_cycles: .., tail: .., late: ..,
+ *     latency: {count: .., ..}
+ *
+ * latency is from issue to the modeled completion, in cycles.
+ */
+struct StorageStats : public Statable
+{
+    StatObj<W64> reads;
+    StatObj<W64> writes;
+    StatObj<W64> read_bytes;
+    StatObj<W64> written_bytes;
+    StatObj<W64> wait_cycles;
+    StatObj<W64> tail;
+    StatObj<W64> late;
+    StatHistogram<6, 3, 26> latency;
+
+    StorageStats()
+        : Statable("storage")
+          , reads("reads", this)
+          , writes("writes", this)
+          , read_bytes("read_bytes", this)
+          , written_bytes("written_bytes", this)
+          , wait_cycles("wait_cycles", this)
+          , tail("tail", this)
+          , late("late", this)
+          , latency("latency", this)
+    {
+        disable_dump();
+    }
+};
+
+extern bool storage_model_enabled;
+
+/* Model from the -storage-* options, reset when they change */
+void storage_model_configure();
+
+#endif // STORAGE_H
@@ -0,0 +1,231 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <telemetry.h>
+#include <ptl-telemetry.h>
+#include <ptlsim.h>
+#include <machine.h>
+#include <basecore.h>
+#include <statsBuilder.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+static MarssTelemetry *telemetry_page = NULL;
+
+/* Stats are looked up at the first update, once the machine has them */
+static stringbuf telemetry_stat_names;
+static bool telemetry_stats_resolved = false;
+static dynarray<StatObjBase*> telemetry_stats;
+static Stats *telemetry_total = NULL;
+
+static W64 telemetry_last_cycle = 0;
+static W64 telemetry_last_insns[MARSS_TELEMETRY_MAX_CORES];
+
+static W64 telemetry_time_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (W64(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void begin_write()
+{
+    telemetry_page->sequence++;
+    __sync_synchronize();
+}
+
+static void end_write()
+{
+    __sync_synchronize();
+    telemetry_page->sequence++;
+}
+
+static void copy_name(char *dest, const char *src)
+{
+    strncpy(dest, src, MARSS_TELEMETRY_NAME_SIZE - 1);
+    dest[MARSS_TELEMETRY_NAME_SIZE - 1] = 0;
+}
+
+bool telemetry_setup(const char *filename, const char *stat_names)
+{
+    if (telemetry_page)
+        return true;
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        ptl_logfile << "Telemetry: unable to open ", filename, ": ",
+                    strerror(errno), endl, flush;
+        return false;
+    }
+
+    /* Also clears the page of an earlier simulation */
+    if (ftruncate(fd, 0) == -1 ||
+            ftruncate(fd, sizeof(MarssTelemetry)) == -1) {
+        ptl_logfile << "Telemetry: unable to size ", filename, ": ",
+                    strerror(errno), endl, flush;
+        close(fd);
+        return false;
+    }
+
+    void *addr = mmap(NULL, sizeof(MarssTelemetry), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        ptl_logfile << "Telemetry: unable to map ", filename, ": ",
+                    strerror(errno), endl, flush;
+        return false;
+    }
+
+    telemetry_page = (MarssTelemetry*)addr;
+    telemetry_stat_names.reset();
+    telemetry_stat_names << stat_names;
+
+    begin_write();
+    telemetry_page->pid = getpid();
+    telemetry_page->state = MARSS_TELEMETRY_STARTING;
+    telemetry_page->start_ns = telemetry_time_ns();
+    telemetry_page->update_ns = telemetry_page->start_ns;
+    copy_name(telemetry_page->machine, config.machine_config.buf);
+    telemetry_page->magic = MARSS_TELEMETRY_MAGIC;
+    end_write();
+
+    ptl_logfile << "Telemetry: writing to ", filename, endl;
+    return true;
+}
+
+static void resolve_stats()
+{
+    telemetry_stats_resolved = true;
+
+    dynarray<stringbuf*> names;
+    char split[] = ",";
+    telemetry_stat_names.split(names, split);
+
+    bool derived = false;
+
+    foreach (i, names.count()) {
+        StatObjBase *obj = StatsBuilder::get().get_stat_obj(names[i]->buf);
+
+        if (!obj || !obj->is_number()) {
+            ptl_logfile << "Telemetry: no stat '", *names[i], "'", endl;
+        } else if (telemetry_stats.count() == MARSS_TELEMETRY_MAX_STATS) {
+            ptl_logfile << "Telemetry: more than ",
+                        MARSS_TELEMETRY_MAX_STATS, " stats, '", *names[i],
+                        "' is left out", endl;
+        } else {
+            copy_name(telemetry_page->stats[telemetry_stats.count()].name,
+                    names[i]->buf);
+            telemetry_stats.push(obj);
+            derived |= obj->is_derived();
+        }
+
+        delete names[i];
+    }
+
+    /* Derived stats don't add up, they are computed from the total */
+    if (derived)
+        telemetry_total = StatsBuilder::get().get_new_stats();
+}
+
+static double stat_value(StatObjBase *obj)
+{
+    double user = 0;
+    double kernel = 0;
+
+    if (obj->is_derived()) {
+        obj->get_number(telemetry_total, user);
+        return user;
+    }
+
+    obj->get_number(user_stats, user);
+    obj->get_number(kernel_stats, kernel);
+    return user + kernel;
+}
+
+void telemetry_update(double cycles_per_sec, double insns_per_sec)
+{
+    if (!telemetry_page)
+        return;
+
+    if unlikely (!telemetry_stats_resolved)
+        resolve_stats();
+
+    if (telemetry_total) {
+        *telemetry_total = *user_stats;
+        StatsBuilder::get().add_stats(*telemetry_total, *kernel_stats);
+    }
+
+    BaseMachine *machine = (BaseMachine*)PTLsimMachine::getmachine(
+            config.core_name.buf);
+    int cores = machine ? min(int(machine->cores.count()),
+            int(MARSS_TELEMETRY_MAX_CORES)) : 0;
+    W64 cycles = sim_cycle - telemetry_last_cycle;
+
+    begin_write();
+
+    telemetry_page->state = MARSS_TELEMETRY_RUNNING;
+    telemetry_page->updates++;
+    telemetry_page->update_ns = telemetry_time_ns();
+    telemetry_page->sim_cycle = sim_cycle;
+    telemetry_page->insns = total_insns_committed;
+    telemetry_page->kips = insns_per_sec / 1000.0;
+    telemetry_page->cycles_per_sec = cycles_per_sec;
+
+    telemetry_page->num_cores = cores;
+    foreach (i, cores) {
+        W64 insns = machine->cores[i]->committed_insns;
+        telemetry_page->core_insns[i] = insns;
+        telemetry_page->core_ipc[i] = cycles ?
+            double(insns - telemetry_last_insns[i]) / double(cycles) : 0;
+        telemetry_last_insns[i] = insns;
+    }
+
+    telemetry_page->num_stats = telemetry_stats.count();
+    foreach (i, telemetry_stats.count())
+        telemetry_page->stats[i].value = stat_value(telemetry_stats[i]);
+
+    end_write();
+
+    telemetry_last_cycle = sim_cycle;
+}
+
+void telemetry_done()
+{
+    if (!telemetry_page)
+        return;
+
+    begin_write();
+    telemetry_page->state = MARSS_TELEMETRY_DONE;
+    telemetry_page->update_ns = telemetry_time_ns();
+    telemetry_page->sim_cycle = sim_cycle;
+    telemetry_page->insns = total_insns_committed;
+    end_write();
+}
+
+void telemetry_remove()
+{
+    if (!telemetry_page)
+        return;
+
+    /* The page stays, so the manager sees the simulator has exited */
+    begin_write();
+    telemetry_page->state = MARSS_TELEMETRY_EXITED;
+    telemetry_page->update_ns = telemetry_time_ns();
+    end_write();
+
+    munmap(telemetry_page, sizeof(MarssTelemetry));
+    telemetry_page = NULL;
+}
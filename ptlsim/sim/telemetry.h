@@ -0,0 +1,42 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/*
+ * Live telemetry of a running simulation ('-telemetry <file>')
+ *
+ * Keeps a MarssTelemetry page (see ptl-telemetry.h) in a shared mapping
+ * of the file up to date: sim_cycle, commits, KIPS and the IPC of each
+ * core, and the '-telemetry-stats' stats, a comma separated list of names
+ * as StatsBuilder::get_stat_obj() takes them, formulas included. It is
+ * updated along with the progress line, so it costs nothing per cycle.
+ */
+
+/* Map the page, false if the file can't be mapped */
+bool telemetry_setup(const char *filename, const char *stat_names);
+
+/**
+ * @brief Rewrite the page, from the progress line
+ *
+ * @param cycles_per_sec Simulated cycles per host second since the last one
+ * @param insns_per_sec Committed instructions per host second since then
+ */
+void telemetry_update(double cycles_per_sec, double insns_per_sec);
+
+/* Simulation is done, or the simulator exits and unmaps the page */
+void telemetry_done();
+void telemetry_remove();
+
+#endif // TELEMETRY_H
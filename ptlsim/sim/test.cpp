@@ -5,6 +5,7 @@
 
 #include <gtest/gtest.h>
 #include <iostream>
+#include <string>
 
 using namespace std;
 
@@ -24,6 +25,25 @@ void run_tests()
     exit(0);
 }
 
+void run_benchmarks(const char *report)
+{
+    char name[] = "none";
+    char filter[] = "--gtest_filter=DISABLED_Bench.*";
+    char disabled[] = "--gtest_also_run_disabled_tests";
+    string output = string("--gtest_output=xml:") + report;
+    char *argv[4] = { name, filter, disabled, (char*)output.c_str() };
+    int argc = 4;
+
+    ::testing::InitGoogleTest(&argc, argv);
+    bool failed = RUN_ALL_TESTS();
+    if (failed)
+        cout << "Benchmarks failed\n";
+    else
+        cout << "Benchmarks written to " << report << "\n";
+
+    exit(failed);
+}
+
 #else
 
 void run_tests()
@@ -31,4 +51,9 @@ void run_tests()
     return;
 }
 
+void run_benchmarks(const char *report)
+{
+    return;
+}
+
 #endif
@@ -10,4 +10,15 @@
  */
 void run_tests();
 
+/**
+ * @brief Run host-performance benchmarks of core data structures
+ *
+ * @param report File gtest's XML report with 'ns_per_op' of each
+ * benchmark is written to
+ *
+ * Only runs the DISABLED_Bench tests, which run_tests() skips, and exits
+ * when they are done.
+ */
+void run_benchmarks(const char *report);
+
 #endif // MARSS_TEST_H
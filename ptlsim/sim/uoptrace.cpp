@@ -0,0 +1,576 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <uoptrace.h>
+#include <machine.h>
+#include <ptlsim.h>
+#include <memoryHierarchy.h>
+#include <branchpred.h>
+#include <ptl-qemu.h>
+
+using namespace Memory;
+
+namespace {
+
+    const W64 NO_UOP = W64(-1);
+
+    enum { SLOT_WAITING, SLOT_MISSED, SLOT_DONE };
+
+    struct ReplaySlot {
+        W64 seq;
+        W64 done;           /* Cycle the result is ready, once SLOT_DONE */
+        W64 src[3];         /* Producers of ra, rb and rc */
+        W32 rec;
+        W8 state;
+        bool mispredicted;
+        PredictorUpdate predinfo;
+    };
+
+    struct ReplayCore {
+        const dynarray<W32> *recs;  /* Record numbers of this core */
+        W64 next;                   /* Index into recs */
+        dynarray<ReplaySlot> window;
+        W64 head;                   /* Oldest uop in the window */
+        W64 tail;                   /* Next uop fetched */
+        W64 writer[TRANSREG_COUNT]; /* Last uop fetched writing each */
+        W64 fetch_resume;
+        W64 blocked_by;             /* Mispredicted branch not executed */
+        BranchPredictorInterface branchpred;
+        W64 insns;
+        W64 done_cycle;
+    };
+
+    struct ReplayStats {
+        W64 uops;
+        W64 loads;
+        W64 stores;
+        W64 branches;
+        W64 mispredicts;
+        W64 fast_hits;
+        W64 misses;
+        W64 completed;
+        W64 latency_sum;
+        W64 forwarded;
+        W64 bank_conflicts;
+        W64 stalls;
+        W64 redirect_cycles;
+    };
+
+    dynarray<ReplayCore*> replay_cores;
+    ReplayStats replay_stats;
+
+    /* Called when a load that missed the fast path completes */
+    bool replay_done(void *arg)
+    {
+        MemoryRequest *request = (MemoryRequest*)arg;
+
+        if (request->get_type() == MEMORY_OP_WRITE)
+            return true;
+
+        ReplayCore &rc = *replay_cores[request->get_coreid()];
+        W64 seq = request->get_owner_uuid();
+        ReplaySlot &slot = rc.window[seq % rc.window.length];
+        assert(slot.seq == seq && slot.state == SLOT_MISSED);
+
+        slot.state = SLOT_DONE;
+        slot.done = sim_cycle;
+        replay_stats.completed++;
+        replay_stats.latency_sum += sim_cycle - request->get_init_cycles();
+
+        return true;
+    }
+
+    /* Producer written its result by now */
+    bool src_ready(const ReplayCore &rc, W64 seq)
+    {
+        if (seq == NO_UOP || seq < rc.head) return true;
+        const ReplaySlot &p = rc.window[seq % rc.window.length];
+        return p.state == SLOT_DONE && p.done <= sim_cycle;
+    }
+
+    W64 src_of(const ReplayCore &rc, int reg)
+    {
+        switch (reg) {
+            case REG_zero: case REG_imm: case REG_mem: case REG_rip:
+                return NO_UOP;
+        }
+        return rc.writer[reg];
+    }
+
+    /*
+     * Older store of the same address still in the window, else NULL: the
+     * load takes its data from it as it would from the store queue
+     */
+    const ReplaySlot* older_store(const ReplayCore &rc,
+            const UopTraceFile &trace, const ReplaySlot &load)
+    {
+        W64 addr = trace.records[load.rec].addr;
+
+        for (W64 seq = load.seq; seq-- > rc.head;) {
+            const ReplaySlot &s = rc.window[seq % rc.window.length];
+            const UopTraceRecord &r = trace.records[s.rec];
+            if ((trace.statics[r.sid].flags & UOPTRACE_STORE) &&
+                    r.addr == addr)
+                return &s;
+        }
+        return NULL;
+    }
+
+    /* Returns false if the slot can't issue this cycle */
+    bool issue(ReplayCore &rc, int coreid, const UopTraceFile &trace,
+            MemoryHierarchy *mem, ReplaySlot &slot, W64 redirect,
+            Signal &done_signal)
+    {
+        foreach (i, 3) {
+            if (!src_ready(rc, slot.src[i])) return false;
+        }
+
+        const UopTraceRecord &r = trace.records[slot.rec];
+        const UopTraceStatic &s = trace.statics[r.sid];
+        W64 latency = max(W64(s.latency), W64(1));
+
+        if (s.flags & UOPTRACE_LOAD) {
+            const ReplaySlot *st = older_store(rc, trace, slot);
+            if (st) {
+                if (!src_ready(rc, st->seq)) return false;
+                replay_stats.forwarded++;
+            } else {
+                int hit = mem->access_hit(coreid, r.threadid, r.addr, s.rip,
+                        slot.seq);
+                if (hit == CACHE_BANK_CONFLICT) {
+                    replay_stats.bank_conflicts++;
+                    return false;
+                }
+
+                if (hit > 0) {
+                    replay_stats.fast_hits++;
+                    latency = hit;
+                } else {
+                    if (!mem->is_cache_available(coreid, r.threadid, false)) {
+                        replay_stats.stalls++;
+                        return false;
+                    }
+
+                    MemoryRequest *request = mem->get_free_request(coreid);
+                    assert(request != NULL);
+                    request->init(coreid, r.threadid, r.addr, 0, sim_cycle,
+                            false, s.rip, slot.seq, MEMORY_OP_READ);
+                    request->set_coreSignal(&done_signal);
+
+                    slot.state = SLOT_MISSED;
+                    if (!mem->access_cache(request)) {
+                        replay_stats.misses++;
+                        return true;
+                    }
+                    replay_stats.fast_hits++;
+                }
+            }
+        }
+
+        slot.state = SLOT_DONE;
+        slot.done = sim_cycle + latency;
+
+        if (slot.mispredicted) {
+            rc.blocked_by = NO_UOP;
+            rc.fetch_resume = slot.done + redirect;
+        }
+        return true;
+    }
+
+    /* Returns false if the oldest uop can't commit this cycle */
+    bool commit(ReplayCore &rc, int coreid, const UopTraceFile &trace,
+            MemoryHierarchy *mem, Signal &done_signal)
+    {
+        if (rc.head == rc.tail) return false;
+
+        ReplaySlot &slot = rc.window[rc.head % rc.window.length];
+        if (slot.state != SLOT_DONE || slot.done > sim_cycle) return false;
+
+        const UopTraceRecord &r = trace.records[slot.rec];
+        const UopTraceStatic &s = trace.statics[r.sid];
+
+        if (s.flags & UOPTRACE_STORE) {
+            if (!mem->is_cache_available(coreid, r.threadid, false)) {
+                replay_stats.stalls++;
+                return false;
+            }
+
+            MemoryRequest *request = mem->get_free_request(coreid);
+            assert(request != NULL);
+            request->init(coreid, r.threadid, r.addr, 0, sim_cycle, false,
+                    s.rip, slot.seq, MEMORY_OP_WRITE);
+            request->set_coreSignal(&done_signal);
+            mem->access_cache(request);
+        }
+
+        if (s.flags & UOPTRACE_BRANCH)
+            rc.branchpred.update(slot.predinfo, s.rip + s.bytes, r.addr);
+
+        if (s.flags & UOPTRACE_EOM) rc.insns++;
+
+        replay_stats.uops++;
+        rc.head++;
+        return true;
+    }
+
+    /* Returns false if fetch ends this cycle */
+    bool fetch(ReplayCore &rc, const UopTraceFile &trace)
+    {
+        if (rc.next >= rc.recs->count() ||
+                rc.tail - rc.head >= rc.window.length)
+            return false;
+
+        W32 idx = (*rc.recs)[rc.next++];
+        const UopTraceRecord &r = trace.records[idx];
+        const UopTraceStatic &s = trace.statics[r.sid];
+
+        ReplaySlot &slot = rc.window[rc.tail % rc.window.length];
+        slot.seq = rc.tail++;
+        slot.rec = idx;
+        slot.state = SLOT_WAITING;
+        slot.done = 0;
+        slot.mispredicted = false;
+
+        slot.src[0] = src_of(rc, s.ra);
+        slot.src[1] = src_of(rc, s.rb);
+        slot.src[2] = src_of(rc, s.rc);
+
+        /* Branches and conditional uops read the flags as REG_zf and so on */
+        if (s.rd != REG_zero && s.rd != REG_rip)
+            rc.writer[s.rd] = slot.seq;
+        if (s.setflags & SETFLAG_ZF) rc.writer[REG_zf] = slot.seq;
+        if (s.setflags & SETFLAG_CF) rc.writer[REG_cf] = slot.seq;
+        if (s.setflags & SETFLAG_OF) rc.writer[REG_of] = slot.seq;
+
+        if (s.flags & UOPTRACE_LOAD) replay_stats.loads++;
+        if (s.flags & UOPTRACE_STORE) replay_stats.stores++;
+
+        if (!(s.flags & UOPTRACE_BRANCH)) return true;
+
+        replay_stats.branches++;
+        W64 ripafter = s.rip + s.bytes;
+        slot.predinfo.uuid = slot.seq;
+        slot.predinfo.ctxid = 0;
+        W64 predrip = rc.branchpred.predict(slot.predinfo, s.bptype,
+                ripafter, s.riptaken);
+        if (s.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET))
+            rc.branchpred.updateras(slot.predinfo, ripafter);
+
+        if (predrip != r.addr) {
+            replay_stats.mispredicts++;
+            slot.mispredicted = true;
+            rc.blocked_by = slot.seq;
+            return false;
+        }
+
+        /* A taken branch ends the fetch cycle */
+        return (predrip == ripafter);
+    }
+
+};
+
+W64 uoptrace_replay(BaseMachine& machine, PTLsimConfig& config)
+{
+    MemoryHierarchy *mem = machine.memoryHierarchyPtr;
+    int cores = machine.get_num_cores();
+
+    UopTraceFile trace;
+    const char *err = trace.open(config.uoptrace_file, cores);
+    if (err) {
+        ptl_logfile << "Uop trace ", config.uoptrace_file, ": ", err, endl,
+                    flush;
+        cerr << "Uop trace ", config.uoptrace_file, ": ", err, endl, flush;
+        return 0;
+    }
+
+    Signal done_signal("uoptrace_done");
+    done_signal.connect(signal_fun_ptr(replay_done));
+
+    int window = max(1, int(config.uoptrace_window));
+    int width = max(1, int(config.uoptrace_width));
+
+    replay_cores.resize(cores);
+    foreach (i, cores) {
+        ReplayCore *rc = new ReplayCore();
+        rc->recs = &trace.per_core[i];
+        rc->next = 0;
+        rc->window.resize(window);
+        rc->head = 0;
+        rc->tail = 0;
+        foreach (r, TRANSREG_COUNT) rc->writer[r] = NO_UOP;
+        rc->fetch_resume = 0;
+        rc->blocked_by = NO_UOP;
+        rc->branchpred.init(i, 0, config.uoptrace_predictor);
+        rc->insns = 0;
+        rc->done_cycle = 0;
+        replay_cores[i] = rc;
+    }
+    memset(&replay_stats, 0, sizeof(replay_stats));
+
+    W64 start_cycle = sim_cycle;
+    W64 tsc_at_start = rdtsc();
+
+    ptl_logfile << "Replaying ", trace.count, " uops (", trace.statics.count(),
+                " distinct) of ", config.uoptrace_file, endl, flush;
+
+    for (;;) {
+        bool pending = false;
+
+        foreach (i, cores) {
+            ReplayCore &rc = *replay_cores[i];
+
+            if (rc.next >= rc.recs->count() && rc.head == rc.tail) {
+                if (!rc.done_cycle)
+                    rc.done_cycle = max(sim_cycle, start_cycle + 1);
+                continue;
+            }
+            pending = true;
+
+            foreach (n, width) {
+                if (!commit(rc, i, trace, mem, done_signal)) break;
+            }
+
+            /* Oldest first, up to the width of uops a cycle */
+            int issued = 0;
+            for (W64 seq = rc.head; seq < rc.tail && issued < width; seq++) {
+                ReplaySlot &slot = rc.window[seq % window];
+                if (slot.state != SLOT_WAITING) continue;
+                if (issue(rc, i, trace, mem, slot, config.uoptrace_redirect,
+                            done_signal))
+                    issued++;
+            }
+
+            if (rc.blocked_by != NO_UOP || sim_cycle < rc.fetch_resume) {
+                replay_stats.redirect_cycles++;
+                continue;
+            }
+
+            foreach (n, width) {
+                if (!fetch(rc, trace)) break;
+            }
+        }
+
+        if unlikely (!pending)
+            break;
+
+        if (sim_cycle % 1000 == 0)
+            update_progress();
+
+        mem->clock();
+        sim_cycle++;
+
+        if unlikely (config.stop_at_cycle <= sim_cycle) {
+            ptl_logfile << "Stopping uop trace replay at specified "
+                        "limit (", sim_cycle, " cycles)", endl;
+            break;
+        }
+    }
+
+    double seconds = ticks_to_native_seconds(rdtsc() - tsc_at_start);
+    W64 cycles = sim_cycle - start_cycle;
+    W64 insns = 0;
+    foreach (i, cores) insns += replay_cores[i]->insns;
+
+    stringbuf sb;
+    sb << "Uop trace replay of ", config.uoptrace_file, ":", endl;
+    sb << "  uops ", replay_stats.uops, " of ", trace.count, ", insns ",
+       insns, " in ", cycles, " cycles, IPC ",
+       floatstring(cycles ? double(insns) / cycles : 0, 0, 3), endl;
+    sb << "  branches ", replay_stats.branches, ", mispredicts ",
+       replay_stats.mispredicts, ", fetch stopped ",
+       replay_stats.redirect_cycles, " core cycles", endl;
+    sb << "  loads ", replay_stats.loads, " (", replay_stats.fast_hits,
+       " hits, ", replay_stats.misses, " misses, ", replay_stats.forwarded,
+       " forwarded), average miss latency ",
+       floatstring(replay_stats.completed ?
+               double(replay_stats.latency_sum) / replay_stats.completed : 0,
+               0, 1),
+       " cycles, stores ", replay_stats.stores, endl;
+    sb << "  bank conflicts ", replay_stats.bank_conflicts,
+       ", controller full stalls ", replay_stats.stalls, endl;
+    foreach (i, cores) {
+        ReplayCore &rc = *replay_cores[i];
+        W64 core_cycles = (rc.done_cycle ? rc.done_cycle : sim_cycle) -
+            start_cycle;
+        sb << "  core ", i, ": ", rc.insns, " insns in ", core_cycles,
+           " cycles", (rc.done_cycle ? "" : " (not done)"), endl;
+    }
+    sb << "  host time ", floatstring(seconds, 0, 3), " seconds, ",
+       W64(seconds > 0 ? replay_stats.uops / seconds : 0), " uops/sec", endl;
+
+    ptl_logfile << sb, flush;
+    cerr << sb, flush;
+
+    foreach (i, cores) {
+        replay_cores[i]->branchpred.destroy();
+        delete replay_cores[i];
+    }
+    replay_cores.clear();
+    return cycles;
+}
+
+/*
+ * Capture of committed uops for later replay
+ */
+
+bool uoptrace_capturing = false;
+
+namespace {
+
+    struct CaptureWriter {
+        ofstream os;
+        UopTraceEncoder encoder;
+        dynarray<W8> payload;
+        dynarray<W8> packed;
+        int filled;
+        int block_records;
+
+        /* Index in its insn of the next uop of each core and thread */
+        W8 uop_index[256][256];
+
+        W64 records;
+        W64 written_bytes;
+    };
+
+    CaptureWriter *capture_writer = NULL;
+
+    template <typename T>
+    void put_raw(ostream &os, T v)
+    {
+        os.write((const char*)&v, sizeof(v));
+    }
+
+    void write_capture_block(CaptureWriter *w)
+    {
+        if (!w->filled) return;
+
+        uLongf packed_size = compressBound(w->payload.length);
+        w->packed.resize(packed_size);
+        if (compress2((Bytef*)w->packed.data, &packed_size,
+                    (const Bytef*)w->payload.data, w->payload.length,
+                    Z_BEST_SPEED) != Z_OK) {
+            /* Statics of the block are lost too, so the trace ends here */
+            ptl_logfile << "Failed to compress uop trace block, capture ",
+                        "stopped", endl;
+            uoptrace_capturing = false;
+            return;
+        }
+
+        put_raw(w->os, W32(w->filled));
+        put_raw(w->os, W32(w->payload.length));
+        put_raw(w->os, W32(packed_size));
+        w->os.write((const char*)w->packed.data, packed_size);
+
+        w->written_bytes += 12 + packed_size;
+        w->payload.clear();
+        w->filled = 0;
+    }
+
+};
+
+bool uoptrace_capture_open(const char *filename, int block_records)
+{
+    uoptrace_capture_close();
+
+    CaptureWriter *w = new CaptureWriter();
+    w->os.open(filename, std::ios_base::binary | std::ios_base::out |
+            std::ios_base::trunc);
+    if (!w->os) {
+        ptl_logfile << "Unable to open uop trace file ", filename, endl;
+        delete w;
+        return false;
+    }
+
+    w->block_records = max(block_records, 1);
+    w->filled = 0;
+    w->records = 0;
+    w->written_bytes = 8;
+    memset(w->uop_index, 0, sizeof(w->uop_index));
+
+    w->os.write(UOPTRACE_MAGIC, 8);
+
+    capture_writer = w;
+    uoptrace_capturing = true;
+    return true;
+}
+
+void uoptrace_capture(W8 coreid, W8 threadid, const TransOp& uop, W64 rip,
+        int latency, int bptype, W64 addr)
+{
+    CaptureWriter *w = capture_writer;
+
+    W8 &index = w->uop_index[coreid][threadid];
+    if (uop.som) index = 0;
+
+    UopTraceStatic s;
+    s.rip = rip;
+    s.opcode = uop.opcode;
+    s.size = uop.size;
+    s.rd = uop.rd;
+    s.ra = uop.ra;
+    s.rb = uop.rb;
+    s.rc = uop.rc;
+    s.setflags = uop.setflags;
+    s.latency = W8(min(latency, 255));
+    s.bytes = uop.bytes;
+    s.flags = (uop.som ? UOPTRACE_SOM : 0) | (uop.eom ? UOPTRACE_EOM : 0) |
+        (isload(uop.opcode) ? UOPTRACE_LOAD : 0) |
+        (isstore(uop.opcode) ? UOPTRACE_STORE : 0) |
+        (isbranch(uop.opcode) ? UOPTRACE_BRANCH : 0);
+    s.bptype = isbranch(uop.opcode) ? bptype : 0;
+    s.index = index++;
+
+    /*
+     * Fetch swaps the targets of conditional branches predicted not taken
+     * and puts the prediction in those of indirect ones, so the static is
+     * the same each time only with the taken target of the code
+     */
+    s.riptaken = 0;
+    if (isclass(uop.opcode, OPCLASS_COND_BRANCH)) {
+        s.riptaken = (uop.riptaken == rip + uop.bytes) ? uop.ripseq :
+            uop.riptaken;
+    } else if (isbranch(uop.opcode) &&
+            !isclass(uop.opcode, OPCLASS_INDIR_BRANCH)) {
+        s.riptaken = uop.riptaken;
+    }
+
+    if (!(s.flags & (UOPTRACE_LOAD | UOPTRACE_STORE | UOPTRACE_BRANCH)))
+        addr = 0;
+
+    w->encoder.put(w->payload, s, coreid, threadid, addr);
+    w->records++;
+
+    if unlikely (++w->filled == w->block_records)
+        write_capture_block(w);
+}
+
+void uoptrace_capture_close()
+{
+    CaptureWriter *w = capture_writer;
+    if (!w) return;
+
+    if (uoptrace_capturing)
+        write_capture_block(w);
+    uoptrace_capturing = false;
+    capture_writer = NULL;
+    w->os.close();
+
+    W64 raw_bytes = w->records * sizeof(UopTraceRecord) +
+        w->encoder.statics.count() * sizeof(UopTraceStatic);
+    ptl_logfile << "Uop trace capture: ", w->records, " uops of ",
+                w->encoder.statics.count(), " distinct, ", w->written_bytes,
+                " bytes written (",
+                floatstring(w->written_bytes ?
+                        double(raw_bytes) / w->written_bytes : 0, 0, 1),
+                "x smaller than unpacked)", endl;
+
+    w->encoder.reset();
+    delete w;
+}
@@ -0,0 +1,389 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef UOPTRACE_H
+#define UOPTRACE_H
+
+#include <globals.h>
+#include <superstl.h>
+#include <memtrace.h>
+
+struct BaseMachine;
+struct PTLsimConfig;
+struct TransOp;
+
+/*
+ * Committed uop traces, written by '-uoptrace-capture' and replayed by
+ * '-uoptrace':
+ *
+ *   "PTLUTRZ1", then blocks until end of file
+ *   block:  W32 records, W32 raw size, W32 compressed size,
+ *           zlib-compressed payload
+ *
+ * What a uop does is the same each time its instruction commits, so it is
+ * written once as a static uop, the first time its (rip, index in the
+ * instruction) commits, and later records refer to it by number. A record
+ * holds the core and thread bytes and the varint static number; a new
+ * number, one past the last defined, is followed by the static uop: the
+ * zigzag varint of its rip to the previous static's, the opcode, size,
+ * rd, ra, rb, rc, setflags, latency, instruction bytes, UOPTRACE_ flags,
+ * branch hint and index bytes, and for branches the zigzag varint of the
+ * taken target to the rip. Then come the zigzag varint of the physical
+ * address to the previous one of the core for loads and stores, and of
+ * the actual target to the rip for branches.
+ *
+ * Static numbers and previous values run on over the blocks, so blocks
+ * are decoded in file order.
+ */
+#define UOPTRACE_MAGIC "PTLUTRZ1"
+
+enum {
+    UOPTRACE_SOM    = (1 << 0),
+    UOPTRACE_EOM    = (1 << 1),
+    UOPTRACE_LOAD   = (1 << 2),
+    UOPTRACE_STORE  = (1 << 3),
+    UOPTRACE_BRANCH = (1 << 4),
+};
+
+/* What a uop does each time, registers are PTLsim arch registers */
+struct UopTraceStatic {
+    W64 rip;
+    W64 riptaken;   /* Taken target of branches */
+    W8 opcode;
+    W8 size;
+    W8 rd, ra, rb, rc;
+    W8 setflags;
+    W8 latency;     /* Of the recording core's functional unit */
+    W8 bytes;       /* Of the instruction */
+    W8 flags;
+    W8 bptype;      /* BRANCH_HINT_ bits */
+    W8 index;       /* In the instruction, 0 for its first uop */
+
+    bool same(const UopTraceStatic &s) const {
+        return rip == s.rip && riptaken == s.riptaken &&
+            opcode == s.opcode && size == s.size && rd == s.rd &&
+            ra == s.ra && rb == s.rb && rc == s.rc &&
+            setflags == s.setflags && latency == s.latency &&
+            bytes == s.bytes && flags == s.flags && bptype == s.bptype &&
+            index == s.index;
+    }
+};
+
+/* One committed uop */
+struct UopTraceRecord {
+    W64 addr;       /* Physical address, or target of branches */
+    W32 sid;        /* Static uop */
+    W8 coreid;
+    W8 threadid;
+    W16 pad;
+};
+
+/**
+ * @brief Pack committed uops into one block payload, see format above
+ *
+ * Statics are numbered in the order they are first seen and kept in
+ * 'statics' across blocks, with the previous values.
+ */
+struct UopTraceEncoder {
+    dynarray<UopTraceStatic> statics;
+    Hashtable<W64, W32, 16384> ids;
+    W64 prev_rip;
+    W64 prev_addr[256];
+
+    UopTraceEncoder() { reset(); }
+
+    void reset() {
+        statics.clear();
+        ids.clear(true);
+        prev_rip = 0;
+        memset(prev_addr, 0, sizeof(prev_addr));
+    }
+
+    static W64 key(const UopTraceStatic &s) {
+        return (s.rip << 6) ^ s.index;
+    }
+
+    void put(dynarray<W8> &payload, const UopTraceStatic &s, W8 coreid,
+            W8 threadid, W64 addr)
+    {
+        /* A rewritten instruction is defined again, later ones use it */
+        W32 *id = ids.get(key(s));
+        bool known = id && statics[*id].same(s);
+        W32 sid = known ? *id : W32(statics.length);
+
+        payload.push(coreid);
+        payload.push(threadid);
+        memtrace_put_varint(payload, sid);
+
+        if (!known) {
+            if (id) *id = sid;
+            else ids.add(key(s), sid);
+            statics.push(s);
+
+            memtrace_put_varint(payload, memtrace_zigzag(s.rip, prev_rip));
+            prev_rip = s.rip;
+            payload.push(s.opcode);
+            payload.push(s.size);
+            payload.push(s.rd);
+            payload.push(s.ra);
+            payload.push(s.rb);
+            payload.push(s.rc);
+            payload.push(s.setflags);
+            payload.push(s.latency);
+            payload.push(s.bytes);
+            payload.push(s.flags);
+            payload.push(s.bptype);
+            payload.push(s.index);
+            if (s.flags & UOPTRACE_BRANCH)
+                memtrace_put_varint(payload,
+                        memtrace_zigzag(s.riptaken, s.rip));
+        }
+
+        if (s.flags & (UOPTRACE_LOAD | UOPTRACE_STORE)) {
+            memtrace_put_varint(payload,
+                    memtrace_zigzag(addr, prev_addr[coreid]));
+            prev_addr[coreid] = addr;
+        } else if (s.flags & UOPTRACE_BRANCH) {
+            memtrace_put_varint(payload, memtrace_zigzag(addr, s.rip));
+        }
+    }
+};
+
+/**
+ * @brief Unpack one block payload, new statics are added to 'statics'
+ *
+ * @param prev_rip Rip of the last static, updated
+ * @param prev_addr Last load or store address of each core, updated
+ *
+ * @return false if payload is corrupt
+ */
+static inline bool uoptrace_decode_block(const W8 *p, const W8 *end,
+        int count, dynarray<UopTraceStatic> &statics, W64 &prev_rip,
+        W64 *prev_addr, UopTraceRecord *out)
+{
+    foreach (i, count) {
+        W64 sid, v;
+        if (end - p < 2) return false;
+
+        UopTraceRecord &r = out[i];
+        r.coreid = *p++;
+        r.threadid = *p++;
+        r.pad = 0;
+        r.addr = 0;
+
+        if (!memtrace_get_varint(p, end, sid) || sid > statics.length)
+            return false;
+
+        if (sid == statics.length) {
+            UopTraceStatic s;
+            if (!memtrace_get_varint(p, end, v) || end - p < 12)
+                return false;
+            s.rip = memtrace_unzigzag(v, prev_rip);
+            prev_rip = s.rip;
+            s.opcode = *p++;
+            s.size = *p++;
+            s.rd = *p++;
+            s.ra = *p++;
+            s.rb = *p++;
+            s.rc = *p++;
+            s.setflags = *p++;
+            s.latency = *p++;
+            s.bytes = *p++;
+            s.flags = *p++;
+            s.bptype = *p++;
+            s.index = *p++;
+            s.riptaken = 0;
+            if (s.flags & UOPTRACE_BRANCH) {
+                if (!memtrace_get_varint(p, end, v)) return false;
+                s.riptaken = memtrace_unzigzag(v, s.rip);
+            }
+            statics.push(s);
+        }
+
+        r.sid = W32(sid);
+        const UopTraceStatic &s = statics[r.sid];
+
+        if (s.flags & (UOPTRACE_LOAD | UOPTRACE_STORE)) {
+            if (!memtrace_get_varint(p, end, v)) return false;
+            r.addr = memtrace_unzigzag(v, prev_addr[r.coreid]);
+            prev_addr[r.coreid] = r.addr;
+        } else if (s.flags & UOPTRACE_BRANCH) {
+            if (!memtrace_get_varint(p, end, v)) return false;
+            r.addr = memtrace_unzigzag(v, s.rip);
+        }
+    }
+
+    return (p == end);
+}
+
+/**
+ * @brief Committed uop trace, unpacked into memory
+ */
+struct UopTraceFile {
+    dynarray<UopTraceStatic> statics;
+    UopTraceRecord *records;
+    W64 count;
+
+    /* Record numbers of each core, in trace order */
+    dynarray< dynarray<W32> > per_core;
+
+    UopTraceFile() : records(NULL), count(0) { }
+
+    ~UopTraceFile() { close(); }
+
+    /**
+     * @brief Read a trace written for a machine of 'cores' cores
+     *
+     * @return NULL if trace is usable, otherwise why it is not
+     */
+    const char* open(const char *filename, int cores)
+    {
+        close();
+
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return "can not open file";
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < 8) {
+            ::close(fd);
+            return "not a uop trace";
+        }
+
+        size_t size = st.st_size;
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return "can not mmap file";
+
+        const char *err = unpack((const W8*)map, size);
+        munmap(map, size);
+        if (err) return err;
+
+        if (count > 0xffffffffULL)
+            return "more than 2^32 records";
+
+        per_core.resize(cores);
+        foreach (i, cores) per_core[i].clear();
+
+        foreach (i, count) {
+            if (records[i].coreid >= cores)
+                return "record of core not in machine";
+            per_core[records[i].coreid].push(W32(i));
+        }
+
+        return NULL;
+    }
+
+    void close()
+    {
+        delete[] records;
+        records = NULL;
+        count = 0;
+        statics.clear();
+    }
+
+    private:
+
+    const char* unpack(const W8 *map, size_t size)
+    {
+        if (memcmp(map, UOPTRACE_MAGIC, 8) != 0)
+            return "not a uop trace";
+
+        const W8 *start = map + 8;
+        const W8 *end = map + size;
+        const int header = 12;
+
+        W64 total = 0;
+        for (const W8 *p = start; p < end;) {
+            W32 n, packed;
+            if (end - p < header) return "truncated block header";
+            memcpy(&n, p, 4);
+            memcpy(&packed, p + 8, 4);
+            p += header;
+            if (W64(end - p) < packed) return "truncated block";
+            p += packed;
+            total += n;
+        }
+
+        count = total;
+        records = new UopTraceRecord[max(count, W64(1))];
+
+        W64 prev_rip = 0;
+        W64 prev_addr[256];
+        memset(prev_addr, 0, sizeof(prev_addr));
+        dynarray<W8> raw;
+        UopTraceRecord *out = records;
+
+        for (const W8 *p = start; p < end;) {
+            W32 n, raw_size, packed;
+            memcpy(&n, p, 4);
+            memcpy(&raw_size, p + 4, 4);
+            memcpy(&packed, p + 8, 4);
+            p += header;
+
+            raw.resize(raw_size);
+            uLongf unpacked = raw_size;
+            if (uncompress((Bytef*)raw.data, &unpacked, (const Bytef*)p,
+                        packed) != Z_OK || unpacked != raw_size)
+                return "corrupt compressed block";
+
+            if (!uoptrace_decode_block(raw.data, raw.data + raw_size, n,
+                        statics, prev_rip, prev_addr, out))
+                return "corrupt block payload";
+
+            out += n;
+            p += packed;
+        }
+
+        return NULL;
+    }
+};
+
+/**
+ * @brief Replay '-uoptrace' file on a trace driven out-of-order model
+ *
+ * Each core fetches its recorded uops in order, '-uoptrace-width' a
+ * cycle, into a window of '-uoptrace-window' uops. They issue once their
+ * source registers are written, up to the width a cycle, and take their
+ * recorded latency. Loads are sent to the machine's memory hierarchy and
+ * stores sent at commit, as by the OOO core. Branches are predicted by
+ * a '-uoptrace-predictor' of each core; a mispredicted one stops fetch
+ * until it executes and '-uoptrace-redirect' cycles after. QEMU,
+ * the contexts and the decoder are not used, so one trace serves sweeps
+ * of the window, widths, predictors and memory hierarchy.
+ *
+ * @return Number of cycles simulated
+ */
+W64 uoptrace_replay(BaseMachine& machine, PTLsimConfig& config);
+
+/* Set while '-uoptrace-capture' is recording */
+extern bool uoptrace_capturing;
+
+/**
+ * @brief Start writing committed uops, 'block_records' per block
+ */
+bool uoptrace_capture_open(const char *filename, int block_records);
+
+/**
+ * @brief Record one committed uop of a core
+ *
+ * @param latency Of the functional unit the uop ran on
+ * @param bptype BRANCH_HINT_ bits of branches
+ * @param addr Physical address of loads and stores, actual target of
+ * branches
+ */
+void uoptrace_capture(W8 coreid, W8 threadid, const TransOp& uop, W64 rip,
+        int latency, int bptype, W64 addr);
+
+/**
+ * @brief Write out the last block and close the trace
+ */
+void uoptrace_capture_close();
+
+#endif // UOPTRACE_H
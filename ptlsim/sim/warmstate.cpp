@@ -0,0 +1,196 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <warmstate.h>
+#include <ptlsim.h>
+
+/* Longest section name, names are component names */
+#define WARM_STATE_MAX_NAME 256
+
+WarmState::WarmState()
+    : file_(NULL)
+      , saving_(false)
+      , data_(NULL)
+      , size_(0)
+      , capacity_(0)
+      , pos_(0)
+      , failed_(false)
+{
+}
+
+WarmState::~WarmState()
+{
+    close();
+    free(data_);
+}
+
+void WarmState::reserve(W64 size)
+{
+    if likely (size <= capacity_)
+        return;
+
+    capacity_ = max(size, max(capacity_ * 2, (W64)4096));
+    data_ = (byte*)realloc(data_, capacity_);
+    assert(data_);
+}
+
+bool WarmState::open_save(const char *filename)
+{
+    close();
+
+    file_ = gzopen(filename, "wb");
+    if (!file_) {
+        ptl_logfile << "Unable to open warm state file ", filename, endl;
+        return false;
+    }
+
+    W32 header[2] = {WARM_STATE_VERSION, 0};
+    gzwrite(file_, WARM_STATE_MAGIC, 8);
+    gzwrite(file_, header, sizeof(header));
+
+    saving_ = true;
+    return true;
+}
+
+bool WarmState::open_load(const char *filename)
+{
+    close();
+
+    file_ = gzopen(filename, "rb");
+    if (!file_) {
+        ptl_logfile << "Unable to open warm state file ", filename, endl;
+        return false;
+    }
+
+    char magic[8];
+    W32 header[2];
+    if (gzread(file_, magic, 8) != 8 || memcmp(magic, WARM_STATE_MAGIC, 8) ||
+            gzread(file_, header, sizeof(header)) != sizeof(header)) {
+        ptl_logfile << "Warm state file ", filename, " has a bad header", endl;
+        close();
+        return false;
+    }
+
+    if (header[0] != WARM_STATE_VERSION) {
+        ptl_logfile << "Warm state file ", filename, " has version ",
+                    header[0], ", expected ", WARM_STATE_VERSION, endl;
+        close();
+        return false;
+    }
+
+    saving_ = false;
+    return true;
+}
+
+void WarmState::close()
+{
+    if (!file_) return;
+
+    gzclose(file_);
+    file_ = NULL;
+}
+
+void WarmState::begin_section(const char *name)
+{
+    assert(saving_);
+
+    name_.reset();
+    name_ << name;
+    size_ = 0;
+    failed_ = false;
+}
+
+/* Sections with nothing in them are not written */
+void WarmState::end_section()
+{
+    assert(saving_);
+
+    if (!size_) return;
+
+    W32 length = strlen(name_.buf);
+    gzwrite(file_, &length, sizeof(length));
+    gzwrite(file_, name_.buf, length);
+    gzwrite(file_, &size_, sizeof(size_));
+    gzwrite(file_, data_, size_);
+}
+
+bool WarmState::next_section()
+{
+    assert(!saving_);
+
+    W32 length;
+    if (gzread(file_, &length, sizeof(length)) != sizeof(length))
+        return false;
+
+    char name[WARM_STATE_MAX_NAME];
+    W64 size;
+
+    if (length >= WARM_STATE_MAX_NAME ||
+            gzread(file_, name, length) != (int)length ||
+            gzread(file_, &size, sizeof(size)) != sizeof(size)) {
+        ptl_logfile << "Warm state file is truncated", endl;
+        return false;
+    }
+    name[length] = '\0';
+
+    reserve(size);
+    if (gzread(file_, data_, size) != (int)size) {
+        ptl_logfile << "Warm state file is truncated in ", name, endl;
+        return false;
+    }
+
+    name_.reset();
+    name_ << name;
+    size_ = size;
+    pos_ = 0;
+    failed_ = false;
+
+    return true;
+}
+
+void WarmState::raw(void *data, W64 size)
+{
+    if (saving_) {
+        reserve(size_ + size);
+        memcpy(data_ + size_, data, size);
+        size_ += size;
+        return;
+    }
+
+    if unlikely (failed_ || pos_ + size > size_) {
+        failed_ = true;
+        return;
+    }
+
+    memcpy(data, data_ + pos_, size);
+    pos_ += size;
+}
+
+void WarmState::expect(W32 v)
+{
+    W32 saved = v;
+    raw(&saved, sizeof(saved));
+
+    if unlikely (!saving_ && saved != v)
+        failed_ = true;
+}
+
+void WarmState::blob(void *data, W32 size)
+{
+    W32 saved = size;
+    raw(&saved, sizeof(saved));
+
+    if unlikely (!saving_ && saved != size) {
+        failed_ = true;
+        return;
+    }
+
+    raw(data, size);
+}
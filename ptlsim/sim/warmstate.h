@@ -0,0 +1,107 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef WARMSTATE_H
+#define WARMSTATE_H
+
+#include <globals.h>
+#include <superstl.h>
+
+#include <zlib.h>
+
+/*
+ * Warm microarchitectural state ('-warm-state-dir', '-warm-state')
+ *
+ * QEMU checkpoints only hold architectural state, so every run from a
+ * checkpoint starts with cold caches, directory, TLBs and branch
+ * predictors. With '-warm-state-dir' each checkpoint created while a
+ * machine simulates also gets <dir>/<checkpoint>.warm with that state,
+ * and '-warm-state <file>' loads it into the machine when simulation
+ * starts. Requests in flight when the checkpoint was taken are not kept.
+ *
+ * File format, gzip compressed:
+ *
+ *   "PTLWARM1", W32 version, W32 pad
+ *   sections until end of file:
+ *     W32 name length, name, W64 payload size, payload
+ *
+ * Each core and controller of the machine writes one section named after
+ * it (see BaseCore::transfer_warm_state and
+ * Controller::transfer_warm_state), whose payload is a sequence of values
+ * and of blobs that start with their W32 size. Caches only write the tag
+ * and coherence state of their valid lines. Sections of components the
+ * machine doesn't have are skipped, and so is the rest of a section from
+ * the first blob whose size doesn't match, like a TLB or predictor of a
+ * build with other sizes. Bump WARM_STATE_VERSION when a payload layout
+ * changes, files of other versions are not loaded.
+ *
+ * Checkpoints of '-periodic-checkpoint-cycles' are resumable: their file
+ * starts with a 'simulation' section holding the global counters, the
+ * Stats and the log and time-stats offsets (see
+ * transfer_simulation_state), and loading it continues the simulation
+ * where the checkpoint was taken instead of starting it.
+ */
+#define WARM_STATE_MAGIC "PTLWARM1"
+#define WARM_STATE_VERSION 1
+
+class WarmState {
+    private:
+        gzFile file_;
+        bool saving_;
+
+        /* Payload of the current section */
+        byte *data_;
+        W64 size_;
+        W64 capacity_;
+        W64 pos_;
+
+        stringbuf name_;
+        bool failed_;
+
+        void reserve(W64 size);
+
+    public:
+        WarmState();
+        ~WarmState();
+
+        bool open_save(const char *filename);
+        bool open_load(const char *filename);
+        void close();
+
+        bool saving() const { return saving_; }
+
+        /* Saving: start a section, written by end_section() */
+        void begin_section(const char *name);
+        void end_section();
+
+        /* Loading: read the next section, false at end of file */
+        bool next_section();
+
+        const char* section_name() const { return name_.buf; }
+
+        /* False once a read ran past the section or a blob size didn't
+         * match, all later reads of the section do nothing */
+        bool ok() const { return !failed_; }
+
+        /* Saving writes 'size' bytes, loading reads them */
+        void raw(void *data, W64 size);
+
+        /* Same with the size written before, loading checks it */
+        void blob(void *data, W32 size);
+
+        /* Saving writes 'v', loading fails unless it reads 'v', for counts
+         * of the structures that follow */
+        void expect(W32 v);
+
+        template <typename T> void value(T &v) { raw(&v, sizeof(T)); }
+        template <typename T> void object(T &v) { blob(&v, sizeof(T)); }
+};
+
+#endif // WARMSTATE_H
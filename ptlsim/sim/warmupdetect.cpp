@@ -0,0 +1,223 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <warmupdetect.h>
+#include <machine.h>
+#include <basecore.h>
+#include <controller.h>
+
+WarmupDetector warmup_detector;
+
+const char* WarmupConvergence::metric_names[METRIC_COUNT] = {
+    "l1i", "l1d", "l2", "l3", "tlb", "branch",
+};
+
+static const char* cache_hit_stats[] = {
+    "cpurequest:count:hit:read:hit:hit",
+    "cpurequest:count:hit:read:hit:forward",
+    "cpurequest:count:hit:write:hit:hit",
+    "cpurequest:count:hit:write:hit:forward",
+};
+
+static const char* cache_miss_stats[] = {
+    "cpurequest:count:miss:read",
+    "cpurequest:count:miss:write",
+};
+
+void WarmupDetector::reset()
+{
+    convergence.reset();
+    active = false;
+    converged = false;
+    window_insns = 0;
+    start_insns = 0;
+    start_cycle = 0;
+    warmup_insns = 0;
+    warmup_cycles = 0;
+
+    foreach (i, caches.count())
+        delete caches[i];
+    caches.clear();
+}
+
+static StatObjBase* find_stat(Memory::Controller *cont, const char *stat)
+{
+    stringbuf name;
+    name << cont->get_name() << ":" << stat;
+    return StatsBuilder::get().get_stat_obj(name);
+}
+
+void WarmupDetector::start(BaseMachine& machine, PTLsimConfig& config)
+{
+    reset();
+
+    if (config.sample_interval) {
+        ptl_logfile << "ERROR: -warmup-detect can't be used with ",
+                    "-sample-interval, not detecting warmup", endl;
+        return;
+    }
+
+    convergence.history = clipto(int(config.warmup_detect_windows), 2,
+            int(WarmupConvergence::MAX_WINDOWS));
+    convergence.error = config.warmup_detect_error;
+
+    /* Caches are the controllers with stats of hits and misses, the CPU
+     * controllers have no get_stats() */
+    foreach (i, machine.controllers.count()) {
+        Memory::Controller *cont = machine.controllers[i];
+        int level = cont->level_;
+
+        if (level > Memory::L3_CACHE || !cont->get_stats())
+            continue;
+
+        CacheCounters *counters = new CacheCounters();
+        counters->metric = WarmupConvergence::METRIC_L1I +
+            (level - Memory::L1_I_CACHE);
+
+        foreach (j, sizeof(cache_hit_stats) / sizeof(char*)) {
+            StatObjBase *stat = find_stat(cont, cache_hit_stats[j]);
+            if (stat) counters->hits.push(stat);
+        }
+
+        foreach (j, sizeof(cache_miss_stats) / sizeof(char*)) {
+            StatObjBase *stat = find_stat(cont, cache_miss_stats[j]);
+            if (stat) counters->misses.push(stat);
+        }
+
+        if (counters->misses.empty()) {
+            delete counters;
+            continue;
+        }
+
+        caches.push(counters);
+    }
+
+    window_insns = max(config.warmup_detect_window, W64(1));
+    start_insns = total_insns_committed;
+    start_cycle = sim_cycle;
+    active = true;
+
+    W64 events[WarmupConvergence::METRIC_COUNT];
+    W64 misses[WarmupConvergence::METRIC_COUNT];
+    get_counts(machine, events, misses);
+    convergence.start(events, misses);
+
+    ptl_logfile << "Detecting warmup over windows of ", window_insns,
+                " insns, ", caches.count(), " caches", endl;
+}
+
+static W64 stat_value(StatObjBase *stat)
+{
+    double user = 0, kernel = 0;
+    stat->get_number(user_stats, user);
+    stat->get_number(kernel_stats, kernel);
+    return W64(user + kernel);
+}
+
+void WarmupDetector::get_counts(BaseMachine& machine, W64 *events,
+        W64 *misses) const
+{
+    foreach (i, WarmupConvergence::METRIC_COUNT) {
+        events[i] = 0;
+        misses[i] = 0;
+    }
+
+    foreach (i, caches.count()) {
+        const CacheCounters *counters = caches[i];
+        W64 miss = 0;
+
+        foreach (j, counters->hits.count())
+            events[counters->metric] += stat_value(counters->hits[j]);
+
+        foreach (j, counters->misses.count())
+            miss += stat_value(counters->misses[j]);
+
+        events[counters->metric] += miss;
+        misses[counters->metric] += miss;
+    }
+
+    Core::WarmupCounts counts;
+    setzero(counts);
+
+    foreach (i, machine.cores.count()) {
+        machine.cores[i]->get_warmup_counts(user_stats, counts);
+        machine.cores[i]->get_warmup_counts(kernel_stats, counts);
+    }
+
+    events[WarmupConvergence::METRIC_TLB] = counts.tlb_accesses;
+    misses[WarmupConvergence::METRIC_TLB] = counts.tlb_misses;
+    events[WarmupConvergence::METRIC_BRANCH] = counts.branches;
+    misses[WarmupConvergence::METRIC_BRANCH] = counts.mispredicts;
+}
+
+/**
+ * @brief Take a window once enough instructions are committed
+ *
+ * @return true once measurement started
+ */
+bool WarmupDetector::update(BaseMachine& machine, PTLsimConfig& config)
+{
+    W64 insns = total_insns_committed - start_insns;
+    if likely (insns < (convergence.windows + 1) * window_insns)
+        return false;
+
+    W64 events[WarmupConvergence::METRIC_COUNT];
+    W64 misses[WarmupConvergence::METRIC_COUNT];
+    get_counts(machine, events, misses);
+    converged = convergence.add_window(events, misses);
+
+    if (logable(1)) {
+        ptl_logfile << "Warmup window ", convergence.windows, " at ",
+                    insns, " insns:";
+        foreach (i, WarmupConvergence::METRIC_COUNT) {
+            double mean;
+            double spread = convergence.spread(i, mean);
+            if (spread >= 0)
+                ptl_logfile << " ", WarmupConvergence::metric_names[i],
+                            " ", mean, " +/- ", spread / 2;
+        }
+        ptl_logfile << endl;
+    }
+
+    if (!converged && !(config.warmup_detect_max &&
+                insns >= config.warmup_detect_max))
+        return false;
+
+    start_measurement(config);
+    return true;
+}
+
+void WarmupDetector::start_measurement(PTLsimConfig& config)
+{
+    active = false;
+    warmup_insns = total_insns_committed - start_insns;
+    warmup_cycles = sim_cycle - start_cycle;
+
+    /* Occupancy integrals up to now go with the warmup */
+    StatOccupancy::flush_all(sim_cycle);
+    user_stats->reset();
+    kernel_stats->reset();
+    StatsBuilder::get().reset_periodic();
+
+    if (config.warmup_detect_measure)
+        config.stop_at_insns = total_insns_committed +
+            config.warmup_detect_measure;
+
+    ptl_logfile << "Warmup ", (converged ? "converged" : "stopped"),
+                " after ", warmup_insns, " insns and ", warmup_cycles,
+                " cycles, stats reset and measurement started", endl;
+}
+
+ostream& WarmupDetector::report(ostream& os) const
+{
+    os << "Warmup: ", warmup_insns, " insns, ", warmup_cycles, " cycles, ",
+       convergence.windows, " windows, ",
+       (converged ? "converged" : "not converged"), endl;
+    return os;
+}
@@ -0,0 +1,186 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef WARMUP_DETECT_H
+#define WARMUP_DETECT_H
+
+#include <ptlsim.h>
+#include <statsBuilder.h>
+
+struct BaseMachine;
+struct PTLsimConfig;
+
+/**
+ * @brief Convergence of miss rates over the last windows
+ *
+ * Each window gives every metric's rate, misses over events since the
+ * window before. A metric with fewer than MIN_EVENTS events in a window
+ * has no rate there and does not hold convergence back, e.g. an L3 that
+ * is hardly used. The rates have converged once, over the last 'history'
+ * windows, the max - min of each metric is within 'error' of its mean or
+ * below min_spread(), 0.1% of the events, for rates close to 0.
+ */
+struct WarmupConvergence {
+    enum {
+        METRIC_L1I = 0,
+        METRIC_L1D,
+        METRIC_L2,
+        METRIC_L3,
+        METRIC_TLB,
+        METRIC_BRANCH,
+        METRIC_COUNT,
+    };
+
+    enum { MAX_WINDOWS = 64, MIN_EVENTS = 100 };
+
+    static const char* metric_names[METRIC_COUNT];
+
+    static double min_spread() { return 0.001; }
+
+    int history;
+    double error;
+
+    W64 last_events[METRIC_COUNT];
+    W64 last_misses[METRIC_COUNT];
+
+    /* Ring of the rates of the last MAX_WINDOWS windows, -1 if none */
+    double rates[MAX_WINDOWS][METRIC_COUNT];
+    W64 windows;
+
+    WarmupConvergence() : history(5), error(0.05) { reset(); }
+
+    void reset()
+    {
+        setzero(last_events);
+        setzero(last_misses);
+        windows = 0;
+    }
+
+    /* Counts are cumulative, start() takes the ones the first is after */
+    void start(const W64 *events, const W64 *misses)
+    {
+        foreach (i, METRIC_COUNT) {
+            last_events[i] = events[i];
+            last_misses[i] = misses[i];
+        }
+    }
+
+    /* Ends a window, returns true if the rates have converged */
+    bool add_window(const W64 *events, const W64 *misses)
+    {
+        double *window = rates[windows % MAX_WINDOWS];
+
+        foreach (i, METRIC_COUNT) {
+            W64 e = events[i] - last_events[i];
+            W64 m = misses[i] - last_misses[i];
+            window[i] = (e >= MIN_EVENTS) ? double(m) / double(e) : -1;
+            last_events[i] = events[i];
+            last_misses[i] = misses[i];
+        }
+
+        windows++;
+        return converged();
+    }
+
+    /* Max - min of a metric's rates over the last windows, -1 if none */
+    double spread(int metric, double &mean) const
+    {
+        double lo = 1, hi = 0, sum = 0;
+        int n = 0;
+        int last = min(W64(history), windows);
+
+        foreach (i, last) {
+            double r = rates[(windows - 1 - i) % MAX_WINDOWS][metric];
+            if (r < 0) continue;
+            lo = min(lo, r);
+            hi = max(hi, r);
+            sum += r;
+            n++;
+        }
+
+        mean = n ? sum / n : 0;
+        return n ? hi - lo : -1;
+    }
+
+    bool stable(int metric) const
+    {
+        double mean;
+        double s = spread(metric, mean);
+        return s <= min_spread() || s <= error * mean;
+    }
+
+    bool converged() const
+    {
+        if (windows < (W64)history)
+            return false;
+
+        foreach (i, METRIC_COUNT) {
+            if (!stable(i))
+                return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Detailed warmup until the miss rates of the machine converge
+ *
+ * With -warmup-detect the run is simulated in detail from the start with
+ * windows of '-warmup-detect-window' committed instructions. The metrics
+ * are the miss rates of the L1-I, L1-D, L2 and L3 cache controllers of
+ * each level summed up, of the TLBs and the mispredict rate of the branch
+ * predictors of the cores (BaseCore::get_warmup_counts). Once they have
+ * converged over '-warmup-detect-windows' windows, or after
+ * '-warmup-detect-max' instructions, all stats are reset and measurement
+ * starts. The insns and cycles warmup took are in 'simulator:warmup' of
+ * the stats.
+ */
+struct WarmupDetector {
+    WarmupConvergence convergence;
+
+    /* Still warming up, and if measurement started at convergence */
+    bool active;
+    bool converged;
+
+    W64 window_insns;
+    W64 start_insns;
+    W64 start_cycle;
+
+    /* Length of the warmup, once measurement started */
+    W64 warmup_insns;
+    W64 warmup_cycles;
+
+    WarmupDetector() { reset(); }
+
+    void reset();
+    void start(BaseMachine& machine, PTLsimConfig& config);
+
+    /* Called once per simulated cycle while active */
+    bool update(BaseMachine& machine, PTLsimConfig& config);
+
+    void get_counts(BaseMachine& machine, W64 *events, W64 *misses) const;
+    ostream& report(ostream& os) const;
+
+    private:
+
+    /* Hit and miss counters of a cache controller */
+    struct CacheCounters {
+        int metric;
+        dynarray<StatObjBase*> hits;
+        dynarray<StatObjBase*> misses;
+    };
+
+    dynarray<CacheCounters*> caches;
+
+    void start_measurement(PTLsimConfig& config);
+};
+
+extern WarmupDetector warmup_detector;
+
+#endif // WARMUP_DETECT_H
@@ -0,0 +1,89 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <energyModel.h>
+#include <statFormula.h>
+
+EnergyModel::~EnergyModel()
+{
+    foreach (i, events.count())
+        delete events[i];
+}
+
+void EnergyModel::add(const char *component, const char *stat, double nj)
+{
+    Event *event = new Event();
+    event->component << component;
+    event->stat << stat;
+    event->nj = nj;
+    events.push(event);
+}
+
+int EnergyModel::setup(int num_cores, W64 freq_hz)
+{
+    StatsBuilder &builder = StatsBuilder::get();
+    stringbuf total;
+    int count = 0;
+
+    foreach (i, events.count()) {
+        const char *component = events[i]->component.buf;
+
+        /* Events of a component are in one formula, at its first event */
+        bool seen = false;
+        foreach (j, i) {
+            if (strequal(events[j]->component.buf, component)) {
+                seen = true;
+                break;
+            }
+        }
+        if (seen) continue;
+
+        bool per_core = strchr(component, '$') != NULL;
+
+        foreach (core, (per_core ? num_cores : 1)) {
+            stringbuf id;
+            id << core;
+            stringbuf instance;
+            stringsubst(instance, component, "$", id.buf);
+
+            stringbuf expr;
+            for (int j = i; j < events.count(); j++) {
+                if (!strequal(events[j]->component.buf, component))
+                    continue;
+
+                if (!expr.empty()) expr << " + ";
+                expr << events[j]->nj << " * " << instance << ":" <<
+                    events[j]->stat;
+            }
+
+            stringbuf name;
+            name << "energy_" << instance;
+            builder.add_formula(name.buf, expr.buf)->enable_periodic_dump();
+
+            if (!total.empty()) total << " + ";
+            total << "formulas:" << name;
+            count++;
+        }
+    }
+
+    if (!count) return 0;
+
+    builder.add_formula("energy", total.buf)->enable_periodic_dump();
+
+    /* nJ over cycles at freq_hz is W */
+    if (!cycles.empty()) {
+        stringbuf power;
+        power << "formulas:energy * " << (double(freq_hz) / 1e9) << " / " <<
+            cycles;
+        builder.add_formula("power", power.buf)->enable_periodic_dump();
+    }
+
+    return count;
+}
@@ -0,0 +1,76 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef ENERGY_MODEL_H
+#define ENERGY_MODEL_H
+
+#include <statsBuilder.h>
+
+/**
+ * @brief Activity based energy and average power from the stats
+ *
+ * The energy of a component is the sum of the counts of some of its stats,
+ * each times the energy of one count in nJ, as given in the 'energy'
+ * section of the machine config:
+ *
+ *   energy:
+ *     cycles: ooo_0_0:cycles
+ *     L1_D_$:
+ *       cpurequest:count:hit:read:hit:hit: 0.05
+ *       cpurequest:count:miss:read: 0.12
+ *     MEM_0:
+ *       dramsim_energy:background: 1 # DRAMSim2 energy, already in nJ
+ *
+ * A '$' in the name of a component is each core id, as in the connections
+ * of the interconnects. setup() adds periodic StatFormulas of them:
+ *
+ *   formulas:
+ *     energy_L1_D_0: ..    # nJ
+ *     energy: ..           # nJ, sum of all components
+ *     power: ..            # W, energy over the time of 'cycles'
+ *
+ * so each time-stats row has the energy and average power of its interval
+ * and the stats dump the ones of the whole run.
+ */
+class EnergyModel {
+    public:
+        ~EnergyModel();
+
+        /* Each count of component:stat takes nj */
+        void add(const char *component, const char *stat, double nj);
+
+        /* Cycles the average power is over, no 'power' without it */
+        void set_cycles(const char *stat) {
+            cycles.reset();
+            cycles << stat;
+        }
+
+        /**
+         * @brief Add the formulas of the components
+         *
+         * @param num_cores Ids '$' stands for
+         * @param freq_hz Clock of 'cycles'
+         *
+         * @return Number of components
+         */
+        int setup(int num_cores, W64 freq_hz);
+
+    private:
+        struct Event {
+            stringbuf component;
+            stringbuf stat;
+            double nj;
+        };
+
+        dynarray<Event*> events;
+        stringbuf cycles;
+};
+
+#endif // ENERGY_MODEL_H
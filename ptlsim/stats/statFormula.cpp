@@ -0,0 +1,286 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <statFormula.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+
+StatFormula::StatFormula(const char *name, Statable *parent,
+        const char *expression_)
+    : StatObj<double>(name, parent)
+      , compiled(false)
+      , periodic(false)
+      , pos(NULL)
+      , depth(0)
+      , max_depth(0)
+{
+    expression << expression_;
+}
+
+void StatFormula::enable_periodic_dump()
+{
+    base_t::enable_periodic_dump();
+    periodic = true;
+
+    /* Time-stats are diffs, so the operands must be diffed too */
+    foreach (i, operands.count())
+        operands[i]->enable_periodic_dump();
+}
+
+bool StatFormula::compile(stringbuf &error)
+{
+    program.clear();
+    operands.clear();
+    compiled = false;
+
+    pos = expression.buf;
+    depth = 0;
+    max_depth = 0;
+
+    bool ok = parse_expr(error);
+
+    skip_space();
+    if (ok && *pos) {
+        error << "unexpected '" << pos << "'";
+        ok = false;
+    }
+
+    if (ok && max_depth > FORMULA_MAX_DEPTH) {
+        error << "nested deeper than " << (int)FORMULA_MAX_DEPTH;
+        ok = false;
+    }
+
+    pos = NULL;
+
+    if (!ok) {
+        program.clear();
+        operands.clear();
+        return false;
+    }
+
+    compiled = true;
+
+    if (periodic)
+        enable_periodic_dump();
+
+    return true;
+}
+
+void StatFormula::emit(Op &op, int stack_change)
+{
+    program.push(op);
+    depth += stack_change;
+    max_depth = max(max_depth, depth);
+}
+
+void StatFormula::skip_space()
+{
+    while (isspace(*pos)) pos++;
+}
+
+bool StatFormula::parse_expr(stringbuf &error)
+{
+    if (!parse_term(error))
+        return false;
+
+    for (;;) {
+        skip_space();
+        if (*pos != '+' && *pos != '-')
+            return true;
+
+        Op op;
+        op.code = (*pos == '+') ? OP_ADD : OP_SUB;
+        pos++;
+
+        if (!parse_term(error))
+            return false;
+        emit(op, -1);
+    }
+}
+
+bool StatFormula::parse_term(stringbuf &error)
+{
+    if (!parse_unary(error))
+        return false;
+
+    for (;;) {
+        skip_space();
+        if (*pos != '*' && *pos != '/')
+            return true;
+
+        Op op;
+        op.code = (*pos == '*') ? OP_MUL : OP_DIV;
+        pos++;
+
+        if (!parse_unary(error))
+            return false;
+        emit(op, -1);
+    }
+}
+
+bool StatFormula::parse_unary(stringbuf &error)
+{
+    skip_space();
+    if (*pos != '-')
+        return parse_primary(error);
+
+    pos++;
+    if (!parse_unary(error))
+        return false;
+
+    Op op;
+    op.code = OP_NEG;
+    emit(op, 0);
+    return true;
+}
+
+bool StatFormula::parse_primary(stringbuf &error)
+{
+    skip_space();
+
+    if (*pos == '(') {
+        pos++;
+        if (!parse_expr(error))
+            return false;
+
+        skip_space();
+        if (*pos != ')') {
+            error << "missing ')'";
+            return false;
+        }
+        pos++;
+        return true;
+    }
+
+    if (isdigit(*pos) || *pos == '.') {
+        char *end;
+        Op op;
+        op.code = OP_CONST;
+        op.value = strtod(pos, &end);
+        pos = end;
+        emit(op, 1);
+        return true;
+    }
+
+    if (isalpha(*pos) || *pos == '_')
+        return parse_name(error);
+
+    if (*pos)
+        error << "unexpected '" << pos << "'";
+    else
+        error << "unexpected end";
+    return false;
+}
+
+bool StatFormula::parse_name(stringbuf &error)
+{
+    const char *start = pos;
+    while (isalnum(*pos) || *pos == '_' || *pos == ':')
+        pos++;
+
+    stringbuf name;
+    name.reserve(pos - start + 1);
+    memcpy(name.p, start, pos - start);
+    name.p += pos - start;
+    *name.p = 0;
+
+    StatObjBase *obj = StatsBuilder::get().get_stat_obj(name);
+    if (!obj) {
+        error << "no stat '" << name << "'";
+        return false;
+    }
+
+    if (obj == this) {
+        error << "'" << name << "' is the formula itself";
+        return false;
+    }
+
+    /* Formulas added later are compiled later, so there are no cycles */
+    if (!obj->is_number()) {
+        if (obj->is_derived())
+            error << "'" << name << "' is not compiled yet";
+        else
+            error << "'" << name << "' is not a number";
+        return false;
+    }
+
+    Op op;
+    bool is_double;
+
+    if (obj->get_number_offset(op.offset, is_double)) {
+        op.code = is_double ? OP_LOAD_DOUBLE : OP_LOAD_W64;
+    } else {
+        op.code = OP_LOAD_DERIVED;
+        op.obj = obj;
+    }
+
+    operands.push(obj);
+    emit(op, 1);
+    return true;
+}
+
+double StatFormula::evaluate(Stats *stats) const
+{
+    double stack[FORMULA_MAX_DEPTH];
+    int top = 0;
+    W8 *base = stats->base();
+
+    foreach (i, program.count()) {
+        const Op &op = program[i];
+
+        switch (op.code) {
+            case OP_CONST:
+                stack[top++] = op.value;
+                break;
+            case OP_LOAD_W64:
+                stack[top++] = double(*(W64*)(base + op.offset));
+                break;
+            case OP_LOAD_DOUBLE:
+                stack[top++] = *(double*)(base + op.offset);
+                break;
+            case OP_LOAD_DERIVED:
+                op.obj->get_number(stats, stack[top]);
+                top++;
+                break;
+            case OP_ADD:
+                top--;
+                stack[top - 1] += stack[top];
+                break;
+            case OP_SUB:
+                top--;
+                stack[top - 1] -= stack[top];
+                break;
+            case OP_MUL:
+                top--;
+                stack[top - 1] *= stack[top];
+                break;
+            case OP_DIV:
+                top--;
+                stack[top - 1] = stack[top] ?
+                    stack[top - 1] / stack[top] : 0;
+                break;
+            case OP_NEG:
+                stack[top - 1] = -stack[top - 1];
+                break;
+        }
+    }
+
+    return top ? stack[0] : 0;
+}
+
+void StatFormula::compute(Stats *stats) const
+{
+    if (!compiled || mark.computed(stats))
+        return;
+
+    double value = evaluate(stats);
+    (*this)(stats) = value;
+}
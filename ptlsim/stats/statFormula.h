@@ -0,0 +1,155 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STAT_FORMULA_H
+#define STAT_FORMULA_H
+
+#include <statsBuilder.h>
+
+/**
+ * @brief Derived stat computed from an expression over other stats
+ *
+ * The expression has numbers, names of stats as they are given to
+ * StatsBuilder::get_stat_obj() ('ooo_0_0:thread0:commit:insns'), + - * /,
+ * unary - and parentheses, e.g.
+ *
+ *   ooo_0_0:thread0:commit:insns / ooo_0_0:cycles
+ *
+ * compile() parses it once into a postfix program that loads counters
+ * straight from the Stats memory, so evaluating it is a loop over a few
+ * ops without any lookups. Operands that are derived themselves, a
+ * StatEquation or a formula compiled before this one, are computed through
+ * get_number(). A formula can only use formulas added before it, so there
+ * are no cycles.
+ *
+ * Like StatEquation the value is computed when it is dumped, once per
+ * StatsSnapshot, and division by zero gives 0.
+ */
+class StatFormula : public StatObj<double> {
+    public:
+        enum {
+            FORMULA_MAX_DEPTH = 32,
+        };
+
+        StatFormula(const char *name, Statable *parent,
+                const char *expression);
+
+        /**
+         * @brief Parse the expression and resolve the names of stats
+         *
+         * @param error Set to why the expression didn't compile
+         *
+         * @return false if it didn't, the formula then stays 0
+         */
+        bool compile(stringbuf &error);
+
+        bool is_compiled() const { return compiled; }
+
+        const char* get_expression() const { return expression.buf; }
+
+        /* Value of the formula for stats, without storing it */
+        double evaluate(Stats *stats) const;
+
+        bool get_number(Stats *stats, double &value) const
+        {
+            compute(stats);
+            return base_t::get_number(stats, value);
+        }
+
+        bool is_number() const { return compiled; }
+
+        bool is_derived() const { return true; }
+
+        void enable_periodic_dump();
+
+        ostream& dump(ostream& os, Stats *stats, const char* pfx="") const
+        {
+            compute(stats);
+            return base_t::dump(os, stats, pfx);
+        }
+
+        YAML::Emitter& dump(YAML::Emitter& out, Stats *stats) const
+        {
+            compute(stats);
+            return base_t::dump(out, stats);
+        }
+
+        StatsWriter& dump(StatsWriter& out, Stats *stats) const
+        {
+            compute(stats);
+            return base_t::dump(out, stats);
+        }
+
+        bson_buffer* dump(bson_buffer* out, Stats *stats) const
+        {
+            compute(stats);
+            return base_t::dump(out, stats);
+        }
+
+        ostream& dump_periodic(ostream &os, Stats *stats) const
+        {
+            compute(stats);
+            return base_t::dump_periodic(os, stats);
+        }
+
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        {
+            compute(stats);
+            base_t::dump_periodic_row(row, stats);
+        }
+
+    private:
+        typedef StatObj<double> base_t;
+
+        enum OpCode {
+            OP_CONST,
+            OP_LOAD_W64,
+            OP_LOAD_DOUBLE,
+            OP_LOAD_DERIVED,
+            OP_ADD,
+            OP_SUB,
+            OP_MUL,
+            OP_DIV,
+            OP_NEG,
+        };
+
+        struct Op {
+            OpCode code;
+            union {
+                double value;
+                W64 offset;
+                const StatObjBase *obj;
+            };
+        };
+
+        stringbuf expression;
+        dynarray<Op> program;
+        dynarray<StatObjBase*> operands;
+        bool compiled;
+        bool periodic;
+        StatSnapshotMark mark;
+
+        /* Parser state of compile() */
+        const char *pos;
+        int depth;
+        int max_depth;
+
+        void compute(Stats *stats) const;
+
+        void emit(Op &op, int stack_change);
+        void skip_space();
+        bool parse_expr(stringbuf &error);
+        bool parse_term(stringbuf &error);
+        bool parse_unary(stringbuf &error);
+        bool parse_primary(stringbuf &error);
+        bool parse_name(stringbuf &error);
+};
+
+#endif // STAT_FORMULA_H
@@ -9,13 +9,182 @@
  */
 
 #include "statsBuilder.h"
+#include "statFormula.h"
 
 #include <ptlsim.h>
+#include <warmstate.h>
+
+#include <pthread.h>
+#include <zlib.h>
+
+#include <sstream>
 
 static Stats *periodic_stats = NULL;
 static Stats *temp_stats  = NULL;
 static Stats *temp2_stats  = NULL;
 
+/**
+ * @brief Background writer for periodic stats
+ *
+ * The simulation thread computes each period's diff straight into a free
+ * snapshot and queues it; the writer thread formats the queued snapshots
+ * in order. When all snapshots are queued the simulation thread waits for
+ * the writer, and the stall is counted.
+ */
+struct PeriodicStatsWriter {
+    struct Snapshot {
+        Stats *stats;
+        W64 cycle;
+    };
+
+    dynarray<Snapshot> slots;
+    int head;
+    int queued;
+    bool stopping;
+    ostream *os;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    W64 snapshots;
+    W64 stalls;
+    int max_queued;
+
+    Snapshot& tail() { return slots[(head + queued) % slots.length]; }
+};
+
+static PeriodicStatsWriter *periodic_writer = NULL;
+
+/*
+ * Binary time-stats format (read by tools/timestats.py):
+ *
+ *   file:   "MTSTATS1", W32 header length, CSV header line (no newline),
+ *           then blocks until EOF
+ *   block:  W32 rows, W32 columns, W8 kind[columns], W32 raw size,
+ *           W32 compressed size, zlib-compressed payload
+ *
+ * The payload holds one varint per column per row. Integer columns store
+ * the zigzag-encoded difference to the previous row and floating point
+ * columns the XOR of their bits with the previous row. Each block starts
+ * from an all-zero previous row, so blocks decode independently. All
+ * fixed-size fields are little-endian.
+ */
+static const char TIME_STATS_MAGIC[8] = {'M','T','S','T','A','T','S','1'};
+static const int TIME_STATS_BLOCK_ROWS = 1024;
+
+struct PeriodicBinaryEncoder {
+    PeriodicRow row;
+    dynarray<W64> prev;
+    dynarray<W8> kinds;
+    dynarray<W8> block;
+    int rows;
+};
+
+static PeriodicBinaryEncoder *periodic_encoder = NULL;
+
+static inline void put_varint(dynarray<W8> &buf, W64 v)
+{
+    while (v >= 0x80) {
+        buf.push((W8)(v | 0x80));
+        v >>= 7;
+    }
+    buf.push((W8)v);
+}
+
+static inline void put_w32(ostream &os, W32 v)
+{
+    os.write((const char*)&v, sizeof(v));
+}
+
+static void flush_periodic_block(ostream &os, PeriodicBinaryEncoder &enc)
+{
+    if (!enc.rows) return;
+
+    uLongf packed_size = compressBound(enc.block.length);
+    dynarray<W8> packed(packed_size);
+    if (compress2((Bytef*)packed.data, &packed_size,
+                (const Bytef*)enc.block.data, enc.block.length,
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+        ptl_logfile << "Failed to compress time-stats block, dropping ",
+                    enc.rows, " rows", endl;
+    } else {
+        put_w32(os, enc.rows);
+        put_w32(os, enc.kinds.length);
+        os.write((const char*)enc.kinds.data, enc.kinds.length);
+        put_w32(os, enc.block.length);
+        put_w32(os, packed_size);
+        os.write((const char*)packed.data, packed_size);
+        os.flush();
+    }
+
+    enc.block.clear();
+    enc.rows = 0;
+    foreach (i, enc.prev.length) enc.prev[i] = 0;
+}
+
+static void encode_periodic_row(ostream &os, PeriodicBinaryEncoder &enc)
+{
+    PeriodicRow &row = enc.row;
+    bool same_layout = (row.kinds.length == enc.kinds.length);
+
+    for (int i = 0; same_layout && i < row.kinds.length; i++)
+        same_layout = (row.kinds[i] == enc.kinds[i]);
+
+    if (!same_layout) {
+        flush_periodic_block(os, enc);
+        enc.kinds.resize(row.kinds.length);
+        enc.prev.resize(row.kinds.length);
+        foreach (i, row.kinds.length) {
+            enc.kinds[i] = row.kinds[i];
+            enc.prev[i] = 0;
+        }
+    }
+
+    foreach (i, row.values.length) {
+        W64 v = row.values[i];
+        if (row.kinds[i] == PeriodicRow::INT) {
+            W64s delta = (W64s)(v - enc.prev[i]);
+            put_varint(enc.block, (W64)((delta << 1) ^ (delta >> 63)));
+        } else {
+            put_varint(enc.block, v ^ enc.prev[i]);
+        }
+        enc.prev[i] = v;
+    }
+
+    if (++enc.rows == TIME_STATS_BLOCK_ROWS)
+        flush_periodic_block(os, enc);
+}
+
+static void* periodic_writer_thread(void *arg)
+{
+    PeriodicStatsWriter *w = (PeriodicStatsWriter*)arg;
+    StatsBuilder &builder = StatsBuilder::get();
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->queued && !w->stopping)
+            pthread_cond_wait(&w->not_empty, &w->lock);
+
+        if (!w->queued) break;
+
+        /* The slot stays queued, so it is not reused, until it is written */
+        PeriodicStatsWriter::Snapshot &snap = w->slots[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        builder.write_periodic(*w->os, snap.stats, snap.cycle);
+
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % w->slots.length;
+        w->queued--;
+        pthread_cond_signal(&w->not_full);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
 Statable::Statable(const char *name)
 {
     this->name = name;
@@ -96,11 +265,8 @@ Statable::~Statable()
     }
 }
 
-void Statable::set_default_stats(Stats *stats, bool recursive, bool force)
+void Statable::rebind_default_stats(Stats *stats, bool recursive)
 {
-    if(default_stats == stats && !force)
-        return;
-
     default_stats = stats;
 
     // First set stats to leafs
@@ -150,6 +316,19 @@ ostream& Statable::dump_periodic(ostream &os, Stats *stats) const
     return os;
 }
 
+void Statable::dump_periodic_row(PeriodicRow &row, Stats *stats) const
+{
+    if(dump_disabled || !periodic_enabled) return;
+
+    foreach(i, leafs.count()) {
+        leafs[i]->dump_periodic_row(row, stats);
+    }
+
+    foreach(i, childNodes.count()) {
+        childNodes[i]->dump_periodic_row(row, stats);
+    }
+}
+
 ostream& Statable::dump_summary(ostream &os, Stats *stats, const char* pfx) const
 {
     if (dump_disabled || !summarize) return os;
@@ -209,6 +388,27 @@ YAML::Emitter& Statable::dump(YAML::Emitter &out, Stats *stats)
     return out;
 }
 
+StatsWriter& Statable::dump(StatsWriter &out, Stats *stats)
+{
+    if(dump_disabled) return out;
+
+    out.begin_map(name.size() ? (char *)name : NULL);
+
+    // First print all the leafs
+    foreach(i, leafs.count()) {
+        leafs[i]->dump(out, stats);
+    }
+
+    // Now print all the child nodes
+    foreach(i, childNodes.count()) {
+        childNodes[i]->dump(out, stats);
+    }
+
+    out.end_map();
+
+    return out;
+}
+
 bson_buffer* Statable::dump(bson_buffer *bb, Stats *stats)
 {
     if(dump_disabled) return bb;
@@ -262,33 +462,41 @@ void Statable::sub_stats(Stats& dest_stats, Stats& src_stats)
     }
 }
 
+/* Only counters that take part in the periodic dump are visited */
 void Statable::add_periodic_stats(Stats& dest_stats, Stats& src_stats)
 {
-    if(periodic_enabled)
-        add_stats(dest_stats, src_stats);
+    if(!periodic_enabled) return;
+
+    foreach(i, leafs.count()) {
+        leafs[i]->add_periodic_stats(dest_stats, src_stats);
+    }
+
+    foreach(i, childNodes.count()) {
+        childNodes[i]->add_periodic_stats(dest_stats, src_stats);
+    }
 }
 
 void Statable::sub_periodic_stats(Stats& dest_stats, Stats& src_stats)
 {
-    if(periodic_enabled)
-        sub_stats(dest_stats, src_stats);
+    if(!periodic_enabled) return;
+
+    foreach(i, leafs.count()) {
+        leafs[i]->sub_periodic_stats(dest_stats, src_stats);
+    }
+
+    foreach(i, childNodes.count()) {
+        childNodes[i]->sub_periodic_stats(dest_stats, src_stats);
+    }
 }
 
-stringbuf *Statable::get_full_stat_string() const
+void Statable::get_full_stat_string(stringbuf &out) const
 {
-    if (parent)
-    {
-        stringbuf *parent_name = parent->get_full_stat_string();
-        if(parent_name->empty())
-            (*parent_name) << name;
-        else
-            (*parent_name) << "." << name;
-        return parent_name;
-    } else {
-        stringbuf *s = new stringbuf();
-        *s << name;
-        return s;
+    if (parent) {
+        parent->get_full_stat_string(out);
+        if (!out.empty())
+            out << ".";
     }
+    out << name;
 }
 
 /**
@@ -308,11 +516,12 @@ StatObjBase* Statable::get_stat_obj(dynarray<stringbuf*> &names, int idx)
 			if (strequal(childNodes[i]->get_name(), names[0]->buf))
 				return childNodes[i]->get_stat_obj(names, idx + 1);
 		}
-		assert(0);
+		return NULL;
 	}
 
-	/* Match the name of this node with name in array with given index */
-	if (name == *names[idx]) {
+	/* Match the name of this node with name in array with given index,
+	 * a name that ends at a node is not an object */
+	if (names.size() > idx + 1 && name == *names[idx]) {
 
 		/* Search leafs if index + 1 is last name */
 		if (names.size() == idx + 2) {
@@ -341,6 +550,73 @@ StatObjBase* Statable::get_stat_obj(dynarray<stringbuf*> &names, int idx)
 
 StatsBuilder *StatsBuilder::_builder = NULL;
 
+__thread W64 StatsSnapshot::id = 0;
+W64 StatsSnapshot::next_id = 0;
+
+/* Nested snapshots are part of the outer one */
+StatsSnapshot::StatsSnapshot()
+{
+    saved = id;
+    if (!id)
+        id = __sync_add_and_fetch(&next_id, 1);
+}
+
+StatsSnapshot::~StatsSnapshot()
+{
+    id = saved;
+}
+
+StatSnapshotMark::StatSnapshotMark()
+{
+    offset = StatsBuilder::get().get_offset(sizeof(W64));
+}
+
+bool StatSnapshotMark::computed(Stats *stats) const
+{
+    W64 current = StatsSnapshot::current();
+    if (!current)
+        return false;
+
+    W64 &mark = *(W64*)(stats->base() + offset);
+    if (mark == current)
+        return true;
+
+    mark = current;
+    return false;
+}
+
+StatFormula* StatsBuilder::add_formula(const char *name,
+        const char *expression)
+{
+    if (!formulaNode)
+        formulaNode = new Statable("formulas", rootNode);
+
+    StatFormula *formula = new StatFormula(name, formulaNode, expression);
+    formulas.push(formula);
+    return formula;
+}
+
+bool StatsBuilder::compile_formulas()
+{
+    bool ok = true;
+
+    foreach (i, formulas.count()) {
+        StatFormula *formula = formulas[i];
+        if (formula->is_compiled())
+            continue;
+
+        stringbuf error;
+        if (!formula->compile(error)) {
+            ptl_logfile << "Stats formula '", formula->get_name(), "': ",
+                        error, ", not dumped", endl;
+            formula->disable_dump();
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
 Stats* StatsBuilder::get_new_stats()
 {
     Stats *stats = new Stats();
@@ -350,7 +626,7 @@ Stats* StatsBuilder::get_new_stats()
 
 void StatsBuilder::destroy_stats(Stats *stats)
 {
-    delete stats->mem;
+    host_free(stats->mem, STATS_SIZE);
     delete stats;
 }
 
@@ -358,6 +634,18 @@ ostream& StatsBuilder::dump_header(ostream &os) const
 {
     if (rootNode->is_dump_periodic())
     {
+        if (periodic_encoder) {
+            std::ostringstream header;
+            header << "sim_cycle,";
+            header << "time_ns";
+            rootNode->dump_header(header);
+
+            os.write(TIME_STATS_MAGIC, sizeof(TIME_STATS_MAGIC));
+            put_w32(os, header.str().size());
+            os << header.str();
+            return os;
+        }
+
         os << "sim_cycle,";
         os << "time_ns";
         rootNode->dump_header(os);
@@ -366,6 +654,23 @@ ostream& StatsBuilder::dump_header(ostream &os) const
     return os;
 }
 
+void StatsBuilder::set_periodic_binary(bool enable)
+{
+    if (enable && !periodic_encoder) {
+        periodic_encoder = new PeriodicBinaryEncoder();
+        periodic_encoder->rows = 0;
+    } else if (!enable && periodic_encoder) {
+        delete periodic_encoder;
+        periodic_encoder = NULL;
+    }
+}
+
+void StatsBuilder::finish_periodic(ostream &os) const
+{
+    if (periodic_encoder)
+        flush_periodic_block(os, *periodic_encoder);
+}
+
 void StatsBuilder::init_timer_stats()
 {
     if(!periodic_stats) {
@@ -381,32 +686,167 @@ void StatsBuilder::init_timer_stats()
     }
 }
 
+void StatsBuilder::reset_periodic() const
+{
+    if (periodic_stats)
+        periodic_stats->reset();
+}
+
 ostream& StatsBuilder::dump_periodic(ostream& os, W64 cycle) const
 {
+    PeriodicStatsWriter *w = periodic_writer;
+    Stats *diff_stats = temp_stats;
+
+    if (w) {
+        pthread_mutex_lock(&w->lock);
+        if (w->queued == w->slots.length) {
+            w->stalls++;
+            while (w->queued == w->slots.length)
+                pthread_cond_wait(&w->not_full, &w->lock);
+        }
+        diff_stats = w->tail().stats;
+        pthread_mutex_unlock(&w->lock);
+    }
+
     /* Here we perform diff of last saved stats and updated user/kernel stats.
      * Addition/Subtraction is done on the operand1 so we keep two temporary
      * stats as copying is faster than addition/subtraction. */
-    *temp_stats = *user_stats;
-    add_periodic_stats(*temp_stats, *kernel_stats);
+    *diff_stats = *user_stats;
+    add_periodic_stats(*diff_stats, *kernel_stats);
 
     *temp2_stats = *periodic_stats;
-    *periodic_stats = *temp_stats;
+    *periodic_stats = *diff_stats;
 
-    sub_periodic_stats(*temp_stats, *temp2_stats);
+    sub_periodic_stats(*diff_stats, *temp2_stats);
 
-    if(rootNode->is_dump_periodic()) {
-        os << cycle << ",";
-        os << simcycles_to_ns(cycle);
-        rootNode->dump_periodic(os, temp_stats);
-        os << "\n";
+    if (w) {
+        pthread_mutex_lock(&w->lock);
+        w->tail().cycle = cycle;
+        w->queued++;
+        w->snapshots++;
+        w->max_queued = max(w->max_queued, w->queued);
+        pthread_cond_signal(&w->not_empty);
+        pthread_mutex_unlock(&w->lock);
+        return os;
     }
 
+    return write_periodic(os, diff_stats, cycle);
+}
+
+ostream& StatsBuilder::write_periodic(ostream& os, Stats *stats,
+        W64 cycle) const
+{
+    if(!rootNode->is_dump_periodic()) return os;
+
+    StatsSnapshot snapshot;
+
+    if (periodic_encoder) {
+        PeriodicRow &row = periodic_encoder->row;
+        row.reset();
+        row.add(cycle);
+        row.add(simcycles_to_ns(cycle));
+        rootNode->dump_periodic_row(row, stats);
+        encode_periodic_row(os, *periodic_encoder);
+        return os;
+    }
+
+    os << cycle << ",";
+    os << simcycles_to_ns(cycle);
+    rootNode->dump_periodic(os, stats);
+    os << "\n";
+
     return os;
 }
 
+void StatsBuilder::start_periodic_writer(ostream *os, int depth)
+{
+    assert(!periodic_writer);
+    assert(depth > 0);
+
+    PeriodicStatsWriter *w = new PeriodicStatsWriter();
+    w->slots.resize(depth);
+    foreach (i, depth) {
+        w->slots[i].stats = get_new_stats();
+        w->slots[i].cycle = 0;
+    }
+    w->head = 0;
+    w->queued = 0;
+    w->stopping = false;
+    w->os = os;
+    w->snapshots = 0;
+    w->stalls = 0;
+    w->max_queued = 0;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+
+    if (pthread_create(&w->thread, NULL, periodic_writer_thread, w)) {
+        ptl_logfile << "Unable to start periodic stats writer thread, ",
+                    "writing time-stats inline", endl;
+        foreach (i, depth) destroy_stats(w->slots[i].stats);
+        delete w;
+        return;
+    }
+
+    periodic_writer = w;
+}
+
+void StatsBuilder::stop_periodic_writer()
+{
+    PeriodicStatsWriter *w = periodic_writer;
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+    periodic_writer = NULL;
+
+    ptl_logfile << "Periodic stats writer: ", w->snapshots, " snapshots, ",
+                w->stalls, " stalls on a full queue, at most ",
+                w->max_queued, " of ", w->slots.length, " queued", endl;
+
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_mutex_destroy(&w->lock);
+
+    foreach (i, w->slots.length) destroy_stats(w->slots[i].stats);
+    delete w;
+}
+
+void StatsBuilder::drain_periodic_writer()
+{
+    PeriodicStatsWriter *w = periodic_writer;
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->queued)
+        pthread_cond_wait(&w->not_full, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void StatsBuilder::transfer_warm_state(WarmState& state, Stats **stats,
+        int count)
+{
+    /* Stats laid out by an other build or configuration don't match */
+    state.expect(used_size());
+    state.expect(count);
+    state.expect(periodic_stats != NULL);
+
+    foreach (i, count)
+        state.raw(stats[i]->mem, used_size());
+
+    if (periodic_stats)
+        state.raw(periodic_stats->mem, used_size());
+}
+
 ostream& StatsBuilder::dump_summary(ostream& os) const
 {
     if (rootNode->is_summarize_enabled()) {
+        StatsSnapshot snapshot;
 
         /* First dump the user stats */
         rootNode->dump_summary(os, user_stats, "user");
@@ -423,6 +863,8 @@ ostream& StatsBuilder::dump_summary(ostream& os) const
 
 ostream& StatsBuilder::dump(Stats *stats, ostream &os, const char* pfx) const
 {
+    StatsSnapshot snapshot;
+
     // First set the stats as default stats in each node
     rootNode->set_default_stats(stats);
 
@@ -434,6 +876,8 @@ ostream& StatsBuilder::dump(Stats *stats, ostream &os, const char* pfx) const
 
 YAML::Emitter& StatsBuilder::dump(Stats *stats, YAML::Emitter &out) const
 {
+    StatsSnapshot snapshot;
+
     // First set the stats as default stats in each node
     rootNode->set_default_stats(stats, true, true);
 
@@ -443,8 +887,23 @@ YAML::Emitter& StatsBuilder::dump(Stats *stats, YAML::Emitter &out) const
     return out;
 }
 
+StatsWriter& StatsBuilder::dump(Stats *stats, StatsWriter &out) const
+{
+    StatsSnapshot snapshot;
+
+    rootNode->set_default_stats(stats, true, true);
+
+    out.begin_doc();
+    rootNode->dump(out, stats);
+    out.end_doc();
+
+    return out;
+}
+
 bson_buffer* StatsBuilder::dump(Stats *stats, bson_buffer *bb) const
 {
+    StatsSnapshot snapshot;
+
     return rootNode->dump(bb, stats);
 }
 
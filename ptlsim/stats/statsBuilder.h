@@ -17,6 +17,12 @@
 #include <yaml/yaml.h>
 #include <bson/bson.h>
 
+#include <statsWriter.h>
+
+#include <limits>
+
+#include <hostmem.h>
+
 #ifdef ENABLE_TESTS
 #  define STATS_SIZE 1024*1024*10
 #else
@@ -25,6 +31,45 @@
 
 class StatObjBase;
 class Stats;
+class WarmState;
+class StatFormula;
+
+/**
+ * @brief One sample of periodic stats in binary form
+ *
+ * Integer counters are stored as-is and floating point values as their raw
+ * IEEE bits, tagged per column, so the binary time-stats writer can
+ * delta-encode each column.
+ */
+struct PeriodicRow {
+    enum { INT = 0, FLOAT = 1 };
+
+    dynarray<W64> values;
+    dynarray<W8> kinds;
+
+    void reset()
+    {
+        values.clear();
+        kinds.clear();
+    }
+
+    void add(double v)
+    {
+        union { double d; W64 w; } u;
+        u.d = v;
+        values.push(u.w);
+        kinds.push(FLOAT);
+    }
+
+    void add(float v) { add((double)v); }
+
+    template<typename V>
+    void add(V v)
+    {
+        values.push((W64)v);
+        kinds.push(INT);
+    }
+};
 
 inline static YAML::Emitter& operator << (YAML::Emitter& out, const W64 value)
 {
@@ -171,9 +216,21 @@ class Statable {
          * @brief Set default Stats* for this Statable and all its Child
          *
          * @param stats
+         *
+         * Cores call this every cycle with the Stats of the current mode,
+         * so keeping the same Stats is only a compare and the StatObjs
+         * are rebound on mode changes only.
          */
-        void set_default_stats(Stats *stats, bool recursive=true,
-                bool force=false);
+        inline void set_default_stats(Stats *stats, bool recursive=true,
+                bool force=false)
+        {
+            if likely (default_stats == stats && !force)
+                return;
+
+            rebind_default_stats(stats, recursive);
+        }
+
+        void rebind_default_stats(Stats *stats, bool recursive);
 
         /**
          * @brief Disable dumping this Stats node and its child
@@ -224,6 +281,12 @@ class Statable {
          */
         YAML::Emitter& dump(YAML::Emitter &out, Stats *stats);
 
+        /**
+         * @brief Dump YAML or JSON of Statable and its childs with a
+         * StatsWriter, same YAML as the YAML::Emitter dump
+         */
+        StatsWriter& dump(StatsWriter &out, Stats *stats);
+
         /**
          * @brief Dump BSON representation to Stats
          *
@@ -241,10 +304,11 @@ class Statable {
         void sub_periodic_stats(Stats& dest_stats, Stats& src_stats);
 
         ostream& dump_periodic(ostream &os, Stats *stats) const;
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const;
 
         ostream& dump_header(ostream &os) const;
 
-        stringbuf *get_full_stat_string() const;
+        void get_full_stat_string(stringbuf &out) const;
 
 		StatObjBase* get_stat_obj(dynarray<stringbuf*> &names, int idx);
 };
@@ -262,11 +326,18 @@ class StatsBuilder {
         static StatsBuilder *_builder;
         Statable *rootNode;
         W64 stat_offset;
+        W64 stat_high_water;
+
+        /* Formulas of the machine config, in 'formulas' at the root */
+        Statable *formulaNode;
+        dynarray<StatFormula*> formulas;
 
         StatsBuilder()
         {
             rootNode = new Statable("", true);
             stat_offset = 0;
+            stat_high_water = 0;
+            formulaNode = NULL;
         }
 
         ~StatsBuilder()
@@ -312,6 +383,7 @@ class StatsBuilder {
             W64 ret_val = stat_offset;
             stat_offset += size;
             assert(stat_offset < STATS_SIZE);
+            stat_high_water = max(stat_high_water, stat_offset);
             return ret_val;
         }
 
@@ -350,6 +422,16 @@ class StatsBuilder {
          */
         YAML::Emitter& dump(Stats *stats, YAML::Emitter &out) const;
 
+        /**
+         * @brief Dump Stats tree as one document of a StatsWriter
+         *
+         * @param stats Use given Stats* for values
+         * @param out StatsWriter to write YAML or JSON into
+         *
+         * @return
+         */
+        StatsWriter& dump(Stats *stats, StatsWriter &out) const;
+
         /**
          * @brief Dump Stats tree in BSON format
          *
@@ -374,19 +456,92 @@ class StatsBuilder {
 
         void add_periodic_stats(Stats& dest_stats, Stats& src_stats) const
         {
-            if(rootNode->is_dump_periodic())
-                add_stats(dest_stats, src_stats);
+            rootNode->add_periodic_stats(dest_stats, src_stats);
         }
 
         void sub_periodic_stats(Stats& dest_stats, Stats& src_stats) const
         {
-            if(rootNode->is_dump_periodic())
-                sub_stats(dest_stats, src_stats);
+            rootNode->sub_periodic_stats(dest_stats, src_stats);
         }
 
         bool is_dump_periodic() { return rootNode->is_dump_periodic(); }
         ostream& dump_header(ostream &os) const;
         ostream& dump_periodic(ostream &os, W64 cycle) const;
+
+        /* Next periodic row is from zero, after user/kernel stats reset */
+        void reset_periodic() const;
+
+        /**
+         * @brief Write one periodic stats row for given diff snapshot
+         *
+         * @param os ostream to write the CSV row to
+         * @param stats Stats holding this period's values
+         * @param cycle Cycle at which the snapshot was taken
+         *
+         * @return
+         */
+        ostream& write_periodic(ostream &os, Stats *stats, W64 cycle) const;
+
+        /**
+         * @brief Format periodic stats on a background thread
+         *
+         * After this call dump_periodic() only takes the snapshot and
+         * queues it; the rows are written to os by a writer thread.
+         *
+         * @param os ostream that receives the periodic rows
+         * @param depth Number of snapshots that can be queued at once
+         */
+        void start_periodic_writer(ostream *os, int depth);
+
+        /**
+         * @brief Write out all queued snapshots and stop the writer thread
+         */
+        void stop_periodic_writer();
+
+        /**
+         * @brief Wait until the writer thread wrote all queued snapshots
+         */
+        void drain_periodic_writer();
+
+        /**
+         * @brief Save or restore Stats for a resumable checkpoint
+         *
+         * The last periodic snapshot is included, so the time-stats rows
+         * after the checkpoint are the same.
+         *
+         * @param state Warm state file, see warmstate.h
+         * @param stats Stats to save or restore
+         * @param count Number of Stats
+         */
+        void transfer_warm_state(WarmState& state, Stats **stats, int count);
+
+        /**
+         * @brief Write periodic stats as blocked, delta-encoded binary
+         * instead of CSV text
+         *
+         * @param enable True for binary, false for CSV
+         */
+        void set_periodic_binary(bool enable);
+
+        /**
+         * @brief Write out any periodic rows still buffered for os
+         *
+         * @param os ostream that received the periodic header and rows
+         */
+        void finish_periodic(ostream &os) const;
+
+        /**
+         * @brief Number of bytes of each Stats block in use
+         */
+        W64 used_size() const { return stat_offset; }
+
+        /**
+         * @brief Number of bytes of each Stats block ever handed out
+         *
+         * Larger than used_size() after delete_nodes(); bytes past this
+         * are still zero in every Stats block.
+         */
+        W64 touched_size() const { return stat_high_water; }
         ostream& dump_summary(ostream &os) const;
 
         void delete_nodes()
@@ -395,8 +550,29 @@ class StatsBuilder {
 
             rootNode = new Statable("", true);
             stat_offset = 0;
+            formulaNode = NULL;
+            formulas.clear();
         }
 
+        /**
+         * @brief Add a derived stat computed from an expression
+         *
+         * Goes to the 'formulas' node as 'name', see StatFormula for the
+         * expressions. Names are resolved by compile_formulas(), so the
+         * expression can use stats created after this call.
+         */
+        StatFormula* add_formula(const char *name, const char *expression);
+
+        /**
+         * @brief Compile the formulas added since the last call
+         *
+         * Called once the machine has created all its stats. A formula
+         * that doesn't compile is logged and left out of the dumps.
+         *
+         * @return false if any formula didn't compile
+         */
+        bool compile_formulas();
+
 		StatObjBase* get_stat_obj(stringbuf &name);
 		StatObjBase* get_stat_obj(const char *name);
 };
@@ -415,8 +591,8 @@ class Stats {
 
         Stats()
         {
-            mem = new W8[STATS_SIZE];
-            reset();
+            /* Zeroed, see hostmem.h */
+            mem = (W8*)host_alloc(STATS_SIZE);
         }
 
     public:
@@ -429,7 +605,8 @@ class Stats {
 
         void reset()
         {
-            memset(mem, 0, sizeof(W8) * STATS_SIZE);
+            memset(mem, 0,
+                    sizeof(W8) * (StatsBuilder::get()).touched_size());
         }
 
         Stats& operator+=(Stats& rhs_stats)
@@ -440,11 +617,57 @@ class Stats {
 
         Stats& operator=(Stats& rhs_stats)
         {
-            memcpy(mem, rhs_stats.mem, sizeof(W8) * STATS_SIZE);
+            /* Nothing past the last allocated offset is ever written */
+            memcpy(mem, rhs_stats.mem,
+                    sizeof(W8) * (StatsBuilder::get()).used_size());
             return *this;
         }
 };
 
+/**
+ * @brief Scope in which Stats values don't change, e.g. one dump
+ *
+ * Derived stats (StatEquation, StatFormula) are computed at most once per
+ * Stats in the current snapshot of their thread, see StatSnapshotMark. The
+ * StatsBuilder dumps each open one and outside of any snapshot they are
+ * computed every time.
+ */
+class StatsSnapshot {
+    public:
+        StatsSnapshot();
+        ~StatsSnapshot();
+
+        /* Id of the current snapshot of this thread, 0 if none */
+        static W64 current() { return id; }
+
+    private:
+        W64 saved;
+
+        static __thread W64 id;
+        static W64 next_id;
+};
+
+/**
+ * @brief Id of the snapshot a derived stat was computed in, kept in Stats
+ *
+ * Being in the Stats memory, copies of a Stats keep it and each Stats is
+ * marked separately, even when dumped from the periodic writer thread.
+ */
+class StatSnapshotMark {
+    private:
+        W64 offset;
+
+    public:
+        StatSnapshotMark();
+
+        /**
+         * @brief Mark stats as computed in the current snapshot
+         *
+         * @return true if it already was, so the value is still good
+         */
+        bool computed(Stats *stats) const;
+};
+
 /**
  * @brief Base class for all Statistics container classes
  */
@@ -476,11 +699,46 @@ class StatObjBase {
 				const char* pfx="") const = 0;
         virtual YAML::Emitter& dump(YAML::Emitter& out,
                 Stats *stats) const = 0;
+        virtual StatsWriter& dump(StatsWriter& out,
+                Stats *stats) const = 0;
         virtual bson_buffer* dump(bson_buffer* out,
                 Stats *stats) const = 0;
 
         virtual ostream& dump_periodic(ostream &os, Stats *stats) const = 0;
 
+        /**
+         * @brief Append periodic values to a binary time-stats row
+         *
+         * Must add the same columns, in the same order, as dump_periodic().
+         */
+        virtual void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        { }
+
+        /* Has a single number, which StatFormula can use */
+        virtual bool is_number() const { return false; }
+
+        /**
+         * @brief Numeric value for StatFormula, derived stats compute it
+         *
+         * @return false if this object has no single number
+         */
+        virtual bool get_number(Stats *stats, double &value) const
+        { return false; }
+
+        /**
+         * @brief Where StatFormula can load the number straight from
+         *
+         * @param offset Offset of the value in each Stats
+         * @param is_double Value is a double, else a W64
+         *
+         * @return false if it has to go through get_number()
+         */
+        virtual bool get_number_offset(W64 &offset, bool &is_double) const
+        { return false; }
+
+        /* Computed from other stats (StatEquation, StatFormula) */
+        virtual bool is_derived() const { return false; }
+
         void disable_dump_periodic()
         {
             periodic_enabled = false;
@@ -504,20 +762,15 @@ class StatObjBase {
 
         inline bool is_summarize_enabled() const { return summarize; }
 
-        stringbuf *get_full_stat_string() const
+        /* Append the dotted name from the root, no heap copies per level */
+        void get_full_stat_string(stringbuf &out) const
         {
-            if (parent){
-                stringbuf *parent_name = parent->get_full_stat_string();
-                if(parent_name->empty())
-                    (*parent_name) << name;
-                else
-                    (*parent_name) << "." << name;
-                return parent_name;
-            } else {
-                stringbuf *s = new stringbuf();
-                *s << name;
-                return s;
+            if (parent) {
+                parent->get_full_stat_string(out);
+                if (!out.empty())
+                    out << ".";
             }
+            out << name;
         }
 
 		/**
@@ -532,10 +785,9 @@ class StatObjBase {
 
         virtual ostream &dump_header(ostream &os) {
             if (is_dump_periodic()) {
-                stringbuf *full_string = get_full_stat_string();
-                os << ","<< (*full_string);
-
-                delete full_string;
+                stringbuf full_string;
+                get_full_stat_string(full_string);
+                os << ","<< full_string;
             }
             return os;
         }
@@ -831,6 +1083,31 @@ class StatObj : public StatObjBase {
             return *(T*)(stats->base() + offset);
         }
 
+        /* Offset of the value in each Stats */
+        W64 stats_offset() const { return offset; }
+
+        bool is_number() const { return true; }
+
+        bool get_number(Stats *stats, double &value) const
+        {
+            value = double((*this)(stats));
+            return true;
+        }
+
+        bool get_number_offset(W64 &offset_, bool &is_double) const
+        {
+            bool integer = std::numeric_limits<T>::is_integer;
+            bool is_w64 = integer && !std::numeric_limits<T>::is_signed;
+
+            if (is_derived() || sizeof(T) != sizeof(W64) ||
+                    (integer && !is_w64))
+                return false;
+
+            offset_ = offset;
+            is_double = !integer;
+            return true;
+        }
+
         /**
          * @brief Dump a string representation to ostream
          *
@@ -845,11 +1122,10 @@ class StatObj : public StatObjBase {
             if(is_dump_disabled()) return os;
 
             T var = (*this)(stats);
-			stringbuf *full_string = get_full_stat_string();
+			stringbuf full_string;
+			get_full_stat_string(full_string);
 
-            os << pfx << *full_string << ":" << var << "\n";
-
-			delete full_string;
+            os << pfx << full_string << ":" << var << "\n";
             return os;
         }
 
@@ -873,6 +1149,15 @@ class StatObj : public StatObjBase {
             return out;
         }
 
+        StatsWriter& dump(StatsWriter &out, Stats *stats) const
+        {
+            if(is_dump_disabled()) return out;
+
+            out.write((char *)name, (*this)(stats));
+
+            return out;
+        }
+
         /**
          * @brief Dump StatObj to BSON format
          *
@@ -927,12 +1212,19 @@ class StatObj : public StatObjBase {
             return os;
         }
 
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        {
+            if (is_dump_periodic())
+                row.add((*this)(stats));
+        }
+
         ostream &dump_summary(ostream &os, Stats *stats, const char* pfx) const
         {
             if (is_summarize_enabled()) {
                 T& val = (*this)(stats);
-                stringbuf *name = get_full_stat_string();
-                os << pfx << "." << (*name) << " = " << val << endl;
+                stringbuf full_name;
+                get_full_stat_string(full_name);
+                os << pfx << "." << full_name << " = " << val << endl;
             }
 
             return os;
@@ -1041,16 +1333,17 @@ class StatArray : public StatObjBase {
         {
             if(is_dump_disabled()) return os;
 
-			stringbuf *full_string = get_full_stat_string();
+			stringbuf full_string;
+			get_full_stat_string(full_string);
 
 			if (labels) {
 				BaseArr& arr = (*this)(stats);
 				foreach(i, size) {
-					os << pfx << *full_string << "." << labels[i] <<
+					os << pfx << full_string << "." << labels[i] <<
 						":" << arr[i] << "\n";
 				}
 			} else {
-				os << pfx << *full_string << ":";
+				os << pfx << full_string << ":";
 				BaseArr& arr = (*this)(stats);
 				foreach(i, size) {
 					os << arr[i] << " ";
@@ -1058,8 +1351,6 @@ class StatArray : public StatObjBase {
 				os << "\n";
 			}
 
-			delete full_string;
-
             return os;
         }
 
@@ -1104,6 +1395,29 @@ class StatArray : public StatObjBase {
             return out;
         }
 
+        StatsWriter& dump(StatsWriter &out, Stats *stats) const
+        {
+            if(is_dump_disabled()) return out;
+
+            BaseArr& arr = (*this)(stats);
+
+            if(labels) {
+                out.begin_map((char *)name);
+                foreach(i, size) {
+                    out.write(labels[i], arr[i]);
+                }
+                out.end_map();
+            } else {
+                out.begin_flow_seq((char *)name);
+                foreach(i, size) {
+                    out.item(arr[i]);
+                }
+                out.end_flow_seq();
+            }
+
+            return out;
+        }
+
         /**
          * @brief Dump StatArray to BSON format
          *
@@ -1190,11 +1504,12 @@ class StatArray : public StatObjBase {
         {
             if (!is_dump_periodic()) return os;
 
-            stringbuf *full_string = get_full_stat_string();
+            stringbuf full_string;
+            get_full_stat_string(full_string);
 
             foreach(i, size) {
                 if(periodic_flag[i]) {
-                    os << "," << *full_string;
+                    os << "," << full_string;
 
                     if(labels) {
                         os << "." << labels[i];
@@ -1203,8 +1518,6 @@ class StatArray : public StatObjBase {
                     }
                 }
             }
-
-            delete full_string;
             return os;
         }
 
@@ -1223,6 +1536,19 @@ class StatArray : public StatObjBase {
             return os;
         }
 
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        {
+            if (!is_dump_periodic()) return;
+
+            BaseArr& arr = (*this)(stats);
+
+            foreach(i, size) {
+                if(periodic_flag[i]) {
+                    row.add(arr[i]);
+                }
+            }
+        }
+
         void enable_summary(int id = -1)
         {
             StatObjBase::enable_summary();
@@ -1239,11 +1565,12 @@ class StatArray : public StatObjBase {
             if (!is_summarize_enabled()) return os;
 
             BaseArr& arr = (*this)(stats);
-            stringbuf* name = get_full_stat_string();
+            stringbuf full_name;
+            get_full_stat_string(full_name);
 
             foreach (i, size) {
                 if(summarize_flag[i]) {
-                    os << pfx << "." << (*name);
+                    os << pfx << "." << full_name;
 
                     if (labels) {
                         os << "." << labels[i];
@@ -1425,24 +1752,23 @@ class StatString : public StatObjBase {
             if(is_dump_disabled()) return os;
 
             char* var = (*this)(stats);
-			stringbuf *full_string = get_full_stat_string();
+			stringbuf full_string;
+			get_full_stat_string(full_string);
 
             if(split[0] != '\0') {
                 dynarray<stringbuf*> tags;
                 stringbuf st_tags; st_tags << var;
                 st_tags.split(tags, split);
 
-                os << pfx << *full_string << "[";
+                os << pfx << full_string << "[";
                 foreach(i, tags.size()) {
                     os << i << ":" << tags[i]->buf << ", ";
                 }
                 os << "]\n";
             } else {
-                os << pfx << *full_string << ":" << var << "\n";
+                os << pfx << full_string << ":" << var << "\n";
             }
 
-			delete full_string;
-
             return os;
         }
 
@@ -1483,6 +1809,29 @@ class StatString : public StatObjBase {
             return out;
         }
 
+        StatsWriter& dump(StatsWriter &out, Stats *stats) const
+        {
+            if(is_dump_disabled()) return out;
+
+            char* var = (*this)(stats);
+
+            if(split[0] != '\0') {
+                dynarray<stringbuf*> tags;
+                stringbuf st_tags; st_tags << var;
+                st_tags.split(tags, split);
+
+                out.begin_flow_seq((char *)name);
+                foreach(i, tags.size()) {
+                    out.item(tags[i]->buf);
+                }
+                out.end_flow_seq();
+            } else {
+                out.write((char *)name, var);
+            }
+
+            return out;
+        }
+
         /**
          * @brief Dump StatString to BSON format
          *
@@ -1592,8 +1941,9 @@ struct StatObjFormulaDiv {
  * @tparam K Type of result to store
  * @tparam F Formula to compute result
  *
- * The computation is done when any of the 'dump' function is called. This
- * class only supports computation over StatObj<T> type objects.
+ * The computation is done when any of the 'dump' function is called, once
+ * per StatsSnapshot. This class only supports computation over StatObj<T>
+ * type objects, see StatFormula for expressions.
  */
 template<typename T, typename K, typename F>
 class StatEquation : public StatObj<K> {
@@ -1602,6 +1952,7 @@ class StatEquation : public StatObj<K> {
         typedef dynarray<StatObj<T>* > elems_t;
         elems_t elems;
         F formula;
+        StatSnapshotMark mark;
 
         /**
          * @brief Perform computation and store result
@@ -1610,6 +1961,8 @@ class StatEquation : public StatObj<K> {
          */
         void compute(Stats* stats) const
         {
+            if(mark.computed(stats)) return;
+
             K& val = (*this)(stats);
             val = formula.compute(stats, elems);
         }
@@ -1636,6 +1989,14 @@ class StatEquation : public StatObj<K> {
             elems.push(obj);
         }
 
+        bool get_number(Stats *stats, double &value) const
+        {
+            compute(stats);
+            return base_t::get_number(stats, value);
+        }
+
+        bool is_derived() const { return true; }
+
         void enable_periodic_dump()
         {
             base_t::enable_periodic_dump();
@@ -1674,6 +2035,13 @@ class StatEquation : public StatObj<K> {
             return base_t::dump(out, stats);
         }
 
+        StatsWriter& dump(StatsWriter& out,
+                Stats *stats) const
+        {
+            compute(stats);
+            return base_t::dump(out, stats);
+        }
+
         /**
          * @brief Dump BSON value of this Stats Object
          *
@@ -1702,6 +2070,415 @@ class StatEquation : public StatObj<K> {
             base_t::dump_periodic(os, stats);
             return os;
         }
+
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        {
+            compute(stats);
+            base_t::dump_periodic_row(row, stats);
+        }
+};
+
+
+/**
+ * @brief Log-linear (HDR style) histogram of W64 samples
+ *
+ * @tparam LINEAR_BITS Samples below 2^LINEAR_BITS get one bucket each
+ * @tparam SUB_BITS Every power of two above is split in 2^SUB_BITS buckets
+ * @tparam MAX_BITS Samples of 2^MAX_BITS and more share the last bucket
+ *
+ * Only a count, a sum and the buckets are kept in the Stats database, so
+ * record() is O(1) and add_stats/sub_stats merge histograms exactly. Above
+ * the linear range a bucket spans at most 1/2^SUB_BITS of its values, which
+ * bounds the error of the percentiles. The default covers 0 to 1M cycles in
+ * 176 buckets.
+ *
+ * Dumps show a summary instead of the buckets:
+ *      dcache_latency: {count: .., mean: .., p50: .., p90: .., p95: ..,
+ *                       p99: .., max: ..}
+ * where percentiles and max are the upper bound of their bucket. Periodic
+ * dumps add the count, p50 and p99 columns of each interval.
+ *
+ * Record into another Stats with N_STAT_UPDATE(hist, .record(v), kernel).
+ */
+template<int LINEAR_BITS = 6, int SUB_BITS = 3, int MAX_BITS = 20>
+class StatHistogram : public StatObjBase {
+    public:
+        typedef char sub_bits_check[(SUB_BITS <= LINEAR_BITS &&
+                LINEAR_BITS < MAX_BITS) ? 1 : -1];
+
+        enum {
+            LINEAR = 1 << LINEAR_BITS,
+            SUB = 1 << SUB_BITS,
+            BUCKETS = LINEAR + (MAX_BITS - LINEAR_BITS) * SUB,
+        };
+
+        static int bucket(W64 value)
+        {
+            if(value < LINEAR)
+                return int(value);
+
+            int msb = msbindex64(value);
+            int b = LINEAR + (msb - LINEAR_BITS) * SUB +
+                int((value >> (msb - SUB_BITS)) & (SUB - 1));
+            return (b < BUCKETS) ? b : BUCKETS - 1;
+        }
+
+        /* Largest value that falls in bucket 'b' */
+        static W64 bucket_value(int b)
+        {
+            if(b < LINEAR)
+                return W64(b);
+
+            int msb = (b - LINEAR) / SUB + LINEAR_BITS;
+            int sub = (b - LINEAR) % SUB;
+            return (W64(SUB + sub + 1) << (msb - SUB_BITS)) - 1;
+        }
+
+        struct Data {
+            W64 count;
+            W64 sum;
+            W64 buckets[BUCKETS];
+
+            void record(W64 value)
+            {
+                count++;
+                sum += value;
+                buckets[bucket(value)]++;
+            }
+
+            /* 'weight' samples of value at once */
+            void record(W64 value, W64 weight)
+            {
+                count += weight;
+                sum += value * weight;
+                buckets[bucket(value)] += weight;
+            }
+
+            double mean() const
+            {
+                return count ? double(sum) / double(count) : 0;
+            }
+
+            /* Upper bound of the bucket holding 'q' of the samples */
+            W64 percentile(double q) const
+            {
+                if(!count)
+                    return 0;
+
+                /* Smallest count that is at least 'q' of the samples */
+                double exact = q * double(count);
+                W64 target = W64(exact);
+                if(double(target) < exact || !target)
+                    target++;
+
+                W64 seen = 0;
+                foreach(i, BUCKETS) {
+                    seen += buckets[i];
+                    if(seen >= target)
+                        return bucket_value(i);
+                }
+                return bucket_value(BUCKETS - 1);
+            }
+
+            W64 max() const
+            {
+                for(int i = BUCKETS - 1; i >= 0; i--) {
+                    if(buckets[i])
+                        return bucket_value(i);
+                }
+                return 0;
+            }
+        };
+
+    private:
+        W64 offset;
+        Data *default_var;
+
+        inline void set_default_var_ptr()
+        {
+            if(default_stats) {
+                default_var = (Data*)(default_stats->base() + offset);
+            } else {
+                default_var = NULL;
+            }
+        }
+
+        static const char* percentile_name(int i)
+        {
+            static const char *names[] = {"p50", "p90", "p95", "p99"};
+            return names[i];
+        }
+
+        static double percentile_quantile(int i)
+        {
+            static const double quantiles[] = {0.50, 0.90, 0.95, 0.99};
+            return quantiles[i];
+        }
+
+    public:
+        StatHistogram(const char *name, Statable *parent)
+            : StatObjBase(name, parent)
+        {
+            StatsBuilder &builder = StatsBuilder::get();
+
+            offset = builder.get_offset(sizeof(Data));
+
+            set_default_var_ptr();
+        }
+
+        void set_default_stats(Stats *stats)
+        {
+            StatObjBase::set_default_stats(stats);
+            set_default_var_ptr();
+        }
+
+        /**
+         * @brief Add one sample to the default Stats
+         */
+        inline void record(W64 value)
+        {
+            assert(default_var);
+            default_var->record(value);
+        }
+
+        /**
+         * @brief () operator to use given Stats* instead of default
+         */
+        inline Data& operator()(Stats *stats) const
+        {
+            return *(Data*)(stats->base() + offset);
+        }
+
+        ostream& dump(ostream& os, Stats *stats, const char* pfx="") const
+        {
+            if(is_dump_disabled()) return os;
+
+            Data& data = (*this)(stats);
+            stringbuf full_string;
+            get_full_stat_string(full_string);
+
+            os << pfx << full_string << ".count:" << data.count << "\n";
+            os << pfx << full_string << ".mean:" << data.mean() << "\n";
+            foreach(i, 4) {
+                os << pfx << full_string << "." << percentile_name(i) <<
+                    ":" << data.percentile(percentile_quantile(i)) << "\n";
+            }
+            os << pfx << full_string << ".max:" << data.max() << "\n";
+            return os;
+        }
+
+        YAML::Emitter& dump(YAML::Emitter &out, Stats *stats) const
+        {
+            if(is_dump_disabled()) return out;
+
+            Data& data = (*this)(stats);
+
+            out << YAML::Key << (char *)name;
+            out << YAML::Value << YAML::Flow << YAML::BeginMap;
+            out << YAML::Key << "count" << YAML::Value << data.count;
+            out << YAML::Key << "mean" << YAML::Value << data.mean();
+            foreach(i, 4) {
+                out << YAML::Key << percentile_name(i);
+                out << YAML::Value << data.percentile(percentile_quantile(i));
+            }
+            out << YAML::Key << "max" << YAML::Value << data.max();
+            out << YAML::EndMap << YAML::Block;
+
+            return out;
+        }
+
+        StatsWriter& dump(StatsWriter &out, Stats *stats) const
+        {
+            if(is_dump_disabled()) return out;
+
+            Data& data = (*this)(stats);
+
+            out.begin_flow_map((char *)name);
+            out.write("count", data.count);
+            out.write("mean", data.mean());
+            foreach(i, 4) {
+                out.write(percentile_name(i),
+                        data.percentile(percentile_quantile(i)));
+            }
+            out.write("max", data.max());
+            out.end_flow_map();
+
+            return out;
+        }
+
+        bson_buffer* dump(bson_buffer *bb, Stats *stats) const
+        {
+            if(is_dump_disabled()) return bb;
+
+            Data& data = (*this)(stats);
+            bson_buffer *obj = bson_append_start_object(bb, (char *)name);
+
+            bson_append_long(obj, "count", data.count);
+            bson_append_double(obj, "mean", data.mean());
+            foreach(i, 4) {
+                bson_append_long(obj, percentile_name(i),
+                        data.percentile(percentile_quantile(i)));
+            }
+            bson_append_long(obj, "max", data.max());
+
+            return bson_append_finish_object(obj);
+        }
+
+        void add_stats(Stats& dest_stats, Stats& src_stats)
+        {
+            W64 *dest = (W64*)&(*this)(&dest_stats);
+            W64 *src = (W64*)&(*this)(&src_stats);
+            foreach(i, sizeof(Data) / sizeof(W64)) {
+                dest[i] += src[i];
+            }
+        }
+
+        void sub_stats(Stats& dest_stats, Stats& src_stats)
+        {
+            W64 *dest = (W64*)&(*this)(&dest_stats);
+            W64 *src = (W64*)&(*this)(&src_stats);
+            foreach(i, sizeof(Data) / sizeof(W64)) {
+                dest[i] -= src[i];
+            }
+        }
+
+        void add_periodic_stats(Stats& dest_stats, Stats& src_stats)
+        {
+            if(is_dump_periodic()) {
+                add_stats(dest_stats, src_stats);
+            }
+        }
+
+        void sub_periodic_stats(Stats& dest_stats, Stats& src_stats)
+        {
+            if(is_dump_periodic()) {
+                sub_stats(dest_stats, src_stats);
+            }
+        }
+
+        ostream &dump_header(ostream &os)
+        {
+            if (!is_dump_periodic()) return os;
+
+            stringbuf full_string;
+            get_full_stat_string(full_string);
+            os << "," << full_string << ".count";
+            os << "," << full_string << ".p50";
+            os << "," << full_string << ".p99";
+            return os;
+        }
+
+        ostream &dump_periodic(ostream &os, Stats *stats) const
+        {
+            if (!is_dump_periodic()) return os;
+
+            Data& data = (*this)(stats);
+            os << "," << data.count;
+            os << "," << data.percentile(0.50);
+            os << "," << data.percentile(0.99);
+            return os;
+        }
+
+        void dump_periodic_row(PeriodicRow &row, Stats *stats) const
+        {
+            if (!is_dump_periodic()) return;
+
+            Data& data = (*this)(stats);
+            row.add(data.count);
+            row.add(data.percentile(0.50));
+            row.add(data.percentile(0.99));
+        }
+
+        ostream &dump_summary(ostream &os, Stats *stats, const char* pfx) const
+        {
+            if (!is_summarize_enabled()) return os;
+
+            Data& data = (*this)(stats);
+            stringbuf full_name;
+            get_full_stat_string(full_name);
+
+            os << pfx << "." << full_name << ".count = " << data.count << endl;
+            os << pfx << "." << full_name << ".p50 = " <<
+                data.percentile(0.50) << endl;
+            os << pfx << "." << full_name << ".p99 = " <<
+                data.percentile(0.99) << endl;
+            return os;
+        }
+};
+
+/**
+ * @brief Time weighted occupancy of a queue or buffer
+ *
+ * A StatHistogram of the occupancy of every cycle, kept without being
+ * touched every cycle: the owner of the structure calls update() with its
+ * new number of entries whenever that may have changed, which records the
+ * cycles since the previous change at the old occupancy, all at once, into
+ * the Stats given with it. A call that changes nothing is a compare.
+ *
+ * Dumps are those of StatHistogram, count being cycles:
+ *      rob: {count: <cycles>, mean: .., p50: .., p90: .., p95: .., p99: ..,
+ *            max: ..}
+ * where mean is the average occupancy and p99 the occupancy the structure
+ * was at or below 99% of the cycles. The cycles since the last change of
+ * every occupancy are recorded with flush_all() before stats are read.
+ */
+class StatOccupancy : public StatHistogram<> {
+    private:
+        W64 level;
+        W64 since;
+        Stats *stats;
+
+        static dynarray<StatOccupancy*>& tracked()
+        {
+            static dynarray<StatOccupancy*> list;
+            return list;
+        }
+
+    public:
+        StatOccupancy(const char *name, Statable *parent)
+            : StatHistogram<>(name, parent)
+              , level(0)
+              , since(0)
+              , stats(NULL)
+        {
+            tracked().push(this);
+        }
+
+        ~StatOccupancy()
+        {
+            tracked().remove(this);
+        }
+
+        /**
+         * @brief Occupancy is new_level from cycle on, counted in new_stats
+         */
+        inline void update(W64 new_level, W64 cycle, Stats *new_stats)
+        {
+            if likely (new_level == level && new_stats == stats)
+                return;
+
+            flush(cycle);
+            level = new_level;
+            stats = new_stats;
+        }
+
+        /* Record the cycles up to 'cycle' at the current occupancy */
+        void flush(W64 cycle)
+        {
+            if(stats && cycle > since)
+                (*this)(stats).record(level, cycle - since);
+            since = cycle;
+        }
+
+        W64 current() const { return level; }
+
+        static void flush_all(W64 cycle)
+        {
+            dynarray<StatOccupancy*> &list = tracked();
+            foreach(i, list.count()) {
+                list[i]->flush(cycle);
+            }
+        }
 };
 
 #endif // STATS_BUILDER_H
@@ -0,0 +1,544 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include "statsExporter.h"
+
+#include <ptlsim.h>
+
+#include <bson/mongo.h>
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* A failed batch is sent again after 0.1, 0.2, 0.4, ... seconds */
+static const int STATS_EXPORT_RETRIES = 6;
+static const int STATS_EXPORT_RETRY_DELAY_MS = 100;
+
+/* A partial batch is sent once its first snapshot waited this long */
+static const int STATS_EXPORT_BATCH_WAIT_MS = 1000;
+
+static W64 wallclock_ns()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return W64(tv.tv_sec) * 1000000000ULL + W64(tv.tv_usec) * 1000ULL;
+}
+
+void stats_export_bson(StatsExportDoc &doc, bson *out)
+{
+    bson_buffer bb[1];
+
+    bson_buffer_init(bb);
+    bson_append_new_oid(bb, "_id");
+    bson_append_string(bb, "kind", doc.kind);
+    bson_append_long(bb, "sim_cycle", doc.cycle);
+    bson_append_date(bb, "time", doc.time_ns / 1000000);
+
+    (StatsBuilder::get()).dump(doc.stats, bb);
+    bson_from_buffer(out, bb);
+}
+
+/* Backslash escape 'special' characters and backslashes */
+static void line_escape(stringbuf &out, const char *s, const char *special)
+{
+    for (; *s; s++) {
+        if (*s == '\\' || strchr(special, *s))
+            out << '\\';
+        out << *s;
+    }
+}
+
+void stats_export_add_tag(stringbuf &tags, const char *key,
+        const char *value)
+{
+    if (!value || !*value)
+        return;
+    if (tags.size())
+        tags << ',';
+    line_escape(tags, key, ", =");
+    tags << '=';
+    line_escape(tags, value, ", =");
+}
+
+static void line_fields(stringbuf &out, bson_iterator *it, char *key,
+        int keylen, int keysize, bool &first)
+{
+    while (bson_iterator_next(it)) {
+        bson_type type = bson_iterator_type(it);
+        const char *name = bson_iterator_key(it);
+
+        if (keylen == 0 && !strcmp(name, "_id"))
+            continue;
+
+        int len = snprintf(key + keylen, keysize - keylen, "%s%s",
+                keylen ? "." : "", name);
+        if (len >= keysize - keylen)
+            continue;
+        len += keylen;
+
+        if (type == bson_object || type == bson_array) {
+            bson_iterator sub;
+            bson_iterator_subiterator(it, &sub);
+            line_fields(out, &sub, key, len, keysize, first);
+            continue;
+        }
+
+        char value[32];
+        const char *str = NULL;
+
+        switch (type) {
+            case bson_int:
+            case bson_long:
+                snprintf(value, sizeof(value), "%lldi",
+                        (long long)bson_iterator_long(it));
+                break;
+            case bson_double:
+                /* Line protocol has no NaN or infinity */
+                if (!isfinite(bson_iterator_double(it)))
+                    continue;
+                snprintf(value, sizeof(value), "%.17g",
+                        bson_iterator_double(it));
+                break;
+            case bson_bool:
+                snprintf(value, sizeof(value), "%s",
+                        bson_iterator_bool(it) ? "true" : "false");
+                break;
+            case bson_string:
+                str = bson_iterator_string(it);
+                break;
+            default:
+                continue;
+        }
+
+        if (!first)
+            out << ',';
+        first = false;
+
+        line_escape(out, key, ", =");
+        out << '=';
+        if (str) {
+            out << '"';
+            line_escape(out, str, "\"");
+            out << '"';
+        } else {
+            out << value;
+        }
+    }
+}
+
+void stats_export_line(stringbuf &out, const char *tags,
+        StatsExportDoc &doc, const bson *obj)
+{
+    char key[512];
+    bool first = false;
+    bson_iterator it;
+
+    out << "marss,kind=";
+    line_escape(out, doc.kind, ", =");
+    if (tags && *tags)
+        out << ',' << tags;
+
+    out << " sim_cycle=";
+    snprintf(key, sizeof(key), "%llui", (unsigned long long)doc.cycle);
+    out << key;
+
+    bson_iterator_init(&it, obj->data);
+    line_fields(out, &it, key, 0, sizeof(key), first);
+
+    snprintf(key, sizeof(key), " %llu\n", (unsigned long long)doc.time_ns);
+    out << key;
+}
+
+/* Mongo backend */
+
+class MongoExportBackend : public StatsExportBackend {
+    public:
+        MongoExportBackend(const char *server, int port)
+        {
+            strncpy(opts.host, server, 255);
+            opts.host[254] = '\0';
+            opts.port = port;
+            memset(conn, 0, sizeof(conn));
+            open = false;
+        }
+
+        ~MongoExportBackend() { disconnect(); }
+
+        const char* name() const { return "mongo"; }
+
+        bool connect()
+        {
+            if (mongo_connect(conn, &opts)) {
+                mongo_destroy(conn);
+                return false;
+            }
+            open = true;
+            return true;
+        }
+
+        void disconnect()
+        {
+            if (open)
+                mongo_destroy(conn);
+            open = false;
+        }
+
+        bool send(StatsExportDoc **docs, int count)
+        {
+            dynarray<bson*> periodic;
+            dynarray<bson*> results;
+            volatile bool ok = true;
+
+            foreach (i, count) {
+                bson *b = new bson();
+                stats_export_bson(*docs[i], b);
+                if (!strcmp(docs[i]->kind, "periodic"))
+                    periodic.push(b);
+                else
+                    results.push(b);
+            }
+
+            /* Network errors longjmp to MONGO_CATCH */
+            MONGO_TRY {
+                if (periodic.count())
+                    mongo_insert_batch(conn, "marss.periodic",
+                            &periodic[0], periodic.count());
+                if (results.count())
+                    mongo_insert_batch(conn, "marss.benchmarks",
+                            &results[0], results.count());
+                ok = !mongo_cmd_get_last_error(conn, "marss", NULL);
+            } MONGO_CATCH {
+                ok = false;
+            }
+
+            foreach (i, periodic.count()) {
+                bson_destroy(periodic[i]);
+                delete periodic[i];
+            }
+            foreach (i, results.count()) {
+                bson_destroy(results[i]);
+                delete results[i];
+            }
+
+            return ok;
+        }
+
+    private:
+        mongo_connection conn[1];
+        mongo_connection_options opts;
+        bool open;
+};
+
+StatsExportBackend* new_mongo_export_backend(const char *server, int port)
+{
+    return new MongoExportBackend(server, port);
+}
+
+/* Line protocol backend */
+
+class LineExportBackend : public StatsExportBackend {
+    public:
+        LineExportBackend(const char *server_, int port_, const char *tags_)
+        {
+            server = server_;
+            port = port_;
+            tags = tags_;
+            fd = -1;
+        }
+
+        ~LineExportBackend() { disconnect(); }
+
+        const char* name() const { return "line"; }
+
+        bool connect()
+        {
+            addrinfo hints, *res, *ai;
+            char portstr[16];
+
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            snprintf(portstr, sizeof(portstr), "%d", port);
+
+            if (getaddrinfo(server.buf, portstr, &hints, &res))
+                return false;
+
+            for (ai = res; ai; ai = ai->ai_next) {
+                fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0)
+                    continue;
+                if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+                    break;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(res);
+
+            return (fd >= 0);
+        }
+
+        void disconnect()
+        {
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+        }
+
+        bool send(StatsExportDoc **docs, int count)
+        {
+            stringbuf out;
+
+            foreach (i, count) {
+                bson b;
+                stats_export_bson(*docs[i], &b);
+                stats_export_line(out, tags.buf, *docs[i], &b);
+                bson_destroy(&b);
+            }
+
+            const char *p = out.buf;
+            int left = out.size();
+            while (left > 0) {
+                /* A closed connection must not raise SIGPIPE */
+                ssize_t n = ::send(fd, p, left, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                p += n;
+                left -= n;
+            }
+
+            return true;
+        }
+
+    private:
+        stringbuf server;
+        int port;
+        stringbuf tags;
+        int fd;
+};
+
+StatsExportBackend* new_line_export_backend(const char *server, int port,
+        const char *tags)
+{
+    return new LineExportBackend(server, port, tags);
+}
+
+/* Exporter */
+
+void* stats_exporter_thread(void *arg)
+{
+    StatsExporter *e = (StatsExporter*)arg;
+    dynarray<StatsExportDoc*> docs;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (!e->queued && !e->stopping)
+            pthread_cond_wait(&e->not_empty, &e->lock);
+
+        if (!e->queued) break;
+
+        /* Give a partial batch some time to fill up */
+        if (e->queued < e->batch && !e->stopping) {
+            timespec deadline;
+            W64 ns = wallclock_ns() + W64(STATS_EXPORT_BATCH_WAIT_MS) * 1000000;
+            deadline.tv_sec = ns / 1000000000ULL;
+            deadline.tv_nsec = ns % 1000000000ULL;
+
+            while (e->queued < e->batch && !e->stopping) {
+                if (pthread_cond_timedwait(&e->not_empty, &e->lock,
+                            &deadline) == ETIMEDOUT)
+                    break;
+            }
+        }
+
+        /* Slots stay queued, so they are not reused, until they are sent */
+        int n = min(e->queued, e->batch);
+        docs.clear();
+        foreach (i, n)
+            docs.push(&e->slots[(e->head + i) % e->slots.length]);
+        pthread_mutex_unlock(&e->lock);
+
+        e->send_batch(&docs[0], n);
+
+        pthread_mutex_lock(&e->lock);
+        e->head = (e->head + n) % e->slots.length;
+        e->queued -= n;
+        pthread_cond_broadcast(&e->not_full);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    return NULL;
+}
+
+StatsExporter::StatsExporter(StatsExportBackend *backend_, int batch_,
+        int depth)
+{
+    assert(backend_);
+    assert(batch_ > 0);
+    assert(depth > 0);
+
+    backend = backend_;
+    batch = min(batch_, depth);
+
+    slots.resize(depth);
+    foreach (i, depth) {
+        slots[i].stats = (StatsBuilder::get()).get_new_stats();
+        slots[i].kind = NULL;
+        slots[i].cycle = 0;
+        slots[i].time_ns = 0;
+    }
+    head = 0;
+    queued = 0;
+    stopping = false;
+    running = false;
+    connected = false;
+
+    sent = 0;
+    batches = 0;
+    retries = 0;
+    dropped = 0;
+    skipped = 0;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+}
+
+StatsExporter::~StatsExporter()
+{
+    stop();
+
+    pthread_cond_destroy(&not_full);
+    pthread_cond_destroy(&not_empty);
+    pthread_mutex_destroy(&lock);
+
+    foreach (i, slots.length)
+        (StatsBuilder::get()).destroy_stats(slots[i].stats);
+    delete backend;
+}
+
+bool StatsExporter::check_connection()
+{
+    assert(!running);
+
+    if (!connected)
+        connected = backend->connect();
+    return connected;
+}
+
+void StatsExporter::send_batch(StatsExportDoc **docs, int count)
+{
+    int delay_ms = STATS_EXPORT_RETRY_DELAY_MS;
+
+    foreach (attempt, STATS_EXPORT_RETRIES + 1) {
+        if (!connected)
+            connected = backend->connect();
+
+        if (connected && backend->send(docs, count)) {
+            sent += count;
+            batches++;
+            return;
+        }
+
+        backend->disconnect();
+        connected = false;
+
+        if (attempt == STATS_EXPORT_RETRIES)
+            break;
+
+        retries++;
+        usleep(delay_ms * 1000);
+        delay_ms *= 2;
+    }
+
+    dropped += count;
+}
+
+bool StatsExporter::export_stats(Stats &stats, const char *kind, W64 cycle,
+        bool wait, Stats *add)
+{
+    pthread_mutex_lock(&lock);
+    if (queued == slots.length) {
+        if (!wait) {
+            skipped++;
+            pthread_mutex_unlock(&lock);
+            return false;
+        }
+        while (queued == slots.length)
+            pthread_cond_wait(&not_full, &lock);
+    }
+    StatsExportDoc &doc = slots[(head + queued) % slots.length];
+    pthread_mutex_unlock(&lock);
+
+    *doc.stats = stats;
+    if (add)
+        (StatsBuilder::get()).add_stats(*doc.stats, *add);
+    doc.kind = kind;
+    doc.cycle = cycle;
+    doc.time_ns = wallclock_ns();
+
+    pthread_mutex_lock(&lock);
+    queued++;
+
+    if (!running) {
+        stopping = false;
+        running = !pthread_create(&thread, NULL, stats_exporter_thread, this);
+    }
+
+    if (!running) {
+        /* No thread, send it from here */
+        StatsExportDoc *d = &doc;
+        queued--;
+        pthread_mutex_unlock(&lock);
+        send_batch(&d, 1);
+        return true;
+    }
+
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&lock);
+
+    return true;
+}
+
+void StatsExporter::stop()
+{
+    pthread_mutex_lock(&lock);
+    bool was_running = running;
+    stopping = true;
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&lock);
+
+    if (was_running)
+        pthread_join(thread, NULL);
+    running = false;
+
+    backend->disconnect();
+    connected = false;
+
+    if (!sent && !dropped && !skipped)
+        return;
+
+    ptl_logfile << "Stats export (", backend->name(), "): ", sent,
+                " snapshots in ", batches, " batches, ", retries,
+                " retries, ", dropped, " dropped, ", skipped,
+                " skipped on a full queue", endl;
+
+    if (dropped)
+        cerr << "Stats export (" << backend->name() << ") failed to send "
+             << dropped << " snapshots" << endl;
+
+    /* Next run of the thread reports only its own snapshots */
+    sent = batches = retries = dropped = skipped = 0;
+}
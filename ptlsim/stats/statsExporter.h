@@ -0,0 +1,154 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STATS_EXPORTER_H
+#define STATS_EXPORTER_H
+
+#include <globals.h>
+#include <superstl.h>
+
+#include <statsBuilder.h>
+
+#include <pthread.h>
+
+/**
+ * @brief One stats snapshot queued for export
+ */
+struct StatsExportDoc {
+    Stats *stats;
+    const char *kind;   /* "periodic", "user", "kernel" or "total" */
+    W64 cycle;
+    W64 time_ns;        /* Host wall clock time the snapshot was taken */
+};
+
+/**
+ * @brief Destination of exported stats, e.g. a database server
+ *
+ * All calls come from the exporter thread. send() gets documents in the
+ * order they were queued and returns false if any of them may not have
+ * been stored; the exporter then reconnects and sends the batch again.
+ */
+class StatsExportBackend {
+    public:
+        virtual ~StatsExportBackend() {}
+
+        virtual const char* name() const = 0;
+        virtual bool connect() = 0;
+        virtual void disconnect() = 0;
+        virtual bool send(StatsExportDoc **docs, int count) = 0;
+};
+
+/**
+ * @brief MongoDB backend
+ *
+ * Final stats go to 'marss.benchmarks' as before, periodic snapshots to
+ * 'marss.periodic'. Each batch is one insert followed by getlasterror.
+ */
+StatsExportBackend* new_mongo_export_backend(const char *server, int port);
+
+/**
+ * @brief Time-series line protocol over TCP
+ *
+ * As accepted by InfluxDB/Telegraf socket listeners and QuestDB. Each
+ * document is one 'marss' line tagged with its kind and given tags
+ * (already in 'key=value,...' form), with one field per stat.
+ */
+StatsExportBackend* new_line_export_backend(const char *server, int port,
+        const char *tags);
+
+/**
+ * @brief Build the BSON document of a snapshot
+ *
+ * Holds the Stats tree as StatsBuilder::dump() writes it, plus 'kind' and
+ * 'sim_cycle'. Caller must bson_destroy() out.
+ */
+void stats_export_bson(StatsExportDoc &doc, bson *out);
+
+/**
+ * @brief Append line protocol line of a snapshot's BSON document
+ *
+ * Nested objects and arrays become '.' separated field keys.
+ */
+void stats_export_line(stringbuf &out, const char *tags,
+        StatsExportDoc &doc, const bson *obj);
+
+/**
+ * @brief Append ',key=value' to a line protocol tag set, escaped
+ */
+void stats_export_add_tag(stringbuf &tags, const char *key,
+        const char *value);
+
+/**
+ * @brief Ships stats snapshots to a StatsExportBackend from a background
+ * thread
+ *
+ * export_stats() copies the given Stats into a free snapshot and queues
+ * it; the exporter thread builds the documents and sends up to 'batch' of
+ * them at a time over one connection it keeps open. A failed batch is
+ * retried with growing delays before it is dropped. Periodic snapshots are
+ * skipped when all snapshots are queued, final stats wait for one.
+ *
+ * The thread starts with the first queued snapshot and stop() writes out
+ * all queued snapshots and joins it, so the exporter can be stopped before
+ * fork() and used again afterwards.
+ */
+class StatsExporter {
+    public:
+        StatsExporter(StatsExportBackend *backend_, int batch_, int depth);
+        ~StatsExporter();
+
+        /**
+         * @brief Queue a copy of stats (plus add, if given)
+         *
+         * @param wait Wait for a free snapshot instead of skipping
+         *
+         * @return false if the snapshot was skipped
+         */
+        bool export_stats(Stats &stats, const char *kind, W64 cycle,
+                bool wait, Stats *add = NULL);
+
+        /**
+         * @brief Tries to connect, for a check at simulation start
+         */
+        bool check_connection();
+
+        void stop();
+
+        StatsExportBackend* get_backend() { return backend; }
+
+        /* Counters, reported by stop() */
+        W64 sent;
+        W64 batches;
+        W64 retries;
+        W64 dropped;
+        W64 skipped;
+
+    private:
+        friend void* stats_exporter_thread(void *arg);
+
+        StatsExportBackend *backend;
+        int batch;
+
+        dynarray<StatsExportDoc> slots;
+        int head;
+        int queued;
+        bool stopping;
+        bool running;
+        bool connected;
+
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+
+        void send_batch(StatsExportDoc **docs, int count);
+};
+
+#endif // STATS_EXPORTER_H
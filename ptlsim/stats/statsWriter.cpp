@@ -0,0 +1,446 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#include <statsWriter.h>
+
+#include <sys/uio.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+
+StatsWriter::StatsWriter(Format format_, int fd_)
+    : format(format_)
+      , fd(fd_)
+      , failed(false)
+      , chunk(0)
+      , pos(0)
+      , written(0)
+      , buffered(0)
+      , depth(0)
+      , docs(0)
+{
+    /* Without a file the output stays here, chunks are added as needed */
+    int count = (fd >= 0) ? WRITER_CHUNKS : 1;
+
+    foreach (i, count)
+        chunks.push(new char[WRITER_CHUNK_SIZE]);
+}
+
+StatsWriter::~StatsWriter()
+{
+    flush();
+
+    foreach (i, chunks.count())
+        delete [] chunks[i];
+}
+
+void StatsWriter::begin_list()
+{
+    if (format == JSON_FORMAT)
+        raw('[');
+}
+
+void StatsWriter::end_list()
+{
+    if (format == JSON_FORMAT)
+        raw("\n]\n");
+}
+
+void StatsWriter::begin_doc()
+{
+    depth = 0;
+
+    if (format == YAML_FORMAT) {
+        raw("---");
+    } else if (docs) {
+        raw(',');
+    }
+
+    docs++;
+}
+
+void StatsWriter::end_doc()
+{
+    assert(depth == 0);
+
+    if (format == YAML_FORMAT)
+        raw('\n');
+}
+
+void StatsWriter::push(bool flow, bool seq)
+{
+    assert(depth < WRITER_MAX_DEPTH);
+
+    Level &level = levels[depth++];
+    level.flow = flow;
+    level.seq = seq;
+    level.count = 0;
+}
+
+void StatsWriter::newline(int indent)
+{
+    char *p = reserve(indent + 1);
+    *p++ = '\n';
+    memset(p, ' ', indent);
+}
+
+/*
+ * Block maps put each entry on its own line, indented 2 per level, and
+ * in JSON one more level in than the map's braces
+ */
+void StatsWriter::entry(const char *key, bool block)
+{
+    assert(depth > 0);
+    Level &level = levels[depth - 1];
+
+    if (level.flow) {
+        if (level.count)
+            raw(", ");
+    } else {
+        if (format == JSON_FORMAT && level.count)
+            raw(',');
+        newline(2 * (depth - 1) + (format == JSON_FORMAT ? 2 : 0));
+    }
+
+    level.count++;
+    put_string(key);
+
+    if (block)
+        raw(':');
+    else
+        raw(": ", 2);
+}
+
+void StatsWriter::separator()
+{
+    assert(depth > 0);
+    Level &level = levels[depth - 1];
+
+    if (level.count)
+        raw(", ");
+    level.count++;
+}
+
+void StatsWriter::begin_map(const char *key)
+{
+    if (depth) {
+        entry(key, format == YAML_FORMAT);
+        if (format == JSON_FORMAT)
+            raw('{');
+    } else if (format == JSON_FORMAT) {
+        newline(0);
+        raw('{');
+    }
+
+    push(false, false);
+}
+
+void StatsWriter::end_map()
+{
+    assert(depth > 0);
+    Level &level = levels[--depth];
+
+    /* Same as YAML::Emitter, an empty block map is {} on its own line */
+    if (format == YAML_FORMAT) {
+        if (!level.count) {
+            newline(2 * depth);
+            raw("{}");
+        }
+    } else {
+        if (level.count)
+            newline(2 * depth);
+        raw('}');
+    }
+}
+
+void StatsWriter::begin_flow_seq(const char *key)
+{
+    entry(key, false);
+    raw('[');
+    push(true, true);
+}
+
+void StatsWriter::end_flow_seq()
+{
+    assert(depth > 0 && levels[depth - 1].seq);
+    depth--;
+    raw(']');
+}
+
+void StatsWriter::begin_flow_map(const char *key)
+{
+    entry(key, false);
+    raw('{');
+    push(true, false);
+}
+
+void StatsWriter::end_flow_map()
+{
+    assert(depth > 0 && !levels[depth - 1].seq);
+    depth--;
+    raw('}');
+}
+
+/*
+ * Output is in the used part of chunks 0 to 'chunk': 'ends' has the size
+ * of each full chunk, as a value that doesn't fit in the rest of a chunk
+ * starts the next one.
+ */
+char* StatsWriter::reserve(int len)
+{
+    assert(len <= WRITER_CHUNK_SIZE);
+
+    if unlikely (pos + len > WRITER_CHUNK_SIZE) {
+        ends.push(pos);
+        chunk++;
+        pos = 0;
+
+        if (chunk == chunks.count()) {
+            if (fd >= 0)
+                flush();
+            else
+                chunks.push(new char[WRITER_CHUNK_SIZE]);
+        }
+    }
+
+    char *p = chunks[chunk] + pos;
+    pos += len;
+    buffered += len;
+    return p;
+}
+
+void StatsWriter::raw(const char *s, int len)
+{
+    while (len) {
+        int n = min(len, int(WRITER_CHUNK_SIZE) - pos);
+        if (!n)
+            n = min(len, int(WRITER_CHUNK_SIZE));
+
+        memcpy(reserve(n), s, n);
+        s += n;
+        len -= n;
+    }
+}
+
+void StatsWriter::raw(char c)
+{
+    *reserve(1) = c;
+}
+
+bool StatsWriter::flush()
+{
+    if (fd < 0 || failed)
+        return !failed;
+
+    struct iovec iov[WRITER_CHUNKS + 1];
+    int count = 0;
+
+    foreach (i, ends.count()) {
+        iov[count].iov_base = chunks[i];
+        iov[count].iov_len = ends[i];
+        count++;
+    }
+
+    /* After the last chunk is full, reserve() flushes before using one */
+    if (chunk < chunks.count() && pos) {
+        iov[count].iov_base = chunks[chunk];
+        iov[count].iov_len = pos;
+        count++;
+    }
+
+    struct iovec *next = iov;
+    while (count) {
+        ssize_t n = writev(fd, next, count);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            failed = true;
+            break;
+        }
+
+        while (count && size_t(n) >= next->iov_len) {
+            n -= next->iov_len;
+            next++;
+            count--;
+        }
+
+        if (count) {
+            next->iov_base = (char*)next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+
+    written += buffered;
+    buffered = 0;
+    ends.clear();
+    chunk = 0;
+    pos = 0;
+
+    return !failed;
+}
+
+static void append(stringbuf &out, const char *data, int len)
+{
+    out.reserve(len + 1);
+    memcpy(out.p, data, len);
+    out.p += len;
+    *out.p = 0;
+}
+
+void StatsWriter::str(stringbuf &out) const
+{
+    foreach (i, ends.count())
+        append(out, chunks[i], ends[i]);
+
+    append(out, chunks[chunk], pos);
+}
+
+void StatsWriter::put_unsigned(W64 v)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+
+    do {
+        *--p = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+
+    raw(p, buf + sizeof(buf) - p);
+}
+
+void StatsWriter::put_signed(W64s v)
+{
+    if (v < 0) {
+        raw('-');
+        put_unsigned(-W64(v));
+    } else {
+        put_unsigned(W64(v));
+    }
+}
+
+void StatsWriter::put(double d)
+{
+    if (format == JSON_FORMAT && !isfinite(d)) {
+        raw("null", 4);
+        return;
+    }
+
+    /* Same as a default std::ostream, which YAML::Emitter writes with */
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%g", d);
+    raw(buf, len);
+}
+
+void StatsWriter::put(bool b)
+{
+    raw(b ? "true" : "false");
+}
+
+void StatsWriter::put(const char *s)
+{
+    put_string(s ? s : "");
+}
+
+void StatsWriter::put_string(const char *s)
+{
+    bool in_flow = depth && levels[depth - 1].flow;
+
+    if (format == JSON_FORMAT || needs_quotes(s, in_flow))
+        put_quoted(s);
+    else
+        raw(s);
+}
+
+void StatsWriter::put_quoted(const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    raw('"');
+
+    const char *start = s;
+    for (; *s; s++) {
+        byte c = *s;
+        if (c != '"' && c != '\\' && c >= 0x20)
+            continue;
+
+        raw(start, s - start);
+        start = s + 1;
+
+        if (c == '"') {
+            raw("\\\"", 2);
+        } else if (c == '\\') {
+            raw("\\\\", 2);
+        } else if (format == JSON_FORMAT) {
+            char esc[] = "\\u0000";
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xf];
+            raw(esc, 6);
+        } else {
+            char esc[] = "\\x00";
+            esc[2] = hex[c >> 4];
+            esc[3] = hex[c & 0xf];
+            raw(esc, 4);
+        }
+    }
+
+    raw(start, s - start);
+    raw('"');
+}
+
+/*
+ * Plain scalar rules of YAML::Emitter (IsValidPlainScalar), for ASCII:
+ * no indicator at the start, no ': ' or ' #' and nothing unprintable.
+ */
+bool StatsWriter::needs_quotes(const char *s, bool in_flow) const
+{
+    static const char *start_block = ",[]{}#&*!|>'\"%@`";
+    static const char *start_flow = "?,[]{}#&*!|>'\"%@`";
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+#define IS_BREAK(c) ((c) == '\n' || (c) == '\r')
+
+    if (!s[0])
+        return true;
+
+    if (IS_BLANK(s[0]) || IS_BREAK(s[0]) ||
+            strchr(in_flow ? start_flow : start_block, s[0]))
+        return true;
+
+    if (strchr(in_flow ? "-:" : "-?:", s[0]) && IS_BLANK(s[1]))
+        return true;
+
+    int len = strlen(s);
+    if (s[len - 1] == ' ')
+        return true;
+
+    foreach (i, len) {
+        byte c = s[i];
+        byte next = s[i + 1];
+
+        if (c == ':' && (IS_BLANK(next) || IS_BREAK(next) ||
+                    (in_flow && next && strchr(",]}", next))))
+            return true;
+
+        if (in_flow && strchr(",?[]{}", c))
+            return true;
+
+        if ((IS_BLANK(c) || IS_BREAK(c)) && next == '#')
+            return true;
+
+        if ((c < 0x20 && c != '\r') || c == 0x7f)
+            return true;
+    }
+
+#undef IS_BLANK
+#undef IS_BREAK
+
+    return false;
+}
@@ -0,0 +1,159 @@
+
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * This code is released under GPL.
+ *
+ * Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+ *
+ */
+
+#ifndef STATS_WRITER_H
+#define STATS_WRITER_H
+
+#include <globals.h>
+#include <superstl.h>
+
+/**
+ * @brief Streaming writer of stats dumps, in YAML or JSON
+ *
+ * Writes the same YAML that YAML::Emitter writes for a Stats tree, block
+ * maps with flow sequences and flow maps as leafs, without building any
+ * state per node: each key and value is formatted straight into a
+ * preallocated buffer of WRITER_CHUNKS chunks. With a file descriptor the
+ * full chunks are written out with one writev() each time all of them are
+ * used, else more chunks are added as needed and the output is read back
+ * with str().
+ *
+ * A document is one block map: begin_map()/end_map() nest maps under a
+ * key, write() adds a key and its value and begin_flow_seq() or
+ * begin_flow_map() start a leaf that item() and write() fill.
+ *
+ * In JSON, documents are separated by ',' so the documents of a dump form
+ * one array, see begin_list(). Values that are not finite are null.
+ */
+class StatsWriter {
+    public:
+        enum Format { YAML_FORMAT, JSON_FORMAT };
+
+        enum {
+            WRITER_CHUNK_SIZE = 64 * 1024,
+            WRITER_CHUNKS = 16,
+            WRITER_MAX_DEPTH = 64,
+        };
+
+        StatsWriter(Format format = YAML_FORMAT, int fd = -1);
+        ~StatsWriter();
+
+        Format get_format() const { return format; }
+
+        /* JSON array around the documents of a dump, nothing in YAML */
+        void begin_list();
+        void end_list();
+
+        void begin_doc();
+        void end_doc();
+
+        /**
+         * @brief Start a block map, under key or as the document's map
+         */
+        void begin_map(const char *key = NULL);
+        void end_map();
+
+        void begin_flow_seq(const char *key);
+        void end_flow_seq();
+
+        void begin_flow_map(const char *key);
+        void end_flow_map();
+
+        /**
+         * @brief Add key: value to the current map
+         */
+        template<typename T>
+        void write(const char *key, T value)
+        {
+            entry(key, false);
+            put(value);
+        }
+
+        /**
+         * @brief Add value to the current flow sequence
+         */
+        template<typename T>
+        void item(T value)
+        {
+            separator();
+            put(value);
+        }
+
+        /**
+         * @brief Write out all buffered output, if there is a file
+         *
+         * @return false if writing to the file failed
+         */
+        bool flush();
+
+        /**
+         * @brief Copy all output written so far, without a file
+         */
+        void str(stringbuf &out) const;
+
+        /* Bytes written so far */
+        W64 size() const { return written + buffered; }
+
+        bool good() const { return !failed; }
+
+    private:
+        struct Level {
+            bool flow;
+            bool seq;
+            int count;
+        };
+
+        Format format;
+        int fd;
+        bool failed;
+
+        dynarray<char*> chunks;
+        dynarray<int> ends;
+        int chunk;
+        int pos;
+        W64 written;
+        W64 buffered;
+
+        Level levels[WRITER_MAX_DEPTH];
+        int depth;
+        int docs;
+
+        void push(bool flow, bool seq);
+        void newline(int indent);
+        void entry(const char *key, bool block);
+        void separator();
+
+        void raw(const char *s, int len);
+        void raw(const char *s) { raw(s, strlen(s)); }
+        void raw(char c);
+        char* reserve(int len);
+
+        void put(const char *s);
+        void put(char *s) { put((const char*)s); }
+        void put(bool b);
+        void put(double d);
+        void put(float f) { put((double)f); }
+        void put(W64 v) { put_unsigned(v); }
+        void put(W32 v) { put_unsigned(v); }
+        void put(W16 v) { put_unsigned(v); }
+        void put(unsigned long v) { put_unsigned(v); }
+        void put(W64s v) { put_signed(v); }
+        void put(W32s v) { put_signed(v); }
+        void put(W16s v) { put_signed(v); }
+        void put(long v) { put_signed(v); }
+
+        void put_unsigned(W64 v);
+        void put_signed(W64s v);
+        void put_string(const char *s);
+        void put_quoted(const char *s);
+        bool needs_quotes(const char *s, bool in_flow) const;
+};
+
+#endif // STATS_WRITER_H
@@ -11,6 +11,7 @@
 #include <atomcore.cpp>
 
 #include <machine.h>
+#include <coherentCache.h>
 
 void gen_atom_test_machine(BaseMachine& machine)
 {
@@ -238,14 +239,14 @@ namespace {
         TestDispatchQueue(thread);
     }
 
-    void TestFetchQueue(AtomCore *core)
+    void TestFetchQueue(AtomThread *thread)
     {
-        int queue_size = core->fetchq.size;
+        int queue_size = thread->fetchq.size;
         ASSERT_EQ(queue_size, NUM_FRONTEND_STAGES + 1);
-        ASSERT_EQ(core->fetchq.count, 0);
+        ASSERT_EQ(thread->fetchq.count, 0);
 
         foreach(i, NUM_FRONTEND_STAGES) {
-            BufferEntry& fetchBuf = core->fetchq(i);
+            BufferEntry& fetchBuf = thread->fetchq(i);
             ASSERT_FALSE(fetchBuf.op);
             ASSERT_EQ(fetchBuf.index(), i);
         }
@@ -267,12 +268,12 @@ namespace {
             ASSERT_EQ(core->get_coreid(), i);
             ASSERT_EQ(core->threadcount, 1);
 
-            // Test Fetch-Queue
-            TestFetchQueue(core);
-
             // Test Thread
             AtomThread* thread = core->threads[0];
 
+            // Test Fetch-Queue
+            TestFetchQueue(thread);
+
             ASSERT_EQ(&thread->core, core);
             TestAtomThread(thread, i);
         }
@@ -414,35 +415,35 @@ namespace {
 
         // First mark the 'waiting_for_icache_miss' to true and make
         // sure that fetch returns without any changes to fetchq
-        int old_count = core.fetchq.count;
+        int old_count = thread.fetchq.count;
         thread.waiting_for_icache_miss = true;
         ASSERT_TRUE(thread.fetch());
-        ASSERT_EQ(core.fetchq.count, old_count);
+        ASSERT_EQ(thread.fetchq.count, old_count);
         thread.waiting_for_icache_miss = false;
 
         // Now fill up the fetchq and make sure that fetch returns without any
         // changes to fetchq
-        old_count = core.fetchq.count;
+        old_count = thread.fetchq.count;
         ASSERT_EQ(old_count, 0);
         foreach(i, NUM_FRONTEND_STAGES) {
-            ASSERT_GT(core.fetchq.remaining(), 0) << "No fetch entry " \
-                "remaining for i=" << i << " count=" << core.fetchq.count;
-            ASSERT_TRUE(core.fetchq.alloc());
+            ASSERT_GT(thread.fetchq.remaining(), 0) << "No fetch entry " \
+                "remaining for i=" << i << " count=" << thread.fetchq.count;
+            ASSERT_TRUE(thread.fetchq.alloc());
         }
-        ASSERT_FALSE(core.fetchq.remaining());
-        ASSERT_EQ(core.fetchq.count, old_count + NUM_FRONTEND_STAGES);
-        ASSERT_NE(core.fetchq.head, core.fetchq.tail);
+        ASSERT_FALSE(thread.fetchq.remaining());
+        ASSERT_EQ(thread.fetchq.count, old_count + NUM_FRONTEND_STAGES);
+        ASSERT_NE(thread.fetchq.head, thread.fetchq.tail);
 
         ASSERT_TRUE(thread.fetch());
 
         // Mark the thread's stall_frontend
         // clear the fetchq
-        core.fetchq.reset();
+        thread.fetchq.reset();
         thread.stall_frontend = true;
         thread.waiting_for_icache_miss = false;
-        old_count = core.fetchq.count;
+        old_count = thread.fetchq.count;
         ASSERT_TRUE(thread.fetch());
-        ASSERT_EQ(core.fetchq.count, old_count);
+        ASSERT_EQ(thread.fetchq.count, old_count);
     }
 
     TEST_F(AtomCoreTest, FetchLogenable)
@@ -455,7 +456,7 @@ namespace {
         thread.fetchrip.rip = config.start_log_at_rip;
         logenable = 0;
 
-        ASSERT_TRUE(core.fetchq.remaining());
+        ASSERT_TRUE(thread.fetchq.remaining());
 
         thread.fetch();
 
@@ -577,7 +578,7 @@ namespace {
         thread->fetchrip = rvp;
         thread->current_bb = bb;
 
-        synth_uops_for_bb(*bb);
+        synth_uops_for_bb(*bb, fill_uop_desc);
     }
 
     TEST_F(AtomCoreTest, AtomOpFetch)
@@ -598,7 +599,7 @@ namespace {
 
             // We have fetched only 1st opcode that has 1 uop
             // Get the buffer entry and AtomOp
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -639,7 +640,7 @@ namespace {
             ASSERT_TRUE(thread.fetch_into_atomop());
             ASSERT_EQ(thread.fetch_uuid, ++uuid_counter);
 
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -678,7 +679,7 @@ namespace {
             ASSERT_TRUE(thread.fetch_into_atomop());
             ASSERT_EQ(thread.fetch_uuid, ++uuid_counter);
 
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -721,7 +722,7 @@ namespace {
             ASSERT_FALSE(thread.fetch_into_atomop());
             ASSERT_EQ(thread.fetch_uuid, ++uuid_counter);
 
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -753,7 +754,7 @@ namespace {
             ASSERT_FALSE(thread.fetch_into_atomop());
             ASSERT_EQ(thread.fetch_uuid, ++uuid_counter);
 
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -803,7 +804,7 @@ namespace {
             ASSERT_TRUE(thread.fetch_into_atomop());
             ASSERT_EQ(thread.fetch_uuid, ++uuid_counter);
 
-            BufferEntry& fetch_entry = core.fetchq(fetch_counter++);
+            BufferEntry& fetch_entry = thread.fetchq(fetch_counter++);
             ASSERT_TRUE(fetch_entry.op);
 
             AtomOp& op = *fetch_entry.op;
@@ -849,6 +850,50 @@ namespace {
         ASSERT_EQ(thread.bb_transop_index, 0);
     }
 
+    TEST_F(AtomCoreTest, AtomOpTemplates)
+    {
+        AtomCore& core = *(AtomCore*)base_machine->cores[0];
+        AtomThread& thread = *core.threads[0];
+
+        SetupBBCache(&thread);
+
+        BasicBlock& bb = *thread.current_bb;
+        ASSERT_FALSE(bb.coredata);
+
+        AtomOpTemplate* tmpls = get_atomop_templates(bb);
+        ASSERT_TRUE(tmpls);
+        ASSERT_EQ(bb.coredata, tmpls);
+
+        /* Built once and reused */
+        ASSERT_EQ(get_atomop_templates(bb), tmpls);
+
+        // 'and' is one AtomOp of 1 uop
+        ASSERT_EQ(tmpls[0].num_uops, 1);
+        ASSERT_EQ(tmpls[0].fu_mask, 0x333);
+        ASSERT_EQ(tmpls[0].port_mask, 3);
+        ASSERT_EQ(tmpls[0].flags, ATOMOP_TMPL_SOM|ATOMOP_TMPL_EOM);
+        ASSERT_EQ(tmpls[0].src_registers[0], REG_rax);
+        ASSERT_EQ(tmpls[0].src_registers[1], REG_rax);
+        ASSERT_EQ(tmpls[0].src_registers[2], (W8)-1);
+        ASSERT_EQ(tmpls[0].dest_registers[0], REG_temp0);
+
+        // 'add' and 'ld' of the 'mov' from memory go in one AtomOp
+        ASSERT_EQ(tmpls[1].num_uops, 2);
+        ASSERT_EQ(tmpls[1].fu_mask, FU_AGU0|FU_AGU1);
+        ASSERT_EQ(tmpls[1].port_mask, 1);
+        ASSERT_EQ(tmpls[1].dest_registers[0], REG_temp8);
+        ASSERT_EQ(tmpls[1].dest_registers[1], REG_rdx);
+        ASSERT_EQ(tmpls[1].dest_registers[2], (W8)-1);
+
+        // Fetch copies the template
+        ASSERT_TRUE(thread.fetch_into_atomop());
+        AtomOp& op = *thread.fetchq(0).op;
+        ASSERT_EQ(op.num_uops_used, tmpls[0].num_uops);
+        ASSERT_EQ(op.fu_mask, tmpls[0].fu_mask);
+        ASSERT_EQ(op.src_registers[1], REG_rax);
+        ASSERT_EQ(thread.bb_transop_index, 1);
+    }
+
     TEST_F(AtomCoreTest, ThreadStoreBuf)
     {
         AtomCore& core = *(AtomCore*)base_machine->cores[0];
@@ -898,6 +943,32 @@ namespace {
         }
     }
 
+    TEST_F(AtomCoreTest, ForwardingBufferThreads)
+    {
+        AtomCore& core = *(AtomCore*)base_machine->cores[0];
+
+        // Same register of two threads gets two entries
+        core.set_forward(REG_rax, 0x1111, 0);
+        core.set_forward(REG_rax, 0x2222, 1);
+
+        ForwardEntry* buf = core.forwardbuf.probe(
+                AtomCore::forward_key(REG_rax, 0));
+        ASSERT_TRUE(buf);
+        ASSERT_EQ(buf->data, 0x1111);
+
+        buf = core.forwardbuf.probe(AtomCore::forward_key(REG_rax, 1));
+        ASSERT_TRUE(buf);
+        ASSERT_EQ(buf->data, 0x2222);
+
+        // Flushing a thread leaves the other thread's entries
+        core.clear_thread_forward(1);
+        ASSERT_FALSE(core.forwardbuf.probe(AtomCore::forward_key(REG_rax, 1)));
+        ASSERT_TRUE(core.forwardbuf.probe(AtomCore::forward_key(REG_rax, 0)));
+
+        core.clear_forward(REG_rax, 0);
+        ASSERT_FALSE(core.forwardbuf.probe(AtomCore::forward_key(REG_rax, 0)));
+    }
+
     TEST_F(AtomCoreTest, RegisterReady)
     {
         AtomCore& core = *(AtomCore*)base_machine->cores[0];
@@ -992,6 +1063,88 @@ namespace {
         }
     }
 
+    TEST_F(AtomCoreTest, WarmupHooks)
+    {
+        AtomCore* core = (AtomCore*)base_machine->cores[0];
+        AtomThread* thread = core->threads[0];
+        Context& ctx = thread->ctx;
+
+        ASSERT_TRUE(core->runs_context(ctx));
+        ASSERT_EQ(thread, core->get_thread(ctx));
+
+        if(base_machine->cores.count() > 1) {
+            ASSERT_FALSE(base_machine->cores[1]->runs_context(ctx));
+        }
+
+        // warm_tlb fills only the requested TLB
+        core->warm_tlb(ctx, 0x400000, false);
+        ASSERT_TRUE(core->dtlb.probe(0x400000, thread->threadid));
+        ASSERT_FALSE(core->itlb.probe(0x400000, thread->threadid));
+
+        core->warm_tlb(ctx, 0x500000, true);
+        ASSERT_TRUE(core->itlb.probe(0x500000, thread->threadid));
+
+        // Branch predictor survives a pipeline flush
+        BranchPredictorImplementation* impl = thread->branchpred.impl;
+        thread->flush_pipeline();
+        ASSERT_EQ(impl, thread->branchpred.impl);
+    }
+
+    TEST_F(AtomCoreTest, WarmAccess)
+    {
+        Memory::MemoryHierarchy* mem = base_machine->memoryHierarchyPtr;
+        Memory::Controller* l1_d = *base_machine->controller_hash.get("L1_D_0");
+        Memory::Controller* l1_i = *base_machine->controller_hash.get("L1_I_0");
+        Memory::Controller* l2 = *base_machine->controller_hash.get("L2_0");
+
+        Memory::MemoryRequest req;
+        req.init(0, 0, 0x12340, 0, sim_cycle, false, 0, 0,
+                Memory::MEMORY_OP_READ);
+
+        ASSERT_EQ(-1, l1_d->access_fast_path(NULL, &req));
+        ASSERT_EQ(-1, l2->access_fast_path(NULL, &req));
+
+        // Data access fills L1-D and L2 with a clean line
+        mem->warm_access(0, 0x12340, false, false);
+
+        ASSERT_GT(l1_d->access_fast_path(NULL, &req), 0);
+        ASSERT_GT(l2->access_fast_path(NULL, &req), 0);
+        ASSERT_EQ(-1, l1_i->access_fast_path(NULL, &req));
+        ASSERT_TRUE(l1_d->warm_line(&req));
+
+        // Instruction fetch of same line fills L1-I and stops at L2
+        mem->warm_access(0, 0x12340, true, true);
+        ASSERT_GT(l1_i->access_fast_path(NULL, &req), 0);
+    }
+
+    TEST_F(AtomCoreTest, FillFastPath)
+    {
+        Memory::MemoryHierarchy* mem = base_machine->memoryHierarchyPtr;
+        Memory::Controller* l1_d = *base_machine->controller_hash.get("L1_D_0");
+        Memory::Interconnect* link =
+            ((Memory::CoherentCache::CacheController*)l1_d)->
+            get_lower_intrconn();
+
+        Memory::MemoryRequest req;
+        req.init(0, 0, 0x23440, 0, sim_cycle, false, 0, 0,
+                Memory::MEMORY_OP_READ);
+        void *arg = NULL;
+
+        // Idle L2 gives its latency without looking up the line
+        int latency = link->fill_fast_path(l1_d, &req, false, &arg);
+        ASSERT_GT(latency, 0);
+        ASSERT_EQ(-1, link->fill_fast_path(l1_d, &req, true, &arg));
+        ASSERT_TRUE(arg == NULL);
+
+        mem->warm_access(0, 0x23440, false, false);
+        ASSERT_EQ(latency, link->fill_fast_path(l1_d, &req, true, &arg));
+        ASSERT_TRUE(arg != NULL);
+
+        // Writes have to update the lower cache
+        req.set_op_type(Memory::MEMORY_OP_WRITE);
+        ASSERT_EQ(-1, link->fill_fast_path(l1_d, &req, true, &arg));
+    }
+
     TEST(AtomCoreModelTest, CheckFUMap)
     {
         for(int i=0; i < (1 << FU_COUNT); i++) {
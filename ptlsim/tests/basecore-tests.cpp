@@ -4,6 +4,7 @@
 // We disable Assert of Simulator
 #define DISABLE_ASSERT
 #include <basecore.h>
+#include <coremigration.h>
 
 #include <machine.h>
 
@@ -58,4 +59,33 @@ namespace {
         }
     }
 
+    TEST_F(BaseCoreMachineTest, MigrationWithoutPeers)
+    {
+        base_machine->reset();
+        migration.init(*base_machine);
+
+        ASSERT_FALSE(migration.enabled());
+        ASSERT_FALSE(migration.request(base_machine->contextof(0),
+                    MIGRATE_SWAP, MIGRATION_SOURCE_GUEST));
+        ASSERT_EQ(migration.get_next_active_cycle(), infinity);
+    }
+
+    TEST_F(BaseCoreMachineTest, MigrationPolicyNames)
+    {
+        stringbuf saved;
+        saved = config.migration_policy.buf;
+
+        config.migration_policy = "ipc";
+        migration.config_changed(config);
+        ASSERT_EQ(migration.policy, MIGRATION_POLICY_IPC);
+
+        config.migration_policy = "unknown";
+        migration.config_changed(config);
+        ASSERT_EQ(migration.policy, MIGRATION_POLICY_NONE);
+        ASSERT_STREQ(config.migration_policy.buf, "none");
+
+        config.migration_policy = saved;
+        migration.config_changed(config);
+    }
+
 }; // namespace
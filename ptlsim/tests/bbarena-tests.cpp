@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+
+namespace {
+
+    class BasicBlockArenaTest : public ::testing::Test {
+        public:
+            BasicBlockArena arena;
+            BasicBlock bb;
+
+            BasicBlockArenaTest()
+            {
+                bb.reset(RIPVirtPhys(0x400000));
+            }
+
+            BasicBlock* make(int count)
+            {
+                bb.count = count;
+                foreach (i, count) {
+                    bb.transops[i].opcode = OP_add;
+                    bb.transops[i].rd = i;
+                }
+                return bb.clone(&arena);
+            }
+    };
+
+    TEST_F(BasicBlockArenaTest, SizeClasses)
+    {
+        ASSERT_EQ(0, BasicBlockArena::size_class(1));
+        ASSERT_EQ(0, BasicBlockArena::size_class(4));
+        ASSERT_EQ(1, BasicBlockArena::size_class(5));
+        ASSERT_EQ(BB_ARENA_CLASSES - 1,
+                BasicBlockArena::size_class(MAX_BB_UOPS*2));
+
+        /* Small blocks take a fraction of a full sized BasicBlock */
+        ASSERT_LT(BasicBlockArena::slot_size(BasicBlockArena::size_class(8)),
+                sizeof(BasicBlock) / 4);
+
+        /* Four uop descriptors per cache line */
+        ASSERT_EQ(16U, sizeof(UopDescriptor));
+    }
+
+    TEST_F(BasicBlockArenaTest, Clone)
+    {
+        BasicBlock* a = make(5);
+        BasicBlock* b = make(5);
+
+        ASSERT_EQ(&arena, a->arena);
+        ASSERT_EQ(5, a->count);
+        ASSERT_EQ(4, a->transops[4].rd);
+        ASSERT_FALSE(a->uopdescs);
+        ASSERT_EQ(2U, arena.live);
+
+        /* Same class slots are contiguous, uopdescs sit inside the slot */
+        ASSERT_EQ((byte*)a + BasicBlockArena::slot_size(1), (byte*)b);
+        UopDescriptor* descs = BasicBlockArena::uopdescs_of(*a);
+        ASSERT_GT((byte*)descs, (byte*)&a->transops[4]);
+        ASSERT_LE((byte*)(descs + 8), (byte*)b);
+        ASSERT_EQ(0U, (Waddr)descs & 63);
+
+        a->free();
+        b->free();
+        ASSERT_EQ(0U, arena.live);
+        ASSERT_EQ(0U, arena.used_bytes);
+    }
+
+    TEST_F(BasicBlockArenaTest, ReuseAndRelease)
+    {
+        BasicBlock* a = make(3);
+        BasicBlock* keep = make(20);
+        a->free();
+
+        /* Freed slot is reused by the next block of its class */
+        ASSERT_EQ(a, make(2));
+        ASSERT_FALSE(arena.release_chunks());
+
+        a->free();
+        keep->free();
+        ASSERT_TRUE(arena.release_chunks());
+        ASSERT_EQ(0U, arena.chunk_bytes);
+
+        /* Fill past one chunk */
+        dynarray<BasicBlock*> bbs;
+        while (arena.chunk_bytes <= BB_ARENA_CHUNK_SIZE) {
+            bbs.push(make(MAX_BB_UOPS*2));
+        }
+        ASSERT_EQ(2 * BB_ARENA_CHUNK_SIZE, arena.chunk_bytes);
+
+        foreach (i, bbs.length) {
+            bbs[i]->free();
+        }
+        ASSERT_TRUE(arena.release_chunks());
+    }
+};
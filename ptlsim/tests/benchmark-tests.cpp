@@ -0,0 +1,487 @@
+
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+#include <logic.h>
+#include <decode.h>
+#include <statelist.h>
+#include <statsBuilder.h>
+#include <memoryRequest.h>
+#include <cacheLines.h>
+
+#include <time.h>
+
+/*
+ * Host speed of the data structures on the simulator's hot paths.
+ *
+ * These are named DISABLED_ so -run-tests skips them. -run-benchmarks runs
+ * only these and writes gtest's XML report, in which every benchmark has
+ * 'ns_per_op' and 'ops' properties; tools/benchcmp.py compares two
+ * reports. Build with 'scons bench=1' to measure optimized code.
+ */
+
+namespace {
+
+    W64 bench_sink;
+
+    W64 now_ns()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (W64(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+    }
+
+    /*
+     * Calls op.run() in growing batches until a batch takes 200 ms, then
+     * records time per operation of that batch. run() does 'ops_per_run'
+     * operations and returns a value that is kept so the work is not
+     * optimized away.
+     */
+    template <typename Op>
+    void run_bench(Op& op, W64 ops_per_run)
+    {
+        W64 runs = 1;
+        W64 elapsed = 0;
+
+        for (;;) {
+            W64 start = now_ns();
+            foreach (i, runs) bench_sink += op.run();
+            elapsed = now_ns() - start;
+
+            if (elapsed >= 200000000ULL) break;
+
+            /* Aim a little past the target from the rate measured so far */
+            if (elapsed < 1000000ULL) runs *= 10;
+            else runs = runs * 240000000ULL / elapsed + 1;
+        }
+
+        W64 ops = runs * ops_per_run;
+        double ns_per_op = double(elapsed) / ops;
+
+        stringbuf sb;
+        sb << floatstring(ns_per_op, 0, 3);
+        ::testing::Test::RecordProperty("ns_per_op", sb.buf);
+        sb.reset();
+        sb << ops;
+        ::testing::Test::RecordProperty("ops", sb.buf);
+
+        const ::testing::TestInfo* info =
+            ::testing::UnitTest::GetInstance()->current_test_info();
+        stringbuf line;
+        line << "  ", info->name(), ": ", ops, " ops, ",
+             floatstring(ns_per_op, 0, 3), " ns/op";
+        std::cout << line.buf << std::endl;
+    }
+
+    /* Same pseudo random sequence on every run */
+    struct BenchRandom {
+        W64 state;
+        BenchRandom() : state(0x9e3779b97f4a7c15ULL) { }
+        W64 next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+    };
+
+    struct BenchListEntry : public FixStateListObject
+    {
+        W64 data;
+        void init() { data = 0; }
+    };
+
+    struct FixStateListOp {
+        FixStateList<BenchListEntry, 64> list;
+        BenchListEntry* entries[32];
+
+        W64 run()
+        {
+            foreach (i, 32) entries[i] = list.alloc();
+            foreach (i, 32) list.free(entries[(i * 7) & 31]);
+            return list.count();
+        }
+    };
+
+    TEST(DISABLED_Bench, FixStateListAllocFree)
+    {
+        FixStateListOp op;
+        run_bench(op, 64);
+        ASSERT_EQ(0, op.list.count());
+    }
+
+    struct BenchLine {
+        W64 data;
+        void reset() { data = 0; }
+    };
+
+    /* Accesses over twice the array capacity, about half of them miss */
+    struct AssociativeArrayOp {
+        AssociativeArray<W64, BenchLine, 64, 8, 64> array;
+        W64 addrs[1024];
+
+        AssociativeArrayOp()
+        {
+            BenchRandom rnd;
+            foreach (i, 1024) addrs[i] = (rnd.next() % 1024) * 64;
+        }
+
+        W64 run()
+        {
+            W64 hits = 0;
+            foreach (i, 1024) {
+                BenchLine* line = array.probe(addrs[i]);
+                if (line) hits++;
+                else array.select(addrs[i])->data = i;
+            }
+            return hits;
+        }
+    };
+
+    TEST(DISABLED_Bench, AssociativeArrayProbeSelect)
+    {
+        AssociativeArrayOp op;
+        run_bench(op, 1024);
+    }
+
+    struct OneHotTagsOp {
+        FullyAssociativeTagsNbitOneHot<64, 40> tags;
+        W64 keys[256];
+
+        OneHotTagsOp()
+        {
+            BenchRandom rnd;
+            W64 values[64];
+            foreach (i, 64) {
+                values[i] = rnd.next() & ((1ULL << 40) - 1);
+                tags.update(i, values[i]);
+            }
+            /* Three in four lookups match */
+            foreach (i, 256) {
+                keys[i] = (i & 3) ? values[rnd.next() % 64] :
+                    (rnd.next() & ((1ULL << 40) - 1));
+            }
+        }
+
+        W64 run()
+        {
+            W64 sum = 0;
+            foreach (i, 256) sum += tags.match(keys[i]);
+            return sum;
+        }
+    };
+
+    TEST(DISABLED_Bench, FullyAssociativeTagsNbitOneHotMatch)
+    {
+        OneHotTagsOp op;
+        run_bench(op, 256);
+    }
+
+    /* TLB sized, three in four lookups match */
+    template <int ways>
+    struct AssocTagsOp {
+        FullyAssociativeTags<W64, ways> tags;
+        W64 keys[256];
+        bool scalar;
+
+        AssocTagsOp(bool scalar_) : scalar(scalar_)
+        {
+            BenchRandom rnd;
+            W64 values[ways];
+            foreach (i, ways) {
+                values[i] = rnd.next() >> 12;
+                tags.select(values[i]);
+            }
+            foreach (i, 256) {
+                keys[i] = (i & 3) ? values[rnd.next() % ways] :
+                    (rnd.next() >> 12);
+            }
+        }
+
+        W64 run()
+        {
+            W64 sum = 0;
+            if (scalar) {
+                foreach (i, 256)
+                    sum += scalar_tag_match<W64, ways>(tags.tags, keys[i]);
+            } else {
+                foreach (i, 256) sum += tags.match(keys[i]);
+            }
+            return sum;
+        }
+    };
+
+    TEST(DISABLED_Bench, FullyAssociativeTagsMatch32)
+    {
+        AssocTagsOp<32> op(false);
+        run_bench(op, 256);
+    }
+
+    TEST(DISABLED_Bench, FullyAssociativeTagsScalarMatch32)
+    {
+        AssocTagsOp<32> op(true);
+        run_bench(op, 256);
+    }
+
+    TEST(DISABLED_Bench, FullyAssociativeTagsMatch64)
+    {
+        AssocTagsOp<64> op(false);
+        run_bench(op, 256);
+    }
+
+    TEST(DISABLED_Bench, FullyAssociativeTagsScalarMatch64)
+    {
+        AssocTagsOp<64> op(true);
+        run_bench(op, 256);
+    }
+
+    struct BenchHashEntry {
+        selflistlink hashlink;
+        W64 key;
+    };
+
+    struct BenchHashLinkManager {
+        static inline BenchHashEntry* objof(selflistlink* link) {
+            return baseof(BenchHashEntry, hashlink, link);
+        }
+
+        static inline W64& keyof(BenchHashEntry* obj) {
+            return obj->key;
+        }
+
+        static inline selflistlink* linkof(BenchHashEntry* obj) {
+            return &obj->hashlink;
+        }
+    };
+
+    /* Four entries per set, as a well used basic block cache */
+    template <typename Table>
+    struct HashtableLookupOp {
+        Table table;
+        BenchHashEntry entries[4096];
+        W64 keys[1024];
+
+        HashtableLookupOp()
+        {
+            BenchRandom rnd;
+            foreach (i, 4096) {
+                entries[i].key = rnd.next();
+                table.add(&entries[i]);
+            }
+            foreach (i, 1024) keys[i] = entries[rnd.next() % 4096].key;
+        }
+
+        W64 run()
+        {
+            W64 found = 0;
+            foreach (i, 1024) found += (table.get(keys[i]) != NULL);
+            return found;
+        }
+    };
+
+    TEST(DISABLED_Bench, SelfHashtableLookup)
+    {
+        HashtableLookupOp<SelfHashtable<W64, BenchHashEntry, 1024,
+            BenchHashLinkManager> > op;
+        run_bench(op, 1024);
+        ASSERT_EQ(W64(1024), op.run());
+        op.table.clear();
+    }
+
+    /* Grown from 64 slots on the way to 4096 entries */
+    TEST(DISABLED_Bench, OpenHashtableLookup)
+    {
+        HashtableLookupOp<OpenHashtable<W64, BenchHashEntry, 64,
+            BenchHashLinkManager> > op;
+        run_bench(op, 1024);
+        ASSERT_EQ(W64(1024), op.run());
+        op.table.clear();
+    }
+
+    /*
+     * Read hit path of the cache controllers: probe, then the hit latency
+     * and the line tag. CACHED reads them from the line bits and latency
+     * the controller keeps, as access_fast_path and complete_request do,
+     * instead of calling CacheLinesBase::latency and tagOf.
+     */
+    template <bool CACHED>
+    struct CacheHitOp {
+        Memory::CacheLinesBase* lines;
+        Memory::MemoryRequest request;
+        int lineBits;
+        int accessLatency;
+        W64 addrs[256];
+
+        CacheHitOp(Memory::CacheLinesBase* lines_) : lines(lines_)
+        {
+            lines->init();
+            lineBits = lines->get_line_bits();
+            accessLatency = lines->get_access_latency();
+
+            BenchRandom rnd;
+            foreach (i, 256) {
+                W64 oldTag;
+                addrs[i] = (rnd.next() % 4096) * 64 + (i & 63);
+                request.set_physical_address(addrs[i]);
+                lines->insert(&request, oldTag)->init(lines->tagOf(addrs[i]));
+            }
+        }
+
+        W64 run()
+        {
+            W64 sum = 0;
+            foreach (i, 256) {
+                request.set_physical_address(addrs[i]);
+                Memory::CacheLine* line = lines->probe(&request);
+                if (!line) continue;
+                if (CACHED) {
+                    sum += accessLatency;
+                    sum += (line->tag == ((addrs[i] >> lineBits) << lineBits));
+                } else {
+                    sum += lines->latency();
+                    sum += (line->tag == lines->tagOf(addrs[i]));
+                }
+            }
+            return sum;
+        }
+    };
+
+    TEST(DISABLED_Bench, CacheHitVirtualLatencyTag)
+    {
+        Memory::CacheLines<512, 8, 64, 2> *lines =
+            new Memory::CacheLines<512, 8, 64, 2>(2, 1);
+        CacheHitOp<false> *op = new CacheHitOp<false>(lines);
+        run_bench(*op, 256);
+        ASSERT_EQ(W64(256 * 3), op->run());
+        delete op;
+        delete lines;
+    }
+
+    TEST(DISABLED_Bench, CacheHitCachedLatencyTag)
+    {
+        Memory::CacheLines<512, 8, 64, 2> *lines =
+            new Memory::CacheLines<512, 8, 64, 2>(2, 1);
+        CacheHitOp<true> *op = new CacheHitOp<true>(lines);
+        run_bench(*op, 256);
+        ASSERT_EQ(W64(256 * 3), op->run());
+        delete op;
+        delete lines;
+    }
+
+    W64 signal_count;
+
+    bool bench_signal_handler(void *arg)
+    {
+        signal_count += (W64)arg;
+        return true;
+    }
+
+    struct SignalOp {
+        Signal signal;
+
+        SignalOp() : signal("bench")
+        {
+            signal.connect(signal_fun_ptr(bench_signal_handler));
+        }
+
+        W64 run()
+        {
+            foreach (i, 256) signal.emit((void*)1);
+            return signal_count;
+        }
+    };
+
+    TEST(DISABLED_Bench, SignalEmit)
+    {
+        SignalOp op;
+        run_bench(op, 256);
+    }
+
+    class BenchStat : public Statable {
+        public:
+            StatObj<W64> count;
+
+            BenchStat() : Statable("bench")
+                          , count("count", this)
+            {}
+    };
+
+    struct StatObjOp {
+        BenchStat& st;
+        Stats *stats;
+
+        StatObjOp(BenchStat& st_, Stats *stats_) : st(st_), stats(stats_) { }
+
+        W64 run()
+        {
+            /* As in the pipeline, where increments don't fold together */
+            foreach (i, 256) {
+                st.count++;
+                barrier();
+            }
+            return st.count(stats);
+        }
+    };
+
+    TEST(DISABLED_Bench, StatObjIncrement)
+    {
+        BenchStat st;
+        Stats *stats = StatsBuilder::get().get_new_stats();
+        st.set_default_stats(stats);
+
+        StatObjOp op(st, stats);
+        run_bench(op, 256);
+
+        StatsBuilder::get().destroy_stats(stats);
+    }
+
+    struct BasicBlockCacheOp {
+        BasicBlockCache cache;
+        BasicBlockArena arena;
+        dynarray<BasicBlock*> bbs;
+        RIPVirtPhys rips[1024];
+
+        BasicBlockCacheOp()
+        {
+            BasicBlock bb;
+            BenchRandom rnd;
+
+            foreach (i, 4096) {
+                bb.reset(RIPVirtPhys(0x400000 + i * 40));
+                bb.count = 4;
+                foreach (j, 4) bb.transops[j].opcode = OP_add;
+                BasicBlock* clone = bb.clone(&arena);
+                cache.add(clone);
+                bbs.push(clone);
+            }
+
+            foreach (i, 1024) rips[i] = bbs[rnd.next() % 4096]->rip;
+        }
+
+        ~BasicBlockCacheOp()
+        {
+            foreach (i, bbs.length) {
+                cache.remove(bbs[i]);
+                bbs[i]->free();
+            }
+        }
+
+        W64 run()
+        {
+            W64 found = 0;
+            foreach (i, 1024) found += (cache.get(rips[i]) != NULL);
+            return found;
+        }
+    };
+
+    TEST(DISABLED_Bench, BasicBlockCacheLookup)
+    {
+        BasicBlockCacheOp *op = new BasicBlockCacheOp();
+        run_bench(*op, 1024);
+        ASSERT_EQ(W64(1024), op->run());
+        delete op;
+    }
+};
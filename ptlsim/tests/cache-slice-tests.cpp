@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+#include <cacheSlice.h>
+#include <machine.h>
+
+using namespace Memory;
+
+namespace {
+
+    class CacheSliceTest : public ::testing::Test {
+        public:
+            BaseMachine *machine;
+            CacheSlice slices[4];
+
+            CacheSliceTest()
+            {
+                machine = (BaseMachine*)(PTLsimMachine::getmachine("base"));
+
+                foreach (i, 4) {
+                    machine->add_option("slice_L2_", i, "slices", 4);
+                }
+            }
+
+            void setup(const char *hash)
+            {
+                foreach (i, 4) {
+                    stringbuf name;
+                    name << "slice_L2_" << i;
+                    machine->add_option(name.buf, "slice_hash", hash);
+                    slices[i].setup(*machine, name.buf, i);
+                }
+            }
+
+            void check_distribution()
+            {
+                int lines[4] = {0};
+                /* Lines per set of a 256 set slice */
+                dynarray<int> sets[4];
+
+                foreach (i, 4) {
+                    sets[i].resize(256, 0);
+                }
+
+                for (W64 addr = 0; addr < (1 << 20); addr += 64) {
+                    int owners = 0;
+
+                    foreach (i, 4) {
+                        if (slices[i].owns(addr)) {
+                            owners++;
+                            lines[i]++;
+                            sets[i][(addr >> 6) & 255]++;
+                        }
+                    }
+
+                    ASSERT_EQ(1, owners);
+                }
+
+                /* 16K lines split close to evenly, no set left unused */
+                foreach (i, 4) {
+                    ASSERT_GT(lines[i], 3500);
+                    ASSERT_LT(lines[i], 4700);
+
+                    foreach (s, 256) {
+                        ASSERT_GT(sets[i][s], 0);
+                    }
+                }
+            }
+    };
+
+    TEST_F(CacheSliceTest, XORHash)
+    {
+        setup("xor");
+
+        ASSERT_TRUE(slices[0].is_sliced());
+        ASSERT_EQ(4, slices[0].count);
+        ASSERT_EQ(3, slices[3].index);
+        ASSERT_EQ(SLICE_HASH_XOR, slices[0].hash);
+
+        /* Whole lines go to one slice */
+        ASSERT_EQ(slices[0].get_slice(0x12340),
+                slices[0].get_slice(0x1237f));
+
+        check_distribution();
+    }
+
+    TEST_F(CacheSliceTest, CRCHash)
+    {
+        setup("crc");
+
+        ASSERT_EQ(SLICE_HASH_CRC, slices[0].hash);
+
+        check_distribution();
+    }
+
+    TEST_F(CacheSliceTest, NotSliced)
+    {
+        CacheSlice slice;
+        slice.setup(*machine, "slice_L1_D_0", 0);
+
+        ASSERT_FALSE(slice.is_sliced());
+        ASSERT_TRUE(slice.owns(0x1000));
+        ASSERT_TRUE(slice.owns(0x1040));
+    }
+
+    TEST_F(CacheSliceTest, MemoryInterleave)
+    {
+        CacheSlice mem[8];
+
+        /* 2 sockets of 4 page interleaved channels, 1GB per socket */
+        foreach (i, 8) {
+            machine->add_option("slice_MEM_", i, "interleave", 4);
+            machine->add_option("slice_MEM_", i, "interleave_bit", 12);
+            machine->add_option("slice_MEM_", i, "sockets", 2);
+            machine->add_option("slice_MEM_", i, "socket_bit", 30);
+        }
+
+        foreach (i, 8) {
+            stringbuf name;
+            name << "slice_MEM_" << i;
+            mem[i].setup_interleave(*machine, name.buf, i);
+        }
+
+        ASSERT_EQ(SLICE_HASH_BITS, mem[0].hash);
+        ASSERT_EQ(8, mem[0].count);
+
+        /* Whole pages go to one channel, next page to the next one */
+        ASSERT_EQ(0, mem[0].get_slice(0x0fff));
+        ASSERT_EQ(1, mem[0].get_slice(0x1000));
+        ASSERT_EQ(3, mem[0].get_slice(0x3000));
+        ASSERT_EQ(0, mem[0].get_slice(0x4000));
+
+        /* Second GB is on the channels of socket 1 */
+        ASSERT_EQ(4, mem[0].get_slice(0x40000000));
+        ASSERT_EQ(6, mem[0].get_slice(0x40002000));
+        ASSERT_TRUE(mem[6].owns(0x40002000));
+        ASSERT_FALSE(mem[2].owns(0x40002000));
+
+        /* Each controller sees its memory as dense addresses */
+        ASSERT_EQ(0x0, mem[1].local_address(0x1000));
+        ASSERT_EQ(0x1040, mem[1].local_address(0x5040));
+        ASSERT_EQ(0x1040, mem[5].local_address(0x40005040));
+
+        for (W64 addr = 0; addr < (1ULL << 31); addr += 0x1000) {
+            int owners = 0;
+
+            foreach (i, 8) {
+                if (mem[i].owns(addr))
+                    owners++;
+            }
+
+            ASSERT_EQ(1, owners);
+            ASSERT_LT(mem[0].local_address(addr), 1ULL << 28);
+        }
+    }
+
+    TEST_F(CacheSliceTest, SingleMemoryController)
+    {
+        CacheSlice mem;
+        mem.setup_interleave(*machine, "slice_MEM_single_0", 0);
+
+        ASSERT_FALSE(mem.is_sliced());
+        ASSERT_TRUE(mem.owns(0x40002000));
+        ASSERT_EQ(0x40002000, mem.local_address(0x40002000));
+    }
+};
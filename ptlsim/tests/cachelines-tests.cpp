@@ -0,0 +1,538 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <memoryRequest.h>
+#include <cacheLines.h>
+
+using namespace Memory;
+
+namespace {
+
+    /*
+     * Run the same random probe/insert/invalidate sequence through both
+     * CacheLines backends and check that they agree on every result.
+     */
+    template <int SETS, int WAYS>
+    void compare_backends()
+    {
+        CacheLines<SETS, WAYS, 64, 2> *lines =
+            new CacheLines<SETS, WAYS, 64, 2>(2, 1);
+        VectorCacheLines<SETS, WAYS, 64, 2> *vlines =
+            new VectorCacheLines<SETS, WAYS, 64, 2>(2, 1);
+        lines->init();
+        vlines->init();
+
+        MemoryRequest request;
+        W64 seed = 12345;
+
+        foreach (i, 50000) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            W64 addr = (seed >> 20) % (SETS * WAYS * 64 * 3);
+            request.set_physical_address(addr);
+
+            int op = (seed >> 8) % 10;
+            if (op < 5) {
+                ASSERT_EQ(lines->probe(&request) == NULL,
+                        vlines->probe(&request) == NULL);
+            } else if (op < 9) {
+                W64 oldTag = 0, vOldTag = 0;
+                CacheLine *line = lines->insert(&request, oldTag);
+                CacheLine *vline = vlines->insert(&request, vOldTag);
+                ASSERT_EQ(oldTag, vOldTag);
+                line->init(lines->tagOf(addr));
+                vline->init(vlines->tagOf(addr));
+            } else {
+                ASSERT_EQ(lines->invalidate(&request),
+                        vlines->invalidate(&request));
+            }
+        }
+
+        delete lines;
+        delete vlines;
+    }
+
+    TEST(VectorCacheLines, SameAsCacheLines)
+    {
+        compare_backends<64, 8>();
+        compare_backends<16, 2>();
+        compare_backends<8, 1>();
+    }
+
+    TEST(VectorCacheLines, OddAssociativity)
+    {
+        compare_backends<32, 12>();
+        compare_backends<16, 3>();
+    }
+
+    TEST(VectorCacheLines, Invalidate)
+    {
+        VectorCacheLines<4, 4, 64, 2> vlines(2, 1);
+        vlines.init();
+
+        MemoryRequest request;
+        W64 oldTag = 0;
+        request.set_physical_address(0x1000);
+        vlines.insert(&request, oldTag);
+
+        ASSERT_TRUE(vlines.probe(&request) != NULL);
+        ASSERT_GE(vlines.invalidate(&request), 0);
+        ASSERT_TRUE(vlines.probe(&request) == NULL);
+        ASSERT_EQ(-1, vlines.invalidate(&request));
+    }
+
+    TEST(Replacement, TreePLRUVictimOrder)
+    {
+        TreePLRU<1, 4> tree;
+        tree.reset();
+
+        /* Fills walk the tree round all ways before coming back */
+        int seen = 0;
+        foreach (i, 4) {
+            int way = tree.victim(0);
+            seen |= (1 << way);
+            tree.inserted(0, way, true);
+        }
+        ASSERT_EQ(0xf, seen);
+
+        /* Ways 0 and 1 were used after 2 and 3 */
+        tree.touch(0, 0);
+        tree.touch(0, 1);
+        int victim = tree.victim(0);
+        ASSERT_TRUE(victim == 2 || victim == 3);
+
+        /* An invalidated way is the next victim */
+        tree.invalidate(0, 1);
+        ASSERT_EQ(1, tree.victim(0));
+    }
+
+    /*
+     * Touch a set of 'hot' lines, then stream through more lines than
+     * the cache holds and count how many hot lines survive.
+     */
+    template <typename POLICY>
+    int hot_lines_after_scan()
+    {
+        VectorCacheLines<1, 8, 64, 2, POLICY> vlines(2, 1);
+        vlines.init();
+
+        MemoryRequest request;
+        W64 oldTag = 0;
+        foreach (i, 4) {
+            request.set_physical_address(i * 64);
+            vlines.insert(&request, oldTag);
+            vlines.probe(&request);
+        }
+
+        foreach (i, 12) {
+            request.set_physical_address((100 + i) * 64);
+            vlines.insert(&request, oldTag);
+        }
+
+        int hot = 0;
+        foreach (i, 4) {
+            request.set_physical_address(i * 64);
+            if (vlines.probe(&request)) hot++;
+        }
+        return hot;
+    }
+
+    TEST(Replacement, RRIPResistsScans)
+    {
+        ASSERT_EQ(0, (hot_lines_after_scan<BitPLRU<1, 8> >()));
+        ASSERT_EQ(4, (hot_lines_after_scan<SRRIP<1, 8> >()));
+        ASSERT_EQ(4, (hot_lines_after_scan<BRRIP<1, 8> >()));
+    }
+
+    TEST(Replacement, RRIPFillsInvalidFirst)
+    {
+        SRRIP<2, 4> rrip;
+        rrip.reset();
+
+        foreach (i, 4) {
+            int way = rrip.victim(1);
+            ASSERT_EQ(i, way);
+            rrip.inserted(1, way, true);
+            ASSERT_EQ(2, rrip.rrpv(1, way));
+        }
+
+        /* All ways at 2, ageing brings them to 3 */
+        ASSERT_EQ(0, rrip.victim(1));
+        ASSERT_EQ(3, rrip.rrpv(1, 3));
+
+        /* Hits bring ways back to 0, invalidating sends them to 3 */
+        foreach (i, 4) rrip.touch(1, i);
+        rrip.invalidate(1, 2);
+        ASSERT_EQ(2, rrip.victim(1));
+        ASSERT_EQ(0, rrip.rrpv(1, 3));
+    }
+
+    TEST(Replacement, DRRIPLeadersVote)
+    {
+        DRRIP<128, 4> drrip;
+        drrip.reset();
+        int psel = drrip.psel_;
+
+        /* Misses in SRRIP leader sets push followers towards BRRIP */
+        foreach (i, 8) drrip.inserted(0, 0, true);
+        ASSERT_EQ(psel + 8, drrip.psel_);
+        ASSERT_TRUE(drrip.bimodal(2));
+        ASSERT_FALSE(drrip.bimodal(0));
+        ASSERT_TRUE(drrip.bimodal(1));
+
+        /* And misses in BRRIP leader sets back to SRRIP */
+        foreach (i, 16) drrip.inserted(1, 0, true);
+        ASSERT_FALSE(drrip.bimodal(2));
+    }
+
+    TEST(Replacement, SwitchRRIPMode)
+    {
+        /* RRIP variants share their state, PLRUs only keep their own */
+        VectorCacheLines<16, 4, 64, 2, SRRIP<16, 4> > rrip(2, 1);
+        VectorCacheLines<16, 4, 64, 2, TreePLRU<16, 4> > tree(2, 1);
+        CacheLinesBase &base = rrip;
+
+        ASSERT_TRUE(base.set_replacement("brrip"));
+        ASSERT_TRUE(base.set_replacement("drrip"));
+        ASSERT_FALSE(base.set_replacement("tree-plru"));
+        ASSERT_TRUE(tree.set_replacement("tree-plru"));
+        ASSERT_FALSE(tree.set_replacement("srrip"));
+
+        SRRIP<1, 8> srrip;
+        srrip.reset();
+        ASSERT_FALSE(srrip.bimodal(0));
+        ASSERT_TRUE(srrip.set_policy("brrip"));
+        ASSERT_TRUE(srrip.bimodal(0));
+        ASSERT_FALSE(srrip.set_policy("lru"));
+        ASSERT_TRUE(srrip.bimodal(0));
+    }
+
+    TEST(Replacement, PoliciesAgreeOnHits)
+    {
+        /* Whatever they evict, every policy finds what it holds */
+        VectorCacheLines<16, 8, 64, 2, TreePLRU<16, 8> > tree(2, 1);
+        VectorCacheLines<16, 8, 64, 2, DRRIP<16, 8> > drrip(2, 1);
+        tree.init();
+        drrip.init();
+
+        MemoryRequest request;
+        W64 seed = 777;
+        foreach (i, 20000) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            W64 addr = (seed >> 20) % (16 * 8 * 64 * 2);
+            request.set_physical_address(addr);
+
+            W64 oldTag = 0;
+            tree.insert(&request, oldTag);
+            drrip.insert(&request, oldTag);
+            ASSERT_TRUE(tree.probe(&request) != NULL);
+            ASSERT_TRUE(drrip.probe(&request) != NULL);
+        }
+    }
+    TEST(SampledCacheLines, SampledSetsAreExact)
+    {
+        /* On sampled sets only, it is the full sized cache */
+        VectorCacheLines<64, 4, 64, 2> *full =
+            new VectorCacheLines<64, 4, 64, 2>(2, 1);
+        SampledCacheLines<64, 4, 64, 2, 8> *sampled =
+            new SampledCacheLines<64, 4, 64, 2, 8>(2, 1);
+        full->init();
+        sampled->init();
+
+        MemoryRequest request;
+        W64 seed = 4242;
+        foreach (i, 20000) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            /* Line in one of the sets 0, 8, .. 56 */
+            W64 n = (seed >> 20) % (8 * 4 * 4);
+            W64 addr = ((n / 8) * 64 + (n % 8) * 8) * 64 + (seed & 63);
+            request.set_physical_address(addr);
+
+            int op = (seed >> 8) % 10;
+            if (op < 5) {
+                ASSERT_EQ(full->probe(&request) == NULL,
+                        sampled->probe(&request) == NULL);
+            } else if (op < 9) {
+                W64 oldTag = 0, sOldTag = 0;
+                CacheLine *line = full->insert(&request, oldTag);
+                CacheLine *sline = sampled->insert(&request, sOldTag);
+                ASSERT_EQ(oldTag, sOldTag);
+                line->init(full->tagOf(addr));
+                sline->init(sampled->tagOf(addr));
+            } else {
+                ASSERT_EQ(full->invalidate(&request) < 0,
+                        sampled->invalidate(&request) < 0);
+            }
+        }
+
+        delete full;
+        delete sampled;
+    }
+
+    TEST(SampledCacheLines, OtherSetsAreFiltered)
+    {
+        SampledCacheLines<16, 2, 64, 2, 4> sampled(2, 1);
+        sampled.init();
+
+        MemoryRequest request;
+        W64 invalid = InvalidTag<W64>::INVALID;
+        W64 oldTag = invalid;
+
+        /* Set 1 is not sampled: fills are dropped and never evict */
+        request.set_physical_address(1 * 64);
+        CacheLine *line = sampled.insert(&request, oldTag);
+        ASSERT_TRUE(line != NULL);
+        line->init(sampled.tagOf(64));
+        ASSERT_EQ(invalid, oldTag);
+        ASSERT_TRUE(sampled.probe(&request) == NULL);
+        ASSERT_EQ(-1, sampled.invalidate(&request));
+
+        /* Set 4 is */
+        request.set_physical_address(4 * 64);
+        sampled.insert(&request, oldTag);
+        ASSERT_TRUE(sampled.probe(&request) != NULL);
+
+        /* Aliases of set 4 evict with their own address */
+        W64 stride = 16 * 64;
+        request.set_physical_address(4 * 64 + stride);
+        sampled.insert(&request, oldTag);
+        request.set_physical_address(4 * 64 + 2 * stride);
+        sampled.insert(&request, oldTag);
+        ASSERT_EQ(W64(4 * 64), oldTag);
+    }
+    TEST(LazyChunks, EpochReset)
+    {
+        LazyChunks chunks(4, 128);
+        bool fresh = false;
+
+        ASSERT_TRUE(chunks.find(2) == NULL);
+        char *c = chunks.get(2, fresh);
+        ASSERT_TRUE(fresh);
+        ASSERT_EQ(0U, W64(c) & 63);
+        ASSERT_EQ(c, chunks.get(2, fresh));
+        ASSERT_FALSE(fresh);
+        ASSERT_EQ(1, chunks.used());
+
+        /* Reset keeps the memory but hands it out fresh again */
+        chunks.reset();
+        ASSERT_TRUE(chunks.find(2) == NULL);
+        ASSERT_EQ(0, chunks.used());
+        ASSERT_EQ(c, chunks.get(2, fresh));
+        ASSERT_TRUE(fresh);
+    }
+
+    TEST(VectorCacheLines, LazyReset)
+    {
+        typedef VectorCacheLines<4096, 8, 64, 2> BigLines;
+        BigLines *vlines = new BigLines(2, 1);
+        vlines->init();
+
+        MemoryRequest request;
+        W64 oldTag = 0;
+        foreach (i, 16) {
+            request.set_physical_address(i * 64 * 4096 + 0x1040);
+            vlines->insert(&request, oldTag);
+            ASSERT_TRUE(vlines->probe(&request) != NULL);
+        }
+
+        /* Sets never inserted into miss without being allocated */
+        request.set_physical_address(0x80000);
+        ASSERT_TRUE(vlines->probe(&request) == NULL);
+        ASSERT_EQ(-1, vlines->invalidate(&request));
+
+        vlines->reset();
+        foreach (i, 16) {
+            request.set_physical_address(i * 64 * 4096 + 0x1040);
+            ASSERT_TRUE(vlines->probe(&request) == NULL);
+        }
+
+        /* Lines after a reset start from empty sets */
+        W64 invalid = InvalidTag<W64>::INVALID;
+        request.set_physical_address(0x1040);
+        oldTag = 0;
+        CacheLine *line = vlines->insert(&request, oldTag);
+        ASSERT_EQ(invalid, oldTag);
+        ASSERT_EQ(W64(-1), line->tag);
+
+        delete vlines;
+    }
+
+    TEST(CachePorts, BankConflicts)
+    {
+        CachePorts ports(4, 1);
+        ASSERT_FALSE(ports.set_banks(3, 8, 1));
+        ASSERT_FALSE(ports.set_banks(2 * CACHE_MAX_BANKS, 8, 1));
+        ASSERT_FALSE(ports.set_banks(4, 8, 0));
+        ASSERT_EQ(1, ports.get_banks());
+        ASSERT_TRUE(ports.set_banks(4, 8, 1));
+
+        MemoryRequest request;
+        request.set_op_type(MEMORY_OP_READ);
+        sim_cycle = 10;
+
+        /* Words 0 and 4 share bank 0, word 1 is in bank 1 */
+        request.set_physical_address(0x1000);
+        ASSERT_TRUE(ports.get_port(&request));
+        ASSERT_FALSE(ports.bank_free(&request));
+        request.set_physical_address(0x1020);
+        ASSERT_FALSE(ports.get_port(&request));
+        ASSERT_FALSE(ports.get_bank_port(&request));
+        request.set_physical_address(0x1008);
+        ASSERT_TRUE(ports.get_bank_port(&request));
+        ASSERT_FALSE(ports.get_port(&request));
+
+        /* A conflict doesn't take a port of the cache */
+        request.set_physical_address(0x1010);
+        ASSERT_TRUE(ports.get_port(&request));
+        request.set_physical_address(0x1018);
+        ASSERT_TRUE(ports.get_port(&request));
+
+        /* The cache's own ports still limit the free banks */
+        CachePorts narrow(1, 1);
+        ASSERT_TRUE(narrow.set_banks(4, 8, 2));
+        request.set_physical_address(0x1000);
+        ASSERT_TRUE(narrow.get_port(&request));
+        request.set_physical_address(0x1008);
+        ASSERT_FALSE(narrow.get_port(&request));
+        ASSERT_TRUE(narrow.bank_free(&request));
+
+        sim_cycle++;
+        request.set_physical_address(0x1020);
+        ASSERT_TRUE(ports.get_port(&request));
+        ASSERT_TRUE(narrow.get_port(&request));
+    }
+    TEST(LineCompression, Sizes)
+    {
+        W64 words[8];
+
+        foreach (i, 8) words[i] = 0;
+        ASSERT_EQ(1, bdi_compressed_size(words, 64));
+        ASSERT_EQ(2, fpc_compressed_size(words, 64));
+
+        /* Pointers into one object, 8 byte base and 1 byte deltas */
+        foreach (i, 8) words[i] = 0x7fff12340000ULL + i * 8;
+        ASSERT_EQ(8 + 8 + 1, bdi_compressed_size(words, 64));
+
+        /* Small integers are deltas from zero */
+        foreach (i, 8) words[i] = i;
+        ASSERT_EQ(8 + 8 + 1, bdi_compressed_size(words, 64));
+        ASSERT_EQ(13, fpc_compressed_size(words, 64));
+
+        W64 seed = 99;
+        foreach (i, 8) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            words[i] = seed;
+        }
+        ASSERT_EQ(64, bdi_compressed_size(words, 64));
+        ASSERT_EQ(64, fpc_compressed_size(words, 64));
+    }
+
+    /* Lines below 64K are all zero, the others don't compress */
+    bool test_line_reader(W64 addr, W64 *words, int count)
+    {
+        foreach (i, count)
+            words[i] = (addr < 0x10000) ? 0 : (addr + i) * 0x9e3779b97f4a7c15ULL;
+        return true;
+    }
+
+    TEST(CompressedCacheLines, PacksCompressedLines)
+    {
+        typedef CompressedCacheLines<4, 2, 64, 2,
+                LINE_COMPRESSION_BDI, 1, 2> Lines;
+        Lines *lines = new Lines(2, 1);
+        cache_line_reader = test_line_reader;
+
+        MemoryRequest request;
+        W64 invalid = InvalidTag<W64>::INVALID;
+        W64 stride = 4 * 64;
+        W64 oldTag;
+        W64 tag;
+        W8 state;
+
+        /* Four zero lines fit in the tags of the 2 ways of set 0 */
+        foreach (i, 4) {
+            request.set_physical_address(i * stride);
+            oldTag = invalid;
+            CacheLine *line = lines->insert(&request, oldTag);
+            line->init(i * stride);
+            line->state = 1;
+            ASSERT_EQ(invalid, oldTag);
+            ASSERT_FALSE(lines->pop_victim(tag, state));
+        }
+
+        foreach (i, 4) {
+            request.set_physical_address(i * stride);
+            ASSERT_TRUE(lines->probe(&request) != NULL);
+            ASSERT_EQ(1, lines->get_segments(0, i));
+        }
+
+        /* Line 0 is the least recently used, it gives its tag */
+        W64 big = 0x100000;
+        request.set_physical_address(big);
+        oldTag = invalid;
+        CacheLine *line = lines->insert(&request, oldTag);
+        line->init(big);
+        line->state = 1;
+        ASSERT_EQ(0U, oldTag);
+        ASSERT_FALSE(lines->pop_victim(tag, state));
+        ASSERT_EQ(0, lines->hit_latency(line));
+
+        /* The next one takes the data of lines 1 and 2 as well */
+        request.set_physical_address(big + stride);
+        oldTag = invalid;
+        line = lines->insert(&request, oldTag);
+        line->init(big + stride);
+        line->state = 1;
+        ASSERT_EQ(stride, oldTag);
+
+        ASSERT_TRUE(lines->pop_victim(tag, state));
+        ASSERT_EQ(3 * stride, tag);
+        ASSERT_EQ(1, state);
+        ASSERT_TRUE(lines->pop_victim(tag, state));
+        ASSERT_EQ(2 * stride, tag);
+        ASSERT_FALSE(lines->pop_victim(tag, state));
+
+        foreach (i, 4) {
+            request.set_physical_address(i * stride);
+            ASSERT_TRUE(lines->probe(&request) == NULL);
+        }
+
+        /* Decompression only on hits of compressed lines */
+        request.set_physical_address(0);
+        line = lines->insert(&request, oldTag);
+        line->init(0);
+        line->state = 1;
+        ASSERT_EQ(1, lines->hit_latency(lines->probe(&request)));
+        request.set_physical_address(big + stride);
+        line = lines->probe(&request);
+        ASSERT_TRUE(line != NULL);
+        ASSERT_EQ(0, lines->hit_latency(line));
+
+        cache_line_reader = NULL;
+        delete lines;
+    }
+
+    TEST(CompressedCacheLines, UnknownLinesAreFull)
+    {
+        CompressedCacheLines<4, 2, 64, 2, LINE_COMPRESSION_FPC, 5, 2>
+            lines(2, 1);
+        MemoryRequest request;
+        W64 oldTag = InvalidTag<W64>::INVALID;
+
+        cache_line_reader = NULL;
+        foreach (i, 3) {
+            request.set_physical_address(i * 4 * 64);
+            CacheLine *line = lines.insert(&request, oldTag);
+            line->init(i * 4 * 64);
+        }
+
+        /* Only two ways of uncompressed data */
+        int segments = 0;
+        foreach (i, 4) segments += lines.get_segments(0, i);
+        ASSERT_EQ(16, segments);
+        request.set_physical_address(0);
+        ASSERT_TRUE(lines.probe(&request) == NULL);
+        request.set_physical_address(2 * 4 * 64);
+        ASSERT_TRUE(lines.probe(&request) != NULL);
+    }
+};
@@ -0,0 +1,67 @@
+
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+
+namespace {
+
+    TEST(ClockDomain, FullSpeedTicksEveryCycle)
+    {
+        ClockDomain domain;
+
+        foreach (i, 10) {
+            domain.tick();
+            ASSERT_TRUE(domain.ticks);
+        }
+
+        ASSERT_EQ(7U, domain.to_sim_cycles(7));
+    }
+
+    TEST(ClockDomain, EdgesSpreadOverSimCycles)
+    {
+        ClockDomain domain;
+        domain.num = 1000;
+        domain.den = 2000;
+
+        int edges = 0;
+        foreach (i, 100) {
+            domain.tick();
+            if (domain.ticks) edges++;
+            /* Never two edges in a row at half speed */
+            if (i % 2 == 0)
+                ASSERT_FALSE(domain.ticks);
+        }
+
+        ASSERT_EQ(50, edges);
+        ASSERT_EQ(20U, domain.to_sim_cycles(10));
+    }
+
+    TEST(ClockDomain, LatencyRoundsUp)
+    {
+        ClockDomain domain;
+        domain.num = 1600;
+        domain.den = 2400;
+
+        /* 3 cycles at 1.6GHz are 4.5 cycles at 2.4GHz */
+        ASSERT_EQ(5U, domain.to_sim_cycles(3));
+        ASSERT_EQ(3U, domain.to_sim_cycles(2));
+    }
+
+    TEST(ClockDomain, SkipKeepsPhase)
+    {
+        ClockDomain ticked;
+        ClockDomain skipped;
+        ticked.num = skipped.num = 1000;
+        ticked.den = skipped.den = 3000;
+
+        foreach (i, 1003)
+            ticked.tick();
+
+        skipped.skip(1002);
+        skipped.tick();
+
+        ASSERT_EQ(ticked.phase, skipped.phase);
+        ASSERT_EQ(ticked.ticks, skipped.ticks);
+    }
+};
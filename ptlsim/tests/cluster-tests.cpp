@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <ptl-qemu.h>
+#include <cluster.h>
+
+#include <sys/wait.h>
+
+namespace {
+
+    TEST(Cluster, PortTransfer)
+    {
+        ClusterPort port;
+        port.init(2.0);
+
+        /* 60 byte frame and the wire overhead, 2 cycles a byte */
+        EXPECT_EQ(168U, port.transfer_cycles(60));
+        EXPECT_EQ(178U, port.transfer(10, 60));
+
+        /* Offered while the first one is still on the port */
+        EXPECT_EQ(346U, port.transfer(100, 60));
+
+        /* Port was idle */
+        EXPECT_EQ(1168U, port.transfer(1000, 60));
+    }
+
+    TEST(Cluster, RxQueueOrder)
+    {
+        byte data[64];
+        memset(data, 0, sizeof(data));
+
+        ClusterRxQueue queue;
+        queue.add(new ClusterFrame(2, 1, 300, data, 64));
+        queue.add(new ClusterFrame(1, 5, 100, data, 64));
+        queue.add(new ClusterFrame(3, 1, 100, data, 64));
+        queue.add(new ClusterFrame(1, 4, 100, data, 64));
+        EXPECT_EQ(4, queue.count());
+
+        /* Nothing arrives before 100 */
+        EXPECT_TRUE(queue.pop_before(100) == NULL);
+
+        ClusterFrame *frame = queue.pop_before(101);
+        ASSERT_TRUE(frame != NULL);
+        EXPECT_EQ(1U, frame->src);
+        EXPECT_EQ(4U, frame->seq);
+        delete frame;
+
+        frame = queue.pop_before(101);
+        ASSERT_TRUE(frame != NULL);
+        EXPECT_EQ(1U, frame->src);
+        EXPECT_EQ(5U, frame->seq);
+        delete frame;
+
+        frame = queue.pop_before(101);
+        ASSERT_TRUE(frame != NULL);
+        EXPECT_EQ(3U, frame->src);
+        delete frame;
+
+        EXPECT_TRUE(queue.pop_before(300) == NULL);
+        frame = queue.pop_before(infinity);
+        ASSERT_TRUE(frame != NULL);
+        EXPECT_EQ(300U, frame->arrival);
+        delete frame;
+
+        EXPECT_EQ(0, queue.count());
+    }
+
+    W64 delivered_at;
+    int delivered_size;
+
+    void record_delivery(void *opaque, const byte *buf, int size)
+    {
+        delivered_at = sim_cycle;
+        delivered_size = size;
+    }
+
+    void run_node(ClusterNode &node, W64 cycles, W64 send_at)
+    {
+        byte frame[60];
+        memset(frame, 0xff, 6);
+        memset(frame + 6, 0x02, sizeof(frame) - 6);
+
+        for (sim_cycle = 0; sim_cycle < cycles; sim_cycle++) {
+            node.clock();
+
+            if (sim_cycle == send_at)
+                node.send(frame, sizeof(frame));
+        }
+
+        node.shutdown();
+    }
+
+    TEST(Cluster, TwoNodesOverLoopback)
+    {
+        char hosts[] = "/tmp/cluster-test.XXXXXX";
+        int fd = mkstemp(hosts);
+        int port = 20000 + (getpid() % 20000);
+
+        FILE *file = fdopen(fd, "w");
+        fprintf(file, "# test cluster\n127.0.0.1:%d\n\n127.0.0.1:%d\n",
+                port, port + 1);
+        fclose(file);
+
+        in_simulation = 1;
+
+        /* Node 1 receives the frame and exits with 0 if it came in time */
+        pid_t child = fork();
+        if (child == 0) {
+            ClusterNode *node = new ClusterNode();
+            if (!node->setup(hosts, 1, 100, 1.0))
+                _exit(2);
+            node->attach(record_delivery, NULL, NULL);
+
+            delivered_at = 0;
+            run_node(*node, 500, infinity);
+
+            /* Sent at 10, 84 cycles on each port and 100 of latency */
+            _exit(delivered_at == 278 && delivered_size == 60 ? 0 : 1);
+        }
+
+        ClusterNode *node = new ClusterNode();
+        ASSERT_TRUE(node->setup(hosts, 0, 100, 1.0));
+        EXPECT_TRUE(node->active());
+        run_node(*node, 500, 10);
+        EXPECT_FALSE(node->active());
+        delete node;
+
+        int status = -1;
+        waitpid(child, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+
+        in_simulation = 0;
+        unlink(hosts);
+    }
+};
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <coherenceHotspots.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(CoherenceHotspots, TracksFrequentlyInvalidatedLines)
+    {
+        CoherenceHotspots *hotspots = new CoherenceHotspots();
+        W64 line = CoherenceHotspots::line_of(0x8040);
+
+        foreach (i, CoherenceHotspots::TRACK_THRESHOLD - 1) {
+            hotspots->invalidation(0x8040);
+            ASSERT_TRUE(hotspots->find(line) == NULL);
+        }
+
+        /* Estimates never under count */
+        ASSERT_LE(CoherenceHotspots::TRACK_THRESHOLD - 1,
+                hotspots->estimate(line));
+
+        hotspots->invalidation(0x8048);
+        ASSERT_TRUE(hotspots->find(line) != NULL);
+
+        hotspots->invalidation(0x8040);
+        ASSERT_EQ(2U, hotspots->find(line)->invalidations);
+
+        /* Lines invalidated once aren't tracked */
+        hotspots->invalidation(0x9000);
+        ASSERT_TRUE(hotspots->find(CoherenceHotspots::line_of(0x9000)) == NULL);
+
+        CoherenceHotspotEntry *top[4];
+        ASSERT_EQ(1, hotspots->top(top, 4));
+        ASSERT_EQ(line, top[0]->line);
+
+        delete hotspots;
+    }
+
+    TEST(CoherenceHotspots, SharingByWords)
+    {
+        CoherenceHotspotEntry e;
+        e.reset(0x100);
+
+        /* Each core writes its own word: false sharing */
+        e.write_words[0] = 1 << 0;
+        e.write_words[1 % NUM_SIM_CORES] |= 1 << 4;
+        if (NUM_SIM_CORES > 1) {
+            ASSERT_EQ(0, e.shared_words());
+            ASSERT_TRUE(e.false_sharing());
+            ASSERT_EQ(3U, e.cores());
+
+            /* Core 1 also reads the word core 0 writes */
+            e.read_words[1] = 1 << 0;
+            ASSERT_EQ(1, e.shared_words());
+            ASSERT_FALSE(e.false_sharing());
+        } else {
+            ASSERT_FALSE(e.false_sharing());
+        }
+    }
+};
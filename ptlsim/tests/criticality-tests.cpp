@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <criticality.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(Criticality, Training)
+    {
+        CriticalityPredictor<1024> cp;
+
+        EXPECT_FALSE(cp.critical(0x1000));
+
+        /* Blocked commit twice before it's taken as critical */
+        cp.train(0x1000, true);
+        EXPECT_FALSE(cp.critical(0x1000));
+        cp.train(0x1000, true);
+        EXPECT_TRUE(cp.critical(0x1000));
+        EXPECT_FALSE(cp.critical(0x1004));
+
+        /* Saturated, one commit without blocking doesn't clear it */
+        cp.train(0x1000, true);
+        cp.train(0x1000, true);
+        cp.train(0x1000, false);
+        EXPECT_TRUE(cp.critical(0x1000));
+        cp.train(0x1000, false);
+        EXPECT_FALSE(cp.critical(0x1000));
+
+        cp.train(0x1000, false);
+        cp.train(0x1000, false);
+        cp.train(0x1000, true);
+        EXPECT_FALSE(cp.critical(0x1000));
+
+        cp.train(0x2000, true);
+        cp.train(0x2000, true);
+        cp.reset();
+        EXPECT_FALSE(cp.critical(0x2000));
+    }
+};
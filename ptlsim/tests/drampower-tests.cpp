@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <dramPower.h>
+
+using namespace Memory;
+
+namespace {
+
+    DRAMPowerConfig small_config()
+    {
+        DRAMPowerConfig cfg;
+        cfg.ranks = 2;
+        cfg.refreshInterval = 1000;
+        cfg.refreshCycles = 100;
+        cfg.powerdownIdle = 50;
+        cfg.powerdownExit = 5;
+        cfg.selfRefreshIdle = 2000;
+        cfg.selfRefreshExit = 300;
+        cfg.actEnergy = 1000;
+        cfg.readEnergy = 2000;
+        cfg.writeEnergy = 3000;
+        cfg.refreshEnergy = 50000;
+        cfg.powerAt[DRAM_STATE_STANDBY] = 200;
+        cfg.powerAt[DRAM_STATE_POWERDOWN] = 100;
+        cfg.powerAt[DRAM_STATE_SELF_REFRESH] = 20;
+        return cfg;
+    }
+
+    TEST(DRAMPower, RanksAndEnergy)
+    {
+        DRAMPower power;
+        EXPECT_FALSE(power.enabled());
+
+        power.init(small_config());
+        EXPECT_TRUE(power.enabled());
+        EXPECT_EQ(0, power.rank_of(0));
+        EXPECT_EQ(0, power.rank_of(MEM_BANKS / 2 - 1));
+        EXPECT_EQ(1, power.rank_of(MEM_BANKS / 2));
+        EXPECT_EQ(W64(500), power.refresh_step());
+
+        EXPECT_DOUBLE_EQ(1.0, power.act_energy());
+        EXPECT_DOUBLE_EQ(2.0, power.burst_energy(false));
+        EXPECT_DOUBLE_EQ(3.0, power.burst_energy(true));
+        EXPECT_DOUBLE_EQ(50.0, power.refresh_energy());
+
+        /* 200 mW for 1000 cycles at 1 GHz is 200 nJ */
+        EXPECT_DOUBLE_EQ(200.0, power.background_energy(
+                    DRAM_STATE_STANDBY, 1000, 1000000000ULL));
+    }
+
+    TEST(DRAMPower, RefreshBlocksAccesses)
+    {
+        DRAMPower power;
+        power.init(small_config());
+        W64 cycles[DRAM_STATE_COUNT] = {0, 0, 0};
+
+        /* Awake, no refresh yet */
+        DRAMWakeup wake = power.start(0, 10, cycles);
+        EXPECT_EQ(DRAM_STATE_STANDBY, wake.exited);
+        EXPECT_EQ(W64(0), wake.delay());
+        power.busy_until(0, 60);
+
+        /* Refresh waits for the access to end */
+        EXPECT_EQ(W64(60), power.refresh(0, 40, cycles));
+
+        /* Next access of the rank waits for the refresh */
+        wake = power.start(0, 45, cycles);
+        EXPECT_EQ(W64(115), wake.refreshCycles);
+        power.busy_until(0, 45 + wake.delay() + 50);
+
+        power.done(0, 60, cycles);
+        power.done(0, 210, cycles);
+
+        /* Other rank is not held back */
+        wake = power.start(1, 45, cycles);
+        EXPECT_EQ(W64(0), wake.delay());
+    }
+
+    TEST(DRAMPower, LowPowerStates)
+    {
+        DRAMPower power;
+        power.init(small_config());
+        W64 cycles[DRAM_STATE_COUNT] = {0, 0, 0};
+
+        power.start(0, 0, cycles);
+        power.busy_until(0, 100);
+        power.done(0, 100, cycles);
+        EXPECT_EQ(W64(100), cycles[DRAM_STATE_STANDBY]);
+
+        /* Idle for 50 cycles powers down */
+        EXPECT_EQ(DRAM_STATE_STANDBY, power.idle_state(power.ranks[0], 149));
+        EXPECT_EQ(DRAM_STATE_POWERDOWN, power.idle_state(power.ranks[0], 150));
+
+        DRAMWakeup wake = power.start(0, 400, cycles);
+        EXPECT_EQ(DRAM_STATE_POWERDOWN, wake.exited);
+        EXPECT_EQ(W64(5), wake.exitCycles);
+        EXPECT_EQ(W64(150), cycles[DRAM_STATE_STANDBY]);
+        EXPECT_EQ(W64(250), cycles[DRAM_STATE_POWERDOWN]);
+        power.busy_until(0, 455);
+        power.done(0, 455, cycles);
+
+        /* In self refresh after 2000 idle cycles, no refreshes needed */
+        EXPECT_EQ(W64(0), power.refresh(0, 3000, cycles));
+        EXPECT_EQ(W64(100 + 50 + 55 + 50), cycles[DRAM_STATE_STANDBY]);
+        EXPECT_EQ(W64(250 + 1950), cycles[DRAM_STATE_POWERDOWN]);
+        EXPECT_EQ(W64(545), cycles[DRAM_STATE_SELF_REFRESH]);
+
+        wake = power.start(0, 3100, cycles);
+        EXPECT_EQ(DRAM_STATE_SELF_REFRESH, wake.exited);
+        EXPECT_EQ(W64(300), wake.delay());
+        EXPECT_EQ(W64(645), cycles[DRAM_STATE_SELF_REFRESH]);
+    }
+
+    TEST(DRAMPower, RefreshWakesPowerdown)
+    {
+        DRAMPower power;
+        power.init(small_config());
+        W64 cycles[DRAM_STATE_COUNT] = {0, 0, 0};
+
+        /* Powered down since cycle 50, the refresh exits first */
+        EXPECT_EQ(W64(505), power.refresh(1, 500, cycles));
+        EXPECT_EQ(W64(50), cycles[DRAM_STATE_STANDBY]);
+        EXPECT_EQ(W64(450), cycles[DRAM_STATE_POWERDOWN]);
+
+        /* Power-down timer starts again after the refresh */
+        EXPECT_EQ(DRAM_STATE_STANDBY, power.idle_state(power.ranks[1], 620));
+        EXPECT_EQ(DRAM_STATE_POWERDOWN, power.idle_state(power.ranks[1], 655));
+
+        DRAMWakeup wake = power.start(1, 550, cycles);
+        EXPECT_EQ(DRAM_STATE_STANDBY, wake.exited);
+        EXPECT_EQ(W64(55), wake.refreshCycles);
+    }
+};
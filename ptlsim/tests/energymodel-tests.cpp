@@ -0,0 +1,86 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <statsBuilder.h>
+#include <statFormula.h>
+#include <energyModel.h>
+
+namespace {
+
+    class EnergyCache : public Statable {
+        public:
+            StatObj<W64> reads;
+            StatObj<W64> misses;
+
+            EnergyCache(const char *name) : Statable(name)
+                                            , reads("reads", this)
+                                            , misses("misses", this)
+            {}
+    };
+
+    class EnergyCore : public Statable {
+        public:
+            StatObj<W64> cycles;
+
+            EnergyCore() : Statable("energy_core")
+                           , cycles("cycles", this)
+            {}
+    };
+
+    double value(const char *name, Stats *stats)
+    {
+        double v = 0;
+        StatObjBase *obj = StatsBuilder::get().get_stat_obj(name);
+        if (obj) obj->get_number(stats, v);
+        return v;
+    }
+
+    TEST(EnergyModel, Formulas)
+    {
+        EnergyCache *l1_0 = new EnergyCache("EL1_0");
+        EnergyCache *l1_1 = new EnergyCache("EL1_1");
+        EnergyCache *l2 = new EnergyCache("EL2_0");
+        EnergyCore *core = new EnergyCore();
+
+        EnergyModel energy;
+        energy.add("EL1_$", "reads", 0.5);
+        energy.add("EL2_0", "misses", 10);
+        energy.add("EL1_$", "misses", 2);
+        energy.set_cycles("energy_core:cycles");
+
+        /* Two per core caches and the shared one */
+        ASSERT_EQ(3, energy.setup(2, 2000000000ULL));
+        ASSERT_TRUE(StatsBuilder::get().compile_formulas());
+
+        Stats *stats = StatsBuilder::get().get_new_stats();
+        l1_0->reads(stats) = 100;
+        l1_0->misses(stats) = 10;
+        l1_1->reads(stats) = 40;
+        l2->misses(stats) = 3;
+        core->cycles(stats) = 1000;
+
+        ASSERT_DOUBLE_EQ(70, value("formulas:energy_EL1_0", stats));
+        ASSERT_DOUBLE_EQ(20, value("formulas:energy_EL1_1", stats));
+        ASSERT_DOUBLE_EQ(30, value("formulas:energy_EL2_0", stats));
+        ASSERT_DOUBLE_EQ(120, value("formulas:energy", stats));
+
+        /* 120 nJ in 500 ns */
+        ASSERT_DOUBLE_EQ(0.24, value("formulas:power", stats));
+
+        /* In time-stats as well */
+        ASSERT_TRUE(StatsBuilder::get().get_stat_obj(
+                    "formulas:power")->is_dump_periodic());
+
+        delete stats;
+    }
+
+    TEST(EnergyModel, Empty)
+    {
+        EnergyModel energy;
+        energy.set_cycles("energy_core:cycles");
+        ASSERT_EQ(0, energy.setup(2, 1000000000ULL));
+    }
+};
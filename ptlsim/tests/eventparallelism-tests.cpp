@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <eventWheel.h>
+#include <eventParallelism.h>
+
+using namespace Memory;
+
+namespace {
+
+    Signal *dir_signal;
+    Event miss_event;
+    int l2_events;
+    int dir_events;
+
+    bool dir_cb(void *arg)
+    {
+        dir_events++;
+        return true;
+    }
+
+    /* Forwards the request to the directory, as an L2 miss would */
+    bool l2_cb(void *arg)
+    {
+        l2_events++;
+        if (!arg)
+            return false;
+
+        miss_event.init();
+        miss_event.setup(dir_signal, sim_cycle + 4, NULL);
+        mem_parallelism_schedule(&miss_event, 4);
+        return true;
+    }
+
+    TEST(MemParallelism, RegisterComponents)
+    {
+        W16 l2 = mem_parallelism_register("L2_pe_0");
+        W16 dir = mem_parallelism_register("Directory_pe_0");
+
+        /* LP 0 is 'cores', each component gets its own LP once */
+        ASSERT_NE(0, l2);
+        ASSERT_NE(0, dir);
+        ASSERT_NE(l2, dir);
+        ASSERT_EQ(l2, mem_parallelism_register("L2_pe_0"));
+        ASSERT_EQ(0, mem_parallelism_register("cores"));
+    }
+
+    TEST(MemParallelism, StampsSourceOfEvents)
+    {
+        Signal l2("l2");
+        Signal dir("dir");
+        l2.connect(signal_fun_ptr(l2_cb));
+        dir.connect(signal_fun_ptr(dir_cb));
+        l2.set_partition(mem_parallelism_register("L2_pe_0"));
+        dir.set_partition(mem_parallelism_register("Directory_pe_0"));
+        dir_signal = &dir;
+
+        mem_parallelism_enabled = true;
+        l2_events = dir_events = 0;
+
+        /* Scheduled by the run loop, so from 'cores' */
+        Event l2_event;
+        l2_event.init();
+        l2_event.setup(&l2, 10, (void*)1);
+        mem_parallelism_schedule(&l2_event, 2);
+        ASSERT_EQ(0, l2_event.get_source());
+
+        mem_parallelism_begin_events();
+        ASSERT_TRUE(mem_parallelism_execute(&l2_event));
+
+        /* Scheduled inside the L2's event, so from its LP */
+        ASSERT_EQ(l2.get_partition(), miss_event.get_source());
+        ASSERT_LE(l2_event.get_ready(), miss_event.get_ready());
+
+        /* Return value of the callback is passed through */
+        Event failing;
+        failing.init();
+        failing.setup(&l2, 10, (void*)0);
+        mem_parallelism_schedule(&failing, 2);
+        ASSERT_FALSE(mem_parallelism_execute(&failing));
+        ASSERT_TRUE(mem_parallelism_execute(&miss_event));
+        mem_parallelism_end_events();
+
+        ASSERT_EQ(2, l2_events);
+        ASSERT_EQ(1, dir_events);
+
+        /* Outside events the ready time follows the time of 'cores' */
+        Event dir_event;
+        dir_event.init();
+        dir_event.setup(&dir, 12, NULL);
+        mem_parallelism_schedule(&dir_event, 2);
+        ASSERT_EQ(0, dir_event.get_source());
+
+        Event later;
+        later.init();
+        later.setup(&dir, 13, NULL);
+        mem_parallelism_schedule(&later, 3);
+        ASSERT_LE(dir_event.get_ready(), later.get_ready());
+
+        mem_parallelism_begin_events();
+        ASSERT_TRUE(mem_parallelism_execute(&dir_event));
+        ASSERT_TRUE(mem_parallelism_execute(&later));
+        mem_parallelism_end_events();
+        ASSERT_EQ(3, dir_events);
+
+        mem_parallelism_enabled = false;
+    }
+};
@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include <eventtrace.h>
+
+#include <pthread.h>
+
+namespace {
+
+    void* record_commits(void *arg)
+    {
+        foreach (i, 10) {
+            trace_record(i, 0, TRACE_OOO_COMMIT, 0x400000 + i);
+        }
+        return NULL;
+    }
+
+    TEST(EventTrace, RingWrap)
+    {
+        TraceRing ring(0, 4);
+        W64 n;
+
+        foreach (i, 3) EXPECT_TRUE(ring.push(i, 1, 2, i, 0, 0, 0));
+        ring.front(n);
+        EXPECT_EQ(3, n);
+        ring.pop(2);
+
+        /* Records 2..4 wrap around end of the ring */
+        foreach (i, 3) EXPECT_TRUE(ring.push(3 + i, 1, 2, 3 + i, 0, 0, 0));
+        EXPECT_EQ(4, ring.count());
+
+        const TraceRecord *r = ring.front(n);
+        EXPECT_EQ(2, n);
+        EXPECT_EQ(2, r[0].cycle);
+        EXPECT_EQ(3, r[1].args[0]);
+        ring.pop(n);
+
+        r = ring.front(n);
+        EXPECT_EQ(2, n);
+        EXPECT_EQ(4, r[0].cycle);
+        EXPECT_EQ(5, r[1].cycle);
+        ring.pop(n);
+
+        ring.front(n);
+        EXPECT_EQ(0, n);
+    }
+
+    TEST(EventTrace, RingFullDrops)
+    {
+        TraceRing ring(0, 2);
+
+        EXPECT_TRUE(ring.push(0, 0, 0, 0, 0, 0, 0));
+        EXPECT_TRUE(ring.push(1, 0, 0, 0, 0, 0, 0));
+        EXPECT_FALSE(ring.push(2, 0, 0, 0, 0, 0, 0));
+        EXPECT_EQ(1, ring.dropped);
+        EXPECT_EQ(2, ring.count());
+    }
+
+    TEST(EventTrace, RingOverwrite)
+    {
+        TraceRing ring(0, 2, true);
+
+        foreach (i, 5) EXPECT_TRUE(ring.push(i, 0, 0, 0, 0, 0, 0));
+        EXPECT_EQ(3, ring.dropped);
+        EXPECT_EQ(2, ring.count());
+
+        W64 n;
+        const TraceRecord *r = ring.front(n);
+        EXPECT_EQ(1, n);
+        EXPECT_EQ(3, r[0].cycle);
+        ring.pop(n);
+        r = ring.front(n);
+        EXPECT_EQ(4, r[0].cycle);
+    }
+
+    TEST(EventTrace, WriteFile)
+    {
+        const char *filename = "/tmp/ptlsim-eventtrace-test.trc";
+        W32 id = trace_register_component("test_component");
+
+        ASSERT_TRUE(trace_open(filename, 16));
+        EXPECT_TRUE(trace_enabled);
+        foreach (i, 3) {
+            trace_record(100 + i, id, TRACE_CACHE_ACCESS, 0x1000 * i);
+        }
+        trace_close();
+        EXPECT_FALSE(trace_enabled);
+
+        ifstream is(filename, std::ios_base::in | std::ios_base::binary);
+        ASSERT_TRUE(is.good());
+
+        char magic[8];
+        is.read(magic, 8);
+        EXPECT_EQ(0, memcmp(magic, "PTLTRCE1", 8));
+
+        W32 events, len;
+        is.read((char*)&events, 4);
+        EXPECT_EQ((W32)TRACE_EVENT_COUNT, events);
+        foreach (i, 2 * events) {
+            is.read((char*)&len, 4);
+            is.seekg(len, std::ios_base::cur);
+        }
+
+        /* Component names first, then records of this thread */
+        W8 kind;
+        W32 ring_id, count = 0;
+        bool seen_component = false;
+        while (is.read((char*)&kind, 1)) {
+            if (kind == 'C') {
+                W32 cid;
+                is.read((char*)&cid, 4);
+                is.read((char*)&len, 4);
+                is.seekg(len, std::ios_base::cur);
+                seen_component |= (cid == id);
+            } else if (kind == 'R') {
+                EXPECT_TRUE(seen_component);
+                W32 n;
+                is.read((char*)&ring_id, 4);
+                is.read((char*)&n, 4);
+                foreach (i, n) {
+                    TraceRecord r;
+                    is.read((char*)&r, sizeof(r));
+                    EXPECT_EQ(100 + count, r.cycle);
+                    EXPECT_EQ(id, r.component);
+                    EXPECT_EQ((W32)TRACE_CACHE_ACCESS, r.event);
+                    EXPECT_EQ(0x1000 * count, r.args[0]);
+                    count++;
+                }
+            } else {
+                EXPECT_EQ('D', kind);
+                W64 dropped;
+                is.read((char*)&ring_id, 4);
+                is.read((char*)&dropped, 8);
+                EXPECT_EQ(0, dropped);
+            }
+        }
+        EXPECT_EQ(3, count);
+
+        unlink(filename);
+    }
+
+    TEST(EventTrace, FlightRecorder)
+    {
+        const char *filename = "/tmp/ptlsim-flight-test.trc";
+
+        EXPECT_EQ(NULL, flight_recorder_dump("test"));
+
+        ASSERT_TRUE(flight_recorder_open(filename, 4));
+        EXPECT_TRUE(trace_enabled);
+
+        /* New thread gets a ring of the flight recorder's size */
+        pthread_t thread;
+        ASSERT_EQ(0, pthread_create(&thread, NULL, record_commits, NULL));
+        pthread_join(thread, NULL);
+
+        const char *dumped = flight_recorder_dump("test");
+        ASSERT_TRUE(dumped != NULL);
+        EXPECT_STREQ(filename, dumped);
+
+        /* Dump leaves the recorder running */
+        EXPECT_TRUE(trace_enabled);
+        trace_close();
+        EXPECT_FALSE(trace_enabled);
+
+        ifstream is(filename, std::ios_base::in | std::ios_base::binary);
+        ASSERT_TRUE(is.good());
+        is.seekg(8, std::ios_base::cur);
+
+        W32 events, len;
+        is.read((char*)&events, 4);
+        foreach (i, 2 * events) {
+            is.read((char*)&len, 4);
+            is.seekg(len, std::ios_base::cur);
+        }
+
+        /* Only the last four records of that thread are kept */
+        W8 kind;
+        W64 expect = 6;
+        W64 dropped = 0;
+        while (is.read((char*)&kind, 1)) {
+            W32 ring_id;
+            if (kind == 'C') {
+                is.seekg(4, std::ios_base::cur);
+                is.read((char*)&len, 4);
+                is.seekg(len, std::ios_base::cur);
+            } else if (kind == 'R') {
+                W32 n;
+                is.read((char*)&ring_id, 4);
+                is.read((char*)&n, 4);
+                foreach (i, n) {
+                    TraceRecord r;
+                    is.read((char*)&r, sizeof(r));
+                    if (r.event != TRACE_OOO_COMMIT) continue;
+                    EXPECT_EQ(expect, r.cycle);
+                    EXPECT_EQ(0x400000 + expect, r.args[0]);
+                    expect++;
+                }
+            } else {
+                W64 d;
+                is.read((char*)&ring_id, 4);
+                is.read((char*)&d, 8);
+                dropped += d;
+            }
+        }
+        EXPECT_EQ(10, expect);
+        EXPECT_EQ(6, dropped);
+
+        unlink(filename);
+    }
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <eventWheel.h>
+#include <controller.h>
+
+using namespace Memory;
+
+namespace {
+
+    class EventWheelTest : public ::testing::Test
+    {
+        protected:
+            EventWheel *wheel;
+            W64 saved_cycle;
+
+            virtual void SetUp()
+            {
+                saved_cycle = sim_cycle;
+                sim_cycle = 100;
+                wheel = new EventWheel();
+            }
+
+            virtual void TearDown()
+            {
+                delete wheel;
+                sim_cycle = saved_cycle;
+            }
+
+            Event* add(W64 clock, int id)
+            {
+                Event *event = wheel->alloc();
+                event->setup(NULL, clock, (void*)(W64)id);
+                wheel->schedule(event);
+                return event;
+            }
+
+            /* Returns id of next due event or -1 */
+            int next(W64 clock)
+            {
+                Event *event = wheel->pop(clock);
+                if(!event) return -1;
+                wheel->free(event);
+                return (int)(W64)event->get_arg();
+            }
+    };
+
+    TEST_F(EventWheelTest, OrderByClock)
+    {
+        add(105, 1);
+        add(102, 2);
+        add(103, 3);
+        add(102, 4);
+
+        ASSERT_EQ(4, wheel->count());
+        ASSERT_EQ(-1, next(101));
+        ASSERT_EQ(2, next(102));
+        ASSERT_EQ(4, next(102));
+        ASSERT_EQ(-1, next(102));
+        ASSERT_EQ(3, next(104));
+        ASSERT_EQ(1, next(105));
+        ASSERT_TRUE(wheel->empty());
+    }
+
+    TEST_F(EventWheelTest, Overflow)
+    {
+        W64 far = 100 + EVENT_WHEEL_SIZE * 3 + 7;
+
+        add(far, 1);
+        add(far + 1, 2);
+        add(far - EVENT_WHEEL_SIZE * 2, 3);
+
+        ASSERT_EQ(-1, next(far - EVENT_WHEEL_SIZE * 2 - 1));
+        ASSERT_EQ(3, next(far - EVENT_WHEEL_SIZE * 2));
+
+        /* An event scheduled later at the same clock runs after the one
+         * that waited in overflow list */
+        sim_cycle = far - 10;
+        ASSERT_EQ(-1, next(sim_cycle));
+        add(far, 4);
+
+        ASSERT_EQ(1, next(far));
+        ASSERT_EQ(4, next(far));
+        ASSERT_EQ(2, next(far + 1));
+        ASSERT_TRUE(wheel->empty());
+    }
+
+    TEST_F(EventWheelTest, PastClockRunsFirst)
+    {
+        add(102, 1);
+        ASSERT_EQ(-1, next(101));
+
+        /* Events whose clock is passed run before the ones of current cycle,
+         * oldest first, like in a list sorted by clock */
+        add(101, 2);
+        add(99, 3);
+        add(101, 4);
+        add(102, 5);
+
+        ASSERT_EQ(3, next(102));
+        ASSERT_EQ(2, next(102));
+        ASSERT_EQ(4, next(102));
+        ASSERT_EQ(1, next(102));
+        ASSERT_EQ(5, next(102));
+        ASSERT_TRUE(wheel->empty());
+    }
+
+    TEST_F(EventWheelTest, PoolGrows)
+    {
+        int total = EVENT_POOL_SLAB_SIZE * 2 + 1;
+
+        foreach(i, total) {
+            add(101 + (i % 50), i);
+        }
+
+        ASSERT_EQ(total, wheel->count());
+        ASSERT_GE(wheel->capacity(), total);
+
+        int popped = 0;
+        while(next(200) != -1)
+            popped++;
+        ASSERT_EQ(total, popped);
+
+        wheel->reset();
+        ASSERT_TRUE(wheel->empty());
+    }
+
+    TEST(SlabPool, AlignedGrowingPool)
+    {
+        SlabPool<Memory::Message, 4> pool;
+        Memory::Message *msgs[9];
+
+        ASSERT_EQ(0, (int)(sizeof(Memory::Message) % 64));
+        ASSERT_EQ(4, pool.capacity());
+
+        foreach(i, 9) {
+            msgs[i] = pool.alloc();
+            ASSERT_EQ(W64(0), W64(msgs[i]) & 63);
+        }
+
+        ASSERT_EQ(12, pool.capacity());
+        ASSERT_EQ(9, pool.used());
+
+        foreach(i, 9) pool.free(msgs[i]);
+        ASSERT_EQ(0, pool.used());
+        ASSERT_EQ(W64(9), pool.peak_used());
+
+        /* Freed objects are reused before growing again */
+        foreach(i, 12) pool.alloc();
+        ASSERT_EQ(12, pool.capacity());
+
+        pool.reset();
+        ASSERT_EQ(0, pool.used());
+        ASSERT_EQ(12, pool.capacity());
+    }
+};
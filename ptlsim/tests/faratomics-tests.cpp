@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <farAtomics.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(FarAtomicUnit, RoundTrip)
+    {
+        FarAtomicUnit unit;
+        unit.latency = 21;
+        unit.occupancy = 4;
+
+        /* 10 cycles there, 4 at the line and 11 back */
+        W64 wait = 1;
+        EXPECT_EQ(W64(100 + 10 + 4 + 11), unit.execute(0x40, 100, wait));
+        EXPECT_EQ(W64(0), wait);
+
+        /* Other lines don't wait for it */
+        EXPECT_EQ(W64(100 + 25), unit.execute(0x41, 100, wait));
+        EXPECT_EQ(W64(0), wait);
+    }
+
+    TEST(FarAtomicUnit, SerializesOneLine)
+    {
+        FarAtomicUnit unit;
+        unit.latency = 20;
+        unit.occupancy = 4;
+
+        W64 wait;
+        EXPECT_EQ(W64(124), unit.execute(7, 100, wait));
+        EXPECT_EQ(W64(128), unit.execute(7, 100, wait));
+        EXPECT_EQ(W64(4), wait);
+        EXPECT_EQ(W64(132), unit.execute(7, 101, wait));
+        EXPECT_EQ(W64(7), wait);
+
+        /* Once the line is free again there is no wait */
+        EXPECT_EQ(W64(224), unit.execute(7, 200, wait));
+        EXPECT_EQ(W64(0), wait);
+
+        /* A line in the same slot replaces it */
+        unit.execute(7, 300, wait);
+        unit.execute(7 + FarAtomicUnit::LINES, 300, wait);
+        EXPECT_EQ(W64(0), wait);
+        EXPECT_EQ(W64(324), unit.execute(7, 300, wait));
+        EXPECT_EQ(W64(0), wait);
+
+        unit.reset();
+        EXPECT_EQ(W64(124), unit.execute(7 + FarAtomicUnit::LINES, 100, wait));
+        EXPECT_EQ(W64(0), wait);
+    }
+};
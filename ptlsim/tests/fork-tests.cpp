@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+#ifdef DRAMSIM
+    TEST(ForkSimulations, DRAMSimLookahead)
+    {
+        ofstream of("/tmp/test_fork_configs");
+        of << "-dramsim-lookahead 0" << endl;
+        of.close();
+
+        stringbuf saved;
+        saved = config.fork_configs.buf;
+        W64 saved_lookahead = config.dramsim_lookahead;
+
+        config.fork_configs = "/tmp/test_fork_configs";
+        config.dramsim_lookahead = 4;
+
+        /* DRAMSim2 thread can't be forked, so nothing runs in a child */
+        ASSERT_EQ(0, fork_simulations(config));
+        ASSERT_EQ(-1, waitpid(-1, NULL, WNOHANG));
+        ASSERT_EQ(ECHILD, errno);
+
+        config.fork_configs = saved;
+        config.dramsim_lookahead = saved_lookahead;
+    }
+
+    TEST(ForkServer, DRAMSimLookahead)
+    {
+        const char *path = "/tmp/test_fork_server";
+        unlink(path);
+
+        /* fork_simulations() runs once per process, so try it in a child,
+         * a server that starts would block until the alarm */
+        pid_t child = fork();
+        if (child == 0) {
+            alarm(10);
+            config.fork_configs = "";
+            config.fork_server = path;
+            config.dramsim_lookahead = 4;
+            int id = fork_simulations(config);
+            _exit(id == 0 && access(path, F_OK) != 0 ? 0 : 1);
+        }
+
+        int status = -1;
+        ASSERT_EQ(child, waitpid(child, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+    }
+#endif
+
+}; // namespace
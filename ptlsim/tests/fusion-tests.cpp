@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+
+namespace {
+
+    const int ALL = FUSION_MACRO | FUSION_MICRO;
+
+    /* cmp rax, rbx: flags of a sub into a temp */
+    TransOp cmp(bool eom = true)
+    {
+        TransOp op(OP_sub, REG_temp0, REG_rax, REG_rbx, REG_zero, 3, 0, 0,
+                SETFLAG_ZF|SETFLAG_CF|SETFLAG_OF);
+        op.som = 1;
+        op.eom = eom;
+        return op;
+    }
+
+    /* jz: single uop branch on ZF */
+    TransOp jz()
+    {
+        TransOp op(OP_br, REG_rip, REG_zf, REG_zero, REG_zero, 3);
+        op.cond = 4;
+        op.som = 1;
+        op.eom = 1;
+        return op;
+    }
+
+    TEST(Fusion, MacroCmpJcc)
+    {
+        TransOp br = jz();
+
+        ASSERT_EQ(FUSION_MACRO, fuse_uop_kind(cmp(), br, ALL));
+        ASSERT_EQ(FUSION_MACRO, fuse_uop_kind(cmp(), br, FUSION_MACRO));
+        ASSERT_EQ(0, fuse_uop_kind(cmp(), br, FUSION_MICRO));
+        ASSERT_EQ(0, fuse_uop_kind(cmp(), br, 0));
+
+        /* Flags of the branch not set by the cmp uop */
+        TransOp test = cmp();
+        test.setflags = SETFLAG_CF;
+        ASSERT_EQ(0, fuse_uop_kind(test, br, ALL));
+
+        /* Not the last uop of its insn, or not a fusible opcode */
+        ASSERT_EQ(0, fuse_uop_kind(cmp(false), br, ALL));
+        TransOp mov(OP_mov, REG_rax, REG_zero, REG_rbx, REG_zero, 3);
+        mov.som = mov.eom = 1;
+        ASSERT_EQ(0, fuse_uop_kind(mov, br, ALL));
+
+        /* jcc after collcc is not a single uop */
+        br.som = 0;
+        ASSERT_EQ(0, fuse_uop_kind(cmp(), br, ALL));
+    }
+
+    TEST(Fusion, MicroLoadOp)
+    {
+        /* add rax, [rbx]: ld temp0 = [rbx]; add rax = rax, temp0 */
+        TransOp ld(OP_ld, REG_temp0, REG_rbx, REG_imm, REG_zero, 3);
+        ld.som = 1;
+        TransOp add(OP_add, REG_rax, REG_rax, REG_temp0, REG_zero, 3, 0, 0,
+                SETFLAG_ZF|SETFLAG_CF|SETFLAG_OF);
+        add.eom = 1;
+
+        ASSERT_EQ(FUSION_MICRO, fuse_uop_kind(ld, add, ALL));
+        ASSERT_EQ(0, fuse_uop_kind(ld, add, FUSION_MACRO));
+
+        /* Value of the load not used */
+        TransOp other = add;
+        other.rb = REG_rcx;
+        ASSERT_EQ(0, fuse_uop_kind(ld, other, ALL));
+
+        /* Uop of the next insn */
+        other = add;
+        other.som = 1;
+        ASSERT_EQ(0, fuse_uop_kind(ld, other, ALL));
+
+        /* Locked loads and stores after the load stay apart */
+        TransOp locked = ld;
+        locked.locked = 1;
+        ASSERT_EQ(0, fuse_uop_kind(locked, add, ALL));
+        TransOp st(OP_st, REG_mem, REG_rbx, REG_imm, REG_temp0, 3);
+        st.eom = 1;
+        ASSERT_EQ(0, fuse_uop_kind(ld, st, ALL));
+    }
+
+};
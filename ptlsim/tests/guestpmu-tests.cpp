@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <guestpmu.h>
+
+namespace {
+
+    TEST(GuestPMU, CountsFilteredEvents)
+    {
+        GuestPMU pmu;
+        W64 user[PMU_EVENT_COUNT];
+        W64 kernel[PMU_EVENT_COUNT];
+        setzero(user);
+        setzero(kernel);
+
+        /* PMC0 counts user instructions, fixed counter 1 all cycles */
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_PERFEVTSEL0, 0x00c0 |
+                    GuestPMU::EVTSEL_USR | GuestPMU::EVTSEL_EN));
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_FIXED_CTR_CTRL, 0x3 << 4));
+
+        user[PMU_EVENT_INSNS] = 100;
+        kernel[PMU_EVENT_INSNS] = 50;
+        user[PMU_EVENT_CYCLES] = 300;
+        kernel[PMU_EVENT_CYCLES] = 200;
+        pmu.update(user, kernel);
+
+        W64 v;
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_PMC0, v));
+        EXPECT_EQ(W64(100), v);
+        EXPECT_TRUE(pmu.rdpmc((1 << 30) | 1, v));
+        EXPECT_EQ(W64(500), v);
+
+        /* Fixed counter 0 is not enabled */
+        EXPECT_TRUE(pmu.rdpmc(1 << 30, v));
+        EXPECT_EQ(W64(0), v);
+        EXPECT_FALSE(pmu.rdpmc(4, v));
+
+        /* Only what was counted since the last update is added */
+        user[PMU_EVENT_INSNS] = 150;
+        pmu.update(user, kernel);
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_PMC0, v));
+        EXPECT_EQ(W64(150), v);
+
+        /* Disabled globally, not counting */
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_GLOBAL_CTRL, 0));
+        user[PMU_EVENT_INSNS] = 200;
+        pmu.update(user, kernel);
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_PMC0, v));
+        EXPECT_EQ(W64(150), v);
+
+        EXPECT_FALSE(pmu.rdmsr(0x10, v));
+        EXPECT_FALSE(GuestPMU::is_msr(0x10));
+        EXPECT_TRUE(GuestPMU::is_msr(MSR_PMU_GLOBAL_STATUS));
+    }
+
+    TEST(GuestPMU, OverflowInterrupts)
+    {
+        GuestPMU pmu;
+        W64 user[PMU_EVENT_COUNT];
+        W64 kernel[PMU_EVENT_COUNT];
+        setzero(user);
+        setzero(kernel);
+
+        /* Sampling every 1000 branch misses, written as -1000 */
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_PERFEVTSEL0 + 1, 0x00c5 |
+                    GuestPMU::EVTSEL_USR | GuestPMU::EVTSEL_OS |
+                    GuestPMU::EVTSEL_INT | GuestPMU::EVTSEL_EN));
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_PMC0 + 1, W32(-1000)));
+        EXPECT_TRUE(pmu.sampling());
+
+        W64 v;
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_PMC0 + 1, v));
+        EXPECT_EQ(GuestPMU::counter_mask() - 999, v);
+
+        user[PMU_EVENT_BRANCH_MISSES] = 600;
+        kernel[PMU_EVENT_BRANCH_MISSES] = 399;
+        pmu.update(user, kernel);
+        EXPECT_FALSE(pmu.pmi_pending);
+
+        kernel[PMU_EVENT_BRANCH_MISSES] = 405;
+        pmu.update(user, kernel);
+        EXPECT_TRUE(pmu.pmi_pending);
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_GLOBAL_STATUS, v));
+        EXPECT_EQ(W64(1 << 1), v);
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_PMC0 + 1, v));
+        EXPECT_EQ(W64(5), v);
+
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_GLOBAL_OVF_CTRL, 1 << 1));
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_GLOBAL_STATUS, v));
+        EXPECT_EQ(W64(0), v);
+    }
+
+    TEST(GuestPMU, StatsReset)
+    {
+        GuestPMU pmu;
+        W64 user[PMU_EVENT_COUNT];
+        W64 kernel[PMU_EVENT_COUNT];
+        setzero(user);
+        setzero(kernel);
+
+        EXPECT_TRUE(pmu.wrmsr(MSR_PMU_FIXED_CTR_CTRL, 0x3));
+        user[PMU_EVENT_INSNS] = 1000;
+        pmu.update(user, kernel);
+
+        /* Stats reset at the end of warmup, counting goes on from there */
+        user[PMU_EVENT_INSNS] = 10;
+        pmu.update(user, kernel);
+
+        W64 v;
+        EXPECT_TRUE(pmu.rdmsr(MSR_PMU_FIXED_CTR0, v));
+        EXPECT_EQ(W64(1010), v);
+
+        W32 eax, ebx, ecx, edx;
+        GuestPMU::cpuid(eax, ebx, ecx, edx);
+        EXPECT_EQ(W32(2), eax & 0xff);
+        EXPECT_EQ(W32(4), (eax >> 8) & 0xff);
+        EXPECT_EQ(W32(3), edx & 0x1f);
+    }
+};
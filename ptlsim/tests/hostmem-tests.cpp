@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <hostmem.h>
+#include <lazyChunks.h>
+
+using namespace Memory;
+
+namespace {
+
+    bool is_zero(const char *mem, size_t bytes)
+    {
+        foreach (i, bytes) {
+            if (mem[i]) return false;
+        }
+        return true;
+    }
+
+    TEST(HostMem, SmallAndLarge)
+    {
+        host_huge_pages = false;
+
+        char *small = (char*)host_alloc(1000);
+        char *large = (char*)host_alloc(3 * HOST_HUGE_PAGE_SIZE + 10);
+
+        EXPECT_EQ(0U, (size_t)small % 64);
+        EXPECT_EQ(0U, (size_t)large % 64);
+        EXPECT_TRUE(is_zero(small, 1000));
+        EXPECT_TRUE(is_zero(large, 3 * HOST_HUGE_PAGE_SIZE + 10));
+
+        memset(small, 1, 1000);
+        memset(large, 1, 3 * HOST_HUGE_PAGE_SIZE + 10);
+
+        host_free(small, 1000);
+        host_free(large, 3 * HOST_HUGE_PAGE_SIZE + 10);
+    }
+
+    TEST(HostMem, HugePages)
+    {
+        host_huge_pages = true;
+
+        /* Small allocations share a 2 MB region */
+        char *a = (char*)host_alloc(100);
+        char *b = (char*)host_alloc(5000);
+        EXPECT_EQ(a + 128, b);
+        EXPECT_EQ((size_t)a / HOST_HUGE_PAGE_SIZE,
+                (size_t)b / HOST_HUGE_PAGE_SIZE);
+        EXPECT_TRUE(is_zero(b, 5000));
+
+        char *large = (char*)host_alloc(HOST_HUGE_PAGE_SIZE + 1);
+        EXPECT_EQ(0U, (size_t)large % HOST_HUGE_PAGE_SIZE);
+        EXPECT_TRUE(is_zero(large, HOST_HUGE_PAGE_SIZE + 1));
+        memset(large, 1, HOST_HUGE_PAGE_SIZE + 1);
+        EXPECT_GE(host_hugetlb_bytes + host_thp_bytes,
+                (W64)3 * HOST_HUGE_PAGE_SIZE);
+
+        host_free(large, HOST_HUGE_PAGE_SIZE + 1);
+
+        /* Stay in their region, also after the option is turned off */
+        host_huge_pages = false;
+        host_free(a, 100);
+        host_free(b, 5000);
+    }
+
+    TEST(HostMem, LazyChunksLayout)
+    {
+        host_huge_pages = false;
+
+        LazyChunks chunks(1000, 100);
+        bool fresh;
+
+        char *c0 = chunks.get(0, fresh);
+        EXPECT_TRUE(fresh);
+        char *c7 = chunks.get(7, fresh);
+        EXPECT_TRUE(fresh);
+        EXPECT_EQ(c0 + 7 * 128, c7);
+        EXPECT_EQ(0U, (size_t)c7 % 64);
+
+        EXPECT_EQ(c7, chunks.get(7, fresh));
+        EXPECT_FALSE(fresh);
+        EXPECT_TRUE(chunks.find(8) == NULL);
+        EXPECT_EQ(2, chunks.used());
+
+        /* Same memory in the next epoch, handed back as fresh */
+        chunks.reset();
+        EXPECT_TRUE(chunks.find(7) == NULL);
+        EXPECT_EQ(c7, chunks.get(7, fresh));
+        EXPECT_TRUE(fresh);
+    }
+};
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <hostperf.h>
+
+namespace {
+
+    Signal *inner_signal;
+
+    void spin(W64 ticks)
+    {
+        W64 start = rdtsc();
+        while (rdtsc() - start < ticks) barrier();
+    }
+
+    bool inner_cb(void *arg)
+    {
+        spin(200000);
+        return true;
+    }
+
+    bool outer_cb(void *arg)
+    {
+        spin(100000);
+        inner_signal->emit(NULL);
+        return true;
+    }
+
+    class HostPerfTest : public ::testing::Test
+    {
+        protected:
+            Signal outer;
+            Signal inner;
+            HostPerfCounter outer_perf;
+            HostPerfCounter inner_perf;
+
+            HostPerfTest() : outer("test_outer"), inner("test_inner") { }
+
+            virtual void SetUp()
+            {
+                outer.connect(signal_fun_ptr(outer_cb));
+                inner.connect(signal_fun_ptr(inner_cb));
+                outer.set_perf(&outer_perf);
+                inner.set_perf(&inner_perf);
+                inner_signal = &inner;
+            }
+
+            virtual void TearDown()
+            {
+                host_perf_enabled = false;
+            }
+    };
+
+    TEST_F(HostPerfTest, DisabledCountsNothing)
+    {
+        host_perf_enabled = false;
+        outer.emit(NULL);
+
+        ASSERT_EQ(W64(0), outer_perf.ticks);
+        ASSERT_EQ(W64(0), outer_perf.calls);
+        ASSERT_EQ(W64(0), inner_perf.calls);
+    }
+
+    TEST_F(HostPerfTest, NestedSignalTimeIsExclusive)
+    {
+        host_perf_enabled = true;
+
+        W64 start = rdtsc();
+        outer.emit(NULL);
+        W64 elapsed = rdtsc() - start;
+
+        ASSERT_EQ(W64(1), outer_perf.calls);
+        ASSERT_EQ(W64(1), inner_perf.calls);
+        ASSERT_GE(inner_perf.ticks, W64(200000));
+        ASSERT_GE(outer_perf.ticks, W64(100000));
+
+        /* Inner time is not counted again in outer */
+        ASSERT_LE(outer_perf.ticks + inner_perf.ticks, elapsed);
+    }
+
+    TEST_F(HostPerfTest, ScopeSwitchesBetweenParts)
+    {
+        HostPerfCounter first, second;
+        host_perf_enabled = true;
+
+        W64 start = rdtsc();
+        {
+            HostPerfScope scope(&first);
+            spin(10000);
+            scope.switch_to(&second);
+            spin(10000);
+            outer.emit(NULL);
+        }
+        W64 elapsed = rdtsc() - start;
+
+        ASSERT_EQ(W64(1), first.calls);
+        ASSERT_EQ(W64(1), second.calls);
+        ASSERT_GE(first.ticks, W64(10000));
+        ASSERT_GE(second.ticks, W64(10000));
+        ASSERT_LE(first.ticks + second.ticks + outer_perf.ticks +
+                inner_perf.ticks, elapsed);
+        ASSERT_EQ(W64(1), outer_perf.calls);
+    }
+
+    TEST(HostPerf, RegisterReturnsSameCounter)
+    {
+        HostPerfCounter *a = host_perf_register("test_core");
+        HostPerfCounter *b = host_perf_register("test_core");
+        HostPerfCounter *fetch = host_perf_register("test_core", "fetch");
+        HostPerfCounter *other = host_perf_register("test_cache");
+
+        ASSERT_EQ(a, b);
+        ASSERT_NE(a, fetch);
+        ASSERT_NE(a, other);
+        ASSERT_EQ(fetch, host_perf_register("test_core", "fetch"));
+    }
+};
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <interlockProfile.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(InterlockProfile, CountsGrabsConflictsAndHolds)
+    {
+        InterlockProfile profile;
+
+        profile.grab(0x1000);
+        profile.conflict(0x1000);
+        profile.conflict(0x1000);
+        profile.release(0x1000, 30);
+        profile.grab(0x1000);
+        profile.release(0x1000, 10);
+        profile.set_full(0x1000);
+
+        InterlockLockEntry& e = profile.lookup(0x1000);
+        EXPECT_EQ(2U, e.grabs);
+        EXPECT_EQ(2U, e.conflicts);
+        EXPECT_EQ(1U, e.set_full);
+        EXPECT_EQ(20U, e.avg_hold());
+        EXPECT_EQ(30U, e.max_hold);
+        EXPECT_EQ(0U, profile.evictions);
+    }
+
+    TEST(InterlockProfile, ReplacesLeastActive)
+    {
+        InterlockProfile profile;
+
+        /* Same set: these lines differ only above the index bits */
+        W64 addrs[InterlockProfile::WAYS + 1];
+        foreach (i, InterlockProfile::WAYS + 1)
+            addrs[i] = 0x1000 + i * (W64(InterlockProfile::SETS) << 15);
+
+        foreach (i, InterlockProfile::WAYS) {
+            foreach (j, 10 - i) profile.grab(addrs[i]);
+        }
+
+        profile.conflict(addrs[InterlockProfile::WAYS]);
+        EXPECT_EQ(1U, profile.evictions);
+
+        EXPECT_EQ(10U, profile.lookup(addrs[0]).grabs);
+        EXPECT_EQ(1U, profile.lookup(addrs[InterlockProfile::WAYS]).conflicts);
+        EXPECT_EQ(1U, profile.evictions);
+    }
+
+    TEST(InterlockProfile, TopByContention)
+    {
+        InterlockProfile profile;
+
+        profile.grab(0x1000);
+        profile.release(0x1000, 500);
+        profile.conflict(0x2000);
+        profile.conflict(0x2000);
+        profile.set_full(0x3000);
+        profile.grab(0x3000);
+        profile.release(0x3000, 5);
+        profile.conflict(0x4000);
+
+        InterlockLockEntry *top[3];
+        ASSERT_EQ(3, profile.top(top, 3));
+        EXPECT_EQ(0x2000U, top[0]->addr);
+        EXPECT_EQ(0x3000U, top[1]->addr);
+        EXPECT_EQ(0x4000U, top[2]->addr);
+
+        InterlockLockEntry *all[8];
+        EXPECT_EQ(4, profile.top(all, 8));
+    }
+};
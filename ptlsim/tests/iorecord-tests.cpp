@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <iorecord.h>
+
+#include <zlib.h>
+
+namespace {
+
+    const char *temp_name()
+    {
+        static char name[] = "/tmp/iorecord-test.XXXXXX";
+        strcpy(name, "/tmp/iorecord-test.XXXXXX");
+        close(mkstemp(name));
+        return name;
+    }
+
+    TEST(IORecord, RecordThenReplay)
+    {
+        ASSERT_EQ(32U, sizeof(IORecord));
+
+        const char *name = temp_name();
+        ASSERT_TRUE(io_record_open(name));
+        ASSERT_TRUE(io_recording);
+
+        /* More than one replay buffer worth of reads */
+        foreach (i, 3000) {
+            sim_cycle = i * 10;
+            io_record(i % 2, IO_RECORD_PORT_IN, 0x60 + (i % 4), 0, i);
+        }
+        io_record(1, IO_RECORD_MMIO_READ, 0xfee00030, 2, 0x14);
+        io_record_close();
+        ASSERT_FALSE(io_recording);
+
+        ASSERT_TRUE(io_replay_open(name));
+        ASSERT_TRUE(io_replaying);
+
+        W64 value = 0;
+        foreach (i, 3000) {
+            ASSERT_TRUE(io_replay(i % 2, IO_RECORD_PORT_IN, 0x60 + (i % 4),
+                        0, value));
+            ASSERT_EQ(W64(i), value);
+        }
+        ASSERT_TRUE(io_replay(1, IO_RECORD_MMIO_READ, 0xfee00030, 2,
+                    value));
+        ASSERT_EQ(W64(0x14), value);
+
+        /* Records ran out */
+        ASSERT_FALSE(io_replay(0, IO_RECORD_PORT_IN, 0x60, 0, value));
+        ASSERT_FALSE(io_replaying);
+
+        io_replay_close();
+        unlink(name);
+    }
+
+    TEST(IORecord, MismatchStopsReplay)
+    {
+        const char *name = temp_name();
+        ASSERT_TRUE(io_record_open(name));
+        io_record(0, IO_RECORD_PORT_IN, 0x40, 0, 7);
+        io_record(0, IO_RECORD_PORT_IN, 0x42, 0, 8);
+        io_record_close();
+
+        ASSERT_TRUE(io_replay_open(name));
+
+        W64 value = 0;
+        ASSERT_TRUE(io_replay(0, IO_RECORD_PORT_IN, 0x40, 0, value));
+        ASSERT_EQ(W64(7), value);
+
+        /* Same port with another size is a different read */
+        ASSERT_FALSE(io_replay(0, IO_RECORD_PORT_IN, 0x42, 1, value));
+        ASSERT_FALSE(io_replaying);
+
+        io_replay_close();
+        unlink(name);
+    }
+
+    TEST(IORecord, BadHeader)
+    {
+        const char *name = temp_name();
+        gzFile f = gzopen(name, "wb");
+        gzwrite(f, "NOTIOREC", 8);
+        gzclose(f);
+
+        ASSERT_FALSE(io_replay_open(name));
+        ASSERT_FALSE(io_replaying);
+        unlink(name);
+    }
+};
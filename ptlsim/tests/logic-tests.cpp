@@ -42,6 +42,77 @@ namespace {
         }
     }
 
+    template <typename T, int ways>
+    void check_tag_match()
+    {
+        FullyAssociativeTags<T, ways> tags;
+        foreach (i, ways) {
+            ASSERT_EQ(-1, tags.match(T(0x1000 + i)));
+            tags.select(T(0x1000 + i));
+        }
+
+        foreach (i, ways) {
+            ASSERT_EQ(i, tags.match(T(0x1000 + i))) << "ways " << ways;
+            ASSERT_EQ(i, (scalar_tag_match<T, ways>(tags.tags,
+                            T(0x1000 + i))));
+        }
+        ASSERT_EQ(-1, tags.match(T(0x1000 + ways)));
+
+        /* Only the high half differs */
+        if (sizeof(T) == 8)
+            ASSERT_EQ(-1, tags.match(T((W64(1) << 40) | 0x1000)));
+
+        tags.invalidate_way(ways - 1);
+        ASSERT_EQ(-1, tags.match(T(0x1000 + ways - 1)));
+    }
+
+    /* Vector and scalar tag match agree at every width */
+    TEST(Logic, TagMatch)
+    {
+        check_tag_match<W64, 1>();
+        check_tag_match<W64, 3>();
+        check_tag_match<W64, 8>();
+        check_tag_match<W64, 13>();
+        check_tag_match<W64, 32>();
+        check_tag_match<W64, 64>();
+        check_tag_match<W64, 72>();
+        check_tag_match<W32, 5>();
+        check_tag_match<W32, 16>();
+        check_tag_match<W32, 28>();
+        check_tag_match<W32, 64>();
+        check_tag_match<W16, 12>();
+    }
+
+    /* Matching a live prefix must agree with a full match */
+    TEST(Logic, AssocTagsPrefixMatch)
+    {
+        const int size = 64;
+        FullyAssociativeTags16bit<size, size> tags16;
+        FullyAssociativeTags8bit<size, size> tags8;
+
+        foreach(i, 37) {
+            tags16.insert(i % 5);
+            tags8.insert(i % 5);
+        }
+
+        foreach(n, 5) {
+            ASSERT_EQ(tags16.match(tags16.prep(n)),
+                    tags16.match(tags16.prep(n), 37));
+            ASSERT_EQ(tags8.match(tags8.prep(n)),
+                    tags8.match(tags8.prep(n), 37));
+        }
+
+        /* Slots past the prefix are never reported */
+        bitvec<size> m = tags16.match(tags16.prep(1), 8);
+        ASSERT_EQ(2, m.popcount());
+        ASSERT_TRUE(m[1]);
+        ASSERT_TRUE(m[6]);
+
+        tags16.invalidate(tags16.prep(1), 37);
+        ASSERT_TRUE(tags16.match(tags16.prep(1)).iszero());
+        ASSERT_TRUE(tags16.isvalid(2));
+    }
+
     /* Test simulation freq related functions */
     TEST(Sim, SimFreq)
     {
@@ -61,4 +132,33 @@ namespace {
         W64 invalid = InvalidTag<W64>::INVALID;
         ASSERT_EQ(-1, invalid);
     }
+
+    TEST(Sim, BitScan)
+    {
+        ASSERT_EQ(0, popcount(0));
+        ASSERT_EQ(32, popcount(0xffffffff));
+        ASSERT_EQ(64, popcount64(W64(-1)));
+        ASSERT_EQ(3, popcount64(0x8000000100000001ULL));
+
+        ASSERT_EQ(0U, lsbindex32(1));
+        ASSERT_EQ(31U, lsbindex32(0x80000000));
+        ASSERT_EQ(63U, lsbindex64(0x8000000000000000ULL));
+        ASSERT_EQ(32U, lsbindex64(0x0000000300000000ULL));
+        ASSERT_EQ(-1, lsbindexi32(0));
+
+        ASSERT_EQ(0U, msbindex32(1));
+        ASSERT_EQ(4U, msbindex32(0x1f));
+        ASSERT_EQ(63U, msbindex64(W64(-1)));
+        ASSERT_EQ(33U, msbindex64(0x0000000300000000ULL));
+        ASSERT_EQ(-1, msbindexi32(0));
+
+        bitvec<130> v;
+        v[3] = 1;
+        v[64] = 1;
+        v[129] = 1;
+        ASSERT_EQ(3U, v.popcount());
+        ASSERT_EQ(3U, v.lsb());
+        ASSERT_EQ(64U, v.nextlsb(3));
+        ASSERT_EQ(129U, v.nextlsb(64));
+    }
 };
@@ -0,0 +1,106 @@
+
+#include <gtest/gtest.h>
+
+#include <machine-options.h>
+
+namespace {
+
+    TEST(MachineOptions, TypedValues) {
+        MachineOptions opts;
+        bool b = false;
+        int i = 0;
+        stringbuf s;
+
+        opts.add("ooo_0", "threads", 2);
+        opts.add("ooo_0", "trace", true);
+        opts.add("L1_D_0", "type", "private");
+
+        ASSERT_TRUE(opts.get("ooo_0", "threads", i));
+        ASSERT_EQ(2, i);
+        ASSERT_TRUE(opts.get("ooo_0", "trace", b));
+        ASSERT_TRUE(b);
+        ASSERT_TRUE(opts.get("L1_D_0", "type", s));
+        ASSERT_STREQ("private", s.buf);
+
+        /* Only the value of the requested type is found */
+        ASSERT_FALSE(opts.get("ooo_0", "threads", b));
+        ASSERT_FALSE(opts.get("L1_D_0", "type", i));
+        ASSERT_TRUE(opts.has("ooo_0", "threads"));
+
+        /* Unknown names don't get symbols */
+        W32 count = opts.symbol_count;
+        ASSERT_FALSE(opts.get("ooo_1", "threads", i));
+        ASSERT_FALSE(opts.get("ooo_0", "missing", i));
+        ASSERT_FALSE(opts.has("L2_0", "type"));
+        ASSERT_EQ(count, opts.symbol_count);
+
+        /* Later values override earlier ones */
+        opts.add("ooo_0", "threads", 4);
+        opts.add("L1_D_0", "type", "shared");
+        ASSERT_TRUE(opts.get("ooo_0", "threads", i));
+        ASSERT_EQ(4, i);
+        s.reset();
+        ASSERT_TRUE(opts.get("L1_D_0", "type", s));
+        ASSERT_STREQ("shared", s.buf);
+    }
+
+    TEST(MachineOptions, TextValues) {
+        MachineOptions opts;
+        bool b = false;
+        int i = 0;
+        stringbuf s;
+
+        opts.add("L2_0", "latency", 10);
+        opts.add("L2_0", "prefetcher", "none");
+        opts.add("MEM_0", "dram_power", false);
+
+        /* Existing options keep their type */
+        ASSERT_TRUE(opts.add_text("L2_0", "latency", "14"));
+        ASSERT_TRUE(opts.get("L2_0", "latency", i));
+        ASSERT_EQ(14, i);
+        ASSERT_TRUE(opts.add_text("L2_0", "prefetcher", "stream"));
+        ASSERT_TRUE(opts.get("L2_0", "prefetcher", s));
+        ASSERT_STREQ("stream", s.buf);
+        ASSERT_TRUE(opts.add_text("MEM_0", "dram_power", "true"));
+        ASSERT_TRUE(opts.get("MEM_0", "dram_power", b));
+        ASSERT_TRUE(b);
+
+        ASSERT_FALSE(opts.add_text("L2_0", "latency", "fast"));
+        ASSERT_FALSE(opts.add_text("MEM_0", "dram_power", "1"));
+        ASSERT_TRUE(opts.get("L2_0", "latency", i));
+        ASSERT_EQ(14, i);
+
+        /* New ones get the type of their text */
+        ASSERT_TRUE(opts.add_text("L1_D_0", "latency", "3"));
+        ASSERT_TRUE(opts.add_text("L1_D_0", "replacement", "drrip"));
+        ASSERT_TRUE(opts.get("L1_D_0", "latency", i));
+        ASSERT_EQ(3, i);
+        s.reset();
+        ASSERT_TRUE(opts.get("L1_D_0", "replacement", s));
+        ASSERT_STREQ("drrip", s.buf);
+        ASSERT_FALSE(opts.get("L1_D_0", "latency", s));
+    }
+
+    TEST(MachineOptions, ManyComponents) {
+        MachineOptions opts;
+        char name[32];
+
+        foreach (c, 128) {
+            snprintf(name, sizeof(name), "ooo_%d", c);
+            opts.add(name, "iq_size", c);
+            opts.add(name, "rob_size", c * 2);
+        }
+
+        /* Component and option names are interned once */
+        ASSERT_EQ(W32(128 + 2), opts.symbol_count);
+
+        foreach (c, 128) {
+            int iq = -1, rob = -1;
+            snprintf(name, sizeof(name), "ooo_%d", c);
+            ASSERT_TRUE(opts.get(name, "iq_size", iq));
+            ASSERT_TRUE(opts.get(name, "rob_size", rob));
+            ASSERT_EQ(c, iq);
+            ASSERT_EQ(c * 2, rob);
+        }
+    }
+};
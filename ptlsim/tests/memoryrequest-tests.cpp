@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <memoryRequest.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(MemoryRequestHandle, FollowsOwner)
+    {
+        MemoryRequest request;
+        MemoryRequestHandle handle;
+        EXPECT_TRUE(handle.get() == NULL);
+
+        request.init(0, 0, 0x1000, 7, 0, false, 0x400000, 42,
+                MEMORY_OP_READ);
+        handle.set(&request);
+        EXPECT_EQ(&request, handle.get());
+
+        /* Recycled by the pool for another uop */
+        request.init(0, 0, 0x2000, 7, 0, false, 0x400000, 43,
+                MEMORY_OP_READ);
+        EXPECT_TRUE(handle.get() == NULL);
+
+        handle.set(&request);
+        handle.reset();
+        EXPECT_TRUE(handle.get() == NULL);
+    }
+
+    TEST(MemoryRequestHandle, AnnulEndsWithRequest)
+    {
+        MemoryRequest request;
+        request.init(1, 0, 0x1000, 3, 0, false, 0x400000, 9,
+                MEMORY_OP_READ);
+        EXPECT_FALSE(request.is_annuled());
+
+        request.annul();
+        request.set_drop_pending(true);
+        EXPECT_TRUE(request.is_annuled());
+
+        /* Writebacks and prefetches made from it are not annuled */
+        MemoryRequest update;
+        update.init(&request);
+        EXPECT_FALSE(update.is_annuled());
+        EXPECT_FALSE(update.is_drop_pending());
+
+        request.init(1, 0, 0x1000, 3, 0, false, 0x400000, 10,
+                MEMORY_OP_READ);
+        EXPECT_FALSE(request.is_annuled());
+        EXPECT_FALSE(request.is_drop_pending());
+    }
+
+    TEST(MemoryRequestPriority, FollowsTypeAndWaiters)
+    {
+        MemoryRequest load, store;
+        load.init(0, 0, 0x1000, 1, 0, false, 0x400000, 1, MEMORY_OP_READ);
+        store.init(0, 0, 0x2000, 2, 0, false, 0x400010, 2, MEMORY_OP_WRITE);
+        EXPECT_EQ(PRIORITY_DEMAND, load.get_priority());
+        EXPECT_EQ(PRIORITY_STORE, store.get_priority());
+
+        /* A critical load waiting on the store's line promotes it */
+        load.set_priority(PRIORITY_CRITICAL);
+        store.inherit_priority(&load);
+        EXPECT_EQ(PRIORITY_CRITICAL, store.get_priority());
+        store.set_priority(PRIORITY_PREFETCH);
+        store.inherit_priority(&store);
+        EXPECT_EQ(PRIORITY_PREFETCH, store.get_priority());
+
+        MemoryRequest update;
+        update.init(&load);
+        update.set_op_type(MEMORY_OP_UPDATE);
+        EXPECT_EQ(PRIORITY_WRITEBACK, update.get_priority());
+
+        priority_scheduling = false;
+        EXPECT_FALSE(more_urgent(&load, &update));
+        priority_scheduling = true;
+        EXPECT_TRUE(more_urgent(&load, &update));
+        EXPECT_FALSE(more_urgent(&update, &load));
+        EXPECT_FALSE(more_urgent(&load, &load));
+        priority_scheduling = false;
+    }
+
+    TEST(MemoryRequest, HotFieldsInOneLine)
+    {
+        /* Links and hot fields, then pool bookkeeping, nothing more */
+        EXPECT_EQ(size_t(128), sizeof(MemoryRequest));
+
+        /* Without a pool there is no side table, hops are dropped */
+        MemoryRequest request;
+        request.init(0, 0, 0x1000, 1, 0, false, 0x400000, 1,
+                MEMORY_OP_READ);
+        request.record_hop(3);
+        EXPECT_EQ(0, request.get_hops().count);
+    }
+
+    TEST(MemoryRequest, SplitStateClearedOnInit)
+    {
+        MemoryRequest owner, part;
+        owner.init(0, 0, 0x1038, 1, 0, false, 0x400000, 1,
+                MEMORY_OP_READ);
+        part.init(&owner);
+        part.set_physical_address(0x1040);
+        part.set_split_owner(&owner);
+        owner.set_split_parts(1);
+        owner.set_split_filled(true);
+
+        EXPECT_EQ(&owner, part.get_split_owner());
+        EXPECT_EQ(W64(0x1040), part.get_physical_address());
+
+        /* A recycled request is no part of, nor waits for, any other */
+        part.init(&owner);
+        EXPECT_TRUE(part.get_split_owner() == NULL);
+        owner.init(0, 0, 0x2000, 2, 0, false, 0x400000, 2,
+                MEMORY_OP_READ);
+        EXPECT_EQ(0, owner.get_split_parts());
+        EXPECT_FALSE(owner.is_split_filled());
+    }
+};
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <memorySurrogate.h>
+
+using namespace Memory;
+
+namespace {
+
+    /* Run cycles [from, to) with 'misses' L1 misses a cycle */
+    int run(MemorySurrogate &m, W64 from, W64 to, int misses)
+    {
+        int phase = MemorySurrogate::PHASE_SAME;
+        for (W64 c = from; c < to && phase == MemorySurrogate::PHASE_SAME;
+                c++) {
+            phase = m.clock(c);
+            foreach (i, misses) m.arrival();
+        }
+        return phase;
+    }
+
+    TEST(MemorySurrogate, FitsLevels)
+    {
+        MemorySurrogate m;
+        m.window = 1000;
+        m.reset(0);
+
+        ASSERT_EQ(-1, m.predict(L2_CACHE));
+
+        /* Two misses a cycle over the last interval */
+        run(m, 0, 257, 2);
+        EXPECT_DOUBLE_EQ(2.0, m.load);
+
+        /* L2 at 12 cycles, memory at 100 plus 50 per miss a cycle */
+        m.load = 0;
+        foreach (i, 40) m.sample(L2_CACHE, 12);
+        foreach (i, 40) m.sample(MAIN_MEMORY, 100);
+        m.load = 1;
+        foreach (i, 40) m.sample(MAIN_MEMORY, 150);
+        foreach (i, 10) m.sample(L3_CACHE, 40);
+
+        /* Nothing predicted yet, so the first window can't go fast */
+        ASSERT_EQ(MemorySurrogate::PHASE_RECALIBRATE, run(m, 257, 2000, 2));
+        ASSERT_FALSE(m.fast);
+        ASSERT_LT(m.lastError, 0);
+        EXPECT_DOUBLE_EQ(2.0, m.load);
+
+        EXPECT_EQ(12, m.predict(L2_CACHE));
+        EXPECT_NEAR(100.0, m.levels[MAIN_MEMORY].base, 0.5);
+        EXPECT_NEAR(50.0, m.levels[MAIN_MEMORY].slope, 0.5);
+        EXPECT_EQ(200, m.predict(MAIN_MEMORY));
+
+        /* Too few samples of L3 */
+        EXPECT_EQ(-1, m.predict(L3_CACHE));
+    }
+
+    TEST(MemorySurrogate, SwitchesOnError)
+    {
+        MemorySurrogate m;
+        m.window = 1000;
+        m.period = 5000;
+        m.bound = 0.1;
+        m.reset(0);
+
+        foreach (i, 40) m.sample(L2_CACHE, 20);
+        ASSERT_EQ(MemorySurrogate::PHASE_RECALIBRATE, run(m, 0, 2000, 0));
+
+        /* Within 10% of what the fit predicts */
+        W64 now = 1000;
+        foreach (i, 40) m.sample(L2_CACHE, 21);
+        ASSERT_EQ(MemorySurrogate::PHASE_FAST, run(m, now, now + 2000, 0));
+        ASSERT_TRUE(m.fast);
+        EXPECT_NEAR(0.05, m.lastError, 0.01);
+        EXPECT_EQ(now + 1000 + 5000, m.phaseEnd);
+
+        now = m.phaseEnd;
+        ASSERT_EQ(MemorySurrogate::PHASE_DETAILED,
+                run(m, now - 10, now + 10, 0));
+        ASSERT_FALSE(m.fast);
+
+        /* Hierarchy got slower, the next window stays detailed */
+        foreach (i, 40) m.sample(L2_CACHE, 40);
+        ASSERT_EQ(MemorySurrogate::PHASE_RECALIBRATE,
+                run(m, now, now + 2000, 0));
+        ASSERT_FALSE(m.fast);
+        EXPECT_GT(m.lastError, 0.4);
+        EXPECT_EQ(40, m.predict(L2_CACHE));
+    }
+
+};
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <memoryTiering.h>
+
+using namespace Memory;
+
+namespace {
+
+    TierConfig small_config()
+    {
+        TierConfig cfg;
+        cfg.fastPages = 4;
+        cfg.slowLatency = 300;
+        cfg.slowLineCycles = 10;
+        cfg.epochCycles = 1000;
+        cfg.hotThreshold = 4;
+        cfg.coldThreshold = 2;
+        cfg.migratePages = 2;
+        cfg.sketchWidth = 256;
+        return cfg;
+    }
+
+    W64 page_addr(int page)
+    {
+        return W64(page) << TIER_PAGE_BITS;
+    }
+
+    TEST(MemoryTiering, SketchCountsAndDecays)
+    {
+        PageHotnessSketch sketch;
+        sketch.setup(64);
+
+        /* Far more pages than counters: collisions only overcount */
+        foreach (p, 500) {
+            foreach (n, p % 7) sketch.add(p);
+        }
+
+        foreach (p, 500) {
+            ASSERT_GE(sketch.estimate(p), p % 7);
+        }
+
+        PageHotnessSketch exact;
+        exact.setup(4096);
+        foreach (n, 300) exact.add(42);
+        EXPECT_EQ(255, exact.estimate(42));
+
+        exact.decay();
+        EXPECT_EQ(127, exact.estimate(42));
+        EXPECT_EQ(0, exact.estimate(43));
+    }
+
+    TEST(MemoryTiering, PageSetRemovesWithoutLosingPages)
+    {
+        TierPageSet set;
+        set.setup(100);
+
+        foreach (p, 100) set.insert(p * 37);
+        EXPECT_TRUE(set.full());
+
+        /* Remove every third page, the rest must still be found */
+        for (int p = 0; p < 100; p += 3)
+            set.remove_slot(set.find(p * 37));
+
+        foreach (p, 100) {
+            ASSERT_EQ(p % 3 != 0, set.contains(p * 37)) << "page " << p;
+        }
+        EXPECT_FALSE(set.full());
+    }
+
+    TEST(MemoryTiering, FirstTouchAndSlowBandwidth)
+    {
+        MemoryTiering tiering;
+        TierAccess tier;
+        tiering.init(small_config());
+
+        /* First 4 pages fit in the fast tier */
+        foreach (p, 4) {
+            tiering.access(page_addr(p), 10, tier);
+            EXPECT_TRUE(tier.placed);
+            EXPECT_FALSE(tier.slow);
+        }
+
+        tiering.access(page_addr(0) + 64, 10, tier);
+        EXPECT_FALSE(tier.placed);
+        EXPECT_FALSE(tier.slow);
+
+        /* Back to back slow accesses queue for its bandwidth */
+        tiering.access(page_addr(9), 20, tier);
+        EXPECT_TRUE(tier.slow);
+        EXPECT_EQ(300, tier.latency);
+
+        tiering.access(page_addr(10), 20, tier);
+        EXPECT_TRUE(tier.slow);
+        EXPECT_EQ(310, tier.latency);
+
+        tiering.access(page_addr(11), 100, tier);
+        EXPECT_EQ(300, tier.latency);
+    }
+
+    TEST(MemoryTiering, HotPolicyPromotesAndDemotes)
+    {
+        MemoryTiering tiering;
+        TierAccess tier;
+        tiering.init(small_config());
+
+        /* Pages 0-3 fill the fast tier, only 0 and 1 stay in use */
+        foreach (p, 4) tiering.access(page_addr(p), 0, tier);
+        foreach (n, 8) {
+            tiering.access(page_addr(0), 100, tier);
+            tiering.access(page_addr(1), 100, tier);
+        }
+
+        /* Page 9 gets hot in the slow tier, page 10 not */
+        foreach (n, 6) tiering.access(page_addr(9), 200, tier);
+        tiering.access(page_addr(10), 200, tier);
+
+        tiering.access(page_addr(0), 1000, tier);
+        EXPECT_TRUE(tier.epoch);
+        EXPECT_EQ(1, tier.promotions);
+        EXPECT_EQ(1, tier.demotions);
+        EXPECT_EQ(0, tier.skipped);
+
+        EXPECT_TRUE(tiering.fast.contains(9));
+        EXPECT_FALSE(tiering.fast.contains(10));
+        EXPECT_TRUE(tiering.fast.contains(0));
+        EXPECT_TRUE(tiering.fast.contains(1));
+        EXPECT_FALSE(tiering.fast.contains(2) && tiering.fast.contains(3));
+
+        /* The migration holds the slow tier for a page each way */
+        tiering.access(page_addr(10), 1000, tier);
+        EXPECT_TRUE(tier.slow);
+        EXPECT_EQ(300 + 2 * TIER_LINES_PER_PAGE * 10, tier.latency);
+    }
+
+    TEST(MemoryTiering, StaticPolicyNeverMigrates)
+    {
+        TierConfig cfg = small_config();
+        cfg.policy = TIER_POLICY_STATIC;
+
+        MemoryTiering tiering;
+        TierAccess tier;
+        tiering.init(cfg);
+
+        foreach (p, 4) tiering.access(page_addr(p), 0, tier);
+        foreach (n, 20) tiering.access(page_addr(9), 100, tier);
+
+        tiering.access(page_addr(9), 5000, tier);
+        EXPECT_TRUE(tier.epoch);
+        EXPECT_EQ(0, tier.promotions);
+        EXPECT_TRUE(tier.slow);
+    }
+
+    TEST(MemoryTiering, DisabledWithoutFastPages)
+    {
+        MemoryTiering tiering;
+        tiering.init(TierConfig());
+
+        EXPECT_FALSE(tiering.enabled());
+    }
+};
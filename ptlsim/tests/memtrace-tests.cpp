@@ -0,0 +1,170 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <memtrace.h>
+
+#include <cstdio>
+
+namespace {
+
+    const char *write_trace(const MemTraceRecord *recs, int count,
+            const char *magic = MEMTRACE_MAGIC)
+    {
+        static char name[] = "/tmp/memtrace-test.XXXXXX";
+        strcpy(name, "/tmp/memtrace-test.XXXXXX");
+        FILE *f = fdopen(mkstemp(name), "wb");
+        fwrite(magic, 8, 1, f);
+        if (count) fwrite(recs, sizeof(MemTraceRecord), count, f);
+        fclose(f);
+        return name;
+    }
+
+    MemTraceRecord record(W8 core, W8 type, W64 addr)
+    {
+        MemTraceRecord r;
+        memset(&r, 0, sizeof(r));
+        r.physaddr = addr;
+        r.coreid = core;
+        r.type = type;
+        r.gap = 1;
+        return r;
+    }
+
+    TEST(MemTrace, PerCoreIndex) {
+        ASSERT_EQ(24U, sizeof(MemTraceRecord));
+
+        MemTraceRecord recs[5] = {
+            record(1, MEMTRACE_READ, 0x1000),
+            record(0, MEMTRACE_WRITE, 0x2000),
+            record(1, MEMTRACE_IFETCH, 0x3000),
+            record(1, MEMTRACE_READ, 0x4000),
+            record(0, MEMTRACE_READ, 0x5000),
+        };
+        const char *name = write_trace(recs, 5);
+
+        MemTraceFile trace;
+        ASSERT_TRUE(trace.open(name, 2) == NULL);
+        ASSERT_EQ(5U, trace.count);
+        ASSERT_EQ(2, trace.per_core[0].count());
+        ASSERT_EQ(3, trace.per_core[1].count());
+        ASSERT_EQ(1U, trace.per_core[0][0]);
+        ASSERT_EQ(4U, trace.per_core[0][1]);
+        ASSERT_EQ(0U, trace.per_core[1][0]);
+        ASSERT_EQ(3U, trace.per_core[1][2]);
+        ASSERT_EQ(W64(0x3000), trace.records[trace.per_core[1][1]].physaddr);
+
+        /* Machine with fewer cores than the trace */
+        ASSERT_TRUE(trace.open(name, 1) != NULL);
+        unlink(name);
+    }
+
+    TEST(MemTrace, BadFiles) {
+        MemTraceFile trace;
+        MemTraceRecord r = record(0, MEMTRACE_READ, 0x1000);
+
+        const char *name = write_trace(&r, 1, "PTLTRCE1");
+        ASSERT_TRUE(trace.open(name, 1) != NULL);
+        unlink(name);
+
+        r.type = MEMTRACE_TYPE_COUNT;
+        name = write_trace(&r, 1);
+        ASSERT_TRUE(trace.open(name, 1) != NULL);
+        unlink(name);
+
+        name = write_trace(NULL, 0);
+        ASSERT_TRUE(trace.open(name, 1) == NULL);
+        ASSERT_EQ(0U, trace.count);
+        unlink(name);
+
+        ASSERT_TRUE(trace.open("/nonexistent/trace", 1) != NULL);
+    }
+    /* Write accesses as '-memtrace-capture' does, 'per_block' a block */
+    const char *write_packed(const MemTraceAccess *acc, int count,
+            int per_block)
+    {
+        static char name[] = "/tmp/memtrace-test.XXXXXX";
+        strcpy(name, "/tmp/memtrace-test.XXXXXX");
+        FILE *f = fdopen(mkstemp(name), "wb");
+        fwrite(MEMTRACE_PACKED_MAGIC, 8, 1, f);
+
+        for (int i = 0; i < count; i += per_block) {
+            int n = min(per_block, count - i);
+            dynarray<W8> payload;
+            memtrace_encode_block(acc + i, n, payload);
+
+            uLongf size = compressBound(payload.length);
+            dynarray<W8> packed(size);
+            compress2((Bytef*)packed.data, &size,
+                    (const Bytef*)payload.data, payload.length, 1);
+
+            W64 cycle = acc[i].cycle;
+            W32 header[3] = { W32(n), W32(payload.length), W32(size) };
+            fwrite(&cycle, 8, 1, f);
+            fwrite(header, 4, 3, f);
+            fwrite(packed.data, size, 1, f);
+        }
+        fclose(f);
+        return name;
+    }
+
+    TEST(MemTrace, PackedRoundTrip) {
+        MemTraceAccess acc[7];
+        W64 cycles[7] = { 100, 100, 103, 110, 111, 200, 1000 };
+        W8 cores[7] = { 0, 1, 0, 1, 1, 0, 1 };
+        W64 addrs[7] = { 0x1000, 0x80000000, 0x1040, 0x7fffffc0, 0x40,
+            0x1000, 0xffffffffffc0ULL };
+
+        foreach (i, 7) {
+            acc[i].cycle = cycles[i];
+            acc[i].physaddr = addrs[i];
+            acc[i].rip = 0xffff800000001000ULL + i * 4;
+            acc[i].coreid = cores[i];
+            acc[i].threadid = i & 1;
+            acc[i].type = i % MEMTRACE_TYPE_COUNT;
+        }
+
+        /* Blocks of 3 so per core state restarts within the trace */
+        const char *name = write_packed(acc, 7, 3);
+
+        MemTraceFile trace;
+        ASSERT_TRUE(trace.open(name, 2) == NULL);
+        ASSERT_EQ(7U, trace.count);
+        ASSERT_EQ(3, trace.per_core[0].count());
+        ASSERT_EQ(4, trace.per_core[1].count());
+
+        W64 gaps[7] = { 0, 0, 3, 10, 1, 97, 889 };
+        foreach (i, 7) {
+            const MemTraceRecord &r = trace.records[i];
+            ASSERT_EQ(addrs[i], r.physaddr);
+            ASSERT_EQ(acc[i].rip, r.rip);
+            ASSERT_EQ(cores[i], r.coreid);
+            ASSERT_EQ(acc[i].threadid, r.threadid);
+            ASSERT_EQ(acc[i].type, r.type);
+            ASSERT_EQ(gaps[i], W64(r.gap));
+        }
+
+        /* Truncated block is refused */
+        ASSERT_EQ(0, truncate(name, 40));
+        ASSERT_TRUE(trace.open(name, 2) != NULL);
+        unlink(name);
+    }
+
+    TEST(MemTrace, MixMetrics) {
+        /* One workload unaffected, the other twice as slow */
+        W64 shared[2] = { 1000, 4000 };
+        W64 alone[2] = { 1000, 2000 };
+
+        MemTraceMixMetrics m = memtrace_mix_metrics(shared, alone, 2);
+        EXPECT_DOUBLE_EQ(1.5, m.weighted_speedup);
+        EXPECT_DOUBLE_EQ(2.0 / 3.0, m.harmonic_speedup);
+        EXPECT_DOUBLE_EQ(0.5, m.fairness);
+
+        /* Equal slowdowns are fair */
+        W64 even[2] = { 2000, 4000 };
+        m = memtrace_mix_metrics(even, alone, 2);
+        EXPECT_DOUBLE_EQ(1.0, m.weighted_speedup);
+        EXPECT_DOUBLE_EQ(1.0, m.fairness);
+    }
+};
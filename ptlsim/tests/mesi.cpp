@@ -8,6 +8,7 @@
 #include <memoryHierarchy.h>
 #include <coherentCache.h>
 #include <mesiLogic.h>
+#include <mesifLogic.h>
 #include <machine.h>
 
 using namespace Memory;
@@ -18,13 +19,16 @@ namespace {
     class TestCacheCont : public CacheController
     {
         public:
-            TestCacheCont(MemoryHierarchy *mem)
+            TestCacheCont(MemoryHierarchy *mem, bool mesif=false)
                 : CacheController(0, "test", mem, CacheType(0))
             {
                 set_lowest_private(true);
 
                 CacheController *cont = (CacheController*)(this);
-                mesi = new MESILogic(cont, cont->get_stats(), mem);
+                if (mesif)
+                    mesi = new MESIFLogic(cont, cont->get_stats(), mem);
+                else
+                    mesi = new MESILogic(cont, cont->get_stats(), mem);
                 set_coherence_logic(mesi);
 
                 queueEntry = new CacheQueueEntry();
@@ -51,7 +55,7 @@ namespace {
                 queueEntry->line = line;
             }
 
-            MESILogic *mesi;
+            CoherenceLogic *mesi;
             CacheLine *line;
             CacheQueueEntry *queueEntry;
             bool evict_upper;
@@ -372,6 +376,36 @@ namespace {
         cont->set_lowest_private(true);
     }
 
+    TEST_F(MesiTest, UpperLevelSnoop)
+    {
+        cont->set_lowest_private(false);
+
+        // Updates from lower level only change the line state
+        MESICacheLineState t_state = mod;
+        qe->m_arg = &t_state;
+        e_ihit(update, exc);
+        ASSERT_EQ(st, mod);
+        ASSERT_TRUE(cont->clear_entry);
+        ASSERT_FALSE(cont->wait_interconn);
+        r();
+
+        e_ihit(read, mod);
+        ASSERT_EQ(st, sh);
+        ASSERT_TRUE(qe->isShared);
+        ASSERT_TRUE(cont->update_lower);
+        ASSERT_TRUE(cont->wait_interconn);
+        r();
+
+        // Only lowest private level invalidates upper levels
+        e_ihit(write, sh);
+        ASSERT_EQ(st, in);
+        ASSERT_FALSE(cont->evict_upper);
+        ASSERT_TRUE(cont->wait_interconn);
+        r();
+
+        cont->set_lowest_private(true);
+    }
+
 #define creq(type, state, shared) { \
     req->set_op_type(type); \
     Message m; m.isShared = shared; m.hasData = 1; \
@@ -405,4 +439,97 @@ namespace {
         ASSERT_EQ(st, exc);
         r();
     }
+
+    class MesifTest : public ::testing::Test {
+        public:
+            TestCacheCont* cont;
+            MemoryRequest* req;
+            CacheLine* line;
+
+            MesifTest()
+            {
+                BaseMachine* machine = (BaseMachine*)(PTLsimMachine::getmachine("base"));
+
+                MemoryHierarchy* mem = new MemoryHierarchy(*machine);
+
+                cont = new TestCacheCont(mem, true);
+                req = cont->queueEntry->request;
+                line = cont->queueEntry->line;
+            }
+
+            void TearDown()
+            {
+                cont->reset();
+            }
+    };
+
+#define fwd MESIF_FORWARD
+
+    TEST_F(MesifTest, ForwarderAnswersWithData)
+    {
+        e_ihit(read, fwd);
+        ASSERT_EQ(st, MESIF_SHARED);
+        ASSERT_TRUE(qe->isShared);
+        ASSERT_TRUE(qe->responseData);
+        ASSERT_TRUE(cont->wait_interconn);
+        r();
+
+        // Shared copies tell they share the line but don't send it
+        e_ihit(read, MESIF_SHARED);
+        ASSERT_EQ(st, MESIF_SHARED);
+        ASSERT_TRUE(qe->isShared);
+        ASSERT_FALSE(qe->responseData);
+        ASSERT_TRUE(qe->line != NULL);
+        r();
+
+        e_ihit(write, fwd);
+        ASSERT_EQ(st, in);
+        ASSERT_TRUE(cont->evict_upper);
+        ASSERT_TRUE(qe->responseData);
+        r();
+
+        e_ihit(read, MESIF_MODIFIED);
+        ASSERT_EQ(st, MESIF_SHARED);
+        ASSERT_TRUE(cont->update_lower);
+        ASSERT_TRUE(qe->responseData);
+        r();
+    }
+
+    TEST_F(MesifTest, LocalWriteOnForwarder)
+    {
+        e_hit(read, fwd);
+        ASSERT_EQ(st, fwd);
+        ASSERT_TRUE(cont->wait_interconn);
+        r();
+
+        e_hit(write, fwd);
+        ASSERT_EQ(st, MESIF_MODIFIED);
+        ASSERT_TRUE(cont->evict_lower);
+        r();
+
+        e_hit(write, MESIF_EXCLUSIVE);
+        ASSERT_EQ(st, MESIF_MODIFIED);
+        ASSERT_FALSE(cont->evict_lower);
+        r();
+    }
+
+#define fcreq(type, l_state, shared) { \
+    req->set_op_type(type); st = l_state; \
+    Message m; m.isShared = shared; m.hasData = 1; \
+    cont->mesi->complete_request(qe, m); }
+
+    TEST_F(MesifTest, SharedFillMakesForwarder)
+    {
+        fcreq(mread, in, true);
+        ASSERT_EQ(st, fwd);
+        r();
+
+        fcreq(mread, in, false);
+        ASSERT_EQ(st, MESIF_EXCLUSIVE);
+        r();
+
+        fcreq(mwrite, fwd, false);
+        ASSERT_EQ(st, MESIF_MODIFIED);
+        r();
+    }
 };
@@ -5,6 +5,7 @@
 #include <ptlsim.h>
 #include <ptl-qemu.h>
 #include <superstl.h>
+#include <statelist.h>
 
 void read_simpoint_file();
 int get_simpoint(int id);
@@ -111,4 +112,319 @@ namespace {
         EXPECT_STREQ("test_sp_0", name->buf);
         delete name;
     }
+
+    TEST(HostTLB, DirectRAMAccess)
+    {
+        Context& ctx = contextof(0);
+        static W64 page[TARGET_PAGE_SIZE / 8] __attribute__((aligned(4096)));
+        Waddr virtaddr = 0x7f0000001000ULL;
+        int index = (virtaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+        CPUTLBEntry& entry = ctx.tlb_table[MMU_USER_IDX][index];
+        CPUTLBEntry saved = entry;
+        bool kernel_mode = ctx.kernel_mode;
+
+        ctx.kernel_mode = 0;
+        entry.addr_read = virtaddr;
+        entry.addr_write = virtaddr;
+        entry.addend = (Waddr)page - virtaddr;
+        page[1] = 0x1122334455667788ULL;
+
+        EXPECT_EQ((byte*)&page[1], ctx.host_addr(virtaddr + 8, 3, false));
+        EXPECT_EQ(0x1122334455667788ULL, ctx.loadvirt(virtaddr + 8, 3));
+        EXPECT_EQ(0x7788, ctx.loadvirt(virtaddr + 8, 1));
+
+        ctx.storemask_virt(virtaddr + 16, 0xabcd, 0x3, 1);
+        EXPECT_EQ(0xabcd, page[2]);
+
+        /* Accesses crossing the page go through QEMU */
+        EXPECT_TRUE(ctx.host_addr(virtaddr + TARGET_PAGE_SIZE - 4, 3,
+                    false) == NULL);
+
+        /* Pages with translated code are written through QEMU */
+        entry.addr_write = virtaddr | TLB_NOTDIRTY;
+        EXPECT_TRUE(ctx.host_addr(virtaddr, 3, true) == NULL);
+        EXPECT_EQ((byte*)page, ctx.host_addr(virtaddr, 3, false));
+
+        /* Kernel mode accesses use kernel TLB */
+        ctx.kernel_mode = 1;
+        EXPECT_TRUE(ctx.host_addr(virtaddr, 3, false) == NULL);
+
+        entry = saved;
+        ctx.kernel_mode = kernel_mode;
+    }
+
+    struct IndexTestEntry : public FixStateListObject
+    {
+        int id;
+        void init() { id = -1; }
+    };
+
+    TEST(IndexedFixStateList, KeyOrder)
+    {
+        IndexedFixStateList<IndexTestEntry, 16> list;
+
+        /* Keys 3 and 35 land in the same bucket */
+        foreach (i, 6) {
+            IndexTestEntry *e = list.alloc();
+            e->id = i;
+            list.index(e, (i % 2) ? 35 : 3);
+        }
+
+        IndexTestEntry *e = list.first(3);
+        ASSERT_TRUE(e != NULL);
+        EXPECT_EQ(0, e->id);
+        e = list.next(e);
+        EXPECT_EQ(2, e->id);
+        e = list.next(e);
+        EXPECT_EQ(4, e->id);
+        EXPECT_TRUE(list.next(e) == NULL);
+
+        EXPECT_EQ(1, list.first(35)->id);
+        EXPECT_FALSE(list.contains(4));
+    }
+
+    TEST(IndexedFixStateList, FreeUnindexes)
+    {
+        IndexedFixStateList<IndexTestEntry, 4> list;
+
+        IndexTestEntry *a = list.alloc();
+        IndexTestEntry *b = list.alloc();
+        a->id = 0;
+        b->id = 1;
+        list.index(a, 7);
+        list.index(b, 7);
+
+        list.free(a);
+        EXPECT_EQ(1, list.first(7)->id);
+
+        list.free(b);
+        EXPECT_FALSE(list.contains(7));
+
+        /* Reused entries are not indexed until asked to */
+        IndexTestEntry *c = list.alloc();
+        EXPECT_FALSE(list.contains(7));
+        list.index(c, 9);
+        EXPECT_TRUE(list.first(9) == c);
+    }
+
+    struct OpenHashEntry {
+        selflistlink hashlink;
+        W64 key;
+    };
+
+    struct OpenHashLinkManager {
+        static inline W64& keyof(OpenHashEntry* obj) { return obj->key; }
+    };
+
+    typedef OpenHashtable<W64, OpenHashEntry, 16, OpenHashLinkManager>
+        OpenHashTestTable;
+
+    TEST(OpenHashtable, GrowsWhileAdding)
+    {
+        OpenHashTestTable table;
+        OpenHashEntry entries[1000];
+
+        foreach (i, 1000) {
+            entries[i].key = W64(i) << 12;
+            EXPECT_EQ(&entries[i], table.add(&entries[i]));
+
+            /* Found in the old slots or the new ones while growing */
+            foreach (j, i + 1)
+                ASSERT_EQ(&entries[j], table.get(W64(j) << 12));
+        }
+        EXPECT_EQ(1000, table.count);
+        EXPECT_TRUE(table.get(0x123) == NULL);
+
+        int seen = 0;
+        OpenHashTestTable::Iterator iter(table);
+        while (iter.next()) seen++;
+        EXPECT_EQ(1000, seen);
+
+        /* Same key again replaces the entry */
+        OpenHashEntry other;
+        other.key = 5 << 12;
+        table.add(&other);
+        EXPECT_EQ(&other, table.get(5 << 12));
+        EXPECT_EQ(1000, table.count);
+
+        /* Not the one in the table, nothing to remove */
+        table.remove(&entries[5]);
+        EXPECT_EQ(1000, table.count);
+    }
+
+    TEST(OpenHashtable, RemoveWhileIterating)
+    {
+        OpenHashTestTable table;
+        OpenHashEntry entries[100];
+
+        foreach (i, 100) {
+            entries[i].key = i;
+            table.add(&entries[i]);
+        }
+
+        int seen = 0;
+        OpenHashTestTable::Iterator iter(table);
+        OpenHashEntry* entry;
+        while ((entry = iter.next())) {
+            seen++;
+            if (entry->key % 2) table.remove(entry);
+        }
+        EXPECT_EQ(100, seen);
+        EXPECT_EQ(50, table.count);
+
+        foreach (i, 100)
+            EXPECT_EQ((i % 2) == 0, table.get(i) != NULL);
+
+        /* Tombstones are reused, then dropped when it grows */
+        foreach (i, 100) {
+            if (i % 2) table.add(&entries[i]);
+        }
+        EXPECT_EQ(100, table.count);
+        foreach (i, 100)
+            EXPECT_EQ(&entries[i], table.get(i));
+
+        table.clear();
+        EXPECT_EQ(0, table.count);
+        EXPECT_TRUE(table.get(2) == NULL);
+    }
+
+    struct SignalBase {
+        int count;
+        SignalBase() : count(0) { }
+        virtual ~SignalBase() { }
+        virtual bool wakeup(void *arg) = 0;
+    };
+
+    struct SignalTarget : public SignalBase {
+        bool wakeup(void *arg) { count += (int)(W64)arg; return true; }
+        bool reject(void *arg) { count--; return false; }
+    };
+
+    int signal_fun_count;
+
+    bool signal_fun(void *arg)
+    {
+        signal_fun_count += (int)(W64)arg;
+        return true;
+    }
+
+    TEST(StateList, MemberScanOldestFirst)
+    {
+        StateList list("scan");
+        list.track_members(128);
+
+        int members[] = {3, 64, 70, 100, 127};
+        foreach (i, lengthof(members))
+            list.mark(members[i]);
+
+        /* Queue head at 70: 70 100 127 then wrap to 3 64 */
+        int expected[] = {70, 100, 127, 3, 64};
+        int n = 0;
+        foreach_state_member(list, 70, i) {
+            ASSERT_LT(n, 5);
+            EXPECT_EQ(expected[n], i);
+            n++;
+            /* Leaving the list while visited is fine */
+            list.unmark(i);
+        }
+        EXPECT_EQ(5, n);
+
+        foreach_state_member(list, 0, j) {
+            ADD_FAILURE() << "member " << j << " left behind";
+        }
+
+        list.mark(5);
+        list.reset();
+        EXPECT_FALSE(list.marked(5));
+    }
+
+    TEST(Signal, Callbacks)
+    {
+        SignalTarget target;
+        Signal member("member");
+        Signal virt("virtual");
+        Signal fun("function");
+
+        member.connect(signal_mem_ptr(target, &SignalTarget::reject));
+        virt.connect(signal_mem_ptr((SignalBase&)target,
+                    &SignalBase::wakeup));
+        signal_fun_count = 0;
+        fun.connect(signal_fun_ptr(signal_fun));
+
+        EXPECT_FALSE(member.emit(NULL));
+        EXPECT_EQ(-1, target.count);
+        EXPECT_TRUE(virt.emit((void*)5));
+        EXPECT_EQ(4, target.count);
+        EXPECT_TRUE(fun.emit((void*)3));
+        EXPECT_EQ(3, signal_fun_count);
+    }
+
+    TEST(Signal, NamesAreCopied)
+    {
+        Signal a, b;
+        stringbuf name;
+
+        name << "core0-run-cycle";
+        a.set_name(name.buf);
+        name.reset();
+        name << "core1-run-cycle";
+        b.set_name(name.buf);
+
+        EXPECT_STREQ("core0-run-cycle", a.get_name());
+        EXPECT_STREQ("core1-run-cycle", b.get_name());
+
+        /* Same names share one copy */
+        Signal c("core0-run-cycle");
+        EXPECT_EQ(a.get_name(), c.get_name());
+    }
+
+    TEST(Stringbuf, CopyAndGrow)
+    {
+        stringbuf a;
+        foreach (i, 100) a << "0123456789";
+
+        stringbuf b(a);
+        EXPECT_EQ(1000, b.size());
+        EXPECT_TRUE(b == a);
+        EXPECT_NE(a.buf, b.buf);
+
+        stringbuf c = a.strip();
+        EXPECT_EQ(1000, c.size());
+
+        stringbuf d;
+        d << "  -run \n";
+        stringbuf e = d.strip();
+        EXPECT_STREQ("-run", e.buf);
+        EXPECT_EQ(4, e.size());
+    }
+
+    TEST(Stringbuf, ArenaBacked)
+    {
+        StringArena arena(4096);
+
+        {
+            stringbuf s(&arena);
+            s << "short";
+            EXPECT_EQ(s.smallbuf, s.buf);
+            EXPECT_EQ(0U, arena.allocated);
+
+            foreach (i, 100) s << "0123456789";
+            EXPECT_EQ(1005, s.size());
+            EXPECT_NE(s.smallbuf, s.buf);
+            EXPECT_GT(arena.allocated, 1005U);
+
+            /* Larger than a chunk */
+            stringbuf big(&arena);
+            big.reserve(10000);
+            big << s;
+            EXPECT_TRUE(big == s);
+        }
+
+        const char *copy = arena.strdup("core0-run-cycle");
+        EXPECT_STREQ("core0-run-cycle", copy);
+        EXPECT_EQ(0, (Waddr)copy & 7);
+
+        arena.reset();
+        EXPECT_EQ(0U, arena.allocated);
+    }
 };
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <pagewalk.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(SecondLevelTLB, ProbeInsert)
+    {
+        SecondLevelTLB<16, 4> stlb;
+
+        EXPECT_FALSE(stlb.probe(0x7f001234, 0));
+        stlb.insert(0x7f001234, 0);
+        EXPECT_TRUE(stlb.probe(0x7f001ff8, 0));
+        EXPECT_FALSE(stlb.probe(0x7f001234, 1));
+        EXPECT_FALSE(stlb.probe(0x7f002000, 0));
+
+        /* Fifth page of one set evicts one of first four */
+        foreach (i, 5) {
+            stlb.insert(W64(i) << 16, 0);
+        }
+        int present = 0;
+        foreach (i, 5) {
+            present += stlb.probe(W64(i) << 16, 0);
+        }
+        EXPECT_EQ(4, present);
+    }
+
+    TEST(SecondLevelTLB, Flush)
+    {
+        SecondLevelTLB<16, 4> stlb;
+
+        stlb.insert(0x1000, 0);
+        stlb.insert(0x2000, 0);
+        stlb.insert(0x1000, 1);
+
+        EXPECT_EQ(1, stlb.flush_virt(0x1000, 0));
+        EXPECT_FALSE(stlb.probe(0x1000, 0));
+        EXPECT_TRUE(stlb.probe(0x1000, 1));
+
+        EXPECT_EQ(1, stlb.flush_thread(1));
+        EXPECT_FALSE(stlb.probe(0x1000, 1));
+        EXPECT_TRUE(stlb.probe(0x2000, 0));
+
+        stlb.flush_all();
+        EXPECT_FALSE(stlb.probe(0x2000, 0));
+    }
+
+    TEST(SecondLevelTLB, Disabled)
+    {
+        SecondLevelTLB<0, 4> stlb;
+
+        stlb.insert(0x1000, 0);
+        EXPECT_FALSE(stlb.probe(0x1000, 0));
+    }
+
+    TEST(LargePageTLBs, Reach)
+    {
+        LargePageTLBs<4, 2> tlb;
+        W64 addr = 0x40000000ULL + (3 << 21) + 0x1234;
+
+        EXPECT_TRUE(tlb.insert(addr, 0, 21));
+        EXPECT_TRUE(tlb.probe(addr + 0x100000, 0));
+        EXPECT_FALSE(tlb.probe(addr + (1 << 21), 0));
+        EXPECT_FALSE(tlb.probe(addr, 1));
+
+        EXPECT_TRUE(tlb.insert(0x80000000ULL, 0, 30));
+        EXPECT_TRUE(tlb.probe(0x80000000ULL + 0x3ff00000, 0));
+
+        /* 4KB pages are left to caller */
+        EXPECT_FALSE(tlb.insert(0x1000, 0, 12));
+        EXPECT_FALSE(tlb.probe(0x1000, 0));
+
+        EXPECT_EQ(1, tlb.flush_virt(addr, 0));
+        EXPECT_FALSE(tlb.probe(addr, 0));
+        EXPECT_EQ(1, tlb.flush_thread(0));
+        EXPECT_FALSE(tlb.probe(0x80000000ULL, 0));
+    }
+
+    TEST(LargePageTLBs, Fallback)
+    {
+        LargePageTLBs<4, 0> tlb2m;
+        LargePageTLBs<0, 0> none;
+
+        /* 1GB page without 1GB array uses a 2MB entry */
+        EXPECT_TRUE(tlb2m.insert(0x40000000ULL, 0, 30));
+        EXPECT_TRUE(tlb2m.probe(0x40100000ULL, 0));
+        EXPECT_FALSE(tlb2m.probe(0x40200000ULL, 0));
+
+        EXPECT_FALSE(none.insert(0x40000000ULL, 0, 21));
+        EXPECT_FALSE(none.probe(0x40000000ULL, 0));
+    }
+
+    TEST(PageWalkCache, StartLevel)
+    {
+        PageWalkCache<8> pwc;
+        W64 addr = 0x7fff12345000ULL;
+
+        EXPECT_EQ(4, pwc.start_level(addr, 0, 4));
+
+        pwc.fill(addr, 0, 4);
+
+        /* Same 2MB region only needs the leaf PTE */
+        EXPECT_EQ(1, pwc.start_level(addr + 0x1000, 0, 4));
+        /* Same 1GB region, other 2MB region needs PD entry */
+        EXPECT_EQ(2, pwc.start_level(addr + (1 << 21), 0, 4));
+        /* Same 512GB region needs PDP and PD entries */
+        EXPECT_EQ(3, pwc.start_level(addr + (1ULL << 30), 0, 4));
+        /* Other thread walks from root */
+        EXPECT_EQ(4, pwc.start_level(addr, 1, 4));
+    }
+
+    TEST(PageWalkCache, Flush)
+    {
+        PageWalkCache<8> pwc;
+        W64 addr = 0x40201000;
+
+        pwc.fill(addr, 0, 3);
+        pwc.fill(addr, 1, 3);
+        EXPECT_EQ(1, pwc.start_level(addr, 0, 3));
+
+        EXPECT_EQ(2, pwc.flush_virt(addr, 0, 3));
+        EXPECT_EQ(3, pwc.start_level(addr, 0, 3));
+        EXPECT_EQ(1, pwc.start_level(addr, 1, 3));
+
+        EXPECT_EQ(2, pwc.flush_thread(1));
+        EXPECT_EQ(3, pwc.start_level(addr, 1, 3));
+    }
+
+    TEST(TLBAddressSpaces, RootsKeepTheirIds)
+    {
+        TLBAddressSpaces spaces;
+        spaces.setup(2);
+
+        EXPECT_FALSE(spaces.switch_to(0x1000));
+        W8 first = spaces.tlb_id(3);
+        EXPECT_EQ(3, first & TLB_THREAD_MASK);
+
+        EXPECT_FALSE(spaces.switch_to(0x2000));
+        W8 second = spaces.tlb_id(3);
+        EXPECT_NE(first, second);
+
+        EXPECT_TRUE(spaces.switch_to(0x1000));
+        EXPECT_EQ(first, spaces.tlb_id(3));
+        EXPECT_EQ(0x1000, spaces.root());
+
+        /* Third root takes the id of the least recently used one */
+        EXPECT_FALSE(spaces.switch_to(0x3000));
+        EXPECT_EQ(second, spaces.tlb_id(3));
+        EXPECT_TRUE(spaces.switch_to(0x1000));
+        EXPECT_FALSE(spaces.switch_to(0x2000));
+    }
+
+    TEST(TLBAddressSpaces, FlushOneSpace)
+    {
+        SecondLevelTLB<16, 4> stlb;
+        PageWalkCache<8> pwc;
+        W8 space0 = 1;
+        W8 space1 = 1 | (1 << TLB_THREAD_BITS);
+        W64 addr = 0x40201000;
+
+        stlb.insert(addr, space0);
+        stlb.insert(addr, space1);
+        stlb.insert(addr, 2);
+        pwc.fill(addr, space0, 3);
+        pwc.fill(addr, space1, 3);
+
+        /* Entries of the other address space survive */
+        EXPECT_EQ(1, stlb.flush_thread(space1, TLB_ID_MASK));
+        EXPECT_TRUE(stlb.probe(addr, space0));
+        EXPECT_FALSE(stlb.probe(addr, space1));
+        EXPECT_EQ(2, pwc.flush_thread(space1, TLB_ID_MASK));
+        EXPECT_EQ(1, pwc.start_level(addr, space0, 3));
+
+        /* Thread flush drops all of its address spaces, not other threads */
+        stlb.insert(addr, space1);
+        EXPECT_EQ(2, stlb.flush_thread(1));
+        EXPECT_TRUE(stlb.probe(addr, 2));
+    }
+
+    TEST(PageWalkCache, Disabled)
+    {
+        PageWalkCache<0> pwc;
+
+        pwc.fill(0x1000, 0, 4);
+        EXPECT_EQ(4, pwc.start_level(0x1000, 0, 4));
+    }
+};
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <pcprofile.h>
+
+using namespace Core;
+using namespace Memory;
+
+namespace {
+
+    TEST(PcProfile, CountsMissesByLevel)
+    {
+        PcProfileTable table;
+
+        table.access(0x1000);
+        table.complete(0x1000, L1_D_CACHE, 3);
+        table.access(0x1000);
+        table.complete(0x1000, L2_CACHE, 12);
+        table.access(0x1000);
+        table.complete(0x1000, MAIN_MEMORY, 201);
+        table.dtlb_miss(0x1000);
+
+        PcProfileEntry& e = table.lookup(0x1000);
+        EXPECT_EQ(3U, e.accesses);
+        EXPECT_EQ(2U, e.l1_misses);
+        EXPECT_EQ(1U, e.l2_misses);
+        EXPECT_EQ(1U, e.llc_misses);
+        EXPECT_EQ(1U, e.dtlb_misses);
+        EXPECT_EQ(72U, e.avg_latency());
+        EXPECT_EQ(201U, e.max_latency);
+        EXPECT_EQ(0U, table.evictions);
+    }
+
+    TEST(PcProfile, ReplacesFewestAccesses)
+    {
+        PcProfileTable table;
+
+        /* Same set: the hash of these rips only differs above the index */
+        W64 rips[PcProfileTable::WAYS + 1];
+        foreach (i, PcProfileTable::WAYS + 1)
+            rips[i] = 0x1000 + i * (W64(PcProfileTable::SETS) << 24);
+
+        foreach (i, PcProfileTable::WAYS) {
+            foreach (j, 10 - i) table.access(rips[i]);
+        }
+
+        table.access(rips[PcProfileTable::WAYS]);
+        EXPECT_EQ(1U, table.evictions);
+
+        /* The way with 7 accesses was replaced */
+        EXPECT_EQ(10U, table.lookup(rips[0]).accesses);
+        EXPECT_EQ(1U, table.lookup(rips[PcProfileTable::WAYS]).accesses);
+        EXPECT_EQ(1U, table.evictions);
+    }
+
+    TEST(PcProfile, TopByTotalLatency)
+    {
+        PcProfileTable table;
+
+        table.complete(0x1000, L1_D_CACHE, 4);
+        table.complete(0x2000, MAIN_MEMORY, 300);
+        table.complete(0x3000, L2_CACHE, 20);
+        table.complete(0x3000, L2_CACHE, 20);
+
+        PcProfileEntry *top[2];
+        ASSERT_EQ(2, table.top(top, 2));
+        EXPECT_EQ(0x2000U, top[0]->rip);
+        EXPECT_EQ(0x3000U, top[1]->rip);
+
+        PcProfileEntry *all[8];
+        EXPECT_EQ(3, table.top(all, 8));
+    }
+};
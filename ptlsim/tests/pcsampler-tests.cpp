@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#define DISABLE_ASSERT
+
+#include <pcsampler.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(FoldedStacks, CountsSameStackOnce)
+    {
+        FoldedStacks stacks;
+        W64 a[] = {0x400a10, 0x400c34};
+        W64 b[] = {0x400a10, 0x400d00};
+
+        EXPECT_TRUE(stacks.add(0x1000, a, 2));
+        EXPECT_TRUE(stacks.add(0x1000, a, 2));
+        EXPECT_TRUE(stacks.add(0x1000, b, 2));
+        EXPECT_TRUE(stacks.add(0x2000, a, 2));
+        EXPECT_TRUE(stacks.add(0x1000, a, 1));
+
+        EXPECT_EQ(4, stacks.stacks);
+        EXPECT_EQ(W64(5), stacks.samples);
+        EXPECT_EQ(W64(0), stacks.dropped);
+
+        FoldedStacks::Entry *e = stacks.table.get(FoldedStacks::hash_of(0x1000, a, 2));
+        ASSERT_TRUE(e != NULL);
+        EXPECT_EQ(W64(2), e->count);
+    }
+
+    TEST(FoldedStacks, DropsPastLimit)
+    {
+        FoldedStacks stacks;
+        stacks.limit = 1;
+        W64 a[] = {0x400a10};
+        W64 b[] = {0x400d00};
+
+        EXPECT_TRUE(stacks.add(0x1000, a, 1));
+        EXPECT_FALSE(stacks.add(0x1000, b, 1));
+        EXPECT_TRUE(stacks.add(0x1000, a, 1));
+
+        EXPECT_EQ(1, stacks.stacks);
+        EXPECT_EQ(W64(3), stacks.samples);
+        EXPECT_EQ(W64(1), stacks.dropped);
+
+        stacks.reset();
+        EXPECT_EQ(0, stacks.stacks);
+        EXPECT_EQ(0, stacks.frames.length);
+    }
+
+    TEST(FoldedStacks, WritesRootFirst)
+    {
+        FoldedStacks stacks;
+        W64 a[] = {0x30, 0x20, 0x10};
+        stacks.add(0x1000, a, 3);
+        stacks.add(0x1000, a, 3);
+
+        std::ostringstream os;
+        stacks.write(os);
+        EXPECT_EQ(std::string("cr3_0000000000001000;0x0000000000000010;"
+                    "0x0000000000000020;0x0000000000000030 2\n"), os.str());
+    }
+};
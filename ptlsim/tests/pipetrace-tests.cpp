@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <pipetrace.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(PipeTrace, CycleWindow)
+    {
+        PipeTraceWindow window;
+        window.setup(true, 100, PipeTraceWindow::NO_RIP, 50);
+
+        window.clock(99);
+        EXPECT_FALSE(window.active);
+        window.clock(100);
+        EXPECT_TRUE(window.active);
+        window.clock(149);
+        EXPECT_TRUE(window.active);
+        window.clock(150);
+        EXPECT_FALSE(window.active);
+
+        /* Opens only once */
+        window.clock(200);
+        EXPECT_FALSE(window.active);
+
+        /* Same options keep the closed window */
+        window.setup(true, 100, PipeTraceWindow::NO_RIP, 50);
+        window.clock(201);
+        EXPECT_FALSE(window.active);
+    }
+
+    TEST(PipeTrace, RipWindow)
+    {
+        PipeTraceWindow window;
+        window.setup(true, 10, 0x401000, 0);
+
+        window.clock(20);
+        window.fetch(0x401000, 5);
+        EXPECT_FALSE(window.active);
+        window.fetch(0x400ff0, 20);
+        EXPECT_FALSE(window.active);
+        window.fetch(0x401000, 20);
+        EXPECT_TRUE(window.active);
+
+        /* No length: stays open */
+        window.clock(1000000);
+        EXPECT_TRUE(window.active);
+    }
+
+    TEST(PipeTrace, DisabledNeverOpens)
+    {
+        PipeTraceWindow window;
+        window.clock(0);
+        window.fetch(PipeTraceWindow::NO_RIP, 0);
+        EXPECT_FALSE(window.active);
+    }
+
+    TEST(PipeTrace, PacksUopName)
+    {
+        EXPECT_EQ(0x646461U, pipe_trace_name("add"));
+        EXPECT_EQ(pipe_trace_name("collcc.x"), pipe_trace_name("collcc.xyz"));
+    }
+};
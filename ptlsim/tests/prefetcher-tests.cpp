@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+#include <memoryRequest.h>
+#include <prefetcher.h>
+#include <machine.h>
+
+using namespace Memory;
+
+namespace {
+
+    class PrefetcherTest : public ::testing::Test {
+        public:
+            BaseMachine *machine;
+            MemoryRequest request;
+            dynarray<W64> lines;
+
+            PrefetcherTest()
+            {
+                machine = (BaseMachine*)(PTLsimMachine::getmachine("base"));
+
+                const char *names[] = {"pf_next", "pf_stride", "pf_stream"};
+                foreach (i, 3) {
+                    machine->add_option(names[i], "prefetch_degree", 2);
+                    machine->add_option(names[i], "prefetch_distance", 1);
+                }
+                machine->add_option("pf_stream", "prefetcher", "stream");
+            }
+
+            /* Train with an access to given 64 byte line */
+            void train(Prefetcher &pf, W64 line, bool miss,
+                    bool prefetchHit = false, W64 rip = 0x401000)
+            {
+                request.init(0, 0, line << 6, 0, 0, false, rip, 1,
+                        MEMORY_OP_READ);
+                lines.clear();
+                pf.train(&request, miss, prefetchHit, lines);
+            }
+    };
+
+    TEST_F(PrefetcherTest, NextLine)
+    {
+        NextLinePrefetcher pf("pf_next", *machine, 6);
+
+        train(pf, 100, true);
+        ASSERT_EQ(2, lines.count());
+        ASSERT_EQ(W64(101), lines[0]);
+        ASSERT_EQ(W64(102), lines[1]);
+
+        /* Plain hits don't trigger, hits on prefetched lines do */
+        train(pf, 101, false);
+        ASSERT_EQ(0, lines.count());
+        train(pf, 101, false, true);
+        ASSERT_EQ(2, lines.count());
+
+        /* Nothing beyond the 4KB page */
+        train(pf, 63, true);
+        ASSERT_EQ(0, lines.count());
+        train(pf, 126, true);
+        ASSERT_EQ(1, lines.count());
+        ASSERT_EQ(W64(127), lines[0]);
+    }
+
+    TEST_F(PrefetcherTest, Stride)
+    {
+        StridePrefetcher pf("pf_stride", *machine, 6);
+
+        train(pf, 0, true);
+        ASSERT_EQ(0, lines.count());
+        train(pf, 3, true);
+        ASSERT_EQ(0, lines.count());
+
+        /* Stride confirmed */
+        train(pf, 6, false);
+        ASSERT_EQ(2, lines.count());
+        ASSERT_EQ(W64(9), lines[0]);
+        ASSERT_EQ(W64(12), lines[1]);
+
+        /* Another instruction has its own entry */
+        train(pf, 40, true, false, 0x402000);
+        ASSERT_EQ(0, lines.count());
+
+        /* Negative strides */
+        train(pf, 36, true, false, 0x402000);
+        train(pf, 32, true, false, 0x402000);
+        ASSERT_EQ(2, lines.count());
+        ASSERT_EQ(W64(28), lines[0]);
+        ASSERT_EQ(W64(24), lines[1]);
+    }
+
+    TEST_F(PrefetcherTest, Stream)
+    {
+        Prefetcher *pf = PrefetcherBuilder::create("pf_stream", *machine, 6);
+        ASSERT_TRUE(pf != NULL);
+
+        train(*pf, 10, true);
+        train(*pf, 11, true);
+        ASSERT_EQ(0, lines.count());
+
+        /* Direction confirmed */
+        train(*pf, 12, true);
+        ASSERT_EQ(2, lines.count());
+        ASSERT_EQ(W64(13), lines[0]);
+        ASSERT_EQ(W64(14), lines[1]);
+
+        /* Hits on prefetched lines only fetch the new lines */
+        train(*pf, 13, false, true);
+        ASSERT_EQ(1, lines.count());
+        ASSERT_EQ(W64(15), lines[0]);
+
+        /* Misses far from the stream start a new one */
+        train(*pf, 50, true);
+        ASSERT_EQ(0, lines.count());
+        train(*pf, 49, true);
+        train(*pf, 48, true);
+        ASSERT_EQ(2, lines.count());
+        ASSERT_EQ(W64(47), lines[0]);
+        ASSERT_EQ(W64(46), lines[1]);
+
+        delete pf;
+    }
+};
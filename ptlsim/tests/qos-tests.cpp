@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <memoryRequest.h>
+#include <cacheLines.h>
+#include <qos.h>
+
+using namespace Memory;
+
+namespace {
+
+    struct QosTest : public ::testing::Test {
+        void SetUp() { qos.reset(); }
+        void TearDown() { qos.reset(); }
+    };
+
+    /* With all ways in the mask, masked victims are the plain ones */
+    template <typename POLICY>
+    void same_victims_with_full_mask(W64 all)
+    {
+        POLICY plain, masked;
+        plain.reset();
+        masked.reset();
+
+        W64 seed = 777;
+        foreach (i, 5000) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            int set = (seed >> 30) & 3;
+            int way = (seed >> 40) & 7;
+
+            if ((seed >> 8) & 1) {
+                plain.touch(set, way);
+                masked.touch(set, way);
+            } else {
+                int victim = plain.victim(set);
+                ASSERT_EQ(victim, masked.victim(set, all));
+                plain.inserted(set, victim, true);
+                masked.inserted(set, victim, true);
+            }
+        }
+    }
+
+    TEST_F(QosTest, FullMaskIsUnpartitioned)
+    {
+        same_victims_with_full_mask<BitPLRU<4, 8> >(0xff);
+        same_victims_with_full_mask<TreePLRU<4, 8> >(0xff);
+        same_victims_with_full_mask<SRRIP<4, 8> >(0xff);
+    }
+
+    /* Fills of a masked class only ever take its ways */
+    template <typename POLICY>
+    void victims_stay_in_mask(W64 mask)
+    {
+        POLICY policy;
+        policy.reset();
+
+        int seen = 0;
+        foreach (i, 64) {
+            int way = policy.victim(0, mask);
+            ASSERT_TRUE(bit(mask, way)) << "way " << way;
+            seen |= 1 << way;
+            policy.inserted(0, way, true);
+            policy.touch(0, (i * 5) & 7);
+        }
+        EXPECT_EQ(W64(seen), mask);
+    }
+
+    TEST_F(QosTest, VictimsStayInMask)
+    {
+        victims_stay_in_mask<BitPLRU<1, 8> >(0x0c);
+        victims_stay_in_mask<BitPLRU<1, 8> >(0x81);
+        victims_stay_in_mask<TreePLRU<1, 8> >(0x0c);
+        victims_stay_in_mask<TreePLRU<1, 8> >(0x81);
+        victims_stay_in_mask<SRRIP<1, 8> >(0x0c);
+        victims_stay_in_mask<DRRIP<1, 8> >(0x81);
+    }
+
+    TEST_F(QosTest, RRIPAgesOnlyMaskedWays)
+    {
+        SRRIP<1, 4> rrip;
+        rrip.reset();
+
+        foreach (way, 4) rrip.touch(0, way);
+        EXPECT_EQ(2, rrip.victim(0, 0x4));
+        EXPECT_EQ(3, rrip.rrpv(0, 2));
+        EXPECT_EQ(0, rrip.rrpv(0, 0));
+        EXPECT_EQ(0, rrip.rrpv(0, 3));
+    }
+
+    /*
+     * Core 1 streams through a cache that core 0 filled, with two ways of
+     * four each: core 0 keeps its lines in the other two.
+     */
+    template <typename LINES>
+    void partition_protects_lines()
+    {
+        qos.set_clos(1, 1);
+        qos.set_ways(0, 0x3);
+        qos.set_ways(1, 0xc);
+
+        LINES *lines = new LINES(2, 1);
+        lines->init();
+        lines->enable_qos();
+
+        MemoryRequest request;
+        W64 oldTag = 0;
+
+        /* 2 lines in each of the 16 sets for core 0 */
+        request.set_coreid(0);
+        foreach (i, 32) {
+            request.set_physical_address(i * 64);
+            CacheLine *line = lines->insert(&request, oldTag);
+            line->state = 1;
+            line->init(lines->tagOf(i * 64));
+        }
+
+        request.set_coreid(1);
+        foreach (i, 1000) {
+            W64 addr = (100 + i) * 64;
+            request.set_physical_address(addr);
+            CacheLine *line = lines->insert(&request, oldTag);
+            line->state = 1;
+            line->init(lines->tagOf(addr));
+        }
+
+        request.set_coreid(0);
+        foreach (i, 32) {
+            request.set_physical_address(i * 64);
+            ASSERT_TRUE(lines->probe(&request) != NULL) << "line " << i;
+        }
+
+        W64 occupancy[QOS_MAX_CLOS] = { 0 };
+        lines->count_clos_lines(occupancy);
+        EXPECT_EQ(32, occupancy[0]);
+        EXPECT_EQ(32, occupancy[1]);
+        EXPECT_EQ(32, qos.classes[0].fills);
+        EXPECT_EQ(1000, qos.classes[1].fills);
+
+        delete lines;
+    }
+
+    TEST_F(QosTest, PartitionProtectsArrayLines)
+    {
+        partition_protects_lines<CacheLines<16, 4, 64, 2> >();
+    }
+
+    TEST_F(QosTest, PartitionProtectsVectorLines)
+    {
+        partition_protects_lines<VectorCacheLines<16, 4, 64, 2> >();
+        qos.reset();
+        partition_protects_lines<VectorCacheLines<16, 4, 64, 2,
+            TreePLRU<16, 4> > >();
+    }
+
+    TEST_F(QosTest, MaskOutsideCacheMeansAllWays)
+    {
+        qos.set_ways(0, 0xf00);
+        EXPECT_EQ(0xf, qos.way_mask(0, 4));
+        EXPECT_EQ(0xf00, qos.way_mask(0, 16));
+
+        /* No core, class 0 */
+        EXPECT_EQ(0, qos.clos_of(-1));
+        EXPECT_FALSE(qos.set_clos(0, QOS_MAX_CLOS));
+        EXPECT_FALSE(qos.set_ways(1, 0));
+    }
+
+    /* DMA only ever takes the IO ways, whatever its core's class */
+    template <typename LINES>
+    void io_fills_stay_in_io_ways()
+    {
+        qos.set_io_ways(0x1);
+
+        LINES *lines = new LINES(2, 1);
+        lines->init();
+        lines->enable_qos();
+
+        MemoryRequest request;
+        W64 oldTag = 0;
+
+        foreach (i, 48) {
+            request.set_physical_address(i * 64);
+            CacheLine *line = lines->insert(&request, oldTag);
+            line->state = 1;
+            line->init(lines->tagOf(i * 64));
+        }
+
+        request.set_io(true);
+        foreach (i, 1000) {
+            W64 addr = (100 + i) * 64;
+            request.set_physical_address(addr);
+            CacheLine *line = lines->insert(&request, oldTag);
+            line->state = 1;
+            line->init(lines->tagOf(addr));
+        }
+
+        /* 3 of the 4 ways of each set kept the core's lines */
+        request.set_io(false);
+        int kept = 0;
+        foreach (i, 48) {
+            request.set_physical_address(i * 64);
+            kept += (lines->probe(&request) != NULL);
+        }
+        EXPECT_EQ(32, kept);
+
+        delete lines;
+    }
+
+    TEST_F(QosTest, IoFillsStayInIoWays)
+    {
+        EXPECT_FALSE(qos.set_io_ways(0));
+        EXPECT_EQ(0xf, qos.way_mask(0, 4, true));
+
+        io_fills_stay_in_io_ways<CacheLines<16, 4, 64, 2> >();
+        qos.reset();
+        io_fills_stay_in_io_ways<VectorCacheLines<16, 4, 64, 2> >();
+
+        /* The other classes keep their own masks */
+        qos.set_ways(0, 0xe);
+        EXPECT_EQ(0xe, qos.way_mask(0, 4));
+        EXPECT_EQ(0x1, qos.way_mask(0, 4, true));
+    }
+
+    TEST_F(QosTest, BandwidthPacesResponses)
+    {
+        /* 64 bytes per 10 cycles at 1GHz */
+        ASSERT_TRUE(qos.set_bandwidth(0, 6400, 1000000000));
+        EXPECT_TRUE(qos.throttled);
+        qos.set_burst(2);
+
+        /* Lines back to back in one cycle: the burst goes through */
+        EXPECT_EQ(0, qos.memory_access(0, 100, true));
+        EXPECT_EQ(0, qos.memory_access(0, 100, true));
+        EXPECT_EQ(0, qos.memory_access(0, 100, true));
+        EXPECT_EQ(10, qos.memory_access(0, 100, true));
+        EXPECT_EQ(20, qos.memory_access(0, 100, true));
+
+        /* Write backs are counted but never wait */
+        EXPECT_EQ(0, qos.memory_access(0, 100, false));
+
+        /* Bucket refills at the rate */
+        EXPECT_EQ(0, qos.memory_access(0, 1000, true));
+
+        EXPECT_EQ(7 * 64, qos.classes[0].memBytes);
+        EXPECT_EQ(2, qos.classes[0].throttled);
+        EXPECT_EQ(30, qos.classes[0].throttleCycles);
+
+        /* Cores of an unthrottled class are not held back */
+        qos.set_clos(1, 1);
+        foreach (i, 10) EXPECT_EQ(0, qos.memory_access(1, 100, true));
+
+        ASSERT_TRUE(qos.set_bandwidth(0, 0, 1000000000));
+        EXPECT_FALSE(qos.throttled);
+        EXPECT_EQ(0, qos.memory_access(0, 100, true));
+    }
+};
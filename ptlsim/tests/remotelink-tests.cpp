@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <unistd.h>
+
+#define DISABLE_ASSERT
+
+#include <memoryHierarchy.h>
+#include <remoteLink.h>
+#include <machine.h>
+
+using namespace Memory;
+using namespace Memory::RemoteLinkInterconnect;
+
+namespace {
+
+    class TestLinkCont : public Controller
+    {
+        public:
+            TestLinkCont(MemoryHierarchy *mem)
+                : Controller(0, "test", mem)
+                , link(NULL)
+                , accept(true)
+                , received(0)
+            {
+                last.init();
+            }
+
+            Interconnect *link;
+            bool accept;
+            int received;
+            Message last;
+
+            bool handle_interconnect_cb(void *arg)
+            {
+                if (!accept)
+                    return false;
+
+                last = *(Message*)arg;
+                received++;
+                return true;
+            }
+
+            bool send(MemoryRequest *request, bool hasData)
+            {
+                Message &msg = *memoryHierarchy_->get_message();
+                msg.sender  = this;
+                msg.request = request;
+                msg.hasData = hasData;
+
+                bool ret = link->get_controller_request_signal()->emit(&msg);
+                memoryHierarchy_->free_message(&msg);
+                return ret;
+            }
+
+            void register_interconnect(Interconnect *interconnect,
+                    int conn_type)
+            {
+                link = interconnect;
+                link->register_controller(this);
+            }
+
+            void print_map(ostream& os) { }
+            void print(ostream& os) const { }
+            bool is_full(bool fromInterconnect, MemoryRequest *request) const
+            {
+                return false;
+            }
+            void annul_request(MemoryRequest *request) { }
+            void dump_configuration(YAML::Emitter &out) const { }
+    };
+
+    class RemoteLinkTest : public ::testing::Test {
+        public:
+            MemoryHierarchy *memA, *memB;
+            RemoteLink *linkA, *linkB;
+            TestLinkCont *contA, *contB;
+
+            RemoteLinkTest()
+            {
+                BaseMachine* machine = (BaseMachine*)(PTLsimMachine::getmachine("base"));
+
+                stringbuf link;
+                link << "gtest_", getpid();
+
+                machine->add_option("rl_a", "link", link.buf);
+                machine->add_option("rl_a", "side", 0);
+                machine->add_option("rl_a", "latency", 5);
+                machine->add_option("rl_b", "link", link.buf);
+                machine->add_option("rl_b", "side", 1);
+                machine->add_option("rl_b", "latency", 5);
+
+                /* Both ends of the link live in this process */
+                memA = new MemoryHierarchy(*machine);
+                memB = new MemoryHierarchy(*machine);
+                linkA = new RemoteLink("rl_a", memA);
+                linkB = new RemoteLink("rl_b", memB);
+
+                contA = new TestLinkCont(memA);
+                contB = new TestLinkCont(memB);
+                contA->register_interconnect(linkA, INTERCONN_TYPE_LOWER);
+                contB->register_interconnect(linkB, INTERCONN_TYPE_UPPER);
+
+                sim_cycle = 0;
+            }
+
+            ~RemoteLinkTest()
+            {
+                delete linkA;
+                delete linkB;
+            }
+
+            MemoryRequest* new_request(OP_TYPE type)
+            {
+                MemoryRequest *request = memA->get_free_request(0);
+                request->init(0, 0, 0x1234540, 0, sim_cycle, false,
+                        0x401000, 7, type);
+                return request;
+            }
+    };
+
+    TEST_F(RemoteLinkTest, RequestResponse)
+    {
+        MemoryRequest *request = new_request(MEMORY_OP_READ);
+        ASSERT_TRUE(contA->send(request, false));
+
+        /* Not delivered before the link latency */
+        sim_cycle = 4;
+        linkB->clock();
+        ASSERT_EQ(0, contB->received);
+
+        sim_cycle = 5;
+        linkB->clock();
+        ASSERT_EQ(1, contB->received);
+
+        MemoryRequest *remote = contB->last.request;
+        ASSERT_NE(request, remote);
+        ASSERT_EQ(W64(0x1234540), remote->get_physical_address());
+        ASSERT_EQ(MEMORY_OP_READ, remote->get_type());
+        ASSERT_EQ(W64(0x401000), remote->get_owner_rip());
+        ASSERT_FALSE(contB->last.hasData);
+
+        /* Response is matched back to the original request */
+        ASSERT_TRUE(contB->send(remote, true));
+
+        sim_cycle = 10;
+        linkA->clock();
+        ASSERT_EQ(1, contA->received);
+        ASSERT_EQ(request, contA->last.request);
+        ASSERT_TRUE(contA->last.hasData);
+    }
+
+    TEST_F(RemoteLinkTest, RetryWhenBusy)
+    {
+        ASSERT_TRUE(contA->send(new_request(MEMORY_OP_UPDATE), true));
+        ASSERT_TRUE(contA->send(new_request(MEMORY_OP_READ), false));
+
+        sim_cycle = 5;
+        contB->accept = false;
+        linkB->clock();
+        ASSERT_EQ(0, contB->received);
+
+        /* Both packets are delivered in order once accepted */
+        sim_cycle = 6;
+        contB->accept = true;
+        linkB->clock();
+        ASSERT_EQ(2, contB->received);
+        ASSERT_EQ(MEMORY_OP_READ, contB->last.request->get_type());
+    }
+
+    TEST_F(RemoteLinkTest, AnnuledResponse)
+    {
+        MemoryRequest *request = new_request(MEMORY_OP_READ);
+        ASSERT_TRUE(contA->send(request, false));
+        linkA->annul_request(request);
+
+        sim_cycle = 5;
+        linkB->clock();
+        ASSERT_TRUE(contB->send(contB->last.request, true));
+
+        sim_cycle = 10;
+        linkA->clock();
+        ASSERT_EQ(0, contA->received);
+    }
+};
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <memoryRequest.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(RequestLatency, HopsKeepFirstArrival)
+    {
+        RequestHops hops;
+        hops.reset();
+
+        hops.record(3, 0);
+        hops.record(7, 4);
+        /* Response passing the same interconnect again */
+        hops.record(3, 40);
+        hops.record(9, 12);
+
+        ASSERT_EQ(3, hops.count);
+        ASSERT_EQ(3, hops.component[0]);
+        ASSERT_EQ(7, hops.component[1]);
+        ASSERT_EQ(9, hops.component[2]);
+        ASSERT_EQ(0U, hops.arrive[0]);
+        ASSERT_EQ(4U, hops.arrive[1]);
+        ASSERT_EQ(12U, hops.arrive[2]);
+
+        /* Extra components past the limit are dropped */
+        hops.reset();
+        foreach (i, REQUEST_MAX_HOPS + 4)
+            hops.record(W16(i), W32(i));
+        ASSERT_EQ(REQUEST_MAX_HOPS, hops.count);
+        ASSERT_EQ(REQUEST_MAX_HOPS - 1,
+                hops.component[REQUEST_MAX_HOPS - 1]);
+    }
+
+};
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <sampling.h>
+
+namespace {
+
+    TEST(SampleEstimate, Empty)
+    {
+        SampleEstimate est;
+
+        EXPECT_EQ(0, est.count);
+        EXPECT_DOUBLE_EQ(0, est.mean());
+        EXPECT_DOUBLE_EQ(0, est.half_width(3.0));
+        EXPECT_DOUBLE_EQ(1.0, est.relative_error(3.0));
+    }
+
+    TEST(SampleEstimate, MeanAndInterval)
+    {
+        SampleEstimate est;
+        double samples[] = {1.0, 2.0, 3.0, 4.0};
+
+        foreach (i, 4) {
+            est.add(samples[i]);
+        }
+
+        EXPECT_EQ(4, est.count);
+        EXPECT_DOUBLE_EQ(2.5, est.mean());
+
+        /* Sample variance of 1..4 is 5/3 */
+        EXPECT_NEAR(sqrt(5.0 / 3.0), est.stddev(), 1e-9);
+        EXPECT_NEAR(2.0 * sqrt(5.0 / 3.0) / 2.0, est.half_width(2.0), 1e-9);
+        EXPECT_NEAR(est.half_width(2.0) / 2.5, est.relative_error(2.0), 1e-9);
+    }
+
+    TEST(SampleEstimate, IntervalShrinks)
+    {
+        SampleEstimate est;
+        double last = 0;
+
+        foreach (i, 100) {
+            est.add((i % 2) ? 1.5 : 0.5);
+
+            if(i == 9)
+                last = est.half_width(3.0);
+        }
+
+        EXPECT_DOUBLE_EQ(1.0, est.mean());
+        EXPECT_LT(est.half_width(3.0), last);
+
+        est.reset();
+        EXPECT_EQ(0, est.count);
+    }
+
+    TEST(SampleController, Converged)
+    {
+        SampleController ctl;
+        PTLsimConfig sample_config;
+
+        sample_config.sample_min_windows = 4;
+        sample_config.sample_error = 0.05;
+        sample_config.sample_zscore = 3.0;
+
+        foreach (i, 3) {
+            ctl.ipc.add(1.0);
+        }
+        EXPECT_FALSE(ctl.converged(sample_config));
+
+        ctl.ipc.add(1.0);
+        EXPECT_TRUE(ctl.converged(sample_config));
+
+        /* Zero error never stops simulation */
+        sample_config.sample_error = 0;
+        EXPECT_FALSE(ctl.converged(sample_config));
+
+        sample_config.sample_error = 0.05;
+        ctl.ipc.add(2.0);
+        EXPECT_FALSE(ctl.converged(sample_config));
+    }
+};
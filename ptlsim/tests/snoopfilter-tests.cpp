@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <snoopFilter.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(SnoopFilter, DisabledByDefault)
+    {
+        SnoopFilter filter;
+        EXPECT_FALSE(filter.enabled());
+        EXPECT_TRUE(filter.find(0x10) == NULL);
+
+        filter.setup(64, 8, 64);
+        EXPECT_TRUE(filter.enabled());
+        EXPECT_EQ(8, filter.sets);
+        EXPECT_EQ(W64(0x1000 >> 6), filter.get_line(0x1000 + 63));
+    }
+
+    TEST(SnoopFilter, NewLinesMayBeAnywhere)
+    {
+        SnoopFilter filter;
+        filter.setup(64, 8, 64);
+
+        bool replaced = true;
+        SnoopFilter::Entry *entry = filter.track(0x10, replaced);
+        EXPECT_FALSE(replaced);
+        EXPECT_EQ(W64(-1), entry->sharers);
+
+        entry->sharers = 1 << 2;
+        EXPECT_EQ(entry, filter.find(0x10));
+        EXPECT_EQ(entry, filter.track(0x10, replaced));
+        EXPECT_EQ(W64(1 << 2), entry->sharers);
+
+        /* After a warmup it is untracked again */
+        filter.forget();
+        EXPECT_TRUE(filter.find(0x10) == NULL);
+    }
+
+    TEST(SnoopFilter, ReplacesLeastRecentlyUsed)
+    {
+        SnoopFilter filter;
+        filter.setup(4, 2, 64);
+
+        /* Lines 0, 2 and 4 are all in set 0 */
+        bool replaced;
+        filter.track(0, replaced)->sharers = 1;
+        filter.track(2, replaced)->sharers = 0;
+        filter.find(0);
+
+        filter.track(4, replaced);
+        EXPECT_FALSE(replaced);
+        EXPECT_TRUE(filter.find(2) == NULL);
+        EXPECT_TRUE(filter.find(0) != NULL);
+
+        /* Line 4 was never answered for, it may still be held */
+        filter.track(6, replaced);
+        EXPECT_TRUE(filter.find(4) == NULL);
+        EXPECT_TRUE(replaced);
+        filter.track(8, replaced);
+        EXPECT_TRUE(replaced);
+        EXPECT_TRUE(filter.find(0) == NULL);
+    }
+};
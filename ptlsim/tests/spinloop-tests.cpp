@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <spinloop.h>
+
+using namespace Core;
+
+namespace {
+
+    /* 'pause; cmp [lock], 0; jne 1b' at 0x1000, branch at 0x1008 */
+    struct SpinLoop {
+        SpinLoopDetector spin;
+        W64 regs[SpinLoopDetector::REGS];
+        W64 insns;
+        W64 cycle;
+
+        SpinLoop() : insns(0), cycle(0) {
+            memset(regs, 0, sizeof(regs));
+        }
+
+        bool iteration(W64 lockaddr = 0x8000) {
+            insns += 3;
+            cycle += 20;
+            spin.load(lockaddr);
+            return spin.taken_branch(0x1008, 0x1000, regs, 0x44,
+                    insns, insns + 1, cycle);
+        }
+    };
+
+    TEST(SpinLoop, Detect)
+    {
+        SpinLoop loop;
+
+        /* First iteration has nothing to compare to */
+        foreach (i, SpinLoopDetector::ITERATIONS + 1) {
+            EXPECT_FALSE(loop.spin.waiting);
+            bool spinning = loop.iteration();
+            EXPECT_EQ(i == SpinLoopDetector::ITERATIONS, spinning);
+        }
+
+        EXPECT_EQ(3U, loop.spin.iteration_insns);
+        EXPECT_EQ(20U, loop.spin.iteration_cycles);
+    }
+
+    TEST(SpinLoop, ChangeRestarts)
+    {
+        SpinLoop loop;
+
+        foreach (i, SpinLoopDetector::ITERATIONS) {
+            EXPECT_FALSE(loop.iteration());
+        }
+
+        /* Register changed, e.g. a spin count */
+        loop.regs[1]++;
+        EXPECT_FALSE(loop.iteration());
+        EXPECT_EQ(0, loop.spin.iterations);
+
+        /* Store in the body */
+        EXPECT_FALSE(loop.iteration());
+        loop.spin.store();
+        EXPECT_FALSE(loop.iteration());
+        EXPECT_EQ(0, loop.spin.iterations);
+
+        /* Loads of another line */
+        loop.insns += 1;
+        loop.spin.load(0x9000);
+        EXPECT_FALSE(loop.iteration());
+        EXPECT_EQ(0, loop.spin.iterations);
+
+        /* Forward branches inside the body are ignored */
+        EXPECT_FALSE(loop.iteration());
+        EXPECT_FALSE(loop.iteration());
+        EXPECT_FALSE(loop.spin.taken_branch(0x1004, 0x1010, loop.regs, 0x44,
+                    loop.insns, loop.insns, loop.cycle));
+        EXPECT_EQ(1, loop.spin.iterations);
+    }
+
+    TEST(SpinLoop, Wake)
+    {
+        SpinLoop loop;
+
+        while (!loop.iteration());
+
+        loop.spin.wait(1000);
+        EXPECT_TRUE(loop.spin.watches(0x8010, 64));
+        EXPECT_TRUE(loop.spin.watches(0x8040, 128));
+        EXPECT_FALSE(loop.spin.watches(0x8040, 64));
+
+        EXPECT_EQ(1500U, loop.spin.wake_cycle(false, 500, 1001));
+        EXPECT_EQ(1001U, loop.spin.wake_cycle(true, 500, 1001));
+        loop.spin.woken = 1;
+        EXPECT_FALSE(loop.spin.watches(0x8010, 64));
+        EXPECT_EQ(1001U, loop.spin.wake_cycle(false, 500, 1001));
+
+        /* 10 iterations of 20 cycles and 3 instructions */
+        W64 insns, uops;
+        EXPECT_EQ(210U, loop.spin.wake(1210, insns, uops));
+        EXPECT_EQ(30U, insns);
+        EXPECT_EQ(30U, uops);
+        EXPECT_FALSE(loop.spin.waiting);
+        EXPECT_EQ(0, loop.spin.iterations);
+    }
+};
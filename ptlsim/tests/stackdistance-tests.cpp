@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <stackDistance.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(StackDistance, SetPoints)
+    {
+        StackDistanceProfile profile(64, 6);
+        EXPECT_EQ(16, profile.sets[0]);
+        EXPECT_EQ(64, profile.sets[StackDistanceProfile::BASE_POINT]);
+        EXPECT_EQ(256, profile.sets[StackDistanceProfile::SET_POINTS - 1]);
+
+        StackDistanceProfile tiny(2, 6);
+        EXPECT_EQ(1, tiny.sets[0]);
+        EXPECT_EQ(1, tiny.sets[1]);
+    }
+
+    TEST(StackDistance, CyclicReuseNeedsAllWays)
+    {
+        /* One set: 4 lines touched round robin, 10 times */
+        StackDistanceProfile profile(4, 6);
+        const int base = StackDistanceProfile::BASE_POINT;
+
+        foreach (i, 10) {
+            foreach (j, 4) profile.access(W64(j) * 4 * 64);
+        }
+
+        EXPECT_EQ(40U, profile.accesses);
+
+        /* LRU with fewer ways than lines always misses */
+        EXPECT_EQ(40U, profile.misses(base, 1));
+        EXPECT_EQ(40U, profile.misses(base, 3));
+
+        /* With 4 ways only the first touches miss */
+        EXPECT_EQ(4U, profile.misses(base, 4));
+        EXPECT_EQ(4U, profile.misses(base, 32));
+
+        /* Four times the sets spreads the lines, one way is enough */
+        EXPECT_EQ(4U, profile.misses(base + 2, 1));
+    }
+
+    TEST(StackDistance, DeepReuseMissesEverywhere)
+    {
+        StackDistanceProfile profile(1, 6);
+        const int ways = StackDistanceProfile::MAX_WAYS;
+
+        foreach (i, ways + 1) profile.access(W64(i) * 64);
+        profile.access(0);
+
+        /* Line 0 was pushed out of the bounded stack */
+        EXPECT_EQ(W64(ways + 2), profile.misses(0, ways));
+
+        /* Most recent line is at depth 1 */
+        profile.access(W64(ways) * 64);
+        EXPECT_EQ(W64(ways + 2), profile.misses(0, 2));
+        EXPECT_EQ(W64(ways + 3), profile.misses(0, 1));
+    }
+};
@@ -0,0 +1,56 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <statehash.h>
+
+namespace {
+
+    TEST(StateHash, SameEventsSameRecords) {
+        ASSERT_EQ(48U, sizeof(StateHashRecord));
+
+        StateHash a, b;
+        foreach (i, 100) {
+            a.commit(i, 0, 0x401000 + i, 1);
+            b.commit(i, 0, 0x401000 + i, 1);
+            a.mem_event(i, 2, 0x1000 * i, 0);
+            b.mem_event(i, 2, 0x1000 * i, 0);
+        }
+        a.stat(100);
+        b.stat(100);
+
+        StateHashRecord ra = a.end_epoch(100);
+        StateHashRecord rb = b.end_epoch(100);
+        EXPECT_EQ(0, memcmp(&ra, &rb, sizeof(ra)));
+        EXPECT_EQ(W64(100), ra.commits);
+        EXPECT_EQ(W64(100), ra.mem_events);
+
+        /* Counts start over, the hashes carry on */
+        StateHashRecord next = a.end_epoch(200);
+        EXPECT_EQ(W64(0), next.commits);
+        EXPECT_EQ(ra.commit_hash, next.commit_hash);
+    }
+
+    TEST(StateHash, DivergenceStaysVisible) {
+        StateHash a, b;
+        a.mem_event(10, 1, 0x2000, 0);
+        a.mem_event(11, 1, 0x2040, 0);
+
+        /* Same events one cycle apart, then in the other order */
+        b.mem_event(10, 1, 0x2000, 0);
+        b.mem_event(12, 1, 0x2040, 0);
+        EXPECT_NE(a.mem_hash, b.mem_hash);
+
+        StateHash c;
+        c.mem_event(11, 1, 0x2040, 0);
+        c.mem_event(10, 1, 0x2000, 0);
+        EXPECT_NE(a.mem_hash, c.mem_hash);
+
+        /* Later matching events don't bring the hashes back together */
+        a.mem_event(20, 3, 0x3000, 1);
+        b.mem_event(20, 3, 0x3000, 1);
+        EXPECT_NE(a.mem_hash, b.mem_hash);
+        EXPECT_EQ(a.commit_hash, b.commit_hash);
+    }
+};
@@ -0,0 +1,124 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <statsBuilder.h>
+#include <statFormula.h>
+
+namespace {
+
+    class FormulaStat : public Statable {
+        public:
+            StatObj<W64> insns;
+            StatObj<W64> cycles;
+            StatObj<double> power;
+            StatArray<W64, 2> hits;
+            StatEquation<W64, W64, StatObjFormulaAdd> total;
+
+            FormulaStat() : Statable("formula_core")
+                            , insns("insns", this)
+                            , cycles("cycles", this)
+                            , power("power", this)
+                            , hits("hits", this)
+                            , total("total", this)
+            {
+                total.add_elem(&insns);
+                total.add_elem(&cycles);
+            }
+    };
+
+    FormulaStat *formula_stat;
+
+    StatFormula* formula(const char *expression)
+    {
+        if (!formula_stat)
+            formula_stat = new FormulaStat();
+
+        static int count = 0;
+        stringbuf name;
+        name << "f" << count++;
+        return StatsBuilder::get().add_formula(name.buf, expression);
+    }
+
+    double value(StatFormula *f, Stats *stats)
+    {
+        double v = 0;
+        f->get_number(stats, v);
+        return v;
+    }
+
+    TEST(StatFormula, Evaluates)
+    {
+        StatFormula *ipc = formula("formula_core:insns / formula_core:cycles");
+        StatFormula *expr = formula(
+                "-(formula_core:insns + 2) * 3 - formula_core:power / 2");
+        StatFormula *derived = formula("formula_core:total + 1");
+        ASSERT_TRUE(StatsBuilder::get().compile_formulas());
+
+        Stats *stats = StatsBuilder::get().get_new_stats();
+        formula_stat->insns(stats) = 300;
+        formula_stat->cycles(stats) = 200;
+        formula_stat->power(stats) = 5.0;
+
+        ASSERT_DOUBLE_EQ(1.5, value(ipc, stats));
+        ASSERT_DOUBLE_EQ(-908.5, value(expr, stats));
+        ASSERT_DOUBLE_EQ(501, value(derived, stats));
+
+        /* Outside a snapshot it follows the counters */
+        formula_stat->cycles(stats) = 0;
+        ASSERT_DOUBLE_EQ(0, value(ipc, stats));
+
+        delete stats;
+    }
+
+    TEST(StatFormula, CachedPerSnapshot)
+    {
+        StatFormula *sum = formula("formula_core:insns + formula_core:cycles");
+        StatFormula *twice = formula("f_missing + 1");
+        ASSERT_FALSE(StatsBuilder::get().compile_formulas());
+        ASSERT_FALSE(twice->is_compiled());
+
+        Stats *stats = StatsBuilder::get().get_new_stats();
+        formula_stat->insns(stats) = 1;
+        formula_stat->cycles(stats) = 2;
+
+        {
+            StatsSnapshot snapshot;
+            ASSERT_DOUBLE_EQ(3, value(sum, stats));
+
+            formula_stat->insns(stats) = 10;
+            ASSERT_DOUBLE_EQ(3, value(sum, stats));
+        }
+
+        StatsSnapshot snapshot;
+        ASSERT_DOUBLE_EQ(12, value(sum, stats));
+
+        delete stats;
+    }
+
+    TEST(StatFormula, Errors)
+    {
+        const char *bad[] = {
+            "formula_core:insns +", "(formula_core:insns", "formula_core:nope",
+            "formula_core:hits", "formula_core:insns )", "2 $ 3", "",
+        };
+
+        foreach (i, sizeof(bad) / sizeof(bad[0])) {
+            StatFormula *f = formula(bad[i]);
+            stringbuf error;
+            ASSERT_FALSE(f->compile(error)) << bad[i];
+            ASSERT_FALSE(error.empty()) << bad[i];
+        }
+
+        /* A formula can only use the ones compiled before it */
+        StatsBuilder &builder = StatsBuilder::get();
+        StatFormula *early = builder.add_formula("early", "formulas:late + 1");
+        StatFormula *late = builder.add_formula("late", "formula_core:insns");
+        stringbuf error;
+        ASSERT_FALSE(early->compile(error));
+        ASSERT_TRUE(late->compile(error));
+        ASSERT_TRUE(early->compile(error));
+    }
+};
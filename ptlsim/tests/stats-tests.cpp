@@ -106,6 +106,86 @@ namespace {
 
     }
 
+    /* Rows written by the background writer must match inline ones */
+    TEST(Stats, TimeStatsBackground) {
+        StatsBuilder &builder = StatsBuilder::get();
+		builder.delete_nodes();
+
+        ostringstream discard, inline_os, async_os;
+        TestStat st;
+        builder.init_timer_stats();
+
+        st.ct1.set_default_stats(user_stats);
+        st.ct2.set_default_stats(kernel_stats);
+        st.ct3.set_default_stats(user_stats);
+        st.time_arr.set_default_stats(user_stats);
+        st.ct3.enable_periodic_dump();
+        st.time_arr.enable_periodic_dump();
+
+#define RUN_PERIODS(os) \
+        builder.dump_periodic(discard, 0); \
+        for (int i = 1; i <= 5; i++) { \
+            st.ct1 += i; \
+            st.ct2++; \
+            st.time_arr[i % 3] += 10 * i; \
+            builder.dump_periodic(os, i * 100); \
+        }
+
+        RUN_PERIODS(inline_os);
+        reset_stream(discard);
+
+        /* A single slot makes every period after the first wait */
+        builder.start_periodic_writer(&async_os, 1);
+        RUN_PERIODS(discard);
+        builder.stop_periodic_writer();
+#undef RUN_PERIODS
+
+        ASSERT_EQ(0U, discard.str().size());
+        ASSERT_NE(0U, inline_os.str().size());
+        ASSERT_STREQ(inline_os.str().c_str(), async_os.str().substr(
+                    async_os.str().find('\n') + 1).c_str());
+    }
+
+    TEST(Stats, TimeStatsBinary) {
+        StatsBuilder &builder = StatsBuilder::get();
+		builder.delete_nodes();
+
+        ostringstream os;
+        TestStat st;
+        builder.init_timer_stats();
+
+        st.ct1.set_default_stats(user_stats);
+        st.ct3.enable_periodic_dump();
+
+        builder.set_periodic_binary(true);
+        builder.dump_header(os);
+        ASSERT_EQ(0, os.str().compare(0, 8, "MTSTATS1"));
+        size_t header_size = os.str().size();
+
+        /* Rows are buffered until the block is full or finished */
+        for (int i = 1; i <= 10; i++) {
+            st.ct1 += i;
+            builder.dump_periodic(os, i * 100);
+        }
+        ASSERT_EQ(header_size, os.str().size());
+
+        builder.finish_periodic(os);
+        builder.set_periodic_binary(false);
+
+        std::string block = os.str().substr(header_size);
+        ASSERT_GT(block.size(), 16U);
+        W32 rows, columns;
+        memcpy(&rows, block.data(), 4);
+        memcpy(&columns, block.data() + 4, 4);
+        ASSERT_EQ(10U, rows);
+        /* sim_cycle, time_ns and the periodic counters of 'test' */
+        ASSERT_GT(columns, 2U);
+
+        /* Nothing left to flush */
+        builder.finish_periodic(os);
+        ASSERT_EQ(header_size + block.size(), os.str().size());
+    }
+
     TEST(Stats, StatArray) {
 
         TestStat st;
@@ -167,6 +247,26 @@ namespace {
         ASSERT_EQ(st.ct1(user_stats), 21);
     }
 
+    TEST(Stats, ModeSwitchRebindsLeafs) {
+        TestStat st;
+
+        st.set_default_stats(user_stats, true, true);
+        W64 user_start = st.ct2(user_stats);
+        W64 kernel_start = st.ct2(kernel_stats);
+
+        st.ct2++;
+        st.set_default_stats(kernel_stats);
+        st.ct2++;
+        st.set_default_stats(kernel_stats);
+        st.ct2++;
+        st.set_default_stats(user_stats);
+        st.ct2++;
+
+        ASSERT_EQ(st.ct2(user_stats), user_start + 2);
+        ASSERT_EQ(st.ct2(kernel_stats), kernel_start + 2);
+        ASSERT_EQ(st.get_default_stats(), user_stats);
+    }
+
     TEST(Stats, StatString) {
         TestStat st;
 
@@ -318,4 +418,127 @@ namespace {
 
 		ASSERT_EQ(ct1_val, 10);
 	}
+
+    class HistogramStat : public Statable {
+        public:
+            StatHistogram<> lat;
+            StatHistogram<2, 1, 6> small;
+
+            HistogramStat() : Statable("hist")
+                              , lat("lat", this)
+                              , small("small", this)
+            { }
+    };
+
+    TEST(Stats, HistogramBuckets) {
+        typedef StatHistogram<> H;
+
+        /* Exact in the linear range */
+        foreach (i, H::LINEAR) {
+            ASSERT_EQ(i, H::bucket(i));
+            ASSERT_EQ(W64(i), H::bucket_value(i));
+        }
+
+        /* Above, each bucket follows the previous and spans at most 1/8 */
+        W64 prev = H::LINEAR - 1;
+        for (int b = H::LINEAR; b < H::BUCKETS; b++) {
+            W64 top = H::bucket_value(b);
+            ASSERT_EQ(b, H::bucket(prev + 1));
+            ASSERT_EQ(b, H::bucket(top));
+            ASSERT_LE(top - prev, (prev + 1) / 8);
+            prev = top;
+        }
+        ASSERT_EQ((1ULL << 20) - 1, prev);
+
+        /* Everything longer goes in the last bucket */
+        ASSERT_EQ(H::BUCKETS - 1, H::bucket(1ULL << 40));
+
+        typedef StatHistogram<2, 1, 6> S;
+        ASSERT_EQ(12, S::BUCKETS);
+        ASSERT_EQ(4, S::bucket(4));
+        ASSERT_EQ(5, S::bucket(7));
+        ASSERT_EQ(W64(7), S::bucket_value(5));
+    }
+
+    TEST(Stats, Histogram) {
+        StatsBuilder &builder = StatsBuilder::get();
+        builder.delete_nodes();
+        user_stats->reset();
+        kernel_stats->reset();
+
+        HistogramStat st;
+        st.lat.set_default_stats(user_stats);
+
+        ASSERT_EQ(W64(0), st.lat(user_stats).percentile(0.5));
+        ASSERT_EQ(W64(0), st.lat(user_stats).max());
+
+        /* 50 samples of 2, 49 of 5 and 1 of 1000 */
+        foreach (i, 50) st.lat.record(2);
+        foreach (i, 49) st.lat.record(5);
+        st.lat(kernel_stats).record(1000);
+
+        /* Merged like the total stats */
+        Stats *total = builder.get_new_stats();
+        *total += *user_stats;
+        *total += *kernel_stats;
+
+        StatHistogram<>::Data &data = st.lat(total);
+        ASSERT_EQ(W64(100), data.count);
+        ASSERT_EQ(W64(100 + 245 + 1000), data.sum);
+        ASSERT_EQ(W64(2), data.percentile(0.50));
+        ASSERT_EQ(W64(5), data.percentile(0.99));
+        ASSERT_EQ(W64(1023), data.max());
+
+        total->reset();
+        *total += *kernel_stats;
+        ASSERT_EQ(W64(1023), st.lat(total).percentile(0.50));
+
+        YAML::Emitter out;
+        out << YAML::BeginMap;
+        out = st.lat.dump(out, user_stats);
+        out << YAML::EndMap;
+
+        ASSERT_TRUE(out.good());
+        ASSERT_STREQ(out.c_str(), "---\nlat: {count: 99, mean: 3.48485, "
+                "p50: 2, p90: 5, p95: 5, p99: 5, max: 5}");
+    }
+
+    class OccupancyStat : public Statable {
+        public:
+            StatOccupancy queue;
+
+            OccupancyStat() : Statable("occ")
+                              , queue("queue", this)
+            { }
+    };
+
+    TEST(Stats, Occupancy) {
+        StatsBuilder &builder = StatsBuilder::get();
+        builder.delete_nodes();
+        user_stats->reset();
+        kernel_stats->reset();
+
+        OccupancyStat st;
+
+        /* 2 entries for cycles 10-29, 5 for 30-39 of which 35- in kernel */
+        st.queue.update(2, 10, user_stats);
+        st.queue.update(2, 20, user_stats);
+        st.queue.update(5, 30, user_stats);
+        st.queue.update(5, 35, kernel_stats);
+        st.queue.update(0, 40, kernel_stats);
+
+        StatHistogram<>::Data &user = st.queue(user_stats);
+        ASSERT_EQ(W64(25), user.count);
+        ASSERT_EQ(W64(2 * 20 + 5 * 5), user.sum);
+        ASSERT_EQ(W64(2), user.percentile(0.50));
+        ASSERT_EQ(W64(5), user.max());
+        ASSERT_EQ(W64(5), st.queue(kernel_stats).count);
+
+        /* Cycles since the last change are only recorded by a flush */
+        StatOccupancy::flush_all(100);
+        ASSERT_EQ(W64(65), st.queue(kernel_stats).count);
+        ASSERT_EQ(W64(25), st.queue(kernel_stats).sum);
+        ASSERT_EQ(W64(0), st.queue(kernel_stats).percentile(0.50));
+        ASSERT_EQ(W64(0), st.queue.current());
+    }
 };
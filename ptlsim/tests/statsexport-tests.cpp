@@ -0,0 +1,136 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <statsBuilder.h>
+#include <statsExporter.h>
+
+namespace {
+
+    class ExportStat : public Statable {
+        public:
+            StatObj<W64> count;
+
+            ExportStat() : Statable("export")
+                           , count("count", this)
+            {}
+    };
+
+    /* Records what it was sent, failing the first 'failures' sends */
+    class TestBackend : public StatsExportBackend {
+        public:
+            ExportStat &st;
+            int failures;
+            int connects;
+            dynarray<int> batch_sizes;
+            dynarray<W64> counts;
+            dynarray<W64> cycles;
+
+            TestBackend(ExportStat &st_, int failures_)
+                : st(st_), failures(failures_), connects(0)
+            {}
+
+            const char* name() const { return "test"; }
+            bool connect() { connects++; return true; }
+            void disconnect() {}
+
+            bool send(StatsExportDoc **docs, int count)
+            {
+                if (failures > 0) {
+                    failures--;
+                    return false;
+                }
+
+                batch_sizes.push(count);
+                foreach (i, count) {
+                    counts.push(st.count(docs[i]->stats));
+                    cycles.push(docs[i]->cycle);
+                }
+                return true;
+            }
+    };
+
+    TEST(StatsExport, LineProtocol) {
+        bson_buffer buf[1];
+        bson b;
+
+        bson_buffer *bb = bson_buffer_init(buf);
+        bson_append_new_oid(bb, "_id");
+        bson_append_long(bb, "insns", 42);
+        bson_buffer *obj = bson_append_start_object(bb, "core 0");
+        bson_append_double(obj, "ipc", 1.5);
+        bson_buffer *arr = bson_append_start_array(obj, "width");
+        bson_append_long(arr, "0", 3);
+        bson_append_long(arr, "1", 4);
+        obj = bson_append_finish_object(arr);
+        bb = bson_append_finish_object(obj);
+        bson_append_string(bb, "name", "a \"b\"");
+        bson_from_buffer(&b, bb);
+
+        StatsExportDoc doc;
+        doc.stats = NULL;
+        doc.kind = "total";
+        doc.cycle = 100;
+        doc.time_ns = 5;
+
+        stringbuf tags;
+        stats_export_add_tag(tags, "machine", "xeon");
+        stats_export_add_tag(tags, "bench", "");
+        stats_export_add_tag(tags, "tags", "a,b c");
+        ASSERT_STREQ("machine=xeon,tags=a\\,b\\ c", tags.buf);
+
+        stringbuf out;
+        stats_export_line(out, tags.buf, doc, &b);
+        ASSERT_STREQ("marss,kind=total,machine=xeon,tags=a\\,b\\ c "
+                "sim_cycle=100i,insns=42i,core\\ 0.ipc=1.5,"
+                "core\\ 0.width.0=3i,core\\ 0.width.1=4i,"
+                "name=\"a \\\"b\\\"\" 5\n", out.buf);
+
+        bson_destroy(&b);
+    }
+
+    TEST(StatsExport, BatchAndRetry) {
+        StatsBuilder &builder = StatsBuilder::get();
+        builder.delete_nodes();
+
+        ExportStat st;
+        Stats *stats = builder.get_new_stats();
+        TestBackend *backend = new TestBackend(st, 1);
+
+        {
+            StatsExporter exporter(backend, 4, 8);
+
+            ASSERT_TRUE(exporter.check_connection());
+            foreach (i, 6) {
+                st.count(stats) = i;
+                ASSERT_TRUE(exporter.export_stats(*stats, "periodic",
+                            i * 100, true));
+            }
+
+            /* Snapshot was copied when queued */
+            st.count(stats) = 99;
+            exporter.stop();
+
+            ASSERT_EQ(6, backend->counts.count());
+            foreach (i, 6) {
+                ASSERT_EQ(W64(i), backend->counts[i]);
+                ASSERT_EQ(W64(i * 100), backend->cycles[i]);
+            }
+            foreach (i, backend->batch_sizes.count())
+                ASSERT_LE(backend->batch_sizes[i], 4);
+
+            /* Failed send reconnects once and is sent again */
+            ASSERT_EQ(2, backend->connects);
+
+            /* Stopped exporter starts again for the final stats */
+            ASSERT_TRUE(exporter.export_stats(*stats, "total", 700, true));
+            exporter.stop();
+            ASSERT_EQ(7, backend->counts.count());
+            ASSERT_EQ(W64(99), backend->counts[6]);
+        }
+
+        builder.destroy_stats(stats);
+    }
+};
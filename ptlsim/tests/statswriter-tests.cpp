@@ -0,0 +1,205 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <statsBuilder.h>
+#include <statsWriter.h>
+
+namespace {
+
+    const char *writer_labels[3] = { "hit", "miss", "evict" };
+
+    class WriterStat : public Statable {
+        public:
+            StatObj<W64> count;
+            StatObj<double> ratio;
+            StatArray<W64, 3> events;
+            StatArray<W64, 4> sizes;
+            StatString name;
+            StatString tags;
+            StatString path;
+            StatHistogram<> lat;
+            Statable empty;
+            Statable child;
+            StatObj<W64> leaf;
+
+            WriterStat() : Statable("writer")
+                           , count("count", this)
+                           , ratio("ratio", this)
+                           , events("events", this, writer_labels)
+                           , sizes("sizes", this)
+                           , name("name", this)
+                           , tags("tags", this)
+                           , path("path", this)
+                           , lat("lat", this)
+                           , empty("empty", this)
+                           , child("child", this)
+                           , leaf("leaf", &child)
+            {}
+    };
+
+    void fill(WriterStat &st, Stats *stats)
+    {
+        st.set_default_stats(stats);
+
+        st.count(stats) = 1234567890123ULL;
+        st.ratio(stats) = 1.0 / 3.0;
+        st.events[0] = 10;
+        st.events[2] = 3;
+        st.sizes[1] = 7;
+        st.name = "ooo_0_0";
+        st.tags = "core,l2,l3";
+        st.tags.set_split(",");
+        st.path = "a: b";
+        foreach (i, 10) st.lat.record(i);
+        st.leaf(stats) = 42;
+    }
+
+    TEST(StatsWriter, SameYAMLAsEmitter)
+    {
+        WriterStat st;
+        Stats *stats = StatsBuilder::get().get_new_stats();
+        fill(st, stats);
+
+        YAML::Emitter emitter;
+        emitter << YAML::BeginMap;
+        st.dump(emitter, stats);
+        emitter << YAML::EndMap;
+        ASSERT_TRUE(emitter.good());
+
+        StatsWriter out;
+        out.begin_doc();
+        out.begin_map();
+        st.dump(out, stats);
+        out.end_map();
+        out.end_doc();
+
+        stringbuf expected;
+        expected << emitter.c_str() << "\n";
+
+        stringbuf written;
+        out.str(written);
+        ASSERT_STREQ(expected.buf, written.buf);
+
+        delete stats;
+    }
+
+    TEST(StatsWriter, QuotesLikeEmitter)
+    {
+        const char *strings[] = {
+            "plain", "", "a:b", "a: b", "ends:", "- item", "-1", "x #y",
+            "x#y", "[x]", "trailing ", "'q'", "say \"hi\"", "tab\there",
+            "?x", "%s", "a,b",
+        };
+
+        foreach (i, sizeof(strings) / sizeof(strings[0])) {
+            YAML::Emitter emitter;
+            emitter << YAML::BeginMap;
+            emitter << YAML::Key << "k" << YAML::Value << strings[i];
+            emitter << YAML::Key << "f" << YAML::Value << YAML::Flow;
+            emitter << YAML::BeginSeq << strings[i] << YAML::EndSeq;
+            emitter << YAML::Block;
+            emitter << YAML::EndMap;
+
+            StatsWriter out;
+            out.begin_doc();
+            out.begin_map();
+            out.write("k", strings[i]);
+            out.begin_flow_seq("f");
+            out.item(strings[i]);
+            out.end_flow_seq();
+            out.end_map();
+
+            stringbuf written;
+            out.str(written);
+            ASSERT_STREQ(emitter.c_str(), written.buf) << strings[i];
+        }
+    }
+
+    TEST(StatsWriter, JSON)
+    {
+        StatsWriter out(StatsWriter::JSON_FORMAT);
+        out.begin_list();
+
+        out.begin_doc();
+        out.begin_map();
+        out.write("a", W64(1));
+        out.begin_map("b");
+        out.write("c", 2.5);
+        out.begin_flow_seq("d");
+        out.item(W64(1));
+        out.item(W64(2));
+        out.end_flow_seq();
+        out.begin_map("e");
+        out.end_map();
+        out.end_map();
+        out.write("s", "say \"hi\"");
+        out.end_map();
+        out.end_doc();
+
+        out.begin_doc();
+        out.begin_map();
+        out.write("inf", 1.0 / 0.0);
+        out.end_map();
+        out.end_doc();
+
+        out.end_list();
+
+        stringbuf written;
+        out.str(written);
+        ASSERT_STREQ("[\n{\n  \"a\": 1,\n  \"b\": {\n    \"c\": 2.5,\n"
+                "    \"d\": [1, 2],\n    \"e\": {}\n  },\n"
+                "  \"s\": \"say \\\"hi\\\"\"\n},\n{\n  \"inf\": null\n}\n]\n",
+                written.buf);
+    }
+
+    TEST(StatsWriter, WritesChunksToFile)
+    {
+        char filename[] = "/tmp/statswriter-test.XXXXXX";
+        int fd = mkstemp(filename);
+        ASSERT_LE(0, fd);
+
+        /* Enough to fill all chunks a few times */
+        int entries = 3 * StatsWriter::WRITER_CHUNKS *
+            StatsWriter::WRITER_CHUNK_SIZE / 32;
+
+        StatsWriter buffered;
+        {
+            StatsWriter out(StatsWriter::YAML_FORMAT, fd);
+
+            StatsWriter *writers[2] = { &out, &buffered };
+            foreach (w, 2) {
+                StatsWriter &wr = *writers[w];
+                wr.begin_doc();
+                wr.begin_map();
+                foreach (i, entries) {
+                    stringbuf key;
+                    key << "counter_" << i;
+                    wr.write(key.buf, W64(i) * 1000003);
+                }
+                wr.end_map();
+                wr.end_doc();
+            }
+
+            ASSERT_TRUE(out.flush());
+            ASSERT_EQ(buffered.size(), out.size());
+        }
+        close(fd);
+
+        stringbuf expected;
+        buffered.str(expected);
+
+        FILE *file = fopen(filename, "r");
+        ASSERT_TRUE(file != NULL);
+        char *data = new char[expected.size() + 1];
+        size_t n = fread(data, 1, expected.size() + 1, file);
+        fclose(file);
+        unlink(filename);
+
+        ASSERT_EQ(size_t(expected.size()), n);
+        ASSERT_EQ(0, memcmp(expected.buf, data, n));
+        delete [] data;
+    }
+};
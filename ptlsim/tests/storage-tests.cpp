@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <storage.h>
+
+namespace {
+
+    TEST(StorageModel, LatencyThenTransfer)
+    {
+        StorageModel model;
+        model.setup(100, 40, 0.5, 1, 1, 0, 1);
+
+        W64 wait;
+        bool tail;
+        EXPECT_EQ(W64(1000 + 100 + 2048), model.submit(1000, false, 4096,
+                    wait, tail));
+        EXPECT_EQ(W64(0), wait);
+        EXPECT_FALSE(tail);
+
+        /* Queue depth 1, the write waits for the read to be done */
+        EXPECT_EQ(W64(3148 + 40 + 2048), model.submit(1010, true, 4096,
+                    wait, tail));
+        EXPECT_EQ(W64(3148 - 1010), wait);
+    }
+
+    TEST(StorageModel, ChannelsOverlapLatency)
+    {
+        StorageModel model;
+        model.setup(100, 100, 0, 2, 8, 0, 1);
+
+        W64 wait;
+        bool tail;
+        EXPECT_EQ(W64(100), model.submit(0, false, 512, wait, tail));
+        EXPECT_EQ(W64(100), model.submit(0, false, 512, wait, tail));
+
+        /* Both channels busy until 100 */
+        EXPECT_EQ(W64(200), model.submit(0, false, 512, wait, tail));
+        EXPECT_EQ(W64(100), wait);
+    }
+
+    TEST(StorageModel, TailIsReproducible)
+    {
+        StorageModel a, b;
+        a.setup(10, 10, 0, 64, 64, 0.25, 10);
+        b.setup(10, 10, 0, 64, 64, 0.25, 10);
+
+        int tails = 0;
+        foreach (i, 400) {
+            W64 wait;
+            bool tail_a, tail_b;
+            W64 done = a.submit(i * 1000, false, 0, wait, tail_a);
+            EXPECT_EQ(done, b.submit(i * 1000, false, 0, wait, tail_b));
+            EXPECT_EQ(W64(i * 1000 + (tail_a ? 100 : 10)), done);
+            tails += tail_a;
+        }
+
+        EXPECT_GT(tails, 50);
+        EXPECT_LT(tails, 150);
+    }
+};
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <storesets.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(StoreSets, Violation)
+    {
+        StoreSetPredictor<1024, 128, 1000> ss;
+        W64 uuid = 0;
+
+        /* No set: load doesn't wait on any store */
+        ss.rename_store(0x2000, 10);
+        EXPECT_FALSE(ss.rename_load(0x1000, uuid));
+
+        ss.violation(0x1000, 0x2000);
+        EXPECT_EQ(ss.ssid(0x1000), ss.ssid(0x2000));
+        EXPECT_GE(ss.ssid(0x1000), 0);
+
+        ss.rename_store(0x2000, 11);
+        EXPECT_TRUE(ss.rename_load(0x1000, uuid));
+        EXPECT_EQ(11, uuid);
+
+        /* Older store resolving doesn't release the last store */
+        ss.issue_store(0x2000, 10);
+        EXPECT_TRUE(ss.rename_load(0x1000, uuid));
+        ss.issue_store(0x2000, 11);
+        EXPECT_FALSE(ss.rename_load(0x1000, uuid));
+    }
+
+    TEST(StoreSets, Merge)
+    {
+        StoreSetPredictor<1024, 128, 1000> ss;
+
+        ss.violation(0x1000, 0x2000);
+        ss.violation(0x1100, 0x2100);
+        int first = ss.ssid(0x1000);
+        int second = ss.ssid(0x1100);
+        EXPECT_NE(first, second);
+
+        /* Store joins load's existing set */
+        ss.violation(0x1000, 0x2200);
+        EXPECT_EQ(first, ss.ssid(0x2200));
+
+        /* Both in sets: smaller id wins */
+        ss.violation(0x1100, 0x2000);
+        EXPECT_EQ(min(first, second), ss.ssid(0x1100));
+        EXPECT_EQ(min(first, second), ss.ssid(0x2000));
+    }
+
+    TEST(StoreSets, Clear)
+    {
+        StoreSetPredictor<1024, 128, 1000> ss;
+
+        ss.violation(0x1000, 0x2000);
+        EXPECT_FALSE(ss.tick(999));
+        EXPECT_GE(ss.ssid(0x1000), 0);
+        EXPECT_TRUE(ss.tick(1000));
+        EXPECT_EQ(-1, ss.ssid(0x1000));
+        EXPECT_EQ(-1, ss.ssid(0x2000));
+        EXPECT_FALSE(ss.tick(1500));
+    }
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <topdown.h>
+
+#include <sstream>
+using std::ostringstream;
+
+using namespace Core;
+
+namespace {
+
+    TEST(TopDown, HotspotsAccumulate)
+    {
+        TopDownHotspots hotspots;
+
+        hotspots.add(0x1000, TOPDOWN_RETIRING, 4);
+        hotspots.add(0x1000, TOPDOWN_MEMORY, 3);
+        hotspots.add(0x1004, TOPDOWN_CORE, 2);
+        hotspots.add(0x1000, TOPDOWN_MEMORY, 1);
+
+        TopDownHotspots::Entry *e = hotspots.table.get(0x1000);
+        ASSERT_TRUE(e != NULL);
+        EXPECT_EQ(4U, e->slots[TOPDOWN_RETIRING]);
+        EXPECT_EQ(4U, e->slots[TOPDOWN_MEMORY]);
+        EXPECT_EQ(4U, e->lost());
+        EXPECT_EQ(4U, hotspots.total[TOPDOWN_MEMORY]);
+        EXPECT_EQ(2U, hotspots.total[TOPDOWN_CORE]);
+
+        hotspots.reset();
+        EXPECT_TRUE(hotspots.table.get(0x1000) == NULL);
+        EXPECT_EQ(0U, hotspots.total[TOPDOWN_RETIRING]);
+    }
+
+    TEST(TopDown, HotspotsSortedByLostSlots)
+    {
+        TopDownHotspots hotspots;
+
+        hotspots.add(0xaaa0, TOPDOWN_RETIRING, 100);
+        hotspots.add(0xbbb0, TOPDOWN_FRONTEND, 5);
+        hotspots.add(0xccc0, TOPDOWN_MEMORY, 50);
+        hotspots.add(0xddd0, TOPDOWN_BAD_SPECULATION, 20);
+
+        ostringstream os;
+        hotspots.write(os, 2);
+        std::string report = os.str();
+
+        size_t memory = report.find("ccc0");
+        size_t badspec = report.find("ddd0");
+        EXPECT_NE(std::string::npos, memory);
+        EXPECT_NE(std::string::npos, badspec);
+        EXPECT_LT(memory, badspec);
+
+        /* Only the top 2 are listed */
+        EXPECT_EQ(std::string::npos, report.find("bbb0"));
+        EXPECT_EQ(std::string::npos, report.find("aaa0"));
+    }
+};
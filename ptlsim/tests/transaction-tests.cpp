@@ -0,0 +1,82 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <transaction.h>
+
+using namespace Memory;
+
+namespace {
+
+    struct CountTransaction : public Transaction {
+        int i;
+        int steps;
+        int available;
+        int availableAt;
+    };
+
+    /* Waits 2 cycles, then a cycle at a time until available is availableAt */
+    bool count_txn(CountTransaction &txn)
+    {
+        TXN_BEGIN(txn);
+
+        txn.steps++;
+        TXN_WAIT(txn, 2);
+
+        for (txn.i = 0; ; txn.i++) {
+            txn.steps++;
+            if (txn.available == txn.availableAt)
+                break;
+            if (txn.available < 0)
+                TXN_EXIT(txn);
+            TXN_WAIT(txn, 1);
+        }
+
+        txn.steps += 100;
+        TXN_END(txn);
+    }
+
+    TEST(Transaction, ResumesAtEachWait) {
+        CountTransaction txn;
+        txn.init();
+        txn.steps = 0;
+        txn.available = 0;
+        txn.availableAt = 3;
+
+        EXPECT_FALSE(count_txn(txn));
+        EXPECT_EQ(2, txn.waitCycles);
+        EXPECT_EQ(1, txn.steps);
+
+        int resumes = 0;
+        while (!count_txn(txn)) {
+            EXPECT_EQ(1, txn.waitCycles);
+            txn.available++;
+            resumes++;
+        }
+
+        EXPECT_EQ(3, resumes);
+        EXPECT_EQ(3, txn.i);
+        EXPECT_EQ(105, txn.steps);
+        EXPECT_TRUE(txn.done());
+
+        /* Stepping a finished transaction does nothing */
+        EXPECT_TRUE(count_txn(txn));
+        EXPECT_EQ(105, txn.steps);
+    }
+
+    TEST(Transaction, ExitSkipsTheRest) {
+        CountTransaction txn;
+        txn.init();
+        txn.steps = 0;
+        txn.available = 0;
+        txn.availableAt = 3;
+
+        EXPECT_FALSE(count_txn(txn));
+        EXPECT_FALSE(count_txn(txn));
+        txn.available = -1;
+        EXPECT_TRUE(count_txn(txn));
+        EXPECT_TRUE(txn.done());
+        EXPECT_EQ(3, txn.steps);
+    }
+};
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <uopcache.h>
+
+using namespace Core;
+
+namespace {
+
+    TEST(UopCache, ProbeInsert)
+    {
+        UopCache<16, 2, 4> uc;
+
+        EXPECT_FALSE(uc.probe(0x401000, 0));
+        uc.insert(0x401003, 0);
+        EXPECT_TRUE(uc.probe(0x40100f, 0));
+        EXPECT_FALSE(uc.probe(0x401010, 0));
+        EXPECT_FALSE(uc.probe(0x401000, 1));
+
+        /* Third window of one set evicts one of first two */
+        foreach (i, 3) {
+            uc.insert(W64(i) << 12, 0);
+        }
+        int present = 0;
+        foreach (i, 3) {
+            present += uc.probe(W64(i) << 12, 0);
+        }
+        EXPECT_EQ(2, present);
+    }
+
+    TEST(UopCache, FlushPage)
+    {
+        UopCache<16, 4, 4> uc;
+
+        uc.insert(0x401000, 0);
+        uc.insert(0x401ff0, 0);
+        uc.insert(0x402000, 0);
+        uc.insert(0x401000, 1);
+
+        EXPECT_EQ(2, uc.flush_virt(0x401800, 0));
+        EXPECT_FALSE(uc.probe(0x401000, 0));
+        EXPECT_FALSE(uc.probe(0x401ff0, 0));
+        EXPECT_TRUE(uc.probe(0x402000, 0));
+        EXPECT_TRUE(uc.probe(0x401000, 1));
+    }
+
+    TEST(UopCache, Disabled)
+    {
+        UopCache<0, 8, 4> uc;
+
+        uc.insert(0x401000, 0);
+        EXPECT_FALSE(uc.probe(0x401000, 0));
+    }
+
+    TEST(LoopStreamDetector, LockAndExit)
+    {
+        LoopStreamDetector<8, 2> lsd;
+
+        /* Loop body 0x1000..0x1010 of 4 uops */
+        foreach (i, 4) lsd.add_uop();
+        EXPECT_FALSE(lsd.taken_branch(0x1010, 0x1000));
+        foreach (i, 4) lsd.add_uop();
+        EXPECT_FALSE(lsd.taken_branch(0x1010, 0x1000));
+        foreach (i, 4) lsd.add_uop();
+        EXPECT_TRUE(lsd.taken_branch(0x1010, 0x1000));
+
+        EXPECT_TRUE(lsd.active(0x1000));
+        EXPECT_TRUE(lsd.active(0x1010));
+
+        /* Falling out of the loop unlocks it */
+        EXPECT_FALSE(lsd.active(0x1014));
+        EXPECT_FALSE(lsd.active(0x1000));
+    }
+
+    TEST(LoopStreamDetector, LongBody)
+    {
+        LoopStreamDetector<8, 2> lsd;
+
+        foreach (n, 4) {
+            foreach (i, 9) lsd.add_uop();
+            EXPECT_FALSE(lsd.taken_branch(0x1040, 0x1000));
+        }
+        EXPECT_FALSE(lsd.active(0x1000));
+    }
+
+    TEST(LoopStreamDetector, OtherBranch)
+    {
+        LoopStreamDetector<8, 2> lsd;
+
+        foreach (n, 3) {
+            lsd.add_uop();
+            lsd.taken_branch(0x1010, 0x1000);
+        }
+        EXPECT_TRUE(lsd.active(0x1008));
+
+        /* Forward taken branch inside the body unlocks the loop */
+        lsd.add_uop();
+        EXPECT_FALSE(lsd.taken_branch(0x1008, 0x100c));
+        EXPECT_FALSE(lsd.active(0x100c));
+    }
+
+    TEST(LoopStreamDetector, Disabled)
+    {
+        LoopStreamDetector<0, 2> lsd;
+
+        foreach (n, 4) {
+            lsd.add_uop();
+            EXPECT_FALSE(lsd.taken_branch(0x1010, 0x1000));
+        }
+        EXPECT_FALSE(lsd.active(0x1000));
+    }
+}
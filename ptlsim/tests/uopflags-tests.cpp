@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <time.h>
+
+#define DISABLE_ASSERT
+
+#include <ptlsim.h>
+#include <uopflags.h>
+
+namespace {
+
+    typedef byte (*genflags_w8_t)(W8 r);
+    typedef byte (*genflags_w32_t)(W32 r);
+    typedef byte (*genflags_w64_t)(W64 r);
+
+    struct FlagsImpl {
+        const char *name;
+        genflags_w8_t w8;
+        genflags_w32_t w32;
+        genflags_w64_t w64;
+    };
+
+    const FlagsImpl impls[] = {
+        {"setcc", &x86_genflags_setcc<W8>, &x86_genflags_setcc<W32>,
+            &x86_genflags_setcc<W64>},
+        {"lahf", &x86_genflags_lahf<W8>, &x86_genflags_lahf<W32>,
+            &x86_genflags_lahf<W64>},
+        {"table", &x86_genflags_table<W8>, &x86_genflags_table<W32>,
+            &x86_genflags_table<W64>},
+    };
+
+    const int impl_count = sizeof(impls) / sizeof(impls[0]);
+
+    W64 next_random(W64 &seed)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed;
+    }
+
+    double now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (ts.tv_sec * 1e9) + ts.tv_nsec;
+    }
+
+    TEST(UopFlags, AllImplementationsAgree)
+    {
+        foreach (v, 256) {
+            byte expected = impls[0].w8(v);
+
+            ASSERT_EQ(expected & ~(FLAG_SF|FLAG_ZF|FLAG_PF), 0);
+
+            for (int i = 1; i < impl_count; i++) {
+                ASSERT_EQ(expected, impls[i].w8(v)) << impls[i].name;
+            }
+        }
+
+        ASSERT_EQ(FLAG_ZF|FLAG_PF, x86_genflags_table<W64>(0));
+        ASSERT_EQ(FLAG_SF|FLAG_PF, x86_genflags_table<W32>(0x80000000));
+        ASSERT_EQ(0, x86_genflags_table<W64>(1));
+
+        W64 seed = 1;
+        foreach (n, 100000) {
+            W64 v = next_random(seed);
+            /* Mostly small and negative values, like real ALU results */
+            if (n & 1) v >>= (v & 63);
+
+            for (int i = 1; i < impl_count; i++) {
+                ASSERT_EQ(impls[0].w32(v), impls[i].w32(v)) << impls[i].name;
+                ASSERT_EQ(impls[0].w64(v), impls[i].w64(v)) << impls[i].name;
+            }
+        }
+    }
+
+    /*
+     * Micro-benchmark: host ns per 'and' uop with flags of each
+     * implementation, the shape of aluop<> in uopimpl.cpp.
+     */
+    TEST(UopFlags, Benchmark)
+    {
+        const int values = 4096;
+        const int rounds = 2000;
+        W64 ra[values];
+        W64 rb[values];
+
+        W64 seed = 7;
+        foreach (i, values) {
+            ra[i] = next_random(seed);
+            rb[i] = next_random(seed) >> (i & 63);
+        }
+
+        foreach (i, impl_count) {
+            W64 sum = 0;
+            double start = now_ns();
+
+            foreach (r, rounds) {
+                foreach (j, values) {
+                    W64 rd = ra[j] & rb[j];
+                    sum += rd + impls[i].w64(rd);
+                }
+            }
+
+            double ns = (now_ns() - start) / ((double)rounds * values);
+            std::cout << "uopflags " << impls[i].name << ": " << ns
+                << " ns/uop (" << (sum & 1) << ")" << std::endl;
+        }
+    }
+};
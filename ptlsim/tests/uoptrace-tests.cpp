@@ -0,0 +1,153 @@
+
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <uoptrace.h>
+
+#include <cstdio>
+
+namespace {
+
+    UopTraceStatic uop(W64 rip, W8 index, W8 flags)
+    {
+        UopTraceStatic s;
+        memset(&s, 0, sizeof(s));
+        s.rip = rip;
+        s.index = index;
+        s.flags = flags;
+        s.opcode = 7;
+        s.rd = 1;
+        s.ra = 2;
+        s.latency = 1;
+        s.bytes = 3;
+        if (flags & UOPTRACE_BRANCH) s.riptaken = rip - 0x40;
+        return s;
+    }
+
+    /* Loop of a load, a store and a branch back, run 'iters' times */
+    void encode_loop(UopTraceEncoder &enc, dynarray<W8> &payload, int iters)
+    {
+        foreach (i, iters) {
+            enc.put(payload, uop(0x1000, 0, UOPTRACE_SOM|UOPTRACE_LOAD), 0, 0,
+                    0x8000 + i * 8);
+            enc.put(payload, uop(0x1000, 1, UOPTRACE_EOM|UOPTRACE_STORE), 0,
+                    0, 0x9000 + i * 8);
+            enc.put(payload, uop(0x1003,  0, UOPTRACE_SOM|UOPTRACE_EOM|
+                        UOPTRACE_BRANCH), 0, 0,
+                    (i == iters - 1) ? 0x1006 : 0x1003 - 0x40);
+        }
+    }
+
+    const char *write_trace(const dynarray<W8> &payload, int count,
+            const char *magic = UOPTRACE_MAGIC)
+    {
+        static char name[] = "/tmp/uoptrace-test.XXXXXX";
+        strcpy(name, "/tmp/uoptrace-test.XXXXXX");
+        FILE *f = fdopen(mkstemp(name), "wb");
+        fwrite(magic, 8, 1, f);
+
+        if (count) {
+            uLongf packed_size = compressBound(payload.length);
+            dynarray<W8> packed(packed_size);
+            compress2((Bytef*)packed.data, &packed_size,
+                    (const Bytef*)payload.data, payload.length, 1);
+            W32 header[3] = { W32(count), W32(payload.length),
+                W32(packed_size) };
+            fwrite(header, sizeof(header), 1, f);
+            fwrite(packed.data, packed_size, 1, f);
+        }
+
+        fclose(f);
+        return name;
+    }
+
+    TEST(UopTrace, StaticsWrittenOnce) {
+        UopTraceEncoder enc;
+        dynarray<W8> payload;
+
+        encode_loop(enc, payload, 100);
+        ASSERT_EQ(3, enc.statics.count());
+
+        /* Later iterations are a few bytes per uop */
+        dynarray<W8> more;
+        encode_loop(enc, more, 100);
+        ASSERT_EQ(3, enc.statics.count());
+        ASSERT_LT(more.length, 300 * 6);
+
+        /* An instruction rewritten at the same rip is a new static */
+        UopTraceStatic s = uop(0x1003, 0, UOPTRACE_SOM|UOPTRACE_EOM);
+        enc.put(more, s, 0, 0, 0);
+        ASSERT_EQ(4, enc.statics.count());
+        enc.put(more, s, 0, 0, 0);
+        ASSERT_EQ(4, enc.statics.count());
+    }
+
+    TEST(UopTrace, DecodeBlock) {
+        UopTraceEncoder enc;
+        dynarray<W8> payload;
+        encode_loop(enc, payload, 4);
+
+        dynarray<UopTraceStatic> statics;
+        W64 prev_rip = 0;
+        W64 prev_addr[256];
+        memset(prev_addr, 0, sizeof(prev_addr));
+        UopTraceRecord recs[12];
+
+        ASSERT_TRUE(uoptrace_decode_block(payload.data,
+                    payload.data + payload.length, 12, statics, prev_rip,
+                    prev_addr, recs));
+        ASSERT_EQ(3, statics.count());
+        ASSERT_TRUE(statics[0].same(uop(0x1000, 0,
+                        UOPTRACE_SOM|UOPTRACE_LOAD)));
+        ASSERT_EQ(W64(0x1003 - 0x40), statics[2].riptaken);
+
+        ASSERT_EQ(0U, recs[3].sid);
+        ASSERT_EQ(W64(0x8008), recs[3].addr);
+        ASSERT_EQ(1U, recs[10].sid);
+        ASSERT_EQ(W64(0x9018), recs[10].addr);
+        ASSERT_EQ(W64(0x1003 - 0x40), recs[8].addr);
+        ASSERT_EQ(W64(0x1006), recs[11].addr);
+
+        /* Truncated and too many records */
+        statics.clear();
+        ASSERT_FALSE(uoptrace_decode_block(payload.data,
+                    payload.data + payload.length - 1, 12, statics, prev_rip,
+                    prev_addr, recs));
+        statics.clear();
+        ASSERT_FALSE(uoptrace_decode_block(payload.data,
+                    payload.data + payload.length, 11, statics, prev_rip,
+                    prev_addr, recs));
+    }
+
+    TEST(UopTrace, File) {
+        UopTraceEncoder enc;
+        dynarray<W8> payload;
+        encode_loop(enc, payload, 2);
+        enc.put(payload, uop(0x2000, 0, UOPTRACE_SOM|UOPTRACE_EOM), 1, 0, 0);
+
+        const char *name = write_trace(payload, 7);
+        UopTraceFile trace;
+        ASSERT_TRUE(trace.open(name, 2) == NULL);
+        ASSERT_EQ(7U, trace.count);
+        ASSERT_EQ(4, trace.statics.count());
+        ASSERT_EQ(6, trace.per_core[0].count());
+        ASSERT_EQ(1, trace.per_core[1].count());
+        ASSERT_EQ(6U, trace.per_core[1][0]);
+        ASSERT_EQ(W64(0x9008), trace.records[4].addr);
+
+        /* Machine with fewer cores than the trace */
+        ASSERT_TRUE(trace.open(name, 1) != NULL);
+        unlink(name);
+
+        name = write_trace(payload, 7, MEMTRACE_PACKED_MAGIC);
+        ASSERT_TRUE(trace.open(name, 2) != NULL);
+        unlink(name);
+
+        name = write_trace(payload, 0);
+        ASSERT_TRUE(trace.open(name, 1) == NULL);
+        ASSERT_EQ(0U, trace.count);
+        unlink(name);
+    }
+
+};
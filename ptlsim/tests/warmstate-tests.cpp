@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+// We disable Assert of Simulator
+#define DISABLE_ASSERT
+#include <ptlsim.h>
+#include <warmstate.h>
+#include <cacheLines.h>
+
+using namespace Memory;
+
+namespace {
+
+    const char *temp_name()
+    {
+        static char name[] = "/tmp/warmstate-test.XXXXXX";
+        strcpy(name, "/tmp/warmstate-test.XXXXXX");
+        close(mkstemp(name));
+        return name;
+    }
+
+    struct Table {
+        W8 counters[1000];
+        W64 history;
+    };
+
+    TEST(WarmState, SaveThenLoad)
+    {
+        const char *name = temp_name();
+
+        Table table;
+        foreach (i, 1000) table.counters[i] = i % 4;
+        table.history = 0x1234;
+
+        WarmState save;
+        ASSERT_TRUE(save.open_save(name));
+        ASSERT_TRUE(save.saving());
+
+        save.begin_section("L1_D_0");
+        W64 count = 2;
+        save.value(count);
+        foreach (i, count) {
+            W64 tag = 0x1000 + 64 * i;
+            W8 state = i + 1;
+            save.value(tag);
+            save.value(state);
+        }
+        save.end_section();
+
+        /* Empty sections are not written */
+        save.begin_section("empty");
+        save.end_section();
+
+        save.begin_section("ooo_0");
+        save.object(table);
+        save.end_section();
+        save.close();
+
+        WarmState load;
+        ASSERT_TRUE(load.open_load(name));
+        ASSERT_FALSE(load.saving());
+
+        ASSERT_TRUE(load.next_section());
+        EXPECT_STREQ("L1_D_0", load.section_name());
+        load.value(count);
+        ASSERT_EQ(2U, count);
+        foreach (i, count) {
+            W64 tag;
+            W8 state;
+            load.value(tag);
+            load.value(state);
+            EXPECT_EQ(0x1000 + 64 * i, tag);
+            EXPECT_EQ(i + 1, state);
+        }
+        EXPECT_TRUE(load.ok());
+
+        ASSERT_TRUE(load.next_section());
+        EXPECT_STREQ("ooo_0", load.section_name());
+        Table loaded;
+        memset(&loaded, 0, sizeof(loaded));
+        load.object(loaded);
+        EXPECT_TRUE(load.ok());
+        EXPECT_EQ(0, memcmp(&table, &loaded, sizeof(table)));
+
+        EXPECT_FALSE(load.next_section());
+        load.close();
+        unlink(name);
+    }
+
+    TEST(WarmState, MismatchedBlobIsSkipped)
+    {
+        const char *name = temp_name();
+
+        WarmState save;
+        ASSERT_TRUE(save.open_save(name));
+        save.begin_section("core");
+        W64 small[2] = {1, 2};
+        save.object(small);
+        W64 after = 7;
+        save.value(after);
+        save.end_section();
+        save.begin_section("next");
+        save.expect(2);
+        save.value(after);
+        save.end_section();
+        save.begin_section("threads");
+        save.expect(2);
+        save.end_section();
+        save.close();
+
+        WarmState load;
+        ASSERT_TRUE(load.open_load(name));
+        ASSERT_TRUE(load.next_section());
+
+        /* Built with an other size */
+        W64 large[4] = {0, 0, 0, 0};
+        load.object(large);
+        EXPECT_FALSE(load.ok());
+        EXPECT_EQ(0U, large[0]);
+
+        W64 value = 0;
+        load.value(value);
+        EXPECT_EQ(0U, value);
+
+        /* Next section reads again */
+        ASSERT_TRUE(load.next_section());
+        EXPECT_TRUE(load.ok());
+        load.expect(2);
+        EXPECT_TRUE(load.ok());
+        load.value(value);
+        EXPECT_EQ(7U, value);
+
+        /* Reads past the section fail */
+        load.value(value);
+        EXPECT_FALSE(load.ok());
+
+        /* Core with an other thread count */
+        ASSERT_TRUE(load.next_section());
+        load.expect(4);
+        EXPECT_FALSE(load.ok());
+
+        EXPECT_FALSE(load.next_section());
+        unlink(name);
+    }
+
+    TEST(WarmState, BadHeader)
+    {
+        const char *name = temp_name();
+
+        gzFile file = gzopen(name, "wb");
+        gzwrite(file, "PTLWARM1", 8);
+        W32 header[2] = {WARM_STATE_VERSION + 1, 0};
+        gzwrite(file, header, sizeof(header));
+        gzclose(file);
+
+        WarmState load;
+        EXPECT_FALSE(load.open_load(name));
+
+        file = gzopen(name, "wb");
+        gzwrite(file, "PTLIORC1", 8);
+        gzclose(file);
+        EXPECT_FALSE(load.open_load(name));
+
+        unlink(name);
+    }
+
+    TEST(WarmState, CacheLinesRoundTrip)
+    {
+        const char *name = temp_name();
+
+        CacheLines<16, 4, 64, 2> lines(2, 1);
+        lines.init();
+
+        MemoryRequest request;
+        foreach (i, 40) {
+            W64 addr = 0x10000 + 64 * 7 * i;
+            W64 oldTag = 0;
+            request.set_physical_address(addr);
+            CacheLine *line = lines.insert(&request, oldTag);
+            line->init(lines.tagOf(addr));
+            line->state = 1 + (i % 3);
+        }
+
+        /* Invalid lines are not saved */
+        request.set_physical_address(0x10000 + 64 * 7 * 39);
+        lines.probe(&request)->state = 0;
+
+        dynarray<CacheLine> saved;
+        lines.get_valid_lines(saved);
+
+        WarmState save;
+        ASSERT_TRUE(save.open_save(name));
+        save.begin_section("L2_0");
+        lines.transfer_warm_state(save);
+        save.end_section();
+        save.close();
+
+        /* Into the other backend */
+        VectorCacheLines<16, 4, 64, 2> vlines(2, 1);
+        vlines.init();
+
+        WarmState load;
+        ASSERT_TRUE(load.open_load(name));
+        ASSERT_TRUE(load.next_section());
+        vlines.transfer_warm_state(load);
+        EXPECT_TRUE(load.ok());
+
+        dynarray<CacheLine> loaded;
+        vlines.get_valid_lines(loaded);
+        ASSERT_EQ(saved.count(), loaded.count());
+
+        foreach (i, saved.count()) {
+            request.set_physical_address(saved[i].tag);
+            CacheLine *line = vlines.probe(&request);
+            ASSERT_TRUE(line != NULL);
+            EXPECT_EQ(saved[i].state, line->state);
+        }
+
+        request.set_physical_address(0x10000 + 64 * 7 * 39);
+        EXPECT_TRUE(vlines.probe(&request) == NULL);
+
+        unlink(name);
+    }
+};
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <warmupdetect.h>
+
+namespace {
+
+    /* Adds a window of the given events and miss rate to every metric */
+    bool add_window(WarmupConvergence& conv, W64 *events, W64 *misses,
+            W64 window_events, double rate)
+    {
+        foreach (i, WarmupConvergence::METRIC_COUNT) {
+            events[i] += window_events;
+            misses[i] += W64(window_events * rate);
+        }
+        return conv.add_window(events, misses);
+    }
+
+    TEST(WarmupConvergence, StableRates)
+    {
+        WarmupConvergence conv;
+        conv.history = 3;
+        conv.error = 0.05;
+
+        W64 events[WarmupConvergence::METRIC_COUNT];
+        W64 misses[WarmupConvergence::METRIC_COUNT];
+        setzero(events);
+        setzero(misses);
+        conv.start(events, misses);
+
+        /* Cold caches miss a lot at first */
+        EXPECT_FALSE(add_window(conv, events, misses, 10000, 0.5));
+        EXPECT_FALSE(add_window(conv, events, misses, 10000, 0.1));
+        EXPECT_FALSE(add_window(conv, events, misses, 10000, 0.1));
+        EXPECT_TRUE(add_window(conv, events, misses, 10000, 0.1));
+
+        double mean;
+        EXPECT_DOUBLE_EQ(0, conv.spread(WarmupConvergence::METRIC_L2, mean));
+        EXPECT_DOUBLE_EQ(0.1, mean);
+        EXPECT_EQ(4, conv.windows);
+    }
+
+    TEST(WarmupConvergence, VaryingRates)
+    {
+        WarmupConvergence conv;
+        conv.history = 3;
+        conv.error = 0.05;
+
+        W64 events[WarmupConvergence::METRIC_COUNT];
+        W64 misses[WarmupConvergence::METRIC_COUNT];
+        setzero(events);
+        setzero(misses);
+        conv.start(events, misses);
+
+        foreach (i, 10) {
+            double rate = (i % 2) ? 0.1 : 0.2;
+            EXPECT_FALSE(add_window(conv, events, misses, 10000, rate));
+        }
+
+        double mean;
+        EXPECT_DOUBLE_EQ(0.1, conv.spread(WarmupConvergence::METRIC_L1D,
+                    mean));
+    }
+
+    TEST(WarmupConvergence, FewEventsIgnored)
+    {
+        WarmupConvergence conv;
+        conv.history = 2;
+        conv.error = 0.05;
+
+        W64 events[WarmupConvergence::METRIC_COUNT];
+        W64 misses[WarmupConvergence::METRIC_COUNT];
+        setzero(events);
+        setzero(misses);
+        conv.start(events, misses);
+
+        /* An L3 that is hardly used misses all of its few accesses */
+        foreach (i, 3) {
+            foreach (j, WarmupConvergence::METRIC_COUNT) {
+                W64 e = (j == WarmupConvergence::METRIC_L3) ?
+                    (i + 1) * 10 : 10000;
+                events[j] += e;
+                misses[j] += (j == WarmupConvergence::METRIC_L3) ?
+                    e * i / 3 : e / 20;
+            }
+            conv.add_window(events, misses);
+        }
+
+        double mean;
+        EXPECT_DOUBLE_EQ(-1, conv.spread(WarmupConvergence::METRIC_L3, mean));
+        EXPECT_TRUE(conv.converged());
+    }
+};
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#define DISABLE_ASSERT
+
+#include <writeQueue.h>
+
+using namespace Memory;
+
+namespace {
+
+    TEST(WriteQueue, DisabledByDefault)
+    {
+        WriteDrain drain;
+        EXPECT_FALSE(drain.enabled());
+
+        drain.setup(16, 12, 4);
+        EXPECT_TRUE(drain.enabled());
+        EXPECT_FALSE(drain.full(15));
+        EXPECT_TRUE(drain.full(16));
+    }
+
+    TEST(WriteQueue, DrainsBetweenWatermarks)
+    {
+        WriteDrain drain;
+        drain.setup(16, 12, 4);
+
+        EXPECT_FALSE(drain.check_start(11, 100));
+        EXPECT_FALSE(drain.draining);
+
+        EXPECT_TRUE(drain.check_start(12, 100));
+        EXPECT_TRUE(drain.draining);
+
+        /* Only one drain at a time */
+        EXPECT_FALSE(drain.check_start(16, 110));
+
+        /* Keeps going until the low watermark */
+        EXPECT_EQ(0, drain.check_end(5, 150));
+        EXPECT_TRUE(drain.draining);
+        EXPECT_EQ(60, drain.check_end(4, 160));
+        EXPECT_FALSE(drain.draining);
+
+        EXPECT_EQ(0, drain.check_end(0, 200));
+    }
+
+    TEST(WriteQueue, ReadsGoFirst)
+    {
+        WriteDrain drain;
+        drain.setup(16, 12, 4);
+        int read, write;
+
+        EXPECT_EQ(&read, drain.pick(&read, &write, true));
+
+        /* Writes only use a bank when no read waits for any */
+        EXPECT_EQ((int*)NULL, drain.pick((int*)NULL, &write, true));
+        EXPECT_EQ(&write, drain.pick((int*)NULL, &write, false));
+        EXPECT_EQ((int*)NULL, drain.pick((int*)NULL, (int*)NULL, false));
+
+        /* Draining writes go before reads */
+        drain.check_start(12, 0);
+        EXPECT_EQ(&write, drain.pick(&read, &write, true));
+        EXPECT_EQ(&read, drain.pick(&read, (int*)NULL, true));
+    }
+};
@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+
+# benchcmp.py
+#
+# Compare '-run-benchmarks' reports of two builds, one line per benchmark
+# with the change in ns per operation. Run each build (scons bench=1) with
+# '-run-benchmarks old.xml' and '-run-benchmarks new.xml', then:
+#
+#   ptlsim/tools/benchcmp.py old.xml new.xml
+#   ptlsim/tools/benchcmp.py --threshold 5 old.xml new.xml || echo regressed
+#
+# Exits with 1 if any benchmark got slower by more than --threshold percent.
+
+import sys
+import xml.etree.ElementTree as ET
+from optparse import OptionParser
+
+def load(path):
+    """Map of benchmark name to ns per operation of a gtest XML report"""
+    results = {}
+    for case in ET.parse(path).getroot().iter("testcase"):
+        # Older gtest writes properties as testcase attributes
+        value = case.get("ns_per_op")
+        for prop in case.iter("property"):
+            if prop.get("name") == "ns_per_op":
+                value = prop.get("value")
+        if value is not None:
+            results[case.get("name")] = float(value)
+    return results
+
+def main():
+    parser = OptionParser(usage="%prog [options] old.xml new.xml")
+    parser.add_option("--threshold", type="float", default=10.0,
+            help="percent slowdown reported as a regression")
+    (options, args) = parser.parse_args()
+    if len(args) != 2:
+        parser.error("need old and new report")
+
+    old = load(args[0])
+    new = load(args[1])
+    regressed = False
+
+    sys.stdout.write("%-40s %12s %12s %8s\n" %
+            ("benchmark", "old ns/op", "new ns/op", "change"))
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            sys.stdout.write("%-40s %12s %12s\n" % (name,
+                "%.3f" % old[name] if name in old else "-",
+                "%.3f" % new[name] if name in new else "-"))
+            continue
+        change = (new[name] - old[name]) * 100.0 / old[name] if old[name] \
+                else 0.0
+        mark = ""
+        if change > options.threshold:
+            mark = "  REGRESSION"
+            regressed = True
+        sys.stdout.write("%-40s %12.3f %12.3f %+7.1f%%%s\n" %
+                (name, old[name], new[name], change, mark))
+
+    sys.exit(1 if regressed else 0)
+
+if __name__ == "__main__":
+    main()
@@ -50,6 +50,8 @@ machine_includes = '''
 #include <basecore.h>
 #include <memoryHierarchy.h>
 #include <cpuController.h>
+#include <statFormula.h>
+#include <energyModel.h>
 
 '''
 
@@ -73,6 +75,32 @@ machine_func_end = '''
 MachineBuilder %s("%s", &gen_%s_machine);
 '''
 
+machine_formula_add = '''
+    StatsBuilder::get().add_formula("%s", "%s");
+'''
+
+machine_formula_add_periodic = '''
+    StatsBuilder::get().add_formula("%s", "%s")->enable_periodic_dump();
+'''
+
+machine_energy_start = '''
+    {
+        EnergyModel energy;
+'''
+
+machine_energy_add = '''
+        energy.add("%s", "%s", %s);
+'''
+
+machine_energy_cycles = '''
+        energy.set_cycles("%s");
+'''
+
+machine_energy_end = '''
+        energy.setup(machine.get_num_cores(), config.core_freq_hz);
+    }
+'''
+
 machine_core_loop_start = '''
     while(!machine.context_used.allset()) {
 '''
@@ -108,6 +136,15 @@ machine_core_create = '''
         if (machine.context_used.allset()) break;
 '''
 
+machine_core_create_paired = '''
+        CoreBuilder::add_new_core(machine, "%s", "%s");
+'''
+
+machine_peer_create = '''
+        CoreBuilder::add_migration_peer(machine, "%s", "%s");
+        if (machine.context_used.allset()) break;
+'''
+
 machine_controller_create = '''
         ControllerBuilder::add_new_cont(machine, i, "%s", "%s", %s);
 '''
@@ -148,10 +185,32 @@ machine_core_option_add = '''
 '''
 
 cache_typedef_cacheline = '''
-typedef CacheLines<%s, %s, %s, %s> %sCacheLines;
+typedef %s<%s, %s, %s, %s%s> %sCacheLines;
 
 '''
 
+# Cache line storage backends selectable with 'LINES_BACKEND' param
+cache_lines_backends = {
+        'array'  : 'CacheLines',
+        'vector' : 'VectorCacheLines',
+        }
+
+# Replacement policies of the 'vector' backend, 'REPLACEMENT' param
+cache_replacement_policies = {
+        'bit-plru'  : 'BitPLRU',
+        'tree-plru' : 'TreePLRU',
+        'srrip'     : 'SRRIP',
+        'brrip'     : 'BRRIP',
+        'drrip'     : 'DRRIP',
+        }
+
+# Line compression of the 'compressed' backend, 'COMPRESSION' param, and
+# the default decompression latency of each
+cache_compressions = {
+        'bdi' : ('LINE_COMPRESSION_BDI', 1),
+        'fpc' : ('LINE_COMPRESSION_FPC', 5),
+        }
+
 cache_case_stmt = '''
         case %s:
             return new %s(%s_READ_PORTS, %s_WRITE_PORTS);
@@ -387,7 +446,9 @@ def write_machine_headers(out_file):
     out_file.write(machine_namespaces)
 
 def write_option_logic(st, of, name, opt, val):
-    if type(val) == str:
+    if val == "$NUMCORES":
+        val = "machine.get_num_cores()"
+    elif type(val) == str:
         val = '"%s"' % val
     elif type(val) == bool:
         val = '%s' % str(val).lower()
@@ -399,9 +460,25 @@ def get_cache_cfg(config, name):
             return cache
     return None
 
+def get_cont_cfg(config, name):
+    cont = get_cache_cfg(config, name)
+    if cont:
+        return cont
+    for mem in config.get("memory", []):
+        if mem["name_prefix"] == name:
+            return mem
+    return None
+
+def is_per_core(cont_cfg):
+    return cont_cfg["insts"] == "$NUMCORES"
+
+def is_migration_peer(core):
+    return core.get("migration_peer", False) == True
+
 def write_core_logic(config, m_conf, of):
     of.write(machine_core_loop_start)
-    for core in m_conf["cores"]:
+    cores = m_conf["cores"]
+    for idx, core in enumerate(cores):
         assert config["core"].has_key(core["type"]), \
                 "Can't find core configuration %s" % core["type"]
         core_cfg = config["core"][core["type"]]
@@ -411,8 +488,19 @@ def write_core_logic(config, m_conf, of):
                 write_option_logic(machine_core_option_add, of,
                         core["name_prefix"], key, val)
 
-        of.write(machine_core_create % (core["name_prefix"],
-            core["type"]))
+        # A migration peer runs the contexts of the core before it, so
+        # that core can't end the loop when it takes the last contexts
+        if is_migration_peer(core):
+            assert idx > 0 and not is_migration_peer(cores[idx - 1]), \
+                    "Migration peer %s must follow a core that is not " \
+                    "a peer" % core["name_prefix"]
+            template = machine_peer_create
+        elif idx + 1 < len(cores) and is_migration_peer(cores[idx + 1]):
+            template = machine_core_create_paired
+        else:
+            template = machine_core_create
+
+        of.write(template % (core["name_prefix"], core["type"]))
     of.write(machine_loop_end)
 
 def write_cont_logic(config, m_conf, of, n1, n2):
@@ -481,9 +569,13 @@ def write_interconn_logic(config, m_conf, of):
                 if cont[-1] == '*':
                     all_conts = True
                     if 'core' not in cont:
-                        c_cfg = get_cache_cfg(m_conf, cont.rstrip('*'))
+                        # All per core caches, or all 'insts' instances of
+                        # a cache or memory controller, e.g. interleaved
+                        # memory controllers on a bus
+                        c_cfg = get_cont_cfg(m_conf, cont.rstrip('*'))
                         assert c_cfg, "Can't find cache for %s" % cont
-                        assert c_cfg["insts"] == "$NUMCORES"
+                        assert is_per_core(c_cfg) or \
+                                str(c_cfg["insts"]).isdigit()
 
             if all_cores:
                 assert all_conts == False, \
@@ -540,7 +632,12 @@ def write_interconn_logic(config, m_conf, of):
                     conn_type = 'INTERCONN_TYPE_%s' % conn_type
                     if cont[-1] == '*':
                         cont = cont.rstrip('*')
-                        of.write(machine_for_each_core_loop_j)
+                        c_cfg = get_cont_cfg(m_conf, cont)
+                        if c_cfg and not is_per_core(c_cfg):
+                            of.write(machine_for_each_num_loop_j %
+                                    int(c_cfg["insts"]))
+                        else:
+                            of.write(machine_for_each_core_loop_j)
                         of.write(machine_add_connection_j % (cont,
                             cont, cont, cont, conn_type))
                         of.write(machine_loop_end_j)
@@ -569,6 +666,37 @@ def write_interconn_logic(config, m_conf, of):
 
             count += 1
 
+def write_stats_logic(m_conf, of):
+    # Formulas are compiled in this order, so each can use the ones above
+    for formula in m_conf.get("stats", []):
+        assert formula.has_key("name") and formula.has_key("expr"), \
+                "Stats formula needs 'name' and 'expr': %s" % formula
+        expr = str(formula["expr"])
+        if formula.get("periodic", False) == True:
+            template = machine_formula_add_periodic
+        else:
+            template = machine_formula_add
+        of.write(template % (formula["name"], expr))
+
+def write_energy_logic(m_conf, of):
+    energy = m_conf.get("energy", None)
+    if not energy:
+        return
+
+    # Formulas of the components go after the ones of 'stats'
+    of.write(machine_energy_start)
+    for comp in sorted(energy.keys()):
+        if comp == "cycles":
+            continue
+        events = energy[comp]
+        assert type(events) == dict, \
+                "Energy of %s needs 'stat: nJ' entries" % comp
+        for stat in sorted(events.keys()):
+            of.write(machine_energy_add % (comp, stat, float(events[stat])))
+    if energy.has_key("cycles"):
+        of.write(machine_energy_cycles % energy["cycles"])
+    of.write(machine_energy_end)
+
 def fill_cache_info(cfg, cache_info, pfx):
     size = get_cache_size(cfg["params"]["SIZE"])
     assoc = cfg["params"]["ASSOC"]
@@ -596,7 +724,11 @@ def gen_handle_cpuid_fn(config, m_conf, m_name, of):
                 fill_cache_info(cfg, cache_info, "L1I")
         elif "2" in cache["name_prefix"]:
             fill_cache_info(cfg, cache_info, "L2")
-            if cache["insts"] == "$NUMCORES":
+            if cache.has_key("option") and \
+                    cache["option"].has_key("slices"):
+                # Slices of a banked L2 are shared by all cores
+                cache_info["CORES_PER_L2"] = "(NUMBER_OF_CORES)"
+            elif cache["insts"] == "$NUMCORES":
                 cache_info["CORES_PER_L2"] = "1"
             else:
                 num_l2_inst = int(cache["insts"])
@@ -645,6 +777,12 @@ def generate_machine(config, options):
         # Write interconnect and connection logic
         write_interconn_logic(config, m_conf, of)
 
+        # Write derived stats of the machine
+        write_stats_logic(m_conf, of)
+
+        # Write energy and power formulas of the machine
+        write_energy_logic(m_conf, of)
+
         # Connect cpuid handler function
         of.write(set_handle_cpuid_fn_ptr % (m_name))
 
@@ -686,6 +824,8 @@ def generate_cache_logic(config, options):
         for cache, cfg in config["cache"].items():
             # First write all params
             for param,val in cfg["params"].items():
+                if param in ("LINES_BACKEND", "REPLACEMENT", "COMPRESSION"):
+                    continue
                 of.write("#define %s_%s %s\n" % (cache.upper(), param,
                     str(val)))
             # Find the number of sets
@@ -699,12 +839,74 @@ def generate_cache_logic(config, options):
             of.write("#define %s_%s %d\n" % (cache.upper(), "SETS",
                 sets))
 
+            backend = cfg["params"].get("LINES_BACKEND", "array")
+            if backend not in cache_lines_backends:
+                _error("Unknown LINES_BACKEND '%s' for cache %s" % (
+                    backend, cache))
+
+            # Set sampling keeps the sampled sets in vector lines
+            sample = cfg["params"].get("SAMPLE_SETS", None)
+            sample_arg = ""
+            if sample:
+                if "LINES_BACKEND" in cfg["params"] and backend != "vector":
+                    _error("SAMPLE_SETS of cache %s needs vector lines" %
+                            cache)
+                if sample & (sample - 1) or sample > sets:
+                    _error("SAMPLE_SETS of cache %s must be a power of two "
+                            "no larger than its %d sets" % (cache, sets))
+                sample_arg = ", " + c_pfx + "SAMPLE_SETS"
+
+            policy = ""
+            replacement = cfg["params"].get("REPLACEMENT", None)
+            if replacement:
+                if backend != "vector" and not sample:
+                    _error("REPLACEMENT of cache %s needs 'LINES_BACKEND: "
+                            "vector'" % cache)
+                if replacement not in cache_replacement_policies:
+                    _error("Unknown REPLACEMENT '%s' for cache %s" % (
+                        replacement, cache))
+                if replacement == "tree-plru" and assoc & (assoc - 1):
+                    _error("tree-plru of cache %s needs a power of two "
+                            "ASSOC" % cache)
+                policy_sets = c_pfx + "SETS"
+                if sample:
+                    policy_sets += " / " + c_pfx + "SAMPLE_SETS"
+                policy = ", %s<%s, %s> " % (
+                        cache_replacement_policies[replacement],
+                        policy_sets, c_pfx + "ASSOC")
+
+            lines_class = cache_lines_backends[backend]
+            if sample:
+                lines_class = "SampledCacheLines"
+
+            # Compressed lines pack variable sized lines in extra tags
+            compression = cfg["params"].get("COMPRESSION", None)
+            if compression:
+                if compression not in cache_compressions:
+                    _error("Unknown COMPRESSION '%s' for cache %s" % (
+                        compression, cache))
+                if sample or policy or "LINES_BACKEND" in cfg["params"]:
+                    _error("COMPRESSION of cache %s can't be used with "
+                            "LINES_BACKEND, SAMPLE_SETS or REPLACEMENT" %
+                            cache)
+                scheme, decompress = cache_compressions[compression]
+                decompress = cfg["params"].get("DECOMPRESS_LATENCY",
+                        decompress)
+                tags = cfg["params"].get("COMPRESSION_TAGS", 2)
+                if tags < 1:
+                    _error("COMPRESSION_TAGS of cache %s must be at least "
+                            "1" % cache)
+                lines_class = "CompressedCacheLines"
+                sample_arg = ", %s, %d, %d" % (scheme, decompress, tags)
+
             # Now write typedef CacheLine
             of.write(cache_typedef_cacheline % (
+                lines_class,
                 c_pfx + "SETS",
                 c_pfx + "ASSOC",
                 c_pfx + "LINE_SIZE",
                 c_pfx + "LATENCY",
+                sample_arg + policy,
                 c_pfx))
 
             typedefs[cache] = c_pfx + "CacheLines"
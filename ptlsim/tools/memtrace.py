@@ -0,0 +1,182 @@
+#!/usr/bin/env python
+
+# memtrace.py
+#
+# Write memory access traces replayed with '-memtrace', or synthesize
+# simple ones to benchmark cache, coherence and DRAM configurations:
+#
+#   memtrace.py --pattern stream --cores 4 --count 1000000 stream.mtr
+#   memtrace.py --pattern shared --cores 8 --footprint 64K shared.mtr
+#   memtrace.py --dump stream.mtr | head
+#   memtrace.py --unpack captured.mtrz captured.mtr
+#
+#   import memtrace
+#   w = memtrace.Writer("app.mtr")
+#   w.add(core, memtrace.READ, physaddr, gap=3)
+#
+# See the format description in ptlsim/sim/memtrace.h.
+
+import random
+import struct
+import sys
+import zlib
+from optparse import OptionParser
+
+MAGIC = b"PTLMTRC1"
+PACKED_MAGIC = b"PTLMTRZ1"
+RECORD = struct.Struct("<QQIBBBB")
+BLOCK = struct.Struct("<QIII")
+
+READ, WRITE, IFETCH = range(3)
+TYPE_NAMES = ["read", "write", "ifetch"]
+
+class Writer(object):
+    """Appends records to a new trace file"""
+
+    def __init__(self, path):
+        self.f = open(path, "wb")
+        self.f.write(MAGIC)
+
+    def add(self, core, kind, physaddr, gap=1, rip=0, thread=0):
+        self.f.write(RECORD.pack(physaddr, rip, gap, core, thread, kind, 0))
+
+    def close(self):
+        self.f.close()
+
+def _varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = ord(data[pos:pos + 1])
+        pos += 1
+        value |= (b & 0x7f) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+def _unzigzag(z, prev):
+    return (prev + ((z >> 1) ^ -(z & 1))) & 0xffffffffffffffff
+
+def _packed_records(f):
+    last_cycle = None
+    while True:
+        header = f.read(BLOCK.size)
+        if not header:
+            break
+        if len(header) != BLOCK.size:
+            raise EOFError("truncated block header")
+        cycle, count, raw_size, packed_size = BLOCK.unpack(header)
+        data = zlib.decompress(f.read(packed_size))
+        if len(data) != raw_size:
+            raise ValueError("corrupt block")
+        if last_cycle is None:
+            last_cycle = {}
+            first = cycle
+        prev_addr = {}
+        prev_rip = {}
+        pos = 0
+        for i in range(count):
+            delta, pos = _varint(data, pos)
+            cycle += delta
+            core, thread, kind = struct.unpack("<BBB", data[pos:pos + 3])
+            pos += 3
+            z, pos = _varint(data, pos)
+            addr = _unzigzag(z, prev_addr.get(core, 0))
+            z, pos = _varint(data, pos)
+            rip = _unzigzag(z, prev_rip.get(core, 0))
+            prev_addr[core] = addr
+            prev_rip[core] = rip
+            gap = min(cycle - last_cycle.get(core, first), 0xffffffff)
+            last_cycle[core] = cycle
+            yield addr, rip, gap, core, thread, kind
+
+def records(path):
+    """Yield (physaddr, rip, gap, core, thread, type) of each record of a
+    plain or packed (captured) trace"""
+    f = open(path, "rb")
+    try:
+        magic = f.read(len(MAGIC))
+        if magic == PACKED_MAGIC:
+            for r in _packed_records(f):
+                yield r
+            return
+        if magic != MAGIC:
+            raise ValueError("%s is not a ptlsim memory trace" % path)
+        while True:
+            data = f.read(RECORD.size)
+            if not data:
+                break
+            if len(data) != RECORD.size:
+                raise EOFError("truncated trace file")
+            yield RECORD.unpack(data)[:6]
+    finally:
+        f.close()
+
+def _size(text):
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    if text[-1].upper() in units:
+        return int(text[:-1]) * units[text[-1].upper()]
+    return int(text)
+
+def synthesize(w, pattern, cores, count, footprint, write_ratio, gap, seed):
+    """Interleave 'count' accesses of each core, 64 byte lines"""
+    rng = random.Random(seed)
+    lines = max(1, footprint // 64)
+    for i in range(count):
+        for core in range(cores):
+            if pattern == "stream":
+                # Private region per core, sequential lines
+                addr = (core * lines + i % lines) * 64
+            elif pattern == "random":
+                addr = (core * lines + rng.randrange(lines)) * 64
+            elif pattern == "shared":
+                # All cores on one region, exercises coherence
+                addr = rng.randrange(lines) * 64
+            else:
+                raise ValueError("unknown pattern %s" % pattern)
+            kind = WRITE if rng.random() < write_ratio else READ
+            w.add(core, kind, addr, gap)
+
+def main():
+    parser = OptionParser(usage="%prog [options] trace-file")
+    parser.add_option("--pattern", default="stream",
+            help="stream, random or shared")
+    parser.add_option("--cores", type="int", default=1)
+    parser.add_option("--count", type="int", default=100000,
+            help="accesses of each core")
+    parser.add_option("--footprint", default="4M",
+            help="bytes touched by each core (K, M, G suffixes)")
+    parser.add_option("--write-ratio", type="float", default=0.3)
+    parser.add_option("--gap", type="int", default=1,
+            help="cycles between accesses of a core")
+    parser.add_option("--seed", type="int", default=1)
+    parser.add_option("--dump", action="store_true",
+            help="print records of an existing trace")
+    parser.add_option("--unpack", action="store_true",
+            help="convert a captured trace to a plain one: captured plain")
+    (options, args) = parser.parse_args()
+    if options.unpack:
+        if len(args) != 2:
+            parser.error("need captured and plain trace files")
+        w = Writer(args[1])
+        for addr, rip, gap, core, thread, kind in records(args[0]):
+            w.add(core, kind, addr, gap, rip, thread)
+        w.close()
+        return
+    if len(args) != 1:
+        parser.error("need one trace file")
+
+    if options.dump:
+        for addr, rip, gap, core, thread, kind in records(args[0]):
+            sys.stdout.write("core %d thread %d %-6s 0x%x rip 0x%x gap %d\n"
+                    % (core, thread, TYPE_NAMES[kind], addr, rip, gap))
+        return
+
+    w = Writer(args[0])
+    synthesize(w, options.pattern, options.cores, options.count,
+            _size(options.footprint), options.write_ratio, options.gap,
+            options.seed)
+    w.close()
+
+if __name__ == "__main__":
+    main()
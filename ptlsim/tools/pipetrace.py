@@ -0,0 +1,185 @@
+#!/usr/bin/env python
+
+# pipetrace.py
+#
+# Convert the uop stages recorded with '-pipe-trace' into a Kanata log for
+# the Konata pipeline viewer (https://github.com/shioyadan/Konata):
+#
+#   qemu-system-x86_64 ... -simconfig "-tracefile run.trc -pipe-trace
+#       -pipe-trace-start 1000000 -pipe-trace-cycles 20000 ..."
+#   pipetrace.py -o run.kanata run.trc
+#
+# Each uop gets one row from fetch to commit or annul, with a stage per
+# record: F fetch, Rn rename, Ds dispatch, Is issue, Cp complete, Wb
+# writeback, Rp replay and Rd redispatch. Uops a flush or fetch redirect
+# drops before rename are shown as flushed too.
+
+import sys
+from optparse import OptionParser
+
+import ptltrace
+
+STAGES = {
+    "UOP_FETCH": "F",
+    "UOP_RENAME": "Rn",
+    "UOP_DISPATCH": "Ds",
+    "UOP_ISSUE": "Is",
+    "UOP_COMPLETE": "Cp",
+    "UOP_WRITEBACK": "Wb",
+    "UOP_REPLAY": "Rp",
+    "UOP_REDISPATCH": "Rd",
+}
+
+def _unpack_name(packed):
+    chars = []
+    for i in range(8):
+        c = (packed >> (i * 8)) & 0xff
+        if not c:
+            break
+        chars.append(chr(c))
+    return "".join(chars)
+
+class Uop(object):
+    def __init__(self, kid, uuid):
+        self.kid = kid
+        self.uuid = uuid
+        self.stage = None
+        self.renamed = False
+
+class KanataWriter(object):
+    """Write uop records of a trace as a Kanata 0004 log"""
+
+    def __init__(self, trace, out, component=None):
+        self.trace = trace
+        self.out = out
+        self.component = component
+        self.cycle = None
+        self.next_id = 0
+        self.next_retire = 0
+        self.inflight = {}
+        self.threads = {}
+        self.events = [name for name, fmt in trace.events]
+
+    def emit(self, *fields):
+        self.out.write("\t".join(str(f) for f in fields) + "\n")
+
+    def clock(self, cycle):
+        if self.cycle is None:
+            self.emit("C=", cycle)
+        elif cycle != self.cycle:
+            self.emit("C", cycle - self.cycle)
+        self.cycle = cycle
+
+    def stage(self, uop, name):
+        if uop.stage:
+            self.emit("E", uop.kid, 0, uop.stage)
+        uop.stage = name
+        if name:
+            self.emit("S", uop.kid, 0, name)
+
+    def retire(self, component, uop, flushed):
+        self.stage(uop, None)
+        self.emit("R", uop.kid, self.next_retire, 1 if flushed else 0)
+        if not flushed:
+            self.next_retire += 1
+        del self.inflight[(component, uop.uuid)]
+
+    def flush(self, component, before=None):
+        for key in sorted(self.inflight):
+            uop = self.inflight[key]
+            if key[0] != component:
+                continue
+            if before is not None and (uop.renamed or uop.uuid >= before):
+                continue
+            self.retire(component, uop, True)
+
+    def fetch(self, component, args):
+        uuid, rip, name, flags = args
+        tid = self.threads.setdefault(component, len(self.threads))
+        uop = Uop(self.next_id, uuid)
+        self.next_id += 1
+        self.inflight[(component, uuid)] = uop
+
+        label = "%#x %s" % (rip, _unpack_name(name))
+        if flags & 1:
+            label = "[" + label
+        if flags & 2:
+            label += "]"
+        self.emit("I", uop.kid, uuid, tid)
+        self.emit("L", uop.kid, 0, label)
+        self.emit("L", uop.kid, 1, "%s uuid %d" %
+                (self.trace.components.get(component,
+                    "component%d" % component), uuid))
+        self.stage(uop, "F")
+
+    def record(self, record):
+        cycle, component, event, args = record
+        if event >= len(self.events):
+            return
+        name = self.events[event]
+        if self.component and \
+                self.trace.components.get(component) != self.component:
+            return
+
+        if name == "UOP_FETCH":
+            self.clock(cycle)
+            self.fetch(component, args)
+            return
+
+        if name == "OOO_FLUSH":
+            self.clock(cycle)
+            self.flush(component)
+            return
+
+        if name == "UOP_REDIRECT":
+            self.clock(cycle)
+            self.flush(component, args[0])
+            return
+
+        uop = self.inflight.get((component, args[0]))
+        if uop is None or not name.startswith("UOP_"):
+            return
+
+        self.clock(cycle)
+        if name == "UOP_COMMIT":
+            self.retire(component, uop, False)
+        elif name == "UOP_ANNUL":
+            self.retire(component, uop, True)
+        elif name in STAGES:
+            uop.renamed = True
+            self.stage(uop, STAGES[name])
+
+    def write(self):
+        self.emit("Kanata", "0004")
+        for r in self.trace.records(sort=True):
+            self.record(r)
+        # Uops still in flight at the end of the trace are left open
+        for key in sorted(self.inflight):
+            self.stage(self.inflight[key], None)
+        return self.next_id
+
+if __name__ == "__main__":
+    opt = OptionParser("usage: %prog [options] <trace file>")
+    opt.add_option("-o", "--output", dest="output", default=None,
+            help="Write the Kanata log to this file instead of stdout")
+    opt.add_option("-c", "--component", dest="component", default=None,
+            help="Only convert uops of this thread, e.g. core_0_thread0")
+    (options, args) = opt.parse_args()
+
+    if len(args) != 1:
+        opt.error("specify one trace file")
+
+    trace = ptltrace.Trace(args[0])
+    out = sys.stdout
+    if options.output:
+        out = open(options.output, "w")
+    uops = KanataWriter(trace, out, options.component).write()
+    if options.output:
+        out.close()
+
+    if not uops:
+        sys.stderr.write("no uops in trace, was it run with -pipe-trace?\n")
+    for ring in sorted(trace.dropped):
+        if trace.dropped[ring]:
+            sys.stderr.write("thread %d dropped %d records, raise "
+                    "-trace-buffer\n" % (ring, trace.dropped[ring]))
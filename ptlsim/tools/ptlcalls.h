@@ -77,6 +77,45 @@ static inline W64 ptlcall_rdtsc() {
 #define PTLCALL_METHOD_OPCODE   0x1  // x86 opcode 0x0f37
 #define PTLCALL_METHOD_MMIO     0x2  // MMIO store to physical address in %rdx[15:0] : %rcx[31:0]
 #define PTLCALL_METHOD_IOPORT   0x4  // OUT to I/O port number in %rdx[31:16]
+#define PTLCALL_METHOD_RING     0x8  // Shared ring of calls just below the MMIO page
+
+//
+// Ring of asynchronous PTLCALLs, in guest physical memory right below the
+// MMIO page and mapped from /dev/mem like it:
+//
+// Calls without a result (markers, log lines, stats regions) can be
+// posted here with plain stores instead of trapping through the MMIO
+// page. The simulator services the ring at the next cycle boundary (or
+// its next main loop in native mode), in post order, so with many
+// threads posting a marker is a few stores to memory.
+//
+// A writer takes slot 'reserve' with a compare and swap, fills the entry
+// and then sets its 'seq' to slot + 1. The simulator services entries in
+// order up to the first one not written yet and moves 'tail' past them.
+// A ring with PTLCALL_RING_ENTRIES entries not yet serviced is full: the
+// writer counts it in 'full' and falls back to the MMIO call.
+//
+#define PTLCALL_RING_SIZE       65536
+#define PTLCALL_RING_ENTRIES    511
+#define PTLCALL_RING_DATA_MAX   96
+
+struct PTLCallRingEntry {
+  volatile W64 seq;     // slot + 1 once the entry is written
+  W32 callid;
+  W32 length;           // bytes used in data
+  W64 arg1;
+  W64 arg2;
+  char data[PTLCALL_RING_DATA_MAX];
+};
+
+struct PTLCallRing {
+  volatile W64 reserve; // next slot to write, moved by the guest
+  volatile W64 full;    // posts that found the ring full
+  W64 pad0[6];
+  volatile W64 tail;    // next slot to service, moved by the simulator
+  W64 pad1[7];
+  struct PTLCallRingEntry entries[PTLCALL_RING_ENTRIES];
+};
 
 #ifdef PTLCALLS_USERSPACE
 //
@@ -99,6 +138,7 @@ static int selected_ptlcall_method __attribute__((common)) = -1;
 static W64 ptlcall_mmio_page_physaddr __attribute__((common)) = 0;
 static W64* ptlcall_mmio_page_virtaddr __attribute__((common)) = NULL;
 static W16 ptlcall_io_port __attribute__((common)) = 0;
+static struct PTLCallRing* ptlcall_ring_page __attribute__((common)) = NULL;
 
 static int ptlsim_ptlcall_init() {
   W32 rax = PTLSIM_CPUID_MAGIC;
@@ -153,6 +193,20 @@ static int ptlsim_ptlcall_init() {
     // Adjust the pointer to the actual trigger word within the page (usually always offset 0)
     ptlcall_mmio_page_virtaddr = (W64*)(((Waddr)ptlcall_mmio_page_virtaddr) + ptlcall_mmio_page_offset);
 
+    // Without the ring all calls go through the MMIO page
+    if (supported_ptlcall_methods & PTLCALL_METHOD_RING) {
+      void* ring = mmap(NULL, PTLCALL_RING_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+                        ptlcall_mmio_page_physaddr - PTLCALL_RING_SIZE);
+
+      if (ring == MAP_FAILED) {
+        fprintf(stderr, "ptlsim_ptlcall_init: cannot mmap %s for the PTLcall ring (%s)\n",
+                mmap_filename, strerror(errno));
+        supported_ptlcall_methods &= ~PTLCALL_METHOD_RING;
+      } else {
+        ptlcall_ring_page = (struct PTLCallRing*)ring;
+      }
+    }
+
     close(fd);
 
     selected_ptlcall_method = PTLCALL_METHOD_MMIO;
@@ -210,6 +264,43 @@ static inline W64 ptlcall(W64 op, W64 arg1, W64 arg2, W64 arg3, W64 arg4, W64 ar
   }
 }
 
+//
+// Post a call to the ring, returns 0 if there is no ring, the data doesn't
+// fit in an entry or the ring is full
+//
+static inline int ptlcall_ring_post(W32 callid, W64 arg1, W64 arg2,
+                                    const char* data, W32 length) {
+  struct PTLCallRing* ring;
+  struct PTLCallRingEntry* entry;
+  W64 slot;
+
+  if (!is_running_under_ptlsim() || !ptlcall_ring_page ||
+      length > PTLCALL_RING_DATA_MAX)
+    return 0;
+
+  ring = ptlcall_ring_page;
+
+  do {
+    slot = ring->reserve;
+    if (slot - ring->tail >= PTLCALL_RING_ENTRIES) {
+      __sync_fetch_and_add(&ring->full, 1);
+      return 0;
+    }
+  } while (!__sync_bool_compare_and_swap(&ring->reserve, slot, slot + 1));
+
+  entry = &ring->entries[slot % PTLCALL_RING_ENTRIES];
+  entry->callid = callid;
+  entry->length = length;
+  entry->arg1 = arg1;
+  entry->arg2 = arg2;
+  if (length)
+    memcpy(entry->data, data, length);
+
+  __sync_synchronize();
+  entry->seq = slot + 1;
+  return 1;
+}
+
 #endif // PTLCALLS_USERSPACE
 
 //
@@ -233,6 +324,9 @@ static inline W64 ptlcall_version() {
 
 #ifdef PTLCALLS_USERSPACE
 static inline W64 ptlcall_marker(W64 marker) {
+  if (ptlcall_ring_post(PTLCALL_MARKER, marker, 0, NULL, 0))
+    return 0;
+
   return ptlcall(PTLCALL_MARKER, marker, 0, 0, 0, 0, 0);
 }
 
@@ -428,6 +522,160 @@ static inline void ptlcall_log(const char* log)
 	ptlcall(PTLCALL_LOG, (W64)log, length, 0, 0, 0, 0);
 }
 
+// Through the ring if it fits, logged at the cycle it is serviced
+static inline void ptlcall_log_async(const char* log)
+{
+	int length = strlen(log);
+	if (!ptlcall_ring_post(PTLCALL_LOG, 0, 0, log, length))
+		ptlcall(PTLCALL_LOG, (W64)log, length, 0, 0, 0, 0);
+}
+
+#endif // PTLCALLS_USERSPACE
+
+//
+// Named stats regions: counters updated between begin and end of a
+// region, summed over all its entries, are dumped in a stats document
+// of their own tagged 'region' and the region name. Regions with
+// different names can overlap. Names are cut at 63 characters.
+//
+#define PTLCALL_STATS_REGION 6
+#define PTLCALL_STATS_REGION_NAME_MAX 63
+
+#define PTLCALL_STATS_REGION_BEGIN 0
+#define PTLCALL_STATS_REGION_END   1
+
+#ifdef PTLCALLS_USERSPACE
+
+static inline W64 ptlcall_stats_region_begin(const char* name)
+{
+	return ptlcall(PTLCALL_STATS_REGION, (W64)name, strlen(name),
+			PTLCALL_STATS_REGION_BEGIN, 0, 0, 0);
+}
+
+static inline W64 ptlcall_stats_region_end(const char* name)
+{
+	return ptlcall(PTLCALL_STATS_REGION, (W64)name, strlen(name),
+			PTLCALL_STATS_REGION_END, 0, 0, 0);
+}
+
+// Through the ring if the name fits, without the result of the call
+static inline void ptlcall_stats_region_async(const char* name, W64 op)
+{
+	int length = strlen(name);
+	if (!ptlcall_ring_post(PTLCALL_STATS_REGION, op, 0, name, length))
+		ptlcall(PTLCALL_STATS_REGION, (W64)name, length, op, 0, 0, 0);
+}
+
+static inline void ptlcall_stats_region_begin_async(const char* name)
+{
+	ptlcall_stats_region_async(name, PTLCALL_STATS_REGION_BEGIN);
+}
+
+static inline void ptlcall_stats_region_end_async(const char* name)
+{
+	ptlcall_stats_region_async(name, PTLCALL_STATS_REGION_END);
+}
+
+#endif // PTLCALLS_USERSPACE
+
+//
+// Migration between the cores of a big.LITTLE pair: moves the Contexts of
+// the core pair running the calling CPU to the primary core (defined first
+// in the machine config), to its migration peer or to the other one. The
+// move starts at the next cycle. Returns -1 if the CPU is not run by a
+// core pair.
+//
+#define PTLCALL_MIGRATE 7
+
+#define PTLCALL_MIGRATE_PRIMARY 0
+#define PTLCALL_MIGRATE_PEER    1
+#define PTLCALL_MIGRATE_SWAP    2
+
+#ifdef PTLCALLS_USERSPACE
+
+static inline W64 ptlcall_migrate(W64 target)
+{
+	return ptlcall(PTLCALL_MIGRATE, target, 0, 0, 0, 0, 0);
+}
+
+#endif // PTLCALLS_USERSPACE
+
+//
+// Frequency of a clock domain in MHz, from 1 to the -corefreq of the
+// simulation: the domain of the core running the calling CPU, or a domain
+// by name (a core name like 'ooo_0' or a name used in the 'clock_domain'
+// option of caches). Returns -1 if there's no such domain or the frequency
+// is out of range.
+//
+#define PTLCALL_SET_FREQ 8
+
+#define PTLCALL_SET_FREQ_NAME_MAX 63
+
+#ifdef PTLCALLS_USERSPACE
+
+static inline W64 ptlcall_set_core_freq(W64 mhz)
+{
+	return ptlcall(PTLCALL_SET_FREQ, mhz, 0, 0, 0, 0, 0);
+}
+
+static inline W64 ptlcall_set_domain_freq(const char* name, W64 mhz)
+{
+	return ptlcall(PTLCALL_SET_FREQ, mhz, (W64)name, strlen(name), 0, 0, 0);
+}
+
+#endif // PTLCALLS_USERSPACE
+
+//
+// Cache way partitioning and memory bandwidth classes of service, like
+// Intel CAT and MBA: map the core running the calling CPU to a class (as
+// an OS does on context switch), or change the way mask of a class in the
+// caches with 'qos_ways' or its MB/s per core in the memory controllers
+// with 'qos_bandwidth' (0 for no limit). Returns -1 for a class out of
+// range or an empty mask.
+//
+#define PTLCALL_QOS 9
+
+#define PTLCALL_QOS_SET_CLOS      0
+#define PTLCALL_QOS_SET_WAYS      1
+#define PTLCALL_QOS_SET_BANDWIDTH 2
+
+#ifdef PTLCALLS_USERSPACE
+
+static inline W64 ptlcall_qos_set_clos(W64 clos)
+{
+	return ptlcall(PTLCALL_QOS, PTLCALL_QOS_SET_CLOS, clos, 0, 0, 0, 0);
+}
+
+static inline W64 ptlcall_qos_set_ways(W64 clos, W64 mask)
+{
+	return ptlcall(PTLCALL_QOS, PTLCALL_QOS_SET_WAYS, clos, mask, 0, 0, 0);
+}
+
+static inline W64 ptlcall_qos_set_bandwidth(W64 clos, W64 mbps)
+{
+	return ptlcall(PTLCALL_QOS, PTLCALL_QOS_SET_BANDWIDTH, clos, mbps,
+			0, 0, 0);
+}
+
+#endif // PTLCALLS_USERSPACE
+
+//
+// Stats of the address space of the calling CPU go to the bank of given
+// id (from 1 to 2^62 - 1) instead of the one of its CR3, with
+// -stats-address-spaces, until it is set to 0 again. Ids let processes
+// that share page tables, or a container of several processes, have one
+// bank. Returns -1 without -stats-address-spaces or for an id out of
+// range.
+//
+#define PTLCALL_STATS_ADDRESS_SPACE 10
+
+#ifdef PTLCALLS_USERSPACE
+
+static inline W64 ptlcall_stats_address_space(W64 id)
+{
+	return ptlcall(PTLCALL_STATS_ADDRESS_SPACE, id, 0, 0, 0, 0, 0);
+}
+
 #endif // PTLCALLS_USERSPACE
 
 #endif // __PTLCALLS_H__
@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+
+# ptltrace.py
+#
+# Render binary event traces written with '-tracefile' as text, one line
+# per record in the style of the ptl_logfile messages they replace:
+#
+#   ptltrace.py run.trc > run.txt
+#   ptltrace.py --sort --component L1_D_0 run.trc
+#
+#   import ptltrace
+#   for cycle, component, event, args in ptltrace.records("run.trc"): ...
+#
+# See the format description in ptlsim/sim/eventtrace.cpp.
+
+import heapq
+import struct
+import sys
+from optparse import OptionParser
+
+MAGIC = b"PTLTRCE1"
+RECORD = struct.Struct("<QII4Q")
+
+def _read_exact(f, size):
+    data = f.read(size)
+    if len(data) != size:
+        raise EOFError("truncated trace file")
+    return data
+
+def _read_w32(f):
+    return struct.unpack("<I", _read_exact(f, 4))[0]
+
+def _read_string(f):
+    return _read_exact(f, _read_w32(f)).decode("ascii")
+
+class Trace(object):
+    """Event table, component names and per thread records of a trace"""
+
+    def __init__(self, path):
+        f = open(path, "rb")
+        try:
+            if _read_exact(f, len(MAGIC)) != MAGIC:
+                raise ValueError("%s is not a ptlsim event trace" % path)
+            self.events = []
+            for i in range(_read_w32(f)):
+                name = _read_string(f)
+                self.events.append((name, _read_string(f)))
+
+            self.components = {}
+            self.threads = {}
+            self.dropped = {}
+            while True:
+                kind = f.read(1)
+                if not kind:
+                    break
+                if kind == b"C":
+                    cid = _read_w32(f)
+                    self.components[cid] = _read_string(f)
+                elif kind == b"R":
+                    ring = _read_w32(f)
+                    count = _read_w32(f)
+                    data = _read_exact(f, count * RECORD.size)
+                    recs = self.threads.setdefault(ring, [])
+                    for i in range(count):
+                        r = RECORD.unpack_from(data, i * RECORD.size)
+                        recs.append((r[0], r[1], r[2], r[3:]))
+                elif kind == b"D":
+                    ring = _read_w32(f)
+                    self.dropped[ring] = struct.unpack("<Q",
+                            _read_exact(f, 8))[0]
+                else:
+                    raise ValueError("corrupt trace chunk %r" % kind)
+        finally:
+            f.close()
+
+    def records(self, sort=False):
+        """Records of all threads, merged into cycle order if sort is set"""
+        if sort:
+            return heapq.merge(*self.threads.values())
+        return (r for ring in sorted(self.threads)
+                for r in self.threads[ring])
+
+    def format(self, record):
+        cycle, component, event, args = record
+        name = self.components.get(component, "component%d" % component)
+        if event < len(self.events):
+            text = self.events[event][1].format(*args)
+        else:
+            text = "unknown event %d %s" % (event, args)
+        return "%d: %s: %s" % (cycle, name, text)
+
+def records(path, sort=True):
+    """Iterate over (cycle, component name, event name, args) of a trace"""
+    trace = Trace(path)
+    for cycle, component, event, args in trace.records(sort):
+        yield (cycle, trace.components.get(component),
+                trace.events[event][0], args)
+
+if __name__ == "__main__":
+    opt = OptionParser("usage: %prog [options] <trace file>")
+    opt.add_option("-o", "--output", dest="output", default=None,
+            help="Write text to this file instead of stdout")
+    opt.add_option("-s", "--sort", dest="sort", action="store_true",
+            default=False, help="Merge records of all threads by cycle")
+    opt.add_option("-c", "--component", dest="component", default=None,
+            help="Only show records of this component")
+    (options, args) = opt.parse_args()
+
+    if len(args) != 1:
+        opt.error("specify one trace file")
+
+    trace = Trace(args[0])
+    out = sys.stdout
+    if options.output:
+        out = open(options.output, "w")
+    for r in trace.records(options.sort):
+        if options.component and \
+                trace.components.get(r[1]) != options.component:
+            continue
+        out.write(trace.format(r) + "\n")
+    for ring in sorted(trace.dropped):
+        if trace.dropped[ring]:
+            sys.stderr.write("thread %d dropped %d records\n" %
+                    (ring, trace.dropped[ring]))
+    if options.output:
+        out.close()
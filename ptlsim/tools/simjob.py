@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+
+# simjob.py
+#
+# Send jobs to a simulator started with '-fork-server <socket>', which
+# forks each one from its warmed up state. Each job is one line of
+# simconfig options; its replies are printed as they come:
+#
+#   ptlsim/tools/simjob.py /tmp/marss.sock "-stopinsns 10m -yamlstats a.yml"
+#   ptlsim/tools/simjob.py --jobs sweep.txt /tmp/marss.sock
+#   ptlsim/tools/simjob.py /tmp/marss.sock quit
+#
+# With --jobs all lines of the file are sent at once and the server runs
+# as many as its -fork-server-jobs allows. Exits with 1 if any job didn't
+# exit with status 0.
+
+import socket
+import sys
+import threading
+from optparse import OptionParser
+
+def run_job(path, line, out, lock):
+    """Send one job line, return the status of its 'done' reply"""
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.connect(path)
+    s.sendall((line.strip() + "\n").encode())
+
+    status = None
+    data = b""
+    while True:
+        chunk = s.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+        while b"\n" in data:
+            reply, data = data.split(b"\n", 1)
+            reply = reply.decode()
+            with lock:
+                out.write("%s\n" % reply)
+                out.flush()
+            words = reply.split()
+            if words and words[0] == "done":
+                status = int(words[-1])
+            elif words and words[0] == "quit":
+                status = 0
+    s.close()
+    return status
+
+def main():
+    parser = OptionParser(usage="%prog [options] socket [options line]")
+    parser.add_option("--jobs", metavar="FILE",
+            help="send each line of FILE as a job")
+    (options, args) = parser.parse_args()
+
+    if options.jobs:
+        if len(args) != 1:
+            parser.error("need the server socket")
+        lines = [l for l in open(options.jobs)
+                if l.strip() and not l.startswith("#")]
+    else:
+        if len(args) != 2:
+            parser.error("need the server socket and an options line")
+        lines = [args[1]]
+
+    lock = threading.Lock()
+    results = [None] * len(lines)
+
+    def worker(i):
+        results[i] = run_job(args[0], lines[i], sys.stdout, lock)
+
+    threads = [threading.Thread(target=worker, args=(i,))
+            for i in range(len(lines))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    sys.exit(0 if all(r == 0 for r in results) else 1)
+
+if __name__ == "__main__":
+    main()
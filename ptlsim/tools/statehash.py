@@ -0,0 +1,107 @@
+#!/usr/bin/env python
+
+# statehash.py
+#
+# Compare the '-state-hash-file' records of two runs of the same checkpoint
+# and machine configuration, e.g. with and without an optimized path, and
+# report the first epoch in which they diverge:
+#
+#   ptlsim/tools/statehash.py base.hash fast.hash
+#   ptlsim/tools/statehash.py --dump base.hash | head
+#
+# Exits with 1 if the runs diverge. See the format description in
+# ptlsim/sim/statehash.h.
+
+import gzip
+import struct
+import sys
+from optparse import OptionParser
+
+MAGIC = b"PTLSTHS1"
+HEADER = struct.Struct("<Q")
+RECORD = struct.Struct("<QQQQQQ")
+
+# Checked in this order, timing changes show in the memory messages first
+HASHES = ["mem_hash", "commit_hash", "stats_hash"]
+FIELDS = ["cycle", "commits", "mem_events", "commit_hash", "mem_hash",
+        "stats_hash"]
+
+def load(path):
+    """Period and list of epoch records (dicts) of a state hash file"""
+    f = gzip.open(path, "rb")
+    data = f.read()
+    f.close()
+    if data[:8] != MAGIC:
+        raise ValueError("%s is not a state hash file" % path)
+    period = HEADER.unpack_from(data, 8)[0]
+    records = []
+    pos = 8 + HEADER.size
+    while pos + RECORD.size <= len(data):
+        records.append(dict(zip(FIELDS, RECORD.unpack_from(data, pos))))
+        pos += RECORD.size
+    return period, records
+
+def first_divergence(a, b):
+    """Index and differing hash of the first divergent epoch, or None"""
+    for i in range(min(len(a), len(b))):
+        if a[i]["cycle"] != b[i]["cycle"]:
+            return i, "cycle"
+        for name in HASHES:
+            if a[i][name] != b[i][name]:
+                return i, name
+    if len(a) != len(b):
+        return min(len(a), len(b)), "length"
+    return None
+
+def dump(path):
+    period, records = load(path)
+    sys.stdout.write("period %d\n" % period)
+    for i, r in enumerate(records):
+        sys.stdout.write("%8d %14d %10d %10d %016x %016x %016x\n" % ((i,) +
+            tuple(r[name] for name in FIELDS)))
+
+def main():
+    parser = OptionParser(usage="%prog [options] a.hash [b.hash]")
+    parser.add_option("--dump", action="store_true", default=False,
+            help="print the records of one file")
+    (options, args) = parser.parse_args()
+
+    if options.dump:
+        if len(args) != 1:
+            parser.error("need one file to dump")
+        dump(args[0])
+        return
+
+    if len(args) != 2:
+        parser.error("need two files to compare")
+
+    period_a, a = load(args[0])
+    period_b, b = load(args[1])
+    if period_a != period_b:
+        sys.stdout.write("periods differ: %d and %d cycles\n" %
+                (period_a, period_b))
+        sys.exit(1)
+
+    found = first_divergence(a, b)
+    if found is None:
+        sys.stdout.write("%d epochs of %d cycles match\n" %
+                (len(a), period_a))
+        sys.exit(0)
+
+    epoch, name = found
+    if name == "length":
+        sys.stdout.write("first %d epochs match, then one run ends\n" %
+                epoch)
+        sys.exit(1)
+
+    ra, rb = a[epoch], b[epoch]
+    start = a[epoch - 1]["cycle"] if epoch else 0
+    sys.stdout.write("first divergent epoch %d, cycles %d to %d: %s "
+            "differs\n" % (epoch, start, ra["cycle"], name))
+    sys.stdout.write("  commits %d and %d, memory events %d and %d\n" %
+            (ra["commits"], rb["commits"], ra["mem_events"],
+                rb["mem_events"]))
+    sys.exit(1)
+
+if __name__ == "__main__":
+    main()
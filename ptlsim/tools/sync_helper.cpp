@@ -2,119 +2,157 @@
  * sync_helper.cpp : A small helper tool for Marss's -sync option
  *
  * This small tool is aimed to help Marss users in -sync option by
- * providing options to manipulate semaphore used for syncing between
- * simulation instances.  Available options are:
+ * providing options to inspect and manipulate the shared memory barrier
+ * used for syncing between simulation instances.  Available options are:
  *
- *    delete   :  Delete the semaphore
- *    set N    :  Set semaphore value to N
+ *    (none)   :  Show barrier state and per instance wait time
+ *    purge    :  Remove instances that died without leaving the barrier
+ *    delete   :  Stop all instances and delete the barrier
  *
  * To compile:
- *    $ g++ sync_helper.cpp -o sync_helper
+ *    $ g++ -I../sim sync_helper.cpp -o sync_helper -lpthread -lrt
  */
 
 
 #include <iostream>
 
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 
-using namespace std;
+#include <ptl-sync.h>
 
-#define SEM_NUM 3764
+using namespace std;
 
-void info(int sem_id)
+void info(MarssSyncShared *shm)
 {
-    int rc;
+    cout << "Barrier generation: " << shm->generation << endl;
+    cout << "Instances: " << shm->members << ", waiting: " <<
+        shm->arrived << (shm->shutdown ? " (shutting down)" : "") << endl;
+
+    for (int i = 0; i < MARSS_SYNC_MAX_INSTANCES; i++) {
+        MarssSyncSlot &slot = shm->slots[i];
+        if (slot.pid == 0)
+            continue;
 
-    rc = semctl(sem_id, 0, GETVAL);
-    cout << "Semaphore value: " << rc << endl;
+        bool alive = (kill(slot.pid, 0) == 0 || errno != ESRCH);
 
-    rc = semctl(sem_id, 0, GETZCNT);
-    cout << "Processes waiting for zero: " << rc << endl;
+        cout << "  [" << i << "] pid " << slot.pid <<
+            (alive ? "" : " (dead)") << (slot.arrived ? " waiting" : "") <<
+            " cycle " << slot.cycle << " barriers " << slot.barriers <<
+            " wait " << (slot.wait_ns / 1000000) << " ms" << endl;
+    }
 }
 
-void remove(int sem_id)
+void lock(MarssSyncShared *shm)
 {
-    int rc;
+    if (pthread_mutex_lock(&shm->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&shm->lock);
+}
 
-    rc = semctl(sem_id, 0, IPC_RMID);
+void wake(MarssSyncShared *shm)
+{
+    syscall(SYS_futex, &shm->generation, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
 
-    if (rc != 0) {
-        cout << "Unable to delete semaphore: ";
-        perror("sem_id");
-        return;
+void purge(MarssSyncShared *shm)
+{
+    int removed = 0;
+
+    lock(shm);
+
+    for (int i = 0; i < MARSS_SYNC_MAX_INSTANCES; i++) {
+        MarssSyncSlot &slot = shm->slots[i];
+        if (slot.pid == 0 || kill(slot.pid, 0) == 0 || errno != ESRCH)
+            continue;
+
+        if (slot.arrived)
+            shm->arrived--;
+        slot.pid = 0;
+        slot.arrived = 0;
+        shm->members--;
+        removed++;
+    }
+
+    /* Release the barrier if only dead instances were holding it */
+    if (shm->members > 0 && shm->arrived >= shm->members) {
+        for (int i = 0; i < MARSS_SYNC_MAX_INSTANCES; i++)
+            shm->slots[i].arrived = 0;
+        shm->arrived = 0;
+        __sync_fetch_and_add(&shm->generation, 1);
     }
 
-    cout << "Semaphore removed." << endl;
+    pthread_mutex_unlock(&shm->lock);
+    wake(shm);
+
+    cout << "Removed " << removed << " dead instances." << endl;
 }
 
-void set(int sem_id, int val)
+void remove(MarssSyncShared *shm, const char *name)
 {
-    int rc;
-
-    rc = semctl(sem_id, 0, SETVAL, val);
+    shm->shutdown = 1;
+    wake(shm);
 
-    if (rc != 0) {
-        cout << "Unable to set semaphore value: ";
-        perror("sem_id");
+    if (shm_unlink(name) != 0) {
+        cout << "Unable to delete barrier: ";
+        perror(name);
         return;
     }
 
-    cout << "Semaphore value set to " << val << endl;
+    cout << "Barrier removed." << endl;
 }
 
 int main(int argc, char** argv)
 {
-    char *env_sem_id_p;
-    int sem_num;
-    int sem_id;
-    int val;
-    int rc;
+    char name[64];
+    int fd;
 
-    /* First check if semaphore exists or not */
+    marss_sync_name(name, sizeof(name));
 
-    env_sem_id_p = getenv("MARSS_SEM_ID");
+    fd = shm_open(name, O_RDWR, 0666);
 
-    if (env_sem_id_p)
-        sem_num = atoi(env_sem_id_p);
-    else
-        sem_num = SEM_NUM;
+    if (fd == -1) {
+        cout << "Unable to access barrier " << name << ".\n";
+        perror("shm_open");
+        exit(0);
+    }
+
+    void *addr = mmap(NULL, sizeof(MarssSyncShared), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
 
-    sem_id = semget(sem_num, 1, IPC_CREAT|IPC_EXCL|0666);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        exit(0);
+    }
 
-    if (sem_id == -1) {
-        if (errno == EEXIST) {
-            sem_id = semget(sem_num, 1, IPC_CREAT|0666);
-        }
+    MarssSyncShared *shm = (MarssSyncShared*)addr;
 
-        if (sem_id == -1) {
-            cout << "Unable to access semaphore.\n";
-            perror("sem_id");
-            exit(0);
-        }
+    if (shm->magic != MARSS_SYNC_MAGIC) {
+        cout << name << " is not a Marss sync barrier.\n";
+        if (argc >= 2 && strcmp("delete", argv[1]) == 0)
+            shm_unlink(name);
+        return -1;
     }
 
-    info(sem_id);
+    info(shm);
 
     if (argc < 2)
         return 0;
 
     if (strcmp("delete", argv[1]) == 0) {
-        remove(sem_id);
-    } else if (strcmp("set", argv[1]) == 0) {
-
-        if (argc < 3) {
-            cout << "Please specify the value to set.\n";
-            return -1;
-        }
-
-        val = atoi(argv[2]);
-        set(sem_id, val);
+        remove(shm, name);
+    } else if (strcmp("purge", argv[1]) == 0) {
+        purge(shm);
     }
 
     return 0;
@@ -0,0 +1,145 @@
+/*
+ * telemetry_helper.cpp : A small reader of Marss's -telemetry pages
+ *
+ * Prints the state of each simulation whose telemetry page is given on
+ * the command line, e.g. all of /dev/shm/marss-*.telemetry:
+ *
+ *    $ telemetry_helper [-stall <seconds>] <file>...
+ *
+ * A running simulation whose page hasn't been updated for -stall seconds
+ * (10 by default) is reported as stalled, and the exit code is the
+ * number of stalled or dead simulations, so a job manager can poll with
+ * it.
+ *
+ * To compile:
+ *    $ g++ -I../sim telemetry_helper.cpp -o telemetry_helper
+ */
+
+
+#include <iostream>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include <ptl-telemetry.h>
+
+using namespace std;
+
+static const char *state_names[] = {
+    "starting", "running", "done", "exited",
+};
+
+uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* Returns true if the simulation is stalled or died */
+bool info(const char *name, const MarssTelemetry &page, double stall)
+{
+    bool alive = (kill(page.pid, 0) == 0 || errno != ESRCH);
+    double age = double(now_ns() - page.update_ns) / 1e9;
+    const char *state = (page.state <= MARSS_TELEMETRY_EXITED) ?
+        state_names[page.state] : "unknown";
+
+    bool bad = false;
+    cout << name << ": pid " << page.pid << " " << page.machine << " " <<
+        state;
+
+    if (page.state != MARSS_TELEMETRY_EXITED && !alive) {
+        cout << " (dead)";
+        bad = true;
+    } else if (page.state == MARSS_TELEMETRY_RUNNING && age > stall) {
+        cout << " (stalled)";
+        bad = true;
+    }
+
+    cout << ", updated " << age << " s ago" << endl;
+    cout << "  cycle " << page.sim_cycle << " commits " << page.insns <<
+        " KIPS " << page.kips << " cycles/sec " << page.cycles_per_sec <<
+        endl;
+
+    if (page.num_cores) {
+        cout << "  IPC";
+        for (uint32_t i = 0; i < page.num_cores &&
+                i < MARSS_TELEMETRY_MAX_CORES; i++)
+            cout << " " << page.core_ipc[i];
+        cout << endl;
+    }
+
+    for (uint32_t i = 0; i < page.num_stats &&
+            i < MARSS_TELEMETRY_MAX_STATS; i++)
+        cout << "  " << page.stats[i].name << ": " << page.stats[i].value <<
+            endl;
+
+    return bad;
+}
+
+int main(int argc, char** argv)
+{
+    double stall = 10;
+    int bad = 0;
+    int i = 1;
+
+    if (argc > 2 && strcmp("-stall", argv[1]) == 0) {
+        stall = atof(argv[2]);
+        i = 3;
+    }
+
+    if (i >= argc) {
+        cout << "Usage: " << argv[0] << " [-stall <seconds>] <file>..." <<
+            endl;
+        return -1;
+    }
+
+    for (; i < argc; i++) {
+        int fd = open(argv[i], O_RDONLY);
+        if (fd == -1) {
+            perror(argv[i]);
+            bad++;
+            continue;
+        }
+
+        /* Reading past the end of a short file would fault */
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MarssTelemetry)) {
+            cout << argv[i] << " is not a Marss telemetry page." << endl;
+            close(fd);
+            bad++;
+            continue;
+        }
+
+        void *addr = mmap(NULL, sizeof(MarssTelemetry), PROT_READ,
+                MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (addr == MAP_FAILED) {
+            perror(argv[i]);
+            bad++;
+            continue;
+        }
+
+        MarssTelemetry page;
+        if (marss_telemetry_read((MarssTelemetry*)addr, &page)) {
+            bad += info(argv[i], page, stall);
+        } else {
+            cout << argv[i] << " is not a Marss telemetry page." << endl;
+            bad++;
+        }
+
+        munmap(addr, sizeof(MarssTelemetry));
+    }
+
+    return bad;
+}
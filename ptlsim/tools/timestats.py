@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+
+# timestats.py
+#
+# Read binary time-stats files written with '-time-stats-format binary'
+# and convert them to CSV, or load them into a pandas DataFrame:
+#
+#   timestats.py run.tstats > run.csv
+#
+#   import timestats
+#   df = timestats.to_dataframe("run.tstats")
+#
+# See the format description in ptlsim/stats/statsBuilder.cpp.
+
+import struct
+import sys
+import zlib
+from optparse import OptionParser
+
+MAGIC = b"MTSTATS1"
+KIND_INT = 0
+KIND_FLOAT = 1
+
+def _read_exact(f, size):
+    data = f.read(size)
+    if len(data) != size:
+        raise EOFError("truncated time-stats file")
+    return data
+
+def _read_w32(f):
+    return struct.unpack("<I", _read_exact(f, 4))[0]
+
+def _varints(data):
+    value = 0
+    shift = 0
+    for b in bytearray(data):
+        value |= (b & 0x7f) << shift
+        if b & 0x80:
+            shift += 7
+        else:
+            yield value
+            value = 0
+            shift = 0
+
+def _decode_block(rows, kinds, payload):
+    columns = len(kinds)
+    prev = [0] * columns
+    values = _varints(payload)
+    for r in range(rows):
+        row = []
+        for c in range(columns):
+            v = next(values)
+            if kinds[c] == KIND_INT:
+                delta = (v >> 1) ^ -(v & 1)
+                prev[c] = (prev[c] + delta) & 0xffffffffffffffff
+                row.append(prev[c])
+            else:
+                prev[c] ^= v
+                row.append(struct.unpack("<d", struct.pack("<Q", prev[c]))[0])
+        yield row
+
+def read(path):
+    """Return (column names, iterator over rows) for a binary time-stats file"""
+    f = open(path, "rb")
+    if _read_exact(f, len(MAGIC)) != MAGIC:
+        raise ValueError("%s is not a binary time-stats file" % path)
+    header = _read_exact(f, _read_w32(f)).decode("ascii")
+    columns = header.split(",")
+
+    def rows():
+        try:
+            while True:
+                head = f.read(4)
+                if not head:
+                    break
+                if len(head) != 4:
+                    raise EOFError("truncated time-stats file")
+                count = struct.unpack("<I", head)[0]
+                kinds = bytearray(_read_exact(f, _read_w32(f)))
+                raw_size = _read_w32(f)
+                payload = zlib.decompress(_read_exact(f, _read_w32(f)))
+                if len(payload) != raw_size:
+                    raise ValueError("corrupt time-stats block")
+                for row in _decode_block(count, kinds, payload):
+                    yield row
+        finally:
+            f.close()
+
+    return columns, rows()
+
+def to_dataframe(path):
+    """Load a binary time-stats file into a pandas DataFrame"""
+    import pandas
+    columns, rows = read(path)
+    return pandas.DataFrame(list(rows), columns=columns)
+
+def to_csv(path, out):
+    columns, rows = read(path)
+    out.write(",".join(columns) + "\n")
+    for row in rows:
+        out.write(",".join([str(v) for v in row]) + "\n")
+
+if __name__ == "__main__":
+    opt = OptionParser("usage: %prog [options] <time-stats file>")
+    opt.add_option("-o", "--output", dest="output", default=None,
+            help="Write CSV to this file instead of stdout")
+    (options, args) = opt.parse_args()
+
+    if len(args) != 1:
+        opt.error("specify one time-stats file")
+
+    out = sys.stdout
+    if options.output:
+        out = open(options.output, "w")
+    to_csv(args[0], out)
+    if options.output:
+        out.close()
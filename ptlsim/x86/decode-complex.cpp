@@ -7,6 +7,7 @@
 //
 
 #include <decode.h>
+#include <iorecord.h>
 
 // QEMU Helper functions
 extern "C" {
@@ -521,6 +522,13 @@ bool assist_rdtsc(Context& ctx) {
     return true;
 }
 
+W64 l_assist_rdtsc(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags,
+		W16 rbflags, W16 rcflags, W16& flags) {
+	// Same value as helper_rdtsc, which also checks CR4.TSD and SVM
+	// intercepts: the decoder uses the full assist if either applies
+	return cpu_get_tsc(&ctx) + ctx.tsc_offset;
+}
+
 bool assist_pushf(Context& ctx) {
 	setup_qemu_switch_except_ctx(ctx);
 	ctx.setup_qemu_switch();
@@ -674,6 +682,26 @@ bool assist_fxrstor(Context& ctx) {
   return true;
 }
 
+/* Zero the high 128 bits of all ymm registers, see decode_avx() */
+bool assist_vzeroupper(Context& ctx) {
+  int count = (ctx.hflags & HF_CS64_MASK) ? CPU_NB_REGS64 : CPU_NB_REGS32;
+  foreach (i, count) {
+    ctx.ymmh_regs[i]._q[0] = 0;
+    ctx.ymmh_regs[i]._q[1] = 0;
+  }
+  ctx.eip = ctx.reg_nextrip;
+  return true;
+}
+
+bool assist_vzeroall(Context& ctx) {
+  int count = (ctx.hflags & HF_CS64_MASK) ? CPU_NB_REGS64 : CPU_NB_REGS32;
+  foreach (i, count) {
+    ctx.xmm_regs[i]._q[0] = 0;
+    ctx.xmm_regs[i]._q[1] = 0;
+  }
+  return assist_vzeroupper(ctx);
+}
+
 bool assist_wrmsr(Context& ctx) {
   ctx.eip = ctx.reg_selfrip;
   ASSIST_IN_QEMU(helper_wrmsr);
@@ -689,6 +717,14 @@ bool assist_rdmsr(Context& ctx) {
     return true;
 }
 
+// Counters of -guest-pmu, faults in QEMU without it
+bool assist_rdpmc(Context& ctx) {
+    ctx.eip = ctx.reg_selfrip;
+    ASSIST_IN_QEMU(helper_rdpmc);
+    ctx.eip = ctx.reg_nextrip;
+    return true;
+}
+
 bool assist_write_cr0(Context& ctx) {
   ctx.eip = ctx.reg_selfrip;
   ASSIST_IN_QEMU(helper_write_crN, 0, ctx.reg_ar1);
@@ -711,9 +747,16 @@ bool assist_write_cr3(Context& ctx) {
 }
 
 bool assist_write_cr4(Context& ctx) {
+  W64 old_cr4 = ctx.cr[4];
+
   ctx.eip = ctx.reg_selfrip;
   ASSIST_IN_QEMU(helper_write_crN, 4, ctx.reg_ar1);
   ctx.eip = ctx.reg_nextrip;
+
+  // Decoded user mode rdtsc depends on CR4.TSD (see rdtsc_faults)
+  if unlikely ((old_cr4 ^ ctx.cr[4]) & CR4_TSD_MASK)
+    bbcache_of(ctx.cpu_index).flush(ctx.cpu_index);
+
   return true;
 }
 
@@ -835,17 +878,23 @@ bool assist_ioport_in(Context& ctx) {
   W64 port = ctx.reg_ar1;
   W64 sizeshift = ctx.reg_ar2;
 
-  setup_qemu_switch_except_ctx(ctx);
-  ctx.setup_qemu_switch();
   W64 value;
-  if(sizeshift == 0) {
-	  value = helper_inb(port);
-  } else if(sizeshift == 1) {
-	  value = helper_inw(port);
-  } else {
-	  value = helper_inl(port);
+  if likely (!io_replaying || !io_replay(ctx.cpu_index, IO_RECORD_PORT_IN,
+              port, sizeshift, value)) {
+    setup_qemu_switch_except_ctx(ctx);
+    ctx.setup_qemu_switch();
+    if(sizeshift == 0) {
+      value = helper_inb(port);
+    } else if(sizeshift == 1) {
+      value = helper_inw(port);
+    } else {
+      value = helper_inl(port);
+    }
+    ctx.setup_ptlsim_switch();
+
+    if unlikely (io_recording)
+      io_record(ctx.cpu_index, IO_RECORD_PORT_IN, port, sizeshift, value);
   }
-  ctx.setup_ptlsim_switch();
 
   ctx.regs[R_EAX] = x86_merge(ctx.regs[R_EAX], value, sizeshift);
   ctx.eip = ctx.reg_nextrip;
@@ -859,17 +908,24 @@ W64 l_assist_ioport_in(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags,
 	W64 sizeshift = rb;
 	W64 old_eax = rc;
 
-	setup_qemu_switch_except_ctx(ctx);
-	ctx.setup_qemu_switch();
 	W64 value;
-	if(sizeshift == 0) {
-		value = helper_inb(port);
-	} else if(sizeshift == 1) {
-		value = helper_inw(port);
-	} else {
-		value = helper_inl(port);
+	if likely (!io_replaying || !io_replay(ctx.cpu_index, IO_RECORD_PORT_IN,
+				port, sizeshift, value)) {
+		setup_qemu_switch_except_ctx(ctx);
+		ctx.setup_qemu_switch();
+		if(sizeshift == 0) {
+			value = helper_inb(port);
+		} else if(sizeshift == 1) {
+			value = helper_inw(port);
+		} else {
+			value = helper_inl(port);
+		}
+		setup_ptlsim_switch_all_ctx(ctx);
+
+		if unlikely (io_recording)
+			io_record(ctx.cpu_index, IO_RECORD_PORT_IN, port, sizeshift,
+					value);
 	}
-	setup_ptlsim_switch_all_ctx(ctx);
 
 	value = x86_merge(old_eax, value, sizeshift);
 
@@ -1465,6 +1521,32 @@ bool TraceDecoder::decode_complex() {
       int increment = (1 << sizeshift);
       if (dirflag) increment = -increment;
 
+      //
+      // Fast strings: forward rep movs and rep stos with 64-bit addresses
+      // move a chunk of up to 'chunk' elements per loop iteration instead
+      // of one. Element k of a chunk of c = min(rcx, chunk) elements is at
+      // offset min(k, c-1) << sizeshift, so the slots past the end of a
+      // short chunk repeat its last element, which is idempotent. The
+      // elements keep their size and program order, so overlapping movs
+      // still see each earlier store through forwarding. A chunk is one
+      // x86 insn, so a fault in any of its accesses restarts the chunk
+      // with %rsi, %rdi and %rcx at its first element.
+      //
+      bool fast_string = rep && !dirflag && (addrsizeshift == 3);
+      int chunk = 0;
+      if (fast_string) {
+        // Largest chunk that keeps the loop in MAX_TRANSOPS_PER_USER_INSN
+        chunk = (op == 0xa4 || op == 0xa5) ? 4 : (op == 0xaa || op == 0xab) ? 8 : 0;
+        fast_string = (chunk > 0);
+      }
+
+      if (fast_string) {
+        // t1 = elements in this chunk, t2 = bytes, t3 = offset of last element
+        this << TransOp(OP_min, REG_temp1, REG_rcx,   REG_imm, REG_zero, 3, chunk);
+        this << TransOp(OP_shl, REG_temp2, REG_temp1, REG_imm, REG_zero, 3, sizeshift);
+        this << TransOp(OP_sub, REG_temp3, REG_temp2, REG_imm, REG_zero, 3, (1 << sizeshift));
+      }
+
       switch (op) {
       case 0xa4: case 0xa5: {
         // movs
@@ -1498,6 +1580,32 @@ bool TraceDecoder::decode_complex() {
 			break;
 		}
 
+        if (fast_string) {
+          foreach (k, chunk) {
+            int offreg = REG_zero;
+            if (k) {
+              this << TransOp(OP_min, REG_temp4, REG_temp3, REG_imm, REG_zero, 3, (k << sizeshift));
+              offreg = REG_temp4;
+            }
+            this << TransOp(OP_ld, REG_temp0, REG_rsi, offreg, REG_zero,  sizeshift);
+            this << TransOp(OP_st, REG_mem,   REG_rdi, offreg, REG_temp0, sizeshift);
+          }
+
+          this << TransOp(OP_add,  REG_rsi,   REG_rsi,    REG_temp2, REG_zero,  addrsizeshift);
+          this << TransOp(OP_add,  REG_rdi,   REG_rdi,    REG_temp2, REG_zero,  addrsizeshift);
+          if (!last_flags_update_was_atomic) this << TransOp(OP_collcc, REG_temp5, REG_zf, REG_cf, REG_of, 3, 0, 0, FLAGS_DEFAULT_ALU);
+
+          TransOp sub(OP_sub,  REG_rcx,   REG_rcx,    REG_temp1, REG_zero, addrsizeshift, 0, 0, SETFLAG_ZF);
+          sub.nouserflags = 1;
+          this << sub;
+          TransOp br(OP_br, REG_rip, REG_rcx, REG_zero, REG_zero, addrsizeshift);
+          br.cond = COND_ne;
+          br.riptaken = (Waddr)ripstart;
+          br.ripseq = (Waddr)rip;
+          this << br;
+          break;
+        }
+
         this << TransOp(OP_ld,     REG_temp0, REG_rsi,    REG_imm,  REG_zero,  sizeshift, 0);
         this << TransOp(OP_st,     REG_mem,   REG_rdi,    REG_imm,  REG_temp0, sizeshift, 0);
         this << TransOp(OP_add,    REG_rsi,   REG_rsi,    REG_imm,   REG_zero,  addrsizeshift, increment);
@@ -1568,6 +1676,30 @@ bool TraceDecoder::decode_complex() {
       case 0xaa: case 0xab: {
         // stos
         //if (rep) assert(rep == PFX_REPZ); // only rep is allowed for movs and rep == repz here
+        if (fast_string) {
+          foreach (k, chunk) {
+            int offreg = REG_zero;
+            if (k) {
+              this << TransOp(OP_min, REG_temp4, REG_temp3, REG_imm, REG_zero, 3, (k << sizeshift));
+              offreg = REG_temp4;
+            }
+            this << TransOp(OP_st, REG_mem, REG_rdi, offreg, REG_rax, sizeshift);
+          }
+
+          this << TransOp(OP_add,  REG_rdi,   REG_rdi,    REG_temp2, REG_zero, addrsizeshift);
+          if (!last_flags_update_was_atomic) this << TransOp(OP_collcc, REG_temp5, REG_zf, REG_cf, REG_of, 3, 0, 0, FLAGS_DEFAULT_ALU);
+
+          TransOp sub(OP_sub,  REG_rcx,   REG_rcx,    REG_temp1, REG_zero, addrsizeshift, 0, 0, SETFLAG_ZF);
+          sub.nouserflags = 1;
+          this << sub;
+          TransOp br(OP_br, REG_rip, REG_rcx, REG_zero, REG_zero, 3);
+          br.cond = COND_ne;
+          br.riptaken = (Waddr)ripstart;
+          br.ripseq = (Waddr)rip;
+          this << br;
+          break;
+        }
+
         this << TransOp(OP_st,   REG_mem,   REG_rdi,    REG_imm,  REG_rax, sizeshift, 0);
         this << TransOp(OP_add,  REG_rdi,   REG_rdi,    REG_imm,   REG_zero, addrsizeshift, increment);
         if (rep) {
@@ -2664,6 +2796,13 @@ bool TraceDecoder::decode_complex() {
     break;
   };
 
+  case 0x133: { // rdpmc
+    EndOfDecode();
+    microcode_assist(ASSIST_RDPMC, ripstart, rip);
+    end_of_block = 1;
+    break;
+  };
+
   case 0x1a3: // bt ra,rb     101 00 011
   case 0x1ab: // bts ra,rb    101 01 011
   case 0x1b3: // btr ra,rb    101 10 011
@@ -3178,8 +3317,19 @@ bool TraceDecoder::decode_complex() {
   case 0x131: {
     // rdtsc: put result into %edx:%eax
     EndOfDecode();
-	microcode_assist(ASSIST_RDTSC, ripstart, rip);
-    end_of_block = 1;
+    if unlikely (rdtsc_faults || (hflags & HF_SVMI_MASK)) {
+      microcode_assist(ASSIST_RDTSC, ripstart, rip);
+      end_of_block = 1;
+      break;
+    }
+
+    // rdtsc is not serializing, so read the TSC in the pipeline
+    TransOp ast(OP_ast, REG_temp0, REG_zero, REG_zero, REG_zero, 3);
+    ast.riptaken = L_ASSIST_RDTSC;
+    ast.nouserflags = 1;
+    this << ast;
+    this << TransOp(OP_mov, REG_rax, REG_zero, REG_temp0, REG_zero, 2);
+    this << TransOp(OP_shr, REG_rdx, REG_temp0, REG_imm, REG_zero, 3, 32);
     break;
   }
 
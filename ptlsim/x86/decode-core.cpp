@@ -8,10 +8,12 @@
 #include <globals.h>
 #include <ptlsim.h>
 #include <decode.h>
+#include <hostperf.h>
 
 #include <setjmp.h>
 
 BasicBlockCache bbcache[NUM_SIM_CORES];
+bool bbcache_shared = false;
 W8 BasicBlockCache::cpuid_counter = 0;
 
 struct BasicBlockChunkListHashtableLinkManager {
@@ -28,10 +30,9 @@ struct BasicBlockChunkListHashtableLinkManager {
     }
 };
 
-typedef SelfHashtable<W64, BasicBlockChunkList, 16384, BasicBlockChunkListHashtableLinkManager> BasicBlockPageCache;
+typedef OpenHashtable<W64, BasicBlockChunkList, 4096, BasicBlockChunkListHashtableLinkManager> BasicBlockPageCache;
 
 BasicBlockPageCache bbpages;
-CycleTimer translate_timer("translate");
 
 ofstream bbcache_dump_file;
 
@@ -96,6 +97,9 @@ const assist_func_t assistid_to_func[ASSIST_COUNT] = {
     assist_ldmxcsr,
     assist_fxsave,
     assist_fxrstor,
+    // AVX state
+    assist_vzeroupper,
+    assist_vzeroall,
     // Interrupts, system calls, etc.
     assist_int,
     assist_syscall,
@@ -119,6 +123,7 @@ const assist_func_t assistid_to_func[ASSIST_COUNT] = {
     assist_write_segreg,
     assist_wrmsr,
     assist_rdmsr,
+    assist_rdpmc,
     assist_write_cr0,
     assist_write_cr2,
     assist_write_cr3,
@@ -221,6 +226,9 @@ const char* assist_names[ASSIST_COUNT] = {
   "ldmxcsr",
   "fxsave",
   "fxrstor",
+  // AVX state
+  "vzeroupper",
+  "vzeroall",
   // Interrupts", system calls", etc.
   "int",
   "syscall",
@@ -244,6 +252,7 @@ const char* assist_names[ASSIST_COUNT] = {
   "write_segreg",
   "wrmsr",
   "rdmsr",
+  "rdpmc",
   "write_cr0",
   "write_cr2",
   "write_cr3",
@@ -327,6 +336,7 @@ const light_assist_func_t light_assistid_to_func[L_ASSIST_COUNT] = {
     l_assist_pause,
     l_assist_popcnt,
 	l_assist_x87_fist,
+	l_assist_rdtsc,
 };
 
 const char* light_assist_names[L_ASSIST_COUNT] = {
@@ -339,6 +349,7 @@ const char* light_assist_names[L_ASSIST_COUNT] = {
 	"l_pause",
     "l_popcnt",
 	"l_x87_fist",
+	"l_rdtsc",
 };
 
 int light_assist_index(light_assist_func_t assist) {
@@ -540,6 +551,8 @@ const byte arch_pseudo_reg_to_arch_reg[APR_COUNT] = {
     REG_rip, REG_zero
 };
 
+byte fast_decode_skip[0x200];
+
 static const byte onebyte_has_modrm[256] = {
     /*       0 1 2 3 4 5 6 7 8 9 a b c d e f        */
     /*       -------------------------------        */
@@ -683,6 +696,8 @@ void TraceDecoder::reset() {
     pe = 0;
     vm86 = 0;
     handle_exec_fault = 0;
+    rdtsc_faults = 1;
+    vex = 0;
 }
 
 TraceDecoder::TraceDecoder(const RIPVirtPhys& rvp) {
@@ -725,6 +740,7 @@ TraceDecoder::TraceDecoder(Context& ctx, Waddr rip) {
 
     pe = (ctx.hflags >> HF_PE_SHIFT) & 1;
     vm86 = (ctx.eflags >> VM_SHIFT) & 1;
+    rdtsc_faults = !kernel && (ctx.cr[4] & CR4_TSD_MASK);
 
     bb.reset();
     setzero(bb.rip);
@@ -832,12 +848,17 @@ bool TraceDecoder::flush() {
         bool ld = isload(transop.opcode);
         bool st = isstore(transop.opcode);
         bool br = isbranch(transop.opcode);
+        if unlikely (transop.opcode == OP_ast)
+            DECODERSTAT->light_assists[transop.riptaken]++;
         if unlikely (br) {
             switch (transop.opcode) {
                 case OP_br: bb.type = BB_TYPE_COND; break;
                 case OP_bru: bb.type = BB_TYPE_UNCOND; break;
                 case OP_jmp: bb.type = BB_TYPE_INDIR; break;
-                case OP_brp: bb.type = BB_TYPE_ASSIST; break;
+                case OP_brp:
+                    bb.type = BB_TYPE_ASSIST;
+                    DECODERSTAT->assists[transop.riptaken]++;
+                    break;
                 default: assert(false); break;
             }
             bb.call = ((transop.extshift & BRANCH_HINT_PUSH_RAS) != 0);
@@ -1631,6 +1652,59 @@ void TraceDecoder::decode_prefixes() {
         if (prefix == PFX_REX) { rex = b; }
         byteoffset++; rip++;
     }
+
+    vex = 0;
+
+    //
+    // C4 and C5 are LES and LDS in 32-bit mode unless the next byte
+    // would be a register ModRM, which is not valid for them:
+    //
+    byte b = insnbytes[byteoffset];
+    if unlikely ((b == 0xc4 || b == 0xc5) &&
+            (use64 || (insnbytes[byteoffset+1] >> 6) == 3)) {
+        decode_vex_prefix();
+    }
+}
+
+//
+// VEX prefix:
+//
+//   C5 [R vvvv L pp]
+//   C4 [R X B mmmmm] [W vvvv L pp]
+//
+// R, X, B and vvvv are stored inverted. pp stands for the 66, F3 and F2
+// prefixes, which may not also appear as bytes. Only the 0F opcode map
+// (mmmmm = 1) is decoded, there are no 0F38 and 0F3A opcodes here.
+//
+void TraceDecoder::decode_vex_prefix() {
+    byte b = fetch1();
+    byte p1 = fetch1();
+    byte p2 = p1;
+    int map = 1;
+
+    invalid |= ((prefixes & (PFX_DATA|PFX_REPZ|PFX_REPNZ|PFX_LOCK|PFX_REX)) != 0);
+
+    rex = 0;
+    if (b == 0xc4) {
+        p2 = fetch1();
+        map = lowbits(p1, 5);
+        if (use64) {
+            rex.extindex = !bit(p1, 6);
+            rex.extbase = !bit(p1, 5);
+            rex.mode64 = bit(p2, 7);
+        }
+    }
+    if (use64) rex.extreg = !bit(p1, 7);
+
+    vex = 1;
+    vex_l = bit(p2, 2);
+    vex_vvvv = lowbits(~p2 >> 3, 4);
+    if (!use64) vex_vvvv &= 7;
+
+    static const W32 pp_to_prefix[4] = {0, PFX_DATA, PFX_REPZ, PFX_REPNZ};
+    prefixes |= pp_to_prefix[lowbits(p2, 2)];
+
+    invalid |= (map != 1);
 }
 
 void TraceDecoder::split(bool after) {
@@ -1685,7 +1759,12 @@ static const bool log_code_page_ops = 0;
 
 bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
     BasicBlockChunkList* pagelist;
-    if unlikely (bb->refcount) {
+    //
+    // A shared cache cannot wait for the pipelines of every core to
+    // flush: referenced blocks are unlinked so no core finds them again,
+    // and freed by free_retired() after their last release.
+    //
+    if unlikely (bb->refcount && !bbcache_shared) {
         if(logable(8))
             ptl_logfile << "Warning: basic block ", bb, " ", *bb, " is still in use somewhere (refcount ", bb->refcount, ")", endl;
         return false;
@@ -1695,28 +1774,59 @@ bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
         bbcache_dump_file << *bb << endl;
     }
 
-    pagelist = bbpages.get(bb->rip.mfnlo);
+    pagelist = bbpages.get(bb->code_mfnlo);
     if (logable(10) | log_code_page_ops) ptl_logfile << "Remove bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes) from low page list ", pagelist, ": loc ", bb->mfnlo_loc.chunk, ":", bb->mfnlo_loc.index, endl;
     assert(pagelist);
     pagelist->remove(bb->mfnlo_loc);
 
     int page_crossing = ((lowbits(bb->rip, 12) + (bb->bytes-1)) >> 12);
     if (page_crossing) {
-        pagelist = bbpages.get(bb->rip.mfnhi);
+        pagelist = bbpages.get(bb->code_mfnhi);
         if (logable(10) | log_code_page_ops) ptl_logfile << "Remove bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes) from high page list ", pagelist, ": loc ", bb->mfnhi_loc.chunk, ":", bb->mfnhi_loc.index, endl;
         assert(pagelist);
         pagelist->remove(bb->mfnhi_loc);
     }
 
     remove(bb);
+    link_epoch++;
     W64 ct = bbcache[cpuid].count;
     DECODERSTAT->bbcache.count = ct;
     DECODERSTAT->bbcache.invalidates[reason]++;
 
+    if unlikely (bb->refcount) {
+        retired.push(bb);
+        DECODERSTAT->shared.retired++;
+        return true;
+    }
+
     bb->free();
+    update_arena_stats();
     return true;
 }
 
+void BasicBlockCache::free_retired() {
+    int n = 0;
+
+    foreach (i, retired.length) {
+        BasicBlock* bb = retired[i];
+        if (bb->refcount) {
+            retired[n++] = bb;
+            continue;
+        }
+        bb->free();
+        DECODERSTAT->shared.freed++;
+    }
+
+    retired.resize(n);
+    update_arena_stats();
+}
+
+void BasicBlockCache::update_arena_stats() {
+    if unlikely (!DECODERSTAT) return;
+    DECODERSTAT->arena.used_bytes = arena.used_bytes;
+    DECODERSTAT->arena.chunk_bytes = arena.chunk_bytes;
+}
+
 bool BasicBlockCache::invalidate(const RIPVirtPhys& rvp, int reason) {
     BasicBlock* bb = get(rvp);
     // BasicBlock* bb = get(rvp.rip);
@@ -1739,14 +1849,106 @@ int BasicBlockCache::get_page_bb_count(Waddr mfn) {
 
 void BasicBlockCache::add_page(BasicBlock* bb)
 {
-    BasicBlockChunkList* pagelist = bbpages.get(bb->rip.mfnlo);
+    BasicBlockChunkList* pagelist = bbpages.get(bb->code_mfnlo);
     if (!pagelist) {
-        pagelist = new BasicBlockChunkList(bb->rip.mfnlo);
+        pagelist = new BasicBlockChunkList(bb->code_mfnlo);
         pagelist->refcount++;
         bbpages.add(pagelist);
         pagelist->refcount--;
     }
     pagelist->add(bb, bb->mfnlo_loc);
+    pagelist->code_lines |= bb_code_lines(bb, bb->code_mfnlo);
+}
+
+//
+// Lines of page mfn holding x86 bytes of bb, one bit per 64 bytes
+//
+W64 bb_code_lines(const BasicBlock* bb, W64 mfn) {
+    W64 offset = lowbits(bb->rip.rip, 12);
+    W64 bytes = min(W64(bb->bytes), PAGE_SIZE - offset);
+
+    if (mfn != bb->code_mfnlo) {
+        bytes = bb->bytes - bytes;
+        offset = 0;
+    }
+
+    if (!bytes) return 0;
+
+    W64 first = offset >> 6;
+    W64 last = (offset + bytes - 1) >> 6;
+    return bitmask(last + 1) & ~bitmask(first);
+}
+
+//
+// A store to a line holding code marks it dirty and returns true, the
+// thread doing it must then flush at the next x86 insn and call
+// invalidate_smc_lines(). Stores to other lines of code pages leave the
+// BBs alone.
+//
+bool BasicBlockCache::smc_store(W64 physaddr) {
+    BasicBlockChunkList* pagelist = bbpages.get(physaddr >> 12);
+
+    if likely (!pagelist) return false;
+
+    W64 line = 1ULL << bits(physaddr, 6, 6);
+
+    if likely (!(pagelist->code_lines & line)) {
+        DECODERSTAT->smc.data_stores++;
+        return false;
+    }
+
+    if (!pagelist->dirty_lines) smc_dirty_pages.push(pagelist->mfn);
+    pagelist->dirty_lines |= line;
+    DECODERSTAT->smc.code_stores++;
+
+    return true;
+}
+
+//
+// Invalidate the BBs overlapping dirty lines, keeping the rest of their
+// pages. Like invalidate_page(), call only once the pipelines holding
+// references to the BBs are flushed.
+//
+bool BasicBlockCache::invalidate_smc_lines(int reason) {
+    bool ok = true;
+
+    foreach (i, smc_dirty_pages.length) {
+        BasicBlockChunkList* pagelist = bbpages.get(smc_dirty_pages[i]);
+        if unlikely (!pagelist) continue;
+
+        W64 dirty = pagelist->dirty_lines;
+        W64 code = 0;
+
+        if (logable(3) | log_code_page_ops) ptl_logfile << "Invalidate lines ", hexstring(dirty, 64), " of page mfn ", pagelist->mfn, endl;
+
+        BasicBlockChunkList::Iterator iter(pagelist);
+        BasicBlockPtr* entry;
+        while ((entry = iter.next())) {
+            BasicBlock* bb = *entry;
+            W64 lines = bb_code_lines(bb, pagelist->mfn);
+
+            if (!(lines & dirty)) {
+                DECODERSTAT->smc.bbs_kept++;
+                code |= lines;
+                continue;
+            }
+
+            if unlikely (!bbcache[bb->cacheid].invalidate(bb, reason)) {
+                if (logable(3) | log_code_page_ops) ptl_logfile << "  Could not invalidate bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes): still has refcount ", bb->refcount, endl;
+                code |= lines;
+                ok = false;
+                continue;
+            }
+
+            DECODERSTAT->smc.bbs_invalidated++;
+        }
+
+        pagelist->code_lines = code;
+        pagelist->dirty_lines = 0;
+    }
+
+    smc_dirty_pages.clear();
+    return ok;
 }
 
 //
@@ -1775,7 +1977,7 @@ bool BasicBlockCache::invalidate_page(Waddr mfn, int reason) {
     while ((entry = iter.next())) {
         BasicBlock* bb = *entry;
         if (logable(3) | log_code_page_ops) ptl_logfile << "  Invalidate bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes)", endl;
-        if unlikely (!bbcache[cpuid].invalidate(bb, reason)) {
+        if unlikely (!bbcache[bb->cacheid].invalidate(bb, reason)) {
             if (logable(3) | log_code_page_ops) ptl_logfile << "  Could not invalidate bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes): still has refcount ", bb->refcount, endl;
             return false;
         }
@@ -1811,7 +2013,7 @@ int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
     W64 oldest = limits<W64>::max;
     W64 newest = 0;
     W64 average = 0;
-    W64 total_bytes = 0;
+    W64 total_bytes = arena.used_bytes;
 
     int n = 0;
 
@@ -1822,7 +2024,6 @@ int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
         oldest = min(oldest, bb->lastused);
         newest = max(newest, bb->lastused);
         average += bb->lastused;
-        total_bytes += sizeof(bb);
         n++;
     }
 
@@ -1868,13 +2069,15 @@ int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
 
         // We use '<=' to guarantee even a uniform distribution will eventually be reclaimed:
         if likely (bb->lastused <= average) {
-            reclaimed_bytes += sizeof(bb);
             reclaimed_objs++;
             invalidate(bb, INVALIDATE_REASON_RECLAIM);
         }
         n++;
     }
 
+    reclaimed_bytes = total_bytes - arena.used_bytes;
+    if (arena.release_chunks()) update_arena_stats();
+
     if (DEBUG) {
         ptl_logfile << "After:", endl;
         ptl_logfile << "  Basic blocks:   ", intstring(reclaimed_objs, 12), " BBs reclaimed", endl;
@@ -1934,6 +2137,10 @@ void BasicBlockCache::flush(int8_t context_id) {
         }
     }
 
+    if unlikely (retired.length) free_retired();
+
+    if (arena.release_chunks()) update_arena_stats();
+
     //
     // Reclaim per-page chunklist heads
     //
@@ -1965,7 +2172,7 @@ bool assist_exec_page_fault(Context& ctx) {
     Waddr bbcache_rip = ctx.reg_ar2;
 
     ctx.eip = ctx.reg_selfrip;
-    assert(bbcache[ctx.cpu_index].invalidate(RIPVirtPhys(bbcache_rip).update(ctx), INVALIDATE_REASON_SPURIOUS));
+    assert(bbcache_of(ctx.cpu_index).invalidate(RIPVirtPhys(bbcache_rip).update(ctx), INVALIDATE_REASON_SPURIOUS));
     ctx.handle_page_fault(faultaddr, 2);
 
     return true;
@@ -2166,13 +2373,14 @@ bool TraceDecoder::translate() {
     if (prefixes & PFX_ADDR) addrsize_prefix = 1;
 
     bool uses_sse = 0;
-    op = fetch1();
+    // VEX stands for the 0F escape, its opcodes all take SSE prefixes
+    op = (vex) ? 0x0f : fetch1();
     bool need_modrm = onebyte_has_modrm[op];
     if (op == 0x0f) {
         op = fetch1();
         need_modrm = twobyte_has_modrm[op];
 
-        if (twobyte_uses_SSE_prefix[op]) {
+        if (twobyte_uses_SSE_prefix[op] || vex) {
             uses_sse = 1;
             use_mmx = false;
             if (prefixes & PFX_DATA) // prefix byte 0x66, typically OPpd
@@ -2182,7 +2390,7 @@ bool TraceDecoder::translate() {
             else if (prefixes & PFX_REPZ) // prefix byte 0xf3, typically OPss
                 op |= 0x200;
             else {
-                if(!((op >= 0x10 && op <= 0x5f) || op == 0xc2 || op == 0xc6))
+                if(!vex && !((op >= 0x10 && op <= 0x5f) || op == 0xc2 || op == 0xc6))
                     use_mmx = true;
                 op |= 0x300; // no prefix byte, typically OPps
             }
@@ -2231,7 +2439,7 @@ bool TraceDecoder::translate() {
 		switch (op >> 8) {
 			case 0:
 			case 1: {
-						rc = decode_fast();
+						rc = (fast_decode_skip[op]) ? false : decode_fast();
 
 						// Try again with the complex decoder if needed
 						bool iscomplex = ((rc == 0) & (!invalid));
@@ -2322,6 +2530,180 @@ ostream& printflags(ostream& os, W64 flags) {
     return os;
 }
 
+//
+// Persistent basic block cache
+//
+// With -bbcache-file, every translated block is written out at exit and
+// the file is mapped back in at the next startup. Records are keyed by
+// RIPVirtPhys and carry a hash of the x86 bytes they were decoded from,
+// so a saved block is only reused when guest memory still holds the same
+// code. The header records DECODER_FORMAT_VERSION and structure sizes; a
+// file written by a different decoder is ignored rather than trusted.
+//
+
+static const W64 BBCACHE_FILE_MAGIC = 0x3230434242544c50ULL; // "PTLBBC02"
+
+struct BasicBlockFileHeader {
+    W64 magic;
+    W32 basesize;
+    W32 transopsize;
+    W32 version;
+    W32 reserved;
+    W64 count;
+};
+
+static Hashtable<RIPVirtPhys, const BasicBlock*, 16384> persistent_bbs;
+static void* persistent_bbs_map = NULL;
+static size_t persistent_bbs_map_size = 0;
+
+static inline size_t bbcache_record_size(int count) {
+    return ceil(sizeof(BasicBlockBase) + (count * sizeof(TransOp)), 8);
+}
+
+// FNV-1a: cheap, and 64 bits keeps false matches out of reach
+static W64 bbcache_code_hash(const byte* code, int bytes) {
+    W64 h = 0xcbf29ce484222325ULL;
+    foreach (i, bytes) {
+        h ^= code[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static const BasicBlock* find_persistent_bb(const RIPVirtPhys& rvp) {
+    if likely (!persistent_bbs_map) return NULL;
+
+    const BasicBlock** entry = persistent_bbs.get(rvp);
+    return (entry) ? *entry : NULL;
+}
+
+static bool persistent_bb_matches(const BasicBlock* bb, const byte* code, int valid_byte_count) {
+    return (bb->bytes <= valid_byte_count) && (bb->codehash == bbcache_code_hash(code, bb->bytes));
+}
+
+void load_bbcache_file(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    // No file yet: this run will create it at exit
+    if (fd < 0) return;
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    void* map = (size >= (off_t)sizeof(BasicBlockFileHeader)) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        ptl_logfile << "Warning: cannot map basic block cache file ", filename, endl;
+        return;
+    }
+
+    const BasicBlockFileHeader* header = (const BasicBlockFileHeader*)map;
+    if ((header->magic != BBCACHE_FILE_MAGIC) ||
+            (header->basesize != sizeof(BasicBlockBase)) ||
+            (header->transopsize != sizeof(TransOp)) ||
+            (header->version != DECODER_FORMAT_VERSION)) {
+        ptl_logfile << "Ignoring basic block cache file ", filename, " written by a different decoder", endl;
+        munmap(map, size);
+        return;
+    }
+
+    const byte* p = (const byte*)(header + 1);
+    const byte* end = (const byte*)map + size;
+
+    foreach (i, header->count) {
+        const BasicBlock* bb = (const BasicBlock*)p;
+        if unlikely (((p + sizeof(BasicBlockBase)) > end) ||
+                (bb->count > MAX_BB_UOPS*2) ||
+                ((p + bbcache_record_size(bb->count)) > end)) {
+            ptl_logfile << "Warning: basic block cache file ", filename, " is truncated after ", i, " blocks", endl;
+            break;
+        }
+        persistent_bbs.add(bb->rip, bb);
+        p += bbcache_record_size(bb->count);
+    }
+
+    persistent_bbs_map = map;
+    persistent_bbs_map_size = size;
+
+    ptl_logfile << "Loaded ", persistent_bbs.count, " basic blocks from ", filename, endl;
+}
+
+static void write_bbcache_record(std::ofstream& os, const BasicBlock& bb) {
+    BasicBlockBase base = bb;
+    base.hashlink.reset();
+    base.uopdescs = NULL;
+    base.coredata = NULL;
+    base.arena = NULL;
+    base.refcount = 0;
+    base.hitcount = 0;
+    base.predcount = 0;
+    base.lastused = 0;
+    base.context_id = 0;
+    base.succ[0] = base.succ[1] = NULL;
+    base.succ_epoch = 0;
+
+    static const byte zeros[8] = {0};
+    size_t bytes = sizeof(BasicBlockBase) + (bb.count * sizeof(TransOp));
+
+    os.write((const char*)&base, sizeof(BasicBlockBase));
+    os.write((const char*)bb.transops, bb.count * sizeof(TransOp));
+    os.write((const char*)zeros, bbcache_record_size(bb.count) - bytes);
+}
+
+void save_bbcache_file(const char* filename) {
+    stringbuf tmpname;
+    tmpname << filename, ".tmp";
+
+    std::ofstream os(tmpname.buf, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        ptl_logfile << "Warning: cannot write basic block cache file ", tmpname, endl;
+        return;
+    }
+
+    BasicBlockFileHeader header;
+    setzero(header);
+    header.magic = BBCACHE_FILE_MAGIC;
+    header.basesize = sizeof(BasicBlockBase);
+    header.transopsize = sizeof(TransOp);
+    header.version = DECODER_FORMAT_VERSION;
+    os.write((const char*)&header, sizeof(header));
+
+    // Blocks live in this run's caches win over the loaded copies
+    Hashtable<RIPVirtPhys, bool, 4096> written;
+
+    foreach (i, NUM_SIM_CORES) {
+        BasicBlockCache::Iterator iter(&bbcache[i]);
+        BasicBlock* bb;
+        while ((bb = iter.next())) {
+            if (bb->invalidblock || (bb->rip.mfnlo == RIPVirtPhys::INVALID)) continue;
+            if (written.get(bb->rip)) continue;
+            write_bbcache_record(os, *bb);
+            written.add(bb->rip, true);
+            header.count++;
+        }
+    }
+
+    Hashtable<RIPVirtPhys, const BasicBlock*, 16384>::Iterator iter(&persistent_bbs);
+    KeyValuePair<RIPVirtPhys, const BasicBlock*>* kvp;
+    while ((kvp = iter.next())) {
+        if (written.get(kvp->key)) continue;
+        write_bbcache_record(os, *kvp->value);
+        header.count++;
+    }
+
+    written.clear_and_free();
+
+    os.seekp(0);
+    os.write((const char*)&header, sizeof(header));
+    os.close();
+
+    if (!os || (rename(tmpname, filename) < 0)) {
+        ptl_logfile << "Warning: cannot write basic block cache file ", filename, endl;
+        unlink(tmpname);
+        return;
+    }
+
+    ptl_logfile << "Saved ", header.count, " basic blocks to ", filename, endl;
+}
+
 //
 // Translate one basic block. This function always returns
 // a BasicBlock, except in the very rare case where one or
@@ -2348,13 +2730,17 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
        */
 
     BasicBlock* bb = get(rvp);
-    if likely (bb && bb->context_id == ctx.cpu_index) {
+    if likely (bb && (bbcache_shared || bb->context_id == ctx.cpu_index)) {
         return bb;
     }
 
+    if unlikely (retired.length) free_retired();
+
     bb = NULL;
 
-    translate_timer.start();
+    /* Translation is charged to 'decoder', not to the core, in host_perf */
+    static HostPerfCounter *translate_perf = host_perf_register("decoder");
+    HostPerfScope perf(translate_perf);
 
     byte insnbuf[MAX_BB_BYTES];
 
@@ -2376,17 +2762,34 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
         assert(trans.valid_byte_count == 0);
     }
 
-    for (;;) {
-        if (!trans.translate()) break;
-    }
+    //
+    // Reuse a block saved by an earlier run if the bytes it was
+    // decoded from are still the ones in guest memory.
+    //
+    const BasicBlock* saved = find_persistent_bb(rvp);
 
-    if(trans.handle_exec_fault) {
-        return NULL;
+    if (saved && !persistent_bb_matches(saved, insnbuf, trans.valid_byte_count)) {
+        DECODERSTAT->persistent.stale++;
+        saved = NULL;
     }
 
-    trans.bb.hitcount = 0;
-    trans.bb.predcount = 0;
-    bb = trans.bb.clone();
+    if (saved) {
+        DECODERSTAT->persistent.hits++;
+        bb = ((BasicBlock*)saved)->clone(&arena);
+    } else {
+        for (;;) {
+            if (!trans.translate()) break;
+        }
+
+        if(trans.handle_exec_fault) {
+            return NULL;
+        }
+
+        trans.bb.hitcount = 0;
+        trans.bb.predcount = 0;
+        trans.bb.codehash = bbcache_code_hash(insnbuf, trans.bb.bytes);
+        bb = trans.bb.clone(&arena);
+    }
     //
     // Acquire a reference to the new basic block right away,
     // since we make allocations below that might reclaim it
@@ -2394,17 +2797,34 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     //
     bb->acquire();
 
+    //
+    // Physical pages of the code for SMC tracking. Code on a page
+    // that does not translate goes on the INVALID mfn list.
+    //
+    {
+        int exception = 0;
+        int mmio = 0;
+        PageFaultErrorCode pfec = 0;
+        Waddr lastbyte = bb->rip.rip + max(int(bb->bytes), 1) - 1;
+        Waddr physlo = ctx.check_and_translate(bb->rip.rip, 0, false, false, exception, mmio, pfec, true);
+        bb->code_mfnlo = (exception | mmio) ? RIPVirtPhys::INVALID : (physlo >> 12);
+        exception = mmio = 0;
+        Waddr physhi = ctx.check_and_translate(lastbyte, 0, false, false, exception, mmio, pfec, true);
+        bb->code_mfnhi = (exception | mmio) ? RIPVirtPhys::INVALID : (physhi >> 12);
+    }
+
     add(bb);
     W64 ct = this->count;
     DECODERSTAT->bbcache.count = ct;
     DECODERSTAT->bbcache.inserts++;
     DECODERSTAT->throughput.basic_blocks++;
+    update_arena_stats();
 
     BasicBlockChunkList* pagelist;
 
-    pagelist = bbpages.get(bb->rip.mfnlo);
+    pagelist = bbpages.get(bb->code_mfnlo);
     if (!pagelist) {
-        pagelist = new BasicBlockChunkList(bb->rip.mfnlo);
+        pagelist = new BasicBlockChunkList(bb->code_mfnlo);
         pagelist->refcount++;
         bbpages.add(pagelist);
         W64 ct = bbpages.count;
@@ -2421,14 +2841,15 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     // to somehow lock it with a refcount to prevent this.
     //
     pagelist->add(bb, bb->mfnlo_loc);
+    pagelist->code_lines |= bb_code_lines(bb, bb->code_mfnlo);
     if (logable(5) | log_code_page_ops) ptl_logfile << "Add bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes) to low page list ", pagelist, ": loc ", bb->mfnlo_loc.chunk, ":", bb->mfnlo_loc.index, endl;
 
     int page_crossing = ((lowbits(bb->rip, 12) + (bb->bytes-1)) >> 12);
 
     if (page_crossing) {
-        BasicBlockChunkList* pagelisthi = bbpages.get(bb->rip.mfnhi);
+        BasicBlockChunkList* pagelisthi = bbpages.get(bb->code_mfnhi);
         if (!pagelisthi) {
-            pagelisthi = new BasicBlockChunkList(bb->rip.mfnhi);
+            pagelisthi = new BasicBlockChunkList(bb->code_mfnhi);
             pagelisthi->refcount++;
             bbpages.add(pagelisthi);
             W64 ct = bbpages.count;
@@ -2438,6 +2859,7 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
         }
         pagelisthi->refcount++;
         pagelisthi->add(bb, bb->mfnhi_loc);
+        pagelisthi->code_lines |= bb_code_lines(bb, bb->code_mfnhi);
         if (logable(5) | log_code_page_ops) ptl_logfile << "Add bb ", bb, " (", bb->rip, ", ", bb->bytes, " bytes) to high page list ", pagelisthi, ": loc ", bb->mfnhi_loc.chunk, ":", bb->mfnhi_loc.index, endl;
         pagelisthi->refcount--;
     }
@@ -2451,8 +2873,9 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     }
 
     bb->context_id = ctx.cpu_index;
+    bb->cacheid = cpuid;
 
-    translate_timer.stop();
+    perf.stop();
 
     bb->release();
 
@@ -2560,7 +2983,25 @@ void bbcache_reclaim(size_t bytes, int urgency) {
 void init_decode() {
 }
 
+//
+// Blocks referenced by a pipeline stay in the cache they were decoded
+// into until released, the next flush of that cache frees them.
+//
+void set_bbcache_shared(bool shared) {
+    if (shared == bbcache_shared) return;
+
+    foreach(i, NUM_SIM_CORES) {
+        bbcache[i].flush(-1);
+    }
+
+    bbcache_shared = shared;
+}
+
 void shutdown_decode() {
+    if (config.bbcache_persist_filename.set()) {
+        save_bbcache_file(config.bbcache_persist_filename);
+    }
+
     foreach(i, NUM_SIM_CORES) {
         bbcache[i].flush(0);
     }
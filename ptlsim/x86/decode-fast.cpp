@@ -1028,6 +1028,7 @@ bool TraceDecoder::decode_fast() {
 
   default: {
     /* Let the slow decoder handle it or mark it invalid */
+    fast_decode_skip[op] = 1;
     return false;
   }
   }
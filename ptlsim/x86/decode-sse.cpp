@@ -11,10 +11,50 @@
 
 static const byte sse_float_datatype_to_ptl_datatype[4] = {DATATYPE_FLOAT, DATATYPE_VEC_FLOAT, DATATYPE_DOUBLE, DATATYPE_VEC_DOUBLE};
 
+static const byte sse_fp_opcode_to_uop[16] = {OP_nop, OP_fsqrt, OP_frsqrt, OP_frcp, OP_and, OP_andnot, OP_or, OP_xor, OP_fadd, OP_fmul, OP_nop, OP_nop, OP_fsub, OP_fmin, OP_fdiv, OP_fmax};
+
+/*
+ * Integer SSE/MMX arithmetic, from 0x5d0 to 0x5ff
+ */
+static const byte sse_int_opcode_to_uop[3][16] = {
+/* 0x5d0: */
+/* 0        1        2        3        4          5         6         7          8           9           a          b        c           d           e          f */
+/* -------- psrlw    psrld    psrlq    paddq      pmullw    movq      pmovmskb   psubusb     psubusw     pminub     pand     paddusb     paddusw     pmaxub     pandn */
+  {0,       OP_vshr, OP_vshr, OP_vshr, OP_vadd,   OP_vmull, 0,        0,         OP_vsub_us, OP_vsub_us, OP_vmin,   OP_and,  OP_vadd_us, OP_vadd_us, OP_vmax,   OP_andnot},
+/* 0x5e0: */
+/* pavgb    psraw    psrad    pavgw    pmulhuw    pmulhw    cvttpd2dq movntdq    psubsb      psubsw      pminsw     por      paddsb      paddsw      pmaxsw     pxor */
+  {OP_vavg, OP_vsar, OP_vsar, OP_vavg, OP_vmulhu, OP_vmulh, 0,        0,         OP_vsub_ss, OP_vsub_ss, OP_vmin_s, OP_or,   OP_vadd_ss, OP_vadd_ss, OP_vmax_s, OP_xor},
+/* 0x5f0: */
+/* -------- psllw    pslld    psllq    pmuludq    pmaddwd   psadbw    maskmovdqu psubb       psubw       psubd      psubq    paddb       paddw       paddd      -------- */
+  {0,       OP_vshl, OP_vshl, OP_vshl, OP_mulhl,  OP_vmaddp,OP_vsad,  0,         OP_vsub,    OP_vsub,    OP_vsub,   OP_vsub, OP_vadd,    OP_vadd,    OP_vadd,   0},
+};
+#define B 0
+#define W 1
+#define D 2
+#define Q 3
+static const byte sse_int_opcode_to_sizeshift[3][16] = {
+/* 0x5d0: */
+/* 0        1        2        3        4          5         6         7          8           9           a          b        c           d           e          f */
+/* -------- psrlw    psrld    psrlq    paddq      pmullw    movq      pmovmskb   psubusb     psubusw     pminub     pand     paddusb     paddusw     pmaxub     pandn */
+  {0,       W,       D,       Q,       Q,         W,        Q,        B,         B,          W,          B,         Q,       B,          W,          B,         Q},
+/* 0x5e0: */
+/* pavgb    psraw    psrad    pavgw    pmulhuw    pmulhw    cvttpd2dq movntdq    psubsb      psubsw      pminsw     por      paddsb      paddsw      pmaxsw     pxor */
+  {B,       W,       D,       W,       W,         W,        0,        0,         B,          W,          W,         Q,       B,          W,          W,         Q},
+/* 0x5f0: */
+/* -------- psllw    pslld    psllq    pmuludq    pmaddwd   psadbw    maskmovdqu psubb       psubw       psubd      psubq    paddb       paddw       paddd      -------- */
+  {0,       W,       D,       Q,       D,         W,        W,        0,         B,          W,          D,         Q,       B,          W,          D,         0},
+};
+#undef B
+#undef W
+#undef D
+#undef Q
+
 bool TraceDecoder::decode_sse() {
   DecodedOperand rd;
   DecodedOperand ra;
 
+  if unlikely (vex) return decode_avx();
+
   is_sse = 1;
   prefixes &= ~PFX_LOCK;
 
@@ -125,9 +165,7 @@ bool TraceDecoder::decode_sse() {
     byte sizetype = (op >> 8) - 2; /* put into 0x{2-5}00 -> 2-5 range, then set to 0-3 range */
     bool packed = bit(sizetype, 0);
 
-    static const byte opcode_to_uop[16] = {OP_nop, OP_fsqrt, OP_frsqrt, OP_frcp, OP_and, OP_andnot, OP_or, OP_xor, OP_fadd, OP_fmul, OP_nop, OP_nop, OP_fsub, OP_fmin, OP_fdiv, OP_fmax};
-
-    int uop = (lowbits(op, 8) == 0xc2) ? OP_fcmp : opcode_to_uop[lowbits(op, 4)];
+    int uop = (lowbits(op, 8) == 0xc2) ? OP_fcmp : sse_fp_opcode_to_uop[lowbits(op, 4)];
     int datatype = sse_float_datatype_to_ptl_datatype[sizetype];
 
     int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
@@ -202,41 +240,9 @@ bool TraceDecoder::decode_sse() {
     DECODE(eform, ra, x_mode);
     EndOfDecode();
 
-    static const byte x86_opcode_to_ptl_opcode[3][16] = {
-    /* 0x5d0: */
-    /* 0        1        2        3        4          5         6         7          8           9           a          b        c           d           e          f */
-    /* -------- psrlw    psrld    psrlq    paddq      pmullw    movq      pmovmskb   psubusb     psubusw     pminub     pand     paddusb     paddusw     pmaxub     pandn */
-      {0,       OP_vshr, OP_vshr, OP_vshr, OP_vadd,   OP_vmull, 0,        0,         OP_vsub_us, OP_vsub_us, OP_vmin,   OP_and,  OP_vadd_us, OP_vadd_us, OP_vmax,   OP_andnot},
-    /* 0x5e0: */
-    /* pavgb    psraw    psrad    pavgw    pmulhuw    pmulhw    cvttpd2dq movntdq    psubsb      psubsw      pminsw     por      paddsb      paddsw      pmaxsw     pxor */
-      {OP_vavg, OP_vsar, OP_vsar, OP_vavg, OP_vmulhu, OP_vmulh, 0,        0,         OP_vsub_ss, OP_vsub_ss, OP_vmin_s, OP_or,   OP_vadd_ss, OP_vadd_ss, OP_vmax_s, OP_xor},
-    /* 0x5f0: */
-    /* -------- psllw    pslld    psllq    pmuludq    pmaddwd   psadbw    maskmovdqu psubb       psubw       psubd      psubq    paddb       paddw       paddd      -------- */
-      {0,       OP_vshl, OP_vshl, OP_vshl, OP_mulhl,  OP_vmaddp,OP_vsad,  0,         OP_vsub,    OP_vsub,    OP_vsub,   OP_vsub, OP_vadd,    OP_vadd,    OP_vadd,   0},
-    };
-#define B 0
-#define W 1
-#define D 2
-#define Q 3
-    static const byte x86_opcode_to_sizeshift[3][16] = {
-    /* 0x5d0: */
-    /* 0        1        2        3        4          5         6         7          8           9           a          b        c           d           e          f */
-    /* -------- psrlw    psrld    psrlq    paddq      pmullw    movq      pmovmskb   psubusb     psubusw     pminub     pand     paddusb     paddusw     pmaxub     pandn */
-      {0,       W,       D,       Q,       Q,         W,        Q,        B,         B,          W,          B,         Q,       B,          W,          B,         Q},
-    /* 0x5e0: */
-    /* pavgb    psraw    psrad    pavgw    pmulhuw    pmulhw    cvttpd2dq movntdq    psubsb      psubsw      pminsw     por      paddsb      paddsw      pmaxsw     pxor */
-      {B,       W,       D,       W,       W,         W,        0,        0,         B,          W,          W,         Q,       B,          W,          W,         Q},
-    /* 0x5f0: */
-    /* -------- psllw    pslld    psllq    pmuludq    pmaddwd   psadbw    maskmovdqu psubb       psubw       psubd      psubq    paddb       paddw       paddd      -------- */
-      {0,       W,       D,       Q,       D,         W,        W,        0,         B,          W,          D,         Q,       B,          W,          D,         0},
-    };
-#undef B
-#undef W
-#undef D
-#undef Q
 
-    int uop = x86_opcode_to_ptl_opcode[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
-    int sizeshift = x86_opcode_to_sizeshift[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
+    int uop = sse_int_opcode_to_uop[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
+    int sizeshift = sse_int_opcode_to_sizeshift[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
 
     assert(uop != OP_nop);
 
@@ -1463,3 +1469,416 @@ bool TraceDecoder::decode_sse() {
 
   return true;
 }
+
+/*
+ * AVX and AVX2 (VEX encoded) instructions
+ *
+ * The low 128 bits of a ymm register are the xmml/xmmh arch registers of
+ * its xmm register. The high 128 bits stay in Context::ymmh_regs and are
+ * moved with internal loads and stores, so a 256-bit (VEX.L=1) operation
+ * is split in one 128-bit operation on the arch registers and one on the
+ * high halves loaded into temps. VEX.128 forms that write an xmm register
+ * zero the high half of its ymm register.
+ *
+ * In the three operand forms vvvv is the first source:
+ *
+ *   vaddps ymm1, ymm2, ymm3/m256  =>  rd = modrm.reg, ra = vvvv, rb = modrm.rm
+ */
+
+static inline W64 ymmh_offset(int archreg, int half) {
+  return offsetof_t(Context, ymmh_regs[(archreg - REG_xmml0) >> 1]._q[half]);
+}
+
+/* High half of the ymm register of archreg into rd+0 and rd+1 */
+static void ymmh_load(TraceDecoder& dec, int rd, int archreg) {
+  foreach (i, 2) {
+    TransOp ldp(OP_ld, rd+i, REG_ctx, REG_imm, REG_zero, 3, ymmh_offset(archreg, i)); ldp.internal = 1; dec << ldp;
+  }
+}
+
+/* rs+0 and rs+1 (or zero if rs is REG_zero) into the high half of archreg */
+static void ymmh_store(TraceDecoder& dec, int rs, int archreg) {
+  foreach (i, 2) {
+    int rc = (rs == REG_zero) ? REG_zero : rs+i;
+    TransOp stp(OP_st, REG_mem, REG_ctx, REG_imm, rc, 3, ymmh_offset(archreg, i)); stp.internal = 1; dec << stp;
+  }
+}
+
+/* High half of a ymm register or m256 operand into rd+0 and rd+1 */
+static void ymm_operand_load_high(TraceDecoder& dec, int rd, DecodedOperand ra, int datatype) {
+  if (ra.type == OPTYPE_MEM) {
+    ra.mem.offset += 16;
+    dec.operand_load(rd+0, ra, OP_ld, datatype);
+    ra.mem.offset += 8;
+    dec.operand_load(rd+1, ra, OP_ld, datatype);
+  } else {
+    ymmh_load(dec, rd, arch_pseudo_reg_to_arch_reg[ra.reg.reg]);
+  }
+}
+
+bool TraceDecoder::decode_avx() {
+  DecodedOperand rd;
+  DecodedOperand ra;
+
+  is_sse = 1;
+
+  int vreg = REG_xmml0 + (vex_vvvv * 2);
+
+  switch (op) {
+  case 0x377: { /* vzeroupper, vzeroall if VEX.L */
+    EndOfDecode();
+    microcode_assist((vex_l) ? ASSIST_VZEROALL : ASSIST_VZEROUPPER, ripstart, rip);
+    end_of_block = 1;
+    break;
+  }
+
+  /* Floating point arithmetic, see decode_sse() */
+  case 0x251 ... 0x253:
+  case 0x258 ... 0x259:
+  case 0x25c ... 0x25f:
+  case 0x2c2:
+  case 0x351 ... 0x359:
+  case 0x35c ... 0x35f:
+  case 0x3c2:
+  case 0x451 ... 0x453:
+  case 0x458 ... 0x459:
+  case 0x45c ... 0x45f:
+  case 0x4c2:
+  case 0x551 ... 0x559:
+  case 0x55c ... 0x55f:
+  case 0x5c2: {
+    DECODE(gform, rd, x_mode);
+    DECODE(eform, ra, x_mode);
+
+    bool cmp = (lowbits(op, 8) == 0xc2);
+    DecodedOperand imm;
+    imm.imm.imm = 0;
+    if (cmp) {
+      DECODE(iform, imm, b_mode);
+      /* Only the eight SSE compare types, not the AVX extended ones */
+      invalid |= (imm.imm.imm >= 8);
+    }
+
+    EndOfDecode();
+
+    byte sizetype = (op >> 8) - 2;
+    bool packed = bit(sizetype, 0);
+    /* Scalar forms ignore VEX.L */
+    bool wide = packed & vex_l;
+
+    int uop = (cmp) ? OP_fcmp : sse_fp_opcode_to_uop[lowbits(op, 4)];
+    int datatype = sse_float_datatype_to_ptl_datatype[sizetype];
+    int size = isclass(uop, OPCLASS_LOGIC) ? 3 : sizetype;
+
+    int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+    int rareg = vreg;
+    int rbreg;
+    DecodedOperand rb = ra;
+
+    if (ra.type == OPTYPE_MEM) {
+      rbreg = REG_temp0;
+      if ((op >> 8) == 0x2) ra.mem.size = 2;
+      operand_load(REG_temp0, ra, OP_ld, datatype);
+      if (packed) {
+        ra.mem.offset += 8;
+        operand_load(REG_temp1, ra, OP_ld, datatype);
+      }
+    } else {
+      rbreg = arch_pseudo_reg_to_arch_reg[ra.reg.reg];
+    }
+
+    /* Zero idiom: vxorXX A,B,B => zero all 256 bits of A */
+    if unlikely ((uop == OP_xor) && (ra.type == OPTYPE_REG) && (rareg == rbreg)) {
+      this << TransOp(OP_xor, rdreg+0, REG_zero, REG_zero, REG_zero, 3);
+      this << TransOp(OP_xor, rdreg+1, REG_zero, REG_zero, REG_zero, 3);
+      ymmh_store(*this, REG_zero, rdreg);
+      break;
+    }
+
+    TransOp lowop(uop, rdreg+0, rareg+0, rbreg+0, REG_zero, size);
+    lowop.cond = imm.imm.imm;
+    lowop.datatype = datatype;
+    this << lowop;
+
+    if (packed) {
+      TransOp highop(uop, rdreg+1, rareg+1, rbreg+1, REG_zero, size);
+      highop.cond = imm.imm.imm;
+      highop.datatype = datatype;
+      this << highop;
+    } else if (rdreg != rareg) {
+      /* Scalar: bits 64-127 come from the first source */
+      TransOp mov(OP_mov, rdreg+1, REG_zero, rareg+1, REG_zero, 3); mov.datatype = datatype; this << mov;
+    }
+
+    if (wide) {
+      ymm_operand_load_high(*this, REG_temp2, rb, datatype);
+      ymmh_load(*this, REG_temp4, rareg);
+      foreach (i, 2) {
+        TransOp ymmop(uop, REG_temp4+i, REG_temp4+i, REG_temp2+i, REG_zero, size);
+        ymmop.cond = imm.imm.imm;
+        ymmop.datatype = datatype;
+        this << ymmop;
+      }
+      ymmh_store(*this, REG_temp4, rdreg);
+    } else {
+      ymmh_store(*this, REG_zero, rdreg);
+    }
+    break;
+  }
+
+  /* Integer arithmetic (AVX2 if VEX.L), see decode_sse() */
+  case 0x5d1 ... 0x5d5:
+  case 0x5d8 ... 0x5df:
+  case 0x5e0 ... 0x5e5:
+  case 0x5e8 ... 0x5ef:
+  case 0x5f1 ... 0x5f6:
+  case 0x5f8 ... 0x5fe:
+  case 0x564 ... 0x566: /* vpcmpgtX */
+  case 0x574 ... 0x576: { /* vpcmpeqX */
+    DECODE(gform, rd, x_mode);
+    DECODE(eform, ra, x_mode);
+    EndOfDecode();
+
+    int uop;
+    int sizeshift;
+    int cond = 0;
+
+    if (bits(op, 4, 4) >= 0xd) {
+      uop = sse_int_opcode_to_uop[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
+      sizeshift = sse_int_opcode_to_sizeshift[bits(op, 4, 4) - 0xd][lowbits(op, 4)];
+    } else {
+      uop = OP_vcmp;
+      sizeshift = lowbits(op, 2);
+      cond = (bits(op, 4, 4) == 0x6) ? COND_nle : COND_e;
+    }
+
+    assert(uop != OP_nop);
+
+    bool isshift = (uop == OP_vshr) | (uop == OP_vsar) | (uop == OP_vshl);
+    bool wide = vex_l;
+
+    int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+    int rareg = vreg;
+    int rbreg;
+    DecodedOperand rb = ra;
+
+    if (ra.type == OPTYPE_MEM) {
+      rbreg = REG_temp0;
+      operand_load(REG_temp0, ra, OP_ld, DATATYPE_VEC_128BIT);
+      ra.mem.offset += 8;
+      operand_load(REG_temp1, ra, OP_ld, DATATYPE_VEC_128BIT);
+    } else {
+      rbreg = arch_pseudo_reg_to_arch_reg[ra.reg.reg];
+    }
+
+    /* Zero idiom: vpxor A,B,B => zero all 256 bits of A */
+    if unlikely ((uop == OP_xor) && (ra.type == OPTYPE_REG) && (rareg == rbreg)) {
+      this << TransOp(OP_xor, rdreg+0, REG_zero, REG_zero, REG_zero, 3);
+      this << TransOp(OP_xor, rdreg+1, REG_zero, REG_zero, REG_zero, 3);
+      ymmh_store(*this, REG_zero, rdreg);
+      break;
+    }
+
+    TransOp lo(uop, rdreg+0, rareg+0, rbreg+0, REG_zero, sizeshift); lo.cond = cond; this << lo;
+    TransOp hi(uop, rdreg+1, rareg+1, rbreg+(!isshift), REG_zero, sizeshift); hi.cond = cond; this << hi;
+
+    if (wide) {
+      /* Shift counts always are the low 64 bits of an xmm or m128 */
+      if (!isshift) ymm_operand_load_high(*this, REG_temp2, rb, DATATYPE_VEC_128BIT);
+      ymmh_load(*this, REG_temp4, rareg);
+      foreach (i, 2) {
+        int rbhigh = (isshift) ? rbreg : REG_temp2+i;
+        TransOp ymmop(uop, REG_temp4+i, REG_temp4+i, rbhigh, REG_zero, sizeshift);
+        ymmop.cond = cond;
+        this << ymmop;
+      }
+      ymmh_store(*this, REG_temp4, rdreg);
+    } else {
+      ymmh_store(*this, REG_zero, rdreg);
+    }
+    break;
+  }
+
+  case 0x328: /* vmovaps load */
+  case 0x528: /* vmovapd load */
+  case 0x310: /* vmovups load */
+  case 0x510: /* vmovupd load */
+  case 0x56f: /* vmovdqa load */
+  case 0x26f: { /* vmovdqu load */
+    DECODE(gform, rd, x_mode);
+    DECODE(eform, ra, x_mode);
+    if (vex_vvvv) MakeInvalid();
+    EndOfDecode();
+
+    int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+    int datatype = sse_float_datatype_to_ptl_datatype[(op >> 8) - 2];
+
+    if (ra.type == OPTYPE_MEM) {
+      DecodedOperand rb = ra;
+      operand_load(rdreg+0, ra, OP_ld, datatype);
+      ra.mem.offset += 8;
+      operand_load(rdreg+1, ra, OP_ld, datatype);
+      if (vex_l) ymm_operand_load_high(*this, REG_temp2, rb, datatype);
+    } else {
+      int rareg = arch_pseudo_reg_to_arch_reg[ra.reg.reg];
+      if (vex_l) ymmh_load(*this, REG_temp2, rareg);
+      TransOp uoplo(OP_mov, rdreg+0, REG_zero, rareg+0, REG_zero, 3); uoplo.datatype = datatype; this << uoplo;
+      TransOp uophi(OP_mov, rdreg+1, REG_zero, rareg+1, REG_zero, 3); uophi.datatype = datatype; this << uophi;
+    }
+
+    ymmh_store(*this, (vex_l) ? REG_temp2 : REG_zero, rdreg);
+    break;
+  }
+
+  case 0x329: /* vmovaps store */
+  case 0x529: /* vmovapd store */
+  case 0x311: /* vmovups store */
+  case 0x511: /* vmovupd store */
+  case 0x57f: /* vmovdqa store */
+  case 0x27f: /* vmovdqu store */
+  case 0x5e7: /* vmovntdq store */
+  case 0x52b: /* vmovntpd store */
+  case 0x32b: { /* vmovntps store */
+    DECODE(eform, rd, x_mode);
+    DECODE(gform, ra, x_mode);
+    if (vex_vvvv) MakeInvalid();
+    EndOfDecode();
+
+    int rareg = arch_pseudo_reg_to_arch_reg[ra.reg.reg];
+    int datatype = sse_float_datatype_to_ptl_datatype[(op >> 8) - 2];
+
+    if (vex_l) ymmh_load(*this, REG_temp2, rareg);
+
+    if (rd.type == OPTYPE_MEM) {
+      result_store(rareg+0, REG_temp0, rd, datatype);
+      rd.mem.offset += 8;
+      result_store(rareg+1, REG_temp1, rd, datatype);
+      if (vex_l) {
+        rd.mem.offset += 8;
+        result_store(REG_temp2, REG_temp4, rd, datatype);
+        rd.mem.offset += 8;
+        result_store(REG_temp3, REG_temp5, rd, datatype);
+      }
+    } else {
+      int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+      TransOp uoplo(OP_mov, rdreg+0, REG_zero, rareg+0, REG_zero, 3); uoplo.datatype = datatype; this << uoplo;
+      TransOp uophi(OP_mov, rdreg+1, REG_zero, rareg+1, REG_zero, 3); uophi.datatype = datatype; this << uophi;
+      ymmh_store(*this, (vex_l) ? REG_temp2 : REG_zero, rdreg);
+    }
+    break;
+  }
+
+  case 0x210: /* vmovss load */
+  case 0x410: /* vmovsd load */
+  case 0x211: /* vmovss store */
+  case 0x411: { /* vmovsd store */
+    bool store = lowbits(op, 1);
+    if (store) {
+      DECODE(eform, rd, x_mode);
+      DECODE(gform, ra, x_mode);
+    } else {
+      DECODE(gform, rd, x_mode);
+      DECODE(eform, ra, x_mode);
+    }
+    /* vvvv is only used by the register to register form */
+    bool mem = (rd.type == OPTYPE_MEM) | (ra.type == OPTYPE_MEM);
+    if (mem && vex_vvvv) MakeInvalid();
+    EndOfDecode();
+
+    int datatype = sse_float_datatype_to_ptl_datatype[(op >> 8) - 2];
+    bool isdouble = ((op >> 8) == 0x4);
+
+    if (rd.type == OPTYPE_MEM) {
+      rd.mem.size = (isdouble) ? 3 : 2;
+      result_store(arch_pseudo_reg_to_arch_reg[ra.reg.reg], REG_temp0, rd, datatype);
+      break;
+    }
+
+    int rdreg = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+
+    if (ra.type == OPTYPE_MEM) {
+      ra.mem.size = (isdouble) ? 3 : 2;
+      operand_load(rdreg+0, ra, OP_ld, datatype);
+      TransOp uop(OP_mov, rdreg+1, REG_zero, REG_zero, REG_zero, 3); uop.datatype = datatype; this << uop;
+    } else {
+      /* Low element from modrm operand, the rest of the low 128 bits from vvvv */
+      int rareg = arch_pseudo_reg_to_arch_reg[ra.reg.reg];
+      if (isdouble) {
+        TransOp uop(OP_mov, rdreg+0, REG_zero, rareg, REG_zero, 3); uop.datatype = datatype; this << uop;
+      } else {
+        TransOp uop(OP_maskb, rdreg+0, vreg+0, rareg, REG_imm, 3, 0, MaskControlInfo(0, 32, 0)); uop.datatype = datatype; this << uop;
+      }
+      TransOp uophi(OP_mov, rdreg+1, REG_zero, vreg+1, REG_zero, 3); uophi.datatype = datatype; this << uophi;
+    }
+
+    ymmh_store(*this, REG_zero, rdreg);
+    break;
+  }
+
+  /*
+   * Two operand forms that match their SSE version, except that registers
+   * they write have the high half of the ymm register zeroed:
+   */
+  case 0x56e: /* vmovd xmm,rm32/rm64 */
+  case 0x27e: /* vmovq xmm,xmmlo|mem64 */
+  case 0x412: /* vmovddup */
+  case 0x570: /* vpshufd */
+  case 0x470: /* vpshuflw */
+  case 0x270: /* vpshufhw */
+  case 0x2e6: /* vcvtdq2pd */
+  case 0x35b: /* vcvtdq2ps */
+  case 0x4e6: /* vcvtpd2dq */
+  case 0x5e6: /* vcvttpd2dq */
+  case 0x55a: /* vcvtpd2ps */
+  case 0x55b: /* vcvtps2dq */
+  case 0x25b: /* vcvttps2dq */
+  case 0x35a: /* vcvtps2pd */
+  case 0x5d6: /* vmovq xmmlo|mem64,xmm */
+  /* and those that write no xmm register */
+  case 0x32e: /* vucomiss */
+  case 0x32f: /* vcomiss */
+  case 0x52e: /* vucomisd */
+  case 0x52f: /* vcomisd */
+  case 0x350: /* vmovmskps */
+  case 0x550: /* vmovmskpd */
+  case 0x5d7: /* vpmovmskb */
+  case 0x57e: /* vmovd rm32/rm64,xmm */
+  case 0x5c5: /* vpextrw */
+  case 0x22c: /* vcvttss2si */
+  case 0x22d: /* vcvtss2si */
+  case 0x42c: /* vcvttsd2si */
+  case 0x42d: { /* vcvtsd2si */
+    if (vex_l | (vex_vvvv != 0)) MakeInvalid();
+
+    int xmmreg = -1;
+    switch (op) {
+    case 0x32e: case 0x32f: case 0x52e: case 0x52f:
+    case 0x350: case 0x550: case 0x5d7: case 0x57e:
+    case 0x5c5: case 0x22c: case 0x22d: case 0x42c: case 0x42d:
+      break;
+    case 0x5d6:
+      if (modrm.mod == 3) xmmreg = modrm.rm + (rex.extbase * 8);
+      break;
+    default:
+      xmmreg = modrm.reg + (rex.extreg * 8);
+      break;
+    }
+
+    vex = 0;
+    bool rc = decode_sse();
+    vex = 1;
+
+    if (invalid | (!rc)) return rc;
+
+    if (xmmreg >= 0) ymmh_store(*this, REG_zero, REG_xmml0 + (xmmreg * 2));
+    break;
+  }
+
+  default: {
+    MakeInvalid();
+    break;
+  }
+  }
+
+  return true;
+}
@@ -94,6 +94,11 @@ extern const char* uniform_arch_reg_names[APR_COUNT];
 
 extern const byte arch_pseudo_reg_to_arch_reg[APR_COUNT];
 
+// One- and two-byte opcodes (op < 0x200) that decode_fast() has no case for;
+// set the first time one falls through so translate() goes straight to
+// decode_complex() for it
+extern byte fast_decode_skip[0x200];
+
 enum { b_mode, v_mode, w_mode, d_mode, q_mode, x_mode, dq_mode };
 
 struct ArchPseudoRegInfo {
@@ -191,6 +196,10 @@ struct TraceDecoder {
   W32 prefixes;
   ModRMByte modrm;
   RexByte rex;
+  // VEX prefix (C4/C5): vvvv is the extra source register, L selects 256 bits
+  bool vex;
+  byte vex_l;
+  byte vex_vvvv;
   W64 user_insn_count;
   bool last_flags_update_was_atomic;
   bool invalid;
@@ -211,6 +220,8 @@ struct TraceDecoder {
   bool pe;
   bool vm86;
   bool handle_exec_fault;
+  // CR4.TSD makes user mode rdtsc fault, then it needs a full assist
+  bool rdtsc_faults;
   W8 cpuid;
 
   Level1PTE ptelo;
@@ -229,6 +240,7 @@ struct TraceDecoder {
 
   void reset();
   void decode_prefixes();
+  void decode_vex_prefix();
   void immediate(int rdreg, int sizeshift, W64s imm, bool issigned = true);
   void abs_code_addr_immediate(int rdreg, int sizeshift, W64 imm);
   int bias_by_segreg(int basereg);
@@ -255,6 +267,7 @@ struct TraceDecoder {
   bool decode_fast();
   bool decode_complex();
   bool decode_sse();
+  bool decode_avx();
   bool decode_x87();
 
   typedef int rep_and_size_to_assist_t[3][4];
@@ -343,6 +356,9 @@ enum {
   ASSIST_LDMXCSR,
   ASSIST_FXSAVE,
   ASSIST_FXRSTOR,
+  // AVX state
+  ASSIST_VZEROUPPER,
+  ASSIST_VZEROALL,
   // Interrupts, system calls, etc.
   ASSIST_INT,
   ASSIST_SYSCALL,
@@ -366,6 +382,7 @@ enum {
   ASSIST_WRITE_SEGREG,
   ASSIST_WRMSR,
   ASSIST_RDMSR,
+  ASSIST_RDPMC,
   ASSIST_WRITE_CR0,
   ASSIST_WRITE_CR2,
   ASSIST_WRITE_CR3,
@@ -437,6 +454,7 @@ enum {
 	L_ASSIST_PAUSE,
     L_ASSIST_POPCNT,
 	L_ASSIST_X87_FIST,
+	L_ASSIST_RDTSC,
 	L_ASSIST_COUNT
 };
 
@@ -493,6 +511,9 @@ bool assist_mmx_emms(Context& ctx);
 bool assist_ldmxcsr(Context& ctx);
 bool assist_fxsave(Context& ctx);
 bool assist_fxrstor(Context& ctx);
+// AVX state
+bool assist_vzeroupper(Context& ctx);
+bool assist_vzeroall(Context& ctx);
 // Interrupts, system calls, etc.
 bool assist_int(Context& ctx);
 bool assist_syscall(Context& ctx);
@@ -516,6 +537,7 @@ bool assist_popf(Context& ctx);
 bool assist_write_segreg(Context& ctx);
 bool assist_wrmsr(Context& ctx);
 bool assist_rdmsr(Context& ctx);
+bool assist_rdpmc(Context& ctx);
 bool assist_write_cr0(Context& ctx);
 bool assist_write_cr2(Context& ctx);
 bool assist_write_cr3(Context& ctx);
@@ -578,13 +600,22 @@ W64 l_assist_ioport_out(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags, W16 r
 W64 l_assist_pause(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags, W16& flags);
 W64 l_assist_popcnt(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags, W16& flags);
 W64 l_assist_x87_fist(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags, W16& flags);
+W64 l_assist_rdtsc(Context& ctx, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags, W16& flags);
 
 //
 // Global functions
 //
 void init_decode();
 void shutdown_decode();
+void load_bbcache_file(const char* filename);
+void save_bbcache_file(const char* filename);
+
+// Version of the uops the decoders emit, kept in -bbcache-file headers.
+// Bump it with any change to decode-*.cpp or to TransOp that alters the
+// translation of an instruction, or saved blocks are reused as they were.
+static const W32 DECODER_FORMAT_VERSION = 1;
 
+// Initial slots of each core's cache, it grows past that as needed
 static const int BB_CACHE_SIZE = 16384;
 
 namespace superstl {
@@ -627,9 +658,52 @@ enum {
   INVALIDATE_REASON_COUNT
 };
 
-struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager> {
-  BasicBlockCache(): SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager>() {
+struct BasicBlockCache: public OpenHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager> {
+  BasicBlockCache(): OpenHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager>() {
       cpuid = cpuid_counter++;
+      link_epoch = 1;
+  }
+
+  //
+  // Find the BB at <rvp> that is fetched after <prev>. Each BB remembers
+  // its last taken and not-taken successors so straight-line and loop
+  // fetch skips the hashtable. Invalidating any BB bumps link_epoch,
+  // which drops every cached successor at once. The successor fetched
+  // last is in lasttarget.
+  //
+  BasicBlock* get_successor(BasicBlock* prev, const RIPVirtPhys& rvp) {
+    if likely (prev && prev->succ_epoch == link_epoch) {
+      foreach (i, 2) {
+        BasicBlock* bb = prev->succ[i];
+        if likely (bb && bb->rip == rvp) {
+          prev->lasttarget = rvp.rip;
+          return bb;
+        }
+      }
+    }
+
+    BasicBlock* bb = get(rvp);
+    if likely (bb && prev) link_successor(prev, bb);
+    return bb;
+  }
+
+  void link_successor(BasicBlock* prev, BasicBlock* bb) {
+    if unlikely (prev->succ_epoch != link_epoch) {
+      prev->succ[0] = prev->succ[1] = NULL;
+      prev->succ_epoch = link_epoch;
+    }
+    prev->succ[(bb->rip.rip == prev->rip_taken) ? 0 : 1] = bb;
+    prev->lasttarget = bb->rip.rip;
+  }
+
+  // Successor of <bb> fetched last, NULL if it's not linked
+  BasicBlock* get_last_successor(BasicBlock* bb) {
+    if unlikely (bb->succ_epoch != link_epoch) return NULL;
+    foreach (i, 2) {
+      BasicBlock* succ = bb->succ[i];
+      if (succ && succ->rip.rip == bb->lasttarget) return succ;
+    }
+    return NULL;
   }
 
   BasicBlock* translate(Context& ctx, const RIPVirtPhys& rvp);
@@ -640,16 +714,40 @@ struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_S
   bool invalidate_page(Waddr mfn, int reason);
   int get_page_bb_count(Waddr mfn);
   void add_page(BasicBlock* bb);
+  bool smc_store(W64 physaddr);
+  bool invalidate_smc_lines(int reason);
+  void free_retired();
   int reclaim(size_t reqbytes = 0, int urgency = 0);
   void flush(int8_t context_id);
+  void update_arena_stats();
   W8 cpuid;
   static W8 cpuid_counter;
+  W32 link_epoch;
+  BasicBlockArena arena;
+  dynarray<W64> smc_dirty_pages;
+  // Invalidated while still referenced, freed once released
+  dynarray<BasicBlock*> retired;
 
   ostream& print(ostream& os);
 };
 
 extern BasicBlockCache bbcache[NUM_SIM_CORES];
 
+//
+// With -shared-bbcache all contexts use bbcache[0], so blocks of kernel
+// and shared library code are decoded once for the machine. Only change
+// through set_bbcache_shared(), which flushes the caches.
+//
+extern bool bbcache_shared;
+
+static inline BasicBlockCache& bbcache_of(int cpu_index) {
+  return bbcache[(bbcache_shared) ? 0 : cpu_index];
+}
+
+void set_bbcache_shared(bool shared);
+
+W64 bb_code_lines(const BasicBlock* bb, W64 mfn);
+
 extern ofstream bbcache_dump_file;
 
 static const char* decode_type_names[DECODE_TYPE_COUNT] = {
@@ -65,8 +65,75 @@ struct DecoderStats : public Statable
     cache bbcache;
     cache pagecache;
 
+    struct persistent : public Statable
+    {
+        StatObj<W64> hits;
+        StatObj<W64> stale;
+
+        persistent(Statable *parent)
+            : Statable("persistent", parent)
+              , hits("hits", this)
+              , stale("stale", this)
+        { }
+    } persistent;
+
+    struct arena : public Statable
+    {
+        StatObj<W64> used_bytes;
+        StatObj<W64> chunk_bytes;
+
+        arena(Statable *parent)
+            : Statable("arena", parent)
+              , used_bytes("used_bytes", this)
+              , chunk_bytes("chunk_bytes", this)
+        { }
+    } arena;
+
+    /*
+     * Stores to pages holding code, by 64 byte line: only BBs on the
+     * lines written are invalidated, the others on the page are kept
+     */
+    struct smc : public Statable
+    {
+        StatObj<W64> code_stores;
+        StatObj<W64> data_stores;
+        StatObj<W64> bbs_invalidated;
+        StatObj<W64> bbs_kept;
+
+        smc(Statable *parent)
+            : Statable("smc", parent)
+              , code_stores("code_stores", this)
+              , data_stores("data_stores", this)
+              , bbs_invalidated("bbs_invalidated", this)
+              , bbs_kept("bbs_kept", this)
+        { }
+    } smc;
+
+    /*
+     * Blocks of a -shared-bbcache invalidated while other cores still
+     * referenced them, and freed later once the last one released them
+     */
+    struct shared : public Statable
+    {
+        StatObj<W64> retired;
+        StatObj<W64> freed;
+
+        shared(Statable *parent)
+            : Statable("shared", parent)
+              , retired("retired", this)
+              , freed("freed", this)
+        { }
+    } shared;
+
     StatObj<W64> reclaim_rounds;
 
+    /*
+     * Assists in decoded basic blocks: each heavy assist basic block
+     * flushes the pipeline when it runs, light assists run in the pipeline
+     */
+    StatArray<W64, ASSIST_COUNT> assists;
+    StatArray<W64, L_ASSIST_COUNT> light_assists;
+
     DecoderStats(Statable *parent)
         : Statable("decode", parent)
           , throughput(this)
@@ -75,7 +142,13 @@ struct DecoderStats : public Statable
           , page_crossings(this)
           , bbcache("bbcache", this)
           , pagecache("pagecache", this)
+          , persistent(this)
+          , arena(this)
+          , smc(this)
+          , shared(this)
           , reclaim_rounds("reclaim_rounds", this)
+          , assists("assists", this, assist_names)
+          , light_assists("light_assists", this, light_assist_names)
     { }
 };
 
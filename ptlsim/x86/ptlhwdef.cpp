@@ -293,6 +293,8 @@ const char* sizeshift_names[4] = {
   "1 (byte)", "2 (word)", "4 (dword)", "8 (qword)"
 };
 
+W64 context_events = 0;
+
 bool Context::check_events() const {
 	if(exit_request)
 		return true;
@@ -301,6 +303,14 @@ bool Context::check_events() const {
 	return false;
 }
 
+//
+// Halted by hlt and nothing to wake it up yet: like QEMU's cpu_halted(),
+// hlt ends on a maskable interrupt with IF set, NMI, INIT or SIPI
+//
+bool Context::is_halted() const {
+    return halted && !qemu_cpu_has_work((CPUState*)this);
+}
+
 bool Context::is_int_pending() const {
     if(eflags & IF_MASK)
         return (interrupt_request > 0);
@@ -476,6 +486,8 @@ void BasicBlock::reset() {
   mfnhi_loc.reset();
   type = BB_TYPE_COND;
   context_id = 0;
+  cacheid = 0;
+  cacheid = 0;
 }
 
 void BasicBlock::reset(const RIPVirtPhys& rip) {
@@ -496,25 +508,104 @@ void BasicBlock::reset(const RIPVirtPhys& rip) {
 // in scope. Don't call this with non-cloned() blocks.
 //
 void BasicBlock::free() {
-  if (synthops) delete[] synthops;
-  synthops = NULL;
+  if (coredata) ::free(coredata);
+  coredata = NULL;
+
+  if (arena) {
+    // uopdescs live in the arena slot
+    arena->release(this);
+    return;
+  }
+
+  if (uopdescs) delete[] uopdescs;
+  uopdescs = NULL;
   ::free(this);
 }
 
-BasicBlock* BasicBlock::clone() {
-  BasicBlock* bb = (BasicBlock*)malloc(sizeof(BasicBlockBase) + (count * sizeof(TransOp)));
+//
+// Clone into <arena> if given, otherwise into a right-sized heap block
+//
+BasicBlock* BasicBlock::clone(BasicBlockArena* arena) {
+  BasicBlock* bb = (arena) ? arena->alloc(count) :
+    (BasicBlock*)malloc(sizeof(BasicBlockBase) + (count * sizeof(TransOp)));
 
   memcpy(bb, this, sizeof(BasicBlockBase));
 
-  bb->synthops = NULL;
+  bb->uopdescs = NULL;
+  bb->coredata = NULL;
+  bb->arena = arena;
   // hashlink, mfnlo_loc, mfnhi_loc are always updated after cloning
   bb->hashlink.reset();
+  bb->succ[0] = bb->succ[1] = NULL;
+  bb->succ_epoch = 0;
   bb->use(0);
 
   foreach (i, count) bb->transops[i] = this->transops[i];
   return bb;
 }
 
+BasicBlock* BasicBlockArena::alloc(int count) {
+  assert(count <= MAX_BB_UOPS*2);
+  int cls = size_class(count);
+  size_t size = slot_size(cls);
+
+  live++;
+  used_bytes += size;
+
+  FreeSlot* slot = freelist[cls];
+  if likely (slot) {
+    freelist[cls] = slot->next;
+    return (BasicBlock*)slot;
+  }
+
+  if unlikely ((top + size) > end) {
+    // The tail of the old chunk is too small for this class: leave it
+    Chunk* chunk = (Chunk*)malloc(BB_ARENA_CHUNK_SIZE);
+    assert(chunk);
+    chunk->next = chunks;
+    chunks = chunk;
+    chunk_bytes += BB_ARENA_CHUNK_SIZE;
+
+    top = ceilptr((byte*)(chunk + 1), 64);
+    end = (byte*)chunk + BB_ARENA_CHUNK_SIZE;
+  }
+
+  BasicBlock* bb = (BasicBlock*)top;
+  top += size;
+  return bb;
+}
+
+void BasicBlockArena::release(BasicBlock* bb) {
+  assert(live > 0);
+  int cls = size_class(bb->count);
+
+  live--;
+  used_bytes -= slot_size(cls);
+
+  FreeSlot* slot = (FreeSlot*)bb;
+  slot->next = freelist[cls];
+  freelist[cls] = slot;
+}
+
+//
+// Free every chunk at once. Only possible once no block is left in
+// the arena; returns false otherwise.
+//
+bool BasicBlockArena::release_chunks() {
+  if (live) return false;
+
+  while (chunks) {
+    Chunk* next = chunks->next;
+    ::free(chunks);
+    chunks = next;
+  }
+
+  top = end = NULL;
+  foreach (i, BB_ARENA_CLASSES) freelist[i] = NULL;
+  chunk_bytes = 0;
+  return true;
+}
+
 ostream& operator <<(ostream& os, const BasicBlock& bb) {
   os << "BasicBlock ", (void*)(Waddr)bb.rip, " of type ", branch_type_names[bb.brtype], ": ", bb.bytes, " bytes, ", bb.count, " transops (", bb.tagcount, "t ", bb.memcount, "m ", bb.storecount, "s";
   if (bb.repblock) os << " rep";
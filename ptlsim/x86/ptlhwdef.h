@@ -198,6 +198,14 @@ extern "C" W64 sim_cycle;
 #include <logic.h>
 #include <config.h>
 
+//
+// Bumped when an interrupt or exit request of any Context may have
+// changed (see ptl_notify_event) and on every return from QEMU to the
+// simulation, which covers IF, kernel mode and hlt changes. Cores check
+// their threads' events only when it moved, see ContextEvents.
+//
+extern W64 context_events;
+
 //
 // Exceptions:
 // These are PTL internal exceptions, NOT x86 exceptions:
@@ -831,6 +839,20 @@ struct Context: public CPUX86State {
   W64 exec_fault_addr;
   map<Waddr, Waddr> hvirt_gphys_map;
 
+  /*
+   * Host TLB: guest physical page of the host page that each QEMU TLB slot
+   * pointed to when it was last translated, so hits in check_and_translate
+   * don't search hvirt_gphys_map. An entry is used only while QEMU's TLB
+   * slot still points to the same host page, so QEMU's own TLB flushes and
+   * refills never leave stale translations here.
+   */
+  struct HostTLBEntry {
+      Waddr host_page;
+      Waddr phys_page;
+  };
+
+  HostTLBEntry host_tlb[NB_MMU_MODES][CPU_TLB_SIZE];
+
 
   void change_runstate(int new_state) { running = new_state; }
 
@@ -875,6 +897,7 @@ struct Context: public CPUX86State {
 	  eip = eip + segs[R_CS].base;
       cs_segment_updated();
 	  update_mode((hflags & HF_CPL_MASK) == 0);
+	  context_events++;
 	  reg_fptos = fpstt << 3;
 	  reg_fpstack = ((W64)&(fpregs[0].mmx.q));
 	  reg_trace = 0;
@@ -927,6 +950,39 @@ struct Context: public CPUX86State {
 
   int copy_from_vm(void* target, Waddr source, int bytes) ;
 
+  void flush_host_tlb() {
+      memset(host_tlb, 0, sizeof(host_tlb));
+  }
+
+  void flush_host_tlb_virt(Waddr virtaddr) {
+      int index = (virtaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+      foreach (i, NB_MMU_MODES) {
+          host_tlb[i][index].host_page = 0;
+      }
+  }
+
+  /*
+   * Host address of a RAM access that hits in QEMU's TLB and doesn't cross
+   * a page, NULL if the access needs QEMU's softmmu (miss, MMIO, or write
+   * to a page with translated code).  Used by loadvirt and storemask_virt
+   * to access RAM without switching Contexts to QEMU.
+   */
+  byte* host_addr(Waddr virtaddr, int sizeshift, bool store) {
+      if unlikely (((virtaddr & ~TARGET_PAGE_MASK) + (1 << sizeshift)) >
+              TARGET_PAGE_SIZE)
+          return NULL;
+
+      int mmu_idx = kernel_mode ? 0 : MMU_USER_IDX;
+      int index = (virtaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+      CPUTLBEntry& entry = tlb_table[mmu_idx][index];
+      W64 tlb_addr = store ? entry.addr_write : entry.addr_read;
+
+      if unlikely ((virtaddr & TARGET_PAGE_MASK) != tlb_addr)
+          return NULL;
+
+      return (byte*)(virtaddr + entry.addend);
+  }
+
   W64 loadvirt(Waddr virtaddr, int sizeshift=3);
   W64 loadphys(Waddr addr, bool internal=0, int sizeshift=3);
 
@@ -987,12 +1043,16 @@ struct Context: public CPUX86State {
 
   void init();
 
-  Context() : invalid_reg(-1), reg_zero(0), reg_ctx((Waddr)this) { }
+  Context() : invalid_reg(-1), reg_zero(0), reg_ctx((Waddr)this) {
+      flush_host_tlb();
+  }
 
   W64 virt_to_pte_phys_addr(Waddr virtaddr, byte& level);
+  int page_shift(Waddr virtaddr);
 
   void update_mode_count();
   bool check_events() const;
+  bool is_halted() const;
   bool is_int_pending() const;
   bool event_upcall();
 
@@ -1163,6 +1223,27 @@ struct Context: public CPUX86State {
 
 ostream& operator <<(ostream& os, const Context& ctx);
 
+//
+// Per thread view of context_events: changed() is true once after each
+// bump, and after recheck() which a core calls when it dropped the
+// interrupt state it took from check_events() (pipeline reset, EOM
+// commit) and still has to see a pending event again.
+//
+struct ContextEvents {
+  W64 seen;
+
+  ContextEvents() { recheck(); }
+
+  void recheck() { seen = (W64)-1; }
+
+  bool changed() {
+      if likely (seen == context_events)
+          return false;
+      seen = context_events;
+      return true;
+  }
+};
+
 static inline ostream& operator <<(ostream& os, const SegmentCache& seg) {
 	os << " selector [", seg.selector, "]";
 	os << " base [", seg.base, "]";
@@ -1603,6 +1684,56 @@ struct BasicBlock;
 
 typedef void (*uopimpl_func_t)(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags);
 
+//
+// Decoded uop descriptor, built once per uop of a cached basic block
+// so the issue loops of the cores read one 16 byte record instead of
+// looking up opinfo and their own fuinfo table on every issue.
+//
+// fu, port and latency depend on the core model: the core passes a
+// uopdesc_fill_func_t to synth_uops_for_bb() to fill them in.
+//
+enum {
+  UOPDESC_LOAD     = (1 << 0),
+  UOPDESC_STORE    = (1 << 1),
+  UOPDESC_BRANCH   = (1 << 2),
+  UOPDESC_BARRIER  = (1 << 3),
+  UOPDESC_RB_IMM   = (1 << 4),
+  UOPDESC_RC_IMM   = (1 << 5),
+  UOPDESC_NONPIPE  = (1 << 6),
+};
+
+//
+// Fusion of a uop with the one before it in its basic block, set by
+// synth_uops_for_bb() for the kinds of the fusion mask it is passed:
+//
+// FUSION_MACRO: single uop conditional branch after the add, sub or and
+//               (cmp, test) setting the flags it reads, as cmp+jcc
+// FUSION_MICRO: uop of the same x86 insn using the value just loaded,
+//               as a load-op; stores are already one address+data uop
+//
+// The OOO core renames, dispatches and commits a fused uop in the slot
+// of the one before it.
+//
+enum {
+  FUSION_MACRO     = (1 << 0),
+  FUSION_MICRO     = (1 << 1),
+};
+
+struct UopDescriptor {
+  uopimpl_func_t synthop;
+  W16 fu;
+  byte latency;
+  byte port;
+  byte flags;
+  // opclassof(opcode)
+  byte opclass;
+  // FUSION_ kind fusing this uop with the previous one, 0 if none
+  byte fused;
+  byte pad[1];
+};
+
+typedef void (*uopdesc_fill_func_t)(UopDescriptor& desc, const TransOp& op);
+
 
 //
 // List of all BBs on a physical page (for SMC invalidation)
@@ -1621,9 +1752,13 @@ struct BasicBlockChunkList: public ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK> {
   selflistlink hashlink;
   W64 mfn;
   int refcount;
+  // One bit per 64 byte line of the page: lines holding code of the
+  // listed BBs, and those of them written since the BBs were decoded
+  W64 code_lines;
+  W64 dirty_lines;
 
-  BasicBlockChunkList(): ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK>() { refcount = 0; }
-  BasicBlockChunkList(W64 mfn): ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK>() { this->mfn = mfn; refcount = 0; }
+  BasicBlockChunkList(): ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK>() { refcount = 0; code_lines = 0; dirty_lines = 0; }
+  BasicBlockChunkList(W64 mfn): ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK>() { this->mfn = mfn; refcount = 0; code_lines = 0; dirty_lines = 0; }
 };
 
 enum { BB_TYPE_COND, BB_TYPE_UNCOND, BB_TYPE_INDIR, BB_TYPE_ASSIST, BB_TYPE_COUNT };
@@ -1682,11 +1817,17 @@ enum {
 extern const char* branch_type_names[8];
 
 
+struct BasicBlockArena;
+
 struct BasicBlockBase {
   RIPVirtPhys rip;
   selflistlink hashlink;
   BasicBlockChunkList::Locator mfnlo_loc;
   BasicBlockChunkList::Locator mfnhi_loc;
+  // Physical pages of the x86 bytes, RIPVirtPhys::INVALID if unmapped;
+  // the page lists used for SMC invalidation are keyed by these
+  W64 code_mfnlo;
+  W64 code_mfnhi;
   W64 rip_taken;
   W64 rip_not_taken;
   W16 count;
@@ -1698,7 +1839,12 @@ struct BasicBlockBase {
   byte type:4, repblock:1, invalidblock:1, call:1, ret:1;
   byte marked:1, mfence:1, x87:1, sse:1, nondeterministic:1, brtype:3;
   W64 usedregs;
-  uopimpl_func_t* synthops;
+  UopDescriptor* uopdescs;
+  // Core model specific decode built from uopdescs on first fetch (e.g.
+  // the in-order core's AtomOp groups), malloc'ed, freed with the block
+  void* coredata;
+  // Arena this block was cloned into, or NULL if it was malloc'ed
+  BasicBlockArena* arena;
   int refcount;
   W32 hitcount;
   W32 predcount;
@@ -1706,6 +1852,14 @@ struct BasicBlockBase {
   W64 lastused;
   W64 lasttarget;
   W16 context_id;
+  // Index in bbcache[] of the cache holding this block
+  W8 cacheid;
+  // Hash of the x86 bytes this block was decoded from
+  W64 codehash;
+  // Cached successors (taken, not taken), valid while succ_epoch matches
+  // the owning BasicBlockCache's link_epoch
+  BasicBlock* succ[2];
+  W32 succ_epoch;
 
   void acquire() {
     refcount++;
@@ -1723,11 +1877,82 @@ struct BasicBlock: public BasicBlockBase {
 
   void reset();
   void reset(const RIPVirtPhys& rip);
-  BasicBlock* clone();
+  BasicBlock* clone(BasicBlockArena* arena = NULL);
   void free();
   void use(W64 counter) { lastused = counter; };
 };
 
+//
+// Slab allocator for the basic blocks held by a BasicBlockCache.
+//
+// Only the full sized BasicBlock the decoder builds in has room for
+// MAX_BB_UOPS*2 transops; each clone takes one slot sized for its uop
+// count rounded up to BB_ARENA_GRAIN, followed by room for its uopdescs,
+// so a block and its uop descriptors share cache lines instead of
+// living in two unrelated heap objects. Slots are carved from large
+// chunks and a freed slot goes back on the free list of its size class.
+// Once the last block is freed, flush() and reclaim() release all chunks
+// at once.
+//
+static const int BB_ARENA_GRAIN = 4;
+static const int BB_ARENA_CLASSES = ((MAX_BB_UOPS*2) + BB_ARENA_GRAIN - 1) / BB_ARENA_GRAIN;
+static const size_t BB_ARENA_CHUNK_SIZE = 256*1024;
+
+struct BasicBlockArena {
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+
+  struct Chunk {
+    Chunk* next;
+  };
+
+  Chunk* chunks;
+  byte* top;
+  byte* end;
+  FreeSlot* freelist[BB_ARENA_CLASSES];
+
+  // Blocks in use, and bytes taken by their slots and by all chunks
+  W64 live;
+  W64 used_bytes;
+  W64 chunk_bytes;
+
+  BasicBlockArena() {
+    chunks = NULL;
+    top = end = NULL;
+    foreach (i, BB_ARENA_CLASSES) freelist[i] = NULL;
+    live = 0;
+    used_bytes = 0;
+    chunk_bytes = 0;
+  }
+
+  ~BasicBlockArena() { release_chunks(); }
+
+  static int size_class(int count) {
+    return (max(count, 1) + BB_ARENA_GRAIN - 1) / BB_ARENA_GRAIN - 1;
+  }
+
+  static int slot_uops(int cls) { return (cls + 1) * BB_ARENA_GRAIN; }
+
+  // Slots start on a cache line, so do their descriptors
+  static size_t descs_offset(int cls) {
+    return ceil(sizeof(BasicBlockBase) + slot_uops(cls) * sizeof(TransOp), 64);
+  }
+
+  static size_t slot_size(int cls) {
+    return ceil(descs_offset(cls) + slot_uops(cls) * sizeof(UopDescriptor), 64);
+  }
+
+  // Descriptor storage reserved after the transops of an arena block
+  static UopDescriptor* uopdescs_of(BasicBlock& bb) {
+    return (UopDescriptor*)((byte*)&bb + descs_offset(size_class(bb.count)));
+  }
+
+  BasicBlock* alloc(int count);
+  void release(BasicBlock* bb);
+  bool release_chunks();
+};
+
 ostream& operator <<(ostream& os, const BasicBlock& bb);
 
 //
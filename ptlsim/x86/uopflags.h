@@ -0,0 +1,71 @@
+//
+// PTLsim: Cycle Accurate x86-64 Simulator
+// SF, ZF and PF generation for uop implementations
+//
+// This code is released under GPL.
+// Copyright 2011 Avadh Patel <apatel@cs.binghamton.edu>
+//
+
+#ifndef _UOPFLAGS_H_
+#define _UOPFLAGS_H_
+
+#include <globals.h>
+#include <ptlhwdef.h>
+
+//
+// x86_genflags<T>() in uopimpl.cpp uses one of these, picked at build
+// time with 'scons uopflags=setcc|lahf|table' (setcc by default).
+// All of them return the same SF, ZF and PF bits; AF is never set.
+//
+// setcc: test, then one setcc per flag
+// lahf:  test, then lahf copies SF ZF AF PF CF to %ah in one go.
+//        Needs LAHF in 64-bit mode (all but the earliest x86-64 hosts).
+// table: no host flags at all: PF from a 256 entry table, ZF and SF
+//        from plain compares the compiler can keep branch free
+//
+
+template <typename T>
+inline byte x86_genflags_setcc(T r) {
+  byte sf, zf, pf;
+  asm("test %[r],%[r]\n"
+      "sets %[sf]\n"
+      "setz %[zf]\n"
+      "setp %[pf]\n"
+      : [sf] "=q" (sf), [zf] "=q" (zf), [pf] "=q" (pf)
+      : [r] "q" (r));
+
+  return (sf << 7) + (zf << 6) + (pf << 2);
+}
+
+template <typename T>
+inline byte x86_genflags_lahf(T r) {
+  W16 ax;
+  asm("test %[r],%[r]\n"
+      "lahf\n"
+      : "=a" (ax)
+      : [r] "q" (r));
+
+  return (ax >> 8) & (FLAG_SF|FLAG_ZF|FLAG_PF);
+}
+
+// FLAG_PF for every byte with an even number of set bits
+#define PARITY2(n) n, n^FLAG_PF, n^FLAG_PF, n
+#define PARITY4(n) PARITY2(n), PARITY2(n^FLAG_PF), PARITY2(n^FLAG_PF), PARITY2(n)
+#define PARITY6(n) PARITY4(n), PARITY4(n^FLAG_PF), PARITY4(n^FLAG_PF), PARITY4(n)
+
+static const byte x86_parity_table[256] = {
+  PARITY6(FLAG_PF), PARITY6(0), PARITY6(0), PARITY6(FLAG_PF)
+};
+
+#undef PARITY2
+#undef PARITY4
+#undef PARITY6
+
+template <typename T>
+inline byte x86_genflags_table(T r) {
+  byte sf = (r >> ((sizeof(T) * 8) - 1)) & 1;
+  byte zf = (r == 0);
+  return (sf << 7) | (zf << 6) | x86_parity_table[(byte)r];
+}
+
+#endif // _UOPFLAGS_H_
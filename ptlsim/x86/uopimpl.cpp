@@ -7,6 +7,7 @@
 
 #include <globals.h>
 #include <ptlsim.h>
+#include <uopflags.h>
 
 
 // No operation
@@ -25,19 +26,17 @@ typedef W32 Wmax;
 // void uop_impl_bogus(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags) { asm("int3"); }
 
 //
-// Flags generation (all but CF and OF)
+// Flags generation (all but CF and OF), see uopflags.h
 //
 template <typename T>
 inline byte x86_genflags(T r) {
-  byte sf, zf, pf;
-  asm("test %[r],%[r]\n"
-      "sets %[sf]\n"
-      "setz %[zf]\n"
-      "setp %[pf]\n"
-      : [sf] "=q" (sf), [zf] "=q" (zf), [pf] "=q" (pf)
-      : [r] "q" (r));
-
-  return (sf << 7) + (zf << 6) + (pf << 2);
+#if defined(UOPIMPL_FLAGS_LAHF)
+  return x86_genflags_lahf<T>(r);
+#elif defined(UOPIMPL_FLAGS_TABLE)
+  return x86_genflags_table<T>(r);
+#else
+  return x86_genflags_setcc<T>(r);
+#endif
 }
 
 template <typename T>
@@ -1788,12 +1787,60 @@ uopimpl_func_t get_synthcode_for_uop(int op, int size, bool setflags, int cond,
   return func;
 }
 
-void synth_uops_for_bb(BasicBlock& bb) {
-  bb.synthops = new uopimpl_func_t[bb.count];
+void make_uop_descriptor(UopDescriptor& desc, const TransOp& op, uopimpl_func_t synthop, uopdesc_fill_func_t fill) {
+  setzero(desc);
+  desc.synthop = synthop;
+  desc.opclass = opclassof(op.opcode);
+  desc.flags =
+    (isload(op.opcode) ? UOPDESC_LOAD : 0) |
+    (isstore(op.opcode) ? UOPDESC_STORE : 0) |
+    (isbranch(op.opcode) ? UOPDESC_BRANCH : 0) |
+    (isbarrier(op.opcode) ? UOPDESC_BARRIER : 0) |
+    ((op.rb == REG_imm) ? UOPDESC_RB_IMM : 0) |
+    ((op.rc == REG_imm) ? UOPDESC_RC_IMM : 0);
+  fill(desc, op);
+}
+
+// SETFLAG_ bit a uop must set for a branch reading flag register reg
+static inline W32 setflag_of_flag_reg(int reg) {
+  switch (reg) {
+  case REG_zf: return SETFLAG_ZF;
+  case REG_cf: return SETFLAG_CF;
+  case REG_of: return SETFLAG_OF;
+  default: return 0;
+  }
+}
+
+//
+// FUSION_ kind, of those in the fusion mask, op is fused with prev as,
+// 0 if it is not fusible with it
+//
+int fuse_uop_kind(const TransOp& prev, const TransOp& op, int fusion) {
+  if ((fusion & FUSION_MACRO) && (op.opcode == OP_br) && op.som && op.eom &&
+      prev.eom && (!prev.nouserflags) &&
+      ((prev.opcode == OP_sub) | (prev.opcode == OP_and) | (prev.opcode == OP_add))) {
+    W32 needed = setflag_of_flag_reg(op.ra) | setflag_of_flag_reg(op.rb);
+    if (needed && ((prev.setflags & needed) == needed)) return FUSION_MACRO;
+  }
+
+  if ((fusion & FUSION_MICRO) && ((prev.opcode == OP_ld) | (prev.opcode == OP_ldx)) &&
+      (!prev.eom) && (!prev.locked) && (!op.som) && (prev.rd != REG_zero) &&
+      (!isload(op.opcode)) && (!isstore(op.opcode)) && (!isbranch(op.opcode)) &&
+      (!isbarrier(op.opcode)) &&
+      ((op.ra == prev.rd) | (op.rb == prev.rd) | (op.rc == prev.rd))) {
+    return FUSION_MICRO;
+  }
+
+  return 0;
+}
+
+void synth_uops_for_bb(BasicBlock& bb, uopdesc_fill_func_t fill, int fusion) {
+  bb.uopdescs = (bb.arena) ? BasicBlockArena::uopdescs_of(bb) : new UopDescriptor[bb.count];
   foreach (i, bb.count) {
     const TransOp& transop = bb.transops[i];
     uopimpl_func_t func = get_synthcode_for_uop(transop.opcode, transop.size, transop.setflags, transop.cond, transop.extshift, 0, transop.internal);
-    bb.synthops[i] = func;
+    make_uop_descriptor(bb.uopdescs[i], transop, func, fill);
+    if (fusion && i) bb.uopdescs[i].fused = fuse_uop_kind(bb.transops[i-1], transop, fusion);
   }
 }
 
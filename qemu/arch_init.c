@@ -27,6 +27,9 @@
 #ifndef _WIN32
 #include <sys/types.h>
 #include <sys/mman.h>
+#ifdef MARSS_QEMU
+#include <sys/file.h>
+#endif
 #endif
 #include "config.h"
 #include "monitor.h"
@@ -89,6 +92,9 @@ const uint32_t arch_type = QEMU_ARCH;
 #define RAM_SAVE_FLAG_PAGE     0x08
 #define RAM_SAVE_FLAG_EOS      0x10
 #define RAM_SAVE_FLAG_CONTINUE 0x20
+#define RAM_SAVE_FLAG_FILE     0x40 /* Block is in a page aligned RAM file */
+#define RAM_SAVE_FLAG_STORE    0x80 /* Block is in the shared page store */
+
 
 static int is_dup_page(uint8_t *page, uint8_t ch)
 {
@@ -105,6 +111,495 @@ static int is_dup_page(uint8_t *page, uint8_t ch)
     return 1;
 }
 
+#ifdef MARSS_QEMU
+/* When set, savevm writes each RAMBlock to '<prefix>.<block>.ram' file that
+ * loadvm maps lazily instead of reading all pages from the snapshot */
+const char *ram_file_prefix = NULL;
+
+static int ram_save_block_file(QEMUFile *f, RAMBlock *block)
+{
+    char path[1024];
+    char tmp_path[1040];
+    ram_addr_t offset;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s.%s.ram", ram_file_prefix, block->idstr);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Can't create RAM file %s\n", tmp_path);
+        return -1;
+    }
+
+    /* Zero pages stay holes of a sparse file */
+    if (ftruncate(fd, block->length) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    for (offset = 0; offset < block->length; offset += TARGET_PAGE_SIZE) {
+        uint8_t *p = block->host + offset;
+        if (p[0] == 0 && is_dup_page(p, 0)) {
+            continue;
+        }
+        if (pwrite(fd, p, TARGET_PAGE_SIZE, offset) != TARGET_PAGE_SIZE) {
+            fprintf(stderr, "Can't write RAM file %s\n", tmp_path);
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+
+    /* Rename so processes that have mapped the old file keep its pages */
+    if (rename(tmp_path, path) < 0) {
+        return -1;
+    }
+
+    qemu_put_be64(f, RAM_SAVE_FLAG_FILE);
+    qemu_put_byte(f, strlen(block->idstr));
+    qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
+    qemu_put_be16(f, strlen(path));
+    qemu_put_buffer(f, (uint8_t *)path, strlen(path));
+
+    cpu_physical_memory_reset_dirty(block->offset,
+                                    block->offset + block->length,
+                                    MIGRATION_DIRTY_FLAG);
+    return 0;
+}
+
+static int ram_load_block_file(QEMUFile *f)
+{
+    RAMBlock *block;
+    char id[256];
+    char path[1024];
+    uint8_t len;
+    uint16_t path_len;
+    void *host;
+    int fd;
+
+    len = qemu_get_byte(f);
+    qemu_get_buffer(f, (uint8_t *)id, len);
+    id[len] = 0;
+
+    path_len = qemu_get_be16(f);
+    if (path_len >= sizeof(path)) {
+        return -EINVAL;
+    }
+    qemu_get_buffer(f, (uint8_t *)path, path_len);
+    path[path_len] = 0;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        if (!strncmp(id, block->idstr, sizeof(id)))
+            break;
+    }
+
+    if (!block) {
+        fprintf(stderr, "Can't find block %s!\n", id);
+        return -EINVAL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open RAM file %s\n", path);
+        return -EIO;
+    }
+
+    /* Private mapping over guest RAM: pages are read from the file when
+     * QEMU or the simulator first touches them and writes stay local */
+    host = mmap(block->host, block->length, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if (host == MAP_FAILED) {
+        fprintf(stderr, "Can't map RAM file %s\n", path);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/*
+ * When set with ram_file_prefix, savevm writes each distinct page once to
+ * this store shared by all checkpoints and a manifest per RAMBlock.
+ *
+ * '<store>' holds page aligned pages, only ever appended, and
+ * '<store>.index' the uint64_t hash and store page number of each. The
+ * manifest '<prefix>.<block>.pages' has one uint64_t per guest page: 0
+ * for a zero page, else the store page number + 1. Savers lock the store,
+ * so checkpoints of several QEMUs can share it.
+ */
+const char *ram_page_store = NULL;
+
+/* Runs of shorter ones are read at loadvm instead of mapped, so a block
+ * needs at most length / (RAM_STORE_MAP_PAGES pages) mappings */
+#define RAM_STORE_MAP_PAGES 64
+
+typedef struct RamStoreEntry {
+    uint64_t hash;
+    uint64_t page;
+} RamStoreEntry;
+
+/* Index of the store in memory, open addressing on hash */
+static struct {
+    char path[1024];
+    RamStoreEntry *table;
+    uint64_t slots;
+    uint64_t used;
+    uint64_t index_read;
+} ram_store;
+
+#define RAM_STORE_EMPTY ((uint64_t)-1)
+
+static uint64_t ram_store_hash(const uint8_t *p)
+{
+    const uint64_t *w = (const uint64_t *)p;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE / 8; i++) {
+        h = (h ^ w[i]) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+
+    return h;
+}
+
+static void ram_store_insert(uint64_t hash, uint64_t page);
+
+static void ram_store_grow(void)
+{
+    RamStoreEntry *old = ram_store.table;
+    uint64_t old_slots = ram_store.slots;
+    uint64_t i;
+
+    ram_store.slots = old_slots ? old_slots * 2 : 65536;
+    ram_store.table = qemu_malloc(ram_store.slots * sizeof(RamStoreEntry));
+    memset(ram_store.table, 0xff, ram_store.slots * sizeof(RamStoreEntry));
+    ram_store.used = 0;
+
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].page != RAM_STORE_EMPTY) {
+            ram_store_insert(old[i].hash, old[i].page);
+        }
+    }
+    qemu_free(old);
+}
+
+static void ram_store_insert(uint64_t hash, uint64_t page)
+{
+    uint64_t i;
+
+    if (2 * (ram_store.used + 1) > ram_store.slots) {
+        ram_store_grow();
+    }
+
+    i = hash & (ram_store.slots - 1);
+    while (ram_store.table[i].page != RAM_STORE_EMPTY) {
+        i = (i + 1) & (ram_store.slots - 1);
+    }
+
+    ram_store.table[i].hash = hash;
+    ram_store.table[i].page = page;
+    ram_store.used++;
+}
+
+/* Store page with the contents of 'p', compared in full as hashes can
+ * collide, or RAM_STORE_EMPTY */
+static uint64_t ram_store_lookup(int fd, uint64_t hash, const uint8_t *p)
+{
+    uint8_t buf[TARGET_PAGE_SIZE];
+    uint64_t i;
+
+    if (!ram_store.slots) {
+        return RAM_STORE_EMPTY;
+    }
+
+    i = hash & (ram_store.slots - 1);
+    for (; ram_store.table[i].page != RAM_STORE_EMPTY;
+            i = (i + 1) & (ram_store.slots - 1)) {
+        uint64_t page = ram_store.table[i].page;
+
+        if (ram_store.table[i].hash != hash) {
+            continue;
+        }
+        if (pread(fd, buf, TARGET_PAGE_SIZE, page * TARGET_PAGE_SIZE) ==
+                TARGET_PAGE_SIZE && !memcmp(buf, p, TARGET_PAGE_SIZE)) {
+            return page;
+        }
+    }
+
+    return RAM_STORE_EMPTY;
+}
+
+/* Catch up with pages other QEMUs added since the last save */
+static int ram_store_read_index(int index_fd)
+{
+    RamStoreEntry entries[512];
+    ssize_t n;
+    int i;
+
+    if (strcmp(ram_store.path, ram_page_store)) {
+        qemu_free(ram_store.table);
+        ram_store.table = NULL;
+        ram_store.slots = 0;
+        ram_store.used = 0;
+        ram_store.index_read = 0;
+        pstrcpy(ram_store.path, sizeof(ram_store.path), ram_page_store);
+    }
+
+    while ((n = pread(index_fd, entries, sizeof(entries),
+                    ram_store.index_read)) > 0) {
+        n /= sizeof(RamStoreEntry);
+        for (i = 0; i < n; i++) {
+            ram_store_insert(entries[i].hash, entries[i].page);
+        }
+        ram_store.index_read += n * sizeof(RamStoreEntry);
+    }
+
+    return n < 0 ? -1 : 0;
+}
+
+static int ram_save_block_store(QEMUFile *f, RAMBlock *block)
+{
+    char path[1024];
+    char tmp_path[1040];
+    char index_path[1040];
+    uint64_t pages = block->length / TARGET_PAGE_SIZE;
+    uint64_t *manifest;
+    RamStoreEntry *added;
+    uint64_t nadded = 0;
+    uint64_t end;
+    uint64_t i;
+    int fd, index_fd, ret = -1;
+
+    snprintf(path, sizeof(path), "%s.%s.pages", ram_file_prefix,
+             block->idstr);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    snprintf(index_path, sizeof(index_path), "%s.index", ram_page_store);
+
+    fd = open(ram_page_store, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open page store %s\n", ram_page_store);
+        return -1;
+    }
+    index_fd = open(index_path, O_RDWR | O_CREAT, 0644);
+    if (index_fd < 0) {
+        fprintf(stderr, "Can't open page store index %s\n", index_path);
+        close(fd);
+        return -1;
+    }
+
+    manifest = qemu_malloc(pages * sizeof(uint64_t));
+    added = qemu_malloc(pages * sizeof(RamStoreEntry));
+
+    /* Pages of a crashed save past the last indexed one are written over */
+    flock(fd, LOCK_EX);
+    if (ram_store_read_index(index_fd) < 0) {
+        goto out;
+    }
+    end = 0;
+    if (ram_store.index_read) {
+        RamStoreEntry last;
+        if (pread(index_fd, &last, sizeof(last),
+                  ram_store.index_read - sizeof(last)) != sizeof(last)) {
+            goto out;
+        }
+        end = last.page + 1;
+    }
+
+    for (i = 0; i < pages; i++) {
+        uint8_t *p = block->host + i * TARGET_PAGE_SIZE;
+        uint64_t hash, page;
+
+        if (p[0] == 0 && is_dup_page(p, 0)) {
+            manifest[i] = 0;
+            continue;
+        }
+
+        hash = ram_store_hash(p);
+        page = ram_store_lookup(fd, hash, p);
+        if (page == RAM_STORE_EMPTY) {
+            page = end++;
+            if (pwrite(fd, p, TARGET_PAGE_SIZE, page * TARGET_PAGE_SIZE) !=
+                    TARGET_PAGE_SIZE) {
+                fprintf(stderr, "Can't write page store %s\n",
+                        ram_page_store);
+                goto out;
+            }
+            ram_store_insert(hash, page);
+            added[nadded].hash = hash;
+            added[nadded].page = page;
+            nadded++;
+        }
+        manifest[i] = page + 1;
+    }
+
+    /* Pages are in the store before the index names them */
+    if (nadded) {
+        ssize_t size = nadded * sizeof(RamStoreEntry);
+        if (pwrite(index_fd, added, size, ram_store.index_read) != size) {
+            fprintf(stderr, "Can't write page store index %s\n", index_path);
+            goto out;
+        }
+        ram_store.index_read += size;
+    }
+    flock(fd, LOCK_UN);
+
+    {
+        int mfd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ssize_t size = pages * sizeof(uint64_t);
+
+        if (mfd < 0 || write(mfd, manifest, size) != size) {
+            fprintf(stderr, "Can't write page manifest %s\n", tmp_path);
+            if (mfd >= 0) {
+                close(mfd);
+            }
+            goto out;
+        }
+        close(mfd);
+    }
+
+    if (rename(tmp_path, path) < 0) {
+        goto out;
+    }
+
+    qemu_put_be64(f, RAM_SAVE_FLAG_STORE);
+    qemu_put_byte(f, strlen(block->idstr));
+    qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
+    qemu_put_be16(f, strlen(ram_page_store));
+    qemu_put_buffer(f, (uint8_t *)ram_page_store, strlen(ram_page_store));
+    qemu_put_be16(f, strlen(path));
+    qemu_put_buffer(f, (uint8_t *)path, strlen(path));
+
+    cpu_physical_memory_reset_dirty(block->offset,
+                                    block->offset + block->length,
+                                    MIGRATION_DIRTY_FLAG);
+
+    fprintf(stderr, "RAM block %s: %" PRIu64 " pages, %" PRIu64
+            " new in page store\n", block->idstr, pages, nadded);
+    ret = 0;
+
+out:
+    flock(fd, LOCK_UN);
+    close(index_fd);
+    close(fd);
+    qemu_free(added);
+    qemu_free(manifest);
+    return ret;
+}
+
+static int ram_get_path(QEMUFile *f, char *path, size_t size)
+{
+    uint16_t len = qemu_get_be16(f);
+
+    if (len >= size) {
+        return -EINVAL;
+    }
+    qemu_get_buffer(f, (uint8_t *)path, len);
+    path[len] = 0;
+    return 0;
+}
+
+static int ram_load_block_store(QEMUFile *f)
+{
+    RAMBlock *block;
+    char id[256];
+    char store[1024];
+    char path[1024];
+    uint8_t len;
+    uint64_t *manifest;
+    uint64_t pages, i, n;
+    int fd, mfd, ret = -EIO;
+
+    len = qemu_get_byte(f);
+    qemu_get_buffer(f, (uint8_t *)id, len);
+    id[len] = 0;
+
+    if (ram_get_path(f, store, sizeof(store)) < 0 ||
+            ram_get_path(f, path, sizeof(path)) < 0) {
+        return -EINVAL;
+    }
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        if (!strncmp(id, block->idstr, sizeof(id)))
+            break;
+    }
+
+    if (!block) {
+        fprintf(stderr, "Can't find block %s!\n", id);
+        return -EINVAL;
+    }
+
+    pages = block->length / TARGET_PAGE_SIZE;
+    manifest = qemu_malloc(pages * sizeof(uint64_t));
+
+    mfd = open(path, O_RDONLY);
+    if (mfd < 0 || read(mfd, manifest, pages * sizeof(uint64_t)) !=
+            (ssize_t)(pages * sizeof(uint64_t))) {
+        fprintf(stderr, "Can't read page manifest %s\n", path);
+        if (mfd >= 0) {
+            close(mfd);
+        }
+        qemu_free(manifest);
+        return -EIO;
+    }
+    close(mfd);
+
+    fd = open(store, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open page store %s\n", store);
+        qemu_free(manifest);
+        return -EIO;
+    }
+
+    /* Runs of consecutive store pages, or of zero pages, that are long
+     * enough are mapped privately like a RAM file, the others read */
+    for (i = 0; i < pages; i += n) {
+        uint8_t *host = block->host + i * TARGET_PAGE_SIZE;
+        size_t size;
+
+        for (n = 1; i + n < pages; n++) {
+            uint64_t next = manifest[i] ? manifest[i] + n : 0;
+            if (manifest[i + n] != next) {
+                break;
+            }
+        }
+        size = n * TARGET_PAGE_SIZE;
+
+        if (n >= RAM_STORE_MAP_PAGES) {
+            void *p;
+            if (manifest[i]) {
+                p = mmap(host, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED, fd,
+                         (manifest[i] - 1) * TARGET_PAGE_SIZE);
+            } else {
+                p = mmap(host, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+            }
+            if (p == MAP_FAILED) {
+                fprintf(stderr, "Can't map page store %s\n", store);
+                goto out;
+            }
+        } else if (manifest[i]) {
+            if (pread(fd, host, size, (manifest[i] - 1) * TARGET_PAGE_SIZE) !=
+                    (ssize_t)size) {
+                fprintf(stderr, "Can't read page store %s\n", store);
+                goto out;
+            }
+        } else {
+            memset(host, 0, size);
+        }
+    }
+    ret = 0;
+
+out:
+    close(fd);
+    qemu_free(manifest);
+    return ret;
+}
+#endif
+
 static RAMBlock *last_block;
 static ram_addr_t last_offset;
 
@@ -291,6 +786,20 @@ int ram_save_live(Monitor *mon, QEMUFile *f, int stage, void *opaque)
             qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
             qemu_put_be64(f, block->length);
         }
+
+#ifdef MARSS_QEMU
+        /* Only snapshots of a stopped VM, pages can't change after this */
+        if (ram_file_prefix && !vm_running) {
+            QLIST_FOREACH(block, &ram_list.blocks, next) {
+                int ret = ram_page_store ? ram_save_block_store(f, block) :
+                    ram_save_block_file(f, block);
+                if (ret < 0) {
+                    qemu_file_set_error(f);
+                    return 0;
+                }
+            }
+        }
+#endif
     }
 
     bytes_transferred_last = bytes_transferred;
@@ -417,6 +926,24 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             }
         }
 
+#ifdef MARSS_QEMU
+        if (flags & RAM_SAVE_FLAG_FILE) {
+            int ret = ram_load_block_file(f);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+
+        if (flags & RAM_SAVE_FLAG_STORE) {
+            int ret = ram_load_block_store(f);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+#endif
+
         if (flags & RAM_SAVE_FLAG_COMPRESS) {
             void *host;
             uint8_t ch;
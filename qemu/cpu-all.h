@@ -904,6 +904,10 @@ extern int mem_prealloc;
 #define VGA_DIRTY_FLAG       0x01
 #define CODE_DIRTY_FLAG      0x02
 #define MIGRATION_DIRTY_FLAG 0x08
+#ifdef MARSS_QEMU
+/* Cleared when simulation stops, for pages written in emulation */
+#define MARSS_DIRTY_FLAG     0x04
+#endif
 
 /* read dirty bit (return 0 or 1) */
 static inline int cpu_physical_memory_is_dirty(ram_addr_t addr)
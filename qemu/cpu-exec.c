@@ -794,6 +794,8 @@ int cpu_exec(CPUState *env1)
                         /* Restore PC.  */
                         cpu_pc_from_tb(env, tb);
 
+                        /* The TB stored its count before exiting */
+                        env->simpoint_decr += tb->icount;
                         insns_left = env->simpoint_decr;
                         if (insns_left > 0) {
                             cpu_exec_nocache(insns_left, tb);
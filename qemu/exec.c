@@ -1647,6 +1647,11 @@ void cpu_interrupt(CPUState *env, int mask)
     old_mask = env->interrupt_request;
     env->interrupt_request |= mask;
 
+#ifdef MARSS_QEMU
+    if(in_simulation)
+        ptl_notify_event();
+#endif
+
 #ifndef CONFIG_USER_ONLY
     /*
      * If called from iothread context, wake the target cpu in
@@ -1674,11 +1679,21 @@ void cpu_interrupt(CPUState *env, int mask)
 void cpu_reset_interrupt(CPUState *env, int mask)
 {
     env->interrupt_request &= ~mask;
+
+#ifdef MARSS_QEMU
+    if(in_simulation)
+        ptl_notify_event();
+#endif
 }
 
 void cpu_exit(CPUState *env)
 {
     env->exit_request = 1;
+
+#ifdef MARSS_QEMU
+    if(in_simulation)
+        ptl_notify_event();
+#endif
     cpu_unlink_tb(env);
 }
 
@@ -2242,7 +2257,8 @@ void tlb_set_page(CPUState *env, target_ulong vaddr,
     }
 
 #ifdef MARSS_QEMU
-	ptl_add_phys_memory_mapping(env->cpu_index, addend & TARGET_PAGE_MASK, paddr & TARGET_PAGE_MASK);
+	ptl_add_phys_memory_mapping(env->cpu_index, addend & TARGET_PAGE_MASK,
+            paddr & TARGET_PAGE_MASK, pd);
 #endif
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
@@ -2670,6 +2686,9 @@ void cpu_register_physical_memory_offset(target_phys_addr_t start_addr,
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
         tlb_flush(env, 1);
     }
+#ifdef MARSS_QEMU
+    ptl_phys_memory_changed();
+#endif
 }
 
 /* XXX: temporary until new memory mapping API */
@@ -3680,6 +3699,10 @@ void cpu_physical_memory_rw(target_phys_addr_t addr, uint8_t *buf,
                 /* RAM case */
                 ptr = qemu_get_ram_ptr(addr1);
                 memcpy(ptr, buf, l);
+#ifdef MARSS_QEMU
+                if(in_simulation)
+                    ptl_dma_access(addr, l, 1);
+#endif
                 if (!cpu_physical_memory_is_dirty(addr1)) {
                     /* invalidate code */
                     tb_invalidate_phys_page_range(addr1, addr1 + l, 0);
@@ -3717,6 +3740,10 @@ void cpu_physical_memory_rw(target_phys_addr_t addr, uint8_t *buf,
                 ptr = qemu_get_ram_ptr(pd & TARGET_PAGE_MASK) +
                     (addr & ~TARGET_PAGE_MASK);
                 memcpy(buf, ptr, l);
+#ifdef MARSS_QEMU
+                if(in_simulation)
+                    ptl_dma_access(addr, l, 0);
+#endif
             }
         }
         len -= l;
@@ -3864,6 +3891,13 @@ void *cpu_physical_memory_map(target_phys_addr_t addr,
             break;
         }
 
+#ifdef MARSS_QEMU
+        /* The device moves the data of RAM itself, bounces go through
+         * cpu_physical_memory_rw */
+        if(in_simulation && ptr != bounce.buffer)
+            ptl_dma_access(addr, l, is_write);
+#endif
+
         len -= l;
         addr += l;
         done += l;
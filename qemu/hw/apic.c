@@ -181,6 +181,15 @@ static void apic_local_deliver(APICState *s, int vector)
     }
 }
 
+/* Performance counter overflow, the LVT entry is masked as on hardware */
+void apic_deliver_pmi(DeviceState *d)
+{
+    APICState *s = DO_UPCAST(APICState, busdev.qdev, d);
+
+    apic_local_deliver(s, APIC_LVT_PERFORM);
+    s->lvt[APIC_LVT_PERFORM] |= APIC_LVT_MASKED;
+}
+
 void apic_deliver_pic_intr(DeviceState *d, int level)
 {
     APICState *s = DO_UPCAST(APICState, busdev.qdev, d);
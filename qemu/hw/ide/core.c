@@ -38,8 +38,6 @@
 #include <ptl-qemu.h>
 #endif
 
-//#define MARSS_DELAY_IO
-
 static const int smart_attributes[][5] = {
     /* id,  flags, val, wrst, thrsh */
     { 0x01, 0x03, 0x64, 0x64, 0x06}, /* raw read */
@@ -514,15 +512,17 @@ handle_rw_error:
     /* end of transfer ? */
     if (s->nsector == 0) {
         s->status = READY_STAT | SEEK_STAT;
-#if defined MARSS_QEMU && defined MARSS_DELAY_IO
-        if (in_simulation) {
-            add_qemu_io_event((QemuIOCB)&ide_set_irq, s->bus, 20000);
-        } else {
-            ide_set_irq(s->bus);
+#ifdef MARSS_QEMU
+        if (s->done_cycle) {
+            int delay = storage_io_complete(s->done_cycle);
+            s->done_cycle = 0;
+            if (delay > 0) {
+                add_qemu_io_event((QemuIOCB)&ide_set_irq, s->bus, delay);
+                goto eot;
+            }
         }
-#else
-        ide_set_irq(s->bus);
 #endif
+        ide_set_irq(s->bus);
         goto eot;
     }
 
@@ -563,6 +563,9 @@ static void ide_sector_start_dma(IDEState *s, int is_read)
     s->io_buffer_index = 0;
     s->io_buffer_size = 0;
     s->is_read = is_read;
+#ifdef MARSS_QEMU
+    s->done_cycle = storage_io_submit(!is_read, (uint64_t)s->nsector * 512);
+#endif
     s->bus->dma->ops->start_dma(s->bus->dma, s, ide_dma_cb);
 }
 
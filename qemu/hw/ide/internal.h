@@ -448,6 +448,10 @@ struct IDEState {
     uint8_t *smart_selftest_data;
     /* AHCI */
     int ncq_queues;
+#ifdef MARSS_QEMU
+    /* Cycle the storage model completes the DMA, 0 if not modeled */
+    uint64_t done_cycle;
+#endif
 };
 
 struct IDEDMAOps {
@@ -132,6 +132,14 @@ uint64_t cpu_get_tsc(CPUX86State *env)
     return cpu_get_ticks();
 }
 
+/* Performance monitoring interrupt of the simulated PMU */
+void cpu_deliver_pmi(CPUX86State *env)
+{
+    if (env->apic_state) {
+        apic_deliver_pmi(env->apic_state);
+    }
+}
+
 /* SMM support */
 
 static cpu_set_smm_t smm_set;
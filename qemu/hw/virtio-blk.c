@@ -19,6 +19,9 @@
 #ifdef __linux__
 # include <scsi/sg.h>
 #endif
+#ifdef MARSS_QEMU
+#include <ptl-qemu.h>
+#endif
 
 typedef struct VirtIOBlock
 {
@@ -47,6 +50,10 @@ typedef struct VirtIOBlockReq
     struct virtio_scsi_inhdr *scsi;
     QEMUIOVector qiov;
     struct VirtIOBlockReq *next;
+#ifdef MARSS_QEMU
+    /* Cycle the storage model completes it, 0 if not modeled */
+    uint64_t done_cycle;
+#endif
 } VirtIOBlockReq;
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, int status)
@@ -87,6 +94,13 @@ static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
     return 1;
 }
 
+#ifdef MARSS_QEMU
+static void virtio_blk_req_complete_ok(void *opaque)
+{
+    virtio_blk_req_complete(opaque, VIRTIO_BLK_S_OK);
+}
+#endif
+
 static void virtio_blk_rw_complete(void *opaque, int ret)
 {
     VirtIOBlockReq *req = opaque;
@@ -99,6 +113,16 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             return;
     }
 
+#ifdef MARSS_QEMU
+    if (req->done_cycle) {
+        int delay = storage_io_complete(req->done_cycle);
+        if (delay > 0) {
+            add_qemu_io_event(virtio_blk_req_complete_ok, req, delay);
+            return;
+        }
+    }
+#endif
+
     virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
 }
 
@@ -121,6 +145,9 @@ static VirtIOBlockReq *virtio_blk_alloc_request(VirtIOBlock *s)
     req->dev = s;
     req->qiov.size = 0;
     req->next = NULL;
+#ifdef MARSS_QEMU
+    req->done_cycle = 0;
+#endif
     return req;
 }
 
@@ -368,10 +395,16 @@ static void virtio_blk_handle_request(VirtIOBlockReq *req,
     } else if (type & VIRTIO_BLK_T_OUT) {
         qemu_iovec_init_external(&req->qiov, &req->elem.out_sg[1],
                                  req->elem.out_num - 1);
+#ifdef MARSS_QEMU
+        req->done_cycle = storage_io_submit(1, req->qiov.size);
+#endif
         virtio_blk_handle_write(req, mrb);
     } else {
         qemu_iovec_init_external(&req->qiov, &req->elem.in_sg[0],
                                  req->elem.in_num - 1);
+#ifdef MARSS_QEMU
+        req->done_cycle = storage_io_submit(0, req->qiov.size);
+#endif
         virtio_blk_handle_read(req);
     }
 }
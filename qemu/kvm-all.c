@@ -28,6 +28,11 @@
 #include "kvm.h"
 #include "bswap.h"
 
+#ifdef MARSS_QEMU
+#include "exec-all.h"
+#include "qemu-timer.h"
+#endif
+
 /* This check must be after config-host.h is included */
 #ifdef CONFIG_EVENTFD
 #include <sys/eventfd.h>
@@ -888,6 +893,37 @@ void kvm_cpu_synchronize_post_init(CPUState *env)
     env->kvm_vcpu_dirty = 0;
 }
 
+#ifdef MARSS_QEMU
+/*
+ * Leave KVM for good when simulation starts: pull every vcpu's state out
+ * of the kernel and continue under TCG, whose CPUState is what PTLsim's
+ * Contexts run on. The guest TSC kept counting in KVM, move QEMU's ticks
+ * up to it so rdtsc doesn't go back. Events still waiting for injection
+ * are not carried over, ptlcalls leave KVM on an MMIO write where there
+ * are none.
+ */
+void kvm_handoff_to_tcg(void)
+{
+    CPUState *env;
+    int64_t tsc = 0;
+
+    if (!kvm_enabled()) {
+        return;
+    }
+
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        kvm_cpu_synchronize_state(env);
+        if (env->tsc > tsc) {
+            tsc = env->tsc;
+        }
+        tlb_flush(env, 1);
+    }
+
+    kvm_allowed = 0;
+    cpu_advance_ticks(tsc);
+}
+#endif
+
 int kvm_cpu_exec(CPUState *env)
 {
     struct kvm_run *run = env->kvm_run;
@@ -151,3 +151,9 @@ int kvm_on_sigbus(int code, void *addr)
 {
     return 1;
 }
+
+#ifdef MARSS_QEMU
+void kvm_handoff_to_tcg(void)
+{
+}
+#endif
@@ -52,6 +52,10 @@ int kvm_has_xsave(void);
 int kvm_has_xcrs(void);
 int kvm_has_many_ioeventfds(void);
 
+#ifdef MARSS_QEMU
+void kvm_handoff_to_tcg(void);
+#endif
+
 #ifdef NEED_CPU_H
 int kvm_init_vcpu(CPUState *env);
 
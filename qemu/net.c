@@ -30,6 +30,9 @@
 #include "net/dump.h"
 #include "net/slirp.h"
 #include "net/vde.h"
+#ifdef MARSS_QEMU
+#include "net/marss.h"
+#endif
 #include "net/util.h"
 #include "monitor.h"
 #include "sysemu.h"
@@ -1103,6 +1106,15 @@ static const struct {
             },
             { /* end of list */ }
         },
+#ifdef MARSS_QEMU
+    }, {
+        .type = "marss",
+        .init = net_init_marss,
+        .desc = {
+            NET_COMMON_PARAMS_DESC,
+            { /* end of list */ }
+        },
+#endif
     },
     { /* end of list */ }
 };
@@ -1190,6 +1202,9 @@ static int net_host_check_device(const char *device)
 {
     int i;
     const char *valid_param_list[] = { "tap", "socket", "dump"
+#ifdef MARSS_QEMU
+                                       ,"marss"
+#endif
 #ifdef CONFIG_SLIRP
                                        ,"user"
 #endif
@@ -0,0 +1,92 @@
+/*
+ * MARSSx86 : A Full System Computer-Architecture Simulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * '-net marss': connects the VLAN to the other nodes of a MARSS cluster
+ * ('-cluster-hosts' simulation option). Frames sent on the VLAN go to the
+ * cluster node, which times them in simulation, and frames from the other
+ * nodes are sent on the VLAN when they are delivered.
+ */
+
+#include "net/marss.h"
+
+#include "qemu-char.h"
+#include "qemu-common.h"
+
+#include <ptl-qemu.h>
+
+typedef struct MarssNetState {
+    VLANClientState nc;
+} MarssNetState;
+
+static ssize_t marss_receive(VLANClientState *nc, const uint8_t *buf,
+                             size_t size)
+{
+    ptl_cluster_send(buf, size);
+    return size;
+}
+
+static void marss_deliver(void *opaque, const uint8_t *buf, int size)
+{
+    MarssNetState *s = opaque;
+
+    qemu_send_packet(&s->nc, buf, size);
+}
+
+static void marss_poll(void *opaque)
+{
+    ptl_cluster_poll();
+}
+
+static void marss_watch(void *opaque, int fd)
+{
+    qemu_set_fd_handler(fd, marss_poll, NULL, opaque);
+}
+
+static void marss_cleanup(VLANClientState *nc)
+{
+    ptl_cluster_attach(NULL, NULL, NULL);
+}
+
+static NetClientInfo net_marss_info = {
+    .type = NET_CLIENT_TYPE_MARSS,
+    .size = sizeof(MarssNetState),
+    .receive = marss_receive,
+    .cleanup = marss_cleanup,
+};
+
+int net_init_marss(QemuOpts *opts, Monitor *mon, const char *name,
+                   VLANState *vlan)
+{
+    VLANClientState *nc;
+
+    assert(vlan);
+
+    nc = qemu_new_net_client(&net_marss_info, vlan, NULL, "marss", name);
+
+    snprintf(nc->info_str, sizeof(nc->info_str), "marss cluster node");
+
+    ptl_cluster_attach(marss_deliver, marss_watch,
+                       DO_UPCAST(MarssNetState, nc, nc));
+
+    return 0;
+}
@@ -90,7 +90,7 @@ int64_t cpu_get_ticks(void)
 {
 #ifdef MARSS_QEMU
     if(in_simulation) {
-        return timers_state.cpu_sim_ticks_offset + sim_cycle;
+        return timers_state.cpu_sim_ticks_offset + get_sim_guest_cycle();
     }
 #endif
     if (use_icount) {
@@ -178,11 +178,22 @@ void cpu_set_sim_ticks(void)
     }
 }
 
+/* Move cpu_get_ticks() forward to 'ticks', never back */
+void cpu_advance_ticks(int64_t ticks)
+{
+    int64_t now = cpu_get_ticks();
+
+    if (ticks > now) {
+        timers_state.cpu_ticks_offset += ticks - now;
+    }
+}
+
 static int64_t cpu_get_sim_clock(void)
 {
     int64_t sim_clock_t;
     sim_clock_t = timers_state.cpu_sim_clock_offset +
-        (int64_t)((float)(sim_cycle) * freq_to_ns(get_sim_cpu_freq()));
+        (int64_t)((float)(get_sim_guest_cycle()) *
+                  freq_to_ns(get_sim_cpu_freq()));
     return sim_clock_t;
 }
 
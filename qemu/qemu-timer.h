@@ -131,6 +131,7 @@ int64_t cpu_get_icount(void);
 
 #ifdef MARSS_QEMU
 void cpu_set_sim_ticks(void);
+void cpu_advance_ticks(int64_t ticks);
 #endif
 
 /*******************************************/
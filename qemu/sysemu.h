@@ -67,6 +67,13 @@ int load_vmstate(const char *name);
 void do_delvm(Monitor *mon, const QDict *qdict);
 void do_info_snapshots(Monitor *mon);
 
+#ifdef MARSS_QEMU
+/* savevm writes guest RAM to mmap-able files with this prefix if set */
+extern const char *ram_file_prefix;
+/* and then stores each distinct page once in this shared page store */
+extern const char *ram_page_store;
+#endif
+
 void cpu_synchronize_all_states(void);
 void cpu_synchronize_all_post_reset(void);
 void cpu_synchronize_all_post_init(void);
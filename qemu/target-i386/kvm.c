@@ -30,6 +30,10 @@
 #include "ioport.h"
 #include "kvm_x86.h"
 
+#ifdef MARSS_QEMU
+#include <ptl-qemu.h>
+#endif
+
 #ifdef CONFIG_KVM_PARA
 #include <linux/kvm_para.h>
 #endif
@@ -330,6 +334,21 @@ int kvm_arch_init_vcpu(CPUState *env)
 
     cpuid_i = 0;
 
+#ifdef MARSS_QEMU
+    /*
+     * Simulation takes the guest from KVM to TCG, where kvmclock and the
+     * other paravirt MSRs are not kept up to date, so don't offer any.
+     */
+    env->cpuid_kvm_features = 0;
+
+    /* Let the guest find the ptlcall interface under KVM too */
+    c = &cpuid_data.entries[cpuid_i++];
+    memset(c, 0, sizeof(*c));
+    c->function = PTLSIM_CPUID_MAGIC;
+    cpu_x86_cpuid(env, PTLSIM_CPUID_MAGIC, 0, &c->eax, &c->ebx, &c->ecx,
+                  &c->edx);
+#endif
+
 #ifdef CONFIG_KVM_PARA
     /* Paravirtualization CPUIDs */
     memcpy(signature, "KVMKVMKVM\0\0\0", 12);
@@ -3012,11 +3012,29 @@ void helper_rdtscp(void)
 
 void helper_rdpmc(void)
 {
-    if ((env->cr[4] & CR4_PCE_MASK) && ((env->hflags & HF_CPL_MASK) != 0)) {
+#ifdef MARSS_QEMU
+    uint64_t val;
+    int ret;
+#endif
+
+    if (!(env->cr[4] & CR4_PCE_MASK) && ((env->hflags & HF_CPL_MASK) != 0)) {
         raise_exception(EXCP0D_GPF);
     }
     helper_svm_check_intercept_param(SVM_EXIT_RDPMC, 0);
-    
+
+#ifdef MARSS_QEMU
+    /* Counters of the simulated machine with -guest-pmu */
+    ret = ptl_pmu_rdpmc(env->cpu_index, (uint32_t)ECX, &val);
+    if (ret > 0) {
+        EAX = (uint32_t)(val);
+        EDX = (uint32_t)(val >> 32);
+        return;
+    }
+    if (ret == 0) {
+        raise_exception(EXCP0D_GPF);
+    }
+#endif
+
     /* currently unimplemented */
     raise_exception_err(EXCP06_ILLOP, 0);
 }
@@ -3038,6 +3056,11 @@ void helper_wrmsr(void)
 
     val = ((uint32_t)EAX) | ((uint64_t)((uint32_t)EDX) << 32);
 
+#ifdef MARSS_QEMU
+    if (ptl_pmu_wrmsr(env->cpu_index, (uint32_t)ECX, val))
+        return;
+#endif
+
     switch((uint32_t)ECX) {
     case MSR_IA32_SYSENTER_CS:
         env->sysenter_cs = val & 0xffff;
@@ -3171,6 +3194,14 @@ void helper_rdmsr(void)
 
     helper_svm_check_intercept_param(SVM_EXIT_MSR, 0);
 
+#ifdef MARSS_QEMU
+    if (ptl_pmu_rdmsr(env->cpu_index, (uint32_t)ECX, &val)) {
+        EAX = (uint32_t)(val);
+        EDX = (uint32_t)(val >> 32);
+        return;
+    }
+#endif
+
     switch((uint32_t)ECX) {
     case MSR_IA32_SYSENTER_CS:
         val = env->sysenter_cs;
@@ -7729,14 +7729,19 @@ static void gen_simpoint_check_start(CPUState *env, DisasContext *dc)
 
         TCGv_i64 count;
 
+        /*
+         * Store the new count before the branch so that 'count' can be a
+         * plain temp, a local temp would be spilled and reloaded in every
+         * TB. When the count goes negative cpu_exec adds tb->icount back.
+         */
         simpoint_count_label = gen_new_label();
-        count = tcg_temp_local_new_i64();
+        count = tcg_temp_new_i64();
         tcg_gen_ld_i64(count, cpu_env, offsetof(CPUX86State, simpoint_decr));
         simpoint_arg = gen_opparam_ptr + 1;
         tcg_gen_subi_i64(count, count, 0xdeadbeef);
+        tcg_gen_st_i64(count, cpu_env, offsetof(CPUState, simpoint_decr));
 
         tcg_gen_brcondi_i64(TCG_COND_LT, count, 0, simpoint_count_label);
-        tcg_gen_st_i64(count, cpu_env, offsetof(CPUState, simpoint_decr));
         tcg_temp_free_i64(count);
     }
 }
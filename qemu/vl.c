@@ -1430,6 +1430,7 @@ static void main_loop(void)
             ptl_check_ptlcall_queue();
 
             if (start_simulation) {
+                kvm_handoff_to_tcg();
                 cpu_set_sim_ticks();
                 in_simulation = 1;
                 start_simulation = 0;
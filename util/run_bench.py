@@ -45,7 +45,42 @@ def get_list_from_conf(value):
                 ret.append(j.strip())
     return ret
 
+def get_simpoint_checkpoints(conf, suite):
+    # Simpoint suites list the simpoint and weights files generated by
+    # SimPoint tool instead of checkpoints. Checkpoints of all simpoints are
+    # created in one run of 'simconfig -simpoint' and are named
+    # '<simpoint_chk_name>_sp_<label>'.
+    sp_file = conf.get(suite, 'simpoints')
+    if not os.path.exists(sp_file):
+        print("Simpoint file (%s) doesn't exists." % sp_file)
+        exit(-1)
+
+    if not conf.has_option(suite, 'weights'):
+        print("Please specify simpoint weights in section '%s'." % suite)
+        exit(-1)
+
+    weights = conf.get(suite, 'weights')
+    if not os.path.exists(weights):
+        print("Simpoint weights file (%s) doesn't exists." % weights)
+        exit(-1)
+
+    if conf.has_option(suite, 'simpoint_chk_name'):
+        pfx = conf.get(suite, 'simpoint_chk_name')
+    else:
+        pfx = suite.split(' ', 1)[1]
+
+    check_list = []
+    with open(sp_file, 'r') as sp_f:
+        for line in sp_f.readlines():
+            sp = line.split()
+            if len(sp) != 2:
+                continue
+            check_list.append("%s_sp_%d" % (pfx, int(sp[1])))
+
+    return pfx, check_list
+
 vnc_inc = 0
+sp_merges = []
 
 def get_run_configs(run_name, options, conf_parser):
     global vnc_inc
@@ -104,13 +139,16 @@ def get_run_configs(run_name, options, conf_parser):
         print("Unable to find section '%s' in your configuration." % suite)
         exit(-1)
 
-    if not conf_parser.has_option(suite, 'checkpoints'):
+    sp_pfx = None
+    if conf_parser.has_option(suite, 'simpoints'):
+        sp_pfx, check_list = get_simpoint_checkpoints(conf_parser, suite)
+    elif conf_parser.has_option(suite, 'checkpoints'):
+        check_list = conf_parser.get(suite, 'checkpoints')
+        check_list = get_list_from_conf(check_list)
+    else:
         print("Please specify checkpoints in section '%s'." % suite)
         exit(-1)
 
-    check_list = conf_parser.get(suite, 'checkpoints')
-    check_list = get_list_from_conf(check_list)
-
     # Filter checkpoint list from user specified ones
     if options.chk_names != "":
         check_sel = options.chk_names.split(',')
@@ -162,6 +200,17 @@ def get_run_configs(run_name, options, conf_parser):
         if not os.path.exists(output_dir):
             os.makedirs(output_dir)
 
+    # Stats of all simpoints of a suite are merged into one file per output
+    # directory once all runs are completed
+    if sp_pfx:
+        weights = conf_parser.get(suite, 'weights')
+        for o_dir in output_dirs:
+            sp_merges.append({ 'prefix' : sp_pfx,
+                'weights' : weights,
+                'out_dir' : o_dir,
+                'checkpoints' : check_list,
+                })
+
     # For each checkpoint create a run_config dict and add to list
     img_idx = 0
     for o_dir, check_pt in itertools.product(output_dirs, check_list):
@@ -178,6 +227,7 @@ def get_run_configs(run_name, options, conf_parser):
                 'vm_memory' : vm_memory,
                 'vnc_counter' : vnc_t,
                 'out_dir' : o_dir,
+                'simpoint' : sp_pfx != None,
                 }
         run_cfgs.append(run_cfg)
         img_idx += 1
@@ -252,6 +302,15 @@ def get_log_file(simconfig):
             if "-logfile" in param:
                 return params[params.index(param)+1]
 
+def get_stats_file(simconfig):
+    stats_file = None
+    for line in simconfig.split('\n'):
+        params = line.split()
+        for param in params:
+            if param in ["-stats", "-yamlstats"]:
+                stats_file = params[params.index(param)+1]
+    return stats_file
+
 # Thread class that will store the output on the serial port of qemu to file
 class SerialOut(Thread):
 
@@ -342,6 +401,12 @@ class RunSim(Thread):
             config_args['out_dir'] = os.path.realpath(run_cfg['out_dir'])
             config_args['bench'] = checkpoint
             t_simconfig = gen_simconfig(config_args, run_cfg['simcfg'])
+
+            # Simpoint stats are merged based on their checkpoint tag
+            if run_cfg['simpoint']:
+                t_simconfig += "\n-tags %s" % checkpoint
+            run_cfg['stats_file'] = get_stats_file(t_simconfig)
+
             log_file = get_log_file(t_simconfig)
             sim_file_cmd_name = log_file.replace(".log", ".simcfg")
             sim_file_cmd = open(sim_file_cmd_name, "w")
@@ -419,6 +484,27 @@ print("All Threads are started")
 for th in threads:
     th.join()
 
+# Merge the stats of simpoint runs using their weights
+mstats = "%s/mstats.py" % os.path.dirname(os.path.realpath(__file__))
+
+for sp in sp_merges:
+    stats_files = [ r['stats_file'] for r in run_configs
+            if r['out_dir'] == sp['out_dir'] and r['simpoint'] and
+            r['checkpoint'] in sp['checkpoints'] and r.get('stats_file') and
+            os.path.exists(r['stats_file']) ]
+
+    if len(stats_files) == 0:
+        print("No stats found for simpoints of %s" % sp['prefix'])
+        continue
+
+    merge_file = "%s%s_sp_merged.yml" % (sp['out_dir'], sp['prefix'])
+    print("Merging %d simpoint stats into %s" % (len(stats_files), merge_file))
+
+    with open(merge_file, 'w') as merge_out:
+        subprocess.call([mstats, "-y", "--yaml-out",
+            "--sp-weights", sp['weights'], "--sp-pfx", sp['prefix']] +
+            stats_files, stdout=merge_out)
+
 # Send email to notify run completion
 if options.email:
     email_script = "%s/send_gmail.py" % os.path.dirname(os.path.realpath(__file__))
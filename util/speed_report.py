@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+
+# speed_report.py
+#
+# Report simulation speed of '-stats' YAML files written by the 'speed'
+# runs of util.cfg.example (or any run with '-host-profile'): KIPS, host
+# cycles per simulated cycle and where host time went in the run loop.
+#
+#   util/speed_report.py out/*.yml
+#   util/speed_report.py --baseline old_out --threshold 5 new_out || echo slow
+#
+# Directories are read for all their '.yml' files. With --baseline, files
+# are matched by name and the script exits with 1 if KIPS of any of them
+# dropped by more than --threshold percent.
+#
+# This script is provided under LGPL licence.
+
+import os
+import sys
+from optparse import OptionParser
+
+try:
+    import yaml
+except (ImportError, NotImplementedError):
+    path = os.path.dirname(sys.argv[0])
+    a_path = os.path.abspath(path)
+    sys.path.append("%s/../ptlsim/lib/python" % a_path)
+    import yaml
+
+try:
+    from yaml import CLoader as Loader
+except:
+    from yaml import Loader
+
+PROFILE_PARTS = ["cores", "memory", "events", "io", "qemu", "stats", "other"]
+
+def total_doc(path):
+    """Return the 'total' stats document of a YAML stats file"""
+    with open(path, 'r') as f:
+        docs = [doc for doc in yaml.load_all(f, Loader=Loader) if doc]
+    for doc in docs:
+        tags = doc.get('simulator', {}).get('tags', [])
+        if 'total' in tags:
+            return doc
+    return docs[-1] if docs else None
+
+def speed(path):
+    """(kips, host cycles per cycle, {part: percent}) of one stats file"""
+    doc = total_doc(path)
+    if doc is None:
+        return None
+    sim = doc.get('simulator', {})
+    perf = sim.get('performance', {})
+    profile = {}
+    ticks = sim.get('host_profile', {}).get('ticks')
+    if isinstance(ticks, dict):
+        total = float(sum(ticks.values()))
+        for part in PROFILE_PARTS:
+            if total:
+                profile[part] = ticks.get(part, 0) * 100.0 / total
+    return (float(perf.get('kips', 0)),
+            float(perf.get('host_cycles_per_cycle', 0)), profile)
+
+def collect(args):
+    """Map of file name to its speed, for files and directories in args"""
+    files = []
+    for arg in args:
+        if os.path.isdir(arg):
+            files += [os.path.join(arg, f) for f in sorted(os.listdir(arg))
+                    if f.endswith('.yml')]
+        else:
+            files.append(arg)
+
+    results = {}
+    for f in files:
+        s = speed(f)
+        if s:
+            results[os.path.basename(f)] = s
+    return results
+
+def main():
+    parser = OptionParser(usage="%prog [options] stats-files-or-dirs")
+    parser.add_option("--baseline", default=None,
+            help="stats file or directory of the build to compare against")
+    parser.add_option("--threshold", type="float", default=5.0,
+            help="percent KIPS drop reported as a regression")
+    (options, args) = parser.parse_args()
+    if not args:
+        parser.error("need stats files")
+
+    new = collect(args)
+    old = collect([options.baseline]) if options.baseline else {}
+    regressed = False
+
+    header = "%-32s %10s %10s" % ("stats", "KIPS", "host/cyc")
+    if old:
+        header += " %10s %8s" % ("base KIPS", "change")
+    header += "  " + " ".join(["%6s" % p for p in PROFILE_PARTS])
+    sys.stdout.write(header + "\n")
+
+    for name in sorted(new):
+        kips, per_cycle, profile = new[name]
+        line = "%-32s %10.1f %10.1f" % (name, kips, per_cycle)
+        mark = ""
+        if old:
+            if name in old and old[name][0]:
+                change = (kips - old[name][0]) * 100.0 / old[name][0]
+                line += " %10.1f %+7.1f%%" % (old[name][0], change)
+                if -change > options.threshold:
+                    mark = "  REGRESSION"
+                    regressed = True
+            else:
+                line += " %10s %8s" % ("-", "")
+        line += "  " + " ".join(["%5.1f%%" % profile[p] if p in profile
+            else "%6s" % "-" for p in PROFILE_PARTS])
+        sys.stdout.write(line + mark + "\n")
+
+    sys.exit(1 if regressed else 0)
+
+if __name__ == "__main__":
+    main()